@@ -1,7 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
-#include <sys/time.h>
 
 extern "C" {
   #include "bilateral_grid.h"
@@ -9,6 +8,7 @@ extern "C" {
 
 #include <static_image.h>
 #include <image_io.h>
+#include <benchmark.h>
 
 int main(int argc, char **argv) {
 
@@ -25,21 +25,12 @@ int main(int argc, char **argv) {
 
 #if 1
     // Timing code
-    timeval t1, t2;
-    double min_t = 1e10f;
-    for (int j = 0; j < 10; j++) {
-        gettimeofday(&t1, NULL);
-        for (int i = 0; i < 10; i++) {
-            bilateral_grid(atof(argv[3]), input, output);
-        }
-        gettimeofday(&t2, NULL);
-        double t = (t2.tv_sec - t1.tv_sec)*1000.0 + (t2.tv_usec - t1.tv_usec)/1000.0;
-        if (t < min_t) {
-            min_t = t;
-        }
+    Benchmark b("bilateral_grid");
+    while (b.running()) {
+        bilateral_grid(atof(argv[3]), input, output);
     }
 
-    printf("Time: %fms\n", min_t/10);
+    printf("Time: %fms\n", b.min());
 #endif
 
     save(output, argv[2]);
@@ -1,18 +1,19 @@
 #include <emmintrin.h>
 #include <math.h>
-#include <sys/time.h>
 #include <stdint.h>
 #include <stdio.h>
 
 #include "static_image.h"
+#include "benchmark.h"
 
 //#define cimg_display 0
 //#include "CImg.h"
 //using namespace cimg_library;
 
-timeval t1, t2;
-#define begin_timing gettimeofday(&t1, NULL); for (int i = 0; i < 10; i++) {
-#define end_timing } gettimeofday(&t2, NULL);
+// The median time in ms of the last block timed.
+double last_time;
+#define begin_timing(name) {Benchmark b_(name); while (b_.running()) {
+#define end_timing } last_time = b_.median();}
 
 // typedef CImg<uint16_t> Image;
 
@@ -20,7 +21,7 @@ Image<uint16_t> blur(Image<uint16_t> in) {
     Image<uint16_t> tmp(in.width()-8, in.height());
     Image<uint16_t> out(in.width()-8, in.height()-2);
 
-    begin_timing;
+    begin_timing("blur_naive");
 
     for (int y = 0; y < tmp.height(); y++)
         for (int x = 0; x < tmp.width(); x++)
@@ -38,7 +39,7 @@ Image<uint16_t> blur(Image<uint16_t> in) {
 
 Image<uint16_t> blur_fast(Image<uint16_t> in) {
     Image<uint16_t> out(in.width()-8, in.height()-2);
-    begin_timing;
+    begin_timing("blur_fast");
     __m128i one_third = _mm_set1_epi16(21846);
 #pragma omp parallel for
     for (int yTile = 0; yTile < out.height(); yTile += 32) {
@@ -120,7 +121,7 @@ Image<uint16_t> blur_fast(Image<uint16_t> in) {
 Image<uint16_t> blur_fast2(const Image<uint16_t> &in) {
     Image<uint16_t> out(in.width()-8, in.height()-2);
 
-    begin_timing;
+    begin_timing("blur_fast2");
 
     // multiplying by 21846 then taking the top 16 bits is equivalent to
     // dividing by three
@@ -183,7 +184,7 @@ Image<uint16_t> blur_halide(Image<uint16_t> in) {
     // Call it once to initialize the halide runtime stuff
     halide_blur(in, out);
 
-    begin_timing;
+    begin_timing("blur_halide");
 
     // Compute the same region of the output as blur_fast (i.e., we're
     // still being sloppy with boundary conditions)
@@ -205,16 +206,16 @@ int main(int argc, char **argv) {
     }
 
     Image<uint16_t> blurry = blur(input);
-    float slow_time = (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec) / 1000000.0f;
+    double slow_time = last_time;
 
     Image<uint16_t> speedy = blur_fast(input);
-    float fast_time = (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec) / 1000000.0f;
+    double fast_time = last_time;
 
     //Image<uint16_t> speedy2 = blur_fast2(input);
-    //float fast_time2 = (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec) / 1000000.0f;
+    //double fast_time2 = last_time;
 
     Image<uint16_t> halide = blur_halide(input);
-    float halide_time = (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec) / 1000000.0f;
+    double halide_time = last_time;
 
     // fast_time2 is always slower than fast_time, so skip printing it
     printf("times: %f %f %f\n", slow_time, fast_time, halide_time);
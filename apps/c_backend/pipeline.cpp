@@ -20,6 +20,10 @@ int main(int argc, char **argv) {
 
     h.compute_root();
     f.compute_root();
+    // Vectorize and parallelize, to test the vector types and the
+    // parallel loops of the C backend.
+    f.vectorize(x, 8).parallel(y);
+    g.vectorize(x, 8).parallel(y);
     f.debug_to_file("f.tiff");
 
     std::vector<Argument> args;
@@ -3,14 +3,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
-#include <sys/time.h>
-#include <unistd.h>
 
 extern "C" {
   #include "curved.h"
 }
 #include <static_image.h>
 #include <image_io.h>
+#include <benchmark.h>
 
 #include "fcam/Demosaic.h"
 #include "fcam/Demosaic_ARM.h"
@@ -46,42 +45,26 @@ int main(int argc, char **argv) {
     float gamma = atof(argv[3]);
     float contrast = atof(argv[4]);
 
-    timeval t1, t2;
-    unsigned int bestT = 0xffffffff;
-    for (int i = 0; i < 5; i++) {
-        gettimeofday(&t1, NULL);
+    Benchmark b_halide("camera_pipe_halide");
+    while (b_halide.running()) {
         curved(color_temp, gamma, contrast,
                input, matrix_3200, matrix_7000, output);
-        gettimeofday(&t2, NULL);
-        unsigned int t = (t2.tv_sec - t1.tv_sec) * 1000000 + (t2.tv_usec - t1.tv_usec);
-        if (t < bestT) bestT = t;
-        if (i % 5 == 0) sleep(1);
     }
-    printf("Halide:\t%u\n", bestT);
+    printf("Halide:\t%u\n", (unsigned int)(b_halide.min() * 1000));
     save(output, argv[5]);
 
-    bestT = 0xffffffff;
-    for (int i = 0; i < 5; i++) {
-        gettimeofday(&t1, NULL);
+    Benchmark b_c("camera_pipe_c");
+    while (b_c.running()) {
         FCam::demosaic(input, output, color_temp, contrast, true, 25, gamma);
-        gettimeofday(&t2, NULL);
-        unsigned int t = (t2.tv_sec - t1.tv_sec) * 1000000 + (t2.tv_usec - t1.tv_usec);
-        if (t < bestT) bestT = t;
-        if (i % 5 == 0) sleep(1);
     }
-    printf("C++:\t%u\n", bestT);
+    printf("C++:\t%u\n", (unsigned int)(b_c.min() * 1000));
     save(output, "fcam_c.png");
 
-    bestT = 0xffffffff;
-    for (int i = 0; i < 5; i++) {
-        gettimeofday(&t1, NULL);
+    Benchmark b_arm("camera_pipe_arm");
+    while (b_arm.running()) {
         FCam::demosaic_ARM(input, output, color_temp, contrast, true, 25, gamma);
-        gettimeofday(&t2, NULL);
-        unsigned int t = (t2.tv_sec - t1.tv_sec) * 1000000 + (t2.tv_usec - t1.tv_usec);
-        if (t < bestT) bestT = t;
-        if (i % 5 == 0) sleep(1);
     }
-    printf("ASM:\t%u\n", bestT);
+    printf("ASM:\t%u\n", (unsigned int)(b_arm.min() * 1000));
     save(output, "fcam_arm.png");
 
     // Timings on N900 as of SIGGRAPH 2012 camera ready are (best of 10)
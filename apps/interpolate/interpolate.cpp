@@ -7,23 +7,10 @@ using namespace Halide;
 #include <iostream>
 #include <limits>
 
-#include <sys/time.h>
+#include <benchmark.h>
 
 using std::vector;
 
-double now() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    static bool first_call = true;
-    static time_t first_sec = 0;
-    if (first_call) {
-        first_call = false;
-        first_sec = tv.tv_sec;
-    }
-    assert(tv.tv_sec >= first_sec);
-    return (tv.tv_sec - first_sec) + (tv.tv_usec / 1000000.0);
-}
-
 int main(int argc, char **argv) {
     if (argc < 3) {
         std::cerr << "Usage:\n\t./interpolate in.png out.png\n" << std::endl;
@@ -182,20 +169,11 @@ int main(int argc, char **argv) {
     input.set(in_png);
 
     std::cout << "Running... " << std::endl;
-    double min = std::numeric_limits<double>::infinity();
-    const int iters = 20;
-
-    for (int x = 0; x < iters; ++x) {
-        double before = now();
+    Benchmark b("interpolate");
+    while (b.running()) {
         final.realize(out);
-        double after = now();
-        double amt = after - before;
-
-        std::cout << "   " << amt * 1000 << std::endl;
-        if (amt < min) min = amt;
-
     }
-    std::cout << " took " << min * 1000 << " msec." << std::endl;
+    std::cout << " took " << b.min() << " msec." << std::endl;
 
     vector<Argument> args;
     args.push_back(input);
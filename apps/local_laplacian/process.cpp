@@ -2,7 +2,7 @@
 #include "local_laplacian.h"
 #include "static_image.h"
 #include "image_io.h"
-#include <sys/time.h>
+#include "benchmark.h"
 
 int main(int argc, char **argv) {
     if (argc < 6) {
@@ -17,16 +17,11 @@ int main(int argc, char **argv) {
     Image<uint16_t> output(input.width(), input.height(), 3);
 
     // Timing code
-    timeval t1, t2;
-    unsigned int bestT = 0xffffffff;
-    for (int i = 0; i < 5; i++) {
-      gettimeofday(&t1, NULL);
+    Benchmark b("local_laplacian");
+    while (b.running()) {
       local_laplacian(levels, alpha/(levels-1), beta, input, output);
-      gettimeofday(&t2, NULL);
-      unsigned int t = (t2.tv_sec - t1.tv_sec) * 1000000 + (t2.tv_usec - t1.tv_usec);
-      if (t < bestT) bestT = t;
     }
-    printf("%u\n", bestT);
+    printf("%u\n", (unsigned int)(b.min() * 1000));
 
 
     local_laplacian(levels, alpha/(levels-1), beta, input, output);
@@ -6,7 +6,7 @@ Var x("x"), y("y"), c("c");
 
 int main(int argc, char **argv) {
 
-    bool can_vectorize = (get_target_from_environment().arch != Target::PNaCl);
+    Target target = get_target_from_environment();
 
     Expr random_bit = cast<uint8_t>(random_float() > 0.5f);
 
@@ -61,9 +61,7 @@ int main(int argc, char **argv) {
                                                  cast<uint8_t>(random_float() < 0.25f), 
                                                  output(clobber.x, clobber.y, c));
 
-        if (can_vectorize) {
-            output.vectorize(x, 4);
-        }
+        output.vectorize(x, target.natural_vector_size(UInt(8)));
 
         Var yi;
         output.split(y, y, yi, 16).reorder(x, yi, c, y).parallel(y);
@@ -81,9 +79,7 @@ int main(int argc, char **argv) {
         Expr b = select(state(x, y, 2) == 1, 255, 0);
         render(x, y) = (255 << 24) + (r << 16) + (g << 8) + b;
 
-        if (can_vectorize) {
-            render.vectorize(x, 4);
-        }
+        render.vectorize(x, target.natural_vector_size(Int(32)));
 
         Var yi;
         render.split(y, y, yi, 16).parallel(y);
@@ -7,20 +7,7 @@ using namespace Halide;
 #include <iostream>
 #include <limits>
 
-#include <sys/time.h>
-
-double now() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    static bool first_call = true;
-    static time_t first_sec = 0;
-    if (first_call) {
-        first_call = false;
-        first_sec = tv.tv_sec;
-    }
-    assert(tv.tv_sec >= first_sec);
-    return (tv.tv_sec - first_sec) + (tv.tv_usec / 1000000.0);
-}
+#include <benchmark.h>
 
 enum InterpolationType {
     BOX, LINEAR, CUBIC, LANCZOS
@@ -203,20 +190,11 @@ int main(int argc, char **argv) {
            out_width, out_height,
            kernelInfo[interpolationType].name);
 
-    double min = std::numeric_limits<double>::infinity();
-    const unsigned int iters = 20;
-
-    for (unsigned int x = 0; x < iters; ++x) {
-        double before = now();
+    Benchmark b("resize");
+    while (b.running()) {
         final.realize(out);
-        double after = now();
-        double amt = after - before;
-
-        std::cout << "   " << amt * 1000 << std::endl;
-        if (amt < min) min = amt;
-
     }
-    std::cout << " took " << min * 1000 << " msec." << std::endl;
+    std::cout << " took " << b.min() << " msec." << std::endl;
 
     save(out, outfile);
 }
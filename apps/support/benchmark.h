@@ -0,0 +1,337 @@
+#ifndef HALIDE_BENCHMARK_H
+#define HALIDE_BENCHMARK_H
+
+// A small benchmarking library for the performance tests and the
+// apps. Time something by running it in a loop:
+//
+//     Benchmark b("blur");
+//     while (b.running()) {
+//         blur.realize(output);
+//     }
+//     printf("%f ms\n", b.median());
+//
+// The loop first runs the body a few times to warm up, then runs it
+// in samples, each of enough iterations to last at least
+// HL_BENCH_SAMPLE_MS milliseconds (so that the clock's resolution
+// doesn't matter), until it has at least HL_BENCH_MIN_SAMPLES samples
+// and they add up to HL_BENCH_MIN_MS milliseconds, or it has
+// HL_BENCH_MAX_SAMPLES of them. The times reported are per iteration,
+// in milliseconds.
+//
+// When it is done, a summary is printed, and if HL_BENCH_JSON names a
+// file, a JSON object with the statistics and the state of the
+// machine is appended to it, one per line, so that a whole suite of
+// benchmarks can write to the same file. Set HL_BENCH_CPU to pin the
+// benchmarking thread to a cpu (linux only; threads in the Halide
+// thread pool aren't pinned). The cpu frequency can't be set from
+// here, but on linux the scaling governor and current frequency of
+// the cpu are recorded, and a warning is printed if the governor
+// might change the frequency during the run.
+//
+// Environment variables (defaults in brackets):
+//   HL_BENCH_WARMUP       iterations before timing starts [1]
+//   HL_BENCH_SAMPLE_MS    minimum length of one sample [1]
+//   HL_BENCH_MIN_SAMPLES  [7]
+//   HL_BENCH_MAX_SAMPLES  [1000]
+//   HL_BENCH_MIN_MS       minimum total time of the samples [100]
+//   HL_BENCH_CPU          cpu to pin to [not pinned]
+//   HL_BENCH_JSON         file to append results to [none]
+//
+// HL_TARGET is recorded in the JSON too, so that a suite run for
+// several targets can be told apart (see util/HalideBenchCompare.cpp).
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+extern "C" bool QueryPerformanceCounter(uint64_t *);
+extern "C" bool QueryPerformanceFrequency(uint64_t *);
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// The current time in milliseconds, from an arbitrary reference.
+inline double benchmark_now_ms() {
+#ifdef _WIN32
+    uint64_t t, freq;
+    QueryPerformanceCounter(&t);
+    QueryPerformanceFrequency(&freq);
+    return (t * 1000.0) / freq;
+#elif defined(CLOCK_MONOTONIC)
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+#else
+    timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec * 1000.0 + t.tv_usec / 1000.0;
+#endif
+}
+
+inline int benchmark_env_int(const char *name, int default_value) {
+    const char *s = getenv(name);
+    return s ? atoi(s) : default_value;
+}
+
+// Read the first line of a small file, without the newline. Returns
+// the empty string if there's no such file.
+inline std::string benchmark_read_line(const std::string &path) {
+    std::string result;
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f) return result;
+    char buf[256];
+    if (fgets(buf, sizeof(buf), f)) {
+        result = buf;
+        while (!result.empty() && (result[result.size() - 1] == '\n' ||
+                                   result[result.size() - 1] == '\r')) {
+            result.erase(result.size() - 1);
+        }
+    }
+    fclose(f);
+    return result;
+}
+
+// Escape a string for a JSON document.
+inline std::string benchmark_json_string(const std::string &s) {
+    std::string result = "\"";
+    for (size_t i = 0; i < s.size(); i++) {
+        char c = s[i];
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if ((unsigned char)c < ' ') {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            result += buf;
+        } else {
+            result += c;
+        }
+    }
+    return result + "\"";
+}
+
+// Append a line to the file named by HL_BENCH_JSON, if it is set.
+inline void benchmark_write_json(const std::string &line) {
+    const char *path = getenv("HL_BENCH_JSON");
+    if (!path || !*path) return;
+    FILE *f = fopen(path, "a");
+    if (!f) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return;
+    }
+    fprintf(f, "%s\n", line.c_str());
+    fclose(f);
+}
+
+// Record a number that isn't a time, e.g. the ratio of two
+// benchmarks, so that it can be tracked along with them.
+inline void benchmark_record(const std::string &name, double value) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.6g", value);
+    benchmark_write_json("{\"name\":" + benchmark_json_string(name) +
+                         ",\"value\":" + buf + "}");
+}
+
+class Benchmark {
+public:
+    explicit Benchmark(const std::string &name)
+        : name(name), state(NotStarted), pinned_cpu(-1),
+          warmup_left(0), batch(1), iterations(0),
+          sample_start(0), total_ms(0) {
+        warmup = std::max(0, benchmark_env_int("HL_BENCH_WARMUP", 1));
+        sample_ms = std::max(0, benchmark_env_int("HL_BENCH_SAMPLE_MS", 1));
+        min_samples = std::max(1, benchmark_env_int("HL_BENCH_MIN_SAMPLES", 7));
+        max_samples = std::max(min_samples, benchmark_env_int("HL_BENCH_MAX_SAMPLES", 1000));
+        min_ms = std::max(0, benchmark_env_int("HL_BENCH_MIN_MS", 100));
+    }
+
+    // Call before each iteration of the loop being timed. Returns
+    // false once there are enough samples.
+    bool running() {
+        double now = benchmark_now_ms();
+        switch (state) {
+        case NotStarted:
+            start();
+            if (warmup_left > 0) {
+                state = WarmingUp;
+                return true;
+            }
+            start_sample();
+            return true;
+        case WarmingUp:
+            if (--warmup_left > 0) return true;
+            start_sample();
+            return true;
+        case Sampling:
+            if (++iterations < batch) return true;
+            end_sample(now);
+            if ((int)samples.size() >= max_samples ||
+                ((int)samples.size() >= min_samples && total_ms >= min_ms)) {
+                finish();
+                return false;
+            }
+            start_sample();
+            return true;
+        case Done:
+            return false;
+        }
+        return false;
+    }
+
+    // Statistics over the samples, in milliseconds per iteration.
+    // @{
+    double min() const {return samples.empty() ? 0 : sorted[0];}
+    double max() const {return samples.empty() ? 0 : sorted[sorted.size() - 1];}
+    double median() const {return percentile(50);}
+    double percentile(double p) const {
+        if (sorted.empty()) return 0;
+        // Nearest rank.
+        int rank = (int)ceil(p / 100 * sorted.size()) - 1;
+        rank = std::max(0, std::min((int)sorted.size() - 1, rank));
+        return sorted[rank];
+    }
+    double mean() const {
+        double sum = 0;
+        for (size_t i = 0; i < samples.size(); i++) sum += samples[i];
+        return samples.empty() ? 0 : sum / samples.size();
+    }
+    double stddev() const {
+        if (samples.size() < 2) return 0;
+        double m = mean(), sum = 0;
+        for (size_t i = 0; i < samples.size(); i++) {
+            sum += (samples[i] - m) * (samples[i] - m);
+        }
+        return sqrt(sum / (samples.size() - 1));
+    }
+    // @}
+
+    int num_samples() const {return (int)samples.size();}
+    const std::string &get_name() const {return name;}
+
+private:
+    enum State {NotStarted, WarmingUp, Sampling, Done};
+
+    std::string name;
+    State state;
+    int warmup, sample_ms, min_samples, max_samples, min_ms;
+    int pinned_cpu;
+    int warmup_left;
+    // The iterations per sample, and in the current sample.
+    int batch, iterations;
+    double sample_start, total_ms;
+    std::vector<double> samples, sorted;
+    std::string governor, cpu_khz;
+
+    void start() {
+        warmup_left = warmup;
+        int cpu = benchmark_env_int("HL_BENCH_CPU", -1);
+#ifdef __linux__
+        if (cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            if (sched_setaffinity(0, sizeof(set), &set) == 0) {
+                pinned_cpu = cpu;
+            } else {
+                fprintf(stderr, "Could not pin %s to cpu %d\n", name.c_str(), cpu);
+            }
+        }
+        std::string dir = "/sys/devices/system/cpu/cpu" +
+            int_to_string(cpu >= 0 ? cpu : 0) + "/cpufreq/";
+        governor = benchmark_read_line(dir + "scaling_governor");
+        if (!governor.empty() && governor != "performance") {
+            fprintf(stderr, "Warning: the cpu frequency governor is %s, "
+                    "so %s may be timed at varying clock rates\n",
+                    governor.c_str(), name.c_str());
+        }
+#else
+        if (cpu >= 0) {
+            fprintf(stderr, "HL_BENCH_CPU is only supported on linux\n");
+        }
+#endif
+    }
+
+    void start_sample() {
+        state = Sampling;
+        iterations = 0;
+        sample_start = benchmark_now_ms();
+    }
+
+    void end_sample(double now) {
+        double elapsed = now - sample_start;
+        if (samples.empty() && elapsed < sample_ms && batch < (1 << 30)) {
+            // Too short to time well. Throw it away, and make the next
+            // one long enough.
+            double scale = elapsed > 0 ? 1.25 * sample_ms / elapsed : 10;
+            batch = (int)std::min((double)(1 << 30), std::max(2.0, scale) * batch);
+            return;
+        }
+        samples.push_back(elapsed / iterations);
+        total_ms += elapsed;
+    }
+
+    static std::string int_to_string(int x) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%d", x);
+        return buf;
+    }
+
+    static std::string number(double x) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.6g", x);
+        return buf;
+    }
+
+    void finish() {
+        state = Done;
+        sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+#ifdef __linux__
+        cpu_khz = benchmark_read_line("/sys/devices/system/cpu/cpu" +
+                                      int_to_string(pinned_cpu >= 0 ? pinned_cpu : 0) +
+                                      "/cpufreq/scaling_cur_freq");
+#endif
+
+        printf("%s: min %.4g ms, median %.4g ms, p90 %.4g ms, stddev %.2g ms "
+               "(%d samples of %d iterations)\n",
+               name.c_str(), min(), median(), percentile(90), stddev(),
+               num_samples(), batch);
+
+        std::string json = "{\"name\":" + benchmark_json_string(name) +
+            ",\"samples\":" + int_to_string(num_samples()) +
+            ",\"iterations_per_sample\":" + int_to_string(batch) +
+            ",\"min_ms\":" + number(min()) +
+            ",\"median_ms\":" + number(median()) +
+            ",\"mean_ms\":" + number(mean()) +
+            ",\"stddev_ms\":" + number(stddev()) +
+            ",\"p10_ms\":" + number(percentile(10)) +
+            ",\"p90_ms\":" + number(percentile(90)) +
+            ",\"p99_ms\":" + number(percentile(99)) +
+            ",\"max_ms\":" + number(max()) +
+            ",\"cpu\":" + int_to_string(pinned_cpu);
+        const char *target = getenv("HL_TARGET");
+        if (target && *target) {
+            json += ",\"target\":" + benchmark_json_string(target);
+        }
+        if (!governor.empty()) {
+            json += ",\"governor\":" + benchmark_json_string(governor);
+        }
+        if (!cpu_khz.empty()) {
+            json += ",\"cpu_khz\":" + number(atof(cpu_khz.c_str()));
+        }
+        json += "}";
+        benchmark_write_json(json);
+    }
+};
+
+#endif
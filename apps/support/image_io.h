@@ -1,5 +1,6 @@
 // This simple PNG IO library works with *both* the Halide::Image<T> type *and*
-// the simple static_image.h version. Also now includes PPM support for faster load/save.
+// the simple static_image.h version. Also now includes PPM support for faster load/save,
+// and a raw format (.raw) that loads without any decoding.
 // If you want the static_image.h version, to use in a program statically
 // linking against a Halide pipeline pre-compiled with Func::compile_to_file, you
 // need to explicitly #include static_image.h first.
@@ -12,6 +13,7 @@
 #include <stdio.h>
 #include <algorithm>
 #include <string.h>
+#include <limits>
 
 //#include <sys/time.h>
 
@@ -54,6 +56,56 @@ inline void convert(uint16_t in, float &out) {out = in/65535.0f;}
 inline void convert(uint16_t in, double &out) {out = in/65535.0f;}
 
 
+// Convert one row of interleaved 8- or 16-bit (big-endian) samples,
+// as stored in PNG files, into the rows of the channels of a planar
+// image c_stride elements apart. Each channel is a separate loop with
+// a constant stride, which compilers can vectorize.
+template<typename T>
+void convert_interleaved_row(const uint8_t *src, int bit_depth, int width, int channels,
+                             T *dst, int c_stride) {
+    for (int c = 0; c < channels; c++) {
+        T *out = dst + c*c_stride;
+        if (bit_depth == 8) {
+            const uint8_t *in = src + c;
+            for (int x = 0; x < width; x++) {
+                convert(in[x*channels], out[x]);
+            }
+        } else {
+            const uint8_t *in = src + c*2;
+            for (int x = 0; x < width; x++) {
+                uint16_t value = (in[x*channels*2] << 8) | in[x*channels*2 + 1];
+                convert(value, out[x]);
+            }
+        }
+    }
+}
+
+// The reverse of convert_interleaved_row.
+template<typename T>
+void convert_to_interleaved_row(const T *src, int c_stride, int width, int channels,
+                                int bit_depth, uint8_t *dst) {
+    for (int c = 0; c < channels; c++) {
+        const T *in = src + c*c_stride;
+        if (bit_depth == 8) {
+            uint8_t *out = dst + c;
+            for (int x = 0; x < width; x++) {
+                convert(in[x], out[x*channels]);
+            }
+        } else {
+            uint8_t *out = dst + c*2;
+            for (int x = 0; x < width; x++) {
+                uint16_t value;
+                convert(in[x], value);
+                out[x*channels*2] = value >> 8;
+                out[x*channels*2 + 1] = value & 0xff;
+            }
+        }
+    }
+}
+
+template<typename T> inline bool is_uint8() {return false;}
+template<> inline bool is_uint8<uint8_t>() {return true;}
+
 inline bool ends_with_ignore_case(std::string a, std::string b) {
     if (a.length() < b.length()) { return false; }
     std::transform(a.begin(), a.end(), a.begin(), ::tolower);
@@ -106,56 +158,50 @@ Image<T> load_png(std::string filename) {
         im = Image<T>(width, height);
     }
 
-    png_set_interlace_handling(png_ptr);
+    int passes = png_set_interlace_handling(png_ptr);
     png_read_update_info(png_ptr, info_ptr);
 
-    // read the file
-    _assert(!setjmp(png_jmpbuf(png_ptr)), "Error during read_image\n");
-
-    row_pointers = new png_bytep[im.height()];
-    for (int y = 0; y < im.height(); y++) {
-        row_pointers[y] = new png_byte[png_get_rowbytes(png_ptr, info_ptr)];
-    }
-
-    png_read_image(png_ptr, row_pointers);
-
-    fclose(f);
-
     _assert((bit_depth == 8) || (bit_depth == 16), "Can only handle 8-bit or 16-bit pngs\n");
 
-    // convert the data to T
+    // read the file
+    _assert(!setjmp(png_jmpbuf(png_ptr)), "Error during read_image\n");
 
     int c_stride = (im.channels() == 1) ? 0 : im.stride(2);
-    T *ptr = (T*)im.data();
-    if (bit_depth == 8) {
+    size_t row_bytes = png_get_rowbytes(png_ptr, info_ptr);
+    if (passes == 1) {
+        // Decode a row at a time, straight into the image if it has
+        // the same layout as the file, and otherwise into one scratch
+        // row that's converted into the image.
+        bool direct = is_uint8<T>() && bit_depth == 8 && channels == 1;
+        png_bytep row = direct ? NULL : new png_byte[row_bytes];
         for (int y = 0; y < im.height(); y++) {
-            uint8_t *srcPtr = (uint8_t *)(row_pointers[y]);
-            for (int x = 0; x < im.width(); x++) {
-                for (int c = 0; c < im.channels(); c++) {
-                    convert(*srcPtr++, ptr[c*c_stride]);
-                }
-                ptr++;
+            T *dst = (T *)im.data() + y*im.stride(1);
+            if (direct) {
+                png_read_row(png_ptr, (png_bytep)dst, NULL);
+            } else {
+                png_read_row(png_ptr, row, NULL);
+                convert_interleaved_row(row, bit_depth, im.width(), channels, dst, c_stride);
             }
         }
-    } else if (bit_depth == 16) {
+        delete[] row;
+    } else {
+        // Interlaced images need every row in memory until the last
+        // pass.
+        png_bytep data = new png_byte[row_bytes * im.height()];
+        row_pointers = new png_bytep[im.height()];
         for (int y = 0; y < im.height(); y++) {
-            uint8_t *srcPtr = (uint8_t *)(row_pointers[y]);
-            for (int x = 0; x < im.width(); x++) {
-                for (int c = 0; c < im.channels(); c++) {
-                    uint16_t hi = (*srcPtr++) << 8;
-                    uint16_t lo = hi | (*srcPtr++);
-                    convert(lo, ptr[c*c_stride]);
-                }
-                ptr++;
-            }
+            row_pointers[y] = data + y*row_bytes;
+        }
+        png_read_image(png_ptr, row_pointers);
+        for (int y = 0; y < im.height(); y++) {
+            convert_interleaved_row(row_pointers[y], bit_depth, im.width(), channels,
+                                    (T *)im.data() + y*im.stride(1), c_stride);
         }
+        delete[] row_pointers;
+        delete[] data;
     }
 
-    // clean up
-    for (int y = 0; y < im.height(); y++) {
-        delete[] row_pointers[y];
-    }
-    delete[] row_pointers;
+    fclose(f);
 
     png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 
@@ -167,7 +213,6 @@ template<typename T>
 void save_png(Image<T> im, std::string filename) {
     png_structp png_ptr;
     png_infop info_ptr;
-    png_bytep *row_pointers;
     png_byte color_type;
 
     im.copy_to_host();
@@ -209,58 +254,23 @@ void save_png(Image<T> im, std::string filename) {
 
     png_write_info(png_ptr, info_ptr);
 
-    row_pointers = new png_bytep[im.height()];
-
-    // im.copyToHost(); // in case the image is on the gpu
+    // write data a row at a time
+    _assert(!setjmp(png_jmpbuf(png_ptr)), "[write_png_file] Error during writing bytes");
 
     int c_stride = (im.channels() == 1) ? 0 : im.stride(2);
-    T *srcPtr = (T*)im.data();
-
+    png_bytep row = new png_byte[png_get_rowbytes(png_ptr, info_ptr)];
     for (int y = 0; y < im.height(); y++) {
-        row_pointers[y] = new png_byte[png_get_rowbytes(png_ptr, info_ptr)];
-        uint8_t *dstPtr = (uint8_t *)(row_pointers[y]);
-        if (bit_depth == 16) {
-            // convert to uint16_t
-            for (int x = 0; x < im.width(); x++) {
-                for (int c = 0; c < im.channels(); c++) {
-                    uint16_t out;
-                    convert(srcPtr[c*c_stride], out);
-                    *dstPtr++ = out >> 8;
-                    *dstPtr++ = out & 0xff;
-                }
-                srcPtr++;
-            }
-        } else if (bit_depth == 8) {
-            // convert to uint8_t
-            for (int x = 0; x < im.width(); x++) {
-                for (int c = 0; c < im.channels(); c++) {
-                    uint8_t out;
-                    convert(srcPtr[c*c_stride], out);
-                    *dstPtr++ = out;
-                }
-                srcPtr++;
-            }
-        } else {
-            _assert(bit_depth == 8 || bit_depth == 16, "We only support saving 8- and 16-bit images.");
-        }
+        const T *src = (const T *)im.data() + y*im.stride(1);
+        convert_to_interleaved_row(src, c_stride, im.width(), im.channels(), bit_depth, row);
+        png_write_row(png_ptr, row);
     }
-
-    // write data
-    _assert(!setjmp(png_jmpbuf(png_ptr)), "[write_png_file] Error during writing bytes");
-
-    png_write_image(png_ptr, row_pointers);
+    delete[] row;
 
     // finish write
     _assert(!setjmp(png_jmpbuf(png_ptr)), "[write_png_file] Error during end of write");
 
     png_write_end(png_ptr, NULL);
 
-    // clean up
-    for (int y = 0; y < im.height(); y++) {
-        delete[] row_pointers[y];
-    }
-    delete[] row_pointers;
-
     fclose(f);
 
     png_destroy_write_struct(&png_ptr, &info_ptr);
@@ -299,41 +309,17 @@ Image<T> load_ppm(std::string filename) {
     int channels = 3;
     Image<T> im(width, height, channels);
 
-    // convert the data to T
-    if (bit_depth == 8) {
-        uint8_t *data = new uint8_t[width*height*3];
-        _assert(fread((void *) data,
-                      sizeof(uint8_t), width*height*3, f) == (size_t) (width*height*3),
-                "Could not read PPM 8-bit data\n");
-        fclose(f);
-
-        T *im_data = (T*) im.data();
-        for (int y = 0; y < im.height(); y++) {
-            uint8_t *row = (uint8_t *)(&data[(y*width)*3]);
-            for (int x = 0; x < im.width(); x++) {
-                convert(*row++, im_data[(0*height+y)*width+x]);
-                convert(*row++, im_data[(1*height+y)*width+x]);
-                convert(*row++, im_data[(2*height+y)*width+x]);
-            }
-        }
-        delete[] data;
-    } else if (bit_depth == 16) {
-        int little_endian = is_little_endian();
-        uint16_t *data = new uint16_t[width*height*3];
-        _assert(fread((void *) data, sizeof(uint16_t), width*height*3, f) == (size_t) (width*height*3), "Could not read PPM 16-bit data\n");
-        fclose(f);
-        T *im_data = (T*) im.data();
-        for (int y = 0; y < im.height(); y++) {
-            uint16_t *row = (uint16_t *) (&data[(y*width)*3]);
-            for (int x = 0; x < im.width(); x++) {
-                uint16_t value;
-                value = *row++; SWAP_ENDIAN16(little_endian, value); convert(value, im_data[(0*height+y)*width+x]);
-                value = *row++; SWAP_ENDIAN16(little_endian, value); convert(value, im_data[(1*height+y)*width+x]);
-                value = *row++; SWAP_ENDIAN16(little_endian, value); convert(value, im_data[(2*height+y)*width+x]);
-            }
-        }
-        delete[] data;
+    // read and convert the data to T a row at a time (16-bit PPM
+    // samples are big-endian, like PNG ones)
+    int c_stride = im.stride(2);
+    uint8_t *row = new uint8_t[width*3*(bit_depth/8)];
+    for (int y = 0; y < im.height(); y++) {
+        _assert(fread((void *) row, bit_depth/8, width*3, f) == (size_t) (width*3),
+                "Could not read PPM data\n");
+        convert_interleaved_row(row, bit_depth, width, 3, (T *)im.data() + y*im.stride(1), c_stride);
     }
+    delete[] row;
+    fclose(f);
     im(0,0,0) = im(0,0,0);      /* Mark dirty inside read/write functions. */
 
     return im;
@@ -343,39 +329,101 @@ template<typename T>
 void save_ppm(Image<T> im, std::string filename) {
 	unsigned int bit_depth = sizeof(T) == 1 ? 8: 16;
 
+    im.copy_to_host();
+
     FILE *f = fopen(filename.c_str(), "wb");
     _assert(f, "File %s could not be opened for writing\n", filename.c_str());
     fprintf(f, "P6\n%d %d\n%d\n", im.width(), im.height(), (1<<bit_depth)-1);
-    int width = im.width(), height = im.height();
+    _assert(im.channels() == 3, "PPM files have three channels\n");
 
-    if (bit_depth == 8) {
-        uint8_t *data = new uint8_t[width*height*3];
-        for (int y = 0; y < im.height(); y++) {
-            for (int x = 0; x < im.width(); x++) {
-                uint8_t *p = (uint8_t *)(&data[(y*width+x)*3]);
-                for (int c = 0; c < im.channels(); c++) {
-                    convert(im(x, y, c), p[c]);
-                }
-            }
-        }
-        _assert(fwrite((void *) data, sizeof(uint8_t), width*height*3, f) == (size_t) (width*height*3), "Could not write PPM 8-bit data\n");
-        delete[] data;
-    } else if (bit_depth == 16) {
-        int little_endian = is_little_endian();
-        uint16_t *data = new uint16_t[width*height*3];
-        for (int y = 0; y < im.height(); y++) {
-            for (int x = 0; x < im.width(); x++) {
-                uint16_t *p = (uint16_t *)(&data[(y*width+x)*3]);
-                for (int c = 0; c < im.channels(); c++) {
-                    uint16_t value;
-                    convert(im(x, y, c), value);
-                    SWAP_ENDIAN16(little_endian, value);
-                    p[c] = value;
-                }
-            }
+    // convert and write the data a row at a time
+    int width = im.width();
+    uint8_t *row = new uint8_t[width*3*(bit_depth/8)];
+    for (int y = 0; y < im.height(); y++) {
+        convert_to_interleaved_row((const T *)im.data() + y*im.stride(1), im.stride(2), width, 3, bit_depth, row);
+        _assert(fwrite((void *) row, bit_depth/8, width*3, f) == (size_t) (width*3), "Could not write PPM data\n");
+    }
+    delete[] row;
+    fclose(f);
+}
+
+// A simple uncompressed format for images of any type and up to four
+// dimensions: this header, followed by the elements in native byte
+// order, x fastest, then y, then the channels, then w.
+struct RawImageHeader {
+    char magic[4];         // "HRAW"
+    int32_t elem_size;     // in bytes
+    int32_t type_code;     // 0 for unsigned ints, 1 for signed ints, and 2 for floats
+    int32_t dimensions;
+    int32_t extent[4];
+};
+
+template<typename T>
+int32_t raw_type_code() {
+    if (!std::numeric_limits<T>::is_integer) return 2;
+    return std::numeric_limits<T>::is_signed ? 1 : 0;
+}
+
+// Raw files hold the elements in the layout of a planar
+// image, so they're read straight into the image's memory, with no
+// decode or conversion. The type of the file must match T.
+template<typename T>
+Image<T> load_raw(std::string filename) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    _assert(f, "File %s could not be opened for reading\n", filename.c_str());
+
+    RawImageHeader header;
+    _assert(fread(&header, sizeof(header), 1, f) == 1, "File ended before end of header\n");
+    _assert(memcmp(header.magic, "HRAW", 4) == 0, "File %s is not a raw image\n", filename.c_str());
+    _assert(header.elem_size == (int32_t)sizeof(T) && header.type_code == raw_type_code<T>(),
+            "Raw image %s doesn't have the type of the Image it's loaded into\n", filename.c_str());
+    _assert(header.dimensions >= 1 && header.dimensions <= 4, "Bad dimensionality in raw image\n");
+
+    int32_t extent[4] = {0, 0, 0, 0};
+    size_t elems = 1;
+    for (int i = 0; i < header.dimensions; i++) {
+        extent[i] = header.extent[i];
+        elems *= extent[i];
+    }
+    Image<T> im(extent[0], extent[1], extent[2], extent[3]);
+    _assert(fread(im.data(), sizeof(T), elems, f) == elems, "Could not read raw image data\n");
+    fclose(f);
+
+    im.set_host_dirty();
+    return im;
+}
+
+template<typename T>
+void save_raw(Image<T> im, std::string filename) {
+    im.copy_to_host();
+
+    FILE *f = fopen(filename.c_str(), "wb");
+    _assert(f, "File %s could not be opened for writing\n", filename.c_str());
+
+    RawImageHeader header;
+    memcpy(header.magic, "HRAW", 4);
+    header.elem_size = sizeof(T);
+    header.type_code = raw_type_code<T>();
+    header.dimensions = im.dimensions();
+    for (int i = 0; i < 4; i++) {
+        header.extent[i] = i < im.dimensions() ? im.extent(i) : 0;
+    }
+    _assert(fwrite(&header, sizeof(header), 1, f) == 1, "Could not write raw image header\n");
+
+    // Write a row at a time, in case the image isn't dense.
+    int rows = 1;
+    for (int i = 1; i < im.dimensions(); i++) {
+        rows *= im.extent(i);
+    }
+    for (int r = 0; r < rows; r++) {
+        const T *src = (const T *)im.data();
+        int i = r;
+        for (int d = 1; d < im.dimensions(); d++) {
+            src += (i % im.extent(d)) * im.stride(d);
+            i /= im.extent(d);
         }
-        _assert(fwrite((void *) data, sizeof(uint16_t), width*height*3, f) == (size_t) (width*height*3), "Could not write PPM 16-bit data\n");
-        delete[] data;
+        _assert(fwrite(src, sizeof(T), im.width(), f) == (size_t)im.width(),
+                "Could not write raw image data\n");
     }
     fclose(f);
 }
@@ -386,8 +434,10 @@ Image<T> load(std::string filename) {
         return load_png<T>(filename);
     } else if (ends_with_ignore_case(filename, ".ppm")) {
         return load_ppm<T>(filename);
+    } else if (ends_with_ignore_case(filename, ".raw")) {
+        return load_raw<T>(filename);
     } else {
-        _assert(false, "[load] unsupported file extension (png|ppm supported)");
+        _assert(false, "[load] unsupported file extension (png|ppm|raw supported)");
     }
 }
 
@@ -397,8 +447,10 @@ void save(Image<T> im, std::string filename) {
         save_png<T>(im, filename);
     } else if (ends_with_ignore_case(filename, ".ppm")) {
         save_ppm<T>(im, filename);
+    } else if (ends_with_ignore_case(filename, ".raw")) {
+        save_raw<T>(im, filename);
     } else {
-        _assert(false, "[save] unsupported file extension (png|ppm supported)");
+        _assert(false, "[save] unsupported file extension (png|ppm|raw supported)");
     }
 }
 
@@ -1,7 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
-#include <sys/time.h>
 
 extern "C" {
   #include "haar_x.h"
@@ -12,6 +11,7 @@ extern "C" {
 
 #include <static_image.h>
 #include <image_io.h>
+#include <benchmark.h>
 
 float clamp(float x, float min, float max) {
     if (x < min) return min;
@@ -37,22 +37,34 @@ int main(int argc, char **argv) {
     Image<float> inverse_transformed(input.width(), input.height(), 1);
 
     printf("haar_x\n");
-    haar_x(input, transformed);    
+    Benchmark b_haar_x("wavelet_haar_x");
+    while (b_haar_x.running()) {
+        haar_x(input, transformed);
+    }
     printf("saving result...\n");
     save_transformed(transformed, "haar_x.png");
 
     printf("inverse_haar_x\n");
-    inverse_haar_x(transformed, inverse_transformed);
+    Benchmark b_inverse_haar_x("wavelet_inverse_haar_x");
+    while (b_inverse_haar_x.running()) {
+        inverse_haar_x(transformed, inverse_transformed);
+    }
     printf("saving result...\n");
     save(inverse_transformed, "inverse_haar_x.png");
 
     printf("daubechies_x\n");
-    daubechies_x(input, transformed);    
+    Benchmark b_daubechies_x("wavelet_daubechies_x");
+    while (b_daubechies_x.running()) {
+        daubechies_x(input, transformed);
+    }
     printf("saving result...\n");
     save_transformed(transformed, "daubechies_x.png");
 
     printf("inverse_daubechies_x\n");
-    inverse_daubechies_x(transformed, inverse_transformed);
+    Benchmark b_inverse_daubechies_x("wavelet_inverse_daubechies_x");
+    while (b_inverse_daubechies_x.running()) {
+        inverse_daubechies_x(transformed, inverse_transformed);
+    }
     printf("saving result...\n");
     save(inverse_transformed, "inverse_daubechies_x.png");
 
@@ -238,6 +238,12 @@ class Func(object):
         argument.
         """
     
+    def compile_to_descriptor(self, filename, list_of_Argument, fn_name=''):
+        """
+        Write a text file describing the arguments of the function
+        that compile_to_file generates, for halide_aot.load.
+        """
+    
     def compile_jit(self):
         """
         Eagerly jit compile the function to machine code. This
@@ -563,11 +569,14 @@ def _image_getattr(self, name):
         if _flip_xy and len(strides) >= 2:
             strides = (strides[1], strides[0]) + strides[2:]
             shape = (shape[1], shape[0]) + shape[2:]
-        data = image_to_string(self)
+        # Share the image's memory rather than copying it. Numpy keeps
+        # a reference to the image for as long as the array lives.
+        data = (image_address(self), False)
         return {'shape': shape,
                 'typestr': typestr,
                 'data': data,
-                'strides': strides}
+                'strides': strides,
+                'version': 3}
     raise AttributeError(name)
 
 for _ImageT in ImageTypes:
@@ -617,15 +626,25 @@ for _ImageT in ImageTypes:
     _ImageT.tostring = lambda self: image_to_string(self)
 
 def _numpy_to_image(a, dtype, C):
+    """
+    Wrap an Image around the memory of a numpy array, honoring its strides, without copying it.
+    Writes to either one are seen by the other. The array is only copied if it isn't of the given
+    dtype or isn't aligned.
+    """
     a = numpy.asarray(a, dtype)
+    if not a.flags.aligned or any(s % a.itemsize for s in a.strides):
+        a = numpy.array(a)
+    if len(a.shape) > 4:
+        raise ValueError('Images have at most four dimensions, not %d' % len(a.shape))
     shape = a.shape
     strides = a.strides
     if _flip_xy and len(shape) >= 2:
         shape = (shape[1], shape[0]) + shape[2:]
         strides = (strides[1], strides[0]) + strides[2:]
 
-    ans = C(*shape)
-    assign_array(ans, a.__array_interface__['data'][0], *strides)
+    ans = C(wrap_array(_numpy_to_type(a), a.__array_interface__['data'][0], list(shape), list(strides)))
+    # The Image doesn't own the memory, so keep the array alive with it.
+    ans._numpy_array = a
     return ans
 
 def _numpy_to_type(a):
@@ -649,13 +668,16 @@ class Image(object):
     The contents can be:
     
         - PIL image
-        - Numpy array
+        - Numpy array (the Image shares its memory, honoring its strides, unless it has to be
+          converted to typeval or scaled)
         - Filename of existing file (typeval defaults to UInt(8))
         - halide.Buffer
         - An int or tuple -- constructs an n-D image (typeval argument is required).
 
     The image can be indexed via I[x], I[y,x], etc, which gives a Halide Expr.
 
+    numpy.asarray(I) also shares the memory of the Image rather than copying it.
+
     If not provided (or None) then the typeval is inferred from the input argument.
 
     For PIL, numpy, and filename constructors, if scale is provided then the input is scaled by the floating point scale factor
@@ -1432,6 +1454,16 @@ def test_numpy():
                 c = numpy.asarray(out[0])
                 assert dist(a,c)<=1500, dist(a,c)
 
+    # Conversions share memory in both directions, honoring strides.
+    a = numpy.zeros((10, 20), 'float32')
+    b = Image(a[:, ::2])
+    assert b.extent(0) == 10 and b.extent(1) == 10
+    a[3, 4] = 5.0
+    c = numpy.asarray(b)
+    assert c[3, 2] == 5.0
+    c[7, 1] = 6.0
+    assert a[7, 2] == 6.0
+
     print 'halide.test_numpy:                   OK'
 
 def test_minimal():
@@ -1520,6 +1552,25 @@ def test_image_constructors():
 
     print 'halide.test_image_constructors:      OK'
 
+def test_threads():
+    # Independent pipelines realized from several Python threads at once.
+    import threading
+    results = {}
+    def run(i):
+        x = Var('x')
+        f = Func('f%d' % i)
+        f[x] = x * (i + 1)
+        results[i] = numpy.asarray(Image(Int(32), f.realize(1000)))
+    threads = [threading.Thread(target=run, args=(i,)) for i in range(4)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    for i in range(4):
+        assert (results[i] == numpy.arange(1000) * (i + 1)).all()
+
+    print 'halide.test_threads:                 OK'
+
 def test():
     exit_on_signal()
 
@@ -1528,6 +1579,7 @@ def test():
     test_core()
     test_numpy()
     test_image_constructors()
+    test_threads()
 
 if __name__ == '__main__':
     test()
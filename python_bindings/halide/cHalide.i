@@ -29,6 +29,34 @@ namespace Halide {
 %ignore Internal;
 }
 
+/* Release the GIL while compiling and running pipelines, so that
+   Python threads can drive independent pipelines at the same
+   time. These don't call back into Python. Two threads must not use
+   the same Func at once, as it caches its compiled code. */
+%init %{
+    PyEval_InitThreads();
+%}
+
+%define RELEASE_GIL(method)
+%exception Halide::Func::method {
+    Py_BEGIN_ALLOW_THREADS
+    $action
+    Py_END_ALLOW_THREADS
+}
+%enddef
+
+RELEASE_GIL(realize)
+RELEASE_GIL(infer_input_bounds)
+RELEASE_GIL(compile_jit)
+RELEASE_GIL(compile_to_bitcode)
+RELEASE_GIL(compile_to_object)
+RELEASE_GIL(compile_to_header)
+RELEASE_GIL(compile_to_descriptor)
+RELEASE_GIL(compile_to_assembly)
+RELEASE_GIL(compile_to_c)
+RELEASE_GIL(compile_to_lowered_stmt)
+RELEASE_GIL(compile_to_file)
+
 %include "std_string.i"
 %include "std_vector.i"
 
@@ -203,6 +203,31 @@ void imul(FuncRefExpr &f, const Expr &e) { f *= e; }
 
 //void set(UniformImage &a, Image<uint8_t> b) { a = DynImage(b); }
 
+// Wrap a buffer around memory owned by someone else (e.g. a numpy
+// array), given its strides in bytes. The caller keeps the memory
+// alive.
+Buffer wrap_array(Type t, size_t base, const std::vector<int> &sizes, const std::vector<int> &strides) {
+    std::vector<int32_t> elem_strides;
+    for (size_t i = 0; i < strides.size(); i++) {
+        assert(strides[i] % t.bytes() == 0 && "Can't wrap an array whose strides aren't a multiple of its element size");
+        elem_strides.push_back(strides[i] / t.bytes());
+    }
+    std::vector<int32_t> buf_sizes(sizes.begin(), sizes.end());
+    return Buffer(t, buf_sizes, elem_strides, std::vector<int32_t>(sizes.size(), 0), (uint8_t *)base);
+}
+
+// The address of the element at the mins of an image.
+#define DEFINE_TYPE(T) size_t image_address(const Image<T> &a) { return (size_t)Buffer(a).host_ptr(); }
+DEFINE_TYPE(uint8_t)
+DEFINE_TYPE(uint16_t)
+DEFINE_TYPE(uint32_t)
+DEFINE_TYPE(int8_t)
+DEFINE_TYPE(int16_t)
+DEFINE_TYPE(int32_t)
+DEFINE_TYPE(float)
+DEFINE_TYPE(double)
+#undef DEFINE_TYPE
+
 #define DEFINE_TYPE(T) \
 void assign_array(Image<T> &a, size_t base, size_t xstride) { \
     for (int x = 0; x < a.extent(0); x++) { \
@@ -185,6 +185,19 @@ DEFINE_TYPE(float)
 DEFINE_TYPE(double)
 #undef DEFINE_TYPE
 
+Buffer wrap_array(Type t, size_t base, const std::vector<int> &sizes, const std::vector<int> &strides);
+
+#define DEFINE_TYPE(T) size_t image_address(const Image<T> &a);
+DEFINE_TYPE(uint8_t)
+DEFINE_TYPE(uint16_t)
+DEFINE_TYPE(uint32_t)
+DEFINE_TYPE(int8_t)
+DEFINE_TYPE(int16_t)
+DEFINE_TYPE(int32_t)
+DEFINE_TYPE(float)
+DEFINE_TYPE(double)
+#undef DEFINE_TYPE
+
 #define DEFINE_TYPE(T) \
 void assign_array(Image<T> &a, size_t base, size_t xstride); \
 void assign_array(Image<T> &a, size_t base, size_t xstride, size_t ystride); \
@@ -0,0 +1,153 @@
+"""
+Call pipelines compiled ahead of time from Python, without the compiler.
+
+A pipeline compiled with Func.compile_to_file, and described with
+Func.compile_to_descriptor, can be linked into a shared library and
+called on numpy arrays:
+
+    // In C++ (or with the halide module):
+    blur.compile_to_file("blur", args);
+    blur.compile_to_descriptor("blur.desc", args);
+
+    $ cc -shared -o blur.so blur.o -lpthread -ldl
+
+    # In Python:
+    import halide_aot
+    blur = halide_aot.load('blur.so')
+    blur(input_array, out_array)
+
+This module only needs numpy and ctypes. It doesn't import the halide
+module, so it doesn't load LLVM, and it compiles nothing at runtime.
+"""
+
+import ctypes
+import os
+import numpy
+
+__all__ = ['load', 'Pipeline']
+
+class buffer_t(ctypes.Structure):
+    """
+    The runtime representation of an image, as in buffer_t.h.
+    """
+    _fields_ = [('dev', ctypes.c_uint64),
+                ('host', ctypes.c_void_p),
+                ('extent', ctypes.c_int32 * 4),
+                ('stride', ctypes.c_int32 * 4),
+                ('min', ctypes.c_int32 * 4),
+                ('elem_size', ctypes.c_int32),
+                ('host_dirty', ctypes.c_bool),
+                ('dev_dirty', ctypes.c_bool)]
+
+_dtypes = {'int8': numpy.int8, 'int16': numpy.int16, 'int32': numpy.int32, 'int64': numpy.int64,
+           'uint1': numpy.bool_, 'uint8': numpy.uint8, 'uint16': numpy.uint16,
+           'uint32': numpy.uint32, 'uint64': numpy.uint64,
+           'float32': numpy.float32, 'float64': numpy.float64}
+
+_ctypes = {'int8': ctypes.c_int8, 'int16': ctypes.c_int16, 'int32': ctypes.c_int32,
+           'int64': ctypes.c_int64, 'uint1': ctypes.c_bool, 'uint8': ctypes.c_uint8,
+           'uint16': ctypes.c_uint16, 'uint32': ctypes.c_uint32, 'uint64': ctypes.c_uint64,
+           'float32': ctypes.c_float, 'float64': ctypes.c_double, 'handle64': ctypes.c_void_p,
+           'handle32': ctypes.c_void_p}
+
+def read_descriptor(filename):
+    """
+    Read a file written by Func.compile_to_descriptor. Returns the name of the function and a list
+    of (kind, is_buffer, name, type) for its arguments, where kind is 'input' or 'output'.
+    """
+    name = None
+    args = []
+    for line in open(filename):
+        words = line.split()
+        if not words or words[0].startswith('#'):
+            continue
+        if words[0] == 'function' and len(words) == 2:
+            name = words[1]
+        elif words[0] in ('input', 'output') and len(words) == 4 and words[1] in ('buffer', 'scalar'):
+            args.append((words[0], words[1] == 'buffer', words[2], words[3]))
+        else:
+            raise ValueError('Bad line in pipeline descriptor %s: %s' % (filename, line.strip()))
+    if name is None:
+        raise ValueError('Pipeline descriptor %s has no function line' % filename)
+    return (name, args)
+
+class Pipeline:
+    """
+    A pipeline in a shared library, callable with one argument per argument of the pipeline, in
+    the order of the descriptor: numpy arrays for buffers, numbers for scalars. Output arrays must
+    be allocated by the caller, with the size of the region to compute.
+
+    The first two axes of each array are swapped into dimensions 1 and 0 (so axis 0 of an array
+    is y and axis 1 is x) if flip_xy is true, as in halide.set_flip_xy, and the other axes are
+    dimensions 2 and 3. Arrays are used in place, honoring their strides. Inputs that aren't of
+    the pipeline's type, or are misaligned, are copied first. Outputs must be of the right type,
+    aligned and writeable.
+    """
+    def __init__(self, library, descriptor, flip_xy=True):
+        (self.name, self.args) = read_descriptor(descriptor)
+        self.flip_xy = flip_xy
+        self.function = getattr(ctypes.CDLL(os.path.abspath(library)), self.name)
+        argtypes = []
+        for (kind, is_buffer, name, t) in self.args:
+            if is_buffer:
+                if t not in _dtypes:
+                    raise ValueError('Unsupported type %s of buffer %s' % (t, name))
+                argtypes.append(ctypes.POINTER(buffer_t))
+            else:
+                if t not in _ctypes:
+                    raise ValueError('Unsupported type %s of argument %s' % (t, name))
+                argtypes.append(_ctypes[t])
+        self.function.argtypes = argtypes
+        self.function.restype = ctypes.c_int
+
+    def _buffer(self, a, kind, name, t):
+        dtype = numpy.dtype(_dtypes[t])
+        if kind == 'input':
+            a = numpy.asarray(a, dtype)
+            if not a.flags.aligned or any(s % a.itemsize for s in a.strides):
+                a = numpy.array(a)
+        elif (not isinstance(a, numpy.ndarray) or a.dtype != dtype or not a.flags.aligned or
+              not a.flags.writeable or any(s % a.itemsize for s in a.strides)):
+            raise ValueError('Output %s must be a writeable, aligned numpy array of %s' % (name, dtype))
+        if len(a.shape) > 4:
+            raise ValueError('Buffers have at most four dimensions, but %s has %d' % (name, len(a.shape)))
+
+        shape = list(a.shape)
+        strides = [s // a.itemsize for s in a.strides]
+        if self.flip_xy and len(shape) >= 2:
+            shape[0], shape[1] = shape[1], shape[0]
+            strides[0], strides[1] = strides[1], strides[0]
+
+        b = buffer_t()
+        b.host = a.ctypes.data
+        for i in range(len(shape)):
+            b.extent[i] = shape[i]
+            b.stride[i] = strides[i]
+        b.elem_size = a.itemsize
+        return (a, b)
+
+    def __call__(self, *values):
+        if len(values) != len(self.args):
+            raise TypeError('%s takes %d arguments (%d given)' % (self.name, len(self.args), len(values)))
+        call_args = []
+        # Keep the arrays (which may be copies) alive during the call.
+        arrays = []
+        for ((kind, is_buffer, name, t), v) in zip(self.args, values):
+            if is_buffer:
+                (a, b) = self._buffer(v, kind, name, t)
+                arrays.append(a)
+                call_args.append(ctypes.byref(b))
+            else:
+                call_args.append(v)
+        result = self.function(*call_args)
+        if result != 0:
+            raise RuntimeError('%s failed with error code %d' % (self.name, result))
+
+def load(library, descriptor=None, flip_xy=True):
+    """
+    Load the pipeline in a shared library. The descriptor defaults to the library's filename with
+    its extension replaced by .desc.
+    """
+    if descriptor is None:
+        descriptor = os.path.splitext(library)[0] + '.desc'
+    return Pipeline(library, descriptor, flip_xy)
@@ -35,6 +35,7 @@ setup(
         "Topic :: Multimedia :: Graphics",
         "Programming Language :: Python :: 2.7"],
     packages=['halide'],
+    py_modules=['halide_aot'],
     package_dir={'halide': 'halide'},
     package_data={'halide': ['data/*.png']},
     ext_modules = ext_modules
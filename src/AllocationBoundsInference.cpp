@@ -119,6 +119,11 @@ public:
         for (map<string, Function>::const_iterator iter = e.begin();
              iter != e.end(); ++iter) {
             Function f = iter->second;
+            // The values of distributed functions are traded
+            // between ranks through a buffer too.
+            if (!f.schedule().distributed_var.empty()) {
+                touched_by_extern.insert(f.name());
+            }
             if (f.has_extern_definition()) {
                 touched_by_extern.insert(f.name());
                 for (size_t i = 0; i < f.extern_arguments().size(); i++) {
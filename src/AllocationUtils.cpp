@@ -0,0 +1,54 @@
+#include "AllocationUtils.h"
+#include "CodeGen_Internal.h"
+
+namespace Halide {
+namespace Internal {
+
+bool small_constant_size(const Allocate *op) {
+    int64_t bytes = op->type.bytes();
+    for (size_t i = 0; i < op->extents.size(); i++) {
+        const IntImm *extent = op->extents[i].as<IntImm>();
+        if (!extent) return false;
+        bytes *= extent->value;
+        if (bytes > stack_allocation_limit()) return false;
+    }
+    return true;
+}
+
+void FindDefinitions::visit(const Let *op) {
+    defined.push(op->name, 0);
+    IRVisitor::visit(op);
+}
+
+void FindDefinitions::visit(const LetStmt *op) {
+    defined.push(op->name, 0);
+    IRVisitor::visit(op);
+}
+
+void FindDefinitions::visit(const For *op) {
+    defined.push(op->name, 0);
+    IRVisitor::visit(op);
+}
+
+void FindDefinitions::visit(const Allocate *op) {
+    defined.push(op->name, 0);
+    allocation_count[op->name]++;
+    IRVisitor::visit(op);
+}
+
+void UsesDefinitions::visit(const Variable *op) {
+    if (defined.contains(op->name)) result = true;
+}
+
+void UsesDefinitions::visit(const Load *op) {
+    if (loads_are_uses || defined.contains(op->name)) result = true;
+    IRVisitor::visit(op);
+}
+
+void UsesDefinitions::visit(const Call *op) {
+    if (defined.contains(op->name)) result = true;
+    IRVisitor::visit(op);
+}
+
+}
+}
@@ -0,0 +1,62 @@
+#ifndef HALIDE_ALLOCATION_UTILS_H
+#define HALIDE_ALLOCATION_UTILS_H
+
+/** \file
+ * Helpers shared by the lowering passes that move, share or account
+ * for allocations.
+ */
+
+#include "IR.h"
+#include "IRVisitor.h"
+#include "Scope.h"
+
+#include <map>
+
+namespace Halide {
+namespace Internal {
+
+/** Check if an allocation has a constant size small enough that the
+ * cpu backends place it on the stack instead of the heap (see
+ * stack_allocation_limit in CodeGen_Internal.h). */
+bool small_constant_size(const Allocate *op);
+
+/** Collect the names of the lets, loops and allocations defined
+ * inside a statement, and how many times each buffer is
+ * allocated. */
+class FindDefinitions : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Let *op);
+    void visit(const LetStmt *op);
+    void visit(const For *op);
+    void visit(const Allocate *op);
+
+public:
+    Scope<int> defined;
+    std::map<std::string, int> allocation_count;
+};
+
+/** Check if an expression refers to any variable or buffer in a
+ * scope. If loads_are_uses is set, any load counts, because the
+ * memory it reads might not have been written yet at the point of
+ * interest. */
+class UsesDefinitions : public IRVisitor {
+    using IRVisitor::visit;
+
+    const Scope<int> &defined;
+    bool loads_are_uses;
+
+    void visit(const Variable *op);
+    void visit(const Load *op);
+    void visit(const Call *op);
+
+public:
+    bool result;
+    UsesDefinitions(const Scope<int> &d, bool l = false) :
+        defined(d), loads_are_uses(l), result(false) {}
+};
+
+}
+}
+
+#endif
@@ -29,9 +29,23 @@ struct Argument {
     /** If this is a scalar parameter, then this is its type */
     Type type;
 
-    Argument() : is_buffer(false) {}
+    /** If this is a buffer, the alignment in bytes its host pointer
+     * is asserted to have, or zero if it's not known. */
+    int host_alignment;
+
+    /** If this is a buffer, whether its host memory is declared not
+     * to overlap that of any other buffer. */
+    bool no_alias;
+
+    /** If this is a buffer passed to a gpu kernel, whether the kernel
+     * only reads it, so that its loads may go through the read-only
+     * (texture) cache. */
+    bool read_only;
+
+    Argument() : is_buffer(false), host_alignment(0), no_alias(false), read_only(false) {}
     Argument(const std::string &_name, bool _is_buffer, Type _type) : 
-        name(_name), is_buffer(_is_buffer), type(_type) {}
+        name(_name), is_buffer(_is_buffer), type(_type), host_alignment(0), no_alias(false),
+        read_only(false) {}
 };
 }
 
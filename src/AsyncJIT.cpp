@@ -0,0 +1,120 @@
+#include "AsyncJIT.h"
+#include "StmtCompiler.h"
+#include "LLVM_Headers.h"
+#include <llvm/Support/Threading.h>
+
+// llvm includes above disable assert.  Include Util.h here
+// to reenable assert.
+#include "Util.h"
+#include "Debug.h"
+
+#ifndef _MSC_VER
+#include <pthread.h>
+#endif
+
+namespace Halide {
+namespace Internal {
+
+template<>
+EXPORT RefCount &ref_count<AsyncJITJob>(const AsyncJITJob *j) {return j->ref_count;}
+
+template<>
+EXPORT void destroy<AsyncJITJob>(const AsyncJITJob *j) {delete j;}
+
+namespace {
+
+void compile_job(AsyncJITJob *job) {
+    debug(1) << "Compiling " << job->name << " in the background\n";
+    StmtCompiler cg(job->target);
+    cg.compile(job->lowered, job->name, job->args, std::vector<Buffer>());
+    job->module = cg.compile_to_function_pointers(job->cache_key);
+    debug(1) << "Done compiling " << job->name << " in the background\n";
+}
+
+#ifndef _MSC_VER
+struct ThreadState {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+void *async_jit_worker(void *arg) {
+    AsyncJITJob *job = (AsyncJITJob *)arg;
+    ThreadState *state = (ThreadState *)job->thread_state;
+    compile_job(job);
+
+    pthread_mutex_lock(&state->mutex);
+    __sync_synchronize();
+    job->done = 1;
+    pthread_cond_broadcast(&state->cond);
+    pthread_mutex_unlock(&state->mutex);
+
+    // The job can't be freed until this thread is joined, so it's
+    // safe to use after signalling.
+    if (job->callback) job->callback(job->callback_arg);
+    return NULL;
+}
+#endif
+
+}
+
+AsyncJITJob::~AsyncJITJob() {
+    #ifndef _MSC_VER
+    ThreadState *state = (ThreadState *)thread_state;
+    if (state) {
+        pthread_join(state->thread, NULL);
+        pthread_mutex_destroy(&state->mutex);
+        pthread_cond_destroy(&state->cond);
+        delete state;
+    }
+    #endif
+}
+
+void start_async_jit(AsyncJITJob *job) {
+    assert(!job->thread_state && !job->done && "Async jit job started twice");
+
+    #ifdef _MSC_VER
+    compile_job(job);
+    job->done = 1;
+    if (job->callback) job->callback(job->callback_arg);
+    #else
+    #if LLVM_VERSION < 35
+    llvm::llvm_start_multithreaded();
+    #endif
+
+    ThreadState *state = new ThreadState;
+    pthread_mutex_init(&state->mutex, NULL);
+    pthread_cond_init(&state->cond, NULL);
+    job->thread_state = state;
+    pthread_create(&state->thread, NULL, async_jit_worker, job);
+    #endif
+}
+
+void wait_for_async_jit(AsyncJITJob *job) {
+    #ifndef _MSC_VER
+    ThreadState *state = (ThreadState *)job->thread_state;
+    if (!state) return;
+    pthread_mutex_lock(&state->mutex);
+    while (!job->done) {
+        pthread_cond_wait(&state->cond, &state->mutex);
+    }
+    pthread_mutex_unlock(&state->mutex);
+    #endif
+}
+
+}
+
+bool JITFuture::ready() const {
+    if (!job.defined()) return false;
+    bool done = job.ptr->done != 0;
+    #ifdef __GNUC__
+    if (done) __sync_synchronize();
+    #endif
+    return done;
+}
+
+void JITFuture::wait() const {
+    if (job.defined()) Internal::wait_for_async_jit(job.ptr);
+}
+
+}
@@ -0,0 +1,88 @@
+#ifndef HALIDE_ASYNC_JIT_H
+#define HALIDE_ASYNC_JIT_H
+
+/** \file
+ * Defines a handle to a jit compilation running in the background
+ */
+
+#include "IR.h"
+#include "Argument.h"
+#include "Parameter.h"
+#include "Target.h"
+#include "JITCompiledModule.h"
+
+#include <string>
+#include <vector>
+
+namespace Halide {
+namespace Internal {
+
+/** A lowered pipeline being jit compiled on another thread. Everything
+ * but the module and the done flag is filled in before the compile
+ * starts, and isn't touched by the compiling thread. */
+struct AsyncJITJob {
+    mutable RefCount ref_count;
+
+    Stmt lowered;
+    std::string name, cache_key;
+    std::vector<Argument> args;
+    Target target;
+
+    /** The argument values to realize the result with, as for
+     * Func::arg_values and Func::image_param_args. */
+    std::vector<const void *> arg_values;
+    std::vector<std::pair<int, Parameter> > image_param_args;
+
+    /** Called on the compiling thread when the compile is done. May
+     * be NULL. */
+    void (*callback)(void *);
+    void *callback_arg;
+
+    /** The compiled module. Only valid once done is set. */
+    JITCompiledModule module;
+    volatile int done;
+
+    /** The thread doing the compile, and the lock and condition to
+     * wait on it with. Opaque so that this header needn't include
+     * pthread.h. */
+    void *thread_state;
+
+    AsyncJITJob() : callback(NULL), callback_arg(NULL), done(0), thread_state(NULL) {}
+
+    /** Waits for the compile to finish. */
+    ~AsyncJITJob();
+};
+
+/** Start compiling a job on a new thread. Where threads aren't
+ * available (on Windows), it's compiled before this returns. */
+void start_async_jit(AsyncJITJob *job);
+
+/** Block until a job started with start_async_jit is done. */
+void wait_for_async_jit(AsyncJITJob *job);
+
+}
+
+/** A handle to a jit compilation running in the background. Returned
+ * by Func::compile_jit_async. */
+class JITFuture {
+    Internal::IntrusivePtr<Internal::AsyncJITJob> job;
+public:
+    JITFuture() {}
+    JITFuture(Internal::AsyncJITJob *j) : job(j) {}
+
+    /** Does this refer to a compilation. */
+    bool defined() const {return job.defined();}
+
+    /** Has the compilation finished, so that the Func's realizations
+     * will use it. Doesn't block. */
+    EXPORT bool ready() const;
+
+    /** Block until the compilation has finished. */
+    EXPORT void wait() const;
+
+    Internal::AsyncJITJob *get() const {return job.ptr;}
+};
+
+}
+
+#endif
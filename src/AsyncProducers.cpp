@@ -0,0 +1,206 @@
+#include "AsyncProducers.h"
+#include "IRMutator.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "Debug.h"
+
+#include <set>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+using std::set;
+
+namespace {
+
+// Does a statement read the output of any of the given functions?
+class UsesFuncs : public IRVisitor {
+    const set<string> &funcs;
+
+    using IRVisitor::visit;
+
+    void visit(const Load *op) {
+        if (funcs.count(op->name)) result = true;
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Call *op) {
+        if (funcs.count(op->name)) result = true;
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Variable *op) {
+        // Extern stages get handed the buffer_t of their inputs.
+        if (ends_with(op->name, ".buffer") &&
+            funcs.count(op->name.substr(0, op->name.size() - 7))) {
+            result = true;
+        }
+    }
+
+public:
+    bool result;
+    UsesFuncs(const set<string> &f) : funcs(f), result(false) {}
+};
+
+bool uses_funcs(Stmt s, const set<string> &funcs) {
+    if (!s.defined()) return false;
+    UsesFuncs u(funcs);
+    s.accept(&u);
+    return u.result;
+}
+
+bool uses_funcs(Expr e, const set<string> &funcs) {
+    UsesFuncs u(funcs);
+    e.accept(&u);
+    return u.result;
+}
+
+// Does a statement contain a producer running ahead of its consumer
+// (see storage_folding)? Those wait on each other, so both tasks of
+// such a pair must be able to run at once, which isn't certain if
+// they're nested inside other tasks.
+class HasPipelinedProducer : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        if (op->name == "halide_make_semaphore") result = true;
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool result;
+    HasPipelinedProducer() : result(false) {}
+};
+
+bool has_pipelined_producer(const Pipeline *p) {
+    HasPipelinedProducer h;
+    p->produce.accept(&h);
+    if (p->update.defined()) {
+        p->update.accept(&h);
+    }
+    return h.result;
+}
+
+class ComputeAsyncProducers : public IRMutator {
+    const map<string, Function> &env;
+
+    bool is_async(const string &name) {
+        map<string, Function>::const_iterator iter = env.find(name);
+        return (iter != env.end() &&
+                iter->second.schedule().async &&
+                iter->second.schedule().compute_level.is_root());
+    }
+
+    using IRMutator::visit;
+
+    // Pipelines inside loops aren't at the root level.
+    void visit(const For *op) {
+        stmt = op;
+    }
+
+    void visit(const Pipeline *op) {
+        if (!is_async(op->name) || has_pipelined_producer(op)) {
+            IRMutator::visit(op);
+            return;
+        }
+
+        // Gather the producers that can run alongside this one. Any
+        // let statements and allocations between two pipelines get
+        // lifted above the group, so they mustn't depend on it either.
+        vector<const Pipeline *> group;
+        vector<Stmt> wrappers;
+        set<string> produced;
+        group.push_back(op);
+        produced.insert(op->name);
+
+        Stmt rest = op->consume;
+        vector<Stmt> pending;
+        while (true) {
+            if (const LetStmt *let = rest.as<LetStmt>()) {
+                if (uses_funcs(let->value, produced)) break;
+                pending.push_back(rest);
+                rest = let->body;
+            } else if (const Allocate *alloc = rest.as<Allocate>()) {
+                bool ok = true;
+                for (size_t i = 0; i < alloc->extents.size(); i++) {
+                    ok = ok && !uses_funcs(alloc->extents[i], produced);
+                }
+                if (!ok) break;
+                pending.push_back(rest);
+                rest = alloc->body;
+            } else if (const Pipeline *p = rest.as<Pipeline>()) {
+                if (!is_async(p->name) ||
+                    has_pipelined_producer(p) ||
+                    uses_funcs(p->produce, produced) ||
+                    uses_funcs(p->update, produced)) {
+                    break;
+                }
+                group.push_back(p);
+                produced.insert(p->name);
+                wrappers.insert(wrappers.end(), pending.begin(), pending.end());
+                pending.clear();
+                rest = p->consume;
+            } else {
+                break;
+            }
+        }
+
+        if (group.size() == 1) {
+            IRMutator::visit(op);
+            return;
+        }
+
+        // Whatever we walked past after the last member of the group
+        // stays where it was.
+        rest = group.back()->consume;
+        rest = mutate(rest);
+
+        debug(3) << "Computing " << group.size() << " producers concurrently, starting with " << op->name << "\n";
+
+        // One task per producer, chosen by the loop index.
+        string task_var = op->name + ".async_task";
+        Expr task = Variable::make(Int(32), task_var);
+        Stmt tasks;
+        for (size_t i = group.size(); i > 0; i--) {
+            const Pipeline *p = group[i-1];
+            Stmt body = p->produce;
+            if (p->update.defined()) {
+                body = Block::make(body, p->update);
+            }
+            if (!tasks.defined()) {
+                tasks = body;
+            } else {
+                tasks = IfThenElse::make(task == (int)(i-1), body, tasks);
+            }
+        }
+        tasks = For::make(task_var, 0, (int)group.size(), For::Parallel, tasks);
+
+        stmt = Pipeline::make(op->name, tasks, Stmt(), rest);
+
+        // Reinstate the lifted lets and allocations around the group.
+        for (size_t i = wrappers.size(); i > 0; i--) {
+            if (const LetStmt *let = wrappers[i-1].as<LetStmt>()) {
+                stmt = LetStmt::make(let->name, let->value, stmt);
+            } else {
+                const Allocate *alloc = wrappers[i-1].as<Allocate>();
+                assert(alloc);
+                stmt = Allocate::make(alloc->name, alloc->type, alloc->extents, stmt);
+            }
+        }
+    }
+
+public:
+    ComputeAsyncProducers(const map<string, Function> &e) : env(e) {}
+};
+
+}
+
+Stmt compute_async_producers(Stmt s, const map<string, Function> &env) {
+    return ComputeAsyncProducers(env).mutate(s);
+}
+
+}
+}
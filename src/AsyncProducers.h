@@ -0,0 +1,27 @@
+#ifndef HALIDE_ASYNC_PRODUCERS_H
+#define HALIDE_ASYNC_PRODUCERS_H
+
+/** \file
+ * Defines the lowering pass that computes independent root-level
+ * producers concurrently.
+ */
+
+#include "IR.h"
+#include "Function.h"
+
+#include <map>
+
+namespace Halide {
+namespace Internal {
+
+/** Find runs of root-level pipelines for functions scheduled with
+ * Func::async, where none of them uses the output of another, and
+ * compute them as the tasks of a single parallel for loop. Their
+ * consumers run after the loop, once every task is done. Must run
+ * after storage flattening. */
+Stmt compute_async_producers(Stmt s, const std::map<std::string, Function> &env);
+
+}
+}
+
+#endif
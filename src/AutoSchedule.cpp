@@ -0,0 +1,427 @@
+#include "AutoSchedule.h"
+#include "Bounds.h"
+#include "Func.h"
+#include "FindCalls.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "Simplify.h"
+#include "VectorWidth.h"
+#include "Debug.h"
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+using std::set;
+using std::ostringstream;
+
+namespace {
+
+// The most redundant work, as a multiple of the work done when a
+// function is computed at the root, that computing it per tile of its
+// consumer may cause.
+const double max_redundancy = 1.5;
+
+// The largest tile of a root-level function.
+const int max_tile_width = 64, max_tile_height = 32;
+
+// Functions with at most this many leaves (variables and constants)
+// that call no other functions, such as boundary conditions on an
+// input, are inlined wherever they're used.
+const int max_inlined_leaves = 12;
+
+// Count the calls to each function, and the leaves, in some
+// definitions.
+class CountCalls : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type == Call::Halide) {
+            calls[op->name]++;
+        }
+    }
+
+public:
+    map<string, int> calls;
+    int leaves;
+
+    CountCalls() : leaves(0) {}
+
+    void include(Expr e) {
+        e.accept(this);
+    }
+
+    void visit(const IntImm *) {leaves++;}
+    void visit(const FloatImm *) {leaves++;}
+    void visit(const Variable *) {leaves++;}
+};
+
+// The calls to other functions in every definition of f.
+CountCalls count_calls(Function f) {
+    CountCalls counter;
+    for (size_t i = 0; i < f.values().size(); i++) {
+        counter.include(f.values()[i]);
+    }
+    for (size_t i = 0; i < f.reductions().size(); i++) {
+        const ReductionDefinition &r = f.reductions()[i];
+        for (size_t j = 0; j < r.values.size(); j++) {
+            counter.include(r.values[j]);
+        }
+        for (size_t j = 0; j < r.args.size(); j++) {
+            counter.include(r.args[j]);
+        }
+    }
+    return counter;
+}
+
+// The regions of other functions needed to compute the given region
+// of f.
+map<string, Box> regions_required(Function f, const Box &region) {
+    Scope<Interval> scope;
+    for (size_t i = 0; i < f.args().size(); i++) {
+        scope.push(f.args()[i], region[i]);
+    }
+
+    map<string, Box> result;
+    vector<Expr> exprs = f.values();
+    for (size_t i = 0; i < f.reductions().size(); i++) {
+        const ReductionDefinition &r = f.reductions()[i];
+        exprs.insert(exprs.end(), r.values.begin(), r.values.end());
+        exprs.insert(exprs.end(), r.args.begin(), r.args.end());
+        if (r.domain.defined()) {
+            const vector<ReductionVariable> &rvars = r.domain.domain();
+            for (size_t j = 0; j < rvars.size(); j++) {
+                scope.push(rvars[j].var, Interval(rvars[j].min, rvars[j].min + rvars[j].extent - 1));
+            }
+        }
+    }
+
+    for (size_t i = 0; i < exprs.size(); i++) {
+        map<string, Box> boxes = boxes_required(exprs[i], scope);
+        for (map<string, Box>::iterator iter = boxes.begin(); iter != boxes.end(); ++iter) {
+            merge_boxes(result[iter->first], iter->second);
+        }
+    }
+    return result;
+}
+
+// The constant extent of an interval, or -1 if it isn't constant.
+int const_extent(const Interval &i) {
+    if (!i.min.defined() || !i.max.defined()) return -1;
+    const int *extent = as_const_int(simplify(i.max - i.min + 1));
+    return extent ? *extent : -1;
+}
+
+// The number of points in a box, or -1 if it isn't constant.
+double box_points(const Box &b) {
+    double points = 1;
+    for (size_t i = 0; i < b.size(); i++) {
+        int extent = const_extent(b[i]);
+        if (extent < 0) return -1;
+        points *= extent;
+    }
+    return points;
+}
+
+bool is_unscheduled(Function f) {
+    const Schedule &s = f.schedule();
+    if (s.touched || !s.compute_level.is_inline() || !s.store_level.is_inline() ||
+        !s.bounds.empty() || !s.specializations.empty()) {
+        return false;
+    }
+    for (size_t i = 0; i < f.reductions().size(); i++) {
+        if (f.reductions()[i].schedule.touched) return false;
+    }
+    return true;
+}
+
+class AutoScheduler {
+    const map<string, Function> &env;
+    const Target &target;
+
+    map<string, set<string> > consumers;
+    map<string, int> calls;
+
+    // The whole region of each function computed, with constant
+    // bounds where they could be found.
+    map<string, Box> region;
+
+    // The function at the root that each function is computed
+    // within, or the function itself if it's at the root. Empty if
+    // that isn't known (e.g. it was scheduled by hand).
+    map<string, string> group;
+
+    // The region of each function computed per tile of its group, in
+    // terms of the position of the tile.
+    map<string, Box> tile;
+
+    // The tile size of each root-level function.
+    map<string, vector<int> > tile_size;
+
+    // The schedules chosen, as code.
+    ostringstream source;
+
+    Function func(const string &name) {
+        return env.find(name)->second;
+    }
+
+    int vector_width(Function f) {
+        return natural_vector_size(f, target);
+    }
+
+    string outer(const string &var) {return var + "_outer";}
+    string inner(const string &var) {return var + "_inner";}
+
+    // Pick the tile size of a root-level function, and the region of
+    // it that each tile covers. Returns false if it isn't worth
+    // tiling, because the extent of its innermost dimension isn't
+    // known.
+    bool make_tile(Function f) {
+        const string &name = f.name();
+        vector<int> size(f.args().size(), 1);
+        Box t(f.args().size());
+        for (size_t i = 0; i < f.args().size(); i++) {
+            int extent = region[name].empty() ? -1 : const_extent(region[name][i]);
+            if (i < 2 && extent > 1) {
+                size[i] = std::min(extent, i == 0 ? max_tile_width : max_tile_height);
+            }
+            Expr min = Variable::make(Int(32), name + "." + f.args()[i] + ".tile_min");
+            t[i] = Interval(min, min + (size[i] - 1));
+        }
+        if (size[0] == 1) return false;
+        tile_size[name] = size;
+        tile[name] = t;
+        return true;
+    }
+
+    // The group of all of f's consumers (if that's one root-level
+    // function with a known tile), and the region of f per tile.
+    bool region_per_tile(Function f, string &g, Box &b) {
+        const set<string> &c = consumers[f.name()];
+        for (set<string>::const_iterator iter = c.begin(); iter != c.end(); ++iter) {
+            if (group[*iter].empty() || (!g.empty() && group[*iter] != g)) {
+                return false;
+            }
+            Function consumer = func(*iter);
+            if (consumer.has_extern_definition() || !tile_size.count(group[*iter]) ||
+                tile[*iter].size() != consumer.args().size()) {
+                return false;
+            }
+            g = group[*iter];
+            merge_boxes(b, regions_required(consumer, tile[*iter])[f.name()]);
+        }
+        return !g.empty() && !b.empty();
+    }
+
+    void choose(Function f) {
+        const string &name = f.name();
+
+        // The whole region computed is the union of what each
+        // consumer needs.
+        const set<string> &c = consumers[name];
+        for (set<string>::const_iterator iter = c.begin(); iter != c.end(); ++iter) {
+            if (region[*iter].empty()) continue;
+            merge_boxes(region[name], regions_required(func(*iter), region[*iter])[name]);
+        }
+        for (size_t i = 0; i < region[name].size(); i++) {
+            region[name][i].min = simplify(region[name][i].min);
+            region[name][i].max = simplify(region[name][i].max);
+        }
+
+        if (!is_unscheduled(f)) {
+            group[name] = "";
+            return;
+        }
+
+        bool consumed_by_extern = false;
+        for (set<string>::const_iterator iter = c.begin(); iter != c.end(); ++iter) {
+            consumed_by_extern = consumed_by_extern || func(*iter).has_extern_definition();
+        }
+
+        if (f.has_reduction_definition() || f.has_extern_definition() ||
+            consumed_by_extern || region[name].empty()) {
+            schedule_root(f);
+            return;
+        }
+
+        CountCalls counter = count_calls(f);
+        bool cheap = counter.calls.empty() && counter.leaves <= max_inlined_leaves;
+        if ((c.size() == 1 && calls[name] == 1) || cheap) {
+            // Inlining it doesn't compute anything twice, or costs
+            // less than a load would.
+            string consumer = *c.begin();
+            group[name] = cheap ? "" : group[consumer];
+            if (!cheap && tile.count(consumer)) {
+                tile[name] = regions_required(func(consumer), tile[consumer])[name];
+            }
+            source << "// " << name << " is inlined\n";
+            return;
+        }
+
+        // Could it be computed per tile of its consumers?
+        string g;
+        Box b;
+        if (region_per_tile(f, g, b)) {
+            double points_per_tile = box_points(b);
+            double points = box_points(region[name]);
+            double tiles = 1;
+            const vector<int> &size = tile_size[g];
+            for (size_t i = 0; i < size.size(); i++) {
+                int extent = const_extent(region[g][i]);
+                tiles *= extent < 0 ? 1 : (extent + size[i] - 1) / size[i];
+            }
+            if (points_per_tile > 0 && points > 0 &&
+                points_per_tile * tiles <= max_redundancy * points) {
+                group[name] = g;
+                tile[name] = b;
+                schedule_per_tile(f, func(g), const_extent(b[0]));
+                return;
+            }
+        }
+
+        schedule_root(f);
+    }
+
+    void schedule_root(Function f) {
+        const string &name = f.name();
+        Func handle(f);
+        if (name != output) {
+            handle.compute_root();
+        }
+        source << name << (name != output ? ".compute_root()" : "");
+        group[name] = "";
+
+        int width = vector_width(f);
+
+        if (f.has_reduction_definition() || f.has_extern_definition() || !make_tile(f)) {
+            // Only the pure definition, which has no races.
+            if (!f.has_extern_definition() && !f.args().empty()) {
+                Var x(f.args()[0]);
+                if (!region[name].empty() && const_extent(region[name][0]) >= width) {
+                    handle.vectorize(x, width, Tail_GuardWithIf);
+                    source << ".vectorize(" << x.name() << ", " << width << ", Tail_GuardWithIf)";
+                }
+                if (f.args().size() > 1) {
+                    Var y(f.args().back());
+                    handle.parallel(y);
+                    source << ".parallel(" << y.name() << ")";
+                }
+            }
+            source << ";\n";
+            return;
+        }
+
+        group[name] = name;
+        const vector<int> &size = tile_size[name];
+
+        Var x(f.args()[0]), xo(outer(x.name())), xi(inner(x.name()));
+        if (f.args().size() == 1 || size[1] == 1) {
+            handle.split(x, xo, xi, size[0], Tail_GuardWithIf);
+            source << ".split(" << x.name() << ", " << xo.name() << ", " << xi.name()
+                   << ", " << size[0] << ", Tail_GuardWithIf)";
+            Var p = f.args().size() == 1 ? xo : Var(f.args().back());
+            handle.parallel(p);
+            source << ".parallel(" << p.name() << ")";
+        } else {
+            Var y(f.args()[1]), yo(outer(y.name())), yi(inner(y.name()));
+            handle.tile(x, y, xo, yo, xi, yi, size[0], size[1], Tail_GuardWithIf);
+            handle.parallel(yo);
+            source << ".tile(" << x.name() << ", " << y.name() << ", "
+                   << xo.name() << ", " << yo.name() << ", "
+                   << xi.name() << ", " << yi.name() << ", "
+                   << size[0] << ", " << size[1] << ", Tail_GuardWithIf)"
+                   << ".parallel(" << yo.name() << ")";
+        }
+        if (size[0] >= width) {
+            handle.vectorize(xi, width, Tail_GuardWithIf);
+            source << ".vectorize(" << xi.name() << ", " << width << ", Tail_GuardWithIf)";
+        }
+        source << ";\n";
+    }
+
+    void schedule_per_tile(Function f, Function root, int inner_extent) {
+        Func handle(f);
+        Var xo(outer(root.args()[0]));
+        handle.compute_at(Func(root), xo);
+        source << f.name() << ".compute_at(" << root.name() << ", " << xo.name() << ")";
+        int width = vector_width(f);
+        if (inner_extent >= width) {
+            Var x(f.args()[0]);
+            handle.vectorize(x, width, Tail_GuardWithIf);
+            source << ".vectorize(" << x.name() << ", " << width << ", Tail_GuardWithIf)";
+        }
+        source << ";\n";
+    }
+
+public:
+    string output;
+
+    AutoScheduler(const map<string, Function> &e, const Target &t) : env(e), target(t) {
+        for (map<string, Function>::const_iterator iter = env.begin(); iter != env.end(); ++iter) {
+            map<string, Function> inputs = find_direct_calls(iter->second);
+            for (map<string, Function>::iterator i = inputs.begin(); i != inputs.end(); ++i) {
+                if (i->first != iter->first) {
+                    consumers[i->first].insert(iter->first);
+                }
+            }
+            CountCalls counter = count_calls(iter->second);
+            for (map<string, int>::iterator i = counter.calls.begin(); i != counter.calls.end(); ++i) {
+                if (i->first != iter->first) {
+                    calls[i->first] += i->second;
+                }
+            }
+        }
+    }
+
+    void run(Function out, const vector<string> &order) {
+        output = out.name();
+
+        Box &r = region[output];
+        const vector<Schedule::Bound> &estimates = out.schedule().estimates;
+        r.resize(out.args().size());
+        for (size_t i = 0; i < out.args().size(); i++) {
+            for (size_t j = 0; j < estimates.size(); j++) {
+                if (estimates[j].var == out.args()[i]) {
+                    r[i] = Interval(estimates[j].min, estimates[j].min + estimates[j].extent - 1);
+                }
+            }
+            if (!r[i].min.defined()) {
+                debug(1) << "Not scheduling " << output << " automatically, because dimension "
+                         << out.args()[i] << " has no estimate\n";
+                return;
+            }
+        }
+
+        if (is_unscheduled(out)) {
+            schedule_root(out);
+        } else {
+            group[output] = "";
+        }
+
+        for (size_t i = order.size(); i > 0; i--) {
+            if (order[i-1] != output) {
+                choose(func(order[i-1]));
+            }
+        }
+
+        debug(1) << "Automatic schedule of " << output << ":\n" << source.str();
+    }
+};
+
+}
+
+void auto_schedule(Function output, const vector<string> &order,
+                   const map<string, Function> &env, const Target &t) {
+    AutoScheduler scheduler(env, t);
+    scheduler.run(output, order);
+}
+
+}
+}
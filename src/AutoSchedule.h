@@ -0,0 +1,38 @@
+#ifndef HALIDE_AUTO_SCHEDULE_H
+#define HALIDE_AUTO_SCHEDULE_H
+
+/** \file
+ * Defines a pass that chooses schedules for the functions of a
+ * pipeline that haven't been scheduled.
+ */
+
+#include "IR.h"
+#include "Function.h"
+#include "Target.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Halide {
+namespace Internal {
+
+/** Choose a schedule for each function of a pipeline that hasn't been
+ * scheduled, given estimates of the region of the output that will be
+ * computed (see \ref Func::estimate). Functions that are cheap, or
+ * used once by a single consumer, are inlined. The output, and
+ * functions whose tiles would mostly be recomputed, are computed at
+ * the root and tiled, and their other producers are computed per tile
+ * where the redundant work that causes is small. Root-level loops are
+ * parallelized, and the innermost dimension of each function is
+ * vectorized. Functions with update definitions are computed at the
+ * root, with only their pure definitions vectorized and parallelized.
+ * The schedules are set on the functions, as if by the scheduling
+ * calls of Func. Must run before the realizations are injected. */
+void auto_schedule(Function output, const std::vector<std::string> &order,
+                   const std::map<std::string, Function> &env, const Target &t);
+
+}
+}
+
+#endif
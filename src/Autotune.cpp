@@ -0,0 +1,384 @@
+#include "Autotune.h"
+#include "FindCalls.h"
+#include "Util.h"
+#include "Debug.h"
+
+#include <fstream>
+#include <sstream>
+#include <map>
+
+namespace Halide {
+
+using std::string;
+using std::vector;
+using std::map;
+using std::ostringstream;
+using std::istringstream;
+using std::pair;
+using std::make_pair;
+
+using namespace Internal;
+
+namespace {
+
+// A candidate this much slower than the best so far after its first
+// timing isn't timed again.
+const double prune_ratio = 2.0;
+
+// How many times each candidate is timed, after warming up.
+const int timings = 5;
+
+string outer(const string &var) {return var + "_outer";}
+string inner(const string &var) {return var + "_inner";}
+
+// The decisions for one Func in a list of settings.
+struct FuncSettings {
+    vector<pair<string, int> > splits, vectorizes;
+    vector<string> parallels;
+    // Empty if it's left as it was, "inline", "root", or a consumer
+    // and a var.
+    string compute_level;
+
+    bool is_split(const string &var) const {
+        for (size_t i = 0; i < splits.size(); i++) {
+            if (splits[i].first == var) return true;
+        }
+        return false;
+    }
+};
+
+map<string, Function> pipeline_env(Func output) {
+    map<string, Function> env = find_transitive_calls(output.function());
+    env[output.name()] = output.function();
+    return env;
+}
+
+// Set the decisions in a list of settings on the functions of env
+// (if schedule is true), and write them as code.
+void apply_settings(const vector<string> &lines, const map<string, Function> &env,
+                    bool schedule, ostringstream &source) {
+    vector<string> order;
+    map<string, FuncSettings> funcs;
+    for (size_t i = 0; i < lines.size(); i++) {
+        istringstream line(lines[i]);
+        string func, kind, var;
+        line >> func >> kind;
+        if (func.empty() || func[0] == '#') continue;
+
+        if (!env.count(func)) {
+            std::cerr << "Tuned schedule refers to " << func
+                      << ", which isn't in this pipeline\n";
+            assert(false);
+        }
+        if (!funcs.count(func)) order.push_back(func);
+        FuncSettings &f = funcs[func];
+
+        int factor = 0;
+        if (kind == "split" && (line >> var >> factor) && factor > 0) {
+            f.splits.push_back(make_pair(var, factor));
+        } else if (kind == "vectorize" && (line >> var >> factor) && factor > 0) {
+            f.vectorizes.push_back(make_pair(var, factor));
+        } else if (kind == "parallel" && (line >> var)) {
+            f.parallels.push_back(var);
+        } else if (kind == "compute_inline") {
+            f.compute_level = "inline";
+        } else if (kind == "compute_root") {
+            f.compute_level = "root";
+        } else if (kind == "compute_at" && (line >> var)) {
+            string consumer = var;
+            if (!(line >> var) || !env.count(consumer)) {
+                std::cerr << "Bad compute_at in tuned schedule: " << lines[i] << "\n";
+                assert(false);
+            }
+            f.compute_level = consumer + " " + var;
+        } else {
+            std::cerr << "Bad line in tuned schedule: " << lines[i] << "\n";
+            assert(false);
+        }
+    }
+
+    for (size_t i = 0; i < order.size(); i++) {
+        const string &name = order[i];
+        const FuncSettings &f = funcs[name];
+        Func handle(env.find(name)->second);
+
+        if (!f.splits.empty() || !f.vectorizes.empty() || !f.parallels.empty()) {
+            source << name;
+        }
+
+        vector<string> inners, outers;
+        for (size_t j = 0; j < f.splits.size(); j++) {
+            const string &v = f.splits[j].first;
+            int factor = f.splits[j].second;
+            if (schedule) handle.split(Var(v), Var(outer(v)), Var(inner(v)), factor, Tail_GuardWithIf);
+            source << ".split(" << v << ", " << outer(v) << ", " << inner(v)
+                   << ", " << factor << ", Tail_GuardWithIf)";
+            inners.push_back(inner(v));
+            outers.push_back(outer(v));
+        }
+        if (inners.size() > 1) {
+            // Tile it.
+            vector<string> names = inners;
+            names.insert(names.end(), outers.begin(), outers.end());
+            vector<VarOrRVar> vars;
+            source << ".reorder(";
+            for (size_t j = 0; j < names.size(); j++) {
+                vars.push_back(Var(names[j]));
+                source << (j ? ", " : "") << names[j];
+            }
+            if (schedule) handle.reorder(vars);
+            source << ")";
+        }
+
+        for (size_t j = 0; j < f.vectorizes.size(); j++) {
+            string v = f.vectorizes[j].first;
+            if (f.is_split(v)) v = inner(v);
+            int width = f.vectorizes[j].second;
+            if (schedule) handle.vectorize(Var(v), width, Tail_GuardWithIf);
+            source << ".vectorize(" << v << ", " << width << ", Tail_GuardWithIf)";
+        }
+
+        for (size_t j = 0; j < f.parallels.size(); j++) {
+            string v = f.parallels[j];
+            if (f.is_split(v)) v = outer(v);
+            if (schedule) handle.parallel(Var(v));
+            source << ".parallel(" << v << ")";
+        }
+
+        if (!f.splits.empty() || !f.vectorizes.empty() || !f.parallels.empty()) {
+            source << ";\n";
+        }
+
+        if (f.compute_level == "inline") {
+            if (schedule) handle.compute_inline();
+            source << name << ".compute_inline();\n";
+        } else if (f.compute_level == "root") {
+            if (schedule) handle.compute_root();
+            source << name << ".compute_root();\n";
+        } else if (!f.compute_level.empty()) {
+            istringstream level(f.compute_level);
+            string consumer, v;
+            level >> consumer >> v;
+            if (funcs.count(consumer) && funcs[consumer].is_split(v)) v = outer(v);
+            if (schedule) handle.compute_at(Func(env.find(consumer)->second), Var(v));
+            source << name << ".compute_at(" << consumer << ", " << v << ");\n";
+        }
+    }
+}
+
+}
+
+int Autotuner::Knob::num_options() const {
+    switch (kind) {
+    case Split:
+    case Vectorize:
+        return (int)factors.size();
+    case Parallel:
+        return (int)vars.size() + 1;
+    default:
+        return (int)vars.size() + 2;
+    }
+}
+
+string Autotuner::Knob::option(int i) const {
+    ostringstream line;
+    switch (kind) {
+    case Split:
+    case Vectorize:
+        if (factors[i] <= 1) return "";
+        line << func << (kind == Split ? " split " : " vectorize ") << var << " " << factors[i];
+        break;
+    case Parallel:
+        if (i == 0) return "";
+        line << func << " parallel " << vars[i-1];
+        break;
+    default:
+        if (i == 0) {
+            line << func << " compute_inline";
+        } else if (i == 1) {
+            line << func << " compute_root";
+        } else {
+            line << func << " compute_at " << consumer << " " << vars[i-2];
+        }
+    }
+    return line.str();
+}
+
+Autotuner::Autotuner(Func o) : output(o), best_ms(0) {}
+
+Autotuner &Autotuner::split(Func f, Var var, const vector<int> &factors) {
+    assert(!factors.empty() && "A knob needs at least one option");
+    Knob k;
+    k.kind = Knob::Split;
+    k.func = f.name();
+    k.var = var.name();
+    k.factors = factors;
+    knobs.push_back(k);
+    return *this;
+}
+
+Autotuner &Autotuner::vectorize(Func f, Var var, const vector<int> &widths) {
+    assert(!widths.empty() && "A knob needs at least one option");
+    Knob k;
+    k.kind = Knob::Vectorize;
+    k.func = f.name();
+    k.var = var.name();
+    k.factors = widths;
+    knobs.push_back(k);
+    return *this;
+}
+
+Autotuner &Autotuner::parallel(Func f, const vector<Var> &vars) {
+    Knob k;
+    k.kind = Knob::Parallel;
+    k.func = f.name();
+    for (size_t i = 0; i < vars.size(); i++) {
+        k.vars.push_back(vars[i].name());
+    }
+    knobs.push_back(k);
+    return *this;
+}
+
+Autotuner &Autotuner::compute_at(Func f, Func consumer, const vector<Var> &vars) {
+    Knob k;
+    k.kind = Knob::ComputeAt;
+    k.func = f.name();
+    k.consumer = consumer.name();
+    for (size_t i = 0; i < vars.size(); i++) {
+        k.vars.push_back(vars[i].name());
+    }
+    knobs.push_back(k);
+    return *this;
+}
+
+vector<string> Autotuner::settings(const vector<int> &choice) const {
+    vector<string> lines;
+    for (size_t i = 0; i < knobs.size(); i++) {
+        string line = knobs[i].option(choice[i]);
+        if (!line.empty()) lines.push_back(line);
+    }
+    return lines;
+}
+
+double Autotuner::tune(const vector<int> &sizes, int max_candidates, const Target &target) {
+    map<string, Function> env = pipeline_env(output);
+    for (size_t i = 0; i < knobs.size(); i++) {
+        if (!env.count(knobs[i].func) || (!knobs[i].consumer.empty() && !env.count(knobs[i].consumer))) {
+            std::cerr << "Can't tune " << knobs[i].func << ", which isn't in the pipeline of "
+                      << output.name() << "\n";
+            assert(false);
+        }
+    }
+
+    // The schedules to try the candidates on top of.
+    map<string, Schedule> initial;
+    for (map<string, Function>::iterator iter = env.begin(); iter != env.end(); ++iter) {
+        initial[iter->first] = iter->second.schedule();
+    }
+
+    Realization dst = Func(output.function()).realize(sizes, target);
+
+    map<vector<int>, double> tried;
+    vector<int> current(knobs.size(), 0);
+    best.clear();
+    best_ms = 0;
+
+    int candidates = 0;
+    bool improved = true;
+    while (improved && candidates < max_candidates) {
+        improved = false;
+        // Time the current choice (the first time around), and then
+        // each change to one knob of it.
+        for (int k = -1; k < (int)knobs.size() && candidates < max_candidates; k++) {
+            int options = k < 0 ? 1 : knobs[k].num_options();
+            for (int o = 0; o < options && candidates < max_candidates; o++) {
+                vector<int> choice = current;
+                if (k >= 0) choice[k] = o;
+                if (tried.count(choice)) continue;
+
+                for (map<string, Function>::iterator iter = env.begin(); iter != env.end(); ++iter) {
+                    iter->second.schedule() = initial[iter->first];
+                }
+                ostringstream source;
+                apply_settings(settings(choice), env, true, source);
+
+                // A new Func, so that it's compiled again, and the
+                // first run compiles it and warms the caches.
+                Func f(output.function());
+                f.realize(dst, target);
+
+                double ms = 0;
+                for (int t = 0; t < timings; t++) {
+                    double start = current_time_ms();
+                    f.realize(dst, target);
+                    double elapsed = current_time_ms() - start;
+                    if (t == 0 || elapsed < ms) ms = elapsed;
+                    if (!best.empty() && ms > prune_ratio * best_ms) break;
+                }
+                tried[choice] = ms;
+                candidates++;
+                debug(1) << "Candidate " << candidates << ": " << ms << " ms\n" << source.str();
+
+                if (best.empty() || ms < best_ms) {
+                    best = choice;
+                    best_ms = ms;
+                    current = choice;
+                    improved = true;
+                }
+            }
+        }
+    }
+
+    for (map<string, Function>::iterator iter = env.begin(); iter != env.end(); ++iter) {
+        iter->second.schedule() = initial[iter->first];
+    }
+
+    debug(0) << "Best of " << candidates << " schedules of " << output.name()
+             << ": " << best_ms << " ms\n" << schedule_source();
+    return best_ms;
+}
+
+void Autotuner::apply() const {
+    assert(!best.empty() && "Autotuner::apply called before tune");
+    ostringstream source;
+    apply_settings(settings(best), pipeline_env(output), true, source);
+}
+
+void Autotuner::save(const string &filename) const {
+    assert(!best.empty() && "Autotuner::save called before tune");
+    std::ofstream file(filename.c_str());
+    if (!file) {
+        std::cerr << "Could not open " << filename << " to write the tuned schedule\n";
+        assert(false);
+    }
+    file << "# " << output.name() << ": " << best_ms << " ms\n";
+    vector<string> lines = settings(best);
+    for (size_t i = 0; i < lines.size(); i++) {
+        file << lines[i] << "\n";
+    }
+}
+
+string Autotuner::schedule_source() const {
+    assert(!best.empty() && "Autotuner::schedule_source called before tune");
+    ostringstream source;
+    apply_settings(settings(best), pipeline_env(output), false, source);
+    return source.str();
+}
+
+void apply_tuned_schedule(Func output, const string &filename) {
+    std::ifstream file(filename.c_str());
+    if (!file) {
+        std::cerr << "Could not open tuned schedule " << filename << "\n";
+        assert(false);
+    }
+    vector<string> lines;
+    string line;
+    while (std::getline(file, line)) {
+        lines.push_back(line);
+    }
+    ostringstream source;
+    apply_settings(lines, pipeline_env(output), true, source);
+    debug(1) << "Applied tuned schedule " << filename << ":\n" << source.str();
+}
+
+}
@@ -0,0 +1,112 @@
+#ifndef HALIDE_AUTOTUNE_H
+#define HALIDE_AUTOTUNE_H
+
+/** \file
+ * Defines a way to search for the fastest of a space of schedules
+ */
+
+#include "Func.h"
+#include "Target.h"
+
+#include <string>
+#include <vector>
+
+namespace Halide {
+
+/** Searches a space of schedules for a pipeline by jit-compiling and
+ * timing the candidates. The space is described by a list of knobs,
+ * each of which is one scheduling decision for one Func with a list
+ * of options to choose from. For example:
+ \code
+ Autotuner tuner(out);
+ tuner.split(blur_x, x, vec(1, 8, 16, 32))
+      .vectorize(blur_x, x, vec(1, 4, 8))
+      .parallel(out, vec(y))
+      .compute_at(blur_x, out, vec(x, y));
+ tuner.tune(vec(1536, 2560));
+ tuner.save("out.schedule");
+ \endcode
+ *
+ * The knobs apply to the pure definitions. Splits are by
+ * Tail_GuardWithIf, into var_outer and var_inner; if more than one
+ * var of a Func is split, the inner vars are moved inside the outer
+ * ones (i.e. it's tiled). Vectorizing a var that was split vectorizes
+ * its inner var, and parallelizing one, or computing another Func at
+ * one, uses its outer var. The knobs are applied on top of whatever
+ * schedule the Funcs had when tune was called, which is restored
+ * afterwards. Every option must give a valid schedule.
+ *
+ * The search starts with the first option of every knob, and then
+ * changes one knob at a time, keeping any change that makes it
+ * faster, until no single change helps. Each candidate is run once to
+ * compile and warm up, and then timed several times; candidates much
+ * slower than the best so far are dropped after one timing. Candidates
+ * that lower to the same code are only compiled once, because of the
+ * jit cache. */
+class Autotuner {
+public:
+    EXPORT Autotuner(Func output);
+
+    /** Try splitting var of f by each factor. A factor of one
+     * doesn't split it. */
+    EXPORT Autotuner &split(Func f, Var var, const std::vector<int> &factors);
+
+    /** Try vectorizing var of f by each width. A width of one
+     * doesn't vectorize it. */
+    EXPORT Autotuner &vectorize(Func f, Var var, const std::vector<int> &widths);
+
+    /** Try parallelizing none of the vars of f, and then each of
+     * the given ones. */
+    EXPORT Autotuner &parallel(Func f, const std::vector<Var> &vars);
+
+    /** Try inlining f, computing it at the root, and computing it at
+     * each of the vars of the consumer. */
+    EXPORT Autotuner &compute_at(Func f, Func consumer, const std::vector<Var> &vars);
+
+    /** Search for the fastest schedule, realizing the output over the
+     * given sizes. At most max_candidates are timed. Returns the time
+     * in milliseconds of the best one, which is also printed at debug
+     * level 0 along with the schedule chosen. */
+    EXPORT double tune(const std::vector<int> &sizes, int max_candidates = 100,
+                       const Target &target = get_jit_target_from_environment());
+
+    /** Set the schedule found by tune on the Funcs, to use it directly. */
+    EXPORT void apply() const;
+
+    /** Write the schedule found by tune to a file, one decision per
+     * line, to be replayed with apply_tuned_schedule. The Funcs are
+     * identified by name, so give them names that don't change from
+     * one run of the program to the next. */
+    EXPORT void save(const std::string &filename) const;
+
+    /** The schedule found by tune, as code. */
+    EXPORT std::string schedule_source() const;
+
+private:
+    struct Knob {
+        enum Kind {Split, Vectorize, Parallel, ComputeAt};
+        Kind kind;
+        std::string func, var, consumer;
+        std::vector<int> factors;
+        std::vector<std::string> vars;
+
+        int num_options() const;
+        std::string option(int i) const;
+    };
+    Func output;
+    std::vector<Knob> knobs;
+    std::vector<int> best;
+    double best_ms;
+
+    /** The decisions of a candidate, in the format of the saved
+     * files. */
+    std::vector<std::string> settings(const std::vector<int> &choice) const;
+};
+
+/** Set the schedule in a file written by Autotuner::save on the Funcs
+ * of the pipeline that computes output. */
+EXPORT void apply_tuned_schedule(Func output, const std::string &filename);
+
+}
+
+#endif
@@ -0,0 +1,142 @@
+#include "BatchCompile.h"
+#include "StmtCompiler.h"
+#include "Lower.h"
+#include "ParallelPasses.h"
+#include "LLVM_Headers.h"
+#include <llvm/Support/Threading.h>
+
+// llvm includes above disable assert.  Include Util.h here
+// to reenable assert.
+#include "Util.h"
+#include "Debug.h"
+
+#ifndef _MSC_VER
+#include <pthread.h>
+#endif
+
+namespace Halide {
+
+using std::string;
+using std::vector;
+
+// Defined in Func.cpp
+void validate_arguments(const string &output,
+                        const vector<Argument> &args,
+                        Internal::Stmt lowered,
+                        vector<Buffer> &images_to_embed);
+
+namespace Internal {
+
+namespace {
+
+// A lowered pipeline waiting for code generation.
+struct LoweredJob {
+    Stmt lowered;
+    string name, object_file;
+    vector<Argument> args;
+    vector<Buffer> images_to_embed;
+    StmtCompiler *cg;
+};
+
+void codegen_job(LoweredJob *job) {
+    job->cg->compile(job->lowered, job->name, job->args, job->images_to_embed);
+    job->cg->compile_to_native(job->object_file, false);
+    // Free the llvm module now rather than when the batch is done.
+    delete job->cg;
+    job->cg = NULL;
+}
+
+struct CodegenQueue {
+    vector<LoweredJob *> jobs;
+    volatile int next;
+};
+
+#ifndef _MSC_VER
+void *codegen_worker(void *arg) {
+    CodegenQueue *queue = (CodegenQueue *)arg;
+    while (true) {
+        int i = __sync_fetch_and_add(&queue->next, 1);
+        if (i >= (int)queue->jobs.size()) break;
+        codegen_job(queue->jobs[i]);
+    }
+    return NULL;
+}
+#endif
+
+}
+
+}
+
+void compile_batch_to_file(const vector<BatchCompileJob> &jobs, int num_threads) {
+    using namespace Internal;
+
+    // Lowering and the headers are done serially. Lowering reads and
+    // writes state shared between pipelines (the Functions, and the
+    // unique name counters), and it's usually the cheaper part.
+    vector<LoweredJob *> lowered(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const BatchCompileJob &job = jobs[i];
+        Func f = job.func;
+        assert(f.defined() && "Can't compile undefined function");
+
+        f.compile_to_header(job.filename_prefix + ".h", job.args, job.name);
+
+        LoweredJob *l = new LoweredJob;
+        // Making the StmtCompiler here also initializes llvm before
+        // any worker threads start.
+        l->cg = new StmtCompiler(job.target);
+        l->lowered = lower(f.function(), job.target);
+        l->name = job.name;
+        l->object_file = job.filename_prefix + ".o";
+        l->args = job.args;
+        validate_arguments(job.name, l->args, l->lowered, l->images_to_embed);
+        vector<OutputImageParam> outputs = f.output_buffers();
+        for (size_t j = 0; j < outputs.size(); j++) {
+            l->args.push_back(outputs[j]);
+        }
+        lowered[i] = l;
+    }
+
+    if (num_threads <= 0) {
+        num_threads = num_compile_threads();
+    }
+    if (num_threads > (int)jobs.size()) {
+        num_threads = (int)jobs.size();
+    }
+
+    #ifdef _MSC_VER
+    num_threads = 1;
+    #endif
+
+    debug(1) << "Generating code for " << jobs.size()
+             << " pipelines on " << num_threads << " threads\n";
+
+    if (num_threads <= 1) {
+        for (size_t i = 0; i < lowered.size(); i++) {
+            codegen_job(lowered[i]);
+        }
+    } else {
+        #ifndef _MSC_VER
+        #if LLVM_VERSION < 35
+        llvm::llvm_start_multithreaded();
+        #endif
+
+        CodegenQueue queue;
+        queue.jobs = lowered;
+        queue.next = 0;
+        vector<pthread_t> threads(num_threads);
+        for (int i = 0; i < num_threads; i++) {
+            pthread_create(&threads[i], NULL, codegen_worker, &queue);
+        }
+        for (int i = 0; i < num_threads; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        #endif
+    }
+
+    for (size_t i = 0; i < lowered.size(); i++) {
+        delete lowered[i];
+    }
+}
+
+}
@@ -0,0 +1,54 @@
+#ifndef HALIDE_BATCH_COMPILE_H
+#define HALIDE_BATCH_COMPILE_H
+
+/** \file
+ * Defines a way to ahead-of-time compile many pipelines at once
+ */
+
+#include "Func.h"
+#include "Argument.h"
+#include "Target.h"
+
+#include <string>
+#include <vector>
+
+namespace Halide {
+
+/** One pipeline to be compiled by compile_batch_to_file. */
+struct BatchCompileJob {
+    /** The output Func of the pipeline. */
+    Func func;
+
+    /** The arguments of the generated function, as for
+     * Func::compile_to_file. */
+    std::vector<Argument> args;
+
+    /** The name of the generated function. */
+    std::string name;
+
+    /** The target to compile for. */
+    Target target;
+
+    /** The path, without extension, of the header and object file to
+     * write. Defaults to the name of the generated function. */
+    std::string filename_prefix;
+
+    BatchCompileJob(Func f, const std::vector<Argument> &a, const std::string &n,
+                    const Target &t = get_target_from_environment(),
+                    const std::string &prefix = "") :
+        func(f), args(a), name(n), target(t),
+        filename_prefix(prefix.empty() ? n : prefix) {}
+};
+
+/** Compile a list of pipelines to a header and an object file each,
+ * as if by calling compile_to_file on each one. The pipelines are
+ * lowered one at a time, and then the llvm optimization and code
+ * generation for them (usually most of the time taken) is done on
+ * num_threads threads. If num_threads is zero, the environment
+ * variable HL_NUMTHREADS is used, or else the number of cores. On
+ * Windows the pipelines are compiled one at a time. */
+EXPORT void compile_batch_to_file(const std::vector<BatchCompileJob> &jobs, int num_threads = 0);
+
+}
+
+#endif
@@ -0,0 +1,186 @@
+#include "BoundaryConditions.h"
+#include "IROperator.h"
+#include "Util.h"
+
+namespace Halide {
+namespace BoundaryConditions {
+
+using std::vector;
+using std::pair;
+using std::make_pair;
+
+namespace {
+
+// The ways a coordinate outside of the bounds can be mapped back
+// inside them.
+enum Rule {RepeatEdge, ConstantExterior, RepeatImage, MirrorImage};
+
+vector<Var> make_args(int dims) {
+    vector<Var> args;
+    for (int i = 0; i < dims; i++) {
+        args.push_back(Var());
+    }
+    return args;
+}
+
+vector<Expr> as_exprs(vector<Var> args) {
+    vector<Expr> exprs;
+    for (size_t i = 0; i < args.size(); i++) {
+        exprs.push_back(args[i]);
+    }
+    return exprs;
+}
+
+// Wrap an image in a Func with pure arguments, so that it can be
+// treated like any other source.
+Func image_func(Expr call, const vector<Var> &args) {
+    Func f("image" + Internal::unique_name('_'));
+    f(args) = call;
+    return f;
+}
+
+Func image_func(const ImageParam &source) {
+    vector<Var> args = make_args(source.dimensions());
+    return image_func(Internal::Call::make(source.parameter(), as_exprs(args)), args);
+}
+
+Func image_func(const Buffer &source) {
+    vector<Var> args = make_args(source.dimensions());
+    return image_func(Internal::Call::make(source, as_exprs(args)), args);
+}
+
+vector<pair<Expr, Expr> > image_bounds(const ImageParam &source) {
+    vector<pair<Expr, Expr> > bounds;
+    for (int i = 0; i < source.dimensions(); i++) {
+        bounds.push_back(make_pair(source.min(i), source.extent(i)));
+    }
+    return bounds;
+}
+
+vector<pair<Expr, Expr> > image_bounds(const Buffer &source) {
+    vector<pair<Expr, Expr> > bounds;
+    for (int i = 0; i < source.dimensions(); i++) {
+        bounds.push_back(make_pair(Expr(source.min(i)), Expr(source.extent(i))));
+    }
+    return bounds;
+}
+
+Func bound(const Func &source, const vector<pair<Expr, Expr> > &bounds, Rule rule, Expr value) {
+    assert(source.defined() && "Can't impose a boundary condition on an undefined Func");
+    vector<Var> args = source.args();
+    assert(bounds.size() <= args.size() &&
+           "Boundary condition has more bounds than the Func has dimensions");
+
+    const char *names[] = {"repeat_edge", "constant_exterior", "repeat_image", "mirror_image"};
+    Func bounded(source.name() + "_" + names[rule] + Internal::unique_name('_'));
+
+    vector<Expr> coords = as_exprs(args);
+    Expr outside = Internal::const_false();
+    for (size_t i = 0; i < bounds.size(); i++) {
+        Expr min = bounds[i].first, extent = bounds[i].second;
+        if (!min.defined() && !extent.defined()) continue;
+        assert(min.defined() && extent.defined() &&
+               "A boundary condition needs both the min and the extent of a dimension");
+
+        Var x = args[i];
+        Expr max = min + extent - 1;
+        Expr is_outside = x < min || x > max;
+        // Inside the bounds, the coordinate is clamped too, so that
+        // bounds inference knows it can't leave them.
+        Expr inside = clamp(x, min, max);
+
+        switch (rule) {
+        case RepeatEdge:
+            coords[i] = inside;
+            break;
+        case ConstantExterior:
+            outside = outside || is_outside;
+            coords[i] = inside;
+            break;
+        case RepeatImage: {
+            Expr wrapped = (x - min) % extent + min;
+            coords[i] = select(is_outside, clamp(wrapped, min, max), inside);
+            break;
+        }
+        case MirrorImage: {
+            Expr c = (x - min) % (2 * extent);
+            c = Halide::min(c, 2 * extent - 1 - c) + min;
+            coords[i] = select(is_outside, clamp(c, min, max), inside);
+            break;
+        }
+        }
+    }
+
+    if (rule == ConstantExterior) {
+        if (source.outputs() > 1) {
+            vector<Expr> values;
+            for (int i = 0; i < source.outputs(); i++) {
+                Expr v = cast(source.output_types()[i], value);
+                values.push_back(select(outside, v, source(coords)[i]));
+            }
+            bounded(args) = Tuple(values);
+        } else {
+            Expr v = cast(source.output_types()[0], value);
+            bounded(args) = select(outside, v, source(coords));
+        }
+    } else if (source.outputs() > 1) {
+        bounded(args) = Tuple(source(coords));
+    } else {
+        bounded(args) = source(coords);
+    }
+    return bounded;
+}
+
+}
+
+Func repeat_edge(const Func &source, const vector<pair<Expr, Expr> > &bounds) {
+    return bound(source, bounds, RepeatEdge, Expr());
+}
+
+Func repeat_edge(const ImageParam &source) {
+    return repeat_edge(image_func(source), image_bounds(source));
+}
+
+Func repeat_edge(const Buffer &source) {
+    return repeat_edge(image_func(source), image_bounds(source));
+}
+
+Func constant_exterior(const Func &source, Expr value, const vector<pair<Expr, Expr> > &bounds) {
+    assert(value.defined() && "constant_exterior needs a value to use outside the bounds");
+    return bound(source, bounds, ConstantExterior, value);
+}
+
+Func constant_exterior(const ImageParam &source, Expr value) {
+    return constant_exterior(image_func(source), value, image_bounds(source));
+}
+
+Func constant_exterior(const Buffer &source, Expr value) {
+    return constant_exterior(image_func(source), value, image_bounds(source));
+}
+
+Func repeat_image(const Func &source, const vector<pair<Expr, Expr> > &bounds) {
+    return bound(source, bounds, RepeatImage, Expr());
+}
+
+Func repeat_image(const ImageParam &source) {
+    return repeat_image(image_func(source), image_bounds(source));
+}
+
+Func repeat_image(const Buffer &source) {
+    return repeat_image(image_func(source), image_bounds(source));
+}
+
+Func mirror_image(const Func &source, const vector<pair<Expr, Expr> > &bounds) {
+    return bound(source, bounds, MirrorImage, Expr());
+}
+
+Func mirror_image(const ImageParam &source) {
+    return mirror_image(image_func(source), image_bounds(source));
+}
+
+Func mirror_image(const Buffer &source) {
+    return mirror_image(image_func(source), image_bounds(source));
+}
+
+}
+}
@@ -0,0 +1,86 @@
+#ifndef HALIDE_BOUNDARY_CONDITIONS_H
+#define HALIDE_BOUNDARY_CONDITIONS_H
+
+/** \file
+ * Support for imposing boundary conditions on Halide Funcs and
+ * images.
+ */
+
+#include <vector>
+#include <utility>
+
+#include "Func.h"
+#include "Param.h"
+#include "Buffer.h"
+
+namespace Halide {
+
+/** Functions that extend a Func or an image beyond some bounds, so
+ * that it can be accessed anywhere. Each returns a new Func that is
+ * the source inside the bounds, and follows some rule outside of
+ * them.
+ *
+ * The bounds are given as a (min, extent) pair per dimension,
+ * starting with the first. Dimensions past the end of the list, or
+ * with an undefined min and extent, are left unbounded. Images and
+ * image parameters are bounded by their own size.
+ *
+ * The new Funcs are meant to be inlined into the stencils that use
+ * them. Their coordinates are written as clamps and selects that
+ * lowering recognizes (see SpecializeClampedRamps.h), so when the
+ * consumer is vectorized along a dimension, the vectors that are
+ * entirely inside the bounds use dense loads of the source, and only
+ * the ones that straddle an edge pay for the boundary condition.
+ *
+ * Example:
+ \code
+ ImageParam input(UInt(8), 2);
+ Func clamped = BoundaryConditions::repeat_edge(input);
+ Func blur;
+ blur(x, y) = (clamped(x-1, y) + clamped(x, y) + clamped(x+1, y)) / 3;
+ blur.vectorize(x, 16);
+ \endcode
+ */
+namespace BoundaryConditions {
+
+/** Outside the bounds, take the value of the nearest point on the
+ * edge. The bounds must not be empty. */
+// @{
+EXPORT Func repeat_edge(const Func &source, const std::vector<std::pair<Expr, Expr> > &bounds);
+EXPORT Func repeat_edge(const ImageParam &source);
+EXPORT Func repeat_edge(const Buffer &source);
+// @}
+
+/** Outside the bounds, take the given value, which is cast to the
+ * type of each output of the source. The source is still only
+ * accessed inside the bounds, which must not be empty. */
+// @{
+EXPORT Func constant_exterior(const Func &source, Expr value,
+                              const std::vector<std::pair<Expr, Expr> > &bounds);
+EXPORT Func constant_exterior(const ImageParam &source, Expr value);
+EXPORT Func constant_exterior(const Buffer &source, Expr value);
+// @}
+
+/** Outside the bounds, repeat the source as a tiling, so that the
+ * coordinates wrap around. */
+// @{
+EXPORT Func repeat_image(const Func &source, const std::vector<std::pair<Expr, Expr> > &bounds);
+EXPORT Func repeat_image(const ImageParam &source);
+EXPORT Func repeat_image(const Buffer &source);
+// @}
+
+/** Outside the bounds, repeat the source mirrored at each edge, with
+ * the pixels on the edge repeated. E.g. with bounds [0, 4), the
+ * coordinates ... -2 -1 0 1 2 3 4 5 ... read the source at
+ * ... 1 0 0 1 2 3 3 2 ... */
+// @{
+EXPORT Func mirror_image(const Func &source, const std::vector<std::pair<Expr, Expr> > &bounds);
+EXPORT Func mirror_image(const ImageParam &source);
+EXPORT Func mirror_image(const Buffer &source);
+// @}
+
+}
+
+}
+
+#endif
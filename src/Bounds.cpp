@@ -1,4 +1,6 @@
 #include <iostream>
+#include <set>
+#include <algorithm>
 
 #include "Bounds.h"
 #include "IRVisitor.h"
@@ -20,6 +22,22 @@ using std::vector;
 using std::string;
 using std::pair;
 
+namespace {
+// Compares Exprs by node identity. Holding the Exprs as keys keeps the
+// nodes alive, so an address can't be reused by a different node
+// while it's in the table.
+struct ExprNodeCompare {
+    bool operator()(const Expr &a, const Expr &b) const {
+        return a.ptr < b.ptr;
+    }
+};
+}
+
+// The bounds already computed for each node under some fixed
+// scope. Exprs are often DAGs (e.g. after inlining), and walking them
+// as trees is exponential in their depth.
+typedef map<Expr, Interval, ExprNodeCompare> BoundsCache;
+
 class Bounds : public IRVisitor {
 public:
     Expr min, max;
@@ -27,8 +45,22 @@ public:
     Scope<Interval> inner_scope;
     const FuncValueBounds &func_bounds;
 
-    Bounds(const Scope<Interval> &s, const FuncValueBounds &fb) :
-        scope(s), func_bounds(fb) {}
+    // Must be cleared when the scope changes.
+    BoundsCache *cache;
+
+    Bounds(const Scope<Interval> &s, const FuncValueBounds &fb, BoundsCache *c) :
+        scope(s), func_bounds(fb), cache(c) {}
+
+    void bounds_of(Expr e) {
+        BoundsCache::iterator iter = cache->find(e);
+        if (iter != cache->end()) {
+            min = iter->second.min;
+            max = iter->second.max;
+        } else {
+            e.accept(this);
+            (*cache)[e] = Interval(min, max);
+        }
+    }
 private:
 
     // Compute the intrinsic bounds of a function.
@@ -77,7 +109,7 @@ private:
 
     void visit(const Cast *op) {
 
-        op->value.accept(this);
+        bounds_of(op->value);
         Expr min_a = min, max_a = max;
 
         if (min_a.same_as(op->value) && max_a.same_as(op->value)) {
@@ -180,9 +212,9 @@ private:
     }
 
     void visit(const Add *op) {
-        op->a.accept(this);
+        bounds_of(op->a);
         Expr min_a = min, max_a = max;
-        op->b.accept(this);
+        bounds_of(op->b);
         Expr min_b = min, max_b = max;
 
         if (min_a.same_as(op->a) && max_a.same_as(op->a) &&
@@ -222,9 +254,9 @@ private:
     }
 
     void visit(const Sub *op) {
-        op->a.accept(this);
+        bounds_of(op->a);
         Expr min_a = min, max_a = max;
-        op->b.accept(this);
+        bounds_of(op->b);
         Expr min_b = min, max_b = max;
 
         if (min_a.same_as(op->a) && max_a.same_as(op->a) &&
@@ -273,13 +305,13 @@ private:
     }
 
     void visit(const Mul *op) {
-        op->a.accept(this);
+        bounds_of(op->a);
         Expr min_a = min, max_a = max;
         if (!min_a.defined() || !max_a.defined()) {
             min = Expr(); max = Expr(); return;
         }
 
-        op->b.accept(this);
+        bounds_of(op->b);
         Expr min_b = min, max_b = max;
         if (!min_b.defined() || !max_b.defined()) {
             min = Expr(); max = Expr(); return;
@@ -357,13 +389,13 @@ private:
 
     void visit(const Div *op) {
 
-        op->a.accept(this);
+        bounds_of(op->a);
         Expr min_a = min, max_a = max;
         if (!min_a.defined() || !max_a.defined()) {
             min = Expr(); max = Expr(); return;
         }
 
-        op->b.accept(this);
+        bounds_of(op->b);
         Expr min_b = min, max_b = max;
         if (!min_b.defined() || !max_b.defined()) {
             min = Expr(); max = Expr(); return;
@@ -421,10 +453,10 @@ private:
     }
 
     void visit(const Mod *op) {
-        op->a.accept(this);
+        bounds_of(op->a);
         Expr min_a = min, max_a = max;
 
-        op->b.accept(this);
+        bounds_of(op->b);
         Expr min_b = min, max_b = max;
         if (!min_b.defined() || !max_b.defined()) {
             min = Expr(); max = Expr(); return;
@@ -451,9 +483,9 @@ private:
     }
 
     void visit(const Min *op) {
-        op->a.accept(this);
+        bounds_of(op->a);
         Expr min_a = min, max_a = max;
-        op->b.accept(this);
+        bounds_of(op->b);
         Expr min_b = min, max_b = max;
 
         debug(3) << "Bounds of " << Expr(op) << "\n";
@@ -488,9 +520,9 @@ private:
 
 
     void visit(const Max *op) {
-        op->a.accept(this);
+        bounds_of(op->a);
         Expr min_a = min, max_a = max;
-        op->b.accept(this);
+        bounds_of(op->b);
         Expr min_b = min, max_b = max;
 
         debug(3) << "Bounds of " << Expr(op) << "\n";
@@ -578,13 +610,13 @@ private:
     }
 
     void visit(const Select *op) {
-        op->true_value.accept(this);
+        bounds_of(op->true_value);
         Expr min_a = min, max_a = max;
         if (!min_a.defined() || !max_a.defined()) {
             min = Expr(); max = Expr(); return;
         }
 
-        op->false_value.accept(this);
+        bounds_of(op->false_value);
         Expr min_b = min, max_b = max;
         if (!min_b.defined() || !max_b.defined()) {
             min = Expr(); max = Expr(); return;
@@ -604,7 +636,7 @@ private:
     }
 
     void visit(const Load *op) {
-        op->index.accept(this);
+        bounds_of(op->index);
         if (min.defined() && min.same_as(max)) {
             // If the index is const we can return the load of that index
             min = max = Load::make(op->type, op->name, min, op->image, op->param);
@@ -631,7 +663,7 @@ private:
         std::vector<Expr> new_args(op->args.size());
         bool const_args = true;
         for (size_t i = 0; i < op->args.size() && const_args; i++) {
-            op->args[i].accept(this);
+            bounds_of(op->args[i]);
             if (min.defined() && min.same_as(max)) {
                 new_args[i] = min;
             } else {
@@ -669,8 +701,17 @@ private:
             max = Call::make(op->type, op->name, vec<Expr>(max_a), op->call_type,
                              op->func, op->value_index, op->image, op->param);
 
-        } else if (op->func.has_pure_definition()) {
+        } else if (op->func.has_pure_definition() || op->func.has_extern_definition()) {
             bounds_of_func(op->func, op->value_index);
+        } else if (op->call_type == Call::Image && op->param.defined()) {
+            // Use the range declared for the values of the image.
+            bounds_of_type(op->type);
+            if (op->param.get_min_value().defined()) {
+                min = op->param.get_min_value();
+            }
+            if (op->param.get_max_value().defined()) {
+                max = op->param.get_max_value();
+            }
         } else {
             // Just use the bounds of the type
             bounds_of_type(op->type);
@@ -678,9 +719,14 @@ private:
     }
 
     void visit(const Let *op) {
-        op->value.accept(this);
+        bounds_of(op->value);
         inner_scope.push(op->name, Interval(min, max));
-        op->body.accept(this);
+        // The body sees a different scope, so it gets its own cache.
+        BoundsCache *outer_cache = cache;
+        BoundsCache body_cache;
+        cache = &body_cache;
+        bounds_of(op->body);
+        cache = outer_cache;
         inner_scope.pop(op->name);
     }
 
@@ -721,10 +767,20 @@ private:
     }
 };
 
+namespace {
+Interval bounds_of_expr_in_scope(Expr expr, const Scope<Interval> &scope, const FuncValueBounds &fb,
+                                 BoundsCache *cache) {
+    Bounds b(scope, fb, cache);
+    b.bounds_of(expr);
+    return Interval(b.min, b.max);
+}
+}
+
 Interval bounds_of_expr_in_scope(Expr expr, const Scope<Interval> &scope, const FuncValueBounds &fb) {
     //debug(3) << "computing bounds_of_expr_in_scope " << expr << "\n";
-    Bounds b(scope, fb);
-    expr.accept(&b);
+    BoundsCache cache;
+    Bounds b(scope, fb, &cache);
+    b.bounds_of(expr);
     //debug(3) << "bounds_of_expr_in_scope " << expr << " = " << simplify(b.min) << ", " << simplify(b.max) << "\n";
     return Interval(b.min, b.max);
 }
@@ -789,10 +845,15 @@ class BoxesTouched : public IRGraphVisitor {
 
 public:
     BoxesTouched(bool calls, bool provides, string fn, const Scope<Interval> &s, const FuncValueBounds &fb) :
-        func(fn), consider_calls(calls), consider_provides(provides), scope(s), func_bounds(fb) {}
+        narrow_selects(false), func(fn), consider_calls(calls),
+        consider_provides(provides), scope(s), func_bounds(fb) {}
 
     map<string, Box> boxes;
 
+    // Whether the conditions of selects narrow the intervals of the
+    // variables they bound in each branch.
+    bool narrow_selects;
+
 private:
 
     string func;
@@ -800,16 +861,34 @@ private:
     Scope<Interval> scope;
     const FuncValueBounds &func_bounds;
 
+    // Bounds of the Exprs seen so far under the current scope. The
+    // args of the calls in a statement share a lot of structure.
+    BoundsCache cache;
+
+    Interval bounds_of(Expr e) {
+        return bounds_of_expr_in_scope(e, scope, func_bounds, &cache);
+    }
+
+    void push_scope(const string &name, const Interval &value) {
+        scope.push(name, value);
+        cache.clear();
+    }
+
+    void pop_scope(const string &name) {
+        scope.pop(name);
+        cache.clear();
+    }
+
     using IRGraphVisitor::visit;
 
     void visit(const Let *op) {
         if (!consider_calls) return;
 
         op->value.accept(this);
-        Interval value_bounds = bounds_of_expr_in_scope(op->value, scope, func_bounds);
-        scope.push(op->name, value_bounds);
+        Interval value_bounds = bounds_of(op->value);
+        push_scope(op->name, value_bounds);
         op->body.accept(this);
-        scope.pop(op->name);
+        pop_scope(op->name);
     }
 
     void visit(const Call *op) {
@@ -840,7 +919,7 @@ private:
         Box b(op->args.size());
         for (size_t i = 0; i < op->args.size(); i++) {
             op->args[i].accept(this);
-            b[i] = bounds_of_expr_in_scope(op->args[i], scope, func_bounds);
+            b[i] = bounds_of(op->args[i]);
         }
         merge_boxes(boxes[op->name], b);
     }
@@ -874,23 +953,23 @@ private:
         if (consider_calls) {
             op->value.accept(this);
         }
-        Interval value_bounds = bounds_of_expr_in_scope(op->value, scope, func_bounds);
+        Interval value_bounds = bounds_of(op->value);
         value_bounds.min = simplify(value_bounds.min);
         value_bounds.max = simplify(value_bounds.max);
 
         if (is_small_enough_to_substitute(value_bounds.min) &&
             is_small_enough_to_substitute(value_bounds.max)) {
-            scope.push(op->name, value_bounds);
+            push_scope(op->name, value_bounds);
             op->body.accept(this);
-            scope.pop(op->name);
+            pop_scope(op->name);
         } else {
             string max_name = unique_name('t');
             string min_name = unique_name('t');
 
-            scope.push(op->name, Interval(Variable::make(op->value.type(), min_name),
+            push_scope(op->name, Interval(Variable::make(op->value.type(), min_name),
                                           Variable::make(op->value.type(), max_name)));
             op->body.accept(this);
-            scope.pop(op->name);
+            pop_scope(op->name);
 
             for (map<string, Box>::iterator iter = boxes.begin();
                  iter != boxes.end(); ++iter) {
@@ -919,20 +998,135 @@ private:
         if (scope.contains(op->name + ".loop_min")) {
             min_val = scope.get(op->name + ".loop_min").min;
         } else {
-            min_val = bounds_of_expr_in_scope(op->min, scope, func_bounds).min;
+            min_val = bounds_of(op->min).min;
         }
 
         if (scope.contains(op->name + ".loop_max")) {
             max_val = scope.get(op->name + ".loop_max").max;
         } else {
-            max_val = bounds_of_expr_in_scope(op->extent, scope, func_bounds).max;
-            max_val += bounds_of_expr_in_scope(op->min, scope, func_bounds).max;
+            max_val = bounds_of(op->extent).max;
+            max_val += bounds_of(op->min).max;
             max_val -= 1;
         }
 
-        scope.push(op->name, Interval(min_val, max_val));
+        push_scope(op->name, Interval(min_val, max_val));
         op->body.accept(this);
-        scope.pop(op->name);
+        pop_scope(op->name);
+    }
+
+    // Narrow the intervals in scope of the variables that a condition
+    // bounds, given the value of the condition. The names pushed are
+    // added to the list, to be popped in reverse order.
+    void push_condition(Expr cond, bool value, vector<string> &pushed) {
+        if (const Not *n = cond.as<Not>()) {
+            push_condition(n->a, !value, pushed);
+            return;
+        } else if (const And *a = cond.as<And>()) {
+            if (value) {
+                push_condition(a->a, true, pushed);
+                push_condition(a->b, true, pushed);
+            }
+            return;
+        } else if (const Or *o = cond.as<Or>()) {
+            if (!value) {
+                push_condition(o->a, false, pushed);
+                push_condition(o->b, false, pushed);
+            }
+            return;
+        }
+
+        // Write the condition as a <= b, or a < b.
+        Expr a, b;
+        bool strict;
+        if (const LT *lt = cond.as<LT>()) {
+            a = lt->a; b = lt->b; strict = true;
+        } else if (const LE *le = cond.as<LE>()) {
+            a = le->a; b = le->b; strict = false;
+        } else if (const GT *gt = cond.as<GT>()) {
+            a = gt->b; b = gt->a; strict = true;
+        } else if (const GE *ge = cond.as<GE>()) {
+            a = ge->b; b = ge->a; strict = false;
+        } else if (const EQ *eq = cond.as<EQ>()) {
+            if (value) {
+                push_limit(eq->a, eq->b, true, pushed);
+                push_limit(eq->a, eq->b, false, pushed);
+                push_limit(eq->b, eq->a, true, pushed);
+                push_limit(eq->b, eq->a, false, pushed);
+            }
+            return;
+        } else {
+            return;
+        }
+        if (!value) {
+            // !(a < b) is b <= a, and !(a <= b) is b < a.
+            std::swap(a, b);
+            strict = !strict;
+        }
+        if (a.type() != Int(32)) return;
+        push_limit(a, strict ? b - 1 : b, true, pushed);
+        push_limit(b, strict ? a + 1 : a, false, pushed);
+    }
+
+    // If e is a variable in scope, narrow its interval by a limit on
+    // its max or min.
+    void push_limit(Expr e, Expr limit, bool is_max, vector<string> &pushed) {
+        const Variable *var = e.as<Variable>();
+        if (!var || var->type != Int(32) || !scope.contains(var->name)) return;
+        Interval i = scope.get(var->name);
+        Interval limit_bounds = bounds_of(limit);
+        if (is_max && limit_bounds.max.defined()) {
+            i.max = i.max.defined() ? Min::make(i.max, limit_bounds.max) : limit_bounds.max;
+        } else if (!is_max && limit_bounds.min.defined()) {
+            i.min = i.min.defined() ? Max::make(i.min, limit_bounds.min) : limit_bounds.min;
+        } else {
+            return;
+        }
+        push_scope(var->name, i);
+        pushed.push_back(var->name);
+    }
+
+    // Visit something that's only evaluated, or only used, when a
+    // condition has a given value. Nodes seen while the intervals are
+    // narrowed aren't counted as visited, so that they're visited
+    // again if they're also used elsewhere.
+    template<typename T>
+    void visit_given(Expr cond, bool value, T node) {
+        vector<string> pushed;
+        push_condition(cond, value, pushed);
+        if (pushed.empty()) {
+            node.accept(this);
+            return;
+        }
+        std::set<const IRNode *> old_visited;
+        old_visited.swap(visited);
+        node.accept(this);
+        visited.swap(old_visited);
+        for (size_t i = pushed.size(); i > 0; i--) {
+            pop_scope(pushed[i-1]);
+        }
+    }
+
+    void visit(const Select *op) {
+        if (!narrow_selects || !consider_calls) {
+            IRGraphVisitor::visit(op);
+            return;
+        }
+        include(op->condition);
+        visit_given(op->condition, true, op->true_value);
+        visit_given(op->condition, false, op->false_value);
+    }
+
+    void visit(const IfThenElse *op) {
+        if (consider_calls) {
+            op->condition.accept(this);
+        }
+
+        // The conditions of ifs bound the variables in each case. This
+        // catches the guards made for splits with Tail_GuardWithIf.
+        visit_given(op->condition, true, op->then_case);
+        if (op->else_case.defined()) {
+            visit_given(op->condition, false, op->else_case);
+        }
     }
 
     void visit(const Provide *op) {
@@ -940,7 +1134,7 @@ private:
             if (op->name == func || func.empty()) {
                 Box b(op->args.size());
                 for (size_t i = 0; i < op->args.size(); i++) {
-                    b[i] = bounds_of_expr_in_scope(op->args[i], scope, func_bounds);
+                    b[i] = bounds_of(op->args[i]);
                 }
                 merge_boxes(boxes[op->name], b);
             }
@@ -982,6 +1176,13 @@ Box box_required(Expr e, string fn, const Scope<Interval> &scope, const FuncValu
     return box_touched(e, Stmt(), true, false, fn, scope, fb);
 }
 
+map<string, Box> boxes_computed(Expr e, const Scope<Interval> &scope, const FuncValueBounds &fb) {
+    BoxesTouched b(true, false, "", scope, fb);
+    b.narrow_selects = true;
+    e.accept(&b);
+    return b.boxes;
+}
+
 map<string, Box> boxes_required(Stmt s, const Scope<Interval> &scope, const FuncValueBounds &fb) {
     return boxes_touched(Expr(), s, true, false, "", scope, fb);
 }
@@ -1081,6 +1282,18 @@ FuncValueBounds compute_function_value_bounds(const vector<string> &order,
 
             }
 
+            // Narrow it by the range declared for the value.
+            pair<Expr, Expr> declared = f.value_bounds(j);
+            if (declared.first.defined()) {
+                result.min = result.min.defined() ? simplify(Max::make(result.min, declared.first)) : declared.first;
+            }
+            if (declared.second.defined()) {
+                result.max = result.max.defined() ? simplify(Min::make(result.max, declared.second)) : declared.second;
+            }
+            if (result.min.defined() || result.max.defined()) {
+                fb[key] = result;
+            }
+
             debug(2) << "Bounds on value " << j
                      << " for func " << order[i]
                      << " are: " << result.min << ", " << result.max << "\n";
@@ -1122,6 +1335,17 @@ void bounds_test() {
     check(scope, (cast<uint8_t>(x)+10)*(cast<uint8_t>(x)), cast<uint8_t>(0), cast<uint8_t>(200));
     check(scope, (cast<uint8_t>(x)+20)-(cast<uint8_t>(x)+5), cast<uint8_t>(5), cast<uint8_t>(25));
 
+    // Exprs with shared subexpressions are only walked once per node,
+    // so this doesn't take 2^40 steps.
+    Expr dag = x;
+    for (int i = 0; i < 40; i++) {
+        dag = dag + dag;
+    }
+    Interval dag_bounds = bounds_of_expr_in_scope(dag, scope);
+    assert(dag_bounds.min.defined() && dag_bounds.max.defined());
+    const Add *dag_add = dag_bounds.max.as<Add>();
+    assert(dag_add && dag_add->a.same_as(dag_add->b));
+
     Expr u8_1 = cast<uint8_t>(Load::make(Int(8), "buf", x, Buffer(), Parameter()));
     Expr u8_2 = cast<uint8_t>(Load::make(Int(8), "buf", x + 17, Buffer(), Parameter()));
     check(scope, cast<uint16_t>(u8_1) + cast<uint16_t>(u8_2),
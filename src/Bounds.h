@@ -54,6 +54,16 @@ std::map<std::string, Box> boxes_required(Stmt s,
                                           const FuncValueBounds &func_bounds = FuncValueBounds());
 // @}
 
+/** Like boxes_required, but calls in a branch of a select that isn't
+ * taken don't count. Where the condition of a select bounds a
+ * variable in scope, the interval of the variable is narrowed to
+ * match in each branch. Both branches of a vectorized select are
+ * still evaluated, so this is the region of each function that needs
+ * to be computed, but not the region that needs to be allocated. */
+std::map<std::string, Box> boxes_computed(Expr e,
+                                          const Scope<Interval> &scope = Scope<Interval>(),
+                                          const FuncValueBounds &func_bounds = FuncValueBounds());
+
 /** Compute rectangular domains large enough to cover all the
  * 'Provides's to each function that occurs within a given statement
  * or expression. */
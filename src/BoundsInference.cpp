@@ -4,6 +4,8 @@
 #include "Bounds.h"
 #include "IROperator.h"
 #include "Inline.h"
+#include "ExprUsesVar.h"
+#include "Substitute.h"
 
 namespace Halide {
 namespace Internal {
@@ -36,6 +38,97 @@ bool depends_on_bounds_inference(Expr e) {
     return d.result;
 }
 
+class ContainsLoop : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &name;
+
+    void visit(const For *op) {
+        result = result || op->name == name;
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool result;
+    ContainsLoop(const string &n) : name(n), result(false) {}
+};
+
+// The region of an extern stage computed in one of the loops over its
+// tiles (see build_produce): the tile, in the dimensions whose loop
+// is this one or outside of it, and the whole region in the others.
+Box extern_box_provided(Function f, const string &stage_name, const For *op) {
+    Box b(f.dimensions());
+    for (int k = 0; k < f.dimensions(); k++) {
+        string var = stage_name + "." + f.args()[k];
+        b[k] = Interval(Variable::make(Int(32), var + ".loop_min"),
+                        Variable::make(Int(32), var + ".loop_max"));
+    }
+    const vector<Schedule::Split> &splits = f.schedule().splits;
+    for (size_t i = 0; i < splits.size(); i++) {
+        const Schedule::Split &split = splits[i];
+        string outer = stage_name + "." + split.outer;
+        ContainsLoop inside(outer);
+        op->body.accept(&inside);
+        if (op->name != outer && inside.result) continue;
+        for (int k = 0; k < f.dimensions(); k++) {
+            if (f.args()[k] != split.old_var) continue;
+            Expr min = Variable::make(Int(32), outer) * split.factor + b[k].min;
+            b[k] = Interval(min, Min::make(min + (split.factor - 1), b[k].max));
+        }
+    }
+    return b;
+}
+
+// The values a split reduction variable of an update stage takes on
+// within one iteration of a loop made from it by splitting, with the
+// enclosing loops fixed. Undefined if the loop isn't one of those, or
+// the variable was fused.
+Interval rvar_tile(const Schedule &sched, const string &prefix,
+                   const string &rvar, const string &loop,
+                   const Scope<int> &enclosing) {
+    // The variable in terms of the loops made from it.
+    Expr loop_min = Variable::make(Int(32), prefix + rvar + ".loop_min");
+    Expr loop_max = Variable::make(Int(32), prefix + rvar + ".loop_max");
+    Expr e = Variable::make(Int(32), prefix + rvar);
+    for (size_t i = 0; i < sched.splits.size(); i++) {
+        const Schedule::Split &split = sched.splits[i];
+        string old_var = prefix + split.old_var;
+        if (!expr_uses_var(e, old_var)) continue;
+        if (split.is_fuse()) return Interval();
+        Expr outer = Variable::make(Int(32), prefix + split.outer);
+        Expr value = outer;
+        if (split.is_split()) {
+            Expr inner = Variable::make(Int(32), prefix + split.inner);
+            value = outer * split.factor + inner;
+            if (split.old_var == rvar) value += loop_min;
+        }
+        e = substitute(old_var, value, e);
+    }
+    if (loop == prefix + rvar || !expr_uses_var(e, loop)) return Interval();
+
+    // The loops not yet entered take on all their values.
+    Scope<Interval> scope;
+    for (size_t i = 0; i < sched.dims.size(); i++) {
+        string var = prefix + sched.dims[i].var;
+        if (!enclosing.contains(var) && expr_uses_var(e, var)) {
+            scope.push(var, Interval(Variable::make(Int(32), var + ".loop_min"),
+                                     Variable::make(Int(32), var + ".loop_max")));
+        }
+    }
+    Interval tile = bounds_of_expr_in_scope(e, scope);
+    if (!tile.min.defined() || !tile.max.defined()) return Interval();
+    // Splits of reduction variables guard against going past the end.
+    tile.max = Min::make(tile.max, loop_max);
+    return tile;
+}
+
+bool is_output(Function f, const vector<Function> &outputs) {
+    for (size_t i = 0; i < outputs.size(); i++) {
+        if (f.same_as(outputs[i])) return true;
+    }
+    return false;
+}
+
 }
 
 class BoundsInference : public IRMutator {
@@ -45,6 +138,9 @@ public:
     set<string> in_pipeline, inner_productions;
     Scope<int> in_stages;
 
+    // The loops we're inside, including the one being visited.
+    Scope<int> in_loops;
+
     struct Stage {
         Function func;
         int stage; // 0 is the pure definition, 1 is the first update
@@ -318,10 +414,10 @@ public:
     vector<Stage> stages;
 
     BoundsInference(const vector<Function> &f,
+                    const vector<Function> &outputs,
                     const FuncValueBounds &fb) :
         funcs(f), func_bounds(fb) {
         assert(!f.empty());
-        Function output_function = f[f.size()-1];
 
         // Compute the intrinsic relationships between the stages of
         // the functions.
@@ -329,7 +425,7 @@ public:
         // Figure out which functions will be inlined away
         vector<bool> inlined(f.size());
         for (size_t i = 0; i < inlined.size(); i++) {
-            if (i < f.size() - 1 &&
+            if (!is_output(f[i], outputs) &&
                 f[i].schedule().compute_level.is_inline() &&
                 f[i].is_pure()) {
                 inlined[i] = true;
@@ -377,7 +473,7 @@ public:
         // Remove the inlined stages
         vector<Stage> new_stages;
         for (size_t i = 0; i < stages.size(); i++) {
-            if (stages[i].func.same_as(output_function) ||
+            if (is_output(stages[i].func, outputs) ||
                 !stages[i].func.schedule().compute_level.is_inline() ||
                 !stages[i].func.is_pure()) {
                 new_stages.push_back(stages[i]);
@@ -433,7 +529,10 @@ public:
             } else {
                 const vector<Expr> &exprs = consumer.exprs;
                 for (size_t j = 0; j < exprs.size(); j++) {
-                    map<string, Box> new_boxes = boxes_required(exprs[j], scope, func_bounds);
+                    // Only the values that are used need computing,
+                    // though the realization covers all of the
+                    // values loaded.
+                    map<string, Box> new_boxes = boxes_computed(exprs[j], scope, func_bounds);
                     for (map<string, Box>::iterator iter = new_boxes.begin();
                          iter != new_boxes.end(); ++iter) {
                         merge_boxes(boxes[iter->first], iter->second);
@@ -469,35 +568,37 @@ public:
             }
         }
 
-        // The region required of the last function is expanded to include output size
-        Function output = stages[stages.size()-1].func;
-        Box output_box;
-        string buffer_name = output.name();
-        if (output.outputs() > 1) {
-            // Use the output size of the first output buffer
-            buffer_name += ".0";
-        }
-        for (int d = 0; d < output.dimensions(); d++) {
-            Expr min = Variable::make(Int(32), buffer_name + ".min." + int_to_string(d));
-            Expr extent = Variable::make(Int(32), buffer_name + ".extent." + int_to_string(d));
+        // The region required of each output function is expanded to include output size
+        for (size_t j = 0; j < outputs.size(); j++) {
+            Function output = outputs[j];
+            Box output_box;
+            string buffer_name = output.name();
+            if (output.outputs() > 1) {
+                // Use the output size of the first output buffer
+                buffer_name += ".0";
+            }
+            for (int d = 0; d < output.dimensions(); d++) {
+                Expr min = Variable::make(Int(32), buffer_name + ".min." + int_to_string(d));
+                Expr extent = Variable::make(Int(32), buffer_name + ".extent." + int_to_string(d));
+
+                // Respect any output min and extent constraints
+                Expr min_constraint = output.output_buffers()[0].min_constraint(d);
+                Expr extent_constraint = output.output_buffers()[0].extent_constraint(d);
 
-            // Respect any output min and extent constraints
-            Expr min_constraint = output.output_buffers()[0].min_constraint(d);
-            Expr extent_constraint = output.output_buffers()[0].extent_constraint(d);
+                if (min_constraint.defined()) {
+                    min = min_constraint;
+                }
+                if (extent_constraint.defined()) {
+                    extent = extent_constraint;
+                }
 
-            if (min_constraint.defined()) {
-                min = min_constraint;
+                output_box.push_back(Interval(min, (min + extent) - 1));
             }
-            if (extent_constraint.defined()) {
-                extent = extent_constraint;
+            for (size_t i = 0; i < stages.size(); i++) {
+                Stage &s = stages[i];
+                if (!s.func.same_as(output)) continue;
+                s.bounds[make_pair(s.name, s.stage)] = output_box;
             }
-
-            output_box.push_back(Interval(min, (min + extent) - 1));
-        }
-        for (size_t i = 0; i < stages.size(); i++) {
-            Stage &s = stages[i];
-            if (!s.func.same_as(output)) continue;
-            s.bounds[make_pair(s.name, s.stage)] = output_box;
         }
 
         // Dump out the region required of each stage for debugging.
@@ -523,6 +624,8 @@ public:
         set<string> old_inner_productions;
         inner_productions.swap(old_inner_productions);
 
+        in_loops.push(op->name, 0);
+
         Stmt body = op->body;
 
         // Walk inside of any let statements that don't depend on
@@ -544,7 +647,7 @@ public:
         string stage_name;
         for (size_t i = 0; i < stages.size(); i++) {
             string next_stage_name = stages[i].name + ".s" + int_to_string(stages[i].stage);
-            if (starts_with(op->name, next_stage_name + ".")) {
+            if (starts_with(op->name, next_stage_name, '.')) {
                 producing = i;
                 f = stages[i].func;
                 stage_name = next_stage_name;
@@ -556,7 +659,11 @@ public:
         // Figure out how much of it we're producing
         Box box;
         if (producing >= 0) {
-            box = box_provided(body, stages[producing].name, Scope<Interval>(), func_bounds);
+            if (f.has_extern_definition()) {
+                box = extern_box_provided(f, stage_name, op);
+            } else {
+                box = box_provided(body, stages[producing].name, Scope<Interval>(), func_bounds);
+            }
             assert((int)box.size() == f.dimensions());
         }
 
@@ -585,6 +692,11 @@ public:
             }
         }
 
+        // An extern stage tells us which inputs its tiles need.
+        if (producing >= 0 && f.has_extern_definition() && !inner_productions.empty()) {
+            body = stages[producing].do_bounds_query(body, in_pipeline);
+        }
+
         // Finally, define the production bounds for the thing
         // we're producing.
         if (producing >= 0 && !inner_productions.empty()) {
@@ -608,12 +720,22 @@ public:
             const ReductionDefinition &r = s.func.reductions()[s.stage-1];
             if (r.domain.defined()) {
                 const vector<ReductionVariable> &d = r.domain.domain();
+                string prefix = s.name + ".s" + int_to_string(s.stage) + ".";
                 for (size_t i = 0; i < d.size(); i++) {
-                    if (op->name == s.name + ".s" + int_to_string(s.stage) + "." + d[i].var) {
+                    if (op->name == prefix + d[i].var) {
                         // We just entered the loop over this var
                         Expr loop_var = Variable::make(Int(32), op->name);
                         body = LetStmt::make(op->name + ".min", loop_var, body);
                         body = LetStmt::make(op->name + ".max", loop_var, body);
+                    } else {
+                        // Or one of the loops made by splitting it, in
+                        // which case it covers a tile.
+                        Interval tile = rvar_tile(r.schedule, prefix, d[i].var, op->name, in_loops);
+                        if (tile.min.defined()) {
+                            string var = prefix + d[i].var;
+                            body = LetStmt::make(var + ".min", tile.min, body);
+                            body = LetStmt::make(var + ".max", tile.max, body);
+                        }
                     }
                 }
             }
@@ -628,8 +750,9 @@ public:
         }
 
         in_stages.pop(stage_name);
+        in_loops.pop(op->name);
 
-        stmt = For::make(op->name, op->min, op->extent, op->for_type, body);
+        stmt = rebuild(op, op->min, op->extent, body);
     }
 
     void visit(const Pipeline *p) {
@@ -643,7 +766,8 @@ public:
 
 
 
-Stmt bounds_inference(Stmt s, const vector<string> &order,
+Stmt bounds_inference(Stmt s, const vector<Function> &outputs,
+                      const vector<string> &order,
                       const map<string, Function> &env,
                       const FuncValueBounds &func_bounds) {
 
@@ -654,7 +778,7 @@ Stmt bounds_inference(Stmt s, const vector<string> &order,
 
     // Add an outermost bounds inference marker
     s = For::make("<outermost>", 0, 1, For::Serial, s);
-    s = BoundsInference(funcs, func_bounds).mutate(s);
+    s = BoundsInference(funcs, outputs, func_bounds).mutate(s);
     return s.as<For>()->body;
 }
 
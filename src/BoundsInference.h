@@ -15,9 +15,11 @@ namespace Internal {
 
 /** Take a partially lowered statement that includes symbolic
  * representations of the bounds over which things should be realized,
- * and inject expressions defining those bounds.
+ * and inject expressions defining those bounds. The region required
+ * of each output is the region of its output buffer.
  */
 Stmt bounds_inference(Stmt,
+                      const std::vector<Function> &outputs,
                       const std::vector<std::string> &realization_order,
                       const std::map<std::string, Function> &environment,
                       const std::map<std::pair<std::string, int>, Interval> &func_bounds);
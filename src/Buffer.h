@@ -2,6 +2,9 @@
 #define HALIDE_BUFFER_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
 #include "buffer_t.h"
 #include "JITCompiledModule.h"
 #include "IntrusivePtr.h"
@@ -29,6 +32,16 @@ struct BufferContents {
      * NULL. */
     uint8_t *allocation;
 
+    /** If the host memory has been page-locked by a gpu runtime (see
+     * Buffer::pin_host_memory), the module whose runtime did it, and
+     * either the page-locked allocation it made for us, or the host
+     * pointer it page-locked in place. */
+    // @{
+    JITCompiledModule host_memory_module;
+    uint8_t *pinned_allocation;
+    uint8_t *registered_host;
+    // @}
+
     /** How many Buffer objects point to this BufferContents */
     mutable RefCount ref_count;
 
@@ -43,9 +56,15 @@ struct BufferContents {
      * alive. */
     JITCompiledModule source_module;
 
+    /** If this buffer is a view onto the host memory of another one
+     * (see Buffer::crop and friends), the buffer that memory came
+     * from, which is kept alive as long as this one is. */
+    IntrusivePtr<BufferContents> owner;
+
     BufferContents(Type t, int x_size, int y_size, int z_size, int w_size,
                    uint8_t* data, const std::string &n) :
-        type(t), allocation(NULL), name(n.empty() ? unique_name('b') : n) {
+        type(t), allocation(NULL), pinned_allocation(NULL), registered_host(NULL),
+        name(n.empty() ? unique_name('b') : n) {
         assert(t.width == 1 && "Can't create of a buffer of a vector type");
         buf.elem_size = t.bytes();
         size_t size = 1;
@@ -89,7 +108,8 @@ struct BufferContents {
     }
 
     BufferContents(Type t, const buffer_t *b, const std::string &n) :
-        type(t), allocation(NULL), name(n.empty() ? unique_name('b') : n) {
+        type(t), allocation(NULL), pinned_allocation(NULL), registered_host(NULL),
+        name(n.empty() ? unique_name('b') : n) {
         buf = *b;
         assert(t.width == 1 && "Can't create of a buffer of a vector type");
     }
@@ -111,6 +131,33 @@ private:
     int32_t size_or_zero(const std::vector<int32_t> &sizes, size_t index) {
         return (index < sizes.size()) ? sizes[index] : 0;
     }
+
+    /** Make a buffer described by b that shares the host memory of
+     * this one. */
+    Buffer make_view(const buffer_t &b) const {
+        Buffer view(type(), &b);
+        view.contents.ptr->buf.dev = 0;
+        view.contents.ptr->buf.host_dirty = false;
+        view.contents.ptr->buf.dev_dirty = false;
+        view.contents.ptr->owner = contents.ptr->owner.defined() ? contents.ptr->owner : contents;
+        return view;
+    }
+
+    /** Check that this buffer can be viewed, and that dim is one of
+     * its dimensions. */
+    void check_view(int dim, const char *op) const {
+        assert(defined());
+        if (contents.ptr->buf.dev_dirty) {
+            std::cerr << "Can't " << op << " buffer " << name()
+                      << ", because its data is on the device. Copy it to the host first.\n";
+            assert(false);
+        }
+        if (dim < 0 || dim >= dimensions()) {
+            std::cerr << "Can't " << op << " buffer " << name() << " in dimension " << dim
+                      << ", because it has " << dimensions() << " dimensions\n";
+            assert(false);
+        }
+    }
 public:
     Buffer() : contents(NULL) {}
 
@@ -131,6 +178,114 @@ public:
         contents(new Internal::BufferContents(t, buf, name)) {
     }
 
+    /** Wrap a buffer around host memory owned by someone else, with
+     * the given size, stride (in elements) and min coordinate in each
+     * dimension. The data pointer is the address of the element at
+     * the mins. The memory must outlive the buffer and all views of
+     * it. */
+    Buffer(Type t, const std::vector<int32_t> &sizes, const std::vector<int32_t> &strides,
+           const std::vector<int32_t> &mins, uint8_t* data, const std::string &name = "") :
+        contents(new Internal::BufferContents(t, 0, 0, 0, 0, data, name)) {
+        assert(data && "Buffer needs the memory to wrap");
+        assert(sizes.size() <= 4 && "Buffer dimensions greater than 4 are not supported.");
+        assert(strides.size() == sizes.size() && mins.size() == sizes.size() &&
+               "Buffer needs a stride and a min for each dimension");
+        for (size_t i = 0; i < sizes.size(); i++) {
+            contents.ptr->buf.extent[i] = sizes[i];
+            contents.ptr->buf.stride[i] = strides[i];
+            contents.ptr->buf.min[i] = mins[i];
+        }
+    }
+
+    /** The buffers below are views that share this buffer's host
+     * memory without copying it, so a pipeline can be realized
+     * directly into part of a larger image. Writing through one
+     * writes to the other. Views don't share device allocations, so a
+     * buffer whose data is on the device must be copied to the host
+     * before making views of it. */
+    // @{
+
+    /** A view of the part of this buffer from min to min + extent - 1
+     * in the given dimension. It keeps the coordinates of this buffer,
+     * so e.g. its min in that dimension is the given min. */
+    Buffer crop(int dim, int min, int extent) const {
+        check_view(dim, "crop");
+        const buffer_t &b = contents.ptr->buf;
+        assert(min >= b.min[dim] && extent >= 0 && min + extent <= b.min[dim] + b.extent[dim] &&
+               "Cropping a buffer to a region outside of it");
+        buffer_t view = b;
+        view.host += (ptrdiff_t)(min - b.min[dim]) * b.stride[dim] * b.elem_size;
+        view.min[dim] = min;
+        view.extent[dim] = extent;
+        return make_view(view);
+    }
+
+    /** A view of this buffer with one fewer dimension, at the given
+     * coordinate of dimension dim. The dimensions after it move down
+     * by one. */
+    Buffer slice(int dim, int pos) const {
+        check_view(dim, "slice");
+        const buffer_t &b = contents.ptr->buf;
+        assert(pos >= b.min[dim] && pos < b.min[dim] + b.extent[dim] &&
+               "Slicing a buffer at a coordinate outside of it");
+        buffer_t view = b;
+        view.host += (ptrdiff_t)(pos - b.min[dim]) * b.stride[dim] * b.elem_size;
+        for (int i = dim; i < 3; i++) {
+            view.min[i] = b.min[i+1];
+            view.extent[i] = b.extent[i+1];
+            view.stride[i] = b.stride[i+1];
+        }
+        view.min[3] = view.extent[3] = view.stride[3] = 0;
+        return make_view(view);
+    }
+
+    /** A view of this buffer with two of its dimensions swapped. To
+     * pass a view whose innermost stride isn't one into a pipeline,
+     * remove the constraint that it is one, with set_stride(0, Expr())
+     * on the ImageParam or output buffer. */
+    Buffer transpose(int d1, int d2) const {
+        check_view(d1, "transpose");
+        check_view(d2, "transpose");
+        buffer_t view = contents.ptr->buf;
+        std::swap(view.min[d1], view.min[d2]);
+        std::swap(view.extent[d1], view.extent[d2]);
+        std::swap(view.stride[d1], view.stride[d2]);
+        return make_view(view);
+    }
+
+    /** A view of this buffer with dimensions dim and dim + 1 fused
+     * into one, which must be possible without copying (i.e. the
+     * stride of dim + 1 must be the stride times the extent of
+     * dim). The coordinate (x, y) of the two dimensions becomes x + y
+     * * extent(dim). The dimensions after them move down by one. */
+    Buffer fuse(int dim) const {
+        check_view(dim, "fuse");
+        check_view(dim + 1, "fuse");
+        const buffer_t &b = contents.ptr->buf;
+        if (b.stride[dim+1] != b.stride[dim] * b.extent[dim]) {
+            std::cerr << "Can't fuse dimensions " << dim << " and " << dim + 1
+                      << " of buffer " << name() << ", because they aren't contiguous\n";
+            assert(false);
+        }
+        buffer_t view = b;
+        view.min[dim] = b.min[dim] + b.min[dim+1] * b.extent[dim];
+        view.extent[dim] = b.extent[dim] * b.extent[dim+1];
+        for (int i = dim + 1; i < 3; i++) {
+            view.min[i] = b.min[i+1];
+            view.extent[i] = b.extent[i+1];
+            view.stride[i] = b.stride[i+1];
+        }
+        view.min[3] = view.extent[3] = view.stride[3] = 0;
+        return make_view(view);
+    }
+
+    /** Is this buffer a view onto the memory of another one. */
+    bool is_view() const {
+        assert(defined());
+        return contents.ptr->owner.defined();
+    }
+    // @}
+
     /** Get a pointer to the host-side memory. */
     void *host_ptr() const {
         assert(defined());
@@ -310,6 +465,61 @@ public:
         }
     }
 
+    /** Move the host-side memory of this buffer into page-locked
+     * memory from the gpu runtime of the given jit-compiled module
+     * (see Func::pin_host_memory), so that copies between it and the
+     * device run at full bandwidth. If this buffer made its own
+     * allocation, the contents move to a new page-locked one, and
+     * host_ptr changes, so Images made from this buffer beforehand
+     * must be made again. Otherwise the memory it points at is
+     * page-locked in place, and must outlive this buffer. Copies to
+     * the device from page-locked memory are asynchronous, so don't
+     * modify it while a pipeline that reads it may still be
+     * running on the device. Returns false, and leaves the buffer
+     * alone, if the runtime can't do it. */
+    bool pin_host_memory(const Internal::JITCompiledModule &module) {
+        assert(defined());
+        Internal::BufferContents *c = contents.ptr;
+        if (c->pinned_allocation || c->registered_host) {
+            return true;
+        }
+        if (!c->buf.host) {
+            return false;
+        }
+
+        size_t size = 0;
+        for (int i = 0; i < 4; i++) {
+            size_t dim_size = (size_t)c->buf.elem_size * c->buf.extent[i] * c->buf.stride[i];
+            if (dim_size > size) size = dim_size;
+        }
+        if (size == 0) {
+            return false;
+        }
+
+        if (c->allocation) {
+            if (!module.host_malloc || !module.host_free) return false;
+            uint8_t *pinned = (uint8_t *)module.host_malloc(NULL, size);
+            if (!pinned) return false;
+            memcpy(pinned, c->buf.host, size);
+            free(c->allocation);
+            c->allocation = NULL;
+            c->pinned_allocation = pinned;
+            c->buf.host = pinned;
+        } else {
+            if (!module.host_register || !module.host_unregister) return false;
+            if (module.host_register(NULL, c->buf.host, size) != 0) return false;
+            c->registered_host = c->buf.host;
+        }
+        c->host_memory_module = module;
+        return true;
+    }
+
+    /** Is the host-side memory of this buffer page-locked. */
+    bool host_memory_pinned() const {
+        assert(defined());
+        return contents.ptr->pinned_allocation || contents.ptr->registered_host;
+    }
+
 };
 
 namespace Internal {
@@ -325,6 +535,13 @@ inline void destroy<BufferContents>(const BufferContents *p) {
         p->source_module.free_dev_buffer(NULL, const_cast<buffer_t *>(&p->buf));
     }
     free(p->allocation);
+    // Give back page-locked host memory
+    if (p->pinned_allocation) {
+        p->host_memory_module.host_free(NULL, p->pinned_allocation);
+    }
+    if (p->registered_host) {
+        p->host_memory_module.host_unregister(NULL, p->registered_host);
+    }
 
     delete p;
 }
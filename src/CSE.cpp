@@ -1,9 +1,12 @@
 #include <map>
+#include <iostream>
 
 #include "CSE.h"
 #include "IRMutator.h"
 #include "IREquality.h"
+#include "IRHash.h"
 #include "IROperator.h"
+#include "Scope.h"
 
 namespace Halide {
 namespace Internal {
@@ -11,43 +14,44 @@ namespace Internal {
 using std::vector;
 using std::string;
 using std::map;
-using std::set;
 using std::pair;
 using std::make_pair;
 
 struct RemoveLets : public IRMutator {
-    set<Expr, ExprDeepCompare> canonical;
+    // Everything made here goes through this table, so equal
+    // subexpressions of the result are the same node.
+    ExprHashCons canonical;
+
+    // The values of the lets being removed.
+    Scope<Expr> lets;
+
+    // What each node has already been replaced with, in each scope
     vector<map<Expr, Expr, ExprCompare> > replacement;
 
     RemoveLets() {
         enter_scope();
     }
 
-    Expr canonicalize(Expr e) {
-        set<Expr, ExprDeepCompare>::iterator i = canonical.find(e);
-        if (i != canonical.end()) {
-            return *i;
-        } else {
-            canonical.insert(e);
-            return e;
-        }
-    }
-
     using IRMutator::mutate;
 
     Expr mutate(Expr e) {
-        e = canonicalize(e);
+        if (const Variable *var = e.as<Variable>()) {
+            if (lets.contains(var->name)) {
+                return lets.get(var->name);
+            } else {
+                return canonical.intern(e);
+            }
+        }
 
         Expr r = find_replacement(e);
         if (r.defined()) {
             return r;
         } else {
-            Expr new_expr = canonicalize(IRMutator::mutate(e));
+            // The children are canonical now, so this is cheap.
+            Expr new_expr = canonical.intern(IRMutator::mutate(e));
             add_replacement(e, new_expr);
             return new_expr;
         }
-
-
     }
 
     Expr find_replacement(Expr e) {
@@ -73,22 +77,21 @@ struct RemoveLets : public IRMutator {
     using IRMutator::visit;
 
     void visit(const Let *let) {
-        Expr var = canonicalize(Variable::make(let->value.type(), let->name));
-
         Expr new_value = mutate(let->value);
+        lets.push(let->name, new_value);
         enter_scope();
-        add_replacement(var, new_value);
         expr = mutate(let->body);
         leave_scope();
+        lets.pop(let->name);
     }
 
     void visit(const LetStmt *let) {
-        Expr var = canonicalize(Variable::make(let->value.type(), let->name));
         Expr new_value = mutate(let->value);
+        lets.push(let->name, new_value);
         enter_scope();
-        add_replacement(var, new_value);
         stmt = mutate(let->body);
         leave_scope();
+        lets.pop(let->name);
     }
 };
 
@@ -100,83 +103,70 @@ Stmt remove_lets(Stmt s) {
     return RemoveLets().mutate(s);
 }
 
-struct ReplaceExpr : public IRMutator {
-    using IRMutator::mutate;
+// Count the number of times each node of an expression graph is
+// used, and list the nodes so that each comes after its children.
+struct CountUses : public IRGraphVisitor {
+    map<const IRNode *, int> uses;
+    vector<Expr> nodes;
 
-    map<Expr, Expr, ExprCompare> mutated;
+    using IRGraphVisitor::include;
 
-    Expr mutate(Expr e) {
-        map<Expr, Expr, ExprCompare>::iterator iter = mutated.find(e);
-        if (iter != mutated.end()) {
-            return iter->second;
-        } else {
-            Expr new_expr = IRMutator::mutate(e);
-            mutated[e] = new_expr;
-            return new_expr;
+    void include(const Expr &e) {
+        if (++uses[e.ptr] == 1) {
+            e.accept(this);
+            nodes.push_back(e);
         }
     }
 };
 
-Expr replace_expr(Expr e, Expr old_expr, Expr replacement) {
-    ReplaceExpr r;
-    r.mutated[old_expr] = replacement;
-    return r.mutate(e);
-}
-
-struct FindOneCommonSubexpression : public IRGraphVisitor {
-    Expr result;
-
-    using IRGraphVisitor::include;
-
-    void include(const Expr &e) {
-        if (result.defined()) return;
-
-        set<const IRNode *>::iterator iter = visited.find(e.ptr);
+// Replace nodes with the variables they've been hoisted into.
+struct ReplaceExprs : public IRMutator {
+    using IRMutator::mutate;
 
-        if (iter != visited.end()) {
-            if (e.as<Variable>() || is_const(e)) {
-                return;
-            }
+    map<Expr, Expr, ExprCompare> replacement;
 
-            result = e;
+    Expr mutate(Expr e) {
+        map<Expr, Expr, ExprCompare>::iterator iter = replacement.find(e);
+        if (iter != replacement.end()) {
+            return iter->second;
         } else {
-            e.accept(this);
-            visited.insert(e.ptr);
+            return IRMutator::mutate(e);
         }
     }
 };
 
 Expr common_subexpression_elimination(Expr e) {
+    // e.g. the predicate of an unpredicated store
+    if (!e.defined()) return e;
 
-    // debug(0) << "Input to letify " << e << "\n";
-
+    // Removing the lets also makes equal subexpressions the same
+    // node, so the common subexpressions are the nodes with more
+    // than one use.
     e = remove_lets(e);
 
-    // debug(0) << "Deletified letify " << e << "\n";
+    CountUses counter;
+    counter.include(e);
 
+    // Hoist each one into a let. Children come first, so each let's
+    // value can refer to the earlier ones.
     vector<pair<string, Expr> > lets;
-
-    while (1) {
-        FindOneCommonSubexpression finder;
-        finder.include(e);
-        if (!finder.result.defined()) break;
-
-        // debug(0) << "\nHoisting out " << finder.result << " from " << e << "\n";
-
+    ReplaceExprs replacer;
+    for (size_t i = 0; i < counter.nodes.size(); i++) {
+        Expr node = counter.nodes[i];
+        if (counter.uses[node.ptr] < 2 || node.as<Variable>() || is_const(node)) {
+            continue;
+        }
         string name = unique_name('t');
-
-        lets.push_back(make_pair(name, finder.result));
-
-        e = replace_expr(e, finder.result, Variable::make(finder.result.type(), name));
-        // debug(0) << "Result: " << e << "\n";
+        lets.push_back(make_pair(name, replacer.IRMutator::mutate(node)));
+        replacer.replacement[node] = Variable::make(node.type(), name);
     }
 
+    e = replacer.mutate(e);
+
     for (size_t i = lets.size(); i > 0; i--) {
         e = Let::make(lets[i-1].first, lets[i-1].second, e);
     }
 
-    // debug(0) << "Output of letify " << e << "\n";
-
     return e;
 }
 
@@ -193,5 +183,45 @@ Stmt common_subexpression_elimination(Stmt s) {
     return LetifyStmt().mutate(s);
 }
 
+void cse_test() {
+    Expr x = Variable::make(Int(32), "x"), y = Variable::make(Int(32), "y");
+
+    // Equal subexpressions that are different nodes get hoisted once.
+    Expr e = common_subexpression_elimination((x*y + 1) * (x*y + 1));
+    const Let *let = e.as<Let>();
+    assert(let && equal(let->value, x*y + 1) && "CSE test failed: hoisting");
+    Expr t = Variable::make(Int(32), let->name);
+    assert(equal(let->body, t * t) && "CSE test failed: replacement");
+
+    // Lets are substituted in before looking for common subexpressions.
+    Expr z = Variable::make(Int(32), "z");
+    e = Let::make("z", x + y, (z + 2) * (x + y + 2));
+    e = common_subexpression_elimination(e);
+    let = e.as<Let>();
+    assert(let && equal(let->value, x + y + 2) && !let->body.as<Let>() &&
+           "CSE test failed: lets");
+
+    // A graph that is exponentially large as a tree gets one let per
+    // shared node, and inner subexpressions come before outer ones.
+    vector<Expr> chain(100);
+    chain[0] = x;
+    chain[1] = y;
+    for (size_t i = 2; i < chain.size(); i++) {
+        chain[i] = chain[i-1] + chain[i-2];
+    }
+    e = common_subexpression_elimination(chain.back());
+    int count = 0;
+    while (const Let *l = e.as<Let>()) {
+        if (count == 0) {
+            assert(equal(l->value, y + x) && "CSE test failed: order");
+        }
+        e = l->body;
+        count++;
+    }
+    assert(count == 96 && "CSE test failed: chain");
+
+    std::cout << "CSE test passed" << std::endl;
+}
+
 }
 }
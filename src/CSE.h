@@ -35,6 +35,8 @@ Expr remove_lets(Expr);
 Stmt remove_lets(Stmt);
 // @}
 
+EXPORT void cse_test();
+
 }
 }
 
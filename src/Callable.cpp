@@ -0,0 +1,40 @@
+#include "Callable.h"
+
+namespace Halide {
+
+using std::vector;
+
+Callable::Callable() {}
+
+int Callable::operator()(const void * const *values, void *user_context) const {
+    assert(defined() && "Can't call an undefined Callable");
+
+    // Small argument lists go on the stack, so that calls don't
+    // allocate.
+    const size_t max_stack_args = 16;
+    const void *stack_values[max_stack_args];
+    vector<const void *> heap_values;
+    const void **all_values = stack_values;
+    if (bound_values.size() > max_stack_args) {
+        heap_values.resize(bound_values.size());
+        all_values = &heap_values[0];
+    }
+
+    for (size_t i = 0; i < bound_values.size(); i++) {
+        all_values[i] = bound_values[i];
+    }
+    for (size_t i = 0; i < slots.size(); i++) {
+        assert(values[i] && "An argument to a Callable is null");
+        all_values[slots[i]] = values[i];
+    }
+    all_values[0] = &user_context;
+
+    return module.wrapped_function(all_values);
+}
+
+int Callable::operator()(const vector<const void *> &values, void *user_context) const {
+    assert(values.size() == args.size() && "Wrong number of arguments to a Callable");
+    return (*this)(values.empty() ? NULL : &values[0], user_context);
+}
+
+}
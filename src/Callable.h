@@ -0,0 +1,81 @@
+#ifndef HALIDE_CALLABLE_H
+#define HALIDE_CALLABLE_H
+
+/** \file
+ * Defines a jit-compiled pipeline that can be called cheaply and from
+ * several threads at once
+ */
+
+#include "Argument.h"
+#include "Buffer.h"
+#include "JITCompiledModule.h"
+
+#include <vector>
+
+namespace Halide {
+
+/** A jit-compiled pipeline with its argument list worked out once,
+ * made by Func::compile_to_callable. Func::realize works out the
+ * arguments, binds the handlers and checks whether to recompile on
+ * every call, which for small pipelines called often can cost as much
+ * as running them. A Callable only fills in an array of pointers and
+ * calls the pipeline. It doesn't change once it's made, so several
+ * threads can call it at once (with different buffers).
+ \code
+ Callable c = f.compile_to_callable();
+ // c.arguments() is (input, scale, f)
+ const void *args[] = {input.raw_buffer(), &scale_value, out.raw_buffer()};
+ int error = c(args);
+ \endcode
+ */
+class Callable {
+public:
+    EXPORT Callable();
+
+    /** The arguments to pass, in order. These are the Params and
+     * ImageParams the pipeline uses, followed by the output
+     * buffer(s). Images used by the pipeline were bound when it was
+     * compiled. */
+    const std::vector<Argument> &arguments() const {
+        return args;
+    }
+
+    /** Call the pipeline. There's one value per argument: the address
+     * of the value of each scalar, and a buffer_t * for each buffer
+     * (which may have a NULL host pointer, to query the bounds, as
+     * for a pipeline compiled statically). The user_context is
+     * passed to the error handler, allocator, task functions and
+     * trace function of the call. Returns zero on success, or the
+     * error code of the pipeline. */
+    // @{
+    EXPORT int operator()(const void * const *values, void *user_context = NULL) const;
+    EXPORT int operator()(const std::vector<const void *> &values, void *user_context = NULL) const;
+    // @}
+
+    /** Whether this was made by Func::compile_to_callable. */
+    bool defined() const {
+        return module.wrapped_function != NULL;
+    }
+
+private:
+    friend class Func;
+
+    Internal::JITCompiledModule module;
+    std::vector<Argument> args;
+
+    /** The values of every argument of the compiled function, the
+     * first of which is the user_context. The entries the caller
+     * supplies are NULL. */
+    std::vector<const void *> bound_values;
+
+    /** Where each argument goes in bound_values. */
+    std::vector<int> slots;
+
+    /** The images bound to the pipeline, held so that they outlive
+     * it. */
+    std::vector<Buffer> images;
+};
+
+}
+
+#endif
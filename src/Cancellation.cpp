@@ -0,0 +1,52 @@
+#include "Cancellation.h"
+#include "IRMutator.h"
+#include "CodeGen_GPU_Dev.h"
+
+namespace Halide {
+namespace Internal {
+
+namespace {
+
+class InjectCancellationChecks : public IRMutator {
+    // Whether a loop has been seen since this was last cleared.
+    bool found_loop;
+
+    using IRMutator::visit;
+
+    void visit(const For *op) {
+        found_loop = true;
+        if (CodeGen_GPU_Dev::is_gpu_var(op->name)) {
+            stmt = op;
+            return;
+        }
+
+        found_loop = false;
+        Stmt body = mutate(op->body);
+        // The innermost loops do too little per iteration to be
+        // worth polling in, unless each iteration is a task.
+        if (found_loop || op->for_type == For::Parallel) {
+            Expr check = Call::make(Int(32), Call::check_cancelled,
+                                    std::vector<Expr>(), Call::Intrinsic);
+            body = Block::make(Evaluate::make(check), body);
+        }
+        found_loop = true;
+
+        if (body.same_as(op->body)) {
+            stmt = op;
+        } else {
+            stmt = For::make(op->name, op->min, op->extent, op->for_type, body);
+        }
+    }
+
+public:
+    InjectCancellationChecks() : found_loop(false) {}
+};
+
+}
+
+Stmt inject_cancellation_checks(Stmt s) {
+    return InjectCancellationChecks().mutate(s);
+}
+
+}
+}
@@ -0,0 +1,25 @@
+#ifndef HALIDE_CANCELLATION_H
+#define HALIDE_CANCELLATION_H
+
+/** \file
+ * Defines the lowering pass that lets a running pipeline be
+ * cancelled.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Poll halide_is_cancelled (with check_cancelled intrinsics) at the
+ * start of each parallel task, and of each iteration of each loop that
+ * has another loop inside it, so that a cancelled pipeline gives up
+ * within about one row of work, and a parallel loop's remaining tasks
+ * return at once. Leaves gpu loops alone. Only used for targets with
+ * the cancellable feature. */
+Stmt inject_cancellation_checks(Stmt s);
+
+}
+}
+
+#endif
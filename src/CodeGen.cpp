@@ -1,5 +1,7 @@
 #include <iostream>
 #include <sstream>
+#include <algorithm>
+#include <stdlib.h>
 
 #include "IRPrinter.h"
 #include "CodeGen.h"
@@ -10,6 +12,8 @@
 #include "JITCompiledModule.h"
 #include "CodeGen_Internal.h"
 #include "Lerp.h"
+#include "IREquality.h"
+#include "ExprUsesVar.h"
 
 namespace Halide {
 namespace Internal {
@@ -86,7 +90,8 @@ CodeGen::CodeGen(Target t) :
     target(t),
     void_t(NULL), i1(NULL), i8(NULL), i16(NULL), i32(NULL), i64(NULL),
     f16(NULL), f32(NULL), f64(NULL),
-    buffer_t_type(NULL) {
+    buffer_t_type(NULL),
+    nontemporal(false) {
     initialize_llvm();
 }
 
@@ -171,6 +176,13 @@ void CodeGen::compile(Stmt stmt, string name,
     // Start the module off with a definition of a buffer_t
     define_buffer_t();
 
+    // With no statement, the module is just the runtime (see
+    // compile_standalone_runtime).
+    if (!stmt.defined()) {
+        function_name = "";
+        return;
+    }
+
     // Now deduce the types of the arguments to our function
     vector<llvm::Type *> arg_types(args.size());
     for (size_t i = 0; i < args.size(); i++) {
@@ -187,9 +199,16 @@ void CodeGen::compile(Stmt stmt, string name,
     function = llvm::Function::Create(func_t, llvm::Function::ExternalLinkage, name, module);
 
     // Mark the buffer args as no alias
+    host_alignment.clear();
+    asserted_conditions.clear();
+    assertion_failures.clear();
+    enclosing_loops.clear();
     for (size_t i = 0; i < args.size(); i++) {
         if (args[i].is_buffer) {
             function->setDoesNotAlias(i+1);
+            if (args[i].host_alignment > 0) {
+                host_alignment[args[i].name] = args[i].host_alignment;
+            }
         }
     }
 
@@ -328,12 +347,12 @@ llvm::Type *CodeGen::llvm_type_of(Type t) {
     return Internal::llvm_type_of(context, t);
 }
 
-JITCompiledModule CodeGen::compile_to_function_pointers() {
+JITCompiledModule CodeGen::compile_to_function_pointers(const string &cache_key) {
     assert(module && "No module defined. Must call compile before calling compile_to_function_pointer");
 
     JITCompiledModule m;
 
-    m.compile_module(this, module, function_name);
+    m.compile_module(this, module, function_name, cache_key);
 
     // We now relinquish ownership of the module, and give it to the
     // JITCompiledModule object that we're returning.
@@ -352,8 +371,26 @@ void CodeGen::optimize_module() {
     // Make sure things marked as always-inline get inlined
     module_pass_manager.add(createAlwaysInlinerPass());
 
+    bool optimize_size = (target.features & Halide::Target::OptimizeSize) != 0;
+    if (optimize_size) {
+        // Ask the code generator, as well as the passes, to favor
+        // small code over fast code in everything we generated.
+        for (llvm::Module::iterator iter = module->begin(); iter != module->end(); iter++) {
+            if (iter->isDeclaration()) continue;
+            iter->addFnAttr(Attribute::OptimizeForSize);
+            #if LLVM_VERSION >= 33
+            iter->addFnAttr(Attribute::MinSize);
+            #endif
+        }
+    }
+
     PassManagerBuilder b;
-    b.OptLevel = 3;
+    b.OptLevel = optimize_size ? 2 : 3;
+    if (optimize_size) {
+        // -Oz: no loop unrolling, and a smaller inlining threshold.
+        b.SizeLevel = 2;
+        b.DisableUnrollLoops = true;
+    }
     b.populateFunctionPassManager(function_pass_manager);
     b.populateModulePassManager(module_pass_manager);
 
@@ -368,11 +405,39 @@ void CodeGen::optimize_module() {
         function_pass_manager.doFinalization();
     }
 
+    char *report = getenv("HL_CODE_SIZE_REPORT");
+    if (optimize_size || (report && atoi(report))) {
+        report_code_size();
+    }
+
     if (debug::debug_level >= 2) {
         module->dump();
     }
 }
 
+void CodeGen::report_code_size() {
+    // Count the llvm instructions left in each function after
+    // optimization. Parallel loop bodies are functions of their own,
+    // named after the loop, so this says which stages the code goes to.
+    vector<pair<size_t, string> > sizes;
+    size_t total = 0;
+    for (llvm::Module::iterator iter = module->begin(); iter != module->end(); iter++) {
+        if (iter->isDeclaration()) continue;
+        size_t size = 0;
+        for (llvm::Function::iterator block = iter->begin(); block != iter->end(); block++) {
+            size += block->size();
+        }
+        sizes.push_back(std::make_pair(size, iter->getName().str()));
+        total += size;
+    }
+    std::sort(sizes.begin(), sizes.end());
+    std::cerr << "Code size of " << module->getModuleIdentifier()
+              << ": " << total << " llvm instructions\n";
+    for (size_t i = sizes.size(); i > 0; i--) {
+        std::cerr << "  " << sizes[i-1].first << "\t" << sizes[i-1].second << "\n";
+    }
+}
+
 void CodeGen::compile_to_bitcode(const string &filename) {
     assert(module && "No module defined. Must call compile before calling compile_to_bitcode");
 
@@ -427,7 +492,8 @@ void CodeGen::compile_to_native(const string &filename, bool assembly) {
                                     options,
                                     Reloc::PIC_,
                                     CodeModel::Default,
-                                    CodeGenOpt::Aggressive);
+                                    (this->target.features & Halide::Target::OptimizeSize) ?
+                                    CodeGenOpt::Default : CodeGenOpt::Aggressive);
 
     assert(target_machine && "Could not allocate target machine!");
 
@@ -674,11 +740,78 @@ void CodeGen::visit(const StringImm *op) {
     value = create_string_constant(op->value);
 }
 
-void CodeGen::visit(const Cast *op) {
-    value = codegen(op->value);
+namespace {
+// Half-precision floats are a storage type. Arithmetic on them is
+// done in single precision.
+bool is_float16(Halide::Type t) {
+    return t.is_float() && t.bits == 16;
+}
+
+Expr widen_float16(Expr e) {
+    return cast(Float(32, e.type().width), e);
+}
+
+// Convert the bits of a half-precision float to single precision
+// with integer arithmetic, for targets without conversion
+// instructions. Moving the exponent and mantissa into place and
+// rescaling by 2^112 handles normals and denormals alike. Infinities
+// and nans just need the rest of their exponent set.
+Expr float16_to_float32(Expr h) {
+    int w = h.type().width;
+    Expr x = cast(UInt(32, w), h);
+    Expr magnitude = (x & 0x7fff) << 13;
+    Expr scaled = reinterpret(Float(32, w), magnitude) * 5.192296858534828e33f;
+    Expr bits = select((x & 0x7fff) >= 0x7c00,
+                       magnitude | 0x7f800000,
+                       reinterpret(UInt(32, w), scaled));
+    bits = bits | ((x & 0x8000) << 16);
+    return reinterpret(Float(32, w), bits);
+}
+
+// The reverse, rounding to nearest even. Values too small to be
+// normal halfs are rounded by adding 0.5f, which lines their bits up
+// with a half denormal mantissa.
+Expr float32_to_float16(Expr f) {
+    int w = f.type().width;
+    Halide::Type u32 = UInt(32, w);
+    Expr x = reinterpret(u32, f);
+    Expr magnitude = x & 0x7fffffff;
+    Expr overflow = select(magnitude > 0x7f800000, make_const(u32, 0x7e00), make_const(u32, 0x7c00));
+    Expr denormal = reinterpret(u32, reinterpret(Float(32, w), magnitude) + 0.5f) - 0x3f000000;
+    Expr mantissa_odd = (magnitude >> 13) & 1;
+    Expr normal = (magnitude - 0x38000000 + 0xfff + mantissa_odd) >> 13;
+    Expr bits = select(magnitude >= 0x47800000, overflow,
+                       select(magnitude < 0x38800000, denormal, normal));
+    bits = bits | ((x >> 31) << 15);
+    return cast(UInt(16, w), bits);
+}
+}
 
+void CodeGen::visit(const Cast *op) {
     Halide::Type src = op->value.type();
     Halide::Type dst = op->type;
+
+    if (is_float16(src) != is_float16(dst)) {
+        // Everything goes to and from half precision via single
+        // precision.
+        Halide::Type single = Float(32, dst.width);
+        if ((is_float16(dst) && src != single) ||
+            (is_float16(src) && dst != single)) {
+            value = codegen(cast(dst, cast(single, op->value)));
+            return;
+        }
+        if (!use_native_float16_conversions()) {
+            if (is_float16(src)) {
+                value = codegen(float16_to_float32(reinterpret(UInt(16, src.width), op->value)));
+            } else {
+                value = codegen(reinterpret(dst, float32_to_float16(op->value)));
+            }
+            return;
+        }
+    }
+
+    value = codegen(op->value);
+
     llvm::Type *llvm_dst = llvm_type_of(dst);
 
     if (!src.is_float() && !dst.is_float()) {
@@ -706,6 +839,11 @@ void CodeGen::visit(const Variable *op) {
 }
 
 void CodeGen::visit(const Add *op) {
+    if (is_float16(op->type)) {
+        value = codegen(cast(op->type, widen_float16(op->a) + widen_float16(op->b)));
+        return;
+    }
+
     if (op->type.is_float()) {
         value = builder->CreateFAdd(codegen(op->a), codegen(op->b));
     } else if (op->type.is_int()) {
@@ -718,6 +856,11 @@ void CodeGen::visit(const Add *op) {
 }
 
 void CodeGen::visit(const Sub *op) {
+    if (is_float16(op->type)) {
+        value = codegen(cast(op->type, widen_float16(op->a) - widen_float16(op->b)));
+        return;
+    }
+
     if (op->type.is_float()) {
         value = builder->CreateFSub(codegen(op->a), codegen(op->b));
     } else if (op->type.is_int()) {
@@ -730,6 +873,11 @@ void CodeGen::visit(const Sub *op) {
 }
 
 void CodeGen::visit(const Mul *op) {
+    if (is_float16(op->type)) {
+        value = codegen(cast(op->type, widen_float16(op->a) * widen_float16(op->b)));
+        return;
+    }
+
     if (op->type.is_float()) {
         value = builder->CreateFMul(codegen(op->a), codegen(op->b));
     } else if (op->type.is_int()) {
@@ -742,6 +890,11 @@ void CodeGen::visit(const Mul *op) {
 }
 
 void CodeGen::visit(const Div *op) {
+    if (is_float16(op->type)) {
+        value = codegen(cast(op->type, widen_float16(op->a) / widen_float16(op->b)));
+        return;
+    }
+
     if (op->type.is_float()) {
         value = builder->CreateFDiv(codegen(op->a), codegen(op->b));
     } else if (op->type.is_uint()) {
@@ -793,6 +946,11 @@ void CodeGen::visit(const Div *op) {
 }
 
 void CodeGen::visit(const Mod *op) {
+    if (is_float16(op->type)) {
+        value = codegen(cast(op->type, widen_float16(op->a) % widen_float16(op->b)));
+        return;
+    }
+
     // To match our definition of division, mod should have this behavior:
     // 3 % 2 -> 1;
     // -3 % 2 -> 1;
@@ -838,6 +996,11 @@ void CodeGen::visit(const Mod *op) {
 }
 
 void CodeGen::visit(const Min *op) {
+    if (is_float16(op->type)) {
+        value = codegen(cast(op->type, min(widen_float16(op->a), widen_float16(op->b))));
+        return;
+    }
+
     Value *a = codegen(op->a);
     Value *b = codegen(op->b);
     Value *cmp;
@@ -855,6 +1018,11 @@ void CodeGen::visit(const Min *op) {
 }
 
 void CodeGen::visit(const Max *op) {
+    if (is_float16(op->type)) {
+        value = codegen(cast(op->type, max(widen_float16(op->a), widen_float16(op->b))));
+        return;
+    }
+
     Value *a = codegen(op->a);
     Value *b = codegen(op->b);
     Value *cmp;
@@ -872,6 +1040,11 @@ void CodeGen::visit(const Max *op) {
 }
 
 void CodeGen::visit(const EQ *op) {
+    if (is_float16(op->a.type())) {
+        value = codegen(widen_float16(op->a) == widen_float16(op->b));
+        return;
+    }
+
     Value *a = codegen(op->a);
     Value *b = codegen(op->b);
     Halide::Type t = op->a.type();
@@ -883,6 +1056,11 @@ void CodeGen::visit(const EQ *op) {
 }
 
 void CodeGen::visit(const NE *op) {
+    if (is_float16(op->a.type())) {
+        value = codegen(widen_float16(op->a) != widen_float16(op->b));
+        return;
+    }
+
     Value *a = codegen(op->a);
     Value *b = codegen(op->b);
     Halide::Type t = op->a.type();
@@ -894,6 +1072,11 @@ void CodeGen::visit(const NE *op) {
 }
 
 void CodeGen::visit(const LT *op) {
+    if (is_float16(op->a.type())) {
+        value = codegen(widen_float16(op->a) < widen_float16(op->b));
+        return;
+    }
+
     Value *a = codegen(op->a);
     Value *b = codegen(op->b);
 
@@ -908,6 +1091,11 @@ void CodeGen::visit(const LT *op) {
 }
 
 void CodeGen::visit(const LE *op) {
+    if (is_float16(op->a.type())) {
+        value = codegen(widen_float16(op->a) <= widen_float16(op->b));
+        return;
+    }
+
     Value *a = codegen(op->a);
     Value *b = codegen(op->b);
     Halide::Type t = op->a.type();
@@ -921,6 +1109,11 @@ void CodeGen::visit(const LE *op) {
 }
 
 void CodeGen::visit(const GT *op) {
+    if (is_float16(op->a.type())) {
+        value = codegen(widen_float16(op->a) > widen_float16(op->b));
+        return;
+    }
+
     Value *a = codegen(op->a);
     Value *b = codegen(op->b);
     Halide::Type t = op->a.type();
@@ -934,6 +1127,11 @@ void CodeGen::visit(const GT *op) {
 }
 
 void CodeGen::visit(const GE *op) {
+    if (is_float16(op->a.type())) {
+        value = codegen(widen_float16(op->a) >= widen_float16(op->b));
+        return;
+    }
+
     Value *a = codegen(op->a);
     Value *b = codegen(op->b);
     Halide::Type t = op->a.type();
@@ -1055,6 +1253,112 @@ Value *CodeGen::codegen_buffer_pointer(string buffer, Halide::Type type, Value *
     return builder->CreateInBoundsGEP(base_address, index);
 }
 
+namespace {
+// Is there a load from the given buffer in an expression.
+class LoadsFrom : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &buffer;
+
+    void visit(const Load *op) {
+        if (op->name == buffer) result = true;
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool result;
+    LoadsFrom(const string &b) : buffer(b), result(false) {}
+};
+}
+
+bool CodeGen::split_large_index(const string &buffer, Expr index, Expr *inner, Expr *offset) {
+    const Add *add = index.as<Add>();
+    if (index.type().bits != 64 || index.type().is_scalar() || !add) return false;
+
+    const Cast *c = add->a.as<Cast>();
+    Expr o = add->b;
+    if (!c || c->value.type().bits != 32) {
+        c = add->b.as<Cast>();
+        o = add->a;
+    }
+    if (!c || c->value.type().bits != 32) return false;
+    const Broadcast *b = o.as<Broadcast>();
+    if (!b) return false;
+
+    // The 32-bit part is codegen'd with the moved host pointer in
+    // scope, so it must not load from the same buffer.
+    LoadsFrom loads(buffer);
+    c->value.accept(&loads);
+    if (loads.result) return false;
+
+    *inner = c->value;
+    *offset = b->value;
+    return true;
+}
+
+void CodeGen::begin_large_buffer_access(const string &buffer, Halide::Type type, Expr offset) {
+    sym_push(buffer + ".host", codegen_buffer_pointer(buffer, type.element_of(), offset));
+
+    // Nothing is known about the alignment of the new pointer.
+    if (host_alignment.count(buffer)) {
+        saved_host_alignment[buffer] = host_alignment[buffer];
+        host_alignment.erase(buffer);
+    }
+    if (!might_be_misaligned.count(buffer)) {
+        might_be_misaligned.insert(buffer);
+        added_misaligned.insert(buffer);
+    }
+}
+
+void CodeGen::end_large_buffer_access(const string &buffer) {
+    sym_pop(buffer + ".host");
+    if (saved_host_alignment.count(buffer)) {
+        host_alignment[buffer] = saved_host_alignment[buffer];
+        saved_host_alignment.erase(buffer);
+    }
+    if (added_misaligned.count(buffer)) {
+        might_be_misaligned.erase(buffer);
+        added_misaligned.erase(buffer);
+    }
+}
+
+Value *CodeGen::codegen_atomic_add(Value *ptr, Value *val, Halide::Type type) {
+    if (!type.is_float()) {
+        return builder->CreateAtomicRMW(AtomicRMWInst::Add, ptr, val, Monotonic);
+    }
+
+    // There's no atomic floating point add, so swap in the sum of the
+    // old value and val, and retry until nobody else changed the old
+    // value in the meantime.
+    llvm::Type *bits_type = llvm_type_of(UInt(type.bits));
+    unsigned address_space = ptr->getType()->getPointerAddressSpace();
+    Value *bits_ptr = builder->CreatePointerCast(ptr, bits_type->getPointerTo(address_space));
+
+    BasicBlock *before_bb = builder->GetInsertBlock();
+    BasicBlock *loop_bb = BasicBlock::Create(*context, "atomic_add_loop", function);
+    BasicBlock *after_bb = BasicBlock::Create(*context, "atomic_add_done", function);
+
+    Value *initial = builder->CreateLoad(bits_ptr);
+    builder->CreateBr(loop_bb);
+
+    builder->SetInsertPoint(loop_bb);
+    PHINode *old_bits = builder->CreatePHI(bits_type, 2);
+    old_bits->addIncoming(initial, before_bb);
+    Value *old_val = builder->CreateBitCast(old_bits, val->getType());
+    Value *new_bits = builder->CreateBitCast(builder->CreateFAdd(old_val, val), bits_type);
+    #if LLVM_VERSION < 35
+    Value *seen = builder->CreateAtomicCmpXchg(bits_ptr, old_bits, new_bits, Monotonic);
+    #else
+    Value *seen = builder->CreateAtomicCmpXchg(bits_ptr, old_bits, new_bits, Monotonic, Monotonic);
+    seen = builder->CreateExtractValue(seen, 0);
+    #endif
+    old_bits->addIncoming(seen, builder->GetInsertBlock());
+    builder->CreateCondBr(builder->CreateICmpEQ(seen, old_bits), after_bb, loop_bb);
+
+    builder->SetInsertPoint(after_bb);
+    return old_val;
+}
+
 void CodeGen::add_tbaa_metadata(llvm::Instruction *inst, string buffer) {
     // Add type-based-alias-analysis metadata to the pointer, so that
     // loads and stores to different buffers can get reordered.
@@ -1063,8 +1367,55 @@ void CodeGen::add_tbaa_metadata(llvm::Instruction *inst, string buffer) {
     inst->setMetadata("tbaa", tbaa);
 }
 
+Value *CodeGen::concat_vectors(const vector<Value *> &v) {
+    assert(!v.empty() && "Can't concatenate zero vectors");
+    vector<Value *> vecs = v;
+    while (vecs.size() > 1) {
+        vector<Value *> merged;
+        for (size_t i = 0; i < vecs.size(); i += 2) {
+            if (i + 1 == vecs.size()) {
+                merged.push_back(vecs[i]);
+                break;
+            }
+            Value *a = vecs[i], *b = vecs[i+1];
+            int wa = a->getType()->getVectorNumElements();
+            int wb = b->getType()->getVectorNumElements();
+            if (wb < wa) {
+                // Pad the second vector out to the width of the first
+                // with undefined lanes.
+                vector<Constant *> pad(wa);
+                for (int j = 0; j < wa; j++) {
+                    pad[j] = j < wb ? ConstantInt::get(i32, j) : UndefValue::get(i32);
+                }
+                b = builder->CreateShuffleVector(b, UndefValue::get(b->getType()), ConstantVector::get(pad));
+            }
+            assert(wb <= wa && "Can't concatenate vectors in order of increasing width");
+            vector<Constant *> indices(wa + wb);
+            for (int j = 0; j < wa + wb; j++) {
+                indices[j] = ConstantInt::get(i32, j);
+            }
+            merged.push_back(builder->CreateShuffleVector(a, b, ConstantVector::get(indices)));
+        }
+        vecs.swap(merged);
+    }
+    return vecs[0];
+}
+
 void CodeGen::visit(const Load *op) {
 
+    if (op->predicate.defined()) {
+        codegen_predicated_load(op);
+        return;
+    }
+
+    Expr inner, offset;
+    if (split_large_index(op->name, op->index, &inner, &offset)) {
+        begin_large_buffer_access(op->name, op->type, offset);
+        value = codegen(Load::make(op->type, op->name, inner, op->image, op->param));
+        end_large_buffer_access(op->name);
+        return;
+    }
+
     bool possibly_misaligned = (might_be_misaligned.find(op->name) != might_be_misaligned.end());
 
     // There are several cases. Different architectures may wish to override some.
@@ -1084,13 +1435,25 @@ void CodeGen::visit(const Load *op) {
         if (ramp && internal) {
             // If it's an internal allocation, we can boost the
             // alignment using the results of the modulus remainder
-            // analysis
-            ModulusRemainder mod_rem = modulus_remainder(ramp->base);
+            // analysis. The strides of the allocation are in scope,
+            // so rows rounded up by align_storage are known to be
+            // aligned.
+            ModulusRemainder mod_rem = modulus_remainder(ramp->base, alignment_info);
             alignment *= gcd(gcd(mod_rem.modulus, mod_rem.remainder), 32);
             if (alignment < 0) {
                 // Can happen if ramp->base is a negative constant
                 alignment = -alignment;
             }
+        } else if (ramp && host_alignment.count(op->name)) {
+            // The host pointer is asserted to be aligned, so the same
+            // goes for an aligned index, up to the alignment of the
+            // host pointer.
+            ModulusRemainder mod_rem = modulus_remainder(ramp->base, alignment_info);
+            int max_lanes = std::max(host_alignment[op->name] / alignment, 1);
+            alignment *= gcd(gcd(mod_rem.modulus, mod_rem.remainder), max_lanes);
+            if (alignment < 0) {
+                alignment = -alignment;
+            }
         }
 
         if (ramp && stride && stride->value == 1) {
@@ -1151,9 +1514,15 @@ void CodeGen::visit(const Load *op) {
             // Re-do alignment analysis for the flipped index
             if (internal && !possibly_misaligned) {
                 alignment = op->type.bytes();
-                ModulusRemainder mod_rem = modulus_remainder(ramp->base - ramp->width + 1);
+                ModulusRemainder mod_rem = modulus_remainder(base, alignment_info);
                 alignment *= gcd(gcd(mod_rem.modulus, mod_rem.remainder), 32);
                 if (alignment < 0) alignment = -alignment;
+            } else if (!internal && host_alignment.count(op->name)) {
+                alignment = op->type.bytes();
+                ModulusRemainder mod_rem = modulus_remainder(base, alignment_info);
+                int max_lanes = std::max(host_alignment[op->name] / alignment, 1);
+                alignment *= gcd(gcd(mod_rem.modulus, mod_rem.remainder), max_lanes);
+                if (alignment < 0) alignment = -alignment;
             }
 
             Value *ptr = codegen_buffer_pointer(op->name, op->type.element_of(), base);
@@ -1211,6 +1580,57 @@ void CodeGen::visit(const Load *op) {
 
 }
 
+void CodeGen::codegen_predicated_load(const Load *op) {
+    Value *pred = codegen(op->predicate);
+    llvm::Type *t = llvm_type_of(op->type);
+    Halide::Type elem = op->type.element_of();
+
+    #if LLVM_VERSION >= 37
+    const Ramp *ramp = op->index.as<Ramp>();
+    if (ramp && is_one(ramp->stride)) {
+        Value *ptr = codegen_buffer_pointer(op->name, elem, ramp->base);
+        ptr = builder->CreatePointerCast(ptr, t->getPointerTo());
+        value = builder->CreateMaskedLoad(ptr, elem.bytes(), pred, UndefValue::get(t));
+        return;
+    }
+    #endif
+
+    // Load each lane in its own basic block, so that the lanes that
+    // are masked off never touch memory.
+    Value *index = codegen(op->index);
+    Value *result = UndefValue::get(t);
+    for (int i = 0; i < op->type.width; i++) {
+        Value *lane = ConstantInt::get(i32, i);
+        Value *lane_pred = pred, *lane_idx = index;
+        if (op->type.is_vector()) {
+            lane_pred = builder->CreateExtractElement(pred, lane);
+            lane_idx = builder->CreateExtractElement(index, lane);
+        }
+
+        BasicBlock *before_bb = builder->GetInsertBlock();
+        BasicBlock *load_bb = BasicBlock::Create(*context, "predicated_load", function);
+        BasicBlock *after_bb = BasicBlock::Create(*context, "after_predicated_load", function);
+        builder->CreateCondBr(lane_pred, load_bb, after_bb);
+
+        builder->SetInsertPoint(load_bb);
+        Value *ptr = codegen_buffer_pointer(op->name, elem, lane_idx);
+        LoadInst *val = builder->CreateAlignedLoad(ptr, elem.bytes());
+        add_tbaa_metadata(val, op->name);
+        Value *loaded = val;
+        if (op->type.is_vector()) {
+            loaded = builder->CreateInsertElement(result, val, lane);
+        }
+        builder->CreateBr(after_bb);
+
+        builder->SetInsertPoint(after_bb);
+        PHINode *phi = builder->CreatePHI(t, 2);
+        phi->addIncoming(result, before_bb);
+        phi->addIncoming(loaded, load_bb);
+        result = phi;
+    }
+    value = result;
+}
+
 void CodeGen::visit(const Ramp *op) {
     if (is_const(op->stride) && !is_const(op->base)) {
         // If the stride is const and the base is not (e.g. ramp(x, 1,
@@ -1268,23 +1688,49 @@ Expr unbroadcast(Expr e) {
 bool CodeGen::function_takes_user_context(const string &name) {
     static const char *user_context_runtime_funcs[] = {
         "halide_copy_to_host",
+        "halide_copy_to_host_range",
         "halide_copy_to_dev",
         "halide_current_time_ns",
         "halide_debug_to_file",
+        "halide_dev_flush",
         "halide_dev_free",
         "halide_dev_malloc",
         "halide_dev_run",
         "halide_dev_sync",
+        "halide_device_split_extent",
+        "halide_device_split_report",
+        "halide_distributed_exchange",
+        "halide_distributed_num_ranks",
+        "halide_distributed_owned_max",
+        "halide_distributed_owned_min",
+        "halide_distributed_rank",
         "halide_do_par_for",
         "halide_do_task",
         "halide_error",
         "halide_error_varargs",
         "halide_free",
+        "halide_free_semaphore",
+        "halide_get_num_threads",
+        "halide_gpu_dispatch_threshold",
         "halide_init_kernels",
+        "halide_make_semaphore",
         "halide_malloc",
+        "halide_memoization_cache_lookup",
+        "halide_memoization_cache_store",
+        "halide_persistent_storage_acquire",
+        "halide_persistent_storage_release",
+        "halide_pgo_counters",
         "halide_printf",
+        "halide_profiler_pipeline_end",
+        "halide_profiler_pipeline_start",
         "halide_profiling_timer",
         "halide_release",
+        "halide_release_worker",
+        "halide_reserve_worker",
+        "halide_runtime_stats_begin",
+        "halide_runtime_stats_end",
+        "halide_schedule_report",
+        "halide_schedule_select",
         "halide_start_clock",
         "halide_trace"
     };
@@ -1298,6 +1744,55 @@ bool CodeGen::function_takes_user_context(const string &name) {
     return false;
 }
 
+Expr CodeGen::lower_vector_reduce(const string &reduce, Type t, Expr arg) {
+    int factor = arg.type().width / t.width;
+    assert(factor * t.width == arg.type().width &&
+           "The width of a vector reduction must divide the width of its argument");
+
+    // Pull out lane j of each group of adjacent lanes as a vector,
+    // for each j, and combine the vectors pairwise.
+    string name = unique_name('v');
+    Expr v = Variable::make(arg.type(), name);
+    vector<Expr> terms;
+    for (int j = 0; j < factor; j++) {
+        vector<Expr> args;
+        args.push_back(v);
+        for (int i = 0; i < t.width; i++) {
+            args.push_back(i * factor + j);
+        }
+        terms.push_back(Call::make(t, Call::shuffle_vector, args, Call::Intrinsic));
+    }
+    while (terms.size() > 1) {
+        vector<Expr> combined;
+        for (size_t i = 0; i + 1 < terms.size(); i += 2) {
+            Expr a = terms[i], b = terms[i+1];
+            if (reduce == Call::vector_reduce_add) {
+                combined.push_back(Add::make(a, b));
+            } else if (reduce == Call::vector_reduce_min) {
+                combined.push_back(Min::make(a, b));
+            } else {
+                combined.push_back(Max::make(a, b));
+            }
+        }
+        if (terms.size() % 2) {
+            combined.push_back(terms.back());
+        }
+        terms.swap(combined);
+    }
+    return Let::make(name, arg, terms[0]);
+}
+
+Value *CodeGen::codegen_vector_reduce(const Call *op, Value *partial, Type partial_type) {
+    if (partial_type == op->type) {
+        return partial;
+    }
+    string name = unique_name('v');
+    sym_push(name, partial);
+    Value *result = codegen(lower_vector_reduce(op->name, op->type, Variable::make(partial_type, name)));
+    sym_pop(name);
+    return result;
+}
+
 void CodeGen::visit(const Call *op) {
     assert((op->call_type == Call::Extern || op->call_type == Call::Intrinsic) &&
            "Can only codegen extern calls and intrinsics");
@@ -1323,18 +1818,43 @@ void CodeGen::visit(const Call *op) {
             }
 
         } else if (op->name == Call::interleave_vectors) {
-            assert(op->args.size() == 2);
-            Expr a = op->args[0], b = op->args[1];
-            debug(3) << "Vectors to interleave: " << a << ", " << b << "\n";
+            int n = (int)op->args.size();
+            assert(n >= 2 && "interleave_vectors takes at least two arguments");
+            int width = op->args[0].type().width;
+            vector<Value *> vecs(n);
+            for (int i = 0; i < n; i++) {
+                assert(op->args[i].type().width == width &&
+                       "The args to interleave_vectors must have the same width");
+                debug(3) << "Vector to interleave: " << op->args[i] << "\n";
+                vecs[i] = codegen(op->args[i]);
+            }
 
-            vector<Constant *> indices(op->type.width);
-            for (int i = 0; i < op->type.width; i++) {
-                int idx = i/2;
-                if (i % 2 == 1) idx += a.type().width;
-                indices[i] = ConstantInt::get(i32, idx);
+            if (n == 2) {
+                vector<Constant *> indices(op->type.width);
+                for (int i = 0; i < op->type.width; i++) {
+                    int idx = i/2;
+                    if (i % 2 == 1) idx += width;
+                    indices[i] = ConstantInt::get(i32, idx);
+                }
+                value = builder->CreateShuffleVector(vecs[0], vecs[1], ConstantVector::get(indices));
+            } else {
+                // Concatenate the vectors, and then take lane i/n of
+                // vector i%n for each lane i of the result.
+                Value *all = concat_vectors(vecs);
+                vector<Constant *> indices(op->type.width);
+                for (int i = 0; i < op->type.width; i++) {
+                    indices[i] = ConstantInt::get(i32, (i % n) * width + i / n);
+                }
+                value = builder->CreateShuffleVector(all, UndefValue::get(all->getType()),
+                                                     ConstantVector::get(indices));
             }
 
-            value = builder->CreateShuffleVector(codegen(a), codegen(b), ConstantVector::get(indices));
+        } else if (op->name == Call::concat_vectors) {
+            vector<Value *> vecs(op->args.size());
+            for (size_t i = 0; i < op->args.size(); i++) {
+                vecs[i] = codegen(op->args[i]);
+            }
+            value = concat_vectors(vecs);
 
         } else if (op->name == Call::debug_to_file) {
             assert(op->args.size() == 9);
@@ -1373,7 +1893,12 @@ void CodeGen::visit(const Call *op) {
             value = builder->CreateNot(codegen(op->args[0]));
         } else if (op->name == Call::reinterpret) {
             assert(op->args.size() == 1);
-            value = builder->CreateBitCast(codegen(op->args[0]), llvm_type_of(op->type));
+            if (op->args[0].type().is_handle() && !op->type.is_handle()) {
+                // Get the address a handle points to as an integer.
+                value = builder->CreatePtrToInt(codegen(op->args[0]), llvm_type_of(op->type));
+            } else {
+                value = builder->CreateBitCast(codegen(op->args[0]), llvm_type_of(op->type));
+            }
         } else if (op->name == Call::shift_left) {
             assert(op->args.size() == 2);
             value = builder->CreateShl(codegen(op->args[0]), codegen(op->args[1]));
@@ -1431,6 +1956,7 @@ void CodeGen::visit(const Call *op) {
             builder->CreateStore(elem_size, buffer_elem_size_ptr(buffer));
 
             int dims = op->args.size()/3;
+            assert(dims <= 4 && "A buffer_t has at most four dimensions");
             for (int i = 0; i < 4; i++) {
                 Value *min, *extent, *stride;
                 if (i < dims) {
@@ -1502,6 +2028,113 @@ void CodeGen::visit(const Call *op) {
 
             value = codegen_buffer_pointer(load->name, load->type, load->index);
 
+        } else if (op->name == Call::vector_reduce_add ||
+                   op->name == Call::vector_reduce_min ||
+                   op->name == Call::vector_reduce_max) {
+            assert(op->args.size() == 1 && "Vector reductions take one argument");
+            value = codegen(lower_vector_reduce(op->name, op->type, op->args[0]));
+        } else if (op->name == Call::prefetch) {
+            assert(op->args.size() == 1 && "prefetch takes one argument");
+            Value *address = builder->CreatePointerCast(codegen(op->args[0]), i8->getPointerTo());
+            llvm::Function *fn = Intrinsic::getDeclaration(module, Intrinsic::prefetch);
+            // A read, with maximum temporal locality, into the data cache.
+            Value *args[4] = {address,
+                              ConstantInt::get(i32, 0),
+                              ConstantInt::get(i32, 3),
+                              ConstantInt::get(i32, 1)};
+            builder->CreateCall(fn, args);
+            value = ConstantInt::get(i32, 0);
+        } else if (op->name == Call::nontemporal_store) {
+            assert(op->args.size() == 2 && "nontemporal_store takes two arguments");
+            const Load *load = op->args[0].as<Load>();
+            assert(load && "The first argument to nontemporal_store must be a Load node");
+            nontemporal = true;
+            codegen(Store::make(load->name, op->args[1], load->index));
+            nontemporal = false;
+            value = ConstantInt::get(i32, 0);
+        } else if (op->name == Call::branch_weights) {
+            // Only meaningful as the condition of an IfThenElse.
+            value = codegen(op->args[0]);
+        } else if (op->name == Call::store_fence) {
+            // Streaming stores are weakly ordered, so order them
+            // before whatever reads the buffer next.
+            builder->CreateFence(SequentiallyConsistent);
+            value = ConstantInt::get(i32, 0);
+        } else if (op->name == Call::check_cancelled) {
+            // Ask the runtime, and if the pipeline has been
+            // cancelled, bail out quietly with the status that says so.
+            llvm::Function *is_cancelled = module->getFunction("halide_is_cancelled");
+            assert(is_cancelled && "Could not find halide_is_cancelled in initial module");
+            Value *cancelled = builder->CreateCall(is_cancelled, get_user_context());
+            cancelled = builder->CreateIsNotNull(cancelled);
+            return_quietly_if(cancelled, cancelled_status);
+            value = ConstantInt::get(i32, 0);
+        } else if (op->name == Call::cleanup_on_exit) {
+            // Nothing happens here. Each early return from here on
+            // makes the call, until a run_cleanup of the same call.
+            assert(op->args.size() == 1 && op->args[0].as<Call>() &&
+                   "cleanup_on_exit takes one call");
+            early_exit_cleanups.push_back(op->args[0]);
+            value = ConstantInt::get(i32, 0);
+        } else if (op->name == Call::run_cleanup) {
+            assert(op->args.size() == 1 && "run_cleanup takes one call");
+            for (size_t i = early_exit_cleanups.size(); i > 0; i--) {
+                if (equal(early_exit_cleanups[i-1], op->args[0])) {
+                    early_exit_cleanups.erase(early_exit_cleanups.begin() + (i-1));
+                    break;
+                }
+            }
+            value = codegen(op->args[0]);
+        } else if (op->name == Call::fill_memory) {
+            assert(op->args.size() == 3 && "fill_memory takes three arguments");
+            Value *ptr = codegen(op->args[0]);
+            Value *byte = builder->CreateTrunc(codegen(op->args[1]), i8);
+            Value *size = codegen(op->args[2]);
+            builder->CreateMemSet(ptr, byte, size, 1);
+            value = ConstantInt::get(i32, 0);
+        } else if (op->name == Call::check_memory_budget) {
+            // Tell the runtime the estimate, and unless this is a
+            // bounds query, give up quietly if it refuses.
+            assert(op->args.size() == 3 && "check_memory_budget takes three arguments");
+            llvm::Function *check = module->getFunction("halide_check_memory_budget");
+            assert(check && "Could not find halide_check_memory_budget in initial module");
+            Value *is_query = codegen(op->args[2]);
+            Value *args[] = {get_user_context(), codegen(op->args[0]), codegen(op->args[1]),
+                             builder->CreateZExt(is_query, i32)};
+            Value *over = builder->CreateIsNotNull(builder->CreateCall(check, args));
+            over = builder->CreateAnd(over, builder->CreateNot(is_query));
+            return_quietly_if(over, over_memory_budget_status);
+            value = ConstantInt::get(i32, 0);
+        } else if (op->name == Call::atomic_add) {
+            assert(op->args.size() == 2 && "atomic_add takes two arguments");
+            Expr dst = op->args[0];
+            if (const Broadcast *b = dst.as<Broadcast>()) {
+                dst = b->value;
+            }
+            const Load *load = dst.as<Load>();
+            assert(load && "The first argument to atomic_add must be a Load node");
+
+            Halide::Type t = op->type.element_of();
+            Value *val = codegen(op->args[1]);
+            if (op->type.is_scalar()) {
+                Value *ptr = codegen_buffer_pointer(load->name, t, load->index);
+                value = codegen_atomic_add(ptr, val, t);
+            } else {
+                // Do one atomic add per lane.
+                Value *index = codegen(load->index);
+                value = UndefValue::get(llvm_type_of(op->type));
+                for (int i = 0; i < op->type.width; i++) {
+                    Value *lane = ConstantInt::get(i32, i);
+                    Value *idx = index;
+                    if (load->index.type().is_vector()) {
+                        idx = builder->CreateExtractElement(index, lane);
+                    }
+                    Value *ptr = codegen_buffer_pointer(load->name, t, idx);
+                    Value *old = codegen_atomic_add(ptr, builder->CreateExtractElement(val, lane), t);
+                    value = builder->CreateInsertElement(value, old, lane);
+                }
+            }
+
         } else if (op->name == Call::trace || op->name == Call::trace_expr) {
 
             int int_args = (int)(op->args.size()) - 5;
@@ -1720,8 +2353,9 @@ void CodeGen::visit(const Call *op) {
             }
         }
 
-        // If any of the args are handles, assume it might access memory
-        bool pure = true;
+        // If any of the args are handles, or it's a runtime function
+        // that gets the user context, assume it might access memory
+        bool pure = !function_takes_user_context(op->name);
         for (size_t i = 0; i < op->args.size(); i++) {
             if (op->args[i].type().is_handle()) {
                 pure = false;
@@ -1811,6 +2445,16 @@ void CodeGen::visit(const Let *op) {
 void CodeGen::visit(const LetStmt *op) {
     sym_push(op->name, codegen(op->value));
 
+    // Conditions that mention a shadowed name don't hold in the
+    // body, and the ones checked in the body don't hold after it.
+    vector<Expr> outer_asserted;
+    outer_asserted.swap(asserted_conditions);
+    for (size_t i = 0; i < outer_asserted.size(); i++) {
+        if (!expr_uses_var(outer_asserted[i], op->name)) {
+            asserted_conditions.push_back(outer_asserted[i]);
+        }
+    }
+
     if (op->value.type() == Int(32)) {
         alignment_info.push(op->name, modulus_remainder(op->value, alignment_info));
     }
@@ -1819,9 +2463,69 @@ void CodeGen::visit(const LetStmt *op) {
         alignment_info.pop(op->name);
     }
     sym_pop(op->name);
+
+    asserted_conditions.swap(outer_asserted);
+}
+
+namespace {
+// Can an expression be evaluated again with the same result and no
+// effects. Loads might see memory written in between, and extern
+// calls and most intrinsics do work of their own (e.g. asserts that
+// a call to halide_shutdown_trace returns zero).
+class CanRepeat : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Load *op) {
+        result = false;
+    }
+
+    void visit(const Call *op) {
+        if (op->call_type != Call::Intrinsic ||
+            !(op->name == Call::reinterpret ||
+              op->name == Call::bitwise_and ||
+              op->name == Call::bitwise_not ||
+              op->name == Call::bitwise_xor ||
+              op->name == Call::bitwise_or ||
+              op->name == Call::shift_left ||
+              op->name == Call::shift_right ||
+              op->name == Call::abs ||
+              op->name == Call::lerp ||
+              op->name == Call::popcount ||
+              op->name == Call::count_leading_zeros ||
+              op->name == Call::count_trailing_zeros ||
+              op->name == Call::null_handle ||
+              op->name == Call::if_then_else)) {
+            result = false;
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool result;
+    CanRepeat() : result(true) {}
+};
+
+bool can_repeat(Expr e) {
+    CanRepeat c;
+    e.accept(&c);
+    return c.result;
+}
 }
 
 void CodeGen::visit(const AssertStmt *op) {
+    // The checks of an image or parameter are often repeated, e.g.
+    // for each buffer that shares it. Only make the first one, unless
+    // evaluating the condition does something.
+    if (can_repeat(op->condition)) {
+        for (size_t i = 0; i < asserted_conditions.size(); i++) {
+            if (equal(asserted_conditions[i], op->condition)) {
+                debug(4) << "Skipping repeated assertion: " << op->condition << "\n";
+                return;
+            }
+        }
+        asserted_conditions.push_back(op->condition);
+    }
+
     vector<Value *> args(op->args.size());
     for (size_t i = 0; i < args.size(); i++) {
         args[i] = codegen(op->args[i]);
@@ -1878,25 +2582,27 @@ void CodeGen::create_assertion(Value *cond, const string &message, const vector<
     BasicBlock *assert_fails_bb = BasicBlock::Create(*context, "assert failed: " + message, function);
     BasicBlock *assert_succeeds_bb = BasicBlock::Create(*context, "assert succeeded: " + message, function);
 
-    // If the condition fails, enter the assert body, otherwise, enter the block after
-    builder->CreateCondBr(cond, assert_succeeds_bb, assert_fails_bb);
+    // If the condition fails, enter the assert body, otherwise,
+    // enter the block after. Asserts almost never fail, so weight the
+    // branch to keep the failure case out of the way of the hot path.
+    MDBuilder md_builder(*context);
+    builder->CreateCondBr(cond, assert_succeeds_bb, assert_fails_bb,
+                          md_builder.createBranchWeights(1 << 20, 1));
 
     // Build the failure case
     builder->SetInsertPoint(assert_fails_bb);
 
-    vector<Value *> call_args(2);
+    vector<Value *> call_args(1);
     call_args[0] = get_user_context();
-    call_args[1] = create_string_constant(message);
     call_args.insert(call_args.end(), args.begin(), args.end());
 
-    // Call the error handler
-    llvm::Function *error_handler = module->getFunction("halide_error_varargs");
-    assert(error_handler && "Could not find halide_error_varargs in initial module");
+    // Call the outlined code that reports the error
     debug(4) << "Creating call to error handlers\n";
-    builder->CreateCall(error_handler, call_args);
+    builder->CreateCall(assertion_failure_function(message, call_args), call_args);
 
     // Do any architecture-specific cleanup necessary
     debug(4) << "Creating cleanup code\n";
+    run_cleanups();
     prepare_for_early_exit();
 
     // Bail out with error code -1
@@ -1906,6 +2612,76 @@ void CodeGen::create_assertion(Value *cond, const string &message, const vector<
     builder->SetInsertPoint(assert_succeeds_bb);
 }
 
+void CodeGen::return_quietly_if(Value *cond, int status) {
+    BasicBlock *return_bb = BasicBlock::Create(*context, "return early", function);
+    BasicBlock *continue_bb = BasicBlock::Create(*context, "continue", function);
+
+    // Giving up is rare, so keep it off the hot path.
+    MDBuilder md_builder(*context);
+    builder->CreateCondBr(cond, return_bb, continue_bb,
+                          md_builder.createBranchWeights(1, 1 << 20));
+
+    builder->SetInsertPoint(return_bb);
+    run_cleanups();
+    prepare_for_early_exit();
+    builder->CreateRet(ConstantInt::get(i32, status));
+
+    builder->SetInsertPoint(continue_bb);
+}
+
+void CodeGen::run_cleanups() {
+    for (size_t i = early_exit_cleanups.size(); i > 0; i--) {
+        codegen(early_exit_cleanups[i-1]);
+    }
+}
+
+llvm::Function *CodeGen::assertion_failure_function(const string &message, const vector<Value *> &args) {
+    vector<llvm::Type *> arg_types(args.size());
+    for (size_t i = 0; i < args.size(); i++) {
+        arg_types[i] = args[i]->getType();
+    }
+    FunctionType *func_t = FunctionType::get(void_t, arg_types, false);
+
+    map<string, llvm::Function *>::iterator iter = assertion_failures.find(message);
+    if (iter != assertion_failures.end() &&
+        iter->second->getFunctionType() == func_t) {
+        return iter->second;
+    }
+
+    // Building the message and calling the error handler is a lot of
+    // code for something that almost never runs. Keep it in a cold
+    // function of its own, away from the code that checks.
+    llvm::Function *fn = llvm::Function::Create(func_t, llvm::Function::InternalLinkage,
+                                                "assert_failed", module);
+    #if LLVM_VERSION >= 33
+    fn->addFnAttr(Attribute::NoInline);
+    fn->addFnAttr(Attribute::OptimizeForSize);
+    #endif
+    #if LLVM_VERSION >= 34
+    fn->addFnAttr(Attribute::Cold);
+    #endif
+
+    BasicBlock *here = builder->GetInsertBlock();
+    builder->SetInsertPoint(BasicBlock::Create(*context, "entry", fn));
+
+    vector<Value *> call_args;
+    llvm::Function::arg_iterator arg = fn->arg_begin();
+    call_args.push_back(arg);
+    call_args.push_back(create_string_constant(message));
+    for (++arg; arg != fn->arg_end(); ++arg) {
+        call_args.push_back(arg);
+    }
+
+    llvm::Function *error_handler = module->getFunction("halide_error_varargs");
+    assert(error_handler && "Could not find halide_error_varargs in initial module");
+    builder->CreateCall(error_handler, call_args);
+    builder->CreateRetVoid();
+
+    builder->SetInsertPoint(here);
+    assertion_failures[message] = fn;
+    return fn;
+}
+
 void CodeGen::visit(const Pipeline *op) {
     BasicBlock *produce = BasicBlock::Create(*context, std::string("produce ") + op->name, function);
     builder->CreateBr(produce);
@@ -1925,10 +2701,31 @@ void CodeGen::visit(const Pipeline *op) {
     codegen(op->consume);
 }
 
+namespace {
+// Do all the symbols a closure holds have the same values now as they
+// had at some earlier point? Symbols in neither scope (untracked
+// buffers) don't count.
+bool closure_unchanged(const vector<string> &names,
+                       const Scope<Value *> &now, const Scope<Value *> &before) {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (!now.contains(names[i])) continue;
+        if (!before.contains(names[i]) ||
+            before.get(names[i]) != now.get(names[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
 void CodeGen::visit(const For *op) {
     Value *min = codegen(op->min);
     Value *extent = codegen(op->extent);
 
+    // The loop may run zero times, so what it checks doesn't hold
+    // after it.
+    size_t asserted_before = asserted_conditions.size();
+
     if (op->for_type == For::Serial) {
         Value *max = builder->CreateNSWAdd(min, extent);
 
@@ -1944,6 +2741,9 @@ void CodeGen::visit(const For *op) {
         builder->CreateCondBr(enter_condition, loop_bb, after_bb);
         builder->SetInsertPoint(loop_bb);
 
+        EnclosingLoop loop = {preheader_bb, symbol_table};
+        enclosing_loops.push_back(loop);
+
         // Make our phi node.
         PHINode *phi = builder->CreatePHI(i32, 2);
         phi->addIncoming(min, preheader_bb);
@@ -1966,6 +2766,8 @@ void CodeGen::visit(const For *op) {
 
         builder->SetInsertPoint(after_bb);
 
+        enclosing_loops.pop_back();
+
         // Pop the loop variable from the scope
         sym_pop(op->name);
     } else if (op->for_type == For::Parallel) {
@@ -1976,15 +2778,41 @@ void CodeGen::visit(const For *op) {
         // and dump it into a closure
         Closure closure = Closure::make(op->body, op->name, track_buffers(), buffer_t_type);
 
-        // Allocate a closure
-        StructType *closure_t = closure.build_type(context);
-        Value *ptr = create_alloca_at_entry(closure_t, 1);
+        // A closure that holds a single value of at most 32 bits is
+        // passed in place of the pointer to it. Otherwise allocate
+        // one.
+        llvm::Type *voidPointerType = (llvm::Type *)(i8->getPointerTo());
+        bool by_value = closure.passed_by_value(context);
+        StructType *closure_t = NULL;
+        Value *ptr = NULL;
+        if (!by_value) {
+            closure_t = closure.build_type(context);
+            ptr = create_alloca_at_entry(closure_t, 1);
+        }
 
-        // Fill in the closure
-        closure.pack_struct(ptr, symbol_table, builder);
+        // Fill in the closure. If the enclosing serial loops don't
+        // change what it holds, do it once before the outermost such
+        // loop instead of on every iteration.
+        size_t level = enclosing_loops.size();
+        vector<string> closure_names = closure.names();
+        while (level > 0 &&
+               closure_unchanged(closure_names, symbol_table, enclosing_loops[level-1].symbols)) {
+            level--;
+        }
+        IRBuilderBase::InsertPoint pack_site = builder->saveIP();
+        if (level < enclosing_loops.size()) {
+            debug(3) << "Packing closure for " << op->name << " outside " << level << " enclosing loops\n";
+            builder->SetInsertPoint(enclosing_loops[level].preheader->getTerminator());
+        }
+        if (by_value) {
+            ptr = closure.pack_value(symbol_table, builder);
+        } else {
+            closure.pack_struct(ptr, symbol_table, builder);
+            ptr = builder->CreatePointerCast(ptr, voidPointerType);
+        }
+        builder->restoreIP(pack_site);
 
         // Make a new function that does one iteration of the body of the loop
-        llvm::Type *voidPointerType = (llvm::Type *)(i8->getPointerTo());
         FunctionType *func_t = FunctionType::get(i32, vec(voidPointerType, i32, voidPointerType), false);
         llvm::Function *containing_function = function;
         function = llvm::Function::Create(func_t, llvm::Function::InternalLinkage,
@@ -2002,6 +2830,10 @@ void CodeGen::visit(const For *op) {
         // Make a new scope to use
         Scope<Value *> saved_symbol_table;
         std::swap(symbol_table, saved_symbol_table);
+        vector<EnclosingLoop> saved_enclosing_loops;
+        std::swap(enclosing_loops, saved_enclosing_loops);
+        vector<Expr> saved_early_exit_cleanups;
+        std::swap(early_exit_cleanups, saved_early_exit_cleanups);
 
         // Get the function arguments
 
@@ -2019,9 +2851,13 @@ void CodeGen::visit(const For *op) {
         // The closure pointer is the third and last argument.
         ++iter;
         iter->setName("closure");
-        Value *closure_handle = builder->CreatePointerCast(iter, closure_t->getPointerTo());
-        // Load everything from the closure into the new scope
-        closure.unpack_struct(symbol_table, closure_handle, builder);
+        if (by_value) {
+            closure.unpack_value(symbol_table, iter, builder);
+        } else {
+            Value *closure_handle = builder->CreatePointerCast(iter, closure_t->getPointerTo());
+            // Load everything from the closure into the new scope
+            closure.unpack_struct(symbol_table, closure_handle, builder);
+        }
 
         // Generate the new function body
         codegen(op->body);
@@ -2035,7 +2871,6 @@ void CodeGen::visit(const For *op) {
         assert(do_par_for && "Could not find halide_do_par_for in initial module");
         do_par_for->setDoesNotAlias(5);
         //do_par_for->setDoesNotCapture(5);
-        ptr = builder->CreatePointerCast(ptr, i8->getPointerTo());
         vector<Value *> args = vec<Value *>(user_context, function, min, extent, ptr);
         debug(4) << "Creating call to do_par_for\n";
         Value *result = builder->CreateCall(do_par_for, args);
@@ -2044,8 +2879,16 @@ void CodeGen::visit(const For *op) {
 
         // Now restore the scope
         std::swap(symbol_table, saved_symbol_table);
+        std::swap(enclosing_loops, saved_enclosing_loops);
+        std::swap(early_exit_cleanups, saved_early_exit_cleanups);
         function = containing_function;
 
+        // Pass on a cancellation without reporting it as an error.
+        if (target.features & Halide::Target::Cancellable) {
+            return_quietly_if(builder->CreateICmpEQ(result, ConstantInt::get(i32, cancelled_status)),
+                              cancelled_status);
+        }
+
         // Check for success
         Value *did_succeed = builder->CreateICmpEQ(result, ConstantInt::get(i32, 0));
         create_assertion(did_succeed, "Failure inside parallel for loop");
@@ -2053,9 +2896,30 @@ void CodeGen::visit(const For *op) {
     } else {
         assert(false && "Unknown type of For node. Only Serial and Parallel For nodes should survive down to codegen");
     }
+
+    asserted_conditions.resize(asserted_before);
 }
 
 void CodeGen::visit(const Store *op) {
+    if (op->predicate.defined()) {
+        codegen_predicated_store(op);
+        return;
+    }
+
+    Expr inner, offset;
+    if (split_large_index(op->name, op->index, &inner, &offset)) {
+        // Codegen the value before moving the host pointer, in case
+        // it loads from the same buffer.
+        string value_name = unique_name('v');
+        sym_push(value_name, codegen(op->value));
+        Expr stored = Variable::make(op->value.type(), value_name);
+        begin_large_buffer_access(op->name, op->value.type(), offset);
+        codegen(Store::make(op->name, stored, inner));
+        end_large_buffer_access(op->name);
+        sym_pop(value_name);
+        return;
+    }
+
     Value *val = codegen(op->value);
     Halide::Type value_type = op->value.type();
     bool possibly_misaligned = (might_be_misaligned.find(op->name) != might_be_misaligned.end());
@@ -2082,10 +2946,21 @@ void CodeGen::visit(const Store *op) {
             Value *ptr = codegen_buffer_pointer(op->name, value_type.element_of(), ramp->base);
             Value *ptr2 = builder->CreatePointerCast(ptr, llvm_type_of(value_type)->getPointerTo());
             if (possibly_misaligned) {
-                alignment = op->value.type().element_of().bytes();
+                int elem_bytes = op->value.type().element_of().bytes();
+                if (host_alignment.count(op->name)) {
+                    // Only as aligned as the host pointer is.
+                    alignment = std::max(std::min(alignment, host_alignment[op->name]), elem_bytes);
+                } else {
+                    alignment = elem_bytes;
+                }
             }
             StoreInst *store = builder->CreateAlignedStore(val, ptr2, alignment);
             add_tbaa_metadata(store, op->name);
+            if (nontemporal) {
+                // llvm only streams stores aligned to their size, and
+                // makes the rest ordinary stores.
+                store->setMetadata("nontemporal", MDNode::get(*context, vec<Value *>(ConstantInt::get(i32, 1))));
+            }
         } else if (ramp) {
             Value *ptr = codegen_buffer_pointer(op->name, value_type.element_of(), ramp->base);
             const IntImm *const_stride = ramp->stride.as<IntImm>();
@@ -2122,6 +2997,46 @@ void CodeGen::visit(const Store *op) {
 
 }
 
+void CodeGen::codegen_predicated_store(const Store *op) {
+    Halide::Type value_type = op->value.type();
+    Halide::Type elem = value_type.element_of();
+    Value *val = codegen(op->value);
+    Value *pred = codegen(op->predicate);
+
+    #if LLVM_VERSION >= 37
+    const Ramp *ramp = op->index.as<Ramp>();
+    if (ramp && is_one(ramp->stride)) {
+        Value *ptr = codegen_buffer_pointer(op->name, elem, ramp->base);
+        ptr = builder->CreatePointerCast(ptr, llvm_type_of(value_type)->getPointerTo());
+        builder->CreateMaskedStore(val, ptr, elem.bytes(), pred);
+        return;
+    }
+    #endif
+
+    // Store each lane for which the predicate is true
+    Value *index = codegen(op->index);
+    for (int i = 0; i < value_type.width; i++) {
+        Value *lane = ConstantInt::get(i32, i);
+        Value *lane_pred = pred, *lane_idx = index, *lane_val = val;
+        if (value_type.is_vector()) {
+            lane_pred = builder->CreateExtractElement(pred, lane);
+            lane_idx = builder->CreateExtractElement(index, lane);
+            lane_val = builder->CreateExtractElement(val, lane);
+        }
+
+        BasicBlock *store_bb = BasicBlock::Create(*context, "predicated_store", function);
+        BasicBlock *after_bb = BasicBlock::Create(*context, "after_predicated_store", function);
+        builder->CreateCondBr(lane_pred, store_bb, after_bb);
+
+        builder->SetInsertPoint(store_bb);
+        Value *ptr = codegen_buffer_pointer(op->name, elem, lane_idx);
+        StoreInst *store = builder->CreateAlignedStore(lane_val, ptr, elem.bytes());
+        add_tbaa_metadata(store, op->name);
+        builder->CreateBr(after_bb);
+
+        builder->SetInsertPoint(after_bb);
+    }
+}
 
 void CodeGen::visit(const Block *op) {
     codegen(op->first);
@@ -2137,20 +3052,37 @@ void CodeGen::visit(const Provide *op) {
 }
 
 void CodeGen::visit(const IfThenElse *op) {
+    size_t asserted_before = asserted_conditions.size();
     BasicBlock *true_bb = BasicBlock::Create(*context, "true_bb", function);
     BasicBlock *false_bb = BasicBlock::Create(*context, "false_bb", function);
     BasicBlock *after_bb = BasicBlock::Create(*context, "after_bb", function);
-    builder->CreateCondBr(codegen(op->condition), true_bb, false_bb);
+
+    // Conditions that come with an estimate of how often they're true
+    // (see ProfileGuided.h) weight the branch.
+    const Call *weights = op->condition.as<Call>();
+    if (weights && weights->name == Call::branch_weights &&
+        weights->call_type == Call::Intrinsic) {
+        const int *taken = as_const_int(weights->args[1]);
+        const int *not_taken = as_const_int(weights->args[2]);
+        assert(taken && not_taken && "The weights of a branch must be constants");
+        MDBuilder md_builder(*context);
+        builder->CreateCondBr(codegen(weights->args[0]), true_bb, false_bb,
+                              md_builder.createBranchWeights(*taken, *not_taken));
+    } else {
+        builder->CreateCondBr(codegen(op->condition), true_bb, false_bb);
+    }
 
     builder->SetInsertPoint(true_bb);
     codegen(op->then_case);
     builder->CreateBr(after_bb);
+    asserted_conditions.resize(asserted_before);
 
     builder->SetInsertPoint(false_bb);
     if (op->else_case.defined()) {
         codegen(op->else_case);
     }
     builder->CreateBr(after_bb);
+    asserted_conditions.resize(asserted_before);
 
     builder->SetInsertPoint(after_bb);
 }
@@ -71,8 +71,10 @@ public:
     virtual void compile_to_native(const std::string &filename, bool assembly = false);
 
     /** Compile to machine code stored in memory, and return some
-     * functions pointers into that machine code. */
-    JITCompiledModule compile_to_function_pointers();
+     * functions pointers into that machine code. If a jit cache key
+     * is given and a jit cache directory is set, the machine code is
+     * loaded from or saved to that directory. */
+    JITCompiledModule compile_to_function_pointers(const std::string &cache_key = "");
 
     /** What should be passed as -mcpu, -mattrs, and related for
      * compilation. The architecture-specific code generator should
@@ -83,6 +85,11 @@ public:
     virtual bool use_soft_float_abi() const = 0;
     // @}
 
+    /** Whether the target has instructions to convert between half
+     * and single precision floats. If not, the conversions are done
+     * with integer arithmetic. */
+    virtual bool use_native_float16_conversions() const {return false;}
+
     /** Do any required target-specific things to the execution engine
      * and the module prior to jitting. Called by JITCompiledModule
      * just before it jits. Does nothing by default. */
@@ -129,9 +136,16 @@ protected:
      * multiple related modules (e.g. multiple device kernels). */
     void init_module();
 
-    /** Run all of llvm's optimization passes on the module. */
+    /** Run all of llvm's optimization passes on the module. With
+     * Target::OptimizeSize, optimize for size instead of speed. */
     void optimize_module();
 
+    /** Print the number of llvm instructions in each function of the
+     * module to stderr. Done after optimization with
+     * Target::OptimizeSize, or when HL_CODE_SIZE_REPORT is set to a
+     * nonzero value. */
+    void report_code_size();
+
     /** Add an entry to the symbol table, hiding previous entries with
      * the same name. Call this when new values come into scope. */
     void sym_push(const std::string &name, llvm::Value *value);
@@ -178,6 +192,30 @@ protected:
     void create_assertion(llvm::Value *condition, const std::string &message,
                           const std::vector<llvm::Value *> &args = std::vector<llvm::Value *>());
 
+    /** Get a cold function that reports the failure of an assertion
+     * with the given message, called with the user context and then
+     * the given args. Functions are shared between assertions with
+     * the same message and argument types. */
+    llvm::Function *assertion_failure_function(const std::string &message,
+                                               const std::vector<llvm::Value *> &args);
+
+    /** The status a cancelled pipeline returns
+     * (halide_error_code_cancelled in HalideRuntime.h). */
+    static const int cancelled_status = -2;
+
+    /** The status a pipeline over its memory budget returns
+     * (halide_error_code_over_memory_budget in HalideRuntime.h). */
+    static const int over_memory_budget_status = -3;
+
+    /** If the condition is true, free everything and return the
+     * status without reporting an error. */
+    void return_quietly_if(llvm::Value *cond, int status);
+
+    /** Make the calls registered with the cleanup_on_exit intrinsic
+     * in the current function, most recent first. Done before every
+     * early return. */
+    void run_cleanups();
+
     /** Put a string constant in the module as a global variable and return a pointer to it. */
     llvm::Constant *create_string_constant(const std::string &str);
 
@@ -217,11 +255,55 @@ protected:
     llvm::Value *codegen_buffer_pointer(std::string buffer, Type type, Expr index);
     // @}
 
+    /** Under the large_buffers target feature, the index of an input
+     * or output is a 32-bit index cast to 64 bits, plus a 64-bit
+     * offset (see storage_flattening). If a vector index of a buffer
+     * has that form, get the two parts. Codegen the access with the
+     * 32-bit part, which is a ramp if the access is dense, between
+     * begin_large_buffer_access, which points the host pointer of the
+     * buffer at the offset, and end_large_buffer_access. */
+    // @{
+    bool split_large_index(const std::string &buffer, Expr index, Expr *inner, Expr *offset);
+    void begin_large_buffer_access(const std::string &buffer, Type type, Expr offset);
+    void end_large_buffer_access(const std::string &buffer);
+    // @}
+
+    /** Atomically add a scalar value of the given type to the value
+     * at a pointer. Returns the value that was there before. Floating
+     * point adds are done with a compare-and-swap loop. */
+    virtual llvm::Value *codegen_atomic_add(llvm::Value *ptr, llvm::Value *val, Type type);
+
+    /** Express one of the vector_reduce intrinsics in terms of vector
+     * shuffles and elementwise operations. Lane i of the result of
+     * type t combines lanes i*f to (i+1)*f - 1 of the arg, where f is
+     * the ratio of their widths. */
+    Expr lower_vector_reduce(const std::string &reduce, Type t, Expr arg);
+
+    /** Finish off a vector_reduce intrinsic, given a partial result
+     * that has already combined some groups of adjacent lanes of its
+     * argument. Used by the targets that have instructions for the
+     * first step of a reduction. */
+    llvm::Value *codegen_vector_reduce(const Call *op, llvm::Value *partial, Type partial_type);
+
+    /** Concatenate vectors of the same element type into one wider
+     * vector. */
+    llvm::Value *concat_vectors(const std::vector<llvm::Value *> &vecs);
+
     /** Mark a load or store with type-based-alias-analysis metadata
      * so that llvm knows it can reorder loads and stores across
      * different buffers */
     void add_tbaa_metadata(llvm::Instruction *inst, std::string buffer);
 
+    /** Generate code for loads and stores with a predicate. The
+     * default versions use llvm's masked memory intrinsics for dense
+     * vectors where available, and otherwise branch around each
+     * lane. Targets with masked moves of their own may override
+     * them. */
+    // @{
+    virtual void codegen_predicated_load(const Load *op);
+    virtual void codegen_predicated_store(const Store *op);
+    // @}
+
     using IRVisitor::visit;
 
     /** Generate code for various IR nodes. These can be overridden by
@@ -308,6 +390,20 @@ protected:
      * guarantee their alignment) */
     std::set<std::string> might_be_misaligned;
 
+    /** The alignment in bytes of the host pointers of buffers from
+     * the outside world that are asserted to be aligned */
+    std::map<std::string, int> host_alignment;
+
+    /** The host alignments and misalignments that are changed during
+     * an access to a large buffer. */
+    std::map<std::string, int> saved_host_alignment;
+    std::set<std::string> added_misaligned;
+
+    /** Whether the dense vector store being generated is
+     * non-temporal. Set while generating the Store that a
+     * nontemporal_store intrinsic stands for. */
+    bool nontemporal;
+
     llvm::Value *get_user_context() const;
 
 
@@ -321,9 +417,34 @@ private:
     /** Alignment info for Int(32) variables in scope. */
     Scope<ModulusRemainder> alignment_info;
 
+    /** A serial loop enclosing the current code location: the block
+     * that jumps into it, and the symbols in scope there. */
+    struct EnclosingLoop {
+        llvm::BasicBlock *preheader;
+        Scope<llvm::Value *> symbols;
+    };
+
+    /** The serial loops enclosing the current code location in the
+     * current llvm function, outermost first. Parallel loops pack
+     * their closures in the preheader of the outermost of these that
+     * leaves the closure's contents unchanged. */
+    std::vector<EnclosingLoop> enclosing_loops;
+
     /** String constants already emitted to the module. Tracked to
      * prevent emitting the same string many times. */
     std::map<std::string, llvm::Constant *> string_constants;
+
+    /** The cold functions made by assertion_failure_function, by
+     * message. */
+    std::map<std::string, llvm::Function *> assertion_failures;
+
+    /** The conditions of the assertions made so far that are known to
+     * hold at the current point, so that repeats can be skipped. */
+    std::vector<Expr> asserted_conditions;
+
+    /** The calls the current llvm function makes if it returns
+     * early. */
+    std::vector<Expr> early_exit_cleanups;
 };
 
 }}
@@ -120,6 +120,55 @@ Expr _u32q(Expr e) {
         return cast(UInt(32, e.type().width), clamp(e, 0, UInt(32).max()));
     }
 }
+
+// Map the name of a 32-bit neon intrinsic (without the
+// llvm.arm.neon. prefix) to the equivalent AArch64 one. Returns the
+// empty string for intrinsics with no AArch64 counterpart of the same
+// signature, which we leave to llvm to select.
+string aarch64_intrinsic_name(const string &name) {
+    size_t dot = name.find('.');
+    string base = name.substr(0, dot);
+    string suffix = (dot == string::npos) ? "" : name.substr(dot);
+    bool is_float = suffix.find('f') != string::npos;
+
+    static const char *renames[][2] = {
+        {"vhadds", "shadd"}, {"vhaddu", "uhadd"},
+        {"vhsubs", "shsub"}, {"vhsubu", "uhsub"},
+        {"vrhadds", "srhadd"}, {"vrhaddu", "urhadd"},
+        {"vqadds", "sqadd"}, {"vqaddu", "uqadd"},
+        {"vqsubs", "sqsub"}, {"vqsubu", "uqsub"},
+        {"vqmovns", "sqxtn"}, {"vqmovnu", "uqxtn"}, {"vqmovnsu", "sqxtun"},
+        {"vqneg", "sqneg"},
+        {"vshifts", "sshl"}, {"vshiftu", "ushl"},
+        {"vqshifts", "sqshl"}, {"vqshiftu", "uqshl"},
+        {"vmaxu", "umax"}, {"vminu", "umin"},
+        {"vabds", "sabd"}, {"vabdu", "uabd"},
+        {"vpaddls", "saddlp"}, {"vpaddlu", "uaddlp"},
+        {"vrecpe", "frecpe"}, {"vrsqrte", "frsqrte"},
+        {"vaddhn", "addhn"}, {"vsubhn", "subhn"},
+        {"vmulls", "smull"}, {"vmullu", "umull"},
+        {"vqrdmulh", "sqrdmulh"}, {"vqdmull", "sqdmull"},
+        // The AArch64 versions are overloaded on the argument type too.
+        {"vacgtq", "facgt.v4i32.v4f32"}, {"vacgtd", "facgt.v2i32.v2f32"},
+        {"vacgeq", "facge.v4i32.v4f32"}, {"vacged", "facge.v2i32.v2f32"}
+    };
+
+    for (size_t i = 0; i < sizeof(renames)/sizeof(renames[0]); i++) {
+        if (base == renames[i][0]) {
+            return renames[i][1] + suffix;
+        }
+    }
+
+    if (base == "vmaxs") {
+        return (is_float ? "fmax" : "smax") + suffix;
+    } else if (base == "vmins") {
+        return (is_float ? "fmin" : "smin") + suffix;
+    } else if (base == "vacgt" || base == "vacge") {
+        return "f" + base.substr(1) + suffix + (suffix == ".v4i32" ? ".v4f32" : ".v2f32");
+    }
+
+    return "";
+}
 }
 
 CodeGen_ARM::CodeGen_ARM(Target t) : CodeGen_Posix(t) {
@@ -272,6 +321,12 @@ CodeGen_ARM::CodeGen_ARM(Target t) : CodeGen_Posix(t) {
     casts.push_back(Pattern("vqmovnsu.v4i16", _u16q(wild_i32x4)));
     casts.push_back(Pattern("vqmovnsu.v2i32", _u32q(wild_i64x2)));
 
+    // Fixed-point multiply-high with rounding, and saturating doubling
+    // widening multiplies.
+    casts.push_back(Pattern("vqrdmulh.v4i16", _i16q((wild_i32x4 * wild_i32x4 + 16384) / 32768), Pattern::NarrowArgs));
+    casts.push_back(Pattern("vqrdmulh.v8i16", _i16q((wild_i32x8 * wild_i32x8 + 16384) / 32768), Pattern::NarrowArgs));
+    casts.push_back(Pattern("vqdmull.v4i32", _i32q(_i64(wild_i16x4) * _i64(wild_i16x4) * 2)));
+
     // Non-widening left shifts
     left_shifts.push_back(Pattern("vshifts.v16i8", wild_i8x16*wild_i8x16, Pattern::LeftShift));
     left_shifts.push_back(Pattern("vshifts.v8i16", wild_i16x8*wild_i16x8, Pattern::LeftShift));
@@ -320,15 +375,26 @@ CodeGen_ARM::CodeGen_ARM(Target t) : CodeGen_Posix(t) {
     negations.push_back(Pattern("vqneg.v2i32", -max(wild_i32x2, -(0x7fffffff))));
     negations.push_back(Pattern("vqneg.v4i32", -max(wild_i32x4, -(0x7fffffff))));
 
+    if (t.bits == 64) {
+        // Drop the patterns whose intrinsics don't exist on AArch64
+        // (e.g. the narrowing shifts, which take an immediate there).
+        vector<Pattern> *pattern_lists[] = {&casts, &left_shifts, &averagings, &negations};
+        for (size_t i = 0; i < 4; i++) {
+            vector<Pattern> kept;
+            for (size_t j = 0; j < pattern_lists[i]->size(); j++) {
+                const Pattern &p = (*pattern_lists[i])[j];
+                if (!aarch64_intrinsic_name(p.intrin).empty()) {
+                    kept.push_back(p);
+                }
+            }
+            pattern_lists[i]->swap(kept);
+        }
+    }
 }
 
 llvm::Triple CodeGen_ARM::get_target_triple() const {
     llvm::Triple triple;
 
-    if (target.bits == 64) {
-
-    }
-
     if (target.bits == 32) {
         triple.setArch(llvm::Triple::arm);
     } else {
@@ -338,13 +404,15 @@ llvm::Triple CodeGen_ARM::get_target_triple() const {
         #else
         assert(false && "AArch64 llvm target not enabled in this build of Halide");
         #endif
-        std::cerr << "Warning: 64-bit arm builds are completely untested\n";
     }
 
     if (target.os == Target::Android) {
-        assert(target.bits == 32 && "Not sure what llvm target triple to use for 64-bit arm android");
         triple.setOS(llvm::Triple::Linux);
-        triple.setEnvironment(llvm::Triple::EABI);
+        if (target.bits == 32) {
+            triple.setEnvironment(llvm::Triple::EABI);
+        } else {
+            triple.setEnvironment(llvm::Triple::Android);
+        }
     } else if (target.os == Target::IOS) {
         triple.setOS(llvm::Triple::IOS);
         triple.setVendor(llvm::Triple::Apple);
@@ -368,7 +436,11 @@ llvm::Triple CodeGen_ARM::get_target_triple() const {
         #endif
     } else if (target.os == Target::Linux) {
         triple.setOS(llvm::Triple::Linux);
-        triple.setEnvironment(llvm::Triple::GNUEABIHF);
+        if (target.bits == 32) {
+            triple.setEnvironment(llvm::Triple::GNUEABIHF);
+        } else {
+            triple.setEnvironment(llvm::Triple::GNU);
+        }
     } else {
         assert(false && "No arm support for this OS");
     }
@@ -382,7 +454,7 @@ void CodeGen_ARM::compile(Stmt stmt, string name,
 
     init_module();
 
-    module = get_initial_module_for_target(target, context);
+    module = get_initial_module_for_target(target, context, !stmt.defined());
 
     // Fix the target triple.
     debug(1) << "Target triple of initial module: " << module->getTargetTriple() << "\n";
@@ -417,13 +489,20 @@ Value *CodeGen_ARM::call_intrin(llvm::Type *result_type,
         arg_types[i] = arg_values[i]->getType();
     }
 
-    llvm::Function *fn = module->getFunction("llvm.arm.neon." + name);
+    string intrin_name = "llvm.arm.neon." + name;
+    if (target.bits == 64) {
+        string aarch64_name = aarch64_intrinsic_name(name);
+        assert(!aarch64_name.empty() && "No AArch64 equivalent for neon intrinsic");
+        intrin_name = "llvm.aarch64.neon." + aarch64_name;
+    }
+
+    llvm::Function *fn = module->getFunction(intrin_name);
 
     if (!fn) {
         FunctionType *func_t = FunctionType::get(result_type, arg_types, false);
         fn = llvm::Function::Create(func_t,
                                     llvm::Function::ExternalLinkage,
-                                    "llvm.arm.neon." + name, module);
+                                    intrin_name, module);
         fn->setCallingConv(CallingConv::C);
 
         if (starts_with(name, "vld")) {
@@ -458,6 +537,10 @@ Instruction *CodeGen_ARM::call_void_intrin(const string &name, vector<Value *> a
         arg_types[i] = arg_values[i]->getType();
     }
 
+    // The vstN intrinsics have a different signature on AArch64, so
+    // we only use them on 32-bit arm.
+    assert(target.bits == 32 && "void neon intrinsics are only used on 32-bit arm");
+
     llvm::Function *fn = module->getFunction("llvm.arm.neon." + name);
 
     if (!fn) {
@@ -602,6 +685,26 @@ void CodeGen_ARM::visit(const Mul *op) {
         return;
     }
 
+    // Widening multiplies of 64-bit vectors should use vmull, even by
+    // small constants, so that llvm can fold any accumulation into
+    // vmlal. Powers of two are better as widening shifts.
+    int bits = op->type.bits, log2_b = 0;
+    if (bits >= 16 && bits * op->type.width == 128 &&
+        !is_const_power_of_two(op->b, &log2_b)) {
+        Type narrow = op->type;
+        narrow.bits = bits / 2;
+        Expr na = try_narrow(op->a, narrow);
+        Expr nb = try_narrow(op->b, narrow);
+        if (na.defined() && nb.defined()) {
+            string intrin = string(op->type.is_int() ? "vmulls" : "vmullu") +
+                ".v" + int_to_string(op->type.width) + "i" + int_to_string(bits);
+            if (target.bits == 32 || !aarch64_intrinsic_name(intrin).empty()) {
+                value = call_intrin(op->type, intrin, vec(na, nb));
+                return;
+            }
+        }
+    }
+
     // Vector multiplies by 3, 5, 7, 9 should do shift-and-add or
     // shift-and-sub instead to reduce register pressure (the
     // shift is an immediate)
@@ -721,13 +824,13 @@ void CodeGen_ARM::visit(const Div *op) {
         Value *mult_wide = builder->CreateIntCast(mult, wider, false);
         Value *wide_val = builder->CreateMul(flipped_wide, mult_wide);
         // Do the shift (add 8 or 16 to narrow back down)
-        if (op->type == Int(32, 2) && shift == 0) {
+        if (target.bits == 32 && op->type == Int(32, 2) && shift == 0) {
             Constant *shift_amount = ConstantInt::get(wider, -32);
             val = call_intrin(narrower, "vshiftn.v2i32", vec<Value *>(wide_val, shift_amount));
-        } else if (op->type == Int(16, 4) && shift == 0) {
+        } else if (target.bits == 32 && op->type == Int(16, 4) && shift == 0) {
             Constant *shift_amount = ConstantInt::get(wider, -16);
             val = call_intrin(narrower, "vshiftn.v4i16", vec<Value *>(wide_val, shift_amount));
-        } else if (op->type == Int(8, 8) && shift == 0) {
+        } else if (target.bits == 32 && op->type == Int(8, 8) && shift == 0) {
             Constant *shift_amount = ConstantInt::get(wider, -8);
             val = call_intrin(narrower, "vshiftn.v8i8", vec<Value *>(wide_val, shift_amount));
         } else {
@@ -773,13 +876,13 @@ void CodeGen_ARM::visit(const Div *op) {
         val = builder->CreateMul(val, mult);
 
         // Narrow
-        if (op->type == UInt(32, 2) && shift == 0) {
+        if (target.bits == 32 && op->type == UInt(32, 2) && shift == 0) {
             Constant *shift_amount = ConstantInt::get(wider, -32);
             val = call_intrin(narrower, "vshiftn.v2i32", vec<Value *>(val, shift_amount));
-        } else if (op->type == UInt(16, 4) && shift == 0) {
+        } else if (target.bits == 32 && op->type == UInt(16, 4) && shift == 0) {
             Constant *shift_amount = ConstantInt::get(wider, -16);
             val = call_intrin(narrower, "vshiftn.v4i16", vec<Value *>(val, shift_amount));
-        } else if (op->type == UInt(8, 8) && shift == 0) {
+        } else if (target.bits == 32 && op->type == UInt(8, 8) && shift == 0) {
             Constant *shift_amount = ConstantInt::get(wider, -8);
             val = call_intrin(narrower, "vshiftn.v8i8", vec<Value *>(val, shift_amount));
         } else {
@@ -1028,7 +1131,7 @@ void CodeGen_ARM::visit(const LE *op) {
             #if LLVM_VERSION < 35
             string name = "vacged";
             #else
-            string name = "vacge.v4i32";
+            string name = "vacge.v2i32";
             #endif
             value = call_intrin(Int(32, 2), name, vec(vb, va));
             value = builder->CreateICmpNE(value, zero);
@@ -1089,11 +1192,12 @@ void CodeGen_ARM::visit(const Select *op) {
 
 void CodeGen_ARM::visit(const Store *op) {
 
-    // A dense store of an interleaving can be done using a vst2 intrinsic
+    // A dense store of an interleaving can be done using a vst2,
+    // vst3, or vst4 intrinsic
     const Ramp *ramp = op->index.as<Ramp>();
 
-    // We only deal with ramps here
-    if (!ramp) {
+    // We only deal with unpredicated ramps here
+    if (!ramp || op->predicate.defined()) {
         CodeGen::visit(op);
         return;
     }
@@ -1110,8 +1214,13 @@ void CodeGen_ARM::visit(const Store *op) {
     if (is_one(ramp->stride) &&
         call && call->call_type == Call::Intrinsic &&
         call->name == Call::interleave_vectors) {
-        assert(call->args.size() == 2 && "Wrong number of args to interleave vectors");
-        vector<Value *> args(call->args.size() + 2);
+        int n = (int)call->args.size();
+        assert(n >= 2 && "Wrong number of args to interleave vectors");
+        if (n > 4 || target.bits == 64) {
+            CodeGen::visit(op);
+            return;
+        }
+        vector<Value *> args(n + 2);
 
         Type t = call->args[0].type();
         int alignment = t.bytes();
@@ -1125,27 +1234,32 @@ void CodeGen_ARM::visit(const Store *op) {
         }
 
         args[0] = ptr; // The pointer
-        args[1] = codegen(call->args[0]);
-        args[2] = codegen(call->args[1]);
-        args[3] = ConstantInt::get(i32, alignment);
+        for (int i = 0; i < n; i++) {
+            args[i+1] = codegen(call->args[i]);
+        }
+        args[n+1] = ConstantInt::get(i32, alignment);
+
+        ostringstream prefix;
+        prefix << "vst" << n << ".";
+        string pre = prefix.str();
 
         Instruction *store = NULL;
         if (t == Int(8, 8) || t == UInt(8, 8)) {
-            store = call_void_intrin("vst2.v8i8", args);
+            store = call_void_intrin(pre+"v8i8", args);
         } else if (t == Int(8, 16) || t == UInt(8, 16)) {
-            store = call_void_intrin("vst2.v16i8", args);
+            store = call_void_intrin(pre+"v16i8", args);
         } else if (t == Int(16, 4) || t == UInt(16, 4)) {
-            store = call_void_intrin("vst2.v4i16", args);
+            store = call_void_intrin(pre+"v4i16", args);
         } else if (t == Int(16, 8) || t == UInt(16, 8)) {
-            store = call_void_intrin("vst2.v8i16", args);
+            store = call_void_intrin(pre+"v8i16", args);
         } else if (t == Int(32, 2) || t == UInt(32, 2)) {
-            store = call_void_intrin("vst2.v2i32", args);
+            store = call_void_intrin(pre+"v2i32", args);
         } else if (t == Int(32, 4) || t == UInt(32, 4)) {
-            store = call_void_intrin("vst2.v4i32", args);
+            store = call_void_intrin(pre+"v4i32", args);
         } else if (t == Float(32, 2)) {
-            store = call_void_intrin("vst2.v2f32", args);
+            store = call_void_intrin(pre+"v2f32", args);
         } else if (t == Float(32, 4)) {
-            store = call_void_intrin("vst2.v4f32", args);
+            store = call_void_intrin(pre+"v4f32", args);
         } else {
             CodeGen::visit(op);
         }
@@ -1195,8 +1309,8 @@ void CodeGen_ARM::visit(const Store *op) {
 void CodeGen_ARM::visit(const Load *op) {
     const Ramp *ramp = op->index.as<Ramp>();
 
-    // We only deal with ramps here
-    if (!ramp) {
+    // We only deal with unpredicated ramps here
+    if (!ramp || op->predicate.defined()) {
         CodeGen::visit(op);
         return;
     }
@@ -1209,8 +1323,9 @@ void CodeGen_ARM::visit(const Load *op) {
         return;
     }
 
-    // Strided loads with known stride
-    if (stride && stride->value >= 2 && stride->value <= 4) {
+    // Strided loads with known stride. The AArch64 vldN intrinsics
+    // have a different signature, so leave those to llvm.
+    if (target.bits == 32 && stride && stride->value >= 2 && stride->value <= 4) {
         // Check alignment on the base.
         Expr base = ramp->base;
         int offset = 0;
@@ -1309,11 +1424,37 @@ void CodeGen_ARM::visit(const Call *op) {
         e.accept(this);
         return;
     }
+
+    if (op->call_type == Call::Intrinsic &&
+        op->name == Call::vector_reduce_add) {
+        // Widening sums of adjacent pairs of lanes are vpaddl.
+        assert(op->args.size() == 1 && "vector_reduce_add takes one argument");
+        Expr arg = op->args[0];
+        const Cast *widened = arg.as<Cast>();
+        int width = arg.type().width;
+        int factor = width / op->type.width;
+        if (widened && factor % 2 == 0 && arg.type().is_int() == widened->value.type().is_int() &&
+            arg.type().bits == widened->value.type().bits * 2 &&
+            (widened->value.type().bits * width == 64 || widened->value.type().bits * width == 128)) {
+            Type narrow = widened->value.type();
+            Type partial_type = arg.type().element_of().vector_of(width/2);
+            std::ostringstream intrin;
+            intrin << "vpaddl" << (narrow.is_int() ? "s" : "u")
+                   << ".v" << width/2 << "i" << narrow.bits * 2
+                   << ".v" << width << "i" << narrow.bits;
+            Value *partial = call_intrin(partial_type, intrin.str(), vec(widened->value));
+            value = codegen_vector_reduce(op, partial, partial_type);
+            return;
+        }
+    }
+
     CodeGen::visit(op);
 }
 
 string CodeGen_ARM::mcpu() const {
-    if (target.bits == 32) {
+    if (!target.cpu.empty()) {
+        return target.cpu;
+    } else if (target.bits == 32) {
         return "cortex-a9";
     } else {
         return "generic";
@@ -1321,11 +1462,35 @@ string CodeGen_ARM::mcpu() const {
 }
 
 string CodeGen_ARM::mattrs() const {
-    return "+neon";
+    // Fused multiply-add and half-float conversions are part of the
+    // base AArch64 instruction set.
+    if (target.bits == 64) {
+        return "+neon";
+    }
+    string attrs = "+neon";
+    if (target.features & Target::FMA) {
+        // vfma is part of vfpv4.
+        attrs += ",+vfp4";
+    } else if (!target.cpu.empty()) {
+        // A named cpu like cortex-a15 would otherwise imply vfpv4.
+        attrs += ",-vfp4";
+    }
+    if (target.features & Target::F16C) {
+        attrs += ",+fp16";
+    } else if (!target.cpu.empty()) {
+        attrs += ",-fp16";
+    }
+    return attrs;
+}
+
+bool CodeGen_ARM::use_native_float16_conversions() const {
+    return target.bits == 64 || (target.features & Target::F16C);
 }
 
 bool CodeGen_ARM::use_soft_float_abi() const {
-    return (target.os == Target::Android) || (target.os == Target::IOS);
+    // AArch64 only has the hard float abi.
+    return target.bits == 32 &&
+        ((target.os == Target::Android) || (target.os == Target::IOS));
 }
 
 }}
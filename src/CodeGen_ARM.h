@@ -75,6 +75,7 @@ protected:
     std::string mcpu() const;
     std::string mattrs() const;
     bool use_soft_float_abi() const;
+    bool use_native_float16_conversions() const;
 };
 
 }}
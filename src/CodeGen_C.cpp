@@ -10,6 +10,7 @@
 #include "Param.h"
 #include "Var.h"
 #include "Lerp.h"
+#include "Deinterleave.h"
 
 namespace Halide {
 namespace Internal {
@@ -53,6 +54,30 @@ const string preamble =
     "extern \"C\" int64_t halide_current_time_ns(void *ctx);\n"
     "extern \"C\" uint64_t halide_profiling_timer(void *ctx);\n"
     "extern \"C\" int halide_printf(void *ctx, const char *fmt, ...);\n"
+    "extern \"C\" void *halide_profiler_pipeline_start(void *ctx, const char *name, int num_funcs, const char *func_names);\n"
+    "extern \"C\" int halide_profiler_pipeline_end(void *ctx, void *state);\n"
+    "extern \"C\" int halide_profiler_acquire_slot(void *state, int func);\n"
+    "extern \"C\" int halide_profiler_release_slot(void *state, int slot);\n"
+    "extern \"C\" int halide_profiler_enter_func(void *state, int slot, int func);\n"
+    "extern \"C\" int halide_profiler_set_func(void *state, int slot, int func);\n"
+    "extern \"C\" int halide_get_num_threads(void *ctx);\n"
+    "extern \"C\" int halide_is_cancelled(void *ctx);\n"
+    "extern \"C\" int halide_check_memory_budget(void *ctx, const char *pipeline, int64_t bytes, int is_query);\n"
+    "extern \"C\" int64_t halide_runtime_stats_begin(void *ctx);\n"
+    "extern \"C\" int halide_runtime_stats_end(void *ctx, const char *pipeline, int64_t begin_ns);\n"
+    "extern \"C\" int halide_lazy_block_claim(int32_t *token);\n"
+    "extern \"C\" int halide_lazy_block_release(int32_t *token);\n"
+    "extern \"C\" int halide_host_cache_size(int level);\n"
+    "extern \"C\" int halide_do_par_for(void *ctx, int (*f)(void *, int, uint8_t *), int min, int size, uint8_t *closure);\n"
+    "extern \"C\" void *halide_make_semaphore(void *ctx, int count);\n"
+    "extern \"C\" int halide_semaphore_acquire(void *sem);\n"
+    "extern \"C\" int halide_semaphore_release(void *sem);\n"
+    "extern \"C\" int halide_free_semaphore(void *ctx, void *sem);\n"
+    "extern \"C\" int halide_semaphore_abandon(void *sem);\n"
+    "extern \"C\" int halide_reserve_worker(void *ctx);\n"
+    "extern \"C\" int halide_release_worker(void *ctx, int reserved);\n"
+    "extern \"C\" int32_t halide_memoization_cache_lookup(void *ctx, const void *key, int32_t key_size, void *dst, int32_t size);\n"
+    "extern \"C\" int32_t halide_memoization_cache_store(void *ctx, const void *key, int32_t key_size, const void *src, int32_t size);\n"
     "\n"
 
     // TODO: this next chunk is copy-pasted from posix_math.cpp. A
@@ -148,6 +173,17 @@ const string preamble =
     "template<typename T> T min(T a, T b) {if (a < b) return a; return b;}\n"
     "template<typename T> T mod(T a, T b) {T result = a % b; if (result < 0) result += b; return result;}\n"
     "template<typename T> T sdiv(T a, T b) {return (a - mod(a, b))/b;}\n"
+    "template<typename T> T halide_atomic_add(T *ptr, T val) {return __sync_fetch_and_add(ptr, val);}\n"
+    "template<typename T, typename B> T halide_atomic_add_float(T *ptr, T val) {\n"
+    " union {T f; B b;} old_val, new_val;\n"
+    " do {\n"
+    "  old_val.f = *(volatile T *)ptr;\n"
+    "  new_val.f = old_val.f + val;\n"
+    " } while (!__sync_bool_compare_and_swap((B *)ptr, old_val.b, new_val.b));\n"
+    " return old_val.f;\n"
+    "}\n"
+    "inline float halide_atomic_add(float *ptr, float val) {return halide_atomic_add_float<float, uint32_t>(ptr, val);}\n"
+    "inline double halide_atomic_add(double *ptr, double val) {return halide_atomic_add_float<double, uint64_t>(ptr, val);}\n"
 
     // This may look wasteful, but it's the right way to do
     // it. Compilers understand memcpy and will convert it to a no-op
@@ -177,12 +213,11 @@ const string preamble =
     "}\n";
 }
 
-CodeGen_C::CodeGen_C(ostream &s) : IRPrinter(s), id("$$ BAD ID $$") {}
+CodeGen_C::CodeGen_C(ostream &s) : IRPrinter(s), id("$$ BAD ID $$"), vector_extensions(true) {}
 
 namespace {
 string type_to_c_type(Type type) {
     ostringstream oss;
-    assert(type.width == 1 && "Can't codegen vector types to C (yet)");
     if (type.is_float()) {
         if (type.bits == 32) {
             oss << "float";
@@ -193,6 +228,7 @@ string type_to_c_type(Type type) {
         }
 
     } else if (type.is_handle()) {
+        assert(type.is_scalar() && "Can't represent a vector of handles in C");
         oss << "void *";
     } else {
         switch (type.bits) {
@@ -201,14 +237,48 @@ string type_to_c_type(Type type) {
             break;
         case 8: case 16: case 32: case 64:
             if (type.is_uint()) oss << 'u';
-            oss << "int" << type.bits << "_t";
+            oss << "int" << type.bits;
+            if (type.is_scalar()) oss << "_t";
             break;
         default:
             assert(false && "Can't represent an integer with this many bits in C");
         }
     }
+    if (type.is_vector()) {
+        // e.g. int32x8, floatx4, boolx16. These are typedefs emitted
+        // by vector_typedef.
+        assert((type.width & (type.width - 1)) == 0 &&
+               "The C backend can only emit vectors whose width is a power of two");
+        oss << 'x' << type.width;
+    }
     return oss.str();
 }
+
+// The typedef of a vector type, using the gcc/clang vector_size
+// attribute. Vectors of bools have one byte per lane, each of which
+// is zero or one.
+string vector_typedef(Type type) {
+    ostringstream oss;
+    Type elem = type.element_of();
+    int bytes = elem.bits == 1 ? 1 : elem.bytes();
+    oss << "typedef " << (elem.bits == 1 ? "uint8_t" : type_to_c_type(elem))
+        << " " << type_to_c_type(type)
+        << " __attribute__((vector_size(" << bytes * type.width << ")));\n";
+    return oss.str();
+}
+
+// Find the vector types used by a Stmt.
+class VectorTypes : public IRGraphVisitor {
+public:
+    std::set<string> typedefs;
+    using IRGraphVisitor::include;
+    void include(const Expr &e) {
+        if (e.defined() && e.type().is_vector()) {
+            typedefs.insert(vector_typedef(e.type()));
+        }
+        IRGraphVisitor::include(e);
+    }
+};
 }
 
 string CodeGen_C::print_type(Type type) {
@@ -217,7 +287,12 @@ string CodeGen_C::print_type(Type type) {
 
 string CodeGen_C::print_reinterpret(Type type, Expr e) {
     ostringstream oss;
-    oss << "reinterpret<" << print_type(type) << ">(" << print_expr(e) << ")";
+    if (e.type().is_handle() && !type.is_handle()) {
+        // Pointers may be narrower than the integer type.
+        oss << "((" << print_type(type) << ")(uintptr_t)(" << print_expr(e) << "))";
+    } else {
+        oss << "reinterpret<" << print_type(type) << ">(" << print_expr(e) << ")";
+    }
     return oss.str();
 }
 
@@ -246,6 +321,13 @@ void CodeGen_C::compile_header(const string &name, const vector<Argument> &args)
 
     // Now the function prototype
     stream << "extern \"C\" int " << name << "(";
+    print_arg_list(args);
+    stream << ") HALIDE_FUNCTION_ATTRS;\n";
+
+    stream << "#endif\n";
+}
+
+void CodeGen_C::print_arg_list(const vector<Argument> &args) {
     for (size_t i = 0; i < args.size(); i++) {
         if (i > 0) stream << ", ";
         if (args[i].is_buffer) {
@@ -256,8 +338,149 @@ void CodeGen_C::compile_header(const string &name, const vector<Argument> &args)
                    << " " << print_name(args[i].name);
         }
     }
+}
+
+void CodeGen_C::compile_check_once_header(const string &name, const vector<Argument> &args) {
+    compile_header(name, args);
+
+    stream << "#ifndef HALIDE_" << name << "_checked\n"
+           << "#define HALIDE_" << name << "_checked\n";
+
+    stream << "extern \"C\" int " << name << "_unchecked(";
+    print_arg_list(args);
     stream << ") HALIDE_FUNCTION_ATTRS;\n";
 
+    // The handle holds copies of the buffer_t and scalar arguments.
+    stream << "struct " << name << "_checked {\n"
+           << "    int valid;\n";
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i].is_buffer) {
+            stream << "    buffer_t " << print_name(args[i].name) << ";\n";
+        } else {
+            // The arguments are const, so handles point to const.
+            string t = args[i].type.is_handle() ? "const void *" : print_type(args[i].type);
+            stream << "    " << t << " " << print_name(args[i].name) << ";\n";
+        }
+    }
+    stream << "};\n";
+
+    // The checks depend on the mins, extents, strides and elem_sizes
+    // of the buffers, and on the values of the scalars. A NULL host
+    // pointer makes it a bounds query, which only the checked version
+    // can answer.
+    ostringstream same;
+    same << "handle->valid";
+    for (size_t i = 0; i < args.size(); i++) {
+        string n = print_name(args[i].name);
+        if (args[i].is_buffer) {
+            same << " &&\n        " << n << "->host && "
+                 << n << "->elem_size == handle->" << n << ".elem_size";
+            for (int d = 0; d < 4; d++) {
+                same << " &&\n        "
+                     << n << "->min[" << d << "] == handle->" << n << ".min[" << d << "] && "
+                     << n << "->extent[" << d << "] == handle->" << n << ".extent[" << d << "] && "
+                     << n << "->stride[" << d << "] == handle->" << n << ".stride[" << d << "]";
+            }
+        } else {
+            same << " &&\n        " << n << " == handle->" << n;
+        }
+    }
+
+    ostringstream call_args;
+    for (size_t i = 0; i < args.size(); i++) {
+        if (i > 0) call_args << ", ";
+        call_args << print_name(args[i].name);
+    }
+
+    stream << "static inline int " << name << "_check(" << name << "_checked *handle";
+    if (!args.empty()) stream << ", ";
+    print_arg_list(args);
+    stream << ") {\n"
+           << "    handle->valid = 0;\n"
+           << "    int result = " << name << "(" << call_args.str() << ");\n"
+           << "    if (result != 0) return result;\n";
+    for (size_t i = 0; i < args.size(); i++) {
+        string n = print_name(args[i].name);
+        if (args[i].is_buffer) {
+            stream << "    if (!" << n << "->host) return 0;\n"
+                   << "    handle->" << n << " = *" << n << ";\n";
+        } else {
+            stream << "    handle->" << n << " = " << n << ";\n";
+        }
+    }
+    stream << "    handle->valid = 1;\n"
+           << "    return 0;\n"
+           << "}\n";
+
+    stream << "static inline int " << name << "_call_checked(const " << name << "_checked *handle";
+    if (!args.empty()) stream << ", ";
+    print_arg_list(args);
+    stream << ") {\n"
+           << "    if (" << same.str() << ") {\n"
+           << "        return " << name << "_unchecked(" << call_args.str() << ");\n"
+           << "    }\n"
+           << "    return " << name << "(" << call_args.str() << ");\n"
+           << "}\n";
+
+    // The batch entry point takes an array of buffers for each buffer
+    // argument, one per frame, and the scalars shared by all of
+    // them. The first frame is checked on its own, and the rest run
+    // as tasks of a parallel loop on the runtime's thread pool, with
+    // the pipeline's own parallel loops nested inside.
+    ostringstream frame_args;
+    for (size_t i = 0; i < args.size(); i++) {
+        string n = print_name(args[i].name);
+        if (i > 0) frame_args << ", ";
+        if (args[i].is_buffer) {
+            frame_args << "b->" << n << "[frame]";
+        } else {
+            frame_args << "b->" << n;
+        }
+    }
+
+    stream << "extern \"C\" int halide_do_par_for(void *, int (*)(void *, int, uint8_t *), int, int, uint8_t *);\n"
+           << "struct " << name << "_batch_args {\n"
+           << "    const " << name << "_checked *handle;\n";
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i].is_buffer) {
+            stream << "    buffer_t **" << print_name(args[i].name) << ";\n";
+        } else {
+            string t = args[i].type.is_handle() ? "const void *" : print_type(args[i].type);
+            stream << "    " << t << " " << print_name(args[i].name) << ";\n";
+        }
+    }
+    stream << "};\n";
+
+    stream << "static inline int " << name << "_batch_frame(void *user_context, int frame, uint8_t *closure) {\n"
+           << "    const " << name << "_batch_args *b = (const " << name << "_batch_args *)closure;\n"
+           << "    return " << name << "_call_checked(b->handle, " << frame_args.str() << ");\n"
+           << "}\n";
+
+    stream << "static inline int " << name << "_batch(int frames";
+    for (size_t i = 0; i < args.size(); i++) {
+        stream << ", ";
+        if (args[i].is_buffer) {
+            stream << "buffer_t **" << print_name(args[i].name);
+        } else {
+            stream << "const " << print_type(args[i].type) << " " << print_name(args[i].name);
+        }
+    }
+    stream << ") {\n"
+           << "    if (frames <= 0) return 0;\n"
+           << "    " << name << "_checked handle;\n"
+           << "    " << name << "_batch_args batch;\n"
+           << "    batch.handle = &handle;\n";
+    for (size_t i = 0; i < args.size(); i++) {
+        string n = print_name(args[i].name);
+        stream << "    batch." << n << " = " << n << ";\n";
+    }
+    stream << "    const " << name << "_batch_args *b = &batch;\n"
+           << "    int frame = 0;\n"
+           << "    int result = " << name << "_check(&handle, " << frame_args.str() << ");\n"
+           << "    if (result != 0 || frames == 1) return result;\n"
+           << "    return halide_do_par_for(NULL, " << name << "_batch_frame, 1, frames - 1, (uint8_t *)b);\n"
+           << "}\n";
+
     stream << "#endif\n";
 }
 
@@ -271,13 +494,14 @@ class ExternCallPrototypes : public IRGraphVisitor {
 
         if (op->call_type == Call::Extern) {
             if (!emitted.count(op->name)) {
-                stream << "extern \"C\" " << type_to_c_type(op->type)
+                // Vector calls are made one lane at a time.
+                stream << "extern \"C\" " << type_to_c_type(op->type.element_of())
                        << " " << op->name << "(";
                 for (size_t i = 0; i < op->args.size(); i++) {
                     if (i > 0) {
                         stream << ", ";
                     }
-                    stream << type_to_c_type(op->args[i].type());
+                    stream << type_to_c_type(op->args[i].type().element_of());
                 }
                 stream << ");\n";
                 emitted.insert(op->name);
@@ -360,6 +584,15 @@ void CodeGen_C::compile(Stmt s, string name,
         have_user_context |= (args[i].name == "__user_context");
     }
 
+    // Emit typedefs for the vector types used.
+    if (vector_extensions) {
+        VectorTypes v;
+        s.accept(&v);
+        for (std::set<string>::iterator iter = v.typedefs.begin(); iter != v.typedefs.end(); ++iter) {
+            stream << *iter;
+        }
+    }
+
     // Emit prototypes for any extern calls used.
     {
         stream << "\n";
@@ -389,7 +622,7 @@ void CodeGen_C::compile(Stmt s, string name,
     // Unpack the buffer_t's
     for (size_t i = 0; i < args.size(); i++) {
         if (args[i].is_buffer) {
-            unpack_buffer(args[i].type, args[i].name);
+            unpack_buffer(args[i].type, args[i].name, args[i].host_alignment, args[i].no_alias);
         }
     }
     for (size_t i = 0; i < images_to_embed.size(); i++) {
@@ -402,18 +635,29 @@ void CodeGen_C::compile(Stmt s, string name,
            << "}\n";
 }
 
-void CodeGen_C::unpack_buffer(Type t, const std::string &buffer_name) {
+void CodeGen_C::unpack_buffer(Type t, const std::string &buffer_name,
+                              int host_alignment, bool no_alias) {
     string name = print_name(buffer_name);
     string type = print_type(t);
+    string host = "_" + name + "->host";
+    if (host_alignment > 0) {
+        // The alignment is asserted in the pipeline.
+        stream << "uint8_t *" << name << "_host = " << host << ";\n";
+        host = "__builtin_assume_aligned(" + name + "_host, " + int_to_string(host_alignment) + ")";
+    }
     stream << type
            << " *"
+           << (no_alias ? "__restrict " : "")
            << name
            << " = ("
            << type
-           << " *)(_"
-           << name
-           << "->host);\n";
+           << " *)("
+           << host
+           << ");\n";
     allocations.push(buffer_name, t);
+    if (no_alias) {
+        no_alias_buffers.insert(buffer_name);
+    }
 
     stream << "const bool "
            << name
@@ -499,6 +743,20 @@ void CodeGen_C::close_scope(const std::string &comment) {
     }
 }
 
+string CodeGen_C::print_lane(Expr e, const string &value) {
+    return e.type().is_vector() ? value + "[__i]" : value;
+}
+
+string CodeGen_C::print_lanewise(Type t, const string &lane) {
+    id = unique_name('V');
+    do_indent();
+    stream << print_type(t) << " " << id << ";\n";
+    do_indent();
+    stream << "for (int __i = 0; __i < " << t.width << "; __i++) "
+           << id << "[__i] = " << lane << ";\n";
+    return id;
+}
+
 void CodeGen_C::visit(const Variable *op) {
     ostringstream oss;
     for (size_t i = 0; i < op->name.size(); i++) {
@@ -510,12 +768,26 @@ void CodeGen_C::visit(const Variable *op) {
 }
 
 void CodeGen_C::visit(const Cast *op) {
+    if (vector_extensions && op->type.is_vector()) {
+        // A cast of a vector type reinterprets the bits, so convert
+        // each lane instead.
+        string value = print_lane(op->value, print_expr(op->value));
+        print_lanewise(op->type, "(" + print_type(op->type.element_of()) + ")(" + value + ")");
+        return;
+    }
     print_assignment(op->type, "(" + print_type(op->type) + ")(" + print_expr(op->value) + ")");
 }
 
 void CodeGen_C::visit_binop(Type t, Expr a, Expr b, const char * op) {
     string sa = print_expr(a);
     string sb = print_expr(b);
+    if (vector_extensions && t.is_vector() && t.is_bool()) {
+        // Comparisons of vectors give masks of the width of the
+        // arguments, rather than vectors of bools, so compare each
+        // lane.
+        print_lanewise(t, print_lane(a, sa) + " " + op + " " + print_lane(b, sb));
+        return;
+    }
     print_assignment(t, sa + " " + op + " " + sb);
 }
 
@@ -596,6 +868,10 @@ void CodeGen_C::visit(const And *op) {
 }
 
 void CodeGen_C::visit(const Not *op) {
+    if (vector_extensions && op->type.is_vector()) {
+        print_lanewise(op->type, "!" + print_lane(op->a, print_expr(op->a)));
+        return;
+    }
     print_assignment(op->type, "!(" + print_expr(op->a) + ")");
 }
 
@@ -750,11 +1026,86 @@ void CodeGen_C::visit(const Call *op) {
                 << " + "
                 << print_expr(l->index)
                 << ")";
+        } else if (op->name == Call::prefetch) {
+            assert(op->args.size() == 1);
+            rhs << "(__builtin_prefetch(" << print_expr(op->args[0]) << "), 0)";
+        } else if (op->name == Call::nontemporal_store) {
+            // A plain store.
+            const Load *l = op->args[0].as<Load>();
+            assert(op->args.size() == 2 && l);
+            print_stmt(Store::make(l->name, op->args[1], l->index));
+            rhs << "0";
+        } else if (op->name == Call::branch_weights) {
+            assert(op->args.size() == 3);
+            rhs << print_expr(op->args[0]);
+        } else if (op->name == Call::store_fence) {
+            assert(op->args.empty());
+            rhs << "(__sync_synchronize(), 0)";
+        } else if (op->name == Call::check_cancelled) {
+            assert(op->args.empty());
+            do_indent();
+            stream << "if (halide_is_cancelled("
+                   << (have_user_context ? "__user_context" : "NULL")
+                   << ")) " << early_return("-2") << "\n";
+            rhs << "0";
+        } else if (op->name == Call::cleanup_on_exit) {
+            assert(op->args.size() == 1);
+            early_exit_cleanups.push_back(print_cleanup_call(op->args[0]));
+            rhs << "0";
+        } else if (op->name == Call::run_cleanup) {
+            assert(op->args.size() == 1);
+            string call = print_cleanup_call(op->args[0]);
+            for (size_t i = early_exit_cleanups.size(); i > 0; i--) {
+                if (early_exit_cleanups[i-1] == call) {
+                    early_exit_cleanups.erase(early_exit_cleanups.begin() + (i-1));
+                    break;
+                }
+            }
+            rhs << call;
+        } else if (op->name == Call::fill_memory) {
+            assert(op->args.size() == 3);
+            rhs << "(memset(" << print_expr(op->args[0]) << ", "
+                << print_expr(op->args[1]) << ", "
+                << print_expr(op->args[2]) << "), 0)";
+        } else if (op->name == Call::check_memory_budget) {
+            assert(op->args.size() == 3);
+            string name = print_expr(op->args[0]);
+            string bytes = print_expr(op->args[1]);
+            string is_query = print_expr(op->args[2]);
+            do_indent();
+            stream << "if (halide_check_memory_budget("
+                   << (have_user_context ? "__user_context" : "NULL") << ", "
+                   << name << ", " << bytes << ", " << is_query << ") && !"
+                   << is_query << ") " << early_return("-3") << "\n";
+            rhs << "0";
+        } else if (op->name == Call::atomic_add) {
+            const Load *l = op->args[0].as<Load>();
+            assert(op->args.size() == 2 && l);
+            string val = print_expr(op->args[1]);
+            rhs << "halide_atomic_add(("
+                << print_type(l->type)
+                << " *)"
+                << print_name(l->name)
+                << " + "
+                << print_expr(l->index)
+                << ", " << val << ")";
         } else if (op->name == Call::return_second) {
             assert(op->args.size() == 2);
             string arg0 = print_expr(op->args[0]);
             string arg1 = print_expr(op->args[1]);
             rhs << "(" << arg0 << ", " << arg1 << ")";
+        } else if (vector_extensions && op->name == Call::if_then_else && op->type.is_vector()) {
+            // Only evaluate the side of each lane that's used.
+            string result_id = unique_name('V');
+            do_indent();
+            stream << print_type(op->type) << " " << result_id << ";\n";
+            for (int i = 0; i < op->type.width; i++) {
+                string lane = print_expr(extract_lane(op, i));
+                do_indent();
+                stream << result_id << "[" << i << "] = " << lane << ";\n";
+            }
+            id = result_id;
+            return;
         } else if (op->name == Call::if_then_else) {
             assert(op->args.size() == 3);
 
@@ -796,6 +1147,7 @@ void CodeGen_C::visit(const Call *op) {
             do_indent();
             stream << buf_id << ".elem_size = " << args[1] << ";\n";
             int dims = ((int)op->args.size() - 2)/3;
+            assert(dims <= 4 && "A buffer_t has at most four dimensions");
             for (int i = 0; i < dims; i++) {
                 do_indent();
                 stream << buf_id << ".min[" << i << "] = " << args[i*3+2] << ";\n";
@@ -818,7 +1170,90 @@ void CodeGen_C::visit(const Call *op) {
         } else if (op->name == Call::abs) {
             assert(op->args.size() == 1);
             string arg = print_expr(op->args[0]);
+            bool lanewise = vector_extensions && op->type.is_vector();
+            if (lanewise) arg = print_lane(op->args[0], arg);
             rhs << "(" << arg << " > 0 ? " << arg << " : -" << arg << ")";
+            if (lanewise) {
+                print_lanewise(op->type, rhs.str());
+                return;
+            }
+        } else if (vector_extensions && op->name == Call::shuffle_vector) {
+            assert(op->args.size() >= 2);
+            string vec = print_expr(op->args[0]);
+            if (op->type.is_vector()) rhs << "{";
+            for (size_t i = 1; i < op->args.size(); i++) {
+                const int *lane = as_const_int(op->args[i]);
+                assert(lane && "The lanes of a shuffle_vector must be constants");
+                if (i > 1) rhs << ", ";
+                rhs << vec << "[" << *lane << "]";
+            }
+            if (op->type.is_vector()) rhs << "}";
+        } else if (vector_extensions && op->name == Call::interleave_vectors) {
+            int n = (int)op->args.size();
+            assert(n > 0);
+            vector<string> args(n);
+            for (int i = 0; i < n; i++) {
+                args[i] = print_expr(op->args[i]);
+            }
+            rhs << "{";
+            for (int i = 0; i < op->type.width; i++) {
+                if (i > 0) rhs << ", ";
+                rhs << args[i % n];
+                if (op->args[i % n].type().is_vector()) {
+                    rhs << "[" << i / n << "]";
+                }
+            }
+            rhs << "}";
+        } else if (vector_extensions && op->name == Call::concat_vectors) {
+            vector<string> args(op->args.size());
+            for (size_t i = 0; i < args.size(); i++) {
+                args[i] = print_expr(op->args[i]);
+            }
+            rhs << "{";
+            for (size_t i = 0; i < args.size(); i++) {
+                for (int j = 0; j < op->args[i].type().width; j++) {
+                    if (i > 0 || j > 0) rhs << ", ";
+                    rhs << args[i] << "[" << j << "]";
+                }
+            }
+            rhs << "}";
+        } else if (vector_extensions &&
+                   (op->name == Call::vector_reduce_add ||
+                    op->name == Call::vector_reduce_min ||
+                    op->name == Call::vector_reduce_max)) {
+            assert(op->args.size() == 1 && "Vector reductions take one argument");
+            string arg = print_expr(op->args[0]);
+            int factor = op->args[0].type().width / op->type.width;
+            assert(factor * op->type.width == op->args[0].type().width &&
+                   "The width of a vector reduction must divide the width of its argument");
+
+            // Lane i of the result combines the group of factor
+            // adjacent lanes starting at lane i * factor.
+            string result_id = unique_name('V');
+            string result = op->type.is_vector() ? result_id + "[__i]" : result_id;
+            ostringstream first, next;
+            first << arg << "[__i * " << factor << "]";
+            next << arg << "[__i * " << factor << " + __j]";
+            string combined;
+            if (op->name == Call::vector_reduce_add) {
+                combined = result + " + " + next.str();
+            } else {
+                combined = (op->name == Call::vector_reduce_min ? "min(" : "max(") +
+                    result + ", " + next.str() + ")";
+            }
+            do_indent();
+            stream << print_type(op->type) << " " << result_id << ";\n";
+            do_indent();
+            stream << "for (int __i = 0; __i < " << op->type.width << "; __i++) {\n";
+            do_indent();
+            stream << " " << result << " = " << first.str() << ";\n";
+            do_indent();
+            stream << " for (int __j = 1; __j < " << factor << "; __j++) "
+                   << result << " = " << combined << ";\n";
+            do_indent();
+            stream << "}\n";
+            id = result_id;
+            return;
         } else {
           // TODO: other intrinsics
           std::cerr << "Unhandled intrinsic: " << op->name << '\n';
@@ -826,10 +1261,12 @@ void CodeGen_C::visit(const Call *op) {
         }
 
     } else {
-        // Generic calls
+        // Generic calls. Vector calls are made one lane at a time.
+        bool lanewise = vector_extensions && op->type.is_vector();
         vector<string> args(op->args.size());
         for (size_t i = 0; i < op->args.size(); i++) {
             args[i] = print_expr(op->args[i]);
+            if (lanewise) args[i] = print_lane(op->args[i], args[i]);
         }
         rhs << print_name(op->name) << "(";
 
@@ -842,12 +1279,43 @@ void CodeGen_C::visit(const Call *op) {
             rhs << args[i];
         }
         rhs << ")";
+
+        if (lanewise) {
+            print_lanewise(op->type, rhs.str());
+            return;
+        }
     }
 
     print_assignment(op->type, rhs.str());
 }
 
 void CodeGen_C::visit(const Load *op) {
+    if (vector_extensions && op->type.is_vector()) {
+        string ptr = "((" + print_type(op->type.element_of()) + " *)" + print_name(op->name) + ")";
+        const Ramp *ramp = op->index.as<Ramp>();
+        if (ramp && is_one(ramp->stride) && !op->predicate.defined()) {
+            // A dense vector load. Compilers turn the memcpy into an
+            // unaligned vector load.
+            string base = print_expr(ramp->base);
+            id = unique_name('V');
+            do_indent();
+            stream << print_type(op->type) << " " << id << ";\n";
+            do_indent();
+            stream << "memcpy(&" << id << ", " << ptr << " + " << base
+                   << ", sizeof(" << id << "));\n";
+        } else {
+            // A gather
+            string index = print_expr(op->index);
+            string lane = ptr + "[" + print_lane(op->index, index) + "]";
+            if (op->predicate.defined()) {
+                string predicate = print_expr(op->predicate);
+                lane = "(" + print_lane(op->predicate, predicate) + " ? " + lane + " : 0)";
+            }
+            print_lanewise(op->type, lane);
+        }
+        return;
+    }
+
     bool type_cast_needed = !(allocations.contains(op->name) &&
                               allocations.get(op->name) == op->type);
     ostringstream rhs;
@@ -864,6 +1332,13 @@ void CodeGen_C::visit(const Load *op) {
         << print_expr(op->index)
         << "]";
 
+    if (op->predicate.defined()) {
+        // Only touch memory if the predicate holds
+        string id_predicate = print_expr(op->predicate);
+        print_assignment(op->type, "(" + id_predicate + " ? " + rhs.str() + " : 0)");
+        return;
+    }
+
     print_assignment(op->type, rhs.str());
 }
 
@@ -871,13 +1346,43 @@ void CodeGen_C::visit(const Store *op) {
 
     Type t = op->value.type();
 
+    if (vector_extensions && t.is_vector()) {
+        string ptr = "((" + print_type(t.element_of()) + " *)" + print_name(op->name) + ")";
+        string id_value = print_expr(op->value);
+        const Ramp *ramp = op->index.as<Ramp>();
+        if (ramp && is_one(ramp->stride) && !op->predicate.defined()) {
+            // A dense vector store
+            string base = print_expr(ramp->base);
+            do_indent();
+            stream << "memcpy(" << ptr << " + " << base << ", &" << id_value
+                   << ", sizeof(" << id_value << "));\n";
+        } else {
+            // A scatter
+            string id_index = print_expr(op->index);
+            string id_predicate = op->predicate.defined() ? print_expr(op->predicate) : "";
+            do_indent();
+            stream << "for (int __i = 0; __i < " << t.width << "; __i++) ";
+            if (op->predicate.defined()) {
+                stream << "if (" << print_lane(op->predicate, id_predicate) << ") ";
+            }
+            stream << ptr << "[" << print_lane(op->index, id_index) << "] = "
+                   << print_lane(op->value, id_value) << ";\n";
+        }
+        return;
+    }
+
     bool type_cast_needed = !(allocations.contains(op->name) &&
                               allocations.get(op->name) == t);
 
     string id_index = print_expr(op->index);
     string id_value = print_expr(op->value);
+    string id_predicate = op->predicate.defined() ? print_expr(op->predicate) : "";
     do_indent();
 
+    if (op->predicate.defined()) {
+        stream << "if (" << id_predicate << ") ";
+    }
+
     if (type_cast_needed) {
         stream << "(("
                << print_type(t)
@@ -906,6 +1411,13 @@ void CodeGen_C::visit(const Select *op) {
     string true_val = print_expr(op->true_value);
     string false_val = print_expr(op->false_value);
     string cond = print_expr(op->condition);
+    if (vector_extensions && op->type.is_vector()) {
+        // The condition may be a scalar.
+        print_lanewise(op->type, "(" + print_lane(op->condition, cond) +
+                       " ? " + print_lane(op->true_value, true_val) +
+                       " : " + print_lane(op->false_value, false_val) + ")");
+        return;
+    }
     rhs << "(" << print_type(op->type) << ")"
         << "(" << cond
         << " ? " << true_val
@@ -914,6 +1426,31 @@ void CodeGen_C::visit(const Select *op) {
     print_assignment(op->type, rhs.str());
 }
 
+void CodeGen_C::visit(const Ramp *op) {
+    string base = print_expr(op->base);
+    string stride = print_expr(op->stride);
+    string elem = print_type(op->type.element_of());
+    ostringstream rhs;
+    rhs << "{" << base;
+    for (int i = 1; i < op->width; i++) {
+        rhs << ", (" << elem << ")(" << base << " + " << stride << " * " << i << ")";
+    }
+    rhs << "}";
+    print_assignment(op->type, rhs.str());
+}
+
+void CodeGen_C::visit(const Broadcast *op) {
+    string value = print_expr(op->value);
+    ostringstream rhs;
+    rhs << "{";
+    for (int i = 0; i < op->width; i++) {
+        if (i > 0) rhs << ", ";
+        rhs << value;
+    }
+    rhs << "}";
+    print_assignment(op->type, rhs.str());
+}
+
 void CodeGen_C::visit(const LetStmt *op) {
     string id_value = print_expr(op->value);
     Expr new_var = Variable::make(op->value.type(), id_value);
@@ -946,11 +1483,39 @@ void CodeGen_C::visit(const AssertStmt *op) {
     }
     stream << ");\n";
     do_indent();
-    stream << " return -1;\n";
+    stream << " " << early_return("-1") << "\n";
     do_indent();
     stream << "}\n";
 }
 
+string CodeGen_C::early_return(const string &status) {
+    if (early_exit_cleanups.empty()) {
+        return "return " + status + ";";
+    }
+    string result = "{";
+    for (size_t i = early_exit_cleanups.size(); i > 0; i--) {
+        result += " " + early_exit_cleanups[i-1] + ";";
+    }
+    return result + " return " + status + "; }";
+}
+
+string CodeGen_C::print_cleanup_call(Expr e) {
+    const Call *call = e.as<Call>();
+    assert(call && call->call_type == Call::Extern && "cleanups must be calls to extern functions");
+    string result = call->name + "(";
+    bool first = true;
+    if (CodeGen::function_takes_user_context(call->name)) {
+        result += have_user_context ? "__user_context" : "NULL";
+        first = false;
+    }
+    for (size_t i = 0; i < call->args.size(); i++) {
+        if (!first) result += ", ";
+        result += print_expr(call->args[i]);
+        first = false;
+    }
+    return result + ")";
+}
+
 void CodeGen_C::visit(const Pipeline *op) {
 
     do_indent();
@@ -968,13 +1533,30 @@ void CodeGen_C::visit(const Pipeline *op) {
     print_stmt(op->consume);
 }
 
+namespace {
+// Whether the name of a variable is a C identifier, rather than e.g.
+// a constant substituted in for a let.
+bool is_identifier(const string &name) {
+    if (name.empty() || ('0' <= name[0] && name[0] <= '9')) return false;
+    for (size_t i = 0; i < name.size(); i++) {
+        char c = name[i];
+        if (!(('A' <= c && c <= 'Z') ||
+              ('a' <= c && c <= 'z') ||
+              ('0' <= c && c <= '9') ||
+              c == '_' || c == '.' || c == '$')) {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
 void CodeGen_C::visit(const For *op) {
     if (op->for_type == For::Parallel) {
-        do_indent();
-        stream << "#pragma omp parallel for\n";
-    } else {
-        assert(op->for_type == For::Serial && "Can only emit serial or parallel for loops to C");
+        print_parallel_for(op);
+        return;
     }
+    assert(op->for_type == For::Serial && "Can only emit serial or parallel for loops to C");
 
     string id_min = print_expr(op->min);
     string id_extent = print_expr(op->extent);
@@ -997,6 +1579,107 @@ void CodeGen_C::visit(const For *op) {
 
 }
 
+void CodeGen_C::print_parallel_for(const For *op) {
+    string id_min = print_expr(op->min);
+    string id_extent = print_expr(op->extent);
+
+    Closure closure = Closure::make(op->body, op->name, false, NULL);
+    vector<string> vars;
+    for (map<string, Type>::iterator iter = closure.vars.begin(); iter != closure.vars.end(); ++iter) {
+        if (is_identifier(iter->first)) vars.push_back(iter->first);
+    }
+
+    // The body becomes a static member of a local struct, which also
+    // holds the state it uses. It can't see the locals of the
+    // enclosing function, so the members are unpacked into locals of
+    // the same names.
+    string closure_type = print_name("par_for_" + op->name);
+    open_scope();
+    do_indent();
+    stream << "struct " << closure_type << " {\n";
+    indent++;
+    for (size_t i = 0; i < vars.size(); i++) {
+        do_indent();
+        stream << print_type(closure.vars[vars[i]]) << " " << print_name(vars[i]) << ";\n";
+    }
+    for (map<string, Closure::BufferRef>::iterator iter = closure.buffers.begin();
+         iter != closure.buffers.end(); ++iter) {
+        do_indent();
+        stream << "void *" << print_name(iter->first) << ";\n";
+    }
+
+    do_indent();
+    stream << "static int task(void *__user_context, int " << print_name(op->name)
+           << ", uint8_t *__closure) {\n";
+    indent++;
+    do_indent();
+    stream << closure_type << " *closure = (" << closure_type << " *)__closure;\n";
+    do_indent();
+    stream << "(void)closure;\n";
+    for (size_t i = 0; i < vars.size(); i++) {
+        string name = print_name(vars[i]);
+        do_indent();
+        stream << "const " << print_type(closure.vars[vars[i]]) << " " << name
+               << " = closure->" << name << ";\n";
+    }
+    for (map<string, Closure::BufferRef>::iterator iter = closure.buffers.begin();
+         iter != closure.buffers.end(); ++iter) {
+        string name = print_name(iter->first);
+        string type = print_type(allocations.contains(iter->first) ?
+                                 allocations.get(iter->first) : iter->second.type.element_of());
+        do_indent();
+        stream << type << " *" << (no_alias_buffers.count(iter->first) ? "__restrict " : "")
+               << name << " = (" << type << " *)closure->" << name << ";\n";
+    }
+
+    // The task is given the user context, if there is one.
+    bool old_have_user_context = have_user_context;
+    have_user_context = true;
+    map<string, string> old_cache;
+    old_cache.swap(cache);
+    vector<string> old_early_exit_cleanups;
+    old_early_exit_cleanups.swap(early_exit_cleanups);
+    op->body.accept(this);
+    early_exit_cleanups.swap(old_early_exit_cleanups);
+    cache.swap(old_cache);
+    have_user_context = old_have_user_context;
+
+    do_indent();
+    stream << "return 0;\n";
+    indent--;
+    do_indent();
+    stream << "}\n";
+    indent--;
+    do_indent();
+    stream << "};\n";
+
+    // Fill in the closure and run the tasks.
+    string closure_id = unique_name('C');
+    do_indent();
+    stream << closure_type << " " << closure_id << ";\n";
+    for (size_t i = 0; i < vars.size(); i++) {
+        string name = print_name(vars[i]);
+        do_indent();
+        stream << closure_id << "." << name << " = " << name << ";\n";
+    }
+    for (map<string, Closure::BufferRef>::iterator iter = closure.buffers.begin();
+         iter != closure.buffers.end(); ++iter) {
+        string name = print_name(iter->first);
+        do_indent();
+        stream << closure_id << "." << name << " = (void *)" << name << ";\n";
+    }
+    string result_id = unique_name('V');
+    do_indent();
+    stream << "int " << result_id << " = halide_do_par_for("
+           << (have_user_context ? "(void *)__user_context" : "NULL") << ", "
+           << closure_type << "::task, "
+           << id_min << ", " << id_extent << ", "
+           << "(uint8_t *)&" << closure_id << ");\n";
+    do_indent();
+    stream << "if (" << result_id << ") " << early_return(result_id) << "\n";
+    close_scope("par_for " + print_name(op->name));
+}
+
 void CodeGen_C::visit(const Provide *op) {
     assert(false && "Cannot emit Provide statements as C");
 }
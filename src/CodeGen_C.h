@@ -10,6 +10,7 @@
 #include <vector>
 #include <ostream>
 #include <map>
+#include <set>
 
 #include "IRPrinter.h"
 #include "Scope.h"
@@ -41,6 +42,17 @@ public:
      * type signature */
     void compile_header(const std::string &name, const std::vector<Argument> &args);
 
+    /** Emit a header file for a pipeline compiled both with its
+     * checks, as name, and without them, as name_unchecked. It also
+     * defines a struct name_checked, which remembers the shapes of
+     * the buffers (and the values of the scalars) of a call that
+     * passed the checks; name_check makes the call and fills it in,
+     * and name_call_checked calls name_unchecked if nothing has
+     * changed since, and name otherwise. name_batch runs a set of
+     * frames, checking the first, and running the rest in parallel
+     * with name_call_checked. */
+    void compile_check_once_header(const std::string &name, const std::vector<Argument> &args);
+
     static void test();
 
 protected:
@@ -57,6 +69,9 @@ protected:
     /** Emit a statement */
     void print_stmt(Stmt);
 
+    /** Emit the parameter list of a pipeline, without the parens. */
+    void print_arg_list(const std::vector<Argument> &args);
+
     /** Emit the C name for a halide type */
     virtual std::string print_type(Type);
 
@@ -75,8 +90,14 @@ protected:
     /** Close a C scope (i.e. throw in an end brace, decrease the indent) */
     void close_scope(const std::string &comment);
 
-    /** Unpack a buffer into its constituent parts */
-    void unpack_buffer(Type t, const std::string &buffer_name);
+    /** Unpack a buffer into its constituent parts. If the host
+     * pointer is known to be aligned, or not to alias any other
+     * buffer, tell the C compiler. */
+    void unpack_buffer(Type t, const std::string &buffer_name,
+                       int host_alignment = 0, bool no_alias = false);
+
+    /** The buffers declared not to alias any others. */
+    std::set<std::string> no_alias_buffers;
 
     /** Track the types of allocations to avoid unnecessary casts. */
     Scope<Type> allocations;
@@ -87,6 +108,31 @@ protected:
     /** True if there is a void * __user_context parameter in the arguments. */
     bool have_user_context;
 
+    /** The calls the current function makes if it returns early
+     * (see Call::cleanup_on_exit). */
+    std::vector<std::string> early_exit_cleanups;
+
+    /** A statement that makes those calls, most recent first, and
+     * then returns the given status. */
+    std::string early_return(const std::string &status);
+
+    /** A call to an extern function, as C, without evaluating it. */
+    std::string print_cleanup_call(Expr call);
+
+    /** True if vector types should be emitted using the gcc/clang
+     * vector_size attribute. Subclasses that print vectors in their
+     * own dialect (e.g. OpenCL C) turn this off. */
+    bool vector_extensions;
+
+    /** Emit a vector of the given type, one lane at a time, in a
+     * loop over the lanes (with index __i) that the C compiler can
+     * vectorize. Sets id to the vector, and returns it. */
+    std::string print_lanewise(Type t, const std::string &lane);
+
+    /** The expression for lane __i of an expression printed as id,
+     * for use in print_lanewise. Scalars are the same in every lane. */
+    std::string print_lane(Expr e, const std::string &id);
+
     using IRPrinter::visit;
 
     void visit(const Variable *);
@@ -112,6 +158,8 @@ protected:
     void visit(const Not *);
     void visit(const Call *);
     void visit(const Select *);
+    void visit(const Ramp *);
+    void visit(const Broadcast *);
     void visit(const Load *);
     void visit(const Store *);
     void visit(const Let *);
@@ -127,6 +175,10 @@ protected:
     void visit(const Evaluate *);
 
     void visit_binop(Type t, Expr a, Expr b, const char *op);
+
+    /** Emit a parallel for loop, by outlining its body into a task
+     * for halide_do_par_for. */
+    void print_parallel_for(const For *);
 };
 
 }
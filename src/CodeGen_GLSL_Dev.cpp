@@ -0,0 +1,415 @@
+#include <sstream>
+
+#include "CodeGen_GLSL_Dev.h"
+#include "CodeGen_Internal.h"
+#include "IROperator.h"
+#include "IRVisitor.h"
+#include "Debug.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::ostringstream;
+using std::string;
+using std::vector;
+
+CodeGen_GLSL_Dev::CodeGen_GLSL_Dev() {
+    glc = new CodeGen_GLSL(src_stream);
+}
+
+string CodeGen_GLSL_Dev::CodeGen_GLSL::print_type(Type type) {
+    assert(type.width == 1 && "OpenGL kernels can't be vectorized yet");
+    if (type.is_bool()) {
+        return "bool";
+    } else if (type.is_float()) {
+        assert(type.bits == 32 && "GLSL ES only has 32-bit floats");
+        return "float";
+    } else {
+        assert(type.bits == 32 && "OpenGL kernels only support 32-bit integers");
+        return type.is_uint() ? "uint" : "int";
+    }
+}
+
+string CodeGen_GLSL_Dev::CodeGen_GLSL::print_reinterpret(Type type, Expr e) {
+    Type from = e.type();
+    string value = print_expr(e);
+    if (from.is_float() && type.is_int()) {
+        return "floatBitsToInt(" + value + ")";
+    } else if (from.is_float() && type.is_uint()) {
+        return "floatBitsToUint(" + value + ")";
+    } else if (from.is_int() && type.is_float()) {
+        return "intBitsToFloat(" + value + ")";
+    } else if (from.is_uint() && type.is_float()) {
+        return "uintBitsToFloat(" + value + ")";
+    } else {
+        return print_type(type) + "(" + value + ")";
+    }
+}
+
+namespace {
+// The built-in variable a gpu loop var is, and its component.
+string simt_intrinsic(const string &name) {
+    if (ends_with(name, ".threadidx")) {
+        return "gl_LocalInvocationID.x";
+    } else if (ends_with(name, ".threadidy")) {
+        return "gl_LocalInvocationID.y";
+    } else if (ends_with(name, ".threadidz")) {
+        return "gl_LocalInvocationID.z";
+    } else if (ends_with(name, ".blockidx")) {
+        return "gl_WorkGroupID.x";
+    } else if (ends_with(name, ".blockidy")) {
+        return "gl_WorkGroupID.y";
+    } else if (ends_with(name, ".blockidz")) {
+        return "gl_WorkGroupID.z";
+    }
+    assert(false && "OpenGL kernels have at most three dimensions of blocks and threads");
+    return "";
+}
+
+// Find the extent of the thread loops of a kernel, which set the
+// size of its work groups.
+class WorkGroupSize : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const For *op) {
+        string name = base_name(op->name);
+        int dim = -1;
+        if (name == "threadidx") dim = 0;
+        else if (name == "threadidy") dim = 1;
+        else if (name == "threadidz") dim = 2;
+        if (dim >= 0) {
+            const int *extent = as_const_int(op->extent);
+            if (!extent) {
+                std::cerr << "The extent of " << op->name << " is " << op->extent
+                          << ", but the number of threads of an OpenGL kernel must be a constant\n";
+                assert(false);
+            }
+            size[dim] = *extent;
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    int size[3];
+    WorkGroupSize() {
+        size[0] = size[1] = size[2] = 1;
+    }
+};
+}
+
+void CodeGen_GLSL_Dev::CodeGen_GLSL::visit(const For *loop) {
+    if (is_gpu_var(loop->name)) {
+        debug(0) << "Dropping loop " << loop->name << " (" << loop->min << ", " << loop->extent << ")\n";
+        assert(loop->for_type == For::Parallel && "kernel loop must be parallel");
+
+        string id_idx = print_assignment(Int(32), "int(" + simt_intrinsic(loop->name) + ")");
+        string id_extent = print_expr(loop->extent);
+        string id_min = print_expr(loop->min);
+
+        do_indent();
+        stream << "if (" << id_idx << " < " << id_extent << ")\n";
+
+        open_scope();
+        do_indent();
+        stream << "int " << print_name(loop->name) << " = " << id_min << " + " << id_idx << ";\n";
+        bool old_in_thread_loop = in_thread_loop;
+        if (starts_with(base_name(loop->name), "threadid")) {
+            in_thread_loop = true;
+        }
+        loop->body.accept(this);
+        in_thread_loop = old_in_thread_loop;
+        close_scope("for " + print_name(loop->name));
+
+    } else {
+        assert(loop->for_type != For::Parallel && "Cannot emit parallel loops in GLSL");
+        CodeGen_C::visit(loop);
+    }
+}
+
+void CodeGen_GLSL_Dev::CodeGen_GLSL::visit(const FloatImm *op) {
+    // The bits, so that nothing is lost in conversion.
+    union {
+        uint32_t as_uint;
+        float as_float;
+    } u;
+    u.as_float = op->value;
+    ostringstream oss;
+    oss << "uintBitsToFloat(" << u.as_uint << "u /* " << u.as_float << " */)";
+    id = oss.str();
+}
+
+void CodeGen_GLSL_Dev::CodeGen_GLSL::visit(const Cast *op) {
+    print_assignment(op->type, print_type(op->type) + "(" + print_expr(op->value) + ")");
+}
+
+// The operands of / and % on signed integers mustn't be negative in
+// GLSL ES, so division and modulus by things other than powers of
+// two go through the helpers in the preamble, which round the way
+// Halide does.
+void CodeGen_GLSL_Dev::CodeGen_GLSL::visit(const Div *op) {
+    int bits;
+    if (op->type.is_int() && is_const_power_of_two(op->b, &bits)) {
+        ostringstream oss;
+        oss << print_expr(op->a) << " >> " << bits;
+        print_assignment(op->type, oss.str());
+    } else if (op->type.is_int()) {
+        print_expr(Call::make(op->type, "halide_sdiv", vec(op->a, op->b), Call::Extern));
+    } else {
+        visit_binop(op->type, op->a, op->b, "/");
+    }
+}
+
+void CodeGen_GLSL_Dev::CodeGen_GLSL::visit(const Mod *op) {
+    int bits;
+    if (op->type.is_int() && is_const_power_of_two(op->b, &bits)) {
+        ostringstream oss;
+        oss << print_expr(op->a) << " & " << ((1 << bits)-1);
+        print_assignment(op->type, oss.str());
+    } else if (op->type.is_int()) {
+        print_expr(Call::make(op->type, "halide_smod", vec(op->a, op->b), Call::Extern));
+    } else if (op->type.is_uint()) {
+        visit_binop(op->type, op->a, op->b, "%");
+    } else {
+        // The built-in mod of floats is a - b * floor(a / b), as in
+        // Halide.
+        print_expr(Call::make(op->type, "mod", vec(op->a, op->b), Call::Extern));
+    }
+}
+
+void CodeGen_GLSL_Dev::CodeGen_GLSL::visit(const Select *op) {
+    string true_val = print_expr(op->true_value);
+    string false_val = print_expr(op->false_value);
+    string cond = print_expr(op->condition);
+    print_assignment(op->type, "(" + cond + " ? " + true_val + " : " + false_val + ")");
+}
+
+string CodeGen_GLSL_Dev::CodeGen_GLSL::print_buffer_name(const string &name) {
+    return "_" + print_name(name);
+}
+
+string CodeGen_GLSL_Dev::CodeGen_GLSL::print_element(const string &name, Type t, const string &index) {
+    assert(allocations.contains(name) && allocations.get(name) == t &&
+           "OpenGL kernels must access buffers as the type they were declared with");
+    if (storage_buffers.count(name)) {
+        return print_buffer_name(name) + ".data[" + index + "]";
+    } else {
+        return print_buffer_name(name) + "[" + index + "]";
+    }
+}
+
+void CodeGen_GLSL_Dev::CodeGen_GLSL::visit(const Load *op) {
+    string rhs = print_element(op->name, op->type, print_expr(op->index));
+    if (op->predicate.defined()) {
+        // Only touch memory if the predicate holds
+        string id_predicate = print_expr(op->predicate);
+        rhs = "(" + id_predicate + " ? " + rhs + " : " + print_type(op->type) + "(0))";
+    }
+    print_assignment(op->type, rhs);
+}
+
+void CodeGen_GLSL_Dev::CodeGen_GLSL::visit(const Store *op) {
+    string id_index = print_expr(op->index);
+    string id_value = print_expr(op->value);
+    string id_predicate = op->predicate.defined() ? print_expr(op->predicate) : "";
+    do_indent();
+    if (op->predicate.defined()) {
+        stream << "if (" << id_predicate << ") ";
+    }
+    stream << print_element(op->name, op->value.type(), id_index) << " = " << id_value << ";\n";
+}
+
+void CodeGen_GLSL_Dev::CodeGen_GLSL::visit(const Call *op) {
+    if (op->call_type == Call::Intrinsic && op->name == Call::atomic_add) {
+        const Load *l = op->args[0].as<Load>();
+        assert(l && op->type.is_scalar() && !op->type.is_float() &&
+               "GLSL ES only has atomic adds of 32-bit integers");
+        string id_index = print_expr(l->index);
+        string id_value = print_expr(op->args[1]);
+        print_assignment(op->type, "atomicAdd(" + print_element(l->name, op->type, id_index) +
+                         ", " + id_value + ")");
+    } else if (op->call_type == Call::Intrinsic && op->name == Call::prefetch) {
+        // Prefetches are only a hint. Drop them.
+        print_assignment(op->type, print_type(op->type) + "(0)");
+    } else if (op->call_type == Call::Intrinsic && op->name == Call::abs) {
+        assert(op->args.size() == 1);
+        print_assignment(op->type, "abs(" + print_expr(op->args[0]) + ")");
+    } else if (op->call_type == Call::Intrinsic &&
+               (op->name == Call::gpu_shuffle_down ||
+                op->name == Call::gpu_vote_any ||
+                op->name == Call::gpu_vote_all ||
+                op->name == Call::gpu_ballot)) {
+        assert(false && "GLSL ES has no warp intrinsics");
+    } else {
+        CodeGen_C::visit(op);
+    }
+}
+
+void CodeGen_GLSL_Dev::CodeGen_GLSL::visit(const Allocate *op) {
+    // Memory shared by the threads of a block would have to be
+    // declared outside main.
+    if (!in_thread_loop) {
+        std::cerr << "Can't allocate " << op->name << " outside the gpu threads, "
+                  << "because OpenGL kernels have no shared memory yet\n";
+        assert(false);
+    }
+    int32_t size = 0;
+    bool is_constant = constant_allocation_size(op->extents, op->name, size);
+    assert(is_constant && "Only fixed-size allocations are supported in OpenGL kernels");
+
+    open_scope();
+    do_indent();
+    stream << print_type(op->type) << " " << print_buffer_name(op->name) << "[" << size << "];\n";
+    allocations.push(op->name, op->type);
+
+    op->body.accept(this);
+
+    // Should have been freed internally
+    assert(!allocations.contains(op->name));
+    close_scope("alloc " + print_buffer_name(op->name));
+}
+
+void CodeGen_GLSL_Dev::CodeGen_GLSL::visit(const AssertStmt *op) {
+    // A shader has no way to report errors.
+    debug(1) << "Dropping assertion in OpenGL kernel: " << op->message << "\n";
+}
+
+void CodeGen_GLSL_Dev::CodeGen_GLSL::visit(const Evaluate *op) {
+    // GLSL has no void casts. Anything with side effects is emitted
+    // by print_expr.
+    print_expr(op->value);
+}
+
+void CodeGen_GLSL_Dev::add_kernel(Stmt s, string name, const vector<Argument> &args) {
+    debug(0) << "hi CodeGen_GLSL_Dev::compile! " << name << "\n";
+
+    cur_kernel_name = name;
+    glc->add_kernel(s, name, args);
+}
+
+void CodeGen_GLSL_Dev::CodeGen_GLSL::add_kernel(Stmt s, string name, const vector<Argument> &args) {
+    cache.clear();
+    storage_buffers.clear();
+    in_thread_loop = false;
+
+    // The runtime splits the module into shaders at these markers,
+    // and binds the arguments by their kinds: b for buffers, which
+    // go in the storage buffer bindings in order, and i, u or f for
+    // the uniforms of other types, which are at consecutive
+    // locations.
+    string kinds;
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i].is_buffer) {
+            kinds += 'b';
+        } else if (args[i].type.is_float()) {
+            kinds += 'f';
+        } else if (args[i].type.is_uint()) {
+            kinds += 'u';
+        } else {
+            kinds += 'i';
+        }
+    }
+    stream << "/*kernel " << name << " " << kinds << "*/\n";
+
+    WorkGroupSize work_group;
+    s.accept(&work_group);
+    stream << "layout(local_size_x = " << work_group.size[0]
+           << ", local_size_y = " << work_group.size[1]
+           << ", local_size_z = " << work_group.size[2] << ") in;\n";
+
+    int binding = 0, location = 0;
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i].is_buffer) {
+            assert(args[i].type.bits == 32 &&
+                   "OpenGL kernels can only access buffers of 32-bit types");
+            stream << "layout(std430, binding = " << binding << ") "
+                   << (args[i].read_only ? "readonly " : "")
+                   << "buffer halide_buffer_" << binding << " { "
+                   << print_type(args[i].type) << " data[]; } "
+                   << print_buffer_name(args[i].name) << ";\n";
+            storage_buffers.insert(args[i].name);
+            allocations.push(args[i].name, args[i].type);
+            binding++;
+        } else {
+            stream << "layout(location = " << location << ") uniform "
+                   << print_type(args[i].type) << " "
+                   << print_name(args[i].name) << ";\n";
+            location++;
+        }
+    }
+
+    stream << "void main() {\n";
+
+    print(s);
+
+    stream << "}\n";
+
+    // Remove buffer arguments from allocation scope
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i].is_buffer) {
+            allocations.pop(args[i].name);
+        }
+    }
+}
+
+void CodeGen_GLSL_Dev::init_module() {
+    debug(0) << "OpenGL device codegen init_module\n";
+
+    // wipe the internal kernel source
+    src_stream.str("");
+    src_stream.clear();
+
+    // This identifies the module as GLSL. The runtime puts the
+    // #version line in front of each shader, and everything up to the
+    // first kernel is shared by all of them.
+    src_stream << "/*OpenGL ES compute*/\n";
+
+    // Write out the Halide math functions.
+    src_stream << "float nan_f32() { return uintBitsToFloat(0x7fc00000u); }\n"
+               << "float neg_inf_f32() { return uintBitsToFloat(0xff800000u); }\n"
+               << "float inf_f32() { return uintBitsToFloat(0x7f800000u); }\n"
+               << "int halide_smod(int a, int b) {\n"
+               << " int r = int(uint(abs(a)) % uint(abs(b)));\n"
+               << " return (a < 0 && r != 0) ? abs(b) - r : r;\n"
+               << "}\n"
+               << "int halide_sdiv(int a, int b) { return (a - halide_smod(a, b)) / b; }\n"
+               << "#define sqrt_f32 sqrt\n"
+               << "#define sin_f32 sin\n"
+               << "#define cos_f32 cos\n"
+               << "#define exp_f32 exp\n"
+               << "#define log_f32 log\n"
+               << "#define abs_f32 abs\n"
+               << "#define floor_f32 floor\n"
+               << "#define ceil_f32 ceil\n"
+               << "#define round_f32 round\n"
+               << "#define pow_f32 pow\n"
+               << "#define asin_f32 asin\n"
+               << "#define acos_f32 acos\n"
+               << "#define tan_f32 tan\n"
+               << "#define atan_f32 atan\n"
+               << "#define atan2_f32 atan\n"
+               << "#define sinh_f32 sinh\n"
+               << "#define asinh_f32 asinh\n"
+               << "#define cosh_f32 cosh\n"
+               << "#define acosh_f32 acosh\n"
+               << "#define tanh_f32 tanh\n"
+               << "#define atanh_f32 atanh\n";
+
+    cur_kernel_name = "";
+}
+
+vector<char> CodeGen_GLSL_Dev::compile_to_src() {
+    string str = src_stream.str();
+    vector<char> buffer(str.begin(), str.end());
+    buffer.push_back(0);
+    return buffer;
+}
+
+string CodeGen_GLSL_Dev::get_current_kernel_name() {
+    return cur_kernel_name;
+}
+
+void CodeGen_GLSL_Dev::dump() {
+    std::cerr << src_stream.str() << std::endl;
+}
+
+}}
@@ -0,0 +1,93 @@
+#ifndef HALIDE_CODEGEN_GLSL_DEV_H
+#define HALIDE_CODEGEN_GLSL_DEV_H
+
+/** \file
+ * Defines the code-generator for producing OpenGL ES compute shaders
+ */
+
+#include <sstream>
+#include <set>
+
+#include "CodeGen_C.h"
+#include "CodeGen_GPU_Dev.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Emits each kernel as a GLSL ES 3.1 compute shader. The gpu blocks
+ * are the work groups, and the gpu threads are the invocations of a
+ * work group, so the thread extents must be constants. Buffers are
+ * shader storage buffers of 32-bit scalars, and the other arguments
+ * are uniforms. */
+class CodeGen_GLSL_Dev : public CodeGen_GPU_Dev {
+public:
+    CodeGen_GLSL_Dev();
+
+    /** Compile a GPU kernel into the module. This may be called many times
+     * with different kernels, which will all be accumulated into a single
+     * source module shared by a given Halide pipeline. Each kernel becomes
+     * a shader of its own, which the runtime compiles separately. */
+    void add_kernel(Stmt stmt, std::string name, const std::vector<Argument> &args);
+
+    /** (Re)initialize the GPU kernel module. This is separate from compile,
+     * since a GPU device module will often have many kernels compiled into it
+     * for a single pipeline. */
+    void init_module();
+
+    std::vector<char> compile_to_src();
+
+    std::string get_current_kernel_name();
+
+    void dump();
+
+protected:
+
+    class CodeGen_GLSL : public CodeGen_C {
+    public:
+        CodeGen_GLSL(std::ostream &s) : CodeGen_C(s), in_thread_loop(false) {vector_extensions = false;}
+        void add_kernel(Stmt stmt, std::string name, const std::vector<Argument> &args);
+
+    protected:
+        using CodeGen_C::visit;
+        std::string print_type(Type type);
+        std::string print_reinterpret(Type type, Expr e);
+
+        void visit(const For *);
+        void visit(const FloatImm *);
+        void visit(const Cast *op);
+        void visit(const Div *op);
+        void visit(const Mod *op);
+        void visit(const Select *op);
+        void visit(const Load *op);
+        void visit(const Store *op);
+        void visit(const Call *op);
+        void visit(const Allocate *op);
+        void visit(const AssertStmt *op);
+        void visit(const Evaluate *op);
+
+        /** The name of a buffer or an allocation, prefixed so that
+         * it can't be a GLSL keyword like input or buffer. */
+        std::string print_buffer_name(const std::string &name);
+
+        /** The GLSL for an element of a buffer or an allocation. */
+        std::string print_element(const std::string &name, Type t, const std::string &index);
+
+        /** The buffer arguments of the current kernel. The rest of
+         * the allocations are arrays local to each invocation. */
+        std::set<std::string> storage_buffers;
+
+        /** Whether the statement being emitted runs once per gpu
+         * thread. */
+        bool in_thread_loop;
+    };
+
+    CodeGen_GLSL *glc;
+
+    std::ostringstream src_stream;
+
+    std::string cur_kernel_name;
+};
+
+}}
+
+#endif
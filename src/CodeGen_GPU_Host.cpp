@@ -1,8 +1,10 @@
 #include <sstream>
+#include <set>
 
 #include "CodeGen_GPU_Host.h"
 #include "CodeGen_PTX_Dev.h"
 #include "CodeGen_OpenCL_Dev.h"
+#include "CodeGen_GLSL_Dev.h"
 #include "CodeGen_SPIR_Dev.h"
 #include "IROperator.h"
 #include "IRPrinter.h"
@@ -57,6 +59,7 @@ void * cl_q = 0;
 using std::vector;
 using std::string;
 using std::map;
+using std::set;
 
 using namespace llvm;
 
@@ -243,6 +246,21 @@ private:
         IRVisitor::visit(op);
     }
 
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        // An atomic add writes to the buffer it loads from.
+        if (op->call_type == Call::Intrinsic && op->name == Call::atomic_add) {
+            const Load *load = op->args[0].as<Load>();
+            if (load && load->name == buf) {
+                if (in_device_code) {
+                    written_on_device = true;
+                } else {
+                    written_on_host = true;
+                }
+            }
+        }
+    }
+
     void visit(const LetStmt *op) {
         IRVisitor::visit(op);
         if (op->name == buf + ".buffer") {
@@ -252,6 +270,32 @@ private:
 };
 
 
+// Find the names of all the buffers a statement might touch.
+class BuffersTouched : public IRVisitor {
+public:
+    set<string> names;
+
+private:
+    using IRVisitor::visit;
+
+    void visit(const Load *op) {
+        names.insert(op->name);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Store *op) {
+        names.insert(op->name);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Variable *op) {
+        // Extern stages and runtime calls get passed the buffer_t.
+        if (ends_with(op->name, ".buffer")) {
+            names.insert(op->name.substr(0, op->name.size() - 7));
+        }
+    }
+};
+
 class GPU_Host_Closure : public Halide::Internal::Closure {
 public:
     static GPU_Host_Closure make(Stmt s, const std::string &lv, bool skip_gpu_loops=false) {
@@ -284,7 +328,9 @@ vector<Argument> GPU_Host_Closure::arguments() {
         if (iter->second.write) debug(2) << " (write)";
         debug(2) << "\n";
 
-        res.push_back(Argument(iter->first, true, iter->second.type));
+        Argument arg(iter->first, true, iter->second.type);
+        arg.read_only = iter->second.read && !iter->second.write;
+        res.push_back(arg);
     }
     return res;
 }
@@ -329,6 +375,9 @@ CodeGen_GPU_Dev* CodeGen_GPU_Host<CodeGen_CPU>::make_dev(Target t)
     } else if (t.features & Target::OpenCL) {
         debug(1) << "Constructing OpenCL device codegen\n";
         return new CodeGen_OpenCL_Dev();
+    } else if (t.features & Target::OpenGL) {
+        debug(1) << "Constructing OpenGL device codegen\n";
+        return new CodeGen_GLSL_Dev();
     } else {
         assert(false && "Requested unknown GPU target");
         return NULL;
@@ -347,12 +396,14 @@ void CodeGen_GPU_Host<CodeGen_CPU>::compile(Stmt stmt, string name,
 
     init_module();
 
+    residency.clear();
+
     // also set up the child codegenerator - this is set up once per
     // PTX_Host::compile, and reused across multiple PTX_Dev::compile
     // invocations for different kernels.
     cgdev->init_module();
 
-    module = get_initial_module_for_target(target, context);
+    module = get_initial_module_for_target(target, context, !stmt.defined());
 
     // grab runtime helper functions
     dev_malloc_fn = module->getFunction("halide_dev_malloc");
@@ -385,6 +436,12 @@ void CodeGen_GPU_Host<CodeGen_CPU>::compile(Stmt stmt, string name,
     // Pass to the generic codegen
     CodeGen::compile(stmt, name, args, images_to_embed);
 
+    if (!stmt.defined()) {
+        // Just the runtime, so there are no kernels.
+        CodeGen::optimize_module();
+        return;
+    }
+
     // Unset constant flag for embedded image global variables
     for (size_t i = 0; i < images_to_embed.size(); i++) {
         string name = images_to_embed[i].name();
@@ -407,6 +464,20 @@ void CodeGen_GPU_Host<CodeGen_CPU>::compile(Stmt stmt, string name,
                                         kernel_src_ptr, kernel_size);
     builder->CreateStore(state, get_module_state());
 
+    // Register the kernels with the runtime when the program starts,
+    // so that halide_gpu_warmup can build them before the first
+    // run. Only the CUDA and OpenCL runtimes can.
+    llvm::Function *register_fn = module->getFunction("halide_register_kernels");
+    if (register_fn) {
+        FunctionType *ctor_t = FunctionType::get(void_t, false);
+        llvm::Function *ctor = llvm::Function::Create(ctor_t, llvm::GlobalValue::InternalLinkage,
+                                                      name + ".register_kernels", module);
+        builder->SetInsertPoint(BasicBlock::Create(*context, "entry", ctor));
+        builder->CreateCall2(register_fn, kernel_src_ptr, kernel_size);
+        builder->CreateRetVoid();
+        llvm::appendToGlobalCtors(*module, ctor, 65535);
+    }
+
     // Optimize the module
     CodeGen::optimize_module();
 }
@@ -468,6 +539,19 @@ void CodeGen_GPU_Host<CodeGen_CPU>::jit_init(ExecutionEngine *ee, Module *module
             }
             assert(error.empty() && "Could not find libopencl.so, OpenCL.framework, or opencl.dll");
         }
+    } else if (target.features & Target::OpenGL) {
+        // The runtime makes its own context with EGL if the caller
+        // hasn't made one current.
+        if (have_symbol("glDispatchCompute")) {
+            debug(1) << "This program was linked to OpenGL ES already\n";
+        } else {
+            debug(1) << "Looking for OpenGL ES shared libraries...\n";
+            string error;
+            llvm::sys::DynamicLibrary::LoadLibraryPermanently("libEGL.so", &error);
+            assert(error.empty() && "Could not find libEGL.so");
+            llvm::sys::DynamicLibrary::LoadLibraryPermanently("libGLESv2.so", &error);
+            assert(error.empty() && "Could not find libGLESv2.so");
+        }
     }
 }
 
@@ -510,6 +594,15 @@ void CodeGen_GPU_Host<CodeGen_CPU>::jit_finalize(ExecutionEngine *ee, Module *mo
         void (*cleanup_routine)() =
             reinterpret_bits<void (*)()>(f);
         cleanup_routines->push_back(cleanup_routine);
+    } else if (target.features & Target::OpenGL) {
+        // When the module dies, we need to call halide_release
+        llvm::Function *fn = module->getFunction("halide_release");
+        assert(fn && "Could not find halide_release in module");
+        void *f = ee->getPointerToFunction(fn);
+        assert(f && "Could not find compiled form of halide_release in module");
+        void (*cleanup_routine)() =
+            reinterpret_bits<void (*)()>(f);
+        cleanup_routines->push_back(cleanup_routine);
     }
 }
 
@@ -580,19 +673,26 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const For *loop) {
 
         map<string, Closure::BufferRef>::iterator it;
         for (it = c.buffers.begin(); it != c.buffers.end(); ++it) {
-            // While internal buffers have all had their device
-            // allocations done via static analysis, external ones
-            // need to be dynamically checked
+            // Internal buffers have all had their device allocations
+            // done via static analysis, but external ones need to be
+            // dynamically checked
             Value *user_context = get_user_context();
             Value *buf = sym_get(it->first + ".buffer");
-            debug(4) << "halide_dev_malloc " << it->first << "\n";
-            builder->CreateCall2(dev_malloc_fn, user_context, buf);
+            if (!sym_exists(it->first + ".dev")) {
+                debug(4) << "halide_dev_malloc " << it->first << "\n";
+                builder->CreateCall2(dev_malloc_fn, user_context, buf);
+            }
 
             // Anything dirty on the cpu that gets read on the gpu
             // needs to be copied over
             if (it->second.read) {
-                debug(4) << "halide_copy_to_dev " << it->first << "\n";
-                builder->CreateCall2(copy_to_dev_fn, user_context, buf);
+                if (known_valid_on(it->first, ValidOnDevice)) {
+                    debug(4) << "skipping halide_copy_to_dev " << it->first << "\n";
+                } else {
+                    debug(4) << "halide_copy_to_dev " << it->first << "\n";
+                    builder->CreateCall2(copy_to_dev_fn, user_context, buf);
+                    add_residency(it->first, ValidOnDevice);
+                }
             }
         }
 
@@ -683,6 +783,8 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const For *loop) {
                 // so it's not dirty now.
                 builder->CreateStore(ConstantInt::get(i8, 0),
                                      buffer_host_dirty_ptr(buf));
+
+                set_residency(it->first, ValidOnDevice);
             }
         }
 
@@ -691,7 +793,46 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const For *loop) {
             sym_pop(shared_mem_allocations[i]);
         }
     } else {
+        // The body may run many times, or not at all, so what we
+        // know on the way in or out doesn't hold for the buffers it
+        // touches.
+        forget_residency(loop);
         CodeGen_CPU::visit(loop);
+        forget_residency(loop);
+    }
+}
+
+template<typename CodeGen_CPU>
+void CodeGen_GPU_Host<CodeGen_CPU>::visit(const IfThenElse *op) {
+    // Only one of the branches runs.
+    forget_residency(op);
+    CodeGen_CPU::visit(op);
+    forget_residency(op);
+}
+
+template<typename CodeGen_CPU>
+bool CodeGen_GPU_Host<CodeGen_CPU>::known_valid_on(const string &name, int where) {
+    map<string, int>::iterator iter = residency.find(name);
+    return iter != residency.end() && (iter->second & where);
+}
+
+template<typename CodeGen_CPU>
+void CodeGen_GPU_Host<CodeGen_CPU>::set_residency(const string &name, int where) {
+    residency[name] = where;
+}
+
+template<typename CodeGen_CPU>
+void CodeGen_GPU_Host<CodeGen_CPU>::add_residency(const string &name, int where) {
+    residency[name] |= where;
+}
+
+template<typename CodeGen_CPU>
+void CodeGen_GPU_Host<CodeGen_CPU>::forget_residency(Stmt s) {
+    BuffersTouched touched;
+    s.accept(&touched);
+    for (set<string>::iterator iter = touched.names.begin();
+         iter != touched.names.end(); ++iter) {
+        residency.erase(*iter);
     }
 }
 
@@ -780,10 +921,17 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const Allocate *alloc) {
         // Put the dev pointer in the symbol table. Mostly so we
         // remember to dev_free it.
         sym_push(alloc->name + ".dev", buffer_dev(buf));
+
+        // A fresh allocation holds nothing worth copying either way.
+        if (!usage.has_buffer_defined) {
+            set_residency(alloc->name, ValidOnHost | ValidOnDevice);
+        }
     }
 
     codegen(alloc->body);
 
+    residency.erase(alloc->name);
+
     if (usage.used_on_host) {
         destroy_allocation(host_allocation);
     }
@@ -795,16 +943,18 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const Allocate *alloc) {
 
 template<typename CodeGen_CPU>
 void CodeGen_GPU_Host<CodeGen_CPU>::visit(const Free *f) {
-    // Free any host allocation
-    if (sym_exists(f->name + ".host")) {
-        CodeGen_CPU::visit(f);
-    }
-
+    // Free any device allocation first, because in zero-copy mode it
+    // may be using the host allocation.
     if (sym_exists(f->name + ".dev")) {
         Value *args[2] = { get_user_context(),
                            sym_get(f->name + ".buffer") };
         builder->CreateCall(dev_free_fn, args);
     }
+
+    // Free any host allocation
+    if (sym_exists(f->name + ".host")) {
+        CodeGen_CPU::visit(f);
+    }
 }
 
 template<typename CodeGen_CPU>
@@ -844,10 +994,12 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const Pipeline *n) {
         return;
     }
 
+    vector<string> names;
     vector<WhereIsBufferUsed> produce_usage;
     for (size_t i = 0; i < bufs.size(); i++) {
         string name = n->name;
         if (bufs.size() > 1) name += "." + int_to_string(i);
+        names.push_back(name);
         WhereIsBufferUsed u(name);
         n->produce.accept(&u);
         produce_usage.push_back(u);
@@ -866,6 +1018,7 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const Pipeline *n) {
             // that's dirty on the GPU).
             builder->CreateStore(ConstantInt::get(i8, 0),
                                  buffer_dev_dirty_ptr(bufs[i]));
+            set_residency(names[i], ValidOnHost);
         }
     }
 
@@ -895,9 +1048,7 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const Pipeline *n) {
 
             vector<WhereIsBufferUsed> update_usage;
             for (size_t i = 0; i < bufs.size(); i++) {
-                string name = n->name;
-                if (bufs.size() > 1) name += "." + int_to_string(i);
-                WhereIsBufferUsed u(name);
+                WhereIsBufferUsed u(names[i]);
                 s.accept(&u);
                 update_usage.push_back(u);
             }
@@ -912,9 +1063,11 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const Pipeline *n) {
                 // theoretically be skipped if this update definition
                 // is pure, but we've lost that metadata at this stage
                 // of codegen.
-                if (update_usage[i].used_on_host) {
+                if (update_usage[i].used_on_host &&
+                    !known_valid_on(names[i], ValidOnHost)) {
                     // debug(0) << "Before update step " << j << " copy tuple element " << i << " to host\n";
                     builder->CreateCall2(copy_to_host_fn, user_context, bufs[i]);
+                    add_residency(names[i], ValidOnHost);
                 }
             }
 
@@ -925,6 +1078,7 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const Pipeline *n) {
                 if (update_usage[i].written_on_host) {
                     builder->CreateStore(ConstantInt::get(i8, 1),
                                          buffer_host_dirty_ptr(bufs[i]));
+                    set_residency(names[i], ValidOnHost);
                 }
             }
         }
@@ -936,17 +1090,17 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const Pipeline *n) {
 
     vector<WhereIsBufferUsed> consume_usage;
     for (size_t i = 0; i < bufs.size(); i++) {
-        string name = n->name;
-        if (bufs.size() > 1) name += "." + int_to_string(i);
-        WhereIsBufferUsed u(name);
+        WhereIsBufferUsed u(names[i]);
         n->consume.accept(&u);
         consume_usage.push_back(u);
     }
 
     for (size_t i = 0; i < bufs.size(); i++) {
-        if (consume_usage[i].read_on_host) {
+        if (consume_usage[i].read_on_host &&
+            !known_valid_on(names[i], ValidOnHost)) {
             // debug(0) << "Before consume step copy tuple element " << i << " to host\n";
             builder->CreateCall2(copy_to_host_fn, user_context, bufs[i]);
+            add_residency(names[i], ValidOnHost);
         }
     }
 
@@ -964,10 +1118,19 @@ void CodeGen_GPU_Host<CodeGen_CPU>::visit(const Call *call) {
         assert(func && "malformed debug to file node");
 
         Value *buf = sym_get(func->name + ".buffer", false);
-        if (buf) {
+        if (buf && !known_valid_on(func->name, ValidOnHost)) {
             // This buffer may have been last-touched on device
             Value *user_context = get_user_context();
             builder->CreateCall2(copy_to_host_fn, user_context, buf);
+            add_residency(func->name, ValidOnHost);
+        }
+    } else if (call->call_type == Call::Extern) {
+        // Extern stages can move their buffers wherever they like.
+        for (size_t i = 0; i < call->args.size(); i++) {
+            const Variable *v = call->args[i].as<Variable>();
+            if (v && ends_with(v->name, ".buffer")) {
+                residency.erase(v->name.substr(0, v->name.size() - 7));
+            }
         }
     }
 
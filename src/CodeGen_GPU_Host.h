@@ -75,12 +75,29 @@ protected:
     /** Nodes for which we need to override default behavior for the GPU runtime */
     // @{
     void visit(const For *);
+    void visit(const IfThenElse *);
     void visit(const Allocate *);
     void visit(const Free *);
     void visit(const Pipeline *);
     void visit(const Call *);
     // @}
 
+    /** What we know at compile time about which side holds an up to
+     * date copy of each buffer, at the point in the generated code
+     * we've reached. Buffers not in the map could be valid anywhere,
+     * and the runtime dirty bits sort them out. Used to leave out
+     * copies, and the dev_malloc checks, that can't do anything. */
+    // @{
+    enum {ValidOnHost = 1, ValidOnDevice = 2};
+    std::map<std::string, int> residency;
+    bool known_valid_on(const std::string &name, int where);
+    void set_residency(const std::string &name, int where);
+    void add_residency(const std::string &name, int where);
+    /** Forget what we know about the buffers a statement touches,
+     * because it's in a loop or a branch. */
+    void forget_residency(Stmt s);
+    // @}
+
     // We track buffer_t's for each allocation in order to manage dirty bits
     bool track_buffers() {return true;}
 
@@ -1,4 +1,8 @@
+#include <stdlib.h>
+#include <algorithm>
+
 #include "CodeGen_Internal.h"
+#include "IROperator.h"
 #include "Debug.h"
 
 namespace Halide {
@@ -34,6 +38,7 @@ void Closure::visit(const For *op) {
 
 void Closure::visit(const Load *op) {
     op->index.accept(this);
+    if (op->predicate.defined()) op->predicate.accept(this);
     if (!ignore.contains(op->name)) {
         debug(3) << "Adding " << op->name << " to closure\n";
         BufferRef & ref = buffers[op->name];
@@ -47,6 +52,7 @@ void Closure::visit(const Load *op) {
 void Closure::visit(const Store *op) {
     op->index.accept(this);
     op->value.accept(this);
+    if (op->predicate.defined()) op->predicate.accept(this);
     if (!ignore.contains(op->name)) {
         debug(3) << "Adding " << op->name << " to closure\n";
         BufferRef & ref = buffers[op->name];
@@ -57,6 +63,17 @@ void Closure::visit(const Store *op) {
     }
 }
 
+void Closure::visit(const Call *op) {
+    IRVisitor::visit(op);
+    // An atomic add writes to the buffer it loads from.
+    if (op->call_type == Call::Intrinsic && op->name == Call::atomic_add) {
+        const Load *load = op->args[0].as<Load>();
+        if (load && !ignore.contains(load->name)) {
+            buffers[load->name].write = true;
+        }
+    }
+}
+
 void Closure::visit(const Allocate *op) {
     ignore.push(op->name, 0);
     for (size_t i = 0; i < op->extents.size(); i++) {
@@ -159,6 +176,49 @@ void Closure::unpack_struct(Scope<Value *> &dst,
     }
 }
 
+bool Closure::passed_by_value(LLVMContext *context) {
+    vector<llvm::Type*> ty = llvm_types(context);
+    if (ty.size() != 1) return false;
+    return (ty[0]->isPointerTy() ||
+            (ty[0]->getPrimitiveSizeInBits() > 0 &&
+             ty[0]->getPrimitiveSizeInBits() <= 32));
+}
+
+Value *Closure::pack_value(const Scope<Value *> &src, IRBuilder<> *builder) {
+    LLVMContext &context = builder->getContext();
+    string name = names()[0];
+    llvm::Type *t = llvm_types(&context)[0];
+    llvm::Type *void_ptr = llvm::Type::getInt8PtrTy(context);
+    Value *val = src.get(name);
+    if (val->getType() != t) {
+        val = builder->CreateBitCast(val, t);
+    }
+    if (t->isPointerTy()) {
+        return builder->CreatePointerCast(val, void_ptr);
+    }
+    if (!t->isIntegerTy()) {
+        val = builder->CreateBitCast(val, llvm::IntegerType::get(context, t->getPrimitiveSizeInBits()));
+    }
+    return builder->CreateIntToPtr(val, void_ptr);
+}
+
+void Closure::unpack_value(Scope<Value *> &dst, Value *src, IRBuilder<> *builder) {
+    LLVMContext &context = builder->getContext();
+    string name = names()[0];
+    llvm::Type *t = llvm_types(&context)[0];
+    Value *val;
+    if (t->isPointerTy()) {
+        val = builder->CreatePointerCast(src, t);
+    } else {
+        val = builder->CreatePtrToInt(src, llvm::IntegerType::get(context, t->getPrimitiveSizeInBits()));
+        if (!t->isIntegerTy()) {
+            val = builder->CreateBitCast(val, t);
+        }
+    }
+    dst.push(name, val);
+    val->setName(name);
+}
+
 llvm::Type *llvm_type_of(LLVMContext *c, Halide::Type t) {
 
     if (t.width == 1) {
@@ -216,5 +276,89 @@ bool constant_allocation_size(const std::vector<Expr> &extents, const std::strin
     return true;
 }
 
+namespace {
+// Find a constant upper bound on a non-negative integer expression,
+// looking through the min, max, select, and arithmetic that bounds
+// inference wraps allocation extents in.
+bool constant_upper_bound(Expr e, const Scope<Expr> &scope, int64_t &result) {
+    const int64_t limit = (static_cast<int64_t>(1)<<31) - 1;
+    if (const IntImm *imm = e.as<IntImm>()) {
+        result = imm->value;
+        return true;
+    } else if (const Variable *var = e.as<Variable>()) {
+        return scope.contains(var->name) &&
+            constant_upper_bound(scope.get(var->name), scope, result);
+    } else if (const Cast *cast = e.as<Cast>()) {
+        return cast->type.is_int() && cast->type.bits >= 32 &&
+            constant_upper_bound(cast->value, scope, result);
+    } else if (const Min *min = e.as<Min>()) {
+        int64_t a, b;
+        bool bounded_a = constant_upper_bound(min->a, scope, a);
+        bool bounded_b = constant_upper_bound(min->b, scope, b);
+        if (bounded_a && bounded_b) {
+            result = std::min(a, b);
+        } else if (bounded_a) {
+            result = a;
+        } else if (bounded_b) {
+            result = b;
+        } else {
+            return false;
+        }
+        return true;
+    } else if (const Max *max = e.as<Max>()) {
+        int64_t a, b;
+        if (!constant_upper_bound(max->a, scope, a) || !constant_upper_bound(max->b, scope, b)) return false;
+        result = std::max(a, b);
+        return true;
+    } else if (const Select *select = e.as<Select>()) {
+        int64_t a, b;
+        if (!constant_upper_bound(select->true_value, scope, a) ||
+            !constant_upper_bound(select->false_value, scope, b)) return false;
+        result = std::max(a, b);
+        return true;
+    } else if (const Add *add = e.as<Add>()) {
+        int64_t a, b;
+        if (!constant_upper_bound(add->a, scope, a) || !constant_upper_bound(add->b, scope, b)) return false;
+        result = a + b;
+        return result <= limit;
+    } else if (const Mul *mul = e.as<Mul>()) {
+        // Only safe if both sides are non-negative, which we can only
+        // check for constants.
+        int64_t a, b;
+        const IntImm *ia = mul->a.as<IntImm>(), *ib = mul->b.as<IntImm>();
+        if (!(ia && ia->value >= 0) && !(ib && ib->value >= 0)) return false;
+        if (!constant_upper_bound(mul->a, scope, a) || !constant_upper_bound(mul->b, scope, b)) return false;
+        if (a < 0 || b < 0) return false;
+        result = a * b;
+        return result <= limit;
+    }
+    return false;
+}
+}
+
+bool constant_allocation_bound(const std::vector<Expr> &extents, const Scope<Expr> &scope, int64_t &bound) {
+    int64_t result = 1;
+    for (size_t i = 0; i < extents.size(); i++) {
+        int64_t extent;
+        if (!constant_upper_bound(extents[i], scope, extent)) return false;
+        // A negative extent would be a bug elsewhere. Treat it as empty.
+        if (extent < 0) extent = 0;
+        result *= extent;
+        if (result > (static_cast<int64_t>(1)<<31) - 1) return false;
+    }
+    bound = result;
+    return true;
+}
+
+int stack_allocation_limit() {
+    static int limit = -1;
+    if (limit < 0) {
+        char *limit_str = getenv("HL_STACK_ALLOCATION_LIMIT");
+        limit = limit_str ? atoi(limit_str) : 1024 * 8;
+        if (limit < 0) limit = 0;
+    }
+    return limit;
+}
+
 }
 }
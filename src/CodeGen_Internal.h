@@ -33,6 +33,7 @@ protected:
     void visit(const For *op);
     void visit(const Load *op);
     void visit(const Store *op);
+    void visit(const Call *op);
     void visit(const Allocate *op);
     void visit(const Variable *op);
 
@@ -95,6 +96,19 @@ public:
      * unpacking code. */
     void unpack_struct(Scope<llvm::Value *> &dst, llvm::Value *src, llvm::IRBuilder<> *builder);
 
+    /** Whether the closure holds a single scalar of at most 32 bits,
+     * or a single pointer, and so can be passed in place of a
+     * pointer to a struct. */
+    bool passed_by_value(llvm::LLVMContext *context);
+
+    /** Emit code that converts the single value such a closure holds
+     * to an i8 pointer. */
+    llvm::Value *pack_value(const Scope<llvm::Value *> &src, llvm::IRBuilder<> *builder);
+
+    /** Emit code that converts an i8 pointer made by pack_value back
+     * to the value, and pushes it into a symbol table. */
+    void unpack_value(Scope<llvm::Value *> &dst, llvm::Value *src, llvm::IRBuilder<> *builder);
+
 };
 
 /** Get the llvm type equivalent to a given halide type */
@@ -106,6 +120,18 @@ llvm::Type *llvm_type_of(llvm::LLVMContext *context, Halide::Type t);
  * assertion message. */
 bool constant_allocation_size(const std::vector<Expr> &extents, const std::string &name, int32_t &size);
 
+/** A routine to find a constant upper bound on the number of elements
+ * in an allocation whose extents are not all constant, e.g. because
+ * they are clamped with min. Variables are looked up in the given
+ * scope of let values. Returns false if there is no such bound less
+ * than 2^31. */
+bool constant_allocation_bound(const std::vector<Expr> &extents, const Scope<Expr> &scope, int64_t &bound);
+
+/** The largest allocation in bytes that cpu backends place on the
+ * stack instead of the heap. Defaults to 8 kilobytes, or the value of
+ * the environment variable HL_STACK_ALLOCATION_LIMIT. */
+int stack_allocation_limit();
+
 }}
 
 #endif
@@ -1,6 +1,8 @@
 #include <sstream>
 
 #include "CodeGen_OpenCL_Dev.h"
+#include "IROperator.h"
+#include "IRVisitor.h"
 #include "Debug.h"
 
 // TODO: This needs a runtime controlled switch based on the device extension
@@ -37,8 +39,10 @@ string CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::print_type(Type type) {
         if (type.is_uint() && type.bits > 1) oss << 'u';
         switch (type.bits) {
         case 1:
-            assert(type.width == 1 && "Vector of bool not valid in OpenCL C (yet)");
-            oss << "bool";
+            // Vectors of bools are kept as masks, which are -1 in
+            // the lanes that are true, like the results of vector
+            // comparisons.
+            oss << (type.width == 1 ? "bool" : "char");
             break;
         case 8:
             oss << "char";
@@ -149,7 +153,13 @@ void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const Ramp *op) {
 
 void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const Broadcast *op) {
     string id_value = print_expr(op->value);
-    
+
+    if (op->value.type().is_bool()) {
+        // Converting true to a vector gives ones, not a mask.
+        print_assignment(op->type, "-((" + print_type(op->type) + ")(" + id_value + "))");
+        return;
+    }
+
     print_assignment(op->type.vector_of(op->width), id_value);
 }
 
@@ -171,9 +181,61 @@ Expr is_ramp1(Expr e) {
 
     return Expr();
 }
+
+// If e is a ramp expression with stride -1, return the base, otherwise undefined.
+Expr is_reverse_ramp1(Expr e) {
+    const Ramp *r = e.as<Ramp>();
+    if (r == NULL) {
+        return Expr();
+    }
+
+    const IntImm *i = r->stride.as<IntImm>();
+    if (i != NULL && i->value == -1) {
+        return r->base;
+    }
+
+    return Expr();
+}
+
+// The swizzle that reverses a vector.
+string reverse_swizzle(int width) {
+    string s = ".s";
+    for (int i = width - 1; i >= 0; i--) {
+        s += vector_elements[i];
+    }
+    return s;
+}
+}
+
+string CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::print_lane_of(const string &vec, int lane) {
+    assert(lane >= 0 && lane < 16);
+    return vec + ".s" + vector_elements[lane];
+}
+
+string CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::print_const(const string &buffer) {
+    return read_only_buffers.count(buffer) ? "const " : "";
 }
 
 void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const Load *op) {
+    if (op->predicate.defined() && op->type.is_vector()) {
+        // Load each lane for which the predicate holds.
+        string id_index = print_expr(op->index);
+        string id_predicate = print_expr(op->predicate);
+        string id_load = unique_name('V');
+        do_indent();
+        stream << print_type(op->type) << " " << id_load << ";\n";
+        for (int i = 0; i < op->type.width; ++i) {
+            do_indent();
+            stream << "if (" << id_predicate << ".s" << vector_elements[i] << ") "
+                   << id_load << ".s" << vector_elements[i]
+                   << " = ((" << print_const(op->name) << "__global " << print_type(op->type.element_of()) << "*)"
+                   << print_name(op->name) << ")"
+                   << "[" << id_index << ".s" << vector_elements[i] << "];\n";
+        }
+        id = id_load;
+        return;
+    }
+
     // If we're loading a contiguous ramp into a vector, use vload instead.
     Expr ramp_base = is_ramp1(op->index);
     if (ramp_base.defined()) {
@@ -183,13 +245,37 @@ void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const Load *op) {
         ostringstream rhs;
         rhs << "vload" << op->type.width
             << "(0, "
-            << "(__global " << print_type(op->type.element_of()) << "*)" 
+            << "(" << print_const(op->name) << "__global " << print_type(op->type.element_of()) << "*)" 
             << print_name(op->name) << " + " << id_ramp_base << ")";
 
         print_assignment(op->type, rhs.str());
         return;
     }
 
+    // A ramp going backwards is a vload of the same elements,
+    // reversed.
+    ramp_base = is_reverse_ramp1(op->index);
+    if (ramp_base.defined()) {
+        string id_ramp_base = print_expr(ramp_base - (op->type.width - 1));
+
+        ostringstream rhs;
+        rhs << "vload" << op->type.width
+            << "(0, "
+            << "(" << print_const(op->name) << "__global " << print_type(op->type.element_of()) << "*)"
+            << print_name(op->name) << " + " << id_ramp_base << ")"
+            << reverse_swizzle(op->type.width);
+
+        print_assignment(op->type, rhs.str());
+        return;
+    }
+
+    // Every lane loading the same element is a scalar load.
+    if (const Broadcast *b = op->index.as<Broadcast>()) {
+        Expr scalar = Load::make(op->type.element_of(), op->name, b->value, op->image, op->param);
+        print_expr(Broadcast::make(scalar, b->width));
+        return;
+    }
+
     string id_index = print_expr(op->index);
 
     // Get the rhs just for the cache.
@@ -227,7 +313,7 @@ void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const Load *op) {
             stream
                 << id << ".s" << vector_elements[i]
                 << " = " 
-                << "((__global " << print_type(op->type.element_of()) << "*)" 
+                << "((" << print_const(op->name) << "__global " << print_type(op->type.element_of()) << "*)" 
                 << print_name(op->name) << ")"
                 << "[" << id_index << ".s" << vector_elements[i] << "];\n";
         }
@@ -240,6 +326,21 @@ void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const Store *op) {
     string id_value = print_expr(op->value);
     Type t = op->value.type();
 
+    if (op->predicate.defined() && t.is_vector()) {
+        // Store each lane for which the predicate holds.
+        string id_index = print_expr(op->index);
+        string id_predicate = print_expr(op->predicate);
+        for (int i = 0; i < t.width; ++i) {
+            do_indent();
+            stream << "if (" << id_predicate << ".s" << vector_elements[i] << ") "
+                   << "((__global " << print_type(t.element_of()) << " *)"
+                   << print_name(op->name) << ")"
+                   << "[" << id_index << ".s" << vector_elements[i] << "] = "
+                   << id_value << ".s" << vector_elements[i] << ";\n";
+        }
+        return;
+    }
+
     // If we're writing a contiguous ramp, use vstore instead.
     Expr ramp_base = is_ramp1(op->index);
     if (ramp_base.defined()) {
@@ -257,6 +358,21 @@ void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const Store *op) {
         return;
     }
 
+    ramp_base = is_reverse_ramp1(op->index);
+    if (ramp_base.defined()) {
+        string id_ramp_base = print_expr(ramp_base - (t.width - 1));
+
+        do_indent();
+        stream << "vstore" << t.width << "("
+               << id_value << reverse_swizzle(t.width) << ","
+               << 0 << ", "
+               << "(__global " << print_type(t.element_of()) << "*)"
+               << print_name(op->name) << " + " << id_ramp_base
+               << ");\n";
+
+        return;
+    }
+
     if (op->index.type().is_vector()) {
         // If index is a vector, scatter vector elements.
         assert(t.is_vector());
@@ -279,13 +395,206 @@ void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const Store *op) {
 }
 
 void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const Cast *op) {
-    if (op->type.is_vector()) {
+    if (op->type.is_vector() && op->value.type().is_bool()) {
+        // Masks are -1 where true.
+        print_assignment(op->type, "convert_" + print_type(op->type) + "(-" + print_expr(op->value) + ")");
+    } else if (op->type.is_vector() && op->type.is_bool()) {
+        print_assignment(op->type, "convert_" + print_type(op->type) + "(" + print_expr(op->value) + " != 0)");
+    } else if (op->type.is_vector()) {
         print_assignment(op->type, "convert_" + print_type(op->type) + "(" + print_expr(op->value) + ")");
     } else {
         CodeGen_C::visit(op);
     }
 }
 
+void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const Call *op) {
+    if (op->call_type == Call::Intrinsic && op->name == Call::atomic_add) {
+        const Load *l = op->args[0].as<Load>();
+        assert(l && op->type.is_scalar() && op->type.bits == 32 &&
+               "OpenCL only supports atomic adds of 32-bit scalars");
+        string id_index = print_expr(l->index);
+        string id_value = print_expr(op->args[1]);
+
+        // OpenCL has no atomic float add, see halide_atomic_add_f32 below.
+        ostringstream rhs;
+        rhs << (op->type.is_float() ? "halide_atomic_add_f32" : "atomic_add")
+            << "((volatile __global " << print_type(op->type) << " *)"
+            << print_name(l->name) << " + " << id_index
+            << ", " << id_value << ")";
+        print_assignment(op->type, rhs.str());
+    } else if (op->call_type == Call::Intrinsic && op->name == Call::prefetch) {
+        // Prefetches are only a hint. Drop them.
+        print_assignment(op->type, "0");
+    } else if (op->call_type == Call::Intrinsic && op->name == Call::gpu_shuffle_down) {
+        // From cl_khr_subgroup_shuffle_relative. The lanes are those
+        // of the sub-group.
+        assert(op->args.size() == 2 && op->type.is_scalar());
+        string value = print_expr(op->args[0]);
+        string delta = print_expr(op->args[1]);
+        print_assignment(op->type, "sub_group_shuffle_down(" + value + ", " + delta + ")");
+    } else if (op->call_type == Call::Intrinsic &&
+               (op->name == Call::gpu_vote_any || op->name == Call::gpu_vote_all)) {
+        // From cl_khr_subgroups.
+        assert(op->args.size() == 1);
+        string pred = print_expr(op->args[0]);
+        string fn = op->name == Call::gpu_vote_any ? "sub_group_any" : "sub_group_all";
+        print_assignment(op->type, "(" + fn + "((int)(" + pred + ")) != 0)");
+    } else if (op->call_type == Call::Intrinsic && op->name == Call::gpu_ballot) {
+        assert(false && "OpenCL C has no warp ballot");
+    } else if (op->call_type == Call::Intrinsic && op->name == Call::shuffle_vector) {
+        // A swizzle.
+        assert(op->args.size() >= 2);
+        string vec = print_expr(op->args[0]);
+        ostringstream rhs;
+        if (op->type.is_vector()) rhs << "(" << print_type(op->type) << ")(";
+        for (size_t i = 1; i < op->args.size(); i++) {
+            const int *lane = as_const_int(op->args[i]);
+            assert(lane && "The lanes of a shuffle_vector must be constants");
+            if (i > 1) rhs << ", ";
+            rhs << print_lane_of(vec, *lane);
+        }
+        if (op->type.is_vector()) rhs << ")";
+        print_assignment(op->type, rhs.str());
+    } else if (op->call_type == Call::Intrinsic && op->name == Call::interleave_vectors) {
+        int n = (int)op->args.size();
+        assert(n > 0);
+        vector<string> args(n);
+        for (int i = 0; i < n; i++) {
+            args[i] = print_expr(op->args[i]);
+        }
+        ostringstream rhs;
+        rhs << "(" << print_type(op->type) << ")(";
+        for (int i = 0; i < op->type.width; i++) {
+            if (i > 0) rhs << ", ";
+            if (op->args[i % n].type().is_vector()) {
+                rhs << print_lane_of(args[i % n], i / n);
+            } else {
+                rhs << args[i % n];
+            }
+        }
+        rhs << ")";
+        print_assignment(op->type, rhs.str());
+    } else if (op->call_type == Call::Intrinsic &&
+               (op->name == Call::vector_reduce_add ||
+                op->name == Call::vector_reduce_min ||
+                op->name == Call::vector_reduce_max)) {
+        assert(op->args.size() == 1 && "Vector reductions take one argument");
+        string arg = print_expr(op->args[0]);
+        int factor = op->args[0].type().width / op->type.width;
+        assert(factor * op->type.width == op->args[0].type().width &&
+               "The width of a vector reduction must divide the width of its argument");
+
+        // Lane i of the result combines the group of factor
+        // adjacent lanes starting at lane i * factor.
+        ostringstream rhs;
+        if (op->type.is_vector()) rhs << "(" << print_type(op->type) << ")(";
+        for (int i = 0; i < op->type.width; i++) {
+            string lane = print_lane_of(arg, i * factor);
+            for (int j = 1; j < factor; j++) {
+                string next = print_lane_of(arg, i * factor + j);
+                if (op->name == Call::vector_reduce_add) {
+                    lane = lane + " + " + next;
+                } else {
+                    lane = (op->name == Call::vector_reduce_min ? "min(" : "max(") + lane + ", " + next + ")";
+                }
+            }
+            if (i > 0) rhs << ", ";
+            rhs << "(" << lane << ")";
+        }
+        if (op->type.is_vector()) rhs << ")";
+        print_assignment(op->type, rhs.str());
+    } else {
+        CodeGen_C::visit(op);
+    }
+}
+
+void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const Select *op) {
+    if (!op->condition.type().is_vector()) {
+        CodeGen_C::visit(op);
+        return;
+    }
+    // select takes a mask with as many bits in each lane as the
+    // values.
+    string true_val = print_expr(op->true_value);
+    string false_val = print_expr(op->false_value);
+    string cond = print_expr(op->condition);
+    Type mask = Int(op->type.is_bool() ? 8 : op->type.bits, op->type.width);
+    print_assignment(op->type, "select(" + false_val + ", " + true_val + ", convert_" +
+                     print_type(mask) + "(" + cond + "))");
+}
+
+void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit_compare(Type t, Expr a, Expr b, const char *op) {
+    if (!t.is_vector()) {
+        visit_binop(t, a, b, op);
+        return;
+    }
+    string sa = print_expr(a);
+    string sb = print_expr(b);
+    print_assignment(t, "convert_" + print_type(t) + "(" + sa + " " + op + " " + sb + ")");
+}
+
+void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const EQ *op) {
+    visit_compare(op->type, op->a, op->b, "==");
+}
+
+void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const NE *op) {
+    visit_compare(op->type, op->a, op->b, "!=");
+}
+
+void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const LT *op) {
+    visit_compare(op->type, op->a, op->b, "<");
+}
+
+void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const LE *op) {
+    visit_compare(op->type, op->a, op->b, "<=");
+}
+
+void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const GT *op) {
+    visit_compare(op->type, op->a, op->b, ">");
+}
+
+void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const GE *op) {
+    visit_compare(op->type, op->a, op->b, ">=");
+}
+
+// Masks combine bitwise.
+void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const And *op) {
+    visit_binop(op->type, op->a, op->b, op->type.is_vector() ? "&" : "&&");
+}
+
+void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const Or *op) {
+    visit_binop(op->type, op->a, op->b, op->type.is_vector() ? "|" : "||");
+}
+
+void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::visit(const Not *op) {
+    if (op->type.is_vector()) {
+        print_assignment(op->type, "~" + print_expr(op->a));
+    } else {
+        CodeGen_C::visit(op);
+    }
+}
+
+namespace {
+// Find calls to the sub-group intrinsics, which need extensions.
+class UsesSubgroups : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        if (op->call_type == Call::Intrinsic) {
+            if (op->name == Call::gpu_shuffle_down) {
+                shuffles = true;
+            } else if (op->name == Call::gpu_vote_any || op->name == Call::gpu_vote_all) {
+                votes = true;
+            }
+        }
+        IRVisitor::visit(op);
+    }
+public:
+    bool shuffles, votes;
+    UsesSubgroups() : shuffles(false), votes(false) {}
+};
+}
+
 void CodeGen_OpenCL_Dev::add_kernel(Stmt s, string name, const vector<Argument> &args) {
     debug(0) << "hi CodeGen_OpenCL_Dev::compile! " << name << "\n";
 
@@ -300,16 +609,33 @@ const string kernel_preamble = "";
 
 void CodeGen_OpenCL_Dev::CodeGen_OpenCL_C::add_kernel(Stmt s, string name, const vector<Argument> &args) {
     cache.clear();
+    read_only_buffers.clear();
 
     debug(0) << "hi! " << name << "\n";
 
     stream << kernel_preamble;
 
+    UsesSubgroups subgroups;
+    s.accept(&subgroups);
+    if (subgroups.votes || subgroups.shuffles) {
+        stream << "#pragma OPENCL EXTENSION cl_khr_subgroups : enable\n";
+    }
+    if (subgroups.shuffles) {
+        stream << "#pragma OPENCL EXTENSION cl_khr_subgroup_shuffle_relative : enable\n";
+    }
+
     // Emit the function prototype
     stream << "__kernel void " << name << "(\n";
     for (size_t i = 0; i < args.size(); i++) {
         if (args[i].is_buffer) {
-            stream << " __global " << print_type(args[i].type) << " *"
+            // Inputs the kernel doesn't write to are declared const
+            // restrict, which lets the compiler load them through
+            // the read-only or texture cache.
+            if (args[i].read_only) {
+                read_only_buffers.insert(args[i].name);
+            }
+            stream << " " << print_const(args[i].name) << "__global "
+                   << print_type(args[i].type) << " *restrict "
                    << print_name(args[i].name);
             allocations.push(args[i].name, args[i].type);
         } else {
@@ -349,6 +675,9 @@ void CodeGen_OpenCL_Dev::init_module() {
 
 #ifdef ENABLE_CL_KHR_FP64
     src_stream << "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n";
+#endif
+#ifdef ENABLE_CL_KHR_FP16
+    src_stream << "#pragma OPENCL EXTENSION cl_khr_fp16 : enable\n";
 #endif
     src_stream << "#pragma OPENCL FP_CONTRACT ON\n";
         
@@ -377,7 +706,14 @@ void CodeGen_OpenCL_Dev::init_module() {
                << "#define cosh_f32 cosh \n"
                << "#define acosh_f32 acosh \n"
                << "#define tanh_f32 tanh \n"
-               << "#define atanh_f32 atanh \n";
+               << "#define atanh_f32 atanh \n"
+               << "float halide_atomic_add_f32(volatile __global float *p, float v) {\n"
+               << " float old;\n"
+               << " do {\n"
+               << "  old = *p;\n"
+               << " } while (atomic_cmpxchg((volatile __global unsigned int *)p, as_uint(old), as_uint(old + v)) != as_uint(old));\n"
+               << " return old;\n"
+               << "}\n";
 
 #ifdef ENABLE_CL_KHR_FP64
     src_stream << "#define sqrt_f64 sqrt\n"
@@ -6,6 +6,7 @@
  */
 
 #include <sstream>
+#include <set>
 
 #include "CodeGen_C.h"
 #include "CodeGen_GPU_Dev.h"
@@ -37,7 +38,7 @@ protected:
 
     class CodeGen_OpenCL_C : public CodeGen_C {
     public:
-        CodeGen_OpenCL_C(std::ostream &s) : CodeGen_C(s) {}
+        CodeGen_OpenCL_C(std::ostream &s) : CodeGen_C(s) {vector_extensions = false;}
         void add_kernel(Stmt stmt, std::string name, const std::vector<Argument> &args);
 
     protected:
@@ -51,6 +52,33 @@ protected:
         void visit(const Load *op);
         void visit(const Store *op);
         void visit(const Cast *op);
+        void visit(const Call *op);
+        void visit(const Select *op);
+        void visit(const EQ *op);
+        void visit(const NE *op);
+        void visit(const LT *op);
+        void visit(const LE *op);
+        void visit(const GT *op);
+        void visit(const GE *op);
+        void visit(const And *op);
+        void visit(const Or *op);
+        void visit(const Not *op);
+
+        /** Vector comparisons give masks of the width of their
+         * arguments. Convert them to the vectors of chars that
+         * vectors of bools are kept in. */
+        void visit_compare(Type t, Expr a, Expr b, const char *op);
+
+        /** Get the OpenCL C for one lane of a vector */
+        std::string print_lane_of(const std::string &vec, int lane);
+
+        /** The qualifier to cast pointers into a buffer with: const
+         * if the kernel only reads it. */
+        std::string print_const(const std::string &buffer);
+
+        /** The buffer arguments of the current kernel that it never
+         * writes to. */
+        std::set<std::string> read_only_buffers;
     };
 
     CodeGen_OpenCL_C *clc;
@@ -1,5 +1,7 @@
 #include "CodeGen_PNaCl.h"
 #include "Util.h"
+#include "IRVisitor.h"
+#include "Debug.h"
 #include "LLVM_Headers.h"
 
 namespace Halide {
@@ -10,6 +12,28 @@ using std::string;
 
 using namespace llvm;
 
+namespace {
+// The PNaCl translator only maps 128-bit vectors onto SSE or NEON
+// registers. Find the widest vector in a stmt, so we can warn about
+// schedules that vectorize wider than that.
+class WidestVector : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Ramp *op) {
+        bits = std::max(bits, op->type.bits * op->type.width);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Broadcast *op) {
+        bits = std::max(bits, op->type.bits * op->type.width);
+        IRVisitor::visit(op);
+    }
+public:
+    int bits;
+    WidestVector() : bits(0) {}
+};
+}
+
 CodeGen_PNaCl::CodeGen_PNaCl(Target t) : CodeGen_Posix(t) {
 
     #if !(WITH_NATIVE_CLIENT)
@@ -24,11 +48,22 @@ void CodeGen_PNaCl::compile(Stmt stmt, string name,
                           const vector<Buffer> &images_to_embed) {
     #if (WITH_NATIVE_CLIENT)
 
-    // TODO: Remove or handle vectorized code in the stmt
+    // Vectors are emitted as portable llvm vector types, which the
+    // translator lowers to the native simd unit. Ones wider than 128
+    // bits are outside the portable simd subset.
+    WidestVector widest;
+    if (stmt.defined()) {
+        stmt.accept(&widest);
+    }
+    if (widest.bits > 128) {
+        std::cerr << "Warning: " << name << " uses " << widest.bits
+                  << "-bit vectors, but PNaCl only supports 128-bit ones. "
+                  << "Use Target::natural_vector_size to pick the vector width.\n";
+    }
 
     init_module();
 
-    module = get_initial_module_for_target(target, context);
+    module = get_initial_module_for_target(target, context, !stmt.defined());
 
     // PNaCl expects the triple le32-unknown-nacl
     llvm::Triple triple;
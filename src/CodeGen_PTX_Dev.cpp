@@ -46,10 +46,15 @@ void CodeGen_PTX_Dev::add_kernel(Stmt stmt, std::string name, const std::vector<
     FunctionType *func_t = FunctionType::get(void_t, arg_types, false);
     function = llvm::Function::Create(func_t, llvm::Function::ExternalLinkage, name, module);
 
-    // Mark the buffer args as no alias
+    // Mark the buffer args as no alias, and the ones the kernel
+    // doesn't write to as read only, so that the backend can load
+    // them through the read-only data cache where there is one.
     for (size_t i = 0; i < args.size(); i++) {
         if (args[i].is_buffer) {
             function->setDoesNotAlias(i+1);
+            if (args[i].read_only) {
+                function->setOnlyReadsMemory(i+1);
+            }
         }
     }
 
@@ -244,11 +249,54 @@ void CodeGen_PTX_Dev::visit(const Free *f) {
     sym_pop(f->name + ".host");
 }
 
+void CodeGen_PTX_Dev::visit(const Call *op) {
+    if (op->call_type != Call::Intrinsic) {
+        CodeGen::visit(op);
+    } else if (op->name == Call::gpu_shuffle_down) {
+        assert(op->args.size() == 2 && op->type.is_scalar() && op->type.bits == 32 &&
+               "gpu_shuffle_down takes a 32-bit scalar and a number of lanes");
+        assert((target.features & Target::CUDACapability30) &&
+               "Warp shuffles need the cuda_capability_30 target feature");
+        // Lanes past the end of the warp get their own value.
+        llvm::FunctionType *fn_t = llvm::FunctionType::get(i32, vec<llvm::Type *>(i32, i32), false);
+        InlineAsm *shfl = InlineAsm::get(fn_t, "shfl.down.b32 $0, $1, $2, 0x1f;", "=r,r,r", true);
+        Value *val = builder->CreateBitCast(codegen(op->args[0]), i32);
+        value = builder->CreateCall2(shfl, val, codegen(op->args[1]));
+        value = builder->CreateBitCast(value, llvm_type_of(op->type));
+    } else if (op->name == Call::gpu_vote_any ||
+               op->name == Call::gpu_vote_all ||
+               op->name == Call::gpu_ballot) {
+        assert(op->args.size() == 1 && op->args[0].type() == Bool() &&
+               "Warp votes take a boolean");
+        string vote;
+        if (op->name == Call::gpu_ballot) {
+            vote = "vote.ballot.b32 $0, %p1;";
+        } else {
+            vote = (op->name == Call::gpu_vote_any ?
+                    "vote.any.pred %p2, %p1;" : "vote.all.pred %p2, %p1;");
+            vote += " selp.u32 $0, 1, 0, %p2;";
+        }
+        string code = "{ .reg .pred %p1, %p2; setp.ne.u32 %p1, $1, 0; " + vote + " }";
+        llvm::FunctionType *fn_t = llvm::FunctionType::get(i32, vec<llvm::Type *>(i32), false);
+        InlineAsm *asm_fn = InlineAsm::get(fn_t, code, "=r,r", true);
+        Value *pred = builder->CreateZExt(codegen(op->args[0]), i32);
+        value = builder->CreateCall(asm_fn, pred);
+        if (op->type.is_bool()) {
+            value = builder->CreateICmpNE(value, ConstantInt::get(i32, 0));
+        }
+    } else {
+        CodeGen::visit(op);
+    }
+}
+
 string CodeGen_PTX_Dev::march() const {
     return "nvptx64";
 }
 
 string CodeGen_PTX_Dev::mcpu() const {
+    if (target.features & Target::CUDACapability30) {
+        return "sm_30";
+    }
     return "sm_20";
 }
 
@@ -260,6 +308,11 @@ bool CodeGen_PTX_Dev::use_soft_float_abi() const {
     return false;
 }
 
+bool CodeGen_PTX_Dev::use_native_float16_conversions() const {
+    // Every ptx target has cvt.f32.f16 and cvt.rn.f16.f32.
+    return true;
+}
+
 vector<char> CodeGen_PTX_Dev::compile_to_src() {
 
     #if WITH_PTX
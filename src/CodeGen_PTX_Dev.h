@@ -52,12 +52,14 @@ protected:
     void visit(const Allocate *);
     void visit(const Free *);
     void visit(const Pipeline *);
+    void visit(const Call *);
     // @}
 
     std::string march() const;
     std::string mcpu() const;
     std::string mattrs() const;
     bool use_soft_float_abi() const;
+    bool use_native_float16_conversions() const;
 
     /** Map from simt variable names (e.g. foo.blockidx) to the llvm
      * ptx intrinsic functions to call to get them. */
@@ -69,6 +69,18 @@ CodeGen_Posix::CodeGen_Posix(Target t) :
     wild_u32x8(Variable::make(UInt(32, 8), "*")),
     wild_u64x4(Variable::make(UInt(64, 4), "*")),
 
+    wild_i16x32(Variable::make(Int(16, 32), "*")),
+    wild_i32x16(Variable::make(Int(32, 16), "*")),
+
+    wild_u16x32(Variable::make(UInt(16, 32), "*")),
+    wild_u32x16(Variable::make(UInt(32, 16), "*")),
+
+    wild_i16x64(Variable::make(Int(16, 64), "*")),
+    wild_i32x32(Variable::make(Int(32, 32), "*")),
+
+    wild_u16x64(Variable::make(UInt(16, 64), "*")),
+    wild_u32x32(Variable::make(UInt(32, 32), "*")),
+
     wild_f32x2(Variable::make(Float(32, 2), "*")),
 
     wild_f32x4(Variable::make(Float(32, 4), "*")),
@@ -77,6 +89,9 @@ CodeGen_Posix::CodeGen_Posix(Target t) :
     wild_f32x8(Variable::make(Float(32, 8), "*")),
     wild_f64x4(Variable::make(Float(64, 4), "*")),
 
+    wild_f32x16(Variable::make(Float(32, 16), "*")),
+    wild_f64x8(Variable::make(Float(64, 8), "*")),
+
     // Bounds of types
     min_i8(Int(8).min()),
     max_i8(Int(8).max()),
@@ -152,22 +167,31 @@ Value *CodeGen_Posix::codegen_allocation_size(const std::string &name, Type type
 CodeGen_Posix::Allocation CodeGen_Posix::create_allocation(const std::string &name, Type type, const std::vector<Expr> &extents) {
 
     Allocation allocation;
+    allocation.profiled_size = NULL;
     Value *llvm_size = NULL;
 
     int32_t constant_size;
+    int64_t size_bound;
     if (constant_allocation_size(extents, name, constant_size)) {
         int64_t stack_bytes = constant_size * type.bytes();
 
         if (stack_bytes > ((int64_t(1) << 31) - 1)) {
             std::cerr << "Total size for allocation " << name << " is constant but exceeds 2^31 - 1.";
             assert(false);
-        } else if (stack_bytes <= 1024 * 8) {
+        } else if (stack_bytes <= stack_allocation_limit()) {
             // Round up to nearest multiple of 32.
             allocation.stack_size = static_cast<int32_t>(((stack_bytes + 31)/32)*32);
         } else {
             allocation.stack_size = 0;
             llvm_size = codegen(Expr(static_cast<int32_t>(stack_bytes)));
         }
+    } else if (constant_allocation_bound(extents, let_values, size_bound) &&
+               size_bound * type.bytes() <= stack_allocation_limit()) {
+        // The size varies, but never exceeds a small constant, so
+        // reserve that much stack space.
+        debug(3) << "Allocation " << name << " is bounded by " << size_bound << " elements\n";
+        int64_t stack_bytes = size_bound * type.bytes();
+        allocation.stack_size = static_cast<int32_t>(((stack_bytes + 31)/32)*32);
     } else {
         allocation.stack_size = 0;
         llvm_size = codegen_allocation_size(name, type, extents);
@@ -181,14 +205,30 @@ CodeGen_Posix::Allocation CodeGen_Posix::create_allocation(const std::string &na
         // stack pointer, but this makes llvm generate streams of
         // spill/reloads.
         Value *ptr = create_alloca_at_entry(i32x8, allocation.stack_size/32, name);
+        // Match the alignment of halide_malloc, regardless of what the
+        // target thinks a vector of eight ints needs.
+        if (AllocaInst *alloca_inst = dyn_cast<AllocaInst>(ptr)) {
+            if (alloca_inst->getAlignment() < 32) {
+                alloca_inst->setAlignment(32);
+            }
+        }
         allocation.ptr = builder->CreatePointerCast(ptr, llvm_type->getPointerTo());
 
+        if (sym_exists("profiler_state")) {
+            profile_allocation("halide_profiler_memory_allocate", name,
+                               ConstantInt::get(i32, allocation.stack_size), true);
+        }
     } else {
         // call malloc
         llvm::Function *malloc_fn = module->getFunction("halide_malloc");
         malloc_fn->setDoesNotAlias(0);
         assert(malloc_fn && "Could not find halide_malloc in module");
 
+        if (sym_exists("profiler_state")) {
+            profile_allocation("halide_profiler_memory_allocate", name, llvm_size, false);
+            allocation.profiled_size = llvm_size;
+        }
+
         llvm::Function::arg_iterator arg_iter = malloc_fn->arg_begin();
         ++arg_iter;  // skip the user context *
         llvm_size = builder->CreateIntCast(llvm_size, arg_iter->getType(), false);
@@ -202,6 +242,16 @@ CodeGen_Posix::Allocation CodeGen_Posix::create_allocation(const std::string &na
         // Assert that the allocation worked.
         create_assertion(builder->CreateIsNotNull(allocation.ptr),
                          "Out of memory (malloc returned NULL)");
+
+        if (target.features & Target::HugePages) {
+            // Ask for huge pages before anything touches the memory.
+            llvm::Function *advise_fn = module->getFunction("halide_advise_huge_pages");
+            assert(advise_fn && "Could not find halide_advise_huge_pages in module");
+            Value *advise_args[3] = { get_user_context(),
+                                      builder->CreatePointerCast(allocation.ptr, i8->getPointerTo()),
+                                      builder->CreateIntCast(llvm_size, i32, false) };
+            builder->CreateCall(advise_fn, advise_args);
+        }
     }
 
     // Push the allocation base pointer onto the symbol table
@@ -230,11 +280,28 @@ void CodeGen_Posix::free_allocation(const std::string &name) {
         debug(4) << "Creating call to halide_free\n";
         Value *args[2] = { get_user_context(), alloc.ptr };
         builder->CreateCall(free_fn, args);
+
+        if (alloc.profiled_size) {
+            profile_allocation("halide_profiler_memory_free", name, alloc.profiled_size, false);
+        }
     }
 
     allocations.pop(name);
 }
 
+void CodeGen_Posix::profile_allocation(const std::string &fn, const std::string &name,
+                                       Value *bytes, bool on_stack) {
+    // The size has no Expr of its own, so give it a name.
+    string bytes_name = name + ".profiled_bytes";
+    sym_push(bytes_name, bytes);
+    Expr state = Variable::make(Handle(), "profiler_state");
+    Expr call = Call::make(Int(32), fn,
+                           vec<Expr>(state, name, Variable::make(Int(32), bytes_name), (int)on_stack),
+                           Call::Extern);
+    codegen(call);
+    sym_pop(bytes_name);
+}
+
 void CodeGen_Posix::destroy_allocation(Allocation alloc) {
     // Heap allocations have already been freed.
 }
@@ -260,6 +327,18 @@ void CodeGen_Posix::visit(const Allocate *alloc) {
     destroy_allocation(allocation);
 }
 
+void CodeGen_Posix::visit(const Let *op) {
+    let_values.push(op->name, op->value);
+    CodeGen::visit(op);
+    let_values.pop(op->name);
+}
+
+void CodeGen_Posix::visit(const LetStmt *op) {
+    let_values.push(op->name, op->value);
+    CodeGen::visit(op);
+    let_values.pop(op->name);
+}
+
 void CodeGen_Posix::visit(const Free *stmt) {
     free_allocation(stmt->name);
     sym_pop(stmt->name + ".host");
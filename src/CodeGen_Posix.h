@@ -39,9 +39,14 @@ protected:
     Expr wild_u8x16, wild_u16x8, wild_u32x4, wild_u64x2; // 128-bit unsigned ints
     Expr wild_i8x32, wild_i16x16, wild_i32x8, wild_i64x4; // 256-bit signed ints
     Expr wild_u8x32, wild_u16x16, wild_u32x8, wild_u64x4; // 256-bit unsigned ints
+    Expr wild_i16x32, wild_i32x16; // 512-bit signed ints
+    Expr wild_u16x32, wild_u32x16; // 512-bit unsigned ints
+    Expr wild_i16x64, wild_i32x32; // 1024-bit signed ints
+    Expr wild_u16x64, wild_u32x32; // 1024-bit unsigned ints
     Expr wild_f32x2; // 64-bit floats
     Expr wild_f32x4, wild_f64x2; // 128-bit floats
     Expr wild_f32x8, wild_f64x4; // 256-bit floats
+    Expr wild_f32x16, wild_f64x8; // 512-bit floats
     Expr min_i8, max_i8, max_u8;
     Expr min_i16, max_i16, max_u16;
     Expr min_i32, max_i32, max_u32;
@@ -51,14 +56,23 @@ protected:
 
     using CodeGen::visit;
 
-    /** Posix implementation of Allocate. Small constant-sized allocations go
-     * on the stack. The rest go on the heap by calling "halide_malloc"
-     * and "halide_free" in the standard library. */
+    /** Posix implementation of Allocate. Allocations whose size is bounded
+     * by a small constant (see stack_allocation_limit) go on the stack,
+     * allocated once at function entry rather than inside any loops. The
+     * rest go on the heap by calling "halide_malloc" and "halide_free" in
+     * the standard library. */
     // @{
     void visit(const Allocate *);
     void visit(const Free *);
     // @}
 
+    /** Track the values of lets, so that allocations whose size is
+     * bounded by a constant can be placed on the stack. */
+    // @{
+    void visit(const Let *);
+    void visit(const LetStmt *);
+    // @}
+
     /** A struct describing heap or stack allocations. */
     struct Allocation {
         llvm::Value *ptr;
@@ -66,12 +80,24 @@ protected:
         /** How many bytes of stack space used. 0 implies it was a
          * heap allocation. */
         int stack_size;
+
+        /** The size in bytes of a heap allocation, as an int32, if
+         * it is being reported to the profiler. */
+        llvm::Value *profiled_size;
     };
 
     /** The allocations currently in scope. The stack gets pushed when
      * we enter a new function. */
     Scope<Allocation> allocations;
 
+    /** The values of the lets currently in scope. */
+    Scope<Expr> let_values;
+
+    /** Tell the runtime's profiler about an allocation or free of
+     * some bytes of a buffer, if the pipeline is being profiled. */
+    void profile_allocation(const std::string &fn, const std::string &name,
+                            llvm::Value *bytes, bool on_stack);
+
     /** Generates code for computing the size of an allocation from a
      * list of its extents and its size. Fires a runtime assert
      * (halide_error) if the size overflows 2^31 -1, the maximum
@@ -46,10 +46,14 @@ void CodeGen_SPIR_Dev::add_kernel(Stmt stmt, std::string name, const std::vector
     function = llvm::Function::Create(func_t, llvm::Function::ExternalLinkage, name, module);
     function->setCallingConv(llvm::CallingConv::SPIR_KERNEL);
 
-    // Mark the buffer args as no alias
+    // Mark the buffer args as no alias, and the ones the kernel
+    // doesn't write to as read only.
     for (size_t i = 0; i < args.size(); i++) {
         if (args[i].is_buffer) {
             function->setDoesNotAlias(i+1);
+            if (args[i].read_only) {
+                function->setOnlyReadsMemory(i+1);
+            }
         }
     }
     // Mark the local memory as no alias (probably not necessary?)
@@ -89,7 +93,9 @@ void CodeGen_SPIR_Dev::add_kernel(Stmt stmt, std::string name, const std::vector
 
             kernel_arg_name.push_back(MDString::get(*context, iter->name));
             kernel_arg_access_qual.push_back(MDString::get(*context, "none"));
-            kernel_arg_type_qual.push_back(MDString::get(*context, ""));
+            kernel_arg_type_qual.push_back(MDString::get(*context,
+                                                         (iter->is_buffer && iter->read_only) ? "const restrict" :
+                                                         iter->is_buffer ? "restrict" : ""));
             // TODO: 'Type' isn't correct, but we don't have C to get the type name from...
             // This really shouldn't matter anyways. Everything SPIR needs is in the function
             // type, this metadata seems redundant.
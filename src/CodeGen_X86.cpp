@@ -89,7 +89,7 @@ void CodeGen_X86::compile(Stmt stmt, string name,
     init_module();
 
     // Fix the target triple
-    module = get_initial_module_for_target(target, context);
+    module = get_initial_module_for_target(target, context, !stmt.defined());
 
     llvm::Triple triple = get_target_triple();
     module->setTargetTriple(triple.str());
@@ -172,6 +172,21 @@ Value *CodeGen_X86::call_intrin(llvm::Type *result_type, const string &name, vec
     return call;
 }
 
+Value *CodeGen_X86::call_masked_intrin(Type result_type, const string &name, vector<Expr> args) {
+    vector<Value *> arg_values(args.size());
+    for (size_t i = 0; i < args.size(); i++) {
+        arg_values[i] = codegen(args[i]);
+    }
+
+    // Enable every lane, so the pass-through value is never used.
+    llvm::Type *t = llvm_type_of(result_type);
+    arg_values.push_back(UndefValue::get(t));
+    llvm::Type *mask_t = llvm::IntegerType::get(*context, std::max(result_type.width, 8));
+    arg_values.push_back(ConstantInt::get(mask_t, -1, true));
+
+    return call_intrin(t, name, arg_values);
+}
+
 namespace {
 
 // Attempt to cast an expression to a smaller type while provably not
@@ -219,52 +234,130 @@ void CodeGen_X86::visit(const Cast *op) {
     vector<Expr> matches;
 
     struct Pattern {
-        bool needs_sse_41;
+        // The target features the pattern requires.
+        int features;
         bool extern_call;
         bool wide_op;
         Type type;
         string intrin;
         Expr pattern;
+        // Whether the intrinsic is an AVX-512 one that also takes a
+        // pass-through vector and a lane mask.
+        bool masked;
     };
 
+    const int SSE41 = Target::SSE41, AVX2 = Target::AVX2;
+    #if LLVM_VERSION >= 38
+    const int AVX512 = Target::AVX512;
+    #endif
+
     Pattern patterns[] = {
-        {false, false, true, Int(8, 16), "sse2.padds.b",
+        {0, false, true, Int(8, 16), "sse2.padds.b",
          _i8(clamp(wild_i16x16 + wild_i16x16, -128, 127))},
-        {false, false, true, Int(8, 16), "sse2.psubs.b",
+        {0, false, true, Int(8, 16), "sse2.psubs.b",
          _i8(clamp(wild_i16x16 - wild_i16x16, -128, 127))},
-        {false, false, true, UInt(8, 16), "sse2.paddus.b",
+        {0, false, true, UInt(8, 16), "sse2.paddus.b",
          _u8(min(wild_u16x16 + wild_u16x16, 255))},
-        {false, false, true, UInt(8, 16), "sse2.psubus.b",
+        {0, false, true, UInt(8, 16), "sse2.psubus.b",
          _u8(max(wild_i16x16 - wild_i16x16, 0))},
-        {false, false, true, Int(16, 8), "sse2.padds.w",
+        {0, false, true, Int(16, 8), "sse2.padds.w",
          _i16(clamp(wild_i32x8 + wild_i32x8, -32768, 32767))},
-        {false, false, true, Int(16, 8), "sse2.psubs.w",
+        {0, false, true, Int(16, 8), "sse2.psubs.w",
          _i16(clamp(wild_i32x8 - wild_i32x8, -32768, 32767))},
-        {false, false, true, UInt(16, 8), "sse2.paddus.w",
+        {0, false, true, UInt(16, 8), "sse2.paddus.w",
          _u16(min(wild_u32x8 + wild_u32x8, 65535))},
-        {false, false, true, UInt(16, 8), "sse2.psubus.w",
+        {0, false, true, UInt(16, 8), "sse2.psubus.w",
          _u16(max(wild_i32x8 - wild_i32x8, 0))},
-        {false, false, true, Int(16, 8), "sse2.pmulh.w",
+        {0, false, true, Int(16, 8), "sse2.pmulh.w",
          _i16((wild_i32x8 * wild_i32x8) / 65536)},
-        {false, false, true, UInt(16, 8), "sse2.pmulhu.w",
+        {0, false, true, UInt(16, 8), "sse2.pmulhu.w",
          _u16((wild_u32x8 * wild_u32x8) / 65536)},
-        {false, false, true, UInt(8, 16), "sse2.pavg.b",
+        {SSE41, false, true, Int(16, 8), "ssse3.pmul.hr.sw.128",
+         _i16((wild_i32x8 * wild_i32x8 + 16384) / 32768)},
+        {0, false, true, UInt(8, 16), "sse2.pavg.b",
          _u8(((wild_u16x16 + wild_u16x16) + 1) / 2)},
-        {false, false, true, UInt(16, 8), "sse2.pavg.w",
+        {0, false, true, UInt(16, 8), "sse2.pavg.w",
          _u16(((wild_u32x8 + wild_u32x8) + 1) / 2)},
-        {false, true, false, Int(16, 8), "packssdw",
+        {0, true, false, Int(16, 8), "packssdw",
          _i16(clamp(wild_i32x8, -32768, 32767))},
-        {false, true, false, Int(8, 16), "packsswb",
+        {0, true, false, Int(8, 16), "packsswb",
          _i8(clamp(wild_i16x16, -128, 127))},
-        {false, true, false, UInt(8, 16), "packuswb",
+        {0, true, false, UInt(8, 16), "packuswb",
          _u8(clamp(wild_i16x16, 0, 255))},
-        {true, true, false, UInt(16, 8), "packusdw",
-         _u16(clamp(wild_i32x8, 0, 65535))}
+        {SSE41, true, false, UInt(16, 8), "packusdw",
+         _u16(clamp(wild_i32x8, 0, 65535))},
+
+        // The same again at twice the width for AVX2
+        {AVX2, false, true, Int(8, 32), "avx2.padds.b",
+         _i8(clamp(wild_i16x32 + wild_i16x32, -128, 127))},
+        {AVX2, false, true, Int(8, 32), "avx2.psubs.b",
+         _i8(clamp(wild_i16x32 - wild_i16x32, -128, 127))},
+        {AVX2, false, true, UInt(8, 32), "avx2.paddus.b",
+         _u8(min(wild_u16x32 + wild_u16x32, 255))},
+        {AVX2, false, true, UInt(8, 32), "avx2.psubus.b",
+         _u8(max(wild_i16x32 - wild_i16x32, 0))},
+        {AVX2, false, true, Int(16, 16), "avx2.padds.w",
+         _i16(clamp(wild_i32x16 + wild_i32x16, -32768, 32767))},
+        {AVX2, false, true, Int(16, 16), "avx2.psubs.w",
+         _i16(clamp(wild_i32x16 - wild_i32x16, -32768, 32767))},
+        {AVX2, false, true, UInt(16, 16), "avx2.paddus.w",
+         _u16(min(wild_u32x16 + wild_u32x16, 65535))},
+        {AVX2, false, true, UInt(16, 16), "avx2.psubus.w",
+         _u16(max(wild_i32x16 - wild_i32x16, 0))},
+        {AVX2, false, true, Int(16, 16), "avx2.pmulh.w",
+         _i16((wild_i32x16 * wild_i32x16) / 65536)},
+        {AVX2, false, true, UInt(16, 16), "avx2.pmulhu.w",
+         _u16((wild_u32x16 * wild_u32x16) / 65536)},
+        {AVX2, false, true, Int(16, 16), "avx2.pmul.hr.sw",
+         _i16((wild_i32x16 * wild_i32x16 + 16384) / 32768)},
+        {AVX2, false, true, UInt(8, 32), "avx2.pavg.b",
+         _u8(((wild_u16x32 + wild_u16x32) + 1) / 2)},
+        {AVX2, false, true, UInt(16, 16), "avx2.pavg.w",
+         _u16(((wild_u32x16 + wild_u32x16) + 1) / 2)},
+        {AVX2, true, false, Int(16, 16), "packssdw",
+         _i16(clamp(wild_i32x16, -32768, 32767))},
+        {AVX2, true, false, Int(8, 32), "packsswb",
+         _i8(clamp(wild_i16x32, -128, 127))},
+        {AVX2, true, false, UInt(8, 32), "packuswb",
+         _u8(clamp(wild_i16x32, 0, 255))},
+        {AVX2, true, false, UInt(16, 16), "packusdw",
+         _u16(clamp(wild_i32x16, 0, 65535))},
+
+        #if LLVM_VERSION >= 38
+        // And at 512 bits for AVX-512. The narrowing packs are left
+        // to llvm.
+        {AVX512, false, true, Int(8, 64), "avx512.mask.padds.b.512",
+         _i8(clamp(wild_i16x64 + wild_i16x64, -128, 127)), true},
+        {AVX512, false, true, Int(8, 64), "avx512.mask.psubs.b.512",
+         _i8(clamp(wild_i16x64 - wild_i16x64, -128, 127)), true},
+        {AVX512, false, true, UInt(8, 64), "avx512.mask.paddus.b.512",
+         _u8(min(wild_u16x64 + wild_u16x64, 255)), true},
+        {AVX512, false, true, UInt(8, 64), "avx512.mask.psubus.b.512",
+         _u8(max(wild_i16x64 - wild_i16x64, 0)), true},
+        {AVX512, false, true, Int(16, 32), "avx512.mask.padds.w.512",
+         _i16(clamp(wild_i32x32 + wild_i32x32, -32768, 32767)), true},
+        {AVX512, false, true, Int(16, 32), "avx512.mask.psubs.w.512",
+         _i16(clamp(wild_i32x32 - wild_i32x32, -32768, 32767)), true},
+        {AVX512, false, true, UInt(16, 32), "avx512.mask.paddus.w.512",
+         _u16(min(wild_u32x32 + wild_u32x32, 65535)), true},
+        {AVX512, false, true, UInt(16, 32), "avx512.mask.psubus.w.512",
+         _u16(max(wild_i32x32 - wild_i32x32, 0)), true},
+        {AVX512, false, true, Int(16, 32), "avx512.mask.pmulh.w.512",
+         _i16((wild_i32x32 * wild_i32x32) / 65536), true},
+        {AVX512, false, true, UInt(16, 32), "avx512.mask.pmulhu.w.512",
+         _u16((wild_u32x32 * wild_u32x32) / 65536), true},
+        {AVX512, false, true, Int(16, 32), "avx512.mask.pmul.hr.sw.512",
+         _i16((wild_i32x32 * wild_i32x32 + 16384) / 32768), true},
+        {AVX512, false, true, UInt(8, 64), "avx512.mask.pavg.b.512",
+         _u8(((wild_u16x64 + wild_u16x64) + 1) / 2), true},
+        {AVX512, false, true, UInt(16, 32), "avx512.mask.pavg.w.512",
+         _u16(((wild_u32x32 + wild_u32x32) + 1) / 2), true},
+        #endif
     };
 
     for (size_t i = 0; i < sizeof(patterns)/sizeof(patterns[0]); i++) {
         const Pattern &pattern = patterns[i];
-        if (!(target.features | Target::SSE41) && pattern.needs_sse_41) continue;
+        if ((target.features & pattern.features) != pattern.features) continue;
         if (expr_match(pattern.pattern, op, matches)) {
             bool ok = true;
             if (pattern.wide_op) {
@@ -278,6 +371,8 @@ void CodeGen_X86::visit(const Cast *op) {
 
             if (pattern.extern_call) {
                 value = codegen(Call::make(pattern.type, pattern.intrin, matches, Call::Extern));
+            } else if (pattern.masked) {
+                value = call_masked_intrin(pattern.type, pattern.intrin, matches);
             } else {
                 value = call_intrin(pattern.type, pattern.intrin, matches);
             }
@@ -332,6 +427,7 @@ void CodeGen_X86::visit(const Div *op) {
     int const_divisor = int_imm ? int_imm->value : 0;
     int shift_amount;
     bool power_of_two = is_const_power_of_two(op->b, &shift_amount);
+    bool use_avx2 = target.features & Target::AVX2;
 
     vector<Expr> matches;
     if (op->type == Float(32, 4) && is_one(op->a)) {
@@ -348,6 +444,13 @@ void CodeGen_X86::visit(const Div *op) {
         } else {
             value = call_intrin(Float(32, 8), "avx.rcp.ps.256", vec(op->b));
         }
+    } else if ((target.features & Target::AVX512) && op->type == Float(32, 16) && is_one(op->a)) {
+        // The AVX-512 versions are accurate to 14 bits instead of 12.
+        if (expr_match(Call::make(Float(32, 16), "sqrt_f32", vec(wild_f32x16), Call::Extern), op->b, matches)) {
+            value = call_masked_intrin(Float(32, 16), "avx512.rsqrt14.ps.512", matches);
+        } else {
+            value = call_masked_intrin(Float(32, 16), "avx512.rcp14.ps.512", vec(op->b));
+        }
     } else if (power_of_two && op->type.is_int()) {
         Value *numerator = codegen(op->a);
         Constant *shift = ConstantInt::get(llvm_type_of(op->type), shift_amount);
@@ -388,8 +491,10 @@ void CodeGen_X86::visit(const Div *op) {
         Value *mult = ConstantInt::get(narrower, multiplier);
 
         // Widening multiply, keep high half, shift
-        if (op->type == Int(16, 8)) {
-            val = call_intrin(narrower, "sse2.pmulhu.w", vec(flipped, mult));
+        if (op->type == Int(16, 8) ||
+            (use_avx2 && op->type == Int(16, 16))) {
+            string pmulhu = op->type.width == 16 ? "avx2.pmulhu.w" : "sse2.pmulhu.w";
+            val = call_intrin(narrower, pmulhu, vec(flipped, mult));
             if (shift) {
                 Constant *shift_amount = ConstantInt::get(narrower, shift);
                 val = builder->CreateLShr(val, shift_amount);
@@ -439,8 +544,10 @@ void CodeGen_X86::visit(const Div *op) {
         Value *mult = ConstantInt::get(narrower, multiplier);
         Value *val = num;
 
-        if (op->type == UInt(16, 8)) {
-            val = call_intrin(narrower, "sse2.pmulhu.w", vec(val, mult));
+        if (op->type == UInt(16, 8) ||
+            (use_avx2 && op->type == UInt(16, 16))) {
+            string pmulhu = op->type.width == 16 ? "avx2.pmulhu.w" : "sse2.pmulhu.w";
+            val = call_intrin(narrower, pmulhu, vec(val, mult));
             if (shift && method == 1) {
                 Constant *shift_amount = ConstantInt::get(narrower, shift);
                 val = builder->CreateLShr(val, shift_amount);
@@ -489,6 +596,7 @@ void CodeGen_X86::visit(const Div *op) {
 
 void CodeGen_X86::visit(const Min *op) {
     bool use_sse_41 = target.features & Target::SSE41;
+    bool use_avx2 = target.features & Target::AVX2;
     if (op->type == UInt(8, 16)) {
         value = call_intrin(UInt(8, 16), "sse2.pminu.b", vec(op->a, op->b));
     } else if (use_sse_41 && op->type == Int(8, 16)) {
@@ -501,6 +609,18 @@ void CodeGen_X86::visit(const Min *op) {
         value = call_intrin(Int(32, 4), "sse41.pminsd", vec(op->a, op->b));
     } else if (use_sse_41 && op->type == UInt(32, 4)) {
         value = call_intrin(UInt(32, 4), "sse41.pminud", vec(op->a, op->b));
+    } else if (use_avx2 && op->type == UInt(8, 32)) {
+        value = call_intrin(UInt(8, 32), "avx2.pminu.b", vec(op->a, op->b));
+    } else if (use_avx2 && op->type == Int(8, 32)) {
+        value = call_intrin(Int(8, 32), "avx2.pmins.b", vec(op->a, op->b));
+    } else if (use_avx2 && op->type == Int(16, 16)) {
+        value = call_intrin(Int(16, 16), "avx2.pmins.w", vec(op->a, op->b));
+    } else if (use_avx2 && op->type == UInt(16, 16)) {
+        value = call_intrin(UInt(16, 16), "avx2.pminu.w", vec(op->a, op->b));
+    } else if (use_avx2 && op->type == Int(32, 8)) {
+        value = call_intrin(Int(32, 8), "avx2.pmins.d", vec(op->a, op->b));
+    } else if (use_avx2 && op->type == UInt(32, 8)) {
+        value = call_intrin(UInt(32, 8), "avx2.pminu.d", vec(op->a, op->b));
     } else {
         CodeGen::visit(op);
     }
@@ -508,6 +628,7 @@ void CodeGen_X86::visit(const Min *op) {
 
 void CodeGen_X86::visit(const Max *op) {
     bool use_sse_41 = target.features & Target::SSE41;
+    bool use_avx2 = target.features & Target::AVX2;
     if (op->type == UInt(8, 16)) {
         value = call_intrin(UInt(8, 16), "sse2.pmaxu.b", vec(op->a, op->b));
     } else if (use_sse_41 && op->type == Int(8, 16)) {
@@ -520,11 +641,331 @@ void CodeGen_X86::visit(const Max *op) {
         value = call_intrin(Int(32, 4), "sse41.pmaxsd", vec(op->a, op->b));
     } else if (use_sse_41 && op->type == UInt(32, 4)) {
         value = call_intrin(UInt(32, 4), "sse41.pmaxud", vec(op->a, op->b));
+    } else if (use_avx2 && op->type == UInt(8, 32)) {
+        value = call_intrin(UInt(8, 32), "avx2.pmaxu.b", vec(op->a, op->b));
+    } else if (use_avx2 && op->type == Int(8, 32)) {
+        value = call_intrin(Int(8, 32), "avx2.pmaxs.b", vec(op->a, op->b));
+    } else if (use_avx2 && op->type == Int(16, 16)) {
+        value = call_intrin(Int(16, 16), "avx2.pmaxs.w", vec(op->a, op->b));
+    } else if (use_avx2 && op->type == UInt(16, 16)) {
+        value = call_intrin(UInt(16, 16), "avx2.pmaxu.w", vec(op->a, op->b));
+    } else if (use_avx2 && op->type == Int(32, 8)) {
+        value = call_intrin(Int(32, 8), "avx2.pmaxs.d", vec(op->a, op->b));
+    } else if (use_avx2 && op->type == UInt(32, 8)) {
+        value = call_intrin(UInt(32, 8), "avx2.pmaxu.d", vec(op->a, op->b));
     } else {
         CodeGen::visit(op);
     }
 }
 
+void CodeGen_X86::visit(const Call *op) {
+    if (op->call_type != Call::Intrinsic || op->name != Call::vector_reduce_add) {
+        CodeGen_Posix::visit(op);
+        return;
+    }
+
+    assert(op->args.size() == 1 && "vector_reduce_add takes one argument");
+    bool use_avx2 = target.features & Target::AVX2;
+    Expr arg = op->args[0];
+    int width = arg.type().width;
+    int factor = width / op->type.width;
+
+    // Look for a product of 16-bit values, or a widened vector of
+    // unsigned bytes.
+    Expr a, b;
+    if (const Mul *mul = arg.as<Mul>()) {
+        a = mul->a;
+        b = mul->b;
+        const Broadcast *bc = b.as<Broadcast>();
+        const IntImm *k = bc ? bc->value.as<IntImm>() : NULL;
+        if (k && k->value >= -32768 && k->value <= 32767) {
+            b = Broadcast::make(cast(Int(16), k->value), width);
+        } else if (const Cast *c = b.as<Cast>()) {
+            b = c->value;
+        }
+        if (const Cast *c = a.as<Cast>()) {
+            a = c->value;
+        }
+    }
+    const Cast *widened = arg.as<Cast>();
+
+    Value *partial = NULL;
+    Type partial_type;
+    if (factor % 2 == 0 && arg.type().element_of() == Int(32) &&
+        a.defined() && a.type().element_of() == Int(16) && b.type().element_of() == Int(16) &&
+        (width == 8 || (use_avx2 && width == 16))) {
+        // Sums of adjacent pairs of products.
+        partial_type = Int(32, width/2);
+        partial = call_intrin(partial_type, width == 8 ? "sse2.pmadd.wd" : "avx2.pmadd.wd", vec(a, b));
+    } else if (factor % 8 == 0 && widened && arg.type().bits >= 16 &&
+               widened->value.type().element_of() == UInt(8) &&
+               (width == 16 || (use_avx2 && width == 32))) {
+        // Sums of groups of eight bytes, as the sum of absolute
+        // differences from zero.
+        Expr zero = make_zero(widened->value.type());
+        Value *sad = call_intrin(UInt(64, width/8), width == 16 ? "sse2.psad.bw" : "avx2.psad.bw",
+                                 vec(widened->value, zero));
+        partial_type = op->type.element_of().vector_of(width/8);
+        partial = builder->CreateIntCast(sad, llvm_type_of(partial_type), false);
+    }
+
+    if (partial) {
+        value = codegen_vector_reduce(op, partial, partial_type);
+    } else {
+        CodeGen_Posix::visit(op);
+    }
+}
+
+bool CodeGen_X86::should_gather(const Load *op) {
+    #if LLVM_VERSION < 33
+    return false;
+    #else
+    if (!(target.features & Target::AVX2)) return false;
+
+    // Dense, strided, and broadcast loads are better done by the
+    // generic code, as are predicated loads.
+    if (op->type.is_scalar() || op->predicate.defined() ||
+        op->index.as<Ramp>() ||
+        op->index.as<Broadcast>()) {
+        return false;
+    }
+
+    // Gathers of fewer than eight lanes are no faster than loading
+    // each lane. Wider vectors are gathered eight lanes at a time.
+    if (op->type.width % 8) {
+        return false;
+    }
+
+    // Narrow elements are gathered as the 32-bit word that ends with
+    // them, which reads a few bytes before the element. The internal
+    // allocations may be read a little outside of, but the input
+    // buffers may not.
+    bool internal = !op->image.defined() && !op->param.defined();
+    int bits = op->type.bits;
+    return bits == 32 || ((bits == 8 || bits == 16) && internal);
+    #endif
+}
+
+Value *CodeGen_X86::codegen_gather(const Load *op) {
+    Type t = op->type;
+    int bytes = t.bytes();
+    bool narrow = bytes < 4;
+
+    Value *base = codegen_buffer_pointer(op->name, t.element_of(), make_zero(Int(32)));
+    base = builder->CreatePointerCast(base, i8->getPointerTo());
+    Value *index = codegen(op->index);
+    if (narrow) {
+        Expr offset = Broadcast::make(4 / bytes - 1, t.width);
+        index = builder->CreateSub(index, codegen(offset));
+    }
+
+    bool is_float = t.is_float();
+    llvm::Type *word_type = is_float ? f32x8 : i32x8;
+    string name = is_float ? "llvm.x86.avx2.gather.d.ps.256" : "llvm.x86.avx2.gather.d.d.256";
+    llvm::Function *fn = module->getFunction(name);
+    if (!fn) {
+        llvm::Type *arg_types[] = {word_type, i8->getPointerTo(), i32x8, word_type, i8};
+        FunctionType *func_t = FunctionType::get(word_type, arg_types, false);
+        fn = llvm::Function::Create(func_t, llvm::Function::ExternalLinkage, name, module);
+    }
+
+    // Gather all the lanes.
+    Value *mask = builder->CreateBitCast(ConstantInt::get(i32x8, -1), word_type);
+    Value *scale = ConstantInt::get(i8, bytes);
+
+    vector<Value *> parts;
+    for (int c = 0; c < t.width / 8; c++) {
+        Value *chunk_index = index;
+        if (t.width > 8) {
+            vector<Constant *> lanes(8);
+            for (int i = 0; i < 8; i++) {
+                lanes[i] = ConstantInt::get(i32, c*8 + i);
+            }
+            chunk_index = builder->CreateShuffleVector(index, UndefValue::get(index->getType()),
+                                                       ConstantVector::get(lanes));
+        }
+        Value *args[] = {UndefValue::get(word_type), base, chunk_index, mask, scale};
+        CallInst *gather = builder->CreateCall(fn, args);
+        gather->setOnlyReadsMemory();
+        gather->setDoesNotThrow();
+        add_tbaa_metadata(gather, op->name);
+
+        Value *part = gather;
+        if (narrow) {
+            // The element is the high end of the word.
+            part = builder->CreateLShr(part, ConstantInt::get(i32x8, 32 - t.bits));
+            part = builder->CreateTrunc(part, llvm_type_of(t.element_of().vector_of(8)));
+        }
+        parts.push_back(part);
+    }
+
+    return concat_vectors(parts);
+}
+
+bool CodeGen_X86::should_deinterleave(const Load *op) {
+    const Ramp *ramp = op->index.as<Ramp>();
+    const IntImm *stride = ramp ? ramp->stride.as<IntImm>() : NULL;
+    if (!stride || op->predicate.defined() ||
+        (stride->value != 3 && stride->value != 4)) {
+        return false;
+    }
+
+    // Count about three instructions per register loaded for the
+    // loads, the shuffles, and merging the results, against a load
+    // and an insert per lane.
+    bool wide = (target.features & Target::AVX2) ||
+        ((target.features & Target::AVX) && op->type.is_float());
+    int vector_bytes = wide ? 32 : 16;
+    int result_bytes = op->type.bytes() * op->type.width;
+    int registers_out = (result_bytes + vector_bytes - 1) / vector_bytes;
+    int shuffle_cost = 3 * stride->value * registers_out;
+    int gather_cost = 2 * op->type.width;
+    return shuffle_cost < gather_cost;
+}
+
+Value *CodeGen_X86::codegen_deinterleaved_load(const Load *op) {
+    const Ramp *ramp = op->index.as<Ramp>();
+    int stride = ramp->stride.as<IntImm>()->value;
+    int width = ramp->width;
+
+    // Load the elements from the first lane read to the last one. The
+    // last load is moved back so as not to read past the last lane,
+    // which might be the end of an input buffer.
+    int last_start = (stride - 1) * width - (stride - 1);
+    vector<Value *> loads;
+    for (int i = 0; i < stride; i++) {
+        int offset = (i == stride - 1) ? last_start : i * width;
+        Expr index = Ramp::make(ramp->base + offset, 1, width);
+        loads.push_back(codegen(Load::make(op->type, op->name, index, op->image, op->param)));
+    }
+    Value *all = concat_vectors(loads);
+
+    // Lane i is element i * stride, which is in the last load if it's
+    // past the others.
+    vector<Constant *> indices(width);
+    for (int i = 0; i < width; i++) {
+        int element = i * stride;
+        if (element >= (stride - 1) * width) {
+            element = (stride - 1) * width + (element - last_start);
+        }
+        indices[i] = ConstantInt::get(i32, element);
+    }
+    return builder->CreateShuffleVector(all, UndefValue::get(all->getType()),
+                                        ConstantVector::get(indices));
+}
+
+void CodeGen_X86::visit(const Load *op) {
+    if (should_gather(op)) {
+        value = codegen_gather(op);
+    } else if (should_deinterleave(op)) {
+        value = codegen_deinterleaved_load(op);
+    } else {
+        CodeGen_Posix::visit(op);
+    }
+}
+
+namespace {
+// The name of the avx masked move (maskload or maskstore) for a
+// dense vector of the given type, or the empty string if there isn't
+// one. The float versions are used for ints when we don't have avx2.
+string masked_move_name(const string &op, Type t, const Target &target) {
+    int total_bits = t.bits * t.width;
+    if (!(target.features & Target::AVX) ||
+        (t.bits != 32 && t.bits != 64) ||
+        (total_bits != 128 && total_bits != 256)) {
+        return "";
+    }
+    string suffix = (total_bits == 256) ? ".256" : "";
+    if (!t.is_float() && (target.features & Target::AVX2)) {
+        return "llvm.x86.avx2." + op + (t.bits == 32 ? ".d" : ".q") + suffix;
+    } else {
+        return "llvm.x86.avx." + op + (t.bits == 32 ? ".ps" : ".pd") + suffix;
+    }
+}
+}
+
+void CodeGen_X86::codegen_predicated_load(const Load *op) {
+    const Ramp *ramp = op->index.as<Ramp>();
+    string name = masked_move_name("maskload", op->type, target);
+    if (!ramp || !is_one(ramp->stride) || name.empty()) {
+        CodeGen_Posix::codegen_predicated_load(op);
+        return;
+    }
+
+    Type mask_t = Int(op->type.bits, op->type.width);
+    Type word_t = op->type;
+    if (name.find("avx2") == string::npos) {
+        word_t = Float(op->type.bits, op->type.width);
+    }
+    llvm::Type *word_type = llvm_type_of(word_t);
+    #if LLVM_VERSION < 38
+    // Older llvms take the mask of the float versions as a float vector.
+    llvm::Type *mask_type = word_type;
+    #else
+    llvm::Type *mask_type = llvm_type_of(mask_t);
+    #endif
+
+    llvm::Function *fn = module->getFunction(name);
+    if (!fn) {
+        llvm::Type *arg_types[] = {i8->getPointerTo(), mask_type};
+        FunctionType *func_t = FunctionType::get(word_type, arg_types, false);
+        fn = llvm::Function::Create(func_t, llvm::Function::ExternalLinkage, name, module);
+    }
+
+    // The mask lanes are all ones or all zeros.
+    Value *mask = builder->CreateSExt(codegen(op->predicate), llvm_type_of(mask_t));
+    mask = builder->CreateBitCast(mask, mask_type);
+    Value *ptr = codegen_buffer_pointer(op->name, op->type.element_of(), ramp->base);
+    ptr = builder->CreatePointerCast(ptr, i8->getPointerTo());
+
+    Value *args[] = {ptr, mask};
+    CallInst *load = builder->CreateCall(fn, args);
+    load->setOnlyReadsMemory();
+    load->setDoesNotThrow();
+    add_tbaa_metadata(load, op->name);
+    value = builder->CreateBitCast(load, llvm_type_of(op->type));
+}
+
+void CodeGen_X86::codegen_predicated_store(const Store *op) {
+    Type t = op->value.type();
+    const Ramp *ramp = op->index.as<Ramp>();
+    string name = masked_move_name("maskstore", t, target);
+    if (!ramp || !is_one(ramp->stride) || name.empty()) {
+        CodeGen_Posix::codegen_predicated_store(op);
+        return;
+    }
+
+    Type mask_t = Int(t.bits, t.width);
+    Type word_t = t;
+    if (name.find("avx2") == string::npos) {
+        word_t = Float(t.bits, t.width);
+    }
+    llvm::Type *word_type = llvm_type_of(word_t);
+    #if LLVM_VERSION < 38
+    llvm::Type *mask_type = word_type;
+    #else
+    llvm::Type *mask_type = llvm_type_of(mask_t);
+    #endif
+
+    llvm::Function *fn = module->getFunction(name);
+    if (!fn) {
+        llvm::Type *arg_types[] = {i8->getPointerTo(), mask_type, word_type};
+        FunctionType *func_t = FunctionType::get(void_t, arg_types, false);
+        fn = llvm::Function::Create(func_t, llvm::Function::ExternalLinkage, name, module);
+    }
+
+    Value *val = builder->CreateBitCast(codegen(op->value), word_type);
+    Value *mask = builder->CreateSExt(codegen(op->predicate), llvm_type_of(mask_t));
+    mask = builder->CreateBitCast(mask, mask_type);
+    Value *ptr = codegen_buffer_pointer(op->name, t.element_of(), ramp->base);
+    ptr = builder->CreatePointerCast(ptr, i8->getPointerTo());
+
+    Value *args[] = {ptr, mask, val};
+    CallInst *store = builder->CreateCall(fn, args);
+    store->setDoesNotThrow();
+    add_tbaa_metadata(store, op->name);
+}
+
 static bool extern_function_1_was_called = false;
 extern "C" int extern_function_1(float x) {
     extern_function_1_was_called = true;
@@ -668,6 +1109,13 @@ void CodeGen_X86::test() {
 }
 
 string CodeGen_X86::mcpu() const {
+    if (!target.cpu.empty()) return target.cpu;
+    // Skylake server is the first core with AVX-512BW. Before that
+    // we name the features in mattrs instead.
+    #if LLVM_VERSION >= 37
+    if (target.features & Target::AVX512) return "skx";
+    #endif
+    if (target.features & Target::AVX2) return "core-avx2";
     if (target.features & Target::AVX) return "corei7-avx";
     // We want SSE4.1 but not SSE4.2, hence "penryn" rather than "corei7"
     if (target.features & Target::SSE41) return "penryn";
@@ -676,11 +1124,53 @@ string CodeGen_X86::mcpu() const {
 }
 
 string CodeGen_X86::mattrs() const {
-    return "";
+    string attrs;
+    // Multiplies and adds are contracted when the instructions exist.
+    if (target.features & Target::FMA) {
+        attrs = "+fma";
+    } else if (target.features & Target::AVX2) {
+        // core-avx2 would otherwise imply fma.
+        attrs = "-fma";
+    }
+
+    if (target.features & Target::F16C) {
+        attrs += attrs.empty() ? "+f16c" : ",+f16c";
+    } else if (target.features & Target::AVX2) {
+        attrs += attrs.empty() ? "-f16c" : ",-f16c";
+    }
+
+    #if LLVM_VERSION < 37
+    if (target.features & Target::AVX512) {
+        attrs += attrs.empty() ? "+avx512f" : ",+avx512f";
+    }
+    #endif
+
+    if (!target.cpu.empty()) {
+        // A named cpu is only there for tuning, so turn off what it
+        // has that the features don't.
+        const char *off[] = {
+            (target.features & Target::SSE41) ? NULL : "-sse4.1",
+            (target.features & Target::AVX) ? NULL : "-avx",
+            (target.features & Target::AVX2) ? NULL : "-avx2",
+            (target.features & Target::AVX512) ? NULL : "-avx512f",
+            ((target.features & Target::FMA) || attrs.find("-fma") != string::npos) ? NULL : "-fma",
+            ((target.features & Target::F16C) || attrs.find("-f16c") != string::npos) ? NULL : "-f16c"
+        };
+        for (size_t i = 0; i < sizeof(off)/sizeof(off[0]); i++) {
+            if (off[i]) {
+                attrs += attrs.empty() ? off[i] : string(",") + off[i];
+            }
+        }
+    }
+    return attrs;
 }
 
 bool CodeGen_X86::use_soft_float_abi() const {
     return false;
 }
 
+bool CodeGen_X86::use_native_float16_conversions() const {
+    return target.features & Target::F16C;
+}
+
 }}
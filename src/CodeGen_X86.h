@@ -38,6 +38,11 @@ protected:
     // @{
     llvm::Value *call_intrin(Type t, const std::string &name, std::vector<Expr>);
     llvm::Value *call_intrin(llvm::Type *t, const std::string &name, std::vector<llvm::Value *>);
+
+    /** Generate a call to an AVX-512 intrinsic that takes a
+     * pass-through vector and a lane mask after its arguments, with
+     * every lane enabled. */
+    llvm::Value *call_masked_intrin(Type t, const std::string &name, std::vector<Expr>);
     // @}
 
     using CodeGen_Posix::visit;
@@ -48,11 +53,38 @@ protected:
     void visit(const Div *);
     void visit(const Min *);
     void visit(const Max *);
+    void visit(const Load *);
+    void visit(const Call *);
+    // @}
+
+    /** Check if a vector load is at data-dependent indices that the
+     * avx2 gathers should be used for. */
+    bool should_gather(const Load *);
+
+    /** Generate a vector load using the avx2 gathers. */
+    llvm::Value *codegen_gather(const Load *);
+
+    /** Check if a vector load with a constant stride of three or
+     * four (e.g. one channel of interleaved rgb or rgba, or a 3x or
+     * 4x downsample) is cheaper done as dense loads and a shuffle
+     * than one lane at a time. */
+    bool should_deinterleave(const Load *);
+
+    /** Generate a strided vector load as one dense load per unit of
+     * stride, and a shuffle that picks out the lanes. */
+    llvm::Value *codegen_deinterleaved_load(const Load *);
+
+    /** Use the avx masked moves for dense predicated loads and stores
+     * of 32 and 64-bit elements. */
+    // @{
+    void codegen_predicated_load(const Load *);
+    void codegen_predicated_store(const Store *);
     // @}
 
     std::string mcpu() const;
     std::string mattrs() const;
     bool use_soft_float_abi() const;
+    bool use_native_float16_conversions() const;
 };
 
 }}
@@ -0,0 +1,167 @@
+#include "ConstantFill.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "Scope.h"
+#include "CodeGen_GPU_Dev.h"
+#include "Debug.h"
+
+#include <cmath>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+
+namespace {
+
+// The byte that a constant is made of, if all its bytes are the
+// same, or -1.
+int fill_byte(Expr e) {
+    Type t = e.type();
+    if (!t.is_scalar()) return -1;
+
+    const Cast *cast = e.as<Cast>();
+    if (cast) e = cast->value;
+    const IntImm *i = e.as<IntImm>();
+    const FloatImm *f = e.as<FloatImm>();
+
+    uint64_t bits;
+    if (t.is_float()) {
+        // Only positive zero is all the same byte in every width.
+        double v = i ? i->value : (f ? f->value : -1.0);
+        if (v != 0 || (f && std::signbit(f->value))) return -1;
+        bits = 0;
+    } else if (i) {
+        bits = (uint64_t)(int64_t)i->value;
+        if (t.bits == 1) bits &= 1;
+    } else {
+        return -1;
+    }
+
+    int byte = (int)(bits & 0xff);
+    for (int b = 1; b < t.bytes(); b++) {
+        if ((int)((bits >> (8 * b)) & 0xff) != byte) return -1;
+    }
+    return byte;
+}
+
+// Check that a produce step only stores constants made of one byte,
+// and find the byte each buffer is filled with.
+class FindConstantStores : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &func;
+
+    void visit(const Store *op) {
+        int byte = fill_byte(op->value);
+        bool ours = op->name == func || op->name.substr(0, func.size() + 1) == func + ".";
+        if (byte < 0 || !ours) {
+            result = false;
+            return;
+        }
+        map<string, int>::iterator iter = bytes.find(op->name);
+        if (iter != bytes.end() && iter->second != byte) {
+            result = false;
+        }
+        bytes[op->name] = byte;
+    }
+
+    void visit(const For *op) {
+        if (CodeGen_GPU_Dev::is_gpu_var(op->name)) {
+            result = false;
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+    // Anything else the produce step does means it has to run.
+    void visit(const Evaluate *) {result = false;}
+    void visit(const AssertStmt *) {result = false;}
+    void visit(const Allocate *) {result = false;}
+    void visit(const Pipeline *) {result = false;}
+
+public:
+    bool result;
+    map<string, int> bytes;
+    FindConstantStores(const string &f) : func(f), result(true) {}
+};
+
+class FillConstantInitializations : public IRMutator {
+    using IRMutator::visit;
+
+    // The size in bytes of each allocation around the statement
+    // being mutated, and how many loops it's inside of.
+    Scope<Expr> allocation_bytes;
+    Scope<int> allocation_depth;
+    int loop_depth;
+
+    void visit(const For *op) {
+        if (CodeGen_GPU_Dev::is_gpu_var(op->name)) {
+            stmt = op;
+            return;
+        }
+        loop_depth++;
+        IRMutator::visit(op);
+        loop_depth--;
+    }
+
+    void visit(const Allocate *op) {
+        Expr bytes = Cast::make(Int(64), op->type.bytes());
+        for (size_t i = 0; i < op->extents.size(); i++) {
+            bytes = bytes * Cast::make(Int(64), op->extents[i]);
+        }
+        allocation_bytes.push(op->name, bytes);
+        allocation_depth.push(op->name, loop_depth);
+        IRMutator::visit(op);
+        allocation_depth.pop(op->name);
+        allocation_bytes.pop(op->name);
+    }
+
+    void visit(const Pipeline *op) {
+        IRMutator::visit(op);
+        const Pipeline *p = stmt.as<Pipeline>();
+        if (!p || !p->update.defined()) return;
+
+        FindConstantStores stores(op->name);
+        p->produce.accept(&stores);
+        if (!stores.result || stores.bytes.empty()) return;
+
+        // Anything made at an outer loop level may already hold
+        // values from earlier iterations, e.g. if it's folded.
+        for (map<string, int>::iterator iter = stores.bytes.begin();
+             iter != stores.bytes.end(); ++iter) {
+            if (!allocation_depth.contains(iter->first) ||
+                allocation_depth.get(iter->first) != loop_depth) {
+                return;
+            }
+        }
+
+        Stmt fill;
+        for (map<string, int>::iterator iter = stores.bytes.begin();
+             iter != stores.bytes.end(); ++iter) {
+            Expr first = Load::make(UInt(8), iter->first, 0, Buffer(), Parameter());
+            Expr ptr = Call::make(Handle(), Call::address_of, vec(first), Call::Intrinsic);
+            Expr call = Call::make(Int(32), Call::fill_memory,
+                                   vec<Expr>(ptr, iter->second, allocation_bytes.get(iter->first)),
+                                   Call::Intrinsic);
+            Stmt s = Evaluate::make(call);
+            fill = fill.defined() ? Block::make(fill, s) : s;
+        }
+        debug(3) << "Initializing " << op->name << " with a memset\n";
+        stmt = Pipeline::make(p->name, fill, p->update, p->consume);
+    }
+
+public:
+    FillConstantInitializations() : loop_depth(0) {}
+};
+
+}
+
+Stmt fill_constant_initializations(Stmt s) {
+    return FillConstantInitializations().mutate(s);
+}
+
+}
+}
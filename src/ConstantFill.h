@@ -0,0 +1,25 @@
+#ifndef HALIDE_CONSTANT_FILL_H
+#define HALIDE_CONSTANT_FILL_H
+
+/** \file
+ * Defines the lowering pass that turns initializations of buffers to
+ * a constant into memsets.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Replace the produce step of a function that only stores a constant
+ * whose bytes are all the same (e.g. the f(x, y) = 0 that starts most
+ * reductions) with a fill_memory intrinsic over its whole allocation,
+ * which codegen turns into a memset. Only done where the allocation
+ * is made at the same loop level as the function is computed, so
+ * nothing else is in it yet. Must run after storage flattening. */
+Stmt fill_constant_initializations(Stmt s);
+
+}
+}
+
+#endif
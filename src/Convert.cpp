@@ -0,0 +1,120 @@
+#include "Convert.h"
+#include "IROperator.h"
+#include "Util.h"
+
+#include <algorithm>
+
+namespace Halide {
+
+using std::vector;
+using std::string;
+
+namespace {
+
+// Clamp an integer to the range of t, and cast it. Only the bounds
+// of t that the type of e can get past are clamped.
+Expr saturate(Expr e, Type t) {
+    Type et = e.type();
+    bool clamp_min = et.is_int() && (t.is_uint() || t.bits < et.bits);
+    bool clamp_max = t.bits < et.bits || (t.bits == et.bits && et.is_uint() && t.is_int());
+    if (clamp_min && clamp_max) {
+        e = clamp(e, cast(et, t.min()), cast(et, t.max()));
+    } else if (clamp_min) {
+        e = max(e, cast(et, t.min()));
+    } else if (clamp_max) {
+        e = min(e, cast(et, t.max()));
+    }
+    return cast(t, e);
+}
+
+// Convert a value to t, rounding and saturating if t is an integer
+// type. Integers are narrowed by halves, so that each step matches a
+// saturating pack instruction.
+Expr convert_value(Expr e, Type t, float scale) {
+    Type et = e.type();
+    if (scale != 1.0f) {
+        e = cast<float>(e) * scale;
+        et = e.type();
+    }
+    if (t.is_float()) {
+        return cast(t, e);
+    }
+    if (et.is_float()) {
+        // Round, and clamp while still in float, so that the cast to
+        // int32 doesn't overflow.
+        e = clamp(floor(e + 0.5f), cast(et, t.min()), cast(et, t.max()));
+        if (t.bits >= 32) {
+            return cast(t, e);
+        }
+        e = cast(Int(32), e);
+        et = e.type();
+    }
+    while (et.bits > 2 * t.bits) {
+        Type half = et.is_uint() ? UInt(et.bits / 2) : Int(et.bits / 2);
+        e = saturate(e, half);
+        et = half;
+    }
+    return saturate(e, t);
+}
+
+}
+
+Func convert(Func in, Type t, float scale, ChannelLayout layout, int channels) {
+    assert(in.defined() && in.outputs() == 1 && "convert takes a Func with a single value");
+    assert((layout == Layout_Planar || (in.dimensions() >= 3 && channels > 0)) &&
+           "convert to interleaved channels needs a Func with at least three dimensions");
+
+    vector<Var> args = in.args();
+    vector<Expr> call;
+    for (size_t i = 0; i < args.size(); i++) {
+        Var v = args[i];
+        call.push_back(v);
+    }
+
+    Func out(in.name() + "_convert" + Internal::unique_name('_'));
+    out(args) = convert_value(in(call), t, scale);
+
+    // 32 bytes of the narrower type: one avx register, or two sse or
+    // neon ones, per store.
+    Type from = in.output_types()[0];
+    int narrow_bytes = std::min(from.bytes(), t.bytes());
+    int lanes = 32 / narrow_bytes;
+
+    Var x = args[0];
+    if (args.size() == 1) {
+        Var xo, xi;
+        out.split(x, xo, xi, lanes * 1024, Tail_GuardWithIf)
+            .parallel(xo)
+            .vectorize(xi, lanes, Tail_GuardWithIf);
+    } else {
+        Var y = args[1], yo, yi;
+        if (layout == Layout_Interleaved) {
+            Var c = args[2];
+            out.bound(c, 0, channels).reorder(c, x, y).unroll(c);
+            out.output_buffer()
+                .set_stride(0, channels)
+                .set_stride(2, 1)
+                .set_extent(2, channels);
+        }
+        out.vectorize(x, lanes, Tail_GuardWithIf)
+            .split(y, yo, yi, 8, Tail_GuardWithIf)
+            .parallel(yo);
+    }
+    out.store_nontemporal();
+    return out;
+}
+
+Func convert(const ImageParam &in, Type t, float scale, ChannelLayout layout, int channels) {
+    vector<Var> args;
+    vector<Expr> call;
+    for (int i = 0; i < in.dimensions(); i++) {
+        Var v;
+        args.push_back(v);
+        call.push_back(v);
+    }
+    Func f(in.name());
+    f(args) = Internal::Call::make(in.parameter(), call);
+    return convert(f, t, scale, layout, channels);
+}
+
+}
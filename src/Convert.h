@@ -0,0 +1,59 @@
+#ifndef HALIDE_CONVERT_H
+#define HALIDE_CONVERT_H
+
+/** \file
+ * Defines ready-scheduled stages that copy images between types and
+ * channel layouts at memory bandwidth.
+ */
+
+#include "Func.h"
+#include "Param.h"
+
+namespace Halide {
+
+/** How the channels (the third dimension) of an image are laid out
+ * in memory. */
+enum ChannelLayout {
+    Layout_Planar,      ///< Each channel is a plane of its own: stride(0) == 1.
+    Layout_Interleaved  ///< The channels of each pixel are next to each other: stride(2) == 1.
+};
+
+/** Copy an image, converting it to the type t. The value is
+ * multiplied by scale first (e.g. 1.0f/255 to turn uint8 into float
+ * in [0, 1]). Conversions to an integer type round to nearest and
+ * saturate, narrowing by halves so that they become packs/packus on
+ * x86 and vqmovn on arm.
+ *
+ * The result is scheduled to run at memory bandwidth: in parallel
+ * strips of rows (or parallel chunks of a one-dimensional image),
+ * vectorized along the first dimension by 32 bytes' worth of the
+ * narrower of the two types, with streaming stores (see
+ * Func::store_nontemporal). Drop those with a schedule of your own if
+ * the result is read again soon. A crop is a convert realized over
+ * the part of the image that is wanted; only that part is read.
+ *
+ * With Layout_Interleaved, the result is meant to be written to a
+ * buffer with the given number of interleaved channels in its third
+ * dimension. The channel loop is innermost and unrolled, so each
+ * vector of pixels is stored as one interleaved run, and if this is
+ * the output of the pipeline its output buffer is constrained to that
+ * layout. The input can be in either layout; give an ImageParam the
+ * strides it will have (e.g. set_stride(0, channels)) so that its
+ * loads become dense loads and shuffles.
+ *
+ \code
+ ImageParam in(UInt(8), 3);
+ in.set_stride(0, 3).set_stride(2, 1);
+ Func planar = convert(in, Float(32), 1.0f / 255);
+ \endcode
+ */
+// @{
+EXPORT Func convert(Func in, Type t, float scale = 1.0f,
+                    ChannelLayout layout = Layout_Planar, int channels = 3);
+EXPORT Func convert(const ImageParam &in, Type t, float scale = 1.0f,
+                    ChannelLayout layout = Layout_Planar, int channels = 3);
+// @}
+
+}
+
+#endif
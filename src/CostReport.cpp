@@ -0,0 +1,244 @@
+#include "CostReport.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Names in the profiler's format can't have spaces.
+string sanitize(const string &s) {
+    string san = s;
+    std::replace(san.begin(), san.end(), ' ', '_');
+    return san;
+}
+
+// The totals for one produce or update step.
+struct StepCost {
+    int64_t points, ops, load_bytes, store_bytes;
+    // The sum over the arithmetic ops of the lanes they used, and of
+    // the lanes in a vector of the target of their type.
+    int64_t lanes_used, lanes_available;
+    StepCost() : points(0), ops(0), load_bytes(0), store_bytes(0),
+                 lanes_used(0), lanes_available(0) {}
+};
+
+class EstimateCost : public IRVisitor {
+public:
+    EstimateCost(const Target &t) : target(t), weight(1), in_index(false) {}
+
+    // Keyed on "produce f" or "update f", in the order first seen.
+    map<string, StepCost> steps;
+    vector<string> order;
+    // The constant size in bytes of the buffer of each Func, or -1 if
+    // the size depends on the inputs.
+    map<string, int64_t> footprint;
+
+private:
+    using IRVisitor::visit;
+
+    const Target &target;
+    int64_t weight;
+    string func, step;
+    // Address arithmetic mostly folds into the loads and stores, so
+    // it isn't counted.
+    bool in_index;
+
+    StepCost *current() {
+        if (step.empty()) return NULL;
+        if (steps.find(step) == steps.end()) {
+            order.push_back(step);
+        }
+        return &steps[step];
+    }
+
+    void count_op(Type t) {
+        StepCost *c = current();
+        if (!c || in_index) return;
+        int natural = std::max(1, target.natural_vector_size(t));
+        c->ops += weight * t.width;
+        c->lanes_used += weight * std::min(t.width, natural);
+        c->lanes_available += weight * natural;
+    }
+
+    // Whether a buffer holds (a tuple element of) the current Func.
+    bool is_current_func(const string &name) {
+        return !func.empty() && starts_with(name, func) &&
+            (name.size() == func.size() || name[func.size()] == '.');
+    }
+
+    void visit_step(const string &op_type, Stmt body) {
+        string old_step = step;
+        step = op_type + " " + sanitize(func);
+        body.accept(this);
+        step = old_step;
+    }
+
+    void visit(const Pipeline *op) {
+        string old_func = func;
+        func = op->name;
+        visit_step("produce", op->produce);
+        if (op->update.defined()) {
+            visit_step("update", op->update);
+        }
+        func = old_func;
+        op->consume.accept(this);
+    }
+
+    void visit(const For *op) {
+        op->min.accept(this);
+        op->extent.accept(this);
+        const int *extent = as_const_int(op->extent);
+        int64_t old_weight = weight;
+        if (extent && *extent > 0) weight *= *extent;
+        op->body.accept(this);
+        weight = old_weight;
+    }
+
+    void visit(const Allocate *op) {
+        int64_t bytes = op->type.bytes();
+        for (size_t i = 0; i < op->extents.size() && bytes >= 0; i++) {
+            const int *extent = as_const_int(op->extents[i]);
+            bytes = extent ? bytes * *extent : -1;
+        }
+        // Tuple elements are allocated separately.
+        string name = op->name;
+        size_t dot = name.rfind('.');
+        if (dot != string::npos && dot + 1 < name.size() &&
+            name[dot + 1] >= '0' && name[dot + 1] <= '9') {
+            name = name.substr(0, dot);
+        }
+        name = sanitize(name);
+        map<string, int64_t>::iterator it = footprint.find(name);
+        if (it == footprint.end()) {
+            footprint[name] = bytes;
+        } else if (it->second >= 0) {
+            it->second = bytes >= 0 ? it->second + bytes : -1;
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit_index(Expr index) {
+        bool old_in_index = in_index;
+        in_index = true;
+        index.accept(this);
+        in_index = old_in_index;
+    }
+
+    void visit(const Load *op) {
+        StepCost *c = current();
+        if (c) c->load_bytes += weight * op->type.bytes() * op->type.width;
+        visit_index(op->index);
+        if (op->predicate.defined()) op->predicate.accept(this);
+    }
+
+    void visit(const Store *op) {
+        StepCost *c = current();
+        if (c) {
+            Type t = op->value.type();
+            c->store_bytes += weight * t.bytes() * t.width;
+            if (is_current_func(op->name)) {
+                c->points += weight * t.width;
+            }
+        }
+        op->value.accept(this);
+        visit_index(op->index);
+        if (op->predicate.defined()) op->predicate.accept(this);
+    }
+
+    void visit(const Cast *op) {count_op(op->type); IRVisitor::visit(op);}
+    void visit(const Add *op) {count_op(op->type); IRVisitor::visit(op);}
+    void visit(const Sub *op) {count_op(op->type); IRVisitor::visit(op);}
+    void visit(const Mul *op) {count_op(op->type); IRVisitor::visit(op);}
+    void visit(const Div *op) {count_op(op->type); IRVisitor::visit(op);}
+    void visit(const Mod *op) {count_op(op->type); IRVisitor::visit(op);}
+    void visit(const Min *op) {count_op(op->type); IRVisitor::visit(op);}
+    void visit(const Max *op) {count_op(op->type); IRVisitor::visit(op);}
+    // Comparisons work at the width of what they compare.
+    void visit(const EQ *op) {count_op(op->a.type()); IRVisitor::visit(op);}
+    void visit(const NE *op) {count_op(op->a.type()); IRVisitor::visit(op);}
+    void visit(const LT *op) {count_op(op->a.type()); IRVisitor::visit(op);}
+    void visit(const LE *op) {count_op(op->a.type()); IRVisitor::visit(op);}
+    void visit(const GT *op) {count_op(op->a.type()); IRVisitor::visit(op);}
+    void visit(const GE *op) {count_op(op->a.type()); IRVisitor::visit(op);}
+    void visit(const Select *op) {count_op(op->type); IRVisitor::visit(op);}
+
+    void visit(const Call *op) {
+        // Math library calls and the bitwise intrinsics are
+        // arithmetic; the calls into the runtime and the intrinsics
+        // that just move data are not.
+        if (op->type.is_handle() || starts_with(op->name, "halide_") ||
+            op->name == Call::shuffle_vector ||
+            op->name == Call::interleave_vectors ||
+            op->name == Call::concat_vectors ||
+            op->name == Call::reinterpret ||
+            op->name == Call::return_second ||
+            op->name == Call::if_then_else ||
+            op->name == Call::trace ||
+            op->name == Call::trace_expr ||
+            op->name == Call::prefetch ||
+            op->name == Call::undef ||
+            op->name == Call::extract_buffer_min ||
+            op->name == Call::extract_buffer_extent) {
+            IRVisitor::visit(op);
+            return;
+        }
+        count_op(op->type);
+        IRVisitor::visit(op);
+    }
+};
+
+}
+
+string static_cost_report(Stmt s, const string &pipeline_name, const Target &t) {
+    EstimateCost cost(t);
+    s.accept(&cost);
+
+    // Each pipeline also has a line per metric for the whole of it,
+    // which HalideProf relies on.
+    StepCost total;
+    for (size_t i = 0; i < cost.order.size(); i++) {
+        const StepCost &c = cost.steps[cost.order[i]];
+        total.points += c.points;
+        total.ops += c.ops;
+        total.load_bytes += c.load_bytes;
+        total.store_bytes += c.store_bytes;
+        total.lanes_used += c.lanes_used;
+        total.lanes_available += c.lanes_available;
+    }
+    cost.order.insert(cost.order.begin(), "$total$ $total$");
+    cost.steps["$total$ $total$"] = total;
+
+    std::ostringstream report;
+    for (size_t i = 0; i < cost.order.size(); i++) {
+        const string &step = cost.order[i];
+        const StepCost &c = cost.steps[step];
+        string parent = i == 0 ? "null null" : "$total$ $total$";
+        string prefix = "halide_profiler ";
+        string suffix = " " + sanitize(pipeline_name) + " " + step + " " + parent + " ";
+        report << prefix << "static_points" << suffix << c.points << "\n"
+               << prefix << "static_ops" << suffix << c.ops << "\n"
+               << prefix << "static_load_bytes" << suffix << c.load_bytes << "\n"
+               << prefix << "static_store_bytes" << suffix << c.store_bytes << "\n"
+               << prefix << "static_lanes_used" << suffix << c.lanes_used << "\n"
+               << prefix << "static_lanes_available" << suffix << c.lanes_available << "\n";
+        string func = step.substr(step.find(' ') + 1);
+        map<string, int64_t>::const_iterator fp = cost.footprint.find(func);
+        if (fp != cost.footprint.end() && fp->second >= 0 && starts_with(step, "produce")) {
+            report << prefix << "static_footprint" << suffix << fp->second << "\n";
+        }
+    }
+    return report.str();
+}
+
+}
+}
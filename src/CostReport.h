@@ -0,0 +1,33 @@
+#ifndef HALIDE_COST_REPORT_H
+#define HALIDE_COST_REPORT_H
+
+/** \file
+ * Defines a static estimate of the work done by each step of a
+ * lowered pipeline.
+ */
+
+#include "IR.h"
+#include "Target.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Estimate, from a lowered and flattened statement, the work done by
+ * each produce and update step: the points stored, the arithmetic
+ * ops (counted per lane), the bytes loaded and stored, how full the
+ * vectors of the target are, and the size of the buffer each Func is
+ * allocated in when that size is a constant (e.g. a tile that is
+ * computed at a loop of its consumer). Loops with a constant extent
+ * multiply the work inside them; other loops count once, which
+ * doesn't change the work per point until they are nested within a
+ * single point. The estimate is returned as lines in the format
+ * printed by the runtime's profiler, with metrics starting with
+ * static_, so that util/HalideProf can read them along with the
+ * measured times and tell the steps that are compute-bound from the
+ * ones that are bandwidth-bound. */
+std::string static_cost_report(Stmt s, const std::string &pipeline_name, const Target &t);
+
+}
+}
+
+#endif
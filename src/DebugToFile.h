@@ -15,7 +15,8 @@ namespace Internal {
  * corresponding functions have a debug_file set, then inject code
  * that will dump the contents of those functions to a file after the
  * realization. */
-Stmt debug_to_file(Stmt s, std::string output, const std::map<std::string, Function> &env);
+Stmt debug_to_file(Stmt s, const std::vector<Function> &outputs,
+                   const std::map<std::string, Function> &env);
 
 }
 }
@@ -7,6 +7,7 @@
 #include "ModulusRemainder.h"
 #include "Debug.h"
 #include "Scope.h"
+#include "ExprUsesVar.h"
 
 namespace Halide {
 namespace Internal {
@@ -43,7 +44,7 @@ private:
         } else {
             Type t = op->type;
             t.width = new_width;
-            expr = Load::make(t, op->name, mutate(op->index), op->image, op->param);
+            expr = Load::make(t, op->name, mutate(op->index), op->image, op->param, mutate(op->predicate));
         }
     }
 
@@ -120,7 +121,7 @@ private:
         internal.push(op->name, 0);
         Expr body = mutate(op->body);
         internal.pop(op->name);
-        expr = Let::make(op->name, value, body);
+        expr = rebuild(op, value, body);
     }
 };
 
@@ -152,6 +153,16 @@ Expr extract_odd_lanes(Expr e) {
     return extract_odd_lanes(e, lets);
 }
 
+Expr extract_lanes(Expr e, int starting_lane, int lane_stride) {
+    Scope<int> lets;
+    Deinterleaver d(lets);
+    d.starting_lane = starting_lane;
+    d.lane_stride = lane_stride;
+    d.new_width = (e.type().width - starting_lane + lane_stride - 1) / lane_stride;
+    e = d.mutate(e);
+    return simplify(e);
+}
+
 Expr extract_lane(Expr e, int lane) {
     Scope<int> lets;
     Deinterleaver d(lets);
@@ -162,6 +173,169 @@ Expr extract_lane(Expr e, int lane) {
     return simplify(e);
 }
 
+class LoadsFrom : public IRVisitor {
+    const std::string &name;
+
+    using IRVisitor::visit;
+
+    void visit(const Load *op) {
+        IRVisitor::visit(op);
+        if (op->name == name) result = true;
+    }
+public:
+    bool result;
+    LoadsFrom(const std::string &n) : name(n), result(false) {}
+};
+
+bool loads_from(Expr e, const std::string &name) {
+    LoadsFrom l(name);
+    e.accept(&l);
+    return l.result;
+}
+
+// Transpose n vectors of n lanes, for n a power of two, so that lane
+// i of result j is lane j of vector i. Each of the log2(n) rounds
+// interleaves pairs of the vectors and splits the result in half
+// again, which is the unpack sequence on x86 and vzip on arm. The
+// interleavings are bound to the lets, innermost last.
+std::vector<Expr> transpose_vectors(std::vector<Expr> v, std::vector<pair<std::string, Expr> > &lets) {
+    int n = (int)v.size();
+    Type t = v[0].type();
+    for (int round = 1; round < n; round *= 2) {
+        std::vector<Expr> next(n);
+        for (int i = 0; i < n/2; i++) {
+            std::string name = unique_name('t');
+            Type wide = t.vector_of(2 * n);
+            lets.push_back(make_pair(name, Call::make(wide, Call::interleave_vectors,
+                                                      vec(v[i], v[i + n/2]), Call::Intrinsic)));
+            Expr var = Variable::make(wide, name);
+            std::vector<Expr> lo(1, var), hi(1, var);
+            for (int j = 0; j < n; j++) {
+                lo.push_back(j);
+                hi.push_back(j + n);
+            }
+            next[2*i] = Call::make(t, Call::shuffle_vector, lo, Call::Intrinsic);
+            next[2*i+1] = Call::make(t, Call::shuffle_vector, hi, Call::Intrinsic);
+        }
+        v.swap(next);
+    }
+    return v;
+}
+
+// Whether a vector access of the given stride is worth transposing
+// in a tile of n by n. Strides that aren't known at compile time would
+// otherwise be gathers. Small constant strides are left to the
+// interleaving and the strided loads of the backends, and would make
+// the rows of the tile overlap.
+bool transposable(const Ramp *ramp) {
+    int n = ramp->width;
+    if (n < 2 || n > 16 || (n & (n - 1))) {
+        return false;
+    }
+    const IntImm *stride = ramp->stride.as<IntImm>();
+    return !stride || stride->value >= n || stride->value <= -n;
+}
+
+// Find the strided vector loads in a statement that could be replaced
+// by loads of the rows of a tile: the ones that aren't under a
+// condition, and whose index doesn't depend on a let inside the
+// statement.
+class FindStridedLoads : public IRVisitor {
+    Scope<int> inner_lets;
+
+    using IRVisitor::visit;
+
+    void visit(const Let *op) {
+        op->value.accept(this);
+        inner_lets.push(op->name, 0);
+        op->body.accept(this);
+        inner_lets.pop(op->name);
+    }
+
+    void visit(const LetStmt *op) {
+        op->value.accept(this);
+        inner_lets.push(op->name, 0);
+        op->body.accept(this);
+        inner_lets.pop(op->name);
+    }
+
+    void visit(const Load *op) {
+        IRVisitor::visit(op);
+        const Ramp *ramp = op->index.as<Ramp>();
+        if (ramp && !op->predicate.defined() && transposable(ramp) &&
+            !expr_uses_vars(op->index, inner_lets)) {
+            loads.push_back(op);
+        }
+    }
+
+    void visit(const Call *op) {
+        if (op->name == Call::if_then_else && op->call_type == Call::Intrinsic) {
+            op->args[0].accept(this);
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+    // Only straight-line code.
+    void visit(const For *) {}
+    void visit(const IfThenElse *) {}
+    void visit(const Pipeline *) {}
+    void visit(const Realize *) {}
+    void visit(const Allocate *) {}
+
+public:
+    std::vector<const Load *> loads;
+};
+
+// Whether a statement might change a buffer, by storing to it or
+// passing it to an extern stage.
+class WritesTo : public IRVisitor {
+    const std::string &name;
+
+    using IRVisitor::visit;
+
+    void visit(const Store *op) {
+        IRVisitor::visit(op);
+        if (op->name == name) result = true;
+    }
+
+    void visit(const Variable *op) {
+        if (op->name == name + ".buffer") result = true;
+    }
+public:
+    bool result;
+    WritesTo(const std::string &n) : name(n), result(false) {}
+};
+
+bool writes_to(Stmt s, const std::string &name) {
+    WritesTo w(name);
+    s.accept(&w);
+    return w.result;
+}
+
+// Replace some loads with variables.
+class ReplaceLoads : public IRMutator {
+    const std::string &name;
+    const std::vector<Expr> &indices, &replacements;
+
+    using IRMutator::visit;
+
+    void visit(const Load *op) {
+        if (op->name == name) {
+            for (size_t i = 0; i < indices.size(); i++) {
+                if (equal(op->index, indices[i]) && op->type == replacements[i].type()) {
+                    expr = replacements[i];
+                    return;
+                }
+            }
+        }
+        IRMutator::visit(op);
+    }
+public:
+    ReplaceLoads(const std::string &n, const std::vector<Expr> &i, const std::vector<Expr> &r) :
+        name(n), indices(i), replacements(r) {}
+};
+
 class Interleaver : public IRMutator {
     Scope<ModulusRemainder> alignment_info;
 
@@ -251,6 +425,255 @@ class Interleaver : public IRMutator {
             expr = Select::make(condition, true_value, false_value);
         }
     }
+
+    void flatten_block(Stmt s, std::vector<Stmt> &stmts) {
+        if (const Block *b = s.as<Block>()) {
+            flatten_block(b->first, stmts);
+            if (b->rest.defined()) {
+                flatten_block(b->rest, stmts);
+            }
+        } else {
+            stmts.push_back(s);
+        }
+    }
+
+    // If the n stores starting at stmts[i] together write every lane
+    // of a dense vector, as when the channels of an interleaved image
+    // are written one at a time, return a single store of the
+    // interleaved values. Otherwise return an undefined Stmt.
+    Stmt interleave_stores(const std::vector<Stmt> &stmts, size_t i) {
+        const Store *first = stmts[i].as<Store>();
+        const Ramp *ramp = first ? first->index.as<Ramp>() : NULL;
+        const IntImm *stride = ramp ? ramp->stride.as<IntImm>() : NULL;
+        if (!stride || stride->value < 2 || stride->value > 4) {
+            return Stmt();
+        }
+        int n = stride->value;
+        if (i + n > stmts.size()) {
+            return Stmt();
+        }
+
+        // Find the value stored at each offset from the first
+        // store. The offsets must be n consecutive integers.
+        std::vector<Expr> values(n);
+        int min_offset = 0;
+        std::vector<int> offsets(n);
+        for (int j = 0; j < n; j++) {
+            const Store *store = stmts[i+j].as<Store>();
+            const Ramp *r = store ? store->index.as<Ramp>() : NULL;
+            if (!r || store->name != first->name || store->predicate.defined() ||
+                r->width != ramp->width || !equal(r->stride, ramp->stride) ||
+                store->value.type() != first->value.type()) {
+                return Stmt();
+            }
+            const IntImm *offset = simplify(r->base - ramp->base).as<IntImm>();
+            if (!offset) {
+                return Stmt();
+            }
+            offsets[j] = offset->value;
+            min_offset = std::min(min_offset, offset->value);
+        }
+        for (int j = 0; j < n; j++) {
+            int k = offsets[j] - min_offset;
+            if (k >= n || values[k].defined()) {
+                return Stmt();
+            }
+            // The values are all computed before any of them are
+            // stored, so they mustn't depend on the buffer.
+            if (loads_from(stmts[i+j].as<Store>()->value, first->name)) {
+                return Stmt();
+            }
+            values[k] = stmts[i+j].as<Store>()->value;
+        }
+
+        Type t = first->value.type();
+        Expr value = Call::make(t.vector_of(t.width * n), Call::interleave_vectors, values, Call::Intrinsic);
+        Expr index = Ramp::make(simplify(ramp->base + min_offset), 1, t.width * n);
+        return Store::make(first->name, value, index);
+    }
+
+    // If the n stores starting at stmts[i] write the n columns of a
+    // tile of n by n, as when a Func is stored transposed, return
+    // stores of its rows instead. The values are computed in place,
+    // so that they still see the stores before them.
+    Stmt transpose_stores(const std::vector<Stmt> &stmts, size_t i) {
+        const Store *first = stmts[i].as<Store>();
+        const Ramp *ramp = first ? first->index.as<Ramp>() : NULL;
+        if (!ramp || first->predicate.defined() || !transposable(ramp)) {
+            return Stmt();
+        }
+        int n = ramp->width;
+        if (i + n > stmts.size()) {
+            return Stmt();
+        }
+
+        std::vector<Expr> values(n);
+        int min_offset = 0;
+        std::vector<int> offsets(n);
+        for (int j = 0; j < n; j++) {
+            const Store *store = stmts[i+j].as<Store>();
+            const Ramp *r = store ? store->index.as<Ramp>() : NULL;
+            if (!r || store->name != first->name || store->predicate.defined() ||
+                r->width != n || !equal(r->stride, ramp->stride) ||
+                store->value.type() != first->value.type()) {
+                return Stmt();
+            }
+            const IntImm *offset = simplify(r->base - ramp->base).as<IntImm>();
+            if (!offset) {
+                return Stmt();
+            }
+            offsets[j] = offset->value;
+            min_offset = std::min(min_offset, offset->value);
+        }
+        for (int j = 0; j < n; j++) {
+            int k = offsets[j] - min_offset;
+            if (k >= n || values[k].defined() ||
+                loads_from(stmts[i+j].as<Store>()->value, first->name)) {
+                return Stmt();
+            }
+            values[k] = stmts[i+j].as<Store>()->value;
+        }
+
+        debug(3) << "Transposing " << n << " stores to " << first->name << "\n";
+        std::vector<pair<std::string, Expr> > lets;
+        for (int k = 0; k < n; k++) {
+            std::string name = unique_name('t');
+            lets.push_back(make_pair(name, values[k]));
+            values[k] = Variable::make(values[k].type(), name);
+        }
+        std::vector<Expr> rows = transpose_vectors(values, lets);
+        Expr base = simplify(ramp->base + min_offset);
+        Stmt stmt;
+        for (int j = n - 1; j >= 0; j--) {
+            Expr index = Ramp::make(simplify(base + j * ramp->stride), 1, n);
+            Stmt store = Store::make(first->name, rows[j], index);
+            stmt = stmt.defined() ? Block::make(store, stmt) : store;
+        }
+        for (size_t k = lets.size(); k > 0; k--) {
+            stmt = LetStmt::make(lets[k-1].first, lets[k-1].second, stmt);
+        }
+        return stmt;
+    }
+
+    // Replace each set of n strided loads in the statements that
+    // together read the columns of a tile of n by n with the
+    // transposes of dense loads of its rows, which are bound to the
+    // lets.
+    bool transpose_loads(std::vector<Stmt> &stmts, std::vector<pair<std::string, Expr> > &lets) {
+        FindStridedLoads finder;
+        for (size_t i = 0; i < stmts.size(); i++) {
+            stmts[i].accept(&finder);
+        }
+
+        bool changed = false;
+        std::vector<bool> used(finder.loads.size(), false);
+        for (size_t a = 0; a < finder.loads.size(); a++) {
+            if (used[a]) continue;
+            const Load *first = finder.loads[a];
+            const Ramp *ramp = first->index.as<Ramp>();
+            int n = ramp->width;
+
+            // The loads of the same buffer and stride, by how far
+            // their bases are from the first one's.
+            std::map<int, Expr> columns;
+            std::vector<size_t> members;
+            for (size_t b = a; b < finder.loads.size(); b++) {
+                const Load *load = finder.loads[b];
+                const Ramp *r = load->index.as<Ramp>();
+                if (used[b] || load->name != first->name || load->type != first->type ||
+                    !equal(r->stride, ramp->stride)) {
+                    continue;
+                }
+                const IntImm *offset = simplify(r->base - ramp->base).as<IntImm>();
+                if (!offset) continue;
+                columns[offset->value] = load->index;
+                members.push_back(b);
+            }
+            if ((int)columns.size() != n ||
+                columns.rbegin()->first - columns.begin()->first != n - 1) {
+                continue;
+            }
+            for (size_t m = 0; m < members.size(); m++) {
+                used[members[m]] = true;
+            }
+
+            bool written = false;
+            for (size_t i = 0; i < stmts.size(); i++) {
+                written = written || writes_to(stmts[i], first->name);
+            }
+            if (written) continue;
+
+            debug(3) << "Transposing " << n << " loads from " << first->name << "\n";
+            Expr base = simplify(ramp->base + columns.begin()->first);
+            std::vector<Expr> rows(n);
+            for (int j = 0; j < n; j++) {
+                std::string name = unique_name('t');
+                Expr index = Ramp::make(simplify(base + j * ramp->stride), 1, n);
+                lets.push_back(make_pair(name, Load::make(first->type, first->name, index,
+                                                          first->image, first->param)));
+                rows[j] = Variable::make(first->type, name);
+            }
+            std::vector<Expr> cols = transpose_vectors(rows, lets);
+
+            std::vector<Expr> indices;
+            for (std::map<int, Expr>::iterator iter = columns.begin(); iter != columns.end(); ++iter) {
+                indices.push_back(iter->second);
+            }
+            ReplaceLoads replacer(first->name, indices, cols);
+            for (size_t i = 0; i < stmts.size(); i++) {
+                stmts[i] = replacer.mutate(stmts[i]);
+            }
+            changed = true;
+        }
+        return changed;
+    }
+
+    void visit(const Block *op) {
+        std::vector<Stmt> stmts;
+        flatten_block(op, stmts);
+
+        bool changed = false;
+        for (size_t i = 0; i < stmts.size(); i++) {
+            Stmt s = mutate(stmts[i]);
+            changed = changed || !s.same_as(stmts[i]);
+            stmts[i] = s;
+        }
+
+        std::vector<pair<std::string, Expr> > lets;
+        changed = transpose_loads(stmts, lets) || changed;
+
+        std::vector<Stmt> result;
+        for (size_t i = 0; i < stmts.size(); i++) {
+            Stmt s = interleave_stores(stmts, i);
+            if (s.defined()) {
+                const Store *store = s.as<Store>();
+                debug(3) << "Interleaving stores to " << store->name << "\n";
+                int n = store->value.type().width / stmts[i].as<Store>()->value.type().width;
+                result.push_back(s);
+                i += n - 1;
+                changed = true;
+            } else if ((s = transpose_stores(stmts, i)).defined()) {
+                result.push_back(s);
+                i += stmts[i].as<Store>()->index.type().width - 1;
+                changed = true;
+            } else {
+                result.push_back(stmts[i]);
+            }
+        }
+
+        if (!changed) {
+            stmt = op;
+            return;
+        }
+
+        stmt = result.back();
+        for (size_t i = result.size() - 1; i > 0; i--) {
+            stmt = Block::make(result[i-1], stmt);
+        }
+        for (size_t i = lets.size(); i > 0; i--) {
+            stmt = LetStmt::make(lets[i-1].first, lets[i-1].second, stmt);
+        }
+    }
 };
 
 Stmt rewrite_interleavings(Stmt s) {
@@ -290,6 +713,13 @@ void deinterleave_vector_test() {
           Load::make(ramp_a.type(), "buf", ramp_a, Buffer(), Parameter()),
           Load::make(ramp_b.type(), "buf", ramp_b, Buffer(), Parameter()));
 
+    Expr ramp_c = Ramp::make(x + 10, 9, 2);
+    Expr lanes = extract_lanes(ramp, 2, 3);
+    if (!equal(lanes, ramp_c)) {
+        std::cerr << lanes << " != " << ramp_c << "\n";
+        assert(false);
+    }
+
     std::cout << "deinterleave_vector test passed" << std::endl;
 }
 
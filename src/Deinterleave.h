@@ -4,8 +4,9 @@
 /** \file
  *
  * Defines methods for splitting up a vector into the even lanes and
- * the odd lanes. Useful for optimizing expressions such as select(x %
- * 2, f(x/2), g(x/2))
+ * the odd lanes, or more generally into every nth lane. Useful for
+ * optimizing expressions such as select(x % 2, f(x/2), g(x/2)), and
+ * accesses to interleaved image data.
  */
 
 #include "IR.h"
@@ -22,8 +23,14 @@ Expr extract_even_lanes(Expr a);
 /** Extract the nth lane of a vector */
 Expr extract_lane(Expr vec, int lane);
 
+/** Extract every lane_stride-th lane of a vector, starting at the
+ * given lane. Used for splitting up the channels of interleaved
+ * data. */
+Expr extract_lanes(Expr vec, int starting_lane, int lane_stride);
+
 /** Look through a statement for expressions of the form select(ramp %
- * 2 == 0, a, b) and replace them with calls to an interleave
+ * 2 == 0, a, b), and for runs of strided stores that together write
+ * a dense vector, and replace them with calls to an interleave
  * intrinsic */
 Stmt rewrite_interleavings(Stmt s);
 
@@ -0,0 +1,251 @@
+#include "DeviceSplit.h"
+#include "CodeGen_GPU_Dev.h"
+#include "IRMutator.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "Debug.h"
+
+#include <iostream>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+
+namespace {
+
+class ContainsGPULoop : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const For *op) {
+        if (CodeGen_GPU_Dev::is_gpu_var(op->name)) {
+            result = true;
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+public:
+    bool result;
+    ContainsGPULoop() : result(false) {}
+};
+
+// Narrow the range of the loop over a pure dimension by rewriting the
+// loop bounds that are defined in terms of the inferred bounds. The
+// new bounds are clamped to the old ones, so that bounds inference
+// still finds the inferred bounds cover them.
+class NarrowLoop : public IRMutator {
+    const string loop_var;
+    Expr new_min, new_max;
+
+    using IRMutator::visit;
+
+    void visit(const LetStmt *op) {
+        Stmt body = mutate(op->body);
+        if (op->name == loop_var + ".loop_min" && new_min.defined()) {
+            stmt = LetStmt::make(op->name, max(op->value, new_min), body);
+        } else if (op->name == loop_var + ".loop_max" && new_max.defined()) {
+            stmt = LetStmt::make(op->name, min(op->value, new_max), body);
+        } else if (op->name == loop_var + ".loop_extent") {
+            Expr loop_min = Variable::make(Int(32), loop_var + ".loop_min");
+            Expr loop_max = Variable::make(Int(32), loop_var + ".loop_max");
+            stmt = LetStmt::make(op->name, max(loop_max + 1 - loop_min, 0), body);
+        } else if (body.same_as(op->body)) {
+            stmt = op;
+        } else {
+            stmt = LetStmt::make(op->name, op->value, body);
+        }
+    }
+
+public:
+    NarrowLoop(const string &v, Expr mn, Expr mx) : loop_var(v), new_min(mn), new_max(mx) {}
+};
+
+// Turn the gpu loops of a loop nest into cpu ones: the block loops
+// parallel, and the thread loops serial. The loops and the variables
+// derived from them are renamed, so that codegen doesn't make kernels
+// of them.
+class MoveToCPU : public IRMutator {
+    using IRMutator::visit;
+
+    static string cpu_name(const string &name) {
+        string result;
+        size_t start = 0;
+        while (true) {
+            size_t end = name.find('.', start);
+            string part = name.substr(start, end == string::npos ? string::npos : end - start);
+            if (CodeGen_GPU_Dev::is_gpu_var(part)) {
+                part += "_cpu";
+            }
+            result += part;
+            if (end == string::npos) break;
+            result += '.';
+            start = end + 1;
+        }
+        return result;
+    }
+
+    void visit(const Variable *op) {
+        string name = cpu_name(op->name);
+        if (name == op->name) {
+            expr = op;
+        } else {
+            expr = Variable::make(op->type, name);
+        }
+    }
+
+    void visit(const LetStmt *op) {
+        Expr value = mutate(op->value);
+        Stmt body = mutate(op->body);
+        stmt = LetStmt::make(cpu_name(op->name), value, body);
+    }
+
+    void visit(const Let *op) {
+        Expr value = mutate(op->value);
+        Expr body = mutate(op->body);
+        expr = Let::make(cpu_name(op->name), value, body);
+    }
+
+    void visit(const For *op) {
+        Expr min = mutate(op->min);
+        Expr extent = mutate(op->extent);
+        Stmt body = mutate(op->body);
+        For::ForType for_type = op->for_type;
+        string name = base_name(op->name);
+        if (CodeGen_GPU_Dev::is_gpu_var(name)) {
+            for_type = starts_with(name, "blockid") ? For::Parallel : For::Serial;
+        }
+        stmt = For::make(cpu_name(op->name), min, extent, for_type, body);
+    }
+};
+
+class SplitDevices : public IRMutator {
+    const map<string, Function> &env;
+
+    using IRMutator::visit;
+
+    // The dimension of the storage the loop var is, or -1 if the
+    // function can't be split between devices.
+    int split_dimension(Function f, Stmt produce) {
+        const Schedule &s = f.schedule();
+        const string &var = s.device_split_var;
+        string reason;
+        ContainsGPULoop gpu;
+        produce.accept(&gpu);
+        bool folded = false;
+        for (size_t i = 0; i < s.storage_folds.size(); i++) {
+            folded = folded || s.storage_folds[i].var == var;
+        }
+        if (f.outputs() != 1) {
+            reason = "it has more than one value";
+        } else if (s.storage_dims.empty() || s.storage_dims.back() != var) {
+            reason = var + " is not the outermost dimension of its storage";
+        } else if (folded) {
+            reason = "its storage is folded over " + var;
+        } else if (!gpu.result) {
+            reason = "it isn't scheduled on the gpu";
+        } else {
+            for (size_t i = 0; i < f.args().size(); i++) {
+                if (f.args()[i] == var) return (int)i;
+            }
+        }
+        std::cerr << "Warning: Not splitting " << f.name()
+                  << " between the cpu and the gpu because " << reason << "\n";
+        return -1;
+    }
+
+    void visit(const Pipeline *op) {
+        IRMutator::visit(op);
+        map<string, Function>::const_iterator iter = env.find(op->name);
+        if (iter == env.end() || iter->second.schedule().device_split_var.empty()) {
+            return;
+        }
+        op = stmt.as<Pipeline>();
+        Function f = iter->second;
+        int dim = split_dimension(f, op->produce);
+        if (dim < 0) return;
+
+        const Schedule &s = f.schedule();
+        const string &var = s.device_split_var;
+        debug(3) << "Splitting " << op->name << " between the cpu and the gpu over " << var << "\n";
+
+        // Keep the tiles of the var whole on the gpu side.
+        int factor = 1;
+        for (size_t i = 0; i < s.splits.size(); i++) {
+            const IntImm *c = s.splits[i].factor.as<IntImm>();
+            if (s.splits[i].is_split() && s.splits[i].old_var == var && c) {
+                factor = c->value;
+                break;
+            }
+        }
+
+        string prefix = op->name + ".s0." + var;
+        string split_name = op->name + ".device_split";
+        Expr t_min = Variable::make(Int(32), prefix + ".min");
+        Expr t_max = Variable::make(Int(32), prefix + ".max");
+        Expr extent = t_max + 1 - t_min;
+        Expr gpu_extent = Call::make(Int(32), "halide_device_split_extent",
+                                     vec<Expr>(op->name, extent), Call::Extern);
+        if (factor > 1) {
+            gpu_extent = (gpu_extent / factor) * factor;
+        }
+        gpu_extent = clamp(gpu_extent, 0, extent);
+        Expr gpu_extent_var = Variable::make(Int(32), split_name + ".gpu_extent");
+        Expr cpu_extent = extent - gpu_extent_var;
+        Expr split_point = t_min + gpu_extent_var;
+
+        // The gpu part is launched first, and doesn't wait for the
+        // kernels to finish.
+        Expr flush = Call::make(Int(32), "halide_dev_flush", vector<Expr>(), Call::Extern);
+        Stmt gpu = NarrowLoop(prefix, Expr(), split_point - 1).mutate(op->produce);
+        gpu = IfThenElse::make(gpu_extent_var > 0, Block::make(gpu, Evaluate::make(flush)));
+
+        Stmt cpu = NarrowLoop(prefix, split_point, Expr()).mutate(op->produce);
+        cpu = IfThenElse::make(cpu_extent > 0, MoveToCPU().mutate(cpu));
+
+        // The var is the outermost dimension of the storage, so the
+        // gpu part is one contiguous range of it.
+        string d = int_to_string(dim);
+        Expr stride = Variable::make(Int(32), op->name + ".stride." + d);
+        Expr buf_min = Variable::make(Int(32), op->name + ".min." + d);
+        Expr elem_size = f.output_types()[0].bytes();
+        Expr offset = Cast::make(Int(64), (t_min - buf_min) * stride) * elem_size;
+        Expr size = Cast::make(Int(64), gpu_extent_var * stride) * elem_size;
+        Expr buffer = Variable::make(Handle(), op->name + ".buffer");
+        Expr copy = Call::make(Int(32), "halide_copy_to_host_range",
+                               vec<Expr>(buffer, offset, size), Call::Extern);
+
+        Expr now = Call::make(Int(64), "halide_current_time_ns", vector<Expr>(), Call::Extern);
+        Expr launched = Variable::make(Int(64), split_name + ".launched");
+        Expr cpu_done = Variable::make(Int(64), split_name + ".cpu_done");
+        Expr synced = Variable::make(Int(64), split_name + ".synced");
+        Expr report = Call::make(Int(32), "halide_device_split_report",
+                                 vec<Expr>(op->name, gpu_extent_var, cpu_extent,
+                                           cpu_done - launched, synced - cpu_done),
+                                 Call::Extern);
+
+        Stmt produce = LetStmt::make(split_name + ".synced", now, Evaluate::make(report));
+        produce = Block::make(Evaluate::make(copy), produce);
+        produce = LetStmt::make(split_name + ".cpu_done", now, produce);
+        produce = Block::make(cpu, produce);
+        produce = LetStmt::make(split_name + ".launched", now, produce);
+        produce = Block::make(gpu, produce);
+        produce = LetStmt::make(split_name + ".gpu_extent", gpu_extent, produce);
+
+        stmt = Pipeline::make(op->name, produce, op->update, op->consume);
+    }
+
+public:
+    SplitDevices(const map<string, Function> &e) : env(e) {}
+};
+
+}
+
+Stmt split_devices(Stmt s, const map<string, Function> &env) {
+    return SplitDevices(env).mutate(s);
+}
+
+}
+}
@@ -0,0 +1,32 @@
+#ifndef HALIDE_DEVICE_SPLIT_H
+#define HALIDE_DEVICE_SPLIT_H
+
+/** \file
+ * Defines the lowering pass that computes functions scheduled with
+ * Func::split_devices on the gpu and the cpu at once.
+ */
+
+#include "IR.h"
+#include "Function.h"
+
+#include <map>
+
+namespace Halide {
+namespace Internal {
+
+/** Replace the produce step of each function with a device split
+ * var by two copies of it: one over the bottom of the range of the
+ * var, launched on the gpu first, and one over the rest, with the
+ * gpu loops made cpu loops, run while the gpu works. The part the gpu
+ * computed is then copied into the host buffer, and the time each
+ * part took is reported to the runtime, which decides the next
+ * split. Must run after the realizations of the functions have been
+ * injected, and before bounds inference, which then sees that each
+ * copy only covers part of the range. Only useful when the target
+ * has a gpu feature. */
+Stmt split_devices(Stmt s, const std::map<std::string, Function> &env);
+
+}
+}
+
+#endif
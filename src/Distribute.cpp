@@ -0,0 +1,190 @@
+#include "Distribute.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "Debug.h"
+
+#include <iostream>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+
+namespace {
+
+// Set the range of the loop over a pure dimension, by replacing the
+// loop bounds that are defined in terms of the inferred bounds.
+class RestrictLoop : public IRMutator {
+    const string loop_var;
+    Expr new_min, new_max;
+
+    using IRMutator::visit;
+
+    void visit(const LetStmt *op) {
+        Stmt body = mutate(op->body);
+        if (op->name == loop_var + ".loop_min") {
+            stmt = LetStmt::make(op->name, new_min, body);
+        } else if (op->name == loop_var + ".loop_max") {
+            stmt = LetStmt::make(op->name, new_max, body);
+        } else if (op->name == loop_var + ".loop_extent") {
+            Expr loop_min = Variable::make(Int(32), loop_var + ".loop_min");
+            Expr loop_max = Variable::make(Int(32), loop_var + ".loop_max");
+            stmt = LetStmt::make(op->name, max(loop_max + 1 - loop_min, 0), body);
+        } else if (body.same_as(op->body)) {
+            stmt = op;
+        } else {
+            stmt = LetStmt::make(op->name, op->value, body);
+        }
+    }
+
+public:
+    RestrictLoop(const string &v, Expr mn, Expr mx) : loop_var(v), new_min(mn), new_max(mx) {}
+};
+
+class DistributeFunctions : public IRMutator {
+    const map<string, Function> &env;
+    const vector<Function> &outputs;
+
+    using IRMutator::visit;
+
+    bool is_output(const string &name) {
+        for (size_t i = 0; i < outputs.size(); i++) {
+            if (outputs[i].name() == name) return true;
+        }
+        return false;
+    }
+
+    // The dimension of the storage the distributed var is, or -1 if
+    // the function can't be distributed.
+    int distributed_dimension(Function f) {
+        const Schedule &s = f.schedule();
+        const string &var = s.distributed_var;
+        string reason;
+        bool folded = false;
+        for (size_t i = 0; i < s.storage_folds.size(); i++) {
+            folded = folded || s.storage_folds[i].var == var;
+        }
+        if (f.outputs() != 1) {
+            reason = "it has more than one value";
+        } else if (s.storage_dims.empty() || s.storage_dims.back() != var) {
+            reason = var + " is not the outermost dimension of its storage";
+        } else if (folded) {
+            reason = "its storage is folded over " + var;
+        } else if (!is_output(f.name()) &&
+                   (!s.compute_level.is_root() || !s.store_level.is_root())) {
+            // Every rank has to trade values the same number of times.
+            reason = "it is not compute_root";
+        } else {
+            for (size_t i = 0; i < f.args().size(); i++) {
+                if (f.args()[i] == var) return (int)i;
+            }
+        }
+        std::cerr << "Warning: Not distributing " << f.name()
+                  << " because " << reason << "\n";
+        return -1;
+    }
+
+    void visit(const Pipeline *op) {
+        IRMutator::visit(op);
+        map<string, Function>::const_iterator iter = env.find(op->name);
+        if (iter == env.end() || iter->second.schedule().distributed_var.empty()) {
+            return;
+        }
+        op = stmt.as<Pipeline>();
+        Function f = iter->second;
+        int dim = distributed_dimension(f);
+        if (dim < 0) return;
+
+        const Schedule &s = f.schedule();
+        const string &var = s.distributed_var;
+        string prefix = op->name + ".s0." + var;
+        Expr t_min = Variable::make(Int(32), prefix + ".min");
+        Expr t_max = Variable::make(Int(32), prefix + ".max");
+        Stmt produce;
+
+        if (is_output(op->name)) {
+            debug(3) << "Giving each rank a slice of " << op->name << " over " << var << "\n";
+
+            // Keep the tiles of the var whole.
+            int factor = 1;
+            for (size_t i = 0; i < s.splits.size(); i++) {
+                const IntImm *c = s.splits[i].factor.as<IntImm>();
+                if (s.splits[i].is_split() && s.splits[i].old_var == var && c) {
+                    factor = c->value;
+                    break;
+                }
+            }
+
+            // The slice is in terms of the rank, so bounds inference
+            // can find the regions of the producers it needs.
+            Expr extent = t_max + 1 - t_min;
+            Expr slice_min = ((extent * rank + (num_ranks * factor - 1)) / (num_ranks * factor)) * factor;
+            Expr slice_end = ((extent * (rank + 1) + (num_ranks * factor - 1)) / (num_ranks * factor)) * factor;
+            produce = RestrictLoop(prefix, t_min + slice_min,
+                                   min(t_min + slice_end - 1, t_max)).mutate(op->produce);
+            distributed_outputs = true;
+        } else {
+            debug(3) << "Trading the values of " << op->name << " over " << var << " between ranks\n";
+
+            // How much of what this rank needs it computes is only
+            // known once the other ranks say what they need, so it's
+            // clamped to what it needs, for bounds inference.
+            string owned_name = op->name + ".distributed";
+            Expr owned_min = Call::make(Int(32), "halide_distributed_owned_min",
+                                        vec<Expr>(op->name, t_min, t_max), Call::Extern);
+            Expr owned_max = Call::make(Int(32), "halide_distributed_owned_max",
+                                        vec<Expr>(op->name, t_min, t_max), Call::Extern);
+            Expr owned_min_var = Variable::make(Int(32), owned_name + ".owned_min");
+            Expr owned_max_var = Variable::make(Int(32), owned_name + ".owned_max");
+
+            Expr buffer = Variable::make(Handle(), op->name + ".buffer");
+            Expr exchange = Call::make(Int(32), "halide_distributed_exchange",
+                                       vec<Expr>(op->name, buffer, dim, t_min, t_max,
+                                                 owned_min_var, owned_max_var),
+                                       Call::Extern);
+            Stmt check = AssertStmt::make(exchange == 0,
+                                          "Failed to trade the values of " + op->name + " between ranks",
+                                          vector<Expr>());
+
+            produce = RestrictLoop(prefix, max(t_min, owned_min_var),
+                                   min(t_max, owned_max_var)).mutate(op->produce);
+            produce = Block::make(produce, check);
+            produce = LetStmt::make(owned_name + ".owned_max", owned_max, produce);
+            produce = LetStmt::make(owned_name + ".owned_min", owned_min, produce);
+        }
+
+        stmt = Pipeline::make(op->name, produce, op->update, op->consume);
+    }
+
+public:
+    DistributeFunctions(const map<string, Function> &e, const vector<Function> &o) :
+        env(e), outputs(o), distributed_outputs(false) {
+        rank = Variable::make(Int(32), "__distributed_rank");
+        num_ranks = Variable::make(Int(32), "__distributed_num_ranks");
+    }
+
+    Expr rank, num_ranks;
+    bool distributed_outputs;
+};
+
+}
+
+Stmt distribute_functions(Stmt s, const map<string, Function> &env,
+                          const vector<Function> &outputs) {
+    DistributeFunctions distribute(env, outputs);
+    s = distribute.mutate(s);
+    if (distribute.distributed_outputs) {
+        // Outside the outermost loop, so that bounds inference treats
+        // them as unknowns.
+        Expr rank = Call::make(Int(32), "halide_distributed_rank", vector<Expr>(), Call::Extern);
+        Expr num_ranks = Call::make(Int(32), "halide_distributed_num_ranks", vector<Expr>(), Call::Extern);
+        s = LetStmt::make("__distributed_num_ranks", num_ranks, s);
+        s = LetStmt::make("__distributed_rank", rank, s);
+    }
+    return s;
+}
+
+}
+}
@@ -0,0 +1,32 @@
+#ifndef HALIDE_DISTRIBUTE_H
+#define HALIDE_DISTRIBUTE_H
+
+/** \file
+ * Defines the lowering pass that splits functions scheduled with
+ * Func::distribute between the ranks of a distributed run.
+ */
+
+#include "IR.h"
+#include "Function.h"
+
+#include <map>
+#include <vector>
+
+namespace Halide {
+namespace Internal {
+
+/** Narrow the loop over the distributed var of each output function
+ * to this rank's slice of it, in terms of the rank and number of
+ * ranks, so that bounds inference finds the (smaller) regions of the
+ * other functions each rank needs, halos included. Each distributed
+ * function that isn't an output computes just the part of the region
+ * it needs that the runtime assigns to it, and then trades the rest
+ * with the other ranks. Must run after the realizations of the
+ * functions have been injected, and before bounds inference. */
+Stmt distribute_functions(Stmt s, const std::map<std::string, Function> &env,
+                          const std::vector<Function> &outputs);
+
+}
+}
+
+#endif
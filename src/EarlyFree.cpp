@@ -55,7 +55,7 @@ private:
     }
 
     void visit(const Variable *var) {
-        if (starts_with(var->name, func + ".") &&
+        if (starts_with(var->name, func, '.') &&
             ends_with(var->name, ".buffer")) {
             last_use = containing_stmt;
         }
@@ -0,0 +1,128 @@
+#include "FFT.h"
+#include "IROperator.h"
+#include "Util.h"
+
+namespace Halide {
+
+using std::vector;
+using std::string;
+
+namespace {
+
+bool is_power_of_two(int n) {
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+// Call f at args with the given dimension replaced by i.
+Tuple call_at(Func f, const vector<Var> &args, int dim, Expr i) {
+    vector<Expr> call;
+    for (size_t d = 0; d < args.size(); d++) {
+        Var v = args[d];
+        call.push_back((int)d == dim ? i : Expr(v));
+    }
+    if (f.outputs() == 1) {
+        return Tuple(cast<float>(f(call)), 0.0f);
+    }
+    return Tuple(f(call)[0], f(call)[1]);
+}
+
+void schedule_pass(Func f) {
+    vector<Var> args = f.args();
+    f.compute_root().vectorize(args[0], 4);
+    if (args.size() > 1) {
+        f.parallel(args.back());
+    }
+}
+
+}
+
+Func fft(Func in, int dim, int n, bool inverse) {
+    assert(in.defined() && "Can't take the FFT of an undefined Func");
+    assert((in.outputs() == 1 || in.outputs() == 2) &&
+           "The FFT takes a real value, or a Tuple of real and imaginary parts");
+    assert(dim >= 0 && dim < in.dimensions() && "FFT along a dimension the Func doesn't have");
+    assert(is_power_of_two(n) && "The size of an FFT must be a power of two");
+
+    string name = in.name() + (inverse ? "_ifft" : "_fft") + Internal::unique_name('_');
+    vector<Var> args = in.args();
+    Var i = args[dim];
+
+    // The twiddle factors exp(-2 pi i k / n), for k in [0, n/2).
+    Var k;
+    Func twiddle(name + "_twiddle");
+    Expr angle = (float)(-2 * 3.14159265358979323846 / n) * cast<float>(k);
+    if (inverse) angle = -angle;
+    twiddle(k) = Tuple(cos(angle), sin(angle));
+    twiddle.compute_root();
+
+    // Pass s takes the transforms of size m at stride 2^s to the
+    // ones of size m/2 at stride 2^(s+1).
+    Func prev = in;
+    for (int s = 1, m = n; m > 1; s *= 2, m /= 2) {
+        Expr q = i % s, p = i / (2 * s), is_sum = (i / s) % 2 == 0;
+        Tuple a = call_at(prev, args, dim, q + s * p);
+        Tuple b = call_at(prev, args, dim, q + s * (p + m / 2));
+        Tuple w = twiddle(p * s);
+        Expr dr = a[0] - b[0], di = a[1] - b[1];
+        Func pass(name + "_" + Internal::int_to_string(s));
+        pass(args) = Tuple(select(is_sum, a[0] + b[0], dr * w[0] - di * w[1]),
+                           select(is_sum, a[1] + b[1], dr * w[1] + di * w[0]));
+        schedule_pass(pass);
+        prev = pass;
+    }
+
+    Func out(name);
+    Tuple result = call_at(prev, args, dim, i);
+    if (inverse) {
+        out(args) = Tuple(result[0] / n, result[1] / n);
+    } else {
+        out(args) = result;
+    }
+    return out;
+}
+
+Func fft_convolve(Func in, Func kernel, int radius, int tile_size) {
+    assert(in.defined() && in.dimensions() == 2 && in.outputs() == 1 &&
+           "fft_convolve takes a two dimensional Func with a single value");
+    assert(kernel.defined() && kernel.dimensions() == 2 && kernel.outputs() == 1 &&
+           "The kernel of fft_convolve must be a two dimensional Func with a single value");
+    assert(radius >= 0 && tile_size > 0);
+
+    int n = 1;
+    while (n < tile_size + 2 * radius) n *= 2;
+    string name = in.name() + "_fft_convolve" + Internal::unique_name('_');
+
+    // The window of the input around each tile.
+    Var i, j, tx, ty;
+    Func window(name + "_window");
+    window(i, j, tx, ty) = cast<float>(in(tx * tile_size - radius + i, ty * tile_size - radius + j));
+
+    // The kernel, padded to the size of the window, with negative
+    // offsets wrapped around to the end.
+    Expr kx = select(i <= radius, i, i - n), ky = select(j <= radius, j, j - n);
+    Expr inside = abs(kx) <= radius && abs(ky) <= radius;
+    Func padded(name + "_kernel");
+    padded(i, j) = select(inside, cast<float>(kernel(clamp(kx, -radius, radius),
+                                                     clamp(ky, -radius, radius))), 0.0f);
+
+    Func kernel_fft = fft(fft(padded, 0, n), 1, n);
+    kernel_fft.compute_root();
+    Func window_fft = fft(fft(window, 0, n), 1, n);
+
+    Func product(name + "_product");
+    Expr ar = window_fft(i, j, tx, ty)[0], ai = window_fft(i, j, tx, ty)[1];
+    Expr br = kernel_fft(i, j)[0], bi = kernel_fft(i, j)[1];
+    product(i, j, tx, ty) = Tuple(ar * br - ai * bi, ar * bi + ai * br);
+    schedule_pass(product);
+
+    // Only the middle of each window isn't wrapped around.
+    Func result = fft(fft(product, 0, n, true), 1, n, true);
+    result.compute_root();
+    Var x, y;
+    Func out(name);
+    out(x, y) = result(x % tile_size + radius, y % tile_size + radius,
+                       x / tile_size, y / tile_size)[0];
+    return out;
+}
+
+}
@@ -0,0 +1,43 @@
+#ifndef HALIDE_FFT_H
+#define HALIDE_FFT_H
+
+/** \file
+ * Defines fast Fourier transforms written as Halide Funcs, and a
+ * convolution that uses them.
+ */
+
+#include "Func.h"
+
+namespace Halide {
+
+/** The discrete Fourier transform of a Func along one dimension, over
+ * [0, n) in that dimension, where n is a power of two. The source
+ * either has a single real value, or a Tuple of the real and
+ * imaginary parts. The result is a Tuple of the real and imaginary
+ * parts, as floats. The inverse transform uses the opposite sign in
+ * the exponent, and divides by n, so that it undoes the forward one.
+ *
+ * This is a radix-2 Stockham FFT, which needs no bit reversal, made
+ * of one Func per pass, so it takes log2(n) Funcs. They're computed
+ * at root, vectorized along the first dimension, and parallelized
+ * along the last when there's more than one. */
+EXPORT Func fft(Func in, int dim, int n, bool inverse = false);
+
+/** Convolve a two dimensional Func with a kernel that is nonzero in
+ * [-radius, radius] in both dimensions, using FFTs. The result is
+ * sum over k of in(x - k.x, y - k.y) * kernel(k.x, k.y). Costs
+ * O(log(tile_size + 2 * radius)) per pixel rather than the O(radius^2)
+ * of a direct convolution, so it's faster for large kernels.
+ *
+ * The output is computed in tiles of tile_size by tile_size
+ * pixels. Each tile reads a square window of the input around it,
+ * whose size is the next power of two that's at least tile_size + 2 *
+ * radius (this is overlap-save). So the input must be defined that
+ * far beyond the region of the output that's used (see
+ * BoundaryConditions.h). The transform of the kernel is computed once
+ * per realization. */
+EXPORT Func fft_convolve(Func in, Func kernel, int radius, int tile_size = 64);
+
+}
+
+#endif
@@ -85,6 +85,48 @@ Image<uint32_t> integer_divide_table_s32() {
 }
 }
 
+namespace {
+
+// The multiplier in the low half and the shift in the high half of
+// each element, so that a vector of denominators needs just one
+// gather.
+Image<uint16_t> packed_integer_divide_table_s8() {
+    static Image<uint16_t> im(256);
+    static bool initialized = false;
+    if (!initialized) {
+        initialized = true;
+        for (size_t i = 0; i < 256; i++) {
+            im(i) = (uint16_t)(table_runtime_s8[i][2] | (table_runtime_s8[i][3] << 8));
+        }
+    }
+    return im;
+}
+
+Image<uint32_t> packed_integer_divide_table_s16() {
+    static Image<uint32_t> im(256);
+    static bool initialized = false;
+    if (!initialized) {
+        initialized = true;
+        for (size_t i = 0; i < 256; i++) {
+            im(i) = (uint32_t)(table_runtime_s16[i][2] | (table_runtime_s16[i][3] << 16));
+        }
+    }
+    return im;
+}
+
+// For unsigned numerators, the shift is floor(log2(denominator - 1)),
+// which is cheaper to compute than to look up.
+Expr unsigned_shift(Expr denominator, Type t) {
+    Expr d = denominator - cast<uint8_t>(1);
+    Expr shift = cast(t, 0);
+    for (int i = 1; i < 8; i++) {
+        shift += select(d >= cast<uint8_t>(1 << i), cast(t, 1), cast(t, 0));
+    }
+    return shift;
+}
+
+}
+
 Expr fast_integer_divide(Expr numerator, Expr denominator) {
     if (is_const(denominator)) {
         // There's code elsewhere for this case.
@@ -100,30 +142,28 @@ Expr fast_integer_divide(Expr numerator, Expr denominator) {
 
     Expr result;
     if (t.is_uint()) {
-        Expr mul, shift;
+        Expr mul;
         switch(t.bits) {
         case 8:
         {
             Image<uint8_t> table = IntegerDivideTable::integer_divide_table_u8();
             mul = table(denominator, 0);
-            shift = table(denominator, 1);
             break;
         }
         case 16:
         {
             Image<uint16_t> table = IntegerDivideTable::integer_divide_table_u16();
             mul = table(denominator, 0);
-            shift = table(denominator, 1);
             break;
         }
         default: // 32
         {
             Image<uint32_t> table = IntegerDivideTable::integer_divide_table_u32();
             mul = table(denominator, 0);
-            shift = table(denominator, 1);
             break;
         }
         }
+        Expr shift = unsigned_shift(denominator, t);
 
         // Multiply-keep-high-half
         result = (cast(wide, mul) * numerator);
@@ -146,16 +186,18 @@ Expr fast_integer_divide(Expr numerator, Expr denominator) {
         switch(t.bits) {
         case 8:
         {
-            Image<uint8_t> table = IntegerDivideTable::integer_divide_table_s8();
-            mul = table(denominator, 0);
-            shift = table(denominator, 1);
+            Image<uint16_t> table = packed_integer_divide_table_s8();
+            Expr packed = table(denominator);
+            mul = cast<uint8_t>(packed);
+            shift = cast<uint8_t>(packed >> 8);
             break;
         }
         case 16:
         {
-            Image<uint16_t> table = IntegerDivideTable::integer_divide_table_s16();
-            mul = table(denominator, 0);
-            shift = table(denominator, 1);
+            Image<uint32_t> table = packed_integer_divide_table_s16();
+            Expr packed = table(denominator);
+            mul = cast<uint16_t>(packed);
+            shift = cast<uint16_t>(packed >> 16);
             break;
         }
         default: // 32
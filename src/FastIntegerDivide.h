@@ -34,8 +34,10 @@ EXPORT Image<uint32_t> integer_divide_table_s32();
  * use this function (but it won't hurt).
  *
  * This function vectorizes well on arm, and well on x86 for 16 and 8
- * bit vectors. For 32-bit vectors on x86 you're better off using
- * native integer division.
+ * bit vectors. A vector of different denominators costs one table
+ * lookup per lane (two for signed 32-bit numerators), which are
+ * gathered eight lanes at a time on avx2. For 32-bit vectors on x86
+ * without avx2 you're better off using native integer division.
  *
  * Also, this routine treats division by zero as division by
  * 256. I.e. it interprets the uint8 divisor as a number from 1 to 256
@@ -0,0 +1,112 @@
+#include "FirstTouch.h"
+#include "IRMutator.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "CodeGen_GPU_Dev.h"
+#include "Debug.h"
+
+#include <algorithm>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+
+namespace {
+
+// Allocations smaller than this aren't worth a parallel loop. Matches
+// the default threshold for asking for huge pages in the runtime.
+const int first_touch_bytes = 4 << 20;
+
+// Write once per page of this size. Huge pages are only ever bigger.
+const int page_bytes = 4096;
+
+class ContainsParallelLoop : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const For *op) {
+        if (op->for_type == For::Parallel) {
+            result = true;
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+public:
+    bool result;
+    ContainsParallelLoop() : result(false) {}
+};
+
+class FirstTouch : public IRMutator {
+    using IRMutator::visit;
+
+    void visit(const For *op) {
+        if (op->for_type == For::Parallel ||
+            CodeGen_GPU_Dev::is_gpu_var(op->name)) {
+            // Allocations inside parallel loops and gpu kernels
+            // already belong to one thread.
+            stmt = op;
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const Allocate *op) {
+        Stmt body = mutate(op->body);
+
+        ContainsParallelLoop parallel;
+        body.accept(&parallel);
+
+        if (!parallel.result || op->type.bits < 8 || op->extents.empty()) {
+            if (body.same_as(op->body)) {
+                stmt = op;
+            } else {
+                stmt = Allocate::make(op->name, op->type, op->extents, body);
+            }
+            return;
+        }
+
+        debug(3) << "First-touching " << op->name << " in parallel\n";
+
+        // Slice the buffer along its outermost dimension, which is the
+        // one parallel loops usually split their consumers over. The
+        // slices are touched by the same dynamic thread pool that will
+        // compute them, so this only approximates the partitioning of
+        // the consumer.
+        Expr slice_elems = 1;
+        for (size_t i = 0; i + 1 < op->extents.size(); i++) {
+            slice_elems *= op->extents[i];
+        }
+        Expr slices = op->extents.back();
+        Expr total_bytes = (Cast::make(Int(64), slice_elems) *
+                            Cast::make(Int(64), slices) *
+                            op->type.bytes());
+
+        int page_elems = std::max(1, page_bytes / op->type.bytes());
+        string slice_name = op->name + ".first_touch";
+        string page_name = op->name + ".first_touch_page";
+        Expr slice = Variable::make(Int(32), slice_name);
+        Expr page = Variable::make(Int(32), page_name);
+        Expr pages = (slice_elems + (page_elems - 1)) / page_elems;
+
+        // The memory is uninitialized, so writing zeros to it doesn't
+        // change what the pipeline computes.
+        Stmt touch = Store::make(op->name, make_zero(op->type),
+                                 slice * slice_elems + page * page_elems);
+        touch = For::make(page_name, 0, pages, For::Serial, touch);
+        touch = For::make(slice_name, 0, slices, For::Parallel, touch);
+        touch = IfThenElse::make(total_bytes >= Cast::make(Int(64), first_touch_bytes), touch);
+
+        body = Block::make(touch, body);
+        stmt = Allocate::make(op->name, op->type, op->extents, body);
+    }
+};
+
+}
+
+Stmt first_touch_allocations(Stmt s) {
+    return FirstTouch().mutate(s);
+}
+
+}
+}
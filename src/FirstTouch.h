@@ -0,0 +1,27 @@
+#ifndef HALIDE_FIRST_TOUCH_H
+#define HALIDE_FIRST_TOUCH_H
+
+/** \file
+ * Defines the lowering pass that first-touches large allocations in
+ * parallel, so their pages land on the NUMA nodes that use them.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Find large allocations outside of any parallel loop that are
+ * consumed by one, and write to each of their pages from a parallel
+ * loop over the outermost dimension before anything else touches
+ * them. The kernel places a page on the node of the thread that first
+ * touches it, so this puts each slice of the buffer near the thread
+ * pool worker likely to compute it, instead of all of it near the
+ * thread that allocated it. Used under the huge_pages target
+ * feature. Must run after storage flattening. */
+Stmt first_touch_allocations(Stmt s);
+
+}
+}
+
+#endif
@@ -0,0 +1,550 @@
+#include "FragmentFile.h"
+#include "ScheduleFile.h"
+#include "FindCalls.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "Debug.h"
+
+#include <fstream>
+#include <sstream>
+#include <set>
+
+namespace Halide {
+
+using std::string;
+using std::vector;
+using std::map;
+using std::set;
+using std::pair;
+using std::ostringstream;
+using std::istringstream;
+
+using namespace Internal;
+
+namespace {
+
+void fragment_error(const string &what) {
+    std::cerr << "Error in pipeline fragment: " << what << "\n";
+    assert(false);
+}
+
+void write_type(ostringstream &out, Type t) {
+    if (t.width != 1) fragment_error("vector types can't be written");
+    const char codes[] = {'i', 'u', 'f', 'h'};
+    out << codes[t.code] << t.bits;
+}
+
+// The inputs a fragment reads, by name.
+struct FragmentInputs {
+    // The type and dimensions of each image.
+    map<string, pair<Type, int> > images;
+    map<string, Type> scalars;
+};
+
+// Write an Expr in prefix form, e.g. (add (var i32 x) (int 1)).
+class WriteExpr : public IRVisitor {
+    ostringstream &out;
+    FragmentInputs &inputs;
+
+    using IRVisitor::visit;
+
+    void node(const char *name, Expr a) {
+        out << "(" << name << " ";
+        a.accept(this);
+        out << ")";
+    }
+
+    void node(const char *name, Expr a, Expr b) {
+        out << "(" << name << " ";
+        a.accept(this);
+        out << " ";
+        b.accept(this);
+        out << ")";
+    }
+
+    void visit(const IntImm *op) {out << "(int " << op->value << ")";}
+    void visit(const FloatImm *op) {
+        ostringstream f;
+        f.precision(9);
+        f << op->value;
+        out << "(float " << f.str() << ")";
+    }
+    void visit(const StringImm *) {fragment_error("string constants can't be written");}
+    void visit(const Cast *op) {
+        out << "(cast ";
+        write_type(out, op->type);
+        out << " ";
+        op->value.accept(this);
+        out << ")";
+    }
+    void visit(const Add *op) {node("add", op->a, op->b);}
+    void visit(const Sub *op) {node("sub", op->a, op->b);}
+    void visit(const Mul *op) {node("mul", op->a, op->b);}
+    void visit(const Div *op) {node("div", op->a, op->b);}
+    void visit(const Mod *op) {node("mod", op->a, op->b);}
+    void visit(const Min *op) {node("min", op->a, op->b);}
+    void visit(const Max *op) {node("max", op->a, op->b);}
+    void visit(const EQ *op) {node("eq", op->a, op->b);}
+    void visit(const NE *op) {node("ne", op->a, op->b);}
+    void visit(const LT *op) {node("lt", op->a, op->b);}
+    void visit(const LE *op) {node("le", op->a, op->b);}
+    void visit(const GT *op) {node("gt", op->a, op->b);}
+    void visit(const GE *op) {node("ge", op->a, op->b);}
+    void visit(const And *op) {node("and", op->a, op->b);}
+    void visit(const Or *op) {node("or", op->a, op->b);}
+    void visit(const Not *op) {node("not", op->a);}
+    void visit(const Select *op) {
+        out << "(select ";
+        op->condition.accept(this);
+        out << " ";
+        op->true_value.accept(this);
+        out << " ";
+        op->false_value.accept(this);
+        out << ")";
+    }
+    void visit(const Let *op) {
+        out << "(let " << op->name << " ";
+        op->value.accept(this);
+        out << " ";
+        op->body.accept(this);
+        out << ")";
+    }
+    void visit(const Variable *op) {
+        if (op->reduction_domain.defined()) {
+            out << "(rvar " << op->name << ")";
+            return;
+        }
+        out << (op->param.defined() ? "(param " : "(var ");
+        write_type(out, op->type);
+        out << " " << op->name << ")";
+        if (op->param.defined()) {
+            inputs.scalars[op->name] = op->type;
+        }
+    }
+    void visit(const Call *op) {
+        const char *kinds[] = {"image", "extern", "call", "intrinsic"};
+        if (op->call_type == Call::Image) {
+            if (!op->param.defined()) {
+                fragment_error("the compiled-in image " + op->name + " can't be written");
+            }
+            inputs.images[op->name] = std::make_pair(op->type, (int)op->args.size());
+        }
+        out << "(" << kinds[op->call_type] << " ";
+        write_type(out, op->type);
+        out << " " << op->name;
+        if (op->call_type == Call::Halide) {
+            out << " " << op->value_index;
+        }
+        for (size_t i = 0; i < op->args.size(); i++) {
+            out << " ";
+            op->args[i].accept(this);
+        }
+        out << ")";
+    }
+    void visit(const Load *) {fragment_error("loads can't be written");}
+    void visit(const Ramp *) {fragment_error("vectors can't be written");}
+    void visit(const Broadcast *) {fragment_error("vectors can't be written");}
+
+public:
+    WriteExpr(ostringstream &o, FragmentInputs &i) : out(o), inputs(i) {}
+};
+
+// Put the functions of the pipeline in an order where each one
+// comes after the ones it calls.
+void order_functions(Function f, set<string> &done, vector<Function> &order) {
+    if (done.count(f.name())) return;
+    done.insert(f.name());
+    map<string, Function> calls = find_direct_calls(f);
+    for (map<string, Function>::iterator iter = calls.begin(); iter != calls.end(); ++iter) {
+        order_functions(iter->second, done, order);
+    }
+    order.push_back(f);
+}
+
+void write_function(ostringstream &out, Function f, FragmentInputs &inputs) {
+    if (f.has_extern_definition()) {
+        fragment_error(f.name() + " has an extern definition, which can't be written");
+    }
+    WriteExpr write(out, inputs);
+
+    out << "func " << f.name();
+    for (size_t i = 0; i < f.args().size(); i++) {
+        out << " " << f.args()[i];
+    }
+    out << "\n";
+    for (size_t i = 0; i < f.values().size(); i++) {
+        out << "value ";
+        f.values()[i].accept(&write);
+        out << "\n";
+    }
+
+    for (size_t i = 0; i < f.reductions().size(); i++) {
+        const ReductionDefinition &r = f.reductions()[i];
+        out << "update\n";
+        if (r.domain.defined()) {
+            for (size_t j = 0; j < r.domain.domain().size(); j++) {
+                const ReductionVariable &v = r.domain.domain()[j];
+                out << "domain " << v.var << " ";
+                v.min.accept(&write);
+                out << " ";
+                v.extent.accept(&write);
+                out << "\n";
+            }
+        }
+        for (size_t j = 0; j < r.args.size(); j++) {
+            out << "arg ";
+            r.args[j].accept(&write);
+            out << "\n";
+        }
+        for (size_t j = 0; j < r.values.size(); j++) {
+            out << "value ";
+            r.values[j].accept(&write);
+            out << "\n";
+        }
+    }
+}
+
+// Read an Expr written by WriteExpr.
+class ReadExpr {
+    vector<string> tokens;
+    size_t pos;
+    const string &line;
+
+    const map<string, Function> &funcs;
+    const map<string, Func> &images;
+    const map<string, Expr> &params;
+    const ReductionDomain &domain;
+
+    string next() {
+        if (pos >= tokens.size()) fragment_error("unexpected end of line: " + line);
+        return tokens[pos++];
+    }
+
+    void expect(const string &token) {
+        if (next() != token) fragment_error("expected " + token + ": " + line);
+    }
+
+    int read_int() {
+        istringstream in(next());
+        int i = 0;
+        if (!(in >> i)) fragment_error("expected an integer: " + line);
+        return i;
+    }
+
+    Type read_type() {
+        string t = next();
+        int bits = 0;
+        istringstream in(t.substr(1));
+        if (t.empty() || !(in >> bits)) fragment_error("bad type " + t + ": " + line);
+        switch (t[0]) {
+        case 'i': return Int(bits);
+        case 'u': return UInt(bits);
+        case 'f': return Float(bits);
+        case 'h': return Handle(bits);
+        default:
+            fragment_error("bad type " + t + ": " + line);
+            return Type();
+        }
+    }
+
+    vector<Expr> read_args() {
+        vector<Expr> args;
+        while (pos < tokens.size() && tokens[pos] != ")") {
+            args.push_back(read());
+        }
+        return args;
+    }
+
+public:
+    ReadExpr(const string &text, const string &l,
+             const map<string, Function> &f,
+             const map<string, Func> &i,
+             const map<string, Expr> &p,
+             const ReductionDomain &d) :
+        pos(0), line(l), funcs(f), images(i), params(p), domain(d) {
+        string token;
+        for (size_t k = 0; k < text.size(); k++) {
+            char c = text[k];
+            if (c == '(' || c == ')' || c == ' ' || c == '\t') {
+                if (!token.empty()) tokens.push_back(token);
+                token.clear();
+                if (c == '(' || c == ')') tokens.push_back(string(1, c));
+            } else {
+                token += c;
+            }
+        }
+        if (!token.empty()) tokens.push_back(token);
+    }
+
+    bool done() const {
+        return pos == tokens.size();
+    }
+
+    Expr read() {
+        expect("(");
+        string kind = next();
+        Expr e;
+        if (kind == "int") {
+            e = read_int();
+        } else if (kind == "float") {
+            istringstream in(next());
+            float f = 0;
+            if (!(in >> f)) fragment_error("expected a float: " + line);
+            e = f;
+        } else if (kind == "cast") {
+            Type t = read_type();
+            e = Cast::make(t, read());
+        } else if (kind == "not") {
+            e = Not::make(read());
+        } else if (kind == "select") {
+            Expr c = read();
+            Expr t = read();
+            e = Select::make(c, t, read());
+        } else if (kind == "let") {
+            string name = next();
+            Expr value = read();
+            e = Let::make(name, value, read());
+        } else if (kind == "var") {
+            Type t = read_type();
+            e = Variable::make(t, next());
+        } else if (kind == "rvar") {
+            string name = next();
+            if (!domain.defined()) fragment_error("reduction variable outside of an update: " + line);
+            e = Variable::make(Int(32), name, domain);
+        } else if (kind == "param") {
+            Type t = read_type();
+            string name = next();
+            map<string, Expr>::const_iterator iter = params.find(name);
+            if (iter == params.end()) fragment_error("no Expr given for the input " + name);
+            e = cast(t, iter->second);
+        } else if (kind == "image") {
+            Type t = read_type();
+            string name = next();
+            vector<Expr> args = read_args();
+            map<string, Func>::const_iterator iter = images.find(name);
+            if (iter == images.end()) fragment_error("no Func given for the input image " + name);
+            Function f = iter->second.function();
+            if (f.dimensions() != (int)args.size() || f.outputs() != 1) {
+                fragment_error("the Func given for " + name + " doesn't have " +
+                               int_to_string((int)args.size()) + " dimensions and one value");
+            }
+            e = cast(t, Call::make(f.output_types()[0], f.name(), args, Call::Halide, f));
+        } else if (kind == "call") {
+            Type t = read_type();
+            string name = next();
+            int value_index = read_int();
+            vector<Expr> args = read_args();
+            map<string, Function>::const_iterator iter = funcs.find(name);
+            if (iter == funcs.end()) fragment_error(name + " is called before it's defined");
+            e = Call::make(t, name, args, Call::Halide, iter->second, value_index);
+        } else if (kind == "extern" || kind == "intrinsic") {
+            Type t = read_type();
+            string name = next();
+            vector<Expr> args = read_args();
+            e = Call::make(t, name, args, kind == "extern" ? Call::Extern : Call::Intrinsic);
+        } else {
+            Expr a = read();
+            Expr b = read();
+            if (kind == "add") e = Add::make(a, b);
+            else if (kind == "sub") e = Sub::make(a, b);
+            else if (kind == "mul") e = Mul::make(a, b);
+            else if (kind == "div") e = Div::make(a, b);
+            else if (kind == "mod") e = Mod::make(a, b);
+            else if (kind == "min") e = Min::make(a, b);
+            else if (kind == "max") e = Max::make(a, b);
+            else if (kind == "eq") e = EQ::make(a, b);
+            else if (kind == "ne") e = NE::make(a, b);
+            else if (kind == "lt") e = LT::make(a, b);
+            else if (kind == "le") e = LE::make(a, b);
+            else if (kind == "gt") e = GT::make(a, b);
+            else if (kind == "ge") e = GE::make(a, b);
+            else if (kind == "and") e = And::make(a, b);
+            else if (kind == "or") e = Or::make(a, b);
+            else fragment_error("unknown node " + kind + ": " + line);
+        }
+        expect(")");
+        return e;
+    }
+};
+
+// The definition being read.
+struct PendingDefinition {
+    Function func;
+    vector<string> args;
+    vector<Expr> values;
+    bool pure_done;
+    // The update being read, if pure_done.
+    vector<ReductionVariable> domain_vars;
+    ReductionDomain domain;
+    vector<Expr> update_args, update_values;
+
+    PendingDefinition() : pure_done(false) {}
+
+    void finish_part() {
+        if (!func.name().empty() && !pure_done) {
+            if (values.empty()) fragment_error(func.name() + " has no value");
+            func.define(args, values);
+            pure_done = true;
+        } else if (pure_done && !update_values.empty()) {
+            func.define_reduction(update_args, update_values);
+        }
+        domain_vars.clear();
+        domain = ReductionDomain();
+        update_args.clear();
+        update_values.clear();
+    }
+};
+
+}
+
+string fragment_to_string(Func output) {
+    set<string> done;
+    vector<Function> order;
+    order_functions(output.function(), done, order);
+
+    FragmentInputs inputs;
+    ostringstream funcs;
+    for (size_t i = 0; i < order.size(); i++) {
+        write_function(funcs, order[i], inputs);
+    }
+
+    ostringstream out;
+    out << "fragment " << output.name() << "\n";
+    for (map<string, pair<Type, int> >::iterator iter = inputs.images.begin();
+         iter != inputs.images.end(); ++iter) {
+        out << "image " << iter->first << " ";
+        write_type(out, iter->second.first);
+        out << " " << iter->second.second << "\n";
+    }
+    for (map<string, Type>::iterator iter = inputs.scalars.begin();
+         iter != inputs.scalars.end(); ++iter) {
+        out << "scalar " << iter->first << " ";
+        write_type(out, iter->second);
+        out << "\n";
+    }
+    out << funcs.str();
+    out << "schedule\n";
+    out << schedule_to_string(output);
+    return out.str();
+}
+
+Func fragment_from_string(const string &text,
+                          const map<string, Func> &images,
+                          const map<string, Expr> &params,
+                          map<string, Func> *funcs) {
+    istringstream lines(text);
+    string line, output_name;
+    map<string, Function> defined;
+    PendingDefinition def;
+    ostringstream schedule;
+    bool in_schedule = false;
+
+    while (std::getline(lines, line)) {
+        if (in_schedule) {
+            schedule << line << "\n";
+            continue;
+        }
+        istringstream in(line);
+        string kind;
+        if (!(in >> kind) || kind[0] == '#') continue;
+        string rest;
+        std::getline(in, rest);
+
+        if (kind == "fragment") {
+            istringstream name(rest);
+            name >> output_name;
+        } else if (kind == "image") {
+            string name;
+            istringstream(rest) >> name;
+            if (!images.count(name)) fragment_error("no Func given for the input image " + name);
+        } else if (kind == "scalar") {
+            string name;
+            istringstream(rest) >> name;
+            if (!params.count(name)) fragment_error("no Expr given for the input " + name);
+        } else if (kind == "func") {
+            def.finish_part();
+            def = PendingDefinition();
+            istringstream names(rest);
+            string name, arg;
+            names >> name;
+            while (names >> arg) def.args.push_back(arg);
+            if (defined.count(name)) fragment_error(name + " is defined twice");
+            def.func = Function(name);
+            defined[name] = def.func;
+        } else if (kind == "update") {
+            if (def.func.name().empty()) fragment_error("update outside of a func: " + line);
+            def.finish_part();
+        } else if (kind == "domain") {
+            if (!def.pure_done || !def.update_args.empty()) fragment_error("misplaced domain: " + line);
+            ReductionVariable v;
+            istringstream var(rest);
+            var >> v.var;
+            string exprs;
+            std::getline(var, exprs);
+            ReadExpr read(exprs, line, defined, images, params, ReductionDomain());
+            v.min = read.read();
+            v.extent = read.read();
+            def.domain_vars.push_back(v);
+        } else if (kind == "arg" || kind == "value") {
+            if (def.func.name().empty()) fragment_error(kind + " outside of a func: " + line);
+            if (def.pure_done && !def.domain.defined() && !def.domain_vars.empty()) {
+                def.domain = ReductionDomain(def.domain_vars);
+            }
+            ReadExpr read(rest, line, defined, images, params, def.domain);
+            Expr e = read.read();
+            if (!read.done()) fragment_error("trailing text: " + line);
+            if (!def.pure_done) {
+                if (kind == "arg") fragment_error("arg outside of an update: " + line);
+                def.values.push_back(e);
+            } else {
+                (kind == "arg" ? def.update_args : def.update_values).push_back(e);
+            }
+        } else if (kind == "schedule") {
+            def.finish_part();
+            in_schedule = true;
+        } else {
+            fragment_error("bad line: " + line);
+        }
+    }
+    if (!in_schedule) def.finish_part();
+
+    if (!defined.count(output_name)) {
+        fragment_error("the output " + output_name + " isn't defined");
+    }
+    Func output(defined[output_name]);
+    schedule_from_string(output, schedule.str());
+
+    if (funcs) {
+        for (map<string, Function>::iterator iter = defined.begin(); iter != defined.end(); ++iter) {
+            (*funcs)[iter->first] = Func(iter->second);
+        }
+    }
+    return output;
+}
+
+void save_fragment(Func output, const string &filename) {
+    std::ofstream file(filename.c_str());
+    if (!file) {
+        std::cerr << "Could not open " << filename << " to write the fragment\n";
+        assert(false);
+    }
+    file << fragment_to_string(output);
+}
+
+Func load_fragment(const string &filename,
+                   const map<string, Func> &images,
+                   const map<string, Expr> &params,
+                   map<string, Func> *funcs) {
+    std::ifstream file(filename.c_str());
+    if (!file) {
+        std::cerr << "Could not open fragment " << filename << "\n";
+        assert(false);
+    }
+    ostringstream text;
+    text << file.rdbuf();
+    Func output = fragment_from_string(text.str(), images, params, funcs);
+    debug(1) << "Loaded the fragment " << output.name() << " from " << filename << "\n";
+    return output;
+}
+
+}
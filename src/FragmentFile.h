@@ -0,0 +1,75 @@
+#ifndef HALIDE_FRAGMENT_FILE_H
+#define HALIDE_FRAGMENT_FILE_H
+
+/** \file
+ * Defines a text format for pipeline fragments: the algorithm and
+ * schedule of a group of Funcs, which other pipelines can import and
+ * fuse into their own.
+ */
+
+#include "Func.h"
+
+#include <map>
+#include <string>
+
+namespace Halide {
+
+/** Write the definitions of every Func in the pipeline that computes
+ * output, pure and update, as text, followed by their schedules (see
+ * \ref schedule_to_string). Input images and scalar parameters are
+ * written by name, as inputs of the fragment. This includes the
+ * variables for the sizes of an input image, e.g. "input.extent.0".
+ * Funcs with extern definitions, compiled-in images and string
+ * constants can't be written, and fail with an error.
+ *
+ * Unlike an extern call to a separately compiled library, a fragment
+ * is compiled with the pipeline that imports it. So the fragment's
+ * Funcs can be inlined into, vectorized with, and tiled by the Funcs
+ * of that pipeline, and rescheduled by it.
+ *
+ * For example, a library can write its color pipeline:
+ \code
+ ImageParam input(Float(32), 3, "input");
+ Param<float> gamma("gamma");
+ Func color("color");
+ ...
+ save_fragment(color, "color.hlf");
+ \endcode
+ * and a product pipeline can use it on one of its Funcs:
+ \code
+ std::map<std::string, Func> images;
+ images["input"] = demosaiced;
+ std::map<std::string, Expr> params;
+ params["gamma"] = 2.2f;
+ Func color = load_fragment("color.hlf", images, params);
+ \endcode
+ */
+EXPORT std::string fragment_to_string(Func output);
+
+/** Define the Funcs in text written by fragment_to_string, with
+ * their schedules, and return the output. Calls to each input image
+ * become calls to the Func of the same name in images, which must
+ * have the same number of dimensions and a single value (cast to the
+ * type of the image if it differs). Each scalar input is replaced by
+ * the Expr of the same name in params. Every input must be given. If
+ * funcs isn't NULL, all the Funcs defined are put in it by name, so
+ * the caller can reschedule them. The Funcs keep their names, so a
+ * fragment can only be imported once per pipeline. */
+EXPORT Func fragment_from_string(const std::string &text,
+                                 const std::map<std::string, Func> &images,
+                                 const std::map<std::string, Expr> &params = std::map<std::string, Expr>(),
+                                 std::map<std::string, Func> *funcs = NULL);
+
+/** Write a fragment to a file, as fragment_to_string. */
+EXPORT void save_fragment(Func output, const std::string &filename);
+
+/** Import a fragment from a file written by save_fragment, as
+ * fragment_from_string. */
+EXPORT Func load_fragment(const std::string &filename,
+                          const std::map<std::string, Func> &images,
+                          const std::map<std::string, Expr> &params = std::map<std::string, Expr>(),
+                          std::map<std::string, Func> *funcs = NULL);
+
+}
+
+#endif
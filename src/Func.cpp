@@ -8,15 +8,23 @@
 #include "Util.h"
 #include "IROperator.h"
 #include "IRPrinter.h"
+#include "IRMutator.h"
 #include "Function.h"
 #include "Argument.h"
 #include "Lower.h"
 #include "StmtCompiler.h"
+#include "JITCache.h"
 #include "CodeGen_C.h"
 #include "Image.h"
 #include "Param.h"
 #include "Debug.h"
 #include "Target.h"
+#include "Substitute.h"
+#include "IREquality.h"
+#include "CostReport.h"
+#include "StaticLibrary.h"
+#include "ScheduleFile.h"
+#include "Interpreter.h"
 
 namespace Halide {
 
@@ -37,6 +45,10 @@ Func::Func(const string &name) : func(unique_name(name)),
                                  custom_do_par_for(NULL),
                                  custom_do_task(NULL),
                                  custom_trace(NULL),
+                                 custom_is_cancelled(NULL),
+                                 custom_check_memory_budget(NULL),
+                                 thread_pool_threads(0),
+                                 thread_pool_priority(0),
                                  random_seed(0) {
 }
 
@@ -47,6 +59,10 @@ Func::Func() : func(unique_name('f')),
                custom_do_par_for(NULL),
                custom_do_task(NULL),
                custom_trace(NULL),
+               custom_is_cancelled(NULL),
+               custom_check_memory_budget(NULL),
+               thread_pool_threads(0),
+               thread_pool_priority(0),
                random_seed(0) {
 }
 
@@ -57,6 +73,10 @@ Func::Func(Expr e) : func(unique_name('f')),
                      custom_do_par_for(NULL),
                      custom_do_task(NULL),
                      custom_trace(NULL),
+                     custom_is_cancelled(NULL),
+                     custom_check_memory_budget(NULL),
+                     thread_pool_threads(0),
+                     thread_pool_priority(0),
                      random_seed(0) {
     (*this)(_) = e;
 }
@@ -68,6 +88,10 @@ Func::Func(Function f) : func(f),
                      custom_do_par_for(NULL),
                      custom_do_task(NULL),
                      custom_trace(NULL),
+                     custom_is_cancelled(NULL),
+                     custom_check_memory_budget(NULL),
+                     thread_pool_threads(0),
+                     thread_pool_priority(0),
                      random_seed(0) {
 }
 
@@ -178,8 +202,9 @@ EXPORT bool Func::is_extern() const {
 void Func::define_extern(const std::string &function_name,
                          const std::vector<ExternFuncArgument> &args,
                          const std::vector<Type> &types,
-                         int dimensionality) {
-    func.define_extern(function_name, args, types, dimensionality);
+                         int dimensionality,
+                         bool thread_safe) {
+    func.define_extern(function_name, args, types, dimensionality, thread_safe);
 }
 
 /** Get the types of the buffers returned by an extern definition. */
@@ -350,9 +375,9 @@ int Func::add_implicit_vars(vector<Expr> &args) const {
 }
 
 namespace {
-bool var_name_match(string candidate, string var) {
+bool var_name_match(const string &candidate, const string &var) {
     if (candidate == var) return true;
-    return Internal::ends_with(candidate, "." + var);
+    return Internal::ends_with(candidate, '.', var);
 }
 }
 
@@ -387,7 +412,7 @@ void ScheduleHandle::dump_argument_list() {
     std::cerr << "\n";
 }
 
-ScheduleHandle &ScheduleHandle::split(Var old, Var outer, Var inner, Expr factor) {
+ScheduleHandle &ScheduleHandle::split(Var old, Var outer, Var inner, Expr factor, TailStrategy tail) {
     // Replace the old dimension with the new dimensions in the dims list
     bool found = false;
     string inner_name, outer_name, old_name;
@@ -416,7 +441,7 @@ ScheduleHandle &ScheduleHandle::split(Var old, Var outer, Var inner, Expr factor
     }
 
     // Add the split to the splits list
-    Schedule::Split split = {old_name, outer_name, inner_name, factor, Schedule::Split::SplitVar};
+    Schedule::Split split = {old_name, outer_name, inner_name, factor, Schedule::Split::SplitVar, tail, false};
     schedule.splits.push_back(split);
     return *this;
 }
@@ -466,11 +491,73 @@ ScheduleHandle &ScheduleHandle::fuse(Var inner, Var outer, Var fused) {
 
 
     // Add the fuse to the splits list
-    Schedule::Split split = {fused_name, outer_name, inner_name, Expr(), Schedule::Split::FuseVars};
+    Schedule::Split split = {fused_name, outer_name, inner_name, Expr(), Schedule::Split::FuseVars, Tail_Auto, false};
     schedule.splits.push_back(split);
     return *this;
 }
 
+ScheduleHandle &ScheduleHandle::atomic() {
+    schedule.atomic = true;
+    return *this;
+}
+
+ScheduleHandle &ScheduleHandle::parallel(RVar var) {
+    assert(schedule.atomic &&
+           "Can't parallelize a reduction variable unless the update is atomic. Call atomic() first.");
+    set_dim_type(Var(var.name()), For::Parallel);
+    return *this;
+}
+
+ScheduleHandle &ScheduleHandle::vectorize(RVar var) {
+    set_dim_type(Var(var.name()), For::Vectorized);
+    return *this;
+}
+
+ScheduleHandle &ScheduleHandle::vectorize(RVar var, int factor, TailStrategy tail) {
+    Var inner;
+    split(Var(var.name()), Var(var.name()), inner, factor, tail);
+    vectorize(inner);
+    return *this;
+}
+
+ScheduleHandle &ScheduleHandle::split(RVar old, RVar outer, RVar inner, Expr factor, TailStrategy tail) {
+    if (tail == Tail_Auto) {
+        tail = Tail_GuardWithIf;
+    }
+    assert(tail == Tail_GuardWithIf &&
+           "Reduction variables can only be split with Tail_GuardWithIf, "
+           "because any other tail strategy would visit points outside the reduction domain");
+    return split(Var(old.name()), Var(outer.name()), Var(inner.name()), factor, tail);
+}
+
+ScheduleHandle &ScheduleHandle::tile(RVar x, RVar y, RVar xo, RVar yo, RVar xi, RVar yi,
+                                     Expr xfactor, Expr yfactor, TailStrategy tail) {
+    split(x, xo, xi, xfactor, tail);
+    split(y, yo, yi, yfactor, tail);
+    reorder(xi, yi, xo, yo);
+    return *this;
+}
+
+ScheduleHandle &ScheduleHandle::tile(RVar x, RVar y, RVar xi, RVar yi,
+                                     Expr xfactor, Expr yfactor, TailStrategy tail) {
+    split(x, x, xi, xfactor, tail);
+    split(y, y, yi, yfactor, tail);
+    reorder(xi, yi, x, y);
+    return *this;
+}
+
+ScheduleHandle &ScheduleHandle::unroll(RVar var) {
+    set_dim_type(Var(var.name()), For::Unrolled);
+    return *this;
+}
+
+ScheduleHandle &ScheduleHandle::unroll(RVar var, int factor, TailStrategy tail) {
+    RVar inner(unique_name('r'));
+    split(var, var, inner, factor, tail);
+    unroll(inner);
+    return *this;
+}
+
 ScheduleHandle &ScheduleHandle::rename(Var old_var, Var new_var) {
     // Replace the old dimension with the new dimensions in the dims list
     bool found = false;
@@ -496,7 +583,7 @@ ScheduleHandle &ScheduleHandle::rename(Var old_var, Var new_var) {
 
     if (old_name.find('.') == string::npos) {
         // If it's a primitive name, add the rename to the splits list.
-        Schedule::Split split = {old_name, new_name, "", 1, Schedule::Split::RenameVar};
+        Schedule::Split split = {old_name, new_name, "", 1, Schedule::Split::RenameVar, Tail_Auto, false};
         schedule.splits.push_back(split);
     } else {
         // It's a derived name, so just rewrite the split or rename that defines it.
@@ -537,6 +624,11 @@ ScheduleHandle &ScheduleHandle::unroll(Var var) {
     return *this;
 }
 
+ScheduleHandle &ScheduleHandle::unroll_and_jam(Var var) {
+    set_dim_type(var, For::Jammed);
+    return *this;
+}
+
 ScheduleHandle &ScheduleHandle::parallel(Var var, Expr factor) {
     Var tmp;
     split(var, var, tmp, factor);
@@ -544,30 +636,47 @@ ScheduleHandle &ScheduleHandle::parallel(Var var, Expr factor) {
     return *this;
 }
 
-ScheduleHandle &ScheduleHandle::vectorize(Var var, int factor) {
+ScheduleHandle &ScheduleHandle::vectorize(Var var, int factor, TailStrategy tail) {
     Var tmp;
-    split(var, var, tmp, factor);
+    split(var, var, tmp, factor, tail);
     vectorize(tmp);
     return *this;
 }
 
-ScheduleHandle &ScheduleHandle::unroll(Var var, int factor) {
+ScheduleHandle &ScheduleHandle::vectorize_natural(Var var, TailStrategy tail) {
     Var tmp;
-    split(var, var, tmp, factor);
+    split(var, var, tmp, 1, tail);
+    schedule.splits.back().natural_width = true;
+    vectorize(tmp);
+    return *this;
+}
+
+ScheduleHandle &ScheduleHandle::unroll(Var var, int factor, TailStrategy tail) {
+    Var tmp;
+    split(var, var, tmp, factor, tail);
     unroll(tmp);
     return *this;
 }
 
-ScheduleHandle &ScheduleHandle::tile(Var x, Var y, Var xo, Var yo, Var xi, Var yi, Expr xfactor, Expr yfactor) {
-    split(x, xo, xi, xfactor);
-    split(y, yo, yi, yfactor);
+ScheduleHandle &ScheduleHandle::unroll_and_jam(Var var, int factor, TailStrategy tail) {
+    Var tmp;
+    split(var, var, tmp, factor, tail);
+    unroll_and_jam(tmp);
+    return *this;
+}
+
+ScheduleHandle &ScheduleHandle::tile(Var x, Var y, Var xo, Var yo, Var xi, Var yi,
+                                     Expr xfactor, Expr yfactor, TailStrategy tail) {
+    split(x, xo, xi, xfactor, tail);
+    split(y, yo, yi, yfactor, tail);
     reorder(xi, yi, xo, yo);
     return *this;
 }
 
-ScheduleHandle &ScheduleHandle::tile(Var x, Var y, Var xi, Var yi, Expr xfactor, Expr yfactor) {
-    split(x, x, xi, xfactor);
-    split(y, y, yi, yfactor);
+ScheduleHandle &ScheduleHandle::tile(Var x, Var y, Var xi, Var yi,
+                                     Expr xfactor, Expr yfactor, TailStrategy tail) {
+    split(x, x, xi, xfactor, tail);
+    split(y, y, yi, yfactor, tail);
     reorder(xi, yi, x, y);
     return *this;
 }
@@ -760,8 +869,8 @@ ScheduleHandle &ScheduleHandle::gpu_tile(Var x, Var y, Var z,
     return *this;
 }
 
-Func &Func::split(Var old, Var outer, Var inner, Expr factor) {
-    ScheduleHandle(func.schedule()).split(old, outer, inner, factor);
+Func &Func::split(Var old, Var outer, Var inner, Expr factor, TailStrategy tail) {
+    ScheduleHandle(func.schedule()).split(old, outer, inner, factor, tail);
     return *this;
 }
 
@@ -795,13 +904,28 @@ Func &Func::parallel(Var var, Expr factor) {
     return *this;
 }
 
-Func &Func::vectorize(Var var, int factor) {
-    ScheduleHandle(func.schedule()).vectorize(var, factor);
+Func &Func::vectorize(Var var, int factor, TailStrategy tail) {
+    ScheduleHandle(func.schedule()).vectorize(var, factor, tail);
+    return *this;
+}
+
+Func &Func::vectorize_natural(Var var, TailStrategy tail) {
+    ScheduleHandle(func.schedule()).vectorize_natural(var, tail);
+    return *this;
+}
+
+Func &Func::unroll(Var var, int factor, TailStrategy tail) {
+    ScheduleHandle(func.schedule()).unroll(var, factor, tail);
+    return *this;
+}
+
+Func &Func::unroll_and_jam(Var var) {
+    ScheduleHandle(func.schedule()).unroll_and_jam(var);
     return *this;
 }
 
-Func &Func::unroll(Var var, int factor) {
-    ScheduleHandle(func.schedule()).unroll(var, factor);
+Func &Func::unroll_and_jam(Var var, int factor, TailStrategy tail) {
+    ScheduleHandle(func.schedule()).unroll_and_jam(var, factor, tail);
     return *this;
 }
 
@@ -825,13 +949,121 @@ Func &Func::bound(Var var, Expr min, Expr extent) {
     return *this;
 }
 
-Func &Func::tile(Var x, Var y, Var xo, Var yo, Var xi, Var yi, Expr xfactor, Expr yfactor) {
-    ScheduleHandle(func.schedule()).tile(x, y, xo, yo, xi, yi, xfactor, yfactor);
+Func &Func::bound_value(Expr min, Expr max, int value_index) {
+    assert(defined() && "Can't bound the value of a Func that isn't defined yet");
+    assert(value_index >= 0 && value_index < func.outputs() &&
+           "Can't bound a value that the Func doesn't have");
+    Type t = func.output_types()[value_index];
+    if (min.defined() && min.type() != t) {
+        min = cast(t, min);
+    }
+    if (max.defined() && max.type() != t) {
+        max = cast(t, max);
+    }
+    func.bound_value(value_index, min, max);
+    return *this;
+}
+
+Func &Func::estimate(Var var, int min, int extent) {
+    bool found = false;
+    for (size_t i = 0; i < func.args().size(); i++) {
+        if (var.name() == func.args()[i]) {
+            found = true;
+        }
+    }
+    if (!found) {
+        std::cerr << "Can't estimate the range of variable " << var.name()
+                  << " of function " << name()
+                  << " because " << var.name()
+                  << " is not one of the pure variables of " << name() << "\n";
+        assert(false);
+    }
+
+    Schedule::Bound b = {var.name(), min, extent};
+    func.schedule().estimates.push_back(b);
+    return *this;
+}
+
+Func &Func::specialize(Expr condition) {
+    assert(condition.defined() && condition.type().is_bool() &&
+           "The argument to Func::specialize must be a boolean condition");
+    func.schedule().specializations.push_back(condition);
+    return *this;
+}
+
+namespace {
+// Rename the vars in a condition to the names of the loops of a
+// schedule that they refer to.
+class NameLoopVars : public IRMutator {
+    const vector<Schedule::Dim> &dims;
+
+    using IRMutator::visit;
+
+    void visit(const Variable *op) {
+        if (op->param.defined()) {
+            expr = op;
+            return;
+        }
+        for (size_t i = 0; i < dims.size(); i++) {
+            if (var_name_match(dims[i].var, op->name)) {
+                expr = Variable::make(op->type, dims[i].var);
+                return;
+            }
+        }
+        std::cerr << "The condition " << op->name << " of Func::skip_unless "
+                  << "is not a loop var or a parameter\n";
+        assert(false);
+    }
+
+public:
+    NameLoopVars(const vector<Schedule::Dim> &d) : dims(d) {}
+};
+}
+
+Func &Func::skip_unless(Var var, Expr active) {
+    assert(active.defined() && active.type().is_bool() &&
+           "The condition of Func::skip_unless must be a boolean");
+    vector<Schedule::Dim> &dims = func.schedule().dims;
+    string loop;
+    for (size_t i = 0; i < dims.size(); i++) {
+        if (var_name_match(dims[i].var, var.name())) {
+            loop = dims[i].var;
+            assert(dims[i].for_type != For::Vectorized &&
+                   "Can't skip the iterations of a vectorized loop");
+        }
+    }
+    if (loop.empty()) {
+        std::cerr << "Can't skip iterations of " << func.name()
+                  << " over " << var.name()
+                  << " because it is not one of its loop vars\n";
+        assert(false);
+    }
+    Schedule::SkipCondition c = {loop, NameLoopVars(dims).mutate(active)};
+    func.schedule().skip_conditions.push_back(c);
+    return *this;
+}
+
+Func &Func::prefetch(Func f, Var var, Expr offset) {
+    Schedule::Prefetch p = {f.name(), var.name(), offset, Parameter()};
+    func.schedule().prefetches.push_back(p);
+    return *this;
+}
+
+Func &Func::prefetch(ImageParam f, Var var, Expr offset) {
+    Schedule::Prefetch p = {f.name(), var.name(), offset, f.parameter()};
+    func.schedule().prefetches.push_back(p);
+    return *this;
+}
+
+Func &Func::tile(Var x, Var y, Var xo, Var yo, Var xi, Var yi,
+                 Expr xfactor, Expr yfactor, TailStrategy tail) {
+    ScheduleHandle(func.schedule()).tile(x, y, xo, yo, xi, yi, xfactor, yfactor, tail);
     return *this;
 }
 
-Func &Func::tile(Var x, Var y, Var xi, Var yi, Expr xfactor, Expr yfactor) {
-    ScheduleHandle(func.schedule()).tile(x, y, xi, yi, xfactor, yfactor);
+Func &Func::tile(Var x, Var y, Var xi, Var yi,
+                 Expr xfactor, Expr yfactor, TailStrategy tail) {
+    ScheduleHandle(func.schedule()).tile(x, y, xi, yi, xfactor, yfactor, tail);
     return *this;
 }
 
@@ -994,6 +1226,82 @@ Func &Func::reorder_storage(Var x, Var y, Var z, Var w, Var t) {
     return *this;
 }
 
+namespace {
+Schedule::StoragePadding &get_storage_padding(Function func, Var dim) {
+    bool found = false;
+    for (size_t i = 0; i < func.args().size(); i++) {
+        if (var_name_match(func.args()[i], dim.name())) {
+            found = true;
+        }
+    }
+    if (!found) {
+        std::cerr << "Can't pad the storage of " << func.name()
+                  << " in " << dim.name()
+                  << " because " << dim.name()
+                  << " is not one of the pure variables of " << func.name() << "\n";
+        assert(false);
+    }
+
+    vector<Schedule::StoragePadding> &padding = func.schedule().storage_padding;
+    for (size_t i = 0; i < padding.size(); i++) {
+        if (var_name_match(padding[i].var, dim.name())) {
+            return padding[i];
+        }
+    }
+    Schedule::StoragePadding p = {dim.name(), 1, 0};
+    padding.push_back(p);
+    return padding.back();
+}
+}
+
+Func &Func::align_storage(Var dim, int alignment) {
+    assert(alignment > 0 && "The alignment of a dimension of storage must be positive");
+    get_storage_padding(func, dim).alignment = alignment;
+    return *this;
+}
+
+Func &Func::pad_storage(Var dim, int padding) {
+    assert(padding >= 0 && "Can't pad storage by a negative amount");
+    get_storage_padding(func, dim).padding = padding;
+    return *this;
+}
+
+Func &Func::fold_storage(Var dim, Expr factor) {
+    assert(factor.defined() && factor.type().is_int() && factor.type().width == 1 &&
+           "The fold factor of a dimension of storage must be a scalar integer");
+    bool found = false;
+    for (size_t i = 0; i < func.args().size(); i++) {
+        if (var_name_match(func.args()[i], dim.name())) {
+            found = true;
+        }
+    }
+    if (!found) {
+        std::cerr << "Can't fold the storage of " << func.name()
+                  << " in " << dim.name()
+                  << " because " << dim.name()
+                  << " is not one of the pure variables of " << func.name() << "\n";
+        assert(false);
+    }
+
+    vector<Schedule::StorageFold> &folds = func.schedule().storage_folds;
+    for (size_t i = 0; i < folds.size(); i++) {
+        if (var_name_match(folds[i].var, dim.name())) {
+            folds[i].factor = factor;
+            return *this;
+        }
+    }
+    Schedule::StorageFold fold = {dim.name(), factor};
+    folds.push_back(fold);
+    return *this;
+}
+
+Func &Func::interleave_tuple() {
+    assert(func.outputs() > 1 &&
+           "Only the storage of Funcs with Tuple values can be interleaved");
+    func.schedule().interleave_tuple = true;
+    return *this;
+}
+
 Func &Func::compute_at(Func f, RVar var) {
     return compute_at(f, Var(var.name()));
 }
@@ -1007,6 +1315,11 @@ Func &Func::compute_at(Func f, Var var) {
     return *this;
 }
 
+Func &Func::compute_with(Func f, Var var) {
+    func.schedule().compute_with = Schedule::LoopLevel(f.name(), var.name());
+    return *this;
+}
+
 Func &Func::compute_root() {
     func.schedule().compute_level = Schedule::LoopLevel::root();
     if (func.schedule().store_level.is_inline()) {
@@ -1029,6 +1342,99 @@ Func &Func::store_root() {
     return *this;
 }
 
+Func &Func::async() {
+    func.schedule().async = true;
+    return *this;
+}
+
+Func &Func::memoize() {
+    func.schedule().memoized = true;
+    return *this;
+}
+
+Func &Func::tabulate(Var var, int min, int extent) {
+    bool found = false;
+    for (size_t i = 0; i < func.args().size(); i++) {
+        if (var.name() == func.args()[i]) {
+            found = true;
+        }
+    }
+    if (!found) {
+        std::cerr << "Can't tabulate variable " << var.name()
+                  << " of function " << name()
+                  << " because " << var.name()
+                  << " is not one of the pure variables of " << name() << "\n";
+        assert(false);
+    }
+    assert(extent > 0 && "A table must have a positive extent");
+
+    Schedule::Bound b = {var.name(), min, extent};
+    func.schedule().table_bounds.push_back(b);
+    return *this;
+}
+
+Func &Func::store_persistent(Var t, int frames) {
+    assert(frames > 0 && "Persistent storage must keep at least one coordinate");
+    fold_storage(t, frames);
+    func.schedule().persistent_var = t.name();
+    return *this;
+}
+
+Func &Func::compute_lazily(Var var, int block_size) {
+    const vector<string> &args = func.args();
+    bool found = false;
+    for (size_t i = 0; i < args.size(); i++) {
+        found = found || args[i] == var.name();
+    }
+    if (!found) {
+        std::cerr << "Can't compute " << name() << " lazily in blocks of "
+                  << var.name() << ", because " << var.name()
+                  << " is not one of the pure variables of " << name() << "\n";
+        assert(false);
+    }
+    assert(block_size > 0 && "Lazily computed blocks must have a positive size");
+
+    Schedule::LazyBlock b = {var.name(), block_size};
+    func.schedule().lazy_blocks.push_back(b);
+    compute_root();
+    return *this;
+}
+
+Func &Func::store_nontemporal() {
+    func.schedule().nontemporal = true;
+    return *this;
+}
+
+Func &Func::split_devices(Var var) {
+    const vector<string> &args = func.args();
+    bool found = false;
+    for (size_t i = 0; i < args.size(); i++) {
+        found = found || args[i] == var.name();
+    }
+    if (!found) {
+        std::cerr << "Can't split " << func.name() << " between devices over "
+                  << var.name() << " because it is not one of its dimensions\n";
+        assert(false);
+    }
+    func.schedule().device_split_var = var.name();
+    return *this;
+}
+
+Func &Func::distribute(Var var) {
+    const vector<string> &args = func.args();
+    bool found = false;
+    for (size_t i = 0; i < args.size(); i++) {
+        found = found || args[i] == var.name();
+    }
+    if (!found) {
+        std::cerr << "Can't distribute " << func.name() << " over "
+                  << var.name() << " because it is not one of its dimensions\n";
+        assert(false);
+    }
+    func.schedule().distributed_var = var.name();
+    return *this;
+}
+
 Func &Func::compute_inline() {
     func.schedule().compute_level = Schedule::LoopLevel();
     func.schedule().store_level = Schedule::LoopLevel();
@@ -1050,48 +1456,305 @@ Func &Func::trace_realizations() {
     return *this;
 }
 
+Func &Func::trace_summary() {
+    func.trace_summary();
+    return *this;
+}
+
 void Func::debug_to_file(const string &filename) {
     func.debug_file() = filename;
 }
 
+Func &Func::use_workspace(ImageParam workspace) {
+    assert(workspace.defined() && workspace.type() == UInt(8) && workspace.dimensions() == 1 &&
+           "The workspace must be a one dimensional ImageParam of type UInt(8)");
+    func.workspace() = workspace.parameter();
+    return *this;
+}
+
 ScheduleHandle Func::update(int idx) {
     return ScheduleHandle(func.reduction_schedule(idx));
 }
 
-FuncRefVar::FuncRefVar(Internal::Function f, const vector<Var> &a, int placeholder_pos) : func(f) {
-    implicit_placeholder_pos = placeholder_pos;
-    args.resize(a.size());
-    for (size_t i = 0; i < a.size(); i++) {
-        args[i] = a[i].name();
+namespace {
+// Is this a call back to the function f with the given args.
+bool is_self_call(Expr e, const string &f, const vector<Expr> &args) {
+    const Call *c = e.as<Call>();
+    if (!c || c->call_type != Call::Halide || c->name != f ||
+        c->args.size() != args.size()) {
+        return false;
     }
+    for (size_t i = 0; i < args.size(); i++) {
+        if (!equal(c->args[i], args[i])) return false;
+    }
+    return true;
 }
 
-namespace {
-class CountImplicitVars : public Internal::IRGraphVisitor {
+// Does an expression call the function f.
+class CallsFunction : public IRGraphVisitor {
+    const string &f;
+    using IRGraphVisitor::visit;
+    void visit(const Call *op) {
+        IRGraphVisitor::visit(op);
+        if (op->call_type == Call::Halide && op->name == f) result = true;
+    }
 public:
-    int count;
+    bool result;
+    CallsFunction(const string &n) : f(n), result(false) {}
+};
 
-    CountImplicitVars(const vector<Expr> &e) : count(0) {
-        for (size_t i = 0; i < e.size(); i++) {
-            e[i].accept(this);
+bool calls_function(Expr e, const string &f) {
+    CallsFunction c(f);
+    e.accept(&c);
+    return c.result;
+}
+
+// Does an expression use the variable v, other than in the args of a
+// call to a Func or image (e.g. to pick the bin of a histogram).
+class UsesVarDirectly : public IRGraphVisitor {
+    const string &v;
+    using IRGraphVisitor::visit;
+    void visit(const Variable *op) {
+        if (op->name == v) result = true;
+    }
+    void visit(const Call *op) {
+        if (op->call_type != Call::Halide && op->call_type != Call::Image) {
+            IRGraphVisitor::visit(op);
         }
     }
+public:
+    bool result;
+    UsesVarDirectly(const string &n) : v(n), result(false) {}
+};
 
-    using IRGraphVisitor::visit;
+bool uses_var_directly(Expr e, const string &v) {
+    UsesVarDirectly u(v);
+    e.accept(&u);
+    return u.result;
+}
+
+enum ReductionOp {ReduceAdd, ReduceMul, ReduceMin, ReduceMax};
+
+Expr apply_reduction_op(ReductionOp op, Expr a, Expr b) {
+    switch (op) {
+    case ReduceAdd: return a + b;
+    case ReduceMul: return a * b;
+    case ReduceMin: return min(a, b);
+    default: return max(a, b);
+    }
+}
+
+// Check that an update step has a single value of the form f(args) =
+// f(args) op e, where e doesn't call f, and get op and e.
+bool match_reduction(const ReductionDefinition &red, const string &f, ReductionOp &op, Expr &e) {
+    if (red.values.size() != 1) return false;
+    Expr value = red.values[0];
+    Expr a, b;
+    if (const Add *add = value.as<Add>()) {
+        op = ReduceAdd; a = add->a; b = add->b;
+    } else if (const Mul *mul = value.as<Mul>()) {
+        op = ReduceMul; a = mul->a; b = mul->b;
+    } else if (const Min *mn = value.as<Min>()) {
+        op = ReduceMin; a = mn->a; b = mn->b;
+    } else if (const Max *mx = value.as<Max>()) {
+        op = ReduceMax; a = mx->a; b = mx->b;
+    } else {
+        return false;
+    }
+    if (is_self_call(a, f, red.args)) {
+        e = b;
+    } else if (is_self_call(b, f, red.args)) {
+        e = a;
+    } else {
+        return false;
+    }
+    return !calls_function(e, f);
+}
 
-    void visit(const Variable *v) {
-      int index = Var::implicit_index(v->name);
-      if (index != -1) {
-            if (index >= count) count = index + 1;
-      }
+Expr reduction_identity(ReductionOp op, Type t) {
+    switch (op) {
+    case ReduceAdd: return make_zero(t);
+    case ReduceMul: return make_one(t);
+    case ReduceMin: return t.max();
+    default: return t.min();
     }
-};
+}
 }
 
-vector<string> FuncRefVar::args_with_implicit_vars(const vector<Expr> &e) const {
-    vector<string> a = args;
+Func Func::rfactor(RVar r, Var v) {
+    assert(is_reduction() && "Can't rfactor a Func with no reduction definition");
+    assert(func.outputs() == 1 && "Can't rfactor a Func with multiple values");
 
-    CountImplicitVars count(e);
+    const ReductionDefinition &red = func.reductions().back();
+    assert(red.domain.defined() && "Can't rfactor an update step that has no reduction domain");
+    const vector<ReductionVariable> &dom = red.domain.domain();
+    int k = -1;
+    for (size_t i = 0; i < dom.size(); i++) {
+        if (dom[i].var == r.name()) k = (int)i;
+    }
+    assert(k >= 0 && "The reduction variable passed to rfactor is not in the reduction domain of the last update step");
+
+    // The update step that replaces this one stores to the pure args,
+    // so it can't reproduce stores to sites computed from r.
+    vector<Expr> lhs = red.args;
+    for (size_t i = 0; i < lhs.size(); i++) {
+        assert(!uses_var_directly(lhs[i], dom[k].var) &&
+               "rfactor can't be applied to a reduction variable that the left-hand side of the update step is computed from");
+    }
+
+    // Find the operator and the term being reduced.
+    ReductionOp op;
+    Expr e;
+    bool matched = match_reduction(red, name(), op, e);
+    assert(matched && "rfactor requires an update step of the form f(args) = f(args) op e, where op is +, *, min or max");
+    Expr identity = reduction_identity(op, red.values[0].type());
+
+    // In the intermediate, r becomes the pure var v, and the rest of
+    // the reduction variables make up a smaller reduction domain.
+    vector<ReductionVariable> rest;
+    for (size_t i = 0; i < dom.size(); i++) {
+        if ((int)i != k) rest.push_back(dom[i]);
+    }
+    std::map<string, Expr> replacements;
+    replacements[dom[k].var] = v;
+    if (!rest.empty()) {
+        ReductionDomain rest_domain(rest);
+        for (size_t i = 0; i < rest.size(); i++) {
+            replacements[rest[i].var] = Variable::make(Int(32), rest[i].var, rest_domain);
+        }
+    }
+
+    vector<Var> pure = args();
+    vector<Expr> pure_args;
+    for (size_t i = 0; i < pure.size(); i++) {
+        pure_args.push_back(pure[i]);
+    }
+    vector<Expr> intm_pure_args = pure_args;
+    intm_pure_args.push_back(v);
+    vector<Expr> intm_args;
+    for (size_t i = 0; i < lhs.size(); i++) {
+        intm_args.push_back(substitute(replacements, lhs[i]));
+    }
+    intm_args.push_back(v);
+
+    Func intm(name() + "_intm");
+    intm(intm_pure_args) = identity;
+    intm(intm_args) = apply_reduction_op(op, intm(intm_args), substitute(replacements, e));
+
+    // Replace the update step with one that combines the values of
+    // the intermediate over r.
+    ReductionVariable rv = dom[k];
+    ReductionDomain merge_domain(vector<ReductionVariable>(1, rv));
+    Expr rk = Variable::make(Int(32), rv.var, merge_domain);
+    vector<Expr> merge_args = pure_args;
+    vector<Expr> intm_merge_args = merge_args;
+    intm_merge_args.push_back(rk);
+
+    func.remove_last_reduction();
+    (*this)(merge_args) = apply_reduction_op(op, (*this)(merge_args), intm(intm_merge_args));
+
+    return intm;
+}
+
+Func Func::privatize(RVar r, Var v, int slices) {
+    assert(is_reduction() && "Can't privatize a Func with no reduction definition");
+    assert(func.outputs() == 1 && "Can't privatize a Func with multiple values");
+    assert(slices > 0 && "privatize needs at least one slice");
+
+    const ReductionDefinition &red = func.reductions().back();
+    assert(red.domain.defined() && "Can't privatize an update step that has no reduction domain");
+    const vector<ReductionVariable> &dom = red.domain.domain();
+    int k = -1;
+    for (size_t i = 0; i < dom.size(); i++) {
+        if (dom[i].var == r.name()) k = (int)i;
+    }
+    assert(k >= 0 && "The reduction variable passed to privatize is not in the reduction domain of the last update step");
+
+    ReductionOp op;
+    Expr e;
+    bool matched = match_reduction(red, name(), op, e);
+    assert(matched && "privatize requires an update step of the form f(args) = f(args) op e, where op is +, *, min or max");
+    Expr identity = reduction_identity(op, red.values[0].type());
+
+    // Split r into slices of equal size, the last of which may run
+    // past the end. There, r is clamped so that the update step only
+    // touches sites it would have touched anyway, and the identity is
+    // folded in instead of e.
+    Expr r_min = dom[k].min, r_extent = dom[k].extent;
+    Expr slice_size = (r_extent + (slices - 1)) / slices;
+    ReductionVariable inner = {dom[k].var + "_inner", 0, slice_size};
+    ReductionVariable outer = {dom[k].var + "_outer", 0, slices};
+    vector<ReductionVariable> split_dom;
+    for (size_t i = 0; i < dom.size(); i++) {
+        if ((int)i == k) {
+            split_dom.push_back(inner);
+            split_dom.push_back(outer);
+        } else {
+            split_dom.push_back(dom[i]);
+        }
+    }
+    ReductionDomain split_domain(split_dom);
+    std::map<string, Expr> replacements;
+    for (size_t i = 0; i < split_dom.size(); i++) {
+        if ((int)i == k || (int)i == k + 1) continue;
+        replacements[split_dom[i].var] = Variable::make(Int(32), split_dom[i].var, split_domain);
+    }
+    Expr ri = Variable::make(Int(32), inner.var, split_domain);
+    Expr ro = Variable::make(Int(32), outer.var, split_domain);
+    Expr unclamped = r_min + ro * slice_size + ri;
+    replacements[dom[k].var] = min(unclamped, r_min + r_extent - 1);
+
+    vector<Expr> lhs;
+    for (size_t i = 0; i < red.args.size(); i++) {
+        lhs.push_back(substitute(replacements, red.args[i]));
+    }
+    Expr term = select(unclamped < r_min + r_extent, substitute(replacements, e), identity);
+
+    func.remove_last_reduction();
+    (*this)(lhs) = apply_reduction_op(op, (*this)(lhs), term);
+
+    // Then give each slice its own copy of f to update, and compute
+    // the slices in parallel.
+    Func intm = rfactor(RVar(outer.var, 0, slices, split_domain), v);
+    intm.compute_root();
+    intm.update().parallel(v);
+    return intm;
+}
+
+FuncRefVar::FuncRefVar(Internal::Function f, const vector<Var> &a, int placeholder_pos) : func(f) {
+    implicit_placeholder_pos = placeholder_pos;
+    args.resize(a.size());
+    for (size_t i = 0; i < a.size(); i++) {
+        args[i] = a[i].name();
+    }
+}
+
+namespace {
+class CountImplicitVars : public Internal::IRGraphVisitor {
+public:
+    int count;
+
+    CountImplicitVars(const vector<Expr> &e) : count(0) {
+        for (size_t i = 0; i < e.size(); i++) {
+            e[i].accept(this);
+        }
+    }
+
+    using IRGraphVisitor::visit;
+
+    void visit(const Variable *v) {
+      int index = Var::implicit_index(v->name);
+      if (index != -1) {
+            if (index >= count) count = index + 1;
+      }
+    }
+};
+}
+
+vector<string> FuncRefVar::args_with_implicit_vars(const vector<Expr> &e) const {
+    vector<string> a = args;
+
+    CountImplicitVars count(e);
 
     if (count.count > 0) {
         if (implicit_placeholder_pos != -1) {
@@ -1461,17 +2124,29 @@ public:
     vector<pair<int, Internal::Parameter> > image_param_args;
     vector<pair<int, Buffer> > image_args;
 
-    InferArguments(const string &o) : output(o) {}
+    InferArguments(const string &o) : outputs(vec<string>(o)) {}
+    InferArguments(const vector<string> &o) : outputs(o) {}
+
+    // Jitted pipelines take the user_context they pass to the runtime
+    // as their first argument, so that each realization can have its
+    // own. Call this before visiting the pipeline, which may also use
+    // it as a Param.
+    void include_user_context() {
+        arg_types.push_back(Argument("__user_context", false, Handle()));
+        arg_values.push_back(NULL);
+    }
 
 private:
-    const string &output;
+    vector<string> outputs;
 
     using IRGraphVisitor::visit;
 
     bool already_have(const string &name) {
         // Ignore dependencies on the output buffers
-        if (name == output || starts_with(name, output + ".")) {
-            return true;
+        for (size_t i = 0; i < outputs.size(); i++) {
+            if (name == outputs[i] || starts_with(name, outputs[i], '.')) {
+                return true;
+            }
         }
         for (size_t i = 0; i < arg_types.size(); i++) {
             if (arg_types[i].name == name) {
@@ -1486,6 +2161,8 @@ private:
         if (already_have(p.name())) return;
         arg_types.push_back(Argument(p.name(), p.is_buffer(), p.type()));
         if (p.is_buffer()) {
+            arg_types.back().host_alignment = p.host_alignment();
+            arg_types.back().no_alias = p.no_alias();
             Buffer b = p.get_buffer();
             int idx = (int)arg_values.size();
             image_param_args.push_back(make_pair(idx, p));
@@ -1532,11 +2209,11 @@ private:
 /** Check that all the necessary arguments are in an args vector. Any
  * images in the source that aren't in the args vector are placed in
  * the images_to_embed list. */
-void validate_arguments(const string &output,
+void validate_arguments(const vector<string> &outputs,
                         const vector<Argument> &args,
                         Stmt lowered,
                         vector<Buffer> &images_to_embed) {
-    InferArguments infer_args(output);
+    InferArguments infer_args(outputs);
     lowered.accept(&infer_args);
     const vector<Argument> &required_args = infer_args.arg_types;
 
@@ -1594,7 +2271,7 @@ void validate_arguments(const string &output,
     }
 
     vector<Buffer> images_to_embed;
-    validate_arguments(name(), args, lowered, images_to_embed);
+    validate_arguments(vec<string>(name()), args, lowered, images_to_embed);
 
     for (int i = 0; i < outputs(); i++) {
         args.push_back(output_buffers()[i]);
@@ -1618,7 +2295,7 @@ void Func::compile_to_bitcode(const string &filename, vector<Argument> args, con
     }
 
     vector<Buffer> images_to_embed;
-    validate_arguments(name(), args, lowered, images_to_embed);
+    validate_arguments(vec<string>(name()), args, lowered, images_to_embed);
 
     for (int i = 0; i < outputs(); i++) {
         args.push_back(output_buffers()[i]);
@@ -1643,13 +2320,31 @@ void Func::compile_to_header(const string &filename, vector<Argument> args, cons
     cg.compile_header(fn_name.empty() ? name() : fn_name, args);
 }
 
+void Func::compile_to_descriptor(const string &filename, vector<Argument> args, const string &fn_name) {
+    size_t inputs = args.size();
+    for (int i = 0; i < outputs(); i++) {
+        args.push_back(output_buffers()[i]);
+    }
+
+    const char *type_names[] = {"int", "uint", "float", "handle"};
+    ofstream desc(filename.c_str());
+    desc << "function " << (fn_name.empty() ? name() : fn_name) << "\n";
+    for (size_t i = 0; i < args.size(); i++) {
+        desc << (i < inputs ? "input " : "output ")
+             << (args[i].is_buffer ? "buffer " : "scalar ")
+             << args[i].name << " "
+             << type_names[args[i].type.code] << args[i].type.bits << "\n";
+    }
+}
+
 void Func::compile_to_c(const string &filename, vector<Argument> args, const string &fn_name) {
+    assert(!func.workspace().defined() && "compile_to_c doesn't support Func::use_workspace");
     if (!lowered.defined()) {
         lowered = Halide::Internal::lower(func, get_host_target());
     }
 
     vector<Buffer> images_to_embed;
-    validate_arguments(name(), args, lowered, images_to_embed);
+    validate_arguments(vec<string>(name()), args, lowered, images_to_embed);
 
     for (int i = 0; i < outputs(); i++) {
         args.push_back(output_buffers()[i]);
@@ -1667,6 +2362,16 @@ void Func::compile_to_lowered_stmt(const string &filename) {
 
     ofstream stmt_output(filename.c_str());
     stmt_output << lowered;
+
+    // The static cost estimate goes next to it, e.g. in f.cost for
+    // f.stmt.
+    string cost_filename = filename;
+    if (ends_with(cost_filename, ".stmt")) {
+        cost_filename = cost_filename.substr(0, cost_filename.size() - 5);
+    }
+    cost_filename += ".cost";
+    ofstream cost_output(cost_filename.c_str());
+    cost_output << Halide::Internal::static_cost_report(lowered, name(), get_host_target());
 }
 
 void Func::compile_to_file(const string &filename_prefix, vector<Argument> args,
@@ -1675,6 +2380,406 @@ void Func::compile_to_file(const string &filename_prefix, vector<Argument> args,
     compile_to_object(filename_prefix + ".o", args, filename_prefix, target);
 }
 
+namespace {
+
+// The instruction sets that the dispatcher of a multi-target pipeline
+// checks for.
+const uint64_t dispatch_features = (Target::SSE41 | Target::AVX | Target::AVX2 |
+                                    Target::FMA | Target::F16C | Target::AVX512);
+
+// A name for a target that can be part of a C identifier.
+string target_suffix(const Target &t) {
+    string s = t.to_string();
+    for (size_t i = 0; i < s.size(); i++) {
+        if (!isalnum(s[i])) s[i] = '_';
+    }
+    return s;
+}
+
+}
+
+void Func::compile_to_file(const string &filename_prefix, vector<Argument> args,
+                           const vector<Target> &targets) {
+    assert(defined() && "Can't compile undefined function");
+    assert(!targets.empty() && "compile_to_file needs at least one target");
+    if (targets.size() == 1) {
+        compile_to_file(filename_prefix, args, targets[0]);
+        return;
+    }
+
+    const Target &fallback = targets.back();
+    for (size_t i = 0; i < targets.size(); i++) {
+        const Target &t = targets[i];
+        if (t.arch != Target::X86 || t.os != fallback.os || t.bits != fallback.bits) {
+            std::cerr << "The targets of a multi-target pipeline must all be x86 with the same os "
+                      << "and bit width, but " << t.to_string() << " and "
+                      << fallback.to_string() << " aren't\n";
+            assert(false);
+        }
+    }
+    if (fallback.os == Target::Windows) {
+        std::cerr << "Multi-target pipelines aren't supported on Windows\n";
+        assert(false);
+    }
+    // OS X prefixes C symbols with an underscore, and reads BSD archives.
+    bool darwin = fallback.os == Target::OSX || fallback.os == Target::IOS;
+    string symbol_prefix = darwin ? "_" : "";
+
+    compile_to_header(filename_prefix + ".h", args, filename_prefix);
+
+    vector<Argument> all_args = args;
+    for (int i = 0; i < outputs(); i++) {
+        all_args.push_back(output_buffers()[i]);
+    }
+
+    // Compile each version on its own.
+    vector<LibraryMember> members;
+    vector<string> variant_names;
+    for (size_t i = 0; i < targets.size(); i++) {
+        string fn_name = filename_prefix + "_" + target_suffix(targets[i]);
+        debug(1) << "Compiling " << fn_name << "\n";
+        Stmt s = Halide::Internal::lower(func, targets[i]);
+
+        vector<Buffer> images_to_embed;
+        validate_arguments(vec<string>(name()), args, s, images_to_embed);
+
+        LibraryMember m;
+        m.filename = filename_prefix + "." + int_to_string((int)i + 1) + ".o";
+        m.symbols.push_back(symbol_prefix + fn_name);
+        StmtCompiler cg(targets[i]);
+        cg.compile(s, fn_name, all_args, images_to_embed);
+        cg.compile_to_native(m.filename, false);
+        members.push_back(m);
+        variant_names.push_back(fn_name);
+    }
+
+    // The dispatcher checks the features of each target but the last
+    // in turn, and calls the first version the machine can run.
+    vector<Expr> call_args;
+    for (size_t i = 0; i < all_args.size(); i++) {
+        if (all_args[i].is_buffer) {
+            call_args.push_back(Variable::make(Handle(), all_args[i].name + ".buffer"));
+        } else {
+            call_args.push_back(Variable::make(all_args[i].type, all_args[i].name));
+        }
+    }
+    Expr cpu_features = Call::make(UInt(64), "halide_get_cpu_features",
+                                   vector<Expr>(), Call::Extern);
+    Stmt dispatch;
+    for (size_t i = targets.size(); i > 0; i--) {
+        const string &fn_name = variant_names[i-1];
+        Expr result = Variable::make(Int(32), fn_name + ".result");
+        Stmt call = AssertStmt::make(result == 0, "Call to " + fn_name + " returned non-zero value: %d",
+                                     vec<Expr>(result));
+        call = LetStmt::make(fn_name + ".result",
+                             Call::make(Int(32), fn_name, call_args, Call::Extern), call);
+        if (!dispatch.defined()) {
+            dispatch = call;
+        } else {
+            Expr needs = make_const(UInt(64), (int)(targets[i-1].features & dispatch_features));
+            dispatch = IfThenElse::make((Variable::make(UInt(64), "cpu_features") & needs) == needs,
+                                        call, dispatch);
+        }
+    }
+    dispatch = LetStmt::make("cpu_features", cpu_features, dispatch);
+
+    LibraryMember m;
+    m.filename = filename_prefix + ".0.o";
+    m.symbols.push_back(symbol_prefix + filename_prefix);
+    StmtCompiler cg(fallback);
+    cg.compile(dispatch, filename_prefix, all_args, vector<Buffer>());
+    cg.compile_to_native(m.filename, false);
+    members.insert(members.begin(), m);
+
+    write_static_library(filename_prefix + ".a", members, darwin);
+    for (size_t i = 0; i < members.size(); i++) {
+        remove(members[i].filename.c_str());
+    }
+}
+
+void Func::compile_to_file_check_once(const string &filename_prefix, vector<Argument> args,
+                                      const Target &target) {
+    assert(defined() && "Can't compile undefined function");
+    if (target.os == Target::Windows) {
+        std::cerr << "compile_to_file_check_once isn't supported on Windows\n";
+        assert(false);
+    }
+    bool darwin = target.os == Target::OSX || target.os == Target::IOS;
+    string symbol_prefix = darwin ? "_" : "";
+
+    vector<Argument> all_args = args;
+    for (int i = 0; i < outputs(); i++) {
+        all_args.push_back(output_buffers()[i]);
+    }
+
+    {
+        ofstream header((filename_prefix + ".h").c_str());
+        CodeGen_C cg(header);
+        cg.compile_check_once_header(filename_prefix, all_args);
+    }
+
+    // The checked version, and the same pipeline with no checks. Each
+    // object has a copy of the runtime, as weak symbols, so the linker
+    // keeps one.
+    Target unchecked = target;
+    unchecked.features |= Target::NoAsserts | Target::NoBoundsQuery;
+    const Target *targets[] = {&target, &unchecked};
+    const char *suffixes[] = {"", "_unchecked"};
+
+    vector<LibraryMember> members;
+    for (int i = 0; i < 2; i++) {
+        string fn_name = filename_prefix + suffixes[i];
+        debug(1) << "Compiling " << fn_name << "\n";
+        Stmt s = Halide::Internal::lower(func, *targets[i]);
+
+        vector<Buffer> images_to_embed;
+        validate_arguments(vec<string>(name()), args, s, images_to_embed);
+
+        LibraryMember m;
+        m.filename = filename_prefix + "." + int_to_string(i) + ".o";
+        m.symbols.push_back(symbol_prefix + fn_name);
+        StmtCompiler cg(*targets[i]);
+        cg.compile(s, fn_name, all_args, images_to_embed);
+        cg.compile_to_native(m.filename, false);
+        members.push_back(m);
+    }
+
+    write_static_library(filename_prefix + ".a", members, darwin);
+    for (size_t i = 0; i < members.size(); i++) {
+        remove(members[i].filename.c_str());
+    }
+}
+
+void Func::compile_to_file_with_gpu_dispatch(const string &filename_prefix, vector<Argument> args,
+                                             const string &gpu_schedule, const Target &target,
+                                             int min_gpu_size) {
+    assert(defined() && "Can't compile undefined function");
+    if (!target.has_gpu_feature()) {
+        std::cerr << "compile_to_file_with_gpu_dispatch needs a gpu target, but "
+                  << target.to_string() << " isn't one\n";
+        assert(false);
+    }
+    if (target.os == Target::Windows) {
+        std::cerr << "compile_to_file_with_gpu_dispatch isn't supported on Windows\n";
+        assert(false);
+    }
+    bool darwin = target.os == Target::OSX || target.os == Target::IOS;
+    string symbol_prefix = darwin ? "_" : "";
+
+    vector<Argument> all_args = args;
+    for (int i = 0; i < outputs(); i++) {
+        all_args.push_back(output_buffers()[i]);
+    }
+
+    string cpu_name = filename_prefix + "_cpu", gpu_name = filename_prefix + "_gpu";
+    {
+        ofstream header((filename_prefix + ".h").c_str());
+        CodeGen_C cg(header);
+        cg.compile_header(filename_prefix, all_args);
+        cg.compile_header(cpu_name, all_args);
+        cg.compile_header(gpu_name, all_args);
+    }
+
+    // Lower the pipeline with its own schedule, then with the gpu
+    // one, and put its own back. Both versions are compiled for the
+    // gpu target, so that every object has the same runtime, and so
+    // that the cpu version copies back any inputs that are only on
+    // the device.
+    string cpu_schedule = schedule_to_string(*this);
+    Stmt cpu = Halide::Internal::lower(func, target);
+    schedule_from_string(*this, gpu_schedule);
+    Stmt gpu = Halide::Internal::lower(func, target);
+    schedule_from_string(*this, cpu_schedule);
+
+    Stmt versions[] = {cpu, gpu};
+    const string *names[] = {&cpu_name, &gpu_name};
+    vector<LibraryMember> members;
+    for (int i = 0; i < 2; i++) {
+        debug(1) << "Compiling " << *names[i] << "\n";
+        vector<Buffer> images_to_embed;
+        validate_arguments(vec<string>(name()), args, versions[i], images_to_embed);
+
+        LibraryMember m;
+        m.filename = filename_prefix + "." + int_to_string(i + 1) + ".o";
+        m.symbols.push_back(symbol_prefix + *names[i]);
+        StmtCompiler cg(target);
+        cg.compile(versions[i], *names[i], all_args, images_to_embed);
+        cg.compile_to_native(m.filename, false);
+        members.push_back(m);
+    }
+
+    // The dispatcher runs the gpu version if the first output has at
+    // least as many elements as the threshold the runtime has for
+    // this pipeline. Bounds queries go the same way as the call they
+    // come before, since they have the same output size.
+    vector<Expr> call_args;
+    for (size_t i = 0; i < all_args.size(); i++) {
+        if (all_args[i].is_buffer) {
+            call_args.push_back(Variable::make(Handle(), all_args[i].name + ".buffer"));
+        } else {
+            call_args.push_back(Variable::make(all_args[i].type, all_args[i].name));
+        }
+    }
+    string output = output_buffers()[0].name();
+    Expr size = make_one(Int(64));
+    for (int i = 0; i < dimensions(); i++) {
+        size *= Cast::make(Int(64), Variable::make(Int(32), output + ".extent." + int_to_string(i)));
+    }
+    Expr threshold = Call::make(Int(64), "halide_gpu_dispatch_threshold",
+                                vec<Expr>(filename_prefix, make_const(Int(64), min_gpu_size)),
+                                Call::Extern);
+
+    Stmt calls[2];
+    for (int i = 0; i < 2; i++) {
+        Expr result = Variable::make(Int(32), *names[i] + ".result");
+        Stmt call = AssertStmt::make(result == 0, "Call to " + *names[i] + " returned non-zero value: %d",
+                                     vec<Expr>(result));
+        calls[i] = LetStmt::make(*names[i] + ".result",
+                                 Call::make(Int(32), *names[i], call_args, Call::Extern), call);
+    }
+    Stmt dispatch = IfThenElse::make(size >= threshold, calls[1], calls[0]);
+
+    LibraryMember m;
+    m.filename = filename_prefix + ".0.o";
+    m.symbols.push_back(symbol_prefix + filename_prefix);
+    StmtCompiler cg(target);
+    cg.compile(dispatch, filename_prefix, all_args, vector<Buffer>());
+    cg.compile_to_native(m.filename, false);
+    members.insert(members.begin(), m);
+
+    write_static_library(filename_prefix + ".a", members, darwin);
+    for (size_t i = 0; i < members.size(); i++) {
+        remove(members[i].filename.c_str());
+    }
+}
+
+void Func::compile_to_file_with_schedules(const string &filename_prefix, vector<Argument> args,
+                                          const vector<string> &schedules, const Target &target) {
+    assert(defined() && "Can't compile undefined function");
+    assert(!schedules.empty() && schedules.size() <= 16 &&
+           "compile_to_file_with_schedules takes between one and sixteen schedules");
+    if (target.os == Target::Windows) {
+        std::cerr << "compile_to_file_with_schedules isn't supported on Windows\n";
+        assert(false);
+    }
+    bool darwin = target.os == Target::OSX || target.os == Target::IOS;
+    string symbol_prefix = darwin ? "_" : "";
+
+    vector<Argument> all_args = args;
+    for (int i = 0; i < outputs(); i++) {
+        all_args.push_back(output_buffers()[i]);
+    }
+
+    vector<string> variant_names;
+    for (size_t i = 0; i < schedules.size(); i++) {
+        variant_names.push_back(filename_prefix + "_schedule_" + int_to_string((int)i));
+    }
+    {
+        ofstream header((filename_prefix + ".h").c_str());
+        CodeGen_C cg(header);
+        cg.compile_header(filename_prefix, all_args);
+        for (size_t i = 0; i < variant_names.size(); i++) {
+            cg.compile_header(variant_names[i], all_args);
+        }
+    }
+
+    // Compile a version with each schedule, then put the Func's own
+    // schedule back.
+    string own_schedule = schedule_to_string(*this);
+    vector<LibraryMember> members;
+    for (size_t i = 0; i < schedules.size(); i++) {
+        debug(1) << "Compiling " << variant_names[i] << "\n";
+        schedule_from_string(*this, schedules[i]);
+        Stmt s = Halide::Internal::lower(func, target);
+
+        vector<Buffer> images_to_embed;
+        validate_arguments(vec<string>(name()), args, s, images_to_embed);
+
+        LibraryMember m;
+        m.filename = filename_prefix + "." + int_to_string((int)i + 1) + ".o";
+        m.symbols.push_back(symbol_prefix + variant_names[i]);
+        StmtCompiler cg(target);
+        cg.compile(s, variant_names[i], all_args, images_to_embed);
+        cg.compile_to_native(m.filename, false);
+        members.push_back(m);
+    }
+    schedule_from_string(*this, own_schedule);
+
+    // The dispatcher asks the runtime which version to run for the
+    // shape of the first output, runs it, and reports how long it
+    // took. Bounds queries always go to the first version, and aren't
+    // timed.
+    vector<Expr> call_args;
+    for (size_t i = 0; i < all_args.size(); i++) {
+        if (all_args[i].is_buffer) {
+            call_args.push_back(Variable::make(Handle(), all_args[i].name + ".buffer"));
+        } else {
+            call_args.push_back(Variable::make(all_args[i].type, all_args[i].name));
+        }
+    }
+    string output = output_buffers()[0].name();
+    Expr bucket = 0;
+    for (int i = 0; i < dimensions() && i < 4; i++) {
+        Expr extent = max(Variable::make(Int(32), output + ".extent." + int_to_string(i)), 1);
+        Expr log2_extent = 31 - Call::make(Int(32), Call::count_leading_zeros,
+                                           vec<Expr>(extent), Call::Intrinsic);
+        bucket = bucket | (log2_extent << (5 * i));
+    }
+    Expr num_variants = (int)schedules.size();
+    Expr is_query = Variable::make(Bool(), output + ".host_and_dev_are_null");
+    Expr variant = Variable::make(Int(32), "schedule_variant");
+    Expr chosen = Call::make(Int(32), "halide_schedule_select",
+                             vec<Expr>(filename_prefix, num_variants, Variable::make(Int(32), "schedule_bucket")),
+                             Call::Extern);
+    chosen = Call::make(Int(32), Call::if_then_else, vec<Expr>(is_query, 0, chosen), Call::Intrinsic);
+
+    // A version over its memory budget (see the memory_budget target
+    // feature) falls back to the next one.
+    const int over_memory_budget = -3;
+    Stmt dispatch, fallback;
+    for (size_t i = schedules.size(); i > 0; i--) {
+        const string &fn_name = variant_names[i-1];
+        Expr result = Variable::make(Int(32), fn_name + ".result");
+        Stmt call = AssertStmt::make(result == 0, "Call to " + fn_name + " returned non-zero value: %d",
+                                     vec<Expr>(result));
+        if (fallback.defined()) {
+            call = IfThenElse::make(result == over_memory_budget, fallback, call);
+        }
+        call = LetStmt::make(fn_name + ".result",
+                             Call::make(Int(32), fn_name, call_args, Call::Extern), call);
+        fallback = call;
+        if (!dispatch.defined()) {
+            dispatch = call;
+        } else {
+            dispatch = IfThenElse::make(variant == (int)(i-1), call, dispatch);
+        }
+    }
+
+    Expr now = Call::make(Int(64), "halide_current_time_ns", vector<Expr>(), Call::Extern);
+    Expr start = Variable::make(Int(64), "schedule_start");
+    Expr report = Call::make(Int(32), "halide_schedule_report",
+                             vec<Expr>(filename_prefix, num_variants,
+                                       Variable::make(Int(32), "schedule_bucket"), variant, now - start),
+                             Call::Extern);
+    dispatch = Block::make(dispatch, IfThenElse::make(!is_query, Evaluate::make(report)));
+    dispatch = LetStmt::make("schedule_start", now, dispatch);
+    dispatch = LetStmt::make("schedule_variant", chosen, dispatch);
+    dispatch = LetStmt::make("schedule_bucket", bucket, dispatch);
+
+    LibraryMember m;
+    m.filename = filename_prefix + ".0.o";
+    m.symbols.push_back(symbol_prefix + filename_prefix);
+    StmtCompiler cg(target);
+    cg.compile(dispatch, filename_prefix, all_args, vector<Buffer>());
+    cg.compile_to_native(m.filename, false);
+    members.insert(members.begin(), m);
+
+    write_static_library(filename_prefix + ".a", members, darwin);
+    for (size_t i = 0; i < members.size(); i++) {
+        remove(members[i].filename.c_str());
+    }
+}
+
 void Func::compile_to_file(const string &filename_prefix, const Target &target) {
   compile_to_file(filename_prefix, vector<Argument>(), target);
 }
@@ -1711,7 +2816,7 @@ void Func::compile_to_assembly(const string &filename, vector<Argument> args, co
     if (!lowered.defined()) lowered = Halide::Internal::lower(func, target);
 
     vector<Buffer> images_to_embed;
-    validate_arguments(name(), args, lowered, images_to_embed);
+    validate_arguments(vec<string>(name()), args, lowered, images_to_embed);
 
     for (int i = 0; i < outputs(); i++) {
         args.push_back(output_buffers()[i]);
@@ -1726,41 +2831,115 @@ void Func::compile_to_assembly(const string &filename, vector<Argument> args, co
     compile_to_assembly(filename, args, "", target);
 }
 
+namespace {
+// Guards compiling Funcs, and setting the hooks and thread pools of
+// the compiled modules, so that several threads can realize the same
+// Func at once. Compiling with llvm from several threads at once
+// isn't safe anyway.
+volatile int jit_lock = 0;
+
+struct JITLock {
+    JITLock() {
+        while (__sync_lock_test_and_set(&jit_lock, 1)) {}
+    }
+    ~JITLock() {
+        __sync_lock_release(&jit_lock);
+    }
+};
+}
+
+Internal::JITHandlers Func::jit_handlers() const {
+    Internal::JITHandlers h;
+    h.error_handler = error_handler;
+    h.custom_malloc = custom_malloc;
+    h.custom_free = custom_free;
+    h.custom_do_par_for = custom_do_par_for;
+    h.custom_do_task = custom_do_task;
+    h.custom_trace = custom_trace;
+    h.custom_is_cancelled = custom_is_cancelled;
+    h.custom_check_memory_budget = custom_check_memory_budget;
+    return h;
+}
+
+JITCompiledModule Func::prepare_jit(const Target &target) {
+    // Released after the lock, as in compile_jit_async.
+    JITFuture finished;
+    JITLock lock;
+    if (pending_jit.defined()) {
+        // Wait for the background compile only if there's nothing
+        // older to run.
+        if (!compiled_module.wrapped_function) pending_jit.wait();
+        if (pending_jit.ready()) {
+            Internal::AsyncJITJob *job = pending_jit.get();
+            lowered = job->lowered;
+            arg_values = job->arg_values;
+            image_param_args = job->image_param_args;
+            compiled_module = job->module;
+            jit_cache_store(job->cache_key, compiled_module);
+            finished = pending_jit;
+            pending_jit = JITFuture();
+        }
+    }
+    if (!compiled_module.wrapped_function) compile_jit(target);
+    assert(compiled_module.wrapped_function);
+
+    // In case these have changed since the last realization
+    compiled_module.set_handlers(jit_handlers());
+    compiled_module.use_thread_pool(thread_pool_threads, thread_pool_priority);
+    return compiled_module;
+}
+
+void Func::update_jit_handlers() {
+    if (compiled_module.wrapped_function) {
+        JITLock lock;
+        compiled_module.set_handlers(jit_handlers());
+    }
+}
+
 void Func::set_error_handler(void (*handler)(void *, const char *)) {
     error_handler = handler;
-    if (compiled_module.set_error_handler) {
-        compiled_module.set_error_handler(handler);
-    }
+    update_jit_handlers();
 }
 
 void Func::set_custom_allocator(void *(*cust_malloc)(void *, size_t),
                                 void (*cust_free)(void *, void *)) {
     custom_malloc = cust_malloc;
     custom_free = cust_free;
-    if (compiled_module.set_custom_allocator) {
-        compiled_module.set_custom_allocator(cust_malloc, cust_free);
-    }
+    update_jit_handlers();
 }
 
 void Func::set_custom_do_par_for(int (*cust_do_par_for)(void *, int (*)(void *, int, uint8_t *), int, int, uint8_t *)) {
     custom_do_par_for = cust_do_par_for;
-    if (compiled_module.set_custom_do_par_for) {
-        compiled_module.set_custom_do_par_for(cust_do_par_for);
+    update_jit_handlers();
+}
+
+void Func::set_thread_pool(int num_threads, int priority) {
+    thread_pool_threads = num_threads;
+    thread_pool_priority = priority;
+    if (compiled_module.wrapped_function) {
+        JITLock lock;
+        compiled_module.use_thread_pool(num_threads, priority);
     }
 }
 
 void Func::set_custom_do_task(int (*cust_do_task)(void *, int (*)(void *, int, uint8_t *), int, uint8_t *)) {
     custom_do_task = cust_do_task;
-    if (compiled_module.set_custom_do_task) {
-        compiled_module.set_custom_do_task(cust_do_task);
-    }
+    update_jit_handlers();
 }
 
 void Func::set_custom_trace(Internal::JITCompiledModule::TraceFn t) {
     custom_trace = t;
-    if (compiled_module.set_custom_trace) {
-        compiled_module.set_custom_trace(t);
-    }
+    update_jit_handlers();
+}
+
+void Func::set_custom_is_cancelled(int (*is_cancelled)(void *)) {
+    custom_is_cancelled = is_cancelled;
+    update_jit_handlers();
+}
+
+void Func::set_custom_check_memory_budget(int (*check)(void *, const char *, int64_t, int)) {
+    custom_check_memory_budget = check;
+    update_jit_handlers();
 }
 
 void Func::realize(Buffer b, const Target &target) {
@@ -1768,50 +2947,129 @@ void Func::realize(Buffer b, const Target &target) {
 }
 
 void Func::realize(Realization dst, const Target &target) {
-    if (!compiled_module.wrapped_function) compile_jit(target);
+    realize(dst, NULL, target);
+}
 
-    assert(compiled_module.wrapped_function);
+void Func::realize(Buffer dst, void *user_context, const Target &target) {
+    realize(Realization(vec<Buffer>(dst)), user_context, target);
+}
+
+namespace {
+// The largest realization, in points, to run on the interpreter
+// instead of jit compiling. Zero if HL_INTERPRET isn't set.
+int64_t interpret_limit() {
+    static int64_t limit = -1;
+    if (limit < 0) {
+        const char *env = getenv("HL_INTERPRET");
+        limit = env ? atoll(env) : 0;
+    }
+    return limit;
+}
+}
+
+bool Func::try_interpret(Realization dst, void *user_context, const Target &target) {
+    int64_t limit = interpret_limit();
+    if (limit <= 0) return false;
+
+    // Use the compiled code if we already have it.
+    if (compiled_module.wrapped_function) return false;
+
+    int64_t points = 0;
+    for (size_t i = 0; i < dst.size(); i++) {
+        int64_t p = 1;
+        for (int d = 0; d < dst[i].dimensions(); d++) {
+            p *= dst[i].extent(d);
+        }
+        points += p;
+    }
+    if (points > limit) return false;
+
+    // The interpreter has no gpu backends, and doesn't call the
+    // runtime's hooks.
+    if (target.has_gpu_feature() || custom_trace || custom_do_par_for ||
+        custom_do_task || custom_malloc || custom_free || custom_is_cancelled ||
+        custom_check_memory_budget) {
+        return false;
+    }
+
+    if (!lowered.defined()) lowered = Halide::Internal::lower(func, target);
+    if (!Internal::can_interpret(lowered)) {
+        Internal::debug(1) << "Can't interpret " << name() << ", so jit compiling it\n";
+        return false;
+    }
+
+    InferArguments infer_args(name());
+    infer_args.include_user_context();
+    lowered.accept(&infer_args);
+    vector<Argument> args = infer_args.arg_types;
+    vector<const void *> values = infer_args.arg_values;
+    values[0] = &user_context;
+
+    for (size_t i = 0; i < infer_args.image_param_args.size(); i++) {
+        Buffer b = infer_args.image_param_args[i].second.get_buffer();
+        assert(b.defined() && "An ImageParam is not bound to a buffer");
+        values[infer_args.image_param_args[i].first] = b.raw_buffer();
+    }
+
+    for (int i = 0; i < func.outputs(); i++) {
+        string buffer_name = name();
+        if (func.outputs() > 1) {
+            buffer_name = buffer_name + '.' + int_to_string(i);
+        }
+        args.push_back(Argument(buffer_name, true, func.output_types()[i]));
+        values.push_back(dst[i].raw_buffer());
+    }
+
+    Internal::debug(2) << "Interpreting " << name() << "\n";
+    int exit_status = Internal::interpret(lowered, args, values, error_handler);
+    Internal::debug(2) << "Done interpreting. Exit status was " << exit_status << "\n";
+    return true;
+}
 
+void Func::realize(Realization dst, void *user_context, const Target &target) {
     // Check the type and dimensionality of the buffer
     for (size_t i = 0; i < dst.size(); i++) {
         assert(dst[i].dimensions() == dimensions() && "Buffer and Func have different dimensionalities");
         assert(dst[i].type() == func.output_types()[i] && "Buffer and Func have different element types");
     }
 
-    // In case these have changed since the last realization
-    compiled_module.set_error_handler(error_handler);
-    compiled_module.set_custom_allocator(custom_malloc, custom_free);
-    compiled_module.set_custom_do_par_for(custom_do_par_for);
-    compiled_module.set_custom_do_task(custom_do_task);
-    compiled_module.set_custom_trace(custom_trace);
+    if (try_interpret(dst, user_context, target)) return;
+
+    JITCompiledModule module = prepare_jit(target);
 
-    // Update the address of the buffers we're realizing into
+    // Fill in a copy of the argument values, so that several threads
+    // can realize this Func at once.
+    vector<const void *> values = arg_values;
+
+    // The addresses of the buffers we're realizing into
     for (size_t i = 0; i < dst.size(); i++) {
-        arg_values[arg_values.size()-dst.size()+i] = dst[i].raw_buffer();
+        values[values.size()-dst.size()+i] = dst[i].raw_buffer();
     }
 
-    // Update the addresses of the image param args
+    values[0] = &user_context;
+
+    // The addresses of the image param args
     Internal::debug(3) << image_param_args.size() << " image param args to set\n";
     for (size_t i = 0; i < image_param_args.size(); i++) {
         Internal::debug(3) << "Updating address for image param: " << image_param_args[i].second.name() << "\n";
         Buffer b = image_param_args[i].second.get_buffer();
         assert(b.defined() && "An ImageParam is not bound to a buffer");
         buffer_t *buf = b.raw_buffer();
-        arg_values[image_param_args[i].first] = buf;
+        values[image_param_args[i].first] = buf;
         assert((buf->host || buf->dev) && "An ImageParam is bound to a buffer with NULL host and dev pointers");
     }
 
-    for (size_t i = 0; i < arg_values.size(); i++) {
-        Internal::debug(2) << "Arg " << i << " = " << arg_values[i] << "\n";
-        assert(arg_values[i] && "An argument to a jitted function is null\n");
+    for (size_t i = 0; i < values.size(); i++) {
+        Internal::debug(2) << "Arg " << i << " = " << values[i] << "\n";
+        assert(values[i] && "An argument to a jitted function is null\n");
     }
 
     Internal::debug(2) << "Calling jitted function\n";
-    int exit_status = compiled_module.wrapped_function(&(arg_values[0]));
+    int exit_status = module.wrapped_function(&(values[0]));
     Internal::debug(2) << "Back from jitted function. Exit status was " << exit_status << "\n";
 
     for (size_t i = 0; i < dst.size(); i++) {
-        dst[i].set_source_module(compiled_module);
+        dst[i].set_source_module(module);
     }
 }
 
@@ -1820,12 +3078,7 @@ void Func::infer_input_bounds(Buffer dst) {
 }
 
 void Func::infer_input_bounds(Realization dst) {
-    if (!compiled_module.wrapped_function) {
-        compile_jit();
-    }
-
-    assert(compiled_module.wrapped_function);
-
+    JITCompiledModule module = prepare_jit(get_jit_target_from_environment());
 
     // Check the type and dimensionality of the buffer
     for (size_t i = 0; i < dst.size(); i++) {
@@ -1833,18 +3086,16 @@ void Func::infer_input_bounds(Realization dst) {
         assert(dst[i].type() == func.output_types()[i] && "Buffer and Func have different element types");
     }
 
-    // In case these have changed since the last realization
-    compiled_module.set_error_handler(error_handler);
-    compiled_module.set_custom_allocator(custom_malloc, custom_free);
-    compiled_module.set_custom_do_par_for(custom_do_par_for);
-    compiled_module.set_custom_do_task(custom_do_task);
-    compiled_module.set_custom_trace(custom_trace);
+    vector<const void *> values = arg_values;
 
-    // Update the address of the buffers we're realizing into
+    // The addresses of the buffers we're realizing into
     for (size_t i = 0; i < dst.size(); i++) {
-        arg_values[arg_values.size()-dst.size()+i] = dst[i].raw_buffer();
+        values[values.size()-dst.size()+i] = dst[i].raw_buffer();
     }
 
+    void *user_context = NULL;
+    values[0] = &user_context;
+
     // Update the addresses of the image param args
     Internal::debug(3) << image_param_args.size() << " image param args to set\n";
     vector<buffer_t> dummy_buffers;
@@ -1852,19 +3103,19 @@ void Func::infer_input_bounds(Realization dst) {
         Internal::debug(3) << "Updating address for image param: " << image_param_args[i].second.name() << "\n";
         Buffer b = image_param_args[i].second.get_buffer();
         if (b.defined()) {
-            arg_values[image_param_args[i].first] = b.raw_buffer();
+            values[image_param_args[i].first] = b.raw_buffer();
         } else {
             Internal::debug(1) << "Going to infer input size for param " << image_param_args[i].second.name() << "\n";
             buffer_t buf;
             memset(&buf, 0, sizeof(buffer_t));
             dummy_buffers.push_back(buf);
-            arg_values[image_param_args[i].first] = &dummy_buffers[dummy_buffers.size()-1];
+            values[image_param_args[i].first] = &dummy_buffers[dummy_buffers.size()-1];
         }
     }
 
-    for (size_t i = 0; i < arg_values.size(); i++) {
-        Internal::debug(2) << "Arg " << i << " = " << arg_values[i] << "\n";
-        assert(arg_values[i] && "An argument to a jitted function is null\n");
+    for (size_t i = 0; i < values.size(); i++) {
+        Internal::debug(2) << "Arg " << i << " = " << values[i] << "\n";
+        assert(values[i] && "An argument to a jitted function is null\n");
     }
 
     // Figure out which buffers to watch for changes
@@ -1887,7 +3138,7 @@ void Func::infer_input_bounds(Realization dst) {
             old_buffer[j] = *tracked_buffers[j];
         }
         Internal::debug(2) << "Calling jitted function\n";
-        int exit_status = compiled_module.wrapped_function(&(arg_values[0]));
+        int exit_status = module.wrapped_function(&(values[0]));
         if (exit_status) {
             std::cerr << "Calling " << name()
                       << " in bounds inference mode returned non-success ("
@@ -1957,39 +3208,128 @@ void Func::infer_input_bounds(Realization dst) {
     }
 }
 
-void *Func::compile_jit(const Target &target) {
+void Func::realize_tiled(vector<int32_t> sizes, vector<int32_t> tile_sizes,
+                         void (*fetch)(void *, const string &, Buffer),
+                         void (*emit)(void *, Realization),
+                         void *user_context, const Target &target) {
     assert(defined() && "Can't realize undefined function");
+    assert((int)sizes.size() == dimensions() && tile_sizes.size() == sizes.size() &&
+           "realize_tiled needs a size and a tile size for each dimension");
+    assert(dimensions() <= 4 && "realize_tiled only supports up to four dimensions");
+    for (size_t d = 0; d < sizes.size(); d++) {
+        assert(sizes[d] > 0 && tile_sizes[d] > 0 && "Sizes and tile sizes must be positive");
+    }
 
-    if (!lowered.defined()) lowered = Halide::Internal::lower(func, target);
+    prepare_jit(target);
 
-    // Infer arguments
-    InferArguments infer_args(name());
+    // The inputs to fetch a region of per tile.
+    vector<Internal::Parameter> inputs;
+    for (size_t i = 0; i < image_param_args.size(); i++) {
+        if (!image_param_args[i].second.get_buffer().defined()) {
+            inputs.push_back(image_param_args[i].second);
+        }
+    }
+    assert((fetch || inputs.empty()) && "realize_tiled needs a fetch callback for the unbound ImageParams");
+
+    vector<int32_t> tile_min(sizes.size(), 0);
+    bool done = false;
+    while (!done) {
+        vector<int32_t> extent(4, 0), min(4, 0);
+        for (size_t d = 0; d < sizes.size(); d++) {
+            min[d] = tile_min[d];
+            extent[d] = std::min(tile_sizes[d], sizes[d] - tile_min[d]);
+        }
+        Internal::debug(2) << "Realizing the tile of " << name() << " at "
+                           << min[0] << ", " << min[1] << ", " << min[2] << ", " << min[3] << "\n";
+
+        vector<Buffer> outputs(func.outputs());
+        for (size_t i = 0; i < outputs.size(); i++) {
+            outputs[i] = Buffer(func.output_types()[i], extent[0], extent[1], extent[2], extent[3]);
+            outputs[i].set_min(min[0], min[1], min[2], min[3]);
+        }
+        Realization tile(outputs);
+
+        infer_input_bounds(tile);
+        for (size_t i = 0; i < inputs.size(); i++) {
+            fetch(user_context, inputs[i].name(), inputs[i].get_buffer());
+        }
+        realize(tile, user_context, target);
+        for (size_t i = 0; i < inputs.size(); i++) {
+            inputs[i].set_buffer(Buffer());
+        }
+        if (emit) emit(user_context, tile);
+
+        // The next tile.
+        done = true;
+        for (size_t d = 0; d < sizes.size(); d++) {
+            tile_min[d] += tile_sizes[d];
+            if (tile_min[d] < sizes[d]) {
+                done = false;
+                break;
+            }
+            tile_min[d] = 0;
+        }
+    }
+}
+
+bool Func::pin_host_memory(Buffer b, const Target &target) {
+    return b.pin_host_memory(prepare_jit(target));
+}
+
+namespace {
+// The arguments of a jitted Func: the user_context, then the Params
+// and images it uses, then a slot for each output buffer.
+void infer_jit_arguments(Internal::Function func, Stmt lowered,
+                         vector<Argument> *args, vector<const void *> *arg_values,
+                         vector<pair<int, Internal::Parameter> > *image_param_args) {
+    InferArguments infer_args(func.name());
+    infer_args.include_user_context();
     lowered.accept(&infer_args);
-    arg_values = infer_args.arg_values;
+    *args = infer_args.arg_types;
+    *arg_values = infer_args.arg_values;
+    *image_param_args = infer_args.image_param_args;
 
     for (int i = 0; i < func.outputs(); i++) {
-        string buffer_name = name();
+        string buffer_name = func.name();
         if (func.outputs() > 1) {
             buffer_name = buffer_name + '.' + int_to_string(i);
         }
         Type t = func.output_types()[i];
         Argument me(buffer_name, true, t);
-        infer_args.arg_types.push_back(me);
-        arg_values.push_back(NULL); // A spot to put the address of this output buffer
+        args->push_back(me);
+        arg_values->push_back(NULL); // A spot to put the address of this output buffer
     }
-    image_param_args = infer_args.image_param_args;
 
     Internal::debug(2) << "Inferred argument list:\n";
-    for (size_t i = 0; i < infer_args.arg_types.size(); i++) {
-        Internal::debug(2) << infer_args.arg_types[i].name << ", "
-                         << infer_args.arg_types[i].type << ", "
-                         << infer_args.arg_types[i].is_buffer << "\n";
+    for (size_t i = 0; i < args->size(); i++) {
+        Internal::debug(2) << (*args)[i].name << ", "
+                           << (*args)[i].type << ", "
+                           << (*args)[i].is_buffer << "\n";
     }
+}
+}
+
+void *Func::compile_jit(const Target &target) {
+    assert(defined() && "Can't realize undefined function");
+
+    if (!lowered.defined()) lowered = Halide::Internal::lower(func, target);
+
+    vector<Argument> arg_types;
+    infer_jit_arguments(func, lowered, &arg_types, &arg_values, &image_param_args);
 
     Target t = target;
     t.features |= Target::JIT;
+    assert(!(t.features & Target::NoRuntime) &&
+           "Can't jit compile without the runtime, because there's nothing to link it against");
+
+    // Reuse the compiled module if we've seen this same pipeline before.
+    string cache_key = jit_cache_key(lowered, t, arg_types);
+    if (debug::debug_level < 3 && jit_cache_lookup(cache_key, &compiled_module)) {
+        return compiled_module.function;
+    }
+
     StmtCompiler cg(t);
-    cg.compile(lowered, name(), infer_args.arg_types, vector<Buffer>());
+    cg.compile(lowered, name(), arg_types, vector<Buffer>());
 
     if (debug::debug_level >= 3) {
         cg.compile_to_native(name() + ".s", true);
@@ -1998,11 +3338,259 @@ void *Func::compile_jit(const Target &target) {
         stmt_debug << lowered;
     }
 
+    compiled_module = cg.compile_to_function_pointers(cache_key);
+    jit_cache_store(cache_key, compiled_module);
+
+    return compiled_module.function;
+}
+
+JITFuture Func::compile_jit_async(const Target &target, void (*callback)(void *), void *callback_arg) {
+    assert(defined() && "Can't realize undefined function");
+
+    Target t = target;
+    t.features |= Target::JIT;
+    assert(!(t.features & Target::NoRuntime) &&
+           "Can't jit compile without the runtime, because there's nothing to link it against");
+
+    // Lowering isn't thread-safe (it shares the Functions and the
+    // unique name counters), so only the llvm part is done on the
+    // other thread.
+    Internal::AsyncJITJob *job = new Internal::AsyncJITJob;
+    JITFuture future(job);
+    job->lowered = Halide::Internal::lower(func, target);
+    job->name = name();
+    job->target = t;
+    job->callback = callback;
+    job->callback_arg = callback_arg;
+    infer_jit_arguments(func, job->lowered, &job->args, &job->arg_values, &job->image_param_args);
+    job->cache_key = jit_cache_key(job->lowered, t, job->args);
+
+    // Destroying a job waits for its thread, which may be running a
+    // callback that realizes this Func, so the job this replaces is
+    // released after the lock.
+    JITFuture replaced;
+    bool cached;
+    {
+        JITLock lock;
+        cached = debug::debug_level < 3 && jit_cache_lookup(job->cache_key, &job->module);
+        if (cached) {
+            job->done = 1;
+        } else {
+            Internal::start_async_jit(job);
+        }
+        replaced = pending_jit;
+        pending_jit = future;
+    }
+    if (cached && callback) callback(callback_arg);
+    return future;
+}
+
+void Func::release_jit() {
+    JITFuture pending;
+    JITLock lock;
+    pending = pending_jit;
+    pending_jit = JITFuture();
+    if (compiled_module.wrapped_function) {
+        jit_cache_forget(compiled_module);
+    }
+    compiled_module = JITCompiledModule();
+    arg_values.clear();
+    image_param_args.clear();
+}
+
+Callable Func::compile_to_callable(const Target &target) {
+    Callable c;
+    c.module = prepare_jit(target);
+
+    InferArguments infer_args(name());
+    infer_args.include_user_context();
+    lowered.accept(&infer_args);
+    c.bound_values = infer_args.arg_values;
+
+    // Images are bound now. Everything else is supplied per call.
+    vector<bool> is_image(infer_args.arg_types.size(), false);
+    for (size_t i = 0; i < infer_args.image_args.size(); i++) {
+        is_image[infer_args.image_args[i].first] = true;
+        c.images.push_back(infer_args.image_args[i].second);
+    }
+    // The user_context is passed separately.
+    is_image[0] = true;
+    for (size_t i = 0; i < infer_args.arg_types.size(); i++) {
+        if (!is_image[i]) {
+            c.args.push_back(infer_args.arg_types[i]);
+            c.slots.push_back((int)i);
+            c.bound_values[i] = NULL;
+        }
+    }
+
+    for (int i = 0; i < func.outputs(); i++) {
+        string buffer_name = name();
+        if (func.outputs() > 1) {
+            buffer_name = buffer_name + '.' + int_to_string(i);
+        }
+        c.args.push_back(Argument(buffer_name, true, func.output_types()[i]));
+        c.slots.push_back((int)c.bound_values.size());
+        c.bound_values.push_back(NULL);
+    }
+
+    return c;
+}
+
+// Halide::Pipeline, not the Internal IR node of the same name.
+Halide::Pipeline::Pipeline(const vector<Func> &outputs) : funcs(outputs) {
+    assert(!funcs.empty() && "A Pipeline needs at least one output");
+}
+
+Halide::Pipeline::Pipeline(Func a, Func b) : funcs(vec<Func>(a, b)) {}
+
+Halide::Pipeline::Pipeline(Func a, Func b, Func c) : funcs(vec<Func>(a, b, c)) {}
+
+vector<string> Halide::Pipeline::output_names() const {
+    vector<string> names;
+    for (size_t i = 0; i < funcs.size(); i++) {
+        names.push_back(funcs[i].name());
+    }
+    return names;
+}
+
+vector<Argument> Halide::Pipeline::output_arguments() const {
+    vector<Argument> args;
+    for (size_t i = 0; i < funcs.size(); i++) {
+        for (int j = 0; j < funcs[i].outputs(); j++) {
+            args.push_back(funcs[i].output_buffers()[j]);
+        }
+    }
+    return args;
+}
+
+void Halide::Pipeline::lower(const Target &target) {
+    if (lowered.defined()) return;
+    vector<Function> functions;
+    for (size_t i = 0; i < funcs.size(); i++) {
+        assert(funcs[i].defined() && "Can't compile a pipeline with an undefined output");
+        functions.push_back(funcs[i].function());
+    }
+    lowered = Halide::Internal::lower(functions, target);
+}
+
+void Halide::Pipeline::compile_to_file(const string &filename_prefix, vector<Argument> args,
+                               const Target &target) {
+    lower(target);
+
+    vector<Buffer> images_to_embed;
+    validate_arguments(output_names(), args, lowered, images_to_embed);
+
+    vector<Argument> outputs = output_arguments();
+    args.insert(args.end(), outputs.begin(), outputs.end());
+
+    ofstream header((filename_prefix + ".h").c_str());
+    CodeGen_C header_cg(header);
+    header_cg.compile_header(filename_prefix, args);
+
+    StmtCompiler cg(target);
+    cg.compile(lowered, filename_prefix, args, images_to_embed);
+    cg.compile_to_native(filename_prefix + ".o", false);
+}
+
+void Halide::Pipeline::compile_to_file(const string &filename_prefix, Argument a, const Target &target) {
+    compile_to_file(filename_prefix, vec<Argument>(a), target);
+}
+
+void Halide::Pipeline::compile_to_file(const string &filename_prefix, Argument a, Argument b,
+                               const Target &target) {
+    compile_to_file(filename_prefix, vec<Argument>(a, b), target);
+}
+
+void Halide::Pipeline::compile_to_lowered_stmt(const string &filename) {
+    lower(get_host_target());
+    ofstream stmt_output(filename.c_str());
+    stmt_output << lowered;
+}
+
+void *Halide::Pipeline::compile_jit(const Target &target) {
+    JITLock lock;
+    if (compiled_module.wrapped_function) return compiled_module.function;
+
+    lower(target);
+
+    InferArguments infer_args(output_names());
+    infer_args.include_user_context();
+    lowered.accept(&infer_args);
+    arg_values = infer_args.arg_values;
+    image_param_args = infer_args.image_param_args;
+
+    vector<Argument> args = infer_args.arg_types;
+    vector<Argument> outputs = output_arguments();
+    for (size_t i = 0; i < outputs.size(); i++) {
+        args.push_back(outputs[i]);
+        arg_values.push_back(NULL);
+    }
+
+    Target t = target;
+    t.features |= Target::JIT;
+    assert(!(t.features & Target::NoRuntime) &&
+           "Can't jit compile without the runtime, because there's nothing to link it against");
+
+    StmtCompiler cg(t);
+    cg.compile(lowered, funcs[0].name(), args, vector<Buffer>());
     compiled_module = cg.compile_to_function_pointers();
 
     return compiled_module.function;
 }
 
+void Halide::Pipeline::realize(Realization dst, const Target &target) {
+    compile_jit(target);
+    JITCompiledModule module = compiled_module;
+
+    // Check the types and dimensionalities of the buffers
+    size_t count = 0;
+    for (size_t i = 0; i < funcs.size(); i++) {
+        for (int j = 0; j < funcs[i].outputs(); j++, count++) {
+            assert(count < dst.size() && "Not enough buffers to realize a Pipeline into");
+            assert(dst[count].dimensions() == funcs[i].dimensions() &&
+                   "Buffer and Func have different dimensionalities");
+            assert(dst[count].type() == funcs[i].output_types()[j] &&
+                   "Buffer and Func have different element types");
+        }
+    }
+    assert(count == dst.size() && "Too many buffers to realize a Pipeline into");
+
+    vector<const void *> values = arg_values;
+    for (size_t i = 0; i < dst.size(); i++) {
+        values[values.size()-dst.size()+i] = dst[i].raw_buffer();
+    }
+
+    void *user_context = NULL;
+    values[0] = &user_context;
+
+    for (size_t i = 0; i < image_param_args.size(); i++) {
+        Buffer b = image_param_args[i].second.get_buffer();
+        assert(b.defined() && "An ImageParam is not bound to a buffer");
+        values[image_param_args[i].first] = b.raw_buffer();
+    }
+
+    for (size_t i = 0; i < values.size(); i++) {
+        assert(values[i] && "An argument to a jitted function is null\n");
+    }
+
+    Internal::debug(2) << "Calling jitted pipeline\n";
+    int exit_status = module.wrapped_function(&(values[0]));
+    Internal::debug(2) << "Back from jitted pipeline. Exit status was " << exit_status << "\n";
+
+    for (size_t i = 0; i < dst.size(); i++) {
+        dst[i].set_source_module(module);
+    }
+}
+
+void compile_standalone_runtime(const string &object_filename, Target t) {
+    t.features &= ~(Target::NoRuntime | Target::JIT);
+
+    // Compiling no statement makes a module of just the runtime.
+    StmtCompiler cg(t);
+    cg.compile(Stmt(), "halide_runtime", vector<Argument>(), vector<Buffer>());
+    cg.compile_to_native(object_filename, false);
+}
+
 void Func::test() {
 
     Image<int> input(7, 5);
@@ -17,6 +17,8 @@
 #include "Target.h"
 #include "Tuple.h"
 #include "Target.h"
+#include "Callable.h"
+#include "AsyncJIT.h"
 
 namespace Halide {
 
@@ -204,16 +206,21 @@ public:
      * traversed. See the documentation for Func for the meanings. */
     // @{
 
-    EXPORT ScheduleHandle &split(Var old, Var outer, Var inner, Expr factor);
+    EXPORT ScheduleHandle &split(Var old, Var outer, Var inner, Expr factor, TailStrategy tail = Tail_Auto);
     EXPORT ScheduleHandle &fuse(Var inner, Var outer, Var fused);
     EXPORT ScheduleHandle &parallel(Var var);
     EXPORT ScheduleHandle &vectorize(Var var);
     EXPORT ScheduleHandle &unroll(Var var);
     EXPORT ScheduleHandle &parallel(Var var, Expr task_size);
-    EXPORT ScheduleHandle &vectorize(Var var, int factor);
-    EXPORT ScheduleHandle &unroll(Var var, int factor);
-    EXPORT ScheduleHandle &tile(Var x, Var y, Var xo, Var yo, Var xi, Var yi, Expr xfactor, Expr yfactor);
-    EXPORT ScheduleHandle &tile(Var x, Var y, Var xi, Var yi, Expr xfactor, Expr yfactor);
+    EXPORT ScheduleHandle &vectorize(Var var, int factor, TailStrategy tail = Tail_Auto);
+    EXPORT ScheduleHandle &vectorize_natural(Var var, TailStrategy tail = Tail_Auto);
+    EXPORT ScheduleHandle &unroll(Var var, int factor, TailStrategy tail = Tail_Auto);
+    EXPORT ScheduleHandle &unroll_and_jam(Var var);
+    EXPORT ScheduleHandle &unroll_and_jam(Var var, int factor, TailStrategy tail = Tail_Auto);
+    EXPORT ScheduleHandle &tile(Var x, Var y, Var xo, Var yo, Var xi, Var yi,
+                                Expr xfactor, Expr yfactor, TailStrategy tail = Tail_Auto);
+    EXPORT ScheduleHandle &tile(Var x, Var y, Var xi, Var yi,
+                                Expr xfactor, Expr yfactor, TailStrategy tail = Tail_Auto);
     EXPORT ScheduleHandle &reorder(const std::vector<VarOrRVar> &vars);
     EXPORT ScheduleHandle &reorder(VarOrRVar x, VarOrRVar y);
     EXPORT ScheduleHandle &reorder(VarOrRVar x, VarOrRVar y, VarOrRVar z);
@@ -260,6 +267,85 @@ public:
                                     Expr x_size, Expr y_size, Expr z_size, GPUAPI gpu_api = GPU_Default);
     // @}
 
+    /** Do this update with atomic read-modify-write operations, so
+     * that iterations that write to the same site may run at the same
+     * time. The update must be of the form f(args) = f(args) + e, with
+     * a single value, where e doesn't refer to f. This makes
+     * scatter-style reductions like histograms safe to parallelize:
+     *
+     \code
+     RDom r(input);
+     hist(x) = 0;
+     hist(input(r.x, r.y)) += 1;
+     hist.update().atomic().parallel(r.y);
+     \endcode
+     *
+     * Any floating point sum is accumulated in an unspecified
+     * order, so the result may round differently from run to run. */
+    EXPORT ScheduleHandle &atomic();
+
+    /** Mark a reduction variable of an atomic update as
+     * parallel. Reduction variables can only be parallelized if \ref
+     * atomic has been called first. */
+    EXPORT ScheduleHandle &parallel(RVar var);
+
+    /** Vectorize a reduction variable that doesn't appear on the
+     * left-hand-side of the update, as in a dot product:
+     \code
+     RDom r(0, 64);
+     f(x) = 0;
+     f(x) += cast<int>(a(r, x)) * b(r);
+     f.update().vectorize(r, 8);
+     \endcode
+     * Each vector of terms is combined across its lanes before being
+     * accumulated, using instructions like pmaddwd and psadbw on x86
+     * and vpaddl on ARM where they apply. Updates that aren't a sum,
+     * minimum, or maximum into a single location are computed a lane
+     * at a time instead. The two-argument form splits the variable by
+     * the factor first. Its tail strategy defaults to
+     * Tail_GuardWithIf, because rounding the extent up would add
+     * terms from outside the reduction domain. */
+    // @{
+    EXPORT ScheduleHandle &vectorize(RVar var);
+    EXPORT ScheduleHandle &vectorize(RVar var, int factor, TailStrategy tail = Tail_GuardWithIf);
+    // @}
+
+    /** Split, tile and unroll reduction variables, to block an update
+     * for cache or registers:
+     \code
+     RDom r(0, 64, 0, 64);
+     RVar rxo("rxo"), ryo("ryo"), rxi("rxi"), ryi("ryi");
+     f(x, y) += k(r.x, r.y) * in(x + r.x, y + r.y);
+     f.update().tile(r.x, r.y, rxo, ryo, rxi, ryi, 16, 16);
+     in.compute_at(f, rxo);
+     \endcode
+     * Producers may be computed at the loops made (see \ref
+     * Func::compute_at), and are then computed over what each tile
+     * of the domain reads. The tail strategy can only be
+     * Tail_GuardWithIf (or Tail_Auto, which means it), because any
+     * other would visit points outside the reduction domain.
+     *
+     * Splitting a variable keeps the order in which the domain is
+     * visited. Loops that change it, by putting the loops of one
+     * reduction variable inside those of another that was inside it,
+     * or the inner loop of a split outside the outer one (as tiling
+     * does), are only allowed if the order doesn't matter. That is
+     * the case if each point of the domain reads and writes only its
+     * own site, as in f(r.x, r.y) = f(r.x, r.y) * 2, or if the update
+     * adds, multiplies, or takes the min or max of the value at a
+     * site and an expression that doesn't read the function, as in
+     * the example above. Sums of floating point numbers may then round
+     * differently. Lowering checks this. */
+    // @{
+    EXPORT ScheduleHandle &split(RVar old, RVar outer, RVar inner, Expr factor, TailStrategy tail = Tail_GuardWithIf);
+    EXPORT ScheduleHandle &tile(RVar x, RVar y, RVar xo, RVar yo, RVar xi, RVar yi,
+                                Expr xfactor, Expr yfactor, TailStrategy tail = Tail_GuardWithIf);
+    EXPORT ScheduleHandle &tile(RVar x, RVar y, RVar xi, RVar yi,
+                                Expr xfactor, Expr yfactor, TailStrategy tail = Tail_GuardWithIf);
+    EXPORT ScheduleHandle &unroll(RVar var);
+    EXPORT ScheduleHandle &unroll(RVar var, int factor, TailStrategy tail = Tail_GuardWithIf);
+    // @}
+
     // These calls are for legacy compatibility only.
     EXPORT ScheduleHandle &cuda_threads(Var thread_x) {
         return gpu_threads(thread_x);
@@ -332,6 +418,10 @@ class Func {
      * we don't have to rejit every time we want to evaluated it. */
     Internal::JITCompiledModule compiled_module;
 
+    /** The last compile started by compile_jit_async, if it hasn't
+     * replaced compiled_module yet. */
+    JITFuture pending_jit;
+
     /** The current error handler used for realizing this
      * function. May be NULL. Only relevant when jitting. */
     void (*error_handler)(void *user_context, const char *);
@@ -359,12 +449,26 @@ class Func {
 
     // @}
 
+    /** The current custom cancellation check. May be NULL. */
+    int (*custom_is_cancelled)(void *user_context);
+
+    /** The current custom memory budget check. May be NULL. */
+    int (*custom_check_memory_budget)(void *user_context, const char *pipeline,
+                                      int64_t bytes, int is_query);
+
+    /** The size and worker priority of the thread pool this function
+     * runs on. Both zero means the shared default pool. */
+    // @{
+    int thread_pool_threads, thread_pool_priority;
+    // @}
+
     /** The random seed to use for realizations of this function. */
     uint32_t random_seed;
 
     /** Pointers to current values of the automatically inferred
      * arguments (buffers and scalars) used to realize this
-     * function. Only relevant when jitting. We can hold these things
+     * function, starting with a slot for the user_context. Only
+     * relevant when jitting. We can hold these things
      * with raw pointers instead of reference-counted handles, because
      * func indirectly holds onto them with reference-counted handles
      * via its value Expr. */
@@ -375,6 +479,23 @@ class Func {
      * still be valid though. */
     std::vector<std::pair<int, Internal::Parameter> > image_param_args;
 
+    /** The hooks currently set on this Func. */
+    Internal::JITHandlers jit_handlers() const;
+
+    /** Jit compile this function if it hasn't been already, give the
+     * module the current hooks and thread pool, and return it. Safe
+     * to call from several threads at once. */
+    Internal::JITCompiledModule prepare_jit(const Target &target);
+
+    /** Run this function on the interpreter instead of jit compiling
+     * it, if HL_INTERPRET is set to at least the number of points in
+     * the realization, and the pipeline and hooks allow it. Returns
+     * whether it did. */
+    bool try_interpret(Realization dst, void *user_context, const Target &target);
+
+    /** Give the hooks to the compiled module, if there is one. */
+    void update_jit_handlers();
+
 public:
     EXPORT static void test();
 
@@ -442,10 +563,23 @@ public:
      * buffers. If the buffer is also one of the arguments to the
      * function, strange things may happen, as the pipeline isn't
      * necessarily safe to run in-place. If you pass multiple buffers,
-     * they must have matching sizes. */
+     * they must have matching sizes.
+     *
+     * Several threads may realize the same Func at once, into
+     * different buffers. The values of its Params and the buffers
+     * bound to its ImageParams are shared between them, though, so
+     * use a Callable to give each call its own. The user_context is
+     * passed to the error handler, allocator, task functions and
+     * trace function of this call (the default is NULL), so a program
+     * realizing one Func from several threads can tell whose call
+     * they're serving. */
     // @{
     EXPORT void realize(Realization dst, const Target &target = get_jit_target_from_environment());
     EXPORT void realize(Buffer dst, const Target &target = get_jit_target_from_environment());
+    EXPORT void realize(Realization dst, void *user_context,
+                        const Target &target = get_jit_target_from_environment());
+    EXPORT void realize(Buffer dst, void *user_context,
+                        const Target &target = get_jit_target_from_environment());
     // @}
 
     /** For a given size of output, or a given output buffer,
@@ -459,6 +593,27 @@ public:
     EXPORT void infer_input_bounds(Buffer dst);
     // @}
 
+    /** Compute an output of the given size one tile at a time, for
+     * images too large to hold in memory. For each tile, the region
+     * of each unbound ImageParam it needs is found as by
+     * infer_input_bounds, allocated, and passed to fetch along with
+     * the name of the ImageParam, to be filled in (e.g. read from a
+     * file). Then the tile is computed into buffers of its own, whose
+     * mins are the position of the tile, and passed to emit. The
+     * input regions are released after each tile (and the tile too,
+     * unless emit keeps a reference), so the memory used is bounded by
+     * the footprint of one tile. Tiles at the edges are smaller if the
+     * tile size doesn't divide the size of the output. ImageParams that
+     * are bound to a buffer are used as they are. Tiles are computed
+     * in order, with the first dimension changing fastest. The
+     * user_context is also passed to the hooks of the pipeline, as
+     * with realize. */
+    EXPORT void realize_tiled(std::vector<int32_t> sizes, std::vector<int32_t> tile_sizes,
+                              void (*fetch)(void *user_context, const std::string &input, Buffer region),
+                              void (*emit)(void *user_context, Realization tile),
+                              void *user_context = NULL,
+                              const Target &target = get_jit_target_from_environment());
+
     /** Statically compile this function to llvm bitcode, with the
      * given filename (which should probably end in .bc), type
      * signature, and C function name (which defaults to the same name
@@ -491,6 +646,15 @@ public:
      * call compile_to_file instead. */
     EXPORT void compile_to_header(const std::string &filename, std::vector<Argument>, const std::string &fn_name = "");
 
+    /** Emit a text file describing the signature of the function
+     * that compile_to_header declares: its name, then a line per
+     * argument, in order, of the form "input buffer <name> <type>",
+     * "input scalar <name> <type>" or "output buffer <name> <type>",
+     * with types written like "uint8" or "float32". This lets loaders
+     * that can't parse C, such as halide_aot in the Python bindings,
+     * call the compiled object. */
+    EXPORT void compile_to_descriptor(const std::string &filename, std::vector<Argument>, const std::string &fn_name = "");
+
     /** Statically compile this function to text assembly equivalent
      * to the object file generated by compile_to_object. This is
      * useful for checking what Halide is producing without having to
@@ -510,7 +674,13 @@ public:
 
     /** Write out an internal representation of lowered code. Useful
      * for analyzing and debugging scheduling. Canonical extension is
-     * .stmt, which must be supplied in filename. */
+     * .stmt, which must be supplied in filename. A static estimate of
+     * the ops, bytes loaded and stored, and vector utilization per
+     * point of each produce and update step, and of the size of the
+     * tile each Func is stored in, is written next to it with the
+     * extension .cost, in the format read by util/HalideProf. Pass
+     * both it and the output of the profiler to HalideProf to see
+     * which steps are compute-bound and which are bandwidth-bound. */
     EXPORT void compile_to_lowered_stmt(const std::string &filename);
 
     /** Compile to object file and header pair, with the given
@@ -534,16 +704,140 @@ public:
                                 const Target &target = get_target_from_environment());
     // @}
 
+    /** Compile a version of the function for each of several x86
+     * targets with the same os and bit width (e.g. sse41, avx2 and
+     * avx512 variants of one target), and a function named after the
+     * first argument that runs the first version whose instruction set
+     * features the machine has. The last target is the fallback, and is
+     * used whatever the machine has, so list them from the most
+     * demanding to the least. The features are found with cpuid on the
+     * first call, and remembered. Writes a header, and a static library
+     * (filename_prefix.a) with an object file for the dispatcher and
+     * for each version, since each one needs its own code generator
+     * settings. The runtime is in every object, but as weak symbols,
+     * so the linker keeps one copy and they all share it. Not
+     * supported on Windows. */
+    EXPORT void compile_to_file(const std::string &filename_prefix, std::vector<Argument> args,
+                                const std::vector<Target> &targets);
+
+    /** Compile to a header and a static library (filename_prefix.a)
+     * with two versions of the pipeline: filename_prefix, with all
+     * of its checks, and filename_prefix_unchecked, compiled with
+     * NoAsserts and NoBoundsQuery. The header also defines a handle,
+     * filename_prefix_checked, which the program fills in with
+     * filename_prefix_check. That calls the checked version and, if
+     * it succeeds, remembers the shapes of the buffers and the values
+     * of the scalars. Afterwards filename_prefix_call_checked runs
+     * the unchecked version if they're all the same (and no host
+     * pointer is NULL), and the checked one otherwise, so it's as safe
+     * as the checked version but doesn't pay for the checks on calls
+     * it has seen before, e.g. for each tile of a large image. The
+     * handle isn't changed by those calls, so several threads can use
+     * one.
+     *
+     * For workloads that run the pipeline on many small frames, the
+     * header also defines filename_prefix_batch, which takes a count
+     * of frames, an array of that many buffer_t pointers for each
+     * buffer argument, and the scalars shared by all of them. It
+     * checks the first frame, then runs the rest as the tasks of one
+     * parallel loop through filename_prefix_call_checked, so the
+     * frames and the parallel loops within each one share the thread
+     * pool. Turning on the runtime's allocator cache (see
+     * halide_use_allocator_cache) lets the frames reuse each other's
+     * intermediate buffers. Not supported on Windows. */
+    EXPORT void compile_to_file_check_once(const std::string &filename_prefix, std::vector<Argument> args,
+                                           const Target &target = get_target_from_environment());
+
+    /** Compile two versions of the pipeline, one with its current
+     * schedule (for the cpu) and one with the schedules in
+     * gpu_schedule (text written by schedule_to_string, or a file read
+     * with load_schedule, for the gpu), and a function named after
+     * the first argument that picks one by output size. Small outputs
+     * lose more to kernel launches and copies than the gpu saves, so
+     * the gpu version only runs if the first output has at least
+     * min_gpu_size elements. The runtime keeps that threshold by
+     * pipeline name, so a program can replace it with one it has
+     * measured for the device it runs on (see
+     * halide_set_gpu_dispatch_threshold). Writes a header, which also
+     * declares the two versions as filename_prefix_cpu and
+     * filename_prefix_gpu for timing them, and a static library
+     * (filename_prefix.a). The target must have a gpu feature; both
+     * versions are compiled for it. The Func keeps its own schedule
+     * afterwards. Not supported on Windows. */
+    EXPORT void compile_to_file_with_gpu_dispatch(const std::string &filename_prefix, std::vector<Argument> args,
+                                                  const std::string &gpu_schedule,
+                                                  const Target &target = get_target_from_environment(),
+                                                  int min_gpu_size = 512 * 1024);
+
+    /** Compile a version of the pipeline with each of several
+     * schedules (text written by schedule_to_string, or files read
+     * with load_schedule), and a function named after the first
+     * argument that chooses among them as the program runs. The
+     * runtime times each version on real calls and runs the fastest
+     * one, separately for each bucket of output shapes (the floor of
+     * the log2 of each extent of the first output), and now and then
+     * tries the others again in case the traffic has changed. See
+     * halide_schedule_select in HalideRuntime.h for the settings, and
+     * for saving the choices between runs. Bounds queries always use
+     * the first schedule, so the schedules must need the same input
+     * region for a given output (e.g. because the inputs have
+     * boundary conditions, or the splits divide the sizes used).
+     * With the memory_budget target feature, a version over its
+     * budget falls back to the next one, so give the schedules in
+     * order of decreasing memory use (e.g. compute_root first, then
+     * smaller tiles or storage folding). Writes a header, which also declares the versions as
+     * filename_prefix_schedule_0, _1, and so on, and a static library
+     * (filename_prefix.a). The Func keeps its own schedule afterwards.
+     * At most sixteen schedules. Not supported on Windows. */
+    EXPORT void compile_to_file_with_schedules(const std::string &filename_prefix, std::vector<Argument> args,
+                                               const std::vector<std::string> &schedules,
+                                               const Target &target = get_target_from_environment());
+
     /** Eagerly jit compile the function to machine code. This
      * normally happens on the first call to realize. If you're
      * running your halide pipeline inside time-sensitive code and
      * wish to avoid including the time taken to compile a pipeline,
      * then you can call this ahead of time. Returns the raw function
-     * pointer to the compiled pipeline. Default is to use the Target
-     * returned from Halide::get_jit_target_from_environment()
+     * pointer to the compiled pipeline, whose first argument is the
+     * void * user_context. Default is to use the Target returned from
+     * Halide::get_jit_target_from_environment()
      */
      EXPORT void *compile_jit(const Target &target = get_jit_target_from_environment());
 
+    /** Forget the jit-compiled version of this function, and remove
+     * it from the jit cache, so its memory is freed once nothing else
+     * holds it. Callables made from it, other Funcs that found it in
+     * the jit cache, and buffers it realized into also hold it.
+     * Realizing this Func again compiles it again. */
+    EXPORT void release_jit();
+
+    /** Lower the function again, on this thread, and then jit compile
+     * it on a new thread. Until the compile is done, realizations of
+     * this Func keep using the previously compiled version, if there
+     * is one, and otherwise wait for it. The callback, if given, is
+     * called with callback_arg on the compiling thread when it's
+     * done. Use this to recompile after changing the schedule
+     * without stalling the caller. On Windows the compile is done
+     * before this returns. */
+    EXPORT JITFuture compile_jit_async(const Target &target = get_jit_target_from_environment(),
+                                       void (*callback)(void *) = NULL, void *callback_arg = NULL);
+
+    /** Jit compile the function, and return it as a Callable, which
+     * is cheaper to call than realize, and can be called from several
+     * threads at once. The error handler, allocator, task functions,
+     * trace function and thread pool set on this Func are those of
+     * the compiled module, which the Callable shares, so setting them
+     * later on the Func changes them for the Callable too. */
+    EXPORT Callable compile_to_callable(const Target &target = get_jit_target_from_environment());
+
+    /** Page-lock the host-side memory of a buffer using the gpu
+     * runtime of this function, jit compiling it first if need be,
+     * so that copies between the buffer and the device run at full
+     * bandwidth. Useful for the inputs and outputs of pipelines that
+     * run on a gpu. Returns false if the target has no gpu, or the
+     * runtime can't do it. See Buffer::pin_host_memory. */
+    EXPORT bool pin_host_memory(Buffer b, const Target &target = get_jit_target_from_environment());
+
     /** Set the error handler function that be called in the case of
      * runtime errors during halide pipelines. If you are compiling
      * statically, you can also just define your own function with
@@ -620,6 +914,21 @@ public:
         int (*custom_do_par_for)(void *, int (*)(void *, int, uint8_t *), int,
                                  int, uint8_t *));
 
+    /** Run the parallel loops of this pipeline on a thread pool of
+     * its own, rather than the one shared with every other jitted
+     * pipeline. The pool has num_threads threads (zero means the
+     * number of cpus), and its workers run at the given nice value,
+     * so giving a background pipeline a positive priority keeps it
+     * from starving a latency-sensitive one. Calling this with both
+     * arguments zero goes back to the shared pool. Ignored if a
+     * custom do_par_for is set.
+     *
+     * If you are statically compiling, create a pool with
+     * halide_create_thread_pool and bind it to the user_context you
+     * call the pipeline with using halide_set_thread_pool (see
+     * HalideRuntime.h). */
+    EXPORT void set_thread_pool(int num_threads, int priority = 0);
+
     /** Set custom routines to call when tracing is enabled. Call this
      * on the output Func of your pipeline. This then sets custom
      * routines for the entire pipeline, not just calls to this
@@ -630,6 +939,31 @@ public:
      * and they will clobber Halide's versions. */
     EXPORT void set_custom_trace(Internal::JITCompiledModule::TraceFn);
 
+    /** Set the function that pipelines compiled for a target with the
+     * cancellable feature call with their user_context at the start
+     * of each parallel task and each row of their loop nests. As soon
+     * as it returns non-zero, realize gives up and fails. Useful for
+     * giving each call a deadline, kept in the user_context passed to
+     * realize. Call this on the output Func of your pipeline.
+     *
+     * If you are statically compiling, call halide_cancel and
+     * halide_uncancel, or define your own halide_is_cancelled (see
+     * HalideRuntime.h). */
+    EXPORT void set_custom_is_cancelled(int (*is_cancelled)(void *user_context));
+
+    /** Set the function that pipelines compiled for a target with the
+     * memory_budget feature call with their user_context and the
+     * estimate of the most bytes they'll have allocated at once,
+     * before doing anything else. If it returns non-zero (except in
+     * a bounds query, when is_query is set), realize gives up and
+     * fails. Call this on the output Func of your pipeline.
+     *
+     * If you are statically compiling, call halide_set_memory_budget,
+     * or define your own halide_check_memory_budget (see
+     * HalideRuntime.h). */
+    EXPORT void set_custom_check_memory_budget(int (*check)(void *user_context, const char *pipeline,
+                                                            int64_t bytes, int is_query));
+
     /** When this function is compiled, include code that dumps its
      * values to a file after it is realized, for the purpose of
      * debugging.
@@ -647,9 +981,47 @@ public:
      * 5, uint32_t = 6, int32_t = 7, uint64_t = 8, int64_t = 9. The
      * data follows the header, as a densely packed array of the given
      * size and the given type. If given the extension .tmp, this file
-     * format can be natively read by the program ImageStack. */
+     * format can be natively read by the program ImageStack.
+     *
+     * By default the pipeline waits while the file is written. Set
+     * HL_DEBUG_TO_FILE_ASYNC=1 to have it just copy the data and
+     * leave the writing to a background thread, and
+     * HL_DEBUG_TO_FILE_EVERY=N to only write every Nth realization
+     * (see halide_debug_to_file in HalideRuntime.h). */
     EXPORT void debug_to_file(const std::string &filename);
 
+    /** Place the intermediate buffers of the pipeline that computes
+     * this Func in a workspace passed in by the caller, instead of
+     * allocating and freeing them with halide_malloc and halide_free
+     * each time it runs. The workspace must be a one dimensional
+     * ImageParam of type UInt(8), and must be in the argument list
+     * when compiling ahead of time. The buffers that are allocated
+     * outside of any loop, and are too big for the stack, go in it,
+     * reusing the space of the ones that have been freed.
+     *
+     * Pass a workspace with a NULL host pointer to query its size:
+     * the pipeline sets its extent to the number of bytes needed for
+     * the sizes of the other buffers, and returns without doing
+     * anything else. Then allocate that many bytes, aligned to 32
+     * bytes, and keep passing the same workspace in to run the
+     * pipeline without allocating (as long as the other buffers
+     * don't grow). A workspace that's too small is an error. For
+     * example:
+     \code
+     ImageParam workspace(UInt(8), 1, "workspace");
+     f.use_workspace(workspace);
+     f.compile_to_file("f", input, workspace);
+     ...
+     buffer_t ws = {0};
+     f(&in, &ws, &out);
+     ws.host = (uint8_t *)aligned_alloc(32, ws.extent[0]);
+     for (each frame) f(&in, &ws, &out);
+     \endcode
+     *
+     * Not supported by compile_to_c. Ignored on gpu targets, where
+     * the pipeline asks for a workspace of size zero. */
+    EXPORT Func &use_workspace(ImageParam workspace);
+
     /** The name of this function, either given during construction,
      * or automatically generated. */
     EXPORT const std::string &name() const;
@@ -705,19 +1077,31 @@ public:
     /** Add an extern definition for this Func. This lets you define a
      * Func that represents an external pipeline stage. You can, for
      * example, use it to wrap a call to an extern library such as
-     * fftw. */
+     * fftw.
+     *
+     * By default the extern function is called once, for the whole
+     * region required. Splitting the dimensions of the Func (found
+     * with \ref Func::args) calls it once per tile instead, with an
+     * output buffer_t covering just that tile, and a bounds query for
+     * that tile first. Only the loops over tiles exist, so only the
+     * outer vars of the splits can be reordered, computed at, or
+     * unrolled. If the extern function is thread safe, they can also
+     * be parallel. Each dimension may be split at most once, and the
+     * tiles at the end of the region are smaller. */
     // @{
     EXPORT void define_extern(const std::string &function_name,
                               const std::vector<ExternFuncArgument> &params,
                               Type t,
-                              int dimensionality) {
-        define_extern(function_name, params, Internal::vec<Type>(t), dimensionality);
+                              int dimensionality,
+                              bool thread_safe = false) {
+        define_extern(function_name, params, Internal::vec<Type>(t), dimensionality, thread_safe);
     }
 
     EXPORT void define_extern(const std::string &function_name,
                               const std::vector<ExternFuncArgument> &params,
                               const std::vector<Type> &types,
-                              int dimensionality);
+                              int dimensionality,
+                              bool thread_safe = false);
     // @}
 
     /** Get the types of the outputs of this Func. */
@@ -772,8 +1156,10 @@ public:
      * given names, where the inner dimension iterates from 0 to
      * factor-1. The inner and outer subdimensions can then be dealt
      * with using the other scheduling calls. It's ok to reuse the old
-     * variable name as either the inner or outer variable. */
-    EXPORT Func &split(Var old, Var outer, Var inner, Expr factor);
+     * variable name as either the inner or outer variable. The tail
+     * strategy says what to do if the factor doesn't divide the extent
+     * of the old dimension (see \ref TailStrategy). */
+    EXPORT Func &split(Var old, Var outer, Var inner, Expr factor, TailStrategy tail = Tail_Auto);
 
     /** Join two dimensions into a single fused dimenion. The fused
      * dimension covers the product of the extents of the inner and
@@ -810,14 +1196,48 @@ public:
      * inner dimension. This is how you vectorize a loop of unknown
      * size. The variable to be vectorized should be the innermost
      * one. After this call, var refers to the outer dimension of the
-     * split. */
-    EXPORT Func &vectorize(Var var, int factor);
+     * split. Use Tail_GuardWithIf for extents that may be smaller
+     * than the factor. */
+    EXPORT Func &vectorize(Var var, int factor, TailStrategy tail = Tail_Auto);
+
+    /** Split a dimension by the natural vector size of the target the
+     * pipeline is compiled for, then vectorize the inner dimension,
+     * as vectorize(var, factor, tail) does. The factor is the number
+     * of lanes of the widest type the function computes with that fit
+     * in a vector register (see \ref Target::natural_vector_size), so
+     * a function of uint8 that computes in float is vectorized by 4
+     * with sse, and by 8 with avx. It's chosen each time the pipeline
+     * is compiled, so one schedule suits every target. */
+    EXPORT Func &vectorize_natural(Var var, TailStrategy tail = Tail_Auto);
 
     /** Split a dimension by the given factor, then unroll the inner
      * dimension. This is how you unroll a loop of unknown size by
      * some constant factor. After this call, var refers to the outer
      * dimension of the split. */
-    EXPORT Func &unroll(Var var, int factor);
+    EXPORT Func &unroll(Var var, int factor, TailStrategy tail = Tail_Auto);
+
+    /** Mark a dimension to be completely unrolled, with the copies of
+     * the body interleaved into the loop directly inside it
+     * (unroll-and-jam). Each iteration of the inner loop then does
+     * the work of every copy, so values the copies share are loaded
+     * once, and the values each copy accumulates can stay in
+     * registers across the inner loop. This is register blocking,
+     * e.g. for a matrix multiply prod(x, y) += a(r, y) * b(x, r):
+     *
+     \code
+     prod.update().split(x, x, xi, 8).split(y, y, yi, 4)
+         .reorder(xi, r.x, yi, x, y).vectorize(xi).unroll_and_jam(yi);
+     \endcode
+     *
+     * Only pure dimensions may be jammed, because it changes the
+     * order of the iterations. If the loop directly inside has bounds
+     * that depend on this one, it is just unrolled. */
+    EXPORT Func &unroll_and_jam(Var var);
+
+    /** Split a dimension by the given factor, then unroll and jam
+     * the inner dimension. After this call, var refers to the outer
+     * dimension of the split. */
+    EXPORT Func &unroll_and_jam(Var var, int factor, TailStrategy tail = Tail_Auto);
 
     /** Statically declare that the range over which a function should
      * be evaluated is given by the second and third arguments. This
@@ -829,14 +1249,102 @@ public:
      * runtime error will occur when you try to run your pipeline. */
     EXPORT Func &bound(Var var, Expr min, Expr extent);
 
+    /** Declare that a value of this function always lies between min
+     * and max inclusive. Bounds inference uses this where the
+     * function's value indexes another one, e.g. for a lookup table
+     * lut(f(x)), so that only the part of lut that can be reached is
+     * computed, instead of the range of f's type. Either may be
+     * undefined to leave that side alone. The range isn't checked:
+     * values outside it read outside the regions computed. For
+     * example, for an index made by an update, whose range can't be
+     * inferred:
+     *
+     \code
+     index(x, y) = cast<uint16_t>(0);
+     index(x, y) += cast<uint16_t>(in(x + r, y) > threshold);
+     index.bound_value(0, 15);
+     out(x, y) = lut(index(x, y));
+     \endcode
+     */
+    EXPORT Func &bound_value(Expr min, Expr max, int value_index = 0);
+
+    /** Estimate the range over which the output of a pipeline will
+     * usually be computed. If the output has an estimate for every
+     * one of its dimensions, every Func in the pipeline that hasn't
+     * been scheduled (and the output itself, if it hasn't) is given
+     * a schedule by the automatic scheduler when the pipeline is
+     * compiled. The schedules chosen are printed at debug level 1 as
+     * code, so they can be pasted in and tuned by hand. Estimates
+     * don't change the region computed, and the schedules chosen work
+     * for any size of output, but they're tuned for this one. */
+    EXPORT Func &estimate(Var var, int min, int extent);
+
+    /** Generate a separate version of the loop nests of this function
+     * for when the given boolean condition holds, and choose between
+     * them at runtime. If specialize is called several times, the
+     * first condition that holds is used, and the generic version is
+     * used when none of them do. Within a version, the condition is
+     * known to be true: a condition that says a scalar parameter or
+     * a buffer stride equals a constant substitutes the constant in
+     * for it. E.g. to get dense vector loads when the input happens
+     * to have a unit stride:
+     *
+     \code
+     ImageParam in(Float(32), 2);
+     f(x, y) = in(x, y) * 2;
+     f.vectorize(x, 8).specialize(in.stride(0) == 1);
+     \endcode
+     *
+     * All versions share the same schedule. Each one adds to code
+     * size and compile time. */
+    EXPORT Func &specialize(Expr condition);
+
+    /** Only run the iterations of this function's loop over var for
+     * which active is true, and skip the rest, along with the
+     * producers computed inside them. The condition may refer to var,
+     * the loop vars outside it, and parameters. For incremental
+     * rendering, pass a coarse mask of the tiles that changed:
+     *
+     \code
+     ImageParam changed(UInt(8), 2);
+     f.tile(x, y, xo, yo, xi, yi, 32, 32).parallel(yo);
+     f.skip_unless(xo, changed(xo, yo) != 0);
+     \endcode
+     *
+     * The skipped parts of the output are left as they were, so the
+     * caller should pass in the previous output to be updated. Only
+     * the pure definition is skipped. Producers stored outside the
+     * loop don't slide over it (see \ref Func::store_at). */
+    EXPORT Func &skip_unless(Var var, Expr active);
+
+    /** At the top of each iteration of this function's loop over var,
+     * issue software prefetches for the region of f that the iteration
+     * offset iterations later will read. This helps when a stage
+     * streams through a large input in a pattern the hardware
+     * prefetcher doesn't recognize, e.g. by tiles:
+     *
+     \code
+     f.tile(x, y, xi, yi, 64, 64).prefetch(in, y, 2);
+     \endcode
+     *
+     * The region is found by bounds inference, and is prefetched a
+     * cache line at a time. Prefetches never fault, so it's safe to
+     * prefetch past the end of f. */
+    // @{
+    EXPORT Func &prefetch(Func f, Var var, Expr offset = 1);
+    EXPORT Func &prefetch(ImageParam f, Var var, Expr offset = 1);
+    // @}
+
     /** Split two dimensions at once by the given factors, and then
      * reorder the resulting dimensions to be xi, yi, xo, yo from
      * innermost outwards. This gives a tiled traversal. */
-    EXPORT Func &tile(Var x, Var y, Var xo, Var yo, Var xi, Var yi, Expr xfactor, Expr yfactor);
+    EXPORT Func &tile(Var x, Var y, Var xo, Var yo, Var xi, Var yi,
+                      Expr xfactor, Expr yfactor, TailStrategy tail = Tail_Auto);
 
     /** A shorter form of tile, which reuses the old variable names as
      * the new outer dimensions */
-    EXPORT Func &tile(Var x, Var y, Var xi, Var yi, Expr xfactor, Expr yfactor);
+    EXPORT Func &tile(Var x, Var y, Var xi, Var yi,
+                      Expr xfactor, Expr yfactor, TailStrategy tail = Tail_Auto);
 
     /** Reorder variables to have the given nesting order, from
      * innermost out */
@@ -1018,6 +1526,72 @@ public:
     EXPORT Func &reorder_storage(Var x, Var y, Var z, Var w, Var t);
     // @}
 
+    /** Round the extent of a dimension of the storage of this
+     * function up to a multiple of alignment. This makes the stride of
+     * the next dimension out a multiple of alignment, so that if the
+     * inner dimension is vectorized by a factor that divides
+     * alignment, every row starts at an aligned address and vector
+     * loads and stores of it can be aligned. For example:
+     *
+     \code
+     g.compute_at(f, y).vectorize(x, 8).align_storage(x, 8);
+     \endcode
+     *
+     * Output buffers are allocated by the caller and aren't
+     * affected. */
+    EXPORT Func &align_storage(Var dim, int alignment);
+
+    /** Add padding elements to the end of each row of a dimension of
+     * the storage of this function, after any rounding up by
+     * align_storage. Strides that are a large power of two make rows
+     * of a tile map to the same cache sets, and padding them by a
+     * vector or a cache line avoids that. For example, for a
+     * compute_root g that is 1024 floats wide:
+     *
+     \code
+     g.align_storage(x, 8).pad_storage(x, 16);
+     \endcode
+     */
+    EXPORT Func &pad_storage(Var dim, int padding);
+
+    /** Fold the storage of a dimension of this function by the given
+     * factor, so that it only holds that many coordinates of the
+     * dimension at once, and coordinate x is stored at x % factor.
+     * Storage folding does this by itself when it can prove the
+     * region of the function used per iteration of a loop has a
+     * constant size, and moves in one direction (see
+     * StorageFolding.h), but this lets it fold when the proof fails,
+     * e.g. for clamped accesses, and fold more than one dimension. It
+     * is checked at runtime that the region the function uses at once
+     * fits in the factor, and that it only moves one way. For
+     * example, for a g computed at each row y of f that reads rows
+     * clamp(y-1, 0, h-1) to clamp(y+1, 0, h-1) of it:
+     *
+     \code
+     g.store_root().compute_at(f, y).fold_storage(y, 4);
+     \endcode
+     */
+    EXPORT Func &fold_storage(Var dim, Expr factor);
+
+    /** Store the values of this Tuple-valued function interleaved in
+     * a single buffer, so that the values at each site are next to
+     * each other, instead of in one buffer per value. This suits
+     * consumers that read all the values at once, such as complex
+     * multiplies, because vectorized loads of the values become one
+     * interleaved load. All the values must have the same type. For
+     * example:
+     *
+     \code
+     Func c;
+     c(x) = Tuple(re(x), im(x));
+     c.compute_root().interleave_tuple();
+     \endcode
+     *
+     * Output buffers are allocated by the caller and aren't
+     * affected. They may already be interleaved by passing in
+     * buffers that share memory and have strides to match. */
+    EXPORT Func &interleave_tuple();
+
     /** Compute this function as needed for each unique value of the
      * given var for the given calling function f.
      *
@@ -1131,6 +1705,28 @@ public:
      */
     EXPORT Func &compute_root();
 
+    /** Fuse the loop nest of this function with that of f, from the
+     * outermost loop down to the loop over var, so that the two are
+     * computed together. The two functions must be computed at the
+     * same loop level, neither may call the other, and var must be at
+     * the same depth in both loop nests (e.g. if both are tiled the
+     * same way). Each fused loop covers the union of the ranges of
+     * the two loops. For example, to compute the x and y gradients of
+     * an image in the same pass over it:
+     *
+     \code
+     Func dx, dy;
+     dx(x, y) = in(x+1, y) - in(x-1, y);
+     dy(x, y) = in(x, y+1) - in(x, y-1);
+     dx.compute_root();
+     dy.compute_root().compute_with(dx, y);
+     \endcode
+     *
+     * Functions with update steps can't be fused. If the loops can't
+     * be fused, a warning is printed, and the schedule is otherwise
+     * unaffected. */
+    EXPORT Func &compute_with(Func f, Var var);
+
     /** Allocate storage for this function within f's loop over
      * var. Scheduling storage is optional, and can be used to
      * separate the loop level at which storage occurs from the loop
@@ -1262,11 +1858,261 @@ public:
      */
     EXPORT Func &compute_inline();
 
+    /** Allow this function to be computed at the same time as other
+     * functions scheduled with async that it doesn't depend on, and
+     * that don't depend on it. Each one becomes a task on the thread
+     * pool, and their consumers wait for all of them. Only has an
+     * effect on functions that are compute_root. For example, if g
+     * and h are both compute_root and async, and don't call each other,
+     * then in:
+     *
+     \code
+     f(x, y) = g(x, y) + h(x, y);
+     \endcode
+     *
+     * g and h are computed concurrently, and then f is computed. Use
+     * this when independent branches of a pipeline don't each have
+     * enough parallelism to keep the machine busy.
+     *
+     * If this function is pure, and is instead stored outside a
+     * serial loop of its consumer and computed inside it, and its
+     * storage gets folded (see \ref Func::store_at), then it runs on
+     * a thread of its own a few iterations ahead of the consumer, and
+     * the circular buffer grows to make room. For example, with:
+     *
+     \code
+     f(x, y) = g(x, y-1) + g(x, y+1);
+     g.store_root().compute_at(f, y).async();
+     \endcode
+     *
+     * g computes scanlines ahead while f consumes them. These two
+     * threads wait on each other, so each such loop is promised a
+     * worker thread of the pool while it runs. When no worker is
+     * free, or a custom do_par_for is set, they run in lockstep as
+     * usual. If either fails, the other stops waiting and the error
+     * is returned. */
+    EXPORT Func &async();
+
+    /** Keep the realizations of this function in a cache, and reuse
+     * them in later runs of the pipeline instead of computing them
+     * again. The cache is keyed on the region computed, the values of
+     * all the Params the function depends on (directly or through
+     * other functions), and the addresses and shapes of the input
+     * images it reads. Changing the contents of an input image in
+     * place isn't noticed, so use this for functions of slowly
+     * changing parameters, such as a lookup table or a lens shading
+     * map computed from calibration values. Typically the function
+     * is compute_root. It must be stored at the same level it is
+     * computed at, and can't be the output of the pipeline. See
+     * halide_memoization_cache_set_size in HalideRuntime.h for how to
+     * control the size of the cache. */
+    EXPORT Func &memoize();
+
+    /** Evaluate this function at compile time, over min to min +
+     * extent - 1 of dimension var, and have its callers read the
+     * values from a table embedded in the compiled code instead of
+     * computing them. Call once per dimension; every dimension needs
+     * a domain. This suits functions of small integer arguments that
+     * are costly to compute, such as a gamma curve over uint8 values
+     * that calls pow:
+     *
+     \code
+     gamma(x) = cast<uint8_t>(pow(x / 255.0f, 1 / 2.2f) * 255.0f);
+     gamma.tabulate(x, 0, 256);
+     out(x, y) = gamma(in(x, y));
+     \endcode
+     *
+     * The table is computed with the JIT for the host, so the function
+     * can't depend on Params or ImageParams, and must have a single
+     * value and no updates. Reads outside the domain fail the bounds
+     * checks of the table. The function's own schedule is used to
+     * compute the table; its callers then treat it as if inlined. In
+     * gpu kernels the table is a read-only buffer, so it goes through
+     * the read-only cache. Set HL_AUTO_TABULATE=1 to also tabulate
+     * inlined functions that call math library functions, when the
+     * arguments of every call to them are known to lie in a domain of
+     * at most 65536 values. */
+    EXPORT Func &tabulate(Var var, int min, int extent);
+
+    /** Keep the storage of this function from one run of the pipeline
+     * to the next, as a circular buffer of the given number of
+     * coordinates of dimension t (see \ref Func::fold_storage), and
+     * only compute the coordinates of t that aren't already in it.
+     * This suits temporal filters over video, which need an
+     * intermediate at the last few frames. For example, with a Param
+     * frame that goes up by one each run:
+     *
+     \code
+     f(x, y, t) = denoise(input)(x, y);
+     g(x, y) = f(x, y, frame) + f(x, y, frame-1) + f(x, y, frame-2);
+     f.compute_root().store_persistent(t, 3);
+     \endcode
+     *
+     * the first run computes f at all three frames, and later runs
+     * only compute it at the newest one. It's up to the caller that
+     * the values kept stay correct, e.g. that f at time t only depends
+     * on the inputs of the run that computed it. If the region of f
+     * in the other dimensions changes, or a run fails, the next run
+     * starts from scratch. The function must be pure, single-valued,
+     * compute_root, and not the output of the pipeline. The storage is
+     * keyed on the name of the function, so two pipelines run with
+     * the same runtime need functions of different names. See
+     * halide_persistent_storage_cleanup in HalideRuntime.h to free it. */
+    EXPORT Func &store_persistent(Var t, int frames);
+
+    /** Compute this function at the root, but only in the blocks of
+     * the given size along dimension var that its callers actually
+     * read. Each block is computed the first time a point in it is
+     * read, by whichever thread reads it first; others that want it
+     * at the same time wait for it. Call once per dimension to
+     * divide; the dimensions not divided are computed whole in each
+     * block. This suits callers that read a few scattered points of
+     * a costly function, such as descriptors sampled at keypoints:
+     *
+     \code
+     blurred(x, y) = expensive_blur(input)(x, y);
+     desc(i, j) = blurred(kx(i) + j % 8, ky(i) + j / 8);
+     blurred.compute_lazily(x, 32).compute_lazily(y, 32);
+     desc.parallel(i);
+     \endcode
+     *
+     * Storage is still allocated for the whole region the callers
+     * may read, but the work scales with the number of blocks
+     * touched instead of with that region. The function must be
+     * pure, can't be the output of the pipeline, and its inputs
+     * should be inlined or computed within it, as root inputs are
+     * computed over the whole region. Give it splits that divide
+     * the block size. Reads from a vectorized loop are preceded by
+     * a scalar pass over the loop that makes sure their blocks are
+     * done; reads from gpu kernels aren't allowed. */
+    EXPORT Func &compute_lazily(Var var, int block_size);
+
+    /** Write the dense vector stores of this function with
+     * non-temporal (streaming) stores, which go around the cache
+     * instead of reading each cache line in and then evicting
+     * something else for it. This suits large outputs and root
+     * intermediates that aren't read again until they would have
+     * left the cache anyway, such as the last conversion of a
+     * bandwidth-bound pipeline:
+     *
+     \code
+     out(x, y) = cast<uint8_t>(clamp(f(x, y), 0, 255));
+     out.vectorize(x, 16).parallel(y).store_nontemporal();
+     \endcode
+     *
+     * Scalar, strided and predicated stores are unchanged, as are
+     * stores on a gpu. Each parallel task that streams, and the
+     * producer as a whole, ends with a fence, so that consumers see
+     * the values. This is movnt on x86 and stnp on arm, where the
+     * stores are aligned enough for them. */
+    EXPORT Func &store_nontemporal();
+
+    /** Compute the pure definition of this function on the gpu and
+     * the cpu at once, by giving the gpu the bottom part of the range
+     * of dimension var, and the cpu the rest. The gpu part runs with
+     * this function's (gpu) schedule, and the cpu part with the same
+     * schedule, with the gpu block loops made parallel, and the
+     * thread loops serial:
+     *
+     \code
+     f.gpu_tile(x, y, 16, 16).split_devices(y);
+     \endcode
+     *
+     * The runtime times each part, and moves the split from one run
+     * to the next so that the two finish together. The gpu starts
+     * with half (or HL_GPU_PERCENT percent) of the range. The part
+     * computed on the gpu is copied back into the rest, and the
+     * result is marked as valid on the host. If var is split, the
+     * split point is a multiple of the factor. The var must be the
+     * outermost dimension of the storage (see \ref
+     * Func::reorder_storage), which must not be folded over it, and
+     * the function must be single-valued. The split is keyed on the
+     * name of the function. It does nothing unless the target has a
+     * gpu feature. */
+    EXPORT Func &split_devices(Var var);
+
+    /** Divide the range of dimension var of this function between
+     * the ranks (processes) of a distributed run. If it's the output,
+     * each rank computes a slice of it, and the other functions are
+     * only computed over the regions that slice needs. If it isn't,
+     * each rank computes part of the region it needs, and gets the
+     * rest (the halo) from the other ranks that computed it:
+     *
+     \code
+     blur_x(x, y) = (in(x-1, y) + in(x, y) + in(x+1, y))/3;
+     blur_y(x, y) = (blur_x(x, y-1) + blur_x(x, y) + blur_x(x, y+1))/3;
+     blur_x.compute_root().distribute(y);
+     blur_y.distribute(y);
+     \endcode
+     *
+     * Here rank r of n computes rows of blur_y from r/n to (r+1)/n of
+     * the way down the output, and the rows of blur_x inside those,
+     * and trades the rows either side with its neighbours. Each rank
+     * only needs (and bounds queries ask for) its slice of the input,
+     * and only its slice of the output is valid afterwards. If var is
+     * split, the slices are multiples of the factor. The var must be
+     * the outermost dimension of the storage, which must not be
+     * folded over it, and the function must be single-valued, and
+     * compute_root if it isn't the output. It must be computed on the
+     * cpu. The ranks are found, and values traded, through the
+     * communication layer in the runtime, which runs everything as
+     * one rank unless it's replaced (see halide_distributed_rank in
+     * HalideRuntime.h). */
+    EXPORT Func &distribute(Var var);
+
     /** Get a handle on an update step of a reduction for the
      * purposes of scheduling it. Only the pure dimensions of the
      * update step can be meaningfully manipulated (see \ref RDom) */
     EXPORT ScheduleHandle update(int idx = 0);
 
+    /** Split the last update step of this reduction into two, so that
+     * the reduction over r can be computed in parallel or
+     * vectorized. Returns a new intermediate Func with an extra pure
+     * dimension v, which computes the reduction for each value of r
+     * separately (r is replaced by v). The update step of this Func
+     * is replaced by one that reduces over r again, combining the
+     * values of the intermediate. The update step must have a single
+     * value of the form f(args) = f(args) op e, where op is one of +,
+     * *, min or max, e doesn't refer to f, and args don't refer to
+     * r, other than through calls to other Funcs or images (as in a
+     * histogram). For example, a sum over the rows of an image:
+     *
+     \code
+     Func f;
+     RDom r(0, 100, 0, 100);
+     f() = 0;
+     f() += in(r.x, r.y);
+     Var y;
+     Func intm = f.rfactor(r.y, y);
+     intm.compute_root().update().parallel(y);
+     \endcode
+     *
+     * intm(y) sums each row on a separate thread, and then f sums
+     * intm over y. As the original sum is reassociated, floating point
+     * results may round differently. */
+    EXPORT Func rfactor(RVar r, Var v);
+
+    /** Compute the last update step of this reduction in parallel
+     * over r, by splitting r into the given number of slices, and
+     * giving each slice its own private copy of this Func to update,
+     * indexed by the new pure dimension v. The copies are then
+     * combined into this Func. This makes histograms parallel without
+     * atomics, and without one copy of the bins per value of r as
+     * \ref rfactor would:
+     *
+     \code
+     RDom r(input);
+     hist(x) = 0;
+     hist(clamp(input(r.x, r.y), 0, 255)) += 1;
+     Var t;
+     hist.privatize(r.y, t, 8);
+     \endcode
+     *
+     * The update step has the same requirements as for \ref
+     * rfactor. Returns the intermediate holding the copies, which is
+     * computed at root with its update parallelized over v. */
+    EXPORT Func privatize(RVar r, Var v, int slices);
+
     /** Trace all loads from this Func by emitting calls to
      * halide_trace. If the Func is inlined, this has no
      * effect. */
@@ -1281,6 +2127,21 @@ public:
      * halide_trace. */
     EXPORT Func &trace_realizations();
 
+    /** Count the points stored to this Func and the bytes it loads
+     * from each of its inputs, and report them in one halide_trace
+     * event per realization, instead of one per load or store. The
+     * halide_trace_summary event has the realized box as its
+     * coordinates, and as its value the int64 pair (points stored,
+     * points in the box), which differ when points are recomputed by
+     * update steps or overlapping tiles. It's followed by a
+     * halide_trace_summary_load event for each input, whose parent is
+     * the summary, with the bytes loaded as its value. The counts of
+     * loops that don't depend on the data are computed once outside
+     * them, so this is cheap enough to leave on. HL_TRACE_SUMMARY=1
+     * does this for every Func that isn't inlined. If the Func is
+     * inlined, this has no effect. */
+    EXPORT Func &trace_summary();
+
     /** Get a handle on the internal halide function that this Func
      * represents. Useful if you want to do introspection on Halide
      * functions */
@@ -1321,6 +2182,90 @@ public:
 
 };
 
+/** A pipeline with several outputs, of different sizes, types and
+ * dimensionalities. They're lowered into one function, in which the
+ * Funcs they call are scheduled once for all of them; a Func called by
+ * several outputs and scheduled compute_root is computed once, over
+ * the union of the regions they need. No output may call another, so
+ * put the values they share in a Func that isn't an output. The
+ * outputs must be scheduled compute_root (the default).
+ \code
+ Func demosaiced, full, thumbnail, histogram;
+ ...
+ demosaiced.compute_root();
+ Pipeline p(full, thumbnail, histogram);
+ p.compile_to_file("camera", input, white_balance);
+ \endcode
+ * makes a function that takes the inputs and then a buffer for each
+ * output (one per value for Tuple-valued ones), in order:
+ \code
+ int camera(buffer_t *input, float white_balance,
+            buffer_t *full, buffer_t *thumbnail, buffer_t *histogram);
+ \endcode
+ */
+class Pipeline {
+    std::vector<Func> funcs;
+
+    /** The lowered form of the pipeline, and its jit-compiled
+     * version, as for Func. */
+    // @{
+    Internal::Stmt lowered;
+    Internal::JITCompiledModule compiled_module;
+    std::vector<const void *> arg_values;
+    std::vector<std::pair<int, Internal::Parameter> > image_param_args;
+    // @}
+
+    std::vector<std::string> output_names() const;
+    std::vector<Argument> output_arguments() const;
+    void lower(const Target &target);
+
+public:
+    /** Make a pipeline that computes some Funcs together. */
+    // @{
+    EXPORT Pipeline(const std::vector<Func> &outputs);
+    EXPORT Pipeline(Func a, Func b);
+    EXPORT Pipeline(Func a, Func b, Func c);
+    // @}
+
+    /** The outputs, in the order their buffers are passed. */
+    const std::vector<Func> &outputs() const {
+        return funcs;
+    }
+
+    /** Evaluate the pipeline into some existing buffers, one per
+     * value of each output, in order. Each output is computed over
+     * the region of its buffers. */
+    EXPORT void realize(Realization dst, const Target &target = get_jit_target_from_environment());
+
+    /** Eagerly jit compile the pipeline, as Func::compile_jit. */
+    EXPORT void *compile_jit(const Target &target = get_jit_target_from_environment());
+
+    /** Compile to an object file and header pair, as
+     * Func::compile_to_file. The function is named after the first
+     * argument, and takes the output buffers after the given
+     * arguments. */
+    // @{
+    EXPORT void compile_to_file(const std::string &filename_prefix, std::vector<Argument> args,
+                                const Target &target = get_target_from_environment());
+    EXPORT void compile_to_file(const std::string &filename_prefix, Argument a,
+                                const Target &target = get_target_from_environment());
+    EXPORT void compile_to_file(const std::string &filename_prefix, Argument a, Argument b,
+                                const Target &target = get_target_from_environment());
+    // @}
+
+    /** Write out the lowered form of the pipeline. */
+    EXPORT void compile_to_lowered_stmt(const std::string &filename);
+};
+
+/** Compile the Halide runtime for a target on its own, to an object
+ * file. Pipelines compiled with the no_runtime target feature leave
+ * the runtime out and link against this instead, so that an app with
+ * several pipelines has one copy of the runtime, with one thread
+ * pool, one gpu context and one allocator cache between them. Any
+ * no_runtime and jit features of the target are ignored. */
+EXPORT void compile_standalone_runtime(const std::string &object_filename,
+                                       Target t = get_target_from_environment());
+
  /** JIT-Compile and run enough code to evaluate a Halide
   * expression. This can be thought of as a scalar version of
   * \ref Func::realize */
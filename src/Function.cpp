@@ -161,6 +161,7 @@ void Function::define(const vector<string> &args, vector<Expr> values) {
 
     assertf(contents.ptr->values.empty(), "Function is already defined", name());
     contents.ptr->values = values;
+    contents.ptr->definition_version++;
     contents.ptr->args = args;
 
     contents.ptr->output_types.resize(values.size());
@@ -323,13 +324,57 @@ void Function::define_reduction(const vector<Expr> &_args, vector<Expr> values)
     }
 
     contents.ptr->reductions.push_back(r);
+    contents.ptr->definition_version++;
 
 }
 
+void Function::remove_last_reduction() {
+    assertf(has_reduction_definition(), "Function has no reduction definition to remove", name());
+
+    // Put back the references that define_reduction took away for
+    // the calls back to this function. They go away again as the
+    // calls are destroyed.
+    const ReductionDefinition &r = contents.ptr->reductions.back();
+    CountSelfReferences counter;
+    counter.func = this;
+    for (size_t i = 0; i < r.args.size(); i++) {
+        r.args[i].accept(&counter);
+    }
+    for (size_t i = 0; i < r.values.size(); i++) {
+        r.values[i].accept(&counter);
+    }
+    for (size_t i = 0; i < counter.calls.size(); i++) {
+        contents.ptr->ref_count.increment();
+    }
+
+    contents.ptr->reductions.pop_back();
+    contents.ptr->definition_version++;
+}
+
+void Function::bound_value(int value_index, Expr min, Expr max) {
+    assertf(value_index >= 0 && value_index < outputs(),
+            "Can't bound a value that the function doesn't have", name());
+    std::vector<std::pair<Expr, Expr> > &bounds = contents.ptr->value_bounds;
+    if ((int)bounds.size() <= value_index) {
+        bounds.resize(value_index + 1);
+    }
+    bounds[value_index] = std::make_pair(min, max);
+    contents.ptr->definition_version++;
+}
+
+std::pair<Expr, Expr> Function::value_bounds(int value_index) const {
+    const std::vector<std::pair<Expr, Expr> > &bounds = contents.ptr->value_bounds;
+    if (value_index < (int)bounds.size()) {
+        return bounds[value_index];
+    }
+    return std::pair<Expr, Expr>();
+}
+
 void Function::define_extern(const std::string &function_name,
                              const std::vector<ExternFuncArgument> &args,
                              const std::vector<Type> &types,
-                             int dimensionality) {
+                             int dimensionality,
+                             bool thread_safe) {
 
     assertf(!has_pure_definition() && !has_reduction_definition(),
             "Function with a pure definition cannot have an extern definition",
@@ -340,7 +385,9 @@ void Function::define_extern(const std::string &function_name,
             name());
 
     contents.ptr->extern_function_name = function_name;
+    contents.ptr->definition_version++;
     contents.ptr->extern_arguments = args;
+    contents.ptr->extern_is_thread_safe = thread_safe;
     contents.ptr->output_types = types;
 
     for (size_t i = 0; i < types.size(); i++) {
@@ -351,11 +398,14 @@ void Function::define_extern(const std::string &function_name,
         contents.ptr->output_buffers.push_back(Parameter(types[i], true, buffer_name));
     }
 
-    // Make some synthetic var names for scheduling purposes (e.g. reorder_storage).
+    // Make some synthetic var names for scheduling purposes
+    // (e.g. reorder_storage, or splitting into tiles).
     contents.ptr->args.resize(dimensionality);
     for (int i = 0; i < dimensionality; i++) {
         string arg = unique_name('e');
         contents.ptr->args[i] = arg;
+        Schedule::Dim d = {arg, For::Serial};
+        contents.ptr->schedule.dims.push_back(d);
         contents.ptr->schedule.storage_dims.push_back(arg);
     }
 
@@ -54,6 +54,10 @@ struct ReductionDefinition {
     ReductionDomain domain;
 };
 
+/** The results of the analyses done by lower that depend only on the
+ * algorithm, and not on the schedule. Defined in Lower.cpp. */
+struct LoweringCache;
+
 struct FunctionContents {
     mutable RefCount ref_count;
     std::string name;
@@ -68,12 +72,30 @@ struct FunctionContents {
 
     std::vector<Parameter> output_buffers;
 
+    // If defined, the buffers of the pipeline that computes this
+    // function go in it. See Func::use_workspace.
+    Parameter workspace;
+
     std::vector<ExternFuncArgument> extern_arguments;
     std::string extern_function_name;
+    // Whether calls to the extern function for different tiles may
+    // run at the same time.
+    bool extern_is_thread_safe;
+
+    // The declared min and max of each value. See Func::bound_value.
+    std::vector<std::pair<Expr, Expr> > value_bounds;
+
+    bool trace_loads, trace_stores, trace_realizations, trace_summary;
+
+    // Changes whenever a definition is added or removed.
+    int definition_version;
 
-    bool trace_loads, trace_stores, trace_realizations;
+    IntrusivePtr<LoweringCache> lowering_cache;
 
-    FunctionContents() : trace_loads(false), trace_stores(false), trace_realizations(false) {}
+    FunctionContents() : extern_is_thread_safe(false),
+                         trace_loads(false), trace_stores(false), trace_realizations(false),
+                         trace_summary(false),
+                         definition_version(0) {}
 };
 
 /** A reference-counted handle to Halide's internal representation of
@@ -108,6 +130,10 @@ public:
      * definition's argument in the same index. */
     void define_reduction(const std::vector<Expr> &args, std::vector<Expr> values);
 
+    /** Remove the last reduction definition, so that a different one
+     * can be put in its place (see \ref Func::rfactor). */
+    void remove_last_reduction();
+
     /** Construct a new function with the given name */
     Function(const std::string &n) : contents(new FunctionContents) {
         for (size_t i = 0; i < n.size(); i++) {
@@ -196,11 +222,22 @@ public:
         return !contents.ptr->extern_function_name.empty();
     }
 
-    /** Add an external definition of this Func */
+    /** Add an external definition of this Func. If it's thread
+     * safe, the loops over its tiles may be parallel. */
     void define_extern(const std::string &function_name,
                        const std::vector<ExternFuncArgument> &args,
                        const std::vector<Type> &types,
-                       int dimensionality);
+                       int dimensionality,
+                       bool thread_safe);
+
+    /** Declare the range of one of the values of this function. This
+     * counts as a change to the definition, because it changes the
+     * bounds that are inferred from it. */
+    void bound_value(int value_index, Expr min, Expr max);
+
+    /** Get the declared min and max of one of the values of this
+     * function. Either may be undefined. */
+    std::pair<Expr, Expr> value_bounds(int value_index) const;
 
     /** Retrive the arguments of the extern definition */
     const std::vector<ExternFuncArgument> &extern_arguments() const {
@@ -213,6 +250,24 @@ public:
         return contents.ptr->extern_function_name;
     }
 
+    /** Can the extern function be called for several tiles at once */
+    bool extern_is_thread_safe() const {
+        return contents.ptr->extern_is_thread_safe;
+    }
+
+    /** A number that changes whenever a definition of this function
+     * is added or removed. Analyses of the algorithm that were done
+     * at the same version still hold. */
+    int definition_version() const {
+        return contents.ptr->definition_version;
+    }
+
+    /** Get a handle to the schedule-independent results of the last
+     * time this function was lowered. See \ref lower. */
+    IntrusivePtr<LoweringCache> &lowering_cache() {
+        return contents.ptr->lowering_cache;
+    }
+
     /** Equality of identity */
     bool same_as(const Function &other) const {
         return contents.same_as(other.contents);
@@ -228,6 +283,12 @@ public:
         return contents.ptr->debug_file;
     }
 
+    /** Get a handle to the workspace that the buffers of the
+     * pipeline that computes this function go in */
+    Parameter &workspace() {
+        return contents.ptr->workspace;
+    }
+
     /** Use an an extern argument to another function. */
     operator ExternFuncArgument() const {
         return ExternFuncArgument(contents);
@@ -245,6 +306,9 @@ public:
     void trace_realizations() {
         contents.ptr->trace_realizations = true;
     }
+    void trace_summary() {
+        contents.ptr->trace_summary = true;
+    }
     bool is_tracing_loads() {
         return contents.ptr->trace_loads;
     }
@@ -254,6 +318,9 @@ public:
     bool is_tracing_realizations() {
         return contents.ptr->trace_realizations;
     }
+    bool is_tracing_summary() {
+        return contents.ptr->trace_summary;
+    }
     // @}
 
 };
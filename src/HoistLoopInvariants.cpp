@@ -0,0 +1,221 @@
+#include "HoistLoopInvariants.h"
+#include "IRMutator.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "IREquality.h"
+#include "ExprUsesVar.h"
+#include "CodeGen_GPU_Dev.h"
+#include "Scope.h"
+#include "Debug.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Count how many times each name is defined by a let.
+class CountLets : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Let *op) {
+        definitions[op->name]++;
+        IRVisitor::visit(op);
+    }
+
+    void visit(const LetStmt *op) {
+        definitions[op->name]++;
+        IRVisitor::visit(op);
+    }
+
+public:
+    map<string, int> definitions;
+};
+
+// Can an expression be evaluated anywhere without faulting or having
+// side-effects.
+class IsSafe : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Load *) {
+        safe = false;
+    }
+
+    void visit(const Call *) {
+        safe = false;
+    }
+
+    void check_divisor(Expr b) {
+        if (b.type().is_float()) return;
+        const int *i = as_const_int(b);
+        if (!i || *i == 0) {
+            safe = false;
+        }
+    }
+
+    void visit(const Div *op) {
+        check_divisor(op->b);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Mod *op) {
+        check_divisor(op->b);
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool safe;
+    IsSafe() : safe(true) {}
+};
+
+bool is_safe(Expr e) {
+    IsSafe check;
+    e.accept(&check);
+    return check.safe;
+}
+
+// Pull what doesn't depend on a loop out of its body.
+class LiftInvariants : public IRMutator {
+    // The names defined inside the loop that stay there.
+    Scope<int> inner;
+
+    const map<string, int> &definitions;
+
+    bool invariant(Expr e) {
+        return !expr_uses_vars(e, inner) && is_safe(e);
+    }
+
+    using IRMutator::visit;
+
+    void visit(const Let *op) {
+        Expr value = mutate(op->value);
+        inner.push(op->name, 0);
+        Expr body = mutate(op->body);
+        inner.pop(op->name);
+        expr = rebuild(op, value, body);
+    }
+
+    void visit(const LetStmt *op) {
+        // A let that's defined only once can move out with its name
+        // intact. The ones lifted from inner loops aren't counted,
+        // but their names are unique.
+        map<string, int>::const_iterator iter = definitions.find(op->name);
+        if ((iter == definitions.end() || iter->second == 1) && invariant(op->value)) {
+            lifted.push_back(make_pair(op->name, op->value));
+            stmt = mutate(op->body);
+            return;
+        }
+        Expr value = mutate(op->value);
+        inner.push(op->name, 0);
+        Stmt body = mutate(op->body);
+        inner.pop(op->name);
+        stmt = rebuild(op, value, body);
+    }
+
+    void visit(const For *op) {
+        Expr min = mutate(op->min);
+        Expr extent = mutate(op->extent);
+        inner.push(op->name, 0);
+        Stmt body = mutate(op->body);
+        inner.pop(op->name);
+        stmt = rebuild(op, min, extent, body);
+    }
+
+public:
+    using IRMutator::mutate;
+
+    Expr mutate(Expr e) {
+        if (e.defined() && e.type().is_scalar() &&
+            !e.as<Variable>() && !is_const(e) &&
+            invariant(e)) {
+            string name = unique_name('t');
+            lifted.push_back(make_pair(name, e));
+            return Variable::make(e.type(), name);
+        }
+        return IRMutator::mutate(e);
+    }
+
+    // The lets to put outside the loop, outermost first.
+    vector<pair<string, Expr> > lifted;
+
+    LiftInvariants(const string &loop, const map<string, int> &d) : definitions(d) {
+        inner.push(loop, 0);
+    }
+};
+
+class HoistLoopInvariants : public IRMutator {
+    const map<string, int> &definitions;
+
+    using IRMutator::visit;
+
+    void visit(const For *op) {
+        Stmt body = mutate(op->body);
+
+        if (CodeGen_GPU_Dev::is_gpu_var(op->name)) {
+            stmt = rebuild(op, op->min, op->extent, body);
+            return;
+        }
+
+        LiftInvariants lift(op->name, definitions);
+        body = lift.mutate(body);
+        stmt = rebuild(op, op->min, op->extent, body);
+        for (size_t i = lift.lifted.size(); i > 0; i--) {
+            debug(4) << "Hoisting " << lift.lifted[i-1].first << " out of " << op->name << "\n";
+            stmt = LetStmt::make(lift.lifted[i-1].first, lift.lifted[i-1].second, stmt);
+        }
+    }
+
+public:
+    HoistLoopInvariants(const map<string, int> &d) : definitions(d) {}
+};
+
+}
+
+Stmt hoist_loop_invariants(Stmt s) {
+    CountLets counter;
+    s.accept(&counter);
+    return HoistLoopInvariants(counter.definitions).mutate(s);
+}
+
+void hoist_loop_invariants_test() {
+    Expr x = Variable::make(Int(32), "x"), y = Variable::make(Int(32), "y");
+    Expr m = Variable::make(Int(32), "m"), s = Variable::make(Int(32), "s");
+    Expr t = Variable::make(Int(32), "t");
+
+    // for y: for x: let t = (y - m)*s in f[x + t] = x/2 + m*3
+    Stmt store = Store::make("f", x/2 + m*3, x + t);
+    Stmt inner = For::make("x", 0, 10, For::Serial, LetStmt::make("t", (y - m)*s, store));
+    Stmt loop = For::make("y", 0, 10, For::Serial, inner);
+    Stmt result = hoist_loop_invariants(loop);
+
+    // m*3 goes all the way out, and t goes out of the loop over x.
+    const LetStmt *outer = result.as<LetStmt>();
+    assert(outer && equal(outer->value, m*3) && "Loop invariant test failed: outermost");
+    const For *for_y = outer->body.as<For>();
+    assert(for_y && "Loop invariant test failed: loop over y");
+    const LetStmt *let_t = for_y->body.as<LetStmt>();
+    assert(let_t && let_t->name == "t" && equal(let_t->value, (y - m)*s) &&
+           "Loop invariant test failed: let");
+    const For *for_x = let_t->body.as<For>();
+    assert(for_x && "Loop invariant test failed: loop over x");
+    const Store *st = for_x->body.as<Store>();
+    Expr lifted = Variable::make(Int(32), outer->name);
+    assert(st && equal(st->value, x/2 + lifted) && equal(st->index, x + t) &&
+           "Loop invariant test failed: body");
+
+    // Loads and divisions by a variable stay where they are.
+    Expr load = Load::make(Int(32), "g", y, Buffer(), Parameter());
+    store = Store::make("f", load + x / m, x);
+    loop = For::make("x", 0, 10, For::Serial, store);
+    result = hoist_loop_invariants(loop);
+    assert(result.as<For>() && equal(result, loop) && "Loop invariant test failed: safety");
+
+    std::cout << "Loop invariant hoisting test passed" << std::endl;
+}
+
+}
+}
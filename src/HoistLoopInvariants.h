@@ -0,0 +1,29 @@
+#ifndef HALIDE_HOIST_LOOP_INVARIANTS_H
+#define HALIDE_HOIST_LOOP_INVARIANTS_H
+
+/** \file
+ * Defines a lowering pass that moves computation that doesn't depend
+ * on a loop out of it.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Move lets whose values don't depend on a loop out of it, and lift
+ * the largest subexpressions inside it that don't depend on it into
+ * new lets outside it. Loops are done innermost first, so things move
+ * out as far as they can. Only expressions that can't fault or have
+ * side-effects are moved (no loads, calls, or divisions by anything
+ * but a constant), because they may be run when the loop body
+ * wouldn't have been. Code for loops over GPU blocks and threads
+ * stays where it is. */
+Stmt hoist_loop_invariants(Stmt s);
+
+EXPORT void hoist_loop_invariants_test();
+
+}
+}
+
+#endif
@@ -1,3 +1,10 @@
+#include <stdlib.h>
+#include <new>
+
+#ifndef _MSC_VER
+#include <pthread.h>
+#endif
+
 #include "IR.h"
 
 namespace Halide {
@@ -5,6 +12,129 @@ namespace Internal {
 
 namespace {
 
+// Nodes are pooled in size classes of this granularity, up to
+// ir_pool_max_size bytes. Larger nodes come from the heap.
+const size_t ir_pool_granularity = 16;
+const size_t ir_pool_max_size = 256;
+const size_t ir_pool_num_classes = ir_pool_max_size / ir_pool_granularity;
+
+// Each thread keeps at most this many bytes of free blocks of each
+// size class. Blocks freed beyond that go back to the heap.
+const size_t ir_pool_max_cached_bytes = 64 * 1024;
+
+struct FreeBlock {
+    FreeBlock *next;
+};
+
+#ifdef _MSC_VER
+#define IR_POOL_THREAD_LOCAL __declspec(thread)
+#else
+#define IR_POOL_THREAD_LOCAL __thread
+#endif
+
+// The free blocks of each size class, and how many there are. These
+// are per-thread, so no locking is needed. Every block is a separate
+// heap allocation of the full size of its class, so a node freed on a
+// different thread from the one that made it can join the freeing
+// thread's pool, or go back to the heap.
+IR_POOL_THREAD_LOCAL FreeBlock *ir_pool_free_lists[ir_pool_num_classes];
+IR_POOL_THREAD_LOCAL size_t ir_pool_free_counts[ir_pool_num_classes];
+
+IR_POOL_THREAD_LOCAL uint64_t ir_pool_nodes_allocated;
+
+bool ir_pool_enabled() {
+    // This is decided once, before the first node is made, so every
+    // node is freed the same way that it was allocated.
+    static int enabled = -1;
+    if (enabled < 0) {
+        const char *env = getenv("HL_IR_POOL");
+        enabled = (env && env[0] == '1') ? 1 : 0;
+    }
+    return enabled == 1;
+}
+
+void ir_pool_release_thread() {
+    for (size_t i = 0; i < ir_pool_num_classes; i++) {
+        FreeBlock *block = ir_pool_free_lists[i];
+        while (block) {
+            FreeBlock *next = block->next;
+            ::operator delete(block);
+            block = next;
+        }
+        ir_pool_free_lists[i] = NULL;
+        ir_pool_free_counts[i] = 0;
+    }
+}
+
+#ifndef _MSC_VER
+// Give a thread's free blocks back to the heap when it exits. The
+// key's value is only there to make the destructor run.
+pthread_key_t ir_pool_key;
+pthread_once_t ir_pool_key_once = PTHREAD_ONCE_INIT;
+IR_POOL_THREAD_LOCAL bool ir_pool_thread_registered;
+
+void ir_pool_thread_exit(void *) {
+    ir_pool_release_thread();
+}
+
+void ir_pool_make_key() {
+    pthread_key_create(&ir_pool_key, ir_pool_thread_exit);
+}
+
+void ir_pool_register_thread() {
+    if (!ir_pool_thread_registered) {
+        pthread_once(&ir_pool_key_once, ir_pool_make_key);
+        pthread_setspecific(ir_pool_key, &ir_pool_key_once);
+        ir_pool_thread_registered = true;
+    }
+}
+#else
+// Threads that exit leak at most ir_pool_max_cached_bytes per size
+// class.
+void ir_pool_register_thread() {}
+#endif
+
+}
+
+uint64_t ir_nodes_allocated() {
+    return ir_pool_nodes_allocated;
+}
+
+void *IRNode::operator new(size_t size) {
+    ir_pool_nodes_allocated++;
+    size_t size_class = (size - 1) / ir_pool_granularity;
+    if (size == 0 || size_class >= ir_pool_num_classes || !ir_pool_enabled()) {
+        return ::operator new(size);
+    }
+    FreeBlock *&list = ir_pool_free_lists[size_class];
+    if (!list) {
+        return ::operator new((size_class + 1) * ir_pool_granularity);
+    }
+    FreeBlock *block = list;
+    list = block->next;
+    ir_pool_free_counts[size_class]--;
+    return block;
+}
+
+void IRNode::operator delete(void *ptr, size_t size) {
+    if (!ptr) return;
+    size_t size_class = (size - 1) / ir_pool_granularity;
+    size_t block_size = (size_class + 1) * ir_pool_granularity;
+    if (size == 0 || size_class >= ir_pool_num_classes || !ir_pool_enabled() ||
+        (ir_pool_free_counts[size_class] + 1) * block_size > ir_pool_max_cached_bytes) {
+        ::operator delete(ptr);
+        return;
+    }
+    ir_pool_register_thread();
+    FreeBlock *block = (FreeBlock *)ptr;
+    FreeBlock *&list = ir_pool_free_lists[size_class];
+    block->next = list;
+    list = block;
+    ir_pool_free_counts[size_class]++;
+}
+
+namespace {
+
 IntImm make_immortal_int(int x) {
     IntImm i;
     i.ref_count.increment();
@@ -79,6 +209,7 @@ using std::string;
 const string Call::debug_to_file = "debug_to_file";
 const string Call::shuffle_vector = "shuffle_vector";
 const string Call::interleave_vectors = "interleave_vectors";
+const string Call::concat_vectors = "concat_vectors";
 const string Call::reinterpret = "reinterpret";
 const string Call::bitwise_and = "bitwise_and";
 const string Call::bitwise_not = "bitwise_not";
@@ -104,6 +235,23 @@ const string Call::trace = "trace";
 const string Call::trace_expr = "trace_expr";
 const string Call::return_second = "return_second";
 const string Call::if_then_else = "if_then_else";
+const string Call::atomic_add = "atomic_add";
+const string Call::prefetch = "prefetch";
+const string Call::nontemporal_store = "nontemporal_store";
+const string Call::store_fence = "store_fence";
+const string Call::branch_weights = "branch_weights";
+const string Call::vector_reduce_add = "vector_reduce_add";
+const string Call::vector_reduce_min = "vector_reduce_min";
+const string Call::vector_reduce_max = "vector_reduce_max";
+const string Call::gpu_shuffle_down = "gpu_shuffle_down";
+const string Call::gpu_vote_any = "gpu_vote_any";
+const string Call::gpu_vote_all = "gpu_vote_all";
+const string Call::gpu_ballot = "gpu_ballot";
+const string Call::check_cancelled = "check_cancelled";
+const string Call::check_memory_budget = "check_memory_budget";
+const string Call::fill_memory = "fill_memory";
+const string Call::cleanup_on_exit = "cleanup_on_exit";
+const string Call::run_cleanup = "run_cleanup";
 
 }
 }
@@ -30,7 +30,7 @@ struct IRNode {
      * visitors.
      */
     virtual void accept(IRVisitor *v) const = 0;
-    IRNode() {}
+    IRNode() : structural_hash_cache(0) {}
     virtual ~IRNode() {}
 
     /** These classes are all managed with intrusive reference
@@ -39,6 +39,11 @@ struct IRNode {
        references to IR nodes. */
     mutable RefCount ref_count;
 
+    /** The structural hash of this node (see IRHash.h), or zero if it
+     * hasn't been computed yet. IR nodes don't change once they're
+     * made, so it never goes stale. */
+    mutable uint64_t structural_hash_cache;
+
     /** Each IR node subclass should return some unique pointer. We
      * can compare these pointers to do runtime type
      * identification. We don't compile with rtti because that
@@ -46,8 +51,23 @@ struct IRNode {
      * often breaks when linking external libraries compiled
      * without it), and we only want it for IR nodes. */
     virtual const IRNodeType *type_info() const = 0;
+
+    /** IR nodes are small, and lowering makes and frees a great many
+     * of them. Set the environment variable HL_IR_POOL=1 to keep
+     * freed nodes in per-thread free lists of fixed-size blocks and
+     * reuse them for new nodes, instead of going to the heap every
+     * time. Each thread keeps at most 64 KB of blocks of each size,
+     * and gives them back to the heap when it exits. */
+    // @{
+    EXPORT static void *operator new(size_t size);
+    EXPORT static void operator delete(void *ptr, size_t size);
+    // @}
 };
 
+/** The number of IR nodes made on this thread so far. Compare it
+ * before and after some work to see how much IR the work made. */
+EXPORT uint64_t ir_nodes_allocated();
+
 template<>
 EXPORT inline RefCount &ref_count<IRNode>(const IRNode *n) {return n->ref_count;}
 
@@ -564,9 +584,18 @@ struct Load : public ExprNode<Load> {
     // If it's a load from an image parameter, this points to that
     Parameter param;
 
-    static Expr make(Type type, std::string name, Expr index, Buffer image, Parameter param) {
+    // If defined, a boolean vector of the same width as the
+    // index. Lanes for which it is false are not read from memory,
+    // and their value is undefined.
+    Expr predicate;
+
+    static Expr make(Type type, std::string name, Expr index, Buffer image, Parameter param,
+                     Expr predicate = Expr()) {
         assert(index.defined() && "Load of undefined");
         assert(type.width == index.type().width && "Vector width of Load must match vector width of index");
+        assert((!predicate.defined() ||
+                (predicate.type().is_bool() && predicate.type().width == type.width)) &&
+               "Predicate of Load must be a boolean vector of the same width");
 
         Load *node = new Load;
         node->type = type;
@@ -574,6 +603,7 @@ struct Load : public ExprNode<Load> {
         node->index = index;
         node->image = image;
         node->param = param;
+        node->predicate = predicate;
         return node;
     }
 };
@@ -708,7 +738,7 @@ struct Pipeline : public StmtNode<Pipeline> {
 };
 
 /** A for loop. Execute the 'body' statement for all values of the
- * variable 'name' from 'min' to 'min + extent'. There are four
+ * variable 'name' from 'min' to 'min + extent'. There are five
  * types of For nodes. A 'Serial' for loop is a conventional
  * one. In a 'Parallel' for loop, each iteration of the loop
  * happens in parallel or in some unspecified order. In a
@@ -718,11 +748,13 @@ struct Pipeline : public StmtNode<Pipeline> {
  * 16). An 'Unrolled' for loop compiles to a completely unrolled
  * version of the loop. Each iteration becomes its own
  * statement. Again in this case, 'extent' should be a small
- * integer constant. */
+ * integer constant. A 'Jammed' for loop is unrolled too, but its
+ * copies go inside the loop directly inside it, so that each
+ * iteration of that loop does one iteration of each copy. */
 struct For : public StmtNode<For> {
     std::string name;
     Expr min, extent;
-    typedef enum {Serial, Parallel, Vectorized, Unrolled} ForType;
+    typedef enum {Serial, Parallel, Vectorized, Unrolled, Jammed} ForType;
     ForType for_type;
     Stmt body;
 
@@ -745,19 +777,25 @@ struct For : public StmtNode<For> {
 
 /** Store a 'value' to the buffer called 'name' at a given
  * 'index'. The buffer is interpreted as an array of the same type as
- * 'value'. */
+ * 'value'. If 'predicate' is defined, it is a boolean vector of the
+ * same width as the value, and only the lanes for which it is true
+ * are written. */
 struct Store : public StmtNode<Store> {
     std::string name;
-    Expr value, index;
+    Expr value, index, predicate;
 
-    static Stmt make(std::string name, Expr value, Expr index) {
+    static Stmt make(std::string name, Expr value, Expr index, Expr predicate = Expr()) {
         assert(value.defined() && "Store of undefined");
         assert(index.defined() && "Store of undefined");
+        assert((!predicate.defined() ||
+                (predicate.type().is_bool() && predicate.type().width == value.type().width)) &&
+               "Predicate of Store must be a boolean vector of the same width");
 
         Store *node = new Store;
         node->name = name;
         node->value = value;
         node->index = index;
+        node->predicate = predicate;
         return node;
     }
 };
@@ -942,6 +980,7 @@ struct Call : public ExprNode<Call> {
     EXPORT static const std::string debug_to_file,
         shuffle_vector,
         interleave_vectors,
+        concat_vectors,
         reinterpret,
         bitwise_and,
         bitwise_not,
@@ -966,7 +1005,24 @@ struct Call : public ExprNode<Call> {
         return_second,
         if_then_else,
         trace,
-        trace_expr;
+        trace_expr,
+        atomic_add,
+        prefetch,
+        nontemporal_store,
+        store_fence,
+        branch_weights,
+        vector_reduce_add,
+        vector_reduce_min,
+        vector_reduce_max,
+        gpu_shuffle_down,
+        gpu_vote_any,
+        gpu_vote_all,
+        gpu_ballot,
+        check_cancelled,
+        check_memory_budget,
+        fill_memory,
+        cleanup_on_exit,
+        run_cleanup;
 
     // If it's a call to another halide function, this call node
     // holds onto a pointer to that function.
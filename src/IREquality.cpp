@@ -1,4 +1,5 @@
 #include "IREquality.h"
+#include "IRHash.h"
 
 namespace Halide {
 namespace Internal {
@@ -93,6 +94,19 @@ public:
         return result;
     }
 
+    // Compare the optional predicates of loads and stores
+    void compare_predicates(Expr a, Expr b) {
+        if (result) return;
+        if (!a.defined() && b.defined()) {
+            result = -1;
+        } else if (a.defined() && !b.defined()) {
+            result = 1;
+        } else if (a.defined()) {
+            expr = a;
+            b.accept(this);
+        }
+    }
+
     void visit(const Cast *op) {
         if (result || expr.same_as(op) || compare_node_types(expr, op)) return;
 
@@ -170,6 +184,8 @@ public:
 
         expr = e->index;
         op->index.accept(this);
+
+        compare_predicates(e->predicate, op->predicate);
     }
 
     void visit(const Ramp *op) {
@@ -321,6 +337,8 @@ public:
 
         expr = s->index;
         op->index.accept(this);
+
+        compare_predicates(s->predicate, op->predicate);
     }
 
     void visit(const Provide *op) {
@@ -488,10 +506,16 @@ int deep_compare(Stmt a, Stmt b) {
 }
 
 EXPORT bool equal(Expr a, Expr b) {
+    if (a.same_as(b)) return true;
+    // Different hashes means different values. The hashes are cached,
+    // so this is cheap for IR that gets compared repeatedly.
+    if (a.defined() && b.defined() && structural_hash(a) != structural_hash(b)) return false;
     return deep_compare(a, b) == 0;
 }
 
 bool equal(Stmt a, Stmt b) {
+    if (a.same_as(b)) return true;
+    if (a.defined() && b.defined() && structural_hash(a) != structural_hash(b)) return false;
     return deep_compare(a, b) == 0;
 }
 
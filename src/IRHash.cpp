@@ -0,0 +1,357 @@
+#include <iostream>
+#include <set>
+#include <string.h>
+
+#include "IRHash.h"
+#include "IREquality.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+
+namespace {
+
+// Hashes exactly the things that IREquals compares (and no more),
+// so that equal IR has equal hashes.
+class IRHasher : public IRVisitor {
+public:
+    uint64_t h;
+
+    IRHasher() : h(14695981039346656037ULL) {}
+
+    void mix(uint64_t v) {
+        h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    }
+
+    void mix(const string &s) {
+        mix(hash_string(s));
+    }
+
+    void mix(Type t) {
+        mix((uint64_t)t.code << 32 | (uint64_t)t.bits << 16 | (uint64_t)t.width);
+    }
+
+    void mix(Expr e) {
+        mix(e.defined() ? structural_hash(e) : 0);
+    }
+
+    void mix(Stmt s) {
+        mix(s.defined() ? structural_hash(s) : 0);
+    }
+
+    template<typename T>
+    void mix_node(const T *op) {
+        mix((uint64_t)(size_t)op->type_info());
+        mix(op->type);
+    }
+
+    template<typename T>
+    void mix_stmt_node(const T *op) {
+        mix((uint64_t)(size_t)op->type_info());
+    }
+
+    void visit(const IntImm *op) {
+        mix_node(op);
+        mix((uint64_t)(int64_t)op->value);
+    }
+
+    void visit(const FloatImm *op) {
+        mix_node(op);
+        // Zeros of either sign compare equal.
+        float value = op->value == 0 ? 0.0f : op->value;
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        mix((uint64_t)bits);
+    }
+
+    void visit(const StringImm *op) {
+        mix_node(op);
+        mix(op->value);
+    }
+
+    void visit(const Cast *op) {
+        mix_node(op);
+        mix(op->value);
+    }
+
+    void visit(const Variable *op) {
+        mix_node(op);
+        mix(op->name);
+    }
+
+    template<typename T>
+    void visit_binary_operator(const T *op) {
+        mix_node(op);
+        mix(op->a);
+        mix(op->b);
+    }
+
+    void visit(const Add *op) {visit_binary_operator(op);}
+    void visit(const Sub *op) {visit_binary_operator(op);}
+    void visit(const Mul *op) {visit_binary_operator(op);}
+    void visit(const Div *op) {visit_binary_operator(op);}
+    void visit(const Mod *op) {visit_binary_operator(op);}
+    void visit(const Min *op) {visit_binary_operator(op);}
+    void visit(const Max *op) {visit_binary_operator(op);}
+    void visit(const EQ *op) {visit_binary_operator(op);}
+    void visit(const NE *op) {visit_binary_operator(op);}
+    void visit(const LT *op) {visit_binary_operator(op);}
+    void visit(const LE *op) {visit_binary_operator(op);}
+    void visit(const GT *op) {visit_binary_operator(op);}
+    void visit(const GE *op) {visit_binary_operator(op);}
+    void visit(const And *op) {visit_binary_operator(op);}
+    void visit(const Or *op) {visit_binary_operator(op);}
+
+    void visit(const Not *op) {
+        mix_node(op);
+        mix(op->a);
+    }
+
+    void visit(const Select *op) {
+        mix_node(op);
+        mix(op->condition);
+        mix(op->true_value);
+        mix(op->false_value);
+    }
+
+    void visit(const Load *op) {
+        mix_node(op);
+        mix(op->name);
+        mix(op->index);
+        mix(op->predicate);
+    }
+
+    void visit(const Ramp *op) {
+        mix_node(op);
+        mix(op->base);
+        mix(op->stride);
+    }
+
+    void visit(const Broadcast *op) {
+        mix_node(op);
+        mix(op->value);
+    }
+
+    void visit(const Call *op) {
+        mix_node(op);
+        mix(op->name);
+        mix((uint64_t)op->call_type);
+        mix((uint64_t)op->value_index);
+        for (size_t i = 0; i < op->args.size(); i++) {
+            mix(op->args[i]);
+        }
+    }
+
+    void visit(const Let *op) {
+        mix_node(op);
+        mix(op->name);
+        mix(op->value);
+        mix(op->body);
+    }
+
+    void visit(const LetStmt *op) {
+        mix_stmt_node(op);
+        mix(op->name);
+        mix(op->value);
+        mix(op->body);
+    }
+
+    void visit(const AssertStmt *op) {
+        mix_stmt_node(op);
+        mix(op->message);
+        mix(op->condition);
+    }
+
+    void visit(const Pipeline *op) {
+        mix_stmt_node(op);
+        mix(op->name);
+        mix(op->produce);
+        mix(op->update);
+        mix(op->consume);
+    }
+
+    void visit(const For *op) {
+        mix_stmt_node(op);
+        mix(op->name);
+        mix((uint64_t)op->for_type);
+        mix(op->min);
+        mix(op->extent);
+        mix(op->body);
+    }
+
+    void visit(const Store *op) {
+        mix_stmt_node(op);
+        mix(op->name);
+        mix(op->value);
+        mix(op->index);
+        mix(op->predicate);
+    }
+
+    void visit(const Provide *op) {
+        mix_stmt_node(op);
+        mix(op->name);
+        for (size_t i = 0; i < op->values.size(); i++) {
+            mix(op->values[i]);
+        }
+        for (size_t i = 0; i < op->args.size(); i++) {
+            mix(op->args[i]);
+        }
+    }
+
+    void visit(const Allocate *op) {
+        mix_stmt_node(op);
+        mix(op->name);
+        for (size_t i = 0; i < op->extents.size(); i++) {
+            mix(op->extents[i]);
+        }
+        mix(op->body);
+    }
+
+    void visit(const Free *op) {
+        mix_stmt_node(op);
+        mix(op->name);
+    }
+
+    void visit(const Realize *op) {
+        mix_stmt_node(op);
+        mix(op->name);
+        for (size_t i = 0; i < op->types.size(); i++) {
+            mix(op->types[i]);
+        }
+        for (size_t i = 0; i < op->bounds.size(); i++) {
+            mix(op->bounds[i].min);
+            mix(op->bounds[i].extent);
+        }
+        mix(op->body);
+    }
+
+    void visit(const Block *op) {
+        mix_stmt_node(op);
+        mix(op->first);
+        mix(op->rest);
+    }
+
+    void visit(const IfThenElse *op) {
+        mix_stmt_node(op);
+        mix(op->condition);
+        mix(op->then_case);
+        mix(op->else_case);
+    }
+
+    void visit(const Evaluate *op) {
+        mix_stmt_node(op);
+        mix(op->value);
+    }
+};
+
+uint64_t hash_node(const IRNode *node) {
+    if (node->structural_hash_cache == 0) {
+        IRHasher hasher;
+        node->accept(&hasher);
+        // Zero means not computed yet.
+        node->structural_hash_cache = hasher.h ? hasher.h : 1;
+    }
+    return node->structural_hash_cache;
+}
+
+// Rebuilds an Expr bottom-up out of canonical nodes.
+class HashConsExprs : public IRMutator {
+public:
+    ExprHashCons *table;
+    map<Expr, Expr, ExprCompare> *canonical;
+
+    using IRMutator::mutate;
+
+    Expr mutate(Expr e) {
+        if (!e.defined()) return e;
+        map<Expr, Expr, ExprCompare>::iterator iter = canonical->find(e);
+        if (iter != canonical->end()) {
+            return iter->second;
+        }
+        Expr result = table->intern(IRMutator::mutate(e));
+        (*canonical)[e] = result;
+        return result;
+    }
+};
+
+}
+
+uint64_t structural_hash(Expr e) {
+    assert(e.defined() && "Can't hash an undefined Expr");
+    return hash_node(e.ptr);
+}
+
+uint64_t structural_hash(Stmt s) {
+    assert(s.defined() && "Can't hash an undefined Stmt");
+    return hash_node(s.ptr);
+}
+
+bool ExprHashCompare::operator()(const Expr &a, const Expr &b) const {
+    if (a.same_as(b)) return false;
+    if (!a.defined() || !b.defined()) return !a.defined();
+    uint64_t ha = structural_hash(a), hb = structural_hash(b);
+    if (ha != hb) return ha < hb;
+    return deep_compare(a, b) < 0;
+}
+
+Expr ExprHashCons::intern(Expr e) {
+    if (!e.defined()) return e;
+    vector<Expr> &bucket = table[structural_hash(e)];
+    for (size_t i = 0; i < bucket.size(); i++) {
+        if (bucket[i].same_as(e) || deep_compare(bucket[i], e) == 0) {
+            return bucket[i];
+        }
+    }
+    bucket.push_back(e);
+    return e;
+}
+
+Expr ExprHashCons::canonicalize(Expr e) {
+    HashConsExprs mutator;
+    mutator.table = this;
+    mutator.canonical = &canonical;
+    return mutator.mutate(e);
+}
+
+void ir_hash_test() {
+    Expr x = Variable::make(Int(32), "x"), y = Variable::make(Int(32), "y");
+
+    Expr a = (x + y) * (x + y) + 3;
+    Expr b = (x + y) * (x + y) + 3;
+    Expr c = (x + y) * (x - y) + 3;
+    assert(structural_hash(a) == structural_hash(b) && "IR hash test failed: equal exprs");
+    assert(structural_hash(a) != structural_hash(c) && "IR hash test failed: different exprs");
+    assert(structural_hash(Cast::make(Int(16), x)) != structural_hash(Cast::make(Int(8), x)) &&
+           "IR hash test failed: types");
+    assert(structural_hash(FloatImm::make(0.0f)) == structural_hash(FloatImm::make(-0.0f)) &&
+           "IR hash test failed: signed zeros");
+    assert(equal(a, b) && !equal(a, c) && "IR hash test failed: equal");
+
+    Stmt s1 = Store::make("f", a, x), s2 = Store::make("f", b, x), s3 = Store::make("g", b, x);
+    assert(structural_hash(s1) == structural_hash(s2) && "IR hash test failed: equal stmts");
+    assert(structural_hash(s1) != structural_hash(s3) && "IR hash test failed: different stmts");
+
+    // Hash-consing makes all the equal subtrees the same node.
+    ExprHashCons table;
+    Expr ca = table.canonicalize(a), cb = table.canonicalize(b);
+    assert(ca.same_as(cb) && "IR hash test failed: hash-consing");
+    const Mul *mul = ca.as<Add>()->a.as<Mul>();
+    assert(mul && mul->a.same_as(mul->b) && "IR hash test failed: shared subtrees");
+    assert(!table.canonicalize(c).same_as(ca) && "IR hash test failed: distinct exprs");
+
+    std::set<Expr, ExprHashCompare> set;
+    set.insert(a);
+    set.insert(b);
+    set.insert(c);
+    assert(set.size() == 2 && "IR hash test failed: ExprHashCompare");
+
+    std::cout << "IR hash test passed" << std::endl;
+}
+
+}
+}
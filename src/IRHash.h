@@ -0,0 +1,61 @@
+#ifndef HALIDE_IR_HASH_H
+#define HALIDE_IR_HASH_H
+
+/** \file
+ * Methods for hashing IR by structure, and for hash-consing Exprs
+ */
+
+#include <map>
+#include <vector>
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Compute a hash of an IR tree from its structure. IR that is equal
+ * according to \ref equal has the same hash. The hash is cached in
+ * each node, so hashing a node whose children have been hashed
+ * before is constant time. */
+// @{
+EXPORT uint64_t structural_hash(Expr e);
+EXPORT uint64_t structural_hash(Stmt s);
+// @}
+
+/** A compare struct suitable for use in std::map and std::set that
+ * orders by structural hash, and only falls back to deep_compare to
+ * break ties. Lookups are much faster than with ExprDeepCompare, but
+ * the order isn't lexical, so don't use it where the order of
+ * iteration matters. */
+struct ExprHashCompare {
+    EXPORT bool operator()(const Expr &a, const Expr &b) const;
+};
+
+/** A table of Exprs in which there is only one node for each value,
+ * so that equal subexpressions of the Exprs that pass through it
+ * become the same node. Comparing canonical Exprs with equal or
+ * deep_compare is then cheap, because the comparison stops at the
+ * first children that are the same node. */
+class ExprHashCons {
+public:
+    /** Return the canonical version of an Expr, rebuilding it from
+     * the canonical versions of its children if necessary. */
+    EXPORT Expr canonicalize(Expr e);
+
+    /** Return the canonical node equal to an Expr whose children are
+     * already canonical, adding it to the table if it's new. This is
+     * the constant-time step used by canonicalize, for passes that
+     * build their Exprs bottom-up anyway. */
+    EXPORT Expr intern(Expr e);
+
+private:
+    std::map<uint64_t, std::vector<Expr> > table;
+    std::map<Expr, Expr, ExprCompare> canonical;
+};
+
+EXPORT void ir_hash_test();
+
+}
+}
+
+#endif
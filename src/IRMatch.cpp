@@ -1,4 +1,5 @@
 #include <iostream>
+#include <map>
 
 #include "IRMatch.h"
 #include "IREquality.h"
@@ -8,6 +9,8 @@ namespace Halide {
 namespace Internal {
 
 using std::vector;
+using std::map;
+using std::string;
 
 void expr_match_test() {
     vector<Expr> matches;
@@ -41,6 +44,15 @@ void expr_match_test() {
 
     assert(expr_match(vec_wild * 3, Ramp::make(x, y, 4) * 3, matches));
 
+    // Named wildcards match any type, and must match consistently.
+    map<string, Expr> bindings;
+    Expr a = Variable::make(Int(32), "a"), b = Variable::make(Int(32), "b");
+    assert(expr_match(Min::make(a, Max::make(a, b)), Min::make(fx, Max::make(fx, fy)), bindings) &&
+           equal(bindings["a"], fx) && equal(bindings["b"], fy));
+    assert(!expr_match(Min::make(a, Max::make(a, b)), Min::make(fx, Max::make(fy, fx)), bindings) &&
+           bindings.empty());
+    assert(expr_match(a + 1, fx + 1.0f, bindings) && equal(bindings["a"], fx));
+
     std::cout << "expr_match test passed" << std::endl;
 }
 
@@ -50,14 +62,25 @@ public:
     vector<Expr> &matches;
     Expr expr;
 
-    IRMatch(Expr e, vector<Expr> &m) : result(true), matches(m), expr(e) {
+    // If set, all variables in the pattern are wildcards of any type,
+    // bound by name.
+    map<string, Expr> *bindings;
+
+    IRMatch(Expr e, vector<Expr> &m) : result(true), matches(m), expr(e), bindings(NULL) {
+    }
+
+    IRMatch(Expr e, vector<Expr> &m, map<string, Expr> &b) :
+        result(true), matches(m), expr(e), bindings(&b) {
     }
 
     using IRVisitor::visit;
 
     void visit(const IntImm *op) {
         const IntImm *e = expr.as<IntImm>();
-        if (!e || e->value != op->value) {
+        if (bindings) {
+            // Match constants of any type.
+            result = result && is_const(expr, op->value);
+        } else if (!e || e->value != op->value) {
             result = false;
         }
     }
@@ -80,7 +103,15 @@ public:
     }
 
     void visit(const Variable *op) {
-        if (op->type != expr.type()) {
+        if (bindings) {
+            if (!result) return;
+            map<string, Expr>::iterator iter = bindings->find(op->name);
+            if (iter == bindings->end()) {
+                (*bindings)[op->name] = expr;
+            } else {
+                result = equal(iter->second, expr);
+            }
+        } else if (op->type != expr.type()) {
             result = false;
         } else if (op->name == "*") {
             matches.push_back(expr);
@@ -145,9 +176,14 @@ public:
 
     void visit(const Load *op) {
         const Load *e = expr.as<Load>();
-        if (result && e && e->type == op->type && e->name == op->name) {
+        if (result && e && e->type == op->type && e->name == op->name &&
+            e->predicate.defined() == op->predicate.defined()) {
             expr = e->index;
             op->index.accept(this);
+            if (op->predicate.defined()) {
+                expr = e->predicate;
+                op->predicate.accept(this);
+            }
         } else {
             result = false;
         }
@@ -220,4 +256,20 @@ bool expr_match(Expr pattern, Expr expr, vector<Expr> &matches) {
     }
 }
 
+bool expr_match(Expr pattern, Expr expr, map<string, Expr> &bindings) {
+    bindings.clear();
+    if (!pattern.defined() && !expr.defined()) return true;
+    if (!pattern.defined() || !expr.defined()) return false;
+
+    vector<Expr> unused;
+    IRMatch eq(expr, unused, bindings);
+    pattern.accept(&eq);
+    if (eq.result) {
+        return true;
+    } else {
+        bindings.clear();
+        return false;
+    }
+}
+
 }}
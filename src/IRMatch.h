@@ -5,6 +5,8 @@
  * Defines a method to match a fragment of IR against a pattern containing wildcards
  */
 
+#include <map>
+#include <string>
 #include <vector>
 
 #include "IR.h"
@@ -27,6 +29,23 @@ namespace Internal {
  */
 
 bool expr_match(Expr pattern, Expr expr, std::vector<Expr> &result);
+
+/** Does the first expression have the same structure as the second?
+ * All variables in the first expression are wildcards, matched by
+ * name. The first time a name is matched, it's bound to the matching
+ * part of the second expression in the map given as the third
+ * argument, and later matches of that name must be equal to it. The
+ * wildcards and integer constants in the pattern match Exprs of any
+ * type, so one pattern covers every type.
+ *
+ * For example:
+ \code
+ Expr x = Variable::make(Int(32), "x");
+ expr_match(min(x, x + 1), min(f, f + 1.0f), result)
+ \endcode
+ * should return true, and set result["x"] to f.
+ */
+bool expr_match(Expr pattern, Expr expr, std::map<std::string, Expr> &result);
 void expr_match_test();
 
 }
@@ -5,6 +5,77 @@ namespace Internal {
 
 using std::vector;
 
+Expr rebuild(const Let *op, Expr value, Expr body) {
+    if (value.same_as(op->value) && body.same_as(op->body)) {
+        return op;
+    }
+    return Let::make(op->name, value, body);
+}
+
+Stmt rebuild(const LetStmt *op, Expr value, Stmt body) {
+    if (value.same_as(op->value) && body.same_as(op->body)) {
+        return op;
+    }
+    return LetStmt::make(op->name, value, body);
+}
+
+Stmt rebuild(const Pipeline *op, Stmt produce, Stmt update, Stmt consume) {
+    if (produce.same_as(op->produce) &&
+        update.same_as(op->update) &&
+        consume.same_as(op->consume)) {
+        return op;
+    }
+    return Pipeline::make(op->name, produce, update, consume);
+}
+
+Stmt rebuild(const For *op, Expr min, Expr extent, Stmt body) {
+    if (min.same_as(op->min) &&
+        extent.same_as(op->extent) &&
+        body.same_as(op->body)) {
+        return op;
+    }
+    return For::make(op->name, min, extent, op->for_type, body);
+}
+
+Stmt rebuild(const Allocate *op, const vector<Expr> &extents, Stmt body) {
+    bool changed = !body.same_as(op->body) || extents.size() != op->extents.size();
+    for (size_t i = 0; !changed && i < extents.size(); i++) {
+        changed = !extents[i].same_as(op->extents[i]);
+    }
+    if (!changed) {
+        return op;
+    }
+    return Allocate::make(op->name, op->type, extents, body);
+}
+
+Stmt rebuild(const Realize *op, const Region &bounds, Stmt body) {
+    bool changed = !body.same_as(op->body) || bounds.size() != op->bounds.size();
+    for (size_t i = 0; !changed && i < bounds.size(); i++) {
+        changed = (!bounds[i].min.same_as(op->bounds[i].min) ||
+                   !bounds[i].extent.same_as(op->bounds[i].extent));
+    }
+    if (!changed) {
+        return op;
+    }
+    return Realize::make(op->name, op->types, bounds, body);
+}
+
+Stmt rebuild(const Block *op, Stmt first, Stmt rest) {
+    if (first.same_as(op->first) && rest.same_as(op->rest)) {
+        return op;
+    }
+    return Block::make(first, rest);
+}
+
+Stmt rebuild(const IfThenElse *op, Expr condition, Stmt then_case, Stmt else_case) {
+    if (condition.same_as(op->condition) &&
+        then_case.same_as(op->then_case) &&
+        else_case.same_as(op->else_case)) {
+        return op;
+    }
+    return IfThenElse::make(condition, then_case, else_case);
+}
+
 Expr IRMutator::mutate(Expr e) {
     if (e.defined()) {
         e.accept(this);
@@ -91,10 +162,12 @@ void IRMutator::visit(const Select *op)  {
 
 void IRMutator::visit(const Load *op) {
     Expr index = mutate(op->index);
-    if (index.same_as(op->index)) {
+    Expr predicate = mutate(op->predicate);
+    if (index.same_as(op->index) &&
+        predicate.same_as(op->predicate)) {
         expr = op;
     } else {
-        expr = Load::make(op->type, op->name, index, op->image, op->param);
+        expr = Load::make(op->type, op->name, index, op->image, op->param, predicate);
     }
 }
 
@@ -138,23 +211,13 @@ void IRMutator::visit(const Call *op) {
 void IRMutator::visit(const Let *op) {
     Expr value = mutate(op->value);
     Expr body = mutate(op->body);
-    if (value.same_as(op->value) &&
-        body.same_as(op->body)) {
-        expr = op;
-    } else {
-        expr = Let::make(op->name, value, body);
-    }
+    expr = rebuild(op, value, body);
 }
 
 void IRMutator::visit(const LetStmt *op) {
     Expr value = mutate(op->value);
     Stmt body = mutate(op->body);
-    if (value.same_as(op->value) &&
-        body.same_as(op->body)) {
-        stmt = op;
-    } else {
-        stmt = LetStmt::make(op->name, value, body);
-    }
+    stmt = rebuild(op, value, body);
 }
 
 void IRMutator::visit(const AssertStmt *op) {
@@ -182,34 +245,24 @@ void IRMutator::visit(const Pipeline *op) {
     Stmt produce = mutate(op->produce);
     Stmt update = mutate(op->update);
     Stmt consume = mutate(op->consume);
-    if (produce.same_as(op->produce) &&
-        update.same_as(op->update) &&
-        consume.same_as(op->consume)) {
-        stmt = op;
-    } else {
-        stmt = Pipeline::make(op->name, produce, update, consume);
-    }
+    stmt = rebuild(op, produce, update, consume);
 }
 
 void IRMutator::visit(const For *op) {
     Expr min = mutate(op->min);
     Expr extent = mutate(op->extent);
     Stmt body = mutate(op->body);
-    if (min.same_as(op->min) &&
-        extent.same_as(op->extent) &&
-        body.same_as(op->body)) {
-        stmt = op;
-    } else {
-        stmt = For::make(op->name, min, extent, op->for_type, body);
-    }
+    stmt = rebuild(op, min, extent, body);
 }
 
 void IRMutator::visit(const Store *op) {
     Expr value = mutate(op->value);
     Expr index = mutate(op->index);
+    Expr predicate = mutate(op->predicate);
     if (value.same_as(op->value) &&
-        index.same_as(op->index)) stmt = op;
-    else stmt = Store::make(op->name, value, index);
+        index.same_as(op->index) &&
+        predicate.same_as(op->predicate)) stmt = op;
+    else stmt = Store::make(op->name, value, index, predicate);
 }
 
 void IRMutator::visit(const Provide *op) {
@@ -240,15 +293,12 @@ void IRMutator::visit(const Provide *op) {
 }
 
 void IRMutator::visit(const Allocate *op) {
-  std::vector<Expr> new_extents;
-    bool all_extents_unmodified = true;
+    std::vector<Expr> new_extents;
     for (size_t i = 0; i < op->extents.size(); i++) {
         new_extents.push_back(mutate(op->extents[i]));
-        all_extents_unmodified &= new_extents[i].same_as(op->extents[i]);
     }
     Stmt body = mutate(op->body);
-    if (all_extents_unmodified && body.same_as(op->body)) stmt = op;
-    else stmt = Allocate::make(op->name, op->type, new_extents, body);
+    stmt = rebuild(op, new_extents, body);
 }
 
 void IRMutator::visit(const Free *op) {
@@ -257,49 +307,27 @@ void IRMutator::visit(const Free *op) {
 
 void IRMutator::visit(const Realize *op) {
     Region new_bounds(op->bounds.size());
-    bool bounds_changed = false;
 
     // Mutate the bounds
     for (size_t i = 0; i < op->bounds.size(); i++) {
-        Expr old_min    = op->bounds[i].min;
-        Expr old_extent = op->bounds[i].extent;
-        Expr new_min    = mutate(old_min);
-        Expr new_extent = mutate(old_extent);
-        if (!new_min.same_as(old_min))       bounds_changed = true;
-        if (!new_extent.same_as(old_extent)) bounds_changed = true;
-        new_bounds[i] = Range(new_min, new_extent);
+        new_bounds[i] = Range(mutate(op->bounds[i].min), mutate(op->bounds[i].extent));
     }
 
     Stmt body = mutate(op->body);
-    if (!bounds_changed && body.same_as(op->body)) {
-        stmt = op;
-    } else {
-        stmt = Realize::make(op->name, op->types, new_bounds, body);
-    }
+    stmt = rebuild(op, new_bounds, body);
 }
 
 void IRMutator::visit(const Block *op) {
     Stmt first = mutate(op->first);
     Stmt rest = mutate(op->rest);
-    if (first.same_as(op->first) &&
-        rest.same_as(op->rest)) {
-        stmt = op;
-    } else {
-        stmt = Block::make(first, rest);
-    }
+    stmt = rebuild(op, first, rest);
 }
 
 void IRMutator::visit(const IfThenElse *op) {
     Expr condition = mutate(op->condition);
     Stmt then_case = mutate(op->then_case);
     Stmt else_case = mutate(op->else_case);
-    if (condition.same_as(op->condition) &&
-        then_case.same_as(op->then_case) &&
-        else_case.same_as(op->else_case)) {
-        stmt = op;
-    } else {
-        stmt = IfThenElse::make(condition, then_case, else_case);
-    }
+    stmt = rebuild(op, condition, then_case, else_case);
 }
 
 void IRMutator::visit(const Evaluate *op) {
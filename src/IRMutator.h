@@ -82,6 +82,23 @@ protected:
     virtual void visit(const Evaluate *);
 };
 
+/** Make a node like an existing one but with new children, or return
+ * the existing node if the new children are all the same as its
+ * own. The default mutator visit methods have this contract; mutators
+ * that override them and only change some children should use these
+ * instead of make, so that they don't copy the parts of the tree they
+ * leave alone. */
+// @{
+EXPORT Expr rebuild(const Let *op, Expr value, Expr body);
+EXPORT Stmt rebuild(const LetStmt *op, Expr value, Stmt body);
+EXPORT Stmt rebuild(const Pipeline *op, Stmt produce, Stmt update, Stmt consume);
+EXPORT Stmt rebuild(const For *op, Expr min, Expr extent, Stmt body);
+EXPORT Stmt rebuild(const Allocate *op, const std::vector<Expr> &extents, Stmt body);
+EXPORT Stmt rebuild(const Realize *op, const Region &bounds, Stmt body);
+EXPORT Stmt rebuild(const Block *op, Stmt first, Stmt rest);
+EXPORT Stmt rebuild(const IfThenElse *op, Expr condition, Stmt then_case, Stmt else_case);
+// @}
+
 }
 }
 
@@ -193,6 +193,15 @@ void match_types(Expr &a, Expr &b) {
     assert(!a.type().is_handle() && !b.type().is_handle() &&
            "Can't do arithmetic on opaque pointer types\n");
 
+    // Half-precision floats are only a storage type. Arithmetic on
+    // them happens in single precision.
+    if (a.type().is_float() && a.type().bits == 16) {
+        a = cast(Float(32, a.type().width), a);
+    }
+    if (b.type().is_float() && b.type().bits == 16) {
+        b = cast(Float(32, b.type().width), b);
+    }
+
     if (a.type() == b.type()) return;
 
     const int *a_int_imm = as_const_int(a);
@@ -344,7 +353,7 @@ Expr halide_exp(Expr x_full) {
         x_full = simplify(x_full);
         const float * f = as_const_float(x_full);
         if (f) {
-            return logf(*f);
+            return expf(*f);
         }
     }
 
@@ -387,6 +396,76 @@ Expr halide_exp(Expr x_full) {
     return result;
 }
 
+namespace {
+// The sine (or cosine) of a Float(32), from the Cephes sinf and
+// cosf. The argument is reduced to [-pi/4, pi/4] by subtracting the
+// nearest multiple of pi/2 in three parts, and then one of two
+// polynomials is used, depending on the quadrant.
+Expr sin_or_cos(Expr x_full, bool cosine) {
+    Expr x_abs = abs(x_full);
+
+    // The octant, rounded up to an even number, so that x_abs - j *
+    // pi/4 is in [-pi/4, pi/4].
+    Expr j = cast<int>(x_abs * 1.27323954473516f);
+    j = (j + 1) & ~1;
+    Expr y = cast<float>(j);
+
+    Expr x = ((x_abs - y * 0.78515625f) - y * 2.4187564849853515625e-4f) - y * 3.77489497744594108e-8f;
+    Expr z = x * x;
+
+    Expr sin_poly = -1.9515295891e-4f;
+    sin_poly = sin_poly * z + 8.3321608736e-3f;
+    sin_poly = sin_poly * z + -1.6666654611e-1f;
+    sin_poly = sin_poly * z * x + x;
+
+    Expr cos_poly = 2.443315711809948e-5f;
+    cos_poly = cos_poly * z + -1.388731625493765e-3f;
+    cos_poly = cos_poly * z + 4.166664568298827e-2f;
+    cos_poly = cos_poly * z * z - 0.5f * z + 1.0f;
+
+    // Which multiple of pi/2 was subtracted, mod 4.
+    Expr quadrant = (j >> 1) & 3;
+    if (cosine) quadrant = (quadrant + 1) & 3;
+
+    Expr use_cos = (quadrant & 1) == 1;
+    Expr result = select(use_cos, cos_poly, sin_poly);
+
+    // Sine is odd, so the sign of the input matters to it. Cosine is
+    // even, and one quadrant ahead of sine.
+    Expr negate = quadrant >= 2;
+    if (!cosine) negate = negate != (x_full < 0.0f);
+    return select(negate, -result, result);
+}
+}
+
+Expr halide_sin(Expr x_full) {
+    assert(x_full.type() == Float(32));
+
+    if (is_const(x_full)) {
+        x_full = simplify(x_full);
+        const float * f = as_const_float(x_full);
+        if (f) {
+            return sinf(*f);
+        }
+    }
+
+    return sin_or_cos(x_full, false);
+}
+
+Expr halide_cos(Expr x_full) {
+    assert(x_full.type() == Float(32));
+
+    if (is_const(x_full)) {
+        x_full = simplify(x_full);
+        const float * f = as_const_float(x_full);
+        if (f) {
+            return cosf(*f);
+        }
+    }
+
+    return sin_or_cos(x_full, true);
+}
+
 Expr raise_to_integer_power(Expr e, int p) {
     Expr result;
     if (p == 0) {
@@ -487,6 +566,12 @@ Expr print(const std::vector<Expr> &args) {
     return call;
 }
 
+Expr host_cache_size(int level) {
+    assert(level >= 1 && level <= 3 && "There are only three levels of cache");
+    return Internal::Call::make(Int(32), "halide_host_cache_size",
+                                Internal::vec<Expr>(level), Internal::Call::Extern);
+}
+
 Expr print_when(Expr condition, const std::vector<Expr> &args) {
     Expr p = print(args);
     return Internal::Call::make(p.type(),
@@ -130,6 +130,8 @@ EXPORT void match_types(Expr &a, Expr &b);
 // @{
 EXPORT Expr halide_log(Expr a);
 EXPORT Expr halide_exp(Expr a);
+EXPORT Expr halide_sin(Expr a);
+EXPORT Expr halide_cos(Expr a);
 // @}
 
 /** Raise an expression to an integer power by repeatedly multiplying
@@ -462,14 +464,18 @@ inline Expr select(Expr c1, Expr v1,
 // @}
 
 /** Return the sine of a floating-point expression. If the argument is
- * not floating-point, it is cast to Float(32). Does not vectorize
- * well. */
+ * not floating-point, it is cast to Float(32). For Float(64)
+ * arguments, this calls the system sin function, and does not
+ * vectorize well. For Float(32) arguments, the absolute error is
+ * within about 10^-7 (a bit of the mantissa for results near one)
+ * for arguments up to 8192 in magnitude, and gets worse for larger
+ * ones. Vectorizes cleanly. */
 inline Expr sin(Expr x) {
     assert(x.defined() && "sin of undefined");
     if (x.type() == Float(64)) {
         return Internal::Call::make(Float(64), "sin_f64", vec(x), Internal::Call::Extern);
     } else {
-        return Internal::Call::make(Float(32), "sin_f32", vec(cast<float>(x)), Internal::Call::Extern);
+        return Internal::halide_sin(cast<float>(x));
     }
 }
 
@@ -486,14 +492,16 @@ inline Expr asin(Expr x) {
 }
 
 /** Return the cosine of a floating-point expression. If the argument
- * is not floating-point, it is cast to Float(32). Does not vectorize
- * well. */
+ * is not floating-point, it is cast to Float(32). For Float(64)
+ * arguments, this calls the system cos function, and does not
+ * vectorize well. For Float(32) arguments, as accurate as sin, and
+ * vectorizes cleanly. */
 inline Expr cos(Expr x) {
     assert(x.defined() && "cos of undefined");
     if (x.type() == Float(64)) {
         return Internal::Call::make(Float(64), "cos_f64", vec(x), Internal::Call::Extern);
     } else {
-        return Internal::Call::make(Float(32), "cos_f32", vec(cast<float>(x)), Internal::Call::Extern);
+        return Internal::halide_cos(cast<float>(x));
     }
 }
 
@@ -510,14 +518,17 @@ inline Expr acos(Expr x) {
 }
 
 /** Return the tangent of a floating-point expression. If the argument
- * is not floating-point, it is cast to Float(32). Does not vectorize
- * well. */
+ * is not floating-point, it is cast to Float(32). For Float(64)
+ * arguments, this calls the system tan function, and does not
+ * vectorize well. For Float(32) arguments, this is sin(x) / cos(x),
+ * with about twice their relative error, and vectorizes cleanly. */
 inline Expr tan(Expr x) {
     assert(x.defined() && "tan of undefined");
     if (x.type() == Float(64)) {
         return Internal::Call::make(Float(64), "tan_f64", vec(x), Internal::Call::Extern);
     } else {
-        return Internal::Call::make(Float(32), "tan_f32", vec(cast<float>(x)), Internal::Call::Extern);
+        x = cast<float>(x);
+        return Internal::halide_sin(x) / Internal::halide_cos(x);
     }
 }
 
@@ -1121,6 +1132,19 @@ inline Expr print_when(Expr condition, PrintArg a, PrintArg b, PrintArg c, Print
 }
 // @}
 
+/** The size in bytes of the data cache at the given level (1, 2, or
+ * 3) of the machine the pipeline runs on, as found by the runtime
+ * when it runs. Use it for split and tile factors, so that one
+ * compiled pipeline tiles to suit the cache of each machine it runs
+ * on. For example, tiles of floats that use a quarter of the L2
+ * cache:
+ *
+ \code
+ Expr rows = max(host_cache_size(2) / (4 * 256 * 4), 1);
+ f.tile(x, y, xi, yi, 256, rows);
+ \endcode
+ */
+EXPORT Expr host_cache_size(int level);
 
 /** Return an undef value of the given type. Halide skips stores that
  * depend on undef values, so you can use this to mean "do not modify
@@ -102,6 +102,9 @@ ostream &operator<<(ostream &out, const For::ForType &type) {
     case For::Vectorized:
         out << "vectorized";
         break;
+    case For::Jammed:
+        out << "jammed";
+        break;
     }
     return out;
 }
@@ -325,6 +328,10 @@ void IRPrinter::visit(const Load *op) {
     stream << op->name << "[";
     print(op->index);
     stream << "]";
+    if (op->predicate.defined()) {
+        stream << " if ";
+        print(op->predicate);
+    }
 }
 
 void IRPrinter::visit(const Ramp *op) {
@@ -440,6 +447,10 @@ void IRPrinter::visit(const Store *op) {
     print(op->index);
     stream << "] = ";
     print(op->value);
+    if (op->predicate.defined()) {
+        stream << " if ";
+        print(op->predicate);
+    }
     stream << '\n';
 }
 
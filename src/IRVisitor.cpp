@@ -110,6 +110,7 @@ void IRVisitor::visit(const Select *op) {
 
 void IRVisitor::visit(const Load *op) {
     op->index.accept(this);
+    if (op->predicate.defined()) op->predicate.accept(this);
 }
 
 void IRVisitor::visit(const Ramp *op) {
@@ -167,6 +168,7 @@ void IRVisitor::visit(const For *op) {
 void IRVisitor::visit(const Store *op) {
     op->value.accept(this);
     op->index.accept(this);
+    if (op->predicate.defined()) op->predicate.accept(this);
 }
 
 void IRVisitor::visit(const Provide *op) {
@@ -338,6 +340,7 @@ void IRGraphVisitor::visit(const Select *op) {
 
 void IRGraphVisitor::visit(const Load *op) {
     include(op->index);
+    if (op->predicate.defined()) include(op->predicate);
 }
 
 void IRGraphVisitor::visit(const Ramp *op) {
@@ -384,6 +387,7 @@ void IRGraphVisitor::visit(const For *op) {
 void IRGraphVisitor::visit(const Store *op) {
     include(op->value);
     include(op->index);
+    if (op->predicate.defined()) include(op->predicate);
 }
 
 void IRGraphVisitor::visit(const Provide *op) {
@@ -0,0 +1,227 @@
+#include "InPlace.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "Bounds.h"
+#include "Simplify.h"
+#include "IRPrinter.h"
+#include "CodeGen_GPU_Dev.h"
+#include "Debug.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+
+namespace {
+
+// Find the calls to an input image.
+class CallsToImage : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &name;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type == Call::Image && op->name == name) {
+            calls.push_back(op);
+        }
+    }
+
+public:
+    vector<const Call *> calls;
+
+    CallsToImage(const string &n) : name(n) {}
+
+    void include(const vector<Expr> &exprs) {
+        for (size_t i = 0; i < exprs.size(); i++) {
+            exprs[i].accept(this);
+        }
+    }
+};
+
+bool calls_image(Function f, const string &name) {
+    CallsToImage finder(name);
+    finder.include(f.values());
+    const vector<ReductionDefinition> &reductions = f.reductions();
+    for (size_t i = 0; i < reductions.size(); i++) {
+        finder.include(reductions[i].values);
+        finder.include(reductions[i].args);
+    }
+    if (!finder.calls.empty()) return true;
+    if (f.has_extern_definition()) {
+        const vector<ExternFuncArgument> &args = f.extern_arguments();
+        for (size_t i = 0; i < args.size(); i++) {
+            if (args[i].is_image_param() && args[i].image_param.name() == name) {
+                return true;
+            }
+            if (args[i].is_expr()) {
+                args[i].expr.accept(&finder);
+            }
+        }
+    }
+    return !finder.calls.empty();
+}
+
+// Whether each point of an output reads an input only at itself,
+// which is safe for any schedule.
+bool reads_only_in_place(Function f, const string &input) {
+    CallsToImage finder(input);
+    finder.include(f.values());
+    bool only_in_place = true;
+    for (size_t i = 0; i < finder.calls.size(); i++) {
+        const Call *call = finder.calls[i];
+        if (call->args.size() != f.args().size()) {
+            std::cerr << "Can't compute " << f.name() << " in place of " << input
+                      << ", because they have different numbers of dimensions\n";
+            assert(false);
+        }
+        for (size_t j = 0; j < call->args.size(); j++) {
+            Expr offset = simplify(call->args[j] - Variable::make(Int(32), f.args()[j]));
+            Interval b = bounds_of_expr_in_scope(offset, Scope<Interval>());
+            const int *min = b.min.defined() ? as_const_int(simplify(b.min)) : NULL;
+            const int *max = b.max.defined() ? as_const_int(simplify(b.max)) : NULL;
+            if (!min || !max || *min < 0) {
+                std::cerr << "Can't compute " << f.name() << " in place of " << input
+                          << ", because it reads " << Expr(call)
+                          << ", which may have been overwritten already\n";
+                assert(false);
+            }
+            if (*max != 0) only_in_place = false;
+        }
+    }
+    return only_in_place;
+}
+
+}
+
+void check_in_place(const vector<Function> &outputs,
+                    const map<string, Function> &env) {
+    for (size_t i = 0; i < outputs.size(); i++) {
+        Function f = outputs[i];
+        for (size_t k = 0; k < f.output_buffers().size(); k++) {
+            const string &input = f.output_buffers()[k].in_place_of();
+            if (input.empty()) continue;
+
+            debug(2) << "Checking that " << f.name() << " can be computed in place of " << input << "\n";
+
+            if (f.has_extern_definition() || !f.reductions().empty()) {
+                std::cerr << "Can't compute " << f.name() << " in place of " << input
+                          << ", because only outputs with no update steps can be computed in place\n";
+                assert(false);
+            }
+
+            for (map<string, Function>::const_iterator iter = env.begin();
+                 iter != env.end(); ++iter) {
+                if (iter->first != f.name() && calls_image(iter->second, input)) {
+                    std::cerr << "Can't compute " << f.name() << " in place of " << input
+                              << ", because " << iter->first << " also reads " << input << "\n";
+                    assert(false);
+                }
+            }
+
+            bool only_in_place = reads_only_in_place(f, input);
+
+            Schedule &s = f.schedule();
+            for (size_t j = 0; j < s.splits.size(); j++) {
+                Schedule::Split &split = s.splits[j];
+                if (!split.is_split()) continue;
+                if (split.tail == Tail_Auto) {
+                    split.tail = Tail_GuardWithIf;
+                }
+                if (split.tail == Tail_ShiftInwards) {
+                    std::cerr << "Can't compute " << f.name() << " in place of " << input
+                              << ", because the split of " << split.old_var
+                              << " would compute some points twice. Use Tail_GuardWithIf or Tail_RoundUp.\n";
+                    assert(false);
+                }
+            }
+
+            if (only_in_place) continue;
+
+            // Reads after each point in every dimension come after it
+            // in any serial loop nest in which the inner loop of each
+            // split is inside its outer loop.
+            for (size_t j = 0; j < s.dims.size(); j++) {
+                if (s.dims[j].for_type == For::Parallel || CodeGen_GPU_Dev::is_gpu_var(s.dims[j].var)) {
+                    std::cerr << "Can't compute " << f.name() << " in place of " << input
+                              << " with a parallel loop over " << s.dims[j].var
+                              << ", because it reads points of " << input << " other than the one it writes\n";
+                    assert(false);
+                }
+            }
+            for (size_t j = 0; j < s.splits.size(); j++) {
+                const Schedule::Split &split = s.splits[j];
+                if (!split.is_split()) continue;
+                size_t inner = s.dims.size(), outer = s.dims.size();
+                for (size_t d = 0; d < s.dims.size(); d++) {
+                    if (s.dims[d].var == split.inner) inner = d;
+                    if (s.dims[d].var == split.outer) outer = d;
+                }
+                if (inner < s.dims.size() && outer < s.dims.size() && inner > outer) {
+                    std::cerr << "Can't compute " << f.name() << " in place of " << input
+                              << " with " << split.inner << " outside " << split.outer
+                              << ", because it reads points of " << input << " other than the one it writes\n";
+                    assert(false);
+                }
+            }
+        }
+    }
+}
+
+namespace {
+
+class ComputeInPlace : public IRMutator {
+    const map<string, Parameter> &inputs;
+
+    using IRMutator::visit;
+
+    void visit(const Load *op) {
+        IRMutator::visit(op);
+        map<string, Parameter>::const_iterator iter = inputs.find(op->name);
+        if (iter != inputs.end()) {
+            op = expr.as<Load>();
+            expr = Load::make(op->type, iter->second.name(), op->index,
+                              Buffer(), iter->second, op->predicate);
+        }
+    }
+
+public:
+    ComputeInPlace(const map<string, Parameter> &i) : inputs(i) {}
+};
+
+}
+
+Stmt compute_in_place(Stmt s, const vector<Function> &outputs) {
+    // The output buffer for each input that one overwrites.
+    map<string, Parameter> inputs;
+    for (size_t i = 0; i < outputs.size(); i++) {
+        const vector<Parameter> &bufs = outputs[i].output_buffers();
+        for (size_t k = 0; k < bufs.size(); k++) {
+            if (!bufs[k].in_place_of().empty()) {
+                inputs[bufs[k].in_place_of()] = bufs[k];
+            }
+        }
+    }
+    if (inputs.empty()) return s;
+
+    s = ComputeInPlace(inputs).mutate(s);
+
+    // A null host pointer means a bounds query.
+    for (map<string, Parameter>::const_iterator iter = inputs.begin();
+         iter != inputs.end(); ++iter) {
+        Expr in_host = reinterpret(UInt(64), Variable::make(Handle(), iter->first + ".host"));
+        Expr out_host = reinterpret(UInt(64), Variable::make(Handle(), iter->second.name() + ".host"));
+        Expr zero = make_zero(UInt(64));
+        Expr check = (in_host == out_host) || (in_host == zero) || (out_host == zero);
+        string error = "Output buffer " + iter->second.name() +
+            " is computed in place of input buffer " + iter->first +
+            ", but they don't have the same host pointer";
+        s = Block::make(AssertStmt::make(check, error, vector<Expr>()), s);
+    }
+    return s;
+}
+
+}
+}
@@ -0,0 +1,41 @@
+#ifndef HALIDE_IN_PLACE_H
+#define HALIDE_IN_PLACE_H
+
+/** \file
+ * Defines the lowering passes for outputs that overwrite an input
+ * (see OutputImageParam::set_in_place).
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "IR.h"
+#include "Function.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Check that the outputs declared to overwrite an input can be
+ * computed in place. Only the output may read the input, and it must
+ * have no update steps. Bounds analysis must show that each point of
+ * the output reads the input only at points at or after it in every
+ * dimension. If any of them are after it, the output must also have
+ * no parallel loops, and no split whose inner loop is outside its
+ * outer loop. Splits of such outputs default to Tail_GuardWithIf,
+ * because shifting the last iteration inwards would compute some
+ * points again from overwritten input. Asserts if any of this
+ * doesn't hold. */
+void check_in_place(const std::vector<Function> &outputs,
+                    const std::map<std::string, Function> &env);
+
+/** Make the loads from each input that an output overwrites load from
+ * the output buffer instead, so that codegen knows they are the same
+ * memory, and check at runtime that the two buffers have the same
+ * host pointer. Must run after storage flattening. */
+Stmt compute_in_place(Stmt s, const std::vector<Function> &outputs);
+
+}
+}
+
+#endif
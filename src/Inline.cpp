@@ -1,4 +1,5 @@
 #include <set>
+#include <map>
 
 #include "Inline.h"
 #include "CSE.h"
@@ -12,11 +13,16 @@ namespace Internal {
 using std::set;
 using std::string;
 using std::vector;
+using std::map;
+using std::pair;
 
 class Inliner : public IRMutator {
     using IRMutator::visit;
 
-    Function func;
+    // The functions to inline, and the inlined body of each of their
+    // values.
+    map<string, Function> funcs;
+    map<pair<string, int>, Expr> bodies;
 
     // Sanity check that this is a reasonable function to inline
     void check(Function f) {
@@ -39,7 +45,7 @@ class Inliner : public IRMutator {
                           << d.var << " of function "
                           << f.name() << " because the function is scheduled inline.\n";
                 assert(false);
-            } else if (d.for_type == For::Unrolled) {
+            } else if (d.for_type == For::Unrolled || d.for_type == For::Jammed) {
                 std::cerr << "Cannot unroll dimension "
                           << d.var << " of function "
                           << f.name() << " because the function is scheduled inline.\n";
@@ -84,15 +90,28 @@ class Inliner : public IRMutator {
     }
 
     void visit(const Call *op) {
-        if (op->name == func.name()) {
+        map<string, Function>::iterator iter = funcs.find(op->name);
+        if (iter != funcs.end()) {
+            const Function &func = iter->second;
 
             // Mutate the args
             vector<Expr> args(op->args.size());
             for (size_t i = 0; i < args.size(); i++) {
                 args[i] = mutate(op->args[i]);
             }
-            // Grab the body
-            Expr body = qualify(func.name() + ".", func.values()[op->value_index]);
+
+            // Grab the body, with any calls in it to the other
+            // functions being inlined also inlined. This doesn't
+            // depend on the call site, so it's only done once.
+            pair<string, int> key(func.name(), op->value_index);
+            map<pair<string, int>, Expr>::iterator cached = bodies.find(key);
+            Expr body;
+            if (cached != bodies.end()) {
+                body = cached->second;
+            } else {
+                body = mutate(qualify(func.name() + ".", func.values()[op->value_index]));
+                bodies[key] = body;
+            }
 
             // Bind the args using Let nodes
             assert(args.size() == func.args().size());
@@ -126,8 +145,16 @@ class Inliner : public IRMutator {
 public:
     bool found;
 
-    Inliner(Function f) : func(f), found(false) {
-        check(func);
+    Inliner(Function f) : found(false) {
+        check(f);
+        funcs[f.name()] = f;
+    }
+
+    Inliner(const vector<Function> &fs) : found(false) {
+        for (size_t i = 0; i < fs.size(); i++) {
+            check(fs[i]);
+            funcs[fs[i].name()] = fs[i];
+        }
     }
 
 };
@@ -138,6 +165,12 @@ Stmt inline_function(Stmt s, Function f) {
     return s;
 }
 
+Stmt inline_functions(Stmt s, const vector<Function> &funcs) {
+    Inliner i(funcs);
+    s = i.mutate(s);
+    return s;
+}
+
 Expr inline_function(Expr e, Function f) {
     Inliner i(f);
     e = i.mutate(e);
@@ -4,6 +4,8 @@
 
 #include "IR.h"
 
+#include <vector>
+
 /** \file
  * Methods for replacing calls to functions with their definitions.
  */
@@ -17,6 +19,13 @@ Stmt inline_function(Stmt, Function);
 Expr inline_function(Expr, Function);
 // @}
 
+/** Inline several pure functions at once. Calls to any of them that
+ * inlining the others introduces are inlined too, so this is the same
+ * as inlining them one at a time with consumers first, but it walks
+ * the statement once, and inlines the definition of each function
+ * once. */
+Stmt inline_functions(Stmt, const std::vector<Function> &);
+
 }
 }
 
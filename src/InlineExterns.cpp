@@ -0,0 +1,100 @@
+#include "InlineExterns.h"
+#include "IRMutator.h"
+#include "Util.h"
+#include "IRPrinter.h"
+#include "Debug.h"
+
+#include <fstream>
+#include <sstream>
+#include <map>
+
+namespace Halide {
+
+using std::string;
+using std::vector;
+using std::map;
+
+namespace {
+
+map<string, ExternBody> &extern_bodies() {
+    static map<string, ExternBody> bodies;
+    return bodies;
+}
+
+vector<string> &bitcode_files() {
+    static vector<string> contents;
+    return contents;
+}
+
+}
+
+void define_extern_body(const string &name, ExternBody body) {
+    assert(body && "define_extern_body needs a body");
+    extern_bodies()[name] = body;
+}
+
+void add_extern_bitcode(const string &filename) {
+    std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!file) {
+        std::cerr << "Could not open bitcode file " << filename << "\n";
+        assert(false);
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    bitcode_files().push_back(contents.str());
+}
+
+namespace Internal {
+
+namespace {
+
+class InlineExternBodies : public IRMutator {
+    using IRMutator::visit;
+
+    void visit(const Call *op) {
+        map<string, ExternBody>::const_iterator iter;
+        if (op->call_type != Call::Extern ||
+            (iter = extern_bodies().find(op->name)) == extern_bodies().end()) {
+            IRMutator::visit(op);
+            return;
+        }
+
+        // Bind the args to lets, so that a body that uses an arg
+        // more than once doesn't compute it more than once.
+        vector<Expr> args(op->args.size());
+        vector<string> names(op->args.size());
+        for (size_t i = 0; i < args.size(); i++) {
+            names[i] = unique_name('a');
+            args[i] = Variable::make(op->args[i].type(), names[i]);
+        }
+
+        Expr body = iter->second(args);
+        if (!body.defined() || body.type() != op->type) {
+            std::cerr << "The body of extern function " << op->name
+                      << " should have type " << op->type << "\n";
+            assert(false);
+        }
+        // The body may call other externs with bodies.
+        body = mutate(body);
+
+        for (size_t i = args.size(); i > 0; i--) {
+            body = Let::make(names[i-1], mutate(op->args[i-1]), body);
+        }
+        debug(3) << "Inlined the body of " << op->name << ": " << body << "\n";
+        expr = body;
+    }
+};
+
+}
+
+Stmt inline_extern_bodies(Stmt s) {
+    if (extern_bodies().empty()) return s;
+    return InlineExternBodies().mutate(s);
+}
+
+const vector<string> &extern_bitcode() {
+    return bitcode_files();
+}
+
+}
+}
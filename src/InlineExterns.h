@@ -0,0 +1,50 @@
+#ifndef HALIDE_INLINE_EXTERNS_H
+#define HALIDE_INLINE_EXTERNS_H
+
+/** \file
+ * Defines ways to give extern functions bodies that the compiler can
+ * see into, so that calls to them in vectorized loops are vectorized
+ * instead of being made once per lane.
+ */
+
+#include "IR.h"
+
+#include <string>
+#include <vector>
+
+namespace Halide {
+
+/** A Halide definition of an extern function. It's given an Expr for
+ * each argument of a call, and returns the Expr the call is replaced
+ * with, which must have the type of the call. */
+typedef Expr (*ExternBody)(const std::vector<Expr> &args);
+
+/** Give the extern function with the given name a body in Halide.
+ * From then on, calls to it (e.g. through the HalideExtern macros)
+ * are replaced with the body during lowering, so they vectorize and
+ * simplify with the rest of the pipeline. The C function still needs
+ * to exist if pipelines lowered before this call are used. */
+EXPORT void define_extern_body(const std::string &name, ExternBody body);
+
+/** Link the llvm bitcode in the given file (e.g. from clang -O2
+ * -emit-llvm -c) into every module compiled from now on, with every
+ * function it defines marked always-inline. Calls to the extern
+ * functions it defines are then inlined, and a vector version of a
+ * function foo of width N, named fooxN, is used for vector calls, as
+ * for the helpers in the runtime's .ll modules. The bitcode should be
+ * compiled for the same target as the pipelines. */
+EXPORT void add_extern_bitcode(const std::string &filename);
+
+namespace Internal {
+
+/** Replace calls to extern functions that have a body from
+ * define_extern_body with the body. */
+Stmt inline_extern_bodies(Stmt s);
+
+/** The contents of the files passed to add_extern_bitcode. */
+const std::vector<std::string> &extern_bitcode();
+
+}
+}
+
+#endif
@@ -3,13 +3,21 @@
 #include "Scope.h"
 #include "IROperator.h"
 #include "IRMutator.h"
+#include "Substitute.h"
+#include "Simplify.h"
 #include "Debug.h"
 
+#include <map>
+#include <set>
+
 namespace Halide {
 
 using std::string;
 using std::vector;
 using std::ostringstream;
+using std::pair;
+using std::make_pair;
+using std::map;
 
 namespace Internal {
 
@@ -36,12 +44,7 @@ private:
         internal.push(op->name, 0);
         Expr body = mutate(op->body);
         internal.pop(op->name);
-        if (value.same_as(op->value) &&
-            body.same_as(op->body)) {
-            expr = op;
-        } else {
-            expr = Let::make(op->name, value, body);
-        }
+        expr = rebuild(op, value, body);
     }
 
     void visit(const Variable *v) {
@@ -220,4 +223,169 @@ Tuple argmin(RDom r, Expr e, const std::string &name) {
     return f(v.call_args);
 }
 
+namespace {
+
+// The compare-exchanges of Batcher's odd-even merge sort of n
+// elements, in order. This version works for any n, not just powers
+// of two (see Knuth, TAOCP vol. 3, 5.3.4).
+vector<pair<int, int> > sorting_network(int n) {
+    vector<pair<int, int> > network;
+    for (int p = 1; p < n; p *= 2) {
+        for (int k = p; k >= 1; k /= 2) {
+            for (int j = k % p; j + k < n; j += 2 * k) {
+                for (int i = 0; i < k && i + j + k < n; i++) {
+                    if ((i + j) / (2 * p) == (i + j + k) / (2 * p)) {
+                        network.push_back(make_pair(i + j, i + j + k));
+                    }
+                }
+            }
+        }
+    }
+    return network;
+}
+
+// Run the values through the network, binding each intermediate
+// value to a let, and return the variables holding the sorted values.
+vector<Expr> apply_network(const vector<Expr> &values, vector<pair<string, Expr> > &lets) {
+    assert(!values.empty() && "Can't sort an empty list of values");
+    Type t = values[0].type();
+    vector<Expr> v;
+    for (size_t i = 0; i < values.size(); i++) {
+        assert(values[i].type() == t && "The values to sort must all have the same type");
+        string name = Internal::unique_name('s');
+        lets.push_back(make_pair(name, values[i]));
+        v.push_back(Internal::Variable::make(t, name));
+    }
+
+    vector<pair<int, int> > network = sorting_network((int)v.size());
+    for (size_t i = 0; i < network.size(); i++) {
+        Expr a = v[network[i].first], b = v[network[i].second];
+        string lo = Internal::unique_name('s'), hi = Internal::unique_name('s');
+        lets.push_back(make_pair(lo, min(a, b)));
+        lets.push_back(make_pair(hi, max(a, b)));
+        v[network[i].first] = Internal::Variable::make(t, lo);
+        v[network[i].second] = Internal::Variable::make(t, hi);
+    }
+    return v;
+}
+
+// Collect the names of the variables an expression uses.
+class CollectVars : public Internal::IRVisitor {
+    using Internal::IRVisitor::visit;
+    void visit(const Internal::Variable *op) {
+        names.insert(op->name);
+    }
+public:
+    std::set<string> names;
+};
+
+// Wrap e in the lets it depends on.
+Expr wrap_lets(Expr e, const vector<pair<string, Expr> > &lets) {
+    CollectVars needed;
+    e.accept(&needed);
+    for (size_t i = lets.size(); i > 0; i--) {
+        if (needed.names.count(lets[i-1].first)) {
+            e = Internal::Let::make(lets[i-1].first, lets[i-1].second, e);
+            lets[i-1].second.accept(&needed);
+        }
+    }
+    return e;
+}
+
+// The value of e at every point of a reduction domain.
+vector<Expr> expand_domain(RDom r, Expr e, const string &name) {
+    Internal::FindFreeVars v(r, name);
+    v.mutate(e);
+    if (!v.rdom.defined()) {
+        std::cerr << "Expression passed to " << name << " must reference a reduction domain\n";
+        assert(false);
+    }
+
+    const vector<Internal::ReductionVariable> &dom = v.rdom.domain().domain();
+    vector<int> mins, extents;
+    int points = 1;
+    for (size_t i = 0; i < dom.size(); i++) {
+        const int *min = Internal::as_const_int(Internal::simplify(dom[i].min));
+        const int *extent = Internal::as_const_int(Internal::simplify(dom[i].extent));
+        if (!min || !extent) {
+            std::cerr << "The reduction domain passed to " << name << " must have constant bounds\n";
+            assert(false);
+        }
+        mins.push_back(*min);
+        extents.push_back(*extent);
+        points *= *extent;
+    }
+    if (points <= 0 || points > 1024) {
+        std::cerr << "The reduction domain passed to " << name
+                  << " must have between 1 and 1024 points, not " << points << "\n";
+        assert(false);
+    }
+
+    vector<Expr> values;
+    for (int p = 0; p < points; p++) {
+        map<string, Expr> replacements;
+        int rest = p;
+        for (size_t i = 0; i < dom.size(); i++) {
+            replacements[dom[i].var] = mins[i] + rest % extents[i];
+            rest /= extents[i];
+        }
+        values.push_back(Internal::substitute(replacements, e));
+    }
+    return values;
+}
+
+}
+
+vector<Expr> sorted(const vector<Expr> &values) {
+    vector<pair<string, Expr> > lets;
+    vector<Expr> v = apply_network(values, lets);
+    for (size_t i = 0; i < v.size(); i++) {
+        v[i] = wrap_lets(v[i], lets);
+    }
+    return v;
+}
+
+Expr kth_smallest(const vector<Expr> &values, int k) {
+    assert(k >= 0 && k < (int)values.size() && "kth_smallest of fewer than k + 1 values");
+    vector<pair<string, Expr> > lets;
+    vector<Expr> v = apply_network(values, lets);
+    return wrap_lets(v[k], lets);
+}
+
+Expr median(const vector<Expr> &values) {
+    return kth_smallest(values, (int)values.size() / 2);
+}
+
+Expr kth_smallest(Expr e, int k, const std::string &name) {
+    return kth_smallest(RDom(), e, k, name);
+}
+
+Expr kth_smallest(RDom r, Expr e, int k, const std::string &name) {
+    return kth_smallest(expand_domain(r, e, name), k);
+}
+
+Expr median(Expr e, const std::string &name) {
+    return median(RDom(), e, name);
+}
+
+Expr median(RDom r, Expr e, const std::string &name) {
+    return median(expand_domain(r, e, name));
+}
+
+vector<Expr> top_k(Expr e, int k, const std::string &name) {
+    return top_k(RDom(), e, k, name);
+}
+
+vector<Expr> top_k(RDom r, Expr e, int k, const std::string &name) {
+    vector<Expr> values = expand_domain(r, e, name);
+    assert(k > 0 && k <= (int)values.size() && "top_k of fewer than k values");
+    vector<pair<string, Expr> > lets;
+    vector<Expr> v = apply_network(values, lets);
+    vector<Expr> result;
+    for (int i = 0; i < k; i++) {
+        result.push_back(wrap_lets(v[v.size() - 1 - i], lets));
+    }
+    return result;
+}
+
 }
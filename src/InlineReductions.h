@@ -67,6 +67,43 @@ EXPORT Tuple argmax(RDom, Expr, const std::string &s = "argmax");
 EXPORT Tuple argmin(RDom, Expr, const std::string &s = "argmin");
 // @}
 
+/** Sort a short list of values of the same type in increasing
+ * order. This is a sorting network (Batcher's odd-even merge sort)
+ * made of mins and maxes, so it has no branches, and vectorizes into
+ * vector min and max instructions. It takes O(n log^2 n) of them. The
+ * results share the intermediate values of the network, so using
+ * several of them costs little more than using one. */
+EXPORT std::vector<Expr> sorted(const std::vector<Expr> &values);
+
+/** The k-th smallest of a short list of values, counting from
+ * zero. Only the parts of the sorting network that \ref sorted would
+ * use that lead to the k-th value are computed. */
+EXPORT Expr kth_smallest(const std::vector<Expr> &values, int k);
+
+/** The median of a short list of values. For an even number of values
+ * this is the larger of the two middle ones. */
+EXPORT Expr median(const std::vector<Expr> &values);
+
+/** Variants of the above over every point of a reduction domain, which
+ * must have constant bounds and contain at most 1024 points. Unlike
+ * the other inline reductions these don't make a new Func: the
+ * expression is evaluated at each point of the domain and fed to a
+ * sorting network, so the result can be used anywhere, e.g. in a 3x3
+ * median filter:
+ \code
+ RDom r(-1, 3, -1, 3);
+ f(x, y) = median(in(x + r.x, y + r.y));
+ \endcode
+ * top_k returns the k largest values, largest first. */
+// @{
+EXPORT Expr kth_smallest(Expr, int k, const std::string &s = "kth_smallest");
+EXPORT Expr kth_smallest(RDom, Expr, int k, const std::string &s = "kth_smallest");
+EXPORT Expr median(Expr, const std::string &s = "median");
+EXPORT Expr median(RDom, Expr, const std::string &s = "median");
+EXPORT std::vector<Expr> top_k(Expr, int k, const std::string &s = "top_k");
+EXPORT std::vector<Expr> top_k(RDom, Expr, int k, const std::string &s = "top_k");
+// @}
+
 }
 
 #endif
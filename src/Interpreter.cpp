@@ -0,0 +1,1048 @@
+#include "Interpreter.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "Scope.h"
+#include "Lerp.h"
+#include "Util.h"
+#include "Debug.h"
+#include "buffer_t.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+
+namespace {
+
+// A value, with one entry per lane. Floats are in f, and everything
+// else, including handles, is in i. Unsigned 64-bit integers are
+// stored as their bit pattern.
+struct Val {
+    Type type;
+    vector<int64_t> i;
+    vector<double> f;
+
+    Val() {}
+    Val(Type t) : type(t) {
+        if (t.is_float()) {
+            f.resize(t.width);
+        } else {
+            i.resize(t.width);
+        }
+    }
+};
+
+bool is_u64(Type t) {
+    return t.is_uint() && t.bits == 64;
+}
+
+// Wrap an integer to the range of a type.
+int64_t wrap(int64_t x, Type t) {
+    if (t.is_handle() || t.bits >= 64) return x;
+    if (t.is_bool()) return x != 0;
+    uint64_t mask = ((uint64_t)1 << t.bits) - 1;
+    uint64_t u = (uint64_t)x & mask;
+    if (t.is_int() && (u >> (t.bits - 1))) {
+        u |= ~mask;
+    }
+    return (int64_t)u;
+}
+
+double round_to(double x, Type t) {
+    return t.bits == 32 ? (double)(float)x : x;
+}
+
+double as_double(const Val &v, int lane) {
+    if (v.type.is_float()) return v.f[lane];
+    if (is_u64(v.type)) return (double)(uint64_t)v.i[lane];
+    return (double)v.i[lane];
+}
+
+int64_t floor_div(int64_t a, int64_t b) {
+    if (b == 0) return 0;
+    int64_t q = a / b;
+    if ((a % b != 0) && ((a < 0) != (b < 0))) q--;
+    return q;
+}
+
+int64_t floor_mod(int64_t a, int64_t b) {
+    if (b == 0) return 0;
+    int64_t r = a % b;
+    if (r != 0 && ((r < 0) != (b < 0))) r += b;
+    return r;
+}
+
+enum BinOp {OpAdd, OpSub, OpMul, OpDiv, OpMod, OpMin, OpMax,
+            OpEQ, OpNE, OpLT, OpLE, OpGT, OpGE, OpAnd, OpOr};
+
+double float_op(BinOp op, double a, double b) {
+    switch (op) {
+    case OpAdd: return a + b;
+    case OpSub: return a - b;
+    case OpMul: return a * b;
+    case OpDiv: return a / b;
+    case OpMod: return a - b * ::floor(a / b);
+    case OpMin: return std::min(a, b);
+    case OpMax: return std::max(a, b);
+    case OpEQ: return a == b;
+    case OpNE: return a != b;
+    case OpLT: return a < b;
+    case OpLE: return a <= b;
+    case OpGT: return a > b;
+    case OpGE: return a >= b;
+    default: return 0;
+    }
+}
+
+// An operation on integers of type t, without wrapping the result.
+int64_t int_op(BinOp op, int64_t a, int64_t b, Type t) {
+    uint64_t ua = (uint64_t)a, ub = (uint64_t)b;
+    if (is_u64(t)) {
+        switch (op) {
+        case OpDiv: return ub ? (int64_t)(ua / ub) : 0;
+        case OpMod: return ub ? (int64_t)(ua % ub) : 0;
+        case OpMin: return (int64_t)std::min(ua, ub);
+        case OpMax: return (int64_t)std::max(ua, ub);
+        case OpLT: return ua < ub;
+        case OpLE: return ua <= ub;
+        case OpGT: return ua > ub;
+        case OpGE: return ua >= ub;
+        default: break;
+        }
+    }
+    switch (op) {
+    // Add, subtract, and multiply through unsigned ints, so that
+    // overflow wraps.
+    case OpAdd: return (int64_t)(ua + ub);
+    case OpSub: return (int64_t)(ua - ub);
+    case OpMul: return (int64_t)(ua * ub);
+    case OpDiv: return floor_div(a, b);
+    case OpMod: return floor_mod(a, b);
+    case OpMin: return std::min(a, b);
+    case OpMax: return std::max(a, b);
+    case OpEQ: return a == b;
+    case OpNE: return a != b;
+    case OpLT: return a < b;
+    case OpLE: return a <= b;
+    case OpGT: return a > b;
+    case OpGE: return a >= b;
+    case OpAnd: return a && b;
+    case OpOr: return a || b;
+    }
+    return 0;
+}
+
+// Halide's math functions on Exprs hide the C ones, so wrap the C
+// ones we need.
+#define MATH_UNARY(f) double math_##f(double x) {return ::f(x);}
+#define MATH_BINARY(f) double math_##f(double x, double y) {return ::f(x, y);}
+MATH_UNARY(sqrt)
+MATH_UNARY(sin)
+MATH_UNARY(cos)
+MATH_UNARY(tan)
+MATH_UNARY(asin)
+MATH_UNARY(acos)
+MATH_UNARY(atan)
+MATH_UNARY(sinh)
+MATH_UNARY(cosh)
+MATH_UNARY(tanh)
+MATH_UNARY(asinh)
+MATH_UNARY(acosh)
+MATH_UNARY(atanh)
+MATH_UNARY(exp)
+MATH_UNARY(log)
+MATH_UNARY(floor)
+MATH_UNARY(ceil)
+MATH_UNARY(trunc)
+MATH_UNARY(fabs)
+MATH_BINARY(pow)
+MATH_BINARY(atan2)
+#undef MATH_UNARY
+#undef MATH_BINARY
+
+// The math library functions that calls to extern functions like
+// sqrt_f32 can be run with.
+typedef double (*UnaryMath)(double);
+typedef double (*BinaryMath)(double, double);
+
+double round_half_even(double x) {
+    double r = ::floor(x + 0.5);
+    if (r - x == 0.5 && ::fmod(r, 2.0) != 0) r -= 1;
+    return r;
+}
+
+double inf_value() {return HUGE_VAL;}
+double neg_inf_value() {return -HUGE_VAL;}
+double nan_value() {return HUGE_VAL - HUGE_VAL;}
+
+struct MathFunctions {
+    map<string, UnaryMath> unary;
+    map<string, BinaryMath> binary;
+    map<string, double (*)()> nullary;
+
+    MathFunctions() {
+        unary["sqrt"] = math_sqrt;
+        unary["sin"] = math_sin;
+        unary["cos"] = math_cos;
+        unary["tan"] = math_tan;
+        unary["asin"] = math_asin;
+        unary["acos"] = math_acos;
+        unary["atan"] = math_atan;
+        unary["sinh"] = math_sinh;
+        unary["cosh"] = math_cosh;
+        unary["tanh"] = math_tanh;
+        unary["asinh"] = math_asinh;
+        unary["acosh"] = math_acosh;
+        unary["atanh"] = math_atanh;
+        unary["exp"] = math_exp;
+        unary["log"] = math_log;
+        unary["floor"] = math_floor;
+        unary["ceil"] = math_ceil;
+        unary["trunc"] = math_trunc;
+        unary["round"] = round_half_even;
+        unary["abs"] = math_fabs;
+        binary["pow"] = math_pow;
+        binary["atan2"] = math_atan2;
+        nullary["inf"] = inf_value;
+        nullary["neg_inf"] = neg_inf_value;
+        nullary["nan"] = nan_value;
+    }
+
+    // Split a name like sqrt_f32 into sqrt and its type.
+    static bool split(const string &name, string *base, int *bits) {
+        if (ends_with(name, "_f32")) {
+            *bits = 32;
+        } else if (ends_with(name, "_f64")) {
+            *bits = 64;
+        } else {
+            return false;
+        }
+        *base = name.substr(0, name.size() - 4);
+        return true;
+    }
+
+    bool has(const string &name, size_t args) const {
+        string base;
+        int bits;
+        if (!split(name, &base, &bits)) return false;
+        switch (args) {
+        case 0: return nullary.count(base) > 0;
+        case 1: return unary.count(base) > 0;
+        case 2: return binary.count(base) > 0;
+        default: return false;
+        }
+    }
+};
+
+const MathFunctions &math_functions() {
+    static MathFunctions m;
+    return m;
+}
+
+bool is_supported_intrinsic(const string &name) {
+    static const string supported[] = {
+        Call::abs, Call::bitwise_and, Call::bitwise_not, Call::bitwise_xor,
+        Call::bitwise_or, Call::shift_left, Call::shift_right, Call::if_then_else,
+        Call::return_second, Call::lerp, Call::popcount, Call::count_leading_zeros,
+        Call::count_trailing_zeros, Call::reinterpret, Call::null_handle,
+        Call::shuffle_vector, Call::interleave_vectors, Call::concat_vectors,
+        Call::vector_reduce_add,
+        Call::vector_reduce_min, Call::vector_reduce_max, Call::address_of,
+        Call::create_buffer_t, Call::rewrite_buffer, Call::extract_buffer_min,
+        Call::extract_buffer_extent, Call::atomic_add, Call::prefetch,
+        Call::nontemporal_store, Call::store_fence, Call::branch_weights,
+        Call::fill_memory
+    };
+    for (size_t i = 0; i < sizeof(supported)/sizeof(supported[0]); i++) {
+        if (name == supported[i]) return true;
+    }
+    return false;
+}
+
+class CanInterpret : public IRVisitor {
+    using IRVisitor::visit;
+
+    void check_type(Type t) {
+        if (t.is_float() && t.bits == 16) result = false;
+    }
+
+    void visit(const Cast *op) {
+        check_type(op->type);
+        check_type(op->value.type());
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Load *op) {
+        check_type(op->type);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Call *op) {
+        if (op->call_type == Call::Intrinsic) {
+            if (!is_supported_intrinsic(op->name)) {
+                debug(2) << "Can't interpret the intrinsic " << op->name << "\n";
+                result = false;
+            }
+        } else if (op->call_type != Call::Extern ||
+                   !math_functions().has(op->name, op->args.size())) {
+            debug(2) << "Can't interpret the call to " << op->name << "\n";
+            result = false;
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Provide *) {result = false;}
+    void visit(const Realize *) {result = false;}
+
+public:
+    bool result;
+    CanInterpret() : result(true) {}
+};
+
+void *handle_of(const Val &v, int lane = 0) {
+    return (void *)(intptr_t)v.i[lane];
+}
+
+// Read and write elements of buffers.
+void read_element(const void *host, int64_t k, Val &v, int lane) {
+    Type t = v.type;
+    if (t.is_float()) {
+        v.f[lane] = (t.bits == 32) ? ((const float *)host)[k] : ((const double *)host)[k];
+    } else if (t.is_handle()) {
+        v.i[lane] = (int64_t)(intptr_t)((void * const *)host)[k];
+    } else if (t.is_int()) {
+        switch (t.bits) {
+        case 8:  v.i[lane] = ((const int8_t *)host)[k]; break;
+        case 16: v.i[lane] = ((const int16_t *)host)[k]; break;
+        case 32: v.i[lane] = ((const int32_t *)host)[k]; break;
+        default: v.i[lane] = ((const int64_t *)host)[k]; break;
+        }
+    } else {
+        switch (t.bits) {
+        case 1:
+        case 8:  v.i[lane] = ((const uint8_t *)host)[k]; break;
+        case 16: v.i[lane] = ((const uint16_t *)host)[k]; break;
+        case 32: v.i[lane] = ((const uint32_t *)host)[k]; break;
+        default: v.i[lane] = (int64_t)((const uint64_t *)host)[k]; break;
+        }
+    }
+}
+
+void write_element(void *host, int64_t k, const Val &v, int lane) {
+    Type t = v.type;
+    if (t.is_float()) {
+        if (t.bits == 32) {
+            ((float *)host)[k] = (float)v.f[lane];
+        } else {
+            ((double *)host)[k] = v.f[lane];
+        }
+    } else if (t.is_handle()) {
+        ((void **)host)[k] = handle_of(v, lane);
+    } else {
+        switch (t.bytes()) {
+        case 1: ((uint8_t *)host)[k] = (uint8_t)v.i[lane]; break;
+        case 2: ((uint16_t *)host)[k] = (uint16_t)v.i[lane]; break;
+        case 4: ((uint32_t *)host)[k] = (uint32_t)v.i[lane]; break;
+        default: ((uint64_t *)host)[k] = (uint64_t)v.i[lane]; break;
+        }
+    }
+}
+
+class Interpreter : public IRVisitor {
+    using IRVisitor::visit;
+
+    Scope<Val> vars;
+
+    // The result of the last expression evaluated.
+    Val value;
+
+    // The buffer_ts made by create_buffer_t, freed at the end.
+    vector<buffer_t *> buffers;
+
+    // The allocations that are live, by name.
+    map<string, void *> allocations;
+
+    void *user_context;
+    void (*error_handler)(void *, const char *);
+
+    Val eval(Expr e) {
+        e.accept(this);
+        return value;
+    }
+
+    void run(Stmt s) {
+        if (s.defined() && !failed) s.accept(this);
+    }
+
+    Val scalar(Type t, int64_t x) {
+        Val v(t);
+        v.i[0] = x;
+        return v;
+    }
+
+    void binary(BinOp op, Expr a, Expr b, Type t) {
+        Val va = eval(a), vb = eval(b);
+        Val result(t);
+        for (int l = 0; l < t.width; l++) {
+            if (va.type.is_float()) {
+                double r = float_op(op, va.f[l], vb.f[l]);
+                if (t.is_float()) {
+                    result.f[l] = round_to(r, t);
+                } else {
+                    result.i[l] = r != 0;
+                }
+            } else {
+                result.i[l] = wrap(int_op(op, va.i[l], vb.i[l], va.type), t);
+            }
+        }
+        value = result;
+    }
+
+    void visit(const IntImm *op) {
+        value = scalar(Int(32), op->value);
+    }
+
+    void visit(const FloatImm *op) {
+        Val v(Float(32));
+        v.f[0] = op->value;
+        value = v;
+    }
+
+    void visit(const Cast *op) {
+        Val v = eval(op->value);
+        Type t = op->type;
+        Val result(t);
+        for (int l = 0; l < t.width; l++) {
+            if (t.is_float()) {
+                result.f[l] = round_to(as_double(v, l), t);
+            } else if (v.type.is_float()) {
+                double x = v.f[l];
+                if (t.is_bool()) {
+                    result.i[l] = x != 0;
+                } else if (is_u64(t)) {
+                    result.i[l] = (int64_t)(uint64_t)x;
+                } else {
+                    result.i[l] = wrap((int64_t)x, t);
+                }
+            } else {
+                result.i[l] = wrap(v.i[l], t);
+            }
+        }
+        value = result;
+    }
+
+    void visit(const Variable *op) {
+        value = vars.get(op->name);
+    }
+
+    void visit(const Add *op) {binary(OpAdd, op->a, op->b, op->type);}
+    void visit(const Sub *op) {binary(OpSub, op->a, op->b, op->type);}
+    void visit(const Mul *op) {binary(OpMul, op->a, op->b, op->type);}
+    void visit(const Div *op) {binary(OpDiv, op->a, op->b, op->type);}
+    void visit(const Mod *op) {binary(OpMod, op->a, op->b, op->type);}
+    void visit(const Min *op) {binary(OpMin, op->a, op->b, op->type);}
+    void visit(const Max *op) {binary(OpMax, op->a, op->b, op->type);}
+    void visit(const EQ *op) {binary(OpEQ, op->a, op->b, op->type);}
+    void visit(const NE *op) {binary(OpNE, op->a, op->b, op->type);}
+    void visit(const LT *op) {binary(OpLT, op->a, op->b, op->type);}
+    void visit(const LE *op) {binary(OpLE, op->a, op->b, op->type);}
+    void visit(const GT *op) {binary(OpGT, op->a, op->b, op->type);}
+    void visit(const GE *op) {binary(OpGE, op->a, op->b, op->type);}
+    void visit(const And *op) {binary(OpAnd, op->a, op->b, op->type);}
+    void visit(const Or *op) {binary(OpOr, op->a, op->b, op->type);}
+
+    void visit(const Not *op) {
+        Val v = eval(op->a);
+        for (size_t l = 0; l < v.i.size(); l++) {
+            v.i[l] = !v.i[l];
+        }
+        value = v;
+    }
+
+    void visit(const Select *op) {
+        Val c = eval(op->condition);
+        if (c.type.is_scalar()) {
+            // Only evaluate the side that's used.
+            value = eval(c.i[0] ? op->true_value : op->false_value);
+            return;
+        }
+        Val t = eval(op->true_value), f = eval(op->false_value);
+        Val result(op->type);
+        for (int l = 0; l < op->type.width; l++) {
+            const Val &side = c.i[l] ? t : f;
+            if (op->type.is_float()) {
+                result.f[l] = side.f[l];
+            } else {
+                result.i[l] = side.i[l];
+            }
+        }
+        value = result;
+    }
+
+    void visit(const Load *op) {
+        const void *host = handle_of(vars.get(op->name + ".host"));
+        Val idx = eval(op->index);
+        Val pred;
+        if (op->predicate.defined()) pred = eval(op->predicate);
+        Val result(op->type);
+        for (int l = 0; l < op->type.width; l++) {
+            if (op->predicate.defined() && !pred.i[l]) continue;
+            read_element(host, idx.i[l], result, l);
+        }
+        value = result;
+    }
+
+    void visit(const Ramp *op) {
+        Val base = eval(op->base), stride = eval(op->stride);
+        Type t = op->type;
+        Val result(t);
+        for (int l = 0; l < op->width; l++) {
+            if (t.is_float()) {
+                result.f[l] = round_to(base.f[0] + l * stride.f[0], t);
+            } else {
+                result.i[l] = wrap(base.i[0] + l * stride.i[0], t);
+            }
+        }
+        value = result;
+    }
+
+    void visit(const Broadcast *op) {
+        Val v = eval(op->value);
+        Val result(op->type);
+        for (int l = 0; l < op->width; l++) {
+            if (op->type.is_float()) {
+                result.f[l] = v.f[0];
+            } else {
+                result.i[l] = v.i[0];
+            }
+        }
+        value = result;
+    }
+
+    void visit(const Let *op) {
+        vars.push(op->name, eval(op->value));
+        value = eval(op->body);
+        vars.pop(op->name);
+    }
+
+    void visit(const Call *op);
+
+    void visit(const LetStmt *op) {
+        vars.push(op->name, eval(op->value));
+        run(op->body);
+        vars.pop(op->name);
+    }
+
+    void visit(const AssertStmt *op) {
+        Val c = eval(op->condition);
+        bool ok = true;
+        for (size_t l = 0; l < c.i.size(); l++) {
+            ok = ok && c.i[l];
+        }
+        if (ok) return;
+
+        vector<Val> args(op->args.size());
+        for (size_t i = 0; i < args.size(); i++) {
+            args[i] = eval(op->args[i]);
+        }
+        string msg = format_message(op->message, args);
+        if (error_handler) {
+            error_handler(user_context, msg.c_str());
+        } else {
+            std::cerr << "Error: " << msg << "\n";
+        }
+        failed = true;
+    }
+
+    // Fill in the printf-style message of an assertion.
+    string format_message(const string &fmt, const vector<Val> &args) {
+        string result;
+        size_t next_arg = 0;
+        for (size_t i = 0; i < fmt.size(); i++) {
+            if (fmt[i] != '%' || i + 1 == fmt.size()) {
+                result += fmt[i];
+                continue;
+            }
+            if (fmt[i+1] == '%') {
+                result += '%';
+                i++;
+                continue;
+            }
+            size_t end = i + 1;
+            while (end < fmt.size() && !isalpha(fmt[end])) end++;
+            while (end < fmt.size() && (fmt[end] == 'l' || fmt[end] == 'h')) end++;
+            string spec = fmt.substr(i, end - i + 1);
+            char buf[256];
+            if (next_arg >= args.size()) {
+                result += spec;
+            } else {
+                const Val &v = args[next_arg++];
+                if (v.type.is_float()) {
+                    snprintf(buf, sizeof(buf), spec.c_str(), v.f[0]);
+                } else if (v.type.is_handle()) {
+                    snprintf(buf, sizeof(buf), "%p", handle_of(v));
+                } else {
+                    snprintf(buf, sizeof(buf), "%lld", (long long)v.i[0]);
+                }
+                result += buf;
+            }
+            i = end;
+        }
+        return result;
+    }
+
+    void visit(const Pipeline *op) {
+        run(op->produce);
+        run(op->update);
+        run(op->consume);
+    }
+
+    void visit(const For *op) {
+        // Everything runs serially, including parallel loops.
+        int64_t min = eval(op->min).i[0];
+        int64_t extent = eval(op->extent).i[0];
+        vars.push(op->name, scalar(Int(32), min));
+        for (int64_t i = min; i < min + extent && !failed; i++) {
+            vars.ref(op->name).i[0] = i;
+            run(op->body);
+        }
+        vars.pop(op->name);
+    }
+
+    void visit(const Store *op) {
+        void *host = handle_of(vars.get(op->name + ".host"));
+        Val v = eval(op->value);
+        Val idx = eval(op->index);
+        Val pred;
+        if (op->predicate.defined()) pred = eval(op->predicate);
+        // Bools are stored as bytes.
+        if (v.type.is_bool()) v.type = UInt(8, v.type.width);
+        for (int l = 0; l < op->value.type().width; l++) {
+            if (op->predicate.defined() && !pred.i[l]) continue;
+            write_element(host, idx.i[l], v, l);
+        }
+    }
+
+    void visit(const Allocate *op) {
+        int64_t size = op->type.bytes();
+        for (size_t i = 0; i < op->extents.size(); i++) {
+            size *= eval(op->extents[i]).i[0];
+        }
+        // Pad the allocation like the runtime's allocator does, in
+        // case vector code reads past the end.
+        void *host = calloc((size_t)size + 64, 1);
+        assert(host && "Interpreter ran out of memory");
+        allocations[op->name] = host;
+
+        vars.push(op->name + ".host", scalar(Handle(), (int64_t)(intptr_t)host));
+        run(op->body);
+        vars.pop(op->name + ".host");
+
+        if (allocations.count(op->name)) {
+            free(allocations[op->name]);
+            allocations.erase(op->name);
+        }
+    }
+
+    void visit(const Free *op) {
+        if (allocations.count(op->name)) {
+            free(allocations[op->name]);
+            allocations.erase(op->name);
+        }
+    }
+
+    void visit(const Block *op) {
+        run(op->first);
+        run(op->rest);
+    }
+
+    void visit(const IfThenElse *op) {
+        if (eval(op->condition).i[0]) {
+            run(op->then_case);
+        } else {
+            run(op->else_case);
+        }
+    }
+
+    void visit(const Evaluate *op) {
+        eval(op->value);
+    }
+
+public:
+    bool failed;
+
+    Interpreter(void *uc, void (*handler)(void *, const char *)) :
+        user_context(uc), error_handler(handler), failed(false) {}
+
+    ~Interpreter() {
+        for (size_t i = 0; i < buffers.size(); i++) {
+            delete buffers[i];
+        }
+        for (map<string, void *>::iterator iter = allocations.begin();
+             iter != allocations.end(); ++iter) {
+            free(iter->second);
+        }
+    }
+
+    // Bind an argument the way codegen unpacks it.
+    void bind(const Argument &arg, const void *value) {
+        if (!arg.is_buffer) {
+            Val v(arg.type);
+            read_element(value, 0, v, 0);
+            vars.push(arg.name, v);
+            return;
+        }
+
+        const buffer_t *b = (const buffer_t *)value;
+        const string &n = arg.name;
+        vars.push(n + ".buffer", scalar(Handle(), (int64_t)(intptr_t)b));
+        vars.push(n + ".host", scalar(Handle(), (int64_t)(intptr_t)b->host));
+        vars.push(n + ".dev", scalar(UInt(64), (int64_t)b->dev));
+        vars.push(n + ".host_and_dev_are_null", scalar(Bool(), !b->host && !b->dev));
+        vars.push(n + ".host_dirty", scalar(Bool(), b->host_dirty));
+        vars.push(n + ".dev_dirty", scalar(Bool(), b->dev_dirty));
+        for (int i = 0; i < 4; i++) {
+            string d = int_to_string(i);
+            vars.push(n + ".extent." + d, scalar(Int(32), b->extent[i]));
+            vars.push(n + ".stride." + d, scalar(Int(32), b->stride[i]));
+            vars.push(n + ".min." + d, scalar(Int(32), b->min[i]));
+        }
+        vars.push(n + ".elem_size", scalar(Int(32), b->elem_size));
+    }
+
+    void execute(Stmt s) {
+        run(s);
+    }
+};
+
+void Interpreter::visit(const Call *op) {
+    Type t = op->type;
+
+    if (op->call_type == Call::Extern) {
+        string base;
+        int bits;
+        MathFunctions::split(op->name, &base, &bits);
+        const MathFunctions &m = math_functions();
+        vector<Val> args(op->args.size());
+        for (size_t i = 0; i < args.size(); i++) {
+            args[i] = eval(op->args[i]);
+        }
+        Val result(t);
+        for (int l = 0; l < t.width; l++) {
+            double r;
+            if (args.size() == 0) {
+                r = m.nullary.find(base)->second();
+            } else if (args.size() == 1) {
+                r = m.unary.find(base)->second(as_double(args[0], l));
+            } else {
+                r = m.binary.find(base)->second(as_double(args[0], l), as_double(args[1], l));
+            }
+            result.f[l] = round_to(r, t);
+        }
+        value = result;
+        return;
+    }
+
+    assert(op->call_type == Call::Intrinsic && "Can only interpret extern calls and intrinsics");
+
+    if (op->name == Call::if_then_else) {
+        Val c = eval(op->args[0]);
+        if (c.type.is_scalar()) {
+            if (c.i[0]) {
+                value = eval(op->args[1]);
+            } else if (op->args.size() > 2) {
+                value = eval(op->args[2]);
+            } else {
+                value = Val(t);
+            }
+            return;
+        }
+        Expr f = op->args.size() > 2 ? op->args[2] : make_zero(t);
+        value = eval(Select::make(op->args[0], op->args[1], f));
+        return;
+    } else if (op->name == Call::branch_weights) {
+        value = eval(op->args[0]);
+        return;
+    } else if (op->name == Call::return_second) {
+        eval(op->args[0]);
+        value = eval(op->args[1]);
+        return;
+    } else if (op->name == Call::lerp) {
+        value = eval(lower_lerp(op->args[0], op->args[1], op->args[2]));
+        return;
+    } else if (op->name == Call::null_handle) {
+        value = scalar(Handle(), 0);
+        return;
+    } else if (op->name == Call::prefetch || op->name == Call::store_fence) {
+        value = scalar(Int(32), 0);
+        return;
+    } else if (op->name == Call::nontemporal_store) {
+        const Load *l = op->args[0].as<Load>();
+        assert(l && "The first argument to nontemporal_store must be a load");
+        run(Store::make(l->name, op->args[1], l->index));
+        value = scalar(Int(32), 0);
+        return;
+    } else if (op->name == Call::fill_memory) {
+        void *host = handle_of(eval(op->args[0]));
+        int byte = (int)eval(op->args[1]).i[0];
+        memset(host, byte, (size_t)eval(op->args[2]).i[0]);
+        value = scalar(Int(32), 0);
+        return;
+    } else if (op->name == Call::address_of) {
+        const Load *l = op->args[0].as<Load>();
+        assert(l && "address_of takes a load");
+        int64_t idx = eval(l->index).i[0];
+        const uint8_t *host = (const uint8_t *)handle_of(vars.get(l->name + ".host"));
+        value = scalar(Handle(), (int64_t)(intptr_t)(host + idx * l->type.bytes()));
+        return;
+    } else if (op->name == Call::atomic_add) {
+        // Loops run serially, so a plain add will do.
+        const Load *l = op->args[0].as<Load>();
+        assert(l && "The first argument to atomic_add must be a load");
+        Val old = eval(op->args[0]);
+        Val v = eval(op->args[1]);
+        int64_t idx = eval(l->index).i[0];
+        void *host = handle_of(vars.get(l->name + ".host"));
+        Val sum(l->type);
+        if (sum.type.is_float()) {
+            sum.f[0] = round_to(old.f[0] + v.f[0], sum.type);
+        } else {
+            sum.i[0] = wrap(old.i[0] + v.i[0], sum.type);
+        }
+        write_element(host, idx, sum, 0);
+        value = old;
+        return;
+    } else if (op->name == Call::create_buffer_t) {
+        buffer_t *b = new buffer_t;
+        memset(b, 0, sizeof(buffer_t));
+        buffers.push_back(b);
+        b->host = (uint8_t *)handle_of(eval(op->args[0]));
+        b->elem_size = (int32_t)eval(op->args[1]).i[0];
+        int dims = (int)op->args.size() / 3;
+        for (int i = 0; i < dims; i++) {
+            b->min[i] = (int32_t)eval(op->args[i*3+2]).i[0];
+            b->extent[i] = (int32_t)eval(op->args[i*3+3]).i[0];
+            b->stride[i] = (int32_t)eval(op->args[i*3+4]).i[0];
+        }
+        value = scalar(Handle(), (int64_t)(intptr_t)b);
+        return;
+    } else if (op->name == Call::rewrite_buffer) {
+        buffer_t *b = (buffer_t *)handle_of(eval(op->args[0]));
+        int dims = ((int)op->args.size() - 2) / 3;
+        b->elem_size = (int32_t)eval(op->args[1]).i[0];
+        for (int i = 0; i < 4; i++) {
+            b->min[i] = i < dims ? (int32_t)eval(op->args[i*3+2]).i[0] : 0;
+            b->extent[i] = i < dims ? (int32_t)eval(op->args[i*3+3]).i[0] : 0;
+            b->stride[i] = i < dims ? (int32_t)eval(op->args[i*3+4]).i[0] : 0;
+        }
+        value = scalar(Bool(), 1);
+        return;
+    } else if (op->name == Call::extract_buffer_min ||
+               op->name == Call::extract_buffer_extent) {
+        const buffer_t *b = (const buffer_t *)handle_of(eval(op->args[0]));
+        int d = (int)eval(op->args[1]).i[0];
+        value = scalar(Int(32), op->name == Call::extract_buffer_min ? b->min[d] : b->extent[d]);
+        return;
+    }
+
+    vector<Val> args(op->args.size());
+    for (size_t i = 0; i < args.size(); i++) {
+        args[i] = eval(op->args[i]);
+    }
+    Val result(t);
+
+    if (op->name == Call::shuffle_vector) {
+        for (int l = 0; l < t.width; l++) {
+            int k = (int)args[l+1].i[0];
+            if (t.is_float()) {
+                result.f[l] = args[0].f[k];
+            } else {
+                result.i[l] = args[0].i[k];
+            }
+        }
+    } else if (op->name == Call::interleave_vectors) {
+        int n = (int)args.size();
+        for (int l = 0; l < t.width; l++) {
+            const Val &src = args[l % n];
+            if (t.is_float()) {
+                result.f[l] = src.f[l / n];
+            } else {
+                result.i[l] = src.i[l / n];
+            }
+        }
+    } else if (op->name == Call::concat_vectors) {
+        int l = 0;
+        for (size_t i = 0; i < args.size(); i++) {
+            for (int j = 0; j < args[i].type.width; j++, l++) {
+                if (t.is_float()) {
+                    result.f[l] = args[i].f[j];
+                } else {
+                    result.i[l] = args[i].i[j];
+                }
+            }
+        }
+    } else if (op->name == Call::vector_reduce_add ||
+               op->name == Call::vector_reduce_min ||
+               op->name == Call::vector_reduce_max) {
+        BinOp reduce = (op->name == Call::vector_reduce_add ? OpAdd :
+                        op->name == Call::vector_reduce_min ? OpMin : OpMax);
+        int factor = args[0].type.width / t.width;
+        for (int l = 0; l < t.width; l++) {
+            for (int j = 0; j < factor; j++) {
+                int k = l * factor + j;
+                if (t.is_float()) {
+                    result.f[l] = j ? round_to(float_op(reduce, result.f[l], args[0].f[k]), t) : args[0].f[k];
+                } else {
+                    result.i[l] = j ? wrap(int_op(reduce, result.i[l], args[0].i[k], t), t) : args[0].i[k];
+                }
+            }
+        }
+    } else if (op->name == Call::reinterpret) {
+        const Val &a = args[0];
+        for (int l = 0; l < t.width; l++) {
+            uint64_t bits = 0;
+            if (a.type.is_float() && a.type.bits == 32) {
+                float f = (float)a.f[l];
+                uint32_t b;
+                memcpy(&b, &f, 4);
+                bits = b;
+            } else if (a.type.is_float()) {
+                memcpy(&bits, &a.f[l], 8);
+            } else {
+                bits = (uint64_t)a.i[l];
+            }
+            if (t.is_float() && t.bits == 32) {
+                uint32_t b = (uint32_t)bits;
+                float f;
+                memcpy(&f, &b, 4);
+                result.f[l] = f;
+            } else if (t.is_float()) {
+                memcpy(&result.f[l], &bits, 8);
+            } else {
+                result.i[l] = wrap((int64_t)bits, t);
+            }
+        }
+    } else {
+        // The rest are elementwise operations on integers.
+        for (int l = 0; l < t.width; l++) {
+            int64_t a = args[0].i[l];
+            Type at = args[0].type;
+            uint64_t ua = (uint64_t)wrap(a, UInt(at.bits));
+            int64_t r = 0;
+            if (op->name == Call::abs) {
+                if (at.is_float()) {
+                    result.f[l] = ::fabs(args[0].f[l]);
+                    continue;
+                }
+                r = a < 0 ? -a : a;
+            } else if (op->name == Call::bitwise_not) {
+                r = ~a;
+            } else if (op->name == Call::bitwise_and) {
+                r = a & args[1].i[l];
+            } else if (op->name == Call::bitwise_or) {
+                r = a | args[1].i[l];
+            } else if (op->name == Call::bitwise_xor) {
+                r = a ^ args[1].i[l];
+            } else if (op->name == Call::shift_left) {
+                r = (int64_t)(ua << args[1].i[l]);
+            } else if (op->name == Call::shift_right) {
+                r = at.is_int() ? (a >> args[1].i[l]) : (int64_t)(ua >> args[1].i[l]);
+            } else if (op->name == Call::popcount) {
+                for (int b = 0; b < at.bits; b++) r += (ua >> b) & 1;
+            } else if (op->name == Call::count_leading_zeros) {
+                while (r < at.bits && !((ua >> (at.bits - 1 - r)) & 1)) r++;
+            } else if (op->name == Call::count_trailing_zeros) {
+                while (r < at.bits && !((ua >> r) & 1)) r++;
+            } else {
+                std::cerr << "Can't interpret intrinsic " << op->name << "\n";
+                assert(false);
+            }
+            result.i[l] = wrap(r, t);
+        }
+    }
+    value = result;
+}
+
+}
+
+bool can_interpret(Stmt s) {
+    CanInterpret check;
+    s.accept(&check);
+    return check.result;
+}
+
+int interpret(Stmt s, const vector<Argument> &args,
+              const vector<const void *> &arg_values,
+              void (*error_handler)(void *, const char *)) {
+    assert(args.size() == arg_values.size());
+    void *user_context = NULL;
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i].name == "__user_context") {
+            user_context = *(void * const *)arg_values[i];
+        }
+    }
+
+    Interpreter interpreter(user_context, error_handler);
+    for (size_t i = 0; i < args.size(); i++) {
+        interpreter.bind(args[i], arg_values[i]);
+    }
+    interpreter.execute(s);
+    return interpreter.failed ? -1 : 0;
+}
+
+void interpreter_test() {
+    // out[x] = select(x < 3, x*x, (x - 10) / 4), with one store of
+    // a vector of four in the middle, and an allocation of a bool.
+    int32_t out[8] = {0};
+    buffer_t buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.host = (uint8_t *)out;
+    buf.extent[0] = 8;
+    buf.stride[0] = 1;
+    buf.elem_size = 4;
+
+    Expr x = Variable::make(Int(32), "x");
+    Expr value = Select::make(x < 3, x * x, (x - 10) / 4);
+    Stmt scalar_loop = For::make("x", 0, 8, For::Serial, Store::make("out", value, x));
+    Expr ramp = Ramp::make(2, 1, 4);
+    Expr vector_value = Cast::make(Int(32, 4), Cast::make(Float(32, 4), ramp) * 0.5f);
+    Stmt vector_store = Store::make("out", vector_value + 100, ramp);
+    Stmt s = Block::make(scalar_loop, vector_store);
+
+    vector<Argument> args;
+    args.push_back(Argument("out", true, Int(32)));
+    vector<const void *> values;
+    values.push_back(&buf);
+    int status = interpret(s, args, values, NULL);
+    assert(status == 0 && "Interpreter test failed: status");
+
+    int correct[8] = {0, 1, 4, -2, -2, -2, -1, -1};
+    for (int i = 2; i < 6; i++) correct[i] = (int)(i * 0.5f) + 100;
+    for (int i = 0; i < 8; i++) {
+        if (out[i] != correct[i]) {
+            std::cerr << "Interpreter test failed: out[" << i << "] = "
+                      << out[i] << " instead of " << correct[i] << "\n";
+            assert(false);
+        }
+    }
+
+    // A failed assertion is an error.
+    Stmt check = AssertStmt::make(x > 3, "x is %d", vec<Expr>(x));
+    s = LetStmt::make("x", 2, check);
+    assert(interpret(s, vector<Argument>(), vector<const void *>(), NULL) == -1 &&
+           "Interpreter test failed: assertion");
+
+    std::cout << "Interpreter test passed" << std::endl;
+}
+
+}
+}
@@ -0,0 +1,37 @@
+#ifndef HALIDE_INTERPRETER_H
+#define HALIDE_INTERPRETER_H
+
+/** \file
+ * Defines an interpreter for lowered statements, for running small
+ * pipelines without waiting for llvm to compile them.
+ */
+
+#include "IR.h"
+#include "Argument.h"
+
+#include <vector>
+
+namespace Halide {
+namespace Internal {
+
+/** Can interpret run a lowered statement. It can't if the statement
+ * calls extern functions other than the math library, or needs the
+ * runtime, e.g. for tracing, profiling, gpus, or random numbers. */
+bool can_interpret(Stmt s);
+
+/** Run a lowered statement directly. The arguments are passed as to
+ * the jit wrapper function: a pointer to the value of each argument,
+ * with a buffer_t pointer for each buffer. Failed assertions are
+ * reported to the error handler, or printed if it's NULL. Returns
+ * the exit status, which is zero on success. All loops run serially,
+ * and vector code runs a lane at a time. */
+int interpret(Stmt s, const std::vector<Argument> &args,
+              const std::vector<const void *> &arg_values,
+              void (*error_handler)(void *, const char *));
+
+EXPORT void interpreter_test();
+
+}
+}
+
+#endif
@@ -14,13 +14,21 @@
 namespace Halide {
 namespace Internal {
 
-/** A class representing a reference count to be used with IntrusivePtr */
+/** A class representing a reference count to be used with
+ * IntrusivePtr. The count is atomic where the compiler makes that
+ * easy, so that IR may be shared between threads (see
+ * compile_batch_to_file). */
 class RefCount {
-    int count;
+    volatile int count;
 public:
     RefCount() : count(0) {}
+#ifdef __GNUC__
+    void increment() {__sync_add_and_fetch(&count, 1);}
+    int decrement() {return __sync_sub_and_fetch(&count, 1);}
+#else
     void increment() {count++;}
-    void decrement() {count--;}
+    int decrement() {return --count;}
+#endif
     bool is_zero() const {return count == 0;}
 };
 
@@ -64,8 +72,7 @@ private:
 
     void decref(T *p) {
         if (p) {
-            ref_count(p).decrement();
-            if (ref_count(p).is_zero()) {
+            if (ref_count(p).decrement() == 0) {
                 //std::cout << "Destroying " << ptr << ", " << live_objects << "\n";
                 destroy(p);
             }
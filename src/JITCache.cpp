@@ -0,0 +1,284 @@
+#include "JITCache.h"
+#include "IRPrinter.h"
+#include "IRVisitor.h"
+#include "Debug.h"
+#include "Util.h"
+
+#include <stdlib.h>
+#include <sstream>
+#include <map>
+#include <algorithm>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+using std::ostringstream;
+
+namespace {
+
+// Print a statement in a form that captures everything the compiled
+// code depends on. The regular printer drops the types of variables,
+// loads, and calls, and rounds floating point constants.
+class CacheKeyPrinter : public IRPrinter {
+    using IRPrinter::visit;
+
+    void visit(const FloatImm *op) {
+        uint32_t bits = reinterpret_bits<uint32_t>(op->value);
+        stream << "float(0x" << std::hex << bits << std::dec << ")";
+    }
+
+    void visit(const Variable *op) {
+        stream << op->name << ':' << op->type;
+    }
+
+    void visit(const Load *op) {
+        stream << op->type << ' ';
+        IRPrinter::visit(op);
+    }
+
+    void visit(const Call *op) {
+        stream << op->type << ' ' << (int)op->call_type << ' ';
+        IRPrinter::visit(op);
+    }
+
+public:
+    CacheKeyPrinter(std::ostream &s) : IRPrinter(s) {}
+};
+
+// Collect the first component of the name of everything defined in a
+// statement, in the order they are found.
+class FindNames : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Let *op) {
+        add(op->name);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const LetStmt *op) {
+        add(op->name);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const For *op) {
+        add(op->name);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Allocate *op) {
+        add(op->name);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Pipeline *op) {
+        add(op->name);
+        IRVisitor::visit(op);
+    }
+
+public:
+    map<string, int> roots;
+
+    void add(const string &name) {
+        string root = name.substr(0, name.find('.'));
+        if (roots.find(root) == roots.end()) {
+            roots[root] = 0;
+        }
+    }
+};
+
+bool is_name_char(char c) {
+    return ((c >= 'a' && c <= 'z') ||
+            (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9') ||
+            c == '_' || c == '$');
+}
+
+// Replace each name in the set of roots with a number in order of
+// first appearance.
+string canonicalize_names(const string &text, map<string, int> &roots) {
+    string result;
+    result.reserve(text.size());
+    int next = 1;
+    size_t i = 0;
+    while (i < text.size()) {
+        if (!is_name_char(text[i])) {
+            result += text[i++];
+            continue;
+        }
+        size_t j = i;
+        while (j < text.size() && is_name_char(text[j])) j++;
+        string token = text.substr(i, j - i);
+        map<string, int>::iterator iter = roots.find(token);
+        if (iter == roots.end()) {
+            result += token;
+        } else {
+            if (iter->second == 0) {
+                iter->second = next++;
+            }
+            // '#' can't appear in names, so this can't collide.
+            result += '#' + int_to_string(iter->second);
+        }
+        i = j;
+    }
+    return result;
+}
+
+bool jit_cache_enabled() {
+    static int enabled = -1;
+    if (enabled < 0) {
+        char *env = getenv("HL_JIT_CACHE");
+        enabled = (env && atoi(env) == 0) ? 0 : 1;
+    }
+    return enabled != 0;
+}
+
+string &jit_cache_dir() {
+    static string *dir = NULL;
+    if (!dir) {
+        char *env = getenv("HL_JIT_CACHE_DIR");
+        dir = new string(env ? env : "");
+    }
+    return *dir;
+}
+
+int &jit_cache_capacity() {
+    static int capacity = -1;
+    if (capacity < 0) {
+        char *env = getenv("HL_JIT_CACHE_SIZE");
+        capacity = env ? std::max(atoi(env), 0) : 0;
+    }
+    return capacity;
+}
+
+struct CacheEntry {
+    JITCompiledModule module;
+    // When it was last looked up or stored, in lookups and stores.
+    uint64_t last_use;
+};
+
+uint64_t jit_cache_clock = 0;
+
+// Heap-allocated and never destroyed, because tearing down the jit
+// modules during static destruction isn't safe.
+map<string, CacheEntry> &jit_cache() {
+    static map<string, CacheEntry> *cache = new map<string, CacheEntry>;
+    return *cache;
+}
+
+// Forget the least recently used modules until there are at most
+// capacity. The cache is small enough to scan when it's full.
+void jit_cache_evict(size_t capacity) {
+    while (jit_cache().size() > capacity) {
+        map<string, CacheEntry>::iterator oldest = jit_cache().begin();
+        for (map<string, CacheEntry>::iterator iter = jit_cache().begin();
+             iter != jit_cache().end(); ++iter) {
+            if (iter->second.last_use < oldest->second.last_use) {
+                oldest = iter;
+            }
+        }
+        debug(2) << "Evicting a module from the JIT cache\n";
+        jit_cache().erase(oldest);
+    }
+}
+
+}
+
+string jit_cache_key(Stmt s, const Target &t, const vector<Argument> &args) {
+    FindNames names;
+    for (size_t i = 0; i < args.size(); i++) {
+        names.add(args[i].name);
+    }
+    s.accept(&names);
+
+    ostringstream key;
+    key << t.to_string() << '\n';
+    for (size_t i = 0; i < args.size(); i++) {
+        key << args[i].name << ' ' << args[i].is_buffer << ' ' << args[i].type << '\n';
+    }
+    CacheKeyPrinter printer(key);
+    printer.print(s);
+
+    return canonicalize_names(key.str(), names.roots);
+}
+
+uint64_t jit_cache_hash(const string &key) {
+    // 64-bit FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < key.size(); i++) {
+        h ^= (unsigned char)key[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+bool jit_cache_lookup(const string &key, JITCompiledModule *result) {
+    if (!jit_cache_enabled()) return false;
+    map<string, CacheEntry>::iterator iter = jit_cache().find(key);
+    if (iter == jit_cache().end()) {
+        debug(2) << "JIT cache miss\n";
+        return false;
+    }
+    debug(2) << "JIT cache hit\n";
+    iter->second.last_use = ++jit_cache_clock;
+    *result = iter->second.module;
+    return true;
+}
+
+void jit_cache_store(const string &key, const JITCompiledModule &m) {
+    if (!jit_cache_enabled()) return;
+    int capacity = jit_cache_capacity();
+    if (capacity > 0 && !jit_cache().count(key)) {
+        jit_cache_evict(capacity - 1);
+    }
+    CacheEntry &entry = jit_cache()[key];
+    entry.module = m;
+    entry.last_use = ++jit_cache_clock;
+}
+
+void jit_cache_forget(const JITCompiledModule &m) {
+    map<string, CacheEntry>::iterator iter = jit_cache().begin();
+    while (iter != jit_cache().end()) {
+        if (iter->second.module.module.same_as(m.module)) {
+            jit_cache().erase(iter++);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+int jit_cache_directory_hit_count = 0;
+
+string jit_cache_directory() {
+    return jit_cache_enabled() ? jit_cache_dir() : string();
+}
+
+void jit_cache_directory_hit() {
+    jit_cache_directory_hit_count++;
+}
+
+}
+
+void clear_jit_cache() {
+    Internal::jit_cache().clear();
+}
+
+void set_jit_cache_capacity(int modules) {
+    assert(modules >= 0 && "The jit cache capacity can't be negative");
+    Internal::jit_cache_capacity() = modules;
+    if (modules > 0) {
+        Internal::jit_cache_evict(modules);
+    }
+}
+
+void set_jit_cache_directory(const std::string &dir) {
+    Internal::jit_cache_dir() = dir;
+}
+
+int jit_cache_directory_hits() {
+    return Internal::jit_cache_directory_hit_count;
+}
+
+}
@@ -0,0 +1,77 @@
+#ifndef HALIDE_JIT_CACHE_H
+#define HALIDE_JIT_CACHE_H
+
+/** \file
+ * Defines an in-process cache of jit-compiled pipelines.
+ */
+
+#include "IR.h"
+#include "Argument.h"
+#include "Target.h"
+#include "JITCompiledModule.h"
+
+#include <string>
+#include <vector>
+
+namespace Halide {
+
+/** Forget every jit-compiled module held by the jit cache. Modules
+ * still in use by a Func stay alive until that Func is recompiled or
+ * destroyed. */
+EXPORT void clear_jit_cache();
+
+/** Hold at most this many modules in the jit cache, forgetting the
+ * one least recently used to make room for a new one. Zero means no
+ * limit, which is the default unless the environment variable
+ * HL_JIT_CACHE_SIZE is set. Programs that keep making new pipelines
+ * should set a limit, or memory grows without bound. */
+EXPORT void set_jit_cache_capacity(int modules);
+
+/** Keep the machine code of jit-compiled pipelines in files in the
+ * given directory, so that later runs of the program can load it
+ * instead of compiling again. The directory must exist. An empty
+ * string turns this off, which is the default unless the environment
+ * variable HL_JIT_CACHE_DIR is set. Only works with MCJIT (i.e. not
+ * on OS X or Windows) and llvm 3.4 or later. */
+EXPORT void set_jit_cache_directory(const std::string &dir);
+
+/** The number of jit compilations in this process so far that loaded
+ * their machine code from the cache directory instead of compiling
+ * it. */
+EXPORT int jit_cache_directory_hits();
+
+namespace Internal {
+
+/** Compute the key under which a lowered statement compiled for the
+ * given target and argument list is cached. Two statements get the
+ * same key if they are the same up to a consistent renaming of the
+ * functions, buffers and variables in them, so rebuilding the same
+ * pipeline from scratch (which makes fresh unique names) still hits
+ * the cache. */
+std::string jit_cache_key(Stmt s, const Target &t, const std::vector<Argument> &args);
+
+/** A 64-bit hash of a cache key, suitable for naming files. */
+uint64_t jit_cache_hash(const std::string &key);
+
+/** Look up a module in the cache. Returns false if there is none, or
+ * if the cache has been disabled by setting HL_JIT_CACHE=0. */
+bool jit_cache_lookup(const std::string &key, JITCompiledModule *result);
+
+/** Add a module to the cache. */
+void jit_cache_store(const std::string &key, const JITCompiledModule &m);
+
+/** Remove a module from the cache, if it's there. */
+void jit_cache_forget(const JITCompiledModule &m);
+
+/** The directory set by set_jit_cache_directory, or HL_JIT_CACHE_DIR,
+ * or an empty string if there isn't one. */
+std::string jit_cache_directory();
+
+/** Count a module whose machine code was loaded from the cache
+ * directory. */
+void jit_cache_directory_hit();
+
+}
+}
+
+#endif
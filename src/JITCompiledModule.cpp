@@ -5,7 +5,19 @@
 #include "JITCompiledModule.h"
 #include "CodeGen.h"
 #include "LLVM_Headers.h"
+#include "JITCache.h"
 #include "Debug.h"
+#include "Util.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+
+#if defined(USE_MCJIT) && LLVM_VERSION >= 34
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <unistd.h>
+#define HALIDE_JIT_OBJECT_CACHE
+#endif
 
 namespace Halide {
 namespace Internal {
@@ -24,7 +36,18 @@ public:
         execution_engine(ee),
         module(m),
         context(&m->getContext()),
-        shutdown_thread_pool(stop_threads) {
+        shutdown_thread_pool(stop_threads),
+        thread_pool(NULL),
+        thread_pool_threads(0),
+        thread_pool_priority(0),
+        destroy_thread_pool(NULL),
+        handlers_set(false),
+        release_allocator_cache(NULL),
+        release_persistent_storage(NULL),
+        shutdown_profiler(NULL),
+        shutdown_timeline(NULL),
+        shutdown_pgo(NULL),
+        wait_for_debug_files(NULL) {
     }
 
     ~JITModuleHolder() {
@@ -35,7 +58,28 @@ public:
             (*cleanup_routines[i])();
         }
 
+        if (wait_for_debug_files) {
+            wait_for_debug_files();
+        }
+        if (thread_pool) {
+            destroy_thread_pool(thread_pool);
+        }
         shutdown_thread_pool();
+        if (shutdown_profiler) {
+            shutdown_profiler();
+        }
+        if (shutdown_timeline) {
+            shutdown_timeline();
+        }
+        if (shutdown_pgo) {
+            shutdown_pgo();
+        }
+        if (release_allocator_cache) {
+            release_allocator_cache();
+        }
+        if (release_persistent_storage) {
+            release_persistent_storage();
+        }
         delete execution_engine;
         delete context;
         // No need to delete the module - deleting the execution engine should take care of that.
@@ -46,6 +90,44 @@ public:
     LLVMContext *context;
     void (*shutdown_thread_pool)();
 
+    /** A thread pool made by JITCompiledModule::use_thread_pool, and
+     * the settings it was made with. */
+    // @{
+    void *thread_pool;
+    int thread_pool_threads, thread_pool_priority;
+    void (*destroy_thread_pool)(void *);
+    // @}
+
+    /** The hooks given to the runtime by set_handlers, if it has
+     * been called. */
+    // @{
+    bool handlers_set;
+    JITHandlers handlers;
+    // @}
+
+    /** Frees the blocks held by the runtime's allocator cache. */
+    void (*release_allocator_cache)();
+
+    /** Frees the storage kept between runs for Funcs scheduled with
+     * Func::store_persistent. */
+    void (*release_persistent_storage)();
+
+    /** Prints the profile, if there is one, and stops the runtime's
+     * sampling profiler. */
+    void (*shutdown_profiler)();
+
+    /** Writes out the timeline of parallel loops, if one is being
+     * recorded. */
+    void (*shutdown_timeline)();
+
+    /** Writes out the counts of a pipeline compiled with
+     * HL_PGO_INSTRUMENT, if it ran. */
+    void (*shutdown_pgo)();
+
+    /** Waits for debug_to_file images that are still being written in
+     * the background. */
+    void (*wait_for_debug_files)();
+
     /** Do any target-specific module cleanup. */
     std::vector<void (*)()> cleanup_routines;
 };
@@ -107,7 +189,74 @@ void hook_up_function_pointer(ExecutionEngine *ee, Module *mod, const string &na
 
 }
 
-void JITCompiledModule::compile_module(CodeGen *cg, llvm::Module *m, const string &function_name) {
+#ifdef HALIDE_JIT_OBJECT_CACHE
+// Saves the machine code MCJIT generates for a module in the jit
+// cache directory, and hands it back instead of compiling when the
+// same module shows up again. Each entry is a pair of files named
+// after the hash of the key: the object code, and the full key so
+// that hash collisions can be detected.
+class JITObjectCache : public llvm::ObjectCache {
+    string object_path, key_path, key;
+
+    bool read_file(const string &path, string &contents) {
+        std::ifstream f(path.c_str(), std::ios::in | std::ios::binary);
+        if (!f.good()) return false;
+        std::ostringstream ss;
+        ss << f.rdbuf();
+        contents = ss.str();
+        return true;
+    }
+
+    // Write to a temporary file then move it into place, so that
+    // another process never sees a partially written entry.
+    void write_file(const string &path, const char *data, size_t size) {
+        string tmp = path + ".tmp" + int_to_string((int)getpid());
+        {
+            std::ofstream f(tmp.c_str(), std::ios::out | std::ios::binary);
+            f.write(data, size);
+            if (!f.good()) {
+                debug(1) << "Could not write jit cache file " << tmp << "\n";
+                remove(tmp.c_str());
+                return;
+            }
+        }
+        rename(tmp.c_str(), path.c_str());
+    }
+
+public:
+    // Whether getObject found an entry.
+    bool hit;
+
+    JITObjectCache(const string &dir, const string &cache_key) : hit(false) {
+        // The object code also depends on the version of llvm that made it.
+        key = cache_key + "\nllvm " + int_to_string(LLVM_VERSION);
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)jit_cache_hash(key));
+        object_path = dir + "/" + name + ".o";
+        key_path = dir + "/" + name + ".key";
+    }
+
+    void notifyObjectCompiled(const llvm::Module *, const MemoryBuffer *obj) {
+        debug(2) << "Saving machine code to " << object_path << "\n";
+        write_file(object_path, obj->getBufferStart(), obj->getBufferSize());
+        write_file(key_path, key.data(), key.size());
+    }
+
+    MemoryBuffer *getObject(const llvm::Module *) {
+        string stored_key, object;
+        if (!read_file(key_path, stored_key) || stored_key != key ||
+            !read_file(object_path, object)) {
+            return NULL;
+        }
+        debug(2) << "Loading machine code from " << object_path << "\n";
+        hit = true;
+        return MemoryBuffer::getMemBufferCopy(object);
+    }
+};
+#endif
+
+void JITCompiledModule::compile_module(CodeGen *cg, llvm::Module *m, const string &function_name,
+                                       const string &cache_key) {
 
     // Make the execution engine
     debug(2) << "Creating new execution engine\n";
@@ -150,6 +299,15 @@ void JITCompiledModule::compile_module(CodeGen *cg, llvm::Module *m, const strin
     if (!ee) std::cerr << error_string << "\n";
     assert(ee && "Couldn't create execution engine");
 
+    #ifdef HALIDE_JIT_OBJECT_CACHE
+    JITObjectCache *object_cache = NULL;
+    string cache_dir = jit_cache_directory();
+    if (!cache_key.empty() && !cache_dir.empty()) {
+        object_cache = new JITObjectCache(cache_dir, cache_key);
+        ee->setObjectCache(object_cache);
+    }
+    #endif
+
     #ifdef __arm__
     start = end = NULL;
     #endif
@@ -170,22 +328,77 @@ void JITCompiledModule::compile_module(CodeGen *cg, llvm::Module *m, const strin
     hook_up_function_pointer(ee, m, "halide_copy_to_host", false, &copy_to_host);
     hook_up_function_pointer(ee, m, "halide_copy_to_dev", false, &copy_to_dev);
     hook_up_function_pointer(ee, m, "halide_dev_free", false, &free_dev_buffer);
+    hook_up_function_pointer(ee, m, "halide_dev_host_malloc", false, &host_malloc);
+    hook_up_function_pointer(ee, m, "halide_dev_host_free", false, &host_free);
+    hook_up_function_pointer(ee, m, "halide_dev_host_register", false, &host_register);
+    hook_up_function_pointer(ee, m, "halide_dev_host_unregister", false, &host_unregister);
     hook_up_function_pointer(ee, m, "halide_set_error_handler", true, &set_error_handler);
     hook_up_function_pointer(ee, m, "halide_set_custom_allocator", true, &set_custom_allocator);
     hook_up_function_pointer(ee, m, "halide_set_custom_do_par_for", true, &set_custom_do_par_for);
     hook_up_function_pointer(ee, m, "halide_set_custom_do_task", true, &set_custom_do_task);
     hook_up_function_pointer(ee, m, "halide_set_custom_trace", true, &set_custom_trace);
+    hook_up_function_pointer(ee, m, "halide_set_custom_is_cancelled", true, &set_custom_is_cancelled);
+    hook_up_function_pointer(ee, m, "halide_set_custom_check_memory_budget", true, &set_custom_check_memory_budget);
     hook_up_function_pointer(ee, m, "halide_shutdown_thread_pool", true, &shutdown_thread_pool);
+    hook_up_function_pointer(ee, m, "halide_create_thread_pool", false, &create_thread_pool);
+    hook_up_function_pointer(ee, m, "halide_destroy_thread_pool", false, &destroy_thread_pool);
+    hook_up_function_pointer(ee, m, "halide_set_thread_pool", false, &set_thread_pool);
+    void (*release_allocator_cache)() = NULL;
+    hook_up_function_pointer(ee, m, "halide_release_allocator_cache", false, &release_allocator_cache);
+    void (*release_persistent_storage)() = NULL;
+    hook_up_function_pointer(ee, m, "halide_persistent_storage_cleanup", false, &release_persistent_storage);
+    void (*shutdown_profiler)() = NULL;
+    hook_up_function_pointer(ee, m, "halide_profiler_shutdown", false, &shutdown_profiler);
+    void (*shutdown_timeline)() = NULL;
+    hook_up_function_pointer(ee, m, "halide_shutdown_timeline", false, &shutdown_timeline);
+    void (*shutdown_pgo)() = NULL;
+    hook_up_function_pointer(ee, m, "halide_shutdown_pgo", false, &shutdown_pgo);
+    void (*wait_for_debug_files)() = NULL;
+    hook_up_function_pointer(ee, m, "halide_debug_to_file_wait", false, &wait_for_debug_files);
 
     debug(2) << "Finalizing object\n";
     ee->finalizeObject();
 
+    #ifdef HALIDE_JIT_OBJECT_CACHE
+    if (object_cache) {
+        debug(1) << "JIT object cache " << (object_cache->hit ? "hit" : "miss") << "\n";
+        if (object_cache->hit) {
+            jit_cache_directory_hit();
+        }
+        ee->setObjectCache(NULL);
+        delete object_cache;
+    }
+    #endif
+
     // Stash the various objects that need to stay alive behind a reference-counted pointer.
     module = new JITModuleHolder(ee, m, shutdown_thread_pool);
+    module.ptr->destroy_thread_pool = destroy_thread_pool;
+    module.ptr->release_allocator_cache = release_allocator_cache;
+    module.ptr->release_persistent_storage = release_persistent_storage;
+    module.ptr->shutdown_profiler = shutdown_profiler;
+    module.ptr->shutdown_timeline = shutdown_timeline;
+    module.ptr->shutdown_pgo = shutdown_pgo;
+    module.ptr->wait_for_debug_files = wait_for_debug_files;
 
     // Do any target-specific post-compilation module meddling
     cg->jit_finalize(ee, m, &module.ptr->cleanup_routines);
 
+    #ifdef USE_MCJIT
+    // MCJIT has compiled the whole module to machine code by now, and
+    // we have all the function pointers we'll need, so the IR is dead
+    // weight. It's mostly the runtime, which is most of the memory a
+    // jitted pipeline costs. The old jit compiles functions lazily,
+    // so it needs to keep it.
+    int stripped = 0;
+    for (llvm::Module::iterator iter = m->begin(); iter != m->end(); ++iter) {
+        if (!iter->isDeclaration()) {
+            iter->deleteBody();
+            stripped++;
+        }
+    }
+    debug(2) << "Deleted the IR of " << stripped << " functions\n";
+    #endif
+
     #ifdef __arm__
     // Flush each function from the dcache so that it gets pulled into
     // the icache correctly.
@@ -206,5 +419,54 @@ void JITCompiledModule::compile_module(CodeGen *cg, llvm::Module *m, const strin
 
 }
 
+void JITCompiledModule::use_thread_pool(int num_threads, int priority) {
+    JITModuleHolder *holder = module.ptr;
+    if (!holder || !create_thread_pool || !set_thread_pool) return;
+    if (holder->thread_pool
+        ? (holder->thread_pool_threads == num_threads &&
+           holder->thread_pool_priority == priority)
+        : (num_threads == 0 && priority == 0)) {
+        // Already set up this way
+        return;
+    }
+
+    if (holder->thread_pool) {
+        debug(2) << "Destroying thread pool " << holder->thread_pool << "\n";
+        destroy_thread_pool(holder->thread_pool);
+        holder->thread_pool = NULL;
+    }
+
+    if (num_threads != 0 || priority != 0) {
+        holder->thread_pool = create_thread_pool(num_threads, priority);
+        holder->thread_pool_threads = num_threads;
+        holder->thread_pool_priority = priority;
+        debug(2) << "Created thread pool " << holder->thread_pool
+                 << " with " << num_threads << " threads at priority " << priority << "\n";
+        // Bind it to the NULL user_context, which the runtime also
+        // falls back on for user_contexts without a pool of their
+        // own, so realizations with a user_context use it too.
+        if (holder->thread_pool) {
+            set_thread_pool(NULL, holder->thread_pool);
+        }
+    }
+}
+
+void JITCompiledModule::set_handlers(const JITHandlers &h) {
+    JITModuleHolder *holder = module.ptr;
+    if (!holder) return;
+    if (holder->handlers_set && holder->handlers == h) return;
+
+    debug(2) << "Setting the runtime hooks of JIT compiled module " << holder << "\n";
+    set_error_handler(h.error_handler);
+    set_custom_allocator(h.custom_malloc, h.custom_free);
+    set_custom_do_par_for(h.custom_do_par_for);
+    set_custom_do_task(h.custom_do_task);
+    set_custom_trace(h.custom_trace);
+    set_custom_is_cancelled(h.custom_is_cancelled);
+    set_custom_check_memory_budget(h.custom_check_memory_budget);
+    holder->handlers = h;
+    holder->handlers_set = true;
+}
+
 }
 }
@@ -27,6 +27,43 @@ namespace Internal {
 class JITModuleHolder;
 class CodeGen;
 
+/** The runtime hooks a jitted pipeline calls into. A NULL member
+ * means the runtime's own version. */
+struct JITHandlers {
+    void (*error_handler)(void *user_context, const char *);
+    void *(*custom_malloc)(void *user_context, size_t);
+    void (*custom_free)(void *user_context, void *ptr);
+    int (*custom_do_par_for)(void *user_context, int (*)(void *, int, uint8_t *),
+                             int, int, uint8_t *);
+    int (*custom_do_task)(void *user_context, int (*)(void *, int, uint8_t *),
+                          int, uint8_t *);
+    int (*custom_trace)(void *, const halide_trace_event *);
+    int (*custom_is_cancelled)(void *user_context);
+    int (*custom_check_memory_budget)(void *user_context, const char *pipeline,
+                                      int64_t bytes, int is_query);
+
+    JITHandlers() :
+        error_handler(NULL),
+        custom_malloc(NULL),
+        custom_free(NULL),
+        custom_do_par_for(NULL),
+        custom_do_task(NULL),
+        custom_trace(NULL),
+        custom_is_cancelled(NULL),
+        custom_check_memory_budget(NULL) {}
+
+    bool operator==(const JITHandlers &other) const {
+        return (error_handler == other.error_handler &&
+                custom_malloc == other.custom_malloc &&
+                custom_free == other.custom_free &&
+                custom_do_par_for == other.custom_do_par_for &&
+                custom_do_task == other.custom_do_task &&
+                custom_trace == other.custom_trace &&
+                custom_is_cancelled == other.custom_is_cancelled &&
+                custom_check_memory_budget == other.custom_check_memory_budget);
+    }
+};
+
 /** Function pointers into a compiled halide module. These function
  * pointers are meaningless once the last copy of a JITCompiledModule
  * is deleted, so don't cache them. */
@@ -52,6 +89,17 @@ struct JITCompiledModule {
     void (*free_dev_buffer)(void *user_context, struct buffer_t*);
     // @}
 
+    /** JITed helpers to allocate page-locked host memory, or to
+     * page-lock existing host memory, for faster copies to and from
+     * the device. NULL if not compiling for a gpu-like target. See
+     * Buffer::pin_host_memory. */
+    // @{
+    void *(*host_malloc)(void *user_context, size_t);
+    void (*host_free)(void *user_context, void *);
+    int (*host_register)(void *user_context, void *, size_t);
+    void (*host_unregister)(void *user_context, void *);
+    // @}
+
     /** The type of a halide runtime error handler function */
     typedef void (*ErrorHandler)(void *user_context, const char *);
 
@@ -78,11 +126,29 @@ struct JITCompiledModule {
     typedef int (*TraceFn)(void *, const halide_trace_event *);
     void (*set_custom_trace)(TraceFn);
 
+    /** Set a custom cancellation check. See
+     * \ref Func::set_custom_is_cancelled. */
+    void (*set_custom_is_cancelled)(int (*is_cancelled)(void *user_context));
+
+    /** Set a custom memory budget check. See
+     * \ref Func::set_custom_check_memory_budget. */
+    void (*set_custom_check_memory_budget)(int (*check)(void *user_context, const char *pipeline,
+                                                        int64_t bytes, int is_query));
+
     /** Shutdown the thread pool maintained by this JIT module. This
      * is also done automatically when the last reference to this
      * module is destroyed. */
     void (*shutdown_thread_pool)();
 
+    /** Create, destroy, and select thread pools other than the
+     * default one. May be NULL if the runtime only has the one
+     * pool. See \ref Func::set_thread_pool */
+    // @{
+    void *(*create_thread_pool)(int num_threads, int priority);
+    void (*destroy_thread_pool)(void *pool);
+    int (*set_thread_pool)(void *user_context, void *pool);
+    // @}
+
     // The JIT Module Allocator holds onto the memory storing the functions above.
     IntrusivePtr<JITModuleHolder> module;
 
@@ -92,16 +158,43 @@ struct JITCompiledModule {
         copy_to_host(NULL),
         copy_to_dev(NULL),
         free_dev_buffer(NULL),
+        host_malloc(NULL),
+        host_free(NULL),
+        host_register(NULL),
+        host_unregister(NULL),
         set_error_handler(NULL),
         set_custom_allocator(NULL),
         set_custom_do_par_for(NULL),
         set_custom_do_task(NULL),
         set_custom_trace(NULL),
-        shutdown_thread_pool(NULL) {}
+        set_custom_is_cancelled(NULL),
+        set_custom_check_memory_budget(NULL),
+        shutdown_thread_pool(NULL),
+        create_thread_pool(NULL),
+        destroy_thread_pool(NULL),
+        set_thread_pool(NULL) {}
 
     /** Take an llvm module and compile it. Populates the function
-     * pointer members above with the result. */
-    void compile_module(CodeGen *cg, llvm::Module *mod, const std::string &function_name);
+     * pointer members above with the result. If a cache key is given
+     * and a jit cache directory is set, the machine code is loaded
+     * from the directory, or saved there. */
+    void compile_module(CodeGen *cg, llvm::Module *mod, const std::string &function_name,
+                        const std::string &cache_key = "");
+
+    /** Run this module's parallel loops on a thread pool of its own,
+     * with the given number of threads and worker nice value. The
+     * pool lives as long as the module. Calling it again with
+     * different settings replaces the pool, and calling it with
+     * both arguments zero goes back to the default pool. */
+    void use_thread_pool(int num_threads, int priority);
+
+    /** Give the runtime of this module the given hooks. The hooks
+     * are global to the module (and to any other Func sharing it
+     * through the jit cache), so they're only set if they differ
+     * from the ones set last, which lets pipelines that are already
+     * running on other threads carry on undisturbed. Not thread-safe
+     * with itself; Func serializes calls to it. */
+    void set_handlers(const JITHandlers &handlers);
 
 };
 
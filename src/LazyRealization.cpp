@@ -0,0 +1,298 @@
+#include "LazyRealization.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "IREquality.h"
+#include "CodeGen_GPU_Dev.h"
+#include "Debug.h"
+
+#include <iostream>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+using std::pair;
+using std::make_pair;
+
+namespace {
+
+// The points of a function read by an expression, with the lets each
+// read is inside of.
+class FindReads : public IRVisitor {
+    const string &name;
+    vector<pair<string, Expr> > lets;
+
+    using IRVisitor::visit;
+
+    void visit(const Let *op) {
+        op->value.accept(this);
+        lets.push_back(make_pair(op->name, op->value));
+        op->body.accept(this);
+        lets.pop_back();
+    }
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type != Call::Halide || op->name != name) return;
+
+        // Several values of a Tuple, or the same point read twice,
+        // need only one claim.
+        for (size_t i = 0; i < reads.size(); i++) {
+            bool same = reads[i].lets.empty() && lets.empty();
+            for (size_t j = 0; same && j < op->args.size(); j++) {
+                same = equal(reads[i].args[j], op->args[j]);
+            }
+            if (same) return;
+        }
+        Read r = {op->args, lets};
+        reads.push_back(r);
+    }
+
+public:
+    struct Read {
+        vector<Expr> args;
+        vector<pair<string, Expr> > lets;
+    };
+    vector<Read> reads;
+
+    FindReads(const string &n) : name(n) {}
+};
+
+class ReadsFunction : public IRVisitor {
+    const string &name;
+
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        result = result || (op->call_type == Call::Halide && op->name == name);
+    }
+
+public:
+    bool result;
+    ReadsFunction(const string &n) : name(n), result(false) {}
+};
+
+// Put the computation of the blocks of a lazily computed function
+// that each statement reads in front of it.
+class GuardReads : public IRMutator {
+    Function func;
+    const vector<int> &block_size;
+    Stmt produce;
+    const string &tokens;
+
+    // Whether to leave only the guards, for the scalar pass in front
+    // of a vectorized loop.
+    bool guards_only;
+
+    bool in_gpu_loop;
+
+    Stmt guard(const FindReads::Read &r) {
+        const string &name = func.name();
+        Expr index = 0, stride = 1;
+        Stmt body = produce;
+        for (size_t i = 0; i < block_size.size(); i++) {
+            int size = block_size[i];
+            if (size == 0) continue;
+            string prefix = name + "." + func.args()[i];
+            Expr min = Variable::make(Int(32), prefix + ".min_realized");
+            Expr extent = Variable::make(Int(32), prefix + ".extent_realized");
+            Expr b = (r.args[i] - min) / size;
+
+            // The values refer to the region required by all the
+            // callers, which these lets shadow.
+            string stage = name + ".s0." + func.args()[i];
+            Expr required_min = Variable::make(Int(32), stage + ".min");
+            Expr required_max = Variable::make(Int(32), stage + ".max");
+            Expr block_min = min + b * size;
+            body = LetStmt::make(stage + ".max", Min::make(block_min + (size - 1), required_max), body);
+            body = LetStmt::make(stage + ".min", Max::make(block_min, required_min), body);
+
+            index = index + b * stride;
+            stride = stride * ((extent + (size - 1)) / size);
+        }
+
+        Expr token = Load::make(Int(32), tokens, index, Buffer(), Parameter());
+        Expr address = Call::make(Handle(), Call::address_of, vec(token), Call::Intrinsic);
+        Expr claim = Call::make(Int(32), "halide_lazy_block_claim", vec(address), Call::Extern);
+        Expr release = Call::make(Int(32), "halide_lazy_block_release", vec(address), Call::Extern);
+        Stmt s = IfThenElse::make(claim != 0, Block::make(body, Evaluate::make(release)));
+        for (size_t i = r.lets.size(); i > 0; i--) {
+            s = LetStmt::make(r.lets[i-1].first, r.lets[i-1].second, s);
+        }
+        return s;
+    }
+
+    // The guards for the reads in some expressions, or an undefined
+    // Stmt if they read nothing.
+    Stmt guards(const vector<Expr> &exprs) {
+        FindReads finder(func.name());
+        for (size_t i = 0; i < exprs.size(); i++) {
+            if (exprs[i].defined()) exprs[i].accept(&finder);
+        }
+        if (!finder.reads.empty() && in_gpu_loop) {
+            std::cerr << "Can't read " << func.name()
+                      << " from a gpu kernel, because it is computed lazily.\n";
+            assert(false);
+        }
+        Stmt result;
+        for (size_t i = finder.reads.size(); i > 0; i--) {
+            Stmt g = guard(finder.reads[i-1]);
+            result = result.defined() ? Block::make(g, result) : g;
+        }
+        return result;
+    }
+
+    Stmt add_guards(Stmt s, const vector<Expr> &exprs) {
+        Stmt g = guards(exprs);
+        if (guards_only) {
+            return g.defined() ? g : Evaluate::make(0);
+        }
+        return g.defined() ? Block::make(g, s) : s;
+    }
+
+    using IRMutator::visit;
+
+    void visit(const Provide *op) {
+        vector<Expr> exprs = op->values;
+        exprs.insert(exprs.end(), op->args.begin(), op->args.end());
+        stmt = add_guards(op, exprs);
+    }
+
+    void visit(const Evaluate *op) {
+        stmt = add_guards(op, vec(op->value));
+    }
+
+    void visit(const AssertStmt *op) {
+        vector<Expr> exprs = op->args;
+        exprs.push_back(op->condition);
+        stmt = add_guards(op, exprs);
+    }
+
+    void visit(const LetStmt *op) {
+        IRMutator::visit(op);
+        Stmt g = guards(vec(op->value));
+        if (g.defined()) stmt = Block::make(g, stmt);
+    }
+
+    void visit(const IfThenElse *op) {
+        IRMutator::visit(op);
+        Stmt g = guards(vec(op->condition));
+        if (g.defined()) stmt = Block::make(g, stmt);
+    }
+
+    void visit(const For *op) {
+        bool old_in_gpu_loop = in_gpu_loop;
+        in_gpu_loop = in_gpu_loop || CodeGen_GPU_Dev::is_gpu_var(op->name);
+
+        ReadsFunction reads(func.name());
+        op->body.accept(&reads);
+        if (op->for_type == For::Vectorized && reads.result) {
+            // The guards can't be vectorized, so they go in a scalar
+            // loop over the same range first.
+            bool old_guards_only = guards_only;
+            guards_only = true;
+            Stmt body = mutate(op->body);
+            guards_only = old_guards_only;
+            Stmt scalar = For::make(op->name, op->min, op->extent, For::Serial, body);
+            stmt = guards_only ? scalar : Block::make(scalar, op);
+        } else {
+            IRMutator::visit(op);
+        }
+        in_gpu_loop = old_in_gpu_loop;
+
+        Stmt g = guards(vec(op->min, op->extent));
+        if (g.defined()) stmt = Block::make(g, stmt);
+    }
+
+public:
+    GuardReads(Function f, const vector<int> &b, Stmt p, const string &t) :
+        func(f), block_size(b), produce(p), tokens(t),
+        guards_only(false), in_gpu_loop(false) {}
+};
+
+class InjectLazyRealization : public IRMutator {
+    Function func;
+    const vector<int> &block_size;
+
+    using IRMutator::visit;
+
+    void visit(const Pipeline *op) {
+        if (op->name != func.name()) {
+            IRMutator::visit(op);
+            return;
+        }
+        found = true;
+
+        const string &name = func.name();
+        string tokens = name + ".lazy_tokens";
+        Stmt consume = GuardReads(func, block_size, op->produce, tokens).mutate(op->consume);
+
+        // All the blocks start out not computed.
+        Expr num_tokens = 1;
+        for (size_t i = 0; i < block_size.size(); i++) {
+            if (block_size[i] == 0) continue;
+            Expr extent = Variable::make(Int(32), name + "." + func.args()[i] + ".extent_realized");
+            num_tokens = num_tokens * ((extent + (block_size[i] - 1)) / block_size[i]);
+        }
+        string token_var = name + ".lazy_token";
+        Stmt clear = Store::make(tokens, 0, Variable::make(Int(32), token_var));
+        clear = For::make(token_var, 0, num_tokens, For::Serial, clear);
+
+        stmt = Pipeline::make(name, clear, Stmt(), consume);
+        stmt = Allocate::make(tokens, Int(32), vec(num_tokens), stmt);
+    }
+
+public:
+    bool found;
+    InjectLazyRealization(Function f, const vector<int> &b) :
+        func(f), block_size(b), found(false) {}
+};
+
+}
+
+Stmt inject_lazy_realizations(Stmt s, const map<string, Function> &env) {
+    for (map<string, Function>::const_iterator iter = env.begin();
+         iter != env.end(); ++iter) {
+        Function f = iter->second;
+        const Schedule &sched = f.schedule();
+        if (sched.lazy_blocks.empty()) continue;
+
+        if (!f.reductions().empty() || f.has_extern_definition()) {
+            std::cerr << "Can't compute " << f.name() << " lazily, because "
+                      << "it has update steps or an extern definition.\n";
+            assert(false);
+        }
+        if (!sched.compute_level.is_root() || !sched.store_level.is_root()) {
+            std::cerr << "Can't compute " << f.name() << " lazily, because "
+                      << "it isn't computed and stored at the root.\n";
+            assert(false);
+        }
+
+        // The block size of each dimension, or zero for the ones
+        // that are computed whole.
+        vector<int> block_size(f.dimensions(), 0);
+        for (size_t i = 0; i < sched.lazy_blocks.size(); i++) {
+            for (int j = 0; j < f.dimensions(); j++) {
+                if (f.args()[j] == sched.lazy_blocks[i].var) {
+                    block_size[j] = sched.lazy_blocks[i].size;
+                }
+            }
+        }
+
+        InjectLazyRealization inject(f, block_size);
+        s = inject.mutate(s);
+        if (!inject.found) {
+            std::cerr << "Can't compute " << f.name() << " lazily, because "
+                      << "it is an output of the pipeline.\n";
+            assert(false);
+        }
+        debug(3) << "Computing " << f.name() << " lazily\n";
+    }
+    return s;
+}
+
+}
+}
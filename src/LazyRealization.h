@@ -0,0 +1,28 @@
+#ifndef HALIDE_LAZY_REALIZATION_H
+#define HALIDE_LAZY_REALIZATION_H
+
+/** \file
+ * Defines the lowering pass that computes functions scheduled with
+ * Func::compute_lazily one block at a time, as their callers read
+ * them.
+ */
+
+#include "IR.h"
+#include "Function.h"
+
+#include <map>
+
+namespace Halide {
+namespace Internal {
+
+/** Replace the produce step of each lazily computed function with a
+ * table of tokens, one per block, and put in front of each statement
+ * that reads the function the computation of the blocks it reads,
+ * guarded by a claim on their tokens. Must run after allocation
+ * bounds inference, and before variable names are uniquified. */
+Stmt inject_lazy_realizations(Stmt s, const std::map<std::string, Function> &env);
+
+}
+}
+
+#endif
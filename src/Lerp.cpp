@@ -147,7 +147,20 @@ Expr lower_lerp(Expr zero_val, Expr one_val, Expr weight) {
 
                 Expr prod_sum = zero_expand * inverse_typed_weight +
                     one_expand * typed_weight + rounding;
-                Expr divided = ((prod_sum / divisor) + prod_sum) / divisor;
+                Expr divided;
+                if (bits == 8) {
+                    // prod_sum is at most 255*255 + 128, so the
+                    // rounded divide by 255 below is the same as
+                    // taking the high half of prod_sum * 257. That's
+                    // a single pmulhuw on x86, and vmull + vshrn on
+                    // arm, and keeps all the arithmetic in 16-bit
+                    // lanes.
+                    Expr wide = Cast::make(UInt(32, computation_type.width), prod_sum);
+                    divided = Cast::make(UInt(16, computation_type.width),
+                                         (wide * 257) / 65536);
+                } else {
+                    divided = ((prod_sum / divisor) + prod_sum) / divisor;
+                }
 
                 result = Cast::make(UInt(bits, computation_type.width), divided);
                 break;
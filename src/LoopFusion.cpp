@@ -0,0 +1,280 @@
+#include "LoopFusion.h"
+#include "IRMutator.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "Debug.h"
+
+#include <set>
+#include <iostream>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+using std::set;
+
+namespace {
+
+// Does a statement or expression call any of the given functions?
+class CallsFuncs : public IRVisitor {
+    const set<string> &funcs;
+
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        if (funcs.count(op->name)) result = true;
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Variable *op) {
+        // Extern stages get handed the buffer_t of their inputs.
+        if (ends_with(op->name, ".buffer") &&
+            funcs.count(op->name.substr(0, op->name.size() - 7))) {
+            result = true;
+        }
+    }
+
+public:
+    bool result;
+    CallsFuncs(const set<string> &f) : funcs(f), result(false) {}
+};
+
+bool calls_funcs(Stmt s, const set<string> &funcs) {
+    CallsFuncs c(funcs);
+    s.accept(&c);
+    return c.result;
+}
+
+bool calls_func(Stmt s, const string &func) {
+    set<string> funcs;
+    funcs.insert(func);
+    return calls_funcs(s, funcs);
+}
+
+// Fuse the outermost 'levels' loops of two loop nests. The guards
+// say which iterations of the fused loops belong to each nest.
+Stmt fuse_loops(Stmt a, Stmt b, int levels, Expr guard_a, Expr guard_b) {
+    vector<const LetStmt *> lets_a, lets_b;
+    while (const LetStmt *l = a.as<LetStmt>()) {
+        lets_a.push_back(l);
+        a = l->body;
+    }
+    while (const LetStmt *l = b.as<LetStmt>()) {
+        lets_b.push_back(l);
+        b = l->body;
+    }
+
+    Stmt result;
+    if (levels == 0) {
+        a = IfThenElse::make(guard_a, a);
+        b = IfThenElse::make(guard_b, b);
+        for (size_t i = lets_a.size(); i > 0; i--) {
+            a = LetStmt::make(lets_a[i-1]->name, lets_a[i-1]->value, a);
+        }
+        for (size_t i = lets_b.size(); i > 0; i--) {
+            b = LetStmt::make(lets_b[i-1]->name, lets_b[i-1]->value, b);
+        }
+        return Block::make(a, b);
+    }
+
+    const For *loop_a = a.as<For>();
+    const For *loop_b = b.as<For>();
+    if (!loop_a || !loop_b ||
+        loop_a->for_type != loop_b->for_type ||
+        (loop_a->for_type != For::Serial && loop_a->for_type != For::Parallel)) {
+        return Stmt();
+    }
+
+    // The loop variables of both nests are defined in terms of the
+    // fused one.
+    string name = loop_a->name + ".fused";
+    Expr var = Variable::make(Int(32), name);
+    Expr end_a = loop_a->min + loop_a->extent;
+    Expr end_b = loop_b->min + loop_b->extent;
+    guard_a = guard_a && var >= loop_a->min && var < end_a;
+    guard_b = guard_b && var >= loop_b->min && var < end_b;
+
+    Stmt body = fuse_loops(loop_a->body, loop_b->body, levels - 1, guard_a, guard_b);
+    if (!body.defined()) return Stmt();
+    body = LetStmt::make(loop_b->name, var, body);
+    body = LetStmt::make(loop_a->name, var, body);
+
+    Expr min = Min::make(loop_a->min, loop_b->min);
+    Expr extent = Max::make(end_a, end_b) - min;
+    result = For::make(name, min, extent, loop_a->for_type, body);
+
+    // The lets at this level are all in terms of outer loops, so they
+    // can all go outside the fused loop.
+    for (size_t i = lets_b.size(); i > 0; i--) {
+        result = LetStmt::make(lets_b[i-1]->name, lets_b[i-1]->value, result);
+    }
+    for (size_t i = lets_a.size(); i > 0; i--) {
+        result = LetStmt::make(lets_a[i-1]->name, lets_a[i-1]->value, result);
+    }
+    return result;
+}
+
+class FuseSiblingLoops : public IRMutator {
+    const map<string, Function> &env;
+
+    // Each function scheduled with compute_with, and its partner,
+    // maps to the other one, and to the number of loop levels to fuse.
+    map<string, string> partner;
+    map<string, int> levels;
+
+    // Remove the pipeline of the given function from somewhere below
+    // the start of s. The lets and realizations passed on the way
+    // there are appended to wrappers, and the names of the other
+    // pipelines passed are put in skipped.
+    Stmt remove_pipeline(Stmt s, const string &name, vector<Stmt> &wrappers,
+                         set<string> &skipped, const Pipeline **found) {
+        if (const LetStmt *let = s.as<LetStmt>()) {
+            wrappers.push_back(s);
+            return remove_pipeline(let->body, name, wrappers, skipped, found);
+        } else if (const Realize *realize = s.as<Realize>()) {
+            wrappers.push_back(s);
+            return remove_pipeline(realize->body, name, wrappers, skipped, found);
+        } else if (const Pipeline *p = s.as<Pipeline>()) {
+            if (p->name == name) {
+                *found = p;
+                return p->consume;
+            }
+            skipped.insert(p->name);
+            Stmt consume = remove_pipeline(p->consume, name, wrappers, skipped, found);
+            if (!consume.defined()) return Stmt();
+            return Pipeline::make(p->name, p->produce, p->update, consume);
+        } else {
+            return Stmt();
+        }
+    }
+
+    using IRMutator::visit;
+
+    void visit(const Pipeline *op) {
+        map<string, string>::iterator iter = partner.find(op->name);
+        if (iter == partner.end()) {
+            IRMutator::visit(op);
+            return;
+        }
+        const string &other = iter->second;
+
+        vector<Stmt> wrappers;
+        set<string> skipped;
+        const Pipeline *second = NULL;
+        Stmt rest = remove_pipeline(op->consume, other, wrappers, skipped, &second);
+
+        // The second function gets computed earlier than it was, so
+        // it can't depend on anything computed in between, nor can
+        // the lets and realizations lifted out of the way.
+        string reason;
+        if (!second) {
+            reason = "they aren't computed at the same loop level";
+        } else if (op->update.defined() || second->update.defined()) {
+            reason = "one of them has an update step";
+        } else if (calls_func(second->produce, op->name) ||
+                   calls_func(op->produce, other)) {
+            reason = "one of them calls the other";
+        } else if (calls_funcs(second->produce, skipped)) {
+            reason = "the second one calls something computed between them";
+        } else {
+            skipped.insert(op->name);
+            for (size_t i = 0; i < wrappers.size(); i++) {
+                if (const LetStmt *let = wrappers[i].as<LetStmt>()) {
+                    if (calls_funcs(Evaluate::make(let->value), skipped)) {
+                        reason = "the bounds of the second one depend on the first";
+                    }
+                }
+            }
+        }
+
+        Stmt fused;
+        if (reason.empty()) {
+            fused = fuse_loops(op->produce, second->produce, levels[op->name],
+                               const_true(), const_true());
+            if (!fused.defined()) {
+                reason = "their loop nests don't match";
+            }
+        }
+
+        if (!reason.empty()) {
+            std::cerr << "Warning: Not fusing the loops of " << op->name
+                      << " and " << other << " because " << reason << "\n";
+            IRMutator::visit(op);
+            return;
+        }
+
+        debug(3) << "Fused the loops of " << op->name << " and " << other << "\n";
+
+        stmt = Pipeline::make(op->name, fused, Stmt(), mutate(rest));
+        for (size_t i = wrappers.size(); i > 0; i--) {
+            if (const LetStmt *let = wrappers[i-1].as<LetStmt>()) {
+                stmt = LetStmt::make(let->name, let->value, stmt);
+            } else {
+                const Realize *realize = wrappers[i-1].as<Realize>();
+                assert(realize);
+                stmt = Realize::make(realize->name, realize->types, realize->bounds, stmt);
+            }
+        }
+    }
+
+public:
+    FuseSiblingLoops(const map<string, Function> &e) : env(e) {
+        for (map<string, Function>::const_iterator iter = env.begin();
+             iter != env.end(); ++iter) {
+            const Schedule &s = iter->second.schedule();
+            const Schedule::LoopLevel &level = s.compute_with;
+            if (level.is_inline()) continue;
+
+            const string &f = iter->first, &g = level.func;
+            map<string, Function>::const_iterator other = env.find(g);
+            if (other == env.end()) {
+                std::cerr << "Func " << f << " is scheduled to be computed with " << g
+                          << ", which isn't part of the same pipeline\n";
+                assert(false);
+                continue;
+            }
+            const Schedule &other_s = other->second.schedule();
+
+            // Count the loops from the outermost one down to the
+            // one over the given var, in both functions.
+            int depth = -1;
+            for (size_t i = 0; i < s.dims.size(); i++) {
+                if (s.dims[i].var == level.var) {
+                    depth = (int)(s.dims.size() - i);
+                }
+            }
+            if (depth <= 0) {
+                std::cerr << "Func " << f << " is scheduled to be computed with " << g
+                          << " at " << level.var << ", which isn't a loop of " << f << "\n";
+                assert(false);
+                continue;
+            }
+            int other_idx = (int)other_s.dims.size() - depth;
+            if (other_idx < 0 || other_s.dims[other_idx].var != level.var) {
+                std::cerr << "Warning: Not fusing the loops of " << f << " and " << g
+                          << " because " << level.var << " isn't at the same depth in both loop nests\n";
+                continue;
+            }
+            if (!(s.compute_level == other_s.compute_level)) {
+                std::cerr << "Warning: Not fusing the loops of " << f << " and " << g
+                          << " because they aren't computed at the same loop level\n";
+                continue;
+            }
+
+            partner[f] = g;
+            partner[g] = f;
+            levels[f] = levels[g] = depth;
+        }
+    }
+};
+
+}
+
+Stmt fuse_sibling_loops(Stmt s, const map<string, Function> &env) {
+    return FuseSiblingLoops(env).mutate(s);
+}
+
+}
+}
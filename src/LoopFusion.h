@@ -0,0 +1,27 @@
+#ifndef HALIDE_LOOP_FUSION_H
+#define HALIDE_LOOP_FUSION_H
+
+/** \file
+ * Defines the lowering pass that fuses the loop nests of sibling
+ * functions scheduled with Func::compute_with.
+ */
+
+#include "IR.h"
+#include "Function.h"
+
+#include <map>
+
+namespace Halide {
+namespace Internal {
+
+/** Merge the loop nests of pairs of functions scheduled with
+ * Func::compute_with, down to the chosen loop level. Each fused loop
+ * runs over the union of the ranges of the two loops it replaces,
+ * and the body of each function is guarded to its own range. Must
+ * run after uniquify_variable_names and before storage flattening. */
+Stmt fuse_sibling_loops(Stmt s, const std::map<std::string, Function> &env);
+
+}
+}
+
+#endif
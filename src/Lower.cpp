@@ -24,11 +24,23 @@
 #include "Deinterleave.h"
 #include "DebugToFile.h"
 #include "EarlyFree.h"
+#include "ReuseAllocations.h"
+#include "Workspace.h"
 #include "UniquifyVariableNames.h"
 #include "SkipStages.h"
 #include "CSE.h"
 #include "SpecializeClampedRamps.h"
 #include "RemoveUndef.h"
+#include "ParallelScratch.h"
+#include "AsyncProducers.h"
+#include "LoopFusion.h"
+#include "Prefetch.h"
+#include "NontemporalStores.h"
+#include "Memoization.h"
+#include "StageGPUInputs.h"
+#include "ParallelPasses.h"
+#include "PassManager.h"
+#include "AutoSchedule.h"
 #include "AllocationBoundsInference.h"
 #include "Inline.h"
 #include "Qualify.h"
@@ -36,6 +48,26 @@
 #include "Func.h"
 #include "ExprUsesVar.h"
 #include "FindCalls.h"
+#include "PartitionLoops.h"
+#include "HoistLoopInvariants.h"
+#include "WarpReductions.h"
+#include "InlineExterns.h"
+#include "FirstTouch.h"
+#include "PersistentStorage.h"
+#include "SkipIterations.h"
+#include "DeviceSplit.h"
+#include "Distribute.h"
+#include "ProfileGuided.h"
+#include "ShareShiftedVectors.h"
+#include "Tabulate.h"
+#include "VectorWidth.h"
+#include "InPlace.h"
+#include "IREquality.h"
+#include "Cancellation.h"
+#include "LazyRealization.h"
+#include "MemoryBudget.h"
+#include "ConstantFill.h"
+#include "RuntimeStats.h"
 
 namespace Halide {
 namespace Internal {
@@ -82,6 +114,21 @@ struct Container {
 };
 }
 
+// Find the Provide at the bottom of a stack of lets and ifs, and only
+// run it if var, defined as value, is at most max.
+Stmt guard_provide(Stmt s, const string &var, Expr value, Expr max) {
+    if (const LetStmt *let = s.as<LetStmt>()) {
+        return LetStmt::make(let->name, let->value, guard_provide(let->body, var, value, max));
+    } else if (const IfThenElse *op = s.as<IfThenElse>()) {
+        assert(!op->else_case.defined());
+        return IfThenElse::make(op->condition, guard_provide(op->then_case, var, value, max));
+    } else {
+        assert(s.as<Provide>());
+        Expr v = Variable::make(Int(32), var);
+        return LetStmt::make(var, value, IfThenElse::make(v <= max, s));
+    }
+}
+
 // Build a loop nest about a provide node using a schedule
 Stmt build_provide_loop_nest(Function f,
                              string prefix,
@@ -157,14 +204,22 @@ Stmt build_provide_loop_nest(Function f,
 
             Expr base = outer * split.factor + old_min;
 
-            map<string, Expr>::iterator iter = known_size_dims.find(split.old_var);
-            if ((iter != known_size_dims.end()) &&
-                is_zero(simplify(iter->second % split.factor))) {
+            TailStrategy tail = split.tail;
+            if (tail == Tail_Auto) {
+                tail = is_update ? Tail_RoundUp : Tail_ShiftInwards;
+            }
+            assert(!(is_update && tail == Tail_ShiftInwards) &&
+                   "Can't use Tail_ShiftInwards for a split of an update step, "
+                   "because it would apply the update twice to some points.");
 
+            map<string, Expr>::iterator iter = known_size_dims.find(split.old_var);
+            bool divides = ((iter != known_size_dims.end()) &&
+                            is_zero(simplify(iter->second % split.factor)));
+            if (divides) {
                 // We have proved that the split factor divides the
                 // old extent. No need to adjust the base.
                 known_size_dims[split.outer] = iter->second / split.factor;
-            } else if (!is_update) {
+            } else if (tail == Tail_ShiftInwards) {
                 // Adjust the base downwards to not compute off the
                 // end of the realization.
 
@@ -174,8 +229,13 @@ Stmt build_provide_loop_nest(Function f,
 
             string base_name = prefix + split.inner + ".base";
             Expr base_var = Variable::make(Int(32), base_name);
-            //stmt = LetStmt::make(prefix + split.old_var, base_var + inner, stmt);
-            stmt = substitute(prefix + split.old_var, base_var + inner, stmt);
+            if (!divides && tail == Tail_GuardWithIf) {
+                // Skip the points past the end of the old extent.
+                stmt = guard_provide(stmt, prefix + split.old_var, base_var + inner, old_max);
+            } else {
+                //stmt = LetStmt::make(prefix + split.old_var, base_var + inner, stmt);
+                stmt = substitute(prefix + split.old_var, base_var + inner, stmt);
+            }
 
             // Don't put the let here, put it just inside the loop over outer
             stmt = LetStmt::make(base_name, base, stmt);
@@ -331,6 +391,12 @@ Stmt build_produce(Function f) {
                 extern_call_args.push_back(args[j].expr);
             } else if (args[j].is_func()) {
                 Function input(args[j].func);
+                if (input.dimensions() > 4) {
+                    std::cerr << "Can't pass " << input.name() << " to the extern stage "
+                              << f.name() << ", because it has " << input.dimensions()
+                              << " dimensions, and a buffer_t has at most four.\n";
+                    assert(false);
+                }
                 for (int k = 0; k < input.outputs(); k++) {
                     string buf_name = input.name();
                     if (input.outputs() > 1) {
@@ -355,12 +421,45 @@ Stmt build_produce(Function f) {
             }
         }
 
+        // The region each call computes. If the extern stage is
+        // split into tiles, it's one tile, and there's a loop over
+        // the outer var of each split.
+        const Schedule &s = f.schedule();
+        string stage_name = f.name() + ".s0.";
+        vector<Expr> mins, maxs;
+        for (int k = 0; k < f.dimensions(); k++) {
+            string var = stage_name + f.args()[k];
+            mins.push_back(Variable::make(Int(32), var + ".min"));
+            maxs.push_back(Variable::make(Int(32), var + ".max"));
+        }
+        set<string> tile_loops;
+        for (size_t i = 0; i < s.splits.size(); i++) {
+            const Schedule::Split &split = s.splits[i];
+            const vector<string> &f_args = f.args();
+            int k = (int)(std::find(f_args.begin(), f_args.end(), split.old_var) - f_args.begin());
+            if (!split.is_split() || k == f.dimensions() ||
+                !mins[k].as<Variable>()) {
+                std::cerr << "Can't schedule the extern stage " << f.name()
+                          << ", because its dimensions may only be split, "
+                          << "and each of them at most once.\n";
+                assert(false);
+            }
+            // The tiles at the end are smaller.
+            string var = stage_name + split.old_var;
+            Expr outer = Variable::make(Int(32), stage_name + split.outer);
+            mins[k] = outer * split.factor + Variable::make(Int(32), var + ".loop_min");
+            maxs[k] = Min::make(mins[k] + (split.factor - 1),
+                                Variable::make(Int(32), var + ".loop_max"));
+            tile_loops.insert(split.outer);
+        }
+        bool tiled = !tile_loops.empty();
+
         // Grab the buffer_ts representing the output. If the store
         // level matches the compute level, then we can use the ones
         // already injected by allocation bounds inference. If it's
         // the output to the pipeline then it will similarly be in the
         // symbol table.
-        if (f.schedule().store_level == f.schedule().compute_level) {
+        if (!tiled && s.store_level == s.compute_level) {
             for (int j = 0; j < f.outputs(); j++) {
                 string buf_name = f.name();
                 if (f.outputs() > 1) {
@@ -377,28 +476,19 @@ Stmt build_produce(Function f) {
             if (f.outputs() > 1) {
                 stride_name += ".0";
             }
-            string stage_name = f.name() + ".s0.";
             for (int j = 0; j < f.outputs(); j++) {
 
                 vector<Expr> buffer_args(2);
 
-                vector<Expr> top_left;
-                for (int k = 0; k < f.dimensions(); k++) {
-                    string var = stage_name + f.args()[k];
-                    top_left.push_back(Variable::make(Int(32), var + ".min"));
-                }
-                Expr host_ptr = Call::make(f, top_left, j);
+                Expr host_ptr = Call::make(f, mins, j);
                 host_ptr = Call::make(Handle(), Call::address_of, vec(host_ptr), Call::Intrinsic);
 
                 buffer_args[0] = host_ptr;
                 buffer_args[1] = f.output_types()[j].bytes();
                 for (int k = 0; k < f.dimensions(); k++) {
-                    string var = stage_name + f.args()[k];
-                    Expr min = Variable::make(Int(32), var + ".min");
-                    Expr max = Variable::make(Int(32), var + ".max");
                     Expr stride = Variable::make(Int(32), stride_name + ".stride." + int_to_string(k));
-                    buffer_args.push_back(min);
-                    buffer_args.push_back(max - min + 1);
+                    buffer_args.push_back(mins[k]);
+                    buffer_args.push_back(maxs[k] - mins[k] + 1);
                     buffer_args.push_back(stride);
                 }
 
@@ -426,6 +516,61 @@ Stmt build_produce(Function f) {
             check = LetStmt::make(lets[i].first, lets[i].second, check);
         }
 
+        if (!tiled) {
+            return check;
+        }
+
+        // Wrap the loops over tiles, innermost first. The other dims
+        // are covered by each call.
+        for (size_t i = 0; i < s.dims.size(); i++) {
+            const Schedule::Dim &dim = s.dims[i];
+            if (!tile_loops.count(dim.var)) {
+                if (dim.for_type != For::Serial) {
+                    std::cerr << "Can't make the loop over " << dim.var << " of the extern stage "
+                              << f.name() << " anything but serial, because the extern stage "
+                              << "computes all of it in each call. Only the loops over tiles "
+                              << "can be scheduled.\n";
+                    assert(false);
+                }
+                continue;
+            }
+            if (dim.for_type == For::Parallel && !f.extern_is_thread_safe()) {
+                std::cerr << "Can't compute the tiles of the extern stage " << f.name()
+                          << " in parallel, because it wasn't defined as thread safe.\n";
+                assert(false);
+            }
+            if (dim.for_type == For::Vectorized || dim.for_type == For::Jammed) {
+                std::cerr << "Can't vectorize or jam the loop over " << dim.var
+                          << " of the extern stage " << f.name() << "\n";
+                assert(false);
+            }
+            string var = stage_name + dim.var;
+            check = For::make(var, Variable::make(Int(32), var + ".loop_min"),
+                              Variable::make(Int(32), var + ".loop_extent"),
+                              dim.for_type, check);
+        }
+
+        // Define the bounds of the loops, the same way as for other
+        // functions.
+        for (size_t i = s.splits.size(); i > 0; i--) {
+            const Schedule::Split &split = s.splits[i-1];
+            string var = stage_name + split.old_var;
+            Expr old_min = Variable::make(Int(32), var + ".loop_min");
+            Expr old_max = Variable::make(Int(32), var + ".loop_max");
+            Expr outer_extent = (old_max - old_min + split.factor)/split.factor;
+            string outer = stage_name + split.outer;
+            check = LetStmt::make(outer + ".loop_min", 0, check);
+            check = LetStmt::make(outer + ".loop_max", outer_extent - 1, check);
+            check = LetStmt::make(outer + ".loop_extent", outer_extent, check);
+        }
+        for (int k = 0; k < f.dimensions(); k++) {
+            string var = stage_name + f.args()[k];
+            Expr min = Variable::make(Int(32), var + ".min");
+            Expr max = Variable::make(Int(32), var + ".max");
+            check = LetStmt::make(var + ".loop_min", min, check);
+            check = LetStmt::make(var + ".loop_max", max, check);
+        }
+
         return check;
     } else {
 
@@ -493,6 +638,19 @@ vector<Stmt> build_update(Function f) {
     return updates;
 }
 
+// Make a copy of a stage for each of the function's specializations,
+// and an if-tree that picks the first one whose condition holds. The
+// simplifier then makes use of the condition within each copy.
+Stmt specialize_stage(Stmt s, Function func) {
+    const vector<Expr> &conditions = func.schedule().specializations;
+    if (!s.defined()) return s;
+    Stmt result = s;
+    for (size_t i = conditions.size(); i > 0; i--) {
+        result = IfThenElse::make(conditions[i-1], s, result);
+    }
+    return result;
+}
+
 pair<Stmt, Stmt> build_production(Function func) {
     Stmt produce = build_produce(func);
     vector<Stmt> updates = build_update(func);
@@ -502,7 +660,8 @@ pair<Stmt, Stmt> build_production(Function func) {
     for (size_t s = updates.size(); s > 0; s--) {
         merged_updates = Block::make(updates[s-1], merged_updates);
     }
-    return make_pair(produce, merged_updates);
+    return make_pair(specialize_stage(produce, func),
+                     specialize_stage(merged_updates, func));
 }
 
 // A schedule may include explicit bounds on some dimension. This
@@ -549,7 +708,7 @@ class IsUsedInStmt : public IRVisitor {
     // A reference to the function's buffers counts as a use
     void visit(const Variable *op) {
         if (op->type == Handle() &&
-            starts_with(op->name, func + ".") &&
+            starts_with(op->name, func, '.') &&
             ends_with(op->name, ".buffer")) {
             result = true;
         }
@@ -758,7 +917,7 @@ public:
     }
 };
 
-vector<string> realization_order(string output, const map<string, Function> &env, map<string, set<string> > &graph) {
+vector<string> realization_order(const vector<string> &outputs, const map<string, Function> &env, map<string, set<string> > &graph) {
     // Make a DAG representing the pipeline. Each function maps to the set describing its inputs.
     // Populate the graph
     for (map<string, Function>::const_iterator iter = env.begin();
@@ -771,41 +930,66 @@ vector<string> realization_order(string output, const map<string, Function> &env
         }
     }
 
-    vector<string> result;
-    set<string> result_set;
+    // Count the inputs that still need to be realized before each
+    // function can be, and note who consumes each function.
+    map<string, int> waiting_on;
+    map<string, vector<string> > consumers;
+    for (map<string, Function>::const_iterator iter = env.begin();
+         iter != env.end(); ++iter) {
+        const string &f = iter->first;
+        int &count = waiting_on[f];
+        map<string, set<string> >::const_iterator inputs = graph.find(f);
+        if (inputs == graph.end()) continue;
+        for (set<string>::const_iterator i = inputs->second.begin();
+             i != inputs->second.end(); ++i) {
+            if (*i != f) {
+                count++;
+                consumers[*i].push_back(f);
+            }
+        }
+    }
+
+    // Repeatedly sweep over the functions in order of name, and
+    // realize each one whose inputs have all been realized. A
+    // function that becomes ready during a sweep is picked up later
+    // in the same sweep if its name comes after the function that
+    // made it ready, and otherwise in the next sweep. Rather than
+    // sweeping over every function, keep the ready ones for this
+    // sweep and the next in sets.
+    set<string> this_sweep, next_sweep;
+    for (map<string, int>::iterator iter = waiting_on.begin();
+         iter != waiting_on.end(); ++iter) {
+        if (iter->second == 0) this_sweep.insert(iter->first);
+    }
 
+    set<string> outputs_left(outputs.begin(), outputs.end());
+    vector<string> result;
     while (true) {
-        // Find a function not in result_set, for which all its inputs are
-        // in result_set. Stop when we reach the output function.
-        bool scheduled_something = false;
-        // Inject a dummy use of this var in case asserts are off.
-        (void)scheduled_something;
-        for (map<string, Function>::const_iterator iter = env.begin();
-             iter != env.end(); ++iter) {
-            const string &f = iter->first;
-            if (result_set.find(f) == result_set.end()) {
-                bool good_to_schedule = true;
-                const set<string> &inputs = graph[f];
-                for (set<string>::const_iterator i = inputs.begin();
-                     i != inputs.end(); ++i) {
-                    if (*i != f && result_set.find(*i) == result_set.end()) {
-                        good_to_schedule = false;
+        assert(!this_sweep.empty() &&
+               "Stuck in a loop computing a realization order. Perhaps this pipeline has a loop?");
+
+        while (!this_sweep.empty()) {
+            string f = *this_sweep.begin();
+            this_sweep.erase(this_sweep.begin());
+            result.push_back(f);
+            debug(4) << "Realization order: " << f << "\n";
+            outputs_left.erase(f);
+            if (outputs_left.empty()) return result;
+
+            const vector<string> &c = consumers[f];
+            for (size_t i = 0; i < c.size(); i++) {
+                if (--waiting_on[c[i]] == 0) {
+                    if (c[i] > f) {
+                        this_sweep.insert(c[i]);
+                    } else {
+                        next_sweep.insert(c[i]);
                     }
                 }
-
-                if (good_to_schedule) {
-                    scheduled_something = true;
-                    result_set.insert(f);
-                    result.push_back(f);
-                    debug(4) << "Realization order: " << f << "\n";
-                    if (f == output) return result;
-                }
             }
         }
 
-        assert(scheduled_something && "Stuck in a loop computing a realization order. Perhaps this pipeline has a loop?");
+        this_sweep.swap(next_sweep);
     }
-
 }
 
 Stmt create_initial_loop_nest(Function f, const Target &t) {
@@ -821,6 +1005,23 @@ Stmt create_initial_loop_nest(Function f, const Target &t) {
     }
 }
 
+// The loop nests of several outputs, computed one after the other.
+Stmt create_initial_loop_nest(const vector<Function> &outputs, const Target &t) {
+    Stmt s;
+    for (size_t i = outputs.size(); i > 0; i--) {
+        Stmt nest = create_initial_loop_nest(outputs[i-1], t);
+        s = s.defined() ? Block::make(nest, s) : nest;
+    }
+    return s;
+}
+
+bool is_output(Function f, const vector<Function> &outputs) {
+    for (size_t i = 0; i < outputs.size(); i++) {
+        if (f.same_as(outputs[i])) return true;
+    }
+    return false;
+}
+
 class ComputeLegalSchedules : public IRVisitor {
 public:
     vector<Schedule::LoopLevel> loops_allowed;
@@ -872,7 +1073,7 @@ private:
 
     void visit(const Variable *v) {
         if (v->type == Handle() &&
-            starts_with(v->name, func.name() + ".") &&
+            starts_with(v->name, func.name(), '.') &&
             ends_with(v->name, ".buffer")) {
             register_use();
         }
@@ -904,6 +1105,161 @@ string schedule_to_source(Function f,
     return ss.str();
 }
 
+namespace {
+
+// Does the loop nest of an update visit its reduction domain in a
+// different order than the definition? Splitting a reduction variable
+// keeps the order, but putting the loops of one inside those of one
+// that was inside it, or the inner loop of a split outside the outer
+// one, changes it. Pure variables may be anywhere.
+bool update_changes_order(const ReductionDefinition &r) {
+    const vector<ReductionVariable> &rvars = r.domain.domain();
+    const vector<Schedule::Dim> &dims = r.schedule.dims;
+    const vector<Schedule::Split> &splits = r.schedule.splits;
+
+    // The index of the reduction variable each loop var comes from.
+    map<string, int> origin;
+    for (size_t j = 0; j < rvars.size(); j++) {
+        origin[rvars[j].var] = (int)j;
+    }
+    for (size_t j = 0; j < splits.size(); j++) {
+        const Schedule::Split &split = splits[j];
+        if (split.is_fuse()) {
+            map<string, int>::iterator iter = origin.find(split.inner);
+            if (iter == origin.end()) iter = origin.find(split.outer);
+            if (iter != origin.end()) origin[split.old_var] = iter->second;
+        } else if (origin.count(split.old_var)) {
+            origin[split.outer] = origin[split.old_var];
+            if (split.is_split()) origin[split.inner] = origin[split.old_var];
+        }
+    }
+
+    // The reduction variables must be in order, innermost first.
+    map<string, int> position;
+    int last = -1;
+    for (size_t j = 0; j < dims.size(); j++) {
+        position[dims[j].var] = (int)j;
+        map<string, int>::iterator iter = origin.find(dims[j].var);
+        if (iter == origin.end()) continue;
+        if (iter->second < last) return true;
+        last = iter->second;
+    }
+
+    // Each loop var made from the inner var of a split must be
+    // inside each one made from the outer var. Walk the splits
+    // backwards to find the range of loop positions each var ends up
+    // in.
+    map<string, pair<int, int> > range;
+    for (map<string, int>::iterator iter = position.begin(); iter != position.end(); ++iter) {
+        range[iter->first] = pair<int, int>(iter->second, iter->second);
+    }
+    for (size_t j = splits.size(); j > 0; j--) {
+        const Schedule::Split &split = splits[j-1];
+        if (!split.is_split() || !origin.count(split.old_var)) {
+            if (split.is_rename() && range.count(split.outer)) {
+                range[split.old_var] = range[split.outer];
+            }
+            continue;
+        }
+        if (!range.count(split.inner) || !range.count(split.outer)) continue;
+        pair<int, int> inner = range[split.inner], outer = range[split.outer];
+        if (inner.second > outer.first) return true;
+        range[split.old_var] = pair<int, int>(inner.first, outer.second);
+    }
+    return false;
+}
+
+// Finds the calls to a function.
+class CallsToFunction : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &name;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type == Call::Halide && op->name == name) {
+            calls.push_back(op);
+        }
+    }
+public:
+    vector<const Call *> calls;
+    CallsToFunction(const string &n) : name(n) {}
+};
+
+bool args_equal(const vector<Expr> &a, const vector<Expr> &b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (!equal(a[i], b[i])) return false;
+    }
+    return true;
+}
+
+// Does the result of an update not depend on the order in which it
+// visits its reduction domain? It doesn't if each point of the domain
+// reads and writes only its own site, or if the update is
+// f(args) = f(args) op e for a commutative and associative op, where
+// e doesn't read f.
+bool update_order_insensitive(Function f, const ReductionDefinition &r) {
+    CallsToFunction in_args(f.name());
+    for (size_t i = 0; i < r.args.size(); i++) {
+        r.args[i].accept(&in_args);
+    }
+    if (!in_args.calls.empty()) return false;
+
+    // Each point of the domain writes a different site if each
+    // reduction variable is an argument.
+    const vector<ReductionVariable> &rvars = r.domain.domain();
+    bool own_site = true;
+    for (size_t i = 0; i < rvars.size() && own_site; i++) {
+        bool found = false;
+        for (size_t j = 0; j < r.args.size(); j++) {
+            const Variable *v = r.args[j].as<Variable>();
+            if (v && v->name == rvars[i].var) found = true;
+        }
+        own_site = found;
+    }
+    if (own_site) {
+        CallsToFunction calls(f.name());
+        for (size_t i = 0; i < r.values.size(); i++) {
+            r.values[i].accept(&calls);
+        }
+        bool reads_own_site = true;
+        for (size_t i = 0; i < calls.calls.size(); i++) {
+            reads_own_site = reads_own_site && args_equal(calls.calls[i]->args, r.args);
+        }
+        if (reads_own_site) return true;
+    }
+
+    if (r.values.size() != 1) return false;
+    Expr a, b;
+    Expr value = r.values[0];
+    if (const Add *op = value.as<Add>()) {
+        a = op->a; b = op->b;
+    } else if (const Mul *op = value.as<Mul>()) {
+        a = op->a; b = op->b;
+    } else if (const Min *op = value.as<Min>()) {
+        a = op->a; b = op->b;
+    } else if (const Max *op = value.as<Max>()) {
+        a = op->a; b = op->b;
+    } else {
+        return false;
+    }
+    const Call *self = a.as<Call>();
+    if (!self || self->call_type != Call::Halide || self->name != f.name()) {
+        std::swap(a, b);
+        self = a.as<Call>();
+    }
+    if (!self || self->call_type != Call::Halide || self->name != f.name() ||
+        !args_equal(self->args, r.args)) {
+        return false;
+    }
+    CallsToFunction calls(f.name());
+    b.accept(&calls);
+    return calls.calls.empty();
+}
+
+}
+
 void validate_schedule(Function f, Stmt s, bool is_output) {
 
     // If f is extern, check that none of its inputs are scheduled inline.
@@ -951,31 +1307,31 @@ void validate_schedule(Function f, Stmt s, bool is_output) {
             continue;
         }
 
-        const vector<ReductionVariable> &rvars = r.domain.domain();
-        const vector<Schedule::Dim> &dims = r.schedule.dims;
+        if (!update_changes_order(r)) {
+            continue;
+        }
 
-        // Look for the rvars in order
-        size_t next = 0;
-        for (size_t j = 0; j < dims.size() && next < rvars.size(); j++) {
-            if (rvars[next].var == dims[j].var) {
-                next++;
-            }
+        if (update_order_insensitive(f, r)) {
+            debug(3) << "The order of stage " << i+1 << " of " << f.name() << " is changed, which is allowed\n";
+            continue;
         }
 
-        if (next != rvars.size()) {
-            std::cerr << "In function " << f.name() << " stage " << i
-                      << ", the reduction variables have been illegally reordered.\n"
-                      << "Correct order:";
-            for (size_t j = 0; j < rvars.size(); j++) {
-                std::cerr << " " << rvars[j].var;
-            }
-            std::cerr << "\nOrder specified by schedule:";
-            for (size_t j = 0; j < dims.size(); j++) {
-                std::cerr << " " << dims[j].var;
-            }
-            std::cerr << "\n";
-            assert(false);
+        const vector<ReductionVariable> &rvars = r.domain.domain();
+        const vector<Schedule::Dim> &dims = r.schedule.dims;
+        std::cerr << "In function " << f.name() << " stage " << i
+                  << ", the reduction variables have been illegally reordered.\n"
+                  << "Correct order:";
+        for (size_t j = 0; j < rvars.size(); j++) {
+            std::cerr << " " << rvars[j].var;
         }
+        std::cerr << "\nOrder specified by schedule:";
+        for (size_t j = 0; j < dims.size(); j++) {
+            std::cerr << " " << dims[j].var;
+        }
+        std::cerr << "\nThe order can only change if each point of the reduction domain "
+                  << "reads and writes only its own site, or the update is a sum, product, "
+                  << "minimum or maximum of terms that don't read " << f.name() << ".\n";
+        assert(false);
     }
 
     Schedule::LoopLevel store_at = f.schedule().store_level;
@@ -1024,7 +1380,17 @@ void validate_schedule(Function f, Stmt s, bool is_output) {
     }
 }
 
-Stmt schedule_functions(Stmt s, const vector<string> &order,
+// Inline the functions waiting to be inlined, if there are any.
+Stmt inline_pending(Stmt s, vector<Function> &funcs) {
+    if (funcs.empty()) return s;
+    s = inline_functions(s, funcs);
+    funcs.clear();
+    debug(2) << s << '\n';
+    return s;
+}
+
+Stmt schedule_functions(Stmt s, const vector<Function> &outputs,
+                        const vector<string> &order,
                         const map<string, Function> &env,
                         const map<string, set<string> > &graph, const Target &t) {
 
@@ -1032,27 +1398,42 @@ Stmt schedule_functions(Stmt s, const vector<string> &order,
     string root_var = Schedule::LoopLevel::root().func + "." + Schedule::LoopLevel::root().var;
     s = For::make(root_var, 0, 1, For::Serial, s);
 
+    // Runs of functions to be inlined are inlined together, in one
+    // pass over the statement.
+    vector<Function> to_inline;
+
     for (size_t i = order.size(); i > 0; i--) {
         Function f = env.find(order[i-1])->second;
 
-        validate_schedule(f, s, i == order.size());
+        bool inlined = (f.has_pure_definition() &&
+                        !f.has_reduction_definition() &&
+                        f.schedule().compute_level.is_inline());
 
-        // We don't actually want to schedule the output function here.
-        if (i == order.size()) continue;
+        // Validating the schedule of a function stored and computed
+        // inline doesn't look at the statement, so it can wait.
+        if (!inlined || !f.schedule().store_level.is_inline()) {
+            s = inline_pending(s, to_inline);
+        }
+
+        bool output = is_output(f, outputs);
+        validate_schedule(f, s, output);
 
-        if (f.has_pure_definition() &&
-            !f.has_reduction_definition() &&
-            f.schedule().compute_level.is_inline()) {
+        // We don't actually want to schedule the output functions here.
+        if (output) continue;
+
+        if (inlined) {
             debug(1) << "Inlining " << order[i-1] << '\n';
-            s = inline_function(s, f);
+            to_inline.push_back(f);
         } else {
+            s = inline_pending(s, to_inline);
             debug(1) << "Injecting realization of " << order[i-1] << '\n';
             InjectRealization injector(f, t);
             s = injector.mutate(s);
             assert(injector.found_store_level && injector.found_compute_level);
+            debug(2) << s << '\n';
         }
-        debug(2) << s << '\n';
     }
+    s = inline_pending(s, to_inline);
 
     // We can remove the loop over root now
     const For *root_loop = s.as<For>();
@@ -1132,10 +1513,12 @@ Stmt add_parameter_checks(Stmt s, const Target &t) {
 // inserted. The second is a piece of code which will rewrite the
 // buffer_t sizes, mins, and strides in order to satisfy the
 // requirements.
-Stmt add_image_checks(Stmt s, Function f, const Target &t, const FuncValueBounds &fb) {
+Stmt add_image_checks(Stmt s, const vector<Function> &outputs, const Target &t,
+                      const FuncValueBounds &fb) {
 
     bool no_asserts = t.features & Target::NoAsserts;
     bool no_bounds_query = t.features & Target::NoBoundsQuery;
+    bool large_buffers = t.features & Target::LargeBuffers;
 
     // First hunt for all the referenced buffers
     FindBuffers finder;
@@ -1143,15 +1526,18 @@ Stmt add_image_checks(Stmt s, Function f, const Target &t, const FuncValueBounds
     map<string, FindBuffers::Result> bufs = finder.buffers;
 
     // Add the output buffer(s)
-    for (size_t i = 0; i < f.values().size(); i++) {
-        FindBuffers::Result output_buffer;
-        output_buffer.type = f.values()[i].type();
-        output_buffer.param = f.output_buffers()[i];
-        output_buffer.dimensions = f.dimensions();
-        if (f.values().size() > 1) {
-            bufs[f.name() + '.' + int_to_string(i)] = output_buffer;
-        } else {
-            bufs[f.name()] = output_buffer;
+    for (size_t j = 0; j < outputs.size(); j++) {
+        Function f = outputs[j];
+        for (size_t i = 0; i < f.values().size(); i++) {
+            FindBuffers::Result output_buffer;
+            output_buffer.type = f.values()[i].type();
+            output_buffer.param = f.output_buffers()[i];
+            output_buffer.dimensions = f.dimensions();
+            if (f.values().size() > 1) {
+                bufs[f.name() + '.' + int_to_string(i)] = output_buffer;
+            } else {
+                bufs[f.name()] = output_buffer;
+            }
         }
     }
 
@@ -1211,15 +1597,20 @@ Stmt add_image_checks(Stmt s, Function f, const Target &t, const FuncValueBounds
         Type type = iter->second.type;
         int dimensions = iter->second.dimensions;
 
-        // Detect if this is one of the outputs of a multi-output pipeline.
+        // Detect if this is one of the outputs of the pipeline, and
+        // if so, one of the later buffers of a Tuple-valued output.
         bool is_output_buffer = false;
         bool is_secondary_output_buffer = false;
-        for (size_t i = 0; i < f.output_buffers().size(); i++) {
-            if (param.defined() &&
-                param.same_as(f.output_buffers()[i])) {
-                is_output_buffer = true;
-                if (i > 0) {
-                    is_secondary_output_buffer = true;
+        Function f;
+        for (size_t j = 0; j < outputs.size(); j++) {
+            for (size_t i = 0; i < outputs[j].output_buffers().size(); i++) {
+                if (param.defined() &&
+                    param.same_as(outputs[j].output_buffers()[i])) {
+                    is_output_buffer = true;
+                    f = outputs[j];
+                    if (i > 0) {
+                        is_secondary_output_buffer = true;
+                    }
                 }
             }
         }
@@ -1252,6 +1643,18 @@ Stmt add_image_checks(Stmt s, Function f, const Target &t, const FuncValueBounds
             asserts_elem_size.push_back(AssertStmt::make(elem_size == correct_size, error_msg.str(), vec<Expr>(elem_size)));
         }
 
+        // Check the host pointer has the alignment it was declared to
+        // have, which codegen relies on.
+        if (param.defined() && param.host_alignment() > 1) {
+            Expr host = Variable::make(Handle(), name + ".host");
+            Expr address = reinterpret(UInt(64), host);
+            int alignment = param.host_alignment();
+            ostringstream error_msg;
+            error_msg << error_name << " is not aligned to " << alignment << " bytes";
+            asserts_elem_size.push_back(AssertStmt::make((address % make_const(UInt(64), alignment)) == make_zero(UInt(64)),
+                                                         error_msg.str(), vector<Expr>()));
+        }
+
         // Check that the region passed in (after applying constraints) is within the region used
         debug(3) << "In image " << name << " region touched is:\n";
 
@@ -1316,14 +1719,18 @@ Stmt add_image_checks(Stmt s, Function f, const Target &t, const FuncValueBounds
             // for extra safety. Ultimately we will want to make
             // Halide handle larger single buffers, at least on 64-bit
             // systems.
+            // With large buffers, only the innermost dimension is
+            // indexed in 32 bits (see storage_flattening).
             Expr max_size = cast<int64_t>(1) << 31 - 1;
-            Stmt check = AssertStmt::make((cast<int64_t>(actual_extent) * actual_stride) <= max_size,
-                                          "Total allocation for buffer " + name + " exceeds 2^31 - 1",
-                                          std::vector<Expr>());
-            dims_no_overflow_asserts.push_back(check);
+            if (j == 0 || !large_buffers) {
+                Stmt check = AssertStmt::make((cast<int64_t>(actual_extent) * actual_stride) <= max_size,
+                                              "Total allocation for buffer " + name + " exceeds 2^31 - 1",
+                                              std::vector<Expr>());
+                dims_no_overflow_asserts.push_back(check);
+            }
 
             // Don't repeat extents check for secondary buffers as extents must be the same as for the first one.
-            if (!is_secondary_output_buffer) {
+            if (!is_secondary_output_buffer && !large_buffers) {
                 if (j == 0) {
                     lets_overflow.push_back(make_pair(name + ".total_extent." + dim, cast<int64_t>(actual_extent)));
                 } else {
@@ -1535,129 +1942,462 @@ Stmt add_image_checks(Stmt s, Function f, const Target &t, const FuncValueBounds
     return s;
 }
 
+struct LoweringCache {
+    mutable RefCount ref_count;
+
+    // The environment, except for the output function itself (which
+    // would then keep itself alive), and the definition version of
+    // each function in it (including the output) when it was found.
+    map<string, Function> env;
+    map<string, int> versions;
+
+    vector<string> order;
+    map<string, set<string> > graph;
+    FuncValueBounds func_bounds;
+
+    bool valid_for(Function f) const {
+        for (map<string, int>::const_iterator iter = versions.begin();
+             iter != versions.end(); ++iter) {
+            Function g = f;
+            if (iter->first != f.name()) {
+                map<string, Function>::const_iterator g_iter = env.find(iter->first);
+                assert(g_iter != env.end());
+                g = g_iter->second;
+            }
+            if (g.definition_version() != iter->second) {
+                return false;
+            }
+        }
+        return !versions.empty();
+    }
+};
+
+template<>
+EXPORT RefCount &ref_count<LoweringCache>(const LoweringCache *c) {return c->ref_count;}
+
+template<>
+EXPORT void destroy<LoweringCache>(const LoweringCache *c) {delete c;}
+
+// Compute the environment, the realization order, and the bounds of
+// each function's value. None of these depend on the schedule, so
+// during schedule exploration they're reused until a Func in the
+// pipeline gets a new definition.
+IntrusivePtr<LoweringCache> algorithm_analyses(Function f) {
+    IntrusivePtr<LoweringCache> &cache = f.lowering_cache();
+    if (cache.defined() && cache.ptr->valid_for(f)) {
+        debug(1) << "Reusing the analyses of the algorithm from the last lowering\n";
+        return cache;
+    }
+
+    LoweringCache *c = new LoweringCache;
+    map<string, Function> env = find_transitive_calls(f);
+    c->order = realization_order(vec<string>(f.name()), env, c->graph);
+
+    debug(1) << "Computing bounds of each function's value\n";
+    c->func_bounds = compute_function_value_bounds(c->order, env);
+
+    for (map<string, Function>::iterator iter = env.begin();
+         iter != env.end(); ++iter) {
+        c->versions[iter->first] = iter->second.definition_version();
+        if (iter->first != f.name()) {
+            c->env[iter->first] = iter->second;
+        }
+    }
+
+    cache = c;
+    return cache;
+}
+
+// The same analyses for a pipeline with several outputs. These aren't
+// cached, because no one Function owns them.
+IntrusivePtr<LoweringCache> algorithm_analyses(const vector<Function> &outputs) {
+    if (outputs.size() == 1) {
+        return algorithm_analyses(outputs[0]);
+    }
+
+    LoweringCache *c = new LoweringCache;
+    map<string, Function> env;
+    vector<string> names;
+    for (size_t i = 0; i < outputs.size(); i++) {
+        map<string, Function> calls = find_transitive_calls(outputs[i]);
+        env.insert(calls.begin(), calls.end());
+        env[outputs[i].name()] = outputs[i];
+        names.push_back(outputs[i].name());
+    }
+    c->order = realization_order(names, env, c->graph);
+
+    for (size_t i = 0; i < outputs.size(); i++) {
+        const set<string> &inputs = c->graph[outputs[i].name()];
+        for (size_t j = 0; j < outputs.size(); j++) {
+            if (i != j && inputs.count(outputs[j].name())) {
+                std::cerr << "Output " << outputs[i].name() << " of a pipeline calls "
+                          << outputs[j].name() << ", which is also an output. "
+                          << "Compute the values they share in a Func that isn't an output.\n";
+                assert(false);
+            }
+        }
+    }
+
+    debug(1) << "Computing bounds of each function's value\n";
+    c->func_bounds = compute_function_value_bounds(c->order, env);
+
+    for (map<string, Function>::iterator iter = env.begin();
+         iter != env.end(); ++iter) {
+        if (!is_output(iter->second, outputs)) {
+            c->env[iter->first] = iter->second;
+        }
+    }
+
+    return c;
+}
+
 Stmt lower(Function f, const Target &t) {
+    return lower(vec<Function>(f), t);
+}
+
+Stmt lower(const vector<Function> &outputs, const Target &t) {
+    assert(!outputs.empty() && "Can't lower a pipeline with no outputs");
+
+    for (size_t i = 0; i < outputs.size(); i++) {
+        Function f = outputs[i];
+        if (f.dimensions() > 4) {
+            std::cerr << "Can't compile a pipeline whose output " << f.name() << " has "
+                      << f.dimensions() << " dimensions, because a buffer_t has at most four. "
+                      << "Funcs inside the pipeline may have more.\n";
+            assert(false);
+        }
+    }
+
+    // The first output names the pipeline.
+    Function f = outputs[0];
+
+    PassManager passes;
+
+    IntrusivePtr<LoweringCache> cache = algorithm_analyses(outputs);
+    const LoweringCache &analyses = *cache.ptr;
 
     // Compute an environment
-    map<string, Function> env = find_transitive_calls(f);
+    map<string, Function> env = analyses.env;
+    for (size_t i = 0; i < outputs.size(); i++) {
+        env[outputs[i].name()] = outputs[i];
+    }
 
     // Compute a realization order
-    map<string, set<string> > graph;
-    vector<string> order = realization_order(f.name(), env, graph);
-    Stmt s = create_initial_loop_nest(f, t);
+    const map<string, set<string> > &graph = analyses.graph;
+    vector<string> order = analyses.order;
+
+    if (outputs.size() == 1 && !f.schedule().estimates.empty()) {
+        debug(1) << "Choosing schedules automatically...\n";
+        auto_schedule(f, order, env, t);
+    }
+
+    choose_vector_widths(env, t);
+
+    check_in_place(outputs, env);
+
+    // Functions evaluated at compile time are read from tables, and
+    // aren't scheduled.
+    map<string, Buffer> tables = compute_tables(outputs, order, env, analyses.func_bounds);
+    if (!tables.empty()) {
+        order = remove_tabulated(order, graph, outputs, tables);
+    }
+
+    Stmt s = create_initial_loop_nest(outputs, t);
 
     debug(2) << "Initial statement: " << '\n' << s << '\n';
-    s = schedule_functions(s, order, env, graph, t);
+    s = schedule_functions(s, outputs, order, env, graph, t);
+    s = use_tables(s, tables);
     debug(2) << "All realizations injected:\n" << s << '\n';
 
-    debug(1) << "Injecting tracing...\n";
-    s = inject_tracing(s, env, f);
-    debug(2) << "Tracing injected:\n" << s << '\n';
+    if (passes.begin("skip_iterations", "Skipping inactive loop iterations...", s)) {
+        s = skip_inactive_iterations(s, env);
+        debug(2) << "Inactive loop iterations skipped:\n" << s << '\n';
+    }
+
+    if (t.has_gpu_feature() &&
+        passes.begin("split_devices", "Splitting functions between the cpu and the gpu...", s)) {
+        s = split_devices(s, env);
+        debug(2) << "Functions split between devices:\n" << s << '\n';
+    }
 
-    debug(1) << "Injecting profiling...\n";
-    s = inject_profiling(s, f.name());
-    debug(2) << "Profiling injected:\n" << s << '\n';
+    if (passes.begin("distribute", "Dividing functions between ranks...", s)) {
+        s = distribute_functions(s, env, outputs);
+        debug(2) << "Functions divided between ranks:\n" << s << '\n';
+    }
 
-    debug(1) << "Adding checks for parameters\n";
-    s = add_parameter_checks(s, t);
-    debug(2) << "Parameter checks injected:\n" << s << '\n';
+    if (passes.begin("tracing", "Injecting tracing...", s)) {
+        s = inject_tracing(s, env, outputs);
+        debug(2) << "Tracing injected:\n" << s << '\n';
+    }
 
-    // Compute the maximum and minimum possible value of each
-    // function. Used in later bounds inference passes.
-    debug(1) << "Computing bounds of each function's value\n";
-    FuncValueBounds func_bounds = compute_function_value_bounds(order, env);
+    if (passes.begin("profiling", "Injecting profiling...", s)) {
+        s = inject_profiling(s, f.name(), t);
+        debug(2) << "Profiling injected:\n" << s << '\n';
+    }
+
+    if (passes.begin("parameter_checks", "Adding checks for parameters", s)) {
+        s = add_parameter_checks(s, t);
+        debug(2) << "Parameter checks injected:\n" << s << '\n';
+    }
+
+    // The maximum and minimum possible value of each function. Used
+    // in later bounds inference passes.
+    const FuncValueBounds &func_bounds = analyses.func_bounds;
 
     // The checks will be in terms of the symbols defined by bounds
     // inference.
-    debug(1) << "Adding checks for images\n";
-    s = add_image_checks(s, f, t, func_bounds);
-    debug(2) << "Image checks injected:\n" << s << '\n';
+    if (passes.begin("image_checks", "Adding checks for images", s)) {
+        s = add_image_checks(s, outputs, t, func_bounds);
+        debug(2) << "Image checks injected:\n" << s << '\n';
+    }
 
     // This pass injects nested definitions of variable names, so we
     // can't simplify statements from here until we fix them up. (We
     // can still simplify Exprs).
-    debug(1) << "Performing computation bounds inference...\n";
-    s = bounds_inference(s, order, env, func_bounds);
-    debug(2) << "Computation bounds inference:\n" << s << '\n';
+    if (passes.begin("bounds_inference", "Performing computation bounds inference...", s)) {
+        s = bounds_inference(s, outputs, order, env, func_bounds);
+        debug(2) << "Computation bounds inference:\n" << s << '\n';
+    }
 
-    debug(1) << "Performing sliding window optimization...\n";
-    s = sliding_window(s, env);
-    debug(2) << "Sliding window:\n" << s << '\n';
+    if (passes.begin("sliding_window", "Performing sliding window optimization...", s)) {
+        s = sliding_window(s, env);
+        debug(2) << "Sliding window:\n" << s << '\n';
+    }
 
-    debug(1) << "Performing allocation bounds inference...\n";
-    s = allocation_bounds_inference(s, env, func_bounds);
-    debug(2) << "Allocation bounds inference:\n" << s << '\n';
+    if (passes.begin("allocation_bounds_inference", "Performing allocation bounds inference...", s)) {
+        s = allocation_bounds_inference(s, env, func_bounds);
+        debug(2) << "Allocation bounds inference:\n" << s << '\n';
+    }
+
+    if (passes.begin("lazy_realization", "Computing lazy functions on demand...", s)) {
+        s = inject_lazy_realizations(s, env);
+        debug(2) << "Lazy realizations injected:\n" << s << '\n';
+    }
 
     // This uniquifies the variable names, so we're good to simplify
     // after this point. This lets later passes assume syntactic
     // equivalence means semantic equivalence.
-    debug(1) << "Uniquifying variable names...\n";
-    s = uniquify_variable_names(s);
-    debug(2) << "Uniquified variable names: \n" << s << "\n\n";
-
-    debug(1) << "Performing storage folding optimization...\n";
-    s = storage_folding(s);
-    debug(2) << "Storage folding:\n" << s << '\n';
-
-    debug(1) << "Injecting debug_to_file calls...\n";
-    s = debug_to_file(s, order[order.size()-1], env);
-    debug(2) << "Injected debug_to_file calls:\n" << s << '\n';
-
-    debug(1) << "Simplifying...\n"; // without removing dead lets, because storage flattening needs the strides
-    s = simplify(s, false);
-    debug(2) << "Simplified: \n" << s << "\n\n";
-
-    debug(1) << "Dynamically skipping stages...\n";
-    s = skip_stages(s, order);
-    debug(2) << "Dynamically skipped stages: \n" << s << "\n\n";
-
-    debug(1) << "Performing storage flattening...\n";
-    s = storage_flattening(s, env);
-    debug(2) << "Storage flattening: \n" << s << "\n\n";
-
-    debug(1) << "Removing code that depends on undef values...\n";
-    s = remove_undef(s);
-    debug(2) << "Removed code that depends on undef values: \n" << s << "\n\n";
-
-    debug(1) << "Simplifying...\n";
-    s = simplify(s);
-    s = unify_duplicate_lets(s);
-    s = remove_trivial_for_loops(s);
-    debug(2) << "Simplified: \n" << s << "\n\n";
-
-    debug(1) << "Unrolling...\n";
-    s = unroll_loops(s);
-    debug(2) << "Unrolled: \n" << s << "\n\n";
-
-    debug(1) << "Simplifying...\n";
-    s = simplify(s);
-    debug(2) << "Simplified: \n" << s << "\n\n";
-
-    debug(1) << "Vectorizing...\n";
-    s = vectorize_loops(s);
-    debug(2) << "Vectorized: \n" << s << "\n\n";
-
-    debug(1) << "Simplifying...\n";
-    s = simplify(s);
-    debug(2) << "Simplified: \n" << s << "\n\n";
-
-    debug(1) << "Specializing clamped ramps...\n";
-    s = specialize_clamped_ramps(s);
-    s = simplify(s);
-    debug(2) << "Specialized clamped ramps: \n" << s << "\n\n";
-
-    debug(1) << "Detecting vector interleavings...\n";
-    s = rewrite_interleavings(s);
-    debug(2) << "Rewrote vector interleavings: \n" << s << "\n\n";
-
-    debug(1) << "Injecting early frees...\n";
-    s = inject_early_frees(s);
-    debug(2) << "Injected early frees: \n" << s << "\n\n";
-
-    debug(1) << "Simplifying...\n";
-    s = common_subexpression_elimination(s);
-    s = simplify(s);
-    debug(1) << "Simplified: \n" << s << "\n\n";
+    if (passes.begin("uniquify_variable_names", "Uniquifying variable names...", s)) {
+        s = uniquify_variable_names(s);
+        debug(2) << "Uniquified variable names: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("storage_folding", "Performing storage folding optimization...", s)) {
+        s = storage_folding(s, env);
+        debug(2) << "Storage folding:\n" << s << '\n';
+    }
+
+    if (passes.begin("loop_fusion", "Fusing the loops of sibling functions...", s)) {
+        s = fuse_sibling_loops(s, env);
+        debug(2) << "Fused the loops of sibling functions:\n" << s << '\n';
+    }
+
+    if (passes.begin("debug_to_file", "Injecting debug_to_file calls...", s)) {
+        s = debug_to_file(s, outputs, env);
+        debug(2) << "Injected debug_to_file calls:\n" << s << '\n';
+    }
+
+    // Without removing dead lets, because storage flattening needs the strides.
+    if (passes.begin("simplify", "Simplifying...", s)) {
+        s = simplify(s, false);
+        debug(2) << "Simplified: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("skip_stages", "Dynamically skipping stages...", s)) {
+        s = skip_stages(s, order);
+        debug(2) << "Dynamically skipped stages: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("prefetch", "Injecting prefetches...", s)) {
+        s = inject_prefetches(s, env);
+        debug(2) << "Injected prefetches: \n" << s << "\n\n";
+    }
+
+    // The OpenCL C backend has no shared allocations yet.
+    if (t.features & (Target::CUDA | Target::SPIR | Target::SPIR64)) {
+        if (passes.begin("stage_gpu_inputs", "Staging gpu stencil inputs through shared memory...", s)) {
+            s = stage_gpu_inputs(s);
+            debug(2) << "Staged gpu stencil inputs: \n" << s << "\n\n";
+        }
+    }
+
+    if (passes.begin("storage_flattening", "Performing storage flattening...", s)) {
+        s = storage_flattening(s, env, t);
+        debug(2) << "Storage flattening: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("in_place", "Computing outputs in place of inputs...", s)) {
+        s = compute_in_place(s, outputs);
+        debug(2) << "Outputs computed in place of inputs: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("trace_summaries", "Injecting tracing summaries...", s)) {
+        s = inject_trace_summaries(s, env, outputs);
+        debug(2) << "Tracing summaries injected: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("memoization", "Injecting memoization...", s)) {
+        s = inject_memoization(s, env);
+        debug(2) << "Injected memoization: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("persistent_storage", "Injecting persistent storage...", s)) {
+        s = inject_persistent_storage(s, env);
+        debug(2) << "Injected persistent storage: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("constant_fill", "Initializing buffers to constants with memsets...", s)) {
+        s = fill_constant_initializations(s);
+        debug(2) << "Initialized buffers to constants with memsets: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("parallel_scratch", "Hoisting per-thread scratch out of parallel loops...", s)) {
+        s = hoist_parallel_scratch(s);
+        debug(2) << "Hoisted per-thread scratch: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("async_producers", "Computing independent producers concurrently...", s)) {
+        s = compute_async_producers(s, env);
+        debug(2) << "Computed independent producers concurrently: \n" << s << "\n\n";
+    }
+
+    if (t.features & Target::HugePages) {
+        if (passes.begin("first_touch", "First-touching large allocations in parallel...", s)) {
+            s = first_touch_allocations(s);
+            debug(2) << "First-touched large allocations: \n" << s << "\n\n";
+        }
+    }
+
+    if (passes.begin("inline_externs", "Inlining the bodies of extern functions...", s)) {
+        s = inline_extern_bodies(s);
+        debug(2) << "Inlined the bodies of extern functions: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("remove_undef", "Removing code that depends on undef values...", s)) {
+        s = remove_undef(s);
+        debug(2) << "Removed code that depends on undef values: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("simplify", "Simplifying...", s)) {
+        s = simplify(s);
+        s = unify_duplicate_lets(s);
+        s = remove_trivial_for_loops(s);
+        debug(2) << "Simplified: \n" << s << "\n\n";
+    }
+
+    // Code-size-optimized builds don't make extra copies of loop
+    // bodies to speed up their edges.
+    bool optimize_size = (t.features & Target::OptimizeSize) != 0;
+
+    if (!optimize_size &&
+        passes.begin("partition_loops", "Partitioning loops to simplify boundary conditions...", s)) {
+        s = run_on_loop_nests(s, partition_loops);
+        debug(2) << "Partitioned loops: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("unroll", "Unrolling...", s)) {
+        if (optimize_size) {
+            s = limit_unrolling(s, 4);
+        }
+        s = run_on_loop_nests(s, unroll_loops);
+        debug(2) << "Unrolled: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("simplify", "Simplifying...", s)) {
+        s = simplify(s);
+        debug(2) << "Simplified: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("vectorize", "Vectorizing...", s)) {
+        s = run_on_loop_nests(s, vectorize_loops);
+        debug(2) << "Vectorized: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("simplify", "Simplifying...", s)) {
+        s = simplify(s);
+        debug(2) << "Simplified: \n" << s << "\n\n";
+    }
+
+    if (!optimize_size &&
+        passes.begin("specialize_clamped_ramps", "Specializing clamped ramps...", s)) {
+        s = specialize_clamped_ramps(s);
+        s = simplify(s);
+        debug(2) << "Specialized clamped ramps: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("share_shifted_vectors", "Sharing vector subexpressions shifted by a few lanes...", s)) {
+        s = share_shifted_vectors(s);
+        debug(2) << "Shared shifted vector subexpressions: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("interleave", "Detecting vector interleavings...", s)) {
+        s = run_on_loop_nests(s, rewrite_interleavings);
+        debug(2) << "Rewrote vector interleavings: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("nontemporal_stores", "Making streaming stores non-temporal...", s)) {
+        s = use_nontemporal_stores(s, env);
+        debug(2) << "Made streaming stores non-temporal: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("early_free", "Injecting early frees...", s)) {
+        s = inject_early_frees(s);
+        debug(2) << "Injected early frees: \n" << s << "\n\n";
+    }
+
+    if (!t.has_gpu_feature() &&
+        passes.begin("reuse_allocations", "Sharing allocations between buffers...", s)) {
+        s = reuse_allocations(s);
+        debug(2) << "Shared allocations: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("simplify", "Simplifying...", s)) {
+        s = run_on_loop_nests(s, common_subexpression_elimination,
+                              common_subexpression_elimination);
+        s = simplify(s);
+        debug(1) << "Simplified: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("hoist_loop_invariants", "Hoisting loop invariants...", s)) {
+        s = hoist_loop_invariants(s);
+        debug(2) << "Hoisted loop invariants: \n" << s << "\n\n";
+    }
+
+    if ((t.features & Target::Cancellable) &&
+        passes.begin("cancellation", "Injecting cancellation checks...", s)) {
+        s = inject_cancellation_checks(s);
+        debug(2) << "Injected cancellation checks: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("profile_guided", "Counting or using loop and branch frequencies...", s)) {
+        s = profile_guided(s, f.name(), !optimize_size);
+        debug(2) << "Applied the loop and branch profile: \n" << s << "\n\n";
+    }
+
+    if (passes.begin("warp_reductions", "Reducing atomic adds across warps...", s)) {
+        s = reduce_atomics_across_warps(s, t);
+        debug(2) << "Reduced atomic adds across warps: \n" << s << "\n\n";
+    }
+
+    if ((t.features & Target::MemoryBudget) &&
+        passes.begin("memory_budget", "Estimating the peak memory...", s)) {
+        s = inject_memory_budget_check(s, f.name());
+        debug(2) << "Injected the memory budget check: \n" << s << "\n\n";
+    }
+
+    if (f.workspace().defined() &&
+        passes.begin("workspace", "Placing buffers in the workspace...", s)) {
+        s = carve_workspace(s, f.workspace(), t);
+        debug(2) << "Placed buffers in the workspace: \n" << s << "\n\n";
+    }
+
+    if ((t.features & Target::Telemetry) &&
+        passes.begin("runtime_stats", "Timing the pipeline for the runtime stats...", s)) {
+        s = inject_runtime_stats(s, f.name());
+        debug(2) << "Injected the runtime stats: \n" << s << "\n\n";
+    }
 
+    passes.end(s);
     return s;
 }
 
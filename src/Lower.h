@@ -18,6 +18,13 @@ namespace Internal {
  * on. Some stages of lowering may be target-specific. */
 Stmt lower(Function f, const Target &t);
 
+/** Create a statement that evaluates several halide functions into
+ * their own output buffers. The functions they depend on are
+ * scheduled once for all of them, so one that several outputs call
+ * is computed over the union of the regions they need. No output may
+ * call another. */
+Stmt lower(const std::vector<Function> &outputs, const Target &t);
+
 void lower_test();
 
 }
@@ -0,0 +1,305 @@
+#include "Memoization.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "IRPrinter.h"
+#include "Scope.h"
+#include "Debug.h"
+
+#include <set>
+#include <sstream>
+#include <iostream>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+using std::set;
+using std::ostringstream;
+
+namespace {
+
+// Find everything the value of a function depends on: the scalar
+// parameters and input images it reads, directly or through the
+// functions it calls, and the text of all of those definitions.
+class FindKeyDependencies : public IRVisitor {
+    set<string> visited;
+
+    using IRVisitor::visit;
+
+    void visit(const Variable *op) {
+        if (op->param.defined()) {
+            if (op->param.is_buffer()) {
+                images.insert(op->param.name());
+            } else {
+                params[op->param.name()] = op->param;
+            }
+        }
+    }
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type == Call::Image) {
+            images.insert(op->name);
+        } else if (op->call_type == Call::Halide) {
+            include(op->func);
+        }
+    }
+
+    void include(Expr e) {
+        definitions << e << "; ";
+        e.accept(this);
+    }
+
+    void include(const vector<Expr> &exprs) {
+        for (size_t i = 0; i < exprs.size(); i++) {
+            include(exprs[i]);
+        }
+    }
+
+public:
+    map<string, Parameter> params;
+    set<string> images;
+    ostringstream definitions;
+
+    void include(Function f) {
+        if (visited.count(f.name())) return;
+        visited.insert(f.name());
+
+        definitions << f.name() << "(";
+        for (size_t i = 0; i < f.args().size(); i++) {
+            definitions << f.args()[i] << ", ";
+        }
+        definitions << ") = ";
+        include(f.values());
+
+        const vector<ReductionDefinition> &reductions = f.reductions();
+        for (size_t i = 0; i < reductions.size(); i++) {
+            definitions << "update " << i << ": ";
+            include(reductions[i].args);
+            include(reductions[i].values);
+            if (reductions[i].domain.defined()) {
+                const vector<ReductionVariable> &domain = reductions[i].domain.domain();
+                for (size_t j = 0; j < domain.size(); j++) {
+                    definitions << domain[j].var << " in ";
+                    include(domain[j].min);
+                    include(domain[j].extent);
+                }
+            }
+        }
+
+        if (f.has_extern_definition()) {
+            definitions << "extern " << f.extern_function_name() << ": ";
+            const vector<ExternFuncArgument> &args = f.extern_arguments();
+            for (size_t i = 0; i < args.size(); i++) {
+                if (args[i].is_func()) {
+                    include(Function(args[i].func));
+                } else if (args[i].is_expr()) {
+                    include(args[i].expr);
+                } else if (args[i].is_buffer()) {
+                    images.insert(args[i].buffer.name());
+                } else if (args[i].is_image_param()) {
+                    images.insert(args[i].image_param.name());
+                }
+            }
+        }
+    }
+};
+
+// A 64-bit FNV-1a hash
+uint64_t hash_string(const string &s) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < s.size(); i++) {
+        h ^= (uint8_t)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Appends values to a cache key made of 32-bit words.
+class KeyBuilder {
+    void add_word64(Expr e) {
+        words.push_back(cast(UInt(32), e));
+        words.push_back(cast(UInt(32), e >> make_const(UInt(64), 32)));
+    }
+
+public:
+    vector<Expr> words;
+
+    void add(Expr e) {
+        Type t = e.type();
+        if (t.is_handle()) {
+            add_word64(reinterpret(UInt(64), e));
+            return;
+        }
+        if (t.is_float()) {
+            e = reinterpret(UInt(t.bits), e);
+        }
+        if (t.bits == 64) {
+            add_word64(e);
+        } else {
+            words.push_back(cast(UInt(32), e));
+        }
+    }
+
+    void add(uint64_t c) {
+        words.push_back(make_const(UInt(32), (int)(c & 0xffffffff)));
+        words.push_back(make_const(UInt(32), (int)(c >> 32)));
+    }
+};
+
+class InjectMemoization : public IRMutator {
+    const map<string, Function> &env;
+
+    // The buffers allocated by the program, as opposed to the output
+    // buffers passed in.
+    Scope<const Allocate *> allocated;
+
+    using IRMutator::visit;
+
+    void visit(const Allocate *op) {
+        allocated.push(op->name, op);
+        IRMutator::visit(op);
+        allocated.pop(op->name);
+    }
+
+    // Make the key words for one of the buffers of a memoized function.
+    vector<Expr> make_key(Function f, int value_index, const string &buffer) {
+        FindKeyDependencies deps;
+        deps.include(f);
+
+        KeyBuilder key;
+        key.add(hash_string(deps.definitions.str()));
+        key.words.push_back(make_const(UInt(32), value_index));
+        for (size_t i = 0; i < f.args().size(); i++) {
+            string dim = int_to_string(i);
+            key.add(Variable::make(Int(32), buffer + ".min." + dim));
+            key.add(Variable::make(Int(32), buffer + ".extent." + dim));
+        }
+        for (map<string, Parameter>::iterator iter = deps.params.begin();
+             iter != deps.params.end(); ++iter) {
+            key.add(Variable::make(iter->second.type(), iter->first, iter->second));
+        }
+        for (set<string>::iterator iter = deps.images.begin();
+             iter != deps.images.end(); ++iter) {
+            const string &name = *iter;
+            key.add(Variable::make(Handle(), name + ".host"));
+            for (int i = 0; i < 4; i++) {
+                string dim = int_to_string(i);
+                key.add(Variable::make(Int(32), name + ".min." + dim));
+                key.add(Variable::make(Int(32), name + ".extent." + dim));
+                key.add(Variable::make(Int(32), name + ".stride." + dim));
+            }
+        }
+
+        debug(3) << "Memoization key for " << buffer << " depends on:\n"
+                 << deps.definitions.str() << "\n";
+        return key.words;
+    }
+
+    Stmt memoize(const Pipeline *op, Function f) {
+        vector<string> buffers;
+        if (f.outputs() == 1) {
+            buffers.push_back(op->name);
+        } else {
+            for (int i = 0; i < f.outputs(); i++) {
+                buffers.push_back(op->name + "." + int_to_string(i));
+            }
+        }
+
+        if (!allocated.contains(buffers[0])) {
+            std::cerr << "Warning: Not memoizing " << op->name
+                      << " because it is an output of the pipeline\n";
+            return op;
+        }
+
+        const Schedule &s = f.schedule();
+        if (s.store_level.func != s.compute_level.func ||
+            s.store_level.var != s.compute_level.var) {
+            std::cerr << "Warning: Not memoizing " << op->name
+                      << " because it is stored at a different level than it is computed at\n";
+            return op;
+        }
+
+        Expr miss;
+        Stmt stores;
+        vector<string> key_names(buffers.size());
+        vector<vector<Expr> > keys(buffers.size());
+        for (size_t i = 0; i < buffers.size(); i++) {
+            key_names[i] = buffers[i] + ".memoize_key";
+            keys[i] = make_key(f, (int)i, buffers[i]);
+
+            // Copy the whole allocation, which may be padded.
+            const Allocate *alloc = allocated.get(buffers[i]);
+            Type t = alloc->type;
+            Expr size = t.bytes();
+            for (size_t j = 0; j < alloc->extents.size(); j++) {
+                size *= alloc->extents[j];
+            }
+
+            Expr key = Call::make(Handle(), Call::address_of,
+                                  vec<Expr>(Load::make(UInt(32), key_names[i], 0, Buffer(), Parameter())),
+                                  Call::Intrinsic);
+            Expr key_size = (int)keys[i].size() * 4;
+            Expr data = Call::make(Handle(), Call::address_of,
+                                   vec<Expr>(Load::make(t, buffers[i], 0, Buffer(), Parameter())),
+                                   Call::Intrinsic);
+
+            Expr lookup = Call::make(Int(32), "halide_memoization_cache_lookup",
+                                     vec(key, key_size, data, size), Call::Extern);
+            Expr store = Call::make(Int(32), "halide_memoization_cache_store",
+                                    vec(key, key_size, data, size), Call::Extern);
+
+            Expr this_miss = (lookup == 0);
+            miss = miss.defined() ? (miss || this_miss) : this_miss;
+            Stmt s = Evaluate::make(store);
+            stores = stores.defined() ? Block::make(stores, s) : s;
+        }
+
+        // Compute the function on a miss and put the result in the
+        // cache. The update steps go in the produce step so that they
+        // share the guard.
+        Stmt produce = op->produce;
+        if (op->update.defined()) {
+            produce = Block::make(produce, op->update);
+        }
+        produce = IfThenElse::make(miss, Block::make(produce, stores));
+
+        // Fill in the keys.
+        for (size_t i = buffers.size(); i > 0; i--) {
+            const vector<Expr> &words = keys[i-1];
+            Stmt fill;
+            for (size_t j = 0; j < words.size(); j++) {
+                Stmt s = Store::make(key_names[i-1], words[j], (int)j);
+                fill = fill.defined() ? Block::make(fill, s) : s;
+            }
+            produce = Block::make(fill, produce);
+            produce = Allocate::make(key_names[i-1], UInt(32), vec<Expr>((int)words.size()), produce);
+        }
+
+        return Pipeline::make(op->name, produce, Stmt(), op->consume);
+    }
+
+    void visit(const Pipeline *op) {
+        map<string, Function>::const_iterator iter = env.find(op->name);
+        if (iter != env.end() && iter->second.schedule().memoized) {
+            IRMutator::visit(op);
+            stmt = memoize(stmt.as<Pipeline>(), iter->second);
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+public:
+    InjectMemoization(const map<string, Function> &e) : env(e) {}
+};
+
+}
+
+Stmt inject_memoization(Stmt s, const map<string, Function> &env) {
+    return InjectMemoization(env).mutate(s);
+}
+
+}
+}
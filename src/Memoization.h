@@ -0,0 +1,27 @@
+#ifndef HALIDE_MEMOIZATION_H
+#define HALIDE_MEMOIZATION_H
+
+/** \file
+ * Defines the lowering pass that makes functions scheduled with
+ * Func::memoize reuse realizations kept in a runtime cache
+ */
+
+#include "IR.h"
+#include "Function.h"
+
+#include <map>
+
+namespace Halide {
+namespace Internal {
+
+/** Guard the production of each memoized function with a lookup in
+ * the runtime's memoization cache, keyed on the region realized, the
+ * parameters and input images the function depends on, and a hash of
+ * its definition. On a miss the function is computed and then
+ * stored in the cache. Must run after storage flattening. */
+Stmt inject_memoization(Stmt s, const std::map<std::string, Function> &env);
+
+}
+}
+
+#endif
@@ -0,0 +1,198 @@
+#include "MemoryBudget.h"
+#include "AllocationUtils.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "Substitute.h"
+#include "ExprUsesVar.h"
+#include "Bounds.h"
+#include "Simplify.h"
+#include "IRPrinter.h"
+#include "CodeGen_GPU_Dev.h"
+#include "Debug.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// The buffers with a bounds query flag, which are the arguments of
+// the pipeline.
+class FindQueryFlags : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Variable *op) {
+        const string suffix = ".host_and_dev_are_null";
+        if (op->name.size() > suffix.size() &&
+            op->name.compare(op->name.size() - suffix.size(), suffix.size(), suffix) == 0 &&
+            !found.contains(op->name)) {
+            found.push(op->name, 0);
+            flags.push_back(op);
+        }
+    }
+
+    Scope<int> found;
+
+public:
+    vector<Expr> flags;
+};
+
+class EstimatePeakMemory : public IRVisitor {
+    using IRVisitor::visit;
+
+    const Scope<int> &defined;
+
+    // The lets and loops around the statement being visited,
+    // outermost first. Loops have no value.
+    struct Binding {
+        string name;
+        Expr value, min, extent;
+    };
+    vector<Binding> bindings;
+
+    // The allocations that haven't been freed yet, with their sizes
+    // and how many loops and ifs they're inside of.
+    struct Live {
+        string name;
+        Expr size;
+        int depth;
+    };
+    vector<Live> live;
+
+    int depth, parallel_depth;
+
+    // Express the size of an allocation in terms of the arguments of
+    // the pipeline, replacing each loop variable by whatever value
+    // makes it largest. Undefined if that can't be done.
+    Expr lift(Expr size) {
+        for (size_t i = bindings.size(); i > 0; i--) {
+            const Binding &b = bindings[i-1];
+            if (!expr_uses_var(size, b.name)) continue;
+            if (b.value.defined()) {
+                size = substitute(b.name, b.value, size);
+            } else {
+                Scope<Interval> scope;
+                scope.push(b.name, Interval(b.min, b.min + b.extent - 1));
+                size = bounds_of_expr_in_scope(size, scope).max;
+                if (!size.defined()) return Expr();
+            }
+        }
+        UsesDefinitions uses(defined, true);
+        size.accept(&uses);
+        return uses.result ? Expr() : size;
+    }
+
+    void end_lifetime(const string &name, int d) {
+        for (size_t i = 0; i < live.size(); i++) {
+            if (live[i].name == name && live[i].depth == d) {
+                live.erase(live.begin() + i);
+                return;
+            }
+        }
+    }
+
+    void visit(const LetStmt *op) {
+        op->value.accept(this);
+        Binding b = {op->name, op->value, Expr(), Expr()};
+        bindings.push_back(b);
+        op->body.accept(this);
+        bindings.pop_back();
+    }
+
+    void visit(const For *op) {
+        // What gpu kernels allocate isn't on the heap.
+        if (CodeGen_GPU_Dev::is_gpu_var(op->name)) return;
+
+        Binding b = {op->name, Expr(), op->min, op->extent};
+        bindings.push_back(b);
+        depth++;
+        if (op->for_type == For::Parallel) parallel_depth++;
+        op->body.accept(this);
+        if (op->for_type == For::Parallel) parallel_depth--;
+        depth--;
+        bindings.pop_back();
+    }
+
+    void visit(const IfThenElse *op) {
+        depth++;
+        IRVisitor::visit(op);
+        depth--;
+    }
+
+    void visit(const Allocate *op) {
+        if (small_constant_size(op)) {
+            IRVisitor::visit(op);
+            return;
+        }
+
+        Expr size = Cast::make(Int(64), op->type.bytes());
+        for (size_t i = 0; i < op->extents.size(); i++) {
+            size = size * Cast::make(Int(64), op->extents[i]);
+        }
+        size = lift(size);
+        if (!size.defined()) {
+            debug(2) << "Leaving " << op->name << " out of the peak memory estimate, "
+                     << "because its size isn't known until the pipeline runs\n";
+            IRVisitor::visit(op);
+            return;
+        }
+        if (parallel_depth > 0) {
+            // One per thread.
+            Expr threads = Call::make(Int(32), "halide_get_num_threads", vector<Expr>(), Call::Extern);
+            size = size * Cast::make(Int(64), threads);
+        }
+
+        Expr total = size;
+        for (size_t i = 0; i < live.size(); i++) {
+            total = total + live[i].size;
+        }
+        peak = max(peak, total);
+
+        Live l = {op->name, size, depth};
+        live.push_back(l);
+        op->body.accept(this);
+        end_lifetime(op->name, depth);
+    }
+
+    void visit(const Free *op) {
+        // A free inside a loop or an if that the allocation isn't
+        // inside of might not happen.
+        end_lifetime(op->name, depth);
+    }
+
+public:
+    Expr peak;
+
+    EstimatePeakMemory(const Scope<int> &d) :
+        defined(d), depth(0), parallel_depth(0), peak(make_zero(Int(64))) {}
+};
+
+}
+
+Stmt inject_memory_budget_check(Stmt s, const string &pipeline_name) {
+    FindDefinitions defs;
+    s.accept(&defs);
+    EstimatePeakMemory estimate(defs.defined);
+    s.accept(&estimate);
+    Expr peak = simplify(estimate.peak);
+    debug(2) << "Peak memory of " << pipeline_name << ": " << peak << "\n";
+
+    FindQueryFlags queries;
+    s.accept(&queries);
+    Expr is_query = const_false();
+    for (size_t i = 0; i < queries.flags.size(); i++) {
+        is_query = is_query || queries.flags[i];
+    }
+
+    string peak_name = pipeline_name + ".peak_memory";
+    Expr check = Call::make(Int(32), Call::check_memory_budget,
+                            vec<Expr>(pipeline_name, Variable::make(Int(64), peak_name), is_query),
+                            Call::Intrinsic);
+    s = Block::make(Evaluate::make(check), s);
+    return LetStmt::make(peak_name, peak, s);
+}
+
+}
+}
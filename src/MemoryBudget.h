@@ -0,0 +1,30 @@
+#ifndef HALIDE_MEMORY_BUDGET_H
+#define HALIDE_MEMORY_BUDGET_H
+
+/** \file
+ * Defines the lowering pass that estimates the peak memory of a
+ * pipeline up front, and checks it against a budget.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Compute, at the top of the pipeline, the most bytes of internal
+ * allocations live at once, in terms of the arguments, and pass it to
+ * halide_check_memory_budget (with a check_memory_budget
+ * intrinsic). In a bounds query the estimate is only reported;
+ * otherwise, if the runtime says it's over budget, the pipeline
+ * returns halide_error_code_over_memory_budget before doing
+ * anything. Allocations in loops count at their largest over the
+ * loop, those in parallel loops once per thread, and those whose size
+ * isn't known until the pipeline runs (or that go on the stack)
+ * aren't counted. Only used for targets with the memory_budget
+ * feature. */
+Stmt inject_memory_budget_check(Stmt s, const std::string &pipeline_name);
+
+}
+}
+
+#endif
@@ -0,0 +1,113 @@
+#include "NontemporalStores.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "CodeGen_GPU_Dev.h"
+#include "Debug.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::map;
+
+namespace {
+
+class NontemporalStores : public IRMutator {
+    const map<string, Function> &env;
+
+    // The function whose producer we're in, or empty.
+    string func;
+
+    // Whether a store has been made non-temporal since the last
+    // fence.
+    bool streamed;
+
+    using IRMutator::visit;
+
+    Stmt fence(Stmt s) {
+        Expr call = Call::make(Int(32), Call::store_fence, std::vector<Expr>(), Call::Intrinsic);
+        return Block::make(s, Evaluate::make(call));
+    }
+
+    bool stores_to_func(const string &buffer) {
+        return !func.empty() && (buffer == func || starts_with(buffer, func, '.'));
+    }
+
+    Stmt mutate_producer(Stmt s) {
+        if (!s.defined()) return s;
+        streamed = false;
+        s = mutate(s);
+        return streamed ? fence(s) : s;
+    }
+
+    void visit(const Pipeline *op) {
+        map<string, Function>::const_iterator iter = env.find(op->name);
+        if (iter == env.end() || !iter->second.schedule().nontemporal) {
+            IRMutator::visit(op);
+            return;
+        }
+
+        string old_func = func;
+        bool old_streamed = streamed;
+        func = op->name;
+        Stmt produce = mutate_producer(op->produce);
+        Stmt update = mutate_producer(op->update);
+        func = old_func;
+        streamed = old_streamed;
+        Stmt consume = mutate(op->consume);
+
+        if (produce.same_as(op->produce) &&
+            update.same_as(op->update) &&
+            consume.same_as(op->consume)) {
+            stmt = op;
+        } else {
+            stmt = Pipeline::make(op->name, produce, update, consume);
+        }
+    }
+
+    void visit(const For *op) {
+        if (CodeGen_GPU_Dev::is_gpu_var(op->name)) {
+            stmt = op;
+        } else if (op->for_type == For::Parallel && !func.empty()) {
+            // Each task needs its own fence.
+            bool old_streamed = streamed;
+            streamed = false;
+            Stmt body = mutate(op->body);
+            if (streamed) {
+                stmt = For::make(op->name, op->min, op->extent, op->for_type, fence(body));
+            } else {
+                stmt = op;
+            }
+            streamed = streamed || old_streamed;
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const Store *op) {
+        const Ramp *ramp = op->index.as<Ramp>();
+        if (!stores_to_func(op->name) || op->predicate.defined() ||
+            !ramp || !is_one(ramp->stride)) {
+            stmt = op;
+            return;
+        }
+        debug(3) << "Making a store to " << op->name << " non-temporal\n";
+        Type t = op->value.type();
+        Expr dst = Load::make(t, op->name, op->index, Buffer(), Parameter());
+        Expr call = Call::make(Int(32), Call::nontemporal_store, vec(dst, op->value), Call::Intrinsic);
+        stmt = Evaluate::make(call);
+        streamed = true;
+    }
+
+public:
+    NontemporalStores(const map<string, Function> &e) : env(e), streamed(false) {}
+};
+
+}
+
+Stmt use_nontemporal_stores(Stmt s, const map<string, Function> &env) {
+    return NontemporalStores(env).mutate(s);
+}
+
+}
+}
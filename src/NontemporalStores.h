@@ -0,0 +1,28 @@
+#ifndef HALIDE_NONTEMPORAL_STORES_H
+#define HALIDE_NONTEMPORAL_STORES_H
+
+/** \file
+ * Defines the lowering pass that makes the stores of functions
+ * scheduled with Func::store_nontemporal non-temporal.
+ */
+
+#include "IR.h"
+#include "Function.h"
+
+#include <map>
+
+namespace Halide {
+namespace Internal {
+
+/** Replace the dense vector stores in the producers of functions
+ * marked store_nontemporal with nontemporal_store intrinsics, and put
+ * a store_fence at the end of each parallel loop body that makes one,
+ * and at the end of the producer. Leaves gpu loops alone. Must run
+ * after vectorization and the rewriting of interleavings, so that the
+ * stores are in their final form. */
+Stmt use_nontemporal_stores(Stmt s, const std::map<std::string, Function> &env);
+
+}
+}
+
+#endif
@@ -0,0 +1,292 @@
+#include "ParallelPasses.h"
+#include "IRMutator.h"
+#include "Debug.h"
+
+#include <stdlib.h>
+#ifndef _MSC_VER
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace Halide {
+namespace Internal {
+
+using std::vector;
+
+namespace {
+
+// A loop nest to run a pass on, wrapped in the lets it's inside.
+struct LoopNest {
+    Stmt s, result;
+};
+
+// The nodes above the loop nests. Code generation passes don't look
+// across these, so each run of other statements between them can be
+// handled on its own.
+bool is_spine(Stmt s) {
+    if (const LetStmt *let = s.as<LetStmt>()) {
+        // Passes that rewrite vector lets may add more lets next to
+        // them, which would get in the way of unwrapping.
+        return let->value.type().is_scalar();
+    }
+    return s.as<Block>() || s.as<Pipeline>() || s.as<Realize>() || s.as<Allocate>();
+}
+
+void flatten_block(Stmt s, vector<Stmt> &stmts) {
+    if (const Block *b = s.as<Block>()) {
+        flatten_block(b->first, stmts);
+        if (b->rest.defined()) {
+            flatten_block(b->rest, stmts);
+        }
+    } else {
+        stmts.push_back(s);
+    }
+}
+
+Stmt make_block(const vector<Stmt> &stmts, size_t begin, size_t end) {
+    Stmt result = stmts[end-1];
+    for (size_t i = end-1; i > begin; i--) {
+        result = Block::make(stmts[i-1], result);
+    }
+    return result;
+}
+
+// Walks the nodes above the loop nests twice: once to list the loop
+// nests, and then again to put the results back in the same order.
+class LoopNests {
+    Expr (*expr_pass)(Expr);
+    vector<const LetStmt *> lets;
+    bool rebuilding;
+    size_t next;
+
+    Expr mutate(Expr e) {
+        return (rebuilding && expr_pass) ? expr_pass(e) : e;
+    }
+
+    Stmt leaf(Stmt s) {
+        if (!rebuilding) {
+            LoopNest nest;
+            nest.s = s;
+            for (size_t i = lets.size(); i > 0; i--) {
+                nest.s = LetStmt::make(lets[i-1]->name, lets[i-1]->value, nest.s);
+            }
+            nests.push_back(nest);
+            return s;
+        }
+
+        // Unwrap the result from the lets.
+        s = nests[next++].result;
+        for (size_t i = 0; i < lets.size(); i++) {
+            const LetStmt *let = s.as<LetStmt>();
+            if (!let || let->name != lets[i]->name) {
+                ok = false;
+                return Stmt();
+            }
+            s = let->body;
+        }
+        return s;
+    }
+
+    Stmt walk(Stmt s) {
+        if (!s.defined() || !ok) {
+            return s;
+        } else if (!is_spine(s)) {
+            return leaf(s);
+        } else if (const LetStmt *op = s.as<LetStmt>()) {
+            Expr value = mutate(op->value);
+            lets.push_back(op);
+            Stmt body = walk(op->body);
+            lets.pop_back();
+            return rebuild(op, value, body);
+        } else if (const Pipeline *op = s.as<Pipeline>()) {
+            Stmt produce = walk(op->produce);
+            Stmt update = walk(op->update);
+            Stmt consume = walk(op->consume);
+            return rebuild(op, produce, update, consume);
+        } else if (const Realize *op = s.as<Realize>()) {
+            Region bounds(op->bounds.size());
+            for (size_t i = 0; i < bounds.size(); i++) {
+                bounds[i] = Range(mutate(op->bounds[i].min), mutate(op->bounds[i].extent));
+            }
+            return rebuild(op, bounds, walk(op->body));
+        } else if (const Allocate *op = s.as<Allocate>()) {
+            vector<Expr> extents(op->extents.size());
+            for (size_t i = 0; i < extents.size(); i++) {
+                extents[i] = mutate(op->extents[i]);
+            }
+            return rebuild(op, extents, walk(op->body));
+        } else {
+            // A block. Each run of statements that aren't spine nodes
+            // is one loop nest, so that passes that look at adjacent
+            // statements (e.g. interleaving stores) see all of them.
+            vector<Stmt> stmts, result;
+            flatten_block(s, stmts);
+            size_t i = 0;
+            while (i < stmts.size()) {
+                size_t j = i;
+                while (j < stmts.size() && !is_spine(stmts[j])) j++;
+                if (j > i) {
+                    result.push_back(leaf(make_block(stmts, i, j)));
+                    i = j;
+                } else {
+                    result.push_back(walk(stmts[i]));
+                    i++;
+                }
+            }
+            if (!ok) return Stmt();
+            return make_block(result, 0, result.size());
+        }
+    }
+
+public:
+    vector<LoopNest> nests;
+    bool ok;
+
+    LoopNests(Expr (*e)(Expr)) : expr_pass(e), rebuilding(false), next(0), ok(true) {}
+
+    void find(Stmt s) {
+        walk(s);
+    }
+
+    Stmt replace(Stmt s) {
+        rebuilding = true;
+        return walk(s);
+    }
+};
+
+#ifndef _MSC_VER
+// Threads that run a pass on the loop nests of one statement at a
+// time. They're started when first needed, and then wait for more
+// work for the rest of the process, so they aren't started again for
+// each statement.
+class WorkerPool {
+    pthread_mutex_t mutex, batch_mutex;
+    pthread_cond_t wake_workers, wake_owner;
+
+    Stmt (*pass)(Stmt);
+    vector<LoopNest> *nests;
+    size_t next, unfinished;
+    int num_workers;
+
+    static void *worker(void *arg) {
+        WorkerPool *pool = (WorkerPool *)arg;
+        pthread_mutex_lock(&pool->mutex);
+        while (true) {
+            if (pool->nests && pool->next < pool->nests->size()) {
+                pool->run_next();
+            } else {
+                pthread_cond_wait(&pool->wake_workers, &pool->mutex);
+            }
+        }
+        return NULL;
+    }
+
+    // Run the pass on the next loop nest. Called and returns with the
+    // mutex held.
+    void run_next() {
+        LoopNest &nest = (*nests)[next++];
+        Stmt (*p)(Stmt) = pass;
+        pthread_mutex_unlock(&mutex);
+        Stmt result = p(nest.s);
+        pthread_mutex_lock(&mutex);
+        nest.result = result;
+        if (--unfinished == 0) {
+            pthread_cond_signal(&wake_owner);
+        }
+    }
+
+public:
+    WorkerPool() : pass(NULL), nests(NULL), next(0), unfinished(0), num_workers(0) {
+        pthread_mutex_init(&mutex, NULL);
+        pthread_mutex_init(&batch_mutex, NULL);
+        pthread_cond_init(&wake_workers, NULL);
+        pthread_cond_init(&wake_owner, NULL);
+    }
+
+    void run(Stmt (*p)(Stmt), vector<LoopNest> &n, int threads) {
+        // Only one statement's loop nests at a time.
+        pthread_mutex_lock(&batch_mutex);
+        pthread_mutex_lock(&mutex);
+
+        while (num_workers < threads - 1) {
+            pthread_t thread;
+            pthread_create(&thread, NULL, worker, this);
+            pthread_detach(thread);
+            num_workers++;
+        }
+
+        pass = p;
+        nests = &n;
+        next = 0;
+        unfinished = n.size();
+        pthread_cond_broadcast(&wake_workers);
+
+        // Work on them here too, and then wait for the stragglers.
+        while (next < nests->size()) {
+            run_next();
+        }
+        while (unfinished > 0) {
+            pthread_cond_wait(&wake_owner, &mutex);
+        }
+
+        nests = NULL;
+        pthread_mutex_unlock(&mutex);
+        pthread_mutex_unlock(&batch_mutex);
+    }
+};
+
+WorkerPool &worker_pool() {
+    static WorkerPool pool;
+    return pool;
+}
+#endif
+
+}
+
+int num_compile_threads() {
+    char *threads_str = getenv("HL_NUMTHREADS");
+    if (threads_str) {
+        return atoi(threads_str);
+    }
+    #ifdef _MSC_VER
+    return 1;
+    #else
+    return (int)sysconf(_SC_NPROCESSORS_ONLN);
+    #endif
+}
+
+Stmt run_on_loop_nests(Stmt s, Stmt (*pass)(Stmt), Expr (*expr_pass)(Expr)) {
+    #ifdef _MSC_VER
+    return pass(s);
+    #else
+    int threads = num_compile_threads();
+    if (threads <= 1) {
+        return pass(s);
+    }
+
+    LoopNests loop_nests(expr_pass);
+    loop_nests.find(s);
+    if (loop_nests.nests.size() < 2) {
+        return pass(s);
+    }
+
+    if (threads > (int)loop_nests.nests.size()) {
+        threads = (int)loop_nests.nests.size();
+    }
+    debug(2) << "Running a pass on " << loop_nests.nests.size()
+             << " loop nests on " << threads << " threads\n";
+    worker_pool().run(pass, loop_nests.nests, threads);
+
+    Stmt result = loop_nests.replace(s);
+    if (!loop_nests.ok) {
+        // The pass changed the lets around a loop nest, so it can't
+        // be run on them separately.
+        debug(2) << "Running the pass again on the whole statement\n";
+        return pass(s);
+    }
+    return result;
+    #endif
+}
+
+}
+}
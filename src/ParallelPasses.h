@@ -0,0 +1,39 @@
+#ifndef HALIDE_PARALLEL_PASSES_H
+#define HALIDE_PARALLEL_PASSES_H
+
+/** \file
+ * Defines a way to run a lowering pass on independent loop nests
+ * concurrently.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Run a lowering pass separately on each of the loop nests that
+ * hang off the top of a statement, under its lets, blocks,
+ * pipelines, realizations and allocations, and put the results back
+ * in place. The loop nests are handed to a pool of worker threads.
+ * If expr_pass is given, it's applied to the expressions of the
+ * nodes above the loop nests (let values, and the bounds of
+ * realizations and allocations); otherwise they're left alone.
+ *
+ * Each loop nest is passed wrapped in the lets it's inside, so this
+ * gives the same result as pass(s) for passes that only rewrite
+ * expressions one at a time or what's inside loops, and that keep
+ * the enclosing lets (unrolling, vectorization, interleaving,
+ * CSE). Don't use it for passes like simplify that drop lets or use
+ * what they learn from one loop nest in another. If there's only one
+ * loop nest, or one thread to run on, this just calls pass(s). */
+Stmt run_on_loop_nests(Stmt s, Stmt (*pass)(Stmt), Expr (*expr_pass)(Expr) = NULL);
+
+/** The number of threads to compile on. This is the environment
+ * variable HL_NUMTHREADS if it's set, or else the number of cores. On
+ * Windows it's always one. */
+EXPORT int num_compile_threads();
+
+}
+}
+
+#endif
@@ -0,0 +1,149 @@
+#include "ParallelScratch.h"
+#include "AllocationUtils.h"
+#include "IRMutator.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "CodeGen_GPU_Dev.h"
+#include "Scope.h"
+#include "Debug.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// How many batches of iterations to make per thread. More batches
+// cost more allocations, but balance the load better.
+const int batches_per_thread = 4;
+
+// Remove the allocations within a parallel loop body whose extents
+// don't depend on anything defined in the body, and remember them
+// so they can be reinstated outside. Doesn't look inside nested
+// parallel loops, which get their own scratch.
+class RemoveInvariantAllocations : public IRMutator {
+    using IRMutator::visit;
+
+    const FindDefinitions &defs;
+
+    void visit(const For *op) {
+        if (op->for_type == For::Parallel) {
+            stmt = op;
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const Allocate *op) {
+        bool invariant = (defs.allocation_count.find(op->name)->second == 1 &&
+                          !small_constant_size(op));
+        for (size_t i = 0; invariant && i < op->extents.size(); i++) {
+            UsesDefinitions uses(defs.defined);
+            op->extents[i].accept(&uses);
+            invariant = !uses.result;
+        }
+
+        Stmt body = mutate(op->body);
+        if (invariant) {
+            debug(3) << "Making " << op->name << " per-thread scratch\n";
+            removed.push_back(op);
+            stmt = body;
+        } else if (body.same_as(op->body)) {
+            stmt = op;
+        } else {
+            stmt = Allocate::make(op->name, op->type, op->extents, body);
+        }
+    }
+
+public:
+    vector<const Allocate *> removed;
+    RemoveInvariantAllocations(const FindDefinitions &d) : defs(d) {}
+};
+
+class HoistParallelScratch : public IRMutator {
+    using IRMutator::visit;
+
+    void visit(const For *op) {
+        if (CodeGen_GPU_Dev::is_gpu_var(op->name)) {
+            // Leave gpu kernels alone.
+            stmt = op;
+            return;
+        }
+
+        Stmt body = mutate(op->body);
+
+        if (op->for_type != For::Parallel) {
+            if (body.same_as(op->body)) {
+                stmt = op;
+            } else {
+                stmt = For::make(op->name, op->min, op->extent, op->for_type, body);
+            }
+            return;
+        }
+
+        FindDefinitions defs;
+        defs.defined.push(op->name, 0);
+        body.accept(&defs);
+
+        RemoveInvariantAllocations remover(defs);
+        Stmt new_body = remover.mutate(body);
+
+        if (remover.removed.empty()) {
+            if (body.same_as(op->body)) {
+                stmt = op;
+            } else {
+                stmt = For::make(op->name, op->min, op->extent, op->for_type, body);
+            }
+            return;
+        }
+
+        debug(3) << "Batching iterations of parallel loop " << op->name << "\n";
+
+        // The iterations each batch covers.
+        string batch_name = op->name + ".batch";
+        string batches_name = op->name + ".batches";
+        string loop_min_name = op->name + ".loop_min";
+        string loop_extent_name = op->name + ".loop_extent";
+        Expr batch = Variable::make(Int(32), batch_name);
+        Expr batches = Variable::make(Int(32), batches_name);
+        Expr loop_min = Variable::make(Int(32), loop_min_name);
+        Expr loop_extent = Variable::make(Int(32), loop_extent_name);
+
+        // Do the multiplication in 64 bits, in case the loop is very
+        // long.
+        Expr wide_extent = Cast::make(Int(64), loop_extent);
+        Expr wide_batches = Cast::make(Int(64), batches);
+        Expr batch_begin = Cast::make(Int(32), (Cast::make(Int(64), batch) * wide_extent) / wide_batches);
+        Expr batch_end = Cast::make(Int(32), (Cast::make(Int(64), batch + 1) * wide_extent) / wide_batches);
+
+        Stmt s = For::make(op->name, loop_min + batch_begin, batch_end - batch_begin,
+                           For::Serial, new_body);
+
+        // Put the allocations back around the serial loop. They were
+        // found innermost first.
+        for (size_t i = 0; i < remover.removed.size(); i++) {
+            const Allocate *alloc = remover.removed[i];
+            s = Allocate::make(alloc->name, alloc->type, alloc->extents, s);
+        }
+
+        s = For::make(batch_name, 0, batches, For::Parallel, s);
+
+        vector<Expr> no_args;
+        Expr threads = Call::make(Int(32), "halide_get_num_threads", no_args, Call::Extern);
+        s = LetStmt::make(batches_name, max(1, min(loop_extent, threads * batches_per_thread)), s);
+        s = LetStmt::make(loop_extent_name, op->extent, s);
+        s = LetStmt::make(loop_min_name, op->min, s);
+        stmt = s;
+    }
+};
+
+}
+
+Stmt hoist_parallel_scratch(Stmt s) {
+    return HoistParallelScratch().mutate(s);
+}
+
+}
+}
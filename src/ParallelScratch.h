@@ -0,0 +1,26 @@
+#ifndef HALIDE_PARALLEL_SCRATCH_H
+#define HALIDE_PARALLEL_SCRATCH_H
+
+/** \file
+ * Defines the lowering pass that gives parallel loops per-thread
+ * scratch buffers.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Find allocations inside parallel for loops whose size does not
+ * depend on the loop, and allocate them once per batch of iterations
+ * instead of once per iteration. Each parallel loop with such an
+ * allocation is split into a parallel loop over a few batches per
+ * thread, which allocates the buffers, and a serial loop over the
+ * iterations in that batch. Must run after storage flattening and
+ * before injecting early frees. */
+Stmt hoist_parallel_scratch(Stmt s);
+
+}
+}
+
+#endif
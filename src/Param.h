@@ -150,7 +150,9 @@ public:
 
     /** Construct an OutputImageParam that wraps an Internal Parameter object. */
     OutputImageParam(const Internal::Parameter &p, int d) :
-        param(p), dims(d) {}
+        param(p), dims(d) {
+        assert(d <= 4 && "Images passed into or out of a pipeline may have at most four dimensions");
+    }
 
     /** Get the name of this Param */
     const std::string &name() const {
@@ -239,6 +241,68 @@ public:
         return set_min(dim, min).set_extent(dim, extent);
     }
 
+    /** Declare that the host pointer of images passed in is aligned
+     * to the given number of bytes (a power of two). Images that
+     * aren't generate a runtime error. Vector loads and stores are
+     * then aligned where the index is known to be (e.g. if the mins
+     * are set to zero and the strides to a multiple of the vector
+     * width), instead of assuming nothing about the alignment of
+     * buffers from the outside world. */
+    OutputImageParam &set_host_alignment(int bytes) {
+        assert(bytes > 0 && (bytes & (bytes - 1)) == 0 &&
+               "The alignment of an image must be a power of two");
+        param.set_host_alignment(bytes);
+        return *this;
+    }
+
+    /** Get the alignment set by set_host_alignment, or zero. */
+    int host_alignment() const {
+        return param.host_alignment();
+    }
+
+    /** Declare that the memory of images passed in doesn't overlap
+     * that of any other image passed to the pipeline. This isn't
+     * checked. The C backend uses it to mark the pointer as restrict,
+     * which spares the C compiler from checking for aliasing at
+     * runtime before it vectorizes loops. (The LLVM backend already
+     * assumes distinct buffers don't alias.) */
+    OutputImageParam &set_no_alias(bool no_alias = true) {
+        param.set_no_alias(no_alias);
+        return *this;
+    }
+
+    /** Get whether the images are declared not to alias others. */
+    bool no_alias() const {
+        return param.no_alias();
+    }
+
+    /** Declare that the images passed in for this output of a Func
+     * are those passed in for the given input ImageParam, so that the
+     * pipeline overwrites its input instead of needing a second
+     * buffer. E.g:
+     \code
+     vignette.output_buffer().set_in_place(in);
+     \endcode
+     * Lowering checks that only this Func reads the input, and that
+     * each point of it reads the input only at points that haven't
+     * been overwritten yet (see \ref Internal::check_in_place). The
+     * pipeline checks that the two images have the same host
+     * pointer. */
+    OutputImageParam &set_in_place(const OutputImageParam &input) {
+        assert(input.param.defined() && input.param.is_buffer() &&
+               input.param.name() != param.name() &&
+               "An output can only be computed in place of an input image");
+        assert(input.type() == type() &&
+               "An output can only be computed in place of an input image of the same type");
+        param.set_in_place_of(input.name());
+        return *this;
+    }
+
+    /** Get the name of the input image set by set_in_place, or empty. */
+    const std::string &in_place_of() const {
+        return param.in_place_of();
+    }
+
     /** Get the dimensionality of this image parameter */
     int dimensions() const {
         return dims;
@@ -302,7 +366,10 @@ public:
      * for the purpose of generating the right type signature when
      * statically compiling halide pipelines. */
     operator Argument() const {
-        return Argument(name(), true, type());
+        Argument arg(name(), true, type());
+        arg.host_alignment = host_alignment();
+        arg.no_alias = no_alias();
+        return arg;
     }
 
     /** Using a param as the argument to an external stage treats it
@@ -339,6 +406,23 @@ public:
         param.set_buffer(b);
     }
 
+    /** Declare that the values in images passed in lie between min
+     * and max inclusive, so that bounds inference can use the range
+     * where the image indexes a Func, e.g. a lookup table. Either
+     * may be undefined to leave that side alone. The range isn't
+     * checked. */
+    ImageParam &set_value_range(Expr min, Expr max) {
+        if (min.defined() && min.type() != type()) {
+            min = Internal::Cast::make(type(), min);
+        }
+        if (max.defined() && max.type() != type()) {
+            max = Internal::Cast::make(type(), max);
+        }
+        param.set_min_value(min);
+        param.set_max_value(max);
+        return *this;
+    }
+
     /** Get the buffer bound to this ImageParam. Only relevant for jitting */
     Buffer get() const {
         return param.get_buffer();
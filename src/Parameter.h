@@ -21,7 +21,12 @@ struct ParameterContents {
     Expr extent_constraint[4];
     Expr stride_constraint[4];
     Expr min_value, max_value;
-    ParameterContents(Type t, bool b, const std::string &n) : type(t), is_buffer(b), name(n), buffer(Buffer()), data(0) {
+    int host_alignment;
+    bool no_alias;
+    std::string in_place_of;
+    ParameterContents(Type t, bool b, const std::string &n) :
+        type(t), is_buffer(b), name(n), buffer(Buffer()), data(0),
+        host_alignment(0), no_alias(false) {
         // stride_constraint[0] defaults to 1. This is important for
         // dense vectorization. You can unset it by setting it to a
         // null expression. (param.set_stride(0, Expr());)
@@ -155,25 +160,62 @@ public:
     }
     //@}
 
-    /** Get and set constraints for scalar parameters */
+    /** Get and set the alignment of the host pointer, and whether
+     * the buffer doesn't alias any other (see
+     * ImageParam::set_host_alignment and ImageParam::set_no_alias) */
+    //@{
+    void set_host_alignment(int bytes) {
+        assert(contents.defined() && is_buffer() && bytes >= 0);
+        contents.ptr->host_alignment = bytes;
+    }
+    int host_alignment() const {
+        assert(contents.defined() && is_buffer());
+        return contents.ptr->host_alignment;
+    }
+    void set_no_alias(bool no_alias) {
+        assert(contents.defined() && is_buffer());
+        contents.ptr->no_alias = no_alias;
+    }
+    bool no_alias() const {
+        assert(contents.defined() && is_buffer());
+        return contents.ptr->no_alias;
+    }
+    //@}
+
+    /** Get and set the name of the input buffer that this output
+     * buffer overwrites, or empty (see
+     * OutputImageParam::set_in_place) */
+    //@{
+    void set_in_place_of(const std::string &input) {
+        assert(contents.defined() && is_buffer());
+        contents.ptr->in_place_of = input;
+    }
+    const std::string &in_place_of() const {
+        assert(contents.defined() && is_buffer());
+        return contents.ptr->in_place_of;
+    }
+    //@}
+
+    /** Get and set constraints for scalar parameters, or the range
+     * of the values in buffer parameters */
     // @{
     void set_min_value(Expr e) {
-        assert(contents.defined() && !is_buffer());
+        assert(contents.defined());
         contents.ptr->min_value = e;
     }
 
-    Expr get_min_value() {
-        assert(contents.defined() && !is_buffer());
+    Expr get_min_value() const {
+        assert(contents.defined());
         return contents.ptr->min_value;
     }
 
     void set_max_value(Expr e) {
-        assert(contents.defined() && !is_buffer());
+        assert(contents.defined());
         contents.ptr->max_value = e;
     }
 
-    Expr get_max_value() {
-        assert(contents.defined() && !is_buffer());
+    Expr get_max_value() const {
+        assert(contents.defined());
         return contents.ptr->max_value;
     }
     // @}
@@ -0,0 +1,340 @@
+#include "PartitionLoops.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "ExprUsesVar.h"
+#include "Bounds.h"
+#include "Scope.h"
+#include "Debug.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// coefficient * (the loop variable) + rest
+struct Linear {
+    int coefficient;
+    Expr rest;
+};
+
+// Rewrite the body of a loop for its steady state, replacing each
+// comparison of a linear function of the loop variable against
+// something that doesn't depend on it by the side it takes in the
+// middle of the loop, and collect the limits on the loop variable
+// for which that's right.
+class SteadyState : public IRMutator {
+    using IRMutator::visit;
+
+    string var;
+
+    // The lets inside the loop that are linear in the loop variable.
+    Scope<Linear> linear;
+
+    // Everything that depends on the loop variable.
+    Scope<int> varying;
+
+    // The bounds of the lets and loop variables inside the loop that
+    // don't, in terms of what's defined outside of it.
+    Scope<Interval> bounds;
+
+    bool linear_in_var(Expr e, Linear &result) {
+        if (e.type() != Int(32)) return false;
+        if (!expr_uses_vars(e, varying)) {
+            result.coefficient = 0;
+            result.rest = e;
+            return true;
+        }
+
+        Linear a, b;
+        if (const Variable *v = e.as<Variable>()) {
+            if (v->name == var) {
+                result.coefficient = 1;
+                result.rest = 0;
+            } else if (linear.contains(v->name)) {
+                result = linear.get(v->name);
+            } else {
+                return false;
+            }
+        } else if (const Add *add = e.as<Add>()) {
+            if (!linear_in_var(add->a, a) || !linear_in_var(add->b, b)) return false;
+            result.coefficient = a.coefficient + b.coefficient;
+            result.rest = a.rest + b.rest;
+        } else if (const Sub *sub = e.as<Sub>()) {
+            if (!linear_in_var(sub->a, a) || !linear_in_var(sub->b, b)) return false;
+            result.coefficient = a.coefficient - b.coefficient;
+            result.rest = a.rest - b.rest;
+        } else if (const Mul *mul = e.as<Mul>()) {
+            const int *factor = as_const_int(mul->b);
+            if (!factor || !linear_in_var(mul->a, a)) return false;
+            result.coefficient = a.coefficient * (*factor);
+            result.rest = a.rest * (*factor);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // Find the limit on the loop variable for which d <= 0 (or d > 0)
+    // wherever it's evaluated.
+    bool limit(Expr d, bool le, vector<Expr> &mins, vector<Expr> &maxs) {
+        Linear l;
+        if (!linear_in_var(d, l) || l.coefficient == 0) return false;
+        Interval i = bounds_of_expr_in_scope(l.rest, bounds);
+        if (!i.min.defined() || !i.max.defined()) return false;
+
+        int k = l.coefficient;
+        if (le) {
+            // k*var <= -rest, for the largest rest.
+            if (k > 0) {
+                maxs.push_back((0 - i.max) / k);
+            } else {
+                mins.push_back((i.max + (-k - 1)) / -k);
+            }
+        } else {
+            // k*var >= 1 - rest, for the smallest rest.
+            if (k > 0) {
+                mins.push_back((k - i.min) / k);
+            } else {
+                maxs.push_back((i.min - 1) / -k);
+            }
+        }
+        return true;
+    }
+
+    // Find the limits for which a condition has the given value.
+    bool condition_limits(Expr c, bool value, vector<Expr> &mins, vector<Expr> &maxs) {
+        if (const Not *op = c.as<Not>()) {
+            return condition_limits(op->a, !value, mins, maxs);
+        } else if (const And *op = c.as<And>()) {
+            return (value &&
+                    condition_limits(op->a, true, mins, maxs) &&
+                    condition_limits(op->b, true, mins, maxs));
+        } else if (const Or *op = c.as<Or>()) {
+            return (!value &&
+                    condition_limits(op->a, false, mins, maxs) &&
+                    condition_limits(op->b, false, mins, maxs));
+        } else if (const LT *op = c.as<LT>()) {
+            return limit(op->a - op->b + 1, value, mins, maxs);
+        } else if (const LE *op = c.as<LE>()) {
+            return limit(op->a - op->b, value, mins, maxs);
+        } else if (const GT *op = c.as<GT>()) {
+            return limit(op->b - op->a + 1, value, mins, maxs);
+        } else if (const GE *op = c.as<GE>()) {
+            return limit(op->b - op->a, value, mins, maxs);
+        }
+        return false;
+    }
+
+    // The value a condition is guessed to take in the middle of the
+    // loop. Checks for being inside a range are true there, and
+    // checks for being outside one are false.
+    bool interior_value(Expr c) {
+        if (const Not *op = c.as<Not>()) {
+            return !interior_value(op->a);
+        }
+        return !c.as<Or>();
+    }
+
+    // The value a condition takes in the steady state, if it's known.
+    bool steady_value(Expr c, bool &value) {
+        if (c.type() != Bool() || !expr_uses_vars(c, varying)) return false;
+        vector<Expr> new_mins, new_maxs;
+        value = interior_value(c);
+        if (!condition_limits(c, value, new_mins, new_maxs)) return false;
+        mins.insert(mins.end(), new_mins.begin(), new_mins.end());
+        maxs.insert(maxs.end(), new_maxs.begin(), new_maxs.end());
+        return true;
+    }
+
+    // Which side of a min or max is taken in the steady state: the
+    // one that varies with the loop variable.
+    template<typename T>
+    void visit_min_or_max(const T *op, bool is_min) {
+        Expr a = mutate(op->a), b = mutate(op->b);
+        bool va = expr_uses_vars(a, varying), vb = expr_uses_vars(b, varying);
+        if (va != vb) {
+            // min(a, b) is a where a - b <= 0, and max(a, b) is a
+            // where b - a <= 0.
+            Expr d = (va == is_min) ? a - b : b - a;
+            vector<Expr> new_mins, new_maxs;
+            if (limit(d, true, new_mins, new_maxs)) {
+                mins.insert(mins.end(), new_mins.begin(), new_mins.end());
+                maxs.insert(maxs.end(), new_maxs.begin(), new_maxs.end());
+                expr = va ? a : b;
+                return;
+            }
+        }
+        if (a.same_as(op->a) && b.same_as(op->b)) {
+            expr = op;
+        } else {
+            expr = T::make(a, b);
+        }
+    }
+
+    void visit(const Min *op) {
+        visit_min_or_max(op, true);
+    }
+
+    void visit(const Max *op) {
+        visit_min_or_max(op, false);
+    }
+
+    void visit(const Select *op) {
+        Expr condition = mutate(op->condition);
+        Expr true_value = mutate(op->true_value);
+        Expr false_value = mutate(op->false_value);
+        bool value;
+        if (steady_value(condition, value)) {
+            expr = value ? true_value : false_value;
+        } else if (condition.same_as(op->condition) &&
+                   true_value.same_as(op->true_value) &&
+                   false_value.same_as(op->false_value)) {
+            expr = op;
+        } else {
+            expr = Select::make(condition, true_value, false_value);
+        }
+    }
+
+    void visit(const IfThenElse *op) {
+        Expr condition = mutate(op->condition);
+        Stmt then_case = mutate(op->then_case);
+        Stmt else_case = mutate(op->else_case);
+        bool value;
+        if (steady_value(condition, value)) {
+            if (value) {
+                stmt = then_case;
+            } else if (else_case.defined()) {
+                stmt = else_case;
+            } else {
+                stmt = Evaluate::make(0);
+            }
+        } else {
+            stmt = rebuild(op, condition, then_case, else_case);
+        }
+    }
+
+    // Track what a let inside the loop depends on.
+    void push_let(const string &name, Expr value) {
+        Linear l;
+        if (!expr_uses_vars(value, varying)) {
+            bounds.push(name, bounds_of_expr_in_scope(value, bounds));
+        } else {
+            if (linear_in_var(value, l)) {
+                linear.push(name, l);
+            }
+            varying.push(name, 0);
+        }
+    }
+
+    void pop_let(const string &name) {
+        if (varying.contains(name)) {
+            varying.pop(name);
+            if (linear.contains(name)) linear.pop(name);
+        } else {
+            bounds.pop(name);
+        }
+    }
+
+    void visit(const Let *op) {
+        Expr value = mutate(op->value);
+        push_let(op->name, value);
+        Expr body = mutate(op->body);
+        pop_let(op->name);
+        expr = rebuild(op, value, body);
+    }
+
+    void visit(const LetStmt *op) {
+        Expr value = mutate(op->value);
+        push_let(op->name, value);
+        Stmt body = mutate(op->body);
+        pop_let(op->name);
+        stmt = rebuild(op, value, body);
+    }
+
+    void visit(const For *op) {
+        Expr min = mutate(op->min);
+        Expr extent = mutate(op->extent);
+        bool varies = expr_uses_vars(min, varying) || expr_uses_vars(extent, varying);
+        if (varies) {
+            varying.push(op->name, 0);
+        } else {
+            Interval i(bounds_of_expr_in_scope(min, bounds).min,
+                       bounds_of_expr_in_scope(min + extent - 1, bounds).max);
+            bounds.push(op->name, i);
+        }
+        Stmt body = mutate(op->body);
+        if (varies) {
+            varying.pop(op->name);
+        } else {
+            bounds.pop(op->name);
+        }
+        stmt = rebuild(op, min, extent, body);
+    }
+
+public:
+    // The limits on the loop variable in the steady state.
+    vector<Expr> mins, maxs;
+
+    SteadyState(const string &v) : var(v) {
+        varying.push(v, 0);
+    }
+};
+
+class PartitionLoops : public IRMutator {
+    using IRMutator::visit;
+
+    void visit(const For *op) {
+        Stmt body = mutate(op->body);
+
+        if ((op->for_type != For::Serial && op->for_type != For::Parallel) ||
+            is_one(op->extent)) {
+            stmt = rebuild(op, op->min, op->extent, body);
+            return;
+        }
+
+        SteadyState steady(op->name);
+        Stmt steady_body = steady.mutate(body);
+        if (steady.mins.empty() && steady.maxs.empty()) {
+            stmt = rebuild(op, op->min, op->extent, body);
+            return;
+        }
+
+        debug(3) << "Partitioning loop over " << op->name << "\n";
+
+        Expr end = op->min + op->extent;
+        Expr steady_min = op->min, steady_end = end;
+        for (size_t i = 0; i < steady.mins.size(); i++) {
+            steady_min = max(steady_min, steady.mins[i]);
+        }
+        for (size_t i = 0; i < steady.maxs.size(); i++) {
+            steady_end = min(steady_end, steady.maxs[i] + 1);
+        }
+
+        // Keep the steady state inside the loop, and the right way
+        // around.
+        string min_name = op->name + ".steady_min";
+        string end_name = op->name + ".steady_end";
+        Expr min_var = Variable::make(Int(32), min_name);
+        Expr end_var = Variable::make(Int(32), end_name);
+
+        Stmt prologue = For::make(op->name, op->min, min_var - op->min, op->for_type, body);
+        Stmt middle = For::make(op->name, min_var, end_var - min_var, op->for_type, steady_body);
+        Stmt epilogue = For::make(op->name, end_var, end - end_var, op->for_type, body);
+
+        stmt = Block::make(prologue, Block::make(middle, epilogue));
+        stmt = LetStmt::make(end_name, max(steady_end, min_var), stmt);
+        stmt = LetStmt::make(min_name, min(steady_min, end), stmt);
+    }
+};
+
+}
+
+Stmt partition_loops(Stmt s) {
+    return PartitionLoops().mutate(s);
+}
+
+}
+}
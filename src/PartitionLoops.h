@@ -0,0 +1,28 @@
+#ifndef HALIDE_PARTITION_LOOPS_H
+#define HALIDE_PARTITION_LOOPS_H
+
+/** \file
+ * Defines a lowering pass that splits loops into a steady state and
+ * the iterations near their edges.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Find serial and parallel loops whose bodies have mins, maxes,
+ * selects or ifs that compare a linear function of the loop variable
+ * against something that doesn't depend on it, as boundary
+ * conditions and the guards of splits do. Work out from the bounds
+ * of the comparisons the range of iterations over which they all go
+ * the same way as in the middle of the loop, and split the loop into
+ * a prologue, that range, and an epilogue. The steady state in the
+ * middle uses the simpler side of each comparison, and the prologue
+ * and epilogue run the original body. */
+Stmt partition_loops(Stmt s);
+
+}
+}
+
+#endif
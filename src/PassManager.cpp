@@ -0,0 +1,134 @@
+#include "PassManager.h"
+#include "IRVisitor.h"
+#include "Debug.h"
+
+#include <iomanip>
+#include <sstream>
+#include <stdlib.h>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::ostringstream;
+using std::pair;
+
+namespace {
+
+vector<pair<string, double> > last_pass_times;
+
+// Counts the distinct nodes of a statement.
+class CountNodes : public IRGraphVisitor {
+public:
+    int count(Stmt s) {
+        if (s.defined()) {
+            include(s);
+        }
+        return (int)visited.size();
+    }
+};
+
+}
+
+PassManager::PassManager() : running(false), stats(false), start_time(0), start_nodes_made(0) {
+    stats = getenv("HL_LOWER_STATS") != NULL;
+
+    if (char *skip_str = getenv("HL_LOWER_SKIP")) {
+        string names = skip_str;
+        size_t start = 0;
+        while (start <= names.size()) {
+            size_t comma = names.find(',', start);
+            if (comma == string::npos) comma = names.size();
+            if (comma > start) {
+                skip.insert(names.substr(start, comma - start));
+            }
+            start = comma + 1;
+        }
+    }
+}
+
+PassManager::~PassManager() {
+    assert(!running && "PassManager destroyed before the last pass was finished");
+}
+
+void PassManager::finish(Stmt s) {
+    if (!running) return;
+    running = false;
+
+    PassStats &p = passes.back();
+    p.ms = current_time_ms() - start_time;
+    p.nodes_made = ir_nodes_allocated() - start_nodes_made;
+    if (stats) {
+        p.nodes_after = CountNodes().count(s);
+    }
+    debug(1) << "  (made " << p.nodes_made << " IR nodes)\n";
+}
+
+bool PassManager::begin(const string &name, const string &message, Stmt s) {
+    finish(s);
+
+    if (skip.count(name)) {
+        debug(1) << "Skipping " << name << "\n";
+        return false;
+    }
+
+    debug(1) << message << "\n";
+
+    PassStats p;
+    p.name = name;
+    p.ms = 0;
+    p.nodes_before = p.nodes_after = stats ? CountNodes().count(s) : 0;
+    p.nodes_made = 0;
+    passes.push_back(p);
+
+    running = true;
+    start_nodes_made = ir_nodes_allocated();
+    // Start the clock last, so counting the nodes isn't included.
+    start_time = current_time_ms();
+    return true;
+}
+
+void PassManager::end(Stmt s) {
+    finish(s);
+
+    last_pass_times.clear();
+    for (size_t i = 0; i < passes.size(); i++) {
+        last_pass_times.push_back(std::make_pair(passes[i].name, passes[i].ms));
+    }
+
+    if (!stats) return;
+
+    double total_ms = 0;
+    for (size_t i = 0; i < passes.size(); i++) {
+        total_ms += passes[i].ms;
+    }
+
+    ostringstream table;
+    table << std::left << std::setw(28) << "pass"
+          << std::right << std::setw(10) << "ms"
+          << std::setw(8) << "%"
+          << std::setw(12) << "nodes in"
+          << std::setw(12) << "nodes out"
+          << std::setw(12) << "nodes made" << "\n";
+    for (size_t i = 0; i < passes.size(); i++) {
+        const PassStats &p = passes[i];
+        table << std::left << std::setw(28) << p.name
+              << std::right << std::fixed << std::setprecision(3) << std::setw(10) << p.ms
+              << std::setprecision(1) << std::setw(8) << (total_ms > 0 ? 100 * p.ms / total_ms : 0)
+              << std::setw(12) << p.nodes_before
+              << std::setw(12) << p.nodes_after
+              << std::setw(12) << p.nodes_made << "\n";
+    }
+    table << std::left << std::setw(28) << "total"
+          << std::right << std::setprecision(3) << std::setw(10) << total_ms << "\n";
+
+    debug(0) << table.str();
+}
+
+vector<pair<string, double> > last_lowering_pass_times() {
+    return last_pass_times;
+}
+
+}
+}
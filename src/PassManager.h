@@ -0,0 +1,76 @@
+#ifndef HALIDE_PASS_MANAGER_H
+#define HALIDE_PASS_MANAGER_H
+
+/** \file
+ * Defines a class that keeps track of the passes of lowering
+ */
+
+#include "IR.h"
+
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Halide {
+namespace Internal {
+
+/** Keeps track of the passes of lowering. Each pass is logged at
+ * debug level 1, and its wall time, the size of its input and
+ * output, and the number of IR nodes it made are recorded. If the
+ * environment variable HL_LOWER_STATS is set, a table of these is
+ * printed at the end. Passes named in the comma-separated
+ * environment variable HL_LOWER_SKIP are skipped, to experiment with
+ * (skipping a pass that later passes depend on will break lowering).
+ *
+ * Use it like this:
+ \code
+ PassManager passes;
+ if (passes.begin("unroll", "Unrolling...", s)) {
+     s = unroll_loops(s);
+ }
+ ...
+ passes.end(s);
+ \endcode
+ */
+class PassManager {
+public:
+    EXPORT PassManager();
+    EXPORT ~PassManager();
+
+    /** Finish the previous pass, whose output is s, and start the one
+     * with the given name, whose input is s. Returns false if the
+     * pass should be skipped. */
+    EXPORT bool begin(const std::string &name, const std::string &message, Stmt s);
+
+    /** Finish the last pass, whose output is s, and print the table
+     * of statistics if it was asked for. */
+    EXPORT void end(Stmt s);
+
+private:
+    struct PassStats {
+        std::string name;
+        double ms;
+        int nodes_before, nodes_after;
+        uint64_t nodes_made;
+    };
+    std::vector<PassStats> passes;
+
+    bool running, stats;
+    std::set<std::string> skip;
+    double start_time;
+    uint64_t start_nodes_made;
+
+    void finish(Stmt s);
+};
+
+/** The name and wall time in milliseconds of each pass of the last
+ * lowering to finish, for benchmarks of compile time. Lowerings on
+ * other threads (e.g. by compile_jit_async) may overwrite it at any
+ * time, so only call it when lowering on one thread. */
+EXPORT std::vector<std::pair<std::string, double> > last_lowering_pass_times();
+
+}
+}
+
+#endif
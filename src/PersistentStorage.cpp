@@ -0,0 +1,206 @@
+#include "PersistentStorage.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "Scope.h"
+#include "Debug.h"
+
+#include <iostream>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+
+namespace {
+
+// Start the loop over the persistent dimension just past the values
+// that are still valid, if the valid ones cover the start of the
+// region needed.
+class SkipValidCoordinates : public IRMutator {
+    const string loop_var;
+    Expr valid_min, valid_max;
+
+    using IRMutator::visit;
+
+    void visit(const LetStmt *op) {
+        Stmt body = mutate(op->body);
+        if (op->name == loop_var + ".loop_min") {
+            Expr min = op->value;
+            Expr reuse = valid_min <= min && min <= valid_max + 1;
+            Expr value = select(reuse, max(min, valid_max + 1), min);
+            stmt = LetStmt::make(op->name, value, body);
+        } else if (op->name == loop_var + ".loop_extent") {
+            // Nothing needs computing if it's all valid.
+            Expr loop_min = Variable::make(Int(32), loop_var + ".loop_min");
+            Expr loop_max = Variable::make(Int(32), loop_var + ".loop_max");
+            stmt = LetStmt::make(op->name, max(loop_max + 1 - loop_min, 0), body);
+        } else if (body.same_as(op->body)) {
+            stmt = op;
+        } else {
+            stmt = LetStmt::make(op->name, op->value, body);
+        }
+    }
+
+public:
+    SkipValidCoordinates(const string &v, Expr vmin, Expr vmax) :
+        loop_var(v), valid_min(vmin), valid_max(vmax) {}
+};
+
+// Narrow the produce step of a persistent function, and release
+// the storage once it's done.
+class RewriteProduce : public IRMutator {
+    const string &name, &loop_var;
+    Expr valid_min, valid_max, release;
+
+    using IRMutator::visit;
+
+    void visit(const Pipeline *op) {
+        if (op->name != name) {
+            IRMutator::visit(op);
+            return;
+        }
+        Stmt produce = SkipValidCoordinates(loop_var, valid_min, valid_max).mutate(op->produce);
+        produce = Block::make(produce, Evaluate::make(release));
+        stmt = Pipeline::make(op->name, produce, op->update, op->consume);
+    }
+
+public:
+    RewriteProduce(const string &n, const string &v, Expr vmin, Expr vmax, Expr r) :
+        name(n), loop_var(v), valid_min(vmin), valid_max(vmax), release(r) {}
+};
+
+class InjectPersistentStorage : public IRMutator {
+    const map<string, Function> &env;
+
+    // The buffers allocated by the program, as opposed to the output
+    // buffers passed in.
+    Scope<int> allocated;
+
+    using IRMutator::visit;
+
+    bool can_persist(Function f) {
+        const Schedule &s = f.schedule();
+        string reason;
+        if (!f.is_pure()) {
+            reason = "it is not pure";
+        } else if (f.outputs() != 1) {
+            reason = "it has more than one value";
+        } else if (!s.compute_level.is_root() || !s.store_level.is_root()) {
+            reason = "it is not compute_root";
+        } else if (s.memoized) {
+            reason = "it is also memoized";
+        } else {
+            return true;
+        }
+        std::cerr << "Warning: Not keeping the storage of " << f.name()
+                  << " between runs because " << reason << "\n";
+        return false;
+    }
+
+    void visit(const Allocate *op) {
+        map<string, Function>::const_iterator iter = env.find(op->name);
+        if (iter == env.end() ||
+            iter->second.schedule().persistent_var.empty() ||
+            !can_persist(iter->second)) {
+            allocated.push(op->name, 0);
+            IRMutator::visit(op);
+            allocated.pop(op->name);
+            return;
+        }
+
+        Function f = iter->second;
+        const Schedule &s = f.schedule();
+        const string &t = s.persistent_var;
+        Expr frames;
+        for (size_t i = 0; i < s.storage_folds.size(); i++) {
+            if (s.storage_folds[i].var == t) {
+                frames = s.storage_folds[i].factor;
+            }
+        }
+        assert(frames.defined() && "Persistent storage must be folded");
+
+        debug(3) << "Keeping the storage of " << op->name << " between runs\n";
+
+        allocated.push(op->name, 0);
+        Stmt body = mutate(op->body);
+        allocated.pop(op->name);
+
+        // The region of the function in every dimension is the key
+        // the storage is kept under. In the persistent dimension it's
+        // just the fold.
+        string state_name = op->name + ".persistent_state";
+        int dims = (int)f.args().size();
+        vector<Expr> shape;
+        for (int i = 0; i < dims; i++) {
+            string d = int_to_string(i);
+            shape.push_back(Variable::make(Int(32), op->name + ".min." + d));
+            shape.push_back(Variable::make(Int(32), op->name + ".extent." + d));
+        }
+        int shape_size = (int)shape.size();
+        Expr valid_min = Load::make(Int(32), state_name, shape_size, Buffer(), Parameter());
+        Expr valid_max = Load::make(Int(32), state_name, shape_size + 1, Buffer(), Parameter());
+
+        // Compute what isn't valid, and then mark everything computed
+        // valid, up to the number of coordinates the storage holds.
+        string prefix = op->name + ".s0." + t;
+        Expr t_min = Variable::make(Int(32), prefix + ".min");
+        Expr t_max = Variable::make(Int(32), prefix + ".max");
+        Expr reuse = valid_min <= t_min && t_min <= valid_max + 1;
+        Expr new_max = select(reuse, max(valid_max, t_max), t_max);
+        Expr new_min = max(select(reuse, valid_min, t_min), new_max - frames + 1);
+        Expr release = Call::make(Int(32), "halide_persistent_storage_release",
+                                  vec<Expr>(op->name, new_min, new_max), Call::Extern);
+
+        RewriteProduce rewrite(op->name, prefix, valid_min, valid_max, release);
+        body = rewrite.mutate(body);
+
+        Expr size = op->type.bytes();
+        for (size_t i = 0; i < op->extents.size(); i++) {
+            size *= op->extents[i];
+        }
+        Expr state = Call::make(Handle(), Call::address_of,
+                                vec<Expr>(Load::make(Int(32), state_name, 0, Buffer(), Parameter())),
+                                Call::Intrinsic);
+        Expr acquire = Call::make(Handle(), "halide_persistent_storage_acquire",
+                                  vec<Expr>(op->name, state, shape_size, size), Call::Extern);
+
+        // Loads and stores find the storage as name.host, as they
+        // would an allocation.
+        string host_name = op->name + ".host";
+        Expr host = Variable::make(Handle(), host_name);
+        Expr null_handle = Call::make(Handle(), Call::null_handle, vector<Expr>(), Call::Intrinsic);
+        Stmt check = AssertStmt::make(host != null_handle,
+                                      "Out of memory acquiring the persistent storage of " + op->name,
+                                      vector<Expr>());
+        body = LetStmt::make(host_name, acquire, Block::make(check, body));
+
+        for (int i = shape_size; i > 0; i--) {
+            body = Block::make(Store::make(state_name, shape[i-1], i-1), body);
+        }
+        stmt = Allocate::make(state_name, Int(32), vec<Expr>(shape_size + 2), body);
+    }
+
+    void visit(const Pipeline *op) {
+        map<string, Function>::const_iterator iter = env.find(op->name);
+        if (iter != env.end() && !iter->second.schedule().persistent_var.empty() &&
+            !allocated.contains(op->name)) {
+            std::cerr << "Warning: Not keeping the storage of " << op->name
+                      << " between runs because it is an output of the pipeline\n";
+        }
+        IRMutator::visit(op);
+    }
+
+public:
+    InjectPersistentStorage(const map<string, Function> &e) : env(e) {}
+};
+
+}
+
+Stmt inject_persistent_storage(Stmt s, const map<string, Function> &env) {
+    return InjectPersistentStorage(env).mutate(s);
+}
+
+}
+}
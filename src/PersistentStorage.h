@@ -0,0 +1,27 @@
+#ifndef HALIDE_PERSISTENT_STORAGE_H
+#define HALIDE_PERSISTENT_STORAGE_H
+
+/** \file
+ * Defines the lowering pass that keeps the storage of functions
+ * scheduled with Func::store_persistent from one run to the next
+ */
+
+#include "IR.h"
+#include "Function.h"
+
+#include <map>
+
+namespace Halide {
+namespace Internal {
+
+/** Replace the allocation of each function with persistent storage
+ * with storage acquired from the runtime, which remembers the range
+ * of the folded dimension computed by earlier runs, and skip
+ * computing the part of that range which is still valid. Must run
+ * after storage flattening. */
+Stmt inject_persistent_storage(Stmt s, const std::map<std::string, Function> &env);
+
+}
+}
+
+#endif
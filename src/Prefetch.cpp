@@ -0,0 +1,149 @@
+#include "Prefetch.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "Bounds.h"
+#include "Substitute.h"
+#include "IRPrinter.h"
+#include "Debug.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+
+namespace {
+
+// The size of a cache line in bytes. Prefetching one address per
+// line is enough to bring in the whole line.
+const int cache_line_bytes = 64;
+
+class RealizesFunction : public IRVisitor {
+    const string &func;
+    using IRVisitor::visit;
+    void visit(const Realize *op) {
+        if (op->name == func) result = true;
+        IRVisitor::visit(op);
+    }
+public:
+    bool result;
+    RealizesFunction(const string &f) : func(f), result(false) {}
+};
+
+class InjectPrefetches : public IRMutator {
+    const map<string, Function> &env;
+
+    using IRMutator::visit;
+
+    Stmt make_prefetch(const Schedule::Prefetch &p, const For *loop, Stmt body) {
+        RealizesFunction realizes(p.name);
+        body.accept(&realizes);
+        if (realizes.result) {
+            std::cerr << "Warning: Not prefetching " << p.name
+                      << " at loop " << loop->name
+                      << " because it is computed within that loop\n";
+            return Stmt();
+        }
+
+        Box b = box_required(body, p.name);
+        if (b.empty()) {
+            debug(2) << "Loop " << loop->name << " doesn't use " << p.name << ", not prefetching\n";
+            return Stmt();
+        }
+        for (size_t i = 0; i < b.size(); i++) {
+            if (!b[i].min.defined() || !b[i].max.defined()) {
+                std::cerr << "Warning: Not prefetching " << p.name
+                          << " at loop " << loop->name
+                          << " because the region used is unbounded\n";
+                return Stmt();
+            }
+        }
+
+        Type t;
+        Function f;
+        if (p.param.defined()) {
+            t = p.param.type();
+        } else {
+            map<string, Function>::const_iterator iter = env.find(p.name);
+            if (iter == env.end()) {
+                return Stmt();
+            }
+            f = iter->second;
+            t = f.output_types()[0];
+        }
+
+        // Prefetch the first element of each cache line of each row
+        // of the box.
+        int elems_per_line = std::max(1, cache_line_bytes / t.bytes());
+        string prefix = loop->name + ".prefetch." + p.name;
+        string line_name = prefix + ".line";
+        vector<Expr> args(b.size());
+        args[0] = b[0].min + Variable::make(Int(32), line_name) * elems_per_line;
+        for (size_t i = 1; i < b.size(); i++) {
+            args[i] = Variable::make(Int(32), prefix + "." + int_to_string(i));
+        }
+
+        Expr site;
+        if (p.param.defined()) {
+            site = Call::make(t, p.name, args, Call::Image, Function(), 0, Buffer(), p.param);
+        } else {
+            site = Call::make(f, args);
+        }
+        Expr address = Call::make(Handle(), Call::address_of, vec(site), Call::Intrinsic);
+        Stmt s = Evaluate::make(Call::make(Int(32), Call::prefetch, vec(address), Call::Intrinsic));
+
+        Expr extent = b[0].max - b[0].min + 1;
+        Expr lines = (extent + (elems_per_line - 1)) / elems_per_line;
+        s = For::make(line_name, 0, lines, For::Serial, s);
+        for (size_t i = 1; i < b.size(); i++) {
+            s = For::make(prefix + "." + int_to_string(i), b[i].min,
+                          b[i].max - b[i].min + 1, For::Serial, s);
+        }
+
+        // The box is in terms of the loop variable. Move it on to a
+        // later iteration.
+        Expr later = Variable::make(Int(32), loop->name) + p.offset;
+        return substitute(loop->name, later, s);
+    }
+
+    void visit(const For *op) {
+        Stmt body = mutate(op->body);
+
+        for (map<string, Function>::const_iterator iter = env.begin();
+             iter != env.end(); ++iter) {
+            const vector<Schedule::Prefetch> &prefetches = iter->second.schedule().prefetches;
+            for (size_t i = 0; i < prefetches.size(); i++) {
+                Schedule::LoopLevel level(iter->first, prefetches[i].var);
+                if (level.match(op->name)) {
+                    Stmt prefetch = make_prefetch(prefetches[i], op, body);
+                    if (prefetch.defined()) {
+                        debug(3) << "Prefetching at " << op->name << ":\n" << prefetch << "\n";
+                        body = Block::make(prefetch, body);
+                    }
+                }
+            }
+        }
+
+        if (body.same_as(op->body)) {
+            stmt = op;
+        } else {
+            stmt = For::make(op->name, op->min, op->extent, op->for_type, body);
+        }
+    }
+
+public:
+    InjectPrefetches(const map<string, Function> &e) : env(e) {}
+};
+
+}
+
+Stmt inject_prefetches(Stmt s, const map<string, Function> &env) {
+    return InjectPrefetches(env).mutate(s);
+}
+
+}
+}
@@ -0,0 +1,26 @@
+#ifndef HALIDE_PREFETCH_H
+#define HALIDE_PREFETCH_H
+
+/** \file
+ * Defines the lowering pass that injects software prefetches
+ * requested with Func::prefetch
+ */
+
+#include "IR.h"
+#include "Function.h"
+
+#include <map>
+
+namespace Halide {
+namespace Internal {
+
+/** At the top of the body of each loop that a function asked to
+ * prefetch at, prefetch the region of the other function or image
+ * that a later iteration of the loop will read. Must run after bounds
+ * inference and before storage flattening. */
+Stmt inject_prefetches(Stmt s, const std::map<std::string, Function> &env);
+
+}
+}
+
+#endif
@@ -0,0 +1,267 @@
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include "ProfileGuided.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "CodeGen_GPU_Dev.h"
+#include "Debug.h"
+#include "Util.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+const char kCountersName[] = "pgo_counters";
+
+// Each site has three counters. For loops: entries, total iterations
+// and total squared iterations. For branches: times taken, and times
+// not taken.
+const int kCountersPerSite = 3;
+
+// The largest constant trip count to make a version of a loop for.
+const uint64_t kMaxFixedTripCount = 16;
+
+struct SiteCounts {
+    uint64_t c[kCountersPerSite];
+};
+
+// Names the loops and branches of a pipeline in the order they are
+// visited, the same way when instrumenting and when optimizing. A
+// loop is named after its variable, and a branch after the innermost
+// loop around it, each numbered to tell apart several with the same
+// name.
+class SiteNamer {
+    map<string, int> seen;
+public:
+    string name(const string &kind, const string &where) {
+        string s = kind + " " + where;
+        return s + "#" + int_to_string(seen[s]++);
+    }
+};
+
+class InjectCounters : public IRMutator {
+    using IRMutator::visit;
+
+    SiteNamer namer;
+    string where;
+
+    Stmt count(int site, int counter, Expr amount) {
+        Expr counters = Variable::make(Handle(), kCountersName);
+        Expr args = Cast::make(Int(64), amount);
+        return Evaluate::make(Call::make(Int(32), "halide_pgo_count",
+                                         vec<Expr>(counters, site * kCountersPerSite + counter, args),
+                                         Call::Extern));
+    }
+
+    void visit(const For *op) {
+        if (CodeGen_GPU_Dev::is_gpu_var(op->name)) {
+            stmt = op;
+            return;
+        }
+        int site = (int)sites.size();
+        sites.push_back(namer.name("loop", op->name));
+
+        string outer = where;
+        where = op->name;
+        Stmt body = mutate(op->body);
+        where = outer;
+
+        Expr extent = Cast::make(Int(64), op->extent);
+        stmt = For::make(op->name, op->min, op->extent, op->for_type, body);
+        stmt = Block::make(count(site, 2, extent * extent), stmt);
+        stmt = Block::make(count(site, 1, extent), stmt);
+        stmt = Block::make(count(site, 0, 1), stmt);
+    }
+
+    void visit(const IfThenElse *op) {
+        int site = (int)sites.size();
+        sites.push_back(namer.name("if", where));
+
+        Stmt then_case = Block::make(count(site, 0, 1), mutate(op->then_case));
+        Stmt else_case = count(site, 1, 1);
+        if (op->else_case.defined()) {
+            else_case = Block::make(else_case, mutate(op->else_case));
+        }
+        stmt = IfThenElse::make(op->condition, then_case, else_case);
+    }
+
+public:
+    vector<string> sites;
+    InjectCounters() : where("$pipeline") {}
+};
+
+// Wrap a condition in the weights llvm wants, which are 32 bits. Add
+// one to each so that a branch never seen can still be taken.
+Expr weighted(Expr cond, uint64_t taken, uint64_t not_taken) {
+    while (taken >= (1 << 30) || not_taken >= (1 << 30)) {
+        taken >>= 1;
+        not_taken >>= 1;
+    }
+    return Call::make(Bool(), Call::branch_weights,
+                      vec<Expr>(cond, (int)taken + 1, (int)not_taken + 1),
+                      Call::Intrinsic);
+}
+
+class UseProfile : public IRMutator {
+    using IRMutator::visit;
+
+    const map<string, SiteCounts> &counts;
+    bool fixed_versions;
+    SiteNamer namer;
+    string where;
+    // Whether the loop being mutated has a loop inside it.
+    bool inner_loop;
+
+    const SiteCounts *find(const string &site) {
+        map<string, SiteCounts>::const_iterator iter = counts.find(site);
+        return iter == counts.end() ? NULL : &iter->second;
+    }
+
+    void visit(const For *op) {
+        if (CodeGen_GPU_Dev::is_gpu_var(op->name)) {
+            inner_loop = true;
+            stmt = op;
+            return;
+        }
+        string site = namer.name("loop", op->name);
+
+        string outer = where;
+        where = op->name;
+        inner_loop = false;
+        Stmt body = mutate(op->body);
+        bool innermost = !inner_loop;
+        where = outer;
+        inner_loop = true;
+
+        const SiteCounts *c = find(site);
+        if (!c || c->c[0] == 0) {
+            stmt = For::make(op->name, op->min, op->extent, op->for_type, body);
+            return;
+        }
+        uint64_t entries = c->c[0], total = c->c[1], squares = c->c[2];
+
+        For::ForType for_type = op->for_type;
+        if (for_type == For::Parallel && total < 2 * entries) {
+            // The thread pool costs more than it saves.
+            debug(2) << "Making parallel loop " << op->name << " serial; it averaged "
+                     << (double)total / entries << " iterations\n";
+            for_type = For::Serial;
+        }
+        stmt = For::make(op->name, op->min, op->extent, for_type, body);
+
+        // If the trip count was always the same, its squares add up
+        // to exactly entries * k * k.
+        uint64_t k = total / entries;
+        if (fixed_versions && innermost && for_type == For::Serial && !is_const(op->extent) &&
+            total == k * entries && squares == k * k * entries &&
+            k > 1 && k <= kMaxFixedTripCount) {
+            debug(2) << "Making a version of " << op->name << " with " << k << " iterations\n";
+            Stmt fixed = For::make(op->name, op->min, (int)k, For::Serial, body);
+            Expr cond = weighted(op->extent == (int)k, entries, 0);
+            stmt = IfThenElse::make(cond, fixed, stmt);
+        }
+    }
+
+    void visit(const IfThenElse *op) {
+        string site = namer.name("if", where);
+        Stmt then_case = mutate(op->then_case);
+        Stmt else_case = op->else_case.defined() ? mutate(op->else_case) : Stmt();
+        Expr cond = op->condition;
+        const SiteCounts *c = find(site);
+        if (c && c->c[0] + c->c[1] > 0) {
+            cond = weighted(cond, c->c[0], c->c[1]);
+        }
+        stmt = IfThenElse::make(cond, then_case, else_case);
+    }
+
+public:
+    UseProfile(const map<string, SiteCounts> &c, bool f) :
+        counts(c), fixed_versions(f), where("$pipeline"), inner_loop(false) {}
+};
+
+// Read the counts for one pipeline from a file written by
+// halide_pgo_write. Sections for the same pipeline (e.g. from several
+// files pasted together) are added up.
+bool read_profile(const string &filename, const string &pipeline_name,
+                  map<string, SiteCounts> *counts) {
+    std::ifstream file(filename.c_str());
+    if (!file) {
+        std::cerr << "Warning: Could not read the profile " << filename << "\n";
+        return false;
+    }
+    bool found = false, in_pipeline = false;
+    string line;
+    while (std::getline(file, line)) {
+        std::istringstream words(line);
+        string kind, where;
+        if (!(words >> kind >> where)) continue;
+        if (kind == "pipeline") {
+            in_pipeline = (where == pipeline_name);
+            found = found || in_pipeline;
+            continue;
+        }
+        if (!in_pipeline) continue;
+        SiteCounts c;
+        for (int i = 0; i < kCountersPerSite; i++) {
+            if (!(words >> c.c[i])) {
+                std::cerr << "Warning: Bad line in the profile " << filename << ": " << line << "\n";
+                return false;
+            }
+        }
+        string site = kind + " " + where;
+        if (counts->find(site) == counts->end()) {
+            (*counts)[site] = c;
+        } else {
+            for (int i = 0; i < kCountersPerSite; i++) {
+                (*counts)[site].c[i] += c.c[i];
+            }
+        }
+    }
+    return found;
+}
+
+int env_int(const char *name) {
+    char *value = getenv(name);
+    return value ? atoi(value) : 0;
+}
+
+}
+
+Stmt profile_guided(Stmt s, const string &pipeline_name, bool fixed_versions) {
+    if (env_int("HL_PGO_INSTRUMENT")) {
+        InjectCounters inject;
+        s = inject.mutate(s);
+        if (inject.sites.empty()) {
+            return s;
+        }
+        string site_names;
+        for (size_t i = 0; i < inject.sites.size(); i++) {
+            site_names += (i > 0 ? "\n" : "") + inject.sites[i];
+        }
+        Expr counters = Call::make(Handle(), "halide_pgo_counters",
+                                   vec<Expr>(pipeline_name, (int)inject.sites.size(), site_names),
+                                   Call::Extern);
+        return LetStmt::make(kCountersName, counters, s);
+    }
+
+    char *profile = getenv("HL_PGO_PROFILE");
+    if (profile && profile[0]) {
+        map<string, SiteCounts> counts;
+        if (!read_profile(profile, pipeline_name, &counts)) {
+            debug(1) << "No profile for " << pipeline_name << " in " << profile << "\n";
+            return s;
+        }
+        s = UseProfile(counts, fixed_versions).mutate(s);
+    }
+    return s;
+}
+
+}
+}
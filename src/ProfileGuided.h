@@ -0,0 +1,37 @@
+#ifndef HALIDE_PROFILE_GUIDED_H
+#define HALIDE_PROFILE_GUIDED_H
+
+/** \file
+ * Defines the lowering pass that records, and then uses, how often
+ * the loops and branches of a pipeline run.
+ */
+
+#include "IR.h"
+
+#include <string>
+
+namespace Halide {
+namespace Internal {
+
+/** If HL_PGO_INSTRUMENT is set to a nonzero value, count the number
+ * of times each loop is entered, its total and squared trip counts,
+ * and how often each branch goes each way, in the runtime. The counts
+ * are written by halide_pgo_write, to the file named by
+ * HL_PGO_OUTPUT ("halide.pgo" by default).
+ *
+ * Otherwise, if HL_PGO_PROFILE names such a file, use the counts it
+ * has for this pipeline: branches get llvm branch weights (which also
+ * guide block placement), parallel loops that averaged fewer than two
+ * iterations become serial, and innermost serial loops that always
+ * ran the same small number of times get a version with that
+ * constant extent for llvm to unroll, unless fixed_versions is
+ * false. The loops and branches are
+ * named by where they are in the lowered pipeline, so the profile
+ * only applies to the same algorithm, schedule and target. Leaves gpu
+ * loops alone. Must run last, so that it sees the final loops. */
+Stmt profile_guided(Stmt s, const std::string &pipeline_name, bool fixed_versions = true);
+
+}
+}
+
+#endif
@@ -5,16 +5,14 @@
 #include "Profiling.h"
 #include "IRMutator.h"
 #include "IROperator.h"
+#include "CodeGen_GPU_Dev.h"
 
 namespace Halide {
 namespace Internal {
 
 namespace {
-    const char kBufName[] = "ProfilerBuffer";
-    const char kToplevel[] = "$total$";
-    const char kOverhead[] = "$overhead$";
-    const char kIgnore[] = "$ignore$";
-    const char kIgnoreBuf[] = "$ignore_buf$";
+    const char kStateName[] = "profiler_state";
+    const char kSlotName[] = "profiler_slot";
 }
 
 int profiling_level() {
@@ -30,76 +28,40 @@ class InjectProfiling : public IRMutator {
 public:
     InjectProfiling(string func_name)
         : level(profiling_level()),
-          func_name(sanitize(func_name)) {
+          func_name(sanitize(func_name)),
+          slot(Variable::make(Int(32), kSlotName)),
+          current(0) {
+        // Func id 0 is the time spent in the pipeline outside of any
+        // produce or update step.
+        names.push_back("pipeline " + this->func_name);
     }
 
-    Stmt inject(Stmt s) {
-        if (level >= 1) {
-            // Add calls to the nsec and timer at the start and end,
-            // so that we can get an estimate of how long a single
-            // tick of the profiling_timer is (since it may be dependent
-            // on e.g. processor clock rate)
-            {
-                PushCallStack st(this, kToplevel, kToplevel);
-                s = mutate(s);
-            }
-            s = add_ticks(kToplevel, kToplevel, s);
-            s = add_nsec(kToplevel, kToplevel, s);
-
-            // Note that this is tacked on to the front of the block, since it must come
-            // before the calls to halide_current_time_ns.
-            Expr begin_clock_call = Call::make(Int(32), "halide_start_clock", vector<Expr>(), Call::Extern);
-            Stmt begin_clock = AssertStmt::make(begin_clock_call == 0, "Failed to start clock", vector<Expr>());
-            s = Block::make(begin_clock, s);
-
-            // Do a little calibration: make a loop that does a large number of calls to add_ticks
-            // and measures the total time, so we can calculate the average overhead
-            // and subtract it from the final results. (The "body" of this loop is just
-            // a store of 0 to scratch that we expect to be optimized away.) This isn't a perfect
-            // solution, but is much better than nothing.
-            //
-            // Note that we deliberately unroll a bit to minimize loop overhead, otherwise our
-            // estimate will be too high.
-            //
-            // NOTE: we deliberately do this *after* measuring
-            // the total, so this should *not* be included in "kToplevel".
-            const int kIters = 1000000;
-            const int kUnroll = 4;
-            Stmt ticker_block = Stmt();
-            for (int i = 0; i < kUnroll; i++) {
-                ticker_block = Block::make(
-                    add_ticks(kIgnore, kIgnore, Store::make(kIgnoreBuf, Cast::make(UInt(32), 0), 0)),
-                        ticker_block);
-            }
-
-            Expr j = Variable::make(Int(32), "j");
-            Stmt do_timings = For::make("j", 0, kIters, For::Serial, ticker_block);
-            do_timings = add_ticks(kOverhead, kOverhead, do_timings);
-            do_timings = add_delta("count", kOverhead, kOverhead, Cast::make(UInt(64), 0),
-                Cast::make(UInt(64), kIters * kUnroll), do_timings);
-            s = Block::make(s, do_timings);
-            s = Allocate::make(kIgnoreBuf, UInt(32), vec(Expr(1)), s);
-
-            // Tack on code to print the counters.
-            for (map<string, int>::const_iterator it = indices.begin(); it != indices.end(); ++it) {
-                int idx = it->second;
-                Expr val = Load::make(UInt(64), kBufName, idx, Buffer(), Parameter());
-                Expr print_val = Call::make(Int(32), "halide_printf",
-                                            vec<Expr>(it->first + " %llu\n", val), Call::Extern);
-                Stmt print_stmt = AssertStmt::make(print_val > 0, "halide_printf failed", vector<Expr>());
-                s = Block::make(s, print_stmt);
-            }
-
-            // Now that we know the final size, allocate the buffer and init to zero.
-            Expr i = Variable::make(Int(32), "i");
-            Stmt init = For::make("i", 0, (int)indices.size(), For::Serial,
-                Store::make(kBufName, Cast::make(UInt(64), 0), i));
-            s = Block::make(init, s);
-
-            s = Allocate::make(kBufName, UInt(64), vec(Expr((int)indices.size())), s);
-        } else {
-            s = mutate(s);
+    Stmt inject(Stmt s, const Target &t) {
+        if (level < 1) {
+            return s;
+        }
+        if (t.os == Target::Windows) {
+            std::cerr << "Warning: The Halide profiler is not yet supported "
+                      << "on Windows. Not profiling " << func_name << "\n";
+            return s;
         }
+
+        s = mutate(s);
+
+        string func_names;
+        for (size_t i = 0; i < names.size(); i++) {
+            func_names += (i > 0 ? "\n" : "") + names[i];
+        }
+
+        Expr start = Call::make(Handle(), "halide_profiler_pipeline_start",
+                                vec<Expr>(func_name, (int)names.size(), func_names),
+                                Call::Extern);
+        Expr end = Call::make(Int(32), "halide_profiler_pipeline_end",
+                              vec<Expr>(state()), Call::Extern);
+        s = Block::make(s, Evaluate::make(end));
+        // The thread that runs the pipeline holds slot zero.
+        s = LetStmt::make(kSlotName, 0, s);
+        s = LetStmt::make(kStateName, start, s);
         return s;
     }
 
@@ -108,21 +70,12 @@ private:
 
     const int level;
     const string func_name;
-    map<string, int> indices;   // map name -> index in buffer.
-    vector<string> call_stack;  // names of the nodes upstream
-
-    class PushCallStack {
-    public:
-        InjectProfiling* ip;
-
-        PushCallStack(InjectProfiling* ip, const string& op_type, const string& op_name) : ip(ip) {
-            ip->call_stack.push_back(op_type + " " + op_name);
-        }
-
-        ~PushCallStack() {
-            ip->call_stack.pop_back();
-        }
-    };
+    map<string, int> indices;   // map name -> func id
+    vector<string> names;       // map func id -> name
+    // The profiler slot of the thread running the current statement,
+    // and the func id it is computing.
+    Expr slot;
+    int current;
 
     // replace all spaces with '_'
     static string sanitize(const string& s) {
@@ -131,109 +84,82 @@ private:
       return san;
     }
 
-    Expr get_index(const string& s) {
+    static Expr state() {
+        return Variable::make(Handle(), kStateName);
+    }
+
+    int get_func_id(const string &op_type, const string &op_name) {
+        string s = op_type + " " + sanitize(op_name);
         if (indices.find(s) == indices.end()) {
-            int idx = indices.size();
+            int idx = names.size();
             indices[s] = idx;
+            names.push_back(s);
         }
         return indices[s];
     }
 
-    Stmt add_count_and_ticks(const string& op_type, const string& op_name, Stmt s) {
-        s = add_count(op_type, op_name, s);
-        s = add_ticks(op_type, op_name, s);
-        return s;
-    }
-
-    Stmt add_count(const string& op_type, const string& op_name, Stmt s) {
-        return add_delta("count", op_type, op_name, Cast::make(UInt(64), 0), Cast::make(UInt(64), 1), s);
+    Stmt profiler_call(const string &name, Expr a, Expr b) {
+        return Evaluate::make(Call::make(Int(32), name, vec<Expr>(state(), a, b), Call::Extern));
     }
 
-    Stmt add_ticks(const string& op_type, const string& op_name, Stmt s) {
-        Expr ticks = Call::make(UInt(64), Internal::Call::profiling_timer, vector<Expr>(), Call::Intrinsic);
-        return add_delta("ticks", op_type, op_name, ticks, ticks, s);
+    // Counts an invocation of the func and marks the thread as computing it.
+    Stmt enter_func(int id) {
+        return profiler_call("halide_profiler_enter_func", slot, id);
     }
 
-    Stmt add_nsec(const string& op_type, const string& op_name, Stmt s) {
-        Expr nsec = Call::make(UInt(64), "halide_current_time_ns", std::vector<Expr>(), Call::Extern);
-        return add_delta("nsec", op_type, op_name, nsec, nsec, s);
+    Stmt set_func(int id) {
+        return profiler_call("halide_profiler_set_func", slot, id);
     }
 
-    Stmt add_delta(const string& metric_name, const string& op_type, const string& op_name,
-                   Expr begin_val, Expr end_val, Stmt s) {
-        string parent_name_pair = call_stack.empty() ?
-            "null null" :
-            call_stack.back();
-        string full_name = "halide_profiler " +
-            metric_name + " " +
-            func_name + " " +
-            op_type + " " +
-            sanitize(op_name) + " " +
-            parent_name_pair;
-        assert(begin_val.type() == UInt(64));
-        assert(end_val.type() == UInt(64));
-        Expr idx = get_index(full_name);
-
-        string begin_var_name = "begin_" + full_name;
-        // variable name doesn't matter at all, but de-spacing
-        // makes the Stmt output easier to read
-        std::replace(begin_var_name.begin(), begin_var_name.end(), ' ', '_');
-        Expr begin_var = Variable::make(UInt(64), begin_var_name);
-
-        Expr old_val = Load::make(UInt(64), kBufName, idx, Buffer(), Parameter());
-        Expr delta_val = Sub::make(end_val, begin_var);
-        Expr new_val = Add::make(old_val, delta_val);
-        s = Block::make(s, Store::make(kBufName, new_val, idx));
-        s = LetStmt::make(begin_var_name, begin_val, s);
+    void visit(const Pipeline *op) {
+        int parent = current;
 
-        return s;
-    }
+        current = get_func_id("produce", op->name);
+        Stmt produce = Block::make(enter_func(current), mutate(op->produce));
 
-    void visit(const Pipeline *op) {
-        if (level >= 1) {
-            Stmt produce, update, consume;
-            {
-                PushCallStack st(this, "produce", op->name);
-                produce = mutate(op->produce);
-            }
-            {
-                PushCallStack st(this, "update", op->name);
-                update = op->update.defined() ? mutate(op->update) : Stmt();
-            }
-            {
-                PushCallStack st(this, "consume", op->name);
-                consume = mutate(op->consume);
-            }
-
-            produce = add_count_and_ticks("produce", op->name, produce);
-            update = update.defined() ? add_count_and_ticks("update", op->name, update) : Stmt();
-            consume = add_count_and_ticks("consume", op->name, consume);
-
-            stmt = Pipeline::make(op->name, produce, update, consume);
-        } else {
-            IRMutator::visit(op);
+        Stmt update;
+        if (op->update.defined()) {
+            current = get_func_id("update", op->name);
+            update = Block::make(enter_func(current), mutate(op->update));
         }
+
+        current = parent;
+        Stmt consume = Block::make(set_func(parent), mutate(op->consume));
+
+        stmt = Pipeline::make(op->name, produce, update, consume);
     }
 
     void visit(const For *op) {
-        if (op->for_type == For::Parallel && level >= 1) {
-            std::cerr << "Warning: The Halide profiler does not yet support "
-                      << "parallel schedules. Not profiling inside the loop over "
-                      << op->name << "\n";
+        if (CodeGen_GPU_Dev::is_gpu_var(op->name) || op->for_type == For::Vectorized) {
+            // Time spent in kernels and vectorized loops is charged to
+            // the func around them.
             stmt = op;
+        } else if (op->for_type == For::Parallel) {
+            // Each task takes a slot of its own, and the thread that
+            // launches them is idle until they are done.
+            Expr outer_slot = slot;
+            string slot_name = op->name + "." + kSlotName;
+            slot = Variable::make(Int(32), slot_name);
+            Stmt body = mutate(op->body);
+            Expr release = Call::make(Int(32), "halide_profiler_release_slot",
+                                      vec<Expr>(state(), slot), Call::Extern);
+            body = Block::make(body, Evaluate::make(release));
+            Expr acquire = Call::make(Int(32), "halide_profiler_acquire_slot",
+                                      vec<Expr>(state(), current), Call::Extern);
+            body = LetStmt::make(slot_name, acquire, body);
+            slot = outer_slot;
+
+            stmt = For::make(op->name, op->min, op->extent, op->for_type, body);
+            stmt = Block::make(set_func(-1), Block::make(stmt, set_func(current)));
         } else {
             IRMutator::visit(op);
         }
-        // We only instrument loops at profiling level 2 or higher
-        if (level >= 2) {
-            stmt = add_count_and_ticks("forloop", op->name, stmt);
-        }
     }
 };
 
-Stmt inject_profiling(Stmt s, string name) {
+Stmt inject_profiling(Stmt s, string name, const Target &t) {
     InjectProfiling profiling(name);
-    s = profiling.inject(s);
+    s = profiling.inject(s, t);
     return s;
 }
 
@@ -2,29 +2,28 @@
 #define HALIDE_PROFILING_H
 
 /** \file
- * Defines the lowering pass that injects print statements when profiling is turned on
+ * Defines the lowering pass that instruments a pipeline for the
+ * sampling profiler when profiling is turned on
  */
 
 #include "IR.h"
+#include "Target.h"
 
 namespace Halide {
 namespace Internal {
 
 /** Take a statement representing a halide pipeline, and (depending on
- * the environment variable HL_PROFILE), insert high-resolution timing
- * into the generated code; summaries of execution times and counts will
- * be logged at the end. Should be done before storage flattening, but
- * after all bounds inference. Use util/HalideProf to analyze the output.
- *
- * NOTE: this makes no effort to provide accurate or useful information
- * when parallelization is scheduled; more work would need to be done
- * to safely record data from multiple threads.
- *
- * NOTE: this makes no effort to account for overhead from the profiling
- * instructions inserted; profile-enabled runtimes will be slower,
- * and inner loops will be more profoundly affected.
+ * the environment variable HL_PROFILE), make it tell the runtime's
+ * sampling profiler which Func each thread is computing as it enters
+ * and leaves each produce and update step, and as parallel tasks
+ * start and finish. A thread in the runtime samples these at a fixed
+ * rate (every HL_PROFILE_INTERVAL_US microseconds, 1000 by default),
+ * so the pipeline itself does no timing. Should be done before
+ * storage flattening, but after all bounds inference. The totals are
+ * printed by halide_profiler_report, or when a JIT-compiled pipeline
+ * is freed; use util/HalideProf to analyze the output.
  */
-Stmt inject_profiling(Stmt, std::string);
+Stmt inject_profiling(Stmt, std::string, const Target &);
 
 /** Gets the current profiling level (by reading HL_PROFILE) */
 int profiling_level();
@@ -0,0 +1,153 @@
+#include "Pyramid.h"
+#include "IROperator.h"
+#include "Util.h"
+
+namespace Halide {
+
+using std::vector;
+using std::string;
+
+namespace {
+
+vector<Expr> as_exprs(const vector<Var> &args) {
+    vector<Expr> result;
+    for (size_t i = 0; i < args.size(); i++) {
+        Var v = args[i];
+        result.push_back(v);
+    }
+    return result;
+}
+
+// The 1 3 3 1 filter along one dimension, at half resolution.
+Expr down_taps(Func f, vector<Expr> args, int dim) {
+    Expr x = args[dim];
+    args[dim] = 2*x - 1;
+    Expr a = f(args);
+    args[dim] = 2*x;
+    Expr b = f(args);
+    args[dim] = 2*x + 1;
+    Expr c = f(args);
+    args[dim] = 2*x + 2;
+    Expr d = f(args);
+    return (a + 3.0f * (b + c) + d) / 8.0f;
+}
+
+// Linear interpolation along one dimension, at double resolution.
+Expr up_taps(Func f, vector<Expr> args, int dim) {
+    Expr x = args[dim];
+    args[dim] = (x/2) - 1 + 2*(x % 2);
+    Expr a = f(args);
+    args[dim] = x/2;
+    Expr b = f(args);
+    return 0.25f * a + 0.75f * b;
+}
+
+// downsample, and the horizontal pass it makes on the way.
+Func downsample_with_pass(Func f, Func *pass) {
+    assert(f.defined() && f.outputs() == 1 && f.dimensions() >= 2 &&
+           "downsample takes a Func with a single value and at least two dimensions");
+    string name = f.name() + "_down" + Internal::unique_name('_');
+    vector<Var> args = f.args();
+    vector<Expr> call = as_exprs(args);
+
+    Func down_x(name + "_x");
+    down_x(args) = down_taps(f, call, 0);
+
+    Func down_y(name);
+    down_y(args) = down_taps(down_x, call, 1);
+
+    if (pass) *pass = down_x;
+    return down_y;
+}
+
+}
+
+Func downsample(Func f) {
+    return downsample_with_pass(f, NULL);
+}
+
+Func upsample(Func f) {
+    assert(f.defined() && f.outputs() == 1 && f.dimensions() >= 2 &&
+           "upsample takes a Func with a single value and at least two dimensions");
+    string name = f.name() + "_up" + Internal::unique_name('_');
+    vector<Var> args = f.args();
+    vector<Expr> call = as_exprs(args);
+
+    Func up_x(name + "_x");
+    up_x(args) = up_taps(f, call, 0);
+
+    Func up_y(name);
+    up_y(args) = up_taps(up_x, call, 1);
+    return up_y;
+}
+
+Pyramid::Pyramid(Func base, int levels, Func (*down)(Func)) {
+    assert(levels > 0 && "A pyramid needs at least one level");
+    levels_.push_back(base);
+    passes_.push_back(Func());
+    for (int i = 1; i < levels; i++) {
+        Func pass;
+        if (down == downsample) {
+            levels_.push_back(downsample_with_pass(levels_.back(), &pass));
+        } else {
+            levels_.push_back(down(levels_.back()));
+        }
+        passes_.push_back(pass);
+    }
+}
+
+Pyramid::Pyramid(const vector<Func> &levels) :
+    levels_(levels), passes_(levels.size()) {
+    assert(!levels.empty() && "A pyramid needs at least one level");
+}
+
+Pyramid Pyramid::laplacian() const {
+    vector<Func> result(levels_.size());
+    int n = levels();
+    result[n-1] = levels_[n-1];
+    for (int i = n - 2; i >= 0; i--) {
+        vector<Var> args = levels_[i].args();
+        vector<Expr> call = as_exprs(args);
+        Func up = upsample(levels_[i+1]);
+        result[i] = Func(levels_[i].name() + "_laplacian" + Internal::unique_name('_'));
+        result[i](args) = levels_[i](call) - up(call);
+    }
+    return Pyramid(result);
+}
+
+Pyramid Pyramid::collapse() const {
+    vector<Func> result(levels_.size());
+    int n = levels();
+    result[n-1] = levels_[n-1];
+    for (int i = n - 2; i >= 0; i--) {
+        vector<Var> args = levels_[i].args();
+        vector<Expr> call = as_exprs(args);
+        Func up = upsample(result[i+1]);
+        result[i] = Func(levels_[i].name() + "_collapsed" + Internal::unique_name('_'));
+        result[i](args) = up(call) + levels_[i](call);
+    }
+    return Pyramid(result);
+}
+
+Pyramid &Pyramid::schedule(int width, int parallel_width) {
+    for (int i = 1; i < levels(); i++) {
+        int w = width >> i;
+        vector<Var> args = levels_[i].args();
+        Var x = args[0], y = args[1];
+        if (w >= parallel_width) {
+            Var yo, yi;
+            levels_[i].compute_root().split(y, yo, yi, 8).parallel(yo).vectorize(x, 8);
+            if (passes_[i].defined()) {
+                passes_[i].compute_at(levels_[i], yo).vectorize(x, 8);
+            }
+        } else {
+            levels_[i].compute_root();
+            if (w >= 8) {
+                levels_[i].vectorize(x, 8);
+            }
+        }
+    }
+    return *this;
+}
+
+}
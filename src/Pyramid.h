@@ -0,0 +1,82 @@
+#ifndef HALIDE_PYRAMID_H
+#define HALIDE_PYRAMID_H
+
+/** \file
+ * Defines image pyramids, and a schedule for them that depends on the
+ * size of each level.
+ */
+
+#include <vector>
+
+#include "Func.h"
+
+namespace Halide {
+
+/** Halve the first two dimensions of a float Func with a 1 3 3 1
+ * filter. The other dimensions are left alone. */
+EXPORT Func downsample(Func f);
+
+/** Double the first two dimensions of a float Func with bilinear
+ * interpolation. The other dimensions are left alone. */
+EXPORT Func upsample(Func f);
+
+/** A sequence of Funcs, each half the size of the one before it in
+ * its first two dimensions. Level zero is the Func the pyramid was
+ * made from, and every other level has the same arguments as it.
+ *
+ * Example:
+ \code
+ Pyramid gaussian(gray, 8);
+ Pyramid laplacian = gaussian.laplacian();
+ ...
+ gaussian.schedule(1536);
+ \endcode
+ */
+class Pyramid {
+    std::vector<Func> levels_;
+    // The horizontal pass that makes each level, if it was made by
+    // downsample.
+    std::vector<Func> passes_;
+public:
+    /** Make a pyramid of the given number of levels, by applying a
+     * rule to each level to make the next. */
+    EXPORT Pyramid(Func base, int levels, Func (*down)(Func) = downsample);
+
+    /** Make a pyramid from levels built by hand. */
+    EXPORT Pyramid(const std::vector<Func> &levels);
+
+    /** The number of levels. */
+    int levels() const {
+        return (int)levels_.size();
+    }
+
+    /** Get a level. Level zero is the largest. */
+    Func operator[](int level) const {
+        assert(level >= 0 && level < levels() && "Pyramid level out of range");
+        return levels_[level];
+    }
+
+    /** The laplacian pyramid of this one: each level is the
+     * difference between this level and the next one upsampled. The
+     * last level is the last level of this pyramid. */
+    EXPORT Pyramid laplacian() const;
+
+    /** Add up the levels of a laplacian pyramid, from the smallest
+     * one up. Level zero of the result is the image the laplacian
+     * pyramid came from. */
+    EXPORT Pyramid collapse() const;
+
+    /** Schedule each level but the first according to its size,
+     * given the width of level zero. Levels at least parallel_width
+     * wide are computed at root in strips of rows in parallel,
+     * vectorized. Smaller levels aren't worth the overhead of a
+     * parallel loop, and are computed at root serially, vectorized if
+     * they're wide enough. The intermediate horizontal passes of the
+     * downsamples are computed per strip for the large levels, and
+     * inlined into the small ones. */
+    EXPORT Pyramid &schedule(int width, int parallel_width = 256);
+};
+
+}
+
+#endif
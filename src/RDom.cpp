@@ -118,6 +118,24 @@ RDom::RDom(Expr min0, Expr extent0, Expr min1, Expr extent1, Expr min2, Expr ext
     w = RVar(name + ".w$r", min3, extent3, dom);
 }
 
+RDom::RDom(const vector<Expr> &mins, const vector<Expr> &extents, string name) {
+    assert(!mins.empty() && mins.size() == extents.size() &&
+           "RDom needs the same number of mins and extents, and at least one of each");
+    if (name == "") name = Internal::unique_name('r');
+    const char *var_names[] = {"x", "y", "z", "w"};
+    vector<Internal::ReductionVariable> d;
+    for (size_t i = 0; i < mins.size(); i++) {
+        string var = i < 4 ? var_names[i] : "v" + Internal::int_to_string((int)i);
+        Internal::ReductionVariable v = {name + "." + var + "$r", cast<int>(mins[i]), cast<int>(extents[i])};
+        d.push_back(v);
+    }
+    dom = Internal::ReductionDomain(d);
+    RVar *vars[] = {&x, &y, &z, &w};
+    for (size_t i = 0; i < d.size() && i < 4; i++) {
+        *(vars[i]) = RVar(d[i].var, d[i].min, d[i].extent, dom);
+    }
+}
+
 RDom::RDom(Buffer b) {
     Expr min[4], extent[4];
     for (int i = 0; i < 4; i++) {
@@ -170,6 +188,10 @@ RVar RDom::operator[](int i) {
     if (i == 1) return y;
     if (i == 2) return z;
     if (i == 3) return w;
+    if (i > 3 && i < dimensions()) {
+        const Internal::ReductionVariable &v = dom.domain()[i];
+        return RVar(v.var, v.min, v.extent, dom);
+    }
     assert(false && "Reduction domain index out of bounds");
     return x; // Keep the compiler happy
 }
@@ -30,6 +30,11 @@ public:
     RVar(std::string __name, Expr __min, Expr __extent, Internal::ReductionDomain _domain) :
         _name(__name), _min(__min), _extent(__extent), domain(_domain) {}
 
+    /** Construct a reduction variable that only has a name, to name
+     * the loops made by splitting another one (see \ref
+     * ScheduleHandle::split). It can't be used in an expression. */
+    explicit RVar(const std::string &__name) : _name(__name) {}
+
     /** The minimum value that this variable will take on */
     Expr min() const {return _min;}
 
@@ -186,6 +191,14 @@ public:
      * name. If the name is left blank, a unique one is
      * auto-generated. */
     EXPORT RDom(Expr min0, Expr extent0, Expr min1, Expr extent1, Expr min2, Expr extent2, Expr min3, Expr extent3, std::string name = "");
+
+    /** Construct a reduction domain of any dimensionality with the
+     * given name, from a list of mins and a list of extents of the
+     * same length. The first four dimensions are also available as
+     * x, y, z and w; use operator[] for the rest. If the name is left
+     * blank, a unique one is auto-generated. */
+    EXPORT RDom(const std::vector<Expr> &mins, const std::vector<Expr> &extents, std::string name = "");
+
     /** Construct a reduction domain that iterates over all points in
      * a given Buffer, Image, or ImageParam. Has the same
      * dimensionality as the argument. */
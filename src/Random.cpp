@@ -7,87 +7,85 @@ namespace Internal {
 
 using std::vector;
 using std::string;
+using std::pair;
+using std::make_pair;
 
 namespace {
 
-// Some randomly-generated integers.
-#define C0 576942909
-#define C1 1121052041
-#define C2 1040796640
-
-// Permute a 32-bit integer using a fixed psuedorandom permutation.
-Expr rng32(Expr x) {
-    assert(x.type() == Int(32));
-
-    // A polynomial P with coefficients C0 .. CN induces a permutation
-    // modulo 2^d iff:
-    // 1) P(0) != P(1) modulo 2
-    // 2) sum(i * Ci) is odd
-    
-    // (See http://en.wikipedia.org/wiki/Permutation_polynomial#Rings_Z.2FpkZ)
-
-    // For a quadratic, this is only satisfied by:
-    // C0 anything
-    // C1 odd
-    // C2 even
-
-    // The coefficients defined above were chosen to satisfy this
-    // property.
-
-    // It's pretty random, but note that the quadratic term disappears
-    // if inputs are the multiples of 2^16, and so you get a linear
-    // sequence.  However, *that* linear sequence probably varies in
-    // the low bits, so if you run in through the permutation again,
-    // you should break it up. All actual use of this runs it through
-    // multiple times in order to combine several inputs, so it should
-    // be ok. The other flaw is it's a permutation, so you get no
-    // collisions. Birthday paradox be damned.
-
-    // However, it's exceedingly cheap to compute, as it only uses
-    // vectorizable int32 muls and adds, and the resulting numbers:
-    // - Have the correct moments for a uniform distribution
-    // - Have no serial correlations in any of the bits
-    // - Have a completely flat power spectrum
-    // - Have no visible patterns
-
-    // So I declare this good enough for image processing.
-
-    // If it's just a const (which it often is), save the simplifier some work:
-    if (const int *i = as_const_int(x)) {
-        return (((C2 * (*i)) + C1) * (*i) + C0);
-    }
+// The multipliers and key increments of Philox4x32 (Salmon et al.,
+// "Parallel random numbers: as easy as 1, 2, 3", SC 2011), along with
+// a fixed key, from the digits of pi.
+const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+const uint32_t K0 = 0xA4093822, K1 = 0x299F31D0;
 
-    return (((C2 * x) + C1) * x) + C0;
-}    
+// Seven rounds is the fewest that pass all of TestU01's BigCrush.
+const int philox_rounds = 7;
 
+Expr u32(uint32_t x) {
+    return make_const(UInt(32), (int)x);
 }
 
-Expr random_int(const vector<Expr> &e) {
+// Permute four 32-bit words with Philox4x32. Each round is a pair of
+// 32x32->64 bit multiplies, which are pmuludq on x86 and vmull on
+// ARM, and the same arithmetic on every other backend. Adds the lets
+// that hold the products to lets, innermost last.
+void philox(Expr x[4], vector<pair<string, Expr> > &lets) {
+    uint32_t k0 = K0, k1 = K1;
+    for (int i = 0; i < philox_rounds; i++) {
+        Expr p0 = cast(UInt(64), u32(M0)) * cast(UInt(64), x[0]);
+        Expr p1 = cast(UInt(64), u32(M1)) * cast(UInt(64), x[2]);
+        string n0 = unique_name('R'), n1 = unique_name('R');
+        lets.push_back(make_pair(n0, p0));
+        lets.push_back(make_pair(n1, p1));
+        p0 = Variable::make(UInt(64), n0);
+        p1 = Variable::make(UInt(64), n1);
+        Expr hi0 = cast(UInt(32), p0 >> 32), lo0 = cast(UInt(32), p0);
+        Expr hi1 = cast(UInt(32), p1 >> 32), lo1 = cast(UInt(32), p1);
+        Expr y[4] = {hi1 ^ x[1] ^ u32(k0), lo1, hi0 ^ x[3] ^ u32(k1), lo0};
+        for (int j = 0; j < 4; j++) x[j] = y[j];
+        k0 += W0;
+        k1 += W1;
+    }
+}
+
+}
+
+vector<Expr> random_ints(const vector<Expr> &e) {
     assert(e.size());
-    assert(e[0].type() == Int(32));
-    // Permute the first term
-    Expr result = rng32(e[0]);
-    for (size_t i = 1; i < e.size(); i++) {
-        assert(e[i].type() == Int(32));
-        // Add in the next term and permute again
-        string name = unique_name('R');
-        // If it's a const, save the simplifier some work
-        const int *ir = as_const_int(result);
-        const int *ie = as_const_int(e[i]);
-        if (ir && ie) {
-            result = rng32((*ir) + (*ie));
-        } else {
-            result = Let::make(name, result + e[i],
-                               rng32(Variable::make(Int(32), name)));
+    // Take in the terms four at a time, mixing each group into the
+    // output of the last one.
+    Expr x[4] = {u32(0), u32(0), u32(0), u32(0)};
+    vector<pair<string, Expr> > lets;
+    for (size_t i = 0; i < e.size(); i += 4) {
+        for (size_t j = 0; j < 4 && i + j < e.size(); j++) {
+            Expr t = e[i + j];
+            assert((t.type() == Int(32) || t.type() == UInt(32)) &&
+                   "The terms of a random number must be 32-bit integers");
+            x[j] = x[j] ^ cast(UInt(32), t);
+        }
+        philox(x, lets);
+    }
+
+    vector<Expr> result;
+    for (int j = 0; j < 4; j++) {
+        Expr r = x[j];
+        for (size_t i = lets.size(); i > 0; i--) {
+            r = Let::make(lets[i-1].first, lets[i-1].second, r);
         }
+        result.push_back(r);
     }
     return result;
 }
 
+Expr random_int(const vector<Expr> &e) {
+    return random_ints(e)[0];
+}
+
 Expr random_float(const vector<Expr> &e) {
     Expr result = random_int(e);
     // Set the exponent to one, and fill the mantissa with 23 random bits.
-    result = (127 << 23) | (cast<uint32_t>(result) >> 9);
+    result = (127 << 23) | (result >> 9);
     // The clamp is purely for the benefit of bounds inference.
     return clamp(reinterpret(Float(32), result) - 1.0f, 0.0f, 1.0f);
 }
@@ -20,9 +20,18 @@ Expr random_float(const std::vector<Expr> &);
 
 /** Return a random unsigned integer between zero and 2^32-1 that
  * varies deterministically based on the input expressions (which must
- * be integers). */
+ * be 32-bit integers). This is the counter-based generator
+ * Philox4x32, which only uses vectorizable 32x32->64 bit multiplies,
+ * and gives the same results on every backend. */
 Expr random_int(const std::vector<Expr> &);
 
+/** Return four independent random unsigned integers that vary
+ * deterministically based on the input expressions. These come from
+ * a single evaluation of the generator used by random_int, so they
+ * cost no more than one of them. The first is the value of
+ * random_int. */
+std::vector<Expr> random_ints(const std::vector<Expr> &);
+
 /** Convert calls to random() to IR generated by random_float and
  * random_int. Tags all calls with the variables in free_vars, and the
  * integer given as the last argument. */
@@ -0,0 +1,138 @@
+#include "Resample.h"
+#include "IROperator.h"
+#include "InlineReductions.h"
+#include "RDom.h"
+#include "Util.h"
+
+#include <math.h>
+
+namespace Halide {
+
+using std::vector;
+using std::string;
+
+namespace {
+
+const float pi = 3.14159265358979323846f;
+
+// How far from zero each filter is nonzero, in input pixels.
+float filter_support(ResampleFilter filter) {
+    switch (filter) {
+    case Resample_Box: return 0.5f;
+    case Resample_Linear: return 1.0f;
+    case Resample_Cubic: return 2.0f;
+    default: return 3.0f;
+    }
+}
+
+Expr sinc(Expr x) {
+    return select(x == 0.0f, 1.0f, sin(pi * x) / (pi * x));
+}
+
+Expr filter_weight(ResampleFilter filter, Expr x) {
+    Expr xx = abs(x);
+    switch (filter) {
+    case Resample_Box:
+        return select(xx <= 0.5f, 1.0f, 0.0f);
+    case Resample_Linear:
+        return max(1.0f - xx, 0.0f);
+    case Resample_Cubic: {
+        const float a = -0.5f;
+        Expr xx2 = xx * xx, xx3 = xx2 * xx;
+        return select(xx < 1.0f, (a + 2.0f) * xx3 - (a + 3.0f) * xx2 + 1.0f,
+                      xx < 2.0f, a * xx3 - 5.0f * a * xx2 + 8.0f * a * xx - 4.0f * a,
+                      0.0f);
+    }
+    default:
+        return select(xx < 3.0f, sinc(x) * sinc(x / 3.0f), 0.0f);
+    }
+}
+
+// The taps used along one dimension: the first input coordinate
+// for output coordinate x, how many taps there are, and a table of
+// their weights, indexed by x and the tap.
+struct Taps {
+    Expr begin;
+    int count;
+    Func weights;
+};
+
+Taps make_taps(Var x, float scale, ResampleFilter filter, const string &name) {
+    assert(scale > 0 && "Resampling factors must be positive");
+    // Widen the filter to low-pass when downsampling.
+    float widen = scale < 1.0f ? scale : 1.0f;
+    float support = filter_support(filter) / widen;
+
+    Taps taps;
+    Expr source = (cast<float>(x) + 0.5f) / scale - 0.5f;
+    taps.begin = cast<int>(ceil(source - support));
+    taps.count = (int)floorf(2 * support) + 1;
+
+    Var k;
+    Func raw(name + "_raw");
+    raw(x, k) = filter_weight(filter, (cast<float>(taps.begin + k) - source) * widen);
+    RDom r(0, taps.count, name + "_r");
+    taps.weights = Func(name);
+    taps.weights(x, k) = raw(x, k) / sum(raw(x, r));
+    taps.weights.compute_root().bound(k, 0, taps.count);
+    return taps;
+}
+
+// The dot product of the taps with the source, unrolled when it's
+// short.
+Expr apply_taps(const Taps &taps, Expr x, Func f, vector<Expr> args, int dim) {
+    if (taps.count <= 16) {
+        Expr result;
+        for (int i = 0; i < taps.count; i++) {
+            args[dim] = taps.begin + i;
+            Expr term = taps.weights(x, i) * f(args);
+            result = result.defined() ? result + term : term;
+        }
+        return result;
+    } else {
+        RDom r(0, taps.count);
+        args[dim] = taps.begin + r;
+        return sum(taps.weights(x, r) * f(args));
+    }
+}
+
+}
+
+Func resample(Func in, float scale_x, float scale_y, ResampleFilter filter) {
+    assert(in.defined() && in.outputs() == 1 && in.dimensions() >= 2 &&
+           "resample takes a Func with a single value and at least two dimensions");
+
+    string name = in.name() + "_resample" + Internal::unique_name('_');
+    vector<Var> args = in.args();
+    Var x = args[0], y = args[1];
+    vector<Expr> call;
+    for (size_t i = 0; i < args.size(); i++) {
+        Var v = args[i];
+        call.push_back(v);
+    }
+
+    Taps taps_x = make_taps(x, scale_x, filter, name + "_weights_x");
+    Taps taps_y = make_taps(y, scale_y, filter, name + "_weights_y");
+
+    Func as_float(name + "_as_float");
+    as_float(args) = cast<float>(in(call));
+
+    Func resized_x(name + "_x");
+    resized_x(args) = apply_taps(taps_x, x, as_float, call, 0);
+
+    Expr value = apply_taps(taps_y, y, resized_x, call, 1);
+    Type t = in.output_types()[0];
+    if (!t.is_float()) {
+        value = clamp(floor(value + 0.5f), cast<float>(t.min()), cast<float>(t.max()));
+    }
+
+    Func out(name);
+    out(args) = cast(t, value);
+
+    Var yo, yi;
+    out.split(y, yo, yi, 32).parallel(yo).vectorize(x, 8);
+    resized_x.compute_at(out, yo).vectorize(x, 8);
+    return out;
+}
+
+}
@@ -0,0 +1,44 @@
+#ifndef HALIDE_RESAMPLE_H
+#define HALIDE_RESAMPLE_H
+
+/** \file
+ * Defines separable resampling of images by arbitrary factors.
+ */
+
+#include "Func.h"
+
+namespace Halide {
+
+/** The filters resample can use. */
+enum ResampleFilter {
+    Resample_Box,     ///< Nearest neighbor when upsampling, averaging when downsampling.
+    Resample_Linear,  ///< Bilinear, the tent filter.
+    Resample_Cubic,   ///< Bicubic, the Catmull-Rom spline (a = -0.5).
+    Resample_Lanczos  ///< Lanczos with three lobes.
+};
+
+/** Resize the first two dimensions of a Func by the given factors,
+ * using a separable filter. The other dimensions are left alone. The
+ * center of output pixel x samples the source at (x + 0.5) / scale_x
+ * - 0.5. When downsampling, the filter is widened by the inverse of
+ * the scale, so that it also filters out the frequencies that can't
+ * be represented.
+ *
+ * The weights of the filter taps are computed once per output column
+ * and once per output row, normalized to sum to one, and kept in
+ * tables at root. The first input pixel of each output pixel is an
+ * affine function of it, rounded down, so bounds inference finds the
+ * footprint of a tile of the output exactly. The source is read
+ * outside of its image near the edges, so it should have a boundary
+ * condition (see BoundaryConditions.h).
+ *
+ * The result has the type of the source, and is computed in float
+ * (and rounded and clamped for integer types). It's scheduled in
+ * strips of 32 rows in parallel, vectorized along the first
+ * dimension, with the horizontal resampling computed per strip. */
+EXPORT Func resample(Func in, float scale_x, float scale_y,
+                     ResampleFilter filter = Resample_Linear);
+
+}
+
+#endif
@@ -0,0 +1,254 @@
+#include "ReuseAllocations.h"
+#include "AllocationUtils.h"
+#include "IRMutator.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "Substitute.h"
+#include "Simplify.h"
+#include "Util.h"
+#include "Debug.h"
+
+#include <map>
+#include <set>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+using std::set;
+using std::pair;
+using std::make_pair;
+
+namespace {
+
+Expr size_in_bytes(const Allocate *op) {
+    Expr size = Cast::make(Int(64), op->type.bytes());
+    for (size_t i = 0; i < op->extents.size(); i++) {
+        size = size * Cast::make(Int(64), op->extents[i]);
+    }
+    return size;
+}
+
+// Decide which buffers go in the allocation of which other buffer,
+// walking the statements outside of any loop in the order they run.
+class PlanReuse : public IRVisitor {
+    using IRVisitor::visit;
+
+    int loop_depth, if_depth;
+
+    // The lets outside of any loop around the statement being
+    // visited, outermost first.
+    vector<pair<string, Expr> > lets;
+
+    // An allocation that stays, along with the buffers that share it.
+    struct Group {
+        const Allocate *op;
+        // How many of the lets were around the Allocate node.
+        size_t lets_outside;
+        // The buffer using it now, and whether it's been freed.
+        string current;
+        bool dead;
+        Scope<int> defined_inside;
+        bool found_definitions;
+    };
+    // The allocations enclosing the statement being visited.
+    vector<Group> groups;
+
+    Group *group_of(const string &name) {
+        map<string, string>::iterator iter = root.find(name);
+        if (iter == root.end()) return NULL;
+        for (size_t i = 0; i < groups.size(); i++) {
+            if (groups[i].op->name == iter->second) return &groups[i];
+        }
+        return NULL;
+    }
+
+    void visit(const For *op) {
+        loop_depth++;
+        IRVisitor::visit(op);
+        loop_depth--;
+    }
+
+    void visit(const IfThenElse *op) {
+        if_depth++;
+        IRVisitor::visit(op);
+        if_depth--;
+    }
+
+    void visit(const LetStmt *op) {
+        if (loop_depth == 0) {
+            op->value.accept(this);
+            lets.push_back(make_pair(op->name, op->value));
+            op->body.accept(this);
+            lets.pop_back();
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+    // The size of a buffer, in terms of what's in scope at the
+    // Allocate node of a group, or undefined if it can't be.
+    Expr size_at(Group &g, const Allocate *op) {
+        Expr size = size_in_bytes(op);
+        for (size_t i = lets.size(); i > g.lets_outside; i--) {
+            size = substitute(lets[i-1].first, lets[i-1].second, size);
+        }
+        if (!g.found_definitions) {
+            FindDefinitions defs;
+            g.op->body.accept(&defs);
+            g.defined_inside = defs.defined;
+            g.found_definitions = true;
+        }
+        UsesDefinitions uses(g.defined_inside, true);
+        size.accept(&uses);
+        if (uses.result) return Expr();
+        return size;
+    }
+
+    void visit(const Allocate *op) {
+        if (loop_depth > 0 || small_constant_size(op)) {
+            IRVisitor::visit(op);
+            return;
+        }
+
+        for (size_t i = groups.size(); i > 0; i--) {
+            Group &g = groups[i-1];
+            if (!g.dead) continue;
+            Expr size = size_at(g, op);
+            if (!size.defined()) continue;
+
+            debug(3) << "Putting " << op->name << " in the allocation of " << g.op->name
+                     << ", after " << g.current << "\n";
+            root[op->name] = g.op->name;
+            dead_frees.insert(g.current);
+            Expr &bytes = sizes[g.op->name];
+            if (!bytes.defined()) bytes = size_in_bytes(g.op);
+            if (!is_one(simplify(bytes >= size))) {
+                bytes = simplify(max(bytes, size));
+            }
+            g.current = op->name;
+            g.dead = false;
+            op->body.accept(this);
+            return;
+        }
+
+        Group g;
+        g.op = op;
+        g.lets_outside = lets.size();
+        g.current = op->name;
+        g.dead = false;
+        g.found_definitions = false;
+        root[op->name] = op->name;
+        groups.push_back(g);
+        op->body.accept(this);
+        groups.pop_back();
+    }
+
+    void visit(const Free *op) {
+        Group *g = group_of(op->name);
+        // A free that might not happen doesn't count.
+        if (g && loop_depth == 0 && if_depth == 0 && g->current == op->name) {
+            g->dead = true;
+        }
+    }
+
+public:
+    // The allocation each buffer goes in.
+    map<string, string> root;
+    // The grown sizes, in bytes, of allocations that are shared.
+    map<string, Expr> sizes;
+    // Buffers whose frees are dropped, because another buffer uses
+    // their allocation afterwards.
+    set<string> dead_frees;
+
+    PlanReuse() : loop_depth(0), if_depth(0) {}
+};
+
+class ApplyReuse : public IRMutator {
+    using IRMutator::visit;
+
+    const PlanReuse &plan;
+
+    // The allocation a buffer was put in, if it isn't its own.
+    bool moved(const string &name, string &new_name) {
+        map<string, string>::const_iterator iter = plan.root.find(name);
+        if (iter == plan.root.end() || iter->second == name) return false;
+        new_name = iter->second;
+        return true;
+    }
+
+    void visit(const Allocate *op) {
+        string new_name;
+        if (moved(op->name, new_name)) {
+            stmt = mutate(op->body);
+            return;
+        }
+        map<string, Expr>::const_iterator iter = plan.sizes.find(op->name);
+        if (iter == plan.sizes.end()) {
+            IRMutator::visit(op);
+            return;
+        }
+        int bytes = op->type.bytes();
+        Expr extent = Cast::make(Int(32), (iter->second + (bytes - 1)) / bytes);
+        stmt = Allocate::make(op->name, op->type, vec(extent), mutate(op->body));
+    }
+
+    void visit(const Free *op) {
+        string new_name;
+        if (plan.dead_frees.count(op->name)) {
+            stmt = Evaluate::make(0);
+        } else if (moved(op->name, new_name)) {
+            stmt = Free::make(new_name);
+        } else {
+            stmt = op;
+        }
+    }
+
+    void visit(const Load *op) {
+        string new_name;
+        if (moved(op->name, new_name)) {
+            Expr predicate = op->predicate.defined() ? mutate(op->predicate) : Expr();
+            expr = Load::make(op->type, new_name, mutate(op->index),
+                              op->image, op->param, predicate);
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const Store *op) {
+        string new_name;
+        if (moved(op->name, new_name)) {
+            Expr predicate = op->predicate.defined() ? mutate(op->predicate) : Expr();
+            stmt = Store::make(new_name, mutate(op->value), mutate(op->index), predicate);
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const Variable *op) {
+        string new_name;
+        if (ends_with(op->name, ".host") &&
+            moved(op->name.substr(0, op->name.size() - 5), new_name)) {
+            expr = Variable::make(op->type, new_name + ".host");
+        } else {
+            expr = op;
+        }
+    }
+
+public:
+    ApplyReuse(const PlanReuse &p) : plan(p) {}
+};
+
+}
+
+Stmt reuse_allocations(Stmt s) {
+    PlanReuse plan;
+    s.accept(&plan);
+    if (plan.dead_frees.empty()) return s;
+    return ApplyReuse(plan).mutate(s);
+}
+
+}
+}
@@ -0,0 +1,26 @@
+#ifndef HALIDE_REUSE_ALLOCATIONS_H
+#define HALIDE_REUSE_ALLOCATIONS_H
+
+/** \file
+ * Defines the lowering pass that lets buffers whose lifetimes don't
+ * overlap share an allocation.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Find buffers allocated outside of any loop that are allocated
+ * after another buffer has been freed (see EarlyFree.h), and put them
+ * in the allocation of the freed buffer instead, growing it if it
+ * might be too small. The memory a pipeline uses at once is then
+ * closer to the biggest set of buffers that are live at the same
+ * time than to the sum of all of them. Must run after injecting
+ * early frees. */
+Stmt reuse_allocations(Stmt s);
+
+}
+}
+
+#endif
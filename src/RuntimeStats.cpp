@@ -0,0 +1,56 @@
+#include "RuntimeStats.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "Scope.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// The buffers with a bounds query flag, which are the arguments of
+// the pipeline.
+class FindQueryFlags : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Variable *op) {
+        const string suffix = ".host_and_dev_are_null";
+        if (op->name.size() > suffix.size() &&
+            op->name.compare(op->name.size() - suffix.size(), suffix.size(), suffix) == 0 &&
+            !found.contains(op->name)) {
+            found.push(op->name, 0);
+            flags.push_back(op);
+        }
+    }
+
+    Scope<int> found;
+
+public:
+    vector<Expr> flags;
+};
+
+}
+
+Stmt inject_runtime_stats(Stmt s, const string &pipeline_name) {
+    FindQueryFlags queries;
+    s.accept(&queries);
+    Expr is_query = const_false();
+    for (size_t i = 0; i < queries.flags.size(); i++) {
+        is_query = is_query || queries.flags[i];
+    }
+
+    // Both calls get the user_context added by codegen.
+    string begin_name = pipeline_name + ".stats_begin";
+    Expr begin = Call::make(Int(64), "halide_runtime_stats_begin", vector<Expr>(), Call::Extern);
+    Expr end = Call::make(Int(32), "halide_runtime_stats_end",
+                          vec<Expr>(pipeline_name, Variable::make(Int(64), begin_name)),
+                          Call::Extern);
+    Stmt record = IfThenElse::make(!is_query, Evaluate::make(end));
+    return LetStmt::make(begin_name, begin, Block::make(s, record));
+}
+
+}
+}
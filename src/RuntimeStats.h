@@ -0,0 +1,24 @@
+#ifndef HALIDE_RUNTIME_STATS_H
+#define HALIDE_RUNTIME_STATS_H
+
+/** \file
+ * Defines the lowering pass that times each call of a pipeline for
+ * halide_get_runtime_stats.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Wrap the pipeline in calls to halide_runtime_stats_begin and
+ * halide_runtime_stats_end, which add the time taken to the
+ * pipeline's latency histogram. Bounds queries, and calls that fail
+ * or return early, aren't counted. Only used for targets with the
+ * telemetry feature. */
+Stmt inject_runtime_stats(Stmt s, const std::string &pipeline_name);
+
+}
+}
+
+#endif
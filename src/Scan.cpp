@@ -0,0 +1,94 @@
+#include "Scan.h"
+#include "RDom.h"
+#include "IROperator.h"
+#include "Util.h"
+
+namespace Halide {
+
+using std::vector;
+using std::string;
+
+Func prefix_sum(Func in, Expr min, Expr extent, int dim, int block_size) {
+    assert(in.defined() && "Can't take the prefix sum of an undefined Func");
+    assert(in.outputs() == 1 && "Can't take the prefix sum of a Func with multiple values");
+    assert(dim >= 0 && dim < in.dimensions() && "Prefix sum along a dimension the Func doesn't have");
+    assert(block_size > 1 && "The blocks of a prefix sum must have more than one element");
+
+    Type t = in.output_types()[0];
+    string name = in.name() + "_prefix_sum" + Internal::unique_name('_');
+    vector<Var> args = in.args();
+    Var x = args[dim];
+
+    // The arguments of the per-block sums, which replace x with its
+    // position in a block and the index of the block.
+    Var i, block;
+    vector<Var> block_args, carry_args;
+    vector<Expr> in_args, local_args, prev_args, carry_call, prev_carry_call, total_call;
+    RDom r(1, block_size - 1, name + "_r");
+    Expr blocks = (extent + (block_size - 1)) / block_size;
+    RDom k(1, blocks - 1, name + "_k");
+    for (size_t d = 0; d < args.size(); d++) {
+        if ((int)d == dim) {
+            block_args.push_back(i);
+            block_args.push_back(block);
+            carry_args.push_back(block);
+            // Past the end, the last block reads the last element
+            // again, so that in isn't read outside of the range.
+            in_args.push_back(clamp(min + block * block_size + i, min, min + extent - 1));
+            local_args.push_back(r);
+            local_args.push_back(block);
+            prev_args.push_back(r - 1);
+            prev_args.push_back(block);
+            carry_call.push_back(k);
+            prev_carry_call.push_back(k - 1);
+            total_call.push_back(block_size - 1);
+            total_call.push_back(k - 1);
+        } else {
+            block_args.push_back(args[d]);
+            carry_args.push_back(args[d]);
+            in_args.push_back(args[d]);
+            local_args.push_back(args[d]);
+            prev_args.push_back(args[d]);
+            carry_call.push_back(args[d]);
+            prev_carry_call.push_back(args[d]);
+            total_call.push_back(args[d]);
+        }
+    }
+
+    // The sums within each block, computed in place.
+    Func local(name + "_local");
+    local(block_args) = in(in_args);
+    local(local_args) = local(local_args) + local(prev_args);
+    local.compute_root().vectorize(i, 8);
+    if (dim > 0) {
+        // Scan whole rows at a time, rather than a column at a time.
+        local.update().reorder(args[0], r).parallel(block);
+    } else {
+        local.update().parallel(block);
+    }
+
+    // The sum of all the blocks before each block.
+    Func carry(name + "_carry");
+    carry(carry_args) = Internal::make_zero(t);
+    carry(carry_call) = carry(prev_carry_call) + local(total_call);
+    carry.compute_root();
+
+    vector<Expr> out_local, out_carry;
+    Expr offset = x - min;
+    for (size_t d = 0; d < args.size(); d++) {
+        if ((int)d == dim) {
+            out_local.push_back(offset % block_size);
+            out_local.push_back(offset / block_size);
+            out_carry.push_back(offset / block_size);
+        } else {
+            out_local.push_back(args[d]);
+            out_carry.push_back(args[d]);
+        }
+    }
+
+    Func out(name);
+    out(args) = local(out_local) + carry(out_carry);
+    return out;
+}
+
+}
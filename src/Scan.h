@@ -0,0 +1,35 @@
+#ifndef HALIDE_SCAN_H
+#define HALIDE_SCAN_H
+
+/** \file
+ * Defines a prefix sum that can be computed in parallel.
+ */
+
+#include "Func.h"
+
+namespace Halide {
+
+/** Return a Func that is the inclusive prefix sum of in along
+ * dimension dim, starting at min. The result at x is the sum of in
+ * over [min, x] in that dimension, for x in [min, min + extent), and
+ * is unspecified elsewhere. The other dimensions are left alone, so
+ * an integral image is two prefix sums:
+ \code
+ Func sum_x = prefix_sum(in, 0, w, 0);
+ Func integral = prefix_sum(sum_x, 0, h, 1);
+ \endcode
+ *
+ * Written as an update like f(x) = f(x - 1) + in(x), a prefix sum
+ * has to run serially, one element at a time. This one is computed
+ * in blocks of block_size elements instead. Each block is summed on
+ * its own, in parallel, and then the totals of the blocks before
+ * each one are scanned serially, which only takes one step per
+ * block. The returned Func adds the two together, and can be
+ * scheduled like any other Func (it's typically vectorized). Sums of
+ * floating point values are reassociated, so they may round
+ * differently from a serial sum. */
+EXPORT Func prefix_sum(Func in, Expr min, Expr extent, int dim = 0, int block_size = 1024);
+
+}
+
+#endif
@@ -10,6 +10,34 @@
 #include <vector>
 
 namespace Halide {
+
+/** Different ways to handle a split of a dimension by a factor that
+ * doesn't divide its extent. See \ref ScheduleHandle::split */
+enum TailStrategy {
+    /** Use Tail_ShiftInwards for the pure definition, and Tail_RoundUp
+     * for update steps. */
+    Tail_Auto,
+
+    /** Round the extent up to a multiple of the factor. The function
+     * is computed over a larger region than was asked for, so this is
+     * only allowed if the storage can be made larger. For an output
+     * buffer, it must already be large enough. */
+    Tail_RoundUp,
+
+    /** Guard the inner loop with an if, so that no point outside the
+     * old extent is computed. Works for update steps, and for extents
+     * smaller than the factor. Vectorized loops run a vector at a time
+     * where the guard passes for the whole vector, and a lane at a
+     * time at the end (the scalar epilogue). */
+    Tail_GuardWithIf,
+
+    /** Shift the last iteration of the outer loop inwards, so that it
+     * recomputes some points computed by the previous one. This keeps
+     * the inner loop a constant size, but isn't allowed for update
+     * steps, and requires the extent to be at least the factor. */
+    Tail_ShiftInwards
+};
+
 namespace Internal {
 
 /** A schedule for a halide function, which defines where, when, and
@@ -48,14 +76,14 @@ struct Schedule {
          * loop, to see if this loop level refers to the site
          * immediately inside this loop. */
         bool match(const std::string &loop) const {
-            return starts_with(loop, func + ".") && ends_with(loop, "." + var);
+            return starts_with(loop, func, '.') && ends_with(loop, '.', var);
         }
 
         bool match(const LoopLevel &other) const {
             return (func == other.func &&
                     (var == other.var ||
-                     ends_with(var, "." + other.var) ||
-                     ends_with(other.var, "." + var)));
+                     ends_with(var, '.', other.var) ||
+                     ends_with(other.var, '.', var)));
         }
 
         /** Check if two loop levels are exactly the same. */
@@ -74,6 +102,12 @@ struct Schedule {
     LoopLevel store_level, compute_level;
     // @}
 
+    /** If this function's loop nest is fused with that of a sibling
+     * function, the loop level of the sibling down to which they are
+     * fused. Inline (the default) if it isn't fused. See \ref
+     * Func::compute_with */
+    LoopLevel compute_with;
+
     struct Split {
         std::string old_var, outer, inner;
         Expr factor;
@@ -90,6 +124,13 @@ struct Schedule {
         // split, it joins the outer and inner into the old_var.
         SplitType split_type;
 
+        // What to do if the factor doesn't divide the old extent.
+        TailStrategy tail;
+
+        // If set, the factor is the natural vector size of the
+        // function on the target, and is set when it's lowered.
+        bool natural_width;
+
         bool is_rename() const {return split_type == RenameVar;}
         bool is_split() const {return split_type == SplitVar;}
         bool is_fuse() const {return split_type == FuseVars;}
@@ -125,6 +166,28 @@ struct Schedule {
      * tightly packed in memory) */
     std::vector<std::string> storage_dims;
 
+    struct StoragePadding {
+        std::string var;
+        /** The extent of this dimension of the storage is rounded up
+         * to a multiple of alignment, and then padding is added. */
+        int alignment, padding;
+    };
+    /** Padding of the dimensions of the storage, which changes the
+     * strides of the dimensions outside them. See \ref
+     * Func::align_storage and \ref Func::pad_storage */
+    std::vector<StoragePadding> storage_padding;
+
+    struct StorageFold {
+        std::string var;
+        /** The storage of this dimension wraps around every factor
+         * coordinates. */
+        Expr factor;
+    };
+    /** Dimensions of the storage that are folded by a factor given
+     * in the schedule, instead of one found by storage folding. See
+     * \ref Func::fold_storage */
+    std::vector<StorageFold> storage_folds;
+
     struct Bound {
         std::string var;
         Expr min, extent;
@@ -133,8 +196,105 @@ struct Schedule {
      * function. See \ref Func::bound */
     std::vector<Bound> bounds;
 
+    /** Estimates of the range of some of the dimensions of a
+     * function, for the automatic scheduler. Unlike bounds, they
+     * don't change what's computed. See \ref Func::estimate */
+    std::vector<Bound> estimates;
+
+    /** The domain over which this function is evaluated at compile
+     * time, into a table that its callers read instead, or empty. See
+     * \ref Func::tabulate */
+    std::vector<Bound> table_bounds;
+
+    struct Prefetch {
+        /** The Func or input image to prefetch. */
+        std::string name;
+
+        /** The loop var of this function at the top of each iteration
+         * of which to prefetch. */
+        std::string var;
+
+        /** How many iterations ahead to prefetch. */
+        Expr offset;
+
+        /** The parameter, if an input image is prefetched. */
+        Parameter param;
+    };
+    /** The regions of other functions or images to prefetch ahead of
+     * when they are needed. See \ref Func::prefetch */
+    std::vector<Prefetch> prefetches;
+
+    /** Conditions for which a separate version of the loop nest is
+     * generated and dispatched to at runtime. See \ref
+     * Func::specialize */
+    std::vector<Expr> specializations;
+
+    struct SkipCondition {
+        /** The loop var of this function whose iterations are
+         * skipped. */
+        std::string var;
+
+        /** Iterations are only run where this is true. It may refer
+         * to this loop var and the ones outside it. */
+        Expr active;
+    };
+    /** Conditions under which the iterations of loops of this
+     * function, and the producers computed within them, are
+     * skipped. See \ref Func::skip_unless */
+    std::vector<SkipCondition> skip_conditions;
+
+    /** Whether this function may be computed concurrently with other
+     * root-level functions it doesn't depend on. See \ref Func::async */
+    bool async;
+
+    /** Whether this update is done with atomic read-modify-write
+     * operations, so that its reduction variables may be marked
+     * parallel. See \ref ScheduleHandle::atomic */
+    bool atomic;
+
+    /** Whether realizations of this function are kept in a cache and
+     * reused by later runs of the pipeline. See \ref Func::memoize */
+    bool memoized;
+
+    /** The dimension over which the storage of this function is kept
+     * by the runtime from one run of the pipeline to the next, as a
+     * circular buffer, or empty. The number of coordinates kept is
+     * the fold factor of the dimension. See \ref
+     * Func::store_persistent */
+    std::string persistent_var;
+
+    /** The dimension whose range is split between a cpu and a gpu
+     * version of the pure definition, run concurrently, or
+     * empty. See \ref Func::split_devices */
+    std::string device_split_var;
+
+    /** The dimension whose range is divided between the ranks of a
+     * distributed run, or empty. See \ref Func::distribute */
+    std::string distributed_var;
+
+    /** Whether the values of a Tuple-valued function are stored
+     * interleaved in one buffer, instead of one buffer each. See
+     * \ref Func::interleave_tuple */
+    bool interleave_tuple;
+
+    /** Whether the dense vector stores of this function are
+     * non-temporal. See \ref Func::store_nontemporal */
+    bool nontemporal;
+
+    struct LazyBlock {
+        /** The pure variable whose range is divided into blocks. */
+        std::string var;
+
+        /** The size of the blocks along it. */
+        int size;
+    };
+    /** The dimensions of this function that are divided into blocks
+     * that are each computed the first time a point in them is
+     * read, or empty. See \ref Func::compute_lazily */
+    std::vector<LazyBlock> lazy_blocks;
 
-    Schedule() : touched(false) {};
+    Schedule() : touched(false), async(false), atomic(false), memoized(false),
+                 interleave_tuple(false), nontemporal(false) {};
 };
 
 }
@@ -0,0 +1,361 @@
+#include "ScheduleFile.h"
+#include "FindCalls.h"
+#include "IROperator.h"
+#include "Debug.h"
+
+#include <fstream>
+#include <sstream>
+#include <map>
+
+namespace Halide {
+
+using std::string;
+using std::vector;
+using std::map;
+using std::ostringstream;
+using std::istringstream;
+
+using namespace Internal;
+
+namespace {
+
+const char *tail_names[] = {"auto", "round_up", "guard_with_if", "shift_inwards"};
+const char *for_type_names[] = {"serial", "parallel", "vectorized", "unrolled", "jammed"};
+
+template<typename T>
+T parse_name(const string &name, const char **names, int count, const string &line) {
+    for (int i = 0; i < count; i++) {
+        if (name == names[i]) return (T)i;
+    }
+    std::cerr << "Unknown name " << name << " in schedule: " << line << "\n";
+    assert(false);
+    return (T)0;
+}
+
+void write_level(ostringstream &out, const Schedule::LoopLevel &l) {
+    if (l.is_inline()) {
+        out << "inline";
+    } else if (l.is_root()) {
+        out << "root";
+    } else {
+        out << l.func << " " << l.var;
+    }
+}
+
+bool read_level(istringstream &in, Schedule::LoopLevel &l) {
+    string func, var;
+    if (!(in >> func)) return false;
+    if (func == "inline") {
+        l = Schedule::LoopLevel();
+    } else if (func == "root") {
+        l = Schedule::LoopLevel::root();
+    } else if (in >> var) {
+        l = Schedule::LoopLevel(func, var);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Write an integer constant, or warn and return false.
+bool write_int(ostringstream &out, Expr e, const string &what, const string &func) {
+    const int *i = as_const_int(e);
+    if (!i) {
+        std::cerr << "Warning: not saving " << what << " of " << func
+                  << ", because " << e << " isn't an integer constant\n";
+        return false;
+    }
+    out << " " << *i;
+    return true;
+}
+
+void write_schedule(ostringstream &out, const string &func, const Schedule &s) {
+    out << "store_level ";
+    write_level(out, s.store_level);
+    out << "\ncompute_level ";
+    write_level(out, s.compute_level);
+    out << "\ncompute_with ";
+    write_level(out, s.compute_with);
+    out << "\n";
+
+    for (size_t i = 0; i < s.splits.size(); i++) {
+        const Schedule::Split &split = s.splits[i];
+        ostringstream line;
+        bool ok = true;
+        if (split.is_rename()) {
+            line << "rename " << split.old_var << " " << split.outer;
+        } else if (split.is_fuse()) {
+            line << "fuse " << split.old_var << " " << split.outer << " " << split.inner;
+        } else {
+            line << "split " << split.old_var << " " << split.outer << " " << split.inner;
+            if (split.natural_width) {
+                line << " natural";
+            } else {
+                ok = write_int(line, split.factor, "the split of " + split.old_var, func);
+            }
+            line << " " << tail_names[split.tail];
+        }
+        if (!ok) {
+            // Later splits may refer to its vars.
+            break;
+        }
+        out << line.str() << "\n";
+    }
+
+    for (size_t i = 0; i < s.dims.size(); i++) {
+        out << "dim " << s.dims[i].var << " " << for_type_names[s.dims[i].for_type] << "\n";
+    }
+
+    for (size_t i = 0; i < s.storage_dims.size(); i++) {
+        out << "storage_dim " << s.storage_dims[i] << "\n";
+    }
+
+    for (size_t i = 0; i < s.storage_padding.size(); i++) {
+        out << "storage_padding " << s.storage_padding[i].var << " "
+            << s.storage_padding[i].alignment << " " << s.storage_padding[i].padding << "\n";
+    }
+
+    for (size_t i = 0; i < s.storage_folds.size(); i++) {
+        ostringstream line;
+        line << "storage_fold " << s.storage_folds[i].var;
+        if (write_int(line, s.storage_folds[i].factor,
+                      "the fold factor of " + s.storage_folds[i].var, func)) {
+            out << line.str() << "\n";
+        }
+    }
+
+    const char *bound_kinds[] = {"bound", "estimate", "tabulate"};
+    const char *bound_names[] = {"the bound", "the estimate", "the table domain"};
+    for (int b = 0; b < 3; b++) {
+        const vector<Schedule::Bound> &bounds =
+            b == 0 ? s.bounds : b == 1 ? s.estimates : s.table_bounds;
+        for (size_t i = 0; i < bounds.size(); i++) {
+            ostringstream line;
+            line << bound_kinds[b] << " " << bounds[i].var;
+            string what = string(bound_names[b]) + " of " + bounds[i].var;
+            if (write_int(line, bounds[i].min, what, func) &&
+                write_int(line, bounds[i].extent, what, func)) {
+                out << line.str() << "\n";
+            }
+        }
+    }
+
+    for (size_t i = 0; i < s.lazy_blocks.size(); i++) {
+        out << "lazy " << s.lazy_blocks[i].var << " " << s.lazy_blocks[i].size << "\n";
+    }
+
+    for (size_t i = 0; i < s.prefetches.size(); i++) {
+        const Schedule::Prefetch &p = s.prefetches[i];
+        if (p.param.defined()) {
+            std::cerr << "Warning: not saving the prefetch of input image " << p.name
+                      << " by " << func << "\n";
+            continue;
+        }
+        ostringstream line;
+        line << "prefetch " << p.name << " " << p.var;
+        if (write_int(line, p.offset, "the prefetch of " + p.name, func)) {
+            out << line.str() << "\n";
+        }
+    }
+
+    if (!s.specializations.empty()) {
+        std::cerr << "Warning: not saving the specializations of " << func << "\n";
+    }
+
+    if (!s.skip_conditions.empty()) {
+        std::cerr << "Warning: not saving the skip conditions of " << func << "\n";
+    }
+
+    if (s.touched) out << "touched\n";
+    if (s.async) out << "async\n";
+    if (s.atomic) out << "atomic\n";
+    if (s.memoized) out << "memoize\n";
+    if (!s.persistent_var.empty()) out << "persistent " << s.persistent_var << "\n";
+    if (!s.device_split_var.empty()) out << "split_devices " << s.device_split_var << "\n";
+    if (!s.distributed_var.empty()) out << "distribute " << s.distributed_var << "\n";
+    if (s.interleave_tuple) out << "interleave_tuple\n";
+    if (s.nontemporal) out << "nontemporal\n";
+}
+
+map<string, Function> pipeline_env(Func output) {
+    map<string, Function> env = find_transitive_calls(output.function());
+    env[output.name()] = output.function();
+    return env;
+}
+
+void bad_line(const string &line) {
+    std::cerr << "Bad line in schedule: " << line << "\n";
+    assert(false);
+}
+
+}
+
+string schedule_to_string(Func output) {
+    map<string, Function> env = pipeline_env(output);
+    ostringstream out;
+    for (map<string, Function>::iterator iter = env.begin(); iter != env.end(); ++iter) {
+        Function f = iter->second;
+        out << "func " << f.name() << "\n";
+        write_schedule(out, f.name(), f.schedule());
+        for (size_t i = 0; i < f.reductions().size(); i++) {
+            out << "update " << i << "\n";
+            write_schedule(out, f.name(), f.reductions()[i].schedule);
+        }
+        out << "end\n";
+    }
+    return out.str();
+}
+
+void schedule_from_string(Func output, const string &text) {
+    map<string, Function> env = pipeline_env(output);
+
+    istringstream lines(text);
+    string line;
+    Function f;
+    Schedule *s = NULL;
+    while (std::getline(lines, line)) {
+        istringstream in(line);
+        string kind;
+        if (!(in >> kind) || kind[0] == '#') continue;
+
+        if (kind == "func") {
+            string name;
+            in >> name;
+            if (!env.count(name)) {
+                std::cerr << "Schedule refers to " << name << ", which isn't in the pipeline of "
+                          << output.name() << "\n";
+                assert(false);
+            }
+            f = env[name];
+            s = &f.schedule();
+            *s = Schedule();
+            continue;
+        } else if (!s) {
+            bad_line(line);
+        }
+
+        Schedule::Split split;
+        split.factor = 1;
+        split.tail = Tail_Auto;
+        split.natural_width = false;
+        if (kind == "update") {
+            int i = -1;
+            in >> i;
+            if (i < 0 || i >= (int)f.reductions().size()) bad_line(line);
+            s = &f.reduction_schedule(i);
+            *s = Schedule();
+        } else if (kind == "end") {
+            s = NULL;
+        } else if (kind == "store_level") {
+            if (!read_level(in, s->store_level)) bad_line(line);
+        } else if (kind == "compute_level") {
+            if (!read_level(in, s->compute_level)) bad_line(line);
+        } else if (kind == "compute_with") {
+            if (!read_level(in, s->compute_with)) bad_line(line);
+        } else if (kind == "split") {
+            string factor, tail;
+            if (!(in >> split.old_var >> split.outer >> split.inner >> factor >> tail)) bad_line(line);
+            if (factor == "natural") {
+                split.natural_width = true;
+            } else {
+                istringstream factor_in(factor);
+                int f;
+                if (!(factor_in >> f)) bad_line(line);
+                split.factor = f;
+            }
+            split.tail = parse_name<TailStrategy>(tail, tail_names, 4, line);
+            split.split_type = Schedule::Split::SplitVar;
+            s->splits.push_back(split);
+        } else if (kind == "rename") {
+            if (!(in >> split.old_var >> split.outer)) bad_line(line);
+            split.split_type = Schedule::Split::RenameVar;
+            s->splits.push_back(split);
+        } else if (kind == "fuse") {
+            if (!(in >> split.old_var >> split.outer >> split.inner)) bad_line(line);
+            split.factor = Expr();
+            split.split_type = Schedule::Split::FuseVars;
+            s->splits.push_back(split);
+        } else if (kind == "dim") {
+            Schedule::Dim d;
+            string for_type;
+            if (!(in >> d.var >> for_type)) bad_line(line);
+            d.for_type = parse_name<For::ForType>(for_type, for_type_names, 5, line);
+            s->dims.push_back(d);
+        } else if (kind == "storage_dim") {
+            string var;
+            if (!(in >> var)) bad_line(line);
+            s->storage_dims.push_back(var);
+        } else if (kind == "storage_padding") {
+            Schedule::StoragePadding p;
+            if (!(in >> p.var >> p.alignment >> p.padding)) bad_line(line);
+            s->storage_padding.push_back(p);
+        } else if (kind == "storage_fold") {
+            Schedule::StorageFold f;
+            int factor;
+            if (!(in >> f.var >> factor)) bad_line(line);
+            f.factor = factor;
+            s->storage_folds.push_back(f);
+        } else if (kind == "bound" || kind == "estimate" || kind == "tabulate") {
+            Schedule::Bound b;
+            int min, extent;
+            if (!(in >> b.var >> min >> extent)) bad_line(line);
+            b.min = min;
+            b.extent = extent;
+            (kind == "bound" ? s->bounds :
+             kind == "estimate" ? s->estimates : s->table_bounds).push_back(b);
+        } else if (kind == "lazy") {
+            Schedule::LazyBlock b;
+            if (!(in >> b.var >> b.size)) bad_line(line);
+            s->lazy_blocks.push_back(b);
+        } else if (kind == "prefetch") {
+            Schedule::Prefetch p;
+            int offset;
+            if (!(in >> p.name >> p.var >> offset)) bad_line(line);
+            p.offset = offset;
+            s->prefetches.push_back(p);
+        } else if (kind == "touched") {
+            s->touched = true;
+        } else if (kind == "async") {
+            s->async = true;
+        } else if (kind == "atomic") {
+            s->atomic = true;
+        } else if (kind == "memoize") {
+            s->memoized = true;
+        } else if (kind == "persistent") {
+            if (!(in >> s->persistent_var)) bad_line(line);
+        } else if (kind == "split_devices") {
+            if (!(in >> s->device_split_var)) bad_line(line);
+        } else if (kind == "distribute") {
+            if (!(in >> s->distributed_var)) bad_line(line);
+        } else if (kind == "interleave_tuple") {
+            s->interleave_tuple = true;
+        } else if (kind == "nontemporal") {
+            s->nontemporal = true;
+        } else {
+            bad_line(line);
+        }
+    }
+}
+
+void save_schedule(Func output, const string &filename) {
+    std::ofstream file(filename.c_str());
+    if (!file) {
+        std::cerr << "Could not open " << filename << " to write the schedule\n";
+        assert(false);
+    }
+    file << schedule_to_string(output);
+}
+
+void load_schedule(Func output, const string &filename) {
+    std::ifstream file(filename.c_str());
+    if (!file) {
+        std::cerr << "Could not open schedule " << filename << "\n";
+        assert(false);
+    }
+    ostringstream text;
+    text << file.rdbuf();
+    schedule_from_string(output, text.str());
+    debug(1) << "Loaded the schedule of " << output.name() << " from " << filename << "\n";
+}
+
+}
@@ -0,0 +1,47 @@
+#ifndef HALIDE_SCHEDULE_FILE_H
+#define HALIDE_SCHEDULE_FILE_H
+
+/** \file
+ * Defines a text format for the schedules of a pipeline
+ */
+
+#include "Func.h"
+
+#include <string>
+
+namespace Halide {
+
+/** Write the schedule of every Func in the pipeline that computes
+ * output, and of each of their update steps, as text. This covers
+ * the store, compute and compute_with levels, the splits, renames and
+ * fuses, the dims and their loop types, the storage dims and padding,
+ * bounds, estimates, prefetches of Funcs, and the async, atomic and
+ * memoize flags. Split factors, bounds, estimates and prefetch
+ * offsets must be integer constants. Splits by the natural vector
+ * size (see \ref Func::vectorize_natural) are written as such, so the
+ * width is chosen again for each target. Specializations, and prefetches
+ * of input images, refer to parameters, so they aren't written (and
+ * a warning is printed). The Funcs are identified by name, so give
+ * them names that don't change from one run of the program to the
+ * next. */
+EXPORT std::string schedule_to_string(Func output);
+
+/** Set the schedules in text written by schedule_to_string on the
+ * Funcs of the pipeline that computes output, replacing the schedules
+ * they had. Funcs of the pipeline that aren't in the text are left
+ * alone. Must be called before the pipeline is compiled, like any
+ * other scheduling call. */
+EXPORT void schedule_from_string(Func output, const std::string &text);
+
+/** Write the schedules of a pipeline to a file, as
+ * schedule_to_string. Keeping one file per target (e.g. avx, avx2,
+ * arm) lets one program compile a version tuned for each. */
+EXPORT void save_schedule(Func output, const std::string &filename);
+
+/** Set the schedules in a file written by save_schedule, as
+ * schedule_from_string. */
+EXPORT void load_schedule(Func output, const std::string &filename);
+
+}
+
+#endif
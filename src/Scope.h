@@ -3,6 +3,7 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <stack>
 #include <utility>
 #include <iostream>
@@ -67,87 +68,131 @@ public:
 /** A common pattern when traversing Halide IR is that you need to
  * keep track of stuff when you find a Let or a LetStmt, and that it
  * should hide previous values with the same name until you leave the
- * Let or LetStmt nodes This class helps with that. */
+ * Let or LetStmt nodes This class helps with that.
+ *
+ * Names are looked up by their hash first, rather than by comparing
+ * them as strings. Names generated during lowering share long
+ * prefixes (e.g. "f.s0.x.x_inner" and "f.s0.x.x_outer"), so ordering
+ * them by string compare is slow. Names with the same hash share a
+ * bucket. Iteration is in order of hash, not of name. */
 template<typename T>
 class Scope {
 private:
-    std::map<std::string, SmallStack<T> > table;
+    typedef std::pair<std::string, SmallStack<T> > Entry;
+    typedef std::vector<Entry> Bucket;
+    typedef std::map<uint64_t, Bucket> Table;
+    Table table;
+
+    const SmallStack<T> *find(const std::string &name) const {
+        typename Table::const_iterator iter = table.find(hash_string(name));
+        if (iter == table.end()) return NULL;
+        const Bucket &bucket = iter->second;
+        for (size_t i = 0; i < bucket.size(); i++) {
+            if (bucket[i].first == name) return &bucket[i].second;
+        }
+        return NULL;
+    }
+
+    SmallStack<T> *find(const std::string &name) {
+        const Scope<T> *self = this;
+        return const_cast<SmallStack<T> *>(self->find(name));
+    }
+
 public:
     Scope() {}
 
     /** Retrive the value referred to by a name */
     T get(const std::string &name) const {
-        typename std::map<std::string, SmallStack<T> >::const_iterator iter = table.find(name);
-        if (iter == table.end() || iter->second.empty()) {
+        const SmallStack<T> *stack = find(name);
+        if (!stack || stack->empty()) {
             std::cerr << "Symbol '" << name << "' not found" << std::endl;
             assert(false);
         }
-        return iter->second.top();
+        return stack->top();
     }
 
     /** Return a reference to an entry */
     T &ref(const std::string &name) {
-        typename std::map<std::string, SmallStack<T> >::iterator iter = table.find(name);
-        if (iter == table.end() || iter->second.empty()) {
+        SmallStack<T> *stack = find(name);
+        if (!stack || stack->empty()) {
             std::cerr << "Symbol '" << name << "' not found" << std::endl;
             assert(false);
         }
-        return iter->second.top_ref();
+        return stack->top_ref();
     }
 
     /** Tests if a name is in scope */
     bool contains(const std::string &name) const {
-        typename std::map<std::string, SmallStack<T> >::const_iterator iter = table.find(name);
-        return iter != table.end() && !iter->second.empty();
+        const SmallStack<T> *stack = find(name);
+        return stack && !stack->empty();
     }
 
     /** Add a new (name, value) pair to the current scope. Hide old
      * values that have this name until we pop this name.
      */
     void push(const std::string &name, const T &value) {
-        table[name].push(value);
+        Bucket &bucket = table[hash_string(name)];
+        for (size_t i = 0; i < bucket.size(); i++) {
+            if (bucket[i].first == name) {
+                bucket[i].second.push(value);
+                return;
+            }
+        }
+        bucket.push_back(Entry(name, SmallStack<T>()));
+        bucket.back().second.push(value);
     }
 
     /** A name goes out of scope. Restore whatever its old value
      * was (or remove it entirely if there was nothing else of the
      * same name in an outer scope) */
     void pop(const std::string &name) {
-        typename std::map<std::string, SmallStack<T> >::iterator iter = table.find(name);
+        typename Table::iterator iter = table.find(hash_string(name));
         assert(iter != table.end() && "Name not in symbol table");
-        iter->second.pop();
-        if (iter->second.empty()) {
-            table.erase(iter);
+        Bucket &bucket = iter->second;
+        size_t i = 0;
+        while (i < bucket.size() && bucket[i].first != name) i++;
+        assert(i < bucket.size() && "Name not in symbol table");
+        bucket[i].second.pop();
+        if (bucket[i].second.empty()) {
+            bucket.erase(bucket.begin() + i);
+            if (bucket.empty()) {
+                table.erase(iter);
+            }
         }
     }
 
     /** Iterate through the scope. */
     class const_iterator {
-        typename std::map<std::string, SmallStack<T> >::const_iterator iter;
+        typename Table::const_iterator iter;
+        size_t idx;
     public:
-        explicit const_iterator(const typename std::map<std::string, SmallStack<T> >::const_iterator &i) :
-            iter(i) {
+        explicit const_iterator(const typename Table::const_iterator &i) :
+            iter(i), idx(0) {
         }
 
-        const_iterator() {}
+        const_iterator() : idx(0) {}
 
         bool operator!=(const const_iterator &other) {
-            return iter != other.iter;
+            return iter != other.iter || idx != other.idx;
         }
 
         void operator++() {
-            ++iter;
+            if (++idx == iter->second.size()) {
+                ++iter;
+                idx = 0;
+            }
         }
 
         const std::string &name() {
-            return iter->first;
+            return iter->second[idx].first;
         }
 
         const SmallStack<T> &stack() {
-            return iter->second;
+            return iter->second[idx].second;
         }
 
         const T &value() {
-            return iter->second.top();
+            return iter->second[idx].second.top();
         }
     };
 
@@ -160,32 +205,36 @@ public:
     }
 
     class iterator {
-        typename std::map<std::string, SmallStack<T> >::iterator iter;
+        typename Table::iterator iter;
+        size_t idx;
     public:
-        explicit iterator(typename std::map<std::string, SmallStack<T> >::iterator i) :
-            iter(i) {
+        explicit iterator(typename Table::iterator i) :
+            iter(i), idx(0) {
         }
 
-        iterator() {}
+        iterator() : idx(0) {}
 
         bool operator!=(const iterator &other) {
-            return iter != other.iter;
+            return iter != other.iter || idx != other.idx;
         }
 
         void operator++() {
-            ++iter;
+            if (++idx == iter->second.size()) {
+                ++iter;
+                idx = 0;
+            }
         }
 
         const std::string &name() {
-            return iter->first;
+            return iter->second[idx].first;
         }
 
         SmallStack<T> &stack() {
-            return iter->second;
+            return iter->second[idx].second;
         }
 
         T &value() {
-            return iter->second.top_ref();
+            return iter->second[idx].second.top_ref();
         }
     };
 
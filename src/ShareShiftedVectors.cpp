@@ -0,0 +1,334 @@
+#include <algorithm>
+#include <map>
+
+#include "ShareShiftedVectors.h"
+#include "IRMutator.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "IREquality.h"
+#include "IRPrinter.h"
+#include "ExprUsesVar.h"
+#include "CodeGen_GPU_Dev.h"
+#include "Simplify.h"
+#include "Scope.h"
+#include "Debug.h"
+#include "Util.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Does a vector expression depend on its lanes only through dense
+// ramps of its width, with every operation in it done lane by lane?
+// Then computing it with every ramp's base moved on by d gives its
+// lanes shifted by d. Also finds the base of the first ramp.
+class LaneShiftable : public IRVisitor {
+    using IRVisitor::visit;
+
+    int width;
+
+    void check_width(Type t) {
+        if (t.width != 1 && t.width != width) {
+            result = false;
+        }
+    }
+
+    void visit(const Ramp *op) {
+        if (op->width != width || !is_one(op->stride)) {
+            result = false;
+        } else if (!first_base.defined()) {
+            first_base = op->base;
+        }
+    }
+
+    void visit(const Broadcast *op) {
+        check_width(op->type);
+        // The value is the same in every lane.
+    }
+
+    void visit(const Variable *op) {
+        // We don't know how the lanes of a vector variable were made.
+        if (op->type.is_vector()) {
+            result = false;
+        }
+    }
+
+    void visit(const Let *op) {
+        result = false;
+    }
+
+    void visit(const Cast *op) {
+        check_width(op->type);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Load *op) {
+        check_width(op->type);
+        if (op->predicate.defined()) {
+            result = false;
+            return;
+        }
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Call *op) {
+        check_width(op->type);
+        bool elementwise =
+            op->call_type == Call::Extern ||
+            (op->call_type == Call::Intrinsic &&
+             (op->name == Call::bitwise_and ||
+              op->name == Call::bitwise_not ||
+              op->name == Call::bitwise_xor ||
+              op->name == Call::bitwise_or ||
+              op->name == Call::shift_left ||
+              op->name == Call::shift_right ||
+              op->name == Call::abs ||
+              op->name == Call::lerp ||
+              op->name == Call::popcount ||
+              op->name == Call::count_leading_zeros ||
+              op->name == Call::count_trailing_zeros));
+        if (!elementwise) {
+            result = false;
+            return;
+        }
+        for (size_t i = 0; i < op->args.size(); i++) {
+            check_width(op->args[i].type());
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool result;
+    Expr first_base;
+    LaneShiftable(int w) : width(w), result(true) {}
+};
+
+// Move the lanes of a shiftable expression on by d.
+class ShiftLanes : public IRMutator {
+    using IRMutator::visit;
+
+    Expr d;
+
+    void visit(const Ramp *op) {
+        expr = Ramp::make(simplify(op->base + d), op->stride, op->width);
+    }
+
+public:
+    ShiftLanes(Expr d) : d(d) {}
+};
+
+Expr shift_lanes(Expr e, int d) {
+    return ShiftLanes(d).mutate(e);
+}
+
+// The vector subexpressions of an expression that are worth sharing,
+// outermost first. Skips those that use a variable bound inside the
+// expression, and the lazily evaluated arguments of if_then_else.
+class FindCandidates : public IRMutator {
+    using IRMutator::visit;
+
+    Scope<int> inner;
+
+    bool worth_sharing(const Expr &e) {
+        // Sharing a lone load or ramp saves nothing over loading it
+        // again.
+        return (e.type().is_vector() &&
+                !e.as<Load>() && !e.as<Ramp>() && !e.as<Broadcast>() &&
+                !e.as<Variable>() && !e.as<Cast>());
+    }
+
+    void visit(const Let *op) {
+        mutate(op->value);
+        inner.push(op->name, 0);
+        mutate(op->body);
+        inner.pop(op->name);
+        expr = op;
+    }
+
+    void visit(const Call *op) {
+        if (op->call_type == Call::Intrinsic && op->name == Call::if_then_else) {
+            mutate(op->args[0]);
+        } else {
+            IRMutator::visit(op);
+        }
+        expr = op;
+    }
+
+public:
+    struct Candidate {
+        Expr expr;
+        Expr first_base;
+    };
+    vector<Candidate> found;
+
+    using IRMutator::mutate;
+
+    Expr mutate(Expr e) {
+        if (e.defined() && worth_sharing(e)) {
+            LaneShiftable check(e.type().width);
+            e.accept(&check);
+            if (check.result && check.first_base.defined() && !expr_uses_vars(e, inner)) {
+                Candidate c = {e, check.first_base};
+                found.push_back(c);
+            }
+        }
+        // We don't change anything.
+        IRMutator::mutate(e);
+        return e;
+    }
+};
+
+// Replace some subexpressions, found by identity.
+class ReplaceExprs : public IRMutator {
+    const map<const IRNode *, Expr> &replacements;
+public:
+    using IRMutator::mutate;
+
+    Expr mutate(Expr e) {
+        map<const IRNode *, Expr>::const_iterator iter = replacements.find(e.ptr);
+        if (iter != replacements.end()) {
+            return iter->second;
+        }
+        return IRMutator::mutate(e);
+    }
+
+    ReplaceExprs(const map<const IRNode *, Expr> &r) : replacements(r) {}
+};
+
+// Share one group of shifted subexpressions of an expression, if
+// there is one. Returns an undefined Expr if not.
+Expr share_one_group(Expr e) {
+    FindCandidates finder;
+    finder.mutate(e);
+    const vector<FindCandidates::Candidate> &c = finder.found;
+
+    for (size_t i = 0; i < c.size(); i++) {
+        int width = c[i].expr.type().width;
+
+        // The lane offset of each member of the group from c[i].
+        map<const IRNode *, int> offsets;
+        offsets[c[i].expr.ptr] = 0;
+        int min_offset = 0, max_offset = 0;
+        for (size_t j = 0; j < c.size(); j++) {
+            if (j == i || c[j].expr.type() != c[i].expr.type() ||
+                offsets.count(c[j].expr.ptr)) {
+                continue;
+            }
+            const IntImm *d = simplify(c[j].first_base - c[i].first_base).as<IntImm>();
+            if (!d || d->value <= -width || d->value >= width) {
+                continue;
+            }
+            if (!equal(shift_lanes(c[i].expr, d->value), shift_lanes(c[j].expr, 0))) {
+                continue;
+            }
+            offsets[c[j].expr.ptr] = d->value;
+            min_offset = std::min(min_offset, d->value);
+            max_offset = std::max(max_offset, d->value);
+        }
+        // The first and last cover every lane of the ones between, if
+        // they overlap or touch. With only two, there's nothing to save.
+        if (max_offset - min_offset > width) {
+            continue;
+        }
+        bool middle = false;
+        for (map<const IRNode *, int>::iterator iter = offsets.begin();
+             iter != offsets.end(); ++iter) {
+            middle = middle || (iter->second != min_offset && iter->second != max_offset);
+        }
+        if (!middle) {
+            continue;
+        }
+
+        Type t = c[i].expr.type();
+        Type both_type = t;
+        both_type.width = 2 * width;
+        string lo_name = unique_name('s'), hi_name = unique_name('s'), both_name = unique_name('s');
+        Expr lo = Variable::make(t, lo_name), hi = Variable::make(t, hi_name);
+        Expr both = Variable::make(both_type, both_name);
+
+        map<const IRNode *, Expr> replacements;
+        for (map<const IRNode *, int>::iterator iter = offsets.begin();
+             iter != offsets.end(); ++iter) {
+            if (iter->second == min_offset) {
+                replacements[iter->first] = lo;
+            } else if (iter->second == max_offset) {
+                replacements[iter->first] = hi;
+            } else {
+                vector<Expr> args;
+                args.push_back(both);
+                for (int lane = 0; lane < width; lane++) {
+                    // Lanes past the end of lo come from hi.
+                    int l = iter->second - min_offset + lane;
+                    args.push_back(l < width ? l : l + width - (max_offset - min_offset));
+                }
+                replacements[iter->first] = Call::make(t, Call::shuffle_vector, args, Call::Intrinsic);
+            }
+        }
+        debug(3) << "Sharing " << offsets.size() << " shifts of " << c[i].expr << "\n";
+        e = ReplaceExprs(replacements).mutate(e);
+        e = Let::make(both_name, Call::make(both_type, Call::concat_vectors, vec(lo, hi), Call::Intrinsic), e);
+        e = Let::make(hi_name, shift_lanes(c[i].expr, max_offset), e);
+        e = Let::make(lo_name, shift_lanes(c[i].expr, min_offset), e);
+        return e;
+    }
+    return Expr();
+}
+
+Expr share_shifted(Expr e) {
+    if (!e.defined() || !e.type().is_vector()) {
+        return e;
+    }
+    // Each group shared makes the expression smaller, so this ends.
+    while (true) {
+        Expr shared = share_one_group(e);
+        if (!shared.defined()) {
+            return e;
+        }
+        e = shared;
+    }
+}
+
+class ShareShiftedVectors : public IRMutator {
+    using IRMutator::visit;
+
+    void visit(const For *op) {
+        if (CodeGen_GPU_Dev::is_gpu_var(op->name)) {
+            stmt = op;
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const Store *op) {
+        Expr value = share_shifted(op->value);
+        if (value.same_as(op->value)) {
+            stmt = op;
+        } else {
+            stmt = Store::make(op->name, value, op->index, op->predicate);
+        }
+    }
+
+    void visit(const LetStmt *op) {
+        Expr value = share_shifted(op->value);
+        Stmt body = mutate(op->body);
+        if (value.same_as(op->value) && body.same_as(op->body)) {
+            stmt = op;
+        } else {
+            stmt = LetStmt::make(op->name, value, body);
+        }
+    }
+};
+
+}
+
+Stmt share_shifted_vectors(Stmt s) {
+    return ShareShiftedVectors().mutate(s);
+}
+
+}
+}
@@ -0,0 +1,27 @@
+#ifndef HALIDE_SHARE_SHIFTED_VECTORS_H
+#define HALIDE_SHARE_SHIFTED_VECTORS_H
+
+/** \file
+ * Defines a lowering pass that computes vector subexpressions that
+ * are shifts of each other by a few lanes once.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Find vector subexpressions of the same store or let that are the
+ * same but for the lanes they're computed at, as are the inlined calls
+ * blur_x(x-1), blur_x(x) and blur_x(x+1) once vectorized over x. If
+ * the first and last are within a vector's width of each other,
+ * compute just those two, and take the ones between from their lanes
+ * with shuffles. Only looks at expressions that depend on the lanes
+ * through dense ramps of the same width, and leaves gpu loops
+ * alone. Must run after vectorization. */
+Stmt share_shifted_vectors(Stmt s);
+
+}
+}
+
+#endif
@@ -12,6 +12,7 @@
 #include "ModulusRemainder.h"
 #include "Substitute.h"
 #include "Bounds.h"
+#include "IRMatch.h"
 
 namespace Halide {
 namespace Internal {
@@ -19,6 +20,7 @@ namespace Internal {
 using std::string;
 using std::map;
 using std::pair;
+using std::vector;
 using std::make_pair;
 using std::ostringstream;
 
@@ -43,12 +45,118 @@ int do_indirect_int_cast(Type t, int x) {
     }
 }
 
+namespace {
+
+// A rewrite rule that's valid for every type. The variables in the
+// pattern are wildcards (see the map form of expr_match), and are
+// substituted into the replacement.
+struct RewriteRule {
+    Expr before, after;
+    RewriteRule(Expr b, Expr a) : before(b), after(a) {}
+};
+
+// The rules that aren't worth a hand-written case in the visitors
+// below. They're indexed on the kind of node at the root of the
+// pattern, so each node is only matched against the rules that could
+// apply to it. To add a rule, add a line here, and a check to
+// simplify_test.
+class RewriteRules {
+    map<const IRNodeType *, vector<RewriteRule> > rules;
+
+    void add(Expr before, Expr after) {
+        rules[before.ptr->type_info()].push_back(RewriteRule(before, after));
+    }
+
+public:
+    RewriteRules() {
+        Expr x = Variable::make(Int(32), "x");
+        Expr y = Variable::make(Int(32), "y");
+        Expr z = Variable::make(Int(32), "z");
+        Expr c = Variable::make(Bool(), "c");
+
+        add(Min::make(x, Max::make(x, y)), x);
+        add(Min::make(x, Max::make(y, x)), x);
+        add(Min::make(Max::make(x, y), x), x);
+        add(Min::make(Max::make(y, x), x), x);
+        add(Max::make(x, Min::make(x, y)), x);
+        add(Max::make(x, Min::make(y, x)), x);
+        add(Max::make(Min::make(x, y), x), x);
+        add(Max::make(Min::make(y, x), x), x);
+
+        add(Select::make(Not::make(c), x, y), Select::make(c, y, x));
+        add(Select::make(c, x, Select::make(c, y, z)), Select::make(c, x, z));
+        add(Select::make(c, Select::make(c, x, y), z), Select::make(c, x, z));
+    }
+
+    // Apply the first matching rule, or return the Expr unchanged.
+    Expr apply(Expr e) const {
+        map<const IRNodeType *, vector<RewriteRule> >::const_iterator iter =
+            rules.find(e.ptr->type_info());
+        if (iter == rules.end()) return e;
+        const vector<RewriteRule> &candidates = iter->second;
+        map<string, Expr> bindings;
+        for (size_t i = 0; i < candidates.size(); i++) {
+            if (expr_match(candidates[i].before, e, bindings)) {
+                return substitute(bindings, candidates[i].after);
+            }
+        }
+        return e;
+    }
+};
+
+const RewriteRules &rewrite_rules() {
+    static RewriteRules rules;
+    return rules;
+}
+
+// Compares Exprs by node identity.
+struct ExprNodeCompare {
+    bool operator()(const Expr &a, const Expr &b) const {
+        return a.ptr < b.ptr;
+    }
+};
+
+}
+
 class Simplify : public IRMutator {
 public:
     Simplify(bool r) : remove_dead_lets(r) {}
+
+    using IRMutator::mutate;
+
+    Expr mutate(Expr e) {
+        if (!e.defined()) return e;
+
+        // The visitors often rebuild a node out of children they've
+        // already simplified and then simplify it again, so check
+        // whether we've seen this node before.
+        map<Expr, Expr, ExprNodeCompare>::iterator iter = simplified.find(e);
+        if (iter != simplified.end()) {
+            return iter->second;
+        }
+
+        Expr result = IRMutator::mutate(e);
+        // Rules may apply in turn, but each makes the Expr smaller.
+        for (Expr next = rewrite_rules().apply(result); !next.same_as(result);
+             next = rewrite_rules().apply(result)) {
+            result = mutate(next);
+        }
+
+        simplified[e] = result;
+        simplified[result] = result;
+        return result;
+    }
+
 private:
     bool remove_dead_lets;
 
+    // The already-simplified Exprs, and what they simplified to. This
+    // depends on all of the scopes below, so it's cleared whenever
+    // they change. Variable uses skipped by a hit don't matter,
+    // because only whether a count is zero is used, and the first
+    // simplification counted them.
+    map<Expr, Expr, ExprNodeCompare> simplified;
+
     struct VarInfo {
         Expr replacement;
         int old_uses, new_uses;
@@ -1329,14 +1437,14 @@ private:
             // (foo <= x && bar <= x) -> max(foo, bar) <= x
             expr = mutate(max(le_a->a, le_b->a) <= le_a->b);
         } else if (lt_a && lt_b && equal(lt_a->a, lt_b->a)) {
-            // (x <= foo && x <= bar) -> x <= min(foo, bar)
-            expr = mutate(lt_a->a <= min(lt_a->b, lt_b->b));
+            // (x < foo && x < bar) -> x < min(foo, bar)
+            expr = mutate(lt_a->a < min(lt_a->b, lt_b->b));
         } else if (lt_a && lt_b && equal(lt_a->b, lt_b->b)) {
-            // (foo <= x && bar <= x) -> max(foo, bar) <= x
-            expr = mutate(max(lt_a->a, lt_b->a) <= lt_a->b);
+            // (foo < x && bar < x) -> max(foo, bar) < x
+            expr = mutate(max(lt_a->a, lt_b->a) < lt_a->b);
         } else if (equal(a, b)) {
-            // x < x
-            expr = make_zero(a.type());
+            // x && x -> x
+            expr = a;
         } else if (a.same_as(op->a) && b.same_as(op->b)) {
             expr = op;
         } else {
@@ -1425,13 +1533,19 @@ private:
     void visit(const Load *op) {
         // Load of a broadcast should be broadcast of the load
         Expr index = mutate(op->index);
-        if (const Broadcast *b = index.as<Broadcast>()) {
+        Expr predicate = mutate(op->predicate);
+        if (predicate.defined() && is_one(predicate)) {
+            // All lanes are loaded
+            predicate = Expr();
+        }
+        const Broadcast *b = index.as<Broadcast>();
+        if (b && !predicate.defined()) {
             Expr load = Load::make(op->type.element_of(), op->name, b->value, op->image, op->param);
             expr = Broadcast::make(load, b->width);
-        } else if (index.same_as(op->index)) {
+        } else if (index.same_as(op->index) && predicate.same_as(op->predicate)) {
             expr = op;
         } else {
-            expr = Load::make(op->type, op->name, index, op->image, op->param);
+            expr = Load::make(op->type, op->name, index, op->image, op->param, predicate);
         }
     }
 
@@ -1444,6 +1558,32 @@ private:
     }
 
     void visit(const Call *op) {
+        if (op->call_type == Call::Intrinsic &&
+            (op->name == Call::shift_left || op->name == Call::shift_right)) {
+            // Shifts by a constant are multiplications or divisions
+            // by a power of two (our division rounds down, just like
+            // an arithmetic shift). Written that way the other rules,
+            // and the peephole patterns in the backends, can see them.
+            Expr a = mutate(op->args[0]), b = mutate(op->args[1]);
+            const Broadcast *broadcast = b.as<Broadcast>();
+            int shift = 0;
+            int max_shift = std::min(a.type().is_int() ? a.type().bits - 1 : a.type().bits, 31);
+            if (const_castint(broadcast ? broadcast->value : b, &shift) &&
+                shift >= 0 && shift < max_shift) {
+                Expr factor = make_const(a.type(), 1 << shift);
+                if (op->name == Call::shift_left) {
+                    expr = mutate(Mul::make(a, factor));
+                } else {
+                    expr = mutate(Div::make(a, factor));
+                }
+            } else if (a.same_as(op->args[0]) && b.same_as(op->args[1])) {
+                expr = op;
+            } else {
+                expr = Call::make(op->type, op->name, vec(a, b), op->call_type);
+            }
+            return;
+        }
+
         // Calls implicitly depend on mins and strides of the buffer referenced
         if (op->call_type == Call::Image || op->call_type == Call::Halide) {
             for (size_t i = 0; i < op->args.size(); i++) {
@@ -1571,6 +1711,7 @@ private:
             value_tracked = true;
         }
 
+        simplified.clear();
         body = mutate(body);
 
         if (value_tracked) {
@@ -1582,6 +1723,7 @@ private:
 
         info = var_info.get(op->name);
         var_info.pop(op->name);
+        simplified.clear();
 
         Body result = body;
 
@@ -1643,12 +1785,14 @@ private:
         if (bounds_tracked) {
             Interval i = Interval(new_min, new_min_int->value + new_extent_int->value - 1);
             bounds_info.push(op->name, i);
+            simplified.clear();
         }
 
         Stmt new_body = mutate(op->body);
 
         if (bounds_tracked) {
             bounds_info.pop(op->name);
+            simplified.clear();
         }
 
         if (op->min.same_as(new_min) &&
@@ -1661,7 +1805,62 @@ private:
     }
 
     void visit(const Store *op) {
-        IRMutator::visit(op);
+        Expr predicate = mutate(op->predicate);
+        if (predicate.defined() && is_zero(predicate)) {
+            // No lanes are stored
+            stmt = Evaluate::make(0);
+            return;
+        }
+        Expr value = mutate(op->value);
+        Expr index = mutate(op->index);
+        if (predicate.defined() && is_one(predicate)) {
+            predicate = Expr();
+        }
+        if (value.same_as(op->value) &&
+            index.same_as(op->index) &&
+            predicate.same_as(op->predicate)) {
+            stmt = op;
+        } else {
+            stmt = Store::make(op->name, value, index, predicate);
+        }
+    }
+
+    // Substitute in the values of variables that a condition says
+    // are equal to constants.
+    Stmt learn_fact(Expr fact, Stmt s) {
+        if (const And *a = fact.as<And>()) {
+            return learn_fact(a->b, learn_fact(a->a, s));
+        }
+        if (const EQ *eq = fact.as<EQ>()) {
+            const Variable *var = eq->a.as<Variable>();
+            Expr value = eq->b;
+            if (!var) {
+                var = eq->b.as<Variable>();
+                value = eq->a;
+            }
+            if (var && is_const(value)) {
+                return substitute(var->name, value, s);
+            }
+        }
+        return s;
+    }
+
+    void visit(const IfThenElse *op) {
+        Expr condition = mutate(op->condition);
+
+        // The condition holds in the then case, so e.g. a loop nest
+        // guarded by a unit stride can be simplified for it (see
+        // Func::specialize).
+        Stmt then_case = mutate(learn_fact(condition, op->then_case));
+        Stmt else_case = mutate(op->else_case);
+
+        if (condition.same_as(op->condition) &&
+            then_case.same_as(op->then_case) &&
+            else_case.same_as(op->else_case)) {
+            stmt = op;
+        } else {
+            stmt = IfThenElse::make(condition, then_case, else_case);
+        }
     }
 
     void visit(const Provide *op) {
@@ -1985,6 +2184,13 @@ void simplify_test() {
     // Check that non-extremes do not lead to incorrect simplification
     check(Max::make(Cast::make(Int(8), x), Cast::make(Int(8), -127)), Max::make(Cast::make(Int(8), x), Cast::make(Int(8), -127)));
 
+    // Shifts by constants become multiplies and divides
+    check(x << 3, x * 8);
+    check(x >> 2, x / 4);
+    check(Cast::make(UInt(8), x) >> 7, Cast::make(UInt(8), x) / Cast::make(UInt(8), 128));
+    check(x >> 31, x >> 31);
+    check(x << y, x << y);
+
     // Check an optimization important for fusing dimensions
     check((x/3)*3 + x%3, x);
     check(x%3 + (x/3)*3, x);
@@ -2093,6 +2299,18 @@ void simplify_test() {
     check(f && (x < 0), f);
     check(t || (x < 0), t);
     check(f || (x < 0), x < 0);
+    check((0 < x) && (7 < x), 7 < x);
+    check((x < 3) && (x < y), x < min(y, 3));
+    check((x < 0) && (x < 0), x < 0);
+
+    // Check the rewrite rules, for a few types
+    Expr b = Variable::make(Bool(), "b");
+    check(Min::make(x, Max::make(y, x)), x);
+    check(Max::make(Min::make(xf, yf), xf), xf);
+    check(Min::make(Max::make(cast<uint8_t>(x), cast<uint8_t>(y)), cast<uint8_t>(x)), cast<uint8_t>(x));
+    check(Select::make(!b, x, y), Select::make(b, y, x));
+    check(select(x < y, z, select(x < y, w, v)), select(x < y, z, v));
+    check(select(b, select(b, xf, yf), 3.0f), select(b, xf, 3.0f));
 
     Expr vec = Variable::make(Int(32, 4), "vec");
     // Check constants get pushed inwards
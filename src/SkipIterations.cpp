@@ -0,0 +1,57 @@
+#include "SkipIterations.h"
+#include "IRMutator.h"
+#include "IRPrinter.h"
+#include "Qualify.h"
+#include "Debug.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+
+namespace {
+
+class SkipInactiveIterations : public IRMutator {
+    const map<string, Function> &env;
+
+    using IRMutator::visit;
+
+    void visit(const For *op) {
+        Stmt body = mutate(op->body);
+
+        for (map<string, Function>::const_iterator iter = env.begin();
+             iter != env.end(); ++iter) {
+            const vector<Schedule::SkipCondition> &conditions =
+                iter->second.schedule().skip_conditions;
+            string prefix = iter->first + ".s0.";
+            for (size_t i = 0; i < conditions.size(); i++) {
+                if (op->name == prefix + conditions[i].var) {
+                    Expr active = qualify(prefix, conditions[i].active);
+                    debug(3) << "Skipping iterations of " << op->name
+                             << " unless " << active << "\n";
+                    body = IfThenElse::make(active, body);
+                }
+            }
+        }
+
+        if (body.same_as(op->body)) {
+            stmt = op;
+        } else {
+            stmt = For::make(op->name, op->min, op->extent, op->for_type, body);
+        }
+    }
+
+public:
+    SkipInactiveIterations(const map<string, Function> &e) : env(e) {}
+};
+
+}
+
+Stmt skip_inactive_iterations(Stmt s, const map<string, Function> &env) {
+    return SkipInactiveIterations(env).mutate(s);
+}
+
+}
+}
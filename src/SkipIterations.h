@@ -0,0 +1,29 @@
+#ifndef HALIDE_SKIP_ITERATIONS_H
+#define HALIDE_SKIP_ITERATIONS_H
+
+/** \file
+ * Defines the lowering pass that skips loop iterations for which a
+ * runtime condition given by Func::skip_unless is false.
+ */
+
+#include "IR.h"
+#include "Function.h"
+
+#include <map>
+
+namespace Halide {
+namespace Internal {
+
+/** Guard the bodies of the loops named in the skip conditions of
+ * each function's schedule with the condition, so that inactive
+ * iterations (e.g. the tiles of an output that haven't changed) skip
+ * the function and the producers computed within them. Must run after
+ * the realizations of the functions have been injected, and before
+ * bounds inference, which then finds the bounds of any images the
+ * conditions read. */
+Stmt skip_inactive_iterations(Stmt s, const std::map<std::string, Function> &env);
+
+}
+}
+
+#endif
@@ -221,7 +221,10 @@ private:
                 // Don't try to skip stages if the predicate may vary
                 // per lane. This will just unvectorize the
                 // production, which is probably contrary to the
-                // intent of the user.
+                // intent of the user. Selects whose conditions bound
+                // a coordinate have already shrunk the region
+                // computed in bounds inference (see boxes_computed in
+                // Bounds.h).
                 predicate = const_true();
             }
 
@@ -233,7 +236,7 @@ private:
                 // loaded. They can be incorrect, but they must be
                 // loadable. Perhaps we can mmap some readable junk memory
                 // (e.g. lots of pages of /dev/zero).
-                stmt = Realize::make(op->name, op->types, op->bounds, body);
+                stmt = rebuild(op, op->bounds, body);
             } else {
                 IRMutator::visit(op);
             }
@@ -8,12 +8,14 @@
 #include "Simplify.h"
 #include "Derivative.h"
 #include "Bounds.h"
+#include "ExprUsesVar.h"
 
 namespace Halide {
 namespace Internal {
 
 using std::string;
 using std::map;
+using std::vector;
 
 namespace {
 
@@ -260,6 +262,16 @@ class SlidingWindowOnFunctionAndLoop : public IRMutator {
         }
     }
 
+    void visit(const IfThenElse *op) {
+        // Iterations that skip the producer would leave holes in
+        // the window (see Func::skip_unless).
+        if (expr_uses_var(expand_expr(op->condition, scope), loop_var)) {
+            stmt = op;
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
     void visit(const LetStmt *op) {
         scope.push(op->name, simplify(expand_expr(op->value, scope)));
         Stmt new_body = mutate(op->body);
@@ -272,11 +284,7 @@ class SlidingWindowOnFunctionAndLoop : public IRMutator {
             replacements.erase(iter);
         }
 
-        if (new_body.same_as(op->body) && value.same_as(op->value)) {
-            stmt = op;
-        } else {
-            stmt = LetStmt::make(op->name, value, new_body);
-        }
+        stmt = rebuild(op, value, new_body);
         scope.pop(op->name);
     }
 
@@ -301,15 +309,100 @@ class SlidingWindowOnFunction : public IRMutator {
             new_body = SlidingWindowOnFunctionAndLoop(func, op->name, op->min).mutate(new_body);
         }
 
-        if (new_body.same_as(op->body)) {
+        stmt = rebuild(op, op->min, op->extent, new_body);
+    }
+
+public:
+    SlidingWindowOnFunction(Function f) : func(f) {}
+};
+
+// A parallel loop that a sliding window would otherwise be lost over
+// is split into this many chunks, which each slide serially.
+const int parallel_sliding_chunks = 16;
+
+// If a function would slide over a parallel loop if it were serial,
+// split the loop into chunks that run in parallel, each with its own
+// realization of the function and a serial loop inside that the
+// function slides over. The first iteration of each chunk computes
+// the whole region it needs, and the rest only compute the new
+// values. Storage folding can then fold the realization in each
+// chunk. The parallel loop is found through lets, blocks and the
+// pipelines of other functions, as SlidingWindowOnFunction finds
+// serial loops. Everything else is handed to the outer mutator, to
+// slide the realizations inside it. Fails if the function is used
+// anywhere but in that loop.
+class SlideOverParallelChunks : public IRMutator {
+    const Realize *realize;
+    Function func;
+    IRMutator &outer;
+
+    using IRMutator::visit;
+
+    void visit(const Pipeline *op) {
+        if (op->name == func.name()) {
+            failed = true;
             stmt = op;
         } else {
-            stmt = For::make(op->name, op->min, op->extent, op->for_type, new_body);
+            IRMutator::visit(op);
         }
     }
 
+    void visit(const Realize *op) {
+        stmt = outer.mutate(op);
+    }
+
+    void visit(const Provide *op) {
+        if (op->name == func.name()) failed = true;
+        IRMutator::visit(op);
+    }
+
+    void visit(const Call *op) {
+        if (op->call_type == Call::Halide && op->name == func.name()) failed = true;
+        IRMutator::visit(op);
+    }
+
+    void visit(const For *op) {
+        if (box_touched(op->body, func.name()).empty()) {
+            stmt = outer.mutate(op);
+            return;
+        }
+        if (op->for_type != For::Parallel || chunked) {
+            failed = true;
+            stmt = op;
+            return;
+        }
+
+        string chunk_name = op->name + ".chunk";
+        string size_name = op->name + ".chunk_size";
+        Expr chunk = Variable::make(Int(32), chunk_name);
+        Expr chunk_size = Variable::make(Int(32), size_name);
+        Expr chunk_min = op->min + chunk * chunk_size;
+        Expr chunk_extent = min(chunk_size, op->extent - chunk * chunk_size);
+
+        // Slide over loops inside the body first, as for a serial loop.
+        Stmt body = SlidingWindowOnFunction(func).mutate(op->body);
+        Stmt slid = SlidingWindowOnFunctionAndLoop(func, op->name, chunk_min).mutate(body);
+        if (slid.same_as(body)) {
+            failed = true;
+            stmt = op;
+            return;
+        }
+
+        debug(3) << "Sliding " << func.name() << " over chunks of parallel loop " << op->name << "\n";
+
+        Stmt s = For::make(op->name, chunk_min, chunk_extent, For::Serial, outer.mutate(slid));
+        s = Realize::make(realize->name, realize->types, realize->bounds, s);
+        Expr chunks = (op->extent + chunk_size - 1) / chunk_size;
+        s = For::make(chunk_name, 0, chunks, For::Parallel, s);
+        Expr size = max((op->extent + (parallel_sliding_chunks - 1)) / parallel_sliding_chunks, 1);
+        stmt = LetStmt::make(size_name, size, s);
+        chunked = true;
+    }
+
 public:
-    SlidingWindowOnFunction(Function f) : func(f) {}
+    bool chunked, failed;
+    SlideOverParallelChunks(const Realize *r, Function f, IRMutator &o) :
+        realize(r), func(f), outer(o), chunked(false), failed(false) {}
 };
 
 // Perform sliding window optimization for all functions
@@ -318,6 +411,15 @@ class SlidingWindow : public IRMutator {
 
     using IRMutator::visit;
 
+    // Returns an undefined Stmt if the realization can't be slid over
+    // chunks of a parallel loop.
+    Stmt slide_over_parallel_chunks(const Realize *op, Function func) {
+        SlideOverParallelChunks chunker(op, func, *this);
+        Stmt s = chunker.mutate(op->body);
+        if (!chunker.chunked || chunker.failed) return Stmt();
+        return s;
+    }
+
     void visit(const Realize *op) {
         // Find the args for this function
         map<string, Function>::const_iterator iter = env.find(op->name);
@@ -333,15 +435,17 @@ class SlidingWindow : public IRMutator {
 
         debug(3) << "Doing sliding window analysis on realization of " << op->name << "\n";
 
+        Stmt chunked = slide_over_parallel_chunks(op, iter->second);
+        if (chunked.defined()) {
+            stmt = chunked;
+            return;
+        }
+
         new_body = SlidingWindowOnFunction(iter->second).mutate(new_body);
 
         new_body = mutate(new_body);
 
-        if (new_body.same_as(op->body)) {
-            stmt = op;
-        } else {
-            stmt = Realize::make(op->name, op->types, op->bounds, new_body);
-        }
+        stmt = rebuild(op, op->bounds, new_body);
     }
 public:
     SlidingWindow(const map<string, Function> &e) : env(e) {}
@@ -15,7 +15,10 @@ namespace Internal {
 
 /** Perform sliding window optimizations on a halide
  * statement. I.e. don't bother computing points in a function that
- * have provably already been computed by a previous iteration.
+ * have provably already been computed by a previous iteration. A
+ * parallel loop that a function would slide over if it were serial
+ * is split into chunks that run in parallel, each of which slides
+ * serially over its own realization of the function.
  */
 Stmt sliding_window(Stmt s, const std::map<std::string, Function> &env);
 
@@ -9,12 +9,128 @@ namespace Internal {
 namespace {
 class PredicateFinder : public IRMutator {
 public:
-    Expr min_predicate, max_predicate;
-    PredicateFinder() : min_predicate(const_true()), max_predicate(const_true()) {}
+    Expr min_predicate, max_predicate, select_predicate;
+    PredicateFinder() : min_predicate(const_true()), max_predicate(const_true()),
+                        select_predicate(const_true()) {}
+
+    Expr predicate() const {
+        return min_predicate && max_predicate && select_predicate;
+    }
 
 private:
     using IRVisitor::visit;
 
+    // The smallest and largest lanes of a ramp, if we know which end
+    // is which.
+    bool ramp_bounds(const Ramp *r, Expr &lo, Expr &hi) {
+        Expr last = r->base + r->stride * (r->width - 1);
+        if (is_positive_const(r->stride)) {
+            lo = r->base;
+            hi = last;
+        } else if (is_negative_const(r->stride)) {
+            lo = last;
+            hi = r->base;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // A condition under which every lane of a vector a < b (or a <=
+    // b) has the given value, where one side is a ramp and the
+    // other a broadcast.
+    Expr uniform_comparison(Expr a, Expr b, bool or_equal, bool value) {
+        const Ramp *ra = a.as<Ramp>();
+        const Ramp *rb = b.as<Ramp>();
+        const Broadcast *ba = a.as<Broadcast>();
+        const Broadcast *bb = b.as<Broadcast>();
+        Expr lo, hi;
+        if (ra && bb && ramp_bounds(ra, lo, hi)) {
+            Expr v = bb->value;
+            if (or_equal) return value ? (hi <= v) : (lo > v);
+            return value ? (hi < v) : (lo >= v);
+        } else if (ba && rb && ramp_bounds(rb, lo, hi)) {
+            Expr v = ba->value;
+            if (or_equal) return value ? (v <= lo) : (v > hi);
+            return value ? (v < lo) : (v >= hi);
+        }
+        return Expr();
+    }
+
+    // A condition under which every lane of a vector condition has
+    // the given value, or an undefined Expr if we can't find one.
+    Expr uniform_condition(Expr cond, bool value) {
+        if (const Not *n = cond.as<Not>()) {
+            return uniform_condition(n->a, !value);
+        } else if (const LT *lt = cond.as<LT>()) {
+            return uniform_comparison(lt->a, lt->b, false, value);
+        } else if (const LE *le = cond.as<LE>()) {
+            return uniform_comparison(le->a, le->b, true, value);
+        } else if (const GT *gt = cond.as<GT>()) {
+            return uniform_comparison(gt->b, gt->a, false, value);
+        } else if (const GE *ge = cond.as<GE>()) {
+            return uniform_comparison(ge->b, ge->a, true, value);
+        }
+
+        // An and is true if both sides are, and false if either side
+        // is. An or is the other way around.
+        Expr a, b;
+        bool both;
+        if (const And *op = cond.as<And>()) {
+            a = uniform_condition(op->a, value);
+            b = uniform_condition(op->b, value);
+            both = value;
+        } else if (const Or *op = cond.as<Or>()) {
+            a = uniform_condition(op->a, value);
+            b = uniform_condition(op->b, value);
+            both = !value;
+        } else {
+            return Expr();
+        }
+        if (a.defined() && b.defined()) {
+            return both ? (a && b) : (a || b);
+        } else if (both) {
+            return Expr();
+        } else {
+            return a.defined() ? a : b;
+        }
+    }
+
+    void visit(const Select *op) {
+        if (op->condition.type().is_scalar()) {
+            IRMutator::visit(op);
+            return;
+        }
+
+        Expr condition = mutate(op->condition);
+
+        // Boundary conditions test whether a ramp is inside some
+        // range. We would like to specialize for the inside, which is
+        // where an and of comparisons is true, or an or of them is
+        // false, so try that way around first.
+        bool value = !condition.as<Or>();
+        Expr p = uniform_condition(condition, value);
+        if (!p.defined()) {
+            value = !value;
+            p = uniform_condition(condition, value);
+        }
+
+        if (p.defined()) {
+            select_predicate = select_predicate && p;
+            expr = mutate(value ? op->true_value : op->false_value);
+        } else {
+            Expr true_value = mutate(op->true_value);
+            Expr false_value = mutate(op->false_value);
+            if (condition.same_as(op->condition) &&
+                true_value.same_as(op->true_value) &&
+                false_value.same_as(op->false_value)) {
+                expr = op;
+            } else {
+                expr = Select::make(condition, true_value, false_value);
+            }
+        }
+    }
+
     void visit(const Min *op) {
         Expr a = mutate(op->a);
         Expr b = mutate(op->b);
@@ -81,6 +197,7 @@ private:
 
         min_predicate = substitute(op->name, value, min_predicate);
         max_predicate = substitute(op->name, value, max_predicate);
+        select_predicate = substitute(op->name, value, select_predicate);
     }
 };
 
@@ -93,7 +210,7 @@ class SpecializeClampedRamps : public IRMutator {
         if (simpler_store.same_as(op)) {
             stmt = op;
         } else {
-            Expr predicate = p.min_predicate && p.max_predicate;
+            Expr predicate = p.predicate();
             stmt = IfThenElse::make(predicate, simpler_store, op);
         }
     }
@@ -108,7 +225,7 @@ class SpecializeClampedRamps : public IRMutator {
             stmt = LetStmt::make(op->name, op->value, body);
         } else {
             Stmt simpler_let = LetStmt::make(op->name, simpler_value, body);
-            Expr predicate = p.min_predicate && p.max_predicate;
+            Expr predicate = p.predicate();
             stmt = IfThenElse::make(predicate, simpler_let, op);
         }
     }
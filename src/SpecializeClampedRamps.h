@@ -10,9 +10,12 @@
 namespace Halide {
 namespace Internal {
 
-/** Take a statement with multi-dimensional Realize, Provide, and Call
- * nodes, and turn it into a statement with single-dimensional
- * Allocate, Store, and Load nodes respectively. */
+/** Find vector stores and lets that clamp a ramp against a broadcast,
+ * or select on whether a ramp is inside a range (as the functions in
+ * BoundaryConditions.h do), and add a version of them without the
+ * clamps or selects that runs when every lane is on the same side of
+ * them. Away from the edges of an image, these are then dense vector
+ * loads and stores. */
 Stmt specialize_clamped_ramps(Stmt s);
 
 }
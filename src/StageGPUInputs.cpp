@@ -0,0 +1,306 @@
+#include "StageGPUInputs.h"
+#include "IRMutator.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "IREquality.h"
+#include "CodeGen_GPU_Dev.h"
+#include "ExprUsesVar.h"
+#include "Bounds.h"
+#include "Simplify.h"
+#include "Scope.h"
+#include "Debug.h"
+
+#include <map>
+#include <set>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::map;
+using std::set;
+
+namespace {
+
+// The most shared memory a block may stage inputs into, in bytes. The
+// smallest devices we target have 16k per block.
+const int max_staged_bytes = 1024 * 12;
+
+bool is_thread_var(const string &name) {
+    return (CodeGen_GPU_Dev::is_gpu_var(name) &&
+            starts_with(base_name(name), "thread"));
+}
+
+bool is_block_var(const string &name) {
+    return (CodeGen_GPU_Dev::is_gpu_var(name) &&
+            starts_with(base_name(name), "block"));
+}
+
+// Find the calls to images and functions in a statement, and the
+// functions it writes to.
+class FindReads : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type == Call::Image || op->call_type == Call::Halide) {
+            calls[op->name].push_back(op);
+        }
+    }
+
+    void visit(const Provide *op) {
+        IRVisitor::visit(op);
+        written.insert(op->name);
+    }
+
+    void visit(const Realize *op) {
+        IRVisitor::visit(op);
+        written.insert(op->name);
+    }
+
+public:
+    map<string, vector<const Call *> > calls;
+    set<string> written;
+};
+
+// Does a list of calls read more than one site?
+bool reads_several_sites(const vector<const Call *> &calls) {
+    for (size_t i = 1; i < calls.size(); i++) {
+        for (size_t j = 0; j < calls[i]->args.size(); j++) {
+            if (!equal(calls[i]->args[j], calls[0]->args[j])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+struct StagedInput {
+    // The name of the shared memory buffer.
+    string name;
+    // A call to the input, to copy from.
+    const Call *call;
+    // The region of the input the block reads.
+    vector<Expr> min, extent;
+};
+
+// Rewrite calls to the staged inputs as loads from shared memory.
+class LoadFromStaged : public IRMutator {
+    const map<string, StagedInput> &staged;
+
+    using IRMutator::visit;
+
+    void visit(const Call *op) {
+        map<string, StagedInput>::const_iterator iter = staged.find(op->name);
+        if ((op->call_type != Call::Image && op->call_type != Call::Halide) ||
+            iter == staged.end()) {
+            IRMutator::visit(op);
+            return;
+        }
+
+        const StagedInput &s = iter->second;
+        Expr idx = 0, stride = 1;
+        for (size_t i = 0; i < op->args.size(); i++) {
+            idx += (mutate(op->args[i]) - s.min[i]) * stride;
+            stride *= s.extent[i];
+        }
+        expr = Load::make(op->type, s.name, idx, Buffer(), Parameter());
+    }
+
+public:
+    LoadFromStaged(const map<string, StagedInput> &s) : staged(s) {}
+};
+
+class StageGPUInputs : public IRMutator {
+    // The bounds of the enclosing loop variables and lets, so that we
+    // can bound the size of the staged regions.
+    Scope<Interval> scope;
+
+    // The functions realized inside the current kernel. Those are in
+    // shared memory already.
+    Scope<int> realized;
+
+    int block_depth;
+
+    using IRMutator::visit;
+
+    void visit(const For *op) {
+        if (block_depth > 0 && is_thread_var(op->name)) {
+            stmt = stage_inputs(op);
+            return;
+        }
+
+        Expr max_loop = bounds_of_expr_in_scope(op->min + op->extent - 1, scope).max;
+        Expr min_loop = bounds_of_expr_in_scope(op->min, scope).min;
+        scope.push(op->name, Interval(min_loop, max_loop));
+        bool is_block = is_block_var(op->name);
+        if (is_block) block_depth++;
+        IRMutator::visit(op);
+        if (is_block) block_depth--;
+        scope.pop(op->name);
+    }
+
+    void visit(const LetStmt *op) {
+        scope.push(op->name, bounds_of_expr_in_scope(op->value, scope));
+        IRMutator::visit(op);
+        scope.pop(op->name);
+    }
+
+    void visit(const Realize *op) {
+        if (block_depth > 0) {
+            realized.push(op->name, 0);
+            IRMutator::visit(op);
+            realized.pop(op->name);
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    // Cooperatively copy the region of an input that a block reads
+    // into shared memory, spreading the work over the threads of the
+    // block.
+    Stmt copy_to_staged(const StagedInput &s, const vector<const For *> &threads) {
+        // Number the threads of the block.
+        Expr thread_id = 0, num_threads = 1;
+        for (size_t i = threads.size(); i > 0; i--) {
+            const For *t = threads[i-1];
+            thread_id += (Variable::make(Int(32), t->name) - t->min) * num_threads;
+            num_threads *= t->extent;
+        }
+
+        Expr size = 1;
+        for (size_t i = 0; i < s.extent.size(); i++) {
+            size *= s.extent[i];
+        }
+
+        string loop_name = s.name + ".k";
+        string idx_name = s.name + ".idx";
+        Expr idx = Variable::make(Int(32), idx_name);
+
+        // Unpack the index into coordinates of the input. The region
+        // may be conservative, so keep the coordinates inside the
+        // input. Those staged values are never read.
+        vector<Expr> args(s.extent.size());
+        Expr rem = idx;
+        for (size_t i = 0; i < args.size(); i++) {
+            Expr coord = rem;
+            if (i + 1 < args.size()) {
+                coord = rem % s.extent[i];
+                rem = rem / s.extent[i];
+            }
+            string dim = int_to_string(i);
+            Expr input_min = Variable::make(Int(32), s.call->name + ".min." + dim);
+            Expr input_extent = Variable::make(Int(32), s.call->name + ".extent." + dim);
+            args[i] = clamp(coord + s.min[i], input_min, input_min + input_extent - 1);
+        }
+
+        const Call *c = s.call;
+        Expr value = Call::make(c->type, c->name, args, c->call_type,
+                                c->func, c->value_index, c->image, c->param);
+        Stmt copy = IfThenElse::make(idx < size, Store::make(s.name, value, idx));
+        copy = LetStmt::make(idx_name, Variable::make(Int(32), loop_name) * num_threads + thread_id, copy);
+        copy = For::make(loop_name, 0, (size + num_threads - 1) / num_threads, For::Serial, copy);
+
+        for (size_t i = threads.size(); i > 0; i--) {
+            const For *t = threads[i-1];
+            copy = For::make(t->name, t->min, t->extent, t->for_type, copy);
+        }
+        return copy;
+    }
+
+    Stmt stage_inputs(const For *op) {
+        Stmt s = op;
+
+        // Collect the nest of thread loops.
+        vector<const For *> threads;
+        for (const For *t = op; t && is_thread_var(t->name); t = t->body.as<For>()) {
+            for (size_t i = 0; i < threads.size(); i++) {
+                if (expr_uses_var(t->min, threads[i]->name) ||
+                    expr_uses_var(t->extent, threads[i]->name)) {
+                    return s;
+                }
+            }
+            threads.push_back(t);
+        }
+
+        FindReads reads;
+        s.accept(&reads);
+
+        map<string, StagedInput> staged;
+        int staged_bytes = 0;
+        for (map<string, vector<const Call *> >::iterator iter = reads.calls.begin();
+             iter != reads.calls.end(); ++iter) {
+            const string &name = iter->first;
+            const vector<const Call *> &calls = iter->second;
+            const Call *c = calls[0];
+
+            if (reads.written.count(name) || realized.contains(name)) continue;
+            if (c->type.bits < 8) continue;
+            if (c->call_type == Call::Halide && c->func.outputs() > 1) continue;
+            if (!reads_several_sites(calls)) continue;
+
+            Box b = box_required(s, name);
+            bool ok = b.size() == c->args.size();
+            StagedInput input;
+            Expr bytes = c->type.bytes();
+            for (size_t i = 0; ok && i < b.size(); i++) {
+                ok = b[i].min.defined() && b[i].max.defined();
+                if (!ok) break;
+                input.min.push_back(b[i].min);
+                input.extent.push_back(simplify(b[i].max - b[i].min + 1));
+                bytes *= input.extent[i];
+            }
+            if (!ok) continue;
+
+            // The region may change from block to block, but the
+            // shared memory for it must be bounded.
+            Expr max_bytes = bounds_of_expr_in_scope(simplify(bytes), scope).max;
+            if (max_bytes.defined()) max_bytes = simplify(max_bytes);
+            const IntImm *size = max_bytes.defined() ? max_bytes.as<IntImm>() : NULL;
+            if (!size || size->value <= 0 ||
+                staged_bytes + size->value > max_staged_bytes) {
+                debug(3) << "Not staging " << name << " through shared memory\n";
+                continue;
+            }
+            staged_bytes += size->value;
+
+            input.name = unique_name(name + ".staged", false);
+            input.call = c;
+            staged[name] = input;
+            debug(3) << "Staging " << name << " through " << size->value
+                     << " bytes of shared memory\n";
+        }
+
+        if (staged.empty()) return s;
+
+        Stmt produce, consume = LoadFromStaged(staged).mutate(s);
+        for (map<string, StagedInput>::iterator iter = staged.begin();
+             iter != staged.end(); ++iter) {
+            Stmt copy = copy_to_staged(iter->second, threads);
+            produce = produce.defined() ? Block::make(produce, copy) : copy;
+        }
+
+        // The pipeline gives us the barrier between the copy and the
+        // reads.
+        Stmt result = Pipeline::make(staged.begin()->second.name, produce, Stmt(), consume);
+        for (map<string, StagedInput>::iterator iter = staged.begin();
+             iter != staged.end(); ++iter) {
+            result = Allocate::make(iter->second.name, iter->second.call->type,
+                                    iter->second.extent, result);
+        }
+        return result;
+    }
+
+public:
+    StageGPUInputs() : block_depth(0) {}
+};
+
+}
+
+Stmt stage_gpu_inputs(Stmt s) {
+    return StageGPUInputs().mutate(s);
+}
+
+}
+}
@@ -0,0 +1,26 @@
+#ifndef HALIDE_STAGE_GPU_INPUTS_H
+#define HALIDE_STAGE_GPU_INPUTS_H
+
+/** \file
+ * Defines the lowering pass that stages stencil inputs of gpu kernels
+ * through shared memory.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Find images and functions that the threads of a gpu block read at
+ * several overlapping sites, as stencils do, and have the threads
+ * cooperatively copy the region the block reads into a shared memory
+ * buffer first. The reads are then rewritten to load from that
+ * buffer. Only inputs computed outside the kernel and not written
+ * inside it are staged. Must run after bounds inference and before
+ * storage flattening. */
+Stmt stage_gpu_inputs(Stmt s);
+
+}
+}
+
+#endif
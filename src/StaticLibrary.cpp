@@ -0,0 +1,126 @@
+#include "StaticLibrary.h"
+#include "Util.h"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::ostringstream;
+
+namespace {
+
+const size_t header_size = 60;
+
+// The fixed-width header of an archive member.
+string member_header(const string &name, size_t size) {
+    ostringstream header;
+    header.setf(std::ios::left);
+    header.width(16); header << name;
+    header.width(12); header << 0;   // mtime
+    header.width(6);  header << 0;   // uid
+    header.width(6);  header << 0;   // gid
+    header.width(8);  header << 644; // mode
+    header.width(10); header << size;
+    header << "`\n";
+    assert(header.str().size() == header_size);
+    return header.str();
+}
+
+void put_u32(string &s, uint32_t x, bool big_endian) {
+    for (int i = 0; i < 4; i++) {
+        int shift = big_endian ? 24 - 8*i : 8*i;
+        s += (char)((x >> shift) & 0xff);
+    }
+}
+
+size_t padded(size_t size) {
+    return (size + 1) & ~(size_t)1;
+}
+
+}
+
+void write_static_library(const string &filename, const vector<LibraryMember> &members, bool bsd) {
+    vector<string> contents(members.size());
+    for (size_t i = 0; i < members.size(); i++) {
+        std::ifstream object(members[i].filename.c_str(), std::ios::binary);
+        if (!object) {
+            std::cerr << "Could not read " << members[i].filename << " to put it in " << filename << "\n";
+            assert(false);
+        }
+        ostringstream data;
+        data << object.rdbuf();
+        contents[i] = data.str();
+    }
+
+    // The symbol index refers to the offsets of the members, which
+    // come after it, so find its size first.
+    size_t num_symbols = 0, names_size = 0;
+    for (size_t i = 0; i < members.size(); i++) {
+        for (size_t j = 0; j < members[i].symbols.size(); j++) {
+            num_symbols++;
+            names_size += members[i].symbols[j].size() + 1;
+        }
+    }
+    if (bsd) {
+        names_size = (names_size + 3) & ~(size_t)3;
+    }
+    size_t index_size = bsd ? 4 + 8 * num_symbols + 4 + names_size : 4 + 4 * num_symbols + names_size;
+
+    vector<uint32_t> offsets(members.size());
+    size_t offset = 8 + header_size + padded(index_size);
+    for (size_t i = 0; i < members.size(); i++) {
+        offsets[i] = (uint32_t)offset;
+        offset += header_size + padded(contents[i].size());
+    }
+
+    string index, names;
+    if (bsd) {
+        // A table of (name offset, member offset) pairs, then the names.
+        put_u32(index, (uint32_t)(8 * num_symbols), false);
+        for (size_t i = 0; i < members.size(); i++) {
+            for (size_t j = 0; j < members[i].symbols.size(); j++) {
+                put_u32(index, (uint32_t)names.size(), false);
+                put_u32(index, offsets[i], false);
+                names += members[i].symbols[j];
+                names += '\0';
+            }
+        }
+        names.resize(names_size, '\0');
+        put_u32(index, (uint32_t)names_size, false);
+    } else {
+        // The count and the member offsets, big-endian, then the names.
+        put_u32(index, (uint32_t)num_symbols, true);
+        for (size_t i = 0; i < members.size(); i++) {
+            for (size_t j = 0; j < members[i].symbols.size(); j++) {
+                put_u32(index, offsets[i], true);
+                names += members[i].symbols[j];
+                names += '\0';
+            }
+        }
+    }
+    index += names;
+    assert(index.size() == index_size);
+
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    if (!out) {
+        std::cerr << "Could not open " << filename << " to write a static library\n";
+        assert(false);
+    }
+    out << "!<arch>\n";
+    out << member_header(bsd ? "__.SYMDEF" : "/", index_size) << index;
+    if (index_size & 1) out << '\n';
+    for (size_t i = 0; i < members.size(); i++) {
+        // Short names, so that no table of long names is needed.
+        string name = int_to_string((int)i) + ".o";
+        out << member_header(bsd ? name : name + "/", contents[i].size()) << contents[i];
+        if (contents[i].size() & 1) out << '\n';
+    }
+}
+
+}
+}
@@ -0,0 +1,32 @@
+#ifndef HALIDE_STATIC_LIBRARY_H
+#define HALIDE_STATIC_LIBRARY_H
+
+/** \file
+ * Defines a way to bundle object files into a static library
+ */
+
+#include <string>
+#include <vector>
+
+namespace Halide {
+namespace Internal {
+
+/** An object file to put in a static library, and the symbols it
+ * defines that the linker should be able to find it by. */
+struct LibraryMember {
+    std::string filename;
+    std::vector<std::string> symbols;
+};
+
+/** Write a static library (an ar archive) containing the given
+ * object files, with an index of their symbols. The index is in the
+ * BSD format read by the OS X linker if bsd is true, and in the GNU
+ * format otherwise. The symbols should already have any prefix the
+ * platform adds to C names (e.g. the underscore on OS X). */
+void write_static_library(const std::string &filename,
+                          const std::vector<LibraryMember> &members, bool bsd);
+
+}
+}
+
+#endif
@@ -17,7 +17,7 @@ StmtCompiler::StmtCompiler(Target target) {
     }
 
     // The awkward mapping from targets to code generators
-    if ((target.features & Target::CUDA) || (target.features & Target::OpenCL)) {
+    if (target.has_gpu_feature()) {
         if (target.arch == Target::X86) {
             contents = new CodeGen_GPU_Host<CodeGen_X86>(target);
         }
@@ -50,8 +50,8 @@ void StmtCompiler::compile_to_native(const string &filename, bool assembly) {
     contents.ptr->compile_to_native(filename, assembly);
 }
 
-JITCompiledModule StmtCompiler::compile_to_function_pointers() {
-    return contents.ptr->compile_to_function_pointers();
+JITCompiledModule StmtCompiler::compile_to_function_pointers(const string &cache_key) {
+    return contents.ptr->compile_to_function_pointers(cache_key);
 }
 
 }
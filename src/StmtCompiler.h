@@ -53,8 +53,12 @@ public:
      * Also returns various other useful functions within the module,
      * such as a hook for setting the function to call when an assert
      * fails.
+     *
+     * If a key from jit_cache_key is given, and a jit cache directory
+     * is set (see set_jit_cache_directory), the machine code is read
+     * from the cache directory if it's there, and saved there if not.
      */
-    JITCompiledModule compile_to_function_pointers();
+    JITCompiledModule compile_to_function_pointers(const std::string &cache_key = "");
 };
 
 }
@@ -4,6 +4,7 @@
 #include "IRMutator.h"
 #include "IROperator.h"
 #include "Scope.h"
+#include "IREquality.h"
 
 namespace Halide {
 namespace Internal {
@@ -15,12 +16,94 @@ using std::map;
 
 class FlattenDimensions : public IRMutator {
 public:
-    FlattenDimensions(const map<string, Function> &e) : env(e) {}
+    FlattenDimensions(const map<string, Function> &e, const Target &t) :
+        env(e), large_buffers(t.features & Target::LargeBuffers) {
+        // Find the loops of the update steps that are to be done
+        // atomically.
+        for (map<string, Function>::const_iterator iter = env.begin();
+             iter != env.end(); ++iter) {
+            const vector<ReductionDefinition> &reductions = iter->second.reductions();
+            for (size_t i = 0; i < reductions.size(); i++) {
+                if (reductions[i].schedule.atomic) {
+                    string prefix = iter->first + ".s" + int_to_string(i+1) + ".";
+                    atomic_stages[prefix] = iter->first;
+                }
+            }
+        }
+    }
     Scope<int> scope;
     Scope<int> need_buffer_t;
 private:
     const map<string, Function> &env;
 
+    // Whether the inputs and outputs may have more than 2^31 elements.
+    bool large_buffers;
+
+    // The functions whose realizations we're inside. The rest of the
+    // buffers are inputs and outputs.
+    Scope<int> realizations;
+
+    // The loop name prefixes of atomic update steps, and the
+    // functions they belong to.
+    map<string, string> atomic_stages;
+
+    // The functions whose atomic update steps we're currently inside.
+    Scope<int> in_atomic_stage;
+
+    // The realizations of Tuple-valued functions whose values are
+    // interleaved in one buffer, and how many values they have.
+    Scope<int> interleaved;
+
+    // Value i of an interleaved function is at offset i of each site
+    // of its buffer, which is named after the function.
+    string element_buffer(const string &func_name, int value_index, Expr &idx) {
+        if (interleaved.contains(func_name)) {
+            idx += value_index;
+            return func_name;
+        }
+        return func_name + "." + int_to_string(value_index);
+    }
+
+    // Rewrite a store of an atomic update step, f(args) = f(args) + e,
+    // as an atomic add of e to f(args).
+    Stmt make_atomic_store(const Provide *provide) {
+        assert(provide->values.size() == 1 &&
+               "Atomic updates of Funcs with multiple values are not supported");
+        Expr value = provide->values[0];
+        assert(value.type().bits == value.type().bytes() * 8 &&
+               "Atomic updates of Funcs of type bool are not supported");
+
+        Expr self, e;
+        const Add *add = value.as<Add>();
+        if (add) {
+            const Call *a = add->a.as<Call>();
+            const Call *b = add->b.as<Call>();
+            if (a && a->name == provide->name && a->args.size() == provide->args.size()) {
+                self = add->a;
+                e = add->b;
+            } else if (b && b->name == provide->name && b->args.size() == provide->args.size()) {
+                self = add->b;
+                e = add->a;
+            }
+        }
+        if (self.defined()) {
+            const Call *c = self.as<Call>();
+            for (size_t i = 0; i < c->args.size(); i++) {
+                if (!equal(c->args[i], provide->args[i])) {
+                    self = Expr();
+                }
+            }
+        }
+        assert(self.defined() &&
+               "An atomic update must be of the form f(args) = f(args) + e");
+
+        Expr load = mutate(self);
+        assert(load.as<Load>());
+        Expr atomic_add = Call::make(value.type(), Call::atomic_add,
+                                     vec(load, mutate(e)), Call::Intrinsic);
+        return Evaluate::make(atomic_add);
+    }
+
     Expr flatten_args(const string &name, const vector<Expr> &args) {
         Expr idx = 0;
         vector<Expr> mins(args.size()), strides(args.size());
@@ -41,7 +124,21 @@ private:
             mins[i] = Variable::make(Int(32), min_name);
         }
 
-        if (env.find(name) != env.end()) {
+        if (large_buffers && args.size() > 1 &&
+            !realizations.contains(name.substr(0, name.find('.')))) {
+            // The index of an input or output that may be larger
+            // than 2^31 elements is split in two: the innermost
+            // dimension in 32 bits, which is all that changes inside
+            // a vectorized loop, plus the rest in 64 bits. Codegen
+            // adds the 64-bit part to the host pointer, and indexes
+            // from there with the 32-bit part.
+            Expr inner = (args[0] - mins[0]) * strides[0];
+            Expr outer = Cast::make(Int(64), args[1] - mins[1]) * Cast::make(Int(64), strides[1]);
+            for (size_t i = 2; i < args.size(); i++) {
+                outer += Cast::make(Int(64), args[i] - mins[i]) * Cast::make(Int(64), strides[i]);
+            }
+            return Cast::make(Int(64), inner) + outer;
+        } else if (env.find(name) != env.end()) {
             // f(x, y) -> f[(x-xmin)*xstride + (y-ymin)*ystride] This
             // strategy makes sense when we expect x to cancel with
             // something in xmin.  We use this for internal allocations
@@ -68,7 +165,28 @@ private:
     using IRMutator::visit;
 
     void visit(const Realize *realize) {
+        map<string, Function>::const_iterator iter = env.find(realize->name);
+        assert(iter != env.end() && "Realize node refers to function not in environment");
+        const Schedule &schedule = iter->second.schedule();
+        int values = (int)realize->types.size();
+        bool interleave = schedule.interleave_tuple && values > 1;
+
+        if (interleave) {
+            for (int i = 1; i < values; i++) {
+                if (realize->types[i] != realize->types[0]) {
+                    std::cerr << "Can't interleave the values of " << realize->name
+                              << " because they don't all have the same type\n";
+                    assert(false);
+                }
+            }
+            interleaved.push(realize->name, values);
+        }
+        realizations.push(realize->name, 0);
         Stmt body = mutate(realize->body);
+        realizations.pop(realize->name);
+        if (interleave) {
+            interleaved.pop(realize->name);
+        }
 
         // Check if we need to create a buffer_t for this realization
         vector<bool> make_buffer_t(realize->types.size());
@@ -87,11 +205,19 @@ private:
         }
 
         vector<int> storage_permutation;
+        vector<int> alignment(realize->bounds.size(), 1), padding(realize->bounds.size(), 0);
         {
-            map<string, Function>::const_iterator iter = env.find(realize->name);
-            assert(iter != env.end() && "Realize node refers to function not in environment");
-            const vector<string> &storage_dims = iter->second.schedule().storage_dims;
+            const vector<string> &storage_dims = schedule.storage_dims;
             const vector<string> &args = iter->second.args();
+            const vector<Schedule::StoragePadding> &storage_padding = schedule.storage_padding;
+            for (size_t i = 0; i < storage_padding.size(); i++) {
+                for (size_t j = 0; j < args.size(); j++) {
+                    if (args[j] == storage_padding[i].var) {
+                        alignment[j] = storage_padding[i].alignment;
+                        padding[j] = storage_padding[i].padding;
+                    }
+                }
+            }
             for (size_t i = 0; i < storage_dims.size(); i++) {
                 for (size_t j = 0; j < args.size(); j++) {
                     if (args[j] == storage_dims[i]) {
@@ -104,7 +230,56 @@ private:
 
         assert(storage_permutation.size() == realize->bounds.size());
 
+        // Promote the types to be a multiple of 8 bits
+        vector<Type> types(realize->types);
+        for (size_t i = 0; i < types.size(); i++) {
+            types[i].bits = types[i].bytes() * 8;
+        }
+
+        // Round up and pad the extents of the storage as asked for by
+        // align_storage and pad_storage.
+        vector<Expr> storage_extents(extents);
+        for (size_t i = 0; i < extents.size(); i++) {
+            if (alignment[i] > 1) {
+                int a = alignment[i];
+                storage_extents[i] = ((storage_extents[i] + (a - 1)) / a) * a;
+            }
+            if (padding[i] > 0) {
+                storage_extents[i] += padding[i];
+            }
+        }
+
         stmt = body;
+
+        if (interleave) {
+            // The buffer_ts of the values point into the one
+            // allocation, so they go inside it.
+            for (int idx = 0; idx < values; idx++) {
+                if (make_buffer_t[idx]) {
+                    string buffer_name = realize->name + '.' + int_to_string(idx);
+                    int dims = realize->bounds.size();
+                    vector<Expr> args(dims*3 + 2);
+                    Expr first = Load::make(types[idx], realize->name, idx, Buffer(), Parameter());
+                    args[0] = Call::make(Handle(), Call::address_of, vec(first), Call::Intrinsic);
+                    args[1] = types[idx].bytes();
+                    for (int i = 0; i < dims; i++) {
+                        string d = int_to_string(i);
+                        args[3*i+2] = Variable::make(Int(32), buffer_name + ".min." + d);
+                        args[3*i+3] = Variable::make(Int(32), buffer_name + ".extent." + d);
+                        args[3*i+4] = Variable::make(Int(32), buffer_name + ".stride." + d);
+                    }
+                    Expr buf = Call::make(Handle(), Call::create_buffer_t,
+                                          args, Call::Intrinsic);
+                    stmt = LetStmt::make(buffer_name + ".buffer", buf, stmt);
+                }
+            }
+
+            vector<Expr> interleaved_extents(1, values);
+            interleaved_extents.insert(interleaved_extents.end(),
+                                       storage_extents.begin(), storage_extents.end());
+            stmt = Allocate::make(realize->name, types[0], interleaved_extents, stmt);
+        }
+
         for (size_t idx = 0; idx < realize->types.size(); idx++) {
             string buffer_name = realize->name;
             if (realize->types.size() > 1) {
@@ -127,7 +302,7 @@ private:
                 stride_var[i] = Variable::make(Int(32), stride_name[i]);
             }
 
-            if (make_buffer_t[idx]) {
+            if (make_buffer_t[idx] && !interleave) {
                 // We need to make a buffer_t for this buffer
                 vector<Expr> args(dims*3 + 2);
                 args[0] = Variable::make(Handle(), buffer_name);
@@ -144,24 +319,34 @@ private:
                                      stmt);
             }
 
-            // Promote the type to be a multiple of 8 bits
-            Type t = realize->types[idx];
-            t.bits = t.bytes() * 8;
+            vector<Expr> storage_extent_var(extent_var);
+            for (int i = 0; i < dims; i++) {
+                if (alignment[i] > 1) {
+                    int a = alignment[i];
+                    storage_extent_var[i] = ((storage_extent_var[i] + (a - 1)) / a) * a;
+                }
+                if (padding[i] > 0) {
+                    storage_extent_var[i] += padding[i];
+                }
+            }
 
             // Make the allocation node
-            stmt = Allocate::make(buffer_name, t, extents, stmt);
+            if (!interleave) {
+                stmt = Allocate::make(buffer_name, types[idx], storage_extents, stmt);
+            }
 
             // Compute the strides
             for (int i = (int)realize->bounds.size()-1; i > 0; i--) {
                 int prev_j = storage_permutation[i-1];
                 int j = storage_permutation[i];
-                Expr stride = stride_var[prev_j] * extent_var[prev_j];
+                Expr stride = stride_var[prev_j] * storage_extent_var[prev_j];
                 stmt = LetStmt::make(stride_name[j], stride, stmt);
             }
-            // Innermost stride is one
+            // Innermost stride is one, or the number of values if
+            // they're interleaved
             if (dims > 0) {
                 int innermost = storage_permutation.empty() ? 0 : storage_permutation[0];
-                stmt = LetStmt::make(stride_name[innermost], 1, stmt);
+                stmt = LetStmt::make(stride_name[innermost], interleave ? values : 1, stmt);
             }
 
             // Assign the mins and extents stored
@@ -172,8 +357,30 @@ private:
         }
     }
 
+    void visit(const For *op) {
+        vector<string> entered;
+        for (map<string, string>::const_iterator iter = atomic_stages.begin();
+             iter != atomic_stages.end(); ++iter) {
+            if (starts_with(op->name, iter->first)) {
+                in_atomic_stage.push(iter->second, 0);
+                entered.push_back(iter->second);
+            }
+        }
+
+        IRMutator::visit(op);
+
+        for (size_t i = 0; i < entered.size(); i++) {
+            in_atomic_stage.pop(entered[i]);
+        }
+    }
+
     void visit(const Provide *provide) {
 
+        if (in_atomic_stage.contains(provide->name)) {
+            stmt = make_atomic_store(provide);
+            return;
+        }
+
         vector<Expr> values(provide->values.size());
         for (size_t i = 0; i < values.size(); i++) {
             values[i] = mutate(provide->values[i]);
@@ -200,7 +407,8 @@ private:
                 Expr idx = mutate(flatten_args(name, provide->args));
                 names[i] = name + ".value";
                 Expr var = Variable::make(values[i].type(), names[i]);
-                Stmt store = Store::make(name, var, idx);
+                string buffer = element_buffer(provide->name, i, idx);
+                Stmt store = Store::make(buffer, var, idx);
                 if (result.defined()) {
                     result = Block::make(result, store);
                 } else {
@@ -232,19 +440,22 @@ private:
                 expr = Call::make(call->type, call->name, args, call->call_type);
             }
         } else {
-            string name = call->name;
+            string name = call->name, buffer = call->name;
+            Expr idx;
             if (call->call_type == Call::Halide &&
                 call->func.outputs() > 1) {
                 name = name + '.' + int_to_string(call->value_index);
-
+                idx = mutate(flatten_args(name, call->args));
+                buffer = element_buffer(call->name, call->value_index, idx);
+            } else {
+                idx = mutate(flatten_args(name, call->args));
             }
 
             // Promote the type to be a multiple of 8 bits
             Type t = call->type;
             t.bits = t.bytes() * 8;
 
-            Expr idx = mutate(flatten_args(name, call->args));
-            expr = Load::make(t, name, idx, call->image, call->param);
+            expr = Load::make(t, buffer, idx, call->image, call->param);
 
             if (call->type.bits != t.bits) {
                 expr = Cast::make(call->type, expr);
@@ -267,8 +478,8 @@ private:
     }
 };
 
-Stmt storage_flattening(Stmt s, const map<string, Function> &env) {
-    return FlattenDimensions(env).mutate(s);
+Stmt storage_flattening(Stmt s, const map<string, Function> &env, const Target &t) {
+    return FlattenDimensions(env, t).mutate(s);
 }
 
 }
@@ -9,14 +9,17 @@
 #include <map>
 
 #include "IR.h"
+#include "Target.h"
 
 namespace Halide {
 namespace Internal {
 
 /** Take a statement with multi-dimensional Realize, Provide, and Call
  * nodes, and turn it into a statement with single-dimensional
- * Allocate, Store, and Load nodes respectively. */
-Stmt storage_flattening(Stmt s, const std::map<std::string, Function> &env);
+ * Allocate, Store, and Load nodes respectively. If the target has the
+ * LargeBuffers feature, the indices of the inputs and outputs are 64
+ * bits, as a 32-bit index cast to 64 bits plus a 64-bit offset. */
+Stmt storage_flattening(Stmt s, const std::map<std::string, Function> &env, const Target &t);
 
 }
 }
@@ -6,6 +6,10 @@
 #include "IRPrinter.h"
 #include "Debug.h"
 #include "Derivative.h"
+#include "Substitute.h"
+
+#include <algorithm>
+#include <set>
 
 namespace Halide {
 namespace Internal {
@@ -13,6 +17,9 @@ namespace Internal {
 using std::string;
 using std::vector;
 using std::map;
+using std::pair;
+using std::make_pair;
+using std::set;
 
 // Fold the storage of a function in a particular dimension by a particular factor
 class FoldStorageOfFunction : public IRMutator {
@@ -51,9 +58,115 @@ public:
         func(f), dim(d), factor(e) {}
 };
 
+// The number of iterations an async producer may run ahead of its
+// consumer is capped at this.
+const int max_async_lead = 8;
+
+Expr semaphore_call(const string &fn, Expr arg) {
+    return Call::make(Int(32), fn, vec(arg), Call::Extern);
+}
+
+// Make a call on any early return from here on, or run it now and
+// stop doing so (see Call::cleanup_on_exit).
+Stmt on_early_exit(Expr call) {
+    return Evaluate::make(Call::make(Int(32), Call::cleanup_on_exit, vec(call), Call::Intrinsic));
+}
+
+Stmt run_cleanup(Expr call) {
+    return Evaluate::make(Call::make(Int(32), Call::run_cleanup, vec(call), Call::Intrinsic));
+}
+
+// Is the body of a loop the pipeline of the given function, after
+// some let statements?
+bool loop_body_is_pipeline(const For *loop, const string &func) {
+    Stmt body = loop->body;
+    while (const LetStmt *l = body.as<LetStmt>()) {
+        body = l->body;
+    }
+    const Pipeline *pipeline = body.as<Pipeline>();
+    return pipeline && pipeline->name == func;
+}
+
+// Split a serial loop whose body is the pipeline of a folded function
+// into two loops run as parallel tasks: one computing the function,
+// and one consuming it. A pair of semaphores keep the producer at most
+// 'lead' iterations ahead. The producer is task zero, so that it's
+// always claimed first. A task that fails abandons both semaphores,
+// and once an acquire fails the other task skips the rest of its
+// iterations, so the failure is returned rather than waited on
+// forever.
+Stmt pipeline_producer(const For *loop, const string &func, int lead) {
+    Stmt body = loop->body;
+    vector<pair<string, Expr> > lets;
+    while (const LetStmt *l = body.as<LetStmt>()) {
+        lets.push_back(make_pair(l->name, l->value));
+        body = l->body;
+    }
+    const Pipeline *pipeline = body.as<Pipeline>();
+    assert(pipeline && pipeline->name == func);
+
+    Expr ready = Variable::make(Handle(), func + ".ready_semaphore");
+    Expr space = Variable::make(Handle(), func + ".space_semaphore");
+
+    Stmt produce = pipeline->produce;
+    if (pipeline->update.defined()) {
+        produce = Block::make(produce, pipeline->update);
+    }
+    produce = Block::make(produce, Evaluate::make(semaphore_call("halide_semaphore_release", ready)));
+    produce = IfThenElse::make(semaphore_call("halide_semaphore_acquire", space) == 0, produce);
+
+    Stmt consume = pipeline->consume;
+    consume = Block::make(consume, Evaluate::make(semaphore_call("halide_semaphore_release", space)));
+    consume = IfThenElse::make(semaphore_call("halide_semaphore_acquire", ready) == 0, consume);
+
+    // Both loops need the bounds computed at the top of the loop body.
+    for (size_t i = lets.size(); i > 0; i--) {
+        produce = LetStmt::make(lets[i-1].first, lets[i-1].second, produce);
+        consume = LetStmt::make(lets[i-1].first, lets[i-1].second, consume);
+    }
+    produce = For::make(loop->name, loop->min, loop->extent, For::Serial, produce);
+    consume = For::make(loop->name, loop->min, loop->extent, For::Serial, consume);
+
+    string task_var = func + ".pipeline_task";
+    Stmt tasks = IfThenElse::make(Variable::make(Int(32), task_var) == 0, produce, consume);
+    tasks = Block::make(on_early_exit(semaphore_call("halide_semaphore_abandon", ready)),
+                        Block::make(on_early_exit(semaphore_call("halide_semaphore_abandon", space)),
+                                    tasks));
+    tasks = For::make(task_var, 0, 2, For::Parallel, tasks);
+
+    // The two tasks wait on each other, so they need a worker thread
+    // besides this one that no other pipeline has been promised. If
+    // there isn't one, or the semaphores can't be made, fall back to
+    // computing the function in lockstep with its consumer.
+    string reserved_name = func + ".reserved_worker";
+    Expr reserved = Variable::make(Int(32), reserved_name);
+    Expr made = (reinterpret(UInt(64), ready) != make_zero(UInt(64)) &&
+                 reinterpret(UInt(64), space) != make_zero(UInt(64)));
+    Stmt s = IfThenElse::make(reserved != 0 && made, tasks, loop);
+
+    // Free the semaphores and the worker however the tasks end.
+    Expr free_ready = semaphore_call("halide_free_semaphore", ready);
+    Expr free_space = semaphore_call("halide_free_semaphore", space);
+    Expr release = semaphore_call("halide_release_worker", reserved);
+    s = Block::make(on_early_exit(free_ready),
+                    Block::make(on_early_exit(free_space),
+                                Block::make(s,
+                                            Block::make(run_cleanup(free_space), run_cleanup(free_ready)))));
+    Expr make_ready = Call::make(Handle(), "halide_make_semaphore", vec<Expr>(0), Call::Extern);
+    Expr make_space = Call::make(Handle(), "halide_make_semaphore", vec<Expr>(lead + 1), Call::Extern);
+    s = LetStmt::make(func + ".space_semaphore", make_space, s);
+    s = LetStmt::make(func + ".ready_semaphore", make_ready, s);
+    s = Block::make(on_early_exit(release), Block::make(s, run_cleanup(release)));
+    Expr reserve = Call::make(Int(32), "halide_reserve_worker", vector<Expr>(), Call::Extern);
+    return LetStmt::make(reserved_name, reserve, s);
+}
+
 // Attempt to fold the storage of a particular function in a statement
 class AttemptStorageFoldingOfFunction : public IRMutator {
     string func;
+    bool async;
+    // Dimensions already folded by a factor from the schedule.
+    const set<int> &skip;
 
     using IRMutator::visit;
 
@@ -84,6 +197,8 @@ class AttemptStorageFoldingOfFunction : public IRMutator {
 
         // Try each dimension in turn from outermost in
         for (size_t i = box.size(); i > 0; i--) {
+            if (skip.count((int)i - 1)) continue;
+
             Expr min = box[i-1].min;
             Expr max = box[i-1].max;
 
@@ -111,12 +226,54 @@ class AttemptStorageFoldingOfFunction : public IRMutator {
                     int extent = max_extent_int->value;
                     debug(3) << "Proceeding...\n";
 
+                    // An async producer runs ahead of its consumer,
+                    // so the buffer must also hold the rows it
+                    // computes in the meantime. That's at most the
+                    // distance the region moves per iteration for
+                    // each iteration of lead.
+                    int step = -1;
+                    if (async && op->for_type == For::Serial &&
+                        loop_body_is_pipeline(op, func)) {
+                        Expr next = Variable::make(Int(32), op->name) + 1;
+                        Expr delta;
+                        if (is_monotonic(min, op->name) == MonotonicIncreasing) {
+                            delta = substitute(op->name, next, min) - min;
+                        } else {
+                            delta = max - substitute(op->name, next, max);
+                        }
+                        scope.push(op->name, Interval(Variable::make(Int(32), op->name + ".loop_min"),
+                                                      Variable::make(Int(32), op->name + ".loop_max")));
+                        Expr max_delta = simplify(bounds_of_expr_in_scope(simplify(delta), scope).max);
+                        scope.pop(op->name);
+                        const IntImm *max_delta_int = max_delta.as<IntImm>();
+                        if (max_delta_int && max_delta_int->value >= 0) {
+                            step = max_delta_int->value;
+                        } else {
+                            debug(3) << "Not running " << func << " ahead of its consumer because "
+                                     << "the distance its region moves per iteration isn't bounded by a constant\n";
+                        }
+                    }
+
                     int factor = 1;
-                    while (factor <= extent) factor *= 2;
+                    while (factor <= extent + (step > 0 ? step : 0)) factor *= 2;
 
                     dim_folded = (int)i - 1;
                     fold_factor = factor;
                     stmt = FoldStorageOfFunction(func, (int)i - 1, factor).mutate(result);
+
+                    if (step >= 0) {
+                        // Use up whatever slack the power of two
+                        // rounding left to run further ahead.
+                        int lead = max_async_lead;
+                        if (step > 0) {
+                            lead = std::min(lead, (factor - 1 - extent) / step);
+                        }
+                        const For *folded = stmt.as<For>();
+                        assert(folded);
+                        debug(3) << "Running " << func << " up to " << lead
+                                 << " iterations ahead of its consumer\n";
+                        stmt = pipeline_producer(folded, func, lead);
+                    }
                     return;
                 } else {
                     debug(3) << "Not folding because extent not bounded by a constant\n"
@@ -137,9 +294,122 @@ class AttemptStorageFoldingOfFunction : public IRMutator {
 public:
     int dim_folded;
     Expr fold_factor;
-    AttemptStorageFoldingOfFunction(string f) : func(f), dim_folded(-1) {}
+    AttemptStorageFoldingOfFunction(string f, bool a, const set<int> &s) :
+        func(f), async(a), skip(s), dim_folded(-1) {}
+};
+
+// The runtime checks that folding a dimension of a function by a
+// factor from the schedule is safe over a loop: the region of the
+// function used in each iteration fits in the factor, and it only
+// moves one way, so that nothing still needed is overwritten.
+Stmt fold_checks(const For *op, const string &func, const string &dim,
+                 Expr min, Expr max, Expr factor) {
+    bool down = (is_monotonic(max, op->name) == MonotonicDecreasing &&
+                 is_monotonic(min, op->name) != MonotonicIncreasing);
+    Expr var = Variable::make(Int(32), op->name);
+    Expr moved;
+    if (down) {
+        moved = max <= substitute(op->name, var - 1, max);
+    } else {
+        moved = min >= substitute(op->name, var - 1, min);
+    }
+    string what = "The storage of " + func + " is folded in " + dim;
+    Stmt fits = AssertStmt::make(max - min < factor,
+                                 what + " by a factor of %d, but %d coordinates of it"
+                                 " are used at once in the loop over " + op->name,
+                                 vec(factor, max - min + 1));
+    Stmt one_way = AssertStmt::make(var == op->min || moved,
+                                    what + ", but the region of it used in the loop over " +
+                                    op->name + " moves " + (down ? "up" : "down"),
+                                    vector<Expr>());
+    return Block::make(fits, one_way);
+}
+
+// Put the checks of a fold from the schedule at the top of the
+// outermost loops inside the realization, looking through the lets,
+// blocks and pipelines of other functions around them, as
+// AttemptStorageFoldingOfFunction does. Folding over an outermost
+// loop is safe even if the function is used by inner loops too,
+// because everything used in one iteration of it fits. Fails if the
+// function is used outside of those loops, or one of them that uses
+// it isn't serial.
+class InjectFoldChecks : public IRMutator {
+    const string &func;
+    int d;
+    const string &dim;
+    Expr factor;
+
+    using IRMutator::visit;
+
+    void visit(const Pipeline *op) {
+        if (op->name == func) {
+            // Produced outside of any loop.
+            failed = true;
+            stmt = op;
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const Provide *op) {
+        if (op->name == func) failed = true;
+        IRMutator::visit(op);
+    }
+
+    void visit(const Call *op) {
+        if (op->call_type == Call::Halide && op->name == func) failed = true;
+        IRMutator::visit(op);
+    }
+
+    void visit(const For *op) {
+        stmt = op;
+        Box box = box_touched(op->body, func);
+        if (box.empty()) return;
+        if ((op->for_type != For::Serial && op->for_type != For::Unrolled) ||
+            (int)box.size() <= d || !box[d].min.defined() || !box[d].max.defined()) {
+            failed = true;
+            return;
+        }
+        Stmt checks = fold_checks(op, func, dim, box[d].min, box[d].max, factor);
+        stmt = For::make(op->name, op->min, op->extent, op->for_type, Block::make(checks, op->body));
+        injected = true;
+    }
+
+public:
+    bool injected, failed;
+    InjectFoldChecks(const string &f, int i, const string &v, Expr k) :
+        func(f), d(i), dim(v), factor(k), injected(false), failed(false) {}
 };
 
+// Returns an undefined Stmt if the checks can't be put in loops.
+Stmt inject_fold_checks(Stmt s, const string &func, int d, const string &dim, Expr factor) {
+    InjectFoldChecks injector(func, d, dim, factor);
+    Stmt result = injector.mutate(s);
+    if (!injector.injected || injector.failed) return Stmt();
+    return result;
+}
+
+// Fold a dimension of a function by a factor from the schedule, with
+// runtime checks that it's safe.
+Stmt fold_explicitly(Stmt s, const string &func, int d, const string &dim, Expr factor) {
+    Stmt checked = inject_fold_checks(s, func, d, dim, factor);
+    if (!checked.defined()) {
+        // The region used doesn't move over a loop, so all of it
+        // must fit.
+        Box box = box_touched(s, func);
+        assert((int)box.size() > d && box[d].min.defined() && box[d].max.defined() &&
+               "The region of a function with folded storage must be bounded");
+        Expr min = box[d].min, max = box[d].max;
+        Stmt fits = AssertStmt::make(max - min < factor,
+                                     "The storage of " + func + " is folded in " + dim +
+                                     " by a factor of %d, but %d coordinates of it are used at once",
+                                     vec(factor, max - min + 1));
+        checked = Block::make(fits, s);
+    }
+    debug(3) << "Folding " << func << " in " << dim << " by " << factor << " from the schedule\n";
+    return FoldStorageOfFunction(func, d, factor).mutate(checked);
+}
+
 /** Check if a buffer's allocated is referred to directly via an
  * intrinsic. If so we should leave it alone. (e.g. it may be used
  * extern). */
@@ -163,46 +433,82 @@ private:
 
 // Look for opportunities for storage folding in a statement
 class StorageFolding : public IRMutator {
+    const map<string, Function> &env;
+
+    // Producers aren't run ahead of their consumers inside parallel
+    // loops. The tasks there could be holding every thread while
+    // their partners wait to be run.
+    int parallel_depth;
+
     using IRMutator::visit;
 
+    void visit(const For *op) {
+        bool parallel = (op->for_type == For::Parallel);
+        if (parallel) parallel_depth++;
+        IRMutator::visit(op);
+        if (parallel) parallel_depth--;
+    }
+
     void visit(const Realize *op) {
         Stmt body = mutate(op->body);
 
-        AttemptStorageFoldingOfFunction folder(op->name);
+        // Only pure functions are run ahead. Without a sliding window
+        // a producer recomputes some of the values its consumer is
+        // reading. That's harmless when the values written are the
+        // same, but not when an update step is halfway through them.
+        map<string, Function>::const_iterator iter = env.find(op->name);
+        bool async = (parallel_depth == 0 &&
+                      iter != env.end() &&
+                      iter->second.schedule().async &&
+                      iter->second.is_pure());
+
         IsBufferSpecial special(op->name);
         op->accept(&special);
 
         if (special.special) {
             debug(3) << "Not attempting to fold " << op->name << " because it is referenced by an intrinsic\n";
-            if (body.same_as(op->body)) {
-                stmt = op;
-            } else {
-                stmt = Realize::make(op->name, op->types, op->bounds, body);
-            }
-        } else {
-            debug(3) << "Attempting to fold " << op->name << "\n";
-            Stmt new_body = folder.mutate(body);
+            stmt = rebuild(op, op->bounds, body);
+            return;
+        }
 
-            if (new_body.same_as(op->body)) {
-                stmt = op;
-            } else if (new_body.same_as(body)) {
-                stmt = Realize::make(op->name, op->types, op->bounds, body);
-            } else {
-                Region bounds = op->bounds;
+        Region bounds = op->bounds;
+
+        // First fold the dimensions the schedule gives factors for.
+        set<int> folded;
+        if (iter != env.end()) {
+            const Function &f = iter->second;
+            const vector<Schedule::StorageFold> &folds = f.schedule().storage_folds;
+            for (size_t i = 0; i < folds.size(); i++) {
+                for (size_t j = 0; j < f.args().size(); j++) {
+                    if (f.args()[j] == folds[i].var) {
+                        body = fold_explicitly(body, op->name, (int)j, folds[i].var, folds[i].factor);
+                        bounds[j] = Range(0, folds[i].factor);
+                        folded.insert((int)j);
+                    }
+                }
+            }
+        }
 
-                assert(folder.dim_folded >= 0 &&
-                       folder.dim_folded < (int)bounds.size());
+        debug(3) << "Attempting to fold " << op->name << "\n";
+        AttemptStorageFoldingOfFunction folder(op->name, async, folded);
+        Stmt new_body = folder.mutate(body);
 
-                bounds[folder.dim_folded] = Range(0, folder.fold_factor);
+        if (!new_body.same_as(body)) {
+            assert(folder.dim_folded >= 0 &&
+                   folder.dim_folded < (int)bounds.size());
 
-                stmt = Realize::make(op->name, op->types, bounds, new_body);
-            }
+            bounds[folder.dim_folded] = Range(0, folder.fold_factor);
         }
+
+        stmt = rebuild(op, bounds, new_body);
     }
+
+public:
+    StorageFolding(const map<string, Function> &e) : env(e), parallel_depth(0) {}
 };
 
-Stmt storage_folding(Stmt s) {
-    return StorageFolding().mutate(s);
+Stmt storage_folding(Stmt s, const map<string, Function> &env) {
+    return StorageFolding(env).mutate(s);
 }
 
 }
@@ -7,6 +7,9 @@
  */
 
 #include "IR.h"
+#include "Function.h"
+
+#include <map>
 
 namespace Halide {
 namespace Internal {
@@ -23,8 +26,18 @@ namespace Internal {
  *
  * We can store f as a circular buffer of size two, instead of
  * allocating space for all of it.
+ *
+ * If f is also scheduled async (and isn't inside a parallel loop),
+ * the buffer is made large enough for f to run some iterations ahead
+ * of g, and the two are computed as concurrent tasks that wait on a
+ * pair of semaphores.
+ *
+ * Dimensions given a fold factor by Func::fold_storage are folded by
+ * it without any proof, along with runtime checks that the region
+ * used in each iteration of the outermost loop fits, and only moves
+ * one way.
  */
-Stmt storage_folding(Stmt s);
+Stmt storage_folding(Stmt s, const std::map<std::string, Function> &env);
 
 }
 }
@@ -0,0 +1,348 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "Tabulate.h"
+#include "Func.h"
+#include "IRMutator.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "Simplify.h"
+#include "Scope.h"
+#include "Debug.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::pair;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+// The largest table to make for a function that wasn't asked for.
+const int64_t kMaxAutoTableSize = 65536;
+
+// Find the first Param or ImageParam a function depends on, directly
+// or through the functions it calls. Those aren't known at compile
+// time.
+class FindParams : public IRVisitor {
+    set<string> visited;
+
+    using IRVisitor::visit;
+
+    void visit(const Variable *op) {
+        if (op->param.defined() && found.empty()) {
+            found = op->param.name();
+        }
+    }
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->param.defined() && found.empty()) {
+            found = op->param.name();
+        } else if (op->call_type == Call::Halide) {
+            include(op->func);
+        }
+    }
+
+    void include(const vector<Expr> &exprs) {
+        for (size_t i = 0; i < exprs.size(); i++) {
+            exprs[i].accept(this);
+        }
+    }
+
+public:
+    string found;
+
+    void include(Function f) {
+        if (visited.count(f.name())) return;
+        visited.insert(f.name());
+
+        include(f.values());
+        const vector<ReductionDefinition> &reductions = f.reductions();
+        for (size_t i = 0; i < reductions.size(); i++) {
+            include(reductions[i].args);
+            include(reductions[i].values);
+            if (reductions[i].domain.defined()) {
+                const vector<ReductionVariable> &domain = reductions[i].domain.domain();
+                for (size_t j = 0; j < domain.size(); j++) {
+                    domain[j].min.accept(this);
+                    domain[j].extent.accept(this);
+                }
+            }
+        }
+
+        const vector<ExternFuncArgument> &args = f.extern_arguments();
+        for (size_t i = 0; i < args.size(); i++) {
+            if (args[i].is_func()) {
+                include(Function(args[i].func));
+            } else if (args[i].is_expr()) {
+                args[i].expr.accept(this);
+            } else if (args[i].is_image_param() && found.empty()) {
+                found = args[i].image_param.name();
+            }
+        }
+    }
+};
+
+// Does an expression call a math library function (or another
+// extern function)?
+class CallsExtern : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        if (op->call_type == Call::Extern) {
+            result = true;
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool result;
+    CallsExtern() : result(false) {}
+};
+
+// Find the constant bounds of the arguments of every call to a
+// function, if they have them.
+class FindCallBounds : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &name;
+    const FuncValueBounds &func_bounds;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type != Call::Halide || op->name != name) {
+            return;
+        }
+        found = true;
+        for (size_t i = 0; i < op->args.size() && i < box.size(); i++) {
+            Interval in = bounds_of_expr_in_scope(op->args[i], Scope<Interval>(), func_bounds);
+            const int *lo = in.min.defined() ? as_const_int(simplify(in.min)) : NULL;
+            const int *hi = in.max.defined() ? as_const_int(simplify(in.max)) : NULL;
+            if (!lo || !hi) {
+                ok = false;
+                return;
+            }
+            box[i].first = std::min(box[i].first, *lo);
+            box[i].second = std::max(box[i].second, *hi);
+        }
+    }
+
+public:
+    bool ok, found;
+    vector<pair<int, int> > box;
+
+    FindCallBounds(const string &n, int dims, const FuncValueBounds &fb) :
+        name(n), func_bounds(fb), ok(true), found(false),
+        box(dims, std::make_pair(INT_MAX, INT_MIN)) {}
+
+    void include(const vector<Expr> &exprs) {
+        for (size_t i = 0; i < exprs.size() && ok; i++) {
+            exprs[i].accept(this);
+        }
+    }
+};
+
+bool is_output(const string &name, const vector<Function> &outputs) {
+    for (size_t i = 0; i < outputs.size(); i++) {
+        if (outputs[i].name() == name) return true;
+    }
+    return false;
+}
+
+// The domain to tabulate a function over, if it's worth it, found
+// from the calls to it.
+vector<Schedule::Bound> detect_table(Function f, const map<string, Function> &env,
+                                     const FuncValueBounds &func_bounds) {
+    vector<Schedule::Bound> domain;
+    if (!f.schedule().compute_level.is_inline() || !f.is_pure() || f.outputs() != 1) {
+        return domain;
+    }
+    CallsExtern calls_extern;
+    for (size_t i = 0; i < f.values().size(); i++) {
+        f.values()[i].accept(&calls_extern);
+    }
+    if (!calls_extern.result) {
+        return domain;
+    }
+
+    FindCallBounds bounds(f.name(), (int)f.args().size(), func_bounds);
+    for (map<string, Function>::const_iterator iter = env.begin();
+         iter != env.end() && bounds.ok; ++iter) {
+        Function g = iter->second;
+        bounds.include(g.values());
+        const vector<ReductionDefinition> &reductions = g.reductions();
+        for (size_t i = 0; i < reductions.size(); i++) {
+            bounds.include(reductions[i].args);
+            bounds.include(reductions[i].values);
+        }
+        const vector<ExternFuncArgument> &args = g.extern_arguments();
+        for (size_t i = 0; i < args.size(); i++) {
+            if (args[i].is_func() && Function(args[i].func).name() == f.name()) {
+                // The whole function is passed in.
+                bounds.ok = false;
+            }
+        }
+    }
+    if (!bounds.ok || !bounds.found) {
+        return domain;
+    }
+
+    int64_t size = 1;
+    for (size_t i = 0; i < bounds.box.size(); i++) {
+        size *= (int64_t)bounds.box[i].second - bounds.box[i].first + 1;
+        if (size > kMaxAutoTableSize) {
+            return vector<Schedule::Bound>();
+        }
+        Schedule::Bound b = {f.args()[i], bounds.box[i].first,
+                             bounds.box[i].second - bounds.box[i].first + 1};
+        domain.push_back(b);
+    }
+    return domain;
+}
+
+class UseTables : public IRMutator {
+    using IRMutator::visit;
+
+    const map<string, Buffer> &tables;
+
+    void visit(const Call *op) {
+        IRMutator::visit(op);
+        if (op->call_type != Call::Halide) return;
+        map<string, Buffer>::const_iterator iter = tables.find(op->name);
+        if (iter == tables.end()) return;
+        op = expr.as<Call>();
+        assert(op);
+        expr = Call::make(iter->second, op->args);
+    }
+
+public:
+    UseTables(const map<string, Buffer> &t) : tables(t) {}
+};
+
+// How many tables are being computed. The pipelines that compute them
+// don't make tables of their own.
+int computing_tables = 0;
+
+}
+
+map<string, Buffer> compute_tables(const vector<Function> &outputs,
+                                   const vector<string> &order,
+                                   const map<string, Function> &env,
+                                   const FuncValueBounds &func_bounds) {
+    map<string, Buffer> tables;
+    if (computing_tables > 0) {
+        return tables;
+    }
+    const char *auto_str = getenv("HL_AUTO_TABULATE");
+    bool auto_tabulate = auto_str && atoi(auto_str);
+
+    for (size_t i = 0; i < order.size(); i++) {
+        map<string, Function>::const_iterator iter = env.find(order[i]);
+        assert(iter != env.end());
+        Function f = iter->second;
+        vector<Schedule::Bound> domain = f.schedule().table_bounds;
+        bool requested = !domain.empty();
+        if (!requested && auto_tabulate && !is_output(f.name(), outputs)) {
+            domain = detect_table(f, env, func_bounds);
+        }
+        if (domain.empty()) {
+            continue;
+        }
+
+        if (is_output(f.name(), outputs)) {
+            std::cerr << "Can't tabulate " << f.name() << ", because it's an output of the pipeline\n";
+            assert(false);
+        }
+        if (!f.is_pure() || f.outputs() != 1) {
+            std::cerr << "Can't tabulate " << f.name()
+                      << ", because only functions with one value and no updates can be tabulated\n";
+            assert(false);
+        }
+        if (f.args().size() > 4) {
+            std::cerr << "Can't tabulate " << f.name() << ", because a table has at most four dimensions\n";
+            assert(false);
+        }
+        FindParams params;
+        params.include(f);
+        if (!params.found.empty()) {
+            if (!requested) continue;
+            std::cerr << "Can't tabulate " << f.name() << ", because it depends on "
+                      << params.found << ", which isn't known at compile time\n";
+            assert(false);
+        }
+
+        // The domain, in the order of the arguments.
+        vector<int32_t> mins, extents;
+        for (size_t j = 0; j < f.args().size(); j++) {
+            const Schedule::Bound *b = NULL;
+            for (size_t k = 0; k < domain.size(); k++) {
+                if (domain[k].var == f.args()[j]) b = &domain[k];
+            }
+            const int *min = b ? as_const_int(b->min) : NULL;
+            const int *extent = b ? as_const_int(b->extent) : NULL;
+            if (!min || !extent) {
+                std::cerr << "Can't tabulate " << f.name() << ", because the table has no constant domain for "
+                          << f.args()[j] << "\n";
+                assert(false);
+            }
+            mins.push_back(*min);
+            extents.push_back(*extent);
+        }
+        mins.resize(4, 0);
+
+        debug(1) << "Computing the table of " << f.name() << "\n";
+        Buffer table(f.output_types()[0], extents, NULL, f.name() + "_table");
+        table.set_min(mins[0], mins[1], mins[2], mins[3]);
+        computing_tables++;
+        Func(f).realize(table);
+        computing_tables--;
+        table.copy_to_host();
+        tables[f.name()] = table;
+    }
+    return tables;
+}
+
+vector<string> remove_tabulated(const vector<string> &order,
+                                const map<string, set<string> > &graph,
+                                const vector<Function> &outputs,
+                                const map<string, Buffer> &tables) {
+    // Find what's still called, without going through the tables.
+    set<string> reached;
+    vector<string> pending;
+    for (size_t i = 0; i < outputs.size(); i++) {
+        pending.push_back(outputs[i].name());
+    }
+    while (!pending.empty()) {
+        string name = pending.back();
+        pending.pop_back();
+        if (reached.count(name) || tables.count(name)) continue;
+        reached.insert(name);
+        map<string, set<string> >::const_iterator iter = graph.find(name);
+        if (iter != graph.end()) {
+            pending.insert(pending.end(), iter->second.begin(), iter->second.end());
+        }
+    }
+
+    vector<string> result;
+    for (size_t i = 0; i < order.size(); i++) {
+        if (reached.count(order[i])) {
+            result.push_back(order[i]);
+        } else {
+            debug(1) << "Not computing " << order[i] << ", which only tables need\n";
+        }
+    }
+    return result;
+}
+
+Stmt use_tables(Stmt s, const map<string, Buffer> &tables) {
+    if (tables.empty()) return s;
+    return UseTables(tables).mutate(s);
+}
+
+}
+}
@@ -0,0 +1,45 @@
+#ifndef HALIDE_TABULATE_H
+#define HALIDE_TABULATE_H
+
+/** \file
+ * Defines the lowering passes that evaluate functions over small
+ * domains at compile time, and read the results from tables instead.
+ */
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "IR.h"
+#include "Bounds.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Evaluate the functions of a pipeline scheduled with
+ * Func::tabulate over their domains with the JIT, each into a
+ * buffer. If HL_AUTO_TABULATE is set to a nonzero value, also do so
+ * for inlined functions that call math library functions, when the
+ * arguments of every call to them have constant bounds that hold at
+ * most 65536 values. Returns the buffers by function name. */
+std::map<std::string, Buffer> compute_tables(const std::vector<Function> &outputs,
+                                             const std::vector<std::string> &order,
+                                             const std::map<std::string, Function> &env,
+                                             const FuncValueBounds &func_bounds);
+
+/** The realization order without the tabulated functions and the
+ * functions that only they call, which are no longer computed. */
+std::vector<std::string> remove_tabulated(const std::vector<std::string> &order,
+                                          const std::map<std::string, std::set<std::string> > &graph,
+                                          const std::vector<Function> &outputs,
+                                          const std::map<std::string, Buffer> &tables);
+
+/** Replace the calls to tabulated functions with reads of their
+ * tables. */
+Stmt use_tables(Stmt s, const std::map<std::string, Buffer> &tables);
+
+}
+}
+
+#endif
@@ -5,6 +5,7 @@
 #include "Debug.h"
 #include "LLVM_Headers.h"
 #include "Util.h"
+#include "InlineExterns.h"
 
 namespace Halide {
 
@@ -12,7 +13,7 @@ using std::string;
 using std::vector;
 
 namespace {
-#ifndef __arm__
+#if !defined(__arm__) && !defined(__aarch64__)
 
 #ifdef _MSC_VER
 static void cpuid(int info[4], int infoType, int extra) {
@@ -60,9 +61,20 @@ Target get_host_target() {
     bool use_64_bits = (sizeof(size_t) == 8);
     int bits = use_64_bits ? 64 : 32;
 
-    #ifdef __arm__
+    // The cpu llvm would pick for the host, for its scheduling model.
+    string cpu = llvm::sys::getHostCPUName();
+    if (cpu == "generic") cpu = "";
+
+    #if defined(__arm__) || defined(__aarch64__)
     Target::Arch arch = Target::ARM;
-    return Target(os, arch, bits, 0);
+    uint64_t features = 0;
+    #ifdef __ARM_FEATURE_FMA
+    features |= Target::FMA;
+    #endif
+    #if defined(__ARM_FP) && (__ARM_FP & 2)
+    features |= Target::F16C;
+    #endif
+    return Target(os, arch, bits, features, cpu);
     #else
 
     Target::Arch arch = Target::X86;
@@ -72,6 +84,7 @@ Target get_host_target() {
     bool have_sse41 = info[2] & (1 << 19);
     bool have_sse2 = info[3] & (1 << 26);
     bool have_avx = info[2] & (1 << 28);
+    bool have_fma = info[2] & (1 << 12);
     bool have_f16 = info[2] & (1 << 29);
     bool have_rdrand = info[2] & (1 << 30);
 
@@ -80,19 +93,26 @@ Target get_host_target() {
     uint64_t features = 0;
     if (have_sse41) features |= Target::SSE41;
     if (have_avx)   features |= Target::AVX;
+    if (have_avx && have_fma) features |= Target::FMA;
+    if (have_avx && have_f16) features |= Target::F16C;
 
     if (use_64_bits && have_avx && have_f16 && have_rdrand) {
         // So far, so good.  AVX2?
         // Call cpuid with eax=7, ecx=0
         int info2[4];
         cpuid(info2, 7, 0);
-        bool have_avx2 = info[1] & (1 << 5);
+        bool have_avx2 = info2[1] & (1 << 5);
         if (have_avx2) {
             features |= Target::AVX2;
         }
+        bool have_avx512f = info2[1] & (1 << 16);
+        bool have_avx512bw = info2[1] & (1 << 30);
+        if (have_avx2 && have_avx512f && have_avx512bw) {
+            features |= Target::AVX512;
+        }
     }
 
-    return Target(os, arch, bits, features);
+    return Target(os, arch, bits, features, cpu);
 #endif
 }
 
@@ -163,8 +183,10 @@ Target parse_target_string(const std::string &target) {
                   << "Where arch is x86-32, x86-64, arm-32, arm-64, "
                   << "and os is linux, windows, osx, nacl, ios, or android. "
                   << "If arch or os are omitted, they default to the host. "
-                  << "Features include sse41, avx, avx2, cuda, opencl, spir, "
-                  << "spir64, no_asserts, no_bounds_query, and gpu_debug.\n"
+                  << "Features include sse41, avx, avx2, avx512, fma, f16c, cuda, opencl, opengl, spir, "
+                  << "spir64, no_asserts, no_bounds_query, no_runtime, large_buffers, huge_pages, optimize_size, cancellable, memory_budget, telemetry, and gpu_debug. "
+                  << "A cpu to tune for can be named with cpu_ and the llvm name with underscores "
+                  << "for dashes, e.g. cpu_haswell or cpu_cortex_a15.\n"
                   << "HL_TARGET can also begin with \"host\", which sets the "
                   << "host's architecture, os, and feature set, with the "
                   << "exception of the GPU runtimes, which default to off\n";
@@ -244,9 +266,19 @@ bool Target::merge_string(const std::string &target) {
         } else if (tok == "avx") {
             features |= (Target::SSE41 | Target::AVX);
         } else if (tok == "avx2") {
-            features |= (Target::SSE41 | Target::AVX | Target::AVX2);
+            // Every processor with avx2 also has fma and f16c.
+            features |= (Target::SSE41 | Target::AVX | Target::AVX2 | Target::FMA | Target::F16C);
+        } else if (tok == "avx512") {
+            features |= (Target::SSE41 | Target::AVX | Target::AVX2 | Target::FMA |
+                         Target::F16C | Target::AVX512);
+        } else if (tok == "fma") {
+            features |= Target::FMA;
+        } else if (tok == "f16c") {
+            features |= Target::F16C;
         } else if (tok == "cuda" || tok == "ptx") {
             features |= Target::CUDA;
+        } else if (tok == "cuda_capability_30") {
+            features |= Target::CUDA | Target::CUDACapability30;
         } else if (tok == "opencl") {
             features |= Target::OpenCL;
         } else if (tok == "spir") {
@@ -259,6 +291,29 @@ bool Target::merge_string(const std::string &target) {
             features |= Target::NoAsserts;
         } else if (tok == "no_bounds_query") {
             features |= Target::NoBoundsQuery;
+        } else if (tok == "no_runtime") {
+            features |= Target::NoRuntime;
+        } else if (tok == "large_buffers") {
+            features |= Target::LargeBuffers;
+        } else if (tok == "huge_pages") {
+            features |= Target::HugePages;
+        } else if (tok == "opengl") {
+            features |= Target::OpenGL;
+        } else if (tok == "optimize_size") {
+            features |= Target::OptimizeSize;
+        } else if (tok == "cancellable") {
+            features |= Target::Cancellable;
+        } else if (tok == "memory_budget") {
+            features |= Target::MemoryBudget;
+        } else if (tok == "telemetry") {
+            features |= Target::Telemetry;
+        } else if (tok.substr(0, 4) == "cpu_" && tok.size() > 4) {
+            // Dashes separate the tokens, so cpu names spell theirs
+            // as underscores.
+            cpu = tok.substr(4);
+            for (size_t j = 0; j < cpu.size(); j++) {
+                if (cpu[j] == '_') cpu[j] = '-';
+            }
         } else {
             return false;
         }
@@ -292,6 +347,20 @@ bool Target::merge_string(const std::string &target) {
     return true;
 }
 
+int Target::natural_vector_size(Type t) const {
+    int vector_bytes = 16;
+    if (arch == Target::X86) {
+        if (features & Target::AVX512) {
+            vector_bytes = 64;
+        } else if ((features & Target::AVX2) ||
+                   ((features & Target::AVX) && t.is_float())) {
+            // AVX 1 only has 256-bit float instructions.
+            vector_bytes = 32;
+        }
+    }
+    return vector_bytes / t.bytes();
+}
+
 std::string Target::to_string() const {
   const char* const arch_names[] = {
     "arch_unknown", "x86", "arm", "pnacl"
@@ -300,16 +369,26 @@ std::string Target::to_string() const {
     "os_unknown", "linux", "windows", "osx", "android", "ios", "nacl"
   };
   const char* const feature_names[] = {
-    "jit", "sse41", "avx", "avx2", "cuda", "opencl", "gpu_debug", "spir", "spir64"
+    "jit", "sse41", "avx", "avx2", "cuda", "opencl", "gpu_debug", "spir", "spir64",
+    "no_asserts", "no_bounds_query", "fma", "f16c", "avx512", "cuda_capability_30",
+    "no_runtime", "large_buffers", "huge_pages", "opengl",
+    "optimize_size", "cancellable", "memory_budget", "telemetry"
   };
   string result = string(arch_names[arch])
       + "-" + Internal::int_to_string(bits)
       + "-" + string(os_names[os]);
-  for (int i = 0; i < 9; ++i) {
+  for (int i = 0; i < (int)(sizeof(feature_names)/sizeof(feature_names[0])); ++i) {
     if (features & (1ULL << i)) {
       result += "-" + string(feature_names[i]);
     }
   }
+  if (!cpu.empty()) {
+    string c = cpu;
+    for (size_t i = 0; i < c.size(); i++) {
+      if (c[i] == '-') c[i] = '_';
+    }
+    result += "-cpu_" + c;
+  }
   return result;
 }
 
@@ -321,6 +400,32 @@ llvm::Module *parse_bitcode_file(llvm::MemoryBuffer *bitcode_buffer, llvm::LLVMC
     return llvm::parseBitcodeFile(bitcode_buffer, *context).get();
     #endif
 }
+
+// Parse bitcode from add_extern_bitcode, and make everything it
+// defines inline into its callers. The functions are weak, like the
+// ones in the runtime, so that they survive linking with the initial
+// module, and then become linkonce, so they don't clash with any C
+// definition of the same function.
+llvm::Module *parse_extern_bitcode(const string &bitcode, llvm::LLVMContext *context) {
+    llvm::StringRef sb = llvm::StringRef(bitcode.data(), bitcode.size());
+    llvm::MemoryBuffer *bitcode_buffer = llvm::MemoryBuffer::getMemBuffer(sb);
+    llvm::Module *module = parse_bitcode_file(bitcode_buffer, context);
+    delete bitcode_buffer;
+    assert(module && "Could not parse bitcode from add_extern_bitcode");
+    module->setModuleIdentifier("extern_bitcode");
+
+    for (llvm::Module::iterator iter = module->begin(); iter != module->end(); iter++) {
+        llvm::Function *f = (llvm::Function *)(iter);
+        if (!f->isDeclaration()) {
+            f->removeFnAttr(llvm::Attribute::NoInline);
+            f->addFnAttr(llvm::Attribute::AlwaysInline);
+            if (!f->hasLocalLinkage()) {
+                f->setLinkage(llvm::GlobalValue::WeakODRLinkage);
+            }
+        }
+    }
+    return module;
+}
 }
 
 #define DECLARE_INITMOD(mod)                                            \
@@ -356,23 +461,49 @@ llvm::Module *parse_bitcode_file(llvm::MemoryBuffer *bitcode_buffer, llvm::LLVMC
 DECLARE_CPP_INITMOD(android_clock)
 DECLARE_CPP_INITMOD(android_host_cpu_count)
 DECLARE_CPP_INITMOD(android_io)
+DECLARE_CPP_INITMOD(android_thread_affinity)
 DECLARE_CPP_INITMOD(ios_io)
+DECLARE_CPP_INITMOD(cancellation)
+DECLARE_CPP_INITMOD(lazy_realization)
+DECLARE_CPP_INITMOD(memory_budget)
+DECLARE_CPP_INITMOD(runtime_stats)
 DECLARE_CPP_INITMOD(cuda)
 DECLARE_CPP_INITMOD(cuda_debug)
+DECLARE_CPP_INITMOD(cycle_clock)
+DECLARE_CPP_INITMOD(device_split)
+DECLARE_CPP_INITMOD(distributed)
+DECLARE_CPP_INITMOD(fake_thread_affinity)
+DECLARE_CPP_INITMOD(fake_cycle_counter)
 DECLARE_CPP_INITMOD(fake_thread_pool)
+DECLARE_CPP_INITMOD(fake_perf_counters)
+DECLARE_CPP_INITMOD(fake_host_cache_size)
+DECLARE_CPP_INITMOD(fake_huge_pages)
 DECLARE_CPP_INITMOD(gcd_thread_pool)
 DECLARE_CPP_INITMOD(linux_clock)
 DECLARE_CPP_INITMOD(linux_host_cpu_count)
+DECLARE_CPP_INITMOD(linux_host_cache_size)
+DECLARE_CPP_INITMOD(linux_thread_affinity)
+DECLARE_CPP_INITMOD(linux_perf_counters)
+DECLARE_CPP_INITMOD(linux_huge_pages)
+DECLARE_CPP_INITMOD(memoization_cache)
+DECLARE_CPP_INITMOD(persistent_storage)
 DECLARE_CPP_INITMOD(nogpu)
 DECLARE_CPP_INITMOD(opencl)
 DECLARE_CPP_INITMOD(opencl_debug)
+DECLARE_CPP_INITMOD(opengl)
+DECLARE_CPP_INITMOD(opengl_debug)
 DECLARE_CPP_INITMOD(osx_host_cpu_count)
+DECLARE_CPP_INITMOD(osx_host_cache_size)
 DECLARE_CPP_INITMOD(osx_io)
 DECLARE_CPP_INITMOD(posix_allocator)
 DECLARE_CPP_INITMOD(posix_clock)
 DECLARE_CPP_INITMOD(windows_clock)
 DECLARE_CPP_INITMOD(osx_clock)
 DECLARE_CPP_INITMOD(posix_error_handler)
+DECLARE_CPP_INITMOD(profiler)
+DECLARE_CPP_INITMOD(timeline)
+DECLARE_CPP_INITMOD(pgo)
+DECLARE_CPP_INITMOD(schedule_select)
 DECLARE_CPP_INITMOD(posix_io)
 DECLARE_CPP_INITMOD(nacl_io)
 DECLARE_CPP_INITMOD(ssp)
@@ -382,8 +513,10 @@ DECLARE_CPP_INITMOD(posix_thread_pool)
 DECLARE_CPP_INITMOD(windows_thread_pool)
 DECLARE_CPP_INITMOD(tracing)
 DECLARE_CPP_INITMOD(write_debug_image)
+DECLARE_CPP_INITMOD(x86_cpu_features)
 
 DECLARE_LL_INITMOD(arm)
+DECLARE_LL_INITMOD(aarch64)
 DECLARE_LL_INITMOD(posix_math)
 DECLARE_LL_INITMOD(pnacl_math)
 DECLARE_LL_INITMOD(ptx_dev)
@@ -396,14 +529,16 @@ DECLARE_LL_INITMOD(spir_dev)
 DECLARE_LL_INITMOD(spir64_dev)
 DECLARE_LL_INITMOD(spir_common_dev)
 DECLARE_LL_INITMOD(x86_avx)
+DECLARE_LL_INITMOD(x86_avx2)
 DECLARE_LL_INITMOD(x86)
 DECLARE_LL_INITMOD(x86_sse41)
 
 namespace {
 
 // Link all modules together and with the result in modules[0],
-// all other input modules are destroyed.
-void link_modules(std::vector<llvm::Module *> &modules) {
+// all other input modules are destroyed. If keep_all is set, the
+// weak symbols stay weak, so that none are stripped.
+void link_modules(std::vector<llvm::Module *> &modules, bool keep_all = false) {
     // Link them all together
     for (size_t i = 1; i < modules.size(); i++) {
         #if LLVM_VERSION >= 35
@@ -428,19 +563,73 @@ void link_modules(std::vector<llvm::Module *> &modules) {
                        "halide_copy_to_dev",
                        "halide_dev_malloc",
                        "halide_dev_free",
+                       "halide_dev_cache_set_size",
+                       "halide_dev_cache_trim",
+                       "halide_dev_host_malloc",
+                       "halide_dev_host_free",
+                       "halide_dev_host_register",
+                       "halide_dev_host_unregister",
+                       "halide_dev_set_zero_copy",
+                       "halide_dev_set_launch_graphs",
+                       "halide_dev_set_profiling",
+                       "halide_gpu_profile_report",
+                       "halide_gpu_profile_reset",
                        "halide_set_error_handler",
                        "halide_set_custom_allocator",
+                       "halide_use_allocator_cache",
+                       "halide_release_allocator_cache",
+                       "halide_get_allocator_cache_stats",
+                       "halide_memoization_cache_set_size",
+                       "halide_memoization_cache_cleanup",
+                       "halide_profiler_report",
+                       "halide_profiler_reset",
+                       "halide_profiler_shutdown",
+                       "halide_profiler_get_memory_stats",
+                       "halide_timeline_write",
+                       "halide_shutdown_timeline",
+                       "halide_pgo_write",
+                       "halide_shutdown_pgo",
+                       "halide_debug_to_file_wait",
                        "halide_set_custom_trace",
                        "halide_set_custom_do_par_for",
                        "halide_set_custom_do_task",
                        "halide_shutdown_thread_pool",
+                       "halide_set_num_threads",
+                       "halide_get_num_threads",
+                       "halide_create_thread_pool",
+                       "halide_destroy_thread_pool",
+                       "halide_set_thread_pool",
+                       "halide_set_thread_pool_wakeup",
+                       "halide_set_big_cores_only",
+                       "halide_cancel",
+                       "halide_uncancel",
+                       "halide_is_cancelled",
+                       "halide_set_custom_is_cancelled",
+                       "halide_check_memory_budget",
+                       "halide_set_memory_budget",
+                       "halide_last_peak_memory",
+                       "halide_set_custom_check_memory_budget",
+                       "halide_get_runtime_stats",
+                       "halide_reset_runtime_stats",
+                       "halide_histogram_percentile",
                        "halide_shutdown_trace",
                        "halide_set_cuda_context",
+                       "halide_cuda_get_device",
+                       "halide_cuda_get_stream",
                        "halide_set_cl_context",
+                       "halide_opengl_create_context",
                        "halide_dev_sync",
+                       "halide_gpu_warmup",
+                       "halide_device_split_gpu_percent",
+                       "halide_gpu_dispatch_threshold",
+                       "halide_set_gpu_dispatch_threshold",
+                       "halide_schedule_select_save",
+                       "halide_schedule_selected",
                        "halide_release",
                        "halide_current_time_ns",
+                       "halide_fast_time_ns",
                        "halide_host_cpu_count",
+                       "halide_host_cache_size",
                        "__stack_chk_guard",
                        "__stack_chk_fail",
                        ""};
@@ -456,7 +645,7 @@ void link_modules(std::vector<llvm::Module *> &modules) {
             }
         }
 
-        if (can_strip) {
+        if (can_strip && !keep_all) {
             llvm::GlobalValue::LinkageTypes t = f->getLinkage();
             if (t == llvm::GlobalValue::WeakAnyLinkage) {
                 f->setLinkage(llvm::GlobalValue::LinkOnceAnyLinkage);
@@ -475,12 +664,53 @@ void link_modules(std::vector<llvm::Module *> &modules) {
     }
 }
 
+// Turn the runtime functions into declarations, to be resolved
+// against the standalone runtime at link time. Only the halide_
+// functions come from the runtime; the helpers from the .ll modules
+// are small and get inlined, so they stay. Globals that only the
+// runtime used go too, so that there's one copy of its state.
+void strip_runtime(llvm::Module *module) {
+    for (llvm::Module::iterator iter = module->begin(); iter != module->end(); iter++) {
+        llvm::Function *f = (llvm::Function *)(iter);
+        if (!f->isDeclaration() && f->getName().startswith("halide_")) {
+            f->deleteBody();
+            f->setLinkage(llvm::GlobalValue::ExternalLinkage);
+        }
+    }
+
+    // The runtime's static helpers aren't called from anywhere now
+    // either. Erasing them may free up more globals, so repeat until
+    // nothing changes.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        vector<llvm::GlobalValue *> dead;
+        for (llvm::Module::iterator iter = module->begin(); iter != module->end(); iter++) {
+            llvm::Function *f = (llvm::Function *)(iter);
+            if (!f->isDeclaration() && f->hasLocalLinkage() && f->use_empty()) {
+                dead.push_back(f);
+            }
+        }
+        for (llvm::Module::global_iterator iter = module->global_begin();
+             iter != module->global_end(); iter++) {
+            llvm::GlobalVariable *g = (llvm::GlobalVariable *)(iter);
+            if (!g->isDeclaration() && g->use_empty()) {
+                dead.push_back(g);
+            }
+        }
+        for (size_t i = 0; i < dead.size(); i++) {
+            dead[i]->eraseFromParent();
+            changed = true;
+        }
+    }
+}
+
 }
 
 namespace Internal {
 
 /** Create an llvm module containing the support code for a given target. */
-llvm::Module *get_initial_module_for_target(Target t, llvm::LLVMContext *c) {
+llvm::Module *get_initial_module_for_target(Target t, llvm::LLVMContext *c, bool for_shared_runtime) {
 
     assert(t.bits == 32 || t.bits == 64);
     // NaCl always uses the 32-bit runtime modules, because pointers
@@ -495,29 +725,38 @@ llvm::Module *get_initial_module_for_target(Target t, llvm::LLVMContext *c) {
         modules.push_back(get_initmod_linux_clock(c, bits_64));
         modules.push_back(get_initmod_posix_io(c, bits_64));
         modules.push_back(get_initmod_linux_host_cpu_count(c, bits_64));
+        modules.push_back(get_initmod_linux_host_cache_size(c, bits_64));
         modules.push_back(get_initmod_posix_thread_pool(c, bits_64));
+        modules.push_back(get_initmod_linux_thread_affinity(c, bits_64));
     } else if (t.os == Target::OSX) {
         modules.push_back(get_initmod_osx_clock(c, bits_64));
         modules.push_back(get_initmod_osx_io(c, bits_64));
+        modules.push_back(get_initmod_osx_host_cache_size(c, bits_64));
         modules.push_back(get_initmod_gcd_thread_pool(c, bits_64));
     } else if (t.os == Target::Android) {
         modules.push_back(get_initmod_android_clock(c, bits_64));
         modules.push_back(get_initmod_android_io(c, bits_64));
         modules.push_back(get_initmod_android_host_cpu_count(c, bits_64));
+        modules.push_back(get_initmod_fake_host_cache_size(c, bits_64));
         modules.push_back(get_initmod_posix_thread_pool(c, bits_64));
+        modules.push_back(get_initmod_android_thread_affinity(c, bits_64));
     } else if (t.os == Target::Windows) {
         modules.push_back(get_initmod_windows_clock(c, bits_64));
         modules.push_back(get_initmod_windows_io(c, bits_64));
+        modules.push_back(get_initmod_fake_host_cache_size(c, bits_64));
         modules.push_back(get_initmod_windows_thread_pool(c, bits_64));
     } else if (t.os == Target::IOS) {
         modules.push_back(get_initmod_posix_clock(c, bits_64));
         modules.push_back(get_initmod_ios_io(c, bits_64));
+        modules.push_back(get_initmod_fake_host_cache_size(c, bits_64));
         modules.push_back(get_initmod_gcd_thread_pool(c, bits_64));
     } else if (t.os == Target::NaCl) {
         modules.push_back(get_initmod_posix_clock(c, bits_64));
         modules.push_back(get_initmod_nacl_io(c, bits_64));
         modules.push_back(get_initmod_linux_host_cpu_count(c, bits_64));
+        modules.push_back(get_initmod_fake_host_cache_size(c, bits_64));
         modules.push_back(get_initmod_posix_thread_pool(c, bits_64));
+        modules.push_back(get_initmod_fake_thread_affinity(c, bits_64));
         modules.push_back(get_initmod_ssp(c, bits_64));
     }
 
@@ -532,14 +771,53 @@ llvm::Module *get_initial_module_for_target(Target t, llvm::LLVMContext *c) {
     modules.push_back(get_initmod_tracing(c, bits_64));
     modules.push_back(get_initmod_write_debug_image(c, bits_64));
     modules.push_back(get_initmod_posix_allocator(c, bits_64));
+    modules.push_back(get_initmod_memoization_cache(c, bits_64));
+    modules.push_back(get_initmod_persistent_storage(c, bits_64));
+    modules.push_back(get_initmod_distributed(c, bits_64));
     modules.push_back(get_initmod_posix_error_handler(c, bits_64));
+    modules.push_back(get_initmod_cycle_clock(c, bits_64));
+    modules.push_back(get_initmod_timeline(c, bits_64));
+    modules.push_back(get_initmod_pgo(c, bits_64));
+    modules.push_back(get_initmod_schedule_select(c, bits_64));
+    modules.push_back(get_initmod_cancellation(c, bits_64));
+    modules.push_back(get_initmod_lazy_realization(c, bits_64));
+    modules.push_back(get_initmod_memory_budget(c, bits_64));
+    modules.push_back(get_initmod_runtime_stats(c, bits_64));
+    // The sampling thread of the profiler uses pthreads.
+    if (t.os != Target::Windows) {
+        modules.push_back(get_initmod_profiler(c, bits_64));
+        // Only linux has perf_event_open for the hardware counters.
+        if (t.os == Target::Linux || t.os == Target::Android) {
+            modules.push_back(get_initmod_linux_perf_counters(c, bits_64));
+        } else {
+            modules.push_back(get_initmod_fake_perf_counters(c, bits_64));
+        }
+    }
 
     // These modules are optional
+    if (t.features & Target::HugePages) {
+        // Only linux has transparent huge pages to ask for.
+        if (t.os == Target::Linux || t.os == Target::Android) {
+            modules.push_back(get_initmod_linux_huge_pages(c, bits_64));
+        } else {
+            modules.push_back(get_initmod_fake_huge_pages(c, bits_64));
+        }
+    }
     if (t.arch == Target::X86) {
         modules.push_back(get_initmod_x86_ll(c));
+        modules.push_back(get_initmod_x86_cpu_features(c, bits_64));
     }
     if (t.arch == Target::ARM) {
-        modules.push_back(get_initmod_arm_ll(c));
+        if (t.bits == 64) {
+            modules.push_back(get_initmod_aarch64_ll(c));
+        } else {
+            modules.push_back(get_initmod_arm_ll(c));
+        }
+    }
+    // The hardware counter read by halide_fast_time_ns. x86 reads
+    // it in x86_cpu_features, and aarch64 in aarch64.ll.
+    if (t.arch != Target::X86 && !(t.arch == Target::ARM && t.bits == 64)) {
+        modules.push_back(get_initmod_fake_cycle_counter(c, bits_64));
     }
     if (t.features & Target::SSE41) {
         modules.push_back(get_initmod_x86_sse41_ll(c));
@@ -547,6 +825,9 @@ llvm::Module *get_initial_module_for_target(Target t, llvm::LLVMContext *c) {
     if (t.features & Target::AVX) {
         modules.push_back(get_initmod_x86_avx_ll(c));
     }
+    if (t.features & Target::AVX2) {
+        modules.push_back(get_initmod_x86_avx2_ll(c));
+    }
     if (t.features & Target::CUDA) {
         if (t.features & Target::GPUDebug) {
             modules.push_back(get_initmod_cuda_debug(c, bits_64));
@@ -559,11 +840,33 @@ llvm::Module *get_initial_module_for_target(Target t, llvm::LLVMContext *c) {
         } else {
             modules.push_back(get_initmod_opencl(c, bits_64));
         }
+    } else if (t.features & Target::OpenGL) {
+        if (t.features & Target::GPUDebug) {
+            modules.push_back(get_initmod_opengl_debug(c, bits_64));
+        } else {
+            modules.push_back(get_initmod_opengl(c, bits_64));
+        }
     } else {
         modules.push_back(get_initmod_nogpu(c, bits_64));
     }
+    if (t.has_gpu_feature()) {
+        modules.push_back(get_initmod_device_split(c, bits_64));
+    }
 
-    link_modules(modules);
+    // User functions from add_extern_bitcode. The standalone runtime
+    // doesn't need them, because they're inlined into the pipelines.
+    if (!for_shared_runtime) {
+        const vector<string> &bitcode = extern_bitcode();
+        for (size_t i = 0; i < bitcode.size(); i++) {
+            modules.push_back(parse_extern_bitcode(bitcode[i], c));
+        }
+    }
+
+    link_modules(modules, for_shared_runtime);
+
+    if ((t.features & Target::NoRuntime) && !for_shared_runtime) {
+        strip_runtime(modules[0]);
+    }
 
     return modules[0];
 }
@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <string>
 #include "Util.h"
+#include "Type.h"
 
 namespace llvm {
 class Module;
@@ -41,24 +42,54 @@ struct Target {
                    SPIR = 128,    /// Enable the OpenCL SPIR runtime in 32-bit mode
                    SPIR64 = 256,  /// Enable the OpenCL SPIR runtime in 64-bit mode
                    NoAsserts = 512, /// Disable all runtime checks, for slightly tighter code.
-                   NoBoundsQuery = 1024 /// Disable the bounds querying functionality.
+                   NoBoundsQuery = 1024, /// Disable the bounds querying functionality.
+                   FMA = 2048,    /// Use fused multiply-add instructions. FMA3 on x86, VFPv4 or later on ARM.
+                   F16C = 4096,   /// Use half-float conversion instructions. F16C on x86, the fp16 extension on 32-bit ARM.
+                   AVX512 = 8192, /// Use AVX-512 F and BW instructions. Only relevant on x86.
+                   CUDACapability30 = 16384, /// Generate code for CUDA devices of compute capability 3.0 or later, which have warp shuffles.
+                   NoRuntime = 32768, /// Leave the runtime out of the object, to link against one made by compile_standalone_runtime.
+                   LargeBuffers = 65536, /// Allow inputs and outputs of more than 2^31 elements, using 64-bit offsets across rows.
+                   HugePages = 131072, /// Back large heap allocations with transparent huge pages, and first-touch them in parallel.
+                   OpenGL = 262144, /// Enable the OpenGL ES runtime, and emit the kernels as GLSL ES 3.1 compute shaders.
+                   OptimizeSize = 524288, /// Optimize for code size instead of speed, e.g. for mobile apps. Unrolls and specializes less.
+                   Cancellable = 1048576, /// Check halide_is_cancelled between parallel tasks and rows of loop nests, and give up early if it says so.
+                   MemoryBudget = 2097152, /// Estimate the peak memory up front, report it to halide_check_memory_budget, and give up if it's over budget.
+                   Telemetry = 4194304 /// Time each call of the pipeline into the latency histograms read by halide_get_runtime_stats.
     };
 
     /** A bitmask that stores the active features. */
     uint64_t features;
 
+    /** The llvm name of the cpu to schedule and tune for,
+     * e.g. haswell or cortex-a15. Empty means a generic cpu chosen
+     * from the features. It never enables instructions the features
+     * leave out. */
+    std::string cpu;
+
     Target() : os(OSUnknown), arch(ArchUnknown), bits(0), features(0) {}
-    Target(OS o, Arch a, int b, uint64_t f) : os(o), arch(a), bits(b), features(f) {}
+    Target(OS o, Arch a, int b, uint64_t f, const std::string &c = "") :
+        os(o), arch(a), bits(b), features(f), cpu(c) {}
+
+    /** The number of lanes of the given type that fit in the widest
+     * vector register of the target. A good vectorization factor. */
+    EXPORT int natural_vector_size(Type t) const;
 
-    bool has_gpu_feature() {
-        return (features & (CUDA|OpenCL|SPIR|SPIR64));
+    /** The natural vector size of the type T. */
+    template<typename T>
+    int natural_vector_size() const {
+        return natural_vector_size(type_of<T>());
+    }
+
+    bool has_gpu_feature() const {
+        return (features & (CUDA|OpenCL|SPIR|SPIR64|OpenGL));
     }
 
     bool operator==(const Target &other) const {
       return os == other.os &&
           arch == other.arch &&
           bits == other.bits &&
-          features == other.features;
+          features == other.features &&
+          cpu == other.cpu;
     }
 
     bool operator!=(const Target &other) const {
@@ -68,7 +99,10 @@ struct Target {
     /** Convert the Target into a string form that can be reconstituted
      * by merge_string(), which will always be of the form
      *
-     *   arch-bits-os-feature1-feature2...featureN.
+     *   arch-bits-os-feature1-feature2...featureN[-cpu_name].
+     *
+     * The cpu name is written with underscores in place of dashes,
+     * e.g. cpu_cortex_a15.
      *
      * Note that is guaranteed that t2.from_string(t1.to_string()) == t1
      * ,but not that from_string(s).to_string() == s (since there can be
@@ -134,8 +168,13 @@ EXPORT Target parse_target_string(const std::string &target);
 
 namespace Internal {
 
-/** Create an llvm module containing the support code for a given target. */
-llvm::Module *get_initial_module_for_target(Target, llvm::LLVMContext *);
+/** Create an llvm module containing the support code for a given
+ * target. If the target has the NoRuntime feature, the runtime
+ * functions are left as declarations, unless for_shared_runtime is
+ * set, in which case every runtime function is kept, so that the
+ * module can be compiled on its own as the runtime that other
+ * pipelines link against. */
+llvm::Module *get_initial_module_for_target(Target, llvm::LLVMContext *, bool for_shared_runtime = false);
 
 /** Create an llvm module containing the support code for ptx device. */
 llvm::Module *get_initial_module_for_ptx_device(llvm::LLVMContext *c);
@@ -1,6 +1,9 @@
 #include "Tracing.h"
 #include "IRMutator.h"
 #include "IROperator.h"
+#include "IRVisitor.h"
+#include "ExprUsesVar.h"
+#include "CodeGen_GPU_Dev.h"
 #include "runtime/HalideRuntime.h"
 
 namespace Halide {
@@ -11,23 +14,36 @@ int tracing_level() {
     return trace ? atoi(trace) : 0;
 }
 
+bool tracing_summary_enabled() {
+    char *summary = getenv("HL_TRACE_SUMMARY");
+    return summary && atoi(summary);
+}
+
 using std::vector;
 using std::map;
+using std::set;
 using std::string;
 
 class InjectTracing : public IRMutator {
 public:
     const map<string, Function> &env;
-    Function output;
+    const vector<Function> &outputs;
     int global_level;
     InjectTracing(const map<string, Function> &e,
-                  Function o) : env(e),
-                                output(o),
-                                global_level(tracing_level()) {}
+                  const vector<Function> &o) : env(e),
+                                               outputs(o),
+                                               global_level(tracing_level()) {}
 
 private:
     using IRMutator::visit;
 
+    bool is_output(Function f) const {
+        for (size_t i = 0; i < outputs.size(); i++) {
+            if (f.same_as(outputs[i])) return true;
+        }
+        return false;
+    }
+
     void visit(const Call *op) {
 
         // Calls inside of an address_of don't count, but we want to
@@ -66,7 +82,7 @@ private:
         }
 
         Function f = op->func;
-        bool inlined = !f.same_as(output) && f.schedule().compute_level.is_inline();
+        bool inlined = !is_output(f) && f.schedule().compute_level.is_inline();
 
         if (f.is_tracing_loads() || (global_level > 2 && !inlined)) {
 
@@ -92,7 +108,7 @@ private:
         map<string, Function>::const_iterator iter = env.find(op->name);
         if (iter == env.end()) return;
         Function f = iter->second;
-        bool inlined = !f.same_as(output) && f.schedule().compute_level.is_inline();
+        bool inlined = !is_output(f) && f.schedule().compute_level.is_inline();
 
         if (f.is_tracing_stores() || (global_level > 1 && !inlined)) {
             // Wrap each expr in a tracing call
@@ -211,29 +227,34 @@ private:
     }
 };
 
-Stmt inject_tracing(Stmt s, const map<string, Function> &env, Function output) {
+Stmt inject_tracing(Stmt s, const map<string, Function> &env, const vector<Function> &outputs) {
     Stmt original = s;
-    InjectTracing tracing(env, output);
+    InjectTracing tracing(env, outputs);
 
     // Add a dummy realize block for the output buffers
-    Region output_region;
-    Parameter output_buf = output.output_buffers()[0];
-    assert(output_buf.is_buffer());
-    for (int i = 0; i < output.dimensions(); i++) {
-        string d = int_to_string(i);
-        Expr min = Variable::make(Int(32), output_buf.name() + ".min." + d);
-        Expr extent = Variable::make(Int(32), output_buf.name() + ".extent." + d);
-        output_region.push_back(Range(min, extent));
+    for (size_t j = 0; j < outputs.size(); j++) {
+        Function output = outputs[j];
+        Region output_region;
+        Parameter output_buf = output.output_buffers()[0];
+        assert(output_buf.is_buffer());
+        for (int i = 0; i < output.dimensions(); i++) {
+            string d = int_to_string(i);
+            Expr min = Variable::make(Int(32), output_buf.name() + ".min." + d);
+            Expr extent = Variable::make(Int(32), output_buf.name() + ".extent." + d);
+            output_region.push_back(Range(min, extent));
+        }
+        s = Realize::make(output.name(), output.output_types(), output_region, s);
     }
-    s = Realize::make(output.name(), output.output_types(), output_region, s);
 
     // Inject tracing calls
     s = tracing.mutate(s);
 
-    // Strip off the dummy realize block
-    const Realize *r = s.as<Realize>();
-    assert(r);
-    s = r->body;
+    // Strip off the dummy realize blocks
+    for (size_t j = 0; j < outputs.size(); j++) {
+        const Realize *r = s.as<Realize>();
+        assert(r);
+        s = r->body;
+    }
 
     // Unless tracing was a no-op, add a call to shut down the trace
     // (which flushes the output stream)
@@ -244,5 +265,372 @@ Stmt inject_tracing(Stmt s, const map<string, Function> &env, Function output) {
     return s;
 }
 
+namespace {
+
+// The counts of accesses made by a piece of code, by counter index.
+// Missing counts are zero.
+typedef map<int, Expr> Counts;
+
+void add_count(Counts &c, int k, Expr e) {
+    Counts::iterator iter = c.find(k);
+    if (iter == c.end()) {
+        c[k] = e;
+    } else {
+        iter->second = iter->second + e;
+    }
+}
+
+bool counts_use_var(const Counts &c, const string &var) {
+    for (Counts::const_iterator iter = c.begin(); iter != c.end(); ++iter) {
+        if (expr_uses_var(iter->second, var)) return true;
+    }
+    return false;
+}
+
+// Can an expression be evaluated somewhere else, outside the loops
+// and allocations it came from? Only if it doesn't load anything.
+class HasLoadsOrCalls : public IRVisitor {
+    using IRVisitor::visit;
+    void visit(const Load *) {result = true;}
+    void visit(const Call *) {result = true;}
+public:
+    bool result;
+    HasLoadsOrCalls() : result(false) {}
+};
+
+bool can_move(Expr e) {
+    HasLoadsOrCalls check;
+    e.accept(&check);
+    return !check.result;
+}
+
+string summary_buffer(const string &func) {
+    return func + ".trace_summary";
+}
+
+class FindLoads : public IRVisitor {
+    using IRVisitor::visit;
+    void visit(const Load *op) {
+        IRVisitor::visit(op);
+        // The counters of other summaries aren't inputs.
+        if (!ends_with(op->name, ".trace_summary")) {
+            loads.push_back(op);
+        }
+    }
+public:
+    vector<const Load *> loads;
+};
+
+// Counts the stores to one Func and the bytes it loads from each of
+// its inputs within one realization of it. Counts that don't depend
+// on the data are computed symbolically and added up once at the end
+// of the realization. The rest are added to the counters in the
+// loop body or branch where they become data-dependent, atomically
+// if that's inside a parallel loop.
+class SummarizeRealization {
+    Function func;
+    string counters;
+    set<string> buffers;
+
+    // Whether the code being visited computes the Func (as opposed
+    // to consuming it, or computing something else).
+    bool own;
+    int parallel_depth, gpu_depth;
+
+public:
+    // The inputs, by counter index less two.
+    vector<string> sources;
+    map<string, int> source_index;
+
+    SummarizeRealization(Function f) : func(f), counters(summary_buffer(f.name())),
+                                       own(false), parallel_depth(0), gpu_depth(0) {
+        buffers.insert(f.name());
+        for (int i = 0; i < f.outputs(); i++) {
+            buffers.insert(f.name() + "." + int_to_string(i));
+        }
+    }
+
+    Expr counter(int k) {
+        return Load::make(Int(64), counters, k, Buffer(), Parameter());
+    }
+
+    Stmt increment(const Counts &c, bool atomic) {
+        Stmt result;
+        for (Counts::const_iterator iter = c.begin(); iter != c.end(); ++iter) {
+            Stmt s;
+            if (atomic) {
+                Expr add = Call::make(Int(64), Call::atomic_add,
+                                      vec(counter(iter->first), iter->second), Call::Intrinsic);
+                s = Evaluate::make(add);
+            } else {
+                s = Store::make(counters, counter(iter->first) + iter->second, iter->first);
+            }
+            result = result.defined() ? Block::make(result, s) : s;
+        }
+        return result;
+    }
+
+    // Add an increment of the counts to the start of a statement, and
+    // clear them.
+    Stmt increment_before(Stmt s, Counts &c) {
+        if (c.empty()) return s;
+        if (gpu_depth > 0) {
+            // Counting on the device isn't supported. These counts
+            // are lost.
+            debug(1) << "Dropping data-dependent counts of " << func.name() << " inside a gpu loop\n";
+            c.clear();
+            return s;
+        }
+        Stmt inc = increment(c, parallel_depth > 0);
+        c.clear();
+        return Block::make(inc, s);
+    }
+
+    void count_loads(Expr e, Counts &c) {
+        if (!own || !e.defined()) return;
+        FindLoads f;
+        e.accept(&f);
+        for (size_t i = 0; i < f.loads.size(); i++) {
+            const Load *l = f.loads[i];
+            map<string, int>::iterator iter = source_index.find(l->name);
+            int k;
+            if (iter == source_index.end()) {
+                k = (int)sources.size() + 2;
+                source_index[l->name] = k;
+                sources.push_back(l->name);
+            } else {
+                k = iter->second;
+            }
+            add_count(c, k, make_const(Int(64), l->type.bytes() * l->type.width));
+        }
+    }
+
+    Stmt count(Stmt s, Counts &c) {
+        if (!s.defined()) return s;
+
+        if (const Store *op = s.as<Store>()) {
+            if (own && buffers.count(op->name)) {
+                add_count(c, 0, make_const(Int(64), op->value.type().width));
+            }
+            count_loads(op->value, c);
+            count_loads(op->index, c);
+            count_loads(op->predicate, c);
+            return s;
+        } else if (const LetStmt *op = s.as<LetStmt>()) {
+            count_loads(op->value, c);
+            Counts body_counts;
+            Stmt body = count(op->body, body_counts);
+            if (counts_use_var(body_counts, op->name)) {
+                if (can_move(op->value)) {
+                    for (Counts::iterator iter = body_counts.begin(); iter != body_counts.end(); ++iter) {
+                        iter->second = Let::make(op->name, op->value, iter->second);
+                    }
+                } else {
+                    body = increment_before(body, body_counts);
+                }
+            }
+            for (Counts::iterator iter = body_counts.begin(); iter != body_counts.end(); ++iter) {
+                add_count(c, iter->first, iter->second);
+            }
+            return body.same_as(op->body) ? s : LetStmt::make(op->name, op->value, body);
+        } else if (const For *op = s.as<For>()) {
+            count_loads(op->min, c);
+            count_loads(op->extent, c);
+            bool gpu = CodeGen_GPU_Dev::is_gpu_var(op->name);
+            bool parallel = op->for_type == For::Parallel;
+            if (gpu) gpu_depth++;
+            if (parallel) parallel_depth++;
+            Counts body_counts;
+            Stmt body = count(op->body, body_counts);
+            bool movable = can_move(op->min) && can_move(op->extent);
+            const int *const_extent = as_const_int(op->extent);
+            if (!counts_use_var(body_counts, op->name) && movable) {
+                for (Counts::iterator iter = body_counts.begin(); iter != body_counts.end(); ++iter) {
+                    add_count(c, iter->first, Cast::make(Int(64), op->extent) * iter->second);
+                }
+            } else if (movable && const_extent && *const_extent <= 16) {
+                // Short loops, such as those to be vectorized or
+                // unrolled, are summed lane by lane.
+                for (Counts::iterator iter = body_counts.begin(); iter != body_counts.end(); ++iter) {
+                    for (int i = 0; i < *const_extent; i++) {
+                        add_count(c, iter->first, Let::make(op->name, op->min + i, iter->second));
+                    }
+                }
+            } else if (op->for_type == For::Vectorized ||
+                       op->for_type == For::Unrolled ||
+                       op->for_type == For::Jammed) {
+                debug(1) << "Dropping data-dependent counts of " << func.name()
+                         << " inside loop " << op->name << "\n";
+            } else {
+                body = increment_before(body, body_counts);
+            }
+            if (gpu) gpu_depth--;
+            if (parallel) parallel_depth--;
+            return body.same_as(op->body) ? s : For::make(op->name, op->min, op->extent, op->for_type, body);
+        } else if (const IfThenElse *op = s.as<IfThenElse>()) {
+            count_loads(op->condition, c);
+            Counts then_counts, else_counts;
+            Stmt then_case = count(op->then_case, then_counts);
+            Stmt else_case = count(op->else_case, else_counts);
+            if (can_move(op->condition)) {
+                Expr zero = make_zero(Int(64));
+                for (Counts::iterator iter = then_counts.begin(); iter != then_counts.end(); ++iter) {
+                    Expr e = else_counts.count(iter->first) ? else_counts[iter->first] : zero;
+                    add_count(c, iter->first, Select::make(op->condition, iter->second, e));
+                    else_counts.erase(iter->first);
+                }
+                for (Counts::iterator iter = else_counts.begin(); iter != else_counts.end(); ++iter) {
+                    add_count(c, iter->first, Select::make(op->condition, zero, iter->second));
+                }
+            } else {
+                then_case = increment_before(then_case, then_counts);
+                if (else_case.defined()) {
+                    else_case = increment_before(else_case, else_counts);
+                }
+            }
+            if (then_case.same_as(op->then_case) && else_case.same_as(op->else_case)) return s;
+            return IfThenElse::make(op->condition, then_case, else_case);
+        } else if (const Block *op = s.as<Block>()) {
+            Stmt first = count(op->first, c);
+            Stmt rest = count(op->rest, c);
+            if (first.same_as(op->first) && rest.same_as(op->rest)) return s;
+            return Block::make(first, rest);
+        } else if (const Pipeline *op = s.as<Pipeline>()) {
+            bool old_own = own;
+            own = (op->name == func.name());
+            Stmt produce = count(op->produce, c);
+            Stmt update = count(op->update, c);
+            own = old_own;
+            Stmt consume = count(op->consume, c);
+            if (produce.same_as(op->produce) && update.same_as(op->update) && consume.same_as(op->consume)) return s;
+            return Pipeline::make(op->name, produce, update, consume);
+        } else if (const Allocate *op = s.as<Allocate>()) {
+            Stmt body = count(op->body, c);
+            return body.same_as(op->body) ? s : Allocate::make(op->name, op->type, op->extents, body);
+        } else if (const Evaluate *op = s.as<Evaluate>()) {
+            count_loads(op->value, c);
+            return s;
+        } else {
+            return s;
+        }
+    }
+
+    // Count the accesses in the body of a realization, and follow it
+    // with the summary events.
+    Stmt summarize(Stmt body) {
+        Counts c;
+        body = count(body, c);
+
+        int num_counters = (int)sources.size() + 2;
+        Stmt init;
+        for (int k = 0; k < num_counters; k++) {
+            Stmt s = Store::make(counters, make_zero(Int(64)), k);
+            init = init.defined() ? Block::make(init, s) : s;
+        }
+
+        // The realized box.
+        string buffer = func.outputs() > 1 ? func.name() + ".0" : func.name();
+        vector<Expr> args;
+        args.push_back(func.name());
+        args.push_back(halide_trace_summary);
+        args.push_back(0); // parent id
+        args.push_back(0); // value index
+        args.push_back(Load::make(Int(64, 2), counters, Ramp::make(0, 1, 2), Buffer(), Parameter()));
+        Expr points = make_const(Int(64), 1);
+        for (int i = 0; i < func.dimensions(); i++) {
+            string d = int_to_string(i);
+            Expr min = Variable::make(Int(32), buffer + ".min." + d);
+            Expr extent = Variable::make(Int(32), buffer + ".extent." + d);
+            args.push_back(min);
+            args.push_back(extent);
+            points = points * Cast::make(Int(64), extent);
+        }
+
+        Stmt finish = Store::make(counters, points, 1);
+        if (!c.empty()) {
+            finish = Block::make(increment(c, false), finish);
+        }
+
+        string id_name = func.name() + ".trace_summary_id";
+        Expr summary_call = Call::make(Int(32), Call::trace, args, Call::Intrinsic);
+        Stmt loads;
+        for (size_t i = 0; i < sources.size(); i++) {
+            vector<Expr> load_args;
+            load_args.push_back(sources[i]);
+            load_args.push_back(halide_trace_summary_load);
+            load_args.push_back(Variable::make(Int(32), id_name));
+            load_args.push_back(0);
+            load_args.push_back(counter((int)i + 2));
+            Stmt s = Evaluate::make(Call::make(Int(32), Call::trace, load_args, Call::Intrinsic));
+            loads = loads.defined() ? Block::make(loads, s) : s;
+        }
+        Stmt events;
+        if (loads.defined()) {
+            events = LetStmt::make(id_name, summary_call, loads);
+        } else {
+            events = Evaluate::make(summary_call);
+        }
+
+        Stmt result = Block::make(init, Block::make(body, Block::make(finish, events)));
+        return Allocate::make(counters, Int(64), vec<Expr>(num_counters), result);
+    }
+};
+
+class InjectTraceSummary : public IRMutator {
+    Function func;
+    using IRMutator::visit;
+
+    void visit(const Allocate *op) {
+        bool interleaved = func.outputs() > 1 && op->name == func.name();
+        string buffer = func.outputs() > 1 ? func.name() + ".0" : func.name();
+        if (op->name == buffer || interleaved) {
+            SummarizeRealization summary(func);
+            found = true;
+            stmt = Allocate::make(op->name, op->type, op->extents, summary.summarize(op->body));
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+public:
+    bool found;
+    InjectTraceSummary(Function f) : func(f), found(false) {}
+};
+
+}
+
+Stmt inject_trace_summaries(Stmt s, const map<string, Function> &env,
+                            const vector<Function> &outputs) {
+    bool all = tracing_summary_enabled();
+    bool injected = false;
+    for (map<string, Function>::const_iterator iter = env.begin(); iter != env.end(); ++iter) {
+        Function f = iter->second;
+        if (!all && !f.is_tracing_summary()) continue;
+
+        bool is_output = false;
+        for (size_t i = 0; i < outputs.size(); i++) {
+            is_output = is_output || outputs[i].same_as(f);
+        }
+
+        if (is_output) {
+            // The outputs have no allocation, so their realization is
+            // the whole pipeline.
+            SummarizeRealization summary(f);
+            s = summary.summarize(s);
+            injected = true;
+        } else {
+            InjectTraceSummary inject(f);
+            s = inject.mutate(s);
+            injected = injected || inject.found;
+        }
+    }
+
+    if (injected) {
+        Expr flush = Call::make(Int(32), "halide_shutdown_trace", vector<Expr>(), Call::Extern);
+        s = Block::make(s, AssertStmt::make(flush == 0, "Failed to flush trace", vector<Expr>()));
+    }
+    return s;
+}
+
 }
 }
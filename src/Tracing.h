@@ -15,7 +15,15 @@ namespace Internal {
  * tracing functions at interesting points, such as
  * allocations. Should be done before storage flattening, but after
  * all bounds inference. */
-Stmt inject_tracing(Stmt, const std::map<std::string, Function> &env, Function output);
+Stmt inject_tracing(Stmt, const std::map<std::string, Function> &env,
+                    const std::vector<Function> &outputs);
+
+/** Inject the counters and summary events of the Funcs marked with
+ * Func::trace_summary, or of all of them if HL_TRACE_SUMMARY=1. Should
+ * be done right after storage flattening, while the mins and extents
+ * of each realization are still defined. */
+Stmt inject_trace_summaries(Stmt, const std::map<std::string, Function> &env,
+                            const std::vector<Function> &outputs);
 
 }
 }
@@ -110,7 +110,8 @@ inline Type UInt(int bits, int width = 1) {
     return t;
 }
 
-/** Construct a floating-point type */
+/** Construct a floating-point type. Float(16) is a storage type:
+ * arithmetic on half-precision values is done in single precision. */
 inline Type Float(int bits, int width = 1) {
     Type t;
     t.code = Type::Float;
@@ -1,6 +1,6 @@
 #include "UnifyDuplicateLets.h"
 #include "IRMutator.h"
-#include "IREquality.h"
+#include "IRHash.h"
 #include <map>
 
 namespace Halide {
@@ -12,7 +12,7 @@ using std::string;
 class UnifyDuplicateLets : public IRMutator {
     using IRMutator::visit;
 
-    map<Expr, string, ExprDeepCompare> scope;
+    map<Expr, string, ExprHashCompare> scope;
     map<string, string> rewrites;
 
 public:
@@ -21,7 +21,7 @@ public:
     Expr mutate(Expr e) {
 
         if (e.defined()) {
-            map<Expr, string, ExprDeepCompare>::iterator iter = scope.find(e);
+            map<Expr, string, ExprHashCompare>::iterator iter = scope.find(e);
             if (iter != scope.end()) {
                 expr = Variable::make(e.type(), iter->second);
             } else {
@@ -59,7 +59,7 @@ protected:
         bool should_pop = false;
 
         if (!contains_calls) {
-            map<Expr, string, ExprDeepCompare>::iterator iter = scope.find(value);
+            map<Expr, string, ExprHashCompare>::iterator iter = scope.find(value);
             if (iter == scope.end()) {
                 scope[value] = op->name;
                 should_pop = true;
@@ -77,11 +77,7 @@ protected:
             rewrites.erase(op->name);
         }
 
-        if (value.same_as(op->value) && body.same_as(op->body)) {
-            stmt = op;
-        } else {
-            stmt = LetStmt::make(op->name, value, body);
-        }
+        stmt = rebuild(op, value, body);
     }
 };
 
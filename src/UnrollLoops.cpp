@@ -3,15 +3,71 @@
 #include "IROperator.h"
 #include "Simplify.h"
 #include "Substitute.h"
+#include "ExprUsesVar.h"
+#include "Scope.h"
+#include "Debug.h"
 
 namespace Halide {
 namespace Internal {
 
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::vector;
+
 class UnrollLoops : public IRMutator {
     using IRMutator::visit;
 
+    // Put the copies of the body of a jammed loop inside the loop
+    // directly inside it, under any lets. Returns an undefined Stmt
+    // if there's no such loop, or its bounds depend on the jammed
+    // loop.
+    Stmt jam(const For *for_loop, Stmt body, int extent) {
+        vector<pair<string, Expr> > lets;
+        Scope<int> outer;
+        outer.push(for_loop->name, 0);
+        while (const LetStmt *let = body.as<LetStmt>()) {
+            lets.push_back(make_pair(let->name, let->value));
+            outer.push(let->name, 0);
+            body = let->body;
+        }
+
+        const For *inner = body.as<For>();
+        if (!inner ||
+            (inner->for_type != For::Serial && inner->for_type != For::Vectorized) ||
+            expr_uses_vars(inner->min, outer) ||
+            expr_uses_vars(inner->extent, outer)) {
+            return Stmt();
+        }
+
+        Stmt inner_body = inner->body;
+        for (size_t i = lets.size(); i > 0; i--) {
+            inner_body = LetStmt::make(lets[i-1].first, lets[i-1].second, inner_body);
+        }
+
+        Stmt block;
+        for (int i = extent-1; i >= 0; i--) {
+            Stmt iter = substitute(for_loop->name, for_loop->min + i, inner_body);
+            block = Block::make(iter, block);
+        }
+        return For::make(inner->name, inner->min, inner->extent, inner->for_type, block);
+    }
+
     void visit(const For *for_loop) {
-        if (for_loop->for_type == For::Unrolled) {
+        if (for_loop->for_type == For::Jammed) {
+            Expr extent = simplify(for_loop->extent);
+            const IntImm *e = extent.as<IntImm>();
+            assert(e && "Can only unroll and jam for loops over a constant extent");
+            Stmt body = mutate(for_loop->body);
+            stmt = jam(for_loop, body, e->value);
+            if (stmt.defined()) {
+                return;
+            }
+            std::cerr << "Warning: Can't jam the loop over " << for_loop->name
+                      << " into the loop inside it, so it's just unrolled\n";
+            stmt = mutate(For::make(for_loop->name, for_loop->min, for_loop->extent,
+                                    For::Unrolled, body));
+        } else if (for_loop->for_type == For::Unrolled) {
             // Give it one last chance to simplify to an int
             Expr extent = simplify(for_loop->extent);
             const IntImm *e = extent.as<IntImm>();
@@ -36,9 +92,40 @@ class UnrollLoops : public IRMutator {
     }
 };
 
+class LimitUnrolling : public IRMutator {
+    using IRMutator::visit;
+
+    int max_extent;
+
+    void visit(const For *for_loop) {
+        Stmt body = mutate(for_loop->body);
+        For::ForType for_type = for_loop->for_type;
+        if (for_type == For::Unrolled || for_type == For::Jammed) {
+            const IntImm *e = simplify(for_loop->extent).as<IntImm>();
+            if (e && e->value > max_extent) {
+                debug(2) << "Not unrolling the loop over " << for_loop->name
+                         << " of extent " << e->value << "\n";
+                for_type = For::Serial;
+            }
+        }
+        if (for_type == for_loop->for_type && body.same_as(for_loop->body)) {
+            stmt = for_loop;
+        } else {
+            stmt = For::make(for_loop->name, for_loop->min, for_loop->extent, for_type, body);
+        }
+    }
+
+public:
+    LimitUnrolling(int m) : max_extent(m) {}
+};
+
 Stmt unroll_loops(Stmt s) {
     return UnrollLoops().mutate(s);
 }
 
+Stmt limit_unrolling(Stmt s, int max_extent) {
+    return LimitUnrolling(max_extent).mutate(s);
+}
+
 }
 }
@@ -12,9 +12,15 @@ namespace Internal {
 
 /** Take a statement with for loops marked for unrolling, and convert
  * each into several copies of the innermost statement. I.e. unroll
- * the loop. */
+ * the loop. Loops marked as jammed have their copies put inside the
+ * loop directly inside them instead, if its bounds don't depend on
+ * them. */
 Stmt unroll_loops(Stmt);
 
+/** Mark loops to be unrolled or jammed over more than max_extent
+ * iterations as serial instead, to keep code small. */
+Stmt limit_unrolling(Stmt s, int max_extent);
+
 }
 }
 
@@ -1,6 +1,12 @@
 #include "Util.h"
 #include <sstream>
 #include <map>
+#ifdef _MSC_VER
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
 
 namespace Halide {
 namespace Internal {
@@ -10,9 +16,29 @@ using std::vector;
 using std::ostringstream;
 using std::map;
 
+namespace {
+// Guards the unique name counters, which code generators running on
+// several threads at once (see compile_batch_to_file) may use.
+volatile int unique_name_lock = 0;
+
+struct UniqueNameLock {
+    UniqueNameLock() {
+#ifdef __GNUC__
+        while (__sync_lock_test_and_set(&unique_name_lock, 1)) {}
+#endif
+    }
+    ~UniqueNameLock() {
+#ifdef __GNUC__
+        __sync_lock_release(&unique_name_lock);
+#endif
+    }
+};
+}
+
 string unique_name(char prefix) {
     // arrays with static storage duration should be initialized to zero automatically
     static int instances[256];
+    UniqueNameLock lock;
     ostringstream str;
     str << prefix << instances[(unsigned char)prefix]++;
     return str.str();
@@ -35,6 +61,27 @@ bool ends_with(const string &str, const string &suffix) {
     return true;
 }
 
+bool starts_with(const string &str, const string &prefix, char sep) {
+    return (str.size() > prefix.size() &&
+            str[prefix.size()] == sep &&
+            str.compare(0, prefix.size(), prefix) == 0);
+}
+
+bool ends_with(const string &str, char sep, const string &suffix) {
+    if (str.size() <= suffix.size()) return false;
+    size_t off = str.size() - suffix.size();
+    return str[off-1] == sep && str.compare(off, suffix.size(), suffix) == 0;
+}
+
+uint64_t hash_string(const string &str) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < str.size(); i++) {
+        h ^= (unsigned char)str[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
 /** Convert an integer to a string. */
 string int_to_string(int x) {
     // Most calls to this function are during lowering, and correspond
@@ -65,8 +112,8 @@ string unique_name(const string &name, bool user) {
         }
     }
 
-    int &count = known_names[name];
-    count++;
+    UniqueNameLock lock;
+    int count = ++known_names[name];
     if (count == 1) {
         // The very first unique name is the original function name itself.
         return name;
@@ -86,6 +133,18 @@ string base_name(const string &name, char delim) {
     return name.substr(off+1);
 }
 
+double current_time_ms() {
+    #ifdef _MSC_VER
+    LARGE_INTEGER ticks, freq;
+    QueryPerformanceCounter(&ticks);
+    QueryPerformanceFrequency(&freq);
+    return ticks.QuadPart * 1000.0 / freq.QuadPart;
+    #else
+    timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec * 1000.0 + t.tv_usec / 1000.0;
+    #endif
+}
 
 }
 }
@@ -16,6 +16,7 @@
 #include <vector>
 #include <string>
 #include <cstring>
+#include <stdint.h>
 
 // by default, the symbol EXPORT does nothing. In windows dll builds we can define it to __declspec(dllexport)
 #if defined(_WIN32) && defined(Halide_SHARED)
@@ -147,9 +148,27 @@ EXPORT bool starts_with(const std::string &str, const std::string &prefix);
 /** Test if the first string ends with the second string */
 EXPORT bool ends_with(const std::string &str, const std::string &suffix);
 
+/** Test if the first string starts with the second string followed
+ * by the separator, e.g. "f.s0.x" starts with "f" and '.'. This is
+ * the same as starts_with(str, prefix + sep), without building the
+ * concatenated string. */
+EXPORT bool starts_with(const std::string &str, const std::string &prefix, char sep);
+
+/** Test if the first string ends with the separator followed by the
+ * second string, e.g. "f.s0.x" ends with '.' and "x". */
+EXPORT bool ends_with(const std::string &str, char sep, const std::string &suffix);
+
+/** A 64-bit hash of a string (FNV-1a). Used to key tables of names,
+ * which often share long prefixes and so are slow to compare. */
+EXPORT uint64_t hash_string(const std::string &str);
+
 /** Return the final token of the name string using the given delimiter. */
 EXPORT std::string base_name(const std::string &name, char delim = '.');
 
+/** The wall-clock time in milliseconds, from an arbitrary start. For
+ * timing compilation and candidate schedules. */
+EXPORT double current_time_ms();
+
 template<typename UnsignedType>
 bool checked_multiply(const UnsignedType &a, const UnsignedType &c, UnsignedType &result) {
   if (a == 0) {
@@ -0,0 +1,98 @@
+#include <algorithm>
+
+#include "VectorWidth.h"
+#include "IRVisitor.h"
+#include "Debug.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+class WidestType : public IRVisitor {
+    using IRVisitor::visit;
+
+    void include(Type t) {
+        if (!t.is_handle() && t.bits > result.bits) {
+            result = t;
+            result.width = 1;
+        }
+    }
+
+    void visit(const Variable *op) {
+        include(op->type);
+    }
+
+    void visit(const Cast *op) {
+        include(op->type);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Load *op) {
+        include(op->type);
+    }
+
+    void visit(const Call *op) {
+        include(op->type);
+        if (op->call_type != Call::Halide && op->call_type != Call::Image) {
+            IRVisitor::visit(op);
+        }
+    }
+
+public:
+    Type result;
+    WidestType() : result(Bool()) {}
+
+    void include(const vector<Expr> &exprs) {
+        for (size_t i = 0; i < exprs.size(); i++) {
+            include(exprs[i].type());
+            exprs[i].accept(this);
+        }
+    }
+};
+
+}
+
+Type widest_type(Function f) {
+    WidestType w;
+    w.include(f.values());
+    const vector<ReductionDefinition> &reductions = f.reductions();
+    for (size_t i = 0; i < reductions.size(); i++) {
+        w.include(reductions[i].values);
+    }
+    return w.result;
+}
+
+int natural_vector_size(Function f, const Target &t) {
+    return std::max(1, t.natural_vector_size(widest_type(f)));
+}
+
+void choose_vector_widths(const map<string, Function> &env, const Target &t) {
+    for (map<string, Function>::const_iterator iter = env.begin();
+         iter != env.end(); ++iter) {
+        Function f = iter->second;
+        vector<Schedule *> schedules(1, &f.schedule());
+        for (size_t i = 0; i < f.reductions().size(); i++) {
+            schedules.push_back(&f.reduction_schedule(i));
+        }
+        int width = 0;
+        for (size_t i = 0; i < schedules.size(); i++) {
+            vector<Schedule::Split> &splits = schedules[i]->splits;
+            for (size_t j = 0; j < splits.size(); j++) {
+                if (!splits[j].natural_width) continue;
+                if (!width) {
+                    width = natural_vector_size(f, t);
+                    debug(2) << "The natural vector size of " << f.name() << " is " << width << "\n";
+                }
+                splits[j].factor = width;
+            }
+        }
+    }
+}
+
+}
+}
@@ -0,0 +1,37 @@
+#ifndef HALIDE_VECTOR_WIDTH_H
+#define HALIDE_VECTOR_WIDTH_H
+
+/** \file
+ * Defines the choice of vector widths for functions vectorized by
+ * the natural vector size of the target.
+ */
+
+#include <map>
+#include <string>
+
+#include "IR.h"
+#include "Function.h"
+#include "Target.h"
+
+namespace Halide {
+namespace Internal {
+
+/** The widest type a function computes with, over its values and
+ * those of its updates. The arguments of the calls and loads in them
+ * are left out, since they're indices. */
+Type widest_type(Function f);
+
+/** The number of lanes of the widest type of a function that fit in a
+ * vector register of the target. */
+int natural_vector_size(Function f, const Target &t);
+
+/** Set the factor of each split made by vectorize_natural to the
+ * natural vector size of its function on the target. The splits keep
+ * their mark, so lowering for another target chooses again. Must run
+ * before the loop nests are made. */
+void choose_vector_widths(const std::map<std::string, Function> &env, const Target &t);
+
+}
+}
+
+#endif
@@ -7,6 +7,7 @@
 #include "Deinterleave.h"
 #include "Substitute.h"
 #include "IROperator.h"
+#include "IREquality.h"
 
 namespace Halide {
 namespace Internal {
@@ -14,6 +15,86 @@ namespace Internal {
 using std::string;
 using std::vector;
 
+// Guard the loads and stores of a vectorized statement with a vector
+// predicate, so that a vector if statement can be done without
+// scalarizing it. Only statements made of stores, lets, and ifs are
+// handled, and only if all of their loads and stores have the width
+// of the predicate. Check 'ok' once done.
+class PredicateLoadsAndStores : public IRMutator {
+    Expr predicate;
+
+    using IRMutator::visit;
+
+    Expr merge(Expr p) {
+        return p.defined() ? (predicate && p) : predicate;
+    }
+
+    void visit(const Load *op) {
+        if (op->type.width != predicate.type().width) {
+            ok = false;
+            expr = op;
+            return;
+        }
+        Expr index = mutate(op->index);
+        expr = Load::make(op->type, op->name, index, op->image, op->param, merge(op->predicate));
+    }
+
+    void visit(const Store *op) {
+        if (op->value.type().width != predicate.type().width) {
+            ok = false;
+            stmt = op;
+            return;
+        }
+        Expr value = mutate(op->value);
+        Expr index = mutate(op->index);
+        stmt = Store::make(op->name, value, index, merge(op->predicate));
+    }
+
+    void visit(const Call *op) {
+        // Calls to the math library are safe to do in every lane, but
+        // other extern calls may have side-effects.
+        if (op->call_type == Call::Extern &&
+            !ends_with(op->name, "_f32") && !ends_with(op->name, "_f64")) {
+            ok = false;
+        }
+        IRMutator::visit(op);
+    }
+
+    void visit(const For *op) {ok = false; stmt = op;}
+    void visit(const Pipeline *op) {ok = false; stmt = op;}
+    void visit(const AssertStmt *op) {ok = false; stmt = op;}
+    void visit(const Allocate *op) {ok = false; stmt = op;}
+    void visit(const Free *op) {ok = false; stmt = op;}
+    void visit(const Evaluate *op) {ok = false; stmt = op;}
+
+    // Ifs nested inside are predicated on their conditions too. The
+    // then and else cases of an if on a scalar condition just have
+    // their loads and stores guarded.
+    void visit(const IfThenElse *op) {
+        Expr condition = mutate(op->condition);
+        if (condition.type().width == 1) {
+            IRMutator::visit(op);
+            return;
+        }
+        if (condition.type().width != predicate.type().width) {
+            ok = false;
+            stmt = op;
+            return;
+        }
+        Expr old_predicate = predicate;
+        predicate = old_predicate && condition;
+        Stmt then_case = mutate(op->then_case);
+        predicate = old_predicate && !condition;
+        Stmt else_case = mutate(op->else_case);
+        predicate = old_predicate;
+        stmt = else_case.defined() ? Block::make(then_case, else_case) : then_case;
+    }
+
+public:
+    bool ok;
+    PredicateLoadsAndStores(Expr p) : predicate(p), ok(true) {}
+};
+
 class VectorizeLoops : public IRMutator {
     class VectorSubs : public IRMutator {
         string var;
@@ -133,11 +214,18 @@ class VectorizeLoops : public IRMutator {
 
 
 
-            if (index.same_as(op->index)) {
+            Expr predicate = mutate(op->predicate);
+
+            if (index.same_as(op->index) && predicate.same_as(op->predicate)) {
                 expr = op;
             } else {
                 int w = index.type().width;
-                expr = Load::make(op->type.vector_of(w), op->name, index, op->image, op->param);
+                if (predicate.defined()) {
+                    w = std::max(w, predicate.type().width);
+                    index = widen(index, w);
+                    predicate = widen(predicate, w);
+                }
+                expr = Load::make(op->type.vector_of(w), op->name, index, op->image, op->param, predicate);
             }
         }
 
@@ -179,11 +267,7 @@ class VectorizeLoops : public IRMutator {
                 scope.pop(op->name);
             }
 
-            if (value.same_as(op->value) && body.same_as(op->body)) {
-                expr = op;
-            } else {
-                expr = Let::make(op->name, value, body);
-            }
+            expr = rebuild(op, value, body);
         }
 
         void visit(const LetStmt *op) {
@@ -198,11 +282,7 @@ class VectorizeLoops : public IRMutator {
                 scope.pop(op->name);
             }
 
-            if (value.same_as(op->value) && body.same_as(op->body)) {
-                stmt = op;
-            } else {
-                stmt = LetStmt::make(op->name, value, body);
-            }
+            stmt = rebuild(op, value, body);
         }
 
         void visit(const Provide *op) {
@@ -262,11 +342,77 @@ class VectorizeLoops : public IRMutator {
                 }
             }
 
-            if (value.same_as(op->value) && index.same_as(op->index)) {
+            if (!scalarized && value.type().is_vector() && index.type().is_scalar()) {
+                // A vector of values to store at a single
+                // location. This happens when vectorizing a reduction
+                // variable that doesn't appear on the left-hand-side.
+                Expr reduced = reduce_across_lanes(op);
+                if (reduced.defined()) {
+                    stmt = Store::make(op->name, reduced, index);
+                } else {
+                    stmt = scalarize(op);
+                }
+                return;
+            }
+
+            Expr predicate = mutate(op->predicate);
+
+            if (value.same_as(op->value) && index.same_as(op->index) &&
+                predicate.same_as(op->predicate)) {
                 stmt = op;
             } else {
                 int width = std::max(value.type().width, index.type().width);
-                stmt = Store::make(op->name, widen(value, width), widen(index, width));
+                if (predicate.defined()) {
+                    width = std::max(width, predicate.type().width);
+                    predicate = widen(predicate, width);
+                }
+                stmt = Store::make(op->name, widen(value, width), widen(index, width), predicate);
+            }
+        }
+
+        // Is an expression a load of the value a store overwrites.
+        bool is_accumulator(Expr e, const Store *op) {
+            const Load *load = e.as<Load>();
+            return load && load->name == op->name && equal(load->index, op->index);
+        }
+
+        // If a store is an associative update of a single location,
+        // e.g. f[i] = f[i] + g[r], where the term being accumulated
+        // is a vector, return the value with the terms summed across
+        // the lanes first. Otherwise return an undefined Expr.
+        Expr reduce_across_lanes(const Store *op) {
+            Expr a, b;
+            string reduce;
+            if (const Add *add = op->value.as<Add>()) {
+                a = add->a; b = add->b; reduce = Call::vector_reduce_add;
+            } else if (const Min *mn = op->value.as<Min>()) {
+                a = mn->a; b = mn->b; reduce = Call::vector_reduce_min;
+            } else if (const Max *mx = op->value.as<Max>()) {
+                a = mx->a; b = mx->b; reduce = Call::vector_reduce_max;
+            } else {
+                return Expr();
+            }
+
+            if (!is_accumulator(a, op)) {
+                std::swap(a, b);
+            }
+            if (!is_accumulator(a, op)) {
+                return Expr();
+            }
+
+            a = mutate(a);
+            b = mutate(b);
+            if (a.type().is_vector() || b.type().is_scalar()) {
+                return Expr();
+            }
+
+            Expr reduced = Call::make(a.type(), reduce, vec(b), Call::Intrinsic);
+            if (reduce == Call::vector_reduce_add) {
+                return Add::make(a, reduced);
+            } else if (reduce == Call::vector_reduce_min) {
+                return Min::make(a, reduced);
+            } else {
+                return Max::make(a, reduced);
             }
         }
 
@@ -274,6 +420,63 @@ class VectorizeLoops : public IRMutator {
             stmt = scalarize(op);
         }
 
+        // Is a vector expression an affine function of the lane index.
+        bool is_affine_in_lanes(Expr e) {
+            if (e.type().is_scalar() || e.as<Broadcast>() || e.as<Ramp>()) {
+                return true;
+            } else if (const Add *add = e.as<Add>()) {
+                return is_affine_in_lanes(add->a) && is_affine_in_lanes(add->b);
+            } else if (const Sub *sub = e.as<Sub>()) {
+                return is_affine_in_lanes(sub->a) && is_affine_in_lanes(sub->b);
+            } else if (const Mul *mul = e.as<Mul>()) {
+                return ((mul->a.as<Broadcast>() && is_affine_in_lanes(mul->b)) ||
+                        (mul->b.as<Broadcast>() && is_affine_in_lanes(mul->a)));
+            } else if (const Variable *v = e.as<Variable>()) {
+                return scope.contains(v->name) && is_affine_in_lanes(scope.get(v->name));
+            } else {
+                return false;
+            }
+        }
+
+        // If a vector condition holds in every lane whenever it holds
+        // in the first and last lanes (e.g. a comparison of affine
+        // functions of the lane), return that it holds in those two
+        // lanes. Otherwise return an undefined Expr.
+        Expr all_lanes_condition(Expr cond) {
+            int width = cond.type().width;
+            Expr a, b;
+            if (const And *op = cond.as<And>()) {
+                Expr ca = all_lanes_condition(op->a);
+                Expr cb = all_lanes_condition(op->b);
+                if (ca.defined() && cb.defined()) {
+                    return ca && cb;
+                }
+                return Expr();
+            } else if (const LT *op = cond.as<LT>()) {
+                a = op->a; b = op->b;
+            } else if (const LE *op = cond.as<LE>()) {
+                a = op->a; b = op->b;
+            } else if (const GT *op = cond.as<GT>()) {
+                a = op->a; b = op->b;
+            } else if (const GE *op = cond.as<GE>()) {
+                a = op->a; b = op->b;
+            } else {
+                return Expr();
+            }
+            if (is_affine_in_lanes(a) && is_affine_in_lanes(b)) {
+                return extract_lane(cond, 0) && extract_lane(cond, width - 1);
+            }
+            return Expr();
+        }
+
+        // Whether a vector condition holds in any lane.
+        Expr any_lane_condition(Expr cond) {
+            Type t = UInt(8, cond.type().width);
+            Expr lanes = Select::make(cond, make_one(t), make_zero(t));
+            Expr any = Call::make(UInt(8), Call::vector_reduce_max, vec(lanes), Call::Intrinsic);
+            return any != make_zero(UInt(8));
+        }
+
         void visit(const IfThenElse *op) {
             Expr cond = mutate(op->condition);
             int width = cond.type().width;
@@ -284,8 +487,42 @@ class VectorizeLoops : public IRMutator {
                 // It's an if statement on a vector of
                 // conditions. We'll have to scalarize and make
                 // multiple copies of the if statement.
-                debug(3) << "Scalarizing if then else\n";
-                stmt = scalarize(op);
+                Stmt then_case = mutate(op->then_case);
+                Stmt else_case = mutate(op->else_case);
+
+                // If the body is just loads and stores, we can
+                // predicate them on the condition instead.
+                PredicateLoadsAndStores then_pred(cond), else_pred(!cond);
+                Stmt fallback = then_pred.mutate(then_case);
+                if (else_case.defined()) {
+                    fallback = Block::make(fallback, else_pred.mutate(else_case));
+                }
+                if (!then_pred.ok || !else_pred.ok) {
+                    debug(3) << "Scalarizing if then else\n";
+                    fallback = scalarize(op);
+                }
+
+                // Skip the predicated or scalarized version when the
+                // condition holds in no lane, which is common for
+                // data-dependent conditions, and do the else case a
+                // vector at a time.
+                if (else_case.defined()) {
+                    fallback = IfThenElse::make(any_lane_condition(cond), fallback, else_case);
+                } else {
+                    fallback = IfThenElse::make(any_lane_condition(cond), fallback);
+                }
+
+                // If we can tell cheaply that the condition holds in
+                // every lane, do the then case a vector at a time, and
+                // only fall back to the other version when it
+                // doesn't. This is the case for the guards made for
+                // splits with Tail_GuardWithIf.
+                Expr all_lanes = all_lanes_condition(cond);
+                if (all_lanes.defined()) {
+                    stmt = IfThenElse::make(all_lanes, then_case, fallback);
+                } else {
+                    stmt = fallback;
+                }
             } else {
                 // It's an if statement on a scalar, we're ok to vectorize the innards.
                 debug(3) << "Not scalarizing if then else\n";
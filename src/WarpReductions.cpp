@@ -0,0 +1,153 @@
+#include "WarpReductions.h"
+#include "IRMutator.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "ExprUsesVar.h"
+#include "CodeGen_GPU_Dev.h"
+#include "Scope.h"
+#include "Util.h"
+#include "Debug.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+
+namespace {
+
+const int warp_size = 32;
+
+// Check that every loop over threadidx in a kernel has a constant
+// extent that's a multiple of the warp size. Then the block is too,
+// and each warp is a run of lanes with the same thread ids in the
+// other dimensions.
+class ThreadLoopsWarpAligned : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const For *op) {
+        if (ends_with(op->name, ".threadidx")) {
+            const int *extent = as_const_int(op->extent);
+            if (!extent || *extent % warp_size != 0) {
+                result = false;
+            }
+        }
+        IRVisitor::visit(op);
+    }
+public:
+    bool result;
+    ThreadLoopsWarpAligned() : result(true) {}
+};
+
+class ReduceAtomicsAcrossWarps : public IRMutator {
+    using IRMutator::visit;
+
+    bool in_kernel;
+
+    // The lane within its warp of the current thread, if inside a
+    // loop over threadidx of a warp-aligned kernel.
+    Expr lane;
+
+    // The names whose values may differ between the lanes of a warp.
+    Scope<int> varying;
+
+    // Whether the lanes of a warp may not all get to the current
+    // statement together.
+    bool divergent;
+
+    void visit(const For *op) {
+        if (!in_kernel && CodeGen_GPU_Dev::is_gpu_var(op->name)) {
+            ThreadLoopsWarpAligned aligned;
+            op->accept(&aligned);
+            if (!aligned.result) {
+                stmt = op;
+                return;
+            }
+            in_kernel = true;
+            IRMutator::visit(op);
+            in_kernel = false;
+        } else if (in_kernel && ends_with(op->name, ".threadidx")) {
+            Expr old_lane = lane;
+            lane = (Variable::make(Int(32), op->name) - op->min) % warp_size;
+            varying.push(op->name, 0);
+            IRMutator::visit(op);
+            varying.pop(op->name);
+            lane = old_lane;
+        } else if (lane.defined() &&
+                   (expr_uses_vars(op->min, varying) || expr_uses_vars(op->extent, varying))) {
+            bool old_divergent = divergent;
+            divergent = true;
+            varying.push(op->name, 0);
+            IRMutator::visit(op);
+            varying.pop(op->name);
+            divergent = old_divergent;
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const LetStmt *op) {
+        bool varies = lane.defined() && expr_uses_vars(op->value, varying);
+        if (varies) varying.push(op->name, 0);
+        IRMutator::visit(op);
+        if (varies) varying.pop(op->name);
+    }
+
+    void visit(const IfThenElse *op) {
+        bool old_divergent = divergent;
+        if (lane.defined() && expr_uses_vars(op->condition, varying)) {
+            divergent = true;
+        }
+        IRMutator::visit(op);
+        divergent = old_divergent;
+    }
+
+    void visit(const Evaluate *op) {
+        const Call *call = op->value.as<Call>();
+        if (!lane.defined() || divergent || !call ||
+            call->call_type != Call::Intrinsic || call->name != Call::atomic_add) {
+            IRMutator::visit(op);
+            return;
+        }
+        const Load *load = call->args[0].as<Load>();
+        Type t = call->type;
+        if (!load || !t.is_scalar() || t.bits != 32 ||
+            expr_uses_vars(load->index, varying)) {
+            IRMutator::visit(op);
+            return;
+        }
+
+        debug(3) << "Reducing the atomic add to " << load->name << " across warps\n";
+
+        // Fold the upper half of the warp onto the lower half until
+        // lane zero has the sum of the whole warp.
+        string base = unique_name('w'), name = base;
+        Expr sum = Variable::make(t, name);
+        Stmt s = IfThenElse::make(lane == 0,
+                                  Evaluate::make(Call::make(t, Call::atomic_add, vec<Expr>(load, sum),
+                                                            Call::Intrinsic)));
+        for (int delta = 1; delta < warp_size; delta *= 2) {
+            string prev = base + "." + int_to_string(delta);
+            Expr prev_sum = Variable::make(t, prev);
+            Expr shuffled = Call::make(t, Call::gpu_shuffle_down, vec<Expr>(prev_sum, delta),
+                                       Call::Intrinsic);
+            s = LetStmt::make(name, prev_sum + shuffled, s);
+            name = prev;
+        }
+        stmt = LetStmt::make(name, call->args[1], s);
+    }
+
+public:
+    ReduceAtomicsAcrossWarps() : in_kernel(false), divergent(false) {}
+};
+
+}
+
+Stmt reduce_atomics_across_warps(Stmt s, const Target &t) {
+    if (!(t.features & Target::CUDA) || !(t.features & Target::CUDACapability30)) {
+        return s;
+    }
+    return ReduceAtomicsAcrossWarps().mutate(s);
+}
+
+}
+}
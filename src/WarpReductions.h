@@ -0,0 +1,27 @@
+#ifndef HALIDE_WARP_REDUCTIONS_H
+#define HALIDE_WARP_REDUCTIONS_H
+
+/** \file
+ * Defines a lowering pass that combines the atomic adds of the lanes
+ * of a CUDA warp.
+ */
+
+#include "IR.h"
+#include "Target.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Find atomic adds in gpu kernels to an address that every lane of
+ * a warp reaches together, such as a sum over an RVar that was made
+ * the gpu thread loop, and sum the values across the warp with
+ * shuffles first, so that only one lane does the atomic add. Only
+ * done for CUDA targets with warp shuffles (compute capability 3.0),
+ * in kernels whose thread loops over x all have extents that are
+ * multiples of the warp size, so that warps never straddle them. */
+Stmt reduce_atomics_across_warps(Stmt s, const Target &t);
+
+}
+}
+
+#endif
@@ -0,0 +1,196 @@
+#include "Workspace.h"
+#include "AllocationUtils.h"
+#include "IRMutator.h"
+#include "IRVisitor.h"
+#include "IROperator.h"
+#include "Substitute.h"
+#include "Scope.h"
+#include "Debug.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+using std::pair;
+using std::make_pair;
+
+namespace {
+
+class CarveWorkspace : public IRMutator {
+    using IRMutator::visit;
+
+    const Parameter &workspace;
+    const Scope<int> &defined;
+    int loop_depth, if_depth;
+
+    // The lets outside of any loop that are around the statement
+    // being mutated, outermost first.
+    vector<pair<string, Expr> > lets;
+
+    // The buffers placed in the workspace that haven't been freed
+    // yet, and the variables holding the ends of their space.
+    vector<pair<string, Expr> > live;
+
+    Scope<int> carved;
+
+    void end_lifetime(const string &name) {
+        for (size_t i = 0; i < live.size(); i++) {
+            if (live[i].first == name) {
+                live.erase(live.begin() + i);
+                return;
+            }
+        }
+    }
+
+    void visit(const For *op) {
+        loop_depth++;
+        IRMutator::visit(op);
+        loop_depth--;
+    }
+
+    void visit(const IfThenElse *op) {
+        if_depth++;
+        IRMutator::visit(op);
+        if_depth--;
+    }
+
+    void visit(const LetStmt *op) {
+        if (loop_depth == 0) {
+            lets.push_back(make_pair(op->name, op->value));
+            IRMutator::visit(op);
+            lets.pop_back();
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const Allocate *op) {
+        if (loop_depth > 0 || small_constant_size(op)) {
+            IRMutator::visit(op);
+            return;
+        }
+
+        // The size in bytes, in terms of the arguments of the
+        // pipeline, so that it can be computed up front.
+        Expr size = Cast::make(Int(64), op->type.bytes());
+        for (size_t i = 0; i < op->extents.size(); i++) {
+            size = size * Cast::make(Int(64), op->extents[i]);
+        }
+        for (size_t i = lets.size(); i > 0; i--) {
+            size = substitute(lets[i-1].first, lets[i-1].second, size);
+        }
+        UsesDefinitions uses(defined, true);
+        size.accept(&uses);
+        if (uses.result) {
+            debug(2) << "Leaving " << op->name << " on the heap, because its size "
+                     << "isn't known until the pipeline runs\n";
+            IRMutator::visit(op);
+            return;
+        }
+
+        // Round up to a multiple of 32 bytes, the alignment codegen
+        // assumes of internal allocations.
+        size = ((size + 31) / 32) * 32;
+
+        // Go after all the buffers that are still live.
+        Expr offset = make_zero(Int(64));
+        for (size_t i = 0; i < live.size(); i++) {
+            offset = max(offset, live[i].second);
+        }
+
+        string prefix = workspace.name() + "." + op->name;
+        Expr offset_var = Variable::make(Int(64), prefix + ".offset");
+        Expr end_var = Variable::make(Int(64), prefix + ".end");
+        placements.push_back(make_pair(prefix + ".offset", offset));
+        placements.push_back(make_pair(prefix + ".end", offset_var + size));
+        ends.push_back(end_var);
+        debug(3) << "Placing " << op->name << " in the workspace\n";
+
+        live.push_back(make_pair(op->name, end_var));
+        carved.push(op->name, 0);
+        Stmt body = mutate(op->body);
+        carved.pop(op->name);
+        end_lifetime(op->name);
+
+        Expr base = Load::make(UInt(8), workspace.name(), Cast::make(Int(32), offset_var),
+                               Buffer(), workspace);
+        Expr ptr = Call::make(Handle(), Call::address_of, vec(base), Call::Intrinsic);
+        stmt = LetStmt::make(op->name + ".host", ptr, body);
+    }
+
+    void visit(const Free *op) {
+        if (carved.contains(op->name)) {
+            // A free that might not happen doesn't end the lifetime,
+            // which instead ends with the Allocate node.
+            if (loop_depth == 0 && if_depth == 0) {
+                end_lifetime(op->name);
+            }
+            stmt = Evaluate::make(0);
+        } else {
+            stmt = op;
+        }
+    }
+
+public:
+    // The lets that compute where each buffer goes, in order.
+    vector<pair<string, Expr> > placements;
+    vector<Expr> ends;
+
+    CarveWorkspace(const Parameter &w, const Scope<int> &d) :
+        workspace(w), defined(d), loop_depth(0), if_depth(0) {}
+};
+
+}
+
+Stmt carve_workspace(Stmt s, const Parameter &workspace, const Target &t) {
+    assert(workspace.is_buffer() && workspace.type() == UInt(8) &&
+           "The workspace must be a buffer of uint8");
+
+    vector<pair<string, Expr> > placements;
+    vector<Expr> ends;
+    if (t.has_gpu_feature()) {
+        // Buffers on the gpu are allocated by the gpu runtime.
+        debug(1) << "Not placing any buffers in the workspace, because the target uses a gpu\n";
+    } else {
+        FindDefinitions defs;
+        s.accept(&defs);
+        CarveWorkspace carver(workspace, defs.defined);
+        s = carver.mutate(s);
+        placements = carver.placements;
+        ends = carver.ends;
+    }
+
+    const string &name = workspace.name();
+    Expr total = make_zero(Int(64));
+    for (size_t i = 0; i < ends.size(); i++) {
+        total = max(total, ends[i]);
+    }
+    Expr total_var = Variable::make(Int(64), name + ".total_size");
+
+    Expr extent = Variable::make(Int(32), name + ".extent.0", workspace);
+    Stmt check = AssertStmt::make(Cast::make(Int(64), extent) >= total_var,
+                                  "Workspace " + name + " is too small for the pipeline",
+                                  vec(extent, total_var));
+    s = Block::make(check, s);
+
+    // In query mode, give the workspace the size the pipeline needs.
+    Expr query = Variable::make(UInt(1), name + ".host_and_dev_are_null", workspace);
+    Expr buffer = Variable::make(Handle(), name + ".buffer", workspace);
+    vector<Expr> args = vec(buffer, Expr(1), Expr(0), Cast::make(Int(32), total_var), Expr(1));
+    Stmt rewrite = Evaluate::make(Call::make(UInt(1), Call::rewrite_buffer, args, Call::Intrinsic));
+    s = IfThenElse::make(query, rewrite, s);
+
+    Stmt overflow = AssertStmt::make(total_var <= Cast::make(Int(64), Int(32).max()),
+                                     "The workspace " + name + " would need more than 2^31 - 1 bytes",
+                                     vector<Expr>());
+    s = Block::make(overflow, s);
+    s = LetStmt::make(name + ".total_size", total, s);
+    for (size_t i = placements.size(); i > 0; i--) {
+        s = LetStmt::make(placements[i-1].first, placements[i-1].second, s);
+    }
+    return s;
+}
+
+}
+}
@@ -0,0 +1,31 @@
+#ifndef HALIDE_WORKSPACE_H
+#define HALIDE_WORKSPACE_H
+
+/** \file
+ * Defines the lowering pass that places intermediate buffers in a
+ * workspace owned by the caller.
+ */
+
+#include "IR.h"
+#include "Parameter.h"
+#include "Target.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Place the buffers that are allocated outside of any loop, and
+ * would go on the heap, in the one dimensional uint8 buffer
+ * workspace, instead of allocating them with halide_malloc. A buffer
+ * reuses the space of the ones that were freed (see EarlyFree.h)
+ * before it's allocated, unless a buffer that's still live was put
+ * after them. If the host pointer of the workspace is NULL, the
+ * pipeline sets its extent to the number of bytes it needs (which
+ * depends on the sizes of the other buffers passed in), and returns
+ * without doing anything else. Otherwise it checks that the
+ * workspace is big enough. Must be the last lowering pass. */
+Stmt carve_workspace(Stmt s, const Parameter &workspace, const Target &t);
+
+}
+}
+
+#endif
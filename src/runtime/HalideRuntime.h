@@ -80,6 +80,195 @@ extern int halide_do_par_for(void *user_context,
 extern void halide_shutdown_thread_pool();
 //@}
 
+/** Set the number of threads used by the default thread pool,
+ * including the thread that calls into the pipeline. Passing zero
+ * restores the default (HL_NUMTHREADS if this is the first use of the
+ * pool, otherwise the number of cpus). The pool grows or shrinks in
+ * place, so there is no need to call halide_shutdown_thread_pool
+ * first. Should not be called while a pipeline is running. Returns the
+ * previous size, or zero if the pool had not started yet. Only the
+ * posix and Windows thread pools can be resized. On Linux machines with more than
+ * one NUMA node, workers are also pinned round-robin to the nodes,
+ * unless HL_NUMA=0. */
+extern int halide_set_num_threads(int n);
+
+/** Get the number of threads, including the calling thread, that
+ * parallel loops run with the given user_context will be spread
+ * across. Jitted and generated code calls this to decide how many
+ * copies of per-thread scratch buffers to make. */
+extern int halide_get_num_threads(void *user_context);
+
+/** Get the size in bytes of the data cache at the given level (1, 2,
+ * or 3) of the machine, as reported by the OS, or a typical size if
+ * it doesn't say. Pipelines that use Halide::host_cache_size in their
+ * schedules call this. */
+extern int halide_host_cache_size(int level);
+
+/** Get the time in nanoseconds since the runtime's clock was started,
+ * like halide_current_time_ns, but by reading a hardware counter
+ * rather than making a syscall, so it's cheap enough to call around
+ * each task or tile and from any thread. The counter is the time stamp
+ * counter on x86 (if it's invariant) and the generic timer on aarch64,
+ * calibrated against the OS clock the first time this is called. Set
+ * HL_CYCLE_CLOCK=0, or use another architecture, to get the OS clock
+ * instead. */
+extern int64_t halide_fast_time_ns(void *user_context);
+
+/** On Android, restrict the thread pools to the big cores of a
+ * big.LITTLE machine (the ones with the highest maximum clock rate),
+ * so that latency-critical pipelines aren't held up waiting on tasks
+ * that landed on slow cores. The default number of threads becomes
+ * the number of big cores. Must be called before the first parallel
+ * loop runs, since it only affects workers started afterwards. The
+ * default is the value of the environment variable HL_BIG_CORES, or
+ * off. Does nothing on other platforms. Combine it with a thread pool
+ * with a negative nice value (see halide_create_thread_pool) for
+ * pipelines such as camera previews. */
+extern void halide_set_big_cores_only(int enable);
+
+/** Separate thread pools, so that pipelines running concurrently do
+ * not compete for the same workers. A pool is created with its own
+ * number of threads (zero means the number of cpus) and a nice value
+ * for its workers (zero leaves it alone, positive values run them at
+ * a lower priority). halide_set_thread_pool routes every
+ * halide_do_par_for call made with the given user_context to the
+ * pool; passing a NULL pool goes back to the default one. A pool
+ * bound to the NULL user_context is also used by user_contexts that
+ * aren't bound to one of their own. It returns
+ * non-zero if too many user_contexts are already bound. Destroying a
+ * pool unbinds it. With Grand Central Dispatch (OS X and iOS), a pool
+ * is a global queue whose priority depends on the nice value
+ * (negative is high, positive is low, 15 and up is background), and
+ * each parallel loop is split into as many chunks as the pool has
+ * threads. With the posix thread pool (linux and Android), a pool has
+ * its own workers, and the nice value is applied to each of
+ * them. Elsewhere everything runs on the default pool. */
+//@{
+struct halide_thread_pool;
+extern struct halide_thread_pool *halide_create_thread_pool(int num_threads, int priority);
+extern void halide_destroy_thread_pool(struct halide_thread_pool *pool);
+extern int halide_set_thread_pool(void *user_context, struct halide_thread_pool *pool);
+//@}
+
+/** Control how idle threads in a pool (NULL means the default pool)
+ * wait for new work. They first poll spin_count times, which makes
+ * launching the next parallel loop much cheaper at the cost of burning
+ * cpu while idle, and then sleep. If targeted_wakeup is non-zero, a
+ * new parallel loop only wakes as many sleeping threads as it has
+ * tasks for. The defaults are 2000 and true, or the values of the
+ * environment variables HL_SPIN_COUNT and HL_TARGETED_WAKEUP. Only
+ * the posix thread pool pays attention to this. */
+extern void halide_set_thread_pool_wakeup(struct halide_thread_pool *pool,
+                                          int spin_count, int targeted_wakeup);
+
+/** Pipelines compiled with the cancellable target feature call
+ * halide_is_cancelled with their user_context at the start of each
+ * parallel task and each iteration of each loop that contains another
+ * loop, and as soon as it returns non-zero they free what they have
+ * allocated and return halide_error_code_cancelled, without calling
+ * halide_error. The thread pool then skips the tasks of the parallel
+ * loop nobody has started, so an abandoned pipeline stops using the
+ * pool within about one task or row. halide_cancel marks a
+ * user_context as cancelled (-1 if too many are at once), and
+ * halide_uncancel clears it again, which should be done before the
+ * user_context is reused. To give each call a deadline instead, set a
+ * custom halide_is_cancelled that compares the clock with a deadline
+ * kept in the user_context, either with
+ * halide_set_custom_is_cancelled, Func::set_custom_is_cancelled, or
+ * by defining halide_is_cancelled in AOT code. It is called from
+ * every thread running the pipeline, so it should be cheap. */
+//@{
+#define halide_error_code_cancelled (-2)
+extern int halide_cancel(void *user_context);
+extern int halide_uncancel(void *user_context);
+extern int halide_is_cancelled(void *user_context);
+extern void halide_set_custom_is_cancelled(int (*is_cancelled)(void *user_context));
+//@}
+
+/** Pipelines compiled with the memory_budget target feature estimate
+ * the most bytes their internal allocations will need at once, from
+ * the sizes of their outputs, and call halide_check_memory_budget
+ * with it before doing anything else, including in a bounds
+ * query. Unless it's a bounds query, a non-zero result makes the
+ * pipeline return halide_error_code_over_memory_budget at once,
+ * without calling halide_error. The default version remembers the
+ * estimate (see halide_last_peak_memory), and refuses calls over the
+ * budget set with halide_set_memory_budget (zero, the default, for no
+ * budget). Replace it with halide_set_custom_check_memory_budget,
+ * Func::set_custom_check_memory_budget, or by defining
+ * halide_check_memory_budget in AOT code, e.g. to keep a budget per
+ * user_context. The estimate leaves out buffers on the stack and
+ * those whose sizes depend on values the pipeline computes. A library
+ * written by Func::compile_to_file_with_schedules tries the next
+ * schedule when one is over budget, so the schedules can be given in
+ * order of decreasing memory use. */
+//@{
+#define halide_error_code_over_memory_budget (-3)
+extern int halide_check_memory_budget(void *user_context, const char *pipeline,
+                                      int64_t bytes, int is_query);
+extern void halide_set_memory_budget(int64_t bytes);
+extern int64_t halide_last_peak_memory();
+extern void halide_set_custom_check_memory_budget(int (*check)(void *user_context, const char *pipeline,
+                                                               int64_t bytes, int is_query));
+//@}
+
+/** Pipelines compiled with the telemetry target feature time each
+ * call (bounds queries aside) with halide_fast_time_ns and add it to
+ * a latency histogram kept per pipeline name. Once one has run, the
+ * posix thread pool also records how many jobs are on each pool's
+ * stack whenever a parallel loop starts, and the CUDA and OpenCL
+ * runtimes count the bytes they copy each way. Everything is updated
+ * with atomic adds, without locks, so it can stay on in production.
+ * halide_get_runtime_stats copies all of it out; the copy is not
+ * taken at one instant if pipelines are running. The histograms have
+ * two buckets per power of two up to 2^32 (about 4 seconds of
+ * nanoseconds) and one for everything bigger;
+ * halide_histogram_percentile gives the top of the bucket holding a
+ * percentile (e.g. 50 or 99), or the largest value seen if that's
+ * smaller. Pipelines or pools beyond the first
+ * halide_runtime_stats_max_pipelines or
+ * halide_runtime_stats_max_pools are not recorded.
+ * halide_reset_runtime_stats zeroes everything, and should only be
+ * called when nothing is running. */
+//@{
+#define halide_runtime_stats_max_pipelines 32
+#define halide_runtime_stats_max_pools 8
+#define halide_histogram_buckets 64
+struct halide_histogram {
+    uint64_t count, sum, max;
+    uint64_t buckets[halide_histogram_buckets];
+};
+struct halide_pipeline_stats {
+    /** The name the pipeline was compiled with. */
+    const char *name;
+    /** Nanoseconds per call. Its count is the number of calls. */
+    struct halide_histogram latency_ns;
+};
+struct halide_pool_stats {
+    const struct halide_thread_pool *pool;
+    /** The number of jobs waiting on the pool, including the new one,
+     * each time a parallel loop starts. */
+    struct halide_histogram queue_depth;
+};
+struct halide_runtime_stats {
+    int num_pipelines;
+    struct halide_pipeline_stats pipelines[halide_runtime_stats_max_pipelines];
+    int num_pools;
+    struct halide_pool_stats pools[halide_runtime_stats_max_pools];
+    uint64_t bytes_to_device, bytes_to_host;
+};
+extern void halide_get_runtime_stats(struct halide_runtime_stats *stats);
+extern void halide_reset_runtime_stats();
+extern uint64_t halide_histogram_percentile(const struct halide_histogram *h, int percent);
+//@}
+
+/** The x86 instruction set features of the machine this is running
+ * on, as a bitmask of Target::Features (SSE41, AVX, AVX2, FMA, F16C
+ * and AVX512). Found with cpuid the first time it's called. Used by
+ * pipelines compiled for several targets to choose which version to
+ * run; only available in pipelines compiled for x86. */
+extern uint64_t halide_get_cpu_features();
+
 /** Define halide_malloc and halide_free to replace the default memory
  * allocator.  See Func::set_custom_allocator. (Specifically note that
  * halide_malloc must return a 32-byte aligned pointer, and it must be
@@ -91,15 +280,337 @@ extern void *halide_malloc(void *user_context, size_t x);
 extern void halide_free(void *user_context, void *ptr);
 //@}
 
+/** Called by pipelines compiled with the huge_pages target feature on
+ * each heap allocation they make, before first touching it. On Linux,
+ * asks for transparent huge pages for allocations of at least
+ * HL_HUGE_PAGE_THRESHOLD megabytes (default 4). A no-op elsewhere. */
+extern void halide_advise_huge_pages(void *user_context, void *ptr, int32_t size);
+
+/** The default halide_malloc can keep freed blocks in a cache of
+ * power-of-two size classes and hand them back out, so that
+ * intermediate buffers allocated inside loops, or afresh on each
+ * realization of a pipeline, don't go to malloc every time. The free
+ * lists are sharded across threads. It is off unless turned on with
+ * halide_use_allocator_cache or by setting HL_ALLOCATOR_CACHE=1, and
+ * holds on to at most max_cached_bytes (zero means 256 MB). Turn it
+ * on or off only when no pipeline is running.
+ * halide_release_allocator_cache returns every cached block to
+ * malloc. */
+//@{
+struct halide_allocator_cache_stats {
+    /** Allocations that were eligible for the cache. */
+    uint64_t allocations;
+    /** Allocations that were served from the cache. */
+    uint64_t hits;
+    /** Bytes currently held by the cache. */
+    uint64_t cached_bytes;
+};
+extern void halide_use_allocator_cache(int enable, size_t max_cached_bytes);
+extern void halide_release_allocator_cache();
+extern void halide_get_allocator_cache_stats(struct halide_allocator_cache_stats *stats);
+//@}
+
+/** The CUDA and OpenCL runtimes keep device allocations released by
+ * halide_dev_free in a cache of size classes, and reuse them for
+ * later allocations across kernels and pipeline invocations. The
+ * cache holds on to at most 256 MB by default;
+ * halide_dev_cache_set_size changes the limit (zero turns the cache
+ * off), and halide_dev_cache_trim releases everything it holds.
+ * halide_release also empties it. */
+//@{
+extern void halide_dev_cache_set_size(void *user_context, size_t max_cached_bytes);
+extern void halide_dev_cache_trim(void *user_context);
+//@}
+
+/** The CUDA and OpenCL runtimes can allocate page-locked host memory,
+ * which copies to and from the device run at full bandwidth, and
+ * asynchronously. halide_dev_host_malloc returns NULL if it can't.
+ * halide_dev_host_register page-locks existing memory in place, and
+ * returns zero on success; only CUDA supports it. */
+//@{
+extern void *halide_dev_host_malloc(void *user_context, size_t size);
+extern void halide_dev_host_free(void *user_context, void *ptr);
+extern int halide_dev_host_register(void *user_context, void *ptr, size_t size);
+extern void halide_dev_host_unregister(void *user_context, void *ptr);
+//@}
+
+/** In zero-copy mode, the CUDA and OpenCL runtimes make device
+ * allocations for buffers with host memory out of that memory, so
+ * that copies to and from the device cost nothing on devices that
+ * share memory with the host, such as integrated and mobile gpus. It
+ * is on by default for such devices, and can be forced on or off by
+ * setting HL_ZERO_COPY to 1 or 0, or with halide_dev_set_zero_copy
+ * (1 on, 0 off, -1 decide automatically). Changes only affect later
+ * allocations. */
+extern void halide_dev_set_zero_copy(int mode);
+
+/** In launch graph mode, the CUDA runtime defers kernel launches until
+ * something needs their results, and sends each batch of launches
+ * that it has seen before to the device as a single cuda graph. That
+ * saves most of the launch overhead of pipelines with many gpu stages
+ * that are run repeatedly on buffers of the same shapes. It is off by
+ * default, and turned on by setting HL_LAUNCH_GRAPHS to 1, or with
+ * halide_dev_set_launch_graphs (1 on, 0 off). Call halide_dev_sync
+ * before using a pipeline's device results outside of Halide. It
+ * needs a driver with cuda graphs (CUDA 11.4 or later), and does
+ * nothing on OpenCL. */
+extern void halide_dev_set_launch_graphs(int mode);
+
+/** When gpu profiling is on, the CUDA and OpenCL runtimes time each
+ * kernel and copy on the device, without making the host wait for
+ * it. halide_gpu_profile_report prints the count, device time and
+ * bytes copied of each, and the launch config and occupancy of each
+ * kernel (CUDA only), in the format read by util/HalideProf.
+ * halide_gpu_profile_reset starts over. Whatever hasn't been
+ * reported yet is printed by halide_release. Profiling is turned on by
+ * setting HL_GPU_PROFILE to 1, or with halide_dev_set_profiling (1
+ * on, 0 off). On OpenCL it must be on before the first pipeline
+ * runs. In launch graph mode, the deferred launches are timed
+ * together, one batch at a time. */
+//@{
+extern void halide_dev_set_profiling(int mode);
+extern void halide_gpu_profile_report(void *user_context);
+extern void halide_gpu_profile_reset(void *user_context);
+//@}
+
+/** The CUDA and OpenCL runtimes build the kernels of a pipeline (the
+ * PTX JIT or clBuildProgram) the first time it runs, which can take
+ * hundreds of milliseconds. halide_gpu_warmup builds the kernels of
+ * every pipeline linked into the program ahead of time, after
+ * creating the context and queue (or stream) of the user_context's
+ * device. With wait set to zero it does so on a background thread,
+ * and returns at once; a pipeline that starts in the meantime waits
+ * for its own kernels instead of building them twice. It returns
+ * zero on success. It covers pipelines compiled ahead of time, which
+ * register their kernels when the program starts. The kernel cache
+ * kept in HL_KERNEL_CACHE_DIR makes each build cheaper still.
+ * halide_release waits for a warm-up in progress. */
+extern int halide_gpu_warmup(void *user_context, int wait);
+
+/** The OpenGL ES runtime runs kernels on the OpenGL ES 3.1 context
+ * current on the calling thread, so apps that draw with OpenGL ES
+ * share theirs with the pipeline. If there isn't one,
+ * halide_opengl_create_context makes an offscreen context with EGL.
+ * Override it to make a different context current; it returns zero
+ * on success. */
+extern int halide_opengl_create_context(void *user_context);
+
+/** Funcs scheduled with Func::memoize keep copies of their
+ * realizations in a cache shared by all pipelines, keyed on the
+ * values they were computed from. The cache evicts the least recently
+ * used entries once it holds more than a size limit, which defaults
+ * to 16 MB and can be changed with halide_memoization_cache_set_size
+ * (zero restores the default). halide_memoization_cache_cleanup
+ * empties it. The lookup and store functions are called by generated
+ * code. A lookup copies a cached realization into dst and returns 1,
+ * or returns 0 if there isn't one. */
+//@{
+extern void halide_memoization_cache_set_size(int64_t size);
+extern void halide_memoization_cache_cleanup();
+extern int32_t halide_memoization_cache_lookup(void *user_context, const uint8_t *key, int32_t key_size,
+                                               uint8_t *dst, int32_t size);
+extern int32_t halide_memoization_cache_store(void *user_context, const uint8_t *key, int32_t key_size,
+                                              const uint8_t *src, int32_t size);
+//@}
+
+/** The storage of Funcs scheduled with Func::store_persistent is kept
+ * by the runtime from one run of a pipeline to the next, keyed on the
+ * name of the Func, along with the range of the folded dimension whose
+ * values are valid. If the region of the Func changes between runs,
+ * the storage is reallocated and computed afresh. Runs of a pipeline
+ * using the same persistent storage must not overlap.
+ * halide_persistent_storage_cleanup frees all of it, so that the next
+ * run starts from scratch (e.g. at a cut in a video). The acquire and
+ * release functions are called by generated code. Acquire returns the
+ * storage, and writes the valid range after the shape_size words of
+ * shape in state. */
+//@{
+extern void halide_persistent_storage_cleanup();
+extern void *halide_persistent_storage_acquire(void *user_context, const char *name,
+                                               int32_t *state, int32_t shape_size, int32_t size);
+extern void halide_persistent_storage_release(void *user_context, const char *name,
+                                              int32_t valid_min, int32_t valid_max);
+//@}
+
+/** Funcs scheduled with Func::split_devices give the gpu a share of
+ * the split dimension, kept by the runtime for each Func name, and
+ * compute the rest on the cpu. The share starts at HL_GPU_PERCENT
+ * percent (50 by default). After each run it moves toward the share
+ * at which the two devices would have finished together, which, if
+ * the gpu was done first, just means giving the gpu more.
+ * halide_device_split_gpu_percent returns the current share. The
+ * other functions are called by generated code:
+ * halide_device_split_extent returns how much of the given extent
+ * goes on the gpu, and halide_device_split_report gives the extents
+ * computed on each device, the time the cpu took, and the time it
+ * then waited for the gpu. */
+//@{
+extern int32_t halide_device_split_gpu_percent(void *user_context, const char *name);
+extern int32_t halide_device_split_extent(void *user_context, const char *name, int32_t extent);
+extern void halide_device_split_report(void *user_context, const char *name,
+                                       int32_t gpu_extent, int32_t cpu_extent,
+                                       int64_t cpu_ns, int64_t wait_ns);
+//@}
+
+/** Pipelines compiled with Func::compile_to_file_with_gpu_dispatch
+ * run their gpu version when the output has at least
+ * halide_gpu_dispatch_threshold elements, and their cpu version
+ * otherwise. The threshold is kept by the runtime for each pipeline
+ * name. It starts at HL_GPU_DISPATCH_SIZE, if that's set, and at the
+ * size given at compile time otherwise. Programs that have measured
+ * where the gpu starts to win on the device they run on (e.g. by
+ * timing both versions at a few sizes when they start) can store it
+ * with halide_set_gpu_dispatch_threshold. Pass a size of -1 to go
+ * back to the default. */
+//@{
+extern int64_t halide_gpu_dispatch_threshold(void *user_context, const char *name, int64_t default_size);
+extern void halide_set_gpu_dispatch_threshold(void *user_context, const char *name, int64_t size);
+//@}
+
+/** Pipelines compiled with Func::compile_to_file_with_schedules call
+ * halide_schedule_select to choose one of their schedules, and
+ * halide_schedule_report with the time it took, for each bucket of
+ * output shapes (the floor of the log2 of each extent). Each schedule
+ * runs HL_SCHEDULE_WARMUP times first (3 by default). After that the
+ * schedule with the lowest moving average time runs, except that one
+ * call in HL_SCHEDULE_EXPLORE (32 by default, or never if 0) runs the
+ * schedules in turn, to notice when another one has become faster.
+ * If HL_SCHEDULE_STATE names a file, the choices are read from it on
+ * the first call, and halide_schedule_select_save writes them back.
+ * halide_schedule_selected returns the schedule that would run when
+ * not exploring, or -1 if they haven't all been timed yet. */
+//@{
+extern int32_t halide_schedule_select(void *user_context, const char *name,
+                                      int32_t num_variants, int32_t bucket);
+extern int halide_schedule_report(void *user_context, const char *name, int32_t num_variants,
+                                  int32_t bucket, int32_t variant, int64_t ns);
+extern int halide_schedule_select_save(void *user_context);
+extern int32_t halide_schedule_selected(void *user_context, const char *name,
+                                        int32_t num_variants, int32_t bucket);
+//@}
+
+/** The communication layer used by Funcs scheduled with
+ * Func::distribute. The defaults run everything as rank 0 of 1. To
+ * run a pipeline as many processes (e.g. on top of MPI), link in
+ * definitions of all five: the rank of this process and the number of
+ * ranks, an allgather that collects size bytes from each rank into
+ * recv in rank order, and blocking point to point sends and receives.
+ * Each returns zero on success. All ranks must run the same pipelines
+ * in the same order, because each distributed Func that isn't an
+ * output makes every rank trade values. halide_distributed_exchange
+ * and the owned functions are called by generated code. */
+//@{
+extern int32_t halide_distributed_rank(void *user_context);
+extern int32_t halide_distributed_num_ranks(void *user_context);
+extern int halide_distributed_allgather(void *user_context, const void *send, int32_t size, void *recv);
+extern int halide_distributed_send(void *user_context, int32_t rank, const void *data, int64_t size);
+extern int halide_distributed_recv(void *user_context, int32_t rank, void *data, int64_t size);
+extern int32_t halide_distributed_owned_min(void *user_context, const char *name,
+                                            int32_t needed_min, int32_t needed_max);
+extern int32_t halide_distributed_owned_max(void *user_context, const char *name,
+                                            int32_t needed_min, int32_t needed_max);
+//@}
+
+/** Pipelines compiled with HL_PROFILE set to 1 tell the sampling
+ * profiler which Func each of their threads is computing. A thread
+ * started by the first such pipeline samples them every
+ * HL_PROFILE_INTERVAL_US microseconds (1000 by default), and charges
+ * the time between samples to the Funcs being computed.
+ * halide_profiler_report prints, for each pipeline, the time spent in
+ * and the number of invocations of the produce and update steps of
+ * each Func, and the number of busy threads, in the format read by
+ * util/HalideProf. halide_profiler_reset zeroes the totals, and
+ * halide_profiler_shutdown prints them and stops the sampling thread;
+ * it must not be called while a pipeline is running. Not available on
+ * Windows. With HL_PROFILE_COUNTERS set to 1 (linux only), the report
+ * also has the cycles, instructions and last level cache misses
+ * counted by each thread's hardware counters while it computed each
+ * Func. The functions that take a state are called by generated
+ * code. */
+//@{
+extern void halide_profiler_report(void *user_context);
+extern void halide_profiler_reset();
+extern void halide_profiler_shutdown();
+extern void *halide_profiler_pipeline_start(void *user_context, const char *name,
+                                            int num_funcs, const char *func_names);
+extern int halide_profiler_pipeline_end(void *user_context, void *state);
+extern int halide_profiler_acquire_slot(void *state, int func);
+extern int halide_profiler_release_slot(void *state, int slot);
+extern int halide_profiler_enter_func(void *state, int slot, int func);
+extern int halide_profiler_set_func(void *state, int slot, int func);
+//@}
+
+/** The profiler also counts the allocations of the buffers of each
+ * Func, and of each pipeline as a whole. Heap sizes are in bytes;
+ * stack_peak is the size of the largest stack allocation. */
+struct halide_profiler_memory_stats {
+    int64_t heap_allocs;
+    int64_t heap_bytes;
+    int64_t heap_current;
+    int64_t heap_peak;
+    int64_t stack_allocs;
+    int64_t stack_peak;
+};
+
+/** Get the allocation statistics of a Func in a pipeline, or of the
+ * whole pipeline if func is NULL. Returns zero on success, or -1 if
+ * nothing is known about it. The allocate and free functions are
+ * called by generated code. */
+//@{
+extern int halide_profiler_get_memory_stats(const char *pipeline, const char *func,
+                                            struct halide_profiler_memory_stats *stats);
+extern int halide_profiler_memory_allocate(void *state, const char *buffer, int bytes, int on_stack);
+extern int halide_profiler_memory_free(void *state, const char *buffer, int bytes, int on_stack);
+//@}
+
+/** When HL_TIMELINE_FILE is set, the thread pool records when each
+ * task of each parallel loop runs and on which thread, along with the
+ * realize, produce, update and consume markers of the Funcs being
+ * traced (HL_TRACE=1 traces them all, and the markers are then not
+ * printed). halide_timeline_write writes them to that file as
+ * trace-event JSON, for chrome://tracing or Perfetto, and prints how
+ * evenly the tasks of each parallel loop were spread over the threads
+ * in the format read by util/HalideProf. halide_shutdown_timeline
+ * writes and then forgets them; it must not be called while a
+ * pipeline is running. At most HL_TIMELINE_EVENTS events (default
+ * 262144) are kept. Returns zero on success. */
+//@{
+extern int halide_timeline_write(void *user_context);
+extern void halide_shutdown_timeline();
+//@}
+
+/** Pipelines compiled with HL_PGO_INSTRUMENT=1 count how often their
+ * loops and branches run. halide_pgo_write writes the counts for
+ * every such pipeline the program has run to the file named by
+ * HL_PGO_OUTPUT ("halide.pgo" by default), for later compiles to read
+ * with HL_PGO_PROFILE. halide_shutdown_pgo writes and then forgets
+ * them; it must not be called while a pipeline is running. Jitted
+ * pipelines call it when they're freed. Returns zero on success. */
+//@{
+extern int halide_pgo_write(void *user_context);
+extern void halide_shutdown_pgo();
+//@}
+
 /** Called when debug_to_file is used inside %Halide code.  See
  * Func::debug_to_file for how this is called
  *
+ * With HL_DEBUG_TO_FILE_ASYNC set to 1, the image is copied and
+ * written out by a background thread, unless more than
+ * HL_DEBUG_TO_FILE_MAX_PENDING_MB megabytes (default 256) are already
+ * waiting. With HL_DEBUG_TO_FILE_EVERY set to N, only every Nth image
+ * sent to each file name is written. halide_debug_to_file_wait
+ * returns once everything queued has been written; JIT-compiled
+ * modules call it when they are freed.
+ *
  * Cannot be replaced in JITted code at present.
  */
+//@{
 extern int32_t halide_debug_to_file(void *user_context, const char *filename,
                                     uint8_t *data, int32_t s0, int32_t s1, int32_t s2,
                                     int32_t s3, int32_t type_code,
                                     int32_t bytes_per_element);
+extern void halide_debug_to_file_wait();
+//@}
 
 
 enum halide_trace_event_code {halide_trace_load = 0,
@@ -109,7 +620,9 @@ enum halide_trace_event_code {halide_trace_load = 0,
                               halide_trace_produce = 4,
                               halide_trace_update = 5,
                               halide_trace_consume = 6,
-                              halide_trace_end_consume = 7};
+                              halide_trace_end_consume = 7,
+                              halide_trace_summary = 8,
+                              halide_trace_summary_load = 9};
 
 struct halide_trace_event {
     const char *func;
@@ -133,10 +646,30 @@ struct halide_trace_event {
  * you may want to make the file a named pipe, and then read from that
  * pipe into gzip.
  *
+ * Packets going to the file are gathered in large buffers without
+ * taking a lock, and a buffer is written out while the next one
+ * fills. The default implementation also drops events that weren't
+ * asked for: HL_TRACE_EVENTS is a comma-separated list of the event
+ * types to keep (load, store, begin_realization, end_realization,
+ * produce, update, consume, end_consume, summary, summary_load),
+ * HL_TRACE_FUNCS a comma-separated list of the Funcs to keep, and
+ * HL_TRACE_SAMPLE=n keeps one load or store in n. Dropped events still get an id.
+ *
+ * With HL_TRACE_COMPRESS=1, the file is written as blocks of
+ * delta-encoded packets, each with an index of the Funcs in it, which
+ * util/HalideTrace reads as well as the raw format.
+ *
  * halide_trace returns a unique ID which will be passed to future
  * events that "belong" to the earlier event as the parent id. The
  * ownership hierarchy looks like:
  *
+ * Funcs marked with trace_summary instead send one summary event at
+ * the end of each realization, with the realized box as its
+ * coordinates, and as its value the int64 pair (points stored, points
+ * in the box). It's the parent of a summary_load event for each
+ * input, named for the input, whose value is the bytes loaded from
+ * it.
+ *
  * begin_realization
  *    produce
  *      store
@@ -155,8 +688,8 @@ struct halide_trace_event {
  */
 extern int32_t halide_trace(void *user_context, const halide_trace_event *event);
 
-/** If tracing is writing to a file. This call closes that file
- * (flushing the trace). Returns zero on success. */
+/** If tracing is writing to a file. This call writes out what is
+ * buffered and closes that file. Returns zero on success. */
 extern int halide_shutdown_trace();
 
 /** Set the seed for the random number generator used by
@@ -0,0 +1,88 @@
+
+declare <4 x float> @llvm.fabs.v4f32(<4 x float>)
+
+define weak_odr <4 x float> @abs_f32x4(<4 x float> %x) nounwind alwaysinline {
+       %tmp = call <4 x float> @llvm.fabs.v4f32(<4 x float> %x)
+       ret <4 x float> %tmp
+}
+
+declare <2 x float> @llvm.fabs.v2f32(<2 x float>)
+
+define weak_odr <2 x float> @abs_f32x2(<2 x float> %x) nounwind alwaysinline {
+       %tmp = call <2 x float> @llvm.fabs.v2f32(<2 x float> %x)
+       ret <2 x float> %tmp
+}
+
+declare <2 x double> @llvm.fabs.v2f64(<2 x double>)
+
+define weak_odr <2 x double> @abs_f64x2(<2 x double> %x) nounwind alwaysinline {
+       %tmp = call <2 x double> @llvm.fabs.v2f64(<2 x double> %x)
+       ret <2 x double> %tmp
+}
+
+declare <4 x i32> @llvm.aarch64.neon.abs.v4i32(<4 x i32>)
+
+define weak_odr <4 x i32> @abs_i32x4(<4 x i32> %x) nounwind alwaysinline {
+       %tmp = call <4 x i32> @llvm.aarch64.neon.abs.v4i32(<4 x i32> %x)
+       ret <4 x i32> %tmp
+}
+
+declare <2 x i32> @llvm.aarch64.neon.abs.v2i32(<2 x i32>)
+
+define weak_odr <2 x i32> @abs_i32x2(<2 x i32> %x) nounwind alwaysinline {
+       %tmp = call <2 x i32> @llvm.aarch64.neon.abs.v2i32(<2 x i32> %x)
+       ret <2 x i32> %tmp
+}
+
+declare <4 x i16> @llvm.aarch64.neon.abs.v4i16(<4 x i16>)
+
+define weak_odr <4 x i16> @abs_i16x4(<4 x i16> %x) nounwind alwaysinline {
+       %tmp = call <4 x i16> @llvm.aarch64.neon.abs.v4i16(<4 x i16> %x)
+       ret <4 x i16> %tmp
+}
+
+declare <8 x i16> @llvm.aarch64.neon.abs.v8i16(<8 x i16>)
+
+define weak_odr <8 x i16> @abs_i16x8(<8 x i16> %x) nounwind alwaysinline {
+       %tmp = call <8 x i16> @llvm.aarch64.neon.abs.v8i16(<8 x i16> %x)
+       ret <8 x i16> %tmp
+}
+
+declare <8 x i8> @llvm.aarch64.neon.abs.v8i8(<8 x i8>)
+
+define weak_odr <8 x i8> @abs_i8x8(<8 x i8> %x) nounwind alwaysinline {
+       %tmp = call <8 x i8> @llvm.aarch64.neon.abs.v8i8(<8 x i8> %x)
+       ret <8 x i8> %tmp
+}
+
+declare <16 x i8> @llvm.aarch64.neon.abs.v16i8(<16 x i8>)
+
+define weak_odr <16 x i8> @abs_i8x16(<16 x i8> %x) nounwind alwaysinline {
+       %tmp = call <16 x i8> @llvm.aarch64.neon.abs.v16i8(<16 x i8> %x)
+       ret <16 x i8> %tmp
+}
+
+declare <4 x float> @llvm.sqrt.v4f32(<4 x float>);
+declare <2 x double> @llvm.sqrt.v2f64(<2 x double>);
+
+define weak_odr <4 x float> @sqrt_f32x4(<4 x float> %x) nounwind alwaysinline {
+       %tmp = call <4 x float> @llvm.sqrt.v4f32(<4 x float> %x)
+       ret <4 x float> %tmp
+}
+
+define weak_odr <2 x double> @sqrt_f64x2(<2 x double> %x) nounwind alwaysinline {
+       %tmp = call <2 x double> @llvm.sqrt.v2f64(<2 x double> %x)
+       ret <2 x double> %tmp
+}
+
+; The virtual count of the generic timer, which ticks at the constant
+; rate in cntfrq_el0 on every core. See cycle_clock.cpp.
+define weak_odr i64 @halide_read_cycle_counter() nounwind {
+       %tmp = call i64 asm sideeffect "mrs $0, cntvct_el0", "=r"() nounwind
+       ret i64 %tmp
+}
+
+define weak_odr i64 @halide_cycle_counter_frequency() nounwind {
+       %tmp = call i64 asm "mrs $0, cntfrq_el0", "=r"() nounwind
+       ret i64 %tmp
+}
@@ -1,2 +1,6 @@
+#ifdef BITS_64
+#define SYS_CLOCK_GETTIME 113
+#else
 #define SYS_CLOCK_GETTIME 263
+#endif
 #include "linux_clock.cpp"
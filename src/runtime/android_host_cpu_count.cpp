@@ -3,9 +3,94 @@
 extern "C" {
 
 extern long sysconf(int);
+extern char *getenv(const char *);
+extern int atoi(const char *);
+extern int open(const char *, int, ...);
+extern int close(int);
+extern long read(int, void *, size_t);
+
+// Android devices don't have more than this many cpus yet
+#define MAX_ANDROID_CPUS 64
+
+// Read the maximum clock rate of a cpu in kHz from sysfs. Returns
+// zero if it's not known (e.g. the cpu is offline).
+WEAK int halide_android_cpu_max_freq(int cpu) {
+    char path[64];
+    const char *prefix = "/sys/devices/system/cpu/cpu";
+    char *p = path;
+    while (*prefix) *p++ = *prefix++;
+    if (cpu >= 10) *p++ = '0' + cpu / 10;
+    *p++ = '0' + cpu % 10;
+    const char *suffix = "/cpufreq/cpuinfo_max_freq";
+    while (*suffix) *p++ = *suffix++;
+    *p = 0;
+
+    int fd = open(path, 0);
+    if (fd < 0) return 0;
+    char buf[32];
+    long len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0) return 0;
+    buf[len] = 0;
+    return atoi(buf);
+}
+
+// The cpus in the fastest cluster of a big.LITTLE machine, which are
+// the ones with the highest maximum clock rate. On machines with a
+// single cluster these are all the cpus. -1 until computed.
+WEAK int halide_android_big_cpu_count = -1;
+WEAK uint64_t halide_android_big_cpu_mask = 0;
+
+// Get the mask of the big cpus, and return how many there
+// are. Returns zero if the clock rates can't be read.
+WEAK int halide_android_big_cpus(uint64_t *mask) {
+    if (halide_android_big_cpu_count < 0) {
+        // Racing threads will all compute the same answer.
+        int best = 0, count = 0;
+        uint64_t m = 0;
+        for (int cpu = 0; cpu < MAX_ANDROID_CPUS; cpu++) {
+            int freq = halide_android_cpu_max_freq(cpu);
+            if (freq <= 0) continue;
+            if (freq > best) {
+                best = freq;
+                count = 0;
+                m = 0;
+            }
+            if (freq == best) {
+                count++;
+                m |= (uint64_t)1 << cpu;
+            }
+        }
+        halide_android_big_cpu_mask = m;
+        halide_android_big_cpu_count = count;
+    }
+    *mask = halide_android_big_cpu_mask;
+    return halide_android_big_cpu_count;
+}
+
+// Whether thread pools are restricted to the big cpus. -1 until
+// read from HL_BIG_CORES.
+WEAK int halide_big_cores_only = -1;
+
+WEAK void halide_set_big_cores_only(int enable) {
+    halide_big_cores_only = enable ? 1 : 0;
+}
+
+WEAK bool halide_use_big_cores_only() {
+    if (halide_big_cores_only < 0) {
+        char *big_str = getenv("HL_BIG_CORES");
+        halide_big_cores_only = (big_str && atoi(big_str) != 0) ? 1 : 0;
+    }
+    return halide_big_cores_only == 1;
+}
 
 WEAK int halide_host_cpu_count() {
-    // Works for Android ARMv7. Probably bogus on other platforms.
+    if (halide_use_big_cores_only()) {
+        uint64_t mask;
+        int big = halide_android_big_cpus(&mask);
+        if (big > 0) return big;
+    }
+    // Works for Android ARMv7 and AArch64. Probably bogus on other platforms.
     return sysconf(97);
 }
 
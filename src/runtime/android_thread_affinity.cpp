@@ -0,0 +1,30 @@
+#include "mini_stdint.h"
+
+extern "C" {
+
+extern int sched_setaffinity(int pid, size_t cpusetsize, const void *mask);
+extern int setpriority(int which, int who, int prio);
+
+extern bool halide_use_big_cores_only();
+extern int halide_android_big_cpus(uint64_t *mask);
+
+// Keep thread pool workers off the little cpus of a big.LITTLE
+// machine if asked to (see halide_set_big_cores_only). Workers may
+// run on any of the big cpus, so that the kernel can still balance
+// them. The thread that calls do_par_for is left alone.
+WEAK void halide_pin_worker_thread(int worker_index) {
+    if (!halide_use_big_cores_only()) return;
+    uint64_t mask;
+    if (halide_android_big_cpus(&mask) > 0) {
+        sched_setaffinity(0, sizeof(mask), &mask);
+    }
+}
+
+// Set the nice value of the calling worker thread. Like on linux,
+// setpriority with PRIO_PROCESS and a zero id only applies to the
+// calling thread.
+WEAK void halide_set_worker_priority(int priority) {
+    setpriority(0, 0, priority);
+}
+
+}
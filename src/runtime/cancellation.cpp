@@ -0,0 +1,94 @@
+#include "mini_stdint.h"
+#include "HalideRuntime.h"
+
+// Cooperative cancellation of running pipelines. Code compiled with
+// the cancellable target feature polls halide_is_cancelled between
+// parallel tasks and rows of its loop nests.
+
+#define WEAK __attribute__((weak))
+#ifndef NULL
+#define NULL 0
+#endif
+
+extern "C" {
+
+// There are rarely more than a few pipelines being abandoned at once,
+// so a small table scanned linearly does fine.
+#define MAX_CANCELLED_CONTEXTS 64
+
+WEAK struct {
+    int lock;
+    // Read without the lock, so that a poll while nothing is
+    // cancelled costs one load.
+    volatile int count;
+    void * volatile user_context[MAX_CANCELLED_CONTEXTS];
+} halide_cancelled_contexts;
+
+WEAK int (*halide_custom_is_cancelled)(void *user_context);
+
+WEAK void halide_set_custom_is_cancelled(int (*f)(void *)) {
+    halide_custom_is_cancelled = f;
+}
+
+WEAK void halide_cancelled_contexts_lock() {
+    while (__sync_lock_test_and_set(&halide_cancelled_contexts.lock, 1)) {}
+}
+
+WEAK void halide_cancelled_contexts_unlock() {
+    __sync_lock_release(&halide_cancelled_contexts.lock);
+}
+
+WEAK int halide_cancel(void *user_context) {
+    int result = 0;
+    halide_cancelled_contexts_lock();
+    int n = halide_cancelled_contexts.count;
+    int i = 0;
+    while (i < n && halide_cancelled_contexts.user_context[i] != user_context) {
+        i++;
+    }
+    if (i == n) {
+        if (n < MAX_CANCELLED_CONTEXTS) {
+            halide_cancelled_contexts.user_context[n] = user_context;
+            // Publish the entry before the count that covers it.
+            __sync_synchronize();
+            halide_cancelled_contexts.count = n + 1;
+        } else {
+            result = -1;
+        }
+    }
+    halide_cancelled_contexts_unlock();
+    return result;
+}
+
+WEAK int halide_uncancel(void *user_context) {
+    halide_cancelled_contexts_lock();
+    int n = halide_cancelled_contexts.count;
+    for (int i = 0; i < n; i++) {
+        if (halide_cancelled_contexts.user_context[i] == user_context) {
+            // Move the last one into its place. A racing poll of the
+            // moved user_context may miss it, and sees it at its next
+            // poll.
+            halide_cancelled_contexts.count = n - 1;
+            __sync_synchronize();
+            halide_cancelled_contexts.user_context[i] = halide_cancelled_contexts.user_context[n - 1];
+            break;
+        }
+    }
+    halide_cancelled_contexts_unlock();
+    return 0;
+}
+
+WEAK int halide_is_cancelled(void *user_context) {
+    if (halide_custom_is_cancelled) {
+        return (*halide_custom_is_cancelled)(user_context);
+    }
+    int n = halide_cancelled_contexts.count;
+    for (int i = 0; i < n; i++) {
+        if (halide_cancelled_contexts.user_context[i] == user_context) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+}
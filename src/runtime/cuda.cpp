@@ -8,7 +8,11 @@ extern int atoi(const char *);
 extern char *getenv(const char *);
 extern int64_t halide_current_time_ns(void *user_context);
 extern void *malloc(size_t);
+extern void free(void *);
+extern void *memcpy(void *, const void *, size_t);
+extern int memcmp(const void *, const void *, size_t);
 extern int snprintf(char *, size_t, const char *, ...);
+extern void halide_runtime_stats_device_transfer(int64_t bytes, int to_device);
 
 #ifndef DEBUG
 #define CHECK_CALL(c,str) c
@@ -22,9 +26,14 @@ extern int snprintf(char *, size_t, const char *, ...);
     halide_assert(user_context, status == CUDA_SUCCESS);                \
 } while(0)
 #define TIME_CALL(c,str) do {\
-    cuEventRecord(__start, 0);                              \
+    if (halide_cuda_device_index(user_context) >= 0) {      \
+        /* The timing events belong to the default device */ \
+        CHECK_CALL((c),(str));                              \
+        break;                                              \
+    }                                                       \
+    cuEventRecord(__start, halide_cuda_get_stream(user_context)); \
     CHECK_CALL((c),(str));                                  \
-    cuEventRecord(__end, 0);                                \
+    cuEventRecord(__end, halide_cuda_get_stream(user_context)); \
     cuEventSynchronize(__end);                              \
     float msec;                                             \
     cuEventElapsedTime(&msec, __start, __end);              \
@@ -41,14 +50,24 @@ extern int snprintf(char *, size_t, const char *, ...);
 #define cuCtxCreate                         cuCtxCreate_v2
 #define cuMemAlloc                          cuMemAlloc_v2
 #define cuMemFree                           cuMemFree_v2
+#define cuMemGetAddressRange                cuMemGetAddressRange_v2
 #define cuMemcpyHtoD                        cuMemcpyHtoD_v2
 #define cuMemcpyDtoH                        cuMemcpyDtoH_v2
+#define cuMemcpyHtoDAsync                   cuMemcpyHtoDAsync_v2
+#define cuMemcpyDtoHAsync                   cuMemcpyDtoHAsync_v2
+#define cuMemHostRegister                   cuMemHostRegister_v2
+#define cuMemHostGetDevicePointer           cuMemHostGetDevicePointer_v2
 // API version >= 4000
 #define cuCtxDestroy                        cuCtxDestroy_v2
 #define cuCtxPopCurrent                     cuCtxPopCurrent_v2
 #define cuCtxPushCurrent                    cuCtxPushCurrent_v2
 #define cuStreamDestroy                     cuStreamDestroy_v2
 #define cuEventDestroy                      cuEventDestroy_v2
+// API version >= 10010
+#define cuStreamBeginCapture                cuStreamBeginCapture_v2
+// API version >= 6050
+#define cuLinkCreate                        cuLinkCreate_v2
+#define cuLinkAddData                       cuLinkAddData_v2
 
 #ifdef BITS_64
 typedef unsigned long long CUdeviceptr;
@@ -62,6 +81,9 @@ typedef struct CUmod_st *CUmodule;                        /**< CUDA module */
 typedef struct CUfunc_st *CUfunction;                     /**< CUDA function */
 typedef struct CUstream_st *CUstream;                     /**< CUDA stream */
 typedef struct CUevent_st *CUevent;                       /**< CUDA event */
+typedef struct CUlinkState_st *CUlinkState;               /**< CUDA linker state */
+typedef struct CUgraph_st *CUgraph;                       /**< CUDA graph */
+typedef struct CUgraphExec_st *CUgraphExec;               /**< CUDA executable graph */
 typedef enum {
     CUDA_SUCCESS                              = 0,
     CUDA_ERROR_INVALID_VALUE                  = 1,
@@ -109,6 +131,20 @@ typedef enum {
 } CUresult;
 
 #define CU_POINTER_ATTRIBUTE_CONTEXT 1
+#define CU_EVENT_DISABLE_TIMING 2
+#define CU_MEMHOSTALLOC_PORTABLE 1
+#define CU_MEMHOSTALLOC_DEVICEMAP 2
+#define CU_MEMHOSTREGISTER_PORTABLE 1
+#define CU_MEMHOSTREGISTER_DEVICEMAP 2
+#define CU_CTX_MAP_HOST 8
+#define CU_DEVICE_ATTRIBUTE_INTEGRATED 18
+#define CU_DEVICE_ATTRIBUTE_CAN_MAP_HOST_MEMORY 19
+#define CU_STREAM_CAPTURE_MODE_THREAD_LOCAL 1
+#define CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR 75
+#define CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MINOR 76
+#define CU_JIT_INPUT_PTX 1
+#define CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT 16
+#define CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_MULTIPROCESSOR 39
 
 CUresult CUDAAPI cuInit(unsigned int Flags);
 CUresult CUDAAPI cuDeviceGetCount(int *count);
@@ -120,8 +156,21 @@ CUresult CUDAAPI cuModuleUnload(CUmodule module);
 CUresult CUDAAPI cuModuleGetFunction(CUfunction *hfunc, CUmodule hmod, const char *name);
 CUresult CUDAAPI cuMemAlloc(CUdeviceptr *dptr, size_t bytesize);
 CUresult CUDAAPI cuMemFree(CUdeviceptr dptr);
+CUresult CUDAAPI cuMemGetAddressRange(CUdeviceptr *pbase, size_t *psize, CUdeviceptr dptr);
 CUresult CUDAAPI cuMemcpyHtoD(CUdeviceptr dstDevice, const void *srcHost, size_t ByteCount);
 CUresult CUDAAPI cuMemcpyDtoH(void *dstHost, CUdeviceptr srcDevice, size_t ByteCount);
+CUresult CUDAAPI cuMemcpyHtoDAsync(CUdeviceptr dstDevice, const void *srcHost, size_t ByteCount, CUstream hStream);
+CUresult CUDAAPI cuMemcpyDtoHAsync(void *dstHost, CUdeviceptr srcDevice, size_t ByteCount, CUstream hStream);
+CUresult CUDAAPI cuMemHostAlloc(void **pp, size_t bytesize, unsigned int Flags);
+CUresult CUDAAPI cuMemFreeHost(void *p);
+CUresult CUDAAPI cuMemHostRegister(void *p, size_t bytesize, unsigned int Flags);
+CUresult CUDAAPI cuMemHostUnregister(void *p);
+CUresult CUDAAPI cuMemHostGetDevicePointer(CUdeviceptr *pdptr, void *p, unsigned int Flags);
+CUresult CUDAAPI cuDeviceGetAttribute(int *pi, int attrib, CUdevice dev);
+CUresult CUDAAPI cuCtxGetDevice(CUdevice *device);
+CUresult CUDAAPI cuCtxGetCurrent(CUcontext *pctx);
+CUresult CUDAAPI cuOccupancyMaxActiveBlocksPerMultiprocessor(int *numBlocks, CUfunction func,
+                                                             int blockSize, size_t dynamicSMemSize);
 CUresult CUDAAPI cuLaunchKernel(CUfunction f,
                                 unsigned int gridDimX,
                                 unsigned int gridDimY,
@@ -135,6 +184,11 @@ CUresult CUDAAPI cuLaunchKernel(CUfunction f,
                                 void **extra);
 CUresult CUDAAPI cuCtxSynchronize();
 
+CUresult CUDAAPI cuStreamCreate(CUstream *phStream, unsigned int Flags);
+CUresult CUDAAPI cuStreamDestroy(CUstream hStream);
+CUresult CUDAAPI cuStreamSynchronize(CUstream hStream);
+CUresult CUDAAPI cuStreamWaitEvent(CUstream hStream, CUevent hEvent, unsigned int Flags);
+
 CUresult CUDAAPI cuCtxPushCurrent(CUcontext ctx);
 CUresult CUDAAPI cuCtxPopCurrent(CUcontext *pctx);
 
@@ -145,7 +199,26 @@ CUresult CUDAAPI cuEventSynchronize(CUevent hEvent);
 CUresult CUDAAPI cuEventElapsedTime(float *pMilliseconds, CUevent hStart, CUevent hEnd);
 CUresult CUDAAPI cuPointerGetAttribute(void *result, int query, CUdeviceptr ptr);
 
+CUresult CUDAAPI cuDriverGetVersion(int *driverVersion);
+CUresult CUDAAPI cuLinkCreate(unsigned int numOptions, int *options, void **optionValues, CUlinkState *stateOut);
+CUresult CUDAAPI cuLinkAddData(CUlinkState state, int type, void *data, size_t size, const char *name,
+                               unsigned int numOptions, int *options, void **optionValues);
+CUresult CUDAAPI cuLinkComplete(CUlinkState state, void **cubinOut, size_t *sizeOut);
+CUresult CUDAAPI cuLinkDestroy(CUlinkState state);
+
+CUresult CUDAAPI cuStreamBeginCapture(CUstream hStream, int mode);
+CUresult CUDAAPI cuStreamEndCapture(CUstream hStream, CUgraph *phGraph);
+CUresult CUDAAPI cuGraphInstantiateWithFlags(CUgraphExec *phGraphExec, CUgraph hGraph, unsigned long long flags);
+CUresult CUDAAPI cuGraphLaunch(CUgraphExec hGraphExec, CUstream hStream);
+CUresult CUDAAPI cuGraphExecDestroy(CUgraphExec hGraphExec);
+CUresult CUDAAPI cuGraphDestroy(CUgraph hGraph);
+
 }
+
+#include "gpu_kernel_cache.h"
+#include "gpu_warmup.h"
+#include "gpu_profile.h"
+
 extern "C" {
 
 // A cuda context defined in this module with weak linkage
@@ -158,16 +231,824 @@ WEAK void halide_set_cuda_context(CUcontext *ctx_ptr) {
     cuda_ctx_ptr = ctx_ptr;
 }
 
+// The stream that copies and kernel launches go on when
+// halide_cuda_get_stream isn't overridden. It is created along with
+// the context.
+CUstream WEAK weak_cuda_stream = 0;
+
+// Get the device to use for the work done on behalf of a
+// user_context, or -1 for the default device (HL_GPU_DEVICE, or the
+// last of the first two). Override this to drive several gpus from
+// one process, e.g. by running a pipeline on one thread per device,
+// each over its own part of the output with its own user_context.
+// Each device gets a context, stream and copy of the kernels of its
+// own. A buffer_t's device allocation belongs to the device it was
+// made on, so buffers must not be shared between user_contexts that
+// use different devices; give each its own buffer_t, which may point
+// at the same host memory.
+WEAK int halide_cuda_get_device(void *user_context) {
+    return -1;
+}
+
+// Contexts and default streams of the devices picked by
+// halide_cuda_get_device, indexed by device number. These are
+// separate from the shared context above, which is only used for the
+// default device.
+#define MAX_CUDA_DEVICES 16
+CUcontext WEAK weak_cuda_device_ctx[MAX_CUDA_DEVICES];
+CUstream WEAK weak_cuda_device_stream[MAX_CUDA_DEVICES];
+
+WEAK int halide_cuda_device_index(void *user_context) {
+    int d = halide_cuda_get_device(user_context);
+    return (d >= 0 && d < MAX_CUDA_DEVICES) ? d : -1;
+}
+
+// Get the stream to use for the work done on behalf of a
+// user_context. Override this to give each user_context a stream of
+// its own, so that e.g. the upload for the next frame can overlap the
+// computation of this one. The stream must belong to the cuda
+// context of the user_context's device.
+WEAK CUstream halide_cuda_get_stream(void *user_context) {
+    int d = halide_cuda_device_index(user_context);
+    return d < 0 ? weak_cuda_stream : weak_cuda_device_stream[d];
+}
+
+// Make the context of the device for a user_context current, until
+// the matching pop. The shared context of the default device is left
+// alone, as it always has been. Returns whether anything was pushed.
+WEAK bool halide_cuda_push_device_context(void *user_context) {
+    int d = halide_cuda_device_index(user_context);
+    if (d >= 0 && weak_cuda_device_ctx[d]) {
+        return cuCtxPushCurrent(weak_cuda_device_ctx[d]) == CUDA_SUCCESS;
+    }
+    return false;
+}
+
+WEAK void halide_cuda_pop_device_context(bool pushed) {
+    if (pushed) {
+        CUcontext ignore;
+        cuCtxPopCurrent(&ignore);
+    }
+}
+
+// The stream that last used each device allocation. When a buffer is
+// next used on a different stream, that stream waits for an event
+// recorded on the old one, which orders it after everything already
+// queued there, e.g. the kernel that wrote the buffer.
+struct buffer_stream {
+    uint64_t dev;
+    CUstream stream;
+    buffer_stream *next;
+};
+
+WEAK struct {
+    int lock;
+    buffer_stream *list;
+} halide_cuda_buffer_streams = {0, NULL};
+
+WEAK void halide_cuda_buffer_streams_lock() {
+    while (__sync_lock_test_and_set(&halide_cuda_buffer_streams.lock, 1)) {
+        while (*(volatile int *)&halide_cuda_buffer_streams.lock) {}
+    }
+}
+
+WEAK void halide_cuda_buffer_streams_unlock() {
+    __sync_lock_release(&halide_cuda_buffer_streams.lock);
+}
+
+WEAK void halide_cuda_flush_launches(void *user_context);
+
+// Record that a buffer is about to be used on a stream, and make
+// the stream wait for any work already queued on another one.
+WEAK void halide_cuda_use_buffer_on_stream(void *user_context, uint64_t dev, CUstream stream) {
+    halide_cuda_buffer_streams_lock();
+    buffer_stream *b = halide_cuda_buffer_streams.list;
+    while (b && b->dev != dev) {
+        b = b->next;
+    }
+    if (!b) {
+        b = (buffer_stream *)malloc(sizeof(buffer_stream));
+        b->dev = dev;
+        b->stream = stream;
+        b->next = halide_cuda_buffer_streams.list;
+        halide_cuda_buffer_streams.list = b;
+    } else if (b->stream != stream) {
+        // The work the event waits for has to be queued first.
+        halide_cuda_flush_launches(user_context);
+        CUevent event;
+        CHECK_CALL( cuEventCreate(&event, CU_EVENT_DISABLE_TIMING), "cuEventCreate" );
+        CHECK_CALL( cuEventRecord(event, b->stream), "cuEventRecord" );
+        CHECK_CALL( cuStreamWaitEvent(stream, event, 0), "cuStreamWaitEvent" );
+        // The wait still happens if the event is destroyed first.
+        cuEventDestroy(event);
+        b->stream = stream;
+    }
+    halide_cuda_buffer_streams_unlock();
+}
+
+WEAK void halide_cuda_forget_buffer(uint64_t dev) {
+    halide_cuda_buffer_streams_lock();
+    buffer_stream **p = &halide_cuda_buffer_streams.list;
+    while (*p && (*p)->dev != dev) {
+        p = &((*p)->next);
+    }
+    if (*p) {
+        buffer_stream *b = *p;
+        *p = b->next;
+        free(b);
+    }
+    halide_cuda_buffer_streams_unlock();
+}
+
+// In zero-copy mode, buffers with host memory use that memory
+// directly, mapped into the device's address space, and copies to and
+// from the device become no-ops. That's much faster on devices that
+// share memory with the host (e.g. Tegra), and much slower on
+// discrete gpus, whose kernels would read it across the bus. It is
+// used when the device says it is integrated, unless HL_ZERO_COPY or
+// halide_dev_set_zero_copy says otherwise. -1 until we've decided.
+WEAK int halide_cuda_zero_copy = -1;
+
+// Turn zero-copy mode on (1) or off (0), or go back to deciding
+// automatically (-1). Only affects later allocations.
+WEAK void halide_dev_set_zero_copy(int mode) {
+    halide_cuda_zero_copy = mode < 0 ? -1 : (mode ? 1 : 0);
+}
+
+WEAK bool halide_cuda_use_zero_copy(void *user_context) {
+    if (halide_cuda_zero_copy < 0) {
+        // Racing threads will all compute the same answer.
+        char *zero_copy_str = getenv("HL_ZERO_COPY");
+        if (zero_copy_str) {
+            halide_cuda_zero_copy = atoi(zero_copy_str) ? 1 : 0;
+        } else {
+            CUdevice dev;
+            int integrated = 0, can_map = 0;
+            if (cuCtxGetDevice(&dev) == CUDA_SUCCESS) {
+                cuDeviceGetAttribute(&integrated, CU_DEVICE_ATTRIBUTE_INTEGRATED, dev);
+                cuDeviceGetAttribute(&can_map, CU_DEVICE_ATTRIBUTE_CAN_MAP_HOST_MEMORY, dev);
+            }
+            #ifdef DEBUG
+            halide_printf(user_context, "Device is integrated: %d, can map host memory: %d\n",
+                          integrated, can_map);
+            #endif
+            halide_cuda_zero_copy = (integrated && can_map) ? 1 : 0;
+        }
+    }
+    return halide_cuda_zero_copy == 1;
+}
+
+// The device allocations that are really mapped host memory, and
+// whether we page-locked that memory ourselves.
+struct mapped_buffer {
+    uint64_t dev;
+    void *host;
+    bool registered;
+    mapped_buffer *next;
+};
+
+WEAK struct {
+    int lock;
+    mapped_buffer *list;
+} halide_cuda_mapped_buffers = {0, NULL};
+
+WEAK void halide_cuda_mapped_buffers_lock() {
+    while (__sync_lock_test_and_set(&halide_cuda_mapped_buffers.lock, 1)) {
+        while (*(volatile int *)&halide_cuda_mapped_buffers.lock) {}
+    }
+}
+
+WEAK void halide_cuda_mapped_buffers_unlock() {
+    __sync_lock_release(&halide_cuda_mapped_buffers.lock);
+}
+
+WEAK bool halide_cuda_is_mapped(uint64_t dev) {
+    halide_cuda_mapped_buffers_lock();
+    mapped_buffer *m = halide_cuda_mapped_buffers.list;
+    while (m && m->dev != dev) {
+        m = m->next;
+    }
+    halide_cuda_mapped_buffers_unlock();
+    return m != NULL;
+}
+
+// Map a buffer's host memory into the device's address space,
+// page-locking it first if it isn't already. Returns 0 if it can't.
+WEAK uint64_t halide_cuda_map_host(void *user_context, void *host, size_t size) {
+    CUdeviceptr p = 0;
+    bool registered = false;
+    if (cuMemHostGetDevicePointer(&p, host, 0) != CUDA_SUCCESS) {
+        if (cuMemHostRegister(host, size, CU_MEMHOSTREGISTER_PORTABLE | CU_MEMHOSTREGISTER_DEVICEMAP) != CUDA_SUCCESS) {
+            return 0;
+        }
+        registered = true;
+        if (cuMemHostGetDevicePointer(&p, host, 0) != CUDA_SUCCESS) {
+            cuMemHostUnregister(host);
+            return 0;
+        }
+    }
+
+    mapped_buffer *m = (mapped_buffer *)malloc(sizeof(mapped_buffer));
+    m->dev = (uint64_t)p;
+    m->host = host;
+    m->registered = registered;
+    halide_cuda_mapped_buffers_lock();
+    m->next = halide_cuda_mapped_buffers.list;
+    halide_cuda_mapped_buffers.list = m;
+    halide_cuda_mapped_buffers_unlock();
+    return (uint64_t)p;
+}
+
+// Forget a mapped buffer, and unlock its host memory if we locked
+// it. Returns false if it wasn't a mapped buffer.
+WEAK bool halide_cuda_unmap_host(void *user_context, uint64_t dev) {
+    halide_cuda_mapped_buffers_lock();
+    mapped_buffer **ptr = &halide_cuda_mapped_buffers.list;
+    while (*ptr && (*ptr)->dev != dev) {
+        ptr = &((*ptr)->next);
+    }
+    mapped_buffer *m = *ptr;
+    if (m) {
+        *ptr = m->next;
+    }
+    halide_cuda_mapped_buffers_unlock();
+
+    if (!m) return false;
+    // The host memory may be freed as soon as we return, so kernels
+    // using it must be done.
+    CHECK_CALL( cuCtxSynchronize(), "cuCtxSynchronize" );
+    if (m->registered) {
+        CHECK_CALL( cuMemHostUnregister(m->host), "cuMemHostUnregister" );
+    }
+    free(m);
+    return true;
+}
+
+// The device allocation cache keeps freed device allocations in
+// size classes, four per power of two from 256 bytes up to 1 GB, and
+// hands them back out to later allocations of the same class, so
+// that GPU intermediates don't cost a cuMemAlloc and cuMemFree per
+// kernel or per pipeline invocation. A cached allocation keeps its
+// entry in the buffer to stream table, so whoever gets it next waits
+// for the work queued by whoever freed it.
+#define DEV_CACHE_MIN_SHIFT 8
+#define DEV_CACHE_MAX_SHIFT 30
+#define DEV_CACHE_CLASSES ((DEV_CACHE_MAX_SHIFT - DEV_CACHE_MIN_SHIFT) * 4 + 1)
+
+struct dev_cache_block {
+    uint64_t dev;
+    // The device the allocation was made on, as in
+    // halide_cuda_device_index.
+    int device;
+    dev_cache_block *next;
+};
+
+WEAK struct {
+    int lock;
+    dev_cache_block *free_list[DEV_CACHE_CLASSES];
+    size_t cached_bytes;
+    // The most bytes the cache holds on to. Frees beyond this go back
+    // to cuMemFree.
+    size_t max_cached_bytes;
+} halide_dev_cache = {0, {NULL}, 0, (size_t)256 << 20};
+
+WEAK void halide_dev_cache_lock() {
+    while (__sync_lock_test_and_set(&halide_dev_cache.lock, 1)) {
+        while (*(volatile int *)&halide_dev_cache.lock) {}
+    }
+}
+
+WEAK void halide_dev_cache_unlock() {
+    __sync_lock_release(&halide_dev_cache.lock);
+}
+
+WEAK size_t halide_dev_cache_class_bytes(int c) {
+    return (size_t)(4 + (c & 3)) << (DEV_CACHE_MIN_SHIFT - 2 + (c >> 2));
+}
+
+// Returns the size class big enough for x bytes, or -1 if x is too
+// large to be worth caching.
+WEAK int halide_dev_cache_size_class(size_t x) {
+    for (int c = 0; c < DEV_CACHE_CLASSES; c++) {
+        if (halide_dev_cache_class_bytes(c) >= x) return c;
+    }
+    return -1;
+}
+
+// Release every cached device allocation.
+WEAK void halide_dev_cache_trim(void *user_context) {
+    halide_dev_cache_lock();
+    dev_cache_block *blocks = NULL;
+    for (int c = 0; c < DEV_CACHE_CLASSES; c++) {
+        while (dev_cache_block *b = halide_dev_cache.free_list[c]) {
+            halide_dev_cache.free_list[c] = b->next;
+            b->next = blocks;
+            blocks = b;
+        }
+    }
+    halide_dev_cache.cached_bytes = 0;
+    halide_dev_cache_unlock();
+
+    while (blocks) {
+        dev_cache_block *next = blocks->next;
+        int d = blocks->device;
+        bool pushed = (d >= 0 && weak_cuda_device_ctx[d] &&
+                       cuCtxPushCurrent(weak_cuda_device_ctx[d]) == CUDA_SUCCESS);
+        halide_cuda_forget_buffer(blocks->dev);
+        CHECK_CALL( cuMemFree(blocks->dev), "cuMemFree" );
+        if (pushed) {
+            CUcontext ignore;
+            cuCtxPopCurrent(&ignore);
+        }
+        free(blocks);
+        blocks = next;
+    }
+}
+
+// Set the most bytes of device memory the cache may hold on to. Zero
+// turns the cache off. Cached allocations beyond the new limit are
+// released.
+WEAK void halide_dev_cache_set_size(void *user_context, size_t max_cached_bytes) {
+    halide_dev_cache.max_cached_bytes = max_cached_bytes;
+    if (halide_dev_cache.cached_bytes > max_cached_bytes) {
+        halide_dev_cache_trim(user_context);
+    }
+}
+
+// Take an allocation of size class c on the user_context's device
+// from the cache, or return 0 if there isn't one.
+WEAK uint64_t halide_dev_cache_get(void *user_context, int c) {
+    int device = halide_cuda_device_index(user_context);
+    halide_dev_cache_lock();
+    dev_cache_block **ptr = &halide_dev_cache.free_list[c];
+    while (*ptr && (*ptr)->device != device) {
+        ptr = &((*ptr)->next);
+    }
+    dev_cache_block *b = *ptr;
+    if (b) {
+        *ptr = b->next;
+        halide_dev_cache.cached_bytes -= halide_dev_cache_class_bytes(c);
+    }
+    halide_dev_cache_unlock();
+
+    if (!b) return 0;
+    uint64_t dev = b->dev;
+    free(b);
+    return dev;
+}
+
+// Try to put a device allocation into the cache. Returns false if it
+// isn't an allocation the cache made, or if the cache is full.
+WEAK bool halide_dev_cache_put(void *user_context, uint64_t dev) {
+    CUdeviceptr base;
+    size_t size;
+    if (cuMemGetAddressRange(&base, &size, (CUdeviceptr)dev) != CUDA_SUCCESS ||
+        base != (CUdeviceptr)dev) {
+        return false;
+    }
+    int c = halide_dev_cache_size_class(size);
+    if (c < 0 || halide_dev_cache_class_bytes(c) != size) {
+        return false;
+    }
+
+    dev_cache_block *b = (dev_cache_block *)malloc(sizeof(dev_cache_block));
+    if (!b) return false;
+    b->dev = dev;
+    b->device = halide_cuda_device_index(user_context);
+
+    bool cached = false;
+    halide_dev_cache_lock();
+    if (halide_dev_cache.cached_bytes + size <= halide_dev_cache.max_cached_bytes) {
+        b->next = halide_dev_cache.free_list[c];
+        halide_dev_cache.free_list[c] = b;
+        halide_dev_cache.cached_bytes += size;
+        cached = true;
+    }
+    halide_dev_cache_unlock();
+
+    if (!cached) free(b);
+    return cached;
+}
+
 // Structure to hold the state of a module attached to the context.
 // Also used as a linked-list to keep track of all the different
 // modules that are attached to a context in order to release them all
 // when then context is released.
 struct _module_state_ WEAK *state_list = NULL;
+struct launch_graph;
 typedef struct _module_state_ {
     CUmodule module;
+    // The module loaded in the context of each device picked by
+    // halide_cuda_get_device.
+    CUmodule device_module[MAX_CUDA_DEVICES];
+    // The batches of kernel launches seen from this module, most
+    // recent first.
+    launch_graph *graphs;
     _module_state_ *next;
 } module_state;
 
+// When profiling, each kernel and copy is bracketed by a pair of
+// events on its stream. The events are only read back once there
+// are MAX_PROFILE_TIMINGS of them, or a report is asked for, so that
+// profiling doesn't serialize the host and the device.
+struct cuda_timing {
+    CUcontext ctx;
+    CUevent start, end;
+    gpu_profile_entry *entry;
+};
+
+#define MAX_PROFILE_TIMINGS 128
+
+WEAK struct {
+    int lock;
+    int count;
+    cuda_timing timings[MAX_PROFILE_TIMINGS];
+} halide_cuda_timings;
+
+WEAK void halide_cuda_timings_lock() {
+    while (__sync_lock_test_and_set(&halide_cuda_timings.lock, 1)) {}
+}
+
+WEAK void halide_cuda_timings_unlock() {
+    __sync_lock_release(&halide_cuda_timings.lock);
+}
+
+// Read back the device times of the kernels and copies recorded so
+// far. Waits for them to finish.
+WEAK void halide_cuda_resolve_timings() {
+    halide_cuda_timings_lock();
+    for (int i = 0; i < halide_cuda_timings.count; i++) {
+        cuda_timing *t = &halide_cuda_timings.timings[i];
+        CUcontext ignore;
+        cuCtxPushCurrent(t->ctx);
+        float msec = 0;
+        if (cuEventSynchronize(t->end) == CUDA_SUCCESS &&
+            cuEventElapsedTime(&msec, t->start, t->end) == CUDA_SUCCESS) {
+            halide_gpu_profile_add_time(t->entry, (uint64_t)(msec * 1000000.0f));
+        }
+        cuEventDestroy(t->start);
+        cuEventDestroy(t->end);
+        cuCtxPopCurrent(&ignore);
+    }
+    halide_cuda_timings.count = 0;
+    halide_cuda_timings_unlock();
+}
+
+// Record the start of a kernel or copy on a stream. Returns NULL if
+// profiling is off.
+WEAK CUevent halide_cuda_timing_start(CUstream stream) {
+    if (!halide_gpu_profile_enabled()) return NULL;
+    CUevent start;
+    if (cuEventCreate(&start, 0) != CUDA_SUCCESS) return NULL;
+    cuEventRecord(start, stream);
+    return start;
+}
+
+// Record the end of a kernel or copy started with
+// halide_cuda_timing_start, to be added to the entry later.
+WEAK void halide_cuda_timing_end(CUstream stream, CUevent start, gpu_profile_entry *e) {
+    if (!start) return;
+    CUevent end;
+    CUcontext ctx;
+    if (cuEventCreate(&end, 0) != CUDA_SUCCESS ||
+        cuCtxGetCurrent(&ctx) != CUDA_SUCCESS) {
+        cuEventDestroy(start);
+        return;
+    }
+    cuEventRecord(end, stream);
+    while (true) {
+        halide_cuda_timings_lock();
+        if (halide_cuda_timings.count < MAX_PROFILE_TIMINGS) break;
+        halide_cuda_timings_unlock();
+        halide_cuda_resolve_timings();
+    }
+    cuda_timing *t = &halide_cuda_timings.timings[halide_cuda_timings.count++];
+    t->ctx = ctx;
+    t->start = start;
+    t->end = end;
+    t->entry = e;
+    halide_cuda_timings_unlock();
+}
+
+// The occupancy of a kernel launch, in percent of the threads the
+// SMs of the device can hold. This is the most the kernel's
+// registers, shared memory and block size allow, less the SMs that
+// a small grid leaves idle; measuring what was achieved needs the
+// hardware counters, which only the profiling tools read. Returns -1
+// if it can't be worked out.
+WEAK int halide_cuda_occupancy(CUfunction f, int blocks, int threads, int shared_mem_bytes) {
+    CUdevice dev;
+    int sms = 0, max_threads = 0, active = 0;
+    if (cuCtxGetDevice(&dev) != CUDA_SUCCESS ||
+        cuDeviceGetAttribute(&sms, CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT, dev) != CUDA_SUCCESS ||
+        cuDeviceGetAttribute(&max_threads, CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_MULTIPROCESSOR, dev) != CUDA_SUCCESS ||
+        cuOccupancyMaxActiveBlocksPerMultiprocessor(&active, f, threads, shared_mem_bytes) != CUDA_SUCCESS ||
+        sms <= 0 || max_threads <= 0) {
+        return -1;
+    }
+    int blocks_per_sm = (blocks + sms - 1) / sms;
+    if (blocks_per_sm < active) {
+        active = blocks_per_sm;
+    }
+    // Threads are scheduled in whole warps.
+    int warp_threads = (threads + 31) & ~31;
+    return (int)((100LL * active * warp_threads) / max_threads);
+}
+
+WEAK void halide_dev_set_profiling(int mode) {
+    halide_gpu_profiling = mode ? 1 : 0;
+}
+
+// In launch graph mode, kernel launches are not made right away, but
+// collected until something needs their results or has to be
+// ordered after them: a copy, a free, a sync, or a launch from
+// another module or stream. A batch of launches that has been seen
+// before is sent to the device as one cuda graph, which costs about
+// as much to launch as a single kernel; so a pipeline of many gpu
+// stages that is run repeatedly on buffers of the same shapes pays
+// the launch overhead once per frame rather than once per stage. It
+// is off by default, and turned on by setting HL_LAUNCH_GRAPHS to 1
+// or calling halide_dev_set_launch_graphs. Code that uses the
+// device results of a pipeline outside of Halide must call
+// halide_dev_sync first.
+WEAK int halide_cuda_launch_graphs = -1;
+
+WEAK bool halide_cuda_use_launch_graphs() {
+    if (halide_cuda_launch_graphs < 0) {
+        char *graphs_str = getenv("HL_LAUNCH_GRAPHS");
+        halide_cuda_launch_graphs = (graphs_str && atoi(graphs_str)) ? 1 : 0;
+    }
+    return halide_cuda_launch_graphs == 1;
+}
+
+// A kernel launch, with a copy of its arguments. Each argument gets
+// an 8-byte aligned slot in arg_data.
+struct kernel_launch {
+    CUfunction f;
+    unsigned int blocks[3], threads[3];
+    unsigned int shared_mem_bytes;
+    int num_args;
+    size_t *arg_sizes;
+    size_t arg_bytes;
+    char *arg_data;
+};
+
+// A batch of launches, and once it has been seen twice, the graph
+// that replays it.
+struct launch_graph {
+    int num_launches;
+    kernel_launch *launches;
+    int times_seen;
+    CUgraphExec exec;
+    // Set if the batch couldn't be captured into a graph.
+    bool failed;
+    launch_graph *next;
+};
+
+// The most batches remembered per module. Pipelines that run on
+// buffers of many different shapes make that many different batches.
+#define MAX_LAUNCH_GRAPHS 8
+// The most launches deferred at once.
+#define MAX_PENDING_LAUNCHES 64
+
+WEAK struct {
+    int lock;
+    void *user_context;
+    module_state *state;
+    CUstream stream;
+    int count;
+    kernel_launch launches[MAX_PENDING_LAUNCHES];
+} halide_cuda_pending_launches = {0, NULL, NULL, 0, 0};
+
+WEAK void halide_cuda_pending_launches_lock() {
+    while (__sync_lock_test_and_set(&halide_cuda_pending_launches.lock, 1)) {
+        while (*(volatile int *)&halide_cuda_pending_launches.lock) {}
+    }
+}
+
+WEAK void halide_cuda_pending_launches_unlock() {
+    __sync_lock_release(&halide_cuda_pending_launches.lock);
+}
+
+WEAK bool halide_cuda_same_launch(const kernel_launch *a, const kernel_launch *b) {
+    if (a->f != b->f ||
+        a->shared_mem_bytes != b->shared_mem_bytes ||
+        a->num_args != b->num_args ||
+        a->arg_bytes != b->arg_bytes) {
+        return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (a->blocks[i] != b->blocks[i] || a->threads[i] != b->threads[i]) {
+            return false;
+        }
+    }
+    return (memcmp(a->arg_sizes, b->arg_sizes, a->num_args * sizeof(size_t)) == 0 &&
+            memcmp(a->arg_data, b->arg_data, a->arg_bytes) == 0);
+}
+
+WEAK void halide_cuda_free_launches(kernel_launch *launches, int n) {
+    for (int i = 0; i < n; i++) {
+        free(launches[i].arg_sizes);
+        free(launches[i].arg_data);
+    }
+}
+
+WEAK CUresult halide_cuda_launch(const kernel_launch *l, CUstream stream) {
+    void **params = (void **)malloc((l->num_args + 1) * sizeof(void *));
+    size_t offset = 0;
+    for (int i = 0; i < l->num_args; i++) {
+        params[i] = l->arg_data + offset;
+        offset += (l->arg_sizes[i] + 7) & ~7;
+    }
+    params[l->num_args] = NULL;
+    CUresult result = cuLaunchKernel(l->f,
+                                     l->blocks[0], l->blocks[1], l->blocks[2],
+                                     l->threads[0], l->threads[1], l->threads[2],
+                                     l->shared_mem_bytes, stream, params, NULL);
+    free(params);
+    return result;
+}
+
+// Capture a batch of launches into a graph. Returns NULL, having
+// launched nothing, if the driver won't capture the stream.
+WEAK CUgraphExec halide_cuda_capture_launches(const kernel_launch *launches, int n, CUstream stream) {
+    if (cuStreamBeginCapture(stream, CU_STREAM_CAPTURE_MODE_THREAD_LOCAL) != CUDA_SUCCESS) {
+        return NULL;
+    }
+    bool ok = true;
+    for (int i = 0; i < n && ok; i++) {
+        ok = halide_cuda_launch(&launches[i], stream) == CUDA_SUCCESS;
+    }
+    CUgraph graph = NULL;
+    ok = (cuStreamEndCapture(stream, &graph) == CUDA_SUCCESS) && ok;
+    CUgraphExec exec = NULL;
+    if (ok && cuGraphInstantiateWithFlags(&exec, graph, 0) != CUDA_SUCCESS) {
+        exec = NULL;
+    }
+    if (graph) {
+        cuGraphDestroy(graph);
+    }
+    return exec;
+}
+
+WEAK void halide_cuda_free_graph(launch_graph *g) {
+    if (g->exec) {
+        cuGraphExecDestroy(g->exec);
+    }
+    halide_cuda_free_launches(g->launches, g->num_launches);
+    free(g->launches);
+    free(g);
+}
+
+// Send the deferred launches to the device.
+WEAK void halide_cuda_flush_launches(void *user_context) {
+    halide_cuda_pending_launches_lock();
+    int n = halide_cuda_pending_launches.count;
+    if (n == 0) {
+        halide_cuda_pending_launches_unlock();
+        return;
+    }
+    kernel_launch *launches = halide_cuda_pending_launches.launches;
+    module_state *state = halide_cuda_pending_launches.state;
+    CUstream stream = halide_cuda_pending_launches.stream;
+    bool pushed = halide_cuda_push_device_context(halide_cuda_pending_launches.user_context);
+
+    // Find the batch if we've seen it before. Otherwise remember it,
+    // taking over the copies of the arguments.
+    launch_graph *g = NULL;
+    if (n > 1) {
+        launch_graph **p = &state->graphs;
+        for (g = state->graphs; g; p = &g->next, g = g->next) {
+            if (g->num_launches != n) continue;
+            bool same = true;
+            for (int i = 0; i < n && same; i++) {
+                same = halide_cuda_same_launch(&g->launches[i], &launches[i]);
+            }
+            if (same) break;
+        }
+        if (g) {
+            // Move it to the front.
+            *p = g->next;
+            halide_cuda_free_launches(launches, n);
+        } else {
+            g = (launch_graph *)malloc(sizeof(launch_graph));
+            g->num_launches = n;
+            g->launches = (kernel_launch *)malloc(n * sizeof(kernel_launch));
+            memcpy(g->launches, launches, n * sizeof(kernel_launch));
+            g->times_seen = 0;
+            g->exec = NULL;
+            g->failed = false;
+        }
+        g->next = state->graphs;
+        state->graphs = g;
+
+        // Forget the least recently used batches.
+        launch_graph *last = g;
+        for (int i = 1; i < MAX_LAUNCH_GRAPHS && last->next; i++) {
+            last = last->next;
+        }
+        while (launch_graph *old = last->next) {
+            last->next = old->next;
+            halide_cuda_free_graph(old);
+        }
+
+        g->times_seen++;
+        if (!g->exec && !g->failed && g->times_seen >= 2) {
+            g->exec = halide_cuda_capture_launches(g->launches, n, stream);
+            g->failed = (g->exec == NULL);
+            #ifdef DEBUG
+            halide_printf(user_context, "Captured %d kernel launches into a graph: %s\n",
+                          n, g->failed ? "failed" : "ok");
+            #endif
+        }
+        launches = g->launches;
+    }
+
+    // Deferred launches are timed as one batch.
+    CUevent start = halide_cuda_timing_start(stream);
+    if (g && g->exec) {
+        CHECK_CALL( cuGraphLaunch(g->exec, stream), "cuGraphLaunch" );
+    } else {
+        for (int i = 0; i < n; i++) {
+            CHECK_CALL( halide_cuda_launch(&launches[i], stream), "cuLaunchKernel" );
+        }
+        if (!g) {
+            halide_cuda_free_launches(launches, n);
+        }
+    }
+    if (start) {
+        char name[32];
+        snprintf(name, 32, "batch_of_%d", n);
+        gpu_profile_entry *e = halide_gpu_profile_record(name, halide_gpu_profile_launch_graph, 0);
+        halide_cuda_timing_end(stream, start, e);
+    }
+
+    halide_cuda_pending_launches.count = 0;
+    halide_cuda_pop_device_context(pushed);
+    halide_cuda_pending_launches_unlock();
+}
+
+// Add a launch to the deferred ones.
+WEAK void halide_cuda_defer_launch(void *user_context, module_state *state, CUstream stream,
+                                   CUfunction f, int blocksX, int blocksY, int blocksZ,
+                                   int threadsX, int threadsY, int threadsZ,
+                                   int shared_mem_bytes, size_t arg_sizes[], void *args[]) {
+    while (true) {
+        halide_cuda_pending_launches_lock();
+        int n = halide_cuda_pending_launches.count;
+        if (n == 0 || (n < MAX_PENDING_LAUNCHES &&
+                       halide_cuda_pending_launches.user_context == user_context &&
+                       halide_cuda_pending_launches.state == state &&
+                       halide_cuda_pending_launches.stream == stream)) {
+            break;
+        }
+        halide_cuda_pending_launches_unlock();
+        halide_cuda_flush_launches(user_context);
+    }
+
+    kernel_launch *l = &halide_cuda_pending_launches.launches[halide_cuda_pending_launches.count++];
+    halide_cuda_pending_launches.user_context = user_context;
+    halide_cuda_pending_launches.state = state;
+    halide_cuda_pending_launches.stream = stream;
+
+    l->f = f;
+    l->blocks[0] = blocksX;
+    l->blocks[1] = blocksY;
+    l->blocks[2] = blocksZ;
+    l->threads[0] = threadsX;
+    l->threads[1] = threadsY;
+    l->threads[2] = threadsZ;
+    l->shared_mem_bytes = shared_mem_bytes;
+    l->num_args = 0;
+    while (args[l->num_args]) {
+        l->num_args++;
+    }
+    l->arg_sizes = (size_t *)malloc((l->num_args + 1) * sizeof(size_t));
+    l->arg_bytes = 0;
+    for (int i = 0; i < l->num_args; i++) {
+        // Bools have a size of zero bits, but take up a byte.
+        l->arg_sizes[i] = arg_sizes[i] ? arg_sizes[i] : 1;
+        l->arg_bytes += (l->arg_sizes[i] + 7) & ~7;
+    }
+    l->arg_data = (char *)malloc(l->arg_bytes + 1);
+    // Clear the padding, so that launches can be compared bytewise.
+    for (size_t i = 0; i < l->arg_bytes; i++) {
+        l->arg_data[i] = 0;
+    }
+    size_t offset = 0;
+    for (int i = 0; i < l->num_args; i++) {
+        memcpy(l->arg_data + offset, args[i], l->arg_sizes[i]);
+        offset += (l->arg_sizes[i] + 7) & ~7;
+    }
+
+    halide_cuda_pending_launches_unlock();
+}
+
+WEAK void halide_dev_set_launch_graphs(int mode) {
+    halide_cuda_flush_launches(NULL);
+    halide_cuda_launch_graphs = mode ? 1 : 0;
+}
+
 static CUevent __start, __end;
 
 WEAK bool halide_validate_dev_pointer(void *user_context, buffer_t* buf) {
@@ -202,17 +1083,50 @@ WEAK void halide_dev_free(void *user_context, buffer_t* buf) {
     if (buf->dev == 0)
         return;
 
+    // Kernels still to be launched may use the allocation.
+    halide_cuda_flush_launches(user_context);
+
+    bool pushed = halide_cuda_push_device_context(user_context);
+
     #ifdef DEBUG
     halide_printf(user_context, "In dev_free of %p - dev: 0x%p\n", buf, (void*)buf->dev);
     halide_assert(user_context, halide_validate_dev_pointer(user_context, buf));
     #endif
 
-    CHECK_CALL( cuMemFree(buf->dev), "cuMemFree" );
+    if (halide_cuda_unmap_host(user_context, buf->dev)) {
+        halide_cuda_forget_buffer(buf->dev);
+    } else if (!halide_dev_cache_put(user_context, buf->dev)) {
+        halide_cuda_forget_buffer(buf->dev);
+        CHECK_CALL( cuMemFree(buf->dev), "cuMemFree" );
+    }
     buf->dev = 0;
 
+    halide_cuda_pop_device_context(pushed);
 }
 
-WEAK void* halide_init_kernels(void *user_context, void *state_ptr, const char* ptx_src, int size) {
+// Create the context for the user_context's device if there isn't
+// one yet.
+WEAK void halide_cuda_init_context(void *user_context) {
+    int d = halide_cuda_device_index(user_context);
+    if (d >= 0) {
+        if (!weak_cuda_device_ctx[d]) {
+            CHECK_CALL( cuInit(0), "cuInit" );
+            CUdevice dev;
+            CHECK_CALL( cuDeviceGet(&dev, d), "cuDeviceGet" );
+            CUcontext ctx;
+            CHECK_CALL( cuCtxCreate(&ctx, CU_CTX_MAP_HOST, dev), "cuCtxCreate" );
+            // Creating the context made it current; put back whatever
+            // was current before.
+            CUcontext ignore;
+            cuCtxPopCurrent(&ignore);
+            // Another thread may have beaten us to it.
+            if (!__sync_bool_compare_and_swap(&weak_cuda_device_ctx[d], (CUcontext)0, ctx)) {
+                cuCtxDestroy(ctx);
+            }
+        }
+        return;
+    }
+
     // If the context pointer isn't hooked up yet, point it at this module's weak-linkage context.
     if (cuda_ctx_ptr == NULL) {
         cuda_ctx_ptr = &weak_cuda_ctx;
@@ -255,24 +1169,117 @@ WEAK void* halide_init_kernels(void *user_context, void *state_ptr, const char*
 
 
         // Create context
-        CHECK_CALL( cuCtxCreate(cuda_ctx_ptr, 0, dev), "cuCtxCreate" );
+        // Allow host memory to be mapped into the device's address
+        // space, for zero-copy mode.
+        CHECK_CALL( cuCtxCreate(cuda_ctx_ptr, CU_CTX_MAP_HOST, dev), "cuCtxCreate" );
     } else {
         //CHECK_CALL( cuCtxPushCurrent(*cuda_ctx_ptr), "cuCtxPushCurrent" );
     }
+}
+
+// Load a module from the kernel cache, or compile the PTX to a cubin
+// and add it to the cache. The driver keeps a cache of its own
+// (~/.nv/ComputeCache), but it is limited in size and shared with
+// everything else on the machine. Returns false if the cache is off
+// or didn't work out, in which case the caller loads the PTX as usual.
+WEAK bool halide_cuda_load_cached_module(void *user_context, CUmodule *module,
+                                         const char *ptx_src, int size) {
+    CUdevice dev;
+    int major = 0, minor = 0, driver = 0;
+    if (cuCtxGetDevice(&dev) != CUDA_SUCCESS ||
+        cuDeviceGetAttribute(&major, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR, dev) != CUDA_SUCCESS ||
+        cuDeviceGetAttribute(&minor, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MINOR, dev) != CUDA_SUCCESS ||
+        cuDriverGetVersion(&driver) != CUDA_SUCCESS) {
+        return false;
+    }
+    char device[64];
+    snprintf(device, sizeof(device), "cuda sm_%d%d driver %d", major, minor, driver);
+
+    char path[1024];
+    if (!halide_kernel_cache_path(path, sizeof(path), device, ptx_src, size, "cubin")) {
+        return false;
+    }
+
+    size_t cubin_size = 0;
+    char *cubin = halide_kernel_cache_load(path, &cubin_size);
+    if (cubin) {
+        CUresult result = cuModuleLoadData(module, cubin);
+        free(cubin);
+        #ifdef DEBUG
+        halide_printf(user_context, "Loading %s from the kernel cache returned %d\n", path, result);
+        #endif
+        if (result == CUDA_SUCCESS) {
+            return true;
+        }
+    }
+
+    // Compile it ourselves, so that we can keep the cubin.
+    CUlinkState link;
+    if (cuLinkCreate(0, NULL, NULL, &link) != CUDA_SUCCESS) {
+        return false;
+    }
+    void *out = NULL;
+    size_t out_size = 0;
+    bool ok = (cuLinkAddData(link, CU_JIT_INPUT_PTX, (void *)ptx_src, size, "halide",
+                             0, NULL, NULL) == CUDA_SUCCESS &&
+               cuLinkComplete(link, &out, &out_size) == CUDA_SUCCESS &&
+               cuModuleLoadData(module, out) == CUDA_SUCCESS);
+    if (ok) {
+        halide_kernel_cache_store(user_context, path, out, out_size);
+    }
+    // This frees the cubin.
+    cuLinkDestroy(link);
+    return ok;
+}
+
+// Create the context, the default stream and the timing events of
+// the user_context's device, if they don't exist yet.
+WEAK int halide_gpu_init_device(void *user_context) {
+    halide_cuda_init_context(user_context);
+    bool pushed = halide_cuda_push_device_context(user_context);
+    int d = halide_cuda_device_index(user_context);
+
+    // Create two events for timing
+    if (!__start && d < 0) {
+        cuEventCreate(&__start, 0);
+        cuEventCreate(&__end, 0);
+    }
+
+    // Create the default stream. It is still ordered with respect to
+    // the legacy stream 0, which other code in the process may use.
+    CUstream *stream = d < 0 ? &weak_cuda_stream : &weak_cuda_device_stream[d];
+    if (!(*stream)) {
+        CHECK_CALL( cuStreamCreate(stream, 0), "cuStreamCreate" );
+    }
+
+    halide_cuda_pop_device_context(pushed);
+    return 0;
+}
+
+WEAK void* halide_build_kernels(void *user_context, void *state_ptr, const char* ptx_src, int size) {
+    halide_gpu_init_device(user_context);
+    bool pushed = halide_cuda_push_device_context(user_context);
+    int d = halide_cuda_device_index(user_context);
 
     // Create the module state if necessary
     module_state *state = (module_state*)state_ptr;
     if (!state) {
         state = (module_state*)malloc(sizeof(module_state));
         state->module = NULL;
+        state->graphs = NULL;
+        for (int i = 0; i < MAX_CUDA_DEVICES; i++) {
+            state->device_module[i] = NULL;
+        }
         state->next = state_list;
         state_list = state;
     }
 
-    // Initialize a module for just this Halide module
-    if ((!state->module)) {
+    // Initialize a module for just this Halide module, in the context
+    // of the user_context's device
+    CUmodule *module = d < 0 ? &state->module : &state->device_module[d];
+    if (!(*module) && !halide_cuda_load_cached_module(user_context, module, ptx_src, size)) {
         // Create module
-        CHECK_CALL( cuModuleLoadData(&state->module, ptx_src), "cuModuleLoadData" );
+        CHECK_CALL( cuModuleLoadData(module, ptx_src), "cuModuleLoadData" );
 
         #ifdef DEBUG
         halide_printf(user_context, "-------\nCompiling PTX:\n%s\n--------\n",
@@ -280,13 +1287,43 @@ WEAK void* halide_init_kernels(void *user_context, void *state_ptr, const char*
         #endif
     }
 
-    // Create two events for timing
-    if (!__start) {
-        cuEventCreate(&__start, 0);
-        cuEventCreate(&__end, 0);
+    halide_cuda_pop_device_context(pushed);
+    return state;
+}
+
+// Allocate and free page-locked host memory. Copies to and from
+// pageable memory go through a staging buffer in the driver, at
+// about half the bandwidth, and are synchronous with respect to the
+// host even when issued asynchronously. Returns NULL if the memory
+// can't be allocated.
+WEAK void *halide_dev_host_malloc(void *user_context, size_t size) {
+    halide_cuda_init_context(user_context);
+    bool pushed = halide_cuda_push_device_context(user_context);
+    void *p = NULL;
+    if (cuMemHostAlloc(&p, size, CU_MEMHOSTALLOC_PORTABLE | CU_MEMHOSTALLOC_DEVICEMAP) != CUDA_SUCCESS) {
+        p = NULL;
     }
+    halide_cuda_pop_device_context(pushed);
+    return p;
+}
 
-    return state;
+WEAK void halide_dev_host_free(void *user_context, void *p) {
+    halide_cuda_flush_launches(user_context);
+    CHECK_CALL( cuMemFreeHost(p), "cuMemFreeHost" );
+}
+
+// Page-lock existing host memory in place. Returns zero on success.
+WEAK int halide_dev_host_register(void *user_context, void *p, size_t size) {
+    halide_cuda_init_context(user_context);
+    bool pushed = halide_cuda_push_device_context(user_context);
+    int result = cuMemHostRegister(p, size, CU_MEMHOSTREGISTER_PORTABLE);
+    halide_cuda_pop_device_context(pushed);
+    return result;
+}
+
+WEAK void halide_dev_host_unregister(void *user_context, void *p) {
+    halide_cuda_flush_launches(user_context);
+    CHECK_CALL( cuMemHostUnregister(p), "cuMemHostUnregister" );
 }
 
 #ifdef DEBUG
@@ -302,6 +1339,21 @@ WEAK void* halide_init_kernels(void *user_context, void *state_ptr, const char*
 #endif
 
 WEAK void halide_release(void *user_context) {
+    halide_gpu_warmup_join();
+    halide_cuda_flush_launches(user_context);
+    // The events go away with the contexts.
+    halide_cuda_resolve_timings();
+    if (halide_gpu_profile.entries) {
+        halide_gpu_profile_print(user_context);
+        halide_gpu_profile_clear();
+    }
+    for (module_state *state = state_list; state; state = state->next) {
+        while (launch_graph *g = state->graphs) {
+            state->graphs = g->next;
+            halide_cuda_free_graph(g);
+        }
+    }
+
     // Do not do any of this if there is not context set. E.g.
     // if halide_release is called and no CUDA calls have been made.
     if (cuda_ctx_ptr != NULL) {
@@ -318,6 +1370,23 @@ WEAK void halide_release(void *user_context) {
             __start = __end = 0;
         }
 
+        // Release the cached device allocations
+        halide_dev_cache_trim(user_context);
+
+        // Destroy the default stream
+        if (weak_cuda_stream) {
+            CHECK_CALL_DEINIT_OK( cuStreamDestroy(weak_cuda_stream), "cuStreamDestroy" );
+            weak_cuda_stream = 0;
+        }
+
+        // Forget which streams used which buffers
+        halide_cuda_buffer_streams_lock();
+        while (buffer_stream *b = halide_cuda_buffer_streams.list) {
+            halide_cuda_buffer_streams.list = b->next;
+            free(b);
+        }
+        halide_cuda_buffer_streams_unlock();
+
         // Unload the modules attached to this context
         module_state *state = state_list;
         while (state) {
@@ -337,6 +1406,35 @@ WEAK void halide_release(void *user_context) {
         cuda_ctx_ptr = NULL;
     }
 
+    // Tear down the devices picked by halide_cuda_get_device
+    for (int d = 0; d < MAX_CUDA_DEVICES; d++) {
+        CUcontext ctx = weak_cuda_device_ctx[d];
+        if (!ctx) continue;
+        CHECK_CALL_DEINIT_OK( cuCtxPushCurrent(ctx), "cuCtxPushCurrent" );
+        CHECK_CALL_DEINIT_OK( cuCtxSynchronize(), "cuCtxSynchronize on exit" );
+        CUcontext ignore;
+        cuCtxPopCurrent(&ignore);
+
+        // The cached allocations free themselves in their own contexts
+        halide_dev_cache_trim(user_context);
+
+        CHECK_CALL_DEINIT_OK( cuCtxPushCurrent(ctx), "cuCtxPushCurrent" );
+        if (weak_cuda_device_stream[d]) {
+            CHECK_CALL_DEINIT_OK( cuStreamDestroy(weak_cuda_device_stream[d]), "cuStreamDestroy" );
+            weak_cuda_device_stream[d] = 0;
+        }
+        for (module_state *state = state_list; state; state = state->next) {
+            if (state->device_module[d]) {
+                CHECK_CALL_DEINIT_OK( cuModuleUnload(state->device_module[d]), "cuModuleUnload" );
+                state->device_module[d] = 0;
+            }
+        }
+        cuCtxPopCurrent(&ignore);
+
+        CHECK_CALL_DEINIT_OK( cuCtxDestroy(ctx), "cuCtxDestroy on exit" );
+        weak_cuda_device_ctx[d] = 0;
+    }
+
     //CHECK_CALL( cuCtxPopCurrent(&ignore), "cuCtxPopCurrent" );
 }
 
@@ -368,8 +1466,14 @@ static size_t __buf_size(void *user_context, buffer_t *buf) {
 }
 
 WEAK void halide_dev_malloc(void *user_context, buffer_t *buf) {
+    bool pushed = halide_cuda_push_device_context(user_context);
     if (buf->dev) {
-        // This buffer already has a device allocation
+        // This buffer already has a device allocation. This is called
+        // before every kernel that uses the buffer, so it's where
+        // kernels are ordered after work on other streams that
+        // touched it.
+        halide_cuda_use_buffer_on_stream(user_context, buf->dev, halide_cuda_get_stream(user_context));
+        halide_cuda_pop_device_context(pushed);
         return;
     }
 
@@ -383,19 +1487,62 @@ WEAK void halide_dev_malloc(void *user_context, buffer_t *buf) {
                   buf->elem_size);
     #endif
 
-    CUdeviceptr p;
-    TIME_CALL( cuMemAlloc(&p, size), "dev_malloc");
+    if (buf->host && halide_cuda_use_zero_copy(user_context)) {
+        buf->dev = halide_cuda_map_host(user_context, buf->host, size);
+        #ifdef DEBUG
+        halide_printf(user_context, "dev_malloc mapped host memory %p to %p\n",
+                      buf->host, (void *)buf->dev);
+        #endif
+        if (buf->dev) {
+            halide_cuda_use_buffer_on_stream(user_context, buf->dev, halide_cuda_get_stream(user_context));
+            halide_cuda_pop_device_context(pushed);
+            return;
+        }
+    }
+
+    int c = halide_dev_cache.max_cached_bytes ? halide_dev_cache_size_class(size) : -1;
+    if (c >= 0) {
+        buf->dev = halide_dev_cache_get(user_context, c);
+        // Allocate the whole size class, so the allocation can go
+        // back in the cache when it's freed.
+        size = halide_dev_cache_class_bytes(c);
+    }
 
-    buf->dev = (uint64_t)p;
+    if (!buf->dev) {
+        CUdeviceptr p;
+        CUresult err = cuMemAlloc(&p, size);
+        if (err == CUDA_ERROR_OUT_OF_MEMORY) {
+            // The cache may be holding on to the memory we need.
+            halide_dev_cache_trim(user_context);
+            err = cuMemAlloc(&p, size);
+        }
+        if (err != CUDA_SUCCESS) {
+            halide_printf(user_context, "CUDA: cuMemAlloc of %lld bytes returned %d\n",
+                          (long long)size, err);
+            p = 0;
+        }
+        buf->dev = (uint64_t)p;
+    }
     halide_assert(user_context, buf->dev);
+    halide_cuda_use_buffer_on_stream(user_context, buf->dev, halide_cuda_get_stream(user_context));
 
     #ifdef DEBUG
     halide_assert(user_context, halide_validate_dev_pointer(user_context, buf));
     #endif
+    halide_cuda_pop_device_context(pushed);
 }
 
 WEAK void halide_copy_to_dev(void *user_context, buffer_t* buf) {
+    // The copy may overwrite what deferred kernels are to read.
     if (buf->host_dirty) {
+        halide_cuda_flush_launches(user_context);
+    }
+    bool pushed = halide_cuda_push_device_context(user_context);
+    CUstream stream = halide_cuda_get_stream(user_context);
+    if (buf->dev) {
+        halide_cuda_use_buffer_on_stream(user_context, buf->dev, stream);
+    }
+    if (buf->host_dirty && !halide_cuda_is_mapped(buf->dev)) {
       halide_assert(user_context, buf->host && buf->dev);
         size_t size = __buf_size(user_context, buf);
         #ifdef DEBUG
@@ -404,13 +1551,24 @@ WEAK void halide_copy_to_dev(void *user_context, buffer_t* buf) {
                  size, buf->host, (void*)buf->dev, (long long)halide_current_time_ns(user_context) );
         halide_assert(user_context, halide_validate_dev_pointer(user_context, buf));
         #endif
-        TIME_CALL( cuMemcpyHtoD(buf->dev, buf->host, size), msg );
+        // This only returns before the copy is done if the host
+        // memory is page-locked.
+        CUevent start = halide_cuda_timing_start(stream);
+        TIME_CALL( cuMemcpyHtoDAsync(buf->dev, buf->host, size, stream), msg );
+        halide_runtime_stats_device_transfer(size, 1);
+        if (start) {
+            gpu_profile_entry *e = halide_gpu_profile_record("host_to_dev", halide_gpu_profile_copy_to_dev, size);
+            halide_cuda_timing_end(stream, start, e);
+        }
     }
     buf->host_dirty = false;
+    halide_cuda_pop_device_context(pushed);
 }
 
 WEAK void halide_copy_to_host(void *user_context, buffer_t* buf) {
     if (buf->dev_dirty) {
+        halide_cuda_flush_launches(user_context);
+        bool pushed = halide_cuda_push_device_context(user_context);
         halide_assert(user_context, buf->dev);
         halide_assert(user_context, buf->host);
         size_t size = __buf_size(user_context, buf);
@@ -419,14 +1577,61 @@ WEAK void halide_copy_to_host(void *user_context, buffer_t* buf) {
         snprintf(msg, 256, "copy_to_host (%zu bytes) %p -> %p", size, (void*)buf->dev, buf->host );
         halide_assert(user_context, halide_validate_dev_pointer(user_context, buf));
         #endif
-        TIME_CALL( cuMemcpyDtoH(buf->host, buf->dev, size), msg );
+        CUstream stream = halide_cuda_get_stream(user_context);
+        halide_cuda_use_buffer_on_stream(user_context, buf->dev, stream);
+        // Mapped host memory already holds the results once the
+        // kernels are done.
+        if (!halide_cuda_is_mapped(buf->dev)) {
+            CUevent start = halide_cuda_timing_start(stream);
+            TIME_CALL( cuMemcpyDtoHAsync(buf->host, buf->dev, size, stream), msg );
+            halide_runtime_stats_device_transfer(size, 0);
+            if (start) {
+                gpu_profile_entry *e = halide_gpu_profile_record("dev_to_host", halide_gpu_profile_copy_to_host, size);
+                halide_cuda_timing_end(stream, start, e);
+            }
+        }
+        // The host is about to use the data.
+        CHECK_CALL( cuStreamSynchronize(stream), "cuStreamSynchronize" );
+        halide_cuda_pop_device_context(pushed);
     }
     buf->dev_dirty = false;
 }
 
+// Copy size bytes of a buffer starting offset bytes in back to the
+// host, leaving the dirty bits alone. Used to merge the part of an
+// output computed on the gpu with the part computed on the cpu.
+WEAK void halide_copy_to_host_range(void *user_context, buffer_t* buf, int64_t offset, int64_t size) {
+    if (!buf->dev_dirty || size <= 0) return;
+    halide_cuda_flush_launches(user_context);
+    bool pushed = halide_cuda_push_device_context(user_context);
+    halide_assert(user_context, buf->dev && buf->host);
+    halide_assert(user_context, offset >= 0 && (size_t)(offset + size) <= __buf_size(user_context, buf));
+    #ifdef DEBUG
+    char msg[256];
+    snprintf(msg, 256, "copy_to_host_range (%lld bytes at %lld) %p -> %p",
+             (long long)size, (long long)offset, (void*)buf->dev, buf->host );
+    #endif
+    CUstream stream = halide_cuda_get_stream(user_context);
+    halide_cuda_use_buffer_on_stream(user_context, buf->dev, stream);
+    if (!halide_cuda_is_mapped(buf->dev)) {
+        TIME_CALL( cuMemcpyDtoHAsync(buf->host + offset, buf->dev + offset, size, stream), msg );
+        halide_runtime_stats_device_transfer(size, 0);
+    }
+    CHECK_CALL( cuStreamSynchronize(stream), "cuStreamSynchronize" );
+    halide_cuda_pop_device_context(pushed);
+}
+
+// Start any kernels launched so far, without waiting for them.
+WEAK void halide_dev_flush(void *user_context) {
+    halide_cuda_flush_launches(user_context);
+}
+
 // Used to generate correct timings when tracing
 WEAK void halide_dev_sync(void *user_context) {
-    cuCtxSynchronize();
+    halide_cuda_flush_launches(user_context);
+    bool pushed = halide_cuda_push_device_context(user_context);
+    cuStreamSynchronize(halide_cuda_get_stream(user_context));
+    halide_cuda_pop_device_context(pushed);
 }
 
 WEAK void halide_dev_run(
@@ -439,11 +1644,22 @@ WEAK void halide_dev_run(
     size_t arg_sizes[],
     void* args[]) {
 
+    bool pushed = halide_cuda_push_device_context(user_context);
     halide_assert(user_context, state_ptr);
-    CUmodule mod = ((module_state*)state_ptr)->module;
+    int d = halide_cuda_device_index(user_context);
+    module_state *state = (module_state*)state_ptr;
+    CUmodule mod = d < 0 ? state->module : state->device_module[d];
     halide_assert(user_context, mod);
     CUfunction f = __get_kernel(user_context, mod, entry_name);
 
+    if (halide_cuda_use_launch_graphs()) {
+        halide_cuda_defer_launch(user_context, state, halide_cuda_get_stream(user_context), f,
+                                 blocksX, blocksY, blocksZ, threadsX, threadsY, threadsZ,
+                                 shared_mem_bytes, arg_sizes, args);
+        halide_cuda_pop_device_context(pushed);
+        return;
+    }
+
     #ifdef DEBUG
     char msg[256];
     snprintf(
@@ -454,18 +1670,43 @@ WEAK void halide_dev_run(
     );
     #endif
 
+    CUevent start = halide_cuda_timing_start(halide_cuda_get_stream(user_context));
     TIME_CALL(
         cuLaunchKernel(
             f,
             blocksX,  blocksY,  blocksZ,
             threadsX, threadsY, threadsZ,
             shared_mem_bytes,
-            NULL, // stream
+            halide_cuda_get_stream(user_context),
             args,
             NULL
         ),
         msg
     );
+    if (start) {
+        gpu_profile_entry *e = halide_gpu_profile_record(entry_name, halide_gpu_profile_kernel, 0);
+        int blocks[] = {blocksX, blocksY, blocksZ};
+        int threads[] = {threadsX, threadsY, threadsZ};
+        if (halide_gpu_profile_set_launch(e, blocks, threads, shared_mem_bytes)) {
+            halide_gpu_profile_set_occupancy(e, halide_cuda_occupancy(f, blocksX * blocksY * blocksZ,
+                                                                      threadsX * threadsY * threadsZ,
+                                                                      shared_mem_bytes));
+        }
+        halide_cuda_timing_end(halide_cuda_get_stream(user_context), start, e);
+    }
+    halide_cuda_pop_device_context(pushed);
+}
+
+WEAK void halide_gpu_profile_report(void *user_context) {
+    halide_cuda_flush_launches(user_context);
+    halide_cuda_resolve_timings();
+    halide_gpu_profile_print(user_context);
+}
+
+WEAK void halide_gpu_profile_reset(void *user_context) {
+    halide_cuda_flush_launches(user_context);
+    halide_cuda_resolve_timings();
+    halide_gpu_profile_clear();
 }
 
 } // extern "C" linkage
@@ -0,0 +1,79 @@
+#include "mini_stdint.h"
+
+// A clock on the same time base as halide_current_time_ns that reads
+// a hardware counter (the time stamp counter on x86, the generic
+// timer on aarch64) instead of making a syscall, so that it's cheap
+// enough to call around every task or tile. The counter is
+// calibrated against the OS clock on first use. Where there is no
+// usable counter, or if HL_CYCLE_CLOCK=0, it is the OS clock.
+
+extern "C" {
+
+extern char *getenv(const char *);
+extern int atoi(const char *);
+extern int halide_start_clock(void *user_context);
+extern int64_t halide_current_time_ns(void *user_context);
+extern uint64_t halide_read_cycle_counter();
+extern int64_t halide_cycle_counter_frequency();
+
+struct halide_cycle_clock_t {
+    // Zero until calibrated, then 1 if the counter is used, or -1 if
+    // the OS clock is.
+    int state;
+    volatile int lock;
+    // The counter and the OS clock at the same moment.
+    uint64_t base_cycles;
+    int64_t base_ns;
+    double ns_per_cycle;
+};
+
+WEAK halide_cycle_clock_t halide_cycle_clock = {0, 0, 0, 0, 0.0};
+
+WEAK void halide_calibrate_cycle_clock(void *user_context) {
+    while (__sync_lock_test_and_set(&halide_cycle_clock.lock, 1)) {}
+    if (halide_cycle_clock.state == 0) {
+        halide_start_clock(user_context);
+        char *clock_str = getenv("HL_CYCLE_CLOCK");
+        int64_t frequency = halide_cycle_counter_frequency();
+        int state = -1;
+        if (frequency >= 0 && (!clock_str || atoi(clock_str) != 0)) {
+            uint64_t c0 = halide_read_cycle_counter();
+            int64_t t0 = halide_current_time_ns(user_context);
+            if (frequency == 0) {
+                // Count the ticks over a millisecond of the OS clock.
+                uint64_t c1;
+                int64_t t1;
+                do {
+                    c1 = halide_read_cycle_counter();
+                    t1 = halide_current_time_ns(user_context);
+                } while (t1 - t0 < 1000000);
+                if (c1 > c0) {
+                    halide_cycle_clock.ns_per_cycle = (double)(t1 - t0) / (double)(c1 - c0);
+                    state = 1;
+                }
+            } else {
+                halide_cycle_clock.ns_per_cycle = 1e9 / (double)frequency;
+                state = 1;
+            }
+            halide_cycle_clock.base_cycles = c0;
+            halide_cycle_clock.base_ns = t0;
+        }
+        __sync_synchronize();
+        halide_cycle_clock.state = state;
+    }
+    __sync_lock_release(&halide_cycle_clock.lock);
+}
+
+// Safe to call from any thread without locking once calibrated.
+WEAK int64_t halide_fast_time_ns(void *user_context) {
+    if (halide_cycle_clock.state == 0) {
+        halide_calibrate_cycle_clock(user_context);
+    }
+    if (halide_cycle_clock.state < 0) {
+        return halide_current_time_ns(user_context);
+    }
+    int64_t ticks = (int64_t)(halide_read_cycle_counter() - halide_cycle_clock.base_cycles);
+    return halide_cycle_clock.base_ns + (int64_t)((double)ticks * halide_cycle_clock.ns_per_cycle);
+}
+
+}
@@ -0,0 +1,142 @@
+#include "mini_stdint.h"
+#include "HalideRuntime.h"
+
+#define WEAK __attribute__((weak))
+#ifndef NULL
+#define NULL 0
+#endif
+
+extern "C" {
+
+extern void *malloc(size_t);
+extern void free(void *);
+extern int strcmp(const char *, const char *);
+extern size_t strlen(const char *);
+extern void *memcpy(void *, const void *, size_t);
+extern char *getenv(const char *);
+extern int atoi(const char *);
+
+// The share of the split dimension of each Func scheduled with
+// split_devices that goes to the gpu, in 1/1024ths, adjusted after
+// every run according to how long each device took, and the output
+// size at which each pipeline compiled with a gpu dispatch moves to
+// the gpu (or -1 to use the size it was compiled with). There are
+// only ever a few entries, so they go in a list, protected by a spin
+// lock.
+struct halide_device_split_entry {
+    halide_device_split_entry *next;
+    char *name;
+    int32_t gpu_share;
+    int64_t gpu_min_size;
+};
+
+WEAK struct {
+    int lock;
+    halide_device_split_entry *entries;
+} halide_device_split = {0, NULL};
+
+WEAK void halide_device_split_lock() {
+    while (__sync_lock_test_and_set(&halide_device_split.lock, 1)) {
+        while (*(volatile int *)&halide_device_split.lock) {}
+    }
+}
+
+WEAK void halide_device_split_unlock() {
+    __sync_lock_release(&halide_device_split.lock);
+}
+
+// Must be called with the lock held. Returns NULL if out of memory.
+WEAK halide_device_split_entry *halide_device_split_find(const char *name) {
+    halide_device_split_entry *e = halide_device_split.entries;
+    while (e && strcmp(e->name, name)) {
+        e = e->next;
+    }
+    if (!e) {
+        e = (halide_device_split_entry *)malloc(sizeof(halide_device_split_entry));
+        if (!e) return NULL;
+        size_t name_len = strlen(name) + 1;
+        e->name = (char *)malloc(name_len);
+        if (!e->name) {
+            free(e);
+            return NULL;
+        }
+        memcpy(e->name, name, name_len);
+        char *percent_str = getenv("HL_GPU_PERCENT");
+        int percent = percent_str ? atoi(percent_str) : 50;
+        if (percent < 0) percent = 0;
+        if (percent > 100) percent = 100;
+        e->gpu_share = (percent * 1024) / 100;
+        char *size_str = getenv("HL_GPU_DISPATCH_SIZE");
+        e->gpu_min_size = size_str ? atoi(size_str) : -1;
+        e->next = halide_device_split.entries;
+        halide_device_split.entries = e;
+    }
+    return e;
+}
+
+WEAK int32_t halide_device_split_extent(void *user_context, const char *name, int32_t extent) {
+    halide_device_split_lock();
+    halide_device_split_entry *e = halide_device_split_find(name);
+    int32_t share = e ? e->gpu_share : 512;
+    halide_device_split_unlock();
+    return (int32_t)(((int64_t)extent * share + 512) / 1024);
+}
+
+WEAK void halide_device_split_report(void *user_context, const char *name,
+                                     int32_t gpu_extent, int32_t cpu_extent,
+                                     int64_t cpu_ns, int64_t wait_ns) {
+    halide_device_split_lock();
+    halide_device_split_entry *e = halide_device_split_find(name);
+    // If either device got nothing (because the extent was small, or
+    // HL_GPU_PERCENT put everything on one side) there's nothing to
+    // compare, so the share stays where it is.
+    if (e && gpu_extent > 0 && cpu_extent > 0 && cpu_ns > 0) {
+        int32_t share = e->gpu_share;
+        if (wait_ns * 16 < cpu_ns) {
+            // The gpu was done before the cpu, or nearly, so we only
+            // know it's at least as fast as it looks. Give it more.
+            share += (1024 - share) / 8 + 1;
+        } else {
+            // The gpu took cpu_ns + wait_ns to do its part. Move half
+            // way to the share that would have made both take the
+            // same time.
+            double gpu_rate = gpu_extent / (double)(cpu_ns + wait_ns);
+            double cpu_rate = cpu_extent / (double)cpu_ns;
+            int32_t balanced = (int32_t)(1024 * gpu_rate / (gpu_rate + cpu_rate));
+            share = (share + balanced) / 2;
+        }
+        // Never starve either device completely, so that there's
+        // always a measurement to adapt with.
+        if (share < 16) share = 16;
+        if (share > 1008) share = 1008;
+        e->gpu_share = share;
+    }
+    halide_device_split_unlock();
+}
+
+WEAK int32_t halide_device_split_gpu_percent(void *user_context, const char *name) {
+    halide_device_split_lock();
+    halide_device_split_entry *e = halide_device_split_find(name);
+    int32_t share = e ? e->gpu_share : 512;
+    halide_device_split_unlock();
+    return (share * 100 + 512) / 1024;
+}
+
+WEAK int64_t halide_gpu_dispatch_threshold(void *user_context, const char *name, int64_t default_size) {
+    halide_device_split_lock();
+    halide_device_split_entry *e = halide_device_split_find(name);
+    int64_t size = (e && e->gpu_min_size >= 0) ? e->gpu_min_size : default_size;
+    halide_device_split_unlock();
+    return size;
+}
+
+WEAK void halide_set_gpu_dispatch_threshold(void *user_context, const char *name, int64_t size) {
+    halide_device_split_lock();
+    halide_device_split_entry *e = halide_device_split_find(name);
+    if (e) {
+        e->gpu_min_size = size;
+    }
+    halide_device_split_unlock();
+}
+
+}
@@ -0,0 +1,228 @@
+#include "mini_stdint.h"
+#include "../buffer_t.h"
+#include "HalideRuntime.h"
+
+#define WEAK __attribute__((weak))
+#ifndef NULL
+#define NULL 0
+#endif
+
+extern "C" {
+
+extern void *malloc(size_t);
+extern void free(void *);
+extern void *memcpy(void *, const void *, size_t);
+
+// The communication layer. These defaults run everything as a single
+// rank. Link in strong definitions of all five (e.g. on top of MPI)
+// to run a pipeline across many processes.
+
+WEAK int32_t halide_distributed_rank(void *user_context) {
+    return 0;
+}
+
+WEAK int32_t halide_distributed_num_ranks(void *user_context) {
+    return 1;
+}
+
+WEAK int halide_distributed_allgather(void *user_context, const void *send, int32_t size, void *recv) {
+    memcpy(recv, send, size);
+    return 0;
+}
+
+WEAK int halide_distributed_send(void *user_context, int32_t rank, const void *data, int64_t size) {
+    halide_printf(user_context, "No communication layer to send to rank %d with\n", rank);
+    return -1;
+}
+
+WEAK int halide_distributed_recv(void *user_context, int32_t rank, void *data, int64_t size) {
+    halide_printf(user_context, "No communication layer to receive from rank %d with\n", rank);
+    return -1;
+}
+
+// The range of a dimension of a Func each rank needs, and the range it
+// computes.
+struct halide_distributed_range {
+    int32_t needed_min, needed_max;
+    int32_t owned_min, owned_max;
+};
+
+// Gather the ranges needed by every rank, and decide which rank
+// computes each coordinate. Where the needed ranges of neighbouring
+// ranks overlap, the overlap is split down the middle. Each rank only
+// computes coordinates it needs itself, so if the needed ranges don't
+// go up with the rank, everyone just computes everything it needs.
+// Returns NULL on failure.
+WEAK halide_distributed_range *halide_distributed_partition(void *user_context,
+                                                            int32_t needed_min, int32_t needed_max,
+                                                            int32_t *num_ranks) {
+    int32_t n = halide_distributed_num_ranks(user_context);
+    halide_distributed_range *ranges =
+        (halide_distributed_range *)malloc(n * sizeof(halide_distributed_range));
+    if (!ranges) return NULL;
+    int32_t mine[2] = {needed_min, needed_max};
+    int32_t *all = (int32_t *)malloc(n * sizeof(mine));
+    if (!all || halide_distributed_allgather(user_context, mine, sizeof(mine), all)) {
+        free(all);
+        free(ranges);
+        return NULL;
+    }
+
+    bool monotonic = true;
+    for (int32_t r = 0; r < n; r++) {
+        ranges[r].needed_min = all[2*r];
+        ranges[r].needed_max = all[2*r + 1];
+        if (r > 0 && (ranges[r].needed_min < ranges[r-1].needed_min ||
+                      ranges[r].needed_max < ranges[r-1].needed_max)) {
+            monotonic = false;
+        }
+    }
+    free(all);
+
+    // The first coordinate owned by rank r + 1 is boundary[r].
+    int64_t prev_boundary = -0x7fffffffLL - 1;
+    for (int32_t r = 0; r < n; r++) {
+        halide_distributed_range &range = ranges[r];
+        int64_t boundary = 0x7fffffffLL;
+        if (r < n - 1) {
+            int64_t next_min = ranges[r+1].needed_min;
+            if (next_min <= range.needed_max + 1) {
+                boundary = (next_min + range.needed_max + 1) / 2;
+            } else {
+                boundary = next_min;
+            }
+        }
+        if (monotonic) {
+            range.owned_min = (int32_t)(prev_boundary > range.needed_min ? prev_boundary : range.needed_min);
+            range.owned_max = (int32_t)(boundary - 1 < range.needed_max ? boundary - 1 : range.needed_max);
+        } else {
+            range.owned_min = range.needed_min;
+            range.owned_max = range.needed_max;
+        }
+        prev_boundary = boundary;
+    }
+
+    *num_ranks = n;
+    return ranges;
+}
+
+// The coordinates a rank needs but doesn't compute, below and above
+// those it computes. If it computes nothing, it's all below.
+WEAK void halide_distributed_missing(const halide_distributed_range &r,
+                                     int32_t *lo_min, int32_t *lo_max,
+                                     int32_t *hi_min, int32_t *hi_max) {
+    if (r.owned_min > r.owned_max) {
+        *lo_min = r.needed_min;
+        *lo_max = r.needed_max;
+        *hi_min = 1;
+        *hi_max = 0;
+    } else {
+        *lo_min = r.needed_min;
+        *lo_max = r.owned_min - 1;
+        *hi_min = r.owned_max + 1;
+        *hi_max = r.needed_max;
+    }
+}
+
+WEAK int32_t halide_distributed_owned_min(void *user_context, const char *name,
+                                          int32_t needed_min, int32_t needed_max) {
+    int32_t n = 0;
+    halide_distributed_range *ranges =
+        halide_distributed_partition(user_context, needed_min, needed_max, &n);
+    if (!ranges) return needed_min;
+    int32_t result = ranges[halide_distributed_rank(user_context)].owned_min;
+    free(ranges);
+    return result;
+}
+
+WEAK int32_t halide_distributed_owned_max(void *user_context, const char *name,
+                                          int32_t needed_min, int32_t needed_max) {
+    int32_t n = 0;
+    halide_distributed_range *ranges =
+        halide_distributed_partition(user_context, needed_min, needed_max, &n);
+    if (!ranges) return needed_max;
+    int32_t result = ranges[halide_distributed_rank(user_context)].owned_max;
+    free(ranges);
+    return result;
+}
+
+// Send or receive the coordinates of dimension dim of buf from min to
+// max. The dimension is the outermost one of the buffer, so they're
+// contiguous.
+WEAK int halide_distributed_transfer(void *user_context, buffer_t *buf, int32_t dim,
+                                     int32_t min, int32_t max, int32_t rank, bool send) {
+    if (min > max) return 0;
+    int64_t slice = (int64_t)buf->stride[dim] * buf->elem_size;
+    uint8_t *data = buf->host + (min - buf->min[dim]) * slice;
+    int64_t size = (max - min + 1) * slice;
+    if (send) {
+        return halide_distributed_send(user_context, rank, data, size);
+    } else {
+        return halide_distributed_recv(user_context, rank, data, size);
+    }
+}
+
+WEAK int halide_distributed_exchange(void *user_context, const char *name, buffer_t *buf, int32_t dim,
+                                     int32_t needed_min, int32_t needed_max,
+                                     int32_t owned_min, int32_t owned_max) {
+    int32_t me = halide_distributed_rank(user_context);
+    int32_t n = halide_distributed_num_ranks(user_context);
+    if (n == 1) return 0;
+
+    halide_distributed_range mine = {needed_min, needed_max, owned_min, owned_max};
+    halide_distributed_range *ranges =
+        (halide_distributed_range *)malloc(n * sizeof(halide_distributed_range));
+    if (!ranges) return -1;
+    if (halide_distributed_allgather(user_context, &mine, sizeof(mine), ranges)) {
+        free(ranges);
+        return -1;
+    }
+
+    // Check every coordinate needed is computed somewhere.
+    for (int32_t p = 0; p < n; p++) {
+        int32_t missing[4];
+        halide_distributed_missing(ranges[p], &missing[0], &missing[1], &missing[2], &missing[3]);
+        for (int i = 0; i < 4; i += 2) {
+            int64_t found = 0;
+            for (int32_t k = 0; k < n; k++) {
+                if (k == p) continue;
+                int32_t lo = ranges[k].owned_min > missing[i] ? ranges[k].owned_min : missing[i];
+                int32_t hi = ranges[k].owned_max < missing[i+1] ? ranges[k].owned_max : missing[i+1];
+                if (hi >= lo) found += hi - lo + 1;
+            }
+            if (missing[i+1] >= missing[i] && found != (int64_t)missing[i+1] - missing[i] + 1) {
+                halide_printf(user_context, "Rank %d needs values of %s from %d to %d "
+                              "that no other rank computes\n",
+                              p, name, missing[i], missing[i+1]);
+                free(ranges);
+                return -1;
+            }
+        }
+    }
+
+    // Trade with each other rank in turn, the lower one sending
+    // first, so that blocking sends can't deadlock.
+    int32_t my_missing[4];
+    halide_distributed_missing(ranges[me], &my_missing[0], &my_missing[1], &my_missing[2], &my_missing[3]);
+    int result = 0;
+    for (int32_t p = 0; p < n && result == 0; p++) {
+        if (p == me) continue;
+        int32_t their_missing[4];
+        halide_distributed_missing(ranges[p], &their_missing[0], &their_missing[1],
+                                   &their_missing[2], &their_missing[3]);
+        for (int step = 0; step < 2 && result == 0; step++) {
+            bool send = (step == 0) == (me < p);
+            const int32_t *wanted = send ? their_missing : my_missing;
+            const halide_distributed_range &source = send ? ranges[me] : ranges[p];
+            for (int i = 0; i < 4 && result == 0; i += 2) {
+                int32_t lo = source.owned_min > wanted[i] ? source.owned_min : wanted[i];
+                int32_t hi = source.owned_max < wanted[i+1] ? source.owned_max : wanted[i+1];
+                result = halide_distributed_transfer(user_context, buf, dim, lo, hi, p, send);
+            }
+        }
+    }
+    free(ranges);
+    return result;
+}
+
+}
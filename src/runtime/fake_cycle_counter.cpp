@@ -0,0 +1,15 @@
+#include "mini_stdint.h"
+
+extern "C" {
+
+// There is no counter that halide_fast_time_ns can use on this
+// architecture, so it falls back to the OS clock.
+WEAK uint64_t halide_read_cycle_counter() {
+    return 0;
+}
+
+WEAK int64_t halide_cycle_counter_frequency() {
+    return -1;
+}
+
+}
@@ -0,0 +1,10 @@
+#include "mini_stdint.h"
+
+extern "C" {
+
+// There's no cheap way to ask this OS, so assume a typical machine.
+WEAK int halide_host_cache_size(int level) {
+    return level <= 1 ? 32 * 1024 : level == 2 ? 256 * 1024 : 2 * 1024 * 1024;
+}
+
+}
@@ -0,0 +1,9 @@
+#include "mini_stdint.h"
+
+extern "C" {
+
+// There are no transparent huge pages to ask for on this OS.
+WEAK void halide_advise_huge_pages(void *user_context, void *ptr, int32_t size) {
+}
+
+}
@@ -0,0 +1,17 @@
+#include "mini_stdint.h"
+
+extern "C" {
+
+// There are no hardware counters the profiler can read on this OS.
+WEAK bool halide_perf_counters_open(int *fds) {
+    return false;
+}
+
+WEAK bool halide_perf_counters_read(const int *fds, uint64_t *values) {
+    return false;
+}
+
+WEAK void halide_perf_counters_close(const int *fds) {
+}
+
+}
@@ -0,0 +1,11 @@
+#include "mini_stdint.h"
+
+extern "C" {
+
+WEAK void halide_pin_worker_thread(int worker_index) {
+}
+
+WEAK void halide_set_worker_priority(int priority) {
+}
+
+}
@@ -7,6 +7,43 @@ extern "C" {
 WEAK void halide_shutdown_thread_pool() {
 }
 
+WEAK int halide_set_num_threads(int n) {
+    return 1;
+}
+
+// There is only one pool here, so every pool is the shared one.
+WEAK void *halide_create_thread_pool(int num_threads, int priority) {
+    return 0;
+}
+
+WEAK void halide_destroy_thread_pool(void *pool) {
+}
+
+WEAK int halide_set_thread_pool(void *user_context, void *pool) {
+    return 0;
+}
+
+WEAK void halide_set_thread_pool_wakeup(void *pool, int spin_count, int targeted_wakeup) {
+}
+
+WEAK int halide_get_num_threads(void *user_context) {
+    return 1;
+}
+
+// Everything runs on the calling thread. Thread ids are never zero.
+WEAK size_t halide_current_thread_id() {
+    return 1;
+}
+
+// Background work runs to completion on the calling thread.
+WEAK void *halide_spawn_thread(void *(*f)(void *), void *closure) {
+    f(closure);
+    return (void *)1;
+}
+
+WEAK void halide_join_thread(void *thread) {
+}
+
 WEAK int (*halide_custom_do_task)(void *, int (*)(void *, int, uint8_t *),
                                   int, uint8_t *);
 
@@ -22,6 +59,51 @@ WEAK void halide_set_custom_do_par_for(int (*f)(void *, int (*)(void *, int, uin
     halide_custom_do_par_for = f;
 }
 
+// Nothing runs concurrently here, so nothing ever waits on these
+// (halide_reserve_worker returns zero, which keeps producers in
+// lockstep with their consumers).
+struct halide_semaphore {
+    int count;
+};
+
+WEAK int halide_reserve_worker(void *user_context) {
+    return 0;
+}
+
+WEAK int halide_release_worker(void *user_context, int reserved) {
+    return 0;
+}
+
+extern void *halide_malloc(void *user_context, size_t);
+extern void halide_free(void *user_context, void *ptr);
+
+WEAK halide_semaphore *halide_make_semaphore(void *user_context, int count) {
+    halide_semaphore *sem = (halide_semaphore *)halide_malloc(user_context, sizeof(halide_semaphore));
+    if (!sem) return NULL;
+    sem->count = count;
+    return sem;
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore *sem) {
+    sem->count--;
+    return 0;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore *sem) {
+    sem->count++;
+    return 0;
+}
+
+WEAK int halide_semaphore_abandon(halide_semaphore *sem) {
+    return 0;
+}
+
+WEAK int halide_free_semaphore(void *user_context, halide_semaphore *sem) {
+    if (!sem) return 0;
+    halide_free(user_context, sem);
+    return 0;
+}
+
 WEAK int halide_do_task(void *user_context, int (*f)(void *, int, uint8_t *),
                         int idx, uint8_t *closure) {
     if (halide_custom_do_task) {
@@ -13,14 +13,154 @@ extern dispatch_queue_t dispatch_get_global_queue(
 extern void dispatch_apply_f(size_t iterations, dispatch_queue_t queue,
                              void *context, void (*work)(void *, size_t));
 
+typedef long pthread_t;
+extern pthread_t pthread_self();
+extern int pthread_create(pthread_t *thread, const void *attr,
+                          void *(*start_routine)(void *), void *arg);
+extern int pthread_join(pthread_t thread, void **retval);
+extern void *malloc(size_t);
+extern void free(void *);
+
+// Timing of parallel loops, for HL_TIMELINE_FILE (see timeline.cpp).
+struct halide_timeline_job;
+extern halide_timeline_job *halide_timeline_job_begin(void *user_context);
+extern int64_t halide_timeline_task_begin(void *user_context, halide_timeline_job *job);
+extern void halide_timeline_task_end(void *user_context, halide_timeline_job *job,
+                                     int task, int64_t begin_ns);
+extern void halide_timeline_job_end(void *user_context, halide_timeline_job *job, int size);
+
 WEAK void halide_shutdown_thread_pool() {
 }
 
+// Grand Central Dispatch owns the threads, so we can't resize it.
+extern int halide_host_cpu_count();
+
+WEAK int halide_set_num_threads(int n) {
+    return halide_host_cpu_count();
+}
+
+// A pool here is a global dispatch queue of some priority, and the
+// number of threads to spread each parallel loop across.
+struct halide_thread_pool {
+    int threads;
+    dispatch_queue_priority_t priority;
+};
+
+#define DISPATCH_QUEUE_PRIORITY_HIGH 2
+#define DISPATCH_QUEUE_PRIORITY_DEFAULT 0
+#define DISPATCH_QUEUE_PRIORITY_LOW (-2)
+#define DISPATCH_QUEUE_PRIORITY_BACKGROUND (-32768)
+
+WEAK halide_thread_pool halide_gcd_default_pool = {0, DISPATCH_QUEUE_PRIORITY_DEFAULT};
+
+// Nice values map onto the four priorities of the global queues. The
+// background one is also throttled for io.
+WEAK halide_thread_pool *halide_create_thread_pool(int num_threads, int priority) {
+    halide_thread_pool *pool = (halide_thread_pool *)malloc(sizeof(halide_thread_pool));
+    if (!pool) return NULL;
+    pool->threads = num_threads < 0 ? 0 : num_threads;
+    if (priority < 0) {
+        pool->priority = DISPATCH_QUEUE_PRIORITY_HIGH;
+    } else if (priority == 0) {
+        pool->priority = DISPATCH_QUEUE_PRIORITY_DEFAULT;
+    } else if (priority < 15) {
+        pool->priority = DISPATCH_QUEUE_PRIORITY_LOW;
+    } else {
+        pool->priority = DISPATCH_QUEUE_PRIORITY_BACKGROUND;
+    }
+    return pool;
+}
+
+// The binding from user_context values to pools, as in the posix
+// thread pool.
+#define MAX_POOL_BINDINGS 16
+WEAK struct {
+    int lock;
+    int count;
+    void *user_context[MAX_POOL_BINDINGS];
+    halide_thread_pool *pool[MAX_POOL_BINDINGS];
+} halide_thread_pool_bindings;
+
+WEAK void halide_thread_pool_bindings_lock() {
+    while (__sync_lock_test_and_set(&halide_thread_pool_bindings.lock, 1)) {}
+}
+
+WEAK void halide_thread_pool_bindings_unlock() {
+    __sync_lock_release(&halide_thread_pool_bindings.lock);
+}
+
+WEAK int halide_set_thread_pool(void *user_context, halide_thread_pool *pool) {
+    int result = 0;
+    halide_thread_pool_bindings_lock();
+    int i = 0;
+    while (i < halide_thread_pool_bindings.count &&
+           halide_thread_pool_bindings.user_context[i] != user_context) {
+        i++;
+    }
+    if (pool == NULL) {
+        if (i < halide_thread_pool_bindings.count) {
+            int last = --halide_thread_pool_bindings.count;
+            halide_thread_pool_bindings.user_context[i] = halide_thread_pool_bindings.user_context[last];
+            halide_thread_pool_bindings.pool[i] = halide_thread_pool_bindings.pool[last];
+        }
+    } else if (i < MAX_POOL_BINDINGS) {
+        halide_thread_pool_bindings.user_context[i] = user_context;
+        halide_thread_pool_bindings.pool[i] = pool;
+        if (i == halide_thread_pool_bindings.count) {
+            halide_thread_pool_bindings.count++;
+        }
+    } else {
+        result = -1;
+    }
+    halide_thread_pool_bindings_unlock();
+    return result;
+}
+
+WEAK void halide_destroy_thread_pool(halide_thread_pool *pool) {
+    halide_thread_pool_bindings_lock();
+    for (int i = halide_thread_pool_bindings.count - 1; i >= 0; i--) {
+        if (halide_thread_pool_bindings.pool[i] == pool) {
+            int last = --halide_thread_pool_bindings.count;
+            halide_thread_pool_bindings.user_context[i] = halide_thread_pool_bindings.user_context[last];
+            halide_thread_pool_bindings.pool[i] = halide_thread_pool_bindings.pool[last];
+        }
+    }
+    halide_thread_pool_bindings_unlock();
+    free(pool);
+}
+
+WEAK halide_thread_pool *halide_pool_for_context(void *user_context) {
+    if (halide_thread_pool_bindings.count == 0) {
+        return &halide_gcd_default_pool;
+    }
+    halide_thread_pool *pool = &halide_gcd_default_pool;
+    halide_thread_pool_bindings_lock();
+    for (int i = 0; i < halide_thread_pool_bindings.count; i++) {
+        if (halide_thread_pool_bindings.user_context[i] == user_context) {
+            pool = halide_thread_pool_bindings.pool[i];
+            break;
+        } else if (halide_thread_pool_bindings.user_context[i] == NULL) {
+            pool = halide_thread_pool_bindings.pool[i];
+        }
+    }
+    halide_thread_pool_bindings_unlock();
+    return pool;
+}
+
+// The threads of Grand Central Dispatch don't wait for work.
+WEAK void halide_set_thread_pool_wakeup(halide_thread_pool *pool, int spin_count, int targeted_wakeup) {
+}
+
+WEAK int halide_get_num_threads(void *user_context) {
+    halide_thread_pool *pool = halide_pool_for_context(user_context);
+    return pool->threads > 0 ? pool->threads : halide_host_cpu_count();
+}
+
 WEAK int (*halide_custom_do_task)(void *user_context, int (*)(void *, int, uint8_t *),
                                   int, uint8_t *);
 
-  WEAK void halide_set_custom_do_task(int (*f)(void *, int (*)(void *, int, uint8_t *),
-                                               int, uint8_t *)) {
+WEAK void halide_set_custom_do_task(int (*f)(void *, int (*)(void *, int, uint8_t *),
+                                             int, uint8_t *)) {
     halide_custom_do_task = f;
 }
 
@@ -32,6 +172,29 @@ WEAK void halide_set_custom_do_par_for(int (*f)(void *, int (*)(void *, int, uin
     halide_custom_do_par_for = f;
 }
 
+WEAK size_t halide_current_thread_id() {
+    return (size_t)pthread_self();
+}
+
+// Start a thread of its own, outside of Grand Central Dispatch, for
+// work that runs in the background (see write_debug_image.cpp), and
+// which must be finished before the code it runs is freed. Returns
+// NULL if the thread couldn't be started.
+WEAK void *halide_spawn_thread(void *(*f)(void *), void *closure) {
+    pthread_t *thread = (pthread_t *)malloc(sizeof(pthread_t));
+    if (thread && pthread_create(thread, NULL, f, closure) != 0) {
+        free(thread);
+        thread = NULL;
+    }
+    return thread;
+}
+
+WEAK void halide_join_thread(void *thread) {
+    void *retval;
+    pthread_join(*(pthread_t *)thread, &retval);
+    free(thread);
+}
+
 WEAK int halide_do_task(void *user_context, int (*f)(void *, int, uint8_t *),
                         int idx, uint8_t *closure) {
     if (halide_custom_do_task) {
@@ -41,31 +204,150 @@ WEAK int halide_do_task(void *user_context, int (*f)(void *, int, uint8_t *),
     }
 }
 
+// Counting semaphores, used to keep the producer of a folded buffer
+// a bounded distance ahead of its consumer (see Func::async).
+typedef struct dispatch_semaphore_s *dispatch_semaphore_t;
+typedef uint64_t dispatch_time_t;
+#define DISPATCH_TIME_FOREVER (~0ull)
+
+extern dispatch_semaphore_t dispatch_semaphore_create(long value);
+extern long dispatch_semaphore_wait(dispatch_semaphore_t dsema, dispatch_time_t timeout);
+extern long dispatch_semaphore_signal(dispatch_semaphore_t dsema);
+extern void dispatch_release(void *object);
+
+// A task that fails abandons them, after which acquiring one fails
+// at once.
+struct halide_semaphore {
+    dispatch_semaphore_t sem;
+    volatile int abandoned;
+};
+
+WEAK halide_semaphore *halide_make_semaphore(void *user_context, int count) {
+    halide_semaphore *s = (halide_semaphore *)malloc(sizeof(halide_semaphore));
+    if (!s) return NULL;
+    s->sem = dispatch_semaphore_create(count);
+    if (!s->sem) {
+        free(s);
+        return NULL;
+    }
+    s->abandoned = 0;
+    return s;
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore *s) {
+    if (!s->abandoned) {
+        dispatch_semaphore_wait(s->sem, DISPATCH_TIME_FOREVER);
+    }
+    if (s->abandoned) {
+        // Pass the wakeup on to anyone else waiting.
+        dispatch_semaphore_signal(s->sem);
+        return -1;
+    }
+    return 0;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore *s) {
+    dispatch_semaphore_signal(s->sem);
+    return 0;
+}
+
+WEAK int halide_semaphore_abandon(halide_semaphore *s) {
+    s->abandoned = 1;
+    __sync_synchronize();
+    dispatch_semaphore_signal(s->sem);
+    return 0;
+}
+
+WEAK int halide_free_semaphore(void *user_context, halide_semaphore *s) {
+    if (!s) return 0;
+    dispatch_release(s->sem);
+    free(s);
+    return 0;
+}
+
+// Parallel loops use up to halide_get_num_threads threads, including
+// the caller, so async producers are promised the others.
+WEAK volatile int halide_gcd_reserved_workers = 0;
+
+WEAK int halide_reserve_worker(void *user_context) {
+    if (halide_custom_do_par_for) return 0;
+    int workers = halide_get_num_threads(user_context) - 1;
+    int reserved = __sync_add_and_fetch(&halide_gcd_reserved_workers, 1);
+    if (reserved > workers) {
+        __sync_sub_and_fetch(&halide_gcd_reserved_workers, 1);
+        return 0;
+    }
+    return 1;
+}
+
+WEAK int halide_release_worker(void *user_context, int reserved) {
+    if (!reserved) return 0;
+    __sync_sub_and_fetch(&halide_gcd_reserved_workers, 1);
+    return 0;
+}
+
 struct halide_gcd_job {
     int (*f)(void *, int, uint8_t *);
     void *user_context;
     uint8_t *closure;
-    int min;
+    int min, size, chunks;
     int exit_status;
+    halide_timeline_job *timeline;
 };
 
 // Take a call from grand-central-dispatch's parallel for loop, and
-// make a call to Halide's do task
+// run one chunk of the iterations of the Halide loop.
 WEAK void halide_do_gcd_task(void *job, size_t idx) {
     halide_gcd_job *j = (halide_gcd_job *)job;
-    j->exit_status = halide_do_task(j->user_context, j->f, j->min + (int)idx,
-                                    j->closure);
+    int begin_idx = (int)(((int64_t)j->size * (int64_t)idx) / j->chunks);
+    int end_idx = (int)(((int64_t)j->size * (int64_t)(idx + 1)) / j->chunks);
+    for (int i = j->min + begin_idx; i < j->min + end_idx; i++) {
+        // Skip the rest of the chunk once some task has failed or
+        // been cancelled.
+        if (j->exit_status) break;
+        int64_t begin = halide_timeline_task_begin(j->user_context, j->timeline);
+        int result = halide_do_task(j->user_context, j->f, i, j->closure);
+        halide_timeline_task_end(j->user_context, j->timeline, i, begin);
+        if (result) {
+            // Keep the first failure.
+            __sync_bool_compare_and_swap(&j->exit_status, 0, result);
+        }
+    }
 }
 
+// Dispatching a block per iteration costs far more than the work of
+// each one in loops with thousands of small iterations, so the
+// iterations are coalesced into a few chunks per cpu. A few rather
+// than one, so that the chunks balance out when some cpus are busy
+// with other work. A pool with a number of threads uses that many
+// chunks, so no more threads than that work on the loop. Nested
+// parallel loops are fine: dispatch_apply_f can be called from one of
+// its own blocks, and limits the threads the inner loops use.
+#define HALIDE_GCD_CHUNKS_PER_CPU 4
+
 WEAK int halide_do_par_for(void *user_context, int (*f)(void *, int, uint8_t *),
                            int min, int size, uint8_t *closure) {
+    if (halide_custom_do_par_for) {
+        return (*halide_custom_do_par_for)(user_context, f, min, size, closure);
+    }
+    if (size <= 0) {
+        return 0;
+    }
+
+    halide_thread_pool *pool = halide_pool_for_context(user_context);
+    int chunks = pool->threads > 0 ? pool->threads : halide_host_cpu_count() * HALIDE_GCD_CHUNKS_PER_CPU;
+
     halide_gcd_job job;
     job.f = f;
     job.user_context = user_context;
     job.closure = closure;
     job.min = min;
+    job.size = size;
+    job.chunks = chunks < size ? chunks : size;
     job.exit_status = 0;
-    dispatch_apply_f(size, dispatch_get_global_queue(0, 0), &job, &halide_do_gcd_task);
+    job.timeline = halide_timeline_job_begin(user_context);
+    dispatch_apply_f(job.chunks, dispatch_get_global_queue(pool->priority, 0), &job, &halide_do_gcd_task);
+    halide_timeline_job_end(user_context, job.timeline, size);
     return job.exit_status;
 }
 
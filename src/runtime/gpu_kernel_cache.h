@@ -0,0 +1,88 @@
+#ifndef HALIDE_GPU_KERNEL_CACHE_H
+#define HALIDE_GPU_KERNEL_CACHE_H
+
+// A cache on disk of gpu kernels compiled for a particular device,
+// shared by the CUDA and OpenCL runtimes. Building kernels from
+// source can take hundreds of milliseconds per pipeline, on every
+// run of a program. It is used when HL_KERNEL_CACHE_DIR names a
+// directory, and each entry is keyed by a hash of the kernel source
+// and a description of the device and driver. An entry that fails to
+// load is rebuilt from source and replaced.
+
+extern "C" {
+
+extern void *fopen(const char *, const char *);
+extern int fclose(void *);
+extern size_t fread(void *, size_t, size_t, void *);
+extern size_t fwrite(const void *, size_t, size_t, void *);
+extern int fseek(void *, long, int);
+extern long ftell(void *);
+extern int rename(const char *, const char *);
+extern int remove(const char *);
+
+// FNV-1a
+WEAK uint64_t halide_kernel_cache_hash(uint64_t h, const void *data, size_t size) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+// Get the path of the entry for some kernel source on a device.
+// Returns false if the cache is off.
+WEAK bool halide_kernel_cache_path(char *path, size_t max_path, const char *device,
+                                   const char *src, size_t size, const char *ext) {
+    const char *dir = getenv("HL_KERNEL_CACHE_DIR");
+    if (!dir || !dir[0]) return false;
+
+    uint64_t h = 14695981039346656037ULL;
+    for (const char *d = device; *d; d++) {
+        h = halide_kernel_cache_hash(h, d, 1);
+    }
+    h = halide_kernel_cache_hash(h, src, size);
+    int len = snprintf(path, max_path, "%s/halide_%016llx.%s", dir, (unsigned long long)h, ext);
+    return len > 0 && (size_t)len < max_path;
+}
+
+// Returns the contents of an entry in a buffer to be freed by the
+// caller, or NULL if there isn't one.
+WEAK char *halide_kernel_cache_load(const char *path, size_t *size) {
+    void *f = fopen(path, "rb");
+    if (!f) return NULL;
+    char *data = NULL;
+    long n = (fseek(f, 0, 2) == 0) ? ftell(f) : -1;
+    if (n > 0 && fseek(f, 0, 0) == 0) {
+        data = (char *)malloc(n + 1);
+        if (fread(data, 1, n, f) == (size_t)n) {
+            // Nul-terminate it in case it's text.
+            data[n] = 0;
+            *size = n;
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(f);
+    return data;
+}
+
+// Write an entry. It goes to a temporary file first, so that other
+// processes never see half of one.
+WEAK void halide_kernel_cache_store(void *user_context, const char *path, const void *data, size_t size) {
+    char tmp_path[1024];
+    int len = snprintf(tmp_path, sizeof(tmp_path), "%s.%lld.tmp", path,
+                       (long long)halide_current_time_ns(user_context));
+    if (len <= 0 || (size_t)len >= sizeof(tmp_path)) return;
+    void *f = fopen(tmp_path, "wb");
+    if (!f) return;
+    bool ok = fwrite(data, 1, size, f) == size;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef HALIDE_GPU_PROFILE_H
+#define HALIDE_GPU_PROFILE_H
+
+// Statistics about the kernels and copies run on the gpu, shared by
+// the CUDA and OpenCL runtimes. They are gathered when HL_GPU_PROFILE
+// is set to 1, or after halide_dev_set_profiling(1). The runtimes
+// record device events around each kernel launch and copy, without
+// waiting on them, and only read back the device times when the
+// events pile up or a report is asked for; so it can be left on in
+// optimized builds. halide_gpu_profile_report prints the totals in
+// the format of the Halide profiler, for util/HalideProf, under the
+// func name $gpu$.
+
+extern "C" {
+
+extern int strncmp(const char *, const char *, size_t);
+
+enum {
+    halide_gpu_profile_kernel = 0,
+    halide_gpu_profile_copy_to_dev = 1,
+    halide_gpu_profile_copy_to_host = 2,
+    halide_gpu_profile_launch_graph = 3
+};
+
+// The totals for one kernel or kind of copy.
+struct gpu_profile_entry {
+    char name[64];
+    int kind;
+    uint64_t count;
+    uint64_t nsec;
+    uint64_t bytes;
+    // The launch config of the last launch of a kernel, and its
+    // occupancy in percent of the threads an SM can hold, or -1 if
+    // it isn't known.
+    int blocks[3], threads[3];
+    int shared_mem_bytes;
+    int occupancy;
+    gpu_profile_entry *next;
+};
+
+WEAK struct {
+    int lock;
+    gpu_profile_entry *entries;
+} halide_gpu_profile = {0, NULL};
+
+WEAK int halide_gpu_profiling = -1;
+
+WEAK void halide_gpu_profile_lock() {
+    while (__sync_lock_test_and_set(&halide_gpu_profile.lock, 1)) {}
+}
+
+WEAK void halide_gpu_profile_unlock() {
+    __sync_lock_release(&halide_gpu_profile.lock);
+}
+
+WEAK bool halide_gpu_profile_enabled() {
+    if (halide_gpu_profiling < 0) {
+        char *profile_str = getenv("HL_GPU_PROFILE");
+        halide_gpu_profiling = (profile_str && atoi(profile_str)) ? 1 : 0;
+    }
+    return halide_gpu_profiling == 1;
+}
+
+static const char *gpu_profile_op_types[] = {"kernel", "copy", "copy", "graph"};
+
+// Get the entry for a kernel or copy, making it if necessary. Must be
+// called with the lock held.
+WEAK gpu_profile_entry *halide_gpu_profile_find(const char *name, int kind) {
+    for (gpu_profile_entry *e = halide_gpu_profile.entries; e; e = e->next) {
+        if (e->kind == kind && !strncmp(e->name, name, sizeof(e->name) - 1)) {
+            return e;
+        }
+    }
+    gpu_profile_entry *e = (gpu_profile_entry *)malloc(sizeof(gpu_profile_entry));
+    // The profiler's output is split on spaces.
+    size_t i = 0;
+    for (; name[i] && i < sizeof(e->name) - 1; i++) {
+        e->name[i] = name[i] == ' ' ? '_' : name[i];
+    }
+    e->name[i] = 0;
+    e->kind = kind;
+    e->count = 0;
+    e->nsec = 0;
+    e->bytes = 0;
+    for (int j = 0; j < 3; j++) {
+        e->blocks[j] = e->threads[j] = 0;
+    }
+    e->shared_mem_bytes = 0;
+    e->occupancy = -1;
+    e->next = halide_gpu_profile.entries;
+    halide_gpu_profile.entries = e;
+    return e;
+}
+
+// Count one more run of a kernel or copy, and the bytes it moved.
+// Returns the entry to add its device time to.
+WEAK gpu_profile_entry *halide_gpu_profile_record(const char *name, int kind, uint64_t bytes) {
+    halide_gpu_profile_lock();
+    gpu_profile_entry *e = halide_gpu_profile_find(name, kind);
+    e->count++;
+    e->bytes += bytes;
+    halide_gpu_profile_unlock();
+    return e;
+}
+
+// Add the device time of one run of a kernel or copy to its entry.
+WEAK void halide_gpu_profile_add_time(gpu_profile_entry *e, uint64_t nsec) {
+    halide_gpu_profile_lock();
+    e->nsec += nsec;
+    halide_gpu_profile_unlock();
+}
+
+// Remember the launch config of a kernel. Returns true if it is not
+// the same as last time, in which case its occupancy is unknown.
+WEAK bool halide_gpu_profile_set_launch(gpu_profile_entry *e, const int *blocks,
+                                        const int *threads, int shared_mem_bytes) {
+    halide_gpu_profile_lock();
+    bool changed = e->shared_mem_bytes != shared_mem_bytes;
+    for (int i = 0; i < 3; i++) {
+        changed = changed || e->blocks[i] != blocks[i] || e->threads[i] != threads[i];
+        e->blocks[i] = blocks[i];
+        e->threads[i] = threads[i];
+    }
+    e->shared_mem_bytes = shared_mem_bytes;
+    if (changed) {
+        e->occupancy = -1;
+    }
+    halide_gpu_profile_unlock();
+    return changed;
+}
+
+WEAK void halide_gpu_profile_set_occupancy(gpu_profile_entry *e, int occupancy) {
+    halide_gpu_profile_lock();
+    e->occupancy = occupancy;
+    halide_gpu_profile_unlock();
+}
+
+// Print the profile. Device times must have been read back already.
+WEAK void halide_gpu_profile_print(void *user_context) {
+    const char *prefix = "halide_profiler";
+    const char *func = "$gpu$";
+    const char *parent = "$total$ $total$";
+
+    halide_gpu_profile_lock();
+    // The times are in nanoseconds, so there is one tick per
+    // nanosecond.
+    uint64_t total = 0;
+    for (gpu_profile_entry *e = halide_gpu_profile.entries; e; e = e->next) {
+        total += e->nsec;
+    }
+    halide_printf(user_context, "%s ticks %s $total$ $total$ null null %llu\n",
+                  prefix, func, (unsigned long long)total);
+    halide_printf(user_context, "%s nsec %s $total$ $total$ null null %llu\n",
+                  prefix, func, (unsigned long long)total);
+    for (gpu_profile_entry *e = halide_gpu_profile.entries; e; e = e->next) {
+        const char *op = gpu_profile_op_types[e->kind];
+        halide_printf(user_context, "%s count %s %s %s %s %llu\n",
+                      prefix, func, op, e->name, parent, (unsigned long long)e->count);
+        halide_printf(user_context, "%s ticks %s %s %s %s %llu\n",
+                      prefix, func, op, e->name, parent, (unsigned long long)e->nsec);
+        if (e->bytes) {
+            halide_printf(user_context, "%s bytes %s %s %s %s %llu\n",
+                          prefix, func, op, e->name, parent, (unsigned long long)e->bytes);
+        }
+        if (e->kind == halide_gpu_profile_kernel) {
+            halide_printf(user_context, "%s blocks %s %s %s %s %lld\n",
+                          prefix, func, op, e->name, parent,
+                          (long long)e->blocks[0] * e->blocks[1] * e->blocks[2]);
+            halide_printf(user_context, "%s threads %s %s %s %s %lld\n",
+                          prefix, func, op, e->name, parent,
+                          (long long)e->threads[0] * e->threads[1] * e->threads[2]);
+            halide_printf(user_context, "%s shmem %s %s %s %s %d\n",
+                          prefix, func, op, e->name, parent, e->shared_mem_bytes);
+            if (e->occupancy >= 0) {
+                halide_printf(user_context, "%s occupancy %s %s %s %s %d\n",
+                              prefix, func, op, e->name, parent, e->occupancy);
+            }
+        }
+    }
+    halide_gpu_profile_unlock();
+}
+
+// Forget the profile.
+WEAK void halide_gpu_profile_clear() {
+    halide_gpu_profile_lock();
+    while (gpu_profile_entry *e = halide_gpu_profile.entries) {
+        halide_gpu_profile.entries = e->next;
+        free(e);
+    }
+    halide_gpu_profile_unlock();
+}
+
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef HALIDE_GPU_WARMUP_H
+#define HALIDE_GPU_WARMUP_H
+
+// Building the kernels of pipelines ahead of their first run, shared
+// by the CUDA and OpenCL runtimes. Each pipeline compiled for one of
+// them registers its kernel source from a static constructor, and
+// halide_gpu_warmup builds everything registered. The runtime defines
+// halide_gpu_init_device, which creates the context and queue, and
+// halide_build_kernels, which builds one module in them.
+
+extern "C" {
+
+extern void *malloc(size_t);
+extern void *halide_spawn_thread(void *(*f)(void *), void *closure);
+extern void halide_join_thread(void *thread);
+
+WEAK int halide_gpu_init_device(void *user_context);
+WEAK void *halide_build_kernels(void *user_context, void *state_ptr, const char *src, int size);
+
+struct halide_kernel_registration {
+    const char *src;
+    int size;
+    // The module state built for it, by whichever of the warm-up and
+    // the pipeline got there first.
+    void *state;
+    halide_kernel_registration *next;
+};
+
+// Only ever prepended to, so it can be walked without the lock.
+WEAK halide_kernel_registration * volatile halide_registered_kernels = NULL;
+
+// Held while a module is built, so that a pipeline that starts while
+// the warm-up builds its kernels waits for them instead of building
+// them again.
+WEAK int halide_kernel_init_lock = 0;
+
+WEAK void *halide_gpu_warmup_thread = NULL;
+
+WEAK void halide_kernel_init_lock_acquire() {
+    while (__sync_lock_test_and_set(&halide_kernel_init_lock, 1)) {}
+}
+
+WEAK void halide_kernel_init_lock_release() {
+    __sync_lock_release(&halide_kernel_init_lock);
+}
+
+WEAK void halide_register_kernels(const char *src, int size) {
+    halide_kernel_registration *r =
+        (halide_kernel_registration *)malloc(sizeof(halide_kernel_registration));
+    if (!r) return;
+    r->src = src;
+    r->size = size;
+    r->state = NULL;
+    halide_kernel_init_lock_acquire();
+    r->next = halide_registered_kernels;
+    halide_registered_kernels = r;
+    halide_kernel_init_lock_release();
+}
+
+WEAK void *halide_init_kernels(void *user_context, void *state_ptr, const char *src, int size) {
+    halide_kernel_registration *r = halide_registered_kernels;
+    while (r && r->src != src) {
+        r = r->next;
+    }
+
+    halide_kernel_init_lock_acquire();
+    if (!state_ptr && r) {
+        state_ptr = r->state;
+    }
+    void *state = halide_build_kernels(user_context, state_ptr, src, size);
+    if (r) {
+        r->state = state;
+    }
+    halide_kernel_init_lock_release();
+    return state;
+}
+
+WEAK int halide_gpu_build_registered_kernels(void *user_context) {
+    halide_kernel_init_lock_acquire();
+    int result = halide_gpu_init_device(user_context);
+    halide_kernel_init_lock_release();
+    if (result != 0) {
+        return result;
+    }
+
+    // Take the lock once per module, so that a pipeline waits for at
+    // most one module that isn't its own.
+    for (halide_kernel_registration *r = halide_registered_kernels; r; r = r->next) {
+        halide_kernel_init_lock_acquire();
+        if (!r->state) {
+            r->state = halide_build_kernels(user_context, NULL, r->src, r->size);
+        }
+        bool ok = r->state != NULL;
+        halide_kernel_init_lock_release();
+        if (!ok) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+WEAK void *halide_gpu_warmup_main(void *user_context) {
+    halide_gpu_build_registered_kernels(user_context);
+    return NULL;
+}
+
+// Wait for a warm-up running in the background, if there is one.
+WEAK void halide_gpu_warmup_join() {
+    void *thread = __sync_lock_test_and_set(&halide_gpu_warmup_thread, (void *)NULL);
+    if (thread) {
+        halide_join_thread(thread);
+    }
+}
+
+WEAK int halide_gpu_warmup(void *user_context, int wait) {
+    halide_gpu_warmup_join();
+    if (!wait) {
+        void *thread = halide_spawn_thread(halide_gpu_warmup_main, user_context);
+        if (thread) {
+            halide_gpu_warmup_thread = thread;
+            return 0;
+        }
+        // Do it here instead.
+    }
+    return halide_gpu_build_registered_kernels(user_context);
+}
+
+}
+
+#endif
@@ -0,0 +1,37 @@
+#include "mini_stdint.h"
+
+// The tokens of the blocks of functions scheduled with
+// Func::compute_lazily. A token is 0 while its block hasn't been
+// computed, 1 while a thread is computing it, and 2 once it's done.
+
+#define WEAK __attribute__((weak))
+
+extern "C" {
+
+// Returns 1 if the caller should compute the block, and 0 once
+// another thread has computed it.
+WEAK int halide_lazy_block_claim(int32_t *token) {
+    volatile int32_t *t = token;
+    while (true) {
+        int32_t state = *t;
+        if (state == 2) {
+            // Don't let reads of the block move above the read of
+            // the token.
+            __sync_synchronize();
+            return 0;
+        }
+        if (state == 0 && __sync_bool_compare_and_swap(token, 0, 1)) {
+            return 1;
+        }
+        // Blocks are small, so wait for the thread computing it.
+    }
+}
+
+WEAK int halide_lazy_block_release(int32_t *token) {
+    // Make the values of the block visible before the token.
+    __sync_synchronize();
+    *(volatile int32_t *)token = 2;
+    return 0;
+}
+
+}
@@ -35,6 +35,7 @@ WEAK timespec halide_reference_clock;
 
 // The syscall number for gettime varies across platforms:
 // -- android arm is 263
+// -- android aarch64 is 113
 // -- i386 and android x86 is 265
 // -- x64 is 228
 
@@ -0,0 +1,26 @@
+#include "mini_stdint.h"
+
+extern "C" {
+
+extern long sysconf(int);
+
+// The defaults when the OS doesn't know, e.g. in some VMs.
+WEAK int halide_default_cache_size(int level) {
+    return level <= 1 ? 32 * 1024 : level == 2 ? 256 * 1024 : 2 * 1024 * 1024;
+}
+
+WEAK int halide_host_cache_size(int level) {
+    static int sizes[4] = {0, 0, 0, 0};
+    if (level < 1) level = 1;
+    if (level > 3) level = 3;
+    if (sizes[level] == 0) {
+        // _SC_LEVEL1_DCACHE_SIZE, _SC_LEVEL2_CACHE_SIZE, and
+        // _SC_LEVEL3_CACHE_SIZE in glibc.
+        const int names[4] = {0, 188, 191, 194};
+        long size = sysconf(names[level]);
+        sizes[level] = size > 0 ? (int)size : halide_default_cache_size(level);
+    }
+    return sizes[level];
+}
+
+}
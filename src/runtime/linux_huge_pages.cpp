@@ -0,0 +1,44 @@
+#include "mini_stdint.h"
+
+extern "C" {
+
+extern char *getenv(const char *);
+extern int atoi(const char *);
+extern int madvise(void *addr, size_t length, int advice);
+
+#define MADV_HUGEPAGE 14
+#define HUGE_PAGE_SIZE (2 << 20)
+
+// The smallest allocation worth backing with huge pages, in bytes. -1
+// until HL_HUGE_PAGE_THRESHOLD (in megabytes) has been read.
+WEAK int64_t halide_huge_page_threshold = -1;
+
+// Ask the kernel to back the whole 2MB pages inside a large allocation
+// with transparent huge pages. Called by the pipeline on each heap
+// allocation it makes under the huge_pages target feature, before the
+// allocation is first touched.
+WEAK void halide_advise_huge_pages(void *user_context, void *ptr, int32_t size) {
+    if (halide_huge_page_threshold < 0) {
+        // Racing threads will all compute the same answer.
+        char *threshold_str = getenv("HL_HUGE_PAGE_THRESHOLD");
+        int64_t threshold = 4 << 20;
+        if (threshold_str) {
+            threshold = (int64_t)atoi(threshold_str) << 20;
+        }
+        halide_huge_page_threshold = threshold;
+    }
+
+    if (size < halide_huge_page_threshold || size < HUGE_PAGE_SIZE) return;
+
+    // halide_malloc doesn't return page-aligned memory, and madvise
+    // needs it, so only advise the aligned range inside.
+    size_t begin = ((size_t)ptr + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+    size_t end = ((size_t)ptr + size) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+    if (end > begin) {
+        // The advice only fails on kernels without transparent huge
+        // pages, which just don't get them.
+        madvise((void *)begin, end - begin, MADV_HUGEPAGE);
+    }
+}
+
+}
@@ -0,0 +1,111 @@
+#include "mini_stdint.h"
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+extern "C" {
+
+extern long syscall(long number, ...);
+extern int uname(void *buf);
+extern long read(int, void *, size_t);
+extern int close(int);
+
+// The hardware counters the profiler reads for each thread: cycles,
+// instructions retired, and last level cache misses.
+#define HALIDE_PERF_COUNTERS 3
+
+// The leading fields of the kernel's struct perf_event_attr, which is
+// all that PERF_ATTR_SIZE_VER0 covers.
+struct halide_perf_event_attr {
+    uint32_t type;
+    uint32_t size;
+    uint64_t config;
+    uint64_t sample_period;
+    uint64_t sample_type;
+    uint64_t read_format;
+    uint64_t flags;
+    uint32_t wakeup_events;
+    uint32_t bp_type;
+    uint64_t config1;
+};
+
+// The system call number of perf_event_open. The runtime modules are
+// only compiled once per pointer size, so the architecture is read
+// from uname. Returns -1 if it's not one we know.
+WEAK long halide_perf_event_open_number() {
+    // The fields of struct utsname are 65 chars each, and machine is
+    // the fifth.
+    char uts[6 * 65];
+    if (uname(uts) != 0) return -1;
+    const char *machine = uts + 4 * 65;
+    bool x86 = (machine[0] == 'x' && machine[1] == '8' && machine[2] == '6') ||
+        (machine[0] == 'i' && machine[2] == '8' && machine[3] == '6');
+    bool arm = (machine[0] == 'a' && machine[1] == 'r' && machine[2] == 'm') ||
+        (machine[0] == 'a' && machine[1] == 'a' && machine[2] == 'r');
+    #ifdef BITS_64
+    if (x86) return 298;
+    if (arm) return 241;
+    #else
+    if (x86) return 336;
+    if (arm) return 364;
+    #endif
+    return -1;
+}
+
+// Start counting, in user mode only, on the calling thread. The
+// counters are opened as one group, led by fds[0], so they are read
+// together. Returns false if the kernel won't let us count,
+// e.g. because of /proc/sys/kernel/perf_event_paranoid.
+WEAK bool halide_perf_counters_open(int *fds) {
+    // PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    // PERF_COUNT_HW_CACHE_MISSES.
+    const uint64_t config[HALIDE_PERF_COUNTERS] = {0, 1, 3};
+    long number = halide_perf_event_open_number();
+    for (int i = 0; i < HALIDE_PERF_COUNTERS; i++) {
+        fds[i] = -1;
+    }
+    if (number < 0) return false;
+    for (int i = 0; i < HALIDE_PERF_COUNTERS; i++) {
+        halide_perf_event_attr attr;
+        char *a = (char *)&attr;
+        for (size_t j = 0; j < sizeof(attr); j++) a[j] = 0;
+        attr.type = 0; // PERF_TYPE_HARDWARE
+        attr.size = sizeof(attr);
+        attr.config = config[i];
+        attr.read_format = 8; // PERF_FORMAT_GROUP
+        attr.flags = (1 << 5) | (1 << 6); // exclude_kernel, exclude_hv
+        // This thread, on any cpu.
+        fds[i] = (int)syscall(number, &attr, 0, -1, i ? fds[0] : -1, 0);
+        if (fds[i] < 0) {
+            for (int j = 0; j < i; j++) {
+                close(fds[j]);
+                fds[j] = -1;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+// Read the counts of the calling thread since it opened its counters.
+WEAK bool halide_perf_counters_read(const int *fds, uint64_t *values) {
+    // The number of counters, and then their values.
+    uint64_t buf[HALIDE_PERF_COUNTERS + 1];
+    if (read(fds[0], buf, sizeof(buf)) != (long)sizeof(buf) ||
+        buf[0] != HALIDE_PERF_COUNTERS) {
+        return false;
+    }
+    for (int i = 0; i < HALIDE_PERF_COUNTERS; i++) {
+        values[i] = buf[i + 1];
+    }
+    return true;
+}
+
+WEAK void halide_perf_counters_close(const int *fds) {
+    for (int i = HALIDE_PERF_COUNTERS - 1; i >= 0; i--) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+}
+
+}
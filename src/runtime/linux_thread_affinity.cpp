@@ -0,0 +1,101 @@
+#include "mini_stdint.h"
+
+extern "C" {
+
+extern char *getenv(const char *);
+extern int atoi(const char *);
+extern int open(const char *, int, ...);
+extern int close(int);
+extern long read(int, void *, size_t);
+extern int sched_setaffinity(int pid, size_t cpusetsize, const void *mask);
+extern int setpriority(int which, int who, int prio);
+
+// Enough for 1024 cpus
+#define MAX_AFFINITY_WORDS 16
+
+// Append the decimal representation of a non-negative integer
+WEAK char *halide_append_int(char *dst, int x) {
+    char buf[16];
+    int n = 0;
+    do {
+        buf[n++] = '0' + (x % 10);
+        x /= 10;
+    } while (x);
+    while (n) *dst++ = buf[--n];
+    *dst = 0;
+    return dst;
+}
+
+// Read the cpulist of a NUMA node from sysfs (e.g. "0-11,24-35")
+// into a cpu mask. Returns false if the node does not exist.
+WEAK bool halide_read_numa_node_cpus(int node, uint64_t *mask) {
+    char path[64];
+    const char *prefix = "/sys/devices/system/node/node";
+    char *p = path;
+    while (*prefix) *p++ = *prefix++;
+    p = halide_append_int(p, node);
+    const char *suffix = "/cpulist";
+    while (*suffix) *p++ = *suffix++;
+    *p = 0;
+
+    int fd = open(path, 0);
+    if (fd < 0) return false;
+    char buf[1024];
+    long len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0) return false;
+    buf[len] = 0;
+
+    for (int i = 0; i < MAX_AFFINITY_WORDS; i++) mask[i] = 0;
+
+    char *c = buf;
+    while (*c >= '0' && *c <= '9') {
+        int first = 0;
+        while (*c >= '0' && *c <= '9') first = first * 10 + (*c++ - '0');
+        int last = first;
+        if (*c == '-') {
+            c++;
+            last = 0;
+            while (*c >= '0' && *c <= '9') last = last * 10 + (*c++ - '0');
+        }
+        for (int cpu = first; cpu <= last && cpu < MAX_AFFINITY_WORDS * 64; cpu++) {
+            mask[cpu / 64] |= (uint64_t)1 << (cpu % 64);
+        }
+        if (*c == ',') c++;
+    }
+    return true;
+}
+
+WEAK int halide_numa_nodes = -1;
+
+// Restrict a thread pool worker to the cpus of one NUMA node, dealing
+// workers out round-robin across the nodes. Does nothing on machines
+// with a single node, or if HL_NUMA=0.
+WEAK void halide_pin_worker_thread(int worker_index) {
+    if (halide_numa_nodes < 0) {
+        // Racing threads will all compute the same answer.
+        char *numa_str = getenv("HL_NUMA");
+        int nodes = 0;
+        if (!numa_str || atoi(numa_str) != 0) {
+            uint64_t mask[MAX_AFFINITY_WORDS];
+            while (halide_read_numa_node_cpus(nodes, mask)) nodes++;
+        }
+        halide_numa_nodes = nodes;
+    }
+
+    if (halide_numa_nodes < 2) return;
+
+    uint64_t mask[MAX_AFFINITY_WORDS];
+    if (halide_read_numa_node_cpus(worker_index % halide_numa_nodes, mask)) {
+        sched_setaffinity(0, sizeof(mask), mask);
+    }
+}
+
+// Set the nice value of the calling worker thread. On linux
+// setpriority with PRIO_PROCESS and a zero id applies to the calling
+// thread only.
+WEAK void halide_set_worker_priority(int priority) {
+    setpriority(0, 0, priority);
+}
+
+}
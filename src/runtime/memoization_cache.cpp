@@ -0,0 +1,200 @@
+#include "mini_stdint.h"
+#include "HalideRuntime.h"
+
+#define WEAK __attribute__((weak))
+#ifndef NULL
+#define NULL 0
+#endif
+
+extern "C" {
+
+extern void *malloc(size_t);
+extern void free(void *);
+extern void *memcpy(void *, const void *, size_t);
+extern int memcmp(const void *, const void *, size_t);
+
+// The memoization cache holds copies of the realizations of memoized
+// Funcs, keyed on the values they were computed from. Entries are
+// chained into a hash table, and also into a list in order of most
+// recent use, so that the least recently used ones can be evicted
+// when the cache grows past its size limit. A single spin lock
+// protects the whole thing.
+#define MEMOIZATION_BUCKETS 256
+
+struct halide_memoization_cache_entry {
+    halide_memoization_cache_entry *next_in_bucket;
+    halide_memoization_cache_entry *more_recent, *less_recent;
+    uint32_t hash;
+    int32_t key_size;
+    int32_t size;
+    uint8_t *key;
+    uint8_t *data;
+};
+
+WEAK struct {
+    int lock;
+    halide_memoization_cache_entry *buckets[MEMOIZATION_BUCKETS];
+    halide_memoization_cache_entry *most_recent, *least_recent;
+    int64_t current_bytes;
+    int64_t max_bytes;
+} halide_memoization_cache = {0};
+
+WEAK void halide_memoization_cache_lock() {
+    while (__sync_lock_test_and_set(&halide_memoization_cache.lock, 1)) {
+        while (*(volatile int *)&halide_memoization_cache.lock) {}
+    }
+}
+
+WEAK void halide_memoization_cache_unlock() {
+    __sync_lock_release(&halide_memoization_cache.lock);
+}
+
+WEAK int64_t halide_memoization_cache_max_bytes() {
+    if (halide_memoization_cache.max_bytes == 0) {
+        halide_memoization_cache.max_bytes = 16 << 20;
+    }
+    return halide_memoization_cache.max_bytes;
+}
+
+// FNV-1a
+WEAK uint32_t halide_memoization_hash(const uint8_t *key, int32_t key_size) {
+    uint32_t h = 2166136261u;
+    for (int32_t i = 0; i < key_size; i++) {
+        h ^= key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+WEAK halide_memoization_cache_entry *halide_memoization_find(const uint8_t *key, int32_t key_size,
+                                                             uint32_t hash, int32_t size) {
+    halide_memoization_cache_entry *e = halide_memoization_cache.buckets[hash % MEMOIZATION_BUCKETS];
+    while (e) {
+        if (e->hash == hash && e->key_size == key_size && e->size == size &&
+            memcmp(e->key, key, key_size) == 0) {
+            return e;
+        }
+        e = e->next_in_bucket;
+    }
+    return NULL;
+}
+
+WEAK void halide_memoization_unlink_recent(halide_memoization_cache_entry *e) {
+    if (e->more_recent) {
+        e->more_recent->less_recent = e->less_recent;
+    } else {
+        halide_memoization_cache.most_recent = e->less_recent;
+    }
+    if (e->less_recent) {
+        e->less_recent->more_recent = e->more_recent;
+    } else {
+        halide_memoization_cache.least_recent = e->more_recent;
+    }
+}
+
+WEAK void halide_memoization_link_recent(halide_memoization_cache_entry *e) {
+    e->more_recent = NULL;
+    e->less_recent = halide_memoization_cache.most_recent;
+    if (e->less_recent) {
+        e->less_recent->more_recent = e;
+    } else {
+        halide_memoization_cache.least_recent = e;
+    }
+    halide_memoization_cache.most_recent = e;
+}
+
+WEAK void halide_memoization_evict(halide_memoization_cache_entry *e) {
+    halide_memoization_cache_entry **p = &halide_memoization_cache.buckets[e->hash % MEMOIZATION_BUCKETS];
+    while (*p != e) {
+        p = &((*p)->next_in_bucket);
+    }
+    *p = e->next_in_bucket;
+    halide_memoization_unlink_recent(e);
+    halide_memoization_cache.current_bytes -= (int64_t)e->key_size + e->size;
+    free(e);
+}
+
+WEAK void halide_memoization_cache_set_size(int64_t size) {
+    if (size == 0) {
+        size = 16 << 20;
+    }
+    halide_memoization_cache_lock();
+    halide_memoization_cache.max_bytes = size;
+    while (halide_memoization_cache.least_recent &&
+           halide_memoization_cache.current_bytes > size) {
+        halide_memoization_evict(halide_memoization_cache.least_recent);
+    }
+    halide_memoization_cache_unlock();
+}
+
+WEAK int32_t halide_memoization_cache_lookup(void *user_context, const uint8_t *key, int32_t key_size,
+                                            uint8_t *dst, int32_t size) {
+    uint32_t hash = halide_memoization_hash(key, key_size);
+    halide_memoization_cache_lock();
+    halide_memoization_cache_entry *e = halide_memoization_find(key, key_size, hash, size);
+    if (e) {
+        memcpy(dst, e->data, size);
+        halide_memoization_unlink_recent(e);
+        halide_memoization_link_recent(e);
+    }
+    halide_memoization_cache_unlock();
+    return e ? 1 : 0;
+}
+
+WEAK int32_t halide_memoization_cache_store(void *user_context, const uint8_t *key, int32_t key_size,
+                                           const uint8_t *src, int32_t size) {
+    int64_t bytes = (int64_t)key_size + size;
+    if (bytes > halide_memoization_cache_max_bytes()) {
+        return 0;
+    }
+
+    // The key and the data live in the same block as the entry, which
+    // is filled in before taking the lock.
+    halide_memoization_cache_entry *e =
+        (halide_memoization_cache_entry *)malloc(sizeof(halide_memoization_cache_entry) + (size_t)bytes);
+    if (e == NULL) {
+        // Caching is an optimization. Just don't do it.
+        return 0;
+    }
+    uint32_t hash = halide_memoization_hash(key, key_size);
+    e->hash = hash;
+    e->key_size = key_size;
+    e->size = size;
+    e->key = (uint8_t *)(e + 1);
+    e->data = e->key + key_size;
+    memcpy(e->key, key, key_size);
+    memcpy(e->data, src, size);
+
+    // Make room and insert under the same lock, so that concurrent
+    // stores can neither insert the same key twice nor push the cache
+    // past its limit.
+    halide_memoization_cache_lock();
+    // Another thread may have computed the same thing.
+    if (halide_memoization_find(key, key_size, hash, size)) {
+        halide_memoization_cache_unlock();
+        free(e);
+        return 0;
+    }
+    int64_t max_bytes = halide_memoization_cache_max_bytes();
+    while (halide_memoization_cache.least_recent &&
+           halide_memoization_cache.current_bytes + bytes > max_bytes) {
+        halide_memoization_evict(halide_memoization_cache.least_recent);
+    }
+    halide_memoization_cache_entry **bucket = &halide_memoization_cache.buckets[hash % MEMOIZATION_BUCKETS];
+    e->next_in_bucket = *bucket;
+    *bucket = e;
+    halide_memoization_link_recent(e);
+    halide_memoization_cache.current_bytes += bytes;
+    halide_memoization_cache_unlock();
+    return 0;
+}
+
+WEAK void halide_memoization_cache_cleanup() {
+    halide_memoization_cache_lock();
+    while (halide_memoization_cache.least_recent) {
+        halide_memoization_evict(halide_memoization_cache.least_recent);
+    }
+    halide_memoization_cache_unlock();
+}
+
+}
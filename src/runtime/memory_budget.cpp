@@ -0,0 +1,44 @@
+#include "mini_stdint.h"
+#include "HalideRuntime.h"
+
+// Pipelines compiled with the memory_budget target feature estimate
+// their peak memory before doing anything, and pass it to
+// halide_check_memory_budget.
+
+#define WEAK __attribute__((weak))
+#ifndef NULL
+#define NULL 0
+#endif
+
+extern "C" {
+
+// Zero for no budget.
+WEAK int64_t halide_memory_budget = 0;
+
+WEAK volatile int64_t halide_peak_memory = 0;
+
+WEAK int (*halide_custom_check_memory_budget)(void *user_context, const char *pipeline,
+                                              int64_t bytes, int is_query);
+
+WEAK void halide_set_custom_check_memory_budget(int (*f)(void *, const char *, int64_t, int)) {
+    halide_custom_check_memory_budget = f;
+}
+
+WEAK void halide_set_memory_budget(int64_t bytes) {
+    halide_memory_budget = bytes;
+}
+
+WEAK int64_t halide_last_peak_memory() {
+    return halide_peak_memory;
+}
+
+WEAK int halide_check_memory_budget(void *user_context, const char *pipeline,
+                                    int64_t bytes, int is_query) {
+    if (halide_custom_check_memory_budget) {
+        return (*halide_custom_check_memory_budget)(user_context, pipeline, bytes, is_query);
+    }
+    halide_peak_memory = bytes;
+    return !is_query && halide_memory_budget > 0 && bytes > halide_memory_budget;
+}
+
+}
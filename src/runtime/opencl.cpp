@@ -34,7 +34,9 @@ extern void free(void *);
 extern void *malloc(size_t);
 extern int snprintf(char *, size_t, const char *, ...);
 extern char *getenv(const char *);
+extern int atoi(const char *);
 extern const char * strstr(const char *, const char *);
+extern void halide_runtime_stats_device_transfer(int64_t bytes, int to_device);
 
 
 #ifndef DEBUG
@@ -56,6 +58,11 @@ extern const char * strstr(const char *, const char *);
   } while (0) /* eat semicolon */
 #endif //DEBUG
 }
+
+#include "gpu_kernel_cache.h"
+#include "gpu_warmup.h"
+#include "gpu_profile.h"
+
 extern "C" {
 // A cuda context defined in this module with weak linkage
 cl_context WEAK weak_cl_ctx = 0;
@@ -99,6 +106,351 @@ WEAK bool halide_validate_dev_pointer(void *user_context, buffer_t* buf, size_t
     return true;
 }
 
+// The device allocation cache keeps freed buffers in size classes,
+// four per power of two from 256 bytes up to 1 GB, and hands them
+// back out to later allocations of the same class, so that GPU
+// intermediates don't cost a clCreateBuffer and clReleaseMemObject
+// per kernel or per pipeline invocation. Everything goes through one
+// in-order queue, so a reused buffer is never touched before the work
+// queued by its previous owner is done.
+#define DEV_CACHE_MIN_SHIFT 8
+#define DEV_CACHE_MAX_SHIFT 30
+#define DEV_CACHE_CLASSES ((DEV_CACHE_MAX_SHIFT - DEV_CACHE_MIN_SHIFT) * 4 + 1)
+
+struct dev_cache_block {
+    cl_mem mem;
+    dev_cache_block *next;
+};
+
+WEAK struct {
+    int lock;
+    dev_cache_block *free_list[DEV_CACHE_CLASSES];
+    size_t cached_bytes;
+    // The most bytes the cache holds on to. Frees beyond this go back
+    // to clReleaseMemObject.
+    size_t max_cached_bytes;
+} halide_dev_cache = {0, {NULL}, 0, (size_t)256 << 20};
+
+WEAK void halide_dev_cache_lock() {
+    while (__sync_lock_test_and_set(&halide_dev_cache.lock, 1)) {
+        while (*(volatile int *)&halide_dev_cache.lock) {}
+    }
+}
+
+WEAK void halide_dev_cache_unlock() {
+    __sync_lock_release(&halide_dev_cache.lock);
+}
+
+WEAK size_t halide_dev_cache_class_bytes(int c) {
+    return (size_t)(4 + (c & 3)) << (DEV_CACHE_MIN_SHIFT - 2 + (c >> 2));
+}
+
+// Returns the size class big enough for x bytes, or -1 if x is too
+// large to be worth caching.
+WEAK int halide_dev_cache_size_class(size_t x) {
+    for (int c = 0; c < DEV_CACHE_CLASSES; c++) {
+        if (halide_dev_cache_class_bytes(c) >= x) return c;
+    }
+    return -1;
+}
+
+// Release every cached device allocation.
+WEAK void halide_dev_cache_trim(void *user_context) {
+    halide_dev_cache_lock();
+    dev_cache_block *blocks = NULL;
+    for (int c = 0; c < DEV_CACHE_CLASSES; c++) {
+        while (dev_cache_block *b = halide_dev_cache.free_list[c]) {
+            halide_dev_cache.free_list[c] = b->next;
+            b->next = blocks;
+            blocks = b;
+        }
+    }
+    halide_dev_cache.cached_bytes = 0;
+    halide_dev_cache_unlock();
+
+    while (blocks) {
+        dev_cache_block *next = blocks->next;
+        CHECK_CALL( clReleaseMemObject(blocks->mem), "clReleaseMemObject" );
+        free(blocks);
+        blocks = next;
+    }
+}
+
+// Set the most bytes of device memory the cache may hold on to. Zero
+// turns the cache off. Cached allocations beyond the new limit are
+// released.
+WEAK void halide_dev_cache_set_size(void *user_context, size_t max_cached_bytes) {
+    halide_dev_cache.max_cached_bytes = max_cached_bytes;
+    if (halide_dev_cache.cached_bytes > max_cached_bytes) {
+        halide_dev_cache_trim(user_context);
+    }
+}
+
+// Take a buffer of size class c from the cache, or return NULL if
+// there isn't one.
+WEAK cl_mem halide_dev_cache_get(int c) {
+    halide_dev_cache_lock();
+    dev_cache_block *b = halide_dev_cache.free_list[c];
+    if (b) {
+        halide_dev_cache.free_list[c] = b->next;
+        halide_dev_cache.cached_bytes -= halide_dev_cache_class_bytes(c);
+    }
+    halide_dev_cache_unlock();
+
+    if (!b) return NULL;
+    cl_mem mem = b->mem;
+    free(b);
+    return mem;
+}
+
+// Try to put a buffer into the cache. Returns false if it isn't a
+// buffer the cache made, or if the cache is full.
+WEAK bool halide_dev_cache_put(cl_mem mem) {
+    size_t size;
+    if (clGetMemObjectInfo(mem, CL_MEM_SIZE, sizeof(size_t), &size, NULL) != CL_SUCCESS) {
+        return false;
+    }
+    int c = halide_dev_cache_size_class(size);
+    if (c < 0 || halide_dev_cache_class_bytes(c) != size) {
+        return false;
+    }
+
+    dev_cache_block *b = (dev_cache_block *)malloc(sizeof(dev_cache_block));
+    if (!b) return false;
+    b->mem = mem;
+
+    bool cached = false;
+    halide_dev_cache_lock();
+    if (halide_dev_cache.cached_bytes + size <= halide_dev_cache.max_cached_bytes) {
+        b->next = halide_dev_cache.free_list[c];
+        halide_dev_cache.free_list[c] = b;
+        halide_dev_cache.cached_bytes += size;
+        cached = true;
+    }
+    halide_dev_cache_unlock();
+
+    if (!cached) free(b);
+    return cached;
+}
+
+// In zero-copy mode, buffers with host memory are created around it
+// with CL_MEM_USE_HOST_PTR, and copies to and from the device become
+// maps and unmaps, which devices that share memory with the host
+// (integrated and mobile gpus) do without copying. It is used when
+// the device reports CL_DEVICE_HOST_UNIFIED_MEMORY, unless
+// HL_ZERO_COPY or halide_dev_set_zero_copy says otherwise.
+// -1 until we've decided.
+WEAK int halide_cl_zero_copy = -1;
+
+// Turn zero-copy mode on (1) or off (0), or go back to deciding
+// automatically (-1). Only affects later allocations.
+WEAK void halide_dev_set_zero_copy(int mode) {
+    halide_cl_zero_copy = mode < 0 ? -1 : (mode ? 1 : 0);
+}
+
+// Kernels enqueued on an OpenCL command queue are already batched by
+// the driver, so there are no launch graphs here.
+WEAK void halide_dev_set_launch_graphs(int mode) {
+}
+
+// When profiling, the command queue is made with profiling enabled,
+// and each kernel and copy gets an event to read its device time
+// from later. Profiling must be on when the queue is made.
+struct cl_timing {
+    cl_event event;
+    gpu_profile_entry *entry;
+};
+
+#define MAX_PROFILE_TIMINGS 128
+
+WEAK struct {
+    int lock;
+    int count;
+    cl_timing timings[MAX_PROFILE_TIMINGS];
+} halide_cl_timings;
+
+WEAK void halide_cl_timings_lock() {
+    while (__sync_lock_test_and_set(&halide_cl_timings.lock, 1)) {}
+}
+
+WEAK void halide_cl_timings_unlock() {
+    __sync_lock_release(&halide_cl_timings.lock);
+}
+
+// Read back the device times of the kernels and copies recorded so
+// far. Waits for them to finish.
+WEAK void halide_cl_resolve_timings() {
+    halide_cl_timings_lock();
+    for (int i = 0; i < halide_cl_timings.count; i++) {
+        cl_timing *t = &halide_cl_timings.timings[i];
+        cl_ulong start = 0, end = 0;
+        if (clWaitForEvents(1, &t->event) == CL_SUCCESS &&
+            clGetEventProfilingInfo(t->event, CL_PROFILING_COMMAND_START,
+                                    sizeof(start), &start, NULL) == CL_SUCCESS &&
+            clGetEventProfilingInfo(t->event, CL_PROFILING_COMMAND_END,
+                                    sizeof(end), &end, NULL) == CL_SUCCESS &&
+            end > start) {
+            halide_gpu_profile_add_time(t->entry, end - start);
+        }
+        clReleaseEvent(t->event);
+    }
+    halide_cl_timings.count = 0;
+    halide_cl_timings_unlock();
+}
+
+// Remember the event of a kernel or copy, to add its device time to
+// the entry later.
+WEAK void halide_cl_add_timing(cl_event event, gpu_profile_entry *e) {
+    while (true) {
+        halide_cl_timings_lock();
+        if (halide_cl_timings.count < MAX_PROFILE_TIMINGS) break;
+        halide_cl_timings_unlock();
+        halide_cl_resolve_timings();
+    }
+    cl_timing *t = &halide_cl_timings.timings[halide_cl_timings.count++];
+    t->event = event;
+    t->entry = e;
+    halide_cl_timings_unlock();
+}
+
+// Copies and kernels are enqueued without waiting for them. Each
+// command lists the events of the earlier ones it depends on, so the
+// command queue may execute out of order. Uploads read from host
+// memory until they finish, so their events are kept until something
+// may touch that memory again: a read back, a sync, or the free of
+// the buffer.
+#define MAX_PENDING_WRITES 32
+
+struct cl_pending_write {
+    cl_event event;
+    // The host memory it reads, if any.
+    const void *host;
+};
+
+WEAK struct {
+    int lock;
+    cl_event last_kernel;
+    int write_count;
+    cl_pending_write writes[MAX_PENDING_WRITES];
+} halide_cl_events;
+
+WEAK void halide_cl_events_lock() {
+    while (__sync_lock_test_and_set(&halide_cl_events.lock, 1)) {}
+}
+
+WEAK void halide_cl_events_unlock() {
+    __sync_lock_release(&halide_cl_events.lock);
+}
+
+// Get the events a command waits for: the last kernel, which may use
+// the same device memory, and if the command reads device memory, the
+// uploads still in flight. Call with the lock held. Returns the
+// number of events.
+WEAK cl_uint halide_cl_get_deps(cl_event *deps, bool after_writes) {
+    cl_uint count = 0;
+    if (halide_cl_events.last_kernel) {
+        deps[count++] = halide_cl_events.last_kernel;
+    }
+    if (after_writes) {
+        for (int i = 0; i < halide_cl_events.write_count; i++) {
+            deps[count++] = halide_cl_events.writes[i].event;
+        }
+    }
+    return count;
+}
+
+// Forget the events of commands that are known to be done. Call with
+// the lock held.
+WEAK void halide_cl_forget_events() {
+    for (int i = 0; i < halide_cl_events.write_count; i++) {
+        clReleaseEvent(halide_cl_events.writes[i].event);
+    }
+    halide_cl_events.write_count = 0;
+    if (halide_cl_events.last_kernel) {
+        clReleaseEvent(halide_cl_events.last_kernel);
+        halide_cl_events.last_kernel = NULL;
+    }
+}
+
+// Wait for the uploads in flight, if any reads from the given host
+// memory (or whatever they read, if it's NULL). Call with the lock
+// held.
+WEAK void halide_cl_wait_for_writes(const void *host) {
+    bool wait = false;
+    for (int i = 0; i < halide_cl_events.write_count; i++) {
+        wait = wait || !host || halide_cl_events.writes[i].host == host;
+    }
+    if (!wait) return;
+    cl_event events[MAX_PENDING_WRITES];
+    for (int i = 0; i < halide_cl_events.write_count; i++) {
+        events[i] = halide_cl_events.writes[i].event;
+    }
+    clWaitForEvents(halide_cl_events.write_count, events);
+    for (int i = 0; i < halide_cl_events.write_count; i++) {
+        clReleaseEvent(events[i]);
+    }
+    halide_cl_events.write_count = 0;
+}
+
+// Take ownership of the event of a kernel, or of an upload from the
+// given host memory. Call with the lock held.
+WEAK void halide_cl_add_event(cl_event event, bool is_kernel, const void *host) {
+    if (is_kernel) {
+        if (halide_cl_events.last_kernel) {
+            clReleaseEvent(halide_cl_events.last_kernel);
+        }
+        halide_cl_events.last_kernel = event;
+    } else {
+        if (halide_cl_events.write_count == MAX_PENDING_WRITES) {
+            halide_cl_wait_for_writes(NULL);
+        }
+        cl_pending_write *w = &halide_cl_events.writes[halide_cl_events.write_count++];
+        w->event = event;
+        w->host = host;
+    }
+}
+
+// Record the device time of a command in the profile, if profiling.
+WEAK gpu_profile_entry *halide_cl_profile(cl_event event, const char *name, int kind, size_t bytes) {
+    if (!event || !halide_gpu_profile_enabled()) return NULL;
+    clRetainEvent(event);
+    gpu_profile_entry *e = halide_gpu_profile_record(name, kind, bytes);
+    halide_cl_add_timing(event, e);
+    return e;
+}
+
+WEAK void halide_dev_set_profiling(int mode) {
+    halide_gpu_profiling = mode ? 1 : 0;
+}
+
+WEAK bool halide_cl_use_zero_copy(void *user_context) {
+    if (halide_cl_zero_copy < 0) {
+        // Racing threads will all compute the same answer.
+        char *zero_copy_str = getenv("HL_ZERO_COPY");
+        if (zero_copy_str) {
+            halide_cl_zero_copy = atoi(zero_copy_str) ? 1 : 0;
+        } else {
+            cl_device_id dev;
+            cl_bool unified = CL_FALSE;
+            if (clGetContextInfo(*cl_ctx, CL_CONTEXT_DEVICES, sizeof(dev), &dev, NULL) == CL_SUCCESS) {
+                clGetDeviceInfo(dev, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified), &unified, NULL);
+            }
+            #ifdef DEBUG
+            halide_printf(user_context, "Device has unified memory: %d\n", (int)unified);
+            #endif
+            halide_cl_zero_copy = unified ? 1 : 0;
+        }
+    }
+    return halide_cl_zero_copy == 1;
+}
+
+// Was this buffer created around host memory by zero-copy mode.
+WEAK bool halide_cl_is_zero_copy(cl_mem mem) {
+    cl_mem_flags flags = 0;
+    clGetMemObjectInfo(mem, CL_MEM_FLAGS, sizeof(flags), &flags, NULL);
+    return (flags & CL_MEM_USE_HOST_PTR) != 0;
+}
+
 WEAK void halide_dev_free(void *user_context, buffer_t* buf) {
     // halide_dev_free, at present, can be exposed to clients and they
     // should be allowed to call halide_dev_free on any buffer_t
@@ -111,104 +463,203 @@ WEAK void halide_dev_free(void *user_context, buffer_t* buf) {
     #endif
 
     halide_assert(user_context, halide_validate_dev_pointer(user_context, buf));
-    CHECK_CALL( clReleaseMemObject((cl_mem)buf->dev), "clReleaseMemObject" );
+
+    // The host memory may be freed next, so uploads from it must be
+    // done.
+    halide_cl_events_lock();
+    halide_cl_wait_for_writes(buf->host);
+    halide_cl_events_unlock();
+
+    if (halide_cl_is_zero_copy((cl_mem)buf->dev)) {
+        // The buffer's storage is the host memory, which may be freed
+        // as soon as we return, so kernels using it must be done.
+        clFinish(*cl_q);
+        halide_cl_events_lock();
+        halide_cl_forget_events();
+        halide_cl_events_unlock();
+        CHECK_CALL( clReleaseMemObject((cl_mem)buf->dev), "clReleaseMemObject" );
+    } else if (!halide_dev_cache_put((cl_mem)buf->dev)) {
+        CHECK_CALL( clReleaseMemObject((cl_mem)buf->dev), "clReleaseMemObject" );
+    }
     buf->dev = 0;
 }
 
-WEAK void* halide_init_kernels(void *user_context, void *state_ptr, const char* src, int size) {
+// Get the path of the kernel cache entry for a program on a
+// device. Returns false if the cache is off.
+WEAK bool halide_cl_kernel_cache_path(cl_device_id dev, const char *src, int size,
+                                      char *path, size_t max_path) {
+    const size_t max_info = 256;
+    char name[max_info], driver[max_info], version[max_info];
+    if (clGetDeviceInfo(dev, CL_DEVICE_NAME, max_info, name, NULL) != CL_SUCCESS ||
+        clGetDeviceInfo(dev, CL_DRIVER_VERSION, max_info, driver, NULL) != CL_SUCCESS ||
+        clGetDeviceInfo(dev, CL_DEVICE_VERSION, max_info, version, NULL) != CL_SUCCESS) {
+        return false;
+    }
+    char device[3 * max_info + 32];
+    snprintf(device, sizeof(device), "opencl %s driver %s %s", name, driver, version);
+    return halide_kernel_cache_path(path, max_path, device, src, size, "clbin");
+}
+
+// Create and build a program from the binary in a kernel cache
+// entry. Returns NULL if there isn't one that works.
+WEAK cl_program halide_cl_load_cached_program(void *user_context, cl_device_id dev,
+                                              const char *path, const char *build_options) {
+    size_t size = 0;
+    char *binary = halide_kernel_cache_load(path, &size);
+    if (!binary) return NULL;
+
+    const unsigned char *binaries[] = { (const unsigned char *)binary };
+    cl_int status = CL_SUCCESS, err = CL_SUCCESS;
+    cl_program program = clCreateProgramWithBinary(*cl_ctx, 1, &dev, &size, binaries, &status, &err);
+    free(binary);
+    if (err != CL_SUCCESS) return NULL;
+    if (status != CL_SUCCESS ||
+        clBuildProgram(program, 1, &dev, build_options, NULL, NULL) != CL_SUCCESS) {
+        clReleaseProgram(program);
+        return NULL;
+    }
+    return program;
+}
+
+// Add a built program to the kernel cache.
+WEAK void halide_cl_store_cached_program(void *user_context, cl_program program, const char *path) {
+    // The context has a single device, so there's a single binary.
+    size_t size = 0;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL) != CL_SUCCESS ||
+        size == 0) {
+        return;
+    }
+    unsigned char *binary = (unsigned char *)malloc(size);
+    unsigned char *binaries[] = { binary };
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binaries), binaries, NULL) == CL_SUCCESS) {
+        halide_kernel_cache_store(user_context, path, binary, size);
+    }
+    free(binary);
+}
+
+// Create the shared context and command queue, if they don't exist
+// yet. Returns zero on success.
+WEAK int halide_gpu_init_device(void *user_context) {
+    if (*cl_ctx) {
+        return 0;
+    }
+
     int err;
     cl_device_id dev;
-    // Initialize one shared context for all Halide compiled instances
-    if (!(*cl_ctx)) {
-        const cl_uint maxPlatforms = 4;
-        cl_platform_id platforms[maxPlatforms];
-        cl_uint platformCount = 0;
-
-        err = clGetPlatformIDs( maxPlatforms, platforms, &platformCount );
-        CHECK_ERR( err, "clGetPlatformIDs" );
-
-        cl_platform_id platform = NULL;
-
-        // Find the requested platform, or the first if none specified.
-        const char * name = getenv("HL_OCL_PLATFORM");
-        if (name != NULL) {
-            for (cl_uint i = 0; i < platformCount; ++i) {
-                const cl_uint maxPlatformName = 256;
-                char platformName[maxPlatformName];
-                err = clGetPlatformInfo( platforms[i], CL_PLATFORM_NAME, maxPlatformName, platformName, NULL );
-                if (err != CL_SUCCESS) continue;
-
-                if (strstr(platformName, name))
-                {
-                    platform = platforms[i];
-                    break;
-                }
+    const cl_uint maxPlatforms = 4;
+    cl_platform_id platforms[maxPlatforms];
+    cl_uint platformCount = 0;
+
+    err = clGetPlatformIDs( maxPlatforms, platforms, &platformCount );
+    CHECK_ERR( err, "clGetPlatformIDs" );
+
+    cl_platform_id platform = NULL;
+
+    // Find the requested platform, or the first if none specified.
+    const char * name = getenv("HL_OCL_PLATFORM");
+    if (name != NULL) {
+        for (cl_uint i = 0; i < platformCount; ++i) {
+            const cl_uint maxPlatformName = 256;
+            char platformName[maxPlatformName];
+            err = clGetPlatformInfo( platforms[i], CL_PLATFORM_NAME, maxPlatformName, platformName, NULL );
+            if (err != CL_SUCCESS) continue;
+
+            if (strstr(platformName, name))
+            {
+                platform = platforms[i];
+                break;
             }
-        } else if (platformCount > 0) {
-            platform = platforms[0];
-        }
-        if (platform == NULL){
-            halide_printf(user_context, "Failed to find OpenCL platform\n");
-            return NULL;
         }
+    } else if (platformCount > 0) {
+        platform = platforms[0];
+    }
+    if (platform == NULL){
+        halide_printf(user_context, "Failed to find OpenCL platform\n");
+        return -1;
+    }
 
-        #ifdef DEBUG
-        const cl_uint maxPlatformName = 256;
-        char platformName[maxPlatformName];
-        err = clGetPlatformInfo( platform, CL_PLATFORM_NAME, maxPlatformName, platformName, NULL );
-        CHECK_ERR( err, "clGetPlatformInfo" );
+    #ifdef DEBUG
+    const cl_uint maxPlatformName = 256;
+    char platformName[maxPlatformName];
+    err = clGetPlatformInfo( platform, CL_PLATFORM_NAME, maxPlatformName, platformName, NULL );
+    CHECK_ERR( err, "clGetPlatformInfo" );
 
-        halide_printf(user_context, "Got platform '%s', about to create context (t=%lld)\n",
-                      platformName, (long long)halide_current_time_ns(user_context));
-        #endif
+    halide_printf(user_context, "Got platform '%s', about to create context (t=%lld)\n",
+                  platformName, (long long)halide_current_time_ns(user_context));
+    #endif
 
-        cl_device_type device_type = 0;
-        // Find the device types requested.
-        const char * dev_type = getenv("HL_OCL_DEVICE");
-        if (dev_type != NULL) {
-            if (strstr("cpu", dev_type))
-                device_type |= CL_DEVICE_TYPE_CPU;
-            if (strstr("gpu", dev_type))
-                device_type |= CL_DEVICE_TYPE_GPU;
-        }
-        // If no devices are specified yet, just use all.
-        if (device_type == 0)
-            device_type = CL_DEVICE_TYPE_ALL;
-
-        // Make sure we have a device
-        const cl_uint maxDevices = 4;
-        cl_device_id devices[maxDevices];
-        cl_uint deviceCount = 0;
-        err = clGetDeviceIDs( platform, device_type, maxDevices, devices, &deviceCount );
-        CHECK_ERR( err, "clGetDeviceIDs" );
-        if (deviceCount == 0) {
-            halide_printf(user_context, "Failed to get device\n");
-            return NULL;
-        }
+    cl_device_type device_type = 0;
+    // Find the device types requested.
+    const char * dev_type = getenv("HL_OCL_DEVICE");
+    if (dev_type != NULL) {
+        if (strstr("cpu", dev_type))
+            device_type |= CL_DEVICE_TYPE_CPU;
+        if (strstr("gpu", dev_type))
+            device_type |= CL_DEVICE_TYPE_GPU;
+    }
+    // If no devices are specified yet, just use all.
+    if (device_type == 0)
+        device_type = CL_DEVICE_TYPE_ALL;
+
+    // Make sure we have a device
+    const cl_uint maxDevices = 4;
+    cl_device_id devices[maxDevices];
+    cl_uint deviceCount = 0;
+    err = clGetDeviceIDs( platform, device_type, maxDevices, devices, &deviceCount );
+    CHECK_ERR( err, "clGetDeviceIDs" );
+    if (deviceCount == 0) {
+        halide_printf(user_context, "Failed to get device\n");
+        return -1;
+    }
 
-        dev = devices[deviceCount-1];
+    dev = devices[deviceCount-1];
 
-        #ifdef DEBUG
-        const cl_uint maxDeviceName = 256;
-        char deviceName[maxDeviceName];
-        err = clGetDeviceInfo( dev, CL_DEVICE_NAME, maxDeviceName, deviceName, NULL );
-        CHECK_ERR( err, "clGetDeviceInfo" );
+    #ifdef DEBUG
+    const cl_uint maxDeviceName = 256;
+    char deviceName[maxDeviceName];
+    err = clGetDeviceInfo( dev, CL_DEVICE_NAME, maxDeviceName, deviceName, NULL );
+    CHECK_ERR( err, "clGetDeviceInfo" );
 
-        halide_printf(user_context, "Got device '%s', about to create context (t=%lld)\n",
-                      deviceName, (long long)halide_current_time_ns(user_context));
-        #endif
+    halide_printf(user_context, "Got device '%s', about to create context (t=%lld)\n",
+                  deviceName, (long long)halide_current_time_ns(user_context));
+    #endif
 
 
-        // Create context
-        cl_context_properties properties[] = { CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
-        *cl_ctx = clCreateContext(properties, 1, &dev, NULL, NULL, &err);
-        CHECK_ERR( err, "clCreateContext" );
-        // cuEventCreate(&__start, 0);
-        // cuEventCreate(&__end, 0);
+    // Create context
+    cl_context_properties properties[] = { CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
+    *cl_ctx = clCreateContext(properties, 1, &dev, NULL, NULL, &err);
+    CHECK_ERR( err, "clCreateContext" );
+    // cuEventCreate(&__start, 0);
+    // cuEventCreate(&__end, 0);
+
+    halide_assert(user_context, !(*cl_q));
+    cl_command_queue_properties props = halide_gpu_profile_enabled() ? CL_QUEUE_PROFILING_ENABLE : 0;
+    // Use an out-of-order queue where the device has them, unless
+    // HL_CL_OUT_OF_ORDER is 0. The dependencies of each command
+    // keep the results the same.
+    char *out_of_order_str = getenv("HL_CL_OUT_OF_ORDER");
+    if (!out_of_order_str || atoi(out_of_order_str)) {
+        cl_command_queue_properties supported = 0;
+        clGetDeviceInfo(dev, CL_DEVICE_QUEUE_PROPERTIES, sizeof(supported), &supported, NULL);
+        props |= (supported & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE);
+    }
+    #ifdef DEBUG
+    halide_printf(user_context, "Creating command queue with properties 0x%x\n", (int)props);
+    #endif
+    *cl_q = clCreateCommandQueue(*cl_ctx, dev, props, &err);
+    CHECK_ERR( err, "clCreateCommandQueue" );
+    return 0;
+}
 
-        halide_assert(user_context, !(*cl_q));
-        *cl_q = clCreateCommandQueue(*cl_ctx, dev, 0, &err);
-        CHECK_ERR( err, "clCreateCommandQueue" );
+WEAK void* halide_build_kernels(void *user_context, void *state_ptr, const char* src, int size) {
+    int err;
+    cl_device_id dev;
+    // Initialize one shared context for all Halide compiled instances
+    if (!(*cl_ctx)) {
+        if (halide_gpu_init_device(user_context) != 0) {
+            return NULL;
+        }
+        CHECK_CALL( clGetContextInfo(*cl_ctx, CL_CONTEXT_DEVICES, sizeof(dev), &dev, NULL), "clGetContextInfo" );
     } else {
         #ifdef DEBUG
         halide_printf(user_context, "Already had context %p\n", *cl_ctx);
@@ -238,7 +689,21 @@ WEAK void* halide_init_kernels(void *user_context, void *state_ptr, const char*
         size_t lengths[] = { size };
         const char *build_options = NULL;
 
-        if (strstr(src, "/*OpenCL C*/")) {
+        // A program built before for this device may be in the
+        // kernel cache.
+        char cache_path[1024];
+        bool use_cache = halide_cl_kernel_cache_path(dev, src, size, cache_path, sizeof(cache_path));
+        if (use_cache) {
+            state->program = halide_cl_load_cached_program(user_context, dev, cache_path,
+                                                           strstr(src, "/*OpenCL C*/") ? NULL : "-x spir");
+        }
+        bool from_cache = state->program != NULL;
+
+        if (from_cache) {
+            #ifdef DEBUG
+            halide_printf(user_context, "Loaded program from the kernel cache: %s\n", cache_path);
+            #endif
+        } else if (strstr(src, "/*OpenCL C*/")) {
             // Program is OpenCL C.
 
             #ifdef DEBUG
@@ -262,43 +727,152 @@ WEAK void* halide_init_kernels(void *user_context, void *state_ptr, const char*
             build_options = "-x spir";
         }
 
-        err = clBuildProgram(state->program, 1, &dev, build_options, NULL, NULL );
-        if (err != CL_SUCCESS) {
-            size_t len = 0;
-            char *buffer = NULL;
+        if (!from_cache) {
+            err = clBuildProgram(state->program, 1, &dev, build_options, NULL, NULL );
+            if (err != CL_SUCCESS) {
+                size_t len = 0;
+                char *buffer = NULL;
 
-            halide_printf(user_context, "Error: Failed to build program executable! err = %d\n", err);
+                halide_printf(user_context, "Error: Failed to build program executable! err = %d\n", err);
 
-            // Get size of build log
-            if (clGetProgramBuildInfo(state->program, dev, CL_PROGRAM_BUILD_LOG, 0, NULL, &len) == CL_SUCCESS)
-                buffer = (char*)malloc((++len)*sizeof(char));
+                // Get size of build log
+                if (clGetProgramBuildInfo(state->program, dev, CL_PROGRAM_BUILD_LOG, 0, NULL, &len) == CL_SUCCESS)
+                    buffer = (char*)malloc((++len)*sizeof(char));
 
-            // Get build log
-            if (buffer && clGetProgramBuildInfo(state->program, dev, CL_PROGRAM_BUILD_LOG, len, buffer, NULL) == CL_SUCCESS)
-                halide_printf(user_context, "Build Log:\n %s\n-----\n", buffer);
-            else
-                halide_printf(user_context, "clGetProgramBuildInfo failed to get build log!\n");
+                // Get build log
+                if (buffer && clGetProgramBuildInfo(state->program, dev, CL_PROGRAM_BUILD_LOG, len, buffer, NULL) == CL_SUCCESS)
+                    halide_printf(user_context, "Build Log:\n %s\n-----\n", buffer);
+                else
+                    halide_printf(user_context, "clGetProgramBuildInfo failed to get build log!\n");
 
-            if (buffer)
-                free(buffer);
+                if (buffer)
+                    free(buffer);
 
-            halide_assert(user_context, err == CL_SUCCESS);
+                halide_assert(user_context, err == CL_SUCCESS);
+            }
+
+            if (use_cache) {
+                halide_cl_store_cached_program(user_context, state->program, cache_path);
+            }
         }
     }
     return state;
 }
 
+// Page-locked host memory comes from buffers created with
+// CL_MEM_ALLOC_HOST_PTR and mapped for good, which is how OpenCL
+// drivers hand out memory they can copy to and from at full
+// bandwidth. This list remembers the buffer behind each mapping.
+struct host_mapping {
+    void *host;
+    cl_mem mem;
+    host_mapping *next;
+};
+
+WEAK struct {
+    int lock;
+    host_mapping *list;
+} halide_cl_host_mappings = {0, NULL};
+
+WEAK void halide_cl_host_mappings_lock() {
+    while (__sync_lock_test_and_set(&halide_cl_host_mappings.lock, 1)) {
+        while (*(volatile int *)&halide_cl_host_mappings.lock) {}
+    }
+}
+
+WEAK void halide_cl_host_mappings_unlock() {
+    __sync_lock_release(&halide_cl_host_mappings.lock);
+}
+
+// Allocate and free page-locked host memory. Returns NULL if the
+// memory can't be allocated, including when no kernel has run yet and
+// so there is no context to allocate it in.
+WEAK void *halide_dev_host_malloc(void *user_context, size_t size) {
+    if (!(*cl_ctx) || !(*cl_q)) {
+        return NULL;
+    }
+
+    host_mapping *m = (host_mapping *)malloc(sizeof(host_mapping));
+    if (!m) return NULL;
+
+    int err;
+    m->mem = clCreateBuffer(*cl_ctx, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, NULL, &err);
+    if (err != CL_SUCCESS) {
+        free(m);
+        return NULL;
+    }
+    m->host = clEnqueueMapBuffer(*cl_q, m->mem, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+                                 0, size, 0, NULL, NULL, &err);
+    if (err != CL_SUCCESS) {
+        clReleaseMemObject(m->mem);
+        free(m);
+        return NULL;
+    }
+
+    halide_cl_host_mappings_lock();
+    m->next = halide_cl_host_mappings.list;
+    halide_cl_host_mappings.list = m;
+    halide_cl_host_mappings_unlock();
+    return m->host;
+}
+
+WEAK void halide_dev_host_free(void *user_context, void *p) {
+    halide_cl_host_mappings_lock();
+    host_mapping **ptr = &halide_cl_host_mappings.list;
+    while (*ptr && (*ptr)->host != p) {
+        ptr = &((*ptr)->next);
+    }
+    host_mapping *m = *ptr;
+    if (m) {
+        *ptr = m->next;
+    }
+    halide_cl_host_mappings_unlock();
+
+    halide_assert(user_context, m && "halide_dev_host_free of memory not from halide_dev_host_malloc");
+    CHECK_CALL( clEnqueueUnmapMemObject(*cl_q, m->mem, p, 0, NULL, NULL), "clEnqueueUnmapMemObject" );
+    CHECK_CALL( clReleaseMemObject(m->mem), "clReleaseMemObject" );
+    free(m);
+}
+
+// OpenCL has no way to page-lock memory it didn't allocate, so this
+// always fails. Returns zero on success.
+WEAK int halide_dev_host_register(void *user_context, void *p, size_t size) {
+    return -1;
+}
+
+WEAK void halide_dev_host_unregister(void *user_context, void *p) {
+}
+
 // Used to generate correct timings when tracing
 WEAK void halide_dev_sync(void *user_context) {
+    if (!(*cl_q)) return;
     clFinish(*cl_q);
+    halide_cl_events_lock();
+    halide_cl_forget_events();
+    halide_cl_events_unlock();
+}
+
+// Start any kernels enqueued so far, without waiting for them.
+WEAK void halide_dev_flush(void *user_context) {
+    if (!(*cl_q)) return;
+    clFlush(*cl_q);
 }
 
 WEAK void halide_release(void *user_context) {
+    halide_gpu_warmup_join();
     // TODO: this is for timing; bad for release-mode performance
     #ifdef DEBUG
     halide_printf(user_context, "dev_sync on exit\n" );
     #endif
     halide_dev_sync(user_context);
+    halide_cl_resolve_timings();
+    if (halide_gpu_profile.entries) {
+        halide_gpu_profile_print(user_context);
+        halide_gpu_profile_clear();
+    }
+
+    // Release the cached device allocations
+    halide_dev_cache_trim(user_context);
 
     // Unload the modules attached to this context
     module_state *state = state_list;
@@ -354,6 +928,11 @@ static cl_mem __dev_malloc(void *user_context, size_t bytes) {
 
     int err;
     p = clCreateBuffer(*cl_ctx, CL_MEM_READ_WRITE, bytes, NULL, &err );
+    if (!p && (err == CL_MEM_OBJECT_ALLOCATION_FAILURE || err == CL_OUT_OF_RESOURCES)) {
+        // The cache may be holding on to the memory we need.
+        halide_dev_cache_trim(user_context);
+        p = clCreateBuffer(*cl_ctx, CL_MEM_READ_WRITE, bytes, NULL, &err );
+    }
     #ifdef DEBUG
     halide_printf(user_context, "    returned: %p (err: %d)\n", (void*)p, err);
     #endif
@@ -389,7 +968,30 @@ WEAK void halide_dev_malloc(void *user_context, buffer_t* buf) {
                   buf->elem_size);
     #endif
 
-    buf->dev = (uint64_t)__dev_malloc(user_context, size);
+    if (buf->host && halide_cl_use_zero_copy(user_context)) {
+        int err;
+        cl_mem p = clCreateBuffer(*cl_ctx, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, size, buf->host, &err);
+        #ifdef DEBUG
+        halide_printf(user_context, "dev_malloc zero-copy around %p returned: %p (err: %d)\n",
+                      buf->host, (void*)p, err);
+        #endif
+        if (err == CL_SUCCESS) {
+            buf->dev = (uint64_t)p;
+            return;
+        }
+    }
+
+    int c = halide_dev_cache.max_cached_bytes ? halide_dev_cache_size_class(size) : -1;
+    if (c >= 0) {
+        buf->dev = (uint64_t)halide_dev_cache_get(c);
+        // Allocate the whole size class, so the buffer can go back in
+        // the cache when it's freed.
+        size = halide_dev_cache_class_bytes(c);
+    }
+
+    if (!buf->dev) {
+        buf->dev = (uint64_t)__dev_malloc(user_context, size);
+    }
     #ifdef DEBUG
     halide_printf(user_context, "dev_malloc allocated buffer %p of with buf->dev of %p\n",
                   buf, (void *)buf->dev);
@@ -405,15 +1007,43 @@ WEAK void halide_copy_to_dev(void *user_context, buffer_t* buf) {
         halide_printf(user_context, "copy_to_dev (%lld bytes) %p -> %p\n", (long long)size, buf->host, (void*)buf->dev);
         #endif
         halide_assert(user_context, halide_validate_dev_pointer(user_context, buf));
-        int err = clEnqueueWriteBuffer( *cl_q, (cl_mem)((void*)buf->dev), CL_TRUE, 0, size, buf->host, 0, NULL, NULL );
-        CHECK_ERR( err, "clEnqueueWriteBuffer" );
+        cl_mem mem = (cl_mem)((void*)buf->dev);
+        int err;
+        halide_cl_events_lock();
+        // The last kernel may still be using the old contents.
+        cl_event deps[MAX_PENDING_WRITES + 1];
+        cl_uint dep_count = halide_cl_get_deps(deps, false);
+        cl_event event = NULL;
+        if (halide_cl_is_zero_copy(mem)) {
+            // The host memory already holds the data. Mapping to
+            // write with the old contents invalidated, then unmapping,
+            // tells the device it changed. Kernels must wait for the
+            // unmap, but it doesn't read the host memory after.
+            void *p = clEnqueueMapBuffer( *cl_q, mem, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION,
+                                          0, size, dep_count, dep_count ? deps : NULL, NULL, &err );
+            CHECK_ERR( err, "clEnqueueMapBuffer" );
+            err = clEnqueueUnmapMemObject( *cl_q, mem, p, 0, NULL, &event );
+            CHECK_ERR( err, "clEnqueueUnmapMemObject" );
+            if (event) {
+                halide_cl_add_event(event, false, NULL);
+            }
+        } else {
+            err = clEnqueueWriteBuffer( *cl_q, mem, CL_FALSE, 0, size, buf->host,
+                                        dep_count, dep_count ? deps : NULL, &event );
+            CHECK_ERR( err, "clEnqueueWriteBuffer" );
+            halide_runtime_stats_device_transfer(size, 1);
+            if (event) {
+                halide_cl_profile(event, "host_to_dev", halide_gpu_profile_copy_to_dev, size);
+                halide_cl_add_event(event, false, buf->host);
+            }
+        }
+        halide_cl_events_unlock();
     }
     buf->host_dirty = false;
 }
 
 WEAK void halide_copy_to_host(void *user_context, buffer_t* buf) {
     if (buf->dev_dirty) {
-        clFinish(*cl_q); // block on completion before read back
         halide_assert(user_context, buf->host && buf->dev);
         size_t size = __buf_size(user_context, buf);
         #ifdef DEBUG
@@ -422,11 +1052,72 @@ WEAK void halide_copy_to_host(void *user_context, buffer_t* buf) {
         #endif
 
         halide_assert(user_context, halide_validate_dev_pointer(user_context, buf, size));
-        int err = clEnqueueReadBuffer( *cl_q, (cl_mem)((void*)buf->dev), CL_TRUE, 0, size, buf->host, 0, NULL, NULL );
-        CHECK_ERR( err, "clEnqueueReadBuffer" );
+        cl_mem mem = (cl_mem)((void*)buf->dev);
+        int err;
+        // Wait only for the commands the read depends on, rather than
+        // everything in the queue. They include every upload in
+        // flight, so afterwards none is.
+        halide_cl_events_lock();
+        cl_event deps[MAX_PENDING_WRITES + 1];
+        cl_uint dep_count = halide_cl_get_deps(deps, true);
+        if (halide_cl_is_zero_copy(mem)) {
+            // A blocking map to read brings the host memory up to date.
+            void *p = clEnqueueMapBuffer( *cl_q, mem, CL_TRUE, CL_MAP_READ,
+                                          0, size, dep_count, dep_count ? deps : NULL, NULL, &err );
+            CHECK_ERR( err, "clEnqueueMapBuffer" );
+            halide_assert(user_context, p == buf->host);
+            err = clEnqueueUnmapMemObject( *cl_q, mem, p, 0, NULL, NULL );
+            CHECK_ERR( err, "clEnqueueUnmapMemObject" );
+        } else {
+            cl_event event = NULL;
+            err = clEnqueueReadBuffer( *cl_q, mem, CL_TRUE, 0, size, buf->host,
+                                       dep_count, dep_count ? deps : NULL,
+                                       halide_gpu_profile_enabled() ? &event : NULL );
+            CHECK_ERR( err, "clEnqueueReadBuffer" );
+            halide_runtime_stats_device_transfer(size, 0);
+            if (event) {
+                halide_cl_profile(event, "dev_to_host", halide_gpu_profile_copy_to_host, size);
+                clReleaseEvent(event);
+            }
+        }
+        halide_cl_wait_for_writes(NULL);
+        halide_cl_events_unlock();
     }
     buf->dev_dirty = false;
 }
+
+// Copy size bytes of a buffer starting offset bytes in back to the
+// host, leaving the dirty bits alone. Used to merge the part of an
+// output computed on the gpu with the part computed on the cpu.
+WEAK void halide_copy_to_host_range(void *user_context, buffer_t* buf, int64_t offset, int64_t size) {
+    if (!buf->dev_dirty || size <= 0) return;
+    halide_assert(user_context, buf->host && buf->dev);
+    halide_assert(user_context, offset >= 0 && (size_t)(offset + size) <= __buf_size(user_context, buf));
+    #ifdef DEBUG
+    halide_printf(user_context, "copy_to_host_range buf %p (%lld bytes at %lld) %p -> %p\n", buf,
+                  (long long)size, (long long)offset, (void*)buf->dev, buf->host );
+    #endif
+
+    cl_mem mem = (cl_mem)((void*)buf->dev);
+    int err;
+    halide_cl_events_lock();
+    cl_event deps[MAX_PENDING_WRITES + 1];
+    cl_uint dep_count = halide_cl_get_deps(deps, true);
+    if (halide_cl_is_zero_copy(mem)) {
+        void *p = clEnqueueMapBuffer( *cl_q, mem, CL_TRUE, CL_MAP_READ,
+                                      offset, size, dep_count, dep_count ? deps : NULL, NULL, &err );
+        CHECK_ERR( err, "clEnqueueMapBuffer" );
+        err = clEnqueueUnmapMemObject( *cl_q, mem, p, 0, NULL, NULL );
+        CHECK_ERR( err, "clEnqueueUnmapMemObject" );
+    } else {
+        err = clEnqueueReadBuffer( *cl_q, mem, CL_TRUE, offset, size, buf->host + offset,
+                                   dep_count, dep_count ? deps : NULL, NULL );
+        CHECK_ERR( err, "clEnqueueReadBuffer" );
+        halide_runtime_stats_device_transfer(size, 0);
+    }
+    halide_cl_wait_for_writes(NULL);
+    halide_cl_events_unlock();
+}
 #define _COPY_TO_HOST
 
 WEAK void halide_dev_run(
@@ -470,7 +1161,12 @@ WEAK void halide_dev_run(
     uint64_t t_before = halide_current_time_ns(user_context);
     #endif
 
-    // Launch kernel
+    // Launch kernel, after the previous kernel, which may have made
+    // its inputs, and the uploads in flight.
+    halide_cl_events_lock();
+    cl_event deps[MAX_PENDING_WRITES + 1];
+    cl_uint dep_count = halide_cl_get_deps(deps, true);
+    cl_event event = NULL;
     int err =
     clEnqueueNDRangeKernel(
         *cl_q,
@@ -479,10 +1175,23 @@ WEAK void halide_dev_run(
         NULL,
         global_dim,
         local_dim,
-        0, NULL, NULL
+        dep_count, dep_count ? deps : NULL,
+        &event
     );
     CHECK_ERR(err, "clEnqueueNDRangeKernel");
 
+    if (event) {
+        // OpenCL has no way to ask for the occupancy.
+        gpu_profile_entry *e = halide_cl_profile(event, entry_name, halide_gpu_profile_kernel, 0);
+        if (e) {
+            int blocks[] = {blocksX, blocksY, blocksZ};
+            int threads[] = {threadsX, threadsY, threadsZ};
+            halide_gpu_profile_set_launch(e, blocks, threads, shared_mem_bytes);
+        }
+        halide_cl_add_event(event, true, NULL);
+    }
+    halide_cl_events_unlock();
+
     #ifdef DEBUG
     halide_dev_sync(user_context);
     uint64_t t_after = halide_current_time_ns(user_context);
@@ -490,6 +1199,16 @@ WEAK void halide_dev_run(
     #endif
 }
 
+WEAK void halide_gpu_profile_report(void *user_context) {
+    halide_cl_resolve_timings();
+    halide_gpu_profile_print(user_context);
+}
+
+WEAK void halide_gpu_profile_reset(void *user_context) {
+    halide_cl_resolve_timings();
+    halide_gpu_profile_clear();
+}
+
 #ifdef TEST_STUB
 const char* src = "                                               \n"\
 "__kernel void knl(                                                       \n" \
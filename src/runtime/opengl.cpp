@@ -0,0 +1,522 @@
+#include "mini_stdint.h"
+#include "../buffer_t.h"
+#include "HalideRuntime.h"
+
+#define WEAK __attribute__((weak))
+#ifndef NULL
+#define NULL 0
+#endif
+
+extern "C" {
+
+extern int64_t halide_current_time_ns(void *user_context);
+extern void free(void *);
+extern void *malloc(size_t);
+extern void *memcpy(void *, const void *, size_t);
+
+// The parts of EGL 1.4 and OpenGL ES 3.1 the runtime uses.
+typedef unsigned int GLenum;
+typedef unsigned int GLuint;
+typedef int GLint;
+typedef int GLsizei;
+typedef unsigned int GLbitfield;
+typedef unsigned char GLboolean;
+typedef float GLfloat;
+typedef char GLchar;
+typedef intptr_t GLintptr;
+typedef intptr_t GLsizeiptr;
+
+#define GL_NO_ERROR 0
+#define GL_VERSION 0x1F02
+#define GL_COMPUTE_SHADER 0x91B9
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#define GL_INFO_LOG_LENGTH 0x8B84
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#define GL_BUFFER_SIZE 0x8764
+#define GL_DYNAMIC_COPY 0x88EA
+#define GL_MAP_READ_BIT 0x0001
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+
+extern GLenum glGetError();
+extern const unsigned char *glGetString(GLenum name);
+extern GLuint glCreateShader(GLenum type);
+extern void glShaderSource(GLuint shader, GLsizei count, const GLchar *const *string, const GLint *length);
+extern void glCompileShader(GLuint shader);
+extern void glGetShaderiv(GLuint shader, GLenum pname, GLint *params);
+extern void glGetShaderInfoLog(GLuint shader, GLsizei size, GLsizei *length, GLchar *log);
+extern void glDeleteShader(GLuint shader);
+extern GLuint glCreateProgram();
+extern void glAttachShader(GLuint program, GLuint shader);
+extern void glLinkProgram(GLuint program);
+extern void glGetProgramiv(GLuint program, GLenum pname, GLint *params);
+extern void glGetProgramInfoLog(GLuint program, GLsizei size, GLsizei *length, GLchar *log);
+extern void glDeleteProgram(GLuint program);
+extern void glUseProgram(GLuint program);
+extern void glGenBuffers(GLsizei n, GLuint *buffers);
+extern void glDeleteBuffers(GLsizei n, const GLuint *buffers);
+extern void glBindBuffer(GLenum target, GLuint buffer);
+extern void glBindBufferBase(GLenum target, GLuint index, GLuint buffer);
+extern void glBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage);
+extern void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data);
+extern void glGetBufferParameteriv(GLenum target, GLenum pname, GLint *params);
+extern void *glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+extern GLboolean glUnmapBuffer(GLenum target);
+extern void glUniform1i(GLint location, GLint v0);
+extern void glUniform1ui(GLint location, GLuint v0);
+extern void glUniform1f(GLint location, GLfloat v0);
+extern void glDispatchCompute(GLuint x, GLuint y, GLuint z);
+extern void glMemoryBarrier(GLbitfield barriers);
+extern void glFinish();
+extern void glFlush();
+
+typedef void *EGLDisplay;
+typedef void *EGLConfig;
+typedef void *EGLContext;
+typedef void *EGLSurface;
+typedef int32_t EGLint;
+typedef unsigned int EGLBoolean;
+
+#define EGL_NONE 0x3038
+#define EGL_SURFACE_TYPE 0x3033
+#define EGL_PBUFFER_BIT 0x0001
+#define EGL_RENDERABLE_TYPE 0x3040
+#define EGL_OPENGL_ES3_BIT_KHR 0x0040
+#define EGL_WIDTH 0x3057
+#define EGL_HEIGHT 0x3056
+#define EGL_CONTEXT_CLIENT_VERSION 0x3098
+#define EGL_CONTEXT_MINOR_VERSION_KHR 0x30FB
+#define EGL_OPENGL_ES_API 0x30A0
+
+extern EGLContext eglGetCurrentContext();
+extern EGLDisplay eglGetDisplay(void *display_id);
+extern EGLBoolean eglInitialize(EGLDisplay dpy, EGLint *major, EGLint *minor);
+extern EGLBoolean eglBindAPI(unsigned int api);
+extern EGLBoolean eglChooseConfig(EGLDisplay dpy, const EGLint *attrib_list, EGLConfig *configs,
+                                  EGLint config_size, EGLint *num_config);
+extern EGLContext eglCreateContext(EGLDisplay dpy, EGLConfig config, EGLContext share_context,
+                                   const EGLint *attrib_list);
+extern EGLSurface eglCreatePbufferSurface(EGLDisplay dpy, EGLConfig config, const EGLint *attrib_list);
+extern EGLBoolean eglMakeCurrent(EGLDisplay dpy, EGLSurface draw, EGLSurface read, EGLContext ctx);
+
+#ifndef DEBUG
+#define CHECK_GL(str)
+#else // DEBUG
+#define CHECK_GL(str)                                                   \
+    do {                                                                \
+        GLenum err = glGetError();                                      \
+        if (err != GL_NO_ERROR) {                                       \
+            halide_printf(user_context, "GL error %x in %s\n", err, str); \
+            halide_assert(user_context, false);                         \
+        }                                                               \
+    } while (0)
+#endif //DEBUG
+
+// Make a context current on the calling thread if there isn't one
+// already. Apps that draw with OpenGL ES make their own context
+// current before running a pipeline, and then the kernels share it.
+// Otherwise this makes an offscreen ES 3.1 context with EGL, which
+// stays current for the life of the thread. Override it to choose
+// the context some other way. Returns zero on success.
+WEAK int halide_opengl_create_context(void *user_context) {
+    if (eglGetCurrentContext()) return 0;
+
+    EGLDisplay display = eglGetDisplay(NULL);
+    if (!display || !eglInitialize(display, NULL, NULL)) {
+        halide_printf(user_context, "Failed to initialize the EGL display\n");
+        return -1;
+    }
+    eglBindAPI(EGL_OPENGL_ES_API);
+
+    EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT_KHR,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs == 0) {
+        halide_printf(user_context, "Failed to find an EGL config for OpenGL ES 3\n");
+        return -1;
+    }
+
+    EGLint context_attribs[] = {
+        EGL_CONTEXT_CLIENT_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 1,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, NULL, context_attribs);
+    if (!context) {
+        halide_printf(user_context, "Failed to create an OpenGL ES 3.1 context\n");
+        return -1;
+    }
+
+    // Compute shaders don't draw, but some drivers won't make a
+    // context current without a surface.
+    EGLint surface_attribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    EGLSurface surface = eglCreatePbufferSurface(display, config, surface_attribs);
+    if (!eglMakeCurrent(display, surface, surface, context)) {
+        halide_printf(user_context, "Failed to make the OpenGL ES context current\n");
+        return -1;
+    }
+
+    #ifdef DEBUG
+    halide_printf(user_context, "Created OpenGL ES context: %s\n", glGetString(GL_VERSION));
+    #endif
+    return 0;
+}
+
+// A kernel of a module, compiled into a program of its own. The
+// kinds are the letters the compiler wrote after its name: b for each
+// buffer argument, and i, u or f for each uniform.
+struct halide_gl_kernel {
+    char *name;
+    char *kinds;
+    GLuint program;
+    halide_gl_kernel *next;
+};
+
+// Structure to hold the state of a module attached to the context.
+// Also used as a linked-list to keep track of all the different
+// modules that are attached to a context in order to release them all
+// when then context is released.
+struct _module_state_ WEAK *state_list = NULL;
+typedef struct _module_state_ {
+    halide_gl_kernel *kernels;
+    _module_state_ *next;
+} module_state;
+
+static const char kernel_marker[] = "/*kernel ";
+
+// The first kernel marker at or after p, or end if there isn't one.
+static const char *__find_kernel(const char *p, const char *end) {
+    const int n = sizeof(kernel_marker) - 1;
+    for (; p + n <= end; p++) {
+        int i = 0;
+        while (i < n && p[i] == kernel_marker[i]) i++;
+        if (i == n) return p;
+    }
+    return end;
+}
+
+// Copy the characters of a header from p up to the stop character.
+static char *__copy_until(const char *p, const char *end, char stop, const char **next) {
+    const char *q = p;
+    while (q < end && *q != stop) q++;
+    char *result = (char *)malloc(q - p + 1);
+    memcpy(result, p, q - p);
+    result[q - p] = 0;
+    *next = q;
+    return result;
+}
+
+static GLuint __compile_kernel(void *user_context, const char *preamble, int preamble_size,
+                               const char *src, int size) {
+    const char *header =
+        "#version 310 es\n"
+        "precision highp float;\n"
+        "precision highp int;\n";
+    int header_size = 0;
+    while (header[header_size]) header_size++;
+
+    const GLchar *sources[] = {header, preamble, src};
+    GLint lengths[] = {header_size, preamble_size, size};
+
+    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader, 3, sources, lengths);
+    glCompileShader(shader);
+    GLint ok = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        GLint len = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+        char *log = (char *)malloc(len + 1);
+        glGetShaderInfoLog(shader, len + 1, NULL, log);
+        halide_printf(user_context, "Error: Failed to compile the compute shader!\nBuild Log:\n %s\n-----\n", log);
+        free(log);
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    // The program keeps the compiled shader.
+    glDeleteShader(shader);
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        GLint len = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &len);
+        char *log = (char *)malloc(len + 1);
+        glGetProgramInfoLog(program, len + 1, NULL, log);
+        halide_printf(user_context, "Error: Failed to link the compute shader!\nLink Log:\n %s\n-----\n", log);
+        free(log);
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+WEAK void* halide_init_kernels(void *user_context, void *state_ptr, const char* src, int size) {
+    if (halide_opengl_create_context(user_context)) {
+        return NULL;
+    }
+
+    // Create the module state if necessary
+    module_state *state = (module_state*)state_ptr;
+    if (!state) {
+        state = (module_state*)malloc(sizeof(module_state));
+        state->kernels = NULL;
+        state->next = state_list;
+        state_list = state;
+    }
+
+    // Compile each kernel of the module into a program of its own.
+    // Everything before the first one goes in front of them all.
+    if (!state->kernels && size > 1) {
+        const char *end = src + size - 1;
+        const char *p = __find_kernel(src, end);
+        int preamble_size = p - src;
+        while (p < end) {
+            const char *header = p + sizeof(kernel_marker) - 1;
+            halide_gl_kernel *k = (halide_gl_kernel *)malloc(sizeof(halide_gl_kernel));
+            k->name = __copy_until(header, end, ' ', &header);
+            k->kinds = __copy_until(header + 1, end, '*', &header);
+            const char *next = __find_kernel(header, end);
+
+            #ifdef DEBUG
+            halide_printf(user_context, "Compiling compute shader %s (args %s)\n", k->name, k->kinds);
+            #endif
+            k->program = __compile_kernel(user_context, src, preamble_size, p, next - p);
+            halide_assert(user_context, k->program);
+            k->next = state->kernels;
+            state->kernels = k;
+            p = next;
+        }
+    }
+    return state;
+}
+
+// Used to generate correct timings when tracing
+WEAK void halide_dev_sync(void *user_context) {
+    if (!eglGetCurrentContext()) return;
+    glFinish();
+}
+
+// Start any kernels dispatched so far, without waiting for them.
+WEAK void halide_dev_flush(void *user_context) {
+    if (!eglGetCurrentContext()) return;
+    glFlush();
+}
+
+WEAK void halide_release(void *user_context) {
+    // The context may be the app's, and may be shared with other
+    // modules, so it stays. Only the programs go.
+    if (!eglGetCurrentContext()) return;
+    halide_dev_sync(user_context);
+
+    // Unload the modules attached to this context
+    module_state *state = state_list;
+    while (state) {
+        while (state->kernels) {
+            halide_gl_kernel *k = state->kernels;
+            #ifdef DEBUG
+            halide_printf(user_context, "glDeleteProgram %s\n", k->name);
+            #endif
+            glDeleteProgram(k->program);
+            state->kernels = k->next;
+            free(k->name);
+            free(k->kinds);
+            free(k);
+        }
+        state = state->next;
+    }
+}
+
+static size_t __buf_size(void *user_context, buffer_t* buf) {
+    size_t size = 0;
+    for (int i = 0; i < sizeof(buf->stride) / sizeof(buf->stride[0]); i++) {
+        size_t total_dim_size = buf->elem_size * buf->extent[i] * buf->stride[i];
+        if (total_dim_size > size)
+            size = total_dim_size;
+     }
+    halide_assert(user_context, size);
+    return size;
+}
+
+WEAK void halide_dev_free(void *user_context, buffer_t* buf) {
+    // halide_dev_free, at present, can be exposed to clients and they
+    // should be allowed to call halide_dev_free on any buffer_t
+    // including ones that have never been used with a GPU.
+    if (buf->dev == 0)
+      return;
+
+    #ifdef DEBUG
+    halide_printf(user_context, "In dev_free of %p - dev: %d\n", buf, (int)buf->dev);
+    #endif
+
+    GLuint name = (GLuint)buf->dev;
+    glDeleteBuffers(1, &name);
+    CHECK_GL("glDeleteBuffers");
+    buf->dev = 0;
+}
+
+WEAK void halide_dev_malloc(void *user_context, buffer_t* buf) {
+    size_t size = __buf_size(user_context, buf);
+    if (buf->dev) {
+        #ifdef DEBUG
+        GLint real_size = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, (GLuint)buf->dev);
+        glGetBufferParameteriv(GL_SHADER_STORAGE_BUFFER, GL_BUFFER_SIZE, &real_size);
+        halide_assert(user_context, (size_t)real_size >= size && "Validating pointer with insufficient size");
+        #endif
+        return;
+    }
+
+    #ifdef DEBUG
+    halide_printf(user_context, "dev_malloc allocating buffer of %lld bytes, "
+                  "extents: %lldx%lldx%lldx%lld strides: %lldx%lldx%lldx%lld (%d bytes per element)\n",
+                  (long long)size, (long long)buf->extent[0], (long long)buf->extent[1],
+                  (long long)buf->extent[2], (long long)buf->extent[3],
+                  (long long)buf->stride[0], (long long)buf->stride[1],
+                  (long long)buf->stride[2], (long long)buf->stride[3],
+                  buf->elem_size);
+    #endif
+
+    GLuint name = 0;
+    glGenBuffers(1, &name);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, name);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_COPY);
+    CHECK_GL("glBufferData");
+    buf->dev = name;
+    halide_assert(user_context, buf->dev);
+}
+
+WEAK void halide_copy_to_dev(void *user_context, buffer_t* buf) {
+    if (buf->host_dirty) {
+        halide_assert(user_context, buf->host && buf->dev);
+        size_t size = __buf_size(user_context, buf);
+        #ifdef DEBUG
+        halide_printf(user_context, "copy_to_dev (%lld bytes) %p -> %d\n", (long long)size, buf->host, (int)buf->dev);
+        #endif
+        // The driver keeps the upload in order with the kernels that
+        // use the old contents.
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, (GLuint)buf->dev);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, buf->host);
+        CHECK_GL("glBufferSubData");
+    }
+    buf->host_dirty = false;
+}
+
+// Read size bytes of the device buffer, starting offset bytes in,
+// into the host buffer at the same offset. Kernels that wrote to it
+// were followed by barriers, so the map waits for them.
+static void __read_range(void *user_context, buffer_t* buf, int64_t offset, int64_t size) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, (GLuint)buf->dev);
+    void *p = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, offset, size, GL_MAP_READ_BIT);
+    CHECK_GL("glMapBufferRange");
+    halide_assert(user_context, p);
+    memcpy(buf->host + offset, p, size);
+    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+}
+
+WEAK void halide_copy_to_host(void *user_context, buffer_t* buf) {
+    if (buf->dev_dirty) {
+        halide_assert(user_context, buf->host && buf->dev);
+        size_t size = __buf_size(user_context, buf);
+        #ifdef DEBUG
+        halide_printf(user_context, "copy_to_host buf %p (%lld bytes) %d -> %p\n", buf, (long long)size,
+                      (int)buf->dev, buf->host );
+        #endif
+        __read_range(user_context, buf, 0, size);
+    }
+    buf->dev_dirty = false;
+}
+
+// Copy size bytes of a buffer starting offset bytes in back to the
+// host, leaving the dirty bits alone. Used to merge the part of an
+// output computed on the gpu with the part computed on the cpu.
+WEAK void halide_copy_to_host_range(void *user_context, buffer_t* buf, int64_t offset, int64_t size) {
+    if (!buf->dev_dirty || size <= 0) return;
+    halide_assert(user_context, buf->host && buf->dev);
+    halide_assert(user_context, offset >= 0 && (size_t)(offset + size) <= __buf_size(user_context, buf));
+    #ifdef DEBUG
+    halide_printf(user_context, "copy_to_host_range buf %p (%lld bytes at %lld) %d -> %p\n", buf,
+                  (long long)size, (long long)offset, (int)buf->dev, buf->host );
+    #endif
+    __read_range(user_context, buf, offset, size);
+}
+#define _COPY_TO_HOST
+
+WEAK void halide_dev_run(
+    void *user_context,
+    void *state_ptr,
+    const char* entry_name,
+    int blocksX, int blocksY, int blocksZ,
+    int threadsX, int threadsY, int threadsZ,
+    int shared_mem_bytes,
+    size_t arg_sizes[],
+    void* args[])
+{
+    halide_assert(user_context, state_ptr);
+    halide_gl_kernel *k = ((module_state*)state_ptr)->kernels;
+    while (k) {
+        int i = 0;
+        while (k->name[i] && k->name[i] == entry_name[i]) i++;
+        if (k->name[i] == 0 && entry_name[i] == 0) break;
+        k = k->next;
+    }
+    halide_assert(user_context, k && "Could not find the compute shader of a kernel");
+    #ifdef DEBUG
+    halide_printf(user_context,
+        "dev_run %s with (%dx%dx%d) blks, (%dx%dx%d) threads\n",
+        entry_name, blocksX, blocksY, blocksZ, threadsX, threadsY, threadsZ
+    );
+    #endif
+
+    // The thread counts are compiled into the shader as its work
+    // group size.
+    glUseProgram(k->program);
+
+    // Bind the buffers in order, and set the uniforms in order.
+    GLuint binding = 0;
+    GLint location = 0;
+    for (int i = 0; arg_sizes[i] != 0; i++) {
+        halide_assert(user_context, k->kinds[i]);
+        switch (k->kinds[i]) {
+        case 'b':
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding++, (GLuint)(*(uint64_t *)args[i]));
+            break;
+        case 'f':
+            glUniform1f(location++, *(float *)args[i]);
+            break;
+        case 'u':
+            glUniform1ui(location++, *(uint32_t *)args[i]);
+            break;
+        default:
+            glUniform1i(location++, *(int32_t *)args[i]);
+            break;
+        }
+    }
+    CHECK_GL("setting the arguments");
+
+    #ifdef DEBUG
+    uint64_t t_before = halide_current_time_ns(user_context);
+    #endif
+
+    glDispatchCompute(blocksX, blocksY, blocksZ);
+    // Later kernels, and reads back to the host, see what it wrote.
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    CHECK_GL("glDispatchCompute");
+
+    #ifdef DEBUG
+    halide_dev_sync(user_context);
+    uint64_t t_after = halide_current_time_ns(user_context);
+    halide_printf(user_context, "Kernel took: %f ms\n", (t_after - t_before) / 1000000.0);
+    #endif
+}
+
+} // extern "C" linkage
+
+#undef CHECK_GL
@@ -0,0 +1,2 @@
+#define DEBUG
+#include "opengl.cpp"
@@ -0,0 +1,28 @@
+#include "mini_stdint.h"
+
+extern "C" {
+
+extern int sysctlbyname(const char *, void *, size_t *, void *, size_t);
+
+// The defaults when the OS doesn't know.
+WEAK int halide_default_cache_size(int level) {
+    return level <= 1 ? 32 * 1024 : level == 2 ? 256 * 1024 : 2 * 1024 * 1024;
+}
+
+WEAK int halide_host_cache_size(int level) {
+    static int sizes[4] = {0, 0, 0, 0};
+    if (level < 1) level = 1;
+    if (level > 3) level = 3;
+    if (sizes[level] == 0) {
+        const char *names[4] = {0, "hw.l1dcachesize", "hw.l2cachesize", "hw.l3cachesize"};
+        int64_t size = 0;
+        size_t len = sizeof(size);
+        if (sysctlbyname(names[level], &size, &len, 0, 0) != 0 || size <= 0) {
+            size = halide_default_cache_size(level);
+        }
+        sizes[level] = (int)size;
+    }
+    return sizes[level];
+}
+
+}
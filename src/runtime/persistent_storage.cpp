@@ -0,0 +1,145 @@
+#include "mini_stdint.h"
+#include "HalideRuntime.h"
+
+#define WEAK __attribute__((weak))
+#ifndef NULL
+#define NULL 0
+#endif
+
+extern "C" {
+
+extern void *malloc(size_t);
+extern void free(void *);
+extern int strcmp(const char *, const char *);
+extern size_t strlen(const char *);
+extern void *memcpy(void *, const void *, size_t);
+extern int memcmp(const void *, const void *, size_t);
+
+// The storage of Funcs scheduled with store_persistent, kept from one
+// run of a pipeline to the next. Each entry remembers the shape it was
+// allocated for, and the range of the folded dimension whose values
+// are valid. There are only ever a few entries, so they go in a list,
+// protected by a spin lock.
+struct halide_persistent_storage_entry {
+    halide_persistent_storage_entry *next;
+    char *name;
+    int32_t *shape;
+    int32_t shape_size;
+    int32_t size;
+    int32_t valid_min, valid_max;
+    uint8_t *data;
+};
+
+WEAK struct {
+    int lock;
+    halide_persistent_storage_entry *entries;
+} halide_persistent_storage = {0, NULL};
+
+WEAK void halide_persistent_storage_lock() {
+    while (__sync_lock_test_and_set(&halide_persistent_storage.lock, 1)) {
+        while (*(volatile int *)&halide_persistent_storage.lock) {}
+    }
+}
+
+WEAK void halide_persistent_storage_unlock() {
+    __sync_lock_release(&halide_persistent_storage.lock);
+}
+
+// Nothing is valid in an entry until a run releases it.
+WEAK void halide_persistent_storage_invalidate(halide_persistent_storage_entry *e) {
+    e->valid_min = 0x7fffffff;
+    e->valid_max = -0x7fffffff - 1;
+}
+
+WEAK void *halide_persistent_storage_acquire(void *user_context, const char *name,
+                                             int32_t *state, int32_t shape_size, int32_t size) {
+    halide_persistent_storage_lock();
+    halide_persistent_storage_entry *e = halide_persistent_storage.entries;
+    while (e && strcmp(e->name, name)) {
+        e = e->next;
+    }
+
+    if (e && (!e->shape || e->size != size || e->shape_size != shape_size ||
+              memcmp(e->shape, state, shape_size * sizeof(int32_t)))) {
+        // The region of the Func moved or changed size, so the old
+        // values are at the wrong coordinates. Start again.
+        free(e->data);
+        e->data = (uint8_t *)malloc(size);
+        e->size = size;
+        if (e->shape_size != shape_size) {
+            free(e->shape);
+            e->shape = (int32_t *)malloc(shape_size * sizeof(int32_t));
+            e->shape_size = shape_size;
+        }
+        if (e->shape) {
+            memcpy(e->shape, state, shape_size * sizeof(int32_t));
+        }
+        halide_persistent_storage_invalidate(e);
+    } else if (!e) {
+        e = (halide_persistent_storage_entry *)malloc(sizeof(halide_persistent_storage_entry));
+        if (e) {
+            size_t name_len = strlen(name) + 1;
+            e->name = (char *)malloc(name_len);
+            e->shape = (int32_t *)malloc(shape_size * sizeof(int32_t));
+            e->data = (uint8_t *)malloc(size);
+            if (e->name) memcpy(e->name, name, name_len);
+            if (e->shape) memcpy(e->shape, state, shape_size * sizeof(int32_t));
+            e->shape_size = shape_size;
+            e->size = size;
+            halide_persistent_storage_invalidate(e);
+            if (e->name && e->shape) {
+                e->next = halide_persistent_storage.entries;
+                halide_persistent_storage.entries = e;
+            } else {
+                free(e->name);
+                free(e->shape);
+                free(e->data);
+                free(e);
+                e = NULL;
+            }
+        }
+    }
+
+    void *data = NULL;
+    if (e && e->shape && e->data) {
+        data = e->data;
+        state[shape_size] = e->valid_min;
+        state[shape_size + 1] = e->valid_max;
+        // If the run fails part way through, nothing is known to be
+        // valid.
+        halide_persistent_storage_invalidate(e);
+    }
+    halide_persistent_storage_unlock();
+    return data;
+}
+
+WEAK void halide_persistent_storage_release(void *user_context, const char *name,
+                                            int32_t valid_min, int32_t valid_max) {
+    halide_persistent_storage_lock();
+    halide_persistent_storage_entry *e = halide_persistent_storage.entries;
+    while (e && strcmp(e->name, name)) {
+        e = e->next;
+    }
+    if (e) {
+        e->valid_min = valid_min;
+        e->valid_max = valid_max;
+    }
+    halide_persistent_storage_unlock();
+}
+
+WEAK void halide_persistent_storage_cleanup() {
+    halide_persistent_storage_lock();
+    halide_persistent_storage_entry *e = halide_persistent_storage.entries;
+    while (e) {
+        halide_persistent_storage_entry *next = e->next;
+        free(e->name);
+        free(e->shape);
+        free(e->data);
+        free(e);
+        e = next;
+    }
+    halide_persistent_storage.entries = NULL;
+    halide_persistent_storage_unlock();
+}
+
+}
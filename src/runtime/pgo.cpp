@@ -0,0 +1,148 @@
+#include "mini_stdint.h"
+#include "HalideRuntime.h"
+
+// The counters of pipelines compiled with HL_PGO_INSTRUMENT=1 (see
+// ProfileGuided.h), and a writer for the profile that later compiles
+// read with HL_PGO_PROFILE.
+
+#define WEAK __attribute__((weak))
+#ifndef NULL
+#define NULL 0
+#endif
+
+extern "C" {
+
+extern char *getenv(const char *);
+extern void *malloc(size_t);
+extern void free(void *);
+extern int strcmp(const char *, const char *);
+extern size_t strlen(const char *);
+extern void *memcpy(void *, const void *, size_t);
+extern void *fopen(const char *path, const char *mode);
+extern size_t fwrite(const void *ptr, size_t size, size_t n, void *file);
+extern int fclose(void *f);
+extern int snprintf(char *str, size_t size, const char *format, ...);
+
+// The three counters of each site of a pipeline, and the site names,
+// one per line. Every run of the pipeline adds to the same counters.
+struct halide_pgo_pipeline {
+    halide_pgo_pipeline *next;
+    char *name;
+    int num_sites;
+    const char *site_names;
+    uint64_t *counters;
+};
+
+WEAK struct {
+    int lock;
+    halide_pgo_pipeline *pipelines;
+} halide_pgo = {0, NULL};
+
+WEAK void halide_pgo_lock() {
+    while (__sync_lock_test_and_set(&halide_pgo.lock, 1)) {}
+}
+
+WEAK void halide_pgo_unlock() {
+    __sync_lock_release(&halide_pgo.lock);
+}
+
+// Called at the start of each run of an instrumented pipeline. If
+// there's no memory for the counters, returns NULL, and the pipeline
+// runs without counting.
+WEAK uint64_t *halide_pgo_counters(void *user_context, const char *name,
+                                   int num_sites, const char *site_names) {
+    halide_pgo_lock();
+    halide_pgo_pipeline *p = halide_pgo.pipelines;
+    while (p && (strcmp(p->name, name) || p->num_sites != num_sites)) {
+        p = p->next;
+    }
+    if (!p) {
+        p = (halide_pgo_pipeline *)malloc(sizeof(halide_pgo_pipeline));
+        size_t name_len = strlen(name) + 1;
+        char *name_copy = p ? (char *)malloc(name_len) : NULL;
+        size_t bytes = 3 * num_sites * sizeof(uint64_t);
+        uint64_t *counters = name_copy ? (uint64_t *)malloc(bytes) : NULL;
+        if (!counters) {
+            if (name_copy) free(name_copy);
+            if (p) free(p);
+            halide_pgo_unlock();
+            return NULL;
+        }
+        memcpy(name_copy, name, name_len);
+        for (int i = 0; i < 3 * num_sites; i++) {
+            counters[i] = 0;
+        }
+        p->name = name_copy;
+        p->num_sites = num_sites;
+        // The names are a constant in the pipeline's code.
+        p->site_names = site_names;
+        p->counters = counters;
+        p->next = halide_pgo.pipelines;
+        halide_pgo.pipelines = p;
+    }
+    halide_pgo_unlock();
+    return p->counters;
+}
+
+WEAK int halide_pgo_count(uint64_t *counters, int index, int64_t amount) {
+    if (counters) {
+        __sync_fetch_and_add(counters + index, (uint64_t)amount);
+    }
+    return 0;
+}
+
+WEAK int halide_pgo_write(void *user_context) {
+    halide_pgo_lock();
+    if (!halide_pgo.pipelines) {
+        halide_pgo_unlock();
+        return 0;
+    }
+    const char *file_name = getenv("HL_PGO_OUTPUT");
+    if (!file_name || !file_name[0]) {
+        file_name = "halide.pgo";
+    }
+    void *f = fopen(file_name, "w");
+    if (!f) {
+        halide_pgo_unlock();
+        halide_printf(user_context, "Could not open profile file %s\n", file_name);
+        return -1;
+    }
+
+    int result = 0;
+    char buf[512];
+    for (halide_pgo_pipeline *p = halide_pgo.pipelines; p && result == 0; p = p->next) {
+        int n = snprintf(buf, sizeof(buf), "pipeline %s\n", p->name);
+        if (n > (int)sizeof(buf) - 1) n = sizeof(buf) - 1;
+        if (fwrite(buf, 1, n, f) != (size_t)n) result = -1;
+        const char *site = p->site_names;
+        for (int i = 0; i < p->num_sites && result == 0; i++) {
+            size_t len = 0;
+            while (site[len] && site[len] != '\n') len++;
+            if (fwrite(site, 1, len, f) != len) result = -1;
+            site += site[len] ? len + 1 : len;
+            const uint64_t *c = p->counters + 3 * i;
+            n = snprintf(buf, sizeof(buf), " %llu %llu %llu\n", (unsigned long long)c[0],
+                         (unsigned long long)c[1], (unsigned long long)c[2]);
+            if (fwrite(buf, 1, n, f) != (size_t)n) result = -1;
+        }
+    }
+    if (fclose(f)) result = -1;
+    halide_pgo_unlock();
+    return result;
+}
+
+// Write the profile if anything was counted, and forget the counts.
+// Must not be called while instrumented pipelines are running.
+WEAK void halide_shutdown_pgo() {
+    halide_pgo_write(NULL);
+    halide_pgo_lock();
+    while (halide_pgo_pipeline *p = halide_pgo.pipelines) {
+        halide_pgo.pipelines = p->next;
+        free(p->name);
+        free(p->counters);
+        free(p);
+    }
+    halide_pgo_unlock();
+}
+
+}
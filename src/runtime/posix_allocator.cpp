@@ -1,4 +1,5 @@
 #include "mini_stdint.h"
+#include "HalideRuntime.h"
 
 #define WEAK __attribute__((weak))
 #ifndef NULL
@@ -9,6 +10,8 @@ extern "C" {
 
 extern void *malloc(size_t);
 extern void free(void *);
+extern char *getenv(const char *);
+extern int atoi(const char *);
 
 WEAK void *(*halide_custom_malloc)(void *, size_t) = NULL;
 WEAK void (*halide_custom_free)(void *, void *) = NULL;
@@ -19,28 +22,193 @@ WEAK void halide_set_custom_allocator(void *(*cust_malloc)(void *, size_t),
     halide_custom_free = cust_free;
 }
 
+// Blocks are 32-byte aligned, and the two words before each block
+// hold the pointer malloc returned and, for blocks that belong to the
+// allocator cache, their size class tagged with a magic number.
+#define ALLOCATOR_HEADER 64
+#define CACHED_BLOCK_MAGIC ((size_t)0x4a4c0000)
+
+// The allocator cache keeps freed blocks in power-of-two size
+// classes, from 64 bytes up to 64 MB or the budget of a shard, and
+// hands them back out to later allocations of the same class. The
+// free lists are split into shards, each with its own spin lock, and
+// threads pick a shard using the address of their stack, so threads
+// mostly stay on their own shard without needing thread-local
+// storage.
+#define CACHE_MIN_CLASS 6
+#define CACHE_MAX_CLASS 26
+#define CACHE_CLASSES (CACHE_MAX_CLASS - CACHE_MIN_CLASS + 1)
+#define CACHE_SHARDS 16
+// The default total for all the shards together.
+#define CACHE_DEFAULT_MAX_BYTES (256 << 20)
+
+struct halide_allocator_cache_shard {
+    int lock;
+    void *free_list[CACHE_CLASSES];
+    size_t cached_bytes;
+    // Keep each shard on its own cache lines.
+    uint8_t padding[64];
+};
+
+WEAK struct {
+    // -1 until we've looked at HL_ALLOCATOR_CACHE
+    int enabled;
+    // The most bytes each shard holds on to. Frees beyond this go
+    // back to malloc.
+    size_t max_cached_bytes;
+    halide_allocator_cache_shard shard[CACHE_SHARDS];
+    halide_allocator_cache_stats stats;
+} halide_allocator_cache = {-1};
+
+WEAK int halide_allocator_cache_enabled() {
+    if (halide_allocator_cache.enabled < 0) {
+        // Racing threads will all compute the same answer.
+        char *enable_str = getenv("HL_ALLOCATOR_CACHE");
+        halide_allocator_cache.max_cached_bytes = CACHE_DEFAULT_MAX_BYTES / CACHE_SHARDS;
+        halide_allocator_cache.enabled = (enable_str && atoi(enable_str)) ? 1 : 0;
+    }
+    return halide_allocator_cache.enabled;
+}
+
+WEAK void halide_use_allocator_cache(int enable, size_t max_cached_bytes) {
+    if (max_cached_bytes == 0) {
+        max_cached_bytes = CACHE_DEFAULT_MAX_BYTES;
+    }
+    halide_allocator_cache.max_cached_bytes = max_cached_bytes / CACHE_SHARDS;
+    halide_allocator_cache.enabled = enable ? 1 : 0;
+}
+
+// Returns the size class big enough for x bytes, or -1 if x is too
+// large to be worth caching. Blocks of a class bigger than the budget
+// of a shard could never be cached, so they're not rounded up.
+WEAK int halide_allocator_size_class(size_t x) {
+    int c = CACHE_MIN_CLASS;
+    while (((size_t)1 << c) < x) {
+        c++;
+        if (c > CACHE_MAX_CLASS) return -1;
+    }
+    if (((size_t)1 << c) > halide_allocator_cache.max_cached_bytes) return -1;
+    return c - CACHE_MIN_CLASS;
+}
+
+WEAK halide_allocator_cache_shard *halide_allocator_this_shard() {
+    int on_my_stack;
+    size_t h = ((size_t)&on_my_stack) >> 16;
+    h ^= h >> 7;
+    return halide_allocator_cache.shard + (h % CACHE_SHARDS);
+}
+
+WEAK void halide_allocator_lock(halide_allocator_cache_shard *s) {
+    while (__sync_lock_test_and_set(&s->lock, 1)) {
+        while (*(volatile int *)&s->lock) {}
+    }
+}
+
+WEAK void halide_allocator_unlock(halide_allocator_cache_shard *s) {
+    __sync_lock_release(&s->lock);
+}
+
+// Get a new block from malloc and set up its header. tag is zero for
+// blocks that don't belong to the cache.
+WEAK void *halide_allocator_new_block(size_t x, size_t tag) {
+    void *orig = malloc(x + ALLOCATOR_HEADER);
+    if (orig == NULL) {
+        // Will result in a failed assertion and a call to halide_error
+        return NULL;
+    }
+    // Round up to a multiple of 32, leaving at least 16 bytes for the
+    // header, and at least 8 bytes beyond the end.
+    void *ptr = (void *)((((size_t)orig + 48) >> 5) << 5);
+    ((void **)ptr)[-1] = orig;
+    ((size_t *)ptr)[-2] = tag;
+    return ptr;
+}
+
 WEAK void *halide_malloc(void *user_context, size_t x) {
     if (halide_custom_malloc) {
         return halide_custom_malloc(user_context, x);
-    } else {
-        void *orig = malloc(x+40);
-        if (orig == NULL) {
-            // Will result in a failed assertion and a call to halide_error
-            return NULL;
-        }
-        // Round up to next multiple of 32. Should add at least 8 bytes so we can fit the original pointer.
-        void *ptr = (void *)((((size_t)orig + 32) >> 5) << 5);
-        ((void **)ptr)[-1] = orig;
+    }
+
+    int c = halide_allocator_cache_enabled() ? halide_allocator_size_class(x) : -1;
+    if (c < 0) {
+        return halide_allocator_new_block(x, 0);
+    }
+
+    __sync_fetch_and_add(&halide_allocator_cache.stats.allocations, (uint64_t)1);
+
+    halide_allocator_cache_shard *s = halide_allocator_this_shard();
+    halide_allocator_lock(s);
+    void *ptr = s->free_list[c];
+    if (ptr) {
+        s->free_list[c] = *(void **)ptr;
+        s->cached_bytes -= (size_t)1 << (c + CACHE_MIN_CLASS);
+    }
+    halide_allocator_unlock(s);
+
+    if (ptr) {
+        __sync_fetch_and_add(&halide_allocator_cache.stats.hits, (uint64_t)1);
+        __sync_fetch_and_sub(&halide_allocator_cache.stats.cached_bytes,
+                             (uint64_t)1 << (c + CACHE_MIN_CLASS));
         return ptr;
     }
+
+    return halide_allocator_new_block((size_t)1 << (c + CACHE_MIN_CLASS),
+                                      CACHED_BLOCK_MAGIC | c);
 }
 
 WEAK void halide_free(void *user_context, void *ptr) {
     if (halide_custom_free) {
         halide_custom_free(user_context, ptr);
+        return;
+    }
+
+    size_t tag = ((size_t *)ptr)[-2];
+    if ((tag & ~(size_t)0xffff) != CACHED_BLOCK_MAGIC || !halide_allocator_cache.enabled) {
+        free(((void**)ptr)[-1]);
+        return;
+    }
+
+    int c = (int)(tag & 0xffff);
+    size_t bytes = (size_t)1 << (c + CACHE_MIN_CLASS);
+    halide_allocator_cache_shard *s = halide_allocator_this_shard();
+    bool cached = false;
+    halide_allocator_lock(s);
+    if (s->cached_bytes + bytes <= halide_allocator_cache.max_cached_bytes) {
+        *(void **)ptr = s->free_list[c];
+        s->free_list[c] = ptr;
+        s->cached_bytes += bytes;
+        cached = true;
+    }
+    halide_allocator_unlock(s);
+
+    if (cached) {
+        __sync_fetch_and_add(&halide_allocator_cache.stats.cached_bytes, (uint64_t)bytes);
     } else {
         free(((void**)ptr)[-1]);
     }
 }
 
+WEAK void halide_release_allocator_cache() {
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        halide_allocator_cache_shard *s = halide_allocator_cache.shard + i;
+        halide_allocator_lock(s);
+        for (int c = 0; c < CACHE_CLASSES; c++) {
+            void *ptr = s->free_list[c];
+            while (ptr) {
+                void *next = *(void **)ptr;
+                free(((void **)ptr)[-1]);
+                ptr = next;
+            }
+            s->free_list[c] = NULL;
+        }
+        __sync_fetch_and_sub(&halide_allocator_cache.stats.cached_bytes, (uint64_t)s->cached_bytes);
+        s->cached_bytes = 0;
+        halide_allocator_unlock(s);
+    }
+}
+
+WEAK void halide_get_allocator_cache_stats(halide_allocator_cache_stats *stats) {
+    *stats = halide_allocator_cache.stats;
+}
+
 }
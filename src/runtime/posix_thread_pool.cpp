@@ -31,83 +31,179 @@ extern int pthread_join(pthread_t thread, void **retval);
 extern int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr);
 extern int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
 extern int pthread_cond_broadcast(pthread_cond_t *cond);
+extern int pthread_cond_signal(pthread_cond_t *cond);
 extern int pthread_cond_destroy(pthread_cond_t *cond);
 extern int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr);
 extern int pthread_mutex_lock(pthread_mutex_t *mutex);
 extern int pthread_mutex_unlock(pthread_mutex_t *mutex);
 extern int pthread_mutex_destroy(pthread_mutex_t *mutex);
+extern pthread_t pthread_self();
 
 extern char *getenv(const char *);
 extern int atoi(const char *);
+extern void *malloc(size_t);
+extern void free(void *);
+extern void *halide_malloc(void *user_context, size_t);
+extern void halide_free(void *user_context, void *ptr);
 
 extern int halide_printf(void *user_context, const char *, ...);
 
+// Timing of parallel loops, for HL_TIMELINE_FILE (see timeline.cpp).
+struct halide_timeline_job;
+extern halide_timeline_job *halide_timeline_job_begin(void *user_context);
+extern int64_t halide_timeline_task_begin(void *user_context, halide_timeline_job *job);
+extern void halide_timeline_task_end(void *user_context, halide_timeline_job *job,
+                                     int task, int64_t begin_ns);
+extern void halide_timeline_job_end(void *user_context, halide_timeline_job *job, int size);
+
+// For halide_get_runtime_stats (see runtime_stats.cpp).
+struct halide_thread_pool;
+extern void halide_runtime_stats_queue_depth(const halide_thread_pool *pool, int depth);
+
 #ifndef NULL
 #define NULL 0
 #endif
 
+// A job is split into one contiguous range of tasks per worker
+// slot. There are at most MAX_SLOTS slots per job. Pools with more
+// threads than that just share slots. Each thread claims tasks from
+// its own slot first by atomically bumping the slot's counter, and
+// only once that runs dry does it steal tasks from the other slots,
+// so claiming a task never touches the pool's lock.
+struct work_slot {
+    int begin, count;
+    // Number of tasks claimed from this slot so far. May overshoot
+    // count by up to the number of threads.
+    int taken;
+    // Keep each slot on its own cache line.
+    uint8_t padding[64 - 3*sizeof(int)];
+};
+
+#define MAX_SLOTS 64
+
 struct work {
     work *next_job;
     int (*f)(void *, int, uint8_t *);
     void *user_context;
-    int next, max;
     uint8_t *closure;
-    int active_workers;
     int exit_status;
-    bool running() { return next < max || active_workers > 0; }
+    // Non-NULL if the tasks are being timed.
+    halide_timeline_job *timeline;
+    // The fields below are protected by the pool mutex.
+    // Number of threads other than the owner currently running tasks
+    // from this job.
+    int active_workers;
+    // Set once some thread found all slots empty. The job is no
+    // longer on the job stack after this.
+    bool exhausted;
+    int slots;
+    work_slot slot[MAX_SLOTS];
+    bool running() { return !exhausted || active_workers > 0; }
 };
 
-// The work queue and thread pool is weak, so one big work queue is shared by all halide functions
-#define MAX_THREADS 64
-WEAK struct {
+// A set of worker threads and the stack of jobs they work on.
+struct halide_thread_pool {
     // all fields are protected by this mutex.
     pthread_mutex_t mutex;
 
-    // Singly linked list for job stack
+    // Singly linked list for job stack. Only jobs which may still
+    // have unclaimed tasks are on it.
     work *jobs;
+    // The number of jobs on the stack.
+    int queued_jobs;
 
     // Broadcast whenever items are added to the queue or a job completes.
     pthread_cond_t state_change;
-    // Keep track of threads so they can be joined at shutdown
-    pthread_t threads[MAX_THREADS];
+    // Keep track of threads so they can be joined at shutdown or
+    // when the pool shrinks. Worker threads[i] owns slot i+1.
+    pthread_t *threads;
+    int thread_capacity;
+    // The number of worker threads currently running.
+    int workers;
+
+    // The desired number of threads, including the thread that calls
+    // do_par_for. Workers whose index is beyond this exit.
+    int desired_threads;
+
+    // The nice value worker threads should run at. Zero leaves them
+    // alone.
+    int priority;
 
     // Global flag indicating
     bool shutdown;
 
+    bool initialized;
+
+    // How many times an idle thread polls for new work before going
+    // to sleep on state_change, and whether new jobs wake only as many
+    // sleeping threads as they have tasks for, rather than all of
+    // them. Taken from HL_SPIN_COUNT and HL_TARGETED_WAKEUP when the
+    // pool starts, unless set with halide_set_thread_pool_wakeup.
+    int spin_count;
+    bool targeted_wakeup;
+    bool wakeup_configured;
+
+    // The number of threads blocked on state_change.
+    int sleepers;
+
+    // The number of worker threads promised to async producers (see
+    // halide_reserve_worker).
+    int reserved_workers;
+
     bool running() {
         return !shutdown;
     }
+};
 
-} halide_work_queue;
+// The default work queue and thread pool is weak, so one big work
+// queue is shared by all halide functions that don't choose a pool
+// of their own.
+WEAK halide_thread_pool halide_work_queue;
 
-WEAK int halide_threads;
-WEAK bool halide_thread_pool_initialized = false;
+extern void halide_pin_worker_thread(int worker_index);
+extern void halide_set_worker_priority(int priority);
 
-WEAK void halide_shutdown_thread_pool() {
-    if (!halide_thread_pool_initialized) return;
+// What a new worker thread needs to know. Freed by the worker.
+struct worker_args {
+    halide_thread_pool *pool;
+    int home;
+};
+
+// Stop all the threads in a pool and reset it to zero, so that it
+// would be reinitialized by another do_par_for.
+WEAK void halide_shutdown_pool(halide_thread_pool *pool) {
+    if (!pool->initialized) return;
 
     // Wake everyone up and tell them the party's over and it's time
     // to go home
-    pthread_mutex_lock(&halide_work_queue.mutex);
-    halide_work_queue.shutdown = true;
-    pthread_cond_broadcast(&halide_work_queue.state_change);
-    pthread_mutex_unlock(&halide_work_queue.mutex);
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->state_change);
+    pthread_mutex_unlock(&pool->mutex);
 
     // Wait until they leave
-    for (int i = 0; i < halide_threads-1; i++) {
+    for (int i = 0; i < pool->workers; i++) {
         //fprintf(stderr, "Waiting for thread %d to exit\n", i);
         void *retval;
-        pthread_join(halide_work_queue.threads[i], &retval);
+        pthread_join(pool->threads[i], &retval);
     }
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->thread_capacity = 0;
+    pool->workers = 0;
 
     //fprintf(stderr, "All threads have quit. Destroying mutex and condition variable.\n");
     // Tidy up
-    pthread_mutex_destroy(&halide_work_queue.mutex);
+    pthread_mutex_destroy(&pool->mutex);
     // Reset it to zero in case we call another do_par_for
     pthread_mutex_t uninitialized_mutex = {0};
-    halide_work_queue.mutex = uninitialized_mutex;
-    pthread_cond_destroy(&halide_work_queue.state_change);
-    halide_thread_pool_initialized = false;
+    pool->mutex = uninitialized_mutex;
+    pthread_cond_destroy(&pool->state_change);
+    pool->initialized = false;
+}
+
+WEAK void halide_shutdown_thread_pool() {
+    halide_shutdown_pool(&halide_work_queue);
 }
 
 typedef int (*halide_task)(void *user_context, int, uint8_t *);
@@ -124,6 +220,28 @@ WEAK void halide_set_custom_do_par_for(int (*f)(void *, halide_task, int, int, u
     halide_custom_do_par_for = f;
 }
 
+WEAK size_t halide_current_thread_id() {
+    return (size_t)pthread_self();
+}
+
+// Start a thread of its own, outside of any pool, for work that runs
+// in the background (see write_debug_image.cpp). Returns NULL if the
+// thread couldn't be started.
+WEAK void *halide_spawn_thread(void *(*f)(void *), void *closure) {
+    pthread_t *thread = (pthread_t *)malloc(sizeof(pthread_t));
+    if (thread && pthread_create(thread, NULL, f, closure) != 0) {
+        free(thread);
+        thread = NULL;
+    }
+    return thread;
+}
+
+WEAK void halide_join_thread(void *thread) {
+    void *retval;
+    pthread_join(*(pthread_t *)thread, &retval);
+    free(thread);
+}
+
 WEAK int halide_do_task(void *user_context, halide_task f, int idx,
                         uint8_t *closure) {
     if (halide_custom_do_task) {
@@ -133,53 +251,112 @@ WEAK int halide_do_task(void *user_context, halide_task f, int idx,
     }
 }
 
-WEAK void *halide_worker_thread(void *void_arg) {
-    work *owned_job = (work *)void_arg;
+// Run tasks from a job until none are left to claim, starting with
+// the slot whose index is home. Does not touch the pool lock.
+WEAK void halide_run_job_tasks(work *job, int home) {
+    for (int i = 0; i < job->slots; i++) {
+        work_slot *s = job->slot + (home + i) % job->slots;
+        while (true) {
+            int t = __sync_fetch_and_add(&s->taken, 1);
+            if (t >= s->count) break;
+            int64_t begin = halide_timeline_task_begin(job->user_context, job->timeline);
+            int result = halide_do_task(job->user_context, job->f, s->begin + t,
+                                        job->closure);
+            halide_timeline_task_end(job->user_context, job->timeline, s->begin + t, begin);
+            // If this task failed, set the exit status on the job,
+            // and give up on the tasks nobody has claimed yet, so a
+            // failed or cancelled pipeline stops using the pool.
+            if (result) {
+                job->exit_status = result;
+                for (int j = 0; j < job->slots; j++) {
+                    __sync_lock_test_and_set(&job->slot[j].taken, job->slot[j].count);
+                }
+            }
+        }
+    }
+}
 
+// Mark a job as having no more tasks to claim, and take it off the
+// job stack. Must be called with the lock held.
+WEAK void halide_retire_job(halide_thread_pool *pool, work *job) {
+    if (job->exhausted) return;
+    job->exhausted = true;
+    work **p = &pool->jobs;
+    while (*p && *p != job) {
+        p = &((*p)->next_job);
+    }
+    if (*p) {
+        *p = job->next_job;
+        pool->queued_jobs--;
+    }
+}
+
+// Poll without the lock until there is a job to work on, the owned
+// job completes, this thread should exit, or we give up. The reads
+// are racy, so the caller must check again with the lock held.
+WEAK void halide_spin_for_work(halide_thread_pool *pool, work *owned_job,
+                               int home, int spin_count) {
+    volatile halide_thread_pool *p = pool;
+    volatile work *j = owned_job;
+    for (int i = 0; i < spin_count; i++) {
+        if (p->jobs != NULL || p->shutdown) return;
+        if (j ? (j->exhausted && j->active_workers == 0)
+            : (home >= p->desired_threads)) return;
+    }
+}
+
+WEAK void halide_worker_thread_loop(halide_thread_pool *pool, work *owned_job, int home) {
     // Grab the lock
-    pthread_mutex_lock(&halide_work_queue.mutex);
+    pthread_mutex_lock(&pool->mutex);
+
+    // Whether we already polled for work since last finding some.
+    bool spun = false;
 
     // If I'm a job owner, then I was the thread that called
     // do_par_for, and I should only stay in this function until my
     // job is complete. If I'm a lowly worker thread, I should stay in
     // this function as long as the work queue is running.
     while (owned_job != NULL ? owned_job->running()
-           : halide_work_queue.running()) {
+           : (pool->running() && home < pool->desired_threads)) {
 
-        if (halide_work_queue.jobs == NULL) {
+        if (pool->jobs == NULL) {
             // There are no jobs pending, though some tasks may still
-            // be in flight from the last job. Release the lock and
-            // wait for something new to happen.
-            pthread_cond_wait(&halide_work_queue.state_change, &halide_work_queue.mutex);
+            // be in flight from the last job. Poll for a while in
+            // case something new shows up soon, which is much
+            // cheaper than sleeping and being woken up. If nothing
+            // does, release the lock and wait for something new to
+            // happen.
+            if (!spun && pool->spin_count > 0) {
+                int spin_count = pool->spin_count;
+                pthread_mutex_unlock(&pool->mutex);
+                halide_spin_for_work(pool, owned_job, home, spin_count);
+                pthread_mutex_lock(&pool->mutex);
+                spun = true;
+            } else {
+                pool->sleepers++;
+                pthread_cond_wait(&pool->state_change, &pool->mutex);
+                pool->sleepers--;
+                spun = false;
+            }
         } else {
-            // There are jobs still to do. Grab the next one.
-            work *job = halide_work_queue.jobs;
-
-            // Claim a task from it.
-            work myjob = *job;
-            job->next++;
+            spun = false;
 
-            // If there were no more tasks pending for this job, or if
-            // it has failed, remove it from the stack.
-            if (job->next == job->max) {
-                halide_work_queue.jobs = job->next_job;
-            }
+            // There are jobs still to do. Grab the most recent one.
+            work *job = pool->jobs;
 
-            // Increment the active_worker count so that other threads
-            // are aware that this job is still in progress even
-            // though there are no outstanding tasks for it.
+            // Increment the active_worker count so that the owner
+            // doesn't return while we still hold a pointer to this
+            // job.
             job->active_workers++;
 
-            // Release the lock and do the task.
-            pthread_mutex_unlock(&halide_work_queue.mutex);
-            int result = halide_do_task(myjob.user_context, myjob.f, myjob.next,
-                                        myjob.closure);
-            pthread_mutex_lock(&halide_work_queue.mutex);
+            // Release the lock and claim tasks until there are none left.
+            pthread_mutex_unlock(&pool->mutex);
+            halide_run_job_tasks(job, home);
+            pthread_mutex_lock(&pool->mutex);
 
-            // If this task failed, set the exit status on the job.
-            if (result) {
-                job->exit_status = result;
-            }
+            // Every slot was empty, so nobody else needs to look at
+            // this job.
+            halide_retire_job(pool, job);
 
             // We are no longer active on this job
             job->active_workers--;
@@ -187,76 +364,404 @@ WEAK void *halide_worker_thread(void *void_arg) {
             // If the job is done and I'm not the owner of it, wake up
             // the owner.
             if (!job->running() && job != owned_job) {
-                pthread_cond_broadcast(&halide_work_queue.state_change);
+                pthread_cond_broadcast(&pool->state_change);
             }
         }
     }
-    pthread_mutex_unlock(&halide_work_queue.mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+WEAK void *halide_worker_thread(void *void_arg) {
+    // Worker threads own slot index (thread number + 1). The thread
+    // that calls do_par_for owns slot zero.
+    worker_args args = *(worker_args *)void_arg;
+    free(void_arg);
+    halide_pin_worker_thread(args.home);
+    if (args.pool->priority) {
+        halide_set_worker_priority(args.pool->priority);
+    }
+    halide_worker_thread_loop(args.pool, NULL, args.home);
     return NULL;
 }
 
 extern int halide_host_cpu_count();
 
+// Start worker threads until there are enough to make up
+// desired_threads. Must be called with the lock held.
+WEAK void halide_spawn_workers(halide_thread_pool *pool) {
+    int wanted = pool->desired_threads - 1;
+    if (wanted > pool->thread_capacity) {
+        int capacity = wanted * 2;
+        pthread_t *threads = (pthread_t *)malloc(capacity * sizeof(pthread_t));
+        for (int i = 0; i < pool->workers; i++) {
+            threads[i] = pool->threads[i];
+        }
+        free(pool->threads);
+        pool->threads = threads;
+        pool->thread_capacity = capacity;
+    }
+    while (pool->workers < wanted) {
+        int i = pool->workers++;
+        //fprintf(stderr, "Creating thread %d\n", i);
+        worker_args *args = (worker_args *)malloc(sizeof(worker_args));
+        args->pool = pool;
+        args->home = i+1;
+        pthread_create(pool->threads + i, NULL, halide_worker_thread, args);
+    }
+}
+
+// Must be called with the lock held.
+WEAK void halide_init_thread_pool(halide_thread_pool *pool, int threads) {
+    pool->shutdown = false;
+    pthread_cond_init(&pool->state_change, NULL);
+    pool->jobs = NULL;
+    pool->queued_jobs = 0;
+    pool->workers = 0;
+    pool->sleepers = 0;
+    pool->reserved_workers = 0;
+
+    if (!pool->wakeup_configured) {
+        char *spin_str = getenv("HL_SPIN_COUNT");
+        pool->spin_count = spin_str ? atoi(spin_str) : 2000;
+        char *targeted_str = getenv("HL_TARGETED_WAKEUP");
+        pool->targeted_wakeup = targeted_str ? (atoi(targeted_str) != 0) : true;
+    }
+
+    if (threads <= 0) {
+        char *threadStr = getenv("HL_NUMTHREADS");
+        if (threadStr) {
+            threads = atoi(threadStr);
+        } else {
+            threads = halide_host_cpu_count();
+            // halide_printf(user_context, "HL_NUMTHREADS not defined. Defaulting to %d threads.\n", threads);
+        }
+    }
+    pool->desired_threads = threads < 1 ? 1 : threads;
+    halide_spawn_workers(pool);
+
+    pool->initialized = true;
+}
+
+WEAK int halide_resize_pool(halide_thread_pool *pool, int n) {
+    pthread_mutex_lock(&pool->mutex);
+    int old = pool->initialized ? pool->desired_threads : 0;
+    if (!pool->initialized) {
+        halide_init_thread_pool(pool, n);
+    } else {
+        if (n <= 0) {
+            n = halide_host_cpu_count();
+        }
+        pool->desired_threads = n < 1 ? 1 : n;
+        if (pool->desired_threads - 1 > pool->workers) {
+            halide_spawn_workers(pool);
+        } else {
+            // Wake everyone up so the surplus workers notice they
+            // should leave, then wait for them. Workers finish any
+            // job they're in the middle of first.
+            int first = pool->desired_threads - 1, last = pool->workers;
+            pthread_cond_broadcast(&pool->state_change);
+            pthread_mutex_unlock(&pool->mutex);
+            for (int i = first; i < last; i++) {
+                void *retval;
+                pthread_join(pool->threads[i], &retval);
+            }
+            pthread_mutex_lock(&pool->mutex);
+            pool->workers = first;
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return old;
+}
+
+WEAK int halide_set_num_threads(int n) {
+    return halide_resize_pool(&halide_work_queue, n);
+}
+
+WEAK halide_thread_pool *halide_create_thread_pool(int num_threads, int priority) {
+    halide_thread_pool *pool = (halide_thread_pool *)malloc(sizeof(halide_thread_pool));
+    // Zero it so that the mutex is treated as uninitialized (see
+    // the comment in halide_do_par_for).
+    uint8_t *bytes = (uint8_t *)pool;
+    for (size_t i = 0; i < sizeof(halide_thread_pool); i++) {
+        bytes[i] = 0;
+    }
+    pool->threads = NULL;
+    pool->priority = priority;
+    halide_resize_pool(pool, num_threads);
+    return pool;
+}
+
+WEAK void halide_set_thread_pool_wakeup(halide_thread_pool *pool,
+                                        int spin_count, int targeted_wakeup) {
+    if (pool == NULL) pool = &halide_work_queue;
+    pthread_mutex_lock(&pool->mutex);
+    pool->spin_count = spin_count < 0 ? 0 : spin_count;
+    pool->targeted_wakeup = targeted_wakeup != 0;
+    pool->wakeup_configured = true;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+// The binding from user_context values to thread pools. There are
+// rarely more than a handful of these, so a small table scanned
+// linearly does fine.
+#define MAX_POOL_BINDINGS 16
+WEAK struct {
+    pthread_mutex_t mutex;
+    int count;
+    void *user_context[MAX_POOL_BINDINGS];
+    halide_thread_pool *pool[MAX_POOL_BINDINGS];
+} halide_thread_pool_bindings;
+
+WEAK int halide_set_thread_pool(void *user_context, halide_thread_pool *pool) {
+    int result = 0;
+    pthread_mutex_lock(&halide_thread_pool_bindings.mutex);
+    int i = 0;
+    while (i < halide_thread_pool_bindings.count &&
+           halide_thread_pool_bindings.user_context[i] != user_context) {
+        i++;
+    }
+    if (pool == NULL) {
+        // Remove the binding by moving the last one into its place.
+        if (i < halide_thread_pool_bindings.count) {
+            int last = --halide_thread_pool_bindings.count;
+            halide_thread_pool_bindings.user_context[i] = halide_thread_pool_bindings.user_context[last];
+            halide_thread_pool_bindings.pool[i] = halide_thread_pool_bindings.pool[last];
+        }
+    } else if (i < MAX_POOL_BINDINGS) {
+        halide_thread_pool_bindings.user_context[i] = user_context;
+        halide_thread_pool_bindings.pool[i] = pool;
+        if (i == halide_thread_pool_bindings.count) {
+            halide_thread_pool_bindings.count++;
+        }
+    } else {
+        result = -1;
+    }
+    pthread_mutex_unlock(&halide_thread_pool_bindings.mutex);
+    return result;
+}
+
+WEAK void halide_destroy_thread_pool(halide_thread_pool *pool) {
+    // Forget any user_contexts bound to this pool
+    pthread_mutex_lock(&halide_thread_pool_bindings.mutex);
+    for (int i = halide_thread_pool_bindings.count - 1; i >= 0; i--) {
+        if (halide_thread_pool_bindings.pool[i] == pool) {
+            int last = --halide_thread_pool_bindings.count;
+            halide_thread_pool_bindings.user_context[i] = halide_thread_pool_bindings.user_context[last];
+            halide_thread_pool_bindings.pool[i] = halide_thread_pool_bindings.pool[last];
+        }
+    }
+    pthread_mutex_unlock(&halide_thread_pool_bindings.mutex);
+
+    halide_shutdown_pool(pool);
+    free(pool);
+}
+
+WEAK halide_thread_pool *halide_pool_for_context(void *user_context) {
+    // Don't take the lock in the common case where no pools have
+    // been bound.
+    if (halide_thread_pool_bindings.count == 0) {
+        return &halide_work_queue;
+    }
+    // user_contexts without a pool of their own use the one bound to
+    // NULL, if there is one.
+    halide_thread_pool *pool = &halide_work_queue;
+    pthread_mutex_lock(&halide_thread_pool_bindings.mutex);
+    for (int i = 0; i < halide_thread_pool_bindings.count; i++) {
+        if (halide_thread_pool_bindings.user_context[i] == user_context) {
+            pool = halide_thread_pool_bindings.pool[i];
+            break;
+        } else if (halide_thread_pool_bindings.user_context[i] == NULL) {
+            pool = halide_thread_pool_bindings.pool[i];
+        }
+    }
+    pthread_mutex_unlock(&halide_thread_pool_bindings.mutex);
+    return pool;
+}
+
+WEAK int halide_get_num_threads(void *user_context) {
+    halide_thread_pool *pool = halide_pool_for_context(user_context);
+    // A racy read, but the answer is only a hint.
+    if (pool->initialized) {
+        return pool->desired_threads;
+    }
+    // The number of threads the pool will start with.
+    char *threadStr = getenv("HL_NUMTHREADS");
+    int threads = threadStr ? atoi(threadStr) : halide_host_cpu_count();
+    return threads < 1 ? 1 : threads;
+}
+
+// An async producer and its consumer wait on each other, so they
+// must run on two threads at once. The thread that calls
+// halide_do_par_for runs one of them, and this promises a worker for
+// the other, so that concurrent pipelines can't tie up every thread
+// in half of a pair. Zero if every worker is already promised, in
+// which case the producer runs in lockstep with its consumer.
+WEAK int halide_reserve_worker(void *user_context) {
+    if (halide_custom_do_par_for) return 0;
+    halide_thread_pool *pool = halide_pool_for_context(user_context);
+    pthread_mutex_lock(&pool->mutex);
+    if (!pool->initialized) {
+        halide_init_thread_pool(pool, 0);
+    }
+    int result = 0;
+    if (pool->reserved_workers < pool->desired_threads - 1) {
+        pool->reserved_workers++;
+        result = 1;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return result;
+}
+
+WEAK int halide_release_worker(void *user_context, int reserved) {
+    if (!reserved) return 0;
+    halide_thread_pool *pool = halide_pool_for_context(user_context);
+    pthread_mutex_lock(&pool->mutex);
+    pool->reserved_workers--;
+    pthread_mutex_unlock(&pool->mutex);
+    return 0;
+}
+
+// Counting semaphores, used to keep the producer of a folded buffer
+// a bounded distance ahead of its consumer (see Func::async). A task
+// that fails abandons them, after which acquiring one fails at once
+// instead of waiting for a release that will never come.
+struct halide_semaphore {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int count;
+    bool abandoned;
+};
+
+WEAK halide_semaphore *halide_make_semaphore(void *user_context, int count) {
+    halide_semaphore *sem = (halide_semaphore *)halide_malloc(user_context, sizeof(halide_semaphore));
+    if (!sem) return NULL;
+    pthread_mutex_init(&sem->mutex, NULL);
+    pthread_cond_init(&sem->cond, NULL);
+    sem->count = count;
+    sem->abandoned = false;
+    return sem;
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore *sem) {
+    pthread_mutex_lock(&sem->mutex);
+    while (sem->count == 0 && !sem->abandoned) {
+        pthread_cond_wait(&sem->cond, &sem->mutex);
+    }
+    int result = -1;
+    if (!sem->abandoned) {
+        sem->count--;
+        result = 0;
+    }
+    pthread_mutex_unlock(&sem->mutex);
+    return result;
+}
+
+WEAK int halide_semaphore_abandon(halide_semaphore *sem) {
+    pthread_mutex_lock(&sem->mutex);
+    sem->abandoned = true;
+    pthread_cond_broadcast(&sem->cond);
+    pthread_mutex_unlock(&sem->mutex);
+    return 0;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore *sem) {
+    pthread_mutex_lock(&sem->mutex);
+    sem->count++;
+    pthread_cond_signal(&sem->cond);
+    pthread_mutex_unlock(&sem->mutex);
+    return 0;
+}
+
+WEAK int halide_free_semaphore(void *user_context, halide_semaphore *sem) {
+    if (!sem) return 0;
+    pthread_cond_destroy(&sem->cond);
+    pthread_mutex_destroy(&sem->mutex);
+    halide_free(user_context, sem);
+    return 0;
+}
+
 WEAK int halide_do_par_for(void *user_context, int (*f)(void *, int, uint8_t *),
                            int min, int size, uint8_t *closure) {
     if (halide_custom_do_par_for) {
         return (*halide_custom_do_par_for)(user_context, f, min, size, closure);
     }
 
+    halide_thread_pool *pool = halide_pool_for_context(user_context);
+    halide_timeline_job *timeline = halide_timeline_job_begin(user_context);
+
     // Grab the lock. If it hasn't been initialized yet, then the
     // field will be zero-initialized because it's a static
     // global. pthreads helpfully interprets zero-valued mutex objects
     // as uninitialized and initializes them for you (see PTHREAD_MUTEX_INITIALIZER).
-    pthread_mutex_lock(&halide_work_queue.mutex);
-
-    if (!halide_thread_pool_initialized) {
-        halide_work_queue.shutdown = false;
-        pthread_cond_init(&halide_work_queue.state_change, NULL);
-        halide_work_queue.jobs = NULL;
+    pthread_mutex_lock(&pool->mutex);
 
-        char *threadStr = getenv("HL_NUMTHREADS");
-        if (threadStr) {
-            halide_threads = atoi(threadStr);
-        } else {
-            halide_threads = halide_host_cpu_count();
-            // halide_printf(user_context, "HL_NUMTHREADS not defined. Defaulting to %d threads.\n", halide_threads);
-        }
-        if (halide_threads > MAX_THREADS) {
-            halide_threads = MAX_THREADS;
-        } else if (halide_threads < 1) {
-            halide_threads = 1;
-        }
-        for (int i = 0; i < halide_threads-1; i++) {
-            //fprintf(stderr, "Creating thread %d\n", i);
-            pthread_create(halide_work_queue.threads + i, NULL, halide_worker_thread, NULL);
-        }
-
-        halide_thread_pool_initialized = true;
+    if (!pool->initialized) {
+        halide_init_thread_pool(pool, 0);
     }
 
     // Make the job.
     work job;
     job.f = f;               // The job should call this function. It takes an index and a closure.
     job.user_context = user_context;
-    job.next = min;          // Start at this index.
-    job.max  = min + size;   // Keep going until one less than this index.
     job.closure = closure;   // Use this closure.
     job.exit_status = 0;     // The job hasn't failed yet
     job.active_workers = 0;  // Nobody is working on this yet
+    job.exhausted = false;
+    job.timeline = timeline;
+
+    // Deal the tasks out evenly across one slot per thread.
+    job.slots = pool->desired_threads < size ? pool->desired_threads : size;
+    if (job.slots > MAX_SLOTS) job.slots = MAX_SLOTS;
+    if (job.slots < 1) job.slots = 1;
+    int per_slot = size / job.slots, leftover = size % job.slots;
+    int next = min;
+    for (int i = 0; i < job.slots; i++) {
+        job.slot[i].begin = next;
+        job.slot[i].count = per_slot + (i < leftover ? 1 : 0);
+        job.slot[i].taken = 0;
+        next += job.slot[i].count;
+    }
 
     // Push the job onto the stack.
-    job.next_job = halide_work_queue.jobs;
-    halide_work_queue.jobs = &job;
-    pthread_mutex_unlock(&halide_work_queue.mutex);
+    job.next_job = pool->jobs;
+    pool->jobs = &job;
+    int depth = ++pool->queued_jobs;
+
+    // Work out how many sleeping threads to wake up. Threads
+    // still polling for work will find the job on their own, and
+    // this thread takes one task itself.
+    int wake = pool->sleepers;
+    if (pool->targeted_wakeup && size - 1 < wake) {
+        wake = size - 1;
+    }
+    bool wake_all = !pool->targeted_wakeup || wake == pool->sleepers;
+    pthread_mutex_unlock(&pool->mutex);
+
+    halide_runtime_stats_queue_depth(pool, depth);
+
+    // Wake up idle worker threads.
+    if (wake_all) {
+        if (wake > 0) pthread_cond_broadcast(&pool->state_change);
+    } else {
+        for (int i = 0; i < wake; i++) {
+            pthread_cond_signal(&pool->state_change);
+        }
+    }
 
-    // Wake up any idle worker threads.
-    pthread_cond_broadcast(&halide_work_queue.state_change);
+    // Do some work myself, starting from my own slot.
+    halide_run_job_tasks(&job, 0);
 
-    // Do some work myself.
-    halide_worker_thread((void *)(&job));
+    // Wait for the stragglers, helping out with other jobs in the
+    // meantime.
+    pthread_mutex_lock(&pool->mutex);
+    halide_retire_job(pool, &job);
+    pthread_mutex_unlock(&pool->mutex);
+    halide_worker_thread_loop(pool, &job, 0);
+    halide_timeline_job_end(user_context, timeline, size);
 
     // Return zero if the job succeeded, otherwise return the exit
-    // status of one of the failing jobs (whichever one failed last).
+    // status of one of the failing jobs (whichever one failed last),
+    // after which no new tasks were started.
     return job.exit_status;
 }
 
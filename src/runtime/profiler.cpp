@@ -0,0 +1,628 @@
+#include "mini_stdint.h"
+#include "HalideRuntime.h"
+
+#define WEAK __attribute__((weak))
+#ifndef NULL
+#define NULL 0
+#endif
+
+extern "C" {
+
+typedef long pthread_t;
+extern int pthread_create(pthread_t *thread, const void *attr,
+                          void *(*start_routine)(void *), void *arg);
+extern int pthread_join(pthread_t thread, void **retval);
+extern int usleep(unsigned int);
+extern char *getenv(const char *);
+extern int atoi(const char *);
+extern void *malloc(size_t);
+extern void free(void *);
+extern int strcmp(const char *, const char *);
+extern int halide_start_clock(void *user_context);
+extern int64_t halide_current_time_ns(void *user_context);
+extern size_t halide_current_thread_id();
+extern bool halide_perf_counters_open(int *fds);
+extern bool halide_perf_counters_read(const int *fds, uint64_t *values);
+extern void halide_perf_counters_close(const int *fds);
+
+// The sampling profiler. Each running pipeline has a slot per thread
+// working on it, holding the id of the Func that thread is computing,
+// which the generated code updates as it enters and leaves each
+// produce and update step. A background thread wakes up every
+// interval and charges the time since it last woke to the Funcs in
+// the slots, split between the threads that were busy. Nothing in
+// the generated code waits on a lock or reads a clock, so the
+// pipeline runs at close to full speed. The totals are printed, in
+// the format read by util/HalideProf, by halide_profiler_report.
+//
+// With HL_PROFILE_COUNTERS=1, each thread also reads its hardware
+// counters whenever it changes the Func in its slot, and charges
+// what they counted since its last change to the Func it was in.
+// That does cost a system call at every produce and update step.
+
+// A slot that isn't held by any thread.
+#define PROFILER_SLOT_FREE -2
+// A slot whose thread is waiting on other threads, e.g. for the
+// tasks of a parallel loop.
+#define PROFILER_SLOT_IDLE -1
+
+// The most threads that can work on one pipeline at once. Threads
+// beyond that share a slot that isn't sampled.
+#define MAX_PROFILER_SLOTS 64
+
+// The most buffer names remembered per pipeline, for looking up which
+// Func an allocation belongs to.
+#define PROFILER_NAME_CACHE 64
+
+// The hardware counters read with HL_PROFILE_COUNTERS, and the names
+// they are reported under.
+#define PROFILER_COUNTERS 3
+WEAK const char *halide_profiler_counter_names[PROFILER_COUNTERS] = {
+    "cycles", "instructions", "llc_misses"
+};
+
+// The most threads whose hardware counters are read.
+#define MAX_PROFILER_THREADS 256
+
+// The hardware counters of one thread, and their values when it last
+// changed Func. Only that thread touches them once it has claimed the
+// entry.
+struct halide_profiler_thread {
+    volatile size_t id;
+    bool opened;
+    int fds[PROFILER_COUNTERS];
+    uint64_t last[PROFILER_COUNTERS];
+};
+
+// The totals for each compiled pipeline.
+struct halide_profiler_pipeline {
+    const char *name;
+    // The name of each Func id, as "produce f" or "update f",
+    // separated by newlines.
+    const char *func_names;
+    int num_funcs;
+    uint64_t *func_nsec;
+    uint64_t *func_count;
+    uint64_t runs;
+    uint64_t wall_nsec;
+    // The number of samples taken while the pipeline ran, and the
+    // sum over them of the number of busy threads.
+    uint64_t samples;
+    uint64_t busy_thread_samples;
+    // The allocations made for each Func, and for the whole pipeline.
+    halide_profiler_memory_stats *func_memory;
+    halide_profiler_memory_stats memory;
+    // The hardware counts charged to each Func, PROFILER_COUNTERS
+    // per Func, if HL_PROFILE_COUNTERS is set.
+    uint64_t *func_counters;
+    // The Func ids of the buffer names seen so far, keyed on the
+    // address of the name in the generated code.
+    const char *volatile cached_name[PROFILER_NAME_CACHE];
+    int cached_func[PROFILER_NAME_CACHE];
+    halide_profiler_pipeline *next;
+};
+
+// One run of a pipeline.
+struct halide_profiler_instance {
+    halide_profiler_pipeline *pipeline;
+    int64_t start_nsec;
+    volatile int slot[MAX_PROFILER_SLOTS + 1];
+    halide_profiler_instance *next;
+};
+
+WEAK struct {
+    int lock;
+    halide_profiler_pipeline *pipelines;
+    halide_profiler_instance *running;
+    halide_profiler_instance *free_instances;
+    bool started;
+    volatile bool shutdown;
+    pthread_t sampler;
+    int interval_us;
+    bool counters;
+    halide_profiler_thread threads[MAX_PROFILER_THREADS];
+} halide_profiler = {0};
+
+WEAK void halide_profiler_lock() {
+    while (__sync_lock_test_and_set(&halide_profiler.lock, 1)) {
+        while (*(volatile int *)&halide_profiler.lock) {}
+    }
+}
+
+WEAK void halide_profiler_unlock() {
+    __sync_lock_release(&halide_profiler.lock);
+}
+
+WEAK void *halide_profiler_sampler(void *arg) {
+    int64_t last = halide_current_time_ns(NULL);
+    while (!halide_profiler.shutdown) {
+        usleep(halide_profiler.interval_us);
+        int64_t now = halide_current_time_ns(NULL);
+        uint64_t dt = (uint64_t)(now - last);
+        last = now;
+
+        halide_profiler_lock();
+        for (halide_profiler_instance *i = halide_profiler.running; i; i = i->next) {
+            halide_profiler_pipeline *p = i->pipeline;
+            int busy = 0;
+            for (int s = 0; s < MAX_PROFILER_SLOTS; s++) {
+                if (i->slot[s] >= 0) busy++;
+            }
+            p->samples++;
+            p->busy_thread_samples += busy;
+            if (!busy) continue;
+            for (int s = 0; s < MAX_PROFILER_SLOTS; s++) {
+                int f = i->slot[s];
+                if (f >= 0 && f < p->num_funcs) {
+                    p->func_nsec[f] += dt / busy;
+                }
+            }
+        }
+        halide_profiler_unlock();
+    }
+    return NULL;
+}
+
+WEAK void halide_profiler_clear_memory_stats(halide_profiler_memory_stats *m) {
+    m->heap_allocs = m->heap_bytes = m->heap_current = m->heap_peak = 0;
+    m->stack_allocs = m->stack_peak = 0;
+}
+
+// Copy the name of the next Func out of a list of them, and return
+// the rest of the list.
+WEAK const char *halide_profiler_next_func_name(const char *names, char *name, int max_len) {
+    int len = 0;
+    while (*names && *names != '\n') {
+        if (len < max_len - 1) name[len++] = *names;
+        names++;
+    }
+    if (*names) names++;
+    name[len] = 0;
+    return names;
+}
+
+WEAK halide_profiler_pipeline *halide_profiler_find_pipeline(const char *name, int num_funcs,
+                                                             const char *func_names) {
+    for (halide_profiler_pipeline *p = halide_profiler.pipelines; p; p = p->next) {
+        // Recompiling a pipeline makes new copies of its strings.
+        if (p->num_funcs == num_funcs &&
+            (p->name == name || !strcmp(p->name, name)) &&
+            (p->func_names == func_names || !strcmp(p->func_names, func_names))) {
+            return p;
+        }
+    }
+    halide_profiler_pipeline *p = (halide_profiler_pipeline *)malloc(sizeof(halide_profiler_pipeline));
+    if (!p) return NULL;
+    p->name = name;
+    p->func_names = func_names;
+    p->num_funcs = num_funcs;
+    p->func_nsec = (uint64_t *)malloc(num_funcs * sizeof(uint64_t));
+    p->func_count = (uint64_t *)malloc(num_funcs * sizeof(uint64_t));
+    p->func_memory = (halide_profiler_memory_stats *)malloc(num_funcs * sizeof(halide_profiler_memory_stats));
+    p->func_counters = (uint64_t *)malloc(num_funcs * PROFILER_COUNTERS * sizeof(uint64_t));
+    if (!p->func_nsec || !p->func_count || !p->func_memory || !p->func_counters) {
+        free(p->func_nsec);
+        free(p->func_count);
+        free(p->func_memory);
+        free(p->func_counters);
+        free(p);
+        return NULL;
+    }
+    for (int i = 0; i < num_funcs; i++) {
+        p->func_nsec[i] = p->func_count[i] = 0;
+        halide_profiler_clear_memory_stats(&p->func_memory[i]);
+    }
+    for (int i = 0; i < num_funcs * PROFILER_COUNTERS; i++) {
+        p->func_counters[i] = 0;
+    }
+    halide_profiler_clear_memory_stats(&p->memory);
+    for (int i = 0; i < PROFILER_NAME_CACHE; i++) {
+        p->cached_name[i] = NULL;
+    }
+    p->runs = p->wall_nsec = 0;
+    p->samples = p->busy_thread_samples = 0;
+    p->next = halide_profiler.pipelines;
+    halide_profiler.pipelines = p;
+    return p;
+}
+
+// Used by runs that can't be profiled, e.g. because malloc
+// failed. None of its slots are sampled.
+WEAK halide_profiler_instance halide_profiler_unsampled_instance;
+
+// Get the counters of the calling thread, opening them the first
+// time. Returns NULL if they can't be read.
+WEAK halide_profiler_thread *halide_profiler_this_thread() {
+    size_t id = halide_current_thread_id();
+    unsigned h = (unsigned)((id >> 4) % MAX_PROFILER_THREADS);
+    for (int i = 0; i < MAX_PROFILER_THREADS; i++) {
+        halide_profiler_thread *t = &halide_profiler.threads[(h + i) % MAX_PROFILER_THREADS];
+        if (t->id == id) {
+            return t->opened ? t : NULL;
+        }
+        if (t->id == 0 && __sync_bool_compare_and_swap(&t->id, (size_t)0, id)) {
+            t->opened = halide_perf_counters_open(t->fds) &&
+                halide_perf_counters_read(t->fds, t->last);
+            return t->opened ? t : NULL;
+        }
+    }
+    return NULL;
+}
+
+// Charge what the calling thread's counters counted since it last
+// changed Func to the Func it was in (nothing if func is negative),
+// and start counting again.
+WEAK void halide_profiler_count(halide_profiler_instance *i, int func) {
+    if (!halide_profiler.counters || i == &halide_profiler_unsampled_instance) return;
+    halide_profiler_thread *t = halide_profiler_this_thread();
+    uint64_t now[PROFILER_COUNTERS];
+    if (!t || !halide_perf_counters_read(t->fds, now)) return;
+    halide_profiler_pipeline *p = i->pipeline;
+    if (func >= 0 && func < p->num_funcs) {
+        uint64_t *counters = p->func_counters + func * PROFILER_COUNTERS;
+        for (int c = 0; c < PROFILER_COUNTERS; c++) {
+            __sync_fetch_and_add(&counters[c], now[c] - t->last[c]);
+        }
+    }
+    for (int c = 0; c < PROFILER_COUNTERS; c++) {
+        t->last[c] = now[c];
+    }
+}
+
+// Called at the start of each run of a pipeline. The calling thread
+// holds slot 0 of the instance returned, with Func id 0 in it.
+WEAK void *halide_profiler_pipeline_start(void *user_context, const char *name,
+                                          int num_funcs, const char *func_names) {
+    halide_start_clock(user_context);
+    halide_profiler_lock();
+    if (!halide_profiler.started) {
+        char *interval_str = getenv("HL_PROFILE_INTERVAL_US");
+        halide_profiler.interval_us = interval_str ? atoi(interval_str) : 0;
+        if (halide_profiler.interval_us <= 0) {
+            halide_profiler.interval_us = 1000;
+        }
+        char *counters_str = getenv("HL_PROFILE_COUNTERS");
+        halide_profiler.counters = counters_str && atoi(counters_str) != 0;
+        halide_profiler.shutdown = false;
+        halide_profiler.started =
+            (pthread_create(&halide_profiler.sampler, NULL, halide_profiler_sampler, NULL) == 0);
+    }
+
+    halide_profiler_pipeline *p = halide_profiler_find_pipeline(name, num_funcs, func_names);
+    halide_profiler_instance *i = halide_profiler.free_instances;
+    if (i) {
+        halide_profiler.free_instances = i->next;
+    } else {
+        i = (halide_profiler_instance *)malloc(sizeof(halide_profiler_instance));
+    }
+    if (!p || !i) {
+        if (i) free(i);
+        halide_profiler_unlock();
+        return &halide_profiler_unsampled_instance;
+    }
+    i->pipeline = p;
+    i->slot[0] = 0;
+    for (int s = 1; s <= MAX_PROFILER_SLOTS; s++) {
+        i->slot[s] = PROFILER_SLOT_FREE;
+    }
+    i->start_nsec = halide_current_time_ns(user_context);
+    i->next = halide_profiler.running;
+    halide_profiler.running = i;
+    p->runs++;
+    p->func_count[0]++;
+    halide_profiler_unlock();
+    halide_profiler_count(i, -1);
+    return i;
+}
+
+WEAK int halide_profiler_pipeline_end(void *user_context, void *state) {
+    halide_profiler_instance *i = (halide_profiler_instance *)state;
+    if (i == &halide_profiler_unsampled_instance) return 0;
+    halide_profiler_count(i, i->slot[0]);
+    int64_t end_nsec = halide_current_time_ns(user_context);
+    halide_profiler_lock();
+    for (halide_profiler_instance **p = &halide_profiler.running; *p; p = &(*p)->next) {
+        if (*p == i) {
+            *p = i->next;
+            break;
+        }
+    }
+    i->pipeline->wall_nsec += end_nsec - i->start_nsec;
+    i->next = halide_profiler.free_instances;
+    halide_profiler.free_instances = i;
+    halide_profiler_unlock();
+    return 0;
+}
+
+// Called at the start of each task of a parallel loop. Returns the
+// slot the task's thread should use.
+WEAK int halide_profiler_acquire_slot(void *state, int func) {
+    halide_profiler_instance *i = (halide_profiler_instance *)state;
+    // Whatever the thread did before the task isn't charged to it.
+    halide_profiler_count(i, -1);
+    for (int s = 1; s < MAX_PROFILER_SLOTS; s++) {
+        if (i->slot[s] == PROFILER_SLOT_FREE &&
+            __sync_bool_compare_and_swap(&i->slot[s], PROFILER_SLOT_FREE, func)) {
+            return s;
+        }
+    }
+    return MAX_PROFILER_SLOTS;
+}
+
+WEAK int halide_profiler_release_slot(void *state, int slot) {
+    halide_profiler_instance *i = (halide_profiler_instance *)state;
+    if (slot != MAX_PROFILER_SLOTS) {
+        halide_profiler_count(i, i->slot[slot]);
+        i->slot[slot] = PROFILER_SLOT_FREE;
+    }
+    return 0;
+}
+
+// Record that the thread holding a slot started computing a Func.
+WEAK int halide_profiler_enter_func(void *state, int slot, int func) {
+    halide_profiler_instance *i = (halide_profiler_instance *)state;
+    if (i != &halide_profiler_unsampled_instance) {
+        __sync_fetch_and_add(&i->pipeline->func_count[func], 1);
+    }
+    halide_profiler_count(i, i->slot[slot]);
+    i->slot[slot] = func;
+    return 0;
+}
+
+// Record that the thread holding a slot went back to computing a
+// Func it was already in, or (with func -1) that it is waiting.
+WEAK int halide_profiler_set_func(void *state, int slot, int func) {
+    halide_profiler_instance *i = (halide_profiler_instance *)state;
+    halide_profiler_count(i, i->slot[slot]);
+    i->slot[slot] = func;
+    return 0;
+}
+
+// Get the id of the Func a buffer belongs to: the one whose name is
+// the longest prefix of the buffer name, up to a '.'. Buffers that
+// don't belong to any Func are charged to the pipeline.
+WEAK int halide_profiler_buffer_func(halide_profiler_pipeline *p, const char *buffer) {
+    unsigned h = (unsigned)(((size_t)buffer >> 3) % PROFILER_NAME_CACHE);
+    for (int i = 0; i < PROFILER_NAME_CACHE; i++) {
+        int j = (h + i) % PROFILER_NAME_CACHE;
+        const char *cached = p->cached_name[j];
+        if (cached == buffer) return p->cached_func[j];
+        if (!cached) break;
+    }
+
+    int best = 0, best_len = 0;
+    const char *n = p->func_names;
+    for (int f = 0; f < p->num_funcs && *n; f++) {
+        char name[256];
+        n = halide_profiler_next_func_name(n, name, 256);
+        // Skip the "produce " or "update ".
+        const char *func = name;
+        while (*func && *func != ' ') func++;
+        if (!*func) continue;
+        func++;
+        int len = 0;
+        while (func[len] && func[len] == buffer[len]) len++;
+        if (!func[len] && (!buffer[len] || buffer[len] == '.') && len > best_len) {
+            best = f;
+            best_len = len;
+        }
+    }
+
+    halide_profiler_lock();
+    for (int i = 0; i < PROFILER_NAME_CACHE; i++) {
+        int j = (h + i) % PROFILER_NAME_CACHE;
+        if (!p->cached_name[j]) {
+            p->cached_func[j] = best;
+            __sync_synchronize();
+            p->cached_name[j] = buffer;
+            break;
+        }
+    }
+    halide_profiler_unlock();
+    return best;
+}
+
+WEAK void halide_profiler_raise_peak(int64_t *peak, int64_t value) {
+    int64_t old = *(volatile int64_t *)peak;
+    while (value > old && !__sync_bool_compare_and_swap(peak, old, value)) {
+        old = *(volatile int64_t *)peak;
+    }
+}
+
+// Called by generated code for each allocation of a buffer, with its
+// size in bytes.
+WEAK int halide_profiler_memory_allocate(void *state, const char *buffer, int bytes, int on_stack) {
+    halide_profiler_instance *i = (halide_profiler_instance *)state;
+    if (i == &halide_profiler_unsampled_instance) return 0;
+    halide_profiler_pipeline *p = i->pipeline;
+    halide_profiler_memory_stats *m = &p->func_memory[halide_profiler_buffer_func(p, buffer)];
+    if (on_stack) {
+        __sync_fetch_and_add(&m->stack_allocs, 1);
+        halide_profiler_raise_peak(&m->stack_peak, bytes);
+        __sync_fetch_and_add(&p->memory.stack_allocs, 1);
+        halide_profiler_raise_peak(&p->memory.stack_peak, bytes);
+    } else {
+        __sync_fetch_and_add(&m->heap_allocs, 1);
+        __sync_fetch_and_add(&m->heap_bytes, (int64_t)bytes);
+        halide_profiler_raise_peak(&m->heap_peak, __sync_add_and_fetch(&m->heap_current, (int64_t)bytes));
+        __sync_fetch_and_add(&p->memory.heap_allocs, 1);
+        __sync_fetch_and_add(&p->memory.heap_bytes, (int64_t)bytes);
+        halide_profiler_raise_peak(&p->memory.heap_peak,
+                                   __sync_add_and_fetch(&p->memory.heap_current, (int64_t)bytes));
+    }
+    return 0;
+}
+
+// Called by generated code for each free of a heap allocation.
+WEAK int halide_profiler_memory_free(void *state, const char *buffer, int bytes, int on_stack) {
+    halide_profiler_instance *i = (halide_profiler_instance *)state;
+    if (i == &halide_profiler_unsampled_instance || on_stack) return 0;
+    halide_profiler_pipeline *p = i->pipeline;
+    halide_profiler_memory_stats *m = &p->func_memory[halide_profiler_buffer_func(p, buffer)];
+    __sync_fetch_and_sub(&m->heap_current, (int64_t)bytes);
+    __sync_fetch_and_sub(&p->memory.heap_current, (int64_t)bytes);
+    return 0;
+}
+
+WEAK int halide_profiler_get_memory_stats(const char *pipeline, const char *func,
+                                          halide_profiler_memory_stats *stats) {
+    int result = -1;
+    halide_profiler_lock();
+    for (halide_profiler_pipeline *p = halide_profiler.pipelines; p && result; p = p->next) {
+        if (strcmp(p->name, pipeline)) continue;
+        if (!func) {
+            *stats = p->memory;
+            result = 0;
+            break;
+        }
+        // Add up the produce and update steps.
+        const char *n = p->func_names;
+        for (int f = 0; f < p->num_funcs && *n; f++) {
+            char name[256];
+            n = halide_profiler_next_func_name(n, name, 256);
+            const char *op = name;
+            while (*op && *op != ' ') op++;
+            if (!*op || strcmp(op + 1, func)) continue;
+            const halide_profiler_memory_stats *m = &p->func_memory[f];
+            if (result) {
+                halide_profiler_clear_memory_stats(stats);
+                result = 0;
+            }
+            stats->heap_allocs += m->heap_allocs;
+            stats->heap_bytes += m->heap_bytes;
+            stats->heap_current += m->heap_current;
+            stats->heap_peak += m->heap_peak;
+            stats->stack_allocs += m->stack_allocs;
+            if (m->stack_peak > stats->stack_peak) stats->stack_peak = m->stack_peak;
+        }
+    }
+    halide_profiler_unlock();
+    return result;
+}
+
+WEAK void halide_profiler_report(void *user_context) {
+    const char *prefix = "halide_profiler";
+    const char *parent = "$total$ $total$";
+    halide_profiler_lock();
+    for (halide_profiler_pipeline *p = halide_profiler.pipelines; p; p = p->next) {
+        // Times are in nanoseconds, so there is one tick per
+        // nanosecond.
+        halide_printf(user_context, "%s count %s $total$ $total$ null null %llu\n",
+                      prefix, p->name, (unsigned long long)p->runs);
+        halide_printf(user_context, "%s ticks %s $total$ $total$ null null %llu\n",
+                      prefix, p->name, (unsigned long long)p->wall_nsec);
+        halide_printf(user_context, "%s nsec %s $total$ $total$ null null %llu\n",
+                      prefix, p->name, (unsigned long long)p->wall_nsec);
+        halide_printf(user_context, "%s samples %s $total$ $total$ null null %llu\n",
+                      prefix, p->name, (unsigned long long)p->samples);
+        halide_printf(user_context, "%s busy_thread_samples %s $total$ $total$ null null %llu\n",
+                      prefix, p->name, (unsigned long long)p->busy_thread_samples);
+        if (p->memory.heap_allocs) {
+            halide_printf(user_context, "%s heap_peak %s $total$ $total$ null null %lld\n",
+                          prefix, p->name, (long long)p->memory.heap_peak);
+        }
+        if (halide_profiler.counters) {
+            for (int c = 0; c < PROFILER_COUNTERS; c++) {
+                uint64_t total = 0;
+                for (int f = 0; f < p->num_funcs; f++) {
+                    total += p->func_counters[f * PROFILER_COUNTERS + c];
+                }
+                halide_printf(user_context, "%s %s %s $total$ $total$ null null %llu\n",
+                              prefix, halide_profiler_counter_names[c], p->name,
+                              (unsigned long long)total);
+            }
+        }
+        const char *n = p->func_names;
+        for (int f = 0; f < p->num_funcs && *n; f++) {
+            char name[256];
+            n = halide_profiler_next_func_name(n, name, 256);
+            halide_printf(user_context, "%s count %s %s %s %llu\n",
+                          prefix, p->name, name, parent, (unsigned long long)p->func_count[f]);
+            halide_printf(user_context, "%s ticks %s %s %s %llu\n",
+                          prefix, p->name, name, parent, (unsigned long long)p->func_nsec[f]);
+            const halide_profiler_memory_stats *m = &p->func_memory[f];
+            if (m->heap_allocs) {
+                halide_printf(user_context, "%s heap_allocs %s %s %s %lld\n",
+                              prefix, p->name, name, parent, (long long)m->heap_allocs);
+                halide_printf(user_context, "%s heap_bytes %s %s %s %lld\n",
+                              prefix, p->name, name, parent, (long long)m->heap_bytes);
+                halide_printf(user_context, "%s heap_peak %s %s %s %lld\n",
+                              prefix, p->name, name, parent, (long long)m->heap_peak);
+            }
+            if (m->stack_allocs) {
+                halide_printf(user_context, "%s stack_allocs %s %s %s %lld\n",
+                              prefix, p->name, name, parent, (long long)m->stack_allocs);
+                halide_printf(user_context, "%s stack_peak %s %s %s %lld\n",
+                              prefix, p->name, name, parent, (long long)m->stack_peak);
+            }
+            if (halide_profiler.counters) {
+                for (int c = 0; c < PROFILER_COUNTERS; c++) {
+                    halide_printf(user_context, "%s %s %s %s %s %llu\n",
+                                  prefix, halide_profiler_counter_names[c], p->name, name, parent,
+                                  (unsigned long long)p->func_counters[f * PROFILER_COUNTERS + c]);
+                }
+            }
+        }
+    }
+    halide_profiler_unlock();
+}
+
+WEAK void halide_profiler_reset() {
+    halide_profiler_lock();
+    for (halide_profiler_pipeline *p = halide_profiler.pipelines; p; p = p->next) {
+        for (int f = 0; f < p->num_funcs; f++) {
+            p->func_nsec[f] = p->func_count[f] = 0;
+            // Memory still in use stays counted.
+            int64_t current = p->func_memory[f].heap_current;
+            halide_profiler_clear_memory_stats(&p->func_memory[f]);
+            p->func_memory[f].heap_current = p->func_memory[f].heap_peak = current;
+        }
+        for (int i = 0; i < p->num_funcs * PROFILER_COUNTERS; i++) {
+            p->func_counters[i] = 0;
+        }
+        int64_t current = p->memory.heap_current;
+        halide_profiler_clear_memory_stats(&p->memory);
+        p->memory.heap_current = p->memory.heap_peak = current;
+        p->runs = p->wall_nsec = 0;
+        p->samples = p->busy_thread_samples = 0;
+    }
+    halide_profiler_unlock();
+}
+
+// Print the report if there is one, stop the sampling thread, and
+// forget everything. Must not be called while pipelines are running.
+WEAK void halide_profiler_shutdown() {
+    if (!halide_profiler.started) return;
+
+    halide_profiler.shutdown = true;
+    void *retval;
+    pthread_join(halide_profiler.sampler, &retval);
+    halide_profiler.started = false;
+
+    halide_profiler_report(NULL);
+
+    halide_profiler_lock();
+    while (halide_profiler_pipeline *p = halide_profiler.pipelines) {
+        halide_profiler.pipelines = p->next;
+        free(p->func_nsec);
+        free(p->func_count);
+        free(p->func_memory);
+        free(p->func_counters);
+        free(p);
+    }
+    while (halide_profiler_instance *i = halide_profiler.free_instances) {
+        halide_profiler.free_instances = i->next;
+        free(i);
+    }
+    for (int i = 0; i < MAX_PROFILER_THREADS; i++) {
+        halide_profiler_thread *t = &halide_profiler.threads[i];
+        if (t->opened) {
+            halide_perf_counters_close(t->fds);
+        }
+        t->opened = false;
+        t->id = 0;
+    }
+    halide_profiler_unlock();
+}
+
+}
@@ -0,0 +1,165 @@
+#include "mini_stdint.h"
+#include "HalideRuntime.h"
+
+// Histograms of the latency of pipelines compiled with the telemetry
+// target feature, of the depth of the thread pools' job stacks, and
+// counts of the bytes copied to and from devices. They are updated
+// with atomic adds from any thread, and read by
+// halide_get_runtime_stats.
+
+#define WEAK __attribute__((weak))
+#ifndef NULL
+#define NULL 0
+#endif
+
+extern "C" {
+
+extern int strcmp(const char *, const char *);
+extern void *memset(void *s, int val, size_t n);
+extern int64_t halide_fast_time_ns(void *user_context);
+
+// Set when the first pipeline with the telemetry feature starts, so
+// that the thread pools and device runtimes don't pay for recording
+// anything when nobody is going to ask.
+WEAK volatile int halide_runtime_stats_active = 0;
+
+WEAK halide_runtime_stats halide_runtime_stats_state;
+
+// Two buckets per power of two: the bit below the highest one set
+// picks which.
+WEAK int halide_histogram_bucket(uint64_t value) {
+    if (value < 2) return (int)value;
+    int log2 = 63 - __builtin_clzll(value);
+    if (log2 >= 32) return halide_histogram_buckets - 1;
+    return 2 * log2 + (int)((value >> (log2 - 1)) & 1);
+}
+
+// The largest value that lands in a bucket.
+WEAK uint64_t halide_histogram_bucket_top(int bucket) {
+    if (bucket < 2) return bucket;
+    if (bucket >= halide_histogram_buckets - 1) return (uint64_t)-1;
+    int log2 = bucket / 2;
+    uint64_t half = (uint64_t)1 << (log2 - 1);
+    return ((uint64_t)1 << log2) + (bucket & 1) * half + half - 1;
+}
+
+WEAK void halide_histogram_add(halide_histogram *h, uint64_t value) {
+    __sync_fetch_and_add(&h->count, 1);
+    __sync_fetch_and_add(&h->sum, value);
+    __sync_fetch_and_add(&h->buckets[halide_histogram_bucket(value)], 1);
+    uint64_t old_max = h->max;
+    while (value > old_max) {
+        uint64_t seen = __sync_val_compare_and_swap(&h->max, old_max, value);
+        if (seen == old_max) break;
+        old_max = seen;
+    }
+}
+
+WEAK uint64_t halide_histogram_percentile(const halide_histogram *h, int percent) {
+    uint64_t count = h->count;
+    if (count == 0) return 0;
+    if (percent < 0) percent = 0;
+    if (percent > 100) percent = 100;
+    uint64_t rank = (count * percent + 99) / 100;
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < halide_histogram_buckets; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t top = halide_histogram_bucket_top(i);
+            return top < h->max ? top : h->max;
+        }
+    }
+    return h->max;
+}
+
+// Find the slot for a pipeline name, claiming an empty one if it has
+// none yet. Slots are claimed in order and never given back, so the
+// first empty one ends the search. NULL if they're all taken.
+WEAK halide_pipeline_stats *halide_runtime_stats_pipeline(const char *name) {
+    for (int i = 0; i < halide_runtime_stats_max_pipelines; i++) {
+        halide_pipeline_stats *p = &halide_runtime_stats_state.pipelines[i];
+        const char *n = p->name;
+        if (n == NULL) {
+            n = __sync_val_compare_and_swap(&p->name, (const char *)NULL, name);
+            if (n == NULL) return p;
+        }
+        // The same pipeline may be linked in more than once, each
+        // with its own copy of its name.
+        if (n == name || strcmp(n, name) == 0) return p;
+    }
+    return NULL;
+}
+
+WEAK halide_pool_stats *halide_runtime_stats_pool(const halide_thread_pool *pool) {
+    for (int i = 0; i < halide_runtime_stats_max_pools; i++) {
+        halide_pool_stats *p = &halide_runtime_stats_state.pools[i];
+        const halide_thread_pool *q = p->pool;
+        if (q == NULL) {
+            q = __sync_val_compare_and_swap(&p->pool, (const halide_thread_pool *)NULL, pool);
+            if (q == NULL) return p;
+        }
+        if (q == pool) return p;
+    }
+    return NULL;
+}
+
+// Called by pipelines at the start of each call. Returns the time.
+WEAK int64_t halide_runtime_stats_begin(void *user_context) {
+    if (!halide_runtime_stats_active) {
+        halide_runtime_stats_active = 1;
+    }
+    return halide_fast_time_ns(user_context);
+}
+
+// Called by pipelines when a call that isn't a bounds query is done,
+// with what halide_runtime_stats_begin returned.
+WEAK int halide_runtime_stats_end(void *user_context, const char *pipeline, int64_t begin_ns) {
+    int64_t elapsed = halide_fast_time_ns(user_context) - begin_ns;
+    halide_pipeline_stats *p = halide_runtime_stats_pipeline(pipeline);
+    if (p) {
+        halide_histogram_add(&p->latency_ns, elapsed > 0 ? (uint64_t)elapsed : 0);
+    }
+    return 0;
+}
+
+// Called by the thread pool with the number of jobs on its stack
+// each time it pushes one.
+WEAK void halide_runtime_stats_queue_depth(const halide_thread_pool *pool, int depth) {
+    if (!halide_runtime_stats_active) return;
+    halide_pool_stats *p = halide_runtime_stats_pool(pool);
+    if (p) {
+        halide_histogram_add(&p->queue_depth, depth > 0 ? (uint64_t)depth : 0);
+    }
+}
+
+// Called by the device runtimes for each copy between the host and a
+// device.
+WEAK void halide_runtime_stats_device_transfer(int64_t bytes, int to_device) {
+    if (!halide_runtime_stats_active || bytes <= 0) return;
+    if (to_device) {
+        __sync_fetch_and_add(&halide_runtime_stats_state.bytes_to_device, (uint64_t)bytes);
+    } else {
+        __sync_fetch_and_add(&halide_runtime_stats_state.bytes_to_host, (uint64_t)bytes);
+    }
+}
+
+WEAK void halide_get_runtime_stats(halide_runtime_stats *stats) {
+    *stats = halide_runtime_stats_state;
+    stats->num_pipelines = 0;
+    while (stats->num_pipelines < halide_runtime_stats_max_pipelines &&
+           stats->pipelines[stats->num_pipelines].name) {
+        stats->num_pipelines++;
+    }
+    stats->num_pools = 0;
+    while (stats->num_pools < halide_runtime_stats_max_pools &&
+           stats->pools[stats->num_pools].pool) {
+        stats->num_pools++;
+    }
+}
+
+WEAK void halide_reset_runtime_stats() {
+    memset(&halide_runtime_stats_state, 0, sizeof(halide_runtime_stats_state));
+}
+
+}
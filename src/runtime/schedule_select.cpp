@@ -0,0 +1,265 @@
+#include "mini_stdint.h"
+#include "HalideRuntime.h"
+
+// Chooses among the schedules of pipelines compiled with
+// Func::compile_to_file_with_schedules, by timing them on the calls
+// the program makes. Each pipeline name and bucket of output shapes
+// has its own choice.
+
+#define WEAK __attribute__((weak))
+#ifndef NULL
+#define NULL 0
+#endif
+
+extern "C" {
+
+extern char *getenv(const char *);
+extern int atoi(const char *);
+extern long long strtoll(const char *, char **, int);
+extern void *malloc(size_t);
+extern void free(void *);
+extern int strcmp(const char *, const char *);
+extern size_t strlen(const char *);
+extern void *memcpy(void *, const void *, size_t);
+extern void *fopen(const char *path, const char *mode);
+extern size_t fread(void *ptr, size_t size, size_t n, void *file);
+extern size_t fwrite(const void *ptr, size_t size, size_t n, void *file);
+extern int fclose(void *f);
+extern int snprintf(char *str, size_t size, const char *format, ...);
+extern int halide_start_clock(void *user_context);
+
+#define SCHEDULE_SELECT_MAX_VARIANTS 16
+
+struct halide_schedule_select_entry {
+    halide_schedule_select_entry *next;
+    char *name;
+    int32_t bucket;
+    int32_t num_variants;
+    uint64_t calls;
+    uint64_t count[SCHEDULE_SELECT_MAX_VARIANTS];
+    // The mean of the first few times, and then a moving average, so
+    // that the choice follows changes in the traffic.
+    int64_t mean_ns[SCHEDULE_SELECT_MAX_VARIANTS];
+};
+
+WEAK struct {
+    int lock;
+    // -1 until the settings and the saved state have been read.
+    int initialized;
+    int warmup;
+    int explore_period;
+    halide_schedule_select_entry *entries;
+} halide_schedule_select_state = {0, -1, 0, 0, NULL};
+
+WEAK void halide_schedule_select_lock() {
+    while (__sync_lock_test_and_set(&halide_schedule_select_state.lock, 1)) {}
+}
+
+WEAK void halide_schedule_select_unlock() {
+    __sync_lock_release(&halide_schedule_select_state.lock);
+}
+
+// Must be called with the lock held. Returns NULL if out of memory.
+WEAK halide_schedule_select_entry *halide_schedule_select_find(const char *name, int32_t bucket,
+                                                               int32_t num_variants) {
+    halide_schedule_select_entry *e = halide_schedule_select_state.entries;
+    while (e && (e->bucket != bucket || e->num_variants != num_variants || strcmp(e->name, name))) {
+        e = e->next;
+    }
+    if (!e) {
+        e = (halide_schedule_select_entry *)malloc(sizeof(halide_schedule_select_entry));
+        if (!e) return NULL;
+        size_t name_len = strlen(name) + 1;
+        e->name = (char *)malloc(name_len);
+        if (!e->name) {
+            free(e);
+            return NULL;
+        }
+        memcpy(e->name, name, name_len);
+        e->bucket = bucket;
+        e->num_variants = num_variants;
+        e->calls = 0;
+        for (int i = 0; i < SCHEDULE_SELECT_MAX_VARIANTS; i++) {
+            e->count[i] = 0;
+            e->mean_ns[i] = 0;
+        }
+        e->next = halide_schedule_select_state.entries;
+        halide_schedule_select_state.entries = e;
+    }
+    return e;
+}
+
+// Read the state saved by halide_schedule_select_save. Must be called
+// with the lock held.
+WEAK void halide_schedule_select_load(const char *file_name) {
+    void *f = fopen(file_name, "r");
+    if (!f) return;
+    size_t capacity = 1 << 16, size = 0;
+    char *text = (char *)malloc(capacity + 1);
+    while (text) {
+        size_t n = fread(text + size, 1, capacity - size, f);
+        size += n;
+        if (size < capacity) break;
+        char *bigger = (char *)malloc(2 * capacity + 1);
+        if (bigger) memcpy(bigger, text, size);
+        free(text);
+        text = bigger;
+        capacity *= 2;
+    }
+    fclose(f);
+    if (!text) return;
+    text[size] = 0;
+
+    // Each line is: name bucket num_variants calls, then the count and
+    // mean of each variant.
+    char *p = text;
+    while (*p) {
+        char *name = p;
+        while (*p && *p != ' ' && *p != '\n') p++;
+        if (*p != ' ') {
+            while (*p == '\n') p++;
+            continue;
+        }
+        *p++ = 0;
+        char *end;
+        int32_t bucket = (int32_t)strtoll(p, &end, 10);
+        int32_t num_variants = (int32_t)strtoll(end, &end, 10);
+        uint64_t calls = (uint64_t)strtoll(end, &end, 10);
+        bool ok = num_variants > 0 && num_variants <= SCHEDULE_SELECT_MAX_VARIANTS;
+        halide_schedule_select_entry *e =
+            ok ? halide_schedule_select_find(name, bucket, num_variants) : NULL;
+        if (e) {
+            e->calls = calls;
+            for (int i = 0; i < num_variants; i++) {
+                e->count[i] = (uint64_t)strtoll(end, &end, 10);
+                e->mean_ns[i] = (int64_t)strtoll(end, &end, 10);
+            }
+        }
+        p = end;
+        while (*p && *p != '\n') p++;
+        while (*p == '\n') p++;
+    }
+    free(text);
+}
+
+WEAK void halide_schedule_select_init(void *user_context) {
+    if (halide_schedule_select_state.initialized >= 0) return;
+    halide_start_clock(user_context);
+    char *warmup_str = getenv("HL_SCHEDULE_WARMUP");
+    int warmup = warmup_str ? atoi(warmup_str) : 3;
+    halide_schedule_select_state.warmup = warmup > 0 ? warmup : 1;
+    char *explore_str = getenv("HL_SCHEDULE_EXPLORE");
+    int explore = explore_str ? atoi(explore_str) : 32;
+    halide_schedule_select_state.explore_period = explore > 0 ? explore : 0;
+    char *file_name = getenv("HL_SCHEDULE_STATE");
+    if (file_name && file_name[0]) {
+        halide_schedule_select_load(file_name);
+    }
+    halide_schedule_select_state.initialized = 1;
+}
+
+WEAK int32_t halide_schedule_select(void *user_context, const char *name,
+                                    int32_t num_variants, int32_t bucket) {
+    if (num_variants <= 1 || num_variants > SCHEDULE_SELECT_MAX_VARIANTS) {
+        return 0;
+    }
+    halide_schedule_select_lock();
+    halide_schedule_select_init(user_context);
+    halide_schedule_select_entry *e = halide_schedule_select_find(name, bucket, num_variants);
+    int32_t choice = 0;
+    if (e) {
+        uint64_t call = e->calls++;
+        // Time each variant a few times first, least timed first.
+        int32_t least = 0;
+        for (int32_t i = 1; i < num_variants; i++) {
+            if (e->count[i] < e->count[least]) least = i;
+        }
+        int period = halide_schedule_select_state.explore_period;
+        if (e->count[least] < (uint64_t)halide_schedule_select_state.warmup) {
+            choice = least;
+        } else if (period && call % period == 0) {
+            // Now and then, run the others in turn, in case they've
+            // become faster.
+            choice = (int32_t)((call / period) % num_variants);
+        } else {
+            for (int32_t i = 1; i < num_variants; i++) {
+                if (e->mean_ns[i] < e->mean_ns[choice]) choice = i;
+            }
+        }
+    }
+    halide_schedule_select_unlock();
+    return choice;
+}
+
+WEAK int halide_schedule_report(void *user_context, const char *name, int32_t num_variants,
+                                int32_t bucket, int32_t variant, int64_t ns) {
+    if (num_variants <= 1 || num_variants > SCHEDULE_SELECT_MAX_VARIANTS ||
+        variant < 0 || variant >= num_variants) {
+        return 0;
+    }
+    halide_schedule_select_lock();
+    halide_schedule_select_entry *e = halide_schedule_select_find(name, bucket, num_variants);
+    if (e) {
+        uint64_t n = ++e->count[variant];
+        if (n <= (uint64_t)halide_schedule_select_state.warmup) {
+            e->mean_ns[variant] += (ns - e->mean_ns[variant]) / (int64_t)n;
+        } else {
+            e->mean_ns[variant] += (ns - e->mean_ns[variant]) / 8;
+        }
+    }
+    halide_schedule_select_unlock();
+    return 0;
+}
+
+WEAK int halide_schedule_select_save(void *user_context) {
+    char *file_name = getenv("HL_SCHEDULE_STATE");
+    if (!file_name || !file_name[0]) {
+        return 0;
+    }
+    void *f = fopen(file_name, "w");
+    if (!f) {
+        halide_printf(user_context, "Could not open schedule state file %s\n", file_name);
+        return -1;
+    }
+    int result = 0;
+    char buf[256];
+    halide_schedule_select_lock();
+    for (halide_schedule_select_entry *e = halide_schedule_select_state.entries;
+         e && result == 0; e = e->next) {
+        int n = snprintf(buf, sizeof(buf), "%s %d %d %llu", e->name, e->bucket, e->num_variants,
+                         (unsigned long long)e->calls);
+        if (n > (int)sizeof(buf) - 1) n = sizeof(buf) - 1;
+        if (fwrite(buf, 1, n, f) != (size_t)n) result = -1;
+        for (int i = 0; i < e->num_variants; i++) {
+            n = snprintf(buf, sizeof(buf), " %llu %lld", (unsigned long long)e->count[i],
+                         (long long)e->mean_ns[i]);
+            if (fwrite(buf, 1, n, f) != (size_t)n) result = -1;
+        }
+        if (fwrite("\n", 1, 1, f) != 1) result = -1;
+    }
+    halide_schedule_select_unlock();
+    if (fclose(f)) result = -1;
+    return result;
+}
+
+WEAK int32_t halide_schedule_selected(void *user_context, const char *name,
+                                      int32_t num_variants, int32_t bucket) {
+    int32_t choice = -1;
+    halide_schedule_select_lock();
+    for (halide_schedule_select_entry *e = halide_schedule_select_state.entries; e; e = e->next) {
+        if (e->bucket == bucket && e->num_variants == num_variants && !strcmp(e->name, name)) {
+            choice = 0;
+            for (int32_t i = 1; i < num_variants; i++) {
+                if (e->mean_ns[i] < e->mean_ns[choice]) choice = i;
+            }
+            for (int32_t i = 0; i < num_variants; i++) {
+                if (e->count[i] == 0) choice = -1;
+            }
+            break;
+        }
+    }
+    halide_schedule_select_unlock();
+    return choice;
+}
+
+}
@@ -0,0 +1,446 @@
+#include "mini_stdint.h"
+#include "HalideRuntime.h"
+
+// Records when each task of each parallel loop runs and on which
+// thread, along with the produce, update and consume markers of
+// traced Funcs (run with HL_TRACE=1 to trace them all), when
+// HL_TIMELINE_FILE is set. halide_timeline_write writes them to that
+// file as trace-event JSON, which chrome://tracing and Perfetto can
+// show, and prints a summary of how well balanced each parallel loop
+// was in the format of the Halide profiler, for util/HalideProf.
+
+extern "C" {
+
+extern char *getenv(const char *);
+extern int atoi(const char *);
+extern void *malloc(size_t);
+extern void free(void *);
+extern void *fopen(const char *path, const char *mode);
+extern size_t fwrite(const void *ptr, size_t size, size_t n, void *file);
+extern int fclose(void *f);
+extern int snprintf(char *str, size_t size, const char *format, ...);
+extern int halide_start_clock(void *user_context);
+extern int64_t halide_fast_time_ns(void *user_context);
+extern size_t halide_current_thread_id();
+
+enum {
+    timeline_realize = 0,
+    timeline_produce = 1,
+    timeline_update = 2,
+    timeline_consume = 3,
+    timeline_par_for = 4,
+    timeline_task = 5
+};
+
+static const char *timeline_kind_names[] = {"realize", "produce", "update", "consume",
+                                            "par_for", "task"};
+
+struct timeline_event {
+    // The Func of a marker, or of the innermost marker around a
+    // parallel loop, or NULL.
+    const char *func;
+    int64_t begin_ns, duration_ns;
+    int32_t thread;
+    // 'B' and 'E' for the beginning and end of a marker, 'X' for
+    // tasks and loops.
+    char phase;
+    int8_t kind;
+    // The kind of the marker the func came from.
+    int8_t func_kind;
+    int32_t task;
+};
+
+// The threads seen so far, numbered in order.
+#define TIMELINE_MAX_THREADS 256
+
+// The per-thread busy time of one run of a parallel loop.
+#define TIMELINE_JOB_THREADS 64
+
+struct halide_timeline_job {
+    const char *func;
+    int func_kind;
+    int32_t thread;
+    int64_t begin_ns;
+    struct {
+        volatile size_t thread_id;
+        // Only added to by the thread that claimed the entry.
+        int64_t busy_ns;
+    } threads[TIMELINE_JOB_THREADS];
+};
+
+// The totals for all runs of the parallel loops in one stage.
+struct timeline_loop_stats {
+    const char *func;
+    int func_kind;
+    uint64_t count;
+    int64_t wall_ns;
+    int64_t busy_ns;
+    // The sums over runs of the busy time of the busiest thread, and
+    // of the mean busy time of the threads that took part.
+    int64_t max_busy_ns;
+    int64_t mean_busy_ns;
+    uint64_t threads;
+    timeline_loop_stats *next;
+};
+
+WEAK struct {
+    // -1 until HL_TIMELINE_FILE has been looked at.
+    volatile int enabled;
+    int lock;
+    const char *file_name;
+    timeline_event *events;
+    uint32_t capacity;
+    volatile uint32_t count;
+    volatile size_t thread_ids[TIMELINE_MAX_THREADS];
+    timeline_loop_stats *loops;
+} halide_timeline = {-1, 0, NULL, NULL, 0, 0, {0}, NULL};
+
+WEAK void halide_timeline_lock() {
+    while (__sync_lock_test_and_set(&halide_timeline.lock, 1)) {}
+}
+
+WEAK void halide_timeline_unlock() {
+    __sync_lock_release(&halide_timeline.lock);
+}
+
+WEAK bool halide_timeline_enabled() {
+    if (halide_timeline.enabled < 0) {
+        halide_timeline_lock();
+        if (halide_timeline.enabled < 0) {
+            const char *file_name = getenv("HL_TIMELINE_FILE");
+            if (file_name) {
+                const char *events_str = getenv("HL_TIMELINE_EVENTS");
+                int capacity = events_str ? atoi(events_str) : 0;
+                halide_timeline.capacity = capacity > 0 ? capacity : (1 << 18);
+                size_t bytes = halide_timeline.capacity * sizeof(timeline_event);
+                halide_timeline.events = (timeline_event *)malloc(bytes);
+                // Events that have been claimed but not yet filled in
+                // must not look like markers to
+                // halide_timeline_enclosing.
+                uint8_t *b = (uint8_t *)halide_timeline.events;
+                for (size_t i = 0; b && i < bytes; i++) {
+                    b[i] = 0;
+                }
+                halide_timeline.count = 0;
+                halide_timeline.file_name = file_name;
+                halide_start_clock(NULL);
+            }
+            __sync_synchronize();
+            halide_timeline.enabled = (file_name && halide_timeline.events) ? 1 : 0;
+        }
+        halide_timeline_unlock();
+    }
+    return halide_timeline.enabled == 1;
+}
+
+// A small number for the calling thread.
+WEAK int32_t halide_timeline_thread() {
+    size_t id = halide_current_thread_id();
+    for (int i = 0; i < TIMELINE_MAX_THREADS; i++) {
+        size_t t = halide_timeline.thread_ids[i];
+        if (t == id) return i;
+        if (t == 0 && __sync_bool_compare_and_swap(&halide_timeline.thread_ids[i], 0, id)) {
+            return i;
+        }
+    }
+    return TIMELINE_MAX_THREADS;
+}
+
+// Claim the next event. Events past the capacity are dropped.
+WEAK timeline_event *halide_timeline_new_event(char phase, int kind, const char *func,
+                                               int func_kind, int32_t thread) {
+    uint32_t i = __sync_fetch_and_add(&halide_timeline.count, 1);
+    if (i >= halide_timeline.capacity) {
+        return NULL;
+    }
+    timeline_event *e = halide_timeline.events + i;
+    e->func = func;
+    e->begin_ns = 0;
+    e->duration_ns = 0;
+    e->thread = thread;
+    e->phase = phase;
+    e->kind = kind;
+    e->func_kind = func_kind;
+    e->task = 0;
+    return e;
+}
+
+// Called by halide_trace for the markers of traced Funcs.
+WEAK void halide_timeline_marker(void *user_context, const halide_trace_event *t) {
+    int kind;
+    switch (t->event) {
+    case halide_trace_begin_realization:
+    case halide_trace_end_realization:
+        kind = timeline_realize;
+        break;
+    case halide_trace_produce:
+        kind = timeline_produce;
+        break;
+    case halide_trace_update:
+        kind = timeline_update;
+        break;
+    case halide_trace_consume:
+    case halide_trace_end_consume:
+        kind = timeline_consume;
+        break;
+    default:
+        return;
+    }
+    int64_t now = halide_fast_time_ns(user_context);
+    int32_t thread = halide_timeline_thread();
+    // An update or a consume ends what came before it.
+    bool ends = (t->event == halide_trace_end_realization ||
+                 t->event == halide_trace_update ||
+                 t->event == halide_trace_consume ||
+                 t->event == halide_trace_end_consume);
+    bool begins = (t->event != halide_trace_end_realization &&
+                   t->event != halide_trace_end_consume);
+    if (ends) {
+        timeline_event *e = halide_timeline_new_event('E', kind, t->func, kind, thread);
+        if (e) e->begin_ns = now;
+    }
+    if (begins) {
+        timeline_event *e = halide_timeline_new_event('B', kind, t->func, kind, thread);
+        if (e) e->begin_ns = now;
+    }
+}
+
+// Find the innermost marker the calling thread is in, by walking
+// back over its recent events. There is no thread-local storage in
+// the runtime to keep a stack in.
+WEAK void halide_timeline_enclosing(int32_t thread, const char **func, int *func_kind) {
+    *func = NULL;
+    *func_kind = -1;
+    uint32_t end = halide_timeline.count;
+    if (end > halide_timeline.capacity) end = halide_timeline.capacity;
+    int depth = 0;
+    for (uint32_t i = end, seen = 0; i > 0 && seen < 4096; i--, seen++) {
+        const timeline_event *e = halide_timeline.events + i - 1;
+        if (e->thread != thread) continue;
+        if (e->phase == 'E') {
+            depth++;
+        } else if (e->phase == 'B') {
+            if (depth == 0) {
+                *func = e->func;
+                *func_kind = e->func_kind;
+                return;
+            }
+            depth--;
+        }
+    }
+}
+
+WEAK halide_timeline_job *halide_timeline_job_begin(void *user_context) {
+    if (!halide_timeline_enabled()) {
+        return NULL;
+    }
+    halide_timeline_job *job = (halide_timeline_job *)malloc(sizeof(halide_timeline_job));
+    if (!job) return NULL;
+    job->thread = halide_timeline_thread();
+    halide_timeline_enclosing(job->thread, &job->func, &job->func_kind);
+    for (int i = 0; i < TIMELINE_JOB_THREADS; i++) {
+        job->threads[i].thread_id = 0;
+        job->threads[i].busy_ns = 0;
+    }
+    job->begin_ns = halide_fast_time_ns(user_context);
+    return job;
+}
+
+WEAK int64_t halide_timeline_task_begin(void *user_context, halide_timeline_job *job) {
+    return job ? halide_fast_time_ns(user_context) : 0;
+}
+
+WEAK void halide_timeline_task_end(void *user_context, halide_timeline_job *job,
+                                   int task, int64_t begin_ns) {
+    if (!job) return;
+    int64_t now = halide_fast_time_ns(user_context);
+    int32_t thread = halide_timeline_thread();
+    timeline_event *e = halide_timeline_new_event('X', timeline_task, job->func, job->func_kind, thread);
+    if (e) {
+        e->begin_ns = begin_ns;
+        e->duration_ns = now - begin_ns;
+        e->task = task;
+    }
+
+    // Charge the time to this thread's entry in the job.
+    size_t id = halide_current_thread_id();
+    for (int i = 0; i < TIMELINE_JOB_THREADS; i++) {
+        int j = (int)((id + i) % TIMELINE_JOB_THREADS);
+        size_t t = job->threads[j].thread_id;
+        if (t == id || (t == 0 && __sync_bool_compare_and_swap(&job->threads[j].thread_id, 0, id))) {
+            job->threads[j].busy_ns += now - begin_ns;
+            return;
+        }
+    }
+}
+
+WEAK void halide_timeline_job_end(void *user_context, halide_timeline_job *job, int size) {
+    if (!job) return;
+    int64_t now = halide_fast_time_ns(user_context);
+    timeline_event *e = halide_timeline_new_event('X', timeline_par_for, job->func, job->func_kind, job->thread);
+    if (e) {
+        e->begin_ns = job->begin_ns;
+        e->duration_ns = now - job->begin_ns;
+        e->task = size;
+    }
+
+    int64_t busy = 0, max_busy = 0;
+    int threads = 0;
+    for (int i = 0; i < TIMELINE_JOB_THREADS; i++) {
+        if (job->threads[i].thread_id) {
+            int64_t b = job->threads[i].busy_ns;
+            busy += b;
+            max_busy = b > max_busy ? b : max_busy;
+            threads++;
+        }
+    }
+
+    halide_timeline_lock();
+    timeline_loop_stats *s = halide_timeline.loops;
+    while (s && (s->func != job->func || s->func_kind != job->func_kind)) {
+        s = s->next;
+    }
+    if (!s) {
+        s = (timeline_loop_stats *)malloc(sizeof(timeline_loop_stats));
+        s->func = job->func;
+        s->func_kind = job->func_kind;
+        s->count = 0;
+        s->wall_ns = s->busy_ns = s->max_busy_ns = s->mean_busy_ns = 0;
+        s->threads = 0;
+        s->next = halide_timeline.loops;
+        halide_timeline.loops = s;
+    }
+    s->count++;
+    s->wall_ns += now - job->begin_ns;
+    s->busy_ns += busy;
+    s->max_busy_ns += max_busy;
+    s->mean_busy_ns += threads ? busy / threads : 0;
+    s->threads += threads;
+    halide_timeline_unlock();
+
+    free(job);
+}
+
+// Write the name of the stage an event belongs to.
+WEAK int halide_timeline_stage_name(char *buf, size_t size, const char *func, int func_kind) {
+    if (!func || func_kind < 0) {
+        return snprintf(buf, size, "pipeline");
+    }
+    return snprintf(buf, size, "%s %s", timeline_kind_names[func_kind], func);
+}
+
+WEAK int halide_timeline_write(void *user_context) {
+    if (!halide_timeline_enabled()) {
+        return 0;
+    }
+    void *f = fopen(halide_timeline.file_name, "w");
+    if (!f) {
+        halide_printf(user_context, "Could not open timeline file %s\n", halide_timeline.file_name);
+        return -1;
+    }
+
+    uint32_t count = halide_timeline.count;
+    if (count > halide_timeline.capacity) {
+        halide_printf(user_context, "Warning: timeline dropped %u events. "
+                      "Set HL_TIMELINE_EVENTS to keep more.\n",
+                      count - halide_timeline.capacity);
+        count = halide_timeline.capacity;
+    }
+
+    int result = 0;
+    char buf[512];
+    const char *head = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    size_t len = 0;
+    while (head[len]) len++;
+    if (fwrite(head, 1, len, f) != len) result = -1;
+    for (uint32_t i = 0; i < count && result == 0; i++) {
+        const timeline_event *e = halide_timeline.events + i;
+        char name[128];
+        if (e->kind == timeline_task || e->kind == timeline_par_for) {
+            halide_timeline_stage_name(name, sizeof(name), e->func, e->func_kind);
+        } else {
+            snprintf(name, sizeof(name), "%s %s", timeline_kind_names[e->kind], e->func);
+        }
+        int n;
+        if (e->phase == 'X') {
+            n = snprintf(buf, sizeof(buf),
+                         "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+                         "\"ts\":%lld.%03d,\"dur\":%lld.%03d,\"args\":{\"%s\":%d}}\n",
+                         i ? "," : "", name, timeline_kind_names[e->kind], e->thread,
+                         (long long)(e->begin_ns / 1000), (int)(e->begin_ns % 1000),
+                         (long long)(e->duration_ns / 1000), (int)(e->duration_ns % 1000),
+                         e->kind == timeline_task ? "task" : "tasks", e->task);
+        } else {
+            n = snprintf(buf, sizeof(buf),
+                         "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":0,\"tid\":%d,"
+                         "\"ts\":%lld.%03d}\n",
+                         i ? "," : "", name, timeline_kind_names[e->kind], e->phase, e->thread,
+                         (long long)(e->begin_ns / 1000), (int)(e->begin_ns % 1000));
+        }
+        if (n > (int)sizeof(buf) - 1) n = sizeof(buf) - 1;
+        if (fwrite(buf, 1, n, f) != (size_t)n) result = -1;
+    }
+    if (fwrite("]}\n", 1, 3, f) != 3) result = -1;
+    if (fclose(f)) result = -1;
+
+    // The balance of each parallel loop, for HalideProf. The ticks
+    // are nanoseconds.
+    halide_timeline_lock();
+    int64_t total = 0;
+    for (timeline_loop_stats *s = halide_timeline.loops; s; s = s->next) {
+        total += s->wall_ns;
+    }
+    if (halide_timeline.loops) {
+        halide_printf(user_context, "halide_profiler ticks $timeline$ $total$ $total$ null null %lld\n",
+                      (long long)total);
+        halide_printf(user_context, "halide_profiler nsec $timeline$ $total$ $total$ null null %lld\n",
+                      (long long)total);
+    }
+    for (timeline_loop_stats *s = halide_timeline.loops; s; s = s->next) {
+        char name[128];
+        halide_timeline_stage_name(name, sizeof(name), s->func, s->func_kind);
+        for (char *c = name; *c; c++) {
+            // The profiler's output is split on spaces.
+            if (*c == ' ') *c = '_';
+        }
+        const char *prefix = "halide_profiler";
+        const char *parent = "$total$ $total$";
+        halide_printf(user_context, "%s count $timeline$ par_for %s %s %llu\n",
+                      prefix, name, parent, (unsigned long long)s->count);
+        halide_printf(user_context, "%s ticks $timeline$ par_for %s %s %lld\n",
+                      prefix, name, parent, (long long)s->wall_ns);
+        halide_printf(user_context, "%s busy $timeline$ par_for %s %s %lld\n",
+                      prefix, name, parent, (long long)s->busy_ns);
+        halide_printf(user_context, "%s max_busy $timeline$ par_for %s %s %lld\n",
+                      prefix, name, parent, (long long)s->max_busy_ns);
+        halide_printf(user_context, "%s mean_busy $timeline$ par_for %s %s %lld\n",
+                      prefix, name, parent, (long long)s->mean_busy_ns);
+        halide_printf(user_context, "%s loop_threads $timeline$ par_for %s %s %llu\n",
+                      prefix, name, parent, (unsigned long long)s->threads);
+    }
+    halide_timeline_unlock();
+    return result;
+}
+
+WEAK void halide_shutdown_timeline() {
+    if (halide_timeline.enabled != 1) {
+        return;
+    }
+    halide_timeline_write(NULL);
+    halide_timeline_lock();
+    free(halide_timeline.events);
+    halide_timeline.events = NULL;
+    halide_timeline.count = 0;
+    while (timeline_loop_stats *s = halide_timeline.loops) {
+        halide_timeline.loops = s->next;
+        free(s);
+    }
+    for (int i = 0; i < TIMELINE_MAX_THREADS; i++) {
+        halide_timeline.thread_ids[i] = 0;
+    }
+    // Look at HL_TIMELINE_FILE again next time.
+    halide_timeline.enabled = -1;
+    halide_timeline_unlock();
+}
+
+}
@@ -8,6 +8,12 @@ extern void *fopen(const char *path, const char *mode);
 extern size_t fwrite(const void *ptr, size_t size, size_t n, void *file);
 extern int snprintf(char *str, size_t size, const char *format, ...);
 extern int fclose(void *f);
+extern int atoi(const char *);
+extern void *malloc(size_t);
+extern void free(void *);
+extern int strncmp(const char *, const char *, size_t);
+extern bool halide_timeline_enabled();
+extern void halide_timeline_marker(void *user_context, const halide_trace_event *e);
 
 typedef int32_t (*trace_fn)(void *, const halide_trace_event *);
 
@@ -19,6 +25,359 @@ WEAK void halide_set_custom_trace(trace_fn t) {
 
 WEAK void *halide_trace_file = NULL;
 WEAK bool halide_trace_initialized = false;
+WEAK int halide_trace_init_lock = 0;
+
+// Packets going to the trace file are gathered in a large buffer, and
+// written out a buffer at a time. Threads reserve space for a packet
+// by atomically bumping the cursor, so writing a packet takes no
+// lock. The thread whose packet doesn't fit swaps in the spare buffer
+// and writes out the full one while the other threads carry on
+// filling the new one; they only wait if it fills up before the write
+// is done.
+#define TRACE_BUFFER_SIZE (1 << 20)
+#define TRACE_BUFFER_EXCLUSIVE 0x80000000U
+#define TRACE_BUFFER_NOT_FULL 0xffffffffU
+
+WEAK struct {
+    // The number of threads writing packets into the buffer. The top
+    // bit is set while a thread has the buffers to itself.
+    volatile uint32_t users;
+    volatile uint32_t cursor;
+    // Where the first packet that didn't fit would have gone, or
+    // TRACE_BUFFER_NOT_FULL.
+    volatile uint32_t end;
+    uint8_t *data;
+    // The other buffer, which is free unless writing is set.
+    uint8_t *spare;
+    volatile int writing;
+} halide_trace_buffer = {0, 0, TRACE_BUFFER_NOT_FULL, NULL, NULL, 0};
+
+// Which events the default trace handler keeps. Loads and stores are
+// kept one in halide_trace_sample_rate, and only for the comma
+// separated Funcs in halide_trace_funcs, if it is set. They come from
+// HL_TRACE_SAMPLE, HL_TRACE_EVENTS and HL_TRACE_FUNCS.
+WEAK uint32_t halide_trace_event_mask = 0x3ff;
+WEAK char *halide_trace_funcs = NULL;
+WEAK int halide_trace_sample_rate = 1;
+WEAK uint32_t halide_trace_sample_counter = 0;
+
+static const char *trace_event_names[] = {"load",
+                                          "store",
+                                          "begin_realization",
+                                          "end_realization",
+                                          "produce",
+                                          "update",
+                                          "consume",
+                                          "end_consume",
+                                          "summary",
+                                          "summary_load"};
+
+// Does the comma separated list contain the name?
+WEAK bool halide_trace_list_contains(const char *list, const char *name) {
+    const char *l = list;
+    while (*l) {
+        const char *n = name;
+        while (*n && *l == *n) {
+            l++;
+            n++;
+        }
+        if (!*n && (!*l || *l == ',')) {
+            return true;
+        }
+        while (*l && *l != ',') l++;
+        if (*l == ',') l++;
+    }
+    return false;
+}
+
+WEAK void halide_trace_buffer_acquire_shared() {
+    while (true) {
+        uint32_t old = __sync_fetch_and_add(&halide_trace_buffer.users, 1);
+        if (!(old & TRACE_BUFFER_EXCLUSIVE)) return;
+        __sync_fetch_and_sub(&halide_trace_buffer.users, 1);
+        while (halide_trace_buffer.users & TRACE_BUFFER_EXCLUSIVE) {}
+    }
+}
+
+WEAK void halide_trace_buffer_release_shared() {
+    __sync_fetch_and_sub(&halide_trace_buffer.users, 1);
+}
+
+WEAK void halide_trace_buffer_acquire_exclusive() {
+    while (!__sync_bool_compare_and_swap(&halide_trace_buffer.users, 0, TRACE_BUFFER_EXCLUSIVE)) {}
+}
+
+WEAK void halide_trace_buffer_release_exclusive() {
+    __sync_fetch_and_and(&halide_trace_buffer.users, ~TRACE_BUFFER_EXCLUSIVE);
+}
+
+// Wait for the last write of the spare buffer to finish. Must be
+// called with the buffers held exclusively.
+WEAK void halide_trace_buffer_wait_for_write() {
+    while (halide_trace_buffer.writing) {}
+}
+
+// With HL_TRACE_COMPRESS=1, each buffer is written out as blocks of
+// the compressed format read by util/HalideTrace instead of as raw
+// packets. A block is
+//
+//   "HLTB", u32 data bytes, u32 packets, u32 funcs,
+//   for each func: u8 name length, name, u32 packets,
+//   the packets.
+//
+// so a reader looking for some Funcs can skip the blocks without
+// them. All integers in the header are little-endian. Each packet is
+// the index of its func in the block, then its id and parent id, the
+// six bytes of metadata of the raw header, the coordinates and the
+// values. The ids, coordinates and values are encoded as varints of
+// their difference from the last packet of the same func in the
+// block; zigzagged for the ids, coordinates and integer values, and
+// xored for floats.
+#define TRACE_BLOCK_MAX_FUNCS 64
+
+WEAK bool halide_trace_compress = false;
+// Room for the encoding of a buffer; varints are at most twice the
+// size of the raw packets.
+WEAK uint8_t *halide_trace_encoded = NULL;
+
+static uint8_t *trace_put_varint(uint8_t *out, uint64_t v) {
+    while (v >= 0x80) {
+        *out++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *out++ = (uint8_t)v;
+    return out;
+}
+
+static uint8_t *trace_put_zigzag(uint8_t *out, int64_t v) {
+    return trace_put_varint(out, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static uint8_t *trace_put_uint32(uint8_t *out, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        *out++ = (uint8_t)(v >> (i * 8));
+    }
+    return out;
+}
+
+// Packets are not aligned in the buffer, so they are read a byte at a
+// time.
+static uint64_t trace_get(const uint8_t *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) {
+        v |= (uint64_t)p[i] << (i * 8);
+    }
+    return v;
+}
+
+static int trace_value_bytes(const uint8_t *packet) {
+    int bytes = 1;
+    while (bytes*8 < packet[10]) bytes <<= 1;
+    return bytes;
+}
+
+static size_t trace_packet_size(const uint8_t *packet) {
+    return 32 + packet[11] * trace_value_bytes(packet) + packet[13] * sizeof(int32_t);
+}
+
+// Encode one packet against the last one of the same func, or NULL.
+WEAK uint8_t *halide_trace_encode_packet(uint8_t *out, const uint8_t *p, const uint8_t *prev) {
+    out = trace_put_zigzag(out, (int64_t)(int32_t)trace_get(p, 4) -
+                                (prev ? (int32_t)trace_get(prev, 4) : 0));
+    out = trace_put_zigzag(out, (int64_t)(int32_t)trace_get(p + 4, 4) -
+                                (prev ? (int32_t)trace_get(prev + 4, 4) : 0));
+    for (int i = 8; i < 14; i++) {
+        *out++ = p[i];
+    }
+
+    // The previous packet is only a useful guess if it has the same
+    // shape.
+    bool same_shape = prev && prev[9] == p[9] && prev[10] == p[10] &&
+        prev[11] == p[11] && prev[13] == p[13];
+    int bytes = trace_value_bytes(p);
+    int width = p[11], dimensions = p[13];
+    const uint8_t *values = p + 32;
+    const uint8_t *coords = values + width * bytes;
+    const uint8_t *prev_values = same_shape ? prev + 32 : NULL;
+    const uint8_t *prev_coords = same_shape ? prev_values + width * bytes : NULL;
+
+    for (int i = 0; i < dimensions; i++) {
+        int32_t c = (int32_t)trace_get(coords + i * 4, 4);
+        int32_t r = prev_coords ? (int32_t)trace_get(prev_coords + i * 4, 4) : 0;
+        out = trace_put_zigzag(out, (int64_t)c - r);
+    }
+
+    int shift = 64 - bytes * 8;
+    for (int i = 0; i < width; i++) {
+        uint64_t v = trace_get(values + i * bytes, bytes);
+        uint64_t r = prev_values ? trace_get(prev_values + i * bytes, bytes) : 0;
+        if (p[9] == 2) {
+            out = trace_put_varint(out, v ^ r);
+        } else {
+            // The difference, sign-extended from the width of the type.
+            out = trace_put_zigzag(out, (int64_t)((v - r) << shift) >> shift);
+        }
+    }
+    return out;
+}
+
+// Write out the raw packets in a buffer. Returns false if the file
+// can't be written.
+WEAK bool halide_trace_write_buffer(const uint8_t *data, size_t bytes) {
+    if (!halide_trace_compress) {
+        return fwrite(data, 1, bytes, halide_trace_file) == bytes;
+    }
+
+    const uint8_t *p = data, *end = data + bytes;
+    while (p < end) {
+        const uint8_t *last[TRACE_BLOCK_MAX_FUNCS];
+        uint32_t counts[TRACE_BLOCK_MAX_FUNCS];
+        int num_funcs = 0;
+        uint32_t num_packets = 0;
+        uint8_t *out = halide_trace_encoded;
+
+        for (; p < end; p += trace_packet_size(p)) {
+            const char *name = (const char *)p + 14;
+            int f = 0;
+            while (f < num_funcs && strncmp((const char *)last[f] + 14, name, 18)) {
+                f++;
+            }
+            if (f == num_funcs) {
+                if (num_funcs == TRACE_BLOCK_MAX_FUNCS) {
+                    // Start a new block.
+                    break;
+                }
+                last[f] = NULL;
+                counts[f] = 0;
+                num_funcs++;
+            }
+            out = trace_put_varint(out, f);
+            out = halide_trace_encode_packet(out, p, last[f]);
+            last[f] = p;
+            counts[f]++;
+            num_packets++;
+        }
+
+        uint8_t header[16 + TRACE_BLOCK_MAX_FUNCS * 24];
+        uint8_t *h = header;
+        *h++ = 'H'; *h++ = 'L'; *h++ = 'T'; *h++ = 'B';
+        h = trace_put_uint32(h, (uint32_t)(out - halide_trace_encoded));
+        h = trace_put_uint32(h, num_packets);
+        h = trace_put_uint32(h, num_funcs);
+        for (int f = 0; f < num_funcs; f++) {
+            const char *name = (const char *)last[f] + 14;
+            uint8_t len = 0;
+            while (len < 18 && name[len]) len++;
+            *h++ = len;
+            for (int i = 0; i < len; i++) {
+                *h++ = name[i];
+            }
+            h = trace_put_uint32(h, counts[f]);
+        }
+        size_t header_bytes = h - header;
+        size_t data_bytes = out - halide_trace_encoded;
+        if (fwrite(header, 1, header_bytes, halide_trace_file) != header_bytes ||
+            fwrite(halide_trace_encoded, 1, data_bytes, halide_trace_file) != data_bytes) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Swap in the spare buffer if the current one is full, and write out
+// the full one.
+WEAK void halide_trace_buffer_swap(void *user_context) {
+    halide_trace_buffer_acquire_exclusive();
+    if (halide_trace_buffer.end == TRACE_BUFFER_NOT_FULL) {
+        // Another thread got here first.
+        halide_trace_buffer_release_exclusive();
+        return;
+    }
+    halide_trace_buffer_wait_for_write();
+    uint8_t *full = halide_trace_buffer.data;
+    size_t bytes = halide_trace_buffer.end;
+    halide_trace_buffer.data = halide_trace_buffer.spare;
+    halide_trace_buffer.spare = full;
+    halide_trace_buffer.cursor = 0;
+    halide_trace_buffer.end = TRACE_BUFFER_NOT_FULL;
+    halide_trace_buffer.writing = 1;
+    halide_trace_buffer_release_exclusive();
+
+    bool written = halide_trace_write_buffer(full, bytes);
+    __sync_lock_release(&halide_trace_buffer.writing);
+    halide_assert(user_context, written && "Can't write to trace file");
+}
+
+// Reserve space for a packet. The buffer is held shared until the
+// packet is written.
+WEAK uint8_t *halide_trace_buffer_acquire_packet(void *user_context, uint32_t size) {
+    while (true) {
+        halide_trace_buffer_acquire_shared();
+        uint32_t offset = __sync_fetch_and_add(&halide_trace_buffer.cursor, size);
+        if (offset + size <= TRACE_BUFFER_SIZE) {
+            return halide_trace_buffer.data + offset;
+        }
+        if (offset <= TRACE_BUFFER_SIZE) {
+            // The packets before this one are the contents of the
+            // buffer.
+            halide_trace_buffer.end = offset;
+        }
+        halide_trace_buffer_release_shared();
+        halide_trace_buffer_swap(user_context);
+    }
+}
+
+WEAK void halide_trace_init(void *user_context) {
+    while (__sync_lock_test_and_set(&halide_trace_init_lock, 1)) {}
+    if (!halide_trace_initialized) {
+        const char *sample_str = getenv("HL_TRACE_SAMPLE");
+        halide_trace_sample_rate = sample_str ? atoi(sample_str) : 1;
+        if (halide_trace_sample_rate < 1) {
+            halide_trace_sample_rate = 1;
+        }
+        halide_trace_sample_counter = 0;
+
+        const char *events_str = getenv("HL_TRACE_EVENTS");
+        halide_trace_event_mask = 0x3ff;
+        if (events_str) {
+            halide_trace_event_mask = 0;
+            for (int i = 0; i < 10; i++) {
+                if (halide_trace_list_contains(events_str, trace_event_names[i])) {
+                    halide_trace_event_mask |= 1 << i;
+                }
+            }
+        }
+
+        const char *funcs_str = getenv("HL_TRACE_FUNCS");
+        if (funcs_str) {
+            size_t len = 0;
+            while (funcs_str[len]) len++;
+            halide_trace_funcs = (char *)malloc(len + 1);
+            for (size_t i = 0; i <= len; i++) {
+                halide_trace_funcs[i] = funcs_str[i];
+            }
+        }
+
+        const char *trace_file_name = getenv("HL_TRACE_FILE");
+        if (trace_file_name) {
+            halide_trace_file = fopen(trace_file_name, "ab");
+            halide_assert(user_context, halide_trace_file && "Failed to open trace file\n");
+            halide_trace_buffer.data = (uint8_t *)malloc(TRACE_BUFFER_SIZE);
+            halide_trace_buffer.spare = (uint8_t *)malloc(TRACE_BUFFER_SIZE);
+            const char *compress_str = getenv("HL_TRACE_COMPRESS");
+            halide_trace_compress = compress_str && atoi(compress_str);
+            if (halide_trace_compress) {
+                halide_trace_encoded = (uint8_t *)malloc(2 * TRACE_BUFFER_SIZE);
+            }
+            halide_trace_buffer.cursor = 0;
+            halide_trace_buffer.end = TRACE_BUFFER_NOT_FULL;
+        }
+        __sync_synchronize();
+        halide_trace_initialized = true;
+    }
+    __sync_lock_release(&halide_trace_init_lock);
+}
+
 WEAK int32_t halide_trace(void *user_context, const halide_trace_event *e) {
 
     static int32_t ids = 1;
@@ -30,14 +389,30 @@ WEAK int32_t halide_trace(void *user_context, const halide_trace_event *e) {
         int32_t my_id = __sync_fetch_and_add(&ids, 1);
 
         if (!halide_trace_initialized) {
-            const char *trace_file_name = getenv("HL_TRACE_FILE");
-            halide_trace_initialized = true;
-            if (trace_file_name) {
-                halide_trace_file = fopen(trace_file_name, "ab");
-                halide_assert(user_context, halide_trace_file && "Failed to open trace file\n");
+            halide_trace_init(user_context);
+        }
+
+        // Realization markers go on the timeline instead of being
+        // printed, if there is one.
+        if (e->event >= halide_trace_begin_realization &&
+            e->event <= halide_trace_end_consume && halide_timeline_enabled()) {
+            halide_timeline_marker(user_context, e);
+            if (!halide_trace_file) {
+                return my_id;
             }
         }
 
+        // Drop the events that weren't asked for. They still get an
+        // id, so that the ids in the trace stay unique.
+        if (!(halide_trace_event_mask & (1 << e->event)) ||
+            (halide_trace_funcs && !halide_trace_list_contains(halide_trace_funcs, e->func))) {
+            return my_id;
+        }
+        if (e->event <= halide_trace_store && halide_trace_sample_rate > 1 &&
+            __sync_fetch_and_add(&halide_trace_sample_counter, 1) % halide_trace_sample_rate) {
+            return my_id;
+        }
+
         // If we're dumping to a file, use a binary format
         if (halide_trace_file) {
             // A 32-byte header. The first 6 bytes are metadata, then the rest is a zero-terminated string.
@@ -54,8 +429,8 @@ WEAK int32_t halide_trace(void *user_context, const halide_trace_event *e) {
             size_t value_bytes = clamped_width * bytes;
             size_t int_arg_bytes = clamped_dimensions * sizeof(int32_t);
             size_t total_bytes = header_bytes + value_bytes + int_arg_bytes;
-            uint8_t buffer[4096];
             halide_assert(user_context, total_bytes <= 4096 && "Tracing packet too large");
+            uint8_t *buffer = halide_trace_buffer_acquire_packet(user_context, total_bytes);
 
             ((int32_t *)buffer)[0] = my_id;
             ((int32_t *)buffer)[1] = e->parent_id;
@@ -87,9 +462,7 @@ WEAK int32_t halide_trace(void *user_context, const halide_trace_event *e) {
                 buffer[header_bytes + value_bytes + i] = ((uint8_t *)(e->coordinates))[i];
             }
 
-
-            size_t written = fwrite(&buffer[0], 1, total_bytes, halide_trace_file);
-            halide_assert(user_context, written == total_bytes && "Can't write to trace file");
+            halide_trace_buffer_release_shared();
 
         } else {
             char buf[256];
@@ -109,10 +482,12 @@ WEAK int32_t halide_trace(void *user_context, const halide_trace_event *e) {
                                          "Produce",
                                          "Update",
                                          "Consume",
-                                         "End consume"};
+                                         "End consume",
+                                         "Summary",
+                                         "Summary load"};
 
-            // Only print out the value on stores and loads.
-            bool print_value = (e->event < 2);
+            // Only print out the value on stores, loads, and summaries.
+            bool print_value = (e->event < 2 || e->event >= halide_trace_summary);
 
             if (buf_ptr < buf_end) {
                 buf_ptr += snprintf(buf_ptr, buf_end - buf_ptr, "%s %s.%d[",
@@ -159,7 +534,7 @@ WEAK int32_t halide_trace(void *user_context, const halide_trace_event *e) {
                         } else if (print_bits == 32) {
                             buf_ptr += snprintf(buf_ptr, buf_end - buf_ptr, "%d", ((int32_t *)(e->value))[i]);
                         } else {
-                            buf_ptr += snprintf(buf_ptr, buf_end - buf_ptr, "%d", (int32_t)((int64_t *)(e->value))[i]);
+                            buf_ptr += snprintf(buf_ptr, buf_end - buf_ptr, "%lld", (long long)((int64_t *)(e->value))[i]);
                         }
                     } else if (e->type_code == 1) {
                         if (print_bits == 8) {
@@ -197,14 +572,38 @@ WEAK int32_t halide_trace(void *user_context, const halide_trace_event *e) {
 }
 
 WEAK int halide_shutdown_trace() {
+    int ret = 0;
+    while (__sync_lock_test_and_set(&halide_trace_init_lock, 1)) {}
     if (halide_trace_file) {
-        int ret = fclose(halide_trace_file);
+        // Write out what is left in the buffer.
+        halide_trace_buffer_acquire_exclusive();
+        halide_trace_buffer_wait_for_write();
+        size_t bytes = halide_trace_buffer.cursor;
+        if (bytes > halide_trace_buffer.end) {
+            bytes = halide_trace_buffer.end;
+        }
+        if (!halide_trace_write_buffer(halide_trace_buffer.data, bytes)) {
+            ret = -1;
+        }
+        free(halide_trace_buffer.data);
+        free(halide_trace_buffer.spare);
+        free(halide_trace_encoded);
+        halide_trace_encoded = NULL;
+        halide_trace_buffer.data = halide_trace_buffer.spare = NULL;
+        halide_trace_buffer.cursor = 0;
+        halide_trace_buffer.end = TRACE_BUFFER_NOT_FULL;
+        halide_trace_buffer_release_exclusive();
+
+        if (fclose(halide_trace_file)) {
+            ret = -1;
+        }
         halide_trace_file = NULL;
-        halide_trace_initialized = false;
-        return ret;
-    } else {
-        return 0;
     }
+    free(halide_trace_funcs);
+    halide_trace_funcs = NULL;
+    halide_trace_initialized = false;
+    __sync_lock_release(&halide_trace_init_lock);
+    return ret;
 }
 
 }
@@ -20,93 +20,97 @@ extern int halide_printf(void *user_context, const char *, ...);
 #endif
 
 // These sizes are large enough for 32-bit and 64-bit
-typedef uint64_t ConditionVariable;
-typedef uint64_t InitOnce;
 typedef uint64_t Thread;
-typedef struct {
-    uint8_t buf[40];
-} CriticalSection;
+typedef void *SRWLock;
+typedef void *ConditionVariable;
+typedef struct TPWork *ThreadpoolWork;
+typedef void (WIN32API *ThreadpoolWorkCallback)(void *instance, void *context, ThreadpoolWork work);
+
+#define INFINITE (-1)
 
 extern WIN32API Thread CreateThread(void *, size_t, void *(*fn)(void *), void *, int32_t, int32_t *);
-extern WIN32API void InitializeConditionVariable(ConditionVariable *);
+extern WIN32API void AcquireSRWLockExclusive(SRWLock *);
+extern WIN32API void ReleaseSRWLockExclusive(SRWLock *);
+extern WIN32API int32_t SleepConditionVariableSRW(ConditionVariable *, SRWLock *, int32_t, uint32_t);
 extern WIN32API void WakeAllConditionVariable(ConditionVariable *);
-extern WIN32API void SleepConditionVariableCS(ConditionVariable *, CriticalSection *, int);
-extern WIN32API void InitializeCriticalSection(CriticalSection *);
-extern WIN32API void DeleteCriticalSection(CriticalSection *);
-extern WIN32API void EnterCriticalSection(CriticalSection *);
-extern WIN32API void LeaveCriticalSection(CriticalSection *);
+extern WIN32API ThreadpoolWork CreateThreadpoolWork(ThreadpoolWorkCallback, void *, void *);
+extern WIN32API void SubmitThreadpoolWork(ThreadpoolWork);
+extern WIN32API void WaitForThreadpoolWorkCallbacks(ThreadpoolWork, int32_t cancel_pending);
+extern WIN32API void CloseThreadpoolWork(ThreadpoolWork);
 extern WIN32API int32_t WaitForSingleObject(Thread, int32_t timeout);
-extern WIN32API bool InitOnceExecuteOnce(InitOnce *, 
-  bool WIN32API (*f)(InitOnce *, void *, void **), void *, void **);
-
+extern WIN32API int32_t GetCurrentThreadId();
+extern WIN32API int32_t CloseHandle(Thread);
+
+// Timing of parallel loops, for HL_TIMELINE_FILE (see timeline.cpp).
+struct halide_timeline_job;
+extern halide_timeline_job *halide_timeline_job_begin(void *user_context);
+extern int64_t halide_timeline_task_begin(void *user_context, halide_timeline_job *job);
+extern void halide_timeline_task_end(void *user_context, halide_timeline_job *job,
+                                     int task, int64_t begin_ns);
+extern void halide_timeline_job_end(void *user_context, halide_timeline_job *job, int size);
+
+// Parallel loops run on the thread pool that Windows (Vista and
+// later) keeps for each process, which sizes itself to the machine
+// and the load. The thread calling halide_do_par_for submits a work
+// item per extra thread it wants, and then claims tasks alongside
+// them with an atomic counter, so no lock is held while handing out
+// tasks, and nested parallel loops can't deadlock: whoever runs the
+// loop finishes any tasks the pool doesn't get to.
+#define MAX_THREADS 64
 
 struct work {
-    work *next_job;
     int (*f)(void *, int, uint8_t *);
     void *user_context;
-    int next, max;
     uint8_t *closure;
-    int active_workers;
+    int next, max;
     int exit_status;
-    bool running() { return next < max || active_workers > 0; }
+    // Non-NULL if the tasks are being timed.
+    halide_timeline_job *timeline;
 };
 
-// The work queue and thread pool is weak, so one big work queue is shared by all halide functions
-#define MAX_THREADS 64
-WEAK struct {
-    // Initialization of the critical section is guarded by this
-    InitOnce init_once; 
-
-    // all fields are protected by this mutex.
-    CriticalSection mutex;
-
-    // Singly linked list for job stack
-    work *jobs;
-
-    // Broadcast whenever items are added to the queue or a job completes.
-    ConditionVariable state_change;
-    // Keep track of threads so they can be joined at shutdown
-    Thread threads[MAX_THREADS];
+// Zero until set by halide_set_num_threads.
+WEAK int halide_threads;
 
-    // Global flag indicating
-    bool shutdown;
+// The OS owns the threads, so there's nothing to shut down.
+WEAK void halide_shutdown_thread_pool() {
+}
 
-    bool running() {
-        return !shutdown;
+// Takes effect from the next parallel loop.
+WEAK int halide_set_num_threads(int n) {
+    int old = halide_threads;
+    if (n > MAX_THREADS) {
+        n = MAX_THREADS;
     }
+    halide_threads = n < 0 ? 0 : n;
+    return old;
+}
 
-} halide_work_queue;
+// There is only one pool here, so every pool is the shared one.
+WEAK void *halide_create_thread_pool(int num_threads, int priority) {
+    return NULL;
+}
 
-WEAK bool WIN32API InitOnceCallback(InitOnce *, void *, void **) {
-    InitializeCriticalSection(&halide_work_queue.mutex);
-    return true;
+WEAK void halide_destroy_thread_pool(void *pool) {
 }
 
-WEAK int halide_threads;
-WEAK bool halide_thread_pool_initialized = false;
+WEAK int halide_set_thread_pool(void *user_context, void *pool) {
+    return 0;
+}
 
-WEAK void halide_shutdown_thread_pool() {
-    if (!halide_thread_pool_initialized) return;
-
-    // Wake everyone up and tell them the party's over and it's time
-    // to go home
-    EnterCriticalSection(&halide_work_queue.mutex);
-    halide_work_queue.shutdown = true;
-    WakeAllConditionVariable(&halide_work_queue.state_change);
-    LeaveCriticalSection(&halide_work_queue.mutex);
-
-    // Wait until they leave
-    for (int i = 0; i < halide_threads-1; i++) {
-        //fprintf(stderr, "Waiting for thread %d to exit\n", i);
-        WaitForSingleObject(halide_work_queue.threads[i], -1);
-    }
+WEAK void halide_set_thread_pool_wakeup(void *pool, int spin_count, int targeted_wakeup) {
+}
 
-    //fprintf(stderr, "All threads have quit. Destroying mutex and condition variable.\n");
-    // Tidy up
-    DeleteCriticalSection(&halide_work_queue.mutex);
-    halide_work_queue.init_once = 0;
-    //DestroyConditionVariable(&halide_work_queue.state_change);
-    halide_thread_pool_initialized = false;
+WEAK int halide_get_num_threads(void *user_context) {
+    if (halide_threads > 0) {
+        return halide_threads;
+    }
+    char *threadStr = getenv("HL_NUMTHREADS");
+    if (!threadStr) {
+        threadStr = getenv("NUMBER_OF_PROCESSORS");
+    }
+    int threads = threadStr ? atoi(threadStr) : 8;
+    if (threads > MAX_THREADS) return MAX_THREADS;
+    return threads < 1 ? 1 : threads;
 }
 
 typedef int (*halide_task)(void *user_context, int, uint8_t *);
@@ -123,6 +127,103 @@ WEAK void halide_set_custom_do_par_for(int (*f)(void *, halide_task, int, int, u
     halide_custom_do_par_for = f;
 }
 
+// Counting semaphores, used to keep the producer of a folded buffer
+// a bounded distance ahead of its consumer (see Func::async). A task
+// that fails abandons them, after which acquiring one fails at once.
+struct halide_semaphore {
+    SRWLock mutex;
+    ConditionVariable cond;
+    int count;
+    bool abandoned;
+};
+
+extern void *halide_malloc(void *user_context, size_t);
+extern void halide_free(void *user_context, void *ptr);
+
+WEAK halide_semaphore *halide_make_semaphore(void *user_context, int count) {
+    halide_semaphore *sem = (halide_semaphore *)halide_malloc(user_context, sizeof(halide_semaphore));
+    if (!sem) return NULL;
+    // Zero is the initial state of both.
+    sem->mutex = NULL;
+    sem->cond = NULL;
+    sem->count = count;
+    sem->abandoned = false;
+    return sem;
+}
+
+WEAK int halide_semaphore_acquire(halide_semaphore *sem) {
+    AcquireSRWLockExclusive(&sem->mutex);
+    while (sem->count == 0 && !sem->abandoned) {
+        SleepConditionVariableSRW(&sem->cond, &sem->mutex, INFINITE, 0);
+    }
+    int result = -1;
+    if (!sem->abandoned) {
+        sem->count--;
+        result = 0;
+    }
+    ReleaseSRWLockExclusive(&sem->mutex);
+    return result;
+}
+
+WEAK int halide_semaphore_abandon(halide_semaphore *sem) {
+    AcquireSRWLockExclusive(&sem->mutex);
+    sem->abandoned = true;
+    ReleaseSRWLockExclusive(&sem->mutex);
+    WakeAllConditionVariable(&sem->cond);
+    return 0;
+}
+
+WEAK int halide_semaphore_release(halide_semaphore *sem) {
+    AcquireSRWLockExclusive(&sem->mutex);
+    sem->count++;
+    ReleaseSRWLockExclusive(&sem->mutex);
+    WakeAllConditionVariable(&sem->cond);
+    return 0;
+}
+
+WEAK int halide_free_semaphore(void *user_context, halide_semaphore *sem) {
+    if (!sem) return 0;
+    halide_free(user_context, sem);
+    return 0;
+}
+
+// Parallel loops use up to halide_get_num_threads threads, including
+// the caller, so async producers are promised the others.
+WEAK volatile int halide_reserved_workers = 0;
+
+WEAK int halide_reserve_worker(void *user_context) {
+    if (halide_custom_do_par_for) return 0;
+    int workers = halide_get_num_threads(user_context) - 1;
+    int reserved = __sync_add_and_fetch(&halide_reserved_workers, 1);
+    if (reserved > workers) {
+        __sync_sub_and_fetch(&halide_reserved_workers, 1);
+        return 0;
+    }
+    return 1;
+}
+
+WEAK int halide_release_worker(void *user_context, int reserved) {
+    if (!reserved) return 0;
+    __sync_sub_and_fetch(&halide_reserved_workers, 1);
+    return 0;
+}
+
+WEAK size_t halide_current_thread_id() {
+    return (size_t)(uint32_t)GetCurrentThreadId();
+}
+
+// Start a thread of its own, outside of the pool, for work that runs
+// in the background (see write_debug_image.cpp). Returns NULL if the
+// thread couldn't be started.
+WEAK void *halide_spawn_thread(void *(*f)(void *), void *closure) {
+    return (void *)(size_t)CreateThread(NULL, 0, f, closure, 0, NULL);
+}
+
+WEAK void halide_join_thread(void *thread) {
+    WaitForSingleObject((Thread)(size_t)thread, -1);
+    CloseHandle((Thread)(size_t)thread);
+}
+
 WEAK int halide_do_task(void *user_context, halide_task f, int idx,
                         uint8_t *closure) {
     if (halide_custom_do_task) {
@@ -132,74 +233,25 @@ WEAK int halide_do_task(void *user_context, halide_task f, int idx,
     }
 }
 
-WEAK void *halide_worker_thread(void *void_arg) {
-    work *owned_job = (work *)void_arg;
-
-    // halide_printf(NULL, "Worker starting\n");
-
-    // Grab the lock
-    EnterCriticalSection(&halide_work_queue.mutex);
-
-    // If I'm a job owner, then I was the thread that called
-    // do_par_for, and I should only stay in this function until my
-    // job is complete. If I'm a lowly worker thread, I should stay in
-    // this function as long as the work queue is running.
-    while (owned_job != NULL ? owned_job->running()
-           : halide_work_queue.running()) {
-
-        if (halide_work_queue.jobs == NULL) {
-            // There are no jobs pending, though some tasks may still
-            // be in flight from the last job. Release the lock and
-            // wait for something new to happen.
-            // halide_printf(NULL, "Worker sleeping\n");
-            SleepConditionVariableCS(&halide_work_queue.state_change, &halide_work_queue.mutex, -1);
-        } else {
-            // There are jobs still to do. Grab the next one.
-            work *job = halide_work_queue.jobs;
-
-            // Claim a task from it.
-            work myjob = *job;
-            job->next++;
-
-            // If there were no more tasks pending for this job, or if
-            // it has failed, remove it from the stack.
-            if (job->next == job->max) {
-                halide_work_queue.jobs = job->next_job;
-            }
-
-            // Increment the active_worker count so that other threads
-            // are aware that this job is still in progress even
-            // though there are no outstanding tasks for it.
-            job->active_workers++;
-
-            // Release the lock and do the task.
-            // halide_printf(NULL, "Worker about to work\n");
-            LeaveCriticalSection(&halide_work_queue.mutex);
-            // halide_printf(NULL, "Worker doing work\n");
-            int result = halide_do_task(myjob.user_context, myjob.f, myjob.next,
-                                        myjob.closure);
-            EnterCriticalSection(&halide_work_queue.mutex);
-            // halide_printf(NULL, "Worker done work\n");
-
-            // If this task failed, set the exit status on the job.
-            if (result) {
-                job->exit_status = result;
-            }
-
-            // We are no longer active on this job
-            job->active_workers--;
-
-            // If the job is done and I'm not the owner of it, wake up
-            // the owner.
-            if (!job->running() && job != owned_job) {
-                // halide_printf(NULL, "Job done. Wake up the owner.\n");
-                WakeAllConditionVariable(&halide_work_queue.state_change);
-            }
+// Claim and run tasks of the job until there are none left.
+WEAK void halide_run_tasks(work *job) {
+    while (true) {
+        int idx = __sync_fetch_and_add(&job->next, 1);
+        if (idx >= job->max) break;
+        int64_t begin = halide_timeline_task_begin(job->user_context, job->timeline);
+        int result = halide_do_task(job->user_context, job->f, idx, job->closure);
+        halide_timeline_task_end(job->user_context, job->timeline, idx, begin);
+        if (result) {
+            // Keep the first failure, and give up on the tasks
+            // nobody has claimed yet.
+            __sync_bool_compare_and_swap(&job->exit_status, 0, result);
+            __sync_lock_test_and_set(&job->next, job->max);
         }
     }
-    // halide_printf(NULL, "Worker quitting\n");
-    LeaveCriticalSection(&halide_work_queue.mutex);
-    return NULL;
+}
+
+WEAK void WIN32API halide_worker_callback(void *instance, void *context, ThreadpoolWork w) {
+    halide_run_tasks((work *)context);
 }
 
 WEAK int halide_do_par_for(void *user_context, int (*f)(void *, int, uint8_t *),
@@ -208,46 +260,7 @@ WEAK int halide_do_par_for(void *user_context, int (*f)(void *, int, uint8_t *),
         return (*halide_custom_do_par_for)(user_context, f, min, size, closure);
     }
 
-    // halide_printf(user_context, "In do_par_for\n");
-
-    // Create the mutex
-    InitOnceExecuteOnce(&halide_work_queue.init_once, InitOnceCallback, NULL, NULL);
-    
-    // halide_printf(user_context, "Grabbing mutex\n");
-
-    // Grab it
-    EnterCriticalSection(&halide_work_queue.mutex);
-
-    if (!halide_thread_pool_initialized) {
-        halide_work_queue.shutdown = false;
-        
-        //  halide_printf(user_context, "Making condition variable\n");
-
-        InitializeConditionVariable(&halide_work_queue.state_change);
-        halide_work_queue.jobs = NULL;
-
-        char *threadStr = getenv("HL_NUMTHREADS");
-        if (!threadStr) {
-            threadStr = getenv("NUMBER_OF_PROCESSORS"); // Apparently a standard windows environment variable
-        }
-        if (threadStr) {
-            halide_threads = atoi(threadStr);
-        } else {
-            halide_threads = 8;
-            // halide_printf(user_context, "HL_NUMTHREADS not defined. Defaulting to %d threads.\n", halide_threads);
-        }
-        if (halide_threads > MAX_THREADS) {
-            halide_threads = MAX_THREADS;
-        } else if (halide_threads < 1) {
-            halide_threads = 1;
-        }
-        for (int i = 0; i < halide_threads-1; i++) {
-            // halide_printf(user_context, "Creating thread %d\n", i);
-            halide_work_queue.threads[i] = CreateThread(NULL, 0, halide_worker_thread, NULL, 0, NULL);
-        }
-
-        halide_thread_pool_initialized = true;
-    }
+    halide_timeline_job *timeline = halide_timeline_job_begin(user_context);
 
     // Make the job.
     work job;
@@ -257,24 +270,39 @@ WEAK int halide_do_par_for(void *user_context, int (*f)(void *, int, uint8_t *),
     job.max  = min + size;   // Keep going until one less than this index.
     job.closure = closure;   // Use this closure.
     job.exit_status = 0;     // The job hasn't failed yet
-    job.active_workers = 0;  // Nobody is working on this yet
+    job.timeline = timeline; // Whether to time the tasks
 
-    // Push the job onto the stack.
-    job.next_job = halide_work_queue.jobs;
-    halide_work_queue.jobs = &job;
-    
-    // halide_printf(user_context, "Releasing mutex\n");
-    LeaveCriticalSection(&halide_work_queue.mutex);
+    // This thread is one of them.
+    int helpers = halide_get_num_threads(user_context) - 1;
+    if (helpers > size - 1) {
+        helpers = size - 1;
+    }
 
-    // Wake up any idle worker threads.
-    // halide_printf(user_context, "Waking up workers\n");
-    WakeAllConditionVariable(&halide_work_queue.state_change);
+    ThreadpoolWork w = NULL;
+    if (helpers > 0) {
+        w = CreateThreadpoolWork(halide_worker_callback, &job, NULL);
+    }
+    if (w) {
+        for (int i = 0; i < helpers; i++) {
+            SubmitThreadpoolWork(w);
+        }
+    }
 
     // Do some work myself.
-    halide_worker_thread((void *)(&job));
+    halide_run_tasks(&job);
+
+    if (w) {
+        // All the tasks have been claimed, so the work items that
+        // haven't started have nothing to do. Cancel them, and wait
+        // for the ones running the last tasks.
+        WaitForThreadpoolWorkCallbacks(w, 1);
+        CloseThreadpoolWork(w);
+    }
+
+    halide_timeline_job_end(user_context, timeline, size);
 
     // Return zero if the job succeeded, otherwise return the exit
-    // status of one of the failing jobs (whichever one failed last).
+    // status of the first failing task.
     return job.exit_status;
 }
 
@@ -5,6 +5,18 @@
 extern "C" void *fopen(const char *, const char *);
 extern "C" int fclose(void *);
 extern "C" size_t fwrite(const void *, size_t, size_t, void *);
+extern "C" char *getenv(const char *);
+extern "C" int atoi(const char *);
+extern "C" void *malloc(size_t);
+extern "C" void free(void *);
+extern "C" void *memcpy(void *, const void *, size_t);
+extern "C" size_t strlen(const char *);
+extern "C" void *halide_spawn_thread(void *(*f)(void *), void *closure);
+extern "C" void halide_join_thread(void *thread);
+
+#ifndef NULL
+#define NULL 0
+#endif
 
 // Use TIFF because it meets the following criteria:
 // - Supports uncompressed data
@@ -46,6 +58,8 @@ struct tiff_tag {
         this->tag_code = tag_code;
         this->type_code = 3;
         this->count = count;
+        // Don't leave the other half of the value uninitialized.
+        this->value.i32 = 0;
         this->value.i16 = value;
     }
 
@@ -103,13 +117,47 @@ bool has_tiff_extension(const char *filename) {
     return *f == '\0';
 }
 
+// Where an image goes: straight to a file, or into memory, to be
+// written to a file later.
+struct debug_image_writer {
+    void *file;
+    uint8_t *dst;
+
+    bool write(const void *src, size_t size) {
+        if (file) {
+            return fwrite(src, size, 1, file) == 1;
+        }
+        memcpy(dst, src, size);
+        dst += size;
+        return true;
+    }
+};
+
+// The size of the file halide_write_debug_image writes.
+size_t debug_image_size(const char *filename, int32_t s0, int32_t s1, int32_t s2, int32_t s3,
+                        int32_t bytes_per_element) {
+    size_t size = (size_t)s0 * s1 * s2 * s3 * bytes_per_element;
+    if (!has_tiff_extension(filename)) {
+        return size + 5 * sizeof(int32_t);
+    }
+    int32_t channels = ((s3 == 0 || s3 == 1) && (s2 < 5)) ? s2 : s3;
+    size += sizeof(halide_tiff_header);
+    if (channels > 1) {
+        size += channels * sizeof(int32_t) * 2;
+    }
+    return size;
 }
 
-WEAK extern "C" int32_t halide_debug_to_file(void *user_context, const char *filename, uint8_t *data,
-                                             int32_t s0, int32_t s1, int32_t s2, int32_t s3,
-                                             int32_t type_code, int32_t bytes_per_element) {
-    void *f = fopen(filename, "wb");
-    if (!f) return -1;
+}
+
+extern "C" {
+
+// Write the image to f, or if f is NULL, copy it to dst, which must
+// have room for debug_image_size bytes.
+WEAK int32_t halide_write_debug_image(void *f, uint8_t *dst, const char *filename, uint8_t *data,
+                                      int32_t s0, int32_t s1, int32_t s2, int32_t s3,
+                                      int32_t type_code, int32_t bytes_per_element) {
+    debug_image_writer out = {f, dst};
 
     size_t elts = s0;
     elts *= s1*s2*s3;
@@ -169,8 +217,7 @@ WEAK extern "C" int32_t halide_debug_to_file(void *user_context, const char *fil
 	header.height_resolution[0] = 1;
 	header.height_resolution[1] = 1;
 
-	if (!fwrite((void *)(&header), sizeof(header), 1, f)) {
-            fclose(f);
+	if (!out.write((void *)(&header), sizeof(header))) {
 	    return -2;
         }
 
@@ -178,33 +225,227 @@ WEAK extern "C" int32_t halide_debug_to_file(void *user_context, const char *fil
 	  int32_t offset = sizeof(header) + channels * sizeof(int32_t) * 2;
 
 	  for (int32_t i = 0; i < channels; i++) {
-              if (!fwrite((void*)(&offset), 4, 1, f)) {
-                  fclose(f);
+              if (!out.write((void*)(&offset), 4)) {
                   return -2;
               }
               offset += s0 * s1 * depth * bytes_per_element;
 	  }
 	  int32_t count = s0 * s1 * depth;
 	  for (int32_t i = 0; i < channels; i++) {
-              if (!fwrite((void*)(&count), 4, 1, f)) {
-                  fclose(f);
+              if (!out.write((void*)(&count), 4)) {
                   return -2;
               }
 	  }
 	}
     } else {
         int32_t header[] = {s0, s1, s2, s3, type_code};
-        if (!fwrite((void *)(&header[0]), sizeof(header), 1, f)) {
-            fclose(f);
+        if (!out.write((void *)(&header[0]), sizeof(header))) {
             return -2;
         }
     }
 
-    if (fwrite((void *)data, bytes_per_element * elts, 1, f)) {
-        fclose(f);
-        return 0;
+    return out.write((void *)data, bytes_per_element * elts) ? 0 : -1;
+}
+
+// With HL_DEBUG_TO_FILE_ASYNC=1, halide_debug_to_file copies the
+// image into memory and hands it to a background thread, which
+// writes it out, so the pipeline only waits for the copy. The thread
+// is started when there is something to write, and exits when there
+// is nothing left. If more than HL_DEBUG_TO_FILE_MAX_PENDING_MB
+// megabytes (256 by default) are waiting to be written, images are
+// written by the pipeline instead. With HL_DEBUG_TO_FILE_EVERY=N,
+// only every Nth image sent to each file name is written, so that
+// debug_to_file can be left in production code.
+
+// An image waiting to be written, followed by its file name and the
+// file contents.
+struct halide_debug_file_job {
+    halide_debug_file_job *next;
+    const char *filename;
+    uint8_t *contents;
+    size_t size;
+};
+
+// The most file names whose images are counted separately for
+// HL_DEBUG_TO_FILE_EVERY. The rest share a count.
+#define DEBUG_FILE_NAMES 64
+
+WEAK struct {
+    int lock, thread_lock;
+    volatile bool initialized;
+    bool async;
+    int every;
+    int64_t max_pending;
+    volatile int64_t pending;
+    halide_debug_file_job *head, *tail;
+    volatile bool running;
+    void *thread;
+    // The number of images sent to each file name, keyed on the
+    // address of the name in the generated code.
+    const char *volatile names[DEBUG_FILE_NAMES];
+    int counts[DEBUG_FILE_NAMES + 1];
+} halide_debug_file = {0};
+
+WEAK void halide_debug_file_lock(int *lock) {
+    while (__sync_lock_test_and_set(lock, 1)) {
+        while (*(volatile int *)lock) {}
+    }
+}
+
+WEAK void halide_debug_file_unlock(int *lock) {
+    __sync_lock_release(lock);
+}
+
+WEAK void halide_debug_file_init() {
+    halide_debug_file_lock(&halide_debug_file.lock);
+    if (!halide_debug_file.initialized) {
+        char *async_str = getenv("HL_DEBUG_TO_FILE_ASYNC");
+        halide_debug_file.async = async_str && atoi(async_str) != 0;
+        char *every_str = getenv("HL_DEBUG_TO_FILE_EVERY");
+        halide_debug_file.every = every_str ? atoi(every_str) : 1;
+        if (halide_debug_file.every < 1) halide_debug_file.every = 1;
+        char *pending_str = getenv("HL_DEBUG_TO_FILE_MAX_PENDING_MB");
+        int pending_mb = pending_str ? atoi(pending_str) : 256;
+        halide_debug_file.max_pending = (int64_t)(pending_mb < 0 ? 0 : pending_mb) << 20;
+        __sync_synchronize();
+        halide_debug_file.initialized = true;
+    }
+    halide_debug_file_unlock(&halide_debug_file.lock);
+}
+
+// Count an image sent to a file name, and decide whether to write it.
+WEAK bool halide_debug_file_sample(const char *filename) {
+    if (halide_debug_file.every == 1) return true;
+    unsigned h = (unsigned)(((size_t)filename >> 3) % DEBUG_FILE_NAMES);
+    int slot = DEBUG_FILE_NAMES;
+    for (int i = 0; i < DEBUG_FILE_NAMES; i++) {
+        int j = (h + i) % DEBUG_FILE_NAMES;
+        if (!halide_debug_file.names[j]) {
+            __sync_bool_compare_and_swap(&halide_debug_file.names[j], (const char *)NULL, filename);
+        }
+        // Another thread may have taken the entry, for this name or
+        // another one.
+        if (halide_debug_file.names[j] == filename) {
+            slot = j;
+            break;
+        }
+    }
+    int count = __sync_fetch_and_add(&halide_debug_file.counts[slot], 1);
+    return count % halide_debug_file.every == 0;
+}
+
+WEAK void halide_debug_file_write_job(halide_debug_file_job *job) {
+    void *f = fopen(job->filename, "wb");
+    if (!f || fwrite(job->contents, job->size, 1, f) != 1) {
+        halide_printf(NULL, "Could not write debug image %s\n", job->filename);
+    }
+    if (f) fclose(f);
+    __sync_fetch_and_sub(&halide_debug_file.pending, (int64_t)job->size);
+    free(job);
+}
+
+WEAK void *halide_debug_file_writer(void *) {
+    while (true) {
+        halide_debug_file_lock(&halide_debug_file.lock);
+        halide_debug_file_job *job = halide_debug_file.head;
+        if (!job) {
+            halide_debug_file.running = false;
+            halide_debug_file_unlock(&halide_debug_file.lock);
+            return NULL;
+        }
+        halide_debug_file.head = job->next;
+        halide_debug_file_unlock(&halide_debug_file.lock);
+        halide_debug_file_write_job(job);
+    }
+}
+
+// Queue an image to be written. Returns false if it should be written
+// synchronously instead.
+WEAK bool halide_debug_file_queue(const char *filename, uint8_t *data,
+                                  int32_t s0, int32_t s1, int32_t s2, int32_t s3,
+                                  int32_t type_code, int32_t bytes_per_element) {
+    size_t size = debug_image_size(filename, s0, s1, s2, s3, bytes_per_element);
+    if (__sync_add_and_fetch(&halide_debug_file.pending, (int64_t)size) > halide_debug_file.max_pending) {
+        __sync_fetch_and_sub(&halide_debug_file.pending, (int64_t)size);
+        return false;
+    }
+    size_t name_len = strlen(filename) + 1;
+    halide_debug_file_job *job =
+        (halide_debug_file_job *)malloc(sizeof(halide_debug_file_job) + name_len + size);
+    if (!job) {
+        __sync_fetch_and_sub(&halide_debug_file.pending, (int64_t)size);
+        return false;
+    }
+    char *name = (char *)(job + 1);
+    memcpy(name, filename, name_len);
+    job->next = NULL;
+    job->filename = name;
+    job->contents = (uint8_t *)name + name_len;
+    job->size = size;
+    halide_write_debug_image(NULL, job->contents, filename, data, s0, s1, s2, s3,
+                             type_code, bytes_per_element);
+
+    halide_debug_file_lock(&halide_debug_file.lock);
+    if (halide_debug_file.head) {
+        halide_debug_file.tail->next = job;
     } else {
-        fclose(f);
-        return -1;
+        halide_debug_file.head = job;
     }
+    halide_debug_file.tail = job;
+    bool start = !halide_debug_file.running;
+    halide_debug_file.running = true;
+    halide_debug_file_unlock(&halide_debug_file.lock);
+
+    if (start) {
+        // The last writer has emptied the queue, or is about to exit.
+        halide_debug_file_lock(&halide_debug_file.thread_lock);
+        if (halide_debug_file.thread) {
+            halide_join_thread(halide_debug_file.thread);
+        }
+        halide_debug_file.thread = halide_spawn_thread(halide_debug_file_writer, NULL);
+        halide_debug_file_unlock(&halide_debug_file.thread_lock);
+        if (!halide_debug_file.thread) {
+            halide_debug_file_writer(NULL);
+        }
+    }
+    return true;
+}
+
+WEAK int32_t halide_debug_to_file(void *user_context, const char *filename, uint8_t *data,
+                                  int32_t s0, int32_t s1, int32_t s2, int32_t s3,
+                                  int32_t type_code, int32_t bytes_per_element) {
+    if (!halide_debug_file.initialized) {
+        halide_debug_file_init();
+    }
+    if (!halide_debug_file_sample(filename)) {
+        return 0;
+    }
+    if (halide_debug_file.async &&
+        halide_debug_file_queue(filename, data, s0, s1, s2, s3, type_code, bytes_per_element)) {
+        return 0;
+    }
+
+    void *f = fopen(filename, "wb");
+    if (!f) return -1;
+    int32_t result = halide_write_debug_image(f, NULL, filename, data, s0, s1, s2, s3,
+                                              type_code, bytes_per_element);
+    fclose(f);
+    return result;
+}
+
+WEAK void halide_debug_to_file_wait() {
+    while (true) {
+        // Don't hold the lock while waiting, or a writer can't be
+        // started for the images queued meanwhile.
+        halide_debug_file_lock(&halide_debug_file.thread_lock);
+        bool done = !halide_debug_file.running;
+        if (done && halide_debug_file.thread) {
+            halide_join_thread(halide_debug_file.thread);
+            halide_debug_file.thread = NULL;
+        }
+        halide_debug_file_unlock(&halide_debug_file.thread_lock);
+        if (done) return;
+    }
+}
+
 }
@@ -0,0 +1,104 @@
+#include "mini_stdint.h"
+#include "HalideRuntime.h"
+
+#define WEAK __attribute__((weak))
+
+extern "C" {
+
+namespace {
+
+// The same bits as Target::Features.
+const uint64_t feature_sse41 = 2;
+const uint64_t feature_avx = 4;
+const uint64_t feature_avx2 = 8;
+const uint64_t feature_fma = 2048;
+const uint64_t feature_f16c = 4096;
+const uint64_t feature_avx512 = 8192;
+
+// Set in the cache once the features have been found.
+const uint64_t features_known = (uint64_t)1 << 63;
+
+void cpuid(int32_t info[4], int32_t leaf, int32_t subleaf) {
+#ifdef BITS_32
+    // ebx holds the GOT pointer in position-independent code.
+    __asm__ __volatile__("xchgl %%ebx, %%esi\n\tcpuid\n\txchgl %%ebx, %%esi"
+                         : "=a"(info[0]), "=S"(info[1]), "=c"(info[2]), "=d"(info[3])
+                         : "a"(leaf), "c"(subleaf));
+#else
+    __asm__ __volatile__("cpuid"
+                         : "=a"(info[0]), "=b"(info[1]), "=c"(info[2]), "=d"(info[3])
+                         : "a"(leaf), "c"(subleaf));
+#endif
+}
+
+// Which register states the OS saves on a context switch.
+uint64_t xgetbv() {
+    uint32_t lo, hi;
+    __asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+}
+
+// Shared by every pipeline linked into the program, so that cpuid
+// only runs once. Racing to fill it in is harmless.
+WEAK uint64_t halide_cpu_features_cache = 0;
+
+WEAK uint64_t halide_get_cpu_features() {
+    uint64_t features = halide_cpu_features_cache;
+    if (features & features_known) {
+        return features & ~features_known;
+    }
+
+    features = 0;
+    int32_t info[4];
+    cpuid(info, 0, 0);
+    int32_t max_leaf = info[0];
+
+    cpuid(info, 1, 0);
+    const int32_t ecx = info[2];
+    if (ecx & (1 << 19)) features |= feature_sse41;
+
+    // AVX also needs the OS to save the ymm registers.
+    bool os_saves_ymm = false, os_saves_zmm = false;
+    if (ecx & (1 << 27)) {
+        uint64_t xcr0 = xgetbv();
+        os_saves_ymm = (xcr0 & 0x6) == 0x6;
+        os_saves_zmm = (xcr0 & 0xe6) == 0xe6;
+    }
+    if (os_saves_ymm) {
+        if (ecx & (1 << 28)) features |= feature_avx;
+        if (ecx & (1 << 12)) features |= feature_fma;
+        if (ecx & (1 << 29)) features |= feature_f16c;
+        if (max_leaf >= 7) {
+            cpuid(info, 7, 0);
+            const int32_t ebx = info[1];
+            if (ebx & (1 << 5)) features |= feature_avx2;
+            if (os_saves_zmm && (ebx & (1 << 16)) && (ebx & (1 << 30))) {
+                features |= feature_avx512;
+            }
+        }
+    }
+
+    halide_cpu_features_cache = features | features_known;
+    return features;
+}
+
+WEAK uint64_t halide_read_cycle_counter() {
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// The time stamp counter ticks at a constant rate, which must be
+// measured, only if it's invariant. Otherwise it changes with the
+// clock rate of each core, and can't be used as a clock.
+WEAK int64_t halide_cycle_counter_frequency() {
+    int32_t info[4];
+    cpuid(info, 0x80000000, 0);
+    if ((uint32_t)info[0] < 0x80000007) return -1;
+    cpuid(info, 0x80000007, 0);
+    return (info[3] & (1 << 8)) ? 0 : -1;
+}
+
+}
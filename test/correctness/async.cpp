@@ -0,0 +1,74 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int task_loops = 0;
+
+// Run the tasks serially, counting the parallel loops with one task
+// per async producer.
+extern "C" int count_task_loops(void *user_context, int (*f)(void *, int, uint8_t *),
+                                int min, int size, uint8_t *closure) {
+    if (min == 0 && size == 2) task_loops++;
+    for (int i = min; i < min + size; i++) {
+        int result = f(user_context, i, closure);
+        if (result) return result;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    // Two independent branches feeding one consumer.
+    Func luma, chroma, out;
+    luma(x, y) = x + y;
+    chroma(x, y) = x * y;
+    out(x, y) = luma(x, y) + chroma(x, y) * 2;
+
+    luma.compute_root().async().parallel(y);
+    chroma.compute_root().async().vectorize(x, 4);
+
+    Image<int> im = out.realize(100, 100);
+    for (int y = 0; y < 100; y++) {
+        for (int x = 0; x < 100; x++) {
+            int correct = x + y + x * y * 2;
+            if (im(x, y) != correct) {
+                printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    out.set_custom_do_par_for(count_task_loops);
+    out.realize(100, 100);
+    if (task_loops != 1) {
+        printf("Expected the two branches to be computed as one pair of tasks\n");
+        return -1;
+    }
+
+    // A producer that depends on another async producer has to wait
+    // for it.
+    Func a, b, c, out2;
+    a(x, y) = x + y;
+    b(x, y) = a(x, y) * 2;
+    c(x, y) = x - y;
+    out2(x, y) = b(x, y) + c(x, y);
+    a.compute_root().async();
+    b.compute_root().async();
+    c.compute_root().async();
+
+    Image<int> im2 = out2.realize(100, 100);
+    for (int y = 0; y < 100; y++) {
+        for (int x = 0; x < 100; x++) {
+            int correct = (x + y) * 2 + x - y;
+            if (im2(x, y) != correct) {
+                printf("im2(%d, %d) = %d instead of %d\n", x, y, im2(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
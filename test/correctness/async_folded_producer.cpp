@@ -0,0 +1,76 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+// Gives up after a number of polls.
+int polls = 0;
+int my_is_cancelled(void *user_context) {
+    return __sync_add_and_fetch(&polls, 1) > 50;
+}
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    // A producer computed a scanline at a time into a folded buffer,
+    // running ahead of its consumer on another thread.
+    Func f, g;
+    f(x, y) = x * 3 + y * 5;
+    g(x, y) = f(x, y-1) + f(x, y) + f(x, y+1);
+    f.store_root().compute_at(g, y).async();
+
+    Image<int> im = g.realize(64, 200);
+    for (int y = 0; y < 200; y++) {
+        for (int x = 0; x < 64; x++) {
+            int correct = 3 * (x * 3 + y * 5);
+            if (im(x, y) != correct) {
+                printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    // The same with a vectorized producer, and a consumer that is
+    // itself computed per scanline.
+    Func a, b, c;
+    a(x, y) = x + y;
+    b(x, y) = a(x, y-2) + a(x, y+2);
+    c(x, y) = b(x, y) * 2;
+    a.store_root().compute_at(c, y).vectorize(x, 4).async();
+    b.compute_at(c, y);
+
+    Image<int> im2 = c.realize(64, 200);
+    for (int y = 0; y < 200; y++) {
+        for (int x = 0; x < 64; x++) {
+            int correct = 2 * ((x + y - 2) + (x + y + 2));
+            if (im2(x, y) != correct) {
+                printf("im2(%d, %d) = %d instead of %d\n", x, y, im2(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    // A cancelled producer or consumer must not leave the other
+    // waiting for it.
+    {
+        Target target = get_jit_target_from_environment();
+        target.features |= Target::Cancellable;
+        Func p, q;
+        p(x, y) = x + y;
+        q(x, y) = p(x, y-1) + p(x, y+1);
+        p.store_root().compute_at(q, y).async();
+        q.set_custom_is_cancelled(my_is_cancelled);
+
+        Callable call = q.compile_to_callable(target);
+        Image<int> out(64, 1000);
+        const void *args[] = {out.raw_buffer()};
+        int result = call(args, NULL);
+        if (result != -2) {
+            printf("A cancelled async producer returned %d\n", result);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
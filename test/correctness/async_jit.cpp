@@ -0,0 +1,59 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+volatile int callbacks = 0;
+void on_compiled(void *arg) {
+    callbacks++;
+    *(int *)arg = 1;
+}
+
+bool check(Image<int> im) {
+    for (int y = 0; y < im.height(); y++) {
+        for (int x = 0; x < im.width(); x++) {
+            if (im(x, y) != x * 3 + y) {
+                printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), x * 3 + y);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Func f, g;
+    Var x, y;
+    f(x, y) = x * 3 + y;
+    g(x, y) = f(x, y);
+
+    // With nothing compiled yet, realize waits for the background
+    // compile.
+    int flag = 0;
+    JITFuture first = g.compile_jit_async(get_jit_target_from_environment(), on_compiled, &flag);
+    if (!check(g.realize(64, 64))) return -1;
+    first.wait();
+    if (!first.ready() || !flag) {
+        printf("The compile should have finished\n");
+        return -1;
+    }
+
+    // Change the schedule and recompile. Realizations keep working
+    // throughout.
+    f.compute_root().vectorize(x, 4);
+    g.parallel(y);
+    JITFuture second = g.compile_jit_async();
+    for (int i = 0; i < 10; i++) {
+        if (!check(g.realize(64, 64))) return -1;
+    }
+    second.wait();
+    if (!check(g.realize(64, 64))) return -1;
+
+    if (callbacks != 1) {
+        printf("The callback was called %d times instead of once\n", callbacks);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int W = 128, H = 128;
+
+    Image<uint8_t> in(W, H);
+    int reference_hist[256];
+    float reference_grid[16];
+    for (int i = 0; i < 256; i++) {
+        reference_hist[i] = 0;
+    }
+    for (int i = 0; i < 16; i++) {
+        reference_grid[i] = 0.0f;
+    }
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            in(x, y) = rand() & 0xff;
+            reference_hist[in(x, y)]++;
+            reference_grid[in(x, y) / 16] += 0.5f;
+        }
+    }
+
+    Var x;
+
+    {
+        // An integer histogram, with the rows handled in parallel.
+        Func hist;
+        RDom r(in);
+        hist(x) = 0;
+        hist(cast<int>(in(r.x, r.y))) += 1;
+        hist.compute_root();
+        hist.update().atomic().parallel(r.y);
+
+        Image<int> result = hist.realize(256);
+        for (int i = 0; i < 256; i++) {
+            if (result(i) != reference_hist[i]) {
+                printf("hist(%d) was %d instead of %d\n", i, result(i), reference_hist[i]);
+                return -1;
+            }
+        }
+    }
+
+    {
+        // A floating point splat. The sums are exact, so the order they
+        // are accumulated in doesn't matter.
+        Func grid;
+        RDom r(in);
+        grid(x) = 0.0f;
+        grid(cast<int>(in(r.x, r.y) / 16)) += 0.5f;
+        grid.compute_root();
+        grid.update().atomic().parallel(r.y);
+
+        Image<float> result = grid.realize(16);
+        for (int i = 0; i < 16; i++) {
+            if (result(i) != reference_grid[i]) {
+                printf("grid(%d) was %f instead of %f\n", i, result(i), reference_grid[i]);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+// Halide's mod is always positive.
+int value(int x, int y) {
+    int v = (x*3 + y*5) % 17;
+    return v < 0 ? v + 17 : v;
+}
+
+// A pipeline with no schedule, and estimates of the size of its
+// output, is scheduled automatically. The schedule must work for
+// sizes other than the estimate.
+int main(int argc, char **argv) {
+    Var x, y;
+    Func in, bx, by, out;
+    in(x, y) = (x*3 + y*5) % 17;
+    bx(x, y) = in(x-1, y) + in(x, y) + in(x+1, y);
+    by(x, y) = bx(x, y-1) + bx(x, y) + bx(x, y+1);
+    out(x, y) = by(x, y) / 3 + by(x+1, y);
+    out.estimate(x, 0, 256).estimate(y, 0, 256);
+
+    const int W = 200, H = 150;
+    Image<int> im = out.realize(W, H);
+
+    // The blurs aren't used once, so they shouldn't have been inlined.
+    if (by.function().schedule().compute_level.is_inline() ||
+        bx.function().schedule().compute_level.is_inline()) {
+        printf("The blurs were inlined\n");
+        return -1;
+    }
+
+    for (int j = 0; j < H; j++) {
+        for (int i = 0; i < W; i++) {
+            int b[2];
+            for (int k = 0; k < 2; k++) {
+                b[k] = 0;
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        b[k] += value(i + k + dx, j + dy);
+                    }
+                }
+            }
+            int correct = b[0] / 3 + b[1];
+            if (im(i, j) != correct) {
+                printf("im(%d, %d) = %d instead of %d\n", i, j, im(i, j), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
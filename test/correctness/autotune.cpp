@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+using Halide::Internal::vec;
+
+// The same pipeline, with names that don't change, so that a tuned
+// schedule saved for one can be replayed on another.
+Func make_pipeline(Func &blur) {
+    Var x("x"), y("y");
+    Func in("in"), out("out");
+    blur = Func("blur");
+    in(x, y) = x * 3 + y;
+    blur(x, y) = in(x - 1, y) + in(x, y) + in(x + 1, y);
+    out(x, y) = blur(x, y - 1) + blur(x, y) + blur(x, y + 1);
+    return out;
+}
+
+int main(int argc, char **argv) {
+    Var x("x"), y("y");
+    Func blur;
+    Func out = make_pipeline(blur);
+
+    Autotuner tuner(out);
+    tuner.split(out, x, vec(1, 16))
+        .split(out, y, vec(1, 8))
+        .vectorize(out, x, vec(1, 4))
+        .parallel(out, vec(y))
+        .compute_at(blur, out, vec(x, y));
+    double ms = tuner.tune(vec(64, 64), 20);
+    if (ms <= 0) {
+        printf("Tuning timed the best schedule at %f ms\n", ms);
+        return -1;
+    }
+    tuner.save("autotune_test.schedule");
+
+    // Replay it on a new copy of the pipeline.
+    Func blur2;
+    Func out2 = make_pipeline(blur2);
+    apply_tuned_schedule(out2, "autotune_test.schedule");
+    Image<int> im = out2.realize(100, 70);
+
+    for (int j = 0; j < im.height(); j++) {
+        for (int i = 0; i < im.width(); i++) {
+            int correct = 9 * (i * 3 + j);
+            if (im(i, j) != correct) {
+                printf("im(%d, %d) = %d instead of %d\n", i, j, im(i, j), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
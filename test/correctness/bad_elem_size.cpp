@@ -16,8 +16,8 @@ int main(int argc, char **argv) {
     f(x, y) = x+y;
 
     // Dig out the raw function pointer so we can use it as if we were
-    // compiling statically
-    void (*function)(buffer_t *) = (void (*)(buffer_t *))(f.compile_jit());
+    // compiling statically. Its first argument is the user_context.
+    void (*function)(void *, buffer_t *) = (void (*)(void *, buffer_t *))(f.compile_jit());
 
     buffer_t out;
     memset(&out, 0, sizeof(out));
@@ -30,7 +30,7 @@ int main(int argc, char **argv) {
 
     f.set_error_handler(&halide_error);
     error_occurred = false;
-    function(&out);
+    function(NULL, &out);
 
     if (error_occurred) {
         printf("Success!\n");
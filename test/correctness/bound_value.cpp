@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+#ifdef _MSC_VER
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+int count = 0;
+extern "C" DLLEXPORT int call_counter(int x, int y) {
+    count++;
+    return x * 2 + y;
+}
+HalideExtern_2(int, call_counter, int, int);
+
+int main(int argc, char **argv) {
+    const int W = 32, H = 16;
+    Var x, y;
+
+    {
+        // A lookup table indexed by an image with a declared range is
+        // only computed over that range, instead of all of uint16.
+        ImageParam in(UInt(16), 2);
+        in.set_value_range(0, 99);
+        Image<uint16_t> input(W, H);
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                input(x, y) = (x * 7 + y * 13) % 100;
+            }
+        }
+        in.set(input);
+
+        Func lut, out;
+        lut(x) = call_counter(x, 1);
+        out(x, y) = lut(in(x, y));
+        lut.compute_root();
+
+        count = 0;
+        Image<int> im = out.realize(W, H);
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                int correct = input(x, y) * 2 + 1;
+                if (im(x, y) != correct) {
+                    printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+        if (count != 100) {
+            printf("lut was called %d times instead of %d times\n", count, 100);
+            return -1;
+        }
+    }
+
+    {
+        // The same for a Func made by an update, whose range can't be
+        // inferred.
+        Func index, lut, out;
+        RDom r(0, 4);
+        index(x, y) = cast<uint16_t>(0);
+        index(x, y) += cast<uint16_t>((x + y + r) % 3 == 0);
+        index.bound_value(0, 4);
+        lut(x) = call_counter(x, 0);
+        out(x, y) = lut(index(x, y));
+        lut.compute_root();
+        index.compute_root();
+
+        count = 0;
+        Image<int> im = out.realize(W, H);
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                int idx = 0;
+                for (int i = 0; i < 4; i++) {
+                    if ((x + y + i) % 3 == 0) idx++;
+                }
+                if (im(x, y) != idx * 2) {
+                    printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), idx * 2);
+                    return -1;
+                }
+            }
+        }
+        if (count != 5) {
+            printf("lut was called %d times instead of %d times\n", count, 5);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+const int W = 23, H = 19;
+
+int input_value(int x, int y) {
+    return x * 64 + y;
+}
+
+int clamp_coord(int x, int extent) {
+    return x < 0 ? 0 : (x >= extent ? extent - 1 : x);
+}
+
+int wrap_coord(int x, int extent) {
+    int c = x % extent;
+    return c < 0 ? c + extent : c;
+}
+
+int mirror_coord(int x, int extent) {
+    int c = wrap_coord(x, 2 * extent);
+    return c < extent ? c : 2 * extent - 1 - c;
+}
+
+// Read the bounded Func over a region larger than the input, with
+// and without vectorization, and check it against the rule.
+bool check(const char *name, Func bounded, int rule) {
+    for (int vectorized = 0; vectorized < 2; vectorized++) {
+        Var x, y;
+        Func out;
+        out(x, y) = bounded(x - 20, y - 20);
+        if (vectorized) out.vectorize(x, 8);
+
+        Image<int> result = out.realize(64, 64);
+        for (int y = 0; y < 64; y++) {
+            for (int x = 0; x < 64; x++) {
+                int ix = x - 20, iy = y - 20;
+                int correct;
+                if (rule == 0) {
+                    correct = input_value(clamp_coord(ix, W), clamp_coord(iy, H));
+                } else if (rule == 1) {
+                    bool inside = ix >= 0 && ix < W && iy >= 0 && iy < H;
+                    correct = inside ? input_value(ix, iy) : -1;
+                } else if (rule == 2) {
+                    correct = input_value(wrap_coord(ix, W), wrap_coord(iy, H));
+                } else {
+                    correct = input_value(mirror_coord(ix, W), mirror_coord(iy, H));
+                }
+                if (result(x, y) != correct) {
+                    printf("%s%s at %d %d: %d instead of %d\n",
+                           name, vectorized ? " (vectorized)" : "",
+                           ix, iy, result(x, y), correct);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Image<int> input(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            input(x, y) = input_value(x, y);
+        }
+    }
+
+    ImageParam param(Int(32), 2);
+    param.set(input);
+
+    if (!check("repeat_edge", BoundaryConditions::repeat_edge(input), 0) ||
+        !check("constant_exterior", BoundaryConditions::constant_exterior(param, -1), 1) ||
+        !check("repeat_image", BoundaryConditions::repeat_image(input), 2) ||
+        !check("mirror_image", BoundaryConditions::mirror_image(param), 3)) {
+        return -1;
+    }
+
+    // A Func source, bounded in the first dimension only.
+    Var x, y;
+    Func f;
+    f(x, y) = x * 64 + y;
+    std::vector<std::pair<Expr, Expr> > bounds;
+    bounds.push_back(std::make_pair(Expr(0), Expr(W)));
+    Func g = BoundaryConditions::mirror_image(f, bounds);
+    Image<int> result = g.realize(64, 8);
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 64; x++) {
+            int correct = mirror_coord(x, W) * 64 + y;
+            if (result(x, y) != correct) {
+                printf("mirror_image of a Func at %d %d: %d instead of %d\n",
+                       x, y, result(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
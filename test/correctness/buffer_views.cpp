@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Var x, y;
+    Func f;
+    f(x, y) = x + y * 1000;
+
+    // Realize directly into a sub-rectangle of a larger frame.
+    Image<int> frame(100, 80);
+    Buffer window = Buffer(frame).crop(0, 20, 40).crop(1, 10, 30);
+    f.realize(window);
+    for (int yy = 0; yy < 80; yy++) {
+        for (int xx = 0; xx < 100; xx++) {
+            bool inside = xx >= 20 && xx < 60 && yy >= 10 && yy < 40;
+            int correct = inside ? xx + yy * 1000 : 0;
+            if (frame(xx, yy) != correct) {
+                printf("frame(%d, %d) = %d instead of %d\n", xx, yy, frame(xx, yy), correct);
+                return -1;
+            }
+        }
+    }
+
+    // Realize into a transposed view, which needs the default
+    // constraint that the innermost stride is one lifted, and then
+    // read a fused view.
+    Func ft;
+    ft(x, y) = x + y * 1000;
+    ft.output_buffer().set_stride(0, Expr());
+    Image<int> t(30, 50);
+    ft.realize(Buffer(t).transpose(0, 1));
+    for (int yy = 0; yy < 50; yy++) {
+        for (int xx = 0; xx < 30; xx++) {
+            if (t(xx, yy) != yy + xx * 1000) {
+                printf("t(%d, %d) = %d instead of %d\n", xx, yy, t(xx, yy), yy + xx * 1000);
+                return -1;
+            }
+        }
+    }
+    Image<int> fused(Buffer(t).fuse(0));
+    if (fused.dimensions() != 1 || fused.extent(0) != 30 * 50 || fused(31) != 1 + 1000) {
+        printf("Bad fused view\n");
+        return -1;
+    }
+
+    // Read a slice of a frame owned by someone else, with a row
+    // stride larger than its width.
+    int *data = new int[64 * 20];
+    for (int i = 0; i < 64 * 20; i++) data[i] = i;
+    Buffer external(Int(32), Internal::vec(50, 20), Internal::vec(1, 64), Internal::vec(0, 0),
+                    (uint8_t *)data);
+    ImageParam in(Int(32), 1);
+    Func g;
+    g(x) = in(x) * 2;
+    in.set(external.slice(1, 7));
+    Image<int> row = g.realize(50);
+    for (int xx = 0; xx < 50; xx++) {
+        if (row(xx) != (7 * 64 + xx) * 2) {
+            printf("row(%d) = %d instead of %d\n", xx, row(xx), (7 * 64 + xx) * 2);
+            return -1;
+        }
+    }
+    delete[] data;
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <pthread.h>
+
+using namespace Halide;
+
+Callable callable;
+Image<float> input(32, 32);
+
+struct Job {
+    float scale;
+    bool ok;
+};
+
+void *run_job(void *arg) {
+    Job *job = (Job *)arg;
+    job->ok = true;
+    for (int iter = 0; iter < 20; iter++) {
+        Image<float> out(16, 16);
+        const void *args[] = {input.raw_buffer(), &job->scale, out.raw_buffer()};
+        if (callable(args) != 0) {
+            job->ok = false;
+        }
+        for (int y = 0; y < 16; y++) {
+            for (int x = 0; x < 16; x++) {
+                if (out(x, y) != input(x + 1, y) * job->scale) {
+                    job->ok = false;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    for (int y = 0; y < input.height(); y++) {
+        for (int x = 0; x < input.width(); x++) {
+            input(x, y) = x + y * 32;
+        }
+    }
+
+    ImageParam in(Float(32), 2, "in");
+    Param<float> scale("scale");
+    Image<float> offset(1);
+    offset(0) = 1;
+
+    Var x, y;
+    Func f("f");
+    f(x, y) = in(x + cast<int>(offset(0)), y) * scale;
+    f.vectorize(x, 4);
+
+    callable = f.compile_to_callable();
+
+    // The Image is bound, so the arguments are in, scale and f.
+    const std::vector<Argument> &args = callable.arguments();
+    if (args.size() != 3 || args[0].name != "in" || args[1].name != "scale" || args[2].name != "f") {
+        printf("Unexpected arguments to the callable\n");
+        return -1;
+    }
+
+    const int num_threads = 4;
+    pthread_t threads[num_threads];
+    Job jobs[num_threads];
+    for (int i = 0; i < num_threads; i++) {
+        jobs[i].scale = i + 1.0f;
+        pthread_create(&threads[i], NULL, run_job, &jobs[i]);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+        if (!jobs[i].ok) {
+            printf("Callable gave the wrong answer on thread %d\n", i);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
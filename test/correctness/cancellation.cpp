@@ -0,0 +1,69 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+// The user_context of each call: gives up after a number of polls, as
+// a deadline would.
+struct Budget {
+    int polls, limit;
+};
+
+int my_is_cancelled(void *user_context) {
+    Budget *b = (Budget *)user_context;
+    return __sync_add_and_fetch(&b->polls, 1) > b->limit;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    target.features |= Target::Cancellable;
+
+    const int W = 64, H = 1000;
+    Func f("f");
+    Var x("x"), y("y"), yo("yo"), yi("yi");
+    f(x, y) = x + y * W;
+    f.split(y, yo, yi, 10).parallel(yo);
+    f.set_custom_is_cancelled(my_is_cancelled);
+
+    Callable c = f.compile_to_callable(target);
+
+    // A budget that runs out after a few rows, and one that doesn't.
+    const int limits[] = {20, 1000000};
+    for (int i = 0; i < 2; i++) {
+        int limit = limits[i];
+        Image<int> out(W, H);
+        for (int yy = 0; yy < H; yy++) {
+            for (int xx = 0; xx < W; xx++) {
+                out(xx, yy) = -1;
+            }
+        }
+
+        Budget budget = {0, limit};
+        const void *args[] = {out.raw_buffer()};
+        int result = c(args, &budget);
+
+        int rows = 0;
+        for (int yy = 0; yy < H; yy++) {
+            if (out(0, yy) == yy * W) rows++;
+        }
+
+        if (limit < H) {
+            if (result != -2) {
+                printf("A cancelled call returned %d\n", result);
+                return -1;
+            }
+            // Each thread may finish the row it's on.
+            if (rows > H / 2) {
+                printf("A cancelled call still computed %d rows out of %d\n", rows, H);
+                return -1;
+            }
+        } else if (result != 0 || rows != H) {
+            printf("An uncancelled call returned %d and computed %d rows out of %d\n",
+                   result, rows, H);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+// NB: You must compile with -rdynamic for llvm to be able to find the appropriate symbols
+
+#ifdef _MSC_VER
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+int call_counter = 0;
+extern "C" DLLEXPORT int count_calls(int x, int y) {
+    __sync_add_and_fetch(&call_counter, 1);
+    return x * 3 + y * 5;
+}
+HalideExtern_2(int, count_calls, int, int);
+
+int main(int argc, char **argv) {
+    const int N = 16, size = 1024, block = 32;
+
+    // Scattered points, some of which share a block, and two corners
+    // so that the region read is the whole function.
+    Image<int> points(N, 2);
+    int blocks_touched = 0;
+    for (int i = 0; i < N; i++) {
+        points(i, 0) = i < 2 ? i * (size - 1) : (i * 397) % size;
+        points(i, 1) = i < 2 ? i * (size - 1) : (i * 211 + (i % 3) * 5) % size;
+        bool new_block = true;
+        for (int j = 0; j < i; j++) {
+            if (points(j, 0) / block == points(i, 0) / block &&
+                points(j, 1) / block == points(i, 1) / block) {
+                new_block = false;
+            }
+        }
+        if (new_block) blocks_touched++;
+    }
+
+    for (int vectorized = 0; vectorized < 2; vectorized++) {
+        call_counter = 0;
+
+        Func f, g;
+        Var x, y, i;
+        f(x, y) = count_calls(x, y);
+        g(i) = f(clamp(points(i, 0), 0, size - 1), clamp(points(i, 1), 0, size - 1));
+
+        f.compute_lazily(x, block).compute_lazily(y, block);
+        if (vectorized) {
+            g.vectorize(i, 4).parallel(i);
+        } else {
+            g.parallel(i);
+        }
+
+        Image<int> result = g.realize(N);
+        for (int j = 0; j < N; j++) {
+            int correct = points(j, 0) * 3 + points(j, 1) * 5;
+            if (result(j) != correct) {
+                printf("result(%d) = %d instead of %d\n", j, result(j), correct);
+                return -1;
+            }
+        }
+
+        if (call_counter != blocks_touched * block * block) {
+            printf("f was computed at %d points instead of %d\n",
+                   call_counter, blocks_touched * block * block);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int parallel_loops = 0;
+
+extern "C" int count_parallel_loops(void *user_context, int (*f)(void *, int, uint8_t *),
+                                    int min, int size, uint8_t *closure) {
+    parallel_loops++;
+    for (int i = min; i < min + size; i++) {
+        int result = f(user_context, i, closure);
+        if (result) return result;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Var x, y, yo, yi;
+
+    Func in;
+    in(x, y) = x * x + y * 3;
+
+    // The x and y gradients of the same input, computed in one pass
+    // over it. They need slightly different regions, so the fused
+    // loops cover the union of the two.
+    Func dx, dy, out;
+    dx(x, y) = in(x+1, y) - in(x-1, y);
+    dy(x, y) = in(x, y+1) - in(x, y-1);
+    out(x, y) = dx(x, y) * dy(x, y) + dx(x, y-1);
+
+    in.compute_root();
+    dx.compute_root().split(y, yo, yi, 8).parallel(yo);
+    dy.compute_root().split(y, yo, yi, 8).parallel(yo).compute_with(dx, yo);
+
+    out.set_custom_do_par_for(count_parallel_loops);
+    Image<int> im = out.realize(100, 100);
+
+    for (int y = 0; y < 100; y++) {
+        for (int x = 0; x < 100; x++) {
+            int ddx = ((x+1)*(x+1) - (x-1)*(x-1));
+            int ddy = 6;
+            int ddx_up = ddx;
+            int correct = ddx * ddy + ddx_up;
+            if (im(x, y) != correct) {
+                printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    if (parallel_loops != 1) {
+        printf("Expected the two parallel loops to be fused into one, but there were %d\n",
+               parallel_loops);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+#ifdef _MSC_VER
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+int count = 0;
+extern "C" DLLEXPORT int call_counter(int x, int y) {
+    count++;
+    return x + y;
+}
+HalideExtern_2(int, call_counter, int, int);
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    {
+        // Only the box of f where the mask is true is used, so only
+        // that box should be computed, even though g is vectorized.
+        Func f, g;
+        f(x, y) = call_counter(x, y);
+        g(x, y) = select(x >= 10 && x < 20 && y > 5 && y <= 8, f(x, y), 0);
+        f.compute_root();
+        g.vectorize(x, 8);
+
+        count = 0;
+        Image<int> im = g.realize(64, 64);
+
+        for (int y = 0; y < 64; y++) {
+            for (int x = 0; x < 64; x++) {
+                int correct = (x >= 10 && x < 20 && y > 5 && y <= 8) ? x + y : 0;
+                if (im(x, y) != correct) {
+                    printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+
+        if (count != 10 * 3) {
+            printf("f was called %d times instead of %d times\n", count, 10 * 3);
+            return -1;
+        }
+    }
+
+    {
+        // The same for the false branch of a select.
+        Func f, g;
+        f(x) = call_counter(x, 0);
+        g(x) = select(x < 50 || x >= 60, 0, f(x));
+        f.compute_root();
+        g.vectorize(x, 4);
+
+        count = 0;
+        Image<int> im = g.realize(100);
+
+        for (int x = 0; x < 100; x++) {
+            int correct = (x < 50 || x >= 60) ? 0 : x;
+            if (im(x) != correct) {
+                printf("im(%d) = %d instead of %d\n", x, im(x), correct);
+                return -1;
+            }
+        }
+
+        if (count != 10) {
+            printf("f was called %d times instead of %d times\n", count, 10);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+using namespace Halide;
+
+Func f;
+
+struct Job {
+    int width;
+    int mallocs, frees;
+    bool ok;
+};
+
+// The allocator gets the user_context of the realization it's
+// serving, and counts its allocations there.
+void *my_malloc(void *user_context, size_t x) {
+    Job *job = (Job *)user_context;
+    if (job) job->mallocs++;
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, 32, x)) return NULL;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    Job *job = (Job *)user_context;
+    if (job) job->frees++;
+    free(ptr);
+}
+
+void *run_job(void *arg) {
+    Job *job = (Job *)arg;
+    job->ok = true;
+    for (int iter = 0; iter < 20; iter++) {
+        Image<int> out(job->width, 16);
+        f.realize(out, job);
+        for (int y = 0; y < 16; y++) {
+            for (int x = 0; x < job->width; x++) {
+                if (out(x, y) != x * 2 + y + 1) {
+                    job->ok = false;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    Var x, y;
+    Func g;
+    g(x, y) = x * 2 + y;
+    f(x, y) = g(x, y) + 1;
+    // g goes on the heap, because its size depends on the output.
+    g.compute_root();
+    f.parallel(y);
+
+    f.set_custom_allocator(my_malloc, my_free);
+    f.compile_jit();
+
+    const int num_threads = 4;
+    pthread_t threads[num_threads];
+    Job jobs[num_threads];
+    for (int i = 0; i < num_threads; i++) {
+        jobs[i].width = 16 + i * 8;
+        jobs[i].mallocs = jobs[i].frees = 0;
+        pthread_create(&threads[i], NULL, run_job, &jobs[i]);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+        if (!jobs[i].ok) {
+            printf("Realizing on thread %d gave the wrong answer\n", i);
+            return -1;
+        }
+        if (jobs[i].mallocs < 20 || jobs[i].mallocs != jobs[i].frees) {
+            printf("The allocator saw %d mallocs and %d frees for thread %d\n",
+                   jobs[i].mallocs, jobs[i].frees, i);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int W = 67, H = 45;
+    Var x, y;
+
+    // A histogram-like sum started at zero, computed at the root.
+    {
+        Func f, g;
+        RDom r(0, 5);
+        f(x, y) = 0;
+        f(x, y) += x * r + y;
+        g(x, y) = f(x, y) * 2;
+        f.compute_root().vectorize(x, 8);
+
+        Image<int> out = g.realize(W, H);
+        for (int yy = 0; yy < H; yy++) {
+            for (int xx = 0; xx < W; xx++) {
+                int correct = 2 * (xx * 10 + yy * 5);
+                if (out(xx, yy) != correct) {
+                    printf("zero: out(%d, %d) = %d instead of %d\n", xx, yy, out(xx, yy), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // An 8-bit initial value that isn't zero, computed per row.
+    {
+        Func f, g;
+        RDom r(0, 3);
+        f(x, y) = cast<uint8_t>(7);
+        f(x, y) += cast<uint8_t>(x + r);
+        g(x, y) = f(x, y);
+        f.compute_at(g, y);
+
+        Image<uint8_t> out = g.realize(W, H);
+        for (int yy = 0; yy < H; yy++) {
+            for (int xx = 0; xx < W; xx++) {
+                uint8_t correct = (uint8_t)(7 + 3 * xx + 3);
+                if (out(xx, yy) != correct) {
+                    printf("uint8: out(%d, %d) = %d instead of %d\n", xx, yy, out(xx, yy), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // A float tuple of zero and minus zero, and storage that outlives
+    // each computation, which must keep its loops.
+    {
+        Func f, g;
+        f(x, y) = Tuple(0.0f, -0.0f);
+        f(x, y) = Tuple(f(x, y)[0] + x, f(x, y)[1] * y);
+        g(x, y) = f(x, y)[0] + f(x, y)[1];
+        f.store_root().compute_at(g, y);
+
+        Image<float> out = g.realize(W, H);
+        for (int yy = 0; yy < H; yy++) {
+            for (int xx = 0; xx < W; xx++) {
+                float correct = (float)xx;
+                if (out(xx, yy) != correct) {
+                    printf("float: out(%d, %d) = %f instead of %f\n", xx, yy, out(xx, yy), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
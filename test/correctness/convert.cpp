@@ -0,0 +1,107 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+using namespace Halide;
+
+const int W = 83, H = 21;
+
+int main(int argc, char **argv) {
+    // float to uint8, scaled, rounded and saturated.
+    {
+        ImageParam in(Float(32), 2);
+        Image<float> im(W, H);
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                im(x, y) = (x - 10) * 0.0137f + y * 0.003f;
+            }
+        }
+        in.set(im);
+        Image<uint8_t> out = convert(in, UInt(8), 255.0f).realize(W, H);
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                float v = floorf(im(x, y) * 255.0f + 0.5f);
+                uint8_t correct = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+                if (out(x, y) != correct) {
+                    printf("float to uint8: out(%d, %d) = %d instead of %d\n",
+                           x, y, out(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // int32 to int8, saturated through int16.
+    {
+        Func f;
+        Var x, y;
+        f(x, y) = (x - W / 2) * 1000 + y;
+        Image<int8_t> out = convert(f, Int(8)).realize(W, H);
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                int v = (x - W / 2) * 1000 + y;
+                int8_t correct = (int8_t)(v < -128 ? -128 : (v > 127 ? 127 : v));
+                if (out(x, y) != correct) {
+                    printf("int32 to int8: out(%d, %d) = %d instead of %d\n",
+                           x, y, out(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // Planar uint8 to interleaved uint16.
+    {
+        Func f;
+        Var x, y, c;
+        f(x, y, c) = cast<uint8_t>(x * 3 + y * 5 + c * 70);
+
+        std::vector<uint16_t> storage(W * H * 3);
+        buffer_t buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.host = (uint8_t *)&storage[0];
+        buf.extent[0] = W;
+        buf.extent[1] = H;
+        buf.extent[2] = 3;
+        buf.stride[0] = 3;
+        buf.stride[1] = 3 * W;
+        buf.stride[2] = 1;
+        buf.elem_size = 2;
+        Buffer out(UInt(16), &buf);
+
+        convert(f, UInt(16), 1.0f, Layout_Interleaved, 3).realize(out);
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                for (int c = 0; c < 3; c++) {
+                    uint16_t correct = (uint8_t)(x * 3 + y * 5 + c * 70);
+                    uint16_t value = storage[y * 3 * W + x * 3 + c];
+                    if (value != correct) {
+                        printf("interleave: out(%d, %d, %d) = %d instead of %d\n",
+                               x, y, c, value, correct);
+                        return -1;
+                    }
+                }
+            }
+        }
+    }
+
+    // A one-dimensional int16 to float.
+    {
+        Func f;
+        Var x;
+        f(x) = cast<int16_t>(x * 37 - 20000);
+        const int N = 100000;
+        Image<float> out = convert(f, Float(32), 0.5f).realize(N);
+        for (int x = 0; x < N; x++) {
+            float correct = (int16_t)(x * 37 - 20000) * 0.5f;
+            if (out(x) != correct) {
+                printf("int16 to float: out(%d) = %f instead of %f\n", x, out(x), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
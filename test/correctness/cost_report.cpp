@@ -0,0 +1,65 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Func f("f"), g("g");
+    Var x, y, xi, yi;
+    f(x, y) = x * y;
+    g(x, y) = f(x, y) + f(x + 1, y);
+    g.tile(x, y, xi, yi, 8, 8).vectorize(xi, 4);
+    f.compute_at(g, x);
+
+    g.compile_to_lowered_stmt("cost_report.stmt");
+
+    FILE *file = fopen("cost_report.cost", "r");
+    if (!file) {
+        printf("No cost report was written\n");
+        return -1;
+    }
+    long long g_points = 0, g_ops = 0, g_bytes = 0, f_footprint = 0;
+    bool has_total = false;
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        char metric[256], pipeline[256], op_type[256], op_name[256];
+        long long value;
+        if (sscanf(line, "halide_profiler %255s %255s %255s %255s %*s %*s %lld",
+                   metric, pipeline, op_type, op_name, &value) != 5) {
+            printf("Bad line in cost report: %s", line);
+            return -1;
+        }
+        if (!strcmp(op_type, "$total$")) has_total = true;
+        if (strcmp(op_type, "produce")) continue;
+        if (!strcmp(op_name, "g")) {
+            if (!strcmp(metric, "static_points")) g_points = value;
+            if (!strcmp(metric, "static_ops")) g_ops = value;
+            if (!strcmp(metric, "static_store_bytes")) g_bytes = value;
+        } else if (!strcmp(op_name, "f") && !strcmp(metric, "static_footprint")) {
+            f_footprint = value;
+        }
+    }
+    fclose(file);
+    remove("cost_report.stmt");
+    remove("cost_report.cost");
+
+    if (!has_total) {
+        printf("The cost report has no totals\n");
+        return -1;
+    }
+    // Each point of g is an add and stores four bytes.
+    if (g_points <= 0 || g_ops < g_points || g_bytes != 4 * g_points) {
+        printf("Estimated %lld points, %lld ops and %lld bytes stored for g\n",
+               g_points, g_ops, g_bytes);
+        return -1;
+    }
+    // f is computed in tiles of 9x8 ints.
+    if (f_footprint <= 0 || f_footprint > 1024) {
+        printf("Estimated a footprint of %lld bytes for f\n", f_footprint);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    // Write in the background, and only every other realization.
+    setenv("HL_DEBUG_TO_FILE_ASYNC", "1", 1);
+    setenv("HL_DEBUG_TO_FILE_EVERY", "2", 1);
+
+    {
+        Func f, g;
+        Var x, y;
+        Param<int> run;
+        f(x, y) = x + y + run * 1000;
+        g(x, y) = f(x, y) * 2;
+        f.compute_root().debug_to_file("f_async.tmp");
+
+        for (int i = 0; i < 4; i++) {
+            run.set(i);
+            g.realize(10, 10);
+        }
+        // Freeing the pipeline waits for the files to be written.
+    }
+
+    FILE *f = fopen("f_async.tmp", "rb");
+    if (!f) {
+        printf("f_async.tmp was not written\n");
+        return -1;
+    }
+
+    int header[5];
+    int32_t f_data[10*10];
+    if (fread((void *)(&header[0]), 4, 5, f) != 5 ||
+        fread((void *)(&f_data[0]), 4, 10*10, f) != 10*10) {
+        printf("f_async.tmp is too short\n");
+        return -1;
+    }
+    fclose(f);
+    remove("f_async.tmp");
+
+    if (header[0] != 10 || header[1] != 10 || header[4] != 7) {
+        printf("Bad header: %d %d %d %d %d\n",
+               header[0], header[1], header[2], header[3], header[4]);
+        return -1;
+    }
+
+    // Runs 0 and 2 were written, so the file holds run 2.
+    for (int y = 0; y < 10; y++) {
+        for (int x = 0; x < 10; x++) {
+            int32_t val = f_data[y*10+x];
+            int32_t correct = x + y + 2000;
+            if (val != correct) {
+                printf("f_data[%d, %d] = %d instead of %d\n", x, y, val, correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
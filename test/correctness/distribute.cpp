@@ -0,0 +1,50 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <algorithm>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Var x, y, yi;
+    ImageParam in(Int(32), 2);
+
+    // A separable blur, with both stages divided between ranks. The
+    // jit runtime has a single rank, which computes everything.
+    Func clamped, blur_x, blur_y;
+    clamped(x, y) = in(clamp(x, 0, 63), clamp(y, 0, 63));
+    blur_x(x, y) = clamped(x-1, y) + clamped(x, y) + clamped(x+1, y);
+    blur_y(x, y) = blur_x(x, y-1) + blur_x(x, y) + blur_x(x, y+1);
+
+    blur_x.compute_root().parallel(y).distribute(y);
+    blur_y.split(y, y, yi, 8).parallel(y).distribute(y);
+
+    Image<int> input(64, 64);
+    for (int j = 0; j < 64; j++) {
+        for (int i = 0; i < 64; i++) {
+            input(i, j) = i * 3 + j * 7;
+        }
+    }
+    in.set(input);
+
+    Image<int> result = blur_y.realize(64, 60);
+
+    for (int j = 0; j < 60; j++) {
+        for (int i = 0; i < 64; i++) {
+            int correct = 0;
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    int xx = std::min(std::max(i + dx, 0), 63);
+                    int yy = std::min(std::max(j + dy, 0), 63);
+                    correct += input(xx, yy);
+                }
+            }
+            if (result(i, j) != correct) {
+                printf("result(%d, %d) = %d instead of %d\n", i, j, result(i, j), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <math.h>
+
+using namespace Halide;
+
+#ifdef _MSC_VER
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+// A color-space helper, as a C function.
+int call_count;
+extern "C" DLLEXPORT float luma(float r, float g, float b) {
+    call_count++;
+    return 0.299f * r + 0.587f * g + 0.114f * b;
+}
+
+HalideExtern_3(float, luma, float, float, float);
+
+// The same helper in Halide.
+Expr luma_body(const std::vector<Expr> &args) {
+    return 0.299f * args[0] + 0.587f * args[1] + 0.114f * args[2];
+}
+
+int main(int argc, char **argv) {
+    const int W = 67, H = 13;
+    Image<float> input(W, H, 3);
+    for (int c = 0; c < 3; c++) {
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                input(x, y, c) = (rand() & 0xff) / 255.0f;
+            }
+        }
+    }
+
+    Var x, y;
+    Func f, g;
+    f(x, y) = luma(input(x, y, 0), input(x, y, 1), input(x, y, 2));
+    f.vectorize(x, 8);
+
+    // Without a body, the vectorized call is made once per lane.
+    call_count = 0;
+    Image<float> out_calls = f.realize(W, H);
+    if (call_count == 0) {
+        printf("luma was never called\n");
+        return -1;
+    }
+
+    // With one, it's inlined, and luma is never called.
+    define_extern_body("luma", luma_body);
+    g(x, y) = luma(input(x, y, 0), input(x, y, 1), input(x, y, 2));
+    g.vectorize(x, 8);
+    call_count = 0;
+    Image<float> out_inlined = g.realize(W, H);
+    if (call_count != 0) {
+        printf("luma was called %d times after it was given a body\n", call_count);
+        return -1;
+    }
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            float correct = luma(input(x, y, 0), input(x, y, 1), input(x, y, 2));
+            if (fabs(out_calls(x, y) - correct) > 0.0001f ||
+                fabs(out_inlined(x, y) - correct) > 0.0001f) {
+                printf("luma(%d, %d) = %f and %f instead of %f\n",
+                       x, y, out_calls(x, y), out_inlined(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <Halide.h>
+#include <stdio.h>
+
+#ifdef _MSC_VER
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+int calls = 0;
+
+// out(x, y) = in(x-1, y) + in(x+1, y)
+extern "C" DLLEXPORT int blur_tile(buffer_t *in, buffer_t *out) {
+    if (in->host == NULL) {
+        in->min[0] = out->min[0] - 1;
+        in->extent[0] = out->extent[0] + 2;
+        in->min[1] = out->min[1];
+        in->extent[1] = out->extent[1];
+        return 0;
+    }
+    if (out->host == NULL) return 0;
+
+    // The input is computed per tile, so it should be just what this
+    // tile needs.
+    if (in->min[0] != out->min[0] - 1 || in->extent[0] != out->extent[0] + 2 ||
+        in->min[1] != out->min[1] || in->extent[1] != out->extent[1]) {
+        printf("Input [%d, %d] x [%d, %d] for output tile [%d, %d] x [%d, %d]\n",
+               in->min[0], in->extent[0], in->min[1], in->extent[1],
+               out->min[0], out->extent[0], out->min[1], out->extent[1]);
+        return -1;
+    }
+    if (out->extent[0] > 16 || out->extent[1] > 8) {
+        printf("Output tile of %d x %d is too large\n", out->extent[0], out->extent[1]);
+        return -1;
+    }
+
+    __sync_fetch_and_add(&calls, 1);
+    for (int y = out->min[1]; y < out->min[1] + out->extent[1]; y++) {
+        for (int x = out->min[0]; x < out->min[0] + out->extent[0]; x++) {
+            int32_t *in_row = (int32_t *)in->host + (y - in->min[1]) * in->stride[1];
+            int32_t *out_row = (int32_t *)out->host + (y - out->min[1]) * out->stride[1];
+            out_row[(x - out->min[0]) * out->stride[0]] =
+                in_row[(x - 1 - in->min[0]) * in->stride[0]] +
+                in_row[(x + 1 - in->min[0]) * in->stride[0]];
+        }
+    }
+    return 0;
+}
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Func input, blur, out;
+    Var x, y;
+    input(x, y) = x + y * 1000;
+
+    blur.define_extern("blur_tile", Internal::vec<ExternFuncArgument>(input), Int(32), 2, true);
+    out(x, y) = blur(x, y) * 2;
+
+    // Compute the extern stage in parallel tiles, and its input per
+    // tile.
+    Var bx = blur.args()[0], by = blur.args()[1];
+    Var xo, yo, xi, yi;
+    blur.compute_root().tile(bx, by, xo, yo, xi, yi, 16, 8).parallel(yo);
+    input.compute_at(blur, xo);
+
+    Image<int> result = out.realize(100, 50);
+
+    for (int y = 0; y < 50; y++) {
+        for (int x = 0; x < 100; x++) {
+            int correct = ((x - 1 + y * 1000) + (x + 1 + y * 1000)) * 2;
+            if (result(x, y) != correct) {
+                printf("result(%d, %d) = %d instead of %d\n", x, y, result(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    // 7 tiles across, and 7 down.
+    if (calls != 49) {
+        printf("The extern stage was called %d times instead of 49\n", calls);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
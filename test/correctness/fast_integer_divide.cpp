@@ -0,0 +1,63 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Halide;
+
+// Check fast_integer_divide with a different denominator in each
+// lane of a vector, for every denominator.
+template<typename T>
+bool test(int vector_width) {
+    Image<T> num(256, 16);
+    for (int y = 0; y < num.height(); y++) {
+        for (int x = 0; x < num.width(); x++) {
+            num(x, y) = (T)(rand() * 65537 + rand());
+        }
+    }
+    // Make sure the extremes are in there.
+    num(0, 0) = (T)(((uint64_t)1 << (sizeof(T)*8 - 1)) - 1);
+    num(1, 0) = (T)((uint64_t)1 << (sizeof(T)*8 - 1));
+    num(2, 0) = (T)(-1);
+    num(3, 0) = 0;
+
+    Var x, y;
+    Func f;
+    f(x, y) = fast_integer_divide(num(x, y), cast<uint8_t>(x));
+    if (vector_width > 1) f.vectorize(x, vector_width);
+    Image<T> result = f.realize(num.width(), num.height());
+
+    for (int y = 0; y < num.height(); y++) {
+        for (int x = 0; x < num.width(); x++) {
+            // A denominator of zero means 256.
+            int d = x == 0 ? 256 : x;
+            // Everything but the division of a T by an int promotes
+            // to int64, so this rounds towards negative infinity, as
+            // Halide's division does.
+            int64_t n = (int64_t)num(x, y);
+            int64_t q = n / d;
+            if (q * d > n) q--;
+            T correct = (T)q;
+            if (result(x, y) != correct) {
+                printf("fast_integer_divide(%lld, %d) = %lld instead of %lld (vector width %d)\n",
+                       (long long)n, d, (long long)result(x, y), (long long)correct, vector_width);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int widths[] = {1, 8, 16};
+    for (int i = 0; i < 3; i++) {
+        int w = widths[i];
+        if (!test<uint8_t>(w) || !test<int8_t>(w) ||
+            !test<uint16_t>(w) || !test<int16_t>(w) ||
+            !test<uint32_t>(w) || !test<int32_t>(w)) {
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <math.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    // The transform of a few rows of a real signal, against a direct
+    // DFT, and then back again.
+    {
+        const int N = 64;
+        Func signal;
+        signal(x, y) = cast<float>((x * 17 + y * 5) % 13) - 6.0f;
+        Func f = fft(signal, 0, N);
+        Func g = fft(f, 0, N, true);
+
+        Realization freq = f.realize(N, 3);
+        Realization back = g.realize(N, 3);
+        Image<float> re = freq[0], im = freq[1], back_re = back[0], back_im = back[1];
+        for (int y = 0; y < 3; y++) {
+            for (int k = 0; k < N; k++) {
+                double cr = 0, ci = 0;
+                for (int x = 0; x < N; x++) {
+                    double v = ((x * 17 + y * 5) % 13) - 6.0;
+                    cr += v * cos(-2 * M_PI * k * x / N);
+                    ci += v * sin(-2 * M_PI * k * x / N);
+                }
+                if (fabs(re(k, y) - cr) > 1e-3 || fabs(im(k, y) - ci) > 1e-3) {
+                    printf("fft at %d %d is %f + %fi instead of %f + %fi\n",
+                           k, y, re(k, y), im(k, y), cr, ci);
+                    return -1;
+                }
+                double v = ((k * 17 + y * 5) % 13) - 6.0;
+                if (fabs(back_re(k, y) - v) > 1e-4 || fabs(back_im(k, y)) > 1e-4) {
+                    printf("Inverse fft at %d %d is %f + %fi instead of %f\n",
+                           k, y, back_re(k, y), back_im(k, y), v);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // A convolution, against a direct one.
+    {
+        const int R = 5, W = 50, H = 37;
+        Func in, kernel;
+        in(x, y) = cast<float>((x * 7 + y * 3) % 11);
+        kernel(x, y) = cast<float>(x + 2 * y + 20) / 100.0f;
+        Func f = fft_convolve(in, kernel, R, 16);
+        Image<float> result = f.realize(W, H);
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                float correct = 0;
+                for (int ky = -R; ky <= R; ky++) {
+                    for (int kx = -R; kx <= R; kx++) {
+                        int ix = x - kx, iy = y - ky;
+                        float v = (float)((((ix * 7 + iy * 3) % 11) + 11) % 11);
+                        correct += v * (kx + 2 * ky + 20) / 100.0f;
+                    }
+                }
+                if (fabs(result(x, y) - correct) > 1e-2) {
+                    printf("fft_convolve at %d %d is %f instead of %f\n",
+                           x, y, result(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <math.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+// The value of the bits of a half-precision float.
+double half_to_double(uint16_t h) {
+    int sign = (h & 0x8000) ? -1 : 1;
+    int exponent = (h >> 10) & 0x1f;
+    int mantissa = h & 0x3ff;
+    if (exponent == 0) {
+        return sign * ldexp((double)mantissa, -24);
+    } else if (exponent == 31) {
+        return mantissa ? NAN : sign * INFINITY;
+    } else {
+        return sign * ldexp((double)(mantissa + 1024), exponent - 25);
+    }
+}
+
+bool is_nan_half(uint16_t h) {
+    return ((h & 0x7c00) == 0x7c00) && (h & 0x3ff);
+}
+
+int main(int argc, char **argv) {
+    Var x;
+
+    // Every half-precision float.
+    const int N = 1 << 16;
+    Buffer all_halfs(Float(16), N);
+    uint16_t *all_halfs_ptr = (uint16_t *)all_halfs.host_ptr();
+    for (int i = 0; i < N; i++) {
+        all_halfs_ptr[i] = (uint16_t)i;
+    }
+
+    ImageParam in(Float(16), 1);
+    in.set(all_halfs);
+
+    for (int vector_width = 1; vector_width <= 8; vector_width *= 8) {
+        // Widen to single precision.
+        Func widen;
+        widen(x) = cast<float>(in(x));
+        if (vector_width > 1) widen.vectorize(x, vector_width);
+        Image<float> widened = widen.realize(N);
+
+        // Narrow back down again, which should be exact.
+        Func round_trip;
+        round_trip(x) = cast(Float(16), cast<float>(in(x)));
+        if (vector_width > 1) round_trip.vectorize(x, vector_width);
+        Buffer round_tripped(Float(16), N);
+        round_trip.realize(round_tripped);
+        uint16_t *round_tripped_ptr = (uint16_t *)round_tripped.host_ptr();
+
+        for (int i = 0; i < N; i++) {
+            uint16_t h = (uint16_t)i;
+            double correct = half_to_double(h);
+            if (is_nan_half(h)) {
+                if (widened(i) == widened(i)) {
+                    printf("widen(%04x) = %f instead of nan\n", h, widened(i));
+                    return -1;
+                }
+                continue;
+            }
+            if (widened(i) != (float)correct) {
+                printf("widen(%04x) = %.10g instead of %.10g\n", h, widened(i), correct);
+                return -1;
+            }
+            if (round_tripped_ptr[i] != h) {
+                printf("round_trip(%04x) = %04x\n", h, round_tripped_ptr[i]);
+                return -1;
+            }
+        }
+    }
+
+    // Narrowing rounds to nearest even, and overflows to infinity.
+    struct {
+        float value;
+        uint16_t bits;
+    } narrowings[] = {
+        {1.0f, 0x3c00},
+        {-2.0f, 0xc000},
+        {65504.0f, 0x7bff},
+        {65520.0f, 0x7c00},
+        {1.0e10f, 0x7c00},
+        {1.0f + 1.0f/1024, 0x3c01},
+        {1.0f + 1.0f/2048, 0x3c00},
+        {1.0f + 3.0f/2048, 0x3c02},
+        {1.0e-8f, 0x0000},
+        {3.0e-8f, 0x0001},
+        {-6.103515625e-05f, 0x8400}
+    };
+    const int M = sizeof(narrowings)/sizeof(narrowings[0]);
+    Image<float> values(M);
+    for (int i = 0; i < M; i++) {
+        values(i) = narrowings[i].value;
+    }
+
+    Func narrow;
+    narrow(x) = cast(Float(16), values(x));
+    Buffer narrowed(Float(16), M);
+    narrow.realize(narrowed);
+    uint16_t *narrowed_ptr = (uint16_t *)narrowed.host_ptr();
+    for (int i = 0; i < M; i++) {
+        if (narrowed_ptr[i] != narrowings[i].bits) {
+            printf("narrow(%.10g) = %04x instead of %04x\n",
+                   narrowings[i].value, narrowed_ptr[i], narrowings[i].bits);
+            return -1;
+        }
+    }
+
+    // Arithmetic on halfs happens in single precision.
+    Func sum;
+    sum(x) = in(x) + in(x);
+    if (sum.output_types()[0] != Float(32)) {
+        printf("Sum of two halfs has the wrong type\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <Halide.h>
+#include <algorithm>
+
+using namespace Halide;
+
+// Override Halide's malloc and free
+
+size_t custom_malloc_size = 0;
+
+void *my_malloc(void *user_context, size_t x) {
+    custom_malloc_size = x;
+    void *orig = malloc(x+32);
+    void *ptr = (void *)((((size_t)orig + 32) >> 5) << 5);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    free(((void**)ptr)[-1]);
+}
+
+bool error_occurred;
+void halide_error(void *user_context, const char *msg) {
+    printf("%s\n", msg);
+    error_occurred = true;
+}
+
+int main(int argc, char **argv) {
+    const int W = 1000, H = 100;
+    Var x, y;
+
+    {
+        // The size of the region of f used per row of g isn't a
+        // constant, because of the clamps, so f can only be folded
+        // by a factor from the schedule.
+        Func f, g;
+        Param<int> h;
+        f(x, y) = x + y;
+        g(x, y) = f(x, clamp(y-1, 0, h-1)) + f(x, clamp(y+1, 0, h-1));
+        f.store_root().compute_at(g, y).fold_storage(y, 4);
+
+        g.set_custom_allocator(my_malloc, my_free);
+        h.set(H);
+        Image<int> im = g.realize(W, H);
+
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                int correct = 2*x + std::max(y-1, 0) + std::min(y+1, H-1);
+                if (im(x, y) != correct) {
+                    printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+
+        if (custom_malloc_size == 0 || custom_malloc_size > W*4*sizeof(int)) {
+            printf("Scratch space allocated was %d instead of %d\n",
+                   (int)custom_malloc_size, (int)(W*4*sizeof(int)));
+            return -1;
+        }
+    }
+
+    {
+        // Three rows of f are used at once, so a factor of two is an
+        // error.
+        Func f, g;
+        f(x, y) = x + y;
+        g(x, y) = f(x, y-1) + f(x, y+1);
+        f.store_root().compute_at(g, y).fold_storage(y, 2);
+
+        g.set_error_handler(&halide_error);
+        error_occurred = false;
+        g.realize(W, H);
+
+        if (!error_occurred) {
+            printf("There should have been an error\n");
+            return -1;
+        }
+    }
+
+    {
+        // Fold along more than one dimension.
+        Func f, g;
+        Var t;
+        f(x, y) = x * y;
+        g(t) = f(t, t) + f(t-1, t-1);
+        f.store_root().compute_at(g, t).fold_storage(x, 2).fold_storage(y, 2);
+
+        Image<int> im = g.realize(H);
+        for (int t = 0; t < H; t++) {
+            int correct = t*t + (t-1)*(t-1);
+            if (im(t) != correct) {
+                printf("im(%d) = %d instead of %d\n", t, im(t), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
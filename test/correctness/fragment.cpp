@@ -0,0 +1,65 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <math.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    // A library pipeline, with an update definition and a schedule.
+    std::string text;
+    {
+        ImageParam input(Float(32), 2, "input");
+        Param<float> gain("gain");
+
+        Func curve("curve"), color("color");
+        RDom r(0, 256);
+        curve(x) = cast<float>(x) / 255.0f;
+        curve(r) = curve(r) * gain;
+        Expr idx = clamp(cast<int>(input(x, y) * 255.0f), 0, 255);
+        color(x, y) = curve(idx) + cast<float>(input.width());
+
+        curve.compute_root();
+        color.vectorize(x, 4);
+
+        text = fragment_to_string(color);
+    }
+
+    // Import it into another pipeline, on one of its Funcs.
+    Func src("src");
+    src(x, y) = cast<float>(x + y) / 200.0f;
+
+    std::map<std::string, Func> images;
+    images["input"] = src;
+    std::map<std::string, Expr> params;
+    params["gain"] = 2.0f;
+    params["input.extent.0"] = 100;
+    std::map<std::string, Func> funcs;
+    Func color = fragment_from_string(text, images, params, &funcs);
+
+    if (!funcs.count("curve") || !funcs.count("color")) {
+        printf("The Funcs of the fragment weren't returned\n");
+        return -1;
+    }
+
+    Func out("out");
+    out(x, y) = color(x, y);
+    Image<float> result = out.realize(100, 100);
+
+    for (int y = 0; y < result.height(); y++) {
+        for (int x = 0; x < result.width(); x++) {
+            float in = (float)(x + y) / 200.0f;
+            int idx = (int)(in * 255.0f);
+            idx = idx < 0 ? 0 : (idx > 255 ? 255 : idx);
+            float correct = ((float)idx / 255.0f) * 2.0f + 100.0f;
+            if (fabs(result(x, y) - correct) > 1e-4f) {
+                printf("result(%d, %d) = %f instead of %f\n", x, y, result(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    // Vector loads at data-dependent indices. On targets with AVX2
+    // these become hardware gathers.
+    const int N = 256;
+    ImageParam idx(Int(32), 1);
+    Image<int> indices(N);
+    for (int i = 0; i < N; i++) {
+        indices(i) = (i * 37 + 11) % 64;
+    }
+    idx.set(indices);
+
+    Var x;
+
+    // A lookup table of each narrow type, computed by the pipeline
+    // so that it's an internal allocation.
+    Func lut_u8, lut_u16, lut_f32, lut_i32;
+    lut_u8(x) = cast<uint8_t>(x * 3 + 1);
+    lut_u16(x) = cast<uint16_t>(x * 1001 + 7);
+    lut_f32(x) = cast<float>(x) * 0.5f;
+    lut_i32(x) = x * x - 100;
+    lut_u8.compute_root();
+    lut_u16.compute_root();
+    lut_f32.compute_root();
+    lut_i32.compute_root();
+
+    Expr i = clamp(idx(x), 0, 63);
+
+    for (int width = 8; width <= 16; width *= 2) {
+        Func f_u8, f_u16, f_f32, f_i32, f_in;
+        f_u8(x) = lut_u8(i);
+        f_u16(x) = lut_u16(i);
+        f_f32(x) = lut_f32(i);
+        f_i32(x) = lut_i32(i);
+        // A gather straight from an input image.
+        f_in(x) = idx(clamp(idx(x), 0, N-1));
+
+        f_u8.vectorize(x, width);
+        f_u16.vectorize(x, width);
+        f_f32.vectorize(x, width);
+        f_i32.vectorize(x, width);
+        f_in.vectorize(x, width);
+
+        Image<uint8_t> r_u8 = f_u8.realize(N);
+        Image<uint16_t> r_u16 = f_u16.realize(N);
+        Image<float> r_f32 = f_f32.realize(N);
+        Image<int> r_i32 = f_i32.realize(N);
+        Image<int> r_in = f_in.realize(N);
+
+        for (int k = 0; k < N; k++) {
+            int j = indices(k);
+            if (r_u8(k) != (uint8_t)(j * 3 + 1)) {
+                printf("u8: r(%d) = %d instead of %d\n", k, r_u8(k), (uint8_t)(j * 3 + 1));
+                return -1;
+            }
+            if (r_u16(k) != (uint16_t)(j * 1001 + 7)) {
+                printf("u16: r(%d) = %d instead of %d\n", k, r_u16(k), (uint16_t)(j * 1001 + 7));
+                return -1;
+            }
+            if (r_f32(k) != j * 0.5f) {
+                printf("f32: r(%d) = %f instead of %f\n", k, r_f32(k), j * 0.5f);
+                return -1;
+            }
+            if (r_i32(k) != j * j - 100) {
+                printf("i32: r(%d) = %d instead of %d\n", k, r_i32(k), j * j - 100);
+                return -1;
+            }
+            if (r_in(k) != indices(j)) {
+                printf("input: r(%d) = %d instead of %d\n", k, r_in(k), indices(j));
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
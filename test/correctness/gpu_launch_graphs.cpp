@@ -0,0 +1,62 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    // Defer the kernel launches, so that repeated runs replay them as
+    // a graph. Must be set before the first kernel runs.
+    setenv("HL_LAUNCH_GRAPHS", "1", 1);
+
+    Var x, y;
+    ImageParam in(Int(32), 2);
+
+    // A chain of gpu stages, each one a separate kernel.
+    const int stages = 6;
+    Func f[stages];
+    f[0](x, y) = in(x, y) + 1;
+    for (int i = 1; i < stages; i++) {
+        f[i](x, y) = f[i-1](x, y) * 2 + i;
+    }
+
+    Target t = get_jit_target_from_environment();
+    if (t.features & (Target::OpenCL | Target::CUDA)) {
+        for (int i = 0; i < stages; i++) {
+            f[i].cuda_tile(x, y, 16, 16);
+            if (i < stages - 1) f[i].compute_root();
+        }
+    }
+
+    // Run it several times on each of two sizes, with new input each
+    // time, so that batches are both replayed and told apart.
+    for (int run = 0; run < 6; run++) {
+        int size = (run & 1) ? 64 : 48;
+        Image<int> input(size, size);
+        for (int j = 0; j < size; j++) {
+            for (int i = 0; i < size; i++) {
+                input(i, j) = i + j * size + run;
+            }
+        }
+        in.set(input);
+
+        Image<int> result = f[stages-1].realize(size, size, t);
+
+        for (int j = 0; j < size; j++) {
+            for (int i = 0; i < size; i++) {
+                int correct = input(i, j) + 1;
+                for (int s = 1; s < stages; s++) {
+                    correct = correct * 2 + s;
+                }
+                if (result(i, j) != correct) {
+                    printf("run %d: result(%d, %d) = %d instead of %d\n",
+                           run, i, j, result(i, j), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
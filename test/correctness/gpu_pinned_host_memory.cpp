@@ -0,0 +1,61 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Func f;
+    Var x, y;
+    ImageParam in(Float(32), 2);
+    f(x, y) = in(x, y) * 2.0f + 1.0f;
+
+    Target t = get_jit_target_from_environment();
+
+    if (t.features & (Target::OpenCL | Target::CUDA)) {
+        f.cuda_tile(x, y, 16, 16);
+    }
+
+    Image<float> input(256, 256);
+    for (int y = 0; y < 256; y++) {
+        for (int x = 0; x < 256; x++) {
+            input(x, y) = (float)(x + y);
+        }
+    }
+    in.set(input);
+
+    // Pinning may not be possible on this target, but it must not
+    // change the contents of the buffer either way.
+    Buffer b = input;
+    bool pinned = f.pin_host_memory(b, t);
+    if (pinned != b.host_memory_pinned()) {
+        printf("pin_host_memory returned %d, but host_memory_pinned is %d\n",
+               (int)pinned, (int)b.host_memory_pinned());
+        return -1;
+    }
+    if (!(t.features & (Target::OpenCL | Target::CUDA)) && pinned) {
+        printf("Pinned host memory without a gpu target\n");
+        return -1;
+    }
+
+    // The output can be pinned too, after which the pipeline runs
+    // repeatedly into it.
+    Buffer out(Float(32), 256, 256);
+    f.pin_host_memory(out, t);
+    for (int i = 0; i < 3; i++) {
+        f.realize(out, t);
+        Image<float> result = out;
+        for (int y = 0; y < 256; y++) {
+            for (int x = 0; x < 256; x++) {
+                float correct = (x + y) * 2.0f + 1.0f;
+                if (result(x, y) != correct) {
+                    printf("result(%d, %d) = %f instead of %f\n",
+                           x, y, result(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
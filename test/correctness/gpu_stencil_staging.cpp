@@ -0,0 +1,56 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <algorithm>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int W = 200, H = 150;
+
+    ImageParam in(Float(32), 2);
+    Image<float> input(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            input(x, y) = (float)((x * 17 + y * 31) % 23);
+        }
+    }
+    in.set(input);
+
+    // A separable blur. On gpu targets both stages read a stencil of
+    // their input, which gets staged through shared memory.
+    Var x, y;
+    Func clamped, blur_x, blur_y;
+    clamped(x, y) = in(clamp(x, 0, W-1), clamp(y, 0, H-1));
+    blur_x(x, y) = clamped(x-1, y) + clamped(x, y) + clamped(x+1, y);
+    blur_y(x, y) = blur_x(x, y-1) + blur_x(x, y) + blur_x(x, y+1);
+
+    Target t = get_jit_target_from_environment();
+    if (t.has_gpu_feature()) {
+        blur_x.compute_root().cuda_tile(x, y, 16, 16);
+        // Tiles that don't divide the output, so the last ones overlap.
+        blur_y.cuda_tile(x, y, 8, 12);
+    }
+
+    Image<float> result = blur_y.realize(W, H, t);
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            float correct = 0;
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    int cx = std::min(std::max(x + dx, 0), W-1);
+                    int cy = std::min(std::max(y + dy, 0), H-1);
+                    correct += input(cx, cy);
+                }
+            }
+            if (result(x, y) != correct) {
+                printf("result(%d, %d) = %f instead of %f\n",
+                       x, y, result(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
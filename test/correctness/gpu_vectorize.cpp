@@ -0,0 +1,57 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <algorithm>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int W = 256, H = 64;
+
+    Image<float> input(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            input(x, y) = (float)((x * 13 + y * 7) % 19);
+        }
+    }
+
+    // Dense and reversed loads, vector comparisons and selects, and a
+    // reduction over the lanes of a vector, vectorized inside each
+    // gpu thread.
+    Var x, y, xi;
+    Func f, g;
+    f(x, y) = select(input(x, y) > input(W-1-x, y),
+                     input(x, y) * 2.0f,
+                     min(input(W-1-x, y), 5.0f));
+    RDom r(0, 4);
+    g(x, y) = sum(f(x*4 + r, y));
+
+    Target t = get_jit_target_from_environment();
+    if (t.has_gpu_feature()) {
+        f.compute_root().split(x, x, xi, 4).vectorize(xi).cuda_tile(x, y, 16, 8);
+        g.split(x, x, xi, 4).vectorize(xi).cuda_tile(x, y, 8, 8);
+    } else {
+        f.compute_root().vectorize(x, 4);
+        g.vectorize(x, 4);
+    }
+
+    Image<float> result = g.realize(W/4, H, t);
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W/4; x++) {
+            float correct = 0;
+            for (int i = 0; i < 4; i++) {
+                int fx = x*4 + i;
+                float a = input(fx, y), b = input(W-1-fx, y);
+                correct += a > b ? a * 2.0f : std::min(b, 5.0f);
+            }
+            if (result(x, y) != correct) {
+                printf("result(%d, %d) = %f instead of %f\n",
+                       x, y, result(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int W = 256, H = 20;
+
+    Image<int> input(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            input(x, y) = (x * 7 + y * 3) % 11 - 5;
+        }
+    }
+
+    // A sum of each row, with the terms of each row spread across the
+    // threads of a block. On cuda targets with warp shuffles, each
+    // warp adds up its terms before doing a single atomic add.
+    Var y, ti("threadidx");
+    RDom r(0, W);
+    Func total;
+    total(y) = 0;
+    total(y) += input(r, y);
+
+    Target t = get_jit_target_from_environment();
+    total.compute_root();
+    if (t.has_gpu_feature()) {
+        Var rx(r.x.name());
+        total.gpu_tile(y, 4);
+        total.update().atomic().split(rx, rx, ti, 64).parallel(ti).reorder(rx, ti).gpu_blocks(y);
+    } else {
+        total.update().atomic().parallel(r.x);
+    }
+
+    Image<int> result = total.realize(H, t);
+
+    for (int y = 0; y < H; y++) {
+        int correct = 0;
+        for (int x = 0; x < W; x++) {
+            correct += input(x, y);
+        }
+        if (result(y) != correct) {
+            printf("total(%d) = %d instead of %d\n", y, result(y), correct);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+int value(int x, int y, int c, int b, int t) {
+    return x + y * 2 + c * 3 + b * 5 + t * 7;
+}
+
+int main(int argc, char **argv) {
+    // A pipeline over 5-D and 6-D Funcs, reduced to a 2-D output. Only
+    // the inputs and outputs of a pipeline are limited to the four
+    // dimensions of a buffer_t.
+    Var x, y, c, b, t, u;
+    Func in5, f6, g;
+    in5(x, y, c, b, t) = x + y * 2 + c * 3 + b * 5 + t * 7;
+    f6(x, y, c, b, t, u) = in5(x, y, c, b, t) * (u + 1);
+
+    std::vector<Expr> mins(4, 0), extents;
+    extents.push_back(4);
+    extents.push_back(3);
+    extents.push_back(3);
+    extents.push_back(3);
+    RDom r(mins, extents);
+    g(x, y) = 0;
+    g(x, y) += f6(x, y, r[0], r[1], r[2], r[3]);
+
+    // Schedule over the fifth and sixth dims.
+    std::vector<VarOrRVar> order;
+    order.push_back(u);
+    order.push_back(t);
+    order.push_back(x);
+    order.push_back(y);
+    order.push_back(c);
+    order.push_back(b);
+    f6.compute_root().reorder(order).parallel(b);
+    in5.compute_at(f6, t);
+
+    Image<int> out = g.realize(16, 8);
+    for (int yy = 0; yy < 8; yy++) {
+        for (int xx = 0; xx < 16; xx++) {
+            int correct = 0;
+            for (int uu = 0; uu < 3; uu++) {
+                for (int tt = 0; tt < 3; tt++) {
+                    for (int bb = 0; bb < 3; bb++) {
+                        for (int cc = 0; cc < 4; cc++) {
+                            correct += value(xx, yy, cc, bb, tt) * (uu + 1);
+                        }
+                    }
+                }
+            }
+            if (out(xx, yy) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", xx, yy, out(xx, yy), correct);
+                return -1;
+            }
+        }
+    }
+
+    // A five-dimensional reduction domain.
+    std::vector<Expr> mins5(5, 0), extents5(5, 2);
+    RDom r5(mins5, extents5);
+    Func total;
+    total(x) = 0;
+    total(x) += in5(r5[0], r5[1], r5[2], r5[3], r5[4]);
+    Image<int> sum = total.realize(1);
+    int correct = 0;
+    for (int i = 0; i < 32; i++) {
+        correct += value(i & 1, (i >> 1) & 1, (i >> 2) & 1, (i >> 3) & 1, (i >> 4) & 1);
+    }
+    if (sum(0) != correct) {
+        printf("sum = %d instead of %d\n", sum(0), correct);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+bool error_occurred;
+void halide_error(void *user_context, const char *msg) {
+    printf("%s\n", msg);
+    error_occurred = true;
+}
+
+int main(int argc, char **argv) {
+    ImageParam input(Float(32), 2);
+    input.set_host_alignment(32).set_no_alias();
+    input.set_min(0, 0).set_min(1, 0);
+    input.set_stride(1, (input.stride(1)/8)*8);
+
+    Var x, y;
+    Func f;
+    f(x, y) = input(x, y) * 2.0f;
+    f.vectorize(x, 8);
+    f.output_buffer().set_host_alignment(32).set_no_alias();
+    f.set_error_handler(&halide_error);
+
+    // Images are allocated 32-byte aligned.
+    Image<float> in(64, 16);
+    for (int y = 0; y < in.height(); y++) {
+        for (int x = 0; x < in.width(); x++) {
+            in(x, y) = x + y * 3.0f;
+        }
+    }
+    input.set(in);
+    error_occurred = false;
+    Image<float> out = f.realize(64, 16);
+    if (error_occurred) {
+        printf("There shouldn't have been an error\n");
+        return -1;
+    }
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            if (out(x, y) != in(x, y) * 2.0f) {
+                printf("out(%d, %d) = %f instead of %f\n", x, y, out(x, y), in(x, y) * 2.0f);
+                return -1;
+            }
+        }
+    }
+
+    // A reversed read of an aligned input is a dense aligned load too.
+    Func g;
+    g(x, y) = input(63 - x, y);
+    g.vectorize(x, 8);
+    g.set_error_handler(&halide_error);
+    error_occurred = false;
+    Image<float> rev = g.realize(64, 16);
+    if (error_occurred) {
+        printf("There shouldn't have been an error\n");
+        return -1;
+    }
+    for (int y = 0; y < rev.height(); y++) {
+        for (int x = 0; x < rev.width(); x++) {
+            if (rev(x, y) != in(63 - x, y)) {
+                printf("rev(%d, %d) = %f instead of %f\n", x, y, rev(x, y), in(63 - x, y));
+                return -1;
+            }
+        }
+    }
+
+    // An input one float past an aligned address should fail the check.
+    std::vector<int32_t> sizes(2), strides(2), mins(2, 0);
+    sizes[0] = 63;
+    sizes[1] = 16;
+    strides[0] = 1;
+    strides[1] = 64;
+    Buffer misaligned(Float(32), sizes, strides, mins, (uint8_t *)(&in(1, 0)));
+    input.set(misaligned);
+    error_occurred = false;
+    f.realize(63, 16);
+    if (!error_occurred) {
+        printf("There should have been a runtime error\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    // Check the runtime finds a cache size at each level.
+    for (int level = 1; level <= 3; level++) {
+        Func size;
+        size() = host_cache_size(level);
+        Image<int> result = size.realize();
+        if (result(0) <= 0) {
+            printf("host_cache_size(%d) = %d\n", level, result(0));
+            return -1;
+        }
+    }
+
+    // Tile by a factor that depends on the size of the L2 cache.
+    Func f;
+    Var x, y, xi, yi;
+    f(x, y) = x + y * 256;
+    Expr rows = max(host_cache_size(2) / (4 * 256 * 4), 1);
+    f.tile(x, y, xi, yi, 64, rows);
+
+    Image<int> out = f.realize(256, 300);
+    for (int y = 0; y < 300; y++) {
+        for (int x = 0; x < 256; x++) {
+            if (out(x, y) != x + y * 256) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), x + y * 256);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
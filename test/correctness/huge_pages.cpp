@@ -0,0 +1,32 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    target.features |= Target::HugePages;
+
+    // An intermediate of 16MB, computed and consumed in parallel, which
+    // gets huge pages and is first-touched across the thread pool.
+    Func f, g;
+    Var x, y;
+    f(x, y) = x * 3 + y;
+    g(x, y) = f(x, y) + f(x, 2047 - y);
+    f.compute_root().parallel(y);
+    g.parallel(y);
+
+    Image<int> out = g.realize(2048, 2048, target);
+    for (int y = 0; y < 2048; y++) {
+        for (int x = 0; x < 2048; x++) {
+            int correct = x * 6 + 2047;
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
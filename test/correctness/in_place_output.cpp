@@ -0,0 +1,73 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Var x("x"), y("y");
+    const int W = 67, H = 20;
+
+    // A pointwise stage, vectorized and parallel.
+    {
+        ImageParam in(Float(32), 2, "in");
+        Func scale("scale");
+        scale(x, y) = in(x, y) * 2.0f + 1.0f;
+        scale.vectorize(x, 8).parallel(y);
+        scale.output_buffer().set_in_place(in);
+
+        Image<float> im(W, H);
+        for (int yy = 0; yy < H; yy++) {
+            for (int xx = 0; xx < W; xx++) {
+                im(xx, yy) = xx + yy;
+            }
+        }
+        in.set(im);
+        scale.realize(im);
+
+        for (int yy = 0; yy < H; yy++) {
+            for (int xx = 0; xx < W; xx++) {
+                float correct = (xx + yy) * 2.0f + 1.0f;
+                if (im(xx, yy) != correct) {
+                    printf("im(%d, %d) = %f instead of %f\n", xx, yy, im(xx, yy), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // A stage that reads ahead of the point it writes, over one less
+    // column of the same memory.
+    {
+        ImageParam in(Int(32), 2, "in");
+        Func diff("diff");
+        diff(x, y) = in(x + 1, y) - in(x, y);
+        diff.vectorize(x, 4);
+        diff.output_buffer().set_in_place(in);
+
+        Image<int> im(W, H);
+        for (int yy = 0; yy < H; yy++) {
+            for (int xx = 0; xx < W; xx++) {
+                im(xx, yy) = xx * xx + yy;
+            }
+        }
+        buffer_t cropped = *im.raw_buffer();
+        cropped.extent[0] = W - 1;
+        Buffer out(Int(32), &cropped);
+
+        in.set(im);
+        diff.realize(out);
+
+        for (int yy = 0; yy < H; yy++) {
+            for (int xx = 0; xx < W - 1; xx++) {
+                int correct = 2 * xx + 1;
+                if (im(xx, yy) != correct) {
+                    printf("im(%d, %d) = %d instead of %d\n", xx, yy, im(xx, yy), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
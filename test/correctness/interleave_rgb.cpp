@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+// Convert between interleaved and planar layouts of an image with the
+// given number of channels, and check the results.
+template<typename T>
+int test_interleave(int channels) {
+    const int W = 67, H = 8;
+    Var x, y, c;
+
+    // An interleaved input and a planar input.
+    ImageParam interleaved_in(type_of<T>(), 3), planar_in(type_of<T>(), 3);
+    interleaved_in.set_stride(0, channels);
+    interleaved_in.set_stride(2, 1);
+    interleaved_in.set_extent(2, channels);
+
+    Image<T> interleaved_data(channels, W, H), planar_data(W, H, channels);
+    for (int cc = 0; cc < channels; cc++) {
+        for (int yy = 0; yy < H; yy++) {
+            for (int xx = 0; xx < W; xx++) {
+                T val = (T)(xx * 3 + yy * 5 + cc * 7);
+                interleaved_data(cc, xx, yy) = val;
+                planar_data(xx, yy, cc) = val;
+            }
+        }
+    }
+
+    // Describe the interleaved data as a (x, y, c) image.
+    buffer_t interleaved_buf = *interleaved_data.raw_buffer();
+    interleaved_buf.extent[0] = W;
+    interleaved_buf.extent[1] = H;
+    interleaved_buf.extent[2] = channels;
+    interleaved_buf.stride[0] = channels;
+    interleaved_buf.stride[1] = channels * W;
+    interleaved_buf.stride[2] = 1;
+    interleaved_in.set(Buffer(type_of<T>(), &interleaved_buf));
+    planar_in.set(planar_data);
+
+    // Deinterleave: strided loads.
+    Func to_planar;
+    to_planar(x, y, c) = interleaved_in(x, y, c);
+    to_planar.bound(c, 0, channels).reorder(c, x, y).unroll(c).vectorize(x, 8);
+    Image<T> planar_out = to_planar.realize(W, H, channels);
+
+    // Interleave: strided stores that get combined.
+    Func to_interleaved;
+    to_interleaved(x, y, c) = planar_in(x, y, c) + 1;
+    to_interleaved.output_buffer().set_stride(0, channels);
+    to_interleaved.output_buffer().set_stride(2, 1);
+    to_interleaved.output_buffer().set_extent(2, channels);
+    to_interleaved.reorder(c, x, y).bound(c, 0, channels).unroll(c).vectorize(x, 8);
+
+    Image<T> interleaved_out(channels, W, H);
+    buffer_t out_buf = *interleaved_out.raw_buffer();
+    out_buf.extent[0] = W;
+    out_buf.extent[1] = H;
+    out_buf.extent[2] = channels;
+    out_buf.stride[0] = channels;
+    out_buf.stride[1] = channels * W;
+    out_buf.stride[2] = 1;
+    to_interleaved.realize(Buffer(type_of<T>(), &out_buf));
+
+    for (int cc = 0; cc < channels; cc++) {
+        for (int yy = 0; yy < H; yy++) {
+            for (int xx = 0; xx < W; xx++) {
+                T correct = (T)(xx * 3 + yy * 5 + cc * 7);
+                if (planar_out(xx, yy, cc) != correct) {
+                    printf("planar(%d, %d, %d) = %d instead of %d\n",
+                           xx, yy, cc, (int)planar_out(xx, yy, cc), (int)correct);
+                    return -1;
+                }
+                correct = (T)(correct + 1);
+                if (interleaved_out(cc, xx, yy) != correct) {
+                    printf("interleaved(%d, %d, %d) = %d instead of %d\n",
+                           xx, yy, cc, (int)interleaved_out(cc, xx, yy), (int)correct);
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    for (int channels = 2; channels <= 4; channels++) {
+        if (test_interleave<uint8_t>(channels)) return -1;
+        if (test_interleave<uint16_t>(channels)) return -1;
+        if (test_interleave<float>(channels)) return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
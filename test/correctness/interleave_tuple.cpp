@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+int allocations = 0;
+size_t allocated_size = 0;
+
+void *my_malloc(void *user_context, size_t x) {
+    allocations++;
+    allocated_size = x;
+    void *orig = malloc(x+32);
+    void *ptr = (void *)((((size_t)orig + 32) >> 5) << 5);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    free(((void**)ptr)[-1]);
+}
+
+int main(int argc, char **argv) {
+    const int W = 64, H = 32;
+    Var x, y;
+
+    // Multiply complex numbers stored interleaved.
+    Func c, g;
+    c(x, y) = Tuple(x + y, x - y);
+    g(x, y) = (c(x, y)[0] * c(x+1, y)[0] - c(x, y)[1] * c(x+1, y)[1] +
+               c(x, y)[0] * c(x+1, y)[1] + c(x, y)[1] * c(x+1, y)[0]);
+    c.compute_root().interleave_tuple().vectorize(x, 4);
+    g.vectorize(x, 4);
+
+    g.set_custom_allocator(my_malloc, my_free);
+    Image<int> im = g.realize(W, H);
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            int re = ((x + y) * (x + 1 + y) - (x - y) * (x + 1 - y));
+            int im_part = ((x + y) * (x + 1 - y) + (x - y) * (x + 1 + y));
+            int correct = re + im_part;
+            if (im(x, y) != correct) {
+                printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    // Both values of c live in one allocation.
+    size_t correct_size = (W + 1) * H * 2 * sizeof(int);
+    if (allocations != 1 || allocated_size < correct_size) {
+        printf("%d allocations of %d bytes instead of one of %d bytes\n",
+               allocations, (int)allocated_size, (int)correct_size);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+using namespace Halide;
+
+bool error_occurred;
+extern "C" void my_error_handler(void *user_context, const char *msg) {
+    error_occurred = true;
+}
+
+int main(int argc, char **argv) {
+    // Run realizations of up to 10000 points on the interpreter.
+    setenv("HL_INTERPRET", "10000", 1);
+
+    Image<uint8_t> input(40, 30);
+    for (int y = 0; y < input.height(); y++) {
+        for (int x = 0; x < input.width(); x++) {
+            input(x, y) = (uint8_t)(x * 7 + y * 13);
+        }
+    }
+
+    Var x, y, xi, yi;
+
+    // A blur, with an intermediate, vectorization, and a split.
+    Func in, blur_x, blur_y;
+    in(x, y) = cast<uint16_t>(input(clamp(x, 0, 39), clamp(y, 0, 29)));
+    blur_x(x, y) = (in(x-1, y) + in(x, y) + in(x+1, y)) / 3;
+    blur_y(x, y) = cast<uint8_t>((blur_x(x, y-1) + blur_x(x, y) + blur_x(x, y+1)) / 3);
+    blur_y.tile(x, y, xi, yi, 8, 4).vectorize(xi, 4).parallel(y);
+    blur_x.compute_at(blur_y, x).vectorize(x, 4);
+
+    Image<uint8_t> out = blur_y.realize(40, 30);
+    for (int y = 0; y < 30; y++) {
+        for (int x = 0; x < 40; x++) {
+            int bx[3];
+            for (int j = 0; j < 3; j++) {
+                int yy = std::min(std::max(y + j - 1, 0), 29);
+                int sum = 0;
+                for (int i = -1; i <= 1; i++) {
+                    sum += input(std::min(std::max(x + i, 0), 39), yy);
+                }
+                bx[j] = sum / 3;
+            }
+            int correct = (bx[0] + bx[1] + bx[2]) / 3;
+            if (out(x, y) != correct) {
+                printf("blur(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    // Floating point math, signed division, and a reduction.
+    Func f, g;
+    f(x) = sqrt(cast<float>(x)) + (x - 50) / 7 + (x - 50) % 7;
+    RDom r(0, 10);
+    g(x) = 0.0f;
+    g(x) += f(x + r);
+    f.compute_root();
+
+    Image<float> g_out = g.realize(100);
+    for (int x = 0; x < 100; x++) {
+        float correct = 0.0f;
+        for (int i = 0; i < 10; i++) {
+            int k = x + i - 50;
+            int q = k / 7, m = k % 7;
+            if (m < 0) {q--; m += 7;}
+            correct += sqrtf((float)(x + i)) + q + m;
+        }
+        if (fabs(g_out(x) - correct) > 0.001f) {
+            printf("g(%d) = %f instead of %f\n", x, g_out(x), correct);
+            return -1;
+        }
+    }
+
+    // Failed assertions go to the error handler.
+    ImageParam param(UInt(8), 1);
+    Func h;
+    h(x) = param(x);
+    h.set_error_handler(my_error_handler);
+    Image<uint8_t> small(10);
+    param.set(small);
+    error_occurred = false;
+    h.realize(20);
+    if (!error_occurred) {
+        printf("Reading out of bounds should have been an error\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
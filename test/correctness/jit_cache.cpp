@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+Func make_pipeline(float k) {
+    Var x, y;
+    Func f, g;
+    f(x, y) = cast<float>(x + y) * k;
+    g(x, y) = f(x, y) + f(x+1, y);
+    f.compute_root();
+    return g;
+}
+
+int main(int argc, char **argv) {
+    // Building the same pipeline again makes fresh names for
+    // everything, but should still reuse the compiled code.
+    Func a = make_pipeline(2.0f);
+    Func b = make_pipeline(2.0f);
+    void *fa = a.compile_jit();
+    void *fb = b.compile_jit();
+    if (fa != fb) {
+        printf("Identical pipelines were compiled twice\n");
+        return -1;
+    }
+
+    // A pipeline that differs only in a constant must not.
+    Func c = make_pipeline(2.0000002f);
+    void *fc = c.compile_jit();
+    if (fc == fa) {
+        printf("Different pipelines share compiled code\n");
+        return -1;
+    }
+
+    Image<float> im_b = b.realize(10, 10);
+    Image<float> im_c = c.realize(10, 10);
+    for (int y = 0; y < 10; y++) {
+        for (int x = 0; x < 10; x++) {
+            float correct_b = (x + y) * 2.0f + (x + 1 + y) * 2.0f;
+            float correct_c = (x + y) * 2.0000002f + (x + 1 + y) * 2.0000002f;
+            if (im_b(x, y) != correct_b || im_c(x, y) != correct_c) {
+                printf("im_b(%d, %d) = %f instead of %f\n"
+                       "im_c(%d, %d) = %f instead of %f\n",
+                       x, y, im_b(x, y), correct_b, x, y, im_c(x, y), correct_c);
+                return -1;
+            }
+        }
+    }
+
+    clear_jit_cache();
+    Func d = make_pipeline(2.0f);
+    d.compile_jit();
+
+    printf("Success!\n");
+    return 0;
+}
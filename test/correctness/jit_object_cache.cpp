@@ -0,0 +1,58 @@
+#include <Halide.h>
+#include <stdio.h>
+#ifndef _MSC_VER
+#include <sys/stat.h>
+#endif
+
+using namespace Halide;
+
+bool check(Func f) {
+    Image<int> im = f.realize(32, 32);
+    for (int y = 0; y < 32; y++) {
+        for (int x = 0; x < 32; x++) {
+            int correct = x*y + 2*x + 1;
+            if (im(x, y) != correct) {
+                printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+Func make_pipeline() {
+    Var x, y;
+    Func f, g;
+    f(x, y) = x*y + x;
+    g(x, y) = f(x, y) + x + 1;
+    g.parallel(y);
+    return g;
+}
+
+int main(int argc, char **argv) {
+    #ifndef _MSC_VER
+    mkdir("jit_object_cache", 0755);
+    #endif
+    set_jit_cache_directory("jit_object_cache");
+
+    // The first compile saves the machine code (unless an earlier run
+    // already did). Forgetting the in-memory copy makes the second one
+    // load it from disk.
+    if (!check(make_pipeline())) return -1;
+    clear_jit_cache();
+    int hits = jit_cache_directory_hits();
+    if (!check(make_pipeline())) return -1;
+
+    // The directory is ignored where there's no MCJIT.
+    #if !defined(__APPLE__) && !defined(_MSC_VER)
+    if (jit_cache_directory_hits() != hits + 1) {
+        printf("The second compile didn't load the machine code from disk\n");
+        return -1;
+    }
+    #endif
+
+    set_jit_cache_directory("");
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int W = 67, H = 19, C = 3;
+    Image<uint16_t> input(W + 1, H, C);
+    for (int c = 0; c < C; c++) {
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W + 1; x++) {
+                input(x, y, c) = rand() & 0xfff;
+            }
+        }
+    }
+
+    // With large buffers, the inputs and outputs are indexed in 64
+    // bits across rows and channels, and in 32 bits along them, so
+    // dense vector loads and stores stay dense.
+    Target t = get_jit_target_from_environment();
+    t.features |= Target::LargeBuffers;
+
+    Var x, y, c;
+    Func f, g;
+    f(x, y, c) = input(x, y, c) * 2 + input(x + 1, y, C - 1 - c);
+    g(x, y, c) = f(x, y, c);
+    g(x, y, c) += cast<uint16_t>(y);
+    f.compute_at(g, y).vectorize(x, 8);
+    g.vectorize(x, 8);
+    g.update().vectorize(x, 8);
+
+    Image<uint16_t> out = g.realize(W, H, C, t);
+
+    for (int c = 0; c < C; c++) {
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                uint16_t correct = input(x, y, c) * 2 + input(x + 1, y, C - 1 - c) + y;
+                if (out(x, y, c) != correct) {
+                    printf("out(%d, %d, %d) = %d instead of %d\n",
+                           x, y, c, out(x, y, c), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+// Several root-level stages give lowering several loop nests to run
+// passes on at once (with HL_NUMTHREADS > 1, or on a multi-core
+// machine). The output must not depend on how they were split up.
+int main(int argc, char **argv) {
+    Var x, y;
+    const int stages = 6;
+    Func f[stages];
+    f[0](x, y) = x + y;
+    for (int i = 1; i < stages; i++) {
+        f[i](x, y) = f[i-1](x, y) * 2 + f[i-1](x + 1, y) + (x*y + i) * (x*y + i);
+        f[i-1].compute_root();
+        if (i % 2) {
+            f[i-1].vectorize(x, 4);
+        } else {
+            f[i-1].unroll(x, 2);
+        }
+    }
+    Func out = f[stages-1];
+    out.vectorize(x, 8);
+
+    Image<int> im = out.realize(64, 16);
+
+    // The same pipeline computed on the host.
+    const int W = 64 + stages, H = 16;
+    int ref[stages][H][W];
+    for (int j = 0; j < H; j++) {
+        for (int i = 0; i < W; i++) {
+            ref[0][j][i] = i + j;
+        }
+    }
+    for (int s = 1; s < stages; s++) {
+        for (int j = 0; j < H; j++) {
+            for (int i = 0; i < W - s; i++) {
+                ref[s][j][i] = ref[s-1][j][i] * 2 + ref[s-1][j][i+1] + (i*j + s) * (i*j + s);
+            }
+        }
+    }
+
+    for (int j = 0; j < im.height(); j++) {
+        for (int i = 0; i < im.width(); i++) {
+            if (im(i, j) != ref[stages-1][j][i]) {
+                printf("im(%d, %d) = %d instead of %d\n", i, j, im(i, j), ref[stages-1][j][i]);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
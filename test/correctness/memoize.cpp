@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+// NB: You must compile with -rdynamic for llvm to be able to find the appropriate symbols
+
+#ifdef _MSC_VER
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+int call_counter = 0;
+extern "C" DLLEXPORT float count_calls(int x) {
+    call_counter++;
+    return (float)x;
+}
+HalideExtern_1(float, count_calls, int);
+
+int main(int argc, char **argv) {
+    Param<float> gain, offset;
+    Var x;
+
+    // An expensive lookup table that only depends on gain.
+    Func lut, f;
+    lut(x) = count_calls(x) * gain;
+    f(x) = lut(x) + offset;
+    lut.compute_root().memoize();
+
+    float gains[] = {2.0f, 2.0f, 3.0f, 2.0f};
+    float offsets[] = {1.0f, 5.0f, 5.0f, 1.0f};
+    // The number of calls to count_calls expected after each run.
+    // The second run differs only in offset, and the fourth repeats
+    // the first, so neither recomputes the table.
+    int expected_calls[] = {256, 256, 512, 512};
+
+    for (int i = 0; i < 4; i++) {
+        gain.set(gains[i]);
+        offset.set(offsets[i]);
+        Image<float> result = f.realize(256);
+        for (int j = 0; j < 256; j++) {
+            float correct = j * gains[i] + offsets[i];
+            if (result(j) != correct) {
+                printf("run %d: result(%d) = %f instead of %f\n", i, j, result(j), correct);
+                return -1;
+            }
+        }
+        if (call_counter != expected_calls[i]) {
+            printf("After run %d the table was computed at %d points instead of %d\n",
+                   i, call_counter, expected_calls[i]);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
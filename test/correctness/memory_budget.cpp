@@ -0,0 +1,82 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+// The user_context of each call: a budget, and the estimate the
+// pipeline gave.
+struct Budget {
+    int64_t limit, estimate;
+};
+
+int my_check_memory_budget(void *user_context, const char *pipeline, int64_t bytes, int is_query) {
+    Budget *b = (Budget *)user_context;
+    b->estimate = bytes;
+    return bytes > b->limit;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    target.features |= Target::MemoryBudget;
+
+    const int W = 256, H = 128;
+    Func g("g"), f("f");
+    Var x("x"), y("y");
+    g(x, y) = x + y;
+    f(x, y) = g(x, y) + g(x + 1, y);
+    g.compute_root();
+    f.set_custom_check_memory_budget(my_check_memory_budget);
+
+    Callable c = f.compile_to_callable(target);
+
+    // g is (W + 1) x H ints, which a budget of W x H ints doesn't
+    // cover, and twice that does.
+    const int64_t needed = (W + 1) * H * sizeof(int);
+    const int64_t limits[] = {W * H * sizeof(int), 2 * needed};
+    for (int i = 0; i < 2; i++) {
+        Image<int> out(W, H);
+        for (int yy = 0; yy < H; yy++) {
+            for (int xx = 0; xx < W; xx++) {
+                out(xx, yy) = -1;
+            }
+        }
+
+        Budget budget = {limits[i], 0};
+        const void *args[] = {out.raw_buffer()};
+        int result = c(args, &budget);
+
+        if (budget.estimate != needed) {
+            printf("The peak memory was estimated as %lld bytes instead of %lld\n",
+                   (long long)budget.estimate, (long long)needed);
+            return -1;
+        }
+
+        if (limits[i] < needed) {
+            if (result != -3) {
+                printf("A call over budget returned %d\n", result);
+                return -1;
+            }
+            if (out(0, 0) != -1) {
+                printf("A call over budget still computed its output\n");
+                return -1;
+            }
+        } else {
+            if (result != 0) {
+                printf("A call within budget returned %d\n", result);
+                return -1;
+            }
+            for (int yy = 0; yy < H; yy++) {
+                for (int xx = 0; xx < W; xx++) {
+                    int correct = 2 * (xx + yy) + 1;
+                    if (out(xx, yy) != correct) {
+                        printf("out(%d, %d) = %d instead of %d\n", xx, yy, out(xx, yy), correct);
+                        return -1;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <algorithm>
+
+using namespace Halide;
+
+#ifdef _MSC_VER
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+int call_count;
+extern "C" DLLEXPORT int call_counter(int x) {
+    call_count++;
+    return x;
+}
+
+HalideExtern_1(int, call_counter, int);
+
+int main(int argc, char **argv) {
+    const int W = 64, H = 48;
+
+    Image<uint8_t> input(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            input(x, y) = (uint8_t)(x * 3 + y * 5);
+        }
+    }
+
+    // An intermediate used by three outputs of different sizes and
+    // types: the full-size image, a thumbnail, and a histogram.
+    Var x, y;
+    Func shared;
+    shared(x, y) = call_counter(cast<int>(input(x, y)) * 2);
+    shared.compute_root();
+
+    Func full;
+    full(x, y) = cast<uint16_t>(shared(x, y) + 1);
+
+    Func thumb;
+    thumb(x, y) = cast<float>(shared(2*x, 2*y) + shared(2*x+1, 2*y+1)) / 2;
+
+    Func hist;
+    RDom r(0, W, 0, H);
+    hist(x) = 0;
+    hist(clamp(shared(r.x, r.y) / 32, 0, 15)) += 1;
+
+    Pipeline p(full, thumb, hist);
+
+    Image<uint16_t> full_out(W, H);
+    Image<float> thumb_out(W/2, H/2);
+    Image<int> hist_out(16);
+    call_count = 0;
+    p.realize(Realization(full_out, thumb_out, hist_out));
+
+    // The shared Func is computed once, over the whole input.
+    if (call_count != W * H) {
+        printf("shared was computed at %d points instead of %d\n", call_count, W * H);
+        return -1;
+    }
+
+    int correct_hist[16] = {0};
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            int s = input(x, y) * 2;
+            if (full_out(x, y) != s + 1) {
+                printf("full(%d, %d) = %d instead of %d\n", x, y, full_out(x, y), s + 1);
+                return -1;
+            }
+            int bucket = std::min(s / 32, 15);
+            correct_hist[bucket]++;
+        }
+    }
+
+    for (int y = 0; y < H/2; y++) {
+        for (int x = 0; x < W/2; x++) {
+            float correct = (input(2*x, 2*y) * 2 + input(2*x+1, 2*y+1) * 2) / 2.0f;
+            if (thumb_out(x, y) != correct) {
+                printf("thumb(%d, %d) = %f instead of %f\n", x, y, thumb_out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    for (int i = 0; i < 16; i++) {
+        if (hist_out(i) != correct_hist[i]) {
+            printf("hist(%d) = %d instead of %d\n", i, hist_out(i), correct_hist[i]);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+// A function of uint8 that computes in float, and one that stays in
+// uint8.
+void make_pipeline(Func &widened, Func &narrow) {
+    Var x("x");
+    Func in("in");
+    widened = Func("widened");
+    narrow = Func("narrow");
+    in(x) = cast<uint8_t>(x * 3);
+    widened(x) = cast<uint8_t>(in(x) * 0.5f);
+    narrow(x) = in(x) / 2 + widened(x);
+}
+
+int check_width(Func f, const std::string &target, int correct) {
+    int width = Internal::natural_vector_size(f.function(), parse_target_string(target));
+    if (width != correct) {
+        printf("The natural vector size of %s on %s is %d instead of %d\n",
+               f.name().c_str(), target.c_str(), width, correct);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Var x("x");
+    Func widened, narrow;
+    make_pipeline(widened, narrow);
+    widened.compute_root().vectorize_natural(x);
+    narrow.vectorize_natural(x);
+
+    if (check_width(widened, "x86-64-linux-sse41", 4) ||
+        check_width(widened, "x86-64-linux-avx", 8) ||
+        check_width(widened, "x86-64-linux-avx-avx2", 8) ||
+        check_width(widened, "arm-32-android", 4) ||
+        check_width(narrow, "x86-64-linux-sse41", 16) ||
+        check_width(narrow, "x86-64-linux-avx", 16) ||
+        check_width(narrow, "x86-64-linux-avx-avx2", 32)) {
+        return -1;
+    }
+
+    // The schedule doesn't name a width, so it can be loaded onto
+    // the same pipeline built for another target.
+    std::string text = schedule_to_string(narrow);
+    if (text.find("natural") == std::string::npos) {
+        printf("The natural width wasn't saved:\n%s\n", text.c_str());
+        return -1;
+    }
+    Func widened2, narrow2;
+    make_pipeline(widened2, narrow2);
+    schedule_from_string(narrow2, text);
+    if (schedule_to_string(narrow2) != text) {
+        printf("The schedule changed when it was loaded:\n%s\ninstead of:\n%s\n",
+               schedule_to_string(narrow2).c_str(), text.c_str());
+        return -1;
+    }
+
+    Image<uint8_t> im = narrow.realize(100);
+    Image<uint8_t> im2 = narrow2.realize(100);
+    for (int i = 0; i < im.width(); i++) {
+        uint8_t in = (uint8_t)(i * 3);
+        uint8_t correct = (uint8_t)(in / 2 + (uint8_t)(in * 0.5f));
+        if (im(i) != correct || im2(i) != correct) {
+            printf("im(%d) = %d and im2(%d) = %d instead of %d\n",
+                   i, im(i), i, im2(i), correct);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,32 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    // A root intermediate and an output, both written with streaming
+    // stores from parallel strips.
+    Func f("f"), g("g");
+    f(x, y) = x * 3 + y;
+    g(x, y) = cast<uint8_t>(f(x, y) + f(x + 1, y));
+
+    f.compute_root().vectorize(x, 8).parallel(y).store_nontemporal();
+    g.vectorize(x, 16).parallel(y).store_nontemporal();
+
+    Image<uint8_t> out = g.realize(100, 50);
+
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            uint8_t correct = (uint8_t)((x * 3 + y) + ((x + 1) * 3 + y));
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
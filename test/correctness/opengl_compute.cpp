@@ -0,0 +1,59 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <math.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int W = 96, H = 70;
+
+    Image<float> input(W + 2, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W + 2; x++) {
+            input(x, y) = (float)((x * 17 + y * 5) % 23) - 11.0f;
+        }
+    }
+
+    // A pointwise stage, with float math and a select, and then an
+    // integer stencil over it, with division and modulus of negative
+    // numbers.
+    Var x, y;
+    Func f, g;
+    f(x, y) = select(input(x, y) > 0.0f, sqrt(input(x, y)), input(x, y) * 0.5f);
+    Expr i = cast<int>(floor(f(x, y) + f(x + 1, y) + f(x + 2, y)));
+    g(x, y) = i / 3 + i % 5 + x / 4;
+
+    Target t = get_jit_target_from_environment();
+    if (t.features & Target::OpenGL) {
+        f.compute_root().gpu_tile(x, y, 16, 8, GPU_GLSL);
+        g.gpu_tile(x, y, 8, 8, GPU_GLSL);
+    } else {
+        // Without OpenGL, check the same pipeline on the cpu.
+        f.compute_root();
+    }
+
+    Image<int> result = g.realize(W, H, t);
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            float fs[3];
+            for (int k = 0; k < 3; k++) {
+                float in = input(x + k, y);
+                fs[k] = in > 0.0f ? sqrtf(in) : in * 0.5f;
+            }
+            int i = (int)floorf(fs[0] + fs[1] + fs[2]);
+            // Halide rounds division down, and modulus is positive.
+            int q = i / 3, r = i % 5;
+            if (i % 3 != 0 && i < 0) q--;
+            if (r < 0) r += 5;
+            int correct = q + r + x / 4;
+            if (result(x, y) != correct) {
+                printf("result(%d, %d) = %d instead of %d\n", x, y, result(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,34 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <algorithm>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    target.features |= Target::OptimizeSize;
+
+    // A clamped boundary, an unroll too big to keep, and a small one,
+    // all of which must still compute the same thing.
+    Func input, f;
+    Var x, y, xi;
+    input(x, y) = x + y * 100;
+    f(x, y) = input(clamp(x - 1, 0, 99), y) + input(clamp(x + 1, 0, 99), y);
+    input.compute_root();
+    f.split(x, x, xi, 16).unroll(xi).unroll(y, 2);
+
+    Image<int> out = f.realize(128, 8, target);
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 128; x++) {
+            int l = std::min(std::max(x - 1, 0), 99), r = std::min(std::max(x + 1, 0), 99);
+            int correct = l + r + y * 200;
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+// A scratch buffer computed inside a parallel loop should be
+// allocated once per batch of iterations, not once per iteration.
+
+int mallocs = 0;
+
+void *my_malloc(void *user_context, size_t x) {
+    __sync_fetch_and_add(&mallocs, 1);
+    void *orig = malloc(x+32);
+    void *ptr = (void *)((((size_t)orig + 32) >> 5) << 5);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    free(((void**)ptr)[-1]);
+}
+
+int main(int argc, char **argv) {
+    Var x, y;
+    Func f, g;
+
+    f(x, y) = x*y;
+    g(x, y) = f(x, y) + f(x+1, y+1);
+
+    f.compute_at(g, y);
+    g.parallel(y);
+
+    g.set_custom_allocator(my_malloc, my_free);
+
+    const int W = 10000, H = 1000;
+    Image<int> im = g.realize(W, H);
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            int correct = x*y + (x+1)*(y+1);
+            if (im(x, y) != correct) {
+                printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    if (mallocs >= H) {
+        printf("Scratch buffer was allocated %d times for %d rows\n", mallocs, H);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+#ifdef _MSC_VER
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+int count = 0;
+extern "C" DLLEXPORT int call_counter(int x, int y) {
+    __sync_fetch_and_add(&count, 1);
+    return x + y;
+}
+HalideExtern_2(int, call_counter, int, int);
+
+int main(int argc, char **argv) {
+    Func f("f"), g("g");
+    Var x("x"), y("y");
+
+    f(x, y) = call_counter(x, y);
+    g(x, y) = f(x, y-1) + f(x, y) + f(x, y+1);
+
+    // f slides over y even though y is parallel, by splitting y into
+    // chunks.
+    f.store_root().compute_at(g, y);
+    g.parallel(y);
+
+    const int W = 10, H = 160;
+    Image<int> im = g.realize(W, H);
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            int correct = 3 * (x + y);
+            if (im(x, y) != correct) {
+                printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    // The loop over y is split into 16 chunks of 10 rows. The first
+    // row of each chunk needs three rows of f, and the others one
+    // more each.
+    int correct = 16 * (10 + 2) * W;
+    if (count != correct) {
+        printf("f was called %d times instead of %d times\n", count, correct);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
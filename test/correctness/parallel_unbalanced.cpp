@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+// Tasks of wildly different sizes force the thread pool to steal
+// work from other threads' slots. Check every task still runs exactly
+// once.
+int main(int argc, char **argv) {
+    Var x, y;
+    Func f, g;
+
+    RDom r(0, 256);
+    f(x, y) = 0;
+    f(x, y) += select(r < (y*y) % 256, 1, 0);
+
+    g(x, y) = f(x, y) + x;
+
+    f.compute_at(g, y);
+    g.parallel(y);
+
+    Image<int> im = g.realize(8, 1000);
+
+    for (int y = 0; y < 1000; y++) {
+        for (int x = 0; x < 8; x++) {
+            int correct = (y*y) % 256 + x;
+            if (im(x, y) != correct) {
+                printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
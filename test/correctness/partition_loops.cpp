@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <Halide.h>
+#include <algorithm>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    // Blurs of inputs with boundary conditions, at sizes with no
+    // steady state at all up to ones that are mostly steady state,
+    // and with a split that doesn't divide the output.
+    const int sizes[] = {1, 2, 3, 17, 100};
+    for (int i = 0; i < 5; i++) {
+        const int W = sizes[i], H = sizes[4 - i] + 1;
+
+        Image<int> input(W, H);
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                input(x, y) = rand() & 0xff;
+            }
+        }
+
+        Var x, y, xi;
+        Func edge = BoundaryConditions::repeat_edge(input);
+        Func zero = BoundaryConditions::constant_exterior(input, 0);
+        Func blur_edge, blur_zero;
+        blur_edge(x, y) = edge(x-1, y-1) + edge(x+1, y) + edge(x, y+2);
+        blur_zero(x, y) = zero(x-1, y-1) + zero(x+1, y) + zero(x, y+2);
+        blur_edge.vectorize(x, 8);
+        blur_zero.split(x, x, xi, 3).parallel(y);
+
+        Image<int> out_edge = blur_edge.realize(W + 5, H);
+        Image<int> out_zero = blur_zero.realize(W + 5, H);
+
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W + 5; x++) {
+                int correct_edge = 0, correct_zero = 0;
+                const int dx[] = {-1, 1, 0}, dy[] = {-1, 0, 2};
+                for (int j = 0; j < 3; j++) {
+                    int cx = x + dx[j], cy = y + dy[j];
+                    correct_edge += input(std::min(std::max(cx, 0), W-1),
+                                          std::min(std::max(cy, 0), H-1));
+                    if (cx >= 0 && cx < W && cy >= 0 && cy < H) {
+                        correct_zero += input(cx, cy);
+                    }
+                }
+                if (out_edge(x, y) != correct_edge) {
+                    printf("blur_edge(%d, %d) = %d instead of %d\n",
+                           x, y, out_edge(x, y), correct_edge);
+                    return -1;
+                }
+                if (out_zero(x, y) != correct_zero) {
+                    printf("blur_zero(%d, %d) = %d instead of %d\n",
+                           x, y, out_zero(x, y), correct_zero);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
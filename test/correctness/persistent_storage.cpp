@@ -0,0 +1,53 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int check(Image<int> out, int correct) {
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    ImageParam input(Int(32), 2);
+    Param<int> frame;
+    Func f, g;
+    Var x, y, t;
+
+    // f at time t is the input of the run that computed it.
+    f(x, y, t) = input(x, y);
+    g(x, y) = f(x, y, frame) + 10 * f(x, y, frame - 1) + 100 * f(x, y, frame - 2);
+    f.compute_root().store_persistent(t, 3);
+
+    Image<int> in(8, 8);
+    for (int k = 0; k < 4; k++) {
+        for (int y = 0; y < 8; y++) {
+            for (int x = 0; x < 8; x++) {
+                in(x, y) = k + 1;
+            }
+        }
+        input.set(in);
+        frame.set(k);
+        Image<int> out = g.realize(8, 8);
+
+        // The first run computes all three frames. Later ones only
+        // compute the newest.
+        int correct[] = {111, 112, 123, 234};
+        if (check(out, correct[k])) return -1;
+    }
+
+    // A different region starts again from scratch.
+    frame.set(4);
+    Image<int> out = g.realize(4, 4);
+    if (check(out, 444)) return -1;
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace Halide;
+
+const char *profile_file_name = "pgo_test.pgo";
+
+// The same pipeline each time, so that the profile applies to it.
+int run(int width) {
+    Func f("f"), g("g");
+    Var x("x"), y("y");
+    f(x, y) = x * y;
+    g(x, y) = f(x, y) + 1;
+    f.compute_root().parallel(y);
+    g.parallel(y);
+
+    Image<int> result = g.realize(width, 1);
+    for (int x = 0; x < width; x++) {
+        if (result(x, 0) != 1) {
+            printf("result(%d, 0) = %d instead of 1\n", x, result(x, 0));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    remove(profile_file_name);
+    setenv("HL_PGO_OUTPUT", profile_file_name, 1);
+    setenv("HL_PGO_INSTRUMENT", "1", 1);
+
+    // The counts are written when the compiled pipeline is freed.
+    if (run(4) != 0) return -1;
+
+    FILE *file = fopen(profile_file_name, "r");
+    if (!file) {
+        printf("No profile was written\n");
+        return -1;
+    }
+    static char buf[1 << 16];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, file);
+    buf[len] = 0;
+    fclose(file);
+
+    // One pass over the single row.
+    const char *expected[] = {"pipeline g\n", "loop g.s0.y#0 1 1 1\n", "loop g.s0.x#0 1 4 16\n"};
+    for (int i = 0; i < 3; i++) {
+        if (!strstr(buf, expected[i])) {
+            printf("The profile has no %s:\n%s", expected[i], buf);
+            return -1;
+        }
+    }
+
+    // The profile makes the loops over y serial, and gives the loops
+    // over x a version with four iterations. The results must be the
+    // same at that size and others.
+    unsetenv("HL_PGO_INSTRUMENT");
+    setenv("HL_PGO_PROFILE", profile_file_name, 1);
+    if (run(4) != 0 || run(7) != 0) return -1;
+    unsetenv("HL_PGO_PROFILE");
+    remove(profile_file_name);
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <string.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+// Is there a predicated store in a lowered statement file.
+bool has_predicated_store(const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if (!f) return false;
+    char line[4096];
+    bool result = false;
+    while (fgets(line, sizeof(line), f)) {
+        const char *eq = strstr(line, "] = ");
+        if (eq && strstr(eq, " if ")) {
+            result = true;
+            break;
+        }
+    }
+    fclose(f);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    Var x;
+
+    // The input is exactly as large as the output, so the last
+    // vector must not read or write past the end of either.
+    const int size = 13;
+    ImageParam in(Int(32), 1);
+    Image<int> input(size);
+    for (int i = 0; i < size; i++) {
+        input(i) = i * 3;
+    }
+    in.set(input);
+
+    Func f;
+    f(x) = in(x) * 2 + 1;
+    f.vectorize(x, 8, Tail_GuardWithIf);
+
+    f.compile_to_lowered_stmt("predicated_vectorization.stmt");
+    if (!has_predicated_store("predicated_vectorization.stmt")) {
+        printf("The guarded tail was not vectorized with a predicated store\n");
+        return -1;
+    }
+
+    Image<int> result = f.realize(size);
+    for (int i = 0; i < size; i++) {
+        int correct = i * 6 + 1;
+        if (result(i) != correct) {
+            printf("result(%d) = %d instead of %d\n", i, result(i), correct);
+            return -1;
+        }
+    }
+
+    // Narrower sizes than the vector width are all tail.
+    for (int width = 1; width < 8; width++) {
+        Func g;
+        g(x) = in(x) - x;
+        g.vectorize(x, 8, Tail_GuardWithIf);
+        Image<int> result = g.realize(width);
+        for (int i = 0; i < width; i++) {
+            if (result(i) != i * 2) {
+                printf("result(%d) = %d instead of %d\n", i, result(i), i * 2);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// Count the prefetches in the lowered statement for a Func.
+class CountPrefetches : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        if (op->call_type == Call::Intrinsic && op->name == Call::prefetch) {
+            count++;
+        }
+    }
+
+public:
+    int count;
+    CountPrefetches() : count(0) {}
+};
+
+int count_prefetches(Func f) {
+    CountPrefetches counter;
+    lower(f.function(), get_jit_target_from_environment()).accept(&counter);
+    return counter.count;
+}
+
+int main(int argc, char **argv) {
+    const int W = 100, H = 60;
+
+    ImageParam in(Float(32), 2);
+    Image<float> input(W + 2, H + 2);
+    for (int y = 0; y < H + 2; y++) {
+        for (int x = 0; x < W + 2; x++) {
+            input(x, y) = (float)(x + y * 3);
+        }
+    }
+    in.set(input);
+
+    Var x, y;
+
+    // A 3x3 box filter that prefetches the rows of the input it will
+    // need two rows from now.
+    Func blur;
+    blur(x, y) = (in(x, y) + in(x+1, y) + in(x+2, y) +
+                  in(x, y+1) + in(x+1, y+1) + in(x+2, y+1) +
+                  in(x, y+2) + in(x+1, y+2) + in(x+2, y+2)) / 9;
+    blur.vectorize(x, 4).prefetch(in, y, 2);
+
+    // Also prefetch from an internal function computed at root.
+    Func g, h;
+    g(x, y) = in(x, y) * 2;
+    h(x, y) = g(x, y) + g(x + 1, y + 1);
+    g.compute_root();
+    h.prefetch(g, y);
+
+    if (count_prefetches(blur) == 0) {
+        printf("There were no prefetches of the input\n");
+        return -1;
+    }
+    if (count_prefetches(h) == 0) {
+        printf("There were no prefetches of g\n");
+        return -1;
+    }
+
+    Image<float> blurred = blur.realize(W, H);
+    Image<float> result = h.realize(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            float correct = 0;
+            for (int dy = 0; dy < 3; dy++) {
+                for (int dx = 0; dx < 3; dx++) {
+                    correct += input(x + dx, y + dy);
+                }
+            }
+            correct /= 9;
+            if (blurred(x, y) != correct) {
+                printf("blurred(%d, %d) = %f instead of %f\n", x, y, blurred(x, y), correct);
+                return -1;
+            }
+            float correct_h = input(x, y) * 2 + input(x + 1, y + 1) * 2;
+            if (result(x, y) != correct_h) {
+                printf("result(%d, %d) = %f instead of %f\n", x, y, result(x, y), correct_h);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int W = 1000, H = 37;
+    Image<int> input(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            input(x, y) = (x * 7 + y * 13) % 17 - 8;
+        }
+    }
+
+    Var x, y;
+    Func in;
+    in(x, y) = input(x, y);
+
+    // A sum along each row, in blocks that don't divide the width.
+    {
+        Func f = prefix_sum(in, 0, W, 0, 64);
+        f.vectorize(x, 8);
+        Image<int> result = f.realize(W, H);
+        for (int y = 0; y < H; y++) {
+            int correct = 0;
+            for (int x = 0; x < W; x++) {
+                correct += input(x, y);
+                if (result(x, y) != correct) {
+                    printf("Row sum at %d %d: %d instead of %d\n", x, y, result(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // An integral image, summing along the columns second, starting
+    // from a min that isn't zero.
+    {
+        Func sum_x = prefix_sum(in, 0, W, 0, 128);
+        Func f = prefix_sum(sum_x, 5, H - 5, 1, 8);
+        Image<int> result(W, H - 5);
+        result.set_min(0, 5);
+        f.realize(result);
+        for (int x = 0; x < W; x++) {
+            int correct = 0;
+            for (int y = 5; y < H; y++) {
+                int row = 0;
+                for (int i = 0; i <= x; i++) row += input(i, y);
+                correct += row;
+                if (result(x, y) != correct) {
+                    printf("Integral image at %d %d: %d instead of %d\n", x, y, result(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
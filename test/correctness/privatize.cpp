@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    // A height that doesn't divide into the slices evenly.
+    const int W = 128, H = 101;
+
+    int reference_hist[256];
+    for (int i = 0; i < 256; i++) {
+        reference_hist[i] = 0;
+    }
+
+    Image<uint8_t> in(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            in(x, y) = (uint8_t)(rand() & 0xff);
+            reference_hist[in(x, y)] += 1;
+        }
+    }
+
+    Func hist("hist");
+    Var x, t;
+
+    RDom r(in);
+    hist(x) = 0;
+    hist(clamp(cast<int>(in(r.x, r.y)), 0, 255)) += 1;
+    hist.privatize(r.y, t, 8);
+    hist.compute_root();
+
+    Image<int32_t> histogram = hist.realize(256);
+    for (int i = 0; i < 256; i++) {
+        if (histogram(i) != reference_hist[i]) {
+            printf("Error: bucket %d is %d instead of %d\n", i, histogram(i), reference_hist[i]);
+            return -1;
+        }
+    }
+
+    // A maximum, which has a different identity.
+    Func biggest("biggest");
+    biggest(x) = cast<uint8_t>(0);
+    RDom c(0, W, 0, H);
+    biggest(c.x % 4) = max(biggest(c.x % 4), in(c.x, c.y));
+    biggest.privatize(c.y, t, 6);
+
+    Image<uint8_t> result = biggest.realize(4);
+    for (int i = 0; i < 4; i++) {
+        uint8_t correct = 0;
+        for (int y = 0; y < H; y++) {
+            for (int x = i; x < W; x += 4) {
+                if (in(x, y) > correct) correct = in(x, y);
+            }
+        }
+        if (result(i) != correct) {
+            printf("Error: maximum %d is %d instead of %d\n", i, result(i), correct);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    // Profiling is decided when the pipeline is compiled. The profile
+    // is printed when the pipeline is freed.
+    setenv("HL_PROFILE", "1", 1);
+
+    Func f, g, h;
+    Var x, y;
+    f(x, y) = x + y;
+    g(x, y) = f(x, y) * 2 + f(x + 1, y);
+    h(x, y) = g(x, y) + g(x, y + 1);
+    h(x, 0) += 1;
+
+    // Stages at different levels, some of them inside parallel loops.
+    f.compute_at(h, y);
+    g.compute_root().parallel(y);
+    h.parallel(y);
+
+    for (int run = 0; run < 10; run++) {
+        Image<int> result = h.realize(256, 256);
+        for (int y = 0; y < 256; y++) {
+            for (int x = 0; x < 256; x++) {
+                int g0 = (x + y) * 2 + (x + 1 + y);
+                int g1 = (x + y + 1) * 2 + (x + 2 + y);
+                int correct = g0 + g1 + (y == 0 ? 1 : 0);
+                if (result(x, y) != correct) {
+                    printf("result(%d, %d) = %d instead of %d\n",
+                           x, y, result(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <math.h>
+
+using namespace Halide;
+
+float input_value(int x, int y) {
+    return (float)((x * 13 + y * 7) % 17);
+}
+
+int main(int argc, char **argv) {
+    Var x, y;
+    Func in("in");
+    in(x, y) = cast<float>((x * 13 + y * 7) % 17);
+
+    const int levels = 5, W = 640, H = 480;
+    Pyramid gaussian(in, levels);
+    Pyramid laplacian = gaussian.laplacian();
+    Pyramid collapsed = laplacian.collapse();
+
+    // The large levels get parallel strips and the small ones are
+    // computed serially.
+    gaussian.schedule(W);
+    collapsed.schedule(W);
+
+    // Check one level of the gaussian pyramid against a 1 3 3 1
+    // filter.
+    Image<float> level = gaussian[2].realize(W/4, H/4);
+    for (int y = 0; y < level.height(); y += 7) {
+        for (int x = 0; x < level.width(); x += 5) {
+            const float w[] = {1, 3, 3, 1};
+            // Level one at (2x-1+i, 2y-1+j), from level zero.
+            float correct = 0;
+            for (int j = 0; j < 4; j++) {
+                for (int i = 0; i < 4; i++) {
+                    int x1 = 2*x - 1 + i, y1 = 2*y - 1 + j;
+                    float l1 = 0;
+                    for (int b = 0; b < 4; b++) {
+                        for (int a = 0; a < 4; a++) {
+                            l1 += w[a] * w[b] * input_value(2*x1 - 1 + a, 2*y1 - 1 + b);
+                        }
+                    }
+                    correct += w[i] * w[j] * l1 / 64;
+                }
+            }
+            correct /= 64;
+            if (fabs(level(x, y) - correct) > 1e-3f) {
+                printf("gaussian[2](%d, %d) = %f instead of %f\n", x, y, level(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    // Collapsing the laplacian pyramid should give back the input.
+    Image<float> out = collapsed[0].realize(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            float correct = input_value(x, y);
+            if (fabs(out(x, y) - correct) > 1e-3f) {
+                printf("out(%d, %d) = %f instead of %f\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
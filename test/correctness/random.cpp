@@ -141,6 +141,28 @@ int main(int argc, char **argv) {
 
     }
 
+    // The same random numbers should come out however the Func is
+    // scheduled.
+    {
+        Expr r = random_int();
+        Func f, g;
+        f(x, y) = r;
+        g(x, y) = r;
+        g.vectorize(x, 8).parallel(y);
+
+        Image<int> im1 = f.realize(64, 64);
+        Image<int> im2 = g.realize(64, 64);
+        for (int y = 0; y < 64; y++) {
+            for (int x = 0; x < 64; x++) {
+                if (im1(x, y) != im2(x, y)) {
+                    printf("Vectorized random number at %d %d was %d instead of %d\n",
+                           x, y, im2(x, y), im1(x, y));
+                    return -1;
+                }
+            }
+        }
+    }
+
     // Check independence and dependence.
     {
         // Make two random variables
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <string.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+const int W = 200, H = 150;
+
+float in_val(int x, int y) {
+    return (float)(x * 3 + y * 5);
+}
+
+struct State {
+    int largest_region, tiles, errors;
+    bool seen[H][W];
+};
+
+void fetch(void *user_context, const std::string &input, Buffer region) {
+    State *state = (State *)user_context;
+    Image<float> im(region);
+    int size = im.width() * im.height();
+    if (size > state->largest_region) state->largest_region = size;
+    for (int y = im.min(1); y < im.min(1) + im.height(); y++) {
+        for (int x = im.min(0); x < im.min(0) + im.width(); x++) {
+            im(x, y) = in_val(x, y);
+        }
+    }
+}
+
+void emit(void *user_context, Realization tile) {
+    State *state = (State *)user_context;
+    state->tiles++;
+    Image<float> im(tile[0]);
+    for (int y = im.min(1); y < im.min(1) + im.height(); y++) {
+        for (int x = im.min(0); x < im.min(0) + im.width(); x++) {
+            float correct = in_val(x - 1, y) + in_val(x, y + 1) * 2;
+            if (im(x, y) != correct && state->errors++ < 10) {
+                printf("im(%d, %d) = %f instead of %f\n", x, y, im(x, y), correct);
+            }
+            if (state->seen[y][x] && state->errors++ < 10) {
+                printf("(%d, %d) was computed twice\n", x, y);
+            }
+            state->seen[y][x] = true;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    ImageParam input(Float(32), 2);
+    Var x, y;
+    Func f;
+    f(x, y) = input(x - 1, y) + input(x, y + 1) * 2;
+
+    State *state = new State;
+    memset(state, 0, sizeof(State));
+    f.realize_tiled(Internal::vec(W, H), Internal::vec(64, 32), fetch, emit, state);
+
+    // 4 by 5 tiles, and no tile needs more than 65 by 33 of the input.
+    if (state->tiles != 20) {
+        printf("%d tiles instead of 20\n", state->tiles);
+        return -1;
+    }
+    if (state->largest_region > 65 * 33) {
+        printf("Fetched a region of %d points\n", state->largest_region);
+        return -1;
+    }
+    for (int j = 0; j < H; j++) {
+        for (int i = 0; i < W; i++) {
+            if (!state->seen[j][i]) {
+                printf("(%d, %d) wasn't computed\n", i, j);
+                return -1;
+            }
+        }
+    }
+    if (state->errors) return -1;
+
+    delete state;
+    printf("Success!\n");
+    return 0;
+}
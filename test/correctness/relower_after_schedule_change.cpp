@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+int check(Image<int> im, int k, int c) {
+    for (int x = 0; x < im.width(); x++) {
+        int correct = (x + c) * k;
+        if (im(x) != correct) {
+            printf("im(%d) = %d instead of %d\n", x, im(x), correct);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Func f, g;
+    Var x;
+    f(x) = x;
+    g(x) = f(x) * 3;
+
+    if (check(g.realize(100), 3, 0)) return -1;
+
+    // Changing only the schedule reuses the analyses of the
+    // algorithm from the last lowering.
+    f.compute_root();
+    if (check(g.realize(100), 3, 0)) return -1;
+
+    g.vectorize(x, 4);
+    if (check(g.realize(100), 3, 0)) return -1;
+
+    // Giving f an update definition changes the algorithm, so it
+    // must be analyzed again.
+    f(x) += 1;
+    if (check(g.realize(100), 3, 1)) return -1;
+
+    printf("Success!\n");
+    return 0;
+}
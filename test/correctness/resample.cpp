@@ -0,0 +1,109 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <math.h>
+
+using namespace Halide;
+
+const int W = 40, H = 30;
+
+float input_value(int x, int y) {
+    x = x < 0 ? 0 : (x >= W ? W - 1 : x);
+    y = y < 0 ? 0 : (y >= H ? H - 1 : y);
+    return (float)((x * 13 + y * 7) % 17);
+}
+
+double filter(int type, double x) {
+    double xx = fabs(x);
+    if (type == 0) return xx <= 0.5 ? 1 : 0;
+    if (type == 1) return xx < 1 ? 1 - xx : 0;
+    if (type == 2) {
+        double a = -0.5;
+        if (xx < 1) return (a + 2) * xx * xx * xx - (a + 3) * xx * xx + 1;
+        if (xx < 2) return a * xx * xx * xx - 5 * a * xx * xx + 8 * a * xx - 4 * a;
+        return 0;
+    }
+    if (xx >= 3) return 0;
+    if (x == 0) return 1;
+    double pi = 3.14159265358979323846;
+    return (sin(pi * x) / (pi * x)) * (sin(pi * x / 3) / (pi * x / 3));
+}
+
+// The weights of the input pixels for output pixel x, starting at
+// *begin.
+std::vector<double> weights(int type, float scale, int x, int *begin) {
+    const double supports[] = {0.5, 1, 2, 3};
+    float widen = scale < 1 ? scale : 1;
+    float support = (float)supports[type] / widen;
+    float source = (x + 0.5f) / scale - 0.5f;
+    *begin = (int)ceil(source - support);
+    int count = (int)floor(2 * support) + 1;
+    std::vector<double> w;
+    double total = 0;
+    for (int i = 0; i < count; i++) {
+        w.push_back(filter(type, (*begin + i - source) * widen));
+        total += w.back();
+    }
+    for (int i = 0; i < count; i++) w[i] /= total;
+    return w;
+}
+
+int main(int argc, char **argv) {
+    Image<float> input(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            input(x, y) = input_value(x, y);
+        }
+    }
+    Func clamped = BoundaryConditions::repeat_edge(input);
+
+    const float scales[] = {2.0f, 0.45f, 1.0f};
+    for (int type = 0; type < 4; type++) {
+        for (int s = 0; s < 3; s++) {
+            float scale = scales[s];
+            int out_w = (int)(W * scale), out_h = (int)(H * scale);
+            Func f = resample(clamped, scale, scale, (ResampleFilter)type);
+            Image<float> result = f.realize(out_w, out_h);
+
+            for (int y = 0; y < out_h; y++) {
+                int by;
+                std::vector<double> wy = weights(type, scale, y, &by);
+                for (int x = 0; x < out_w; x++) {
+                    int bx;
+                    std::vector<double> wx = weights(type, scale, x, &bx);
+                    double correct = 0;
+                    for (size_t j = 0; j < wy.size(); j++) {
+                        for (size_t i = 0; i < wx.size(); i++) {
+                            correct += wx[i] * wy[j] * input_value(bx + (int)i, by + (int)j);
+                        }
+                    }
+                    if (fabs(result(x, y) - correct) > 1e-3) {
+                        printf("Filter %d at scale %f, pixel %d %d: %f instead of %f\n",
+                               type, scale, x, y, result(x, y), correct);
+                        return -1;
+                    }
+                }
+            }
+        }
+    }
+
+    // Integer images are rounded, and stay in range.
+    Image<uint8_t> bright(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            bright(x, y) = 255;
+        }
+    }
+    Func g = resample(BoundaryConditions::repeat_edge(bright), 1.7f, 0.6f, Resample_Lanczos);
+    Image<uint8_t> result = g.realize(60, 18);
+    for (int y = 0; y < 18; y++) {
+        for (int x = 0; x < 60; x++) {
+            if (result(x, y) != 255) {
+                printf("Resampling a constant uint8 image gave %d at %d %d\n", result(x, y), x, y);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
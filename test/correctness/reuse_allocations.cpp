@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+// Buffers that aren't live at the same time should share an
+// allocation.
+
+int mallocs = 0;
+
+void *my_malloc(void *user_context, size_t x) {
+    mallocs++;
+    void *orig = malloc(x+32);
+    void *ptr = (void *)((((size_t)orig + 32) >> 5) << 5);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void my_free(void *user_context, void *ptr) {
+    free(((void**)ptr)[-1]);
+}
+
+int main(int argc, char **argv) {
+    const int W = 64, H = 64;
+
+    for (int skip = 0; skip < 2; skip++) {
+        Var x, y;
+        Func d0, d1, d2, out;
+        d0(x, y) = x + y;
+        d1(x, y) = d0(2*x, y) + d0(2*x+1, y);
+        d2(x, y) = cast<float>(d1(2*x, y) + d1(2*x+1, y));
+        if (skip) {
+            // d0 is used again at the end, so d2 can't go in its
+            // allocation.
+            out(x, y) = d2(2*x, y) + d2(2*x+1, y) + d0(8*x, y);
+        } else {
+            out(x, y) = d2(2*x, y) + d2(2*x+1, y);
+        }
+        d0.compute_root();
+        d1.compute_root();
+        d2.compute_root();
+
+        out.set_custom_allocator(my_malloc, my_free);
+        mallocs = 0;
+        Image<float> im = out.realize(W, H);
+
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                // The sum of d0 over the 8 values starting at 8*x.
+                float correct = (float)(8 * (8*x + y) + 28);
+                if (skip) correct += 8*x + y;
+                if (im(x, y) != correct) {
+                    printf("im(%d, %d) = %f instead of %f\n", x, y, im(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+
+        int expected = skip ? 3 : 2;
+        if (mallocs != expected) {
+            printf("%d allocations instead of %d\n", mallocs, expected);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
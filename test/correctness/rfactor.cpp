@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int W = 64, H = 48;
+
+    Image<int> in(W, H);
+    int reference_sum = 0;
+    int reference_max = 0;
+    int reference_hist[256];
+    for (int i = 0; i < 256; i++) {
+        reference_hist[i] = 0;
+    }
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            in(x, y) = rand() & 0xff;
+            reference_sum += in(x, y);
+            reference_max = std::max(reference_max, in(x, y));
+            reference_hist[in(x, y)]++;
+        }
+    }
+
+    Var x, y, v;
+
+    {
+        // Sum each row on a separate thread.
+        Func sum;
+        RDom r(0, W, 0, H);
+        sum() = 0;
+        sum() += in(r.x, r.y);
+
+        Func intm = sum.rfactor(r.y, y);
+        intm.compute_root().update().parallel(y);
+
+        Image<int> result = sum.realize();
+        if (result(0) != reference_sum) {
+            printf("sum was %d instead of %d\n", result(0), reference_sum);
+            return -1;
+        }
+    }
+
+    {
+        // Vectorize a max over columns.
+        Func mx;
+        RDom r(0, W, 0, H);
+        mx() = 0;
+        mx() = max(mx(), in(r.x, r.y));
+
+        Func intm = mx.rfactor(r.x, x);
+        intm.compute_root().vectorize(x, 8).update().vectorize(x, 8);
+
+        Image<int> result = mx.realize();
+        if (result(0) != reference_max) {
+            printf("max was %d instead of %d\n", result(0), reference_max);
+            return -1;
+        }
+    }
+
+    {
+        // A histogram, with a partial histogram per row.
+        Func hist;
+        RDom r(0, W, 0, H);
+        hist(x) = 0;
+        hist(in(r.x, r.y)) += 1;
+
+        Func intm = hist.rfactor(r.y, v);
+        intm.compute_root().update().parallel(v);
+
+        Image<int> result = hist.realize(256);
+        for (int i = 0; i < 256; i++) {
+            if (result(i) != reference_hist[i]) {
+                printf("hist(%d) was %d instead of %d\n", i, result(i), reference_hist[i]);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,35 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    target.features |= Target::Telemetry;
+
+    // Timing a pipeline, and recording the thread pool's queue
+    // depth, shouldn't change what it computes.
+    const int W = 64, H = 64;
+    Func f, g;
+    Var x, y;
+    f(x, y) = x * y;
+    g(x, y) = f(x, y) + f(x + 1, y);
+    f.compute_root().parallel(y);
+    g.parallel(y);
+
+    for (int i = 0; i < 3; i++) {
+        Image<int> out = g.realize(W, H, target);
+        for (int yy = 0; yy < H; yy++) {
+            for (int xx = 0; xx < W; xx++) {
+                int correct = xx * yy + (xx + 1) * yy;
+                if (out(xx, yy) != correct) {
+                    printf("out(%d, %d) = %d instead of %d\n", xx, yy, out(xx, yy), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
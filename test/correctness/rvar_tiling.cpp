@@ -0,0 +1,57 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+// A convolution written as a reduction, with its update scheduled by
+// the given function.
+Image<int> convolve(void (*schedule)(Func, Func, RDom)) {
+    Var x("x"), y("y");
+    Func in("in"), k("k"), f("f");
+    in(x, y) = x * 3 + y * 5;
+    k(x, y) = x - y;
+
+    RDom r(0, 37, 0, 29);
+    f(x, y) = 0;
+    f(x, y) += k(r.x, r.y) * in(x + r.x, y + r.y);
+
+    k.compute_root();
+    schedule(f, in, r);
+    return f.realize(20, 10);
+}
+
+void unscheduled(Func f, Func in, RDom r) {
+    in.compute_root();
+}
+
+void tiled(Func f, Func in, RDom r) {
+    RVar rxo("rxo"), ryo("ryo"), rxi("rxi"), ryi("ryi");
+    f.update().tile(r.x, r.y, rxo, ryo, rxi, ryi, 8, 8).unroll(rxi, 2);
+    in.compute_at(f, rxo);
+}
+
+void split(Func f, Func in, RDom r) {
+    RVar ryo("ryo"), ryi("ryi");
+    f.update().split(r.y, ryo, ryi, 4).unroll(r.x, 4);
+    in.compute_at(f, ryo);
+}
+
+int main(int argc, char **argv) {
+    Image<int> correct = convolve(unscheduled);
+    Image<int> results[] = {convolve(tiled), convolve(split)};
+
+    for (int i = 0; i < 2; i++) {
+        for (int y = 0; y < correct.height(); y++) {
+            for (int x = 0; x < correct.width(); x++) {
+                if (results[i](x, y) != correct(x, y)) {
+                    printf("Schedule %d: f(%d, %d) = %d instead of %d\n",
+                           i, x, y, results[i](x, y), correct(x, y));
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+// The same pipeline, with names that don't change, so that a schedule
+// saved for one can be loaded onto another.
+Func make_pipeline(Func &blur) {
+    Var x("x"), y("y");
+    Func in("in"), out("out");
+    blur = Func("blur");
+    in(x, y) = x * 3 + y;
+    blur(x, y) = in(x - 1, y) + in(x, y) + in(x + 1, y);
+    out(x, y) = blur(x, y - 1) + blur(x, y) + blur(x, y + 1);
+    out(x, 0) += 1;
+    return out;
+}
+
+int main(int argc, char **argv) {
+    Var x("x"), y("y"), xi("xi"), yi("yi");
+    Func blur;
+    Func out = make_pipeline(blur);
+    out.tile(x, y, xi, yi, 16, 8).vectorize(xi, 4).parallel(y).bound(x, 0, 64);
+    out.update().vectorize(x, 8);
+    blur.compute_at(out, x).vectorize(x, 4).store_root();
+
+    std::string text = schedule_to_string(out);
+
+    Func blur2;
+    Func out2 = make_pipeline(blur2);
+    schedule_from_string(out2, text);
+    if (schedule_to_string(out2) != text) {
+        printf("The schedule changed when it was loaded:\n%s\ninstead of:\n%s\n",
+               schedule_to_string(out2).c_str(), text.c_str());
+        return -1;
+    }
+
+    Image<int> im = out.realize(64, 32);
+    Image<int> im2 = out2.realize(64, 32);
+    for (int j = 0; j < im.height(); j++) {
+        for (int i = 0; i < im.width(); i++) {
+            int correct = 9 * (i * 3 + j) + (j == 0 ? 1 : 0);
+            if (im(i, j) != correct || im2(i, j) != correct) {
+                printf("im(%d, %d) = %d and im2(%d, %d) = %d instead of %d\n",
+                       i, j, im(i, j), i, j, im2(i, j), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,41 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Image<int> input(140, 4);
+    for (int y = 0; y < input.height(); y++) {
+        for (int x = 0; x < input.width(); x++) {
+            input(x, y) = (x * 17 + y * 31) % 23;
+        }
+    }
+
+    // An inlined blur used at three shifts, and at a fourth too far
+    // away to share.
+    Func blur_x("blur_x"), f("f");
+    Var x("x"), y("y");
+    blur_x(x, y) = input(x, y) + input(x + 1, y) * 2 + input(x + 2, y);
+    f(x, y) = blur_x(x, y) + blur_x(x + 1, y) * 3 + blur_x(x + 3, y) - blur_x(x + 11, y);
+    f.vectorize(x, 8);
+
+    Image<int> out = f.realize(128, 4);
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            int b[4];
+            int shifts[] = {0, 1, 3, 11};
+            for (int i = 0; i < 4; i++) {
+                int xi = x + shifts[i];
+                b[i] = input(xi, y) + input(xi + 1, y) * 2 + input(xi + 2, y);
+            }
+            int correct = b[0] + b[1] * 3 + b[2] - b[3];
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
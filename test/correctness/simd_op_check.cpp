@@ -12,7 +12,7 @@ using std::vector;
 bool failed = false;
 Var x, y;
 
-bool use_ssse3, use_sse41, use_sse42, use_avx, use_avx2;
+bool use_ssse3, use_sse41, use_sse42, use_avx, use_avx2, use_avx512, use_fma;
 
 char *filter = NULL;
 
@@ -324,6 +324,8 @@ void check_sse_all() {
 
     // SSSE 3
     if (use_ssse3) {
+        check("pmulhrsw", 8, i16((i32(i16_1) * i32(i16_2) + 16384) >> 15));
+        check("pmulhrsw", 8, i16((i32(i16_1) * i32(i16_2) + 16384) / 32768));
         check("pabsb", 16, abs(i8_1));
         check("pabsw", 8, abs(i16_1));
         check("pabsd", 4, abs(i32_1));
@@ -454,6 +456,10 @@ void check_sse_all() {
 	check("vpmaxub", 32, max(u8_1, u8_2));
 	check("vpminub", 32, min(u8_1, u8_2));
 	check("vpmulhuw", 16, i16((i32(i16_1) * i32(i16_2))/(256*256)));
+	check("vpmulhuw", 16, u16((u32(u16_1) * u32(u16_2))/(256*256)));
+	check("vpmulhuw", 16, u16_1 / 15);
+	check("vpmulhuw", 16, i16_1 / 15);
+	check("vpmulhrsw", 16, i16((i32(i16_1) * i32(i16_2) + 16384) >> 15));
 
 	check("vpaddq", 8, i64_1 + i64_2);
 	check("vpsubq", 8, i64_1 - i64_2);
@@ -486,6 +492,36 @@ void check_sse_all() {
 	check("vpcmpeqq", 4, select(i64_1 == i64_2, i64(1), i64(2)));
 	check("vpackusdw", 16, u16(clamp(i32_1, 0, max_u16)));
 	check("vpcmpgtq", 4, select(i64_1 > i64_2, i64(1), i64(2)));
+
+	check("vpgatherdd", 8, in_i32(i32_1 & 15));
+	check("vpgatherdd", 16, in_u32(i32_1 & 15));
+	check("vgatherdps", 8, in_f32(i32_1 & 15));
+    }
+
+    if (use_fma) {
+	check("vfmadd", 8, f32_1 * f32_2 + f32_3);
+	check("vfmadd", 4, f64_1 * f64_2 + f64_3);
+	check("vfmsub", 8, f32_1 * f32_2 - f32_3);
+    }
+
+    // AVX 512
+
+    if (use_avx512) {
+	check("vpaddsb", 64, i8(clamp(i16(i8_1) + i16(i8_2), min_i8, max_i8)));
+	check("vpsubsb", 64, i8(clamp(i16(i8_1) - i16(i8_2), min_i8, max_i8)));
+	check("vpaddusb", 64, u8(min(u16(u8_1) + u16(u8_2), max_u8)));
+	check("vpaddsw", 32, i16(clamp(i32(i16_1) + i32(i16_2), min_i16, max_i16)));
+	check("vpsubsw", 32, i16(clamp(i32(i16_1) - i32(i16_2), min_i16, max_i16)));
+	check("vpaddusw", 32, u16(min(u32(u16_1) + u32(u16_2), max_u16)));
+	check("vpmulhw", 32, i16((i32(i16_1) * i32(i16_2)) / (256*256)));
+	check("vpmulhuw", 32, u16((u32(u16_1) * u32(u16_2))/(256*256)));
+	check("vpavgb", 64, u8((u16(u8_1) + u16(u8_2) + 1)/2));
+	check("vpavgw", 32, u16((u32(u16_1) + u32(u16_2) + 1)/2));
+	check("vpmaxsd", 16, max(i32_1, i32_2));
+	check("vpminud", 16, min(u32_1, u32_2));
+	check("vmaxps", 16, max(f32_1, f32_2));
+	check("vrcp14ps", 16, 1.0f / f32_2);
+	check("vrsqrt14ps", 16, 1.0f / sqrt(f32_2));
     }
 }
 
@@ -896,7 +932,11 @@ void check_neon_all() {
     check("vmla.i16", 8, u16_1 + u16_2*u16_3);
     check("vmla.i32", 4, i32_1 + i32_2*i32_3);
     check("vmla.i32", 4, u32_1 + u32_2*u32_3);
-    check("vmla.f32", 4, f32_1 + f32_2*f32_3);
+    if (use_fma) {
+        check("vfma.f32", 4, f32_1 + f32_2*f32_3);
+    } else {
+        check("vmla.f32", 4, f32_1 + f32_2*f32_3);
+    }
     //check("vmla.f64", 2, f64_1 + f64_2*f64_3);
     check("vmla.i8",  8, i8_1 + i8_2*i8_3);
     check("vmla.i8",  8, u8_1 + u8_2*u8_3);
@@ -904,7 +944,11 @@ void check_neon_all() {
     check("vmla.i16", 4, u16_1 + u16_2*u16_3);
     check("vmla.i32", 2, i32_1 + i32_2*i32_3);
     check("vmla.i32", 2, u32_1 + u32_2*u32_3);
-    check("vmla.f32", 2, f32_1 + f32_2*f32_3);
+    if (use_fma) {
+        check("vfma.f32", 2, f32_1 + f32_2*f32_3);
+    } else {
+        check("vmla.f32", 2, f32_1 + f32_2*f32_3);
+    }
 
     // VMLS	I, F	F, D	Multiply Subtract
     check("vmls.i8", 16, i8_1 - i8_2*i8_3);
@@ -930,6 +974,8 @@ void check_neon_all() {
     check("vmlal.u16", 4, u32_1 + u32(u16_2)*u16_3);
     check("vmlal.s32", 2, i64_1 + i64(i32_2)*i32_3);
     check("vmlal.u32", 2, u64_1 + u64(u32_2)*u32_3);
+    check("vmlal.s16", 4, i32_1 + i32(i16_2)*3);
+    check("vmlal.u16", 4, u32_1 + u32(u16_2)*7);
 
     // VMLSL	I	-	Multiply Subtract Long
     check("vmlsl.s8",  8, i16_1 - i16(i8_2)*i8_3);
@@ -1086,7 +1132,7 @@ void check_neon_all() {
     // VQDMLSL	I	-	Saturating Double Multiply Subtract Long
     // VQDMULH	I	-	Saturating Doubling Multiply Returning High Half
     // VQDMULL	I	-	Saturating Doubling Multiply Long
-    // Not sure why I'd use these
+    check("vqdmull.s16", 4, i32(clamp(i64(i16_1)*i64(i16_2)*2, min_i32, max_i32)));
 
     // VQMOVN	I	-	Saturating Move and Narrow
     check("vqmovn.s16", 8,  i8(clamp(i16_1, min_i8,  max_i8)));
@@ -1110,6 +1156,8 @@ void check_neon_all() {
     check("vqneg.s32", 2, -max(i32_1, -max_i32));
 
     // VQRDMULH	I	-	Saturating Rounding Doubling Multiply Returning High Half
+    check("vqrdmulh.s16", 4, i16(clamp((i32(i16_1)*i32(i16_2) + 16384) >> 15, min_i16, max_i16)));
+    check("vqrdmulh.s16", 8, i16(clamp((i32(i16_1)*i32(i16_2) + 16384) / 32768, min_i16, max_i16)));
     // VQRSHL	I	-	Saturating Rounding Shift Left
     // VQRSHRN	I	-	Saturating Rounding Shift Right Narrow
     // VQRSHRUN	I	-	Saturating Rounding Shift Right Unsigned Narrow
@@ -1420,7 +1468,9 @@ int main(int argc, char **argv) {
 
     target = get_target_from_environment();
 
-    use_avx2 = target.features & Target::AVX2;
+    use_avx512 = target.features & Target::AVX512;
+    use_avx2 = use_avx512 | (target.features & Target::AVX2);
+    use_fma = target.features & Target::FMA;
     use_avx = use_avx2 | (target.features & Target::AVX);
     use_sse41 = use_avx | (target.features & Target::SSE41);
 
@@ -0,0 +1,46 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    ImageParam changed(UInt(8), 2);
+    Func f, g;
+    Var x, y, xo, yo, xi, yi;
+
+    f(x, y) = x + y;
+    g(x, y) = f(x, y) * 2;
+    g.tile(x, y, xo, yo, xi, yi, 8, 8).parallel(yo);
+    g.skip_unless(xo, changed(xo, yo) != 0);
+    f.compute_at(g, xo);
+
+    // Only the tiles on the diagonal have changed.
+    Image<uint8_t> mask(4, 4);
+    for (int ty = 0; ty < 4; ty++) {
+        for (int tx = 0; tx < 4; tx++) {
+            mask(tx, ty) = (tx == ty);
+        }
+    }
+    changed.set(mask);
+
+    Image<int> out(32, 32);
+    for (int y = 0; y < 32; y++) {
+        for (int x = 0; x < 32; x++) {
+            out(x, y) = -1;
+        }
+    }
+    g.realize(out);
+
+    for (int y = 0; y < 32; y++) {
+        for (int x = 0; x < 32; x++) {
+            int correct = (x / 8 == y / 8) ? (x + y) * 2 : -1;
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <algorithm>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int W = 64, H = 32;
+    Image<uint8_t> input(W + 2, H + 2);
+    for (int y = 0; y < H + 2; y++) {
+        for (int x = 0; x < W + 2; x++) {
+            input(x, y) = (uint8_t)(rand() & 0xff);
+        }
+    }
+
+    Var x, y;
+    Func in;
+    in(x, y) = input(x + 1, y + 1);
+
+    // A 3x3 median filter, its second smallest value, and its three
+    // largest values.
+    RDom r(-1, 3, -1, 3);
+    Func f;
+    std::vector<Expr> top = top_k(in(x + r.x, y + r.y), 3);
+    f(x, y) = Tuple(median(in(x + r.x, y + r.y)),
+                    kth_smallest(r, in(x + r.x, y + r.y), 1),
+                    top[0], top[1], top[2]);
+    f.vectorize(x, 16);
+    Realization results = f.realize(W, H);
+    Image<uint8_t> med = results[0], second = results[1];
+    Image<uint8_t> top0 = results[2], top1 = results[3], top2 = results[4];
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            uint8_t window[9];
+            for (int i = 0; i < 9; i++) {
+                window[i] = input(x + i % 3, y + i / 3);
+            }
+            std::sort(window, window + 9);
+            if (med(x, y) != window[4] || second(x, y) != window[1] ||
+                top0(x, y) != window[8] || top1(x, y) != window[7] || top2(x, y) != window[6]) {
+                printf("Wrong order statistics at %d %d\n", x, y);
+                return -1;
+            }
+        }
+    }
+
+    // Sorting a list of values that isn't a power of two long.
+    std::vector<Expr> values;
+    for (int i = 0; i < 7; i++) {
+        values.push_back(cast<float>((x * (i + 3) * 37 + i * 11) % 23));
+    }
+    std::vector<Expr> s = sorted(values);
+    Func g;
+    g(x) = Tuple(s);
+    g.vectorize(x, 4);
+    Realization sorted_values = g.realize(100);
+    for (int x = 0; x < 100; x++) {
+        float correct[7];
+        for (int i = 0; i < 7; i++) {
+            correct[i] = (float)((x * (i + 3) * 37 + i * 11) % 23);
+        }
+        std::sort(correct, correct + 7);
+        for (int i = 0; i < 7; i++) {
+            Image<float> im = sorted_values[i];
+            if (im(x) != correct[i]) {
+                printf("Sorted value %d at %d is %f instead of %f\n", i, x, im(x), correct[i]);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
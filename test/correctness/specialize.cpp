@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <string.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    ImageParam in(Float(32), 1);
+    Param<float> scale;
+    Var x;
+
+    Func f;
+    f(x) = in(x) * scale;
+    f.vectorize(x, 8)
+        .specialize(in.stride(0) == 1)
+        .specialize(scale == 1.0f);
+
+    // A dense input, and a view of every second element of it.
+    const int N = 64;
+    float data[2*N];
+    for (int i = 0; i < 2*N; i++) {
+        data[i] = (float)i;
+    }
+
+    buffer_t dense;
+    memset(&dense, 0, sizeof(dense));
+    dense.host = (uint8_t *)data;
+    dense.extent[0] = N;
+    dense.stride[0] = 1;
+    dense.elem_size = 4;
+
+    buffer_t strided = dense;
+    strided.stride[0] = 2;
+
+    for (int s = 0; s < 2; s++) {
+        for (int p = 0; p < 2; p++) {
+            float scale_val = p ? 1.0f : 3.0f;
+            in.set(Buffer(Float(32), s ? &strided : &dense));
+            scale.set(scale_val);
+
+            Image<float> result = f.realize(N);
+            for (int i = 0; i < N; i++) {
+                float correct = data[s ? 2*i : i] * scale_val;
+                if (result(i) != correct) {
+                    printf("result(%d) = %f instead of %f (stride %d, scale %f)\n",
+                           i, result(i), correct, s ? 2 : 1, scale_val);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
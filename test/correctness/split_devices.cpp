@@ -0,0 +1,63 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    // Start with less than half on the gpu. Must be set before the
+    // first run.
+    setenv("HL_GPU_PERCENT", "30", 1);
+
+    Var x, y;
+    ImageParam in(Int(32), 2);
+
+    // f is split between the devices, and read back on the cpu by
+    // g. h is split too, and is the output.
+    Func f, g, h;
+    f(x, y) = in(x, y) * 3 + y;
+    g(x, y) = f(x, y) + f(x, y + 1);
+    h(x, y) = g(x, y) * 2;
+
+    Target t = get_jit_target_from_environment();
+    if (t.features & (Target::OpenCL | Target::CUDA)) {
+        f.compute_root().gpu_tile(x, y, 16, 16).split_devices(y);
+        g.compute_root();
+        h.gpu_tile(x, y, 8, 8).split_devices(y);
+    } else {
+        // Without a gpu, the split does nothing.
+        f.compute_root().split_devices(y);
+        g.compute_root().parallel(y);
+    }
+
+    // Run it several times, so that the split moves, on heights
+    // that aren't multiples of the tiles.
+    for (int run = 0; run < 5; run++) {
+        int w = 64, ht = 100 + run * 3;
+        Image<int> input(w, ht + 1);
+        for (int j = 0; j < ht + 1; j++) {
+            for (int i = 0; i < w; i++) {
+                input(i, j) = i + j * w + run;
+            }
+        }
+        in.set(input);
+
+        Image<int> result = h.realize(w, ht, t);
+
+        for (int j = 0; j < ht; j++) {
+            for (int i = 0; i < w; i++) {
+                int f0 = input(i, j) * 3 + j;
+                int f1 = input(i, j + 1) * 3 + j + 1;
+                int correct = (f0 + f1) * 2;
+                if (result(i, j) != correct) {
+                    printf("run %d: result(%d, %d) = %d instead of %d\n",
+                           run, i, j, result(i, j), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -16,23 +16,87 @@ extern "C" {
     }
 }
 
+// Small intermediates computed inside loops should go on the stack,
+// and large ones on the heap.
+
+int mallocs = 0;
+
+void *counting_malloc(void *user_context, size_t x) {
+    mallocs++;
+    void *orig = malloc(x+32);
+    void *ptr = (void *)((((size_t)orig + 32) >> 5) << 5);
+    ((void **)ptr)[-1] = orig;
+    return ptr;
+}
+
+void counting_free(void *user_context, void *ptr) {
+    free(((void**)ptr)[-1]);
+}
+
 int main(int argc, char **argv) {
-    Func f, g, h;
-    Var x, y;
+    {
+        Func f, g, h;
+        Var x, y;
+
+        f(x, y) = x + y;
+        g(x, y) = f(x-1, y+1) * f(x+1, y-1);
+        h(x, y) = g(x+1, y+1) + g(x-1, y-1);
 
-    f(x, y) = x + y;    
-    g(x, y) = f(x-1, y+1) * f(x+1, y-1);
-    h(x, y) = g(x+1, y+1) + g(x-1, y-1);
+        f.compute_at(h, x);
+        g.compute_at(h, x);
+        Var xi, yi;
+        h.tile(x, y, xi, yi, 4, 3).vectorize(xi);
 
-    f.compute_at(h, x);
-    g.compute_at(h, x);
-    Var xi, yi;
-    h.tile(x, y, xi, yi, 4, 3).vectorize(xi);
+        // f and g should both do stack allocations
+        h.set_custom_allocator(&my_malloc, &my_free);
+
+        h.realize(10, 10);
+    }
 
-    // f and g should both do stack allocations
-    h.set_custom_allocator(&my_malloc, &my_free);
+    Var x, y, xo, xi;
 
-    h.realize(10, 10);
+    {
+        // A 9x1 scratch buffer per tile of the output.
+        Func f, g;
+        f(x, y) = x + y;
+        g(x, y) = f(x, y) + f(x+1, y);
+        g.split(x, xo, xi, 8);
+        f.compute_at(g, xo);
+
+        g.set_custom_allocator(counting_malloc, counting_free);
+        Image<int> im = g.realize(64, 64);
+
+        for (int y = 0; y < 64; y++) {
+            for (int x = 0; x < 64; x++) {
+                if (im(x, y) != 2*(x + y) + 1) {
+                    printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), 2*(x + y) + 1);
+                    return -1;
+                }
+            }
+        }
+
+        if (mallocs != 0) {
+            printf("Small allocation went on the heap %d times\n", mallocs);
+            return -1;
+        }
+    }
+
+    {
+        // A scratch buffer the size of the whole output is too big
+        // for the stack.
+        Func f, g;
+        f(x, y) = x + y;
+        g(x, y) = f(x, y) + f(x+1, y);
+        f.compute_root();
+
+        g.set_custom_allocator(counting_malloc, counting_free);
+        g.realize(1024, 1024);
+
+        if (mallocs != 1) {
+            printf("Large allocation went to halide_malloc %d times instead of once\n", mallocs);
+            return -1;
+        }
+    }
 
     printf("Success!\n");
     return 0;
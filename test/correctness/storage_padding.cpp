@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int W = 37, H = 20;
+    Var x, y;
+
+    // An odd width, so that rounding up the rows changes the stride.
+    Func g, h, f;
+    g(x, y) = x + y * 100;
+    h(x, y) = cast<float>(x * 2 - y);
+    f(x, y) = g(x, y) + g(x + 1, y + 1) + cast<int>(h(x, y) + h(x + 3, y));
+
+    g.compute_root().vectorize(x, 8).align_storage(x, 8).pad_storage(x, 16);
+    h.compute_at(f, y).vectorize(x, 4).align_storage(x, 4);
+    f.vectorize(x, 4);
+
+    Image<int> result = f.realize(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            int correct = (x + y * 100) + (x + 1 + (y + 1) * 100) +
+                (x * 2 - y) + ((x + 3) * 2 - y);
+            if (result(x, y) != correct) {
+                printf("result(%d, %d) = %d instead of %d\n", x, y, result(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -27,5 +27,34 @@ int main(int argc, char **argv) {
 
     g.realize(425);
 
+    // Strides of three and four (one channel of rgb or rgba, or a
+    // downsample) load one vector per unit of stride, with the last
+    // one pushed backwards in the same way.
+    for (int stride = 3; stride <= 4; stride++) {
+        Image<uint8_t> in(16 * 7 * stride);
+        for (int i = 0; i < in.width(); i++) {
+            in(i) = (uint8_t)(i * 7 + 3);
+        }
+
+        Func h, k;
+        h(x) = in(stride*x) + in(stride*x + stride - 1);
+        h.compute_root().vectorize(x, 16);
+        k(x) = h(stride*x);
+        k.vectorize(x, 16);
+
+        const int N = 16 * 7 / stride;
+        h.bound(x, 0, 16 * 7);
+        Image<uint8_t> out = k.realize(N);
+        for (int i = 0; i < N; i++) {
+            int j = stride * i;
+            uint8_t correct = (uint8_t)(in(stride*j) + in(stride*j + stride - 1));
+            if (out(i) != correct) {
+                printf("stride %d: out(%d) = %d instead of %d\n", stride, i, out(i), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
     return 0;
 }
@@ -0,0 +1,45 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Halide;
+
+// Apply a gamma curve to an image, with the curve tabulated or not.
+Image<uint8_t> apply_gamma(Image<uint8_t> input, bool tabulate) {
+    Func gamma("gamma"), out("out");
+    Var x("x"), y("y");
+    gamma(x) = cast<uint8_t>(clamp(pow(x / 255.0f, 1 / 2.2f) * 255.0f + 0.5f, 0.0f, 255.0f));
+    out(x, y) = gamma(input(x, y));
+    if (tabulate) {
+        gamma.tabulate(x, 0, 256);
+    }
+    return out.realize(input.width(), input.height());
+}
+
+int main(int argc, char **argv) {
+    Image<uint8_t> input(64, 16);
+    for (int y = 0; y < input.height(); y++) {
+        for (int x = 0; x < input.width(); x++) {
+            input(x, y) = (uint8_t)(x * 7 + y * 13);
+        }
+    }
+
+    Image<uint8_t> correct = apply_gamma(input, false);
+    Image<uint8_t> tabulated = apply_gamma(input, true);
+    setenv("HL_AUTO_TABULATE", "1", 1);
+    Image<uint8_t> detected = apply_gamma(input, false);
+    unsetenv("HL_AUTO_TABULATE");
+
+    for (int y = 0; y < input.height(); y++) {
+        for (int x = 0; x < input.width(); x++) {
+            if (tabulated(x, y) != correct(x, y) || detected(x, y) != correct(x, y)) {
+                printf("At (%d, %d): %d and %d from tables instead of %d\n", x, y,
+                       tabulated(x, y), detected(x, y), correct(x, y));
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
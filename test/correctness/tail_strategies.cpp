@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+// Realize f over an odd width, and check that f(x) == x * scale + offset.
+int check(Func f, int width, int scale, int offset, const char *name) {
+    Image<int> result = f.realize(width);
+    for (int x = 0; x < width; x++) {
+        int correct = x * scale + offset;
+        if (result(x) != correct) {
+            printf("%s: result(%d) = %d instead of %d\n", name, x, result(x), correct);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Var x;
+
+    // Guarding with an if works for extents smaller than the vector
+    // width, which shifting inwards doesn't.
+    for (int width = 1; width < 20; width += 3) {
+        Func f;
+        f(x) = x * 2;
+        f.vectorize(x, 8, Tail_GuardWithIf);
+        if (check(f, width, 2, 0, "guard with if")) return -1;
+    }
+
+    {
+        Func f;
+        f(x) = x * 3;
+        f.vectorize(x, 8, Tail_ShiftInwards);
+        if (check(f, 13, 3, 0, "shift inwards")) return -1;
+    }
+
+    {
+        // Update steps can be split by factors that don't divide the
+        // output size if they're guarded.
+        Func f;
+        f(x) = x;
+        f(x) += 5;
+        f.vectorize(x, 8, Tail_GuardWithIf);
+        f.update().vectorize(x, 8, Tail_GuardWithIf);
+        if (check(f, 13, 1, 5, "guarded update")) return -1;
+    }
+
+    {
+        // Rounding up an internal function makes its allocation bigger
+        // instead. It's computed over 16 points, so it must be safe to
+        // evaluate past the end of what's required.
+        ImageParam in(Int(32), 1);
+        Image<int> input(13);
+        for (int i = 0; i < 13; i++) {
+            input(i) = i;
+        }
+        in.set(input);
+
+        Func g, f;
+        g(x) = in(clamp(x, 0, 12)) + 1;
+        f(x) = g(x);
+        g.compute_root().vectorize(x, 8, Tail_RoundUp);
+        if (check(f, 13, 1, 1, "round up")) return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -78,6 +78,22 @@ int main(int argc, char **argv) {
        return -1;
     }
 
+    // A cpu to tune for round-trips with underscores for dashes.
+    t1 = Target(Target::Linux, Target::ARM, 32, Target::FMA, "cortex-a15");
+    ts = t1.to_string();
+    if (ts != "arm-32-linux-fma-cpu_cortex_a15") {
+       printf("to_string failure: %s\n", ts.c_str());
+       return -1;
+    }
+    if (!t2.from_string(ts)) {
+       printf("from_string failure: %s\n", ts.c_str());
+       return -1;
+    }
+    if (t2 != t1) {
+       printf("compare failure: %s %s\n", t1.to_string().c_str(), t2.to_string().c_str());
+       return -1;
+    }
+
     // Expected failures:
     ts = "host-unknowntoken";
     if (t2.from_string(ts)) {
@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+bool check(Image<int> im, int k) {
+    for (int y = 0; y < im.height(); y++) {
+        for (int x = 0; x < im.width(); x++) {
+            int correct = x*y + k;
+            if (im(x, y) != correct) {
+                printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), correct);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Pipelines that run on thread pools of their own.
+int main(int argc, char **argv) {
+    Var x, y;
+    Func f, g;
+
+    f(x, y) = x*y + 1;
+    f.parallel(y);
+
+    g(x, y) = x*y + 2;
+    g.parallel(y);
+
+    // A small low-priority pool for one, the shared pool for the other.
+    f.set_thread_pool(2, 10);
+    if (!check(f.realize(16, 100), 1)) return -1;
+    if (!check(g.realize(16, 100), 2)) return -1;
+
+    // Replace the pool with a bigger one.
+    f.set_thread_pool(8);
+    if (!check(f.realize(16, 100), 1)) return -1;
+
+    // A pool with a single thread runs everything on the caller.
+    g.set_thread_pool(1);
+    if (!check(g.realize(16, 100), 2)) return -1;
+
+    // And back to the shared pool.
+    f.set_thread_pool(0);
+    if (!check(f.realize(16, 100), 1)) return -1;
+
+    printf("Success!\n");
+    return 0;
+}
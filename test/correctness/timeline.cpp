@@ -0,0 +1,59 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace Halide;
+
+const char *timeline_file_name = "timeline_test.json";
+
+int main(int argc, char **argv) {
+    remove(timeline_file_name);
+    setenv("HL_TIMELINE_FILE", timeline_file_name, 1);
+    // Trace the realizations, to get produce and consume markers.
+    setenv("HL_TRACE", "1", 1);
+
+    {
+        Func f("f"), g("g");
+        Var x, y;
+        f(x, y) = x + y;
+        g(x, y) = f(x, y) + f(x, y + 1);
+        f.compute_root().parallel(y);
+        g.parallel(y);
+
+        Image<int> result = g.realize(64, 64);
+        for (int y = 0; y < 64; y++) {
+            for (int x = 0; x < 64; x++) {
+                int correct = 2 * (x + y) + 1;
+                if (result(x, y) != correct) {
+                    printf("result(%d, %d) = %d instead of %d\n",
+                           x, y, result(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+        // The timeline is written when the compiled pipeline is freed.
+    }
+
+    FILE *file = fopen(timeline_file_name, "r");
+    if (!file) {
+        printf("No timeline was written\n");
+        return -1;
+    }
+    static char buf[1 << 20];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, file);
+    buf[len] = 0;
+    fclose(file);
+    remove(timeline_file_name);
+
+    const char *expected[] = {"{\"displayTimeUnit\"", "\"produce f\"", "\"ph\":\"X\"", "\"cat\":\"task\"", "]}"};
+    for (int i = 0; i < 5; i++) {
+        if (!strstr(buf, expected[i])) {
+            printf("The timeline has no %s\n", expected[i]);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace Halide;
+
+const char *trace_file_name = "trace_file_test.bin";
+
+// Count the stores to each of f and g in the trace file, and check
+// that every packet is whole.
+bool count_stores(int *f_stores, int *g_stores) {
+    *f_stores = *g_stores = 0;
+    FILE *file = fopen(trace_file_name, "rb");
+    if (!file) {
+        printf("Could not open %s\n", trace_file_name);
+        return false;
+    }
+    unsigned char header[32];
+    while (fread(header, 1, 32, file) == 32) {
+        int event = header[8];
+        int bits = header[10];
+        int width = header[11];
+        int dimensions = header[13];
+        const char *func = (const char *)(header + 14);
+
+        int bytes = 1;
+        while (bytes * 8 < bits) bytes <<= 1;
+        int payload = width * bytes + dimensions * 4;
+        unsigned char rest[4096];
+        if (fread(rest, 1, payload, file) != (size_t)payload) {
+            printf("Truncated packet in trace file\n");
+            fclose(file);
+            return false;
+        }
+        if (event == halide_trace_store) {
+            if (!strcmp(func, "f")) (*f_stores)++;
+            if (!strcmp(func, "g")) (*g_stores)++;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Func f("f"), g("g");
+    Var x, y;
+    f(x, y) = x + y;
+    g(x, y) = f(x, y) * 2;
+    f.compute_root().parallel(y).trace_stores();
+    g.parallel(y).trace_stores().trace_realizations();
+
+    // Large enough to fill the trace buffer a few times over.
+    const int size = 512;
+
+    // Everything goes to the file.
+    remove(trace_file_name);
+    setenv("HL_TRACE_FILE", trace_file_name, 1);
+    Image<int> result = g.realize(size, size);
+    int f_stores, g_stores;
+    if (!count_stores(&f_stores, &g_stores)) {
+        return -1;
+    }
+    if (f_stores != size * size || g_stores != size * size) {
+        printf("Traced %d stores to f and %d to g instead of %d each\n",
+               f_stores, g_stores, size * size);
+        return -1;
+    }
+
+    // Just one store to g in every ten.
+    remove(trace_file_name);
+    setenv("HL_TRACE_FUNCS", "g", 1);
+    setenv("HL_TRACE_EVENTS", "store,begin_realization", 1);
+    setenv("HL_TRACE_SAMPLE", "10", 1);
+    g.realize(result);
+    if (!count_stores(&f_stores, &g_stores)) {
+        return -1;
+    }
+    int expected = (size * size + 9) / 10;
+    if (f_stores != 0 || g_stores != expected) {
+        printf("Traced %d stores to f and %d to g instead of 0 and %d\n",
+               f_stores, g_stores, expected);
+        return -1;
+    }
+
+    remove(trace_file_name);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            if (result(x, y) != (x + y) * 2) {
+                printf("result(%d, %d) = %d instead of %d\n",
+                       x, y, result(x, y), (x + y) * 2);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace Halide;
+
+int f_summaries = 0, g_summaries = 0, other_events = 0;
+int64_t f_stored = 0, f_box = 0, f_input_bytes = 0, g_f_bytes = 0;
+int f_summary_id = -1, g_summary_id = -1, next_id = 1;
+bool bad_box = false;
+
+int my_trace(void *user_context, const halide_trace_event *e) {
+    int id = next_id++;
+    if (e->event == halide_trace_summary) {
+        const int64_t *v = (const int64_t *)e->value;
+        if (!strcmp(e->func, "f")) {
+            f_summaries++;
+            f_stored += v[0];
+            f_box += v[1];
+            f_summary_id = id;
+            // Each realization of f covers two rows of ten.
+            if (e->dimensions != 4 || e->coordinates[0] != 0 || e->coordinates[1] != 10 ||
+                e->coordinates[3] != 2) {
+                bad_box = true;
+            }
+        } else if (!strcmp(e->func, "g")) {
+            g_summaries++;
+            g_summary_id = id;
+            if (v[0] != 100 || v[1] != 100) bad_box = true;
+        }
+    } else if (e->event == halide_trace_summary_load) {
+        int64_t bytes = ((const int64_t *)e->value)[0];
+        if (e->parent_id == f_summary_id && !strcmp(e->func, "input")) {
+            f_input_bytes += bytes;
+        } else if (e->parent_id == g_summary_id && !strcmp(e->func, "f")) {
+            g_f_bytes += bytes;
+        }
+    } else {
+        other_events++;
+    }
+    return id;
+}
+
+int main(int argc, char **argv) {
+    ImageParam input(UInt(8), 2, "input");
+    Func f("f"), g("g");
+    Var x("x"), y("y");
+    f(x, y) = cast<int>(input(x, y)) * 2;
+    g(x, y) = f(x, y) + f(x, y + 1);
+
+    // Each row of g recomputes the row of f the previous one needed.
+    f.compute_at(g, y);
+    f.trace_summary();
+    g.trace_summary();
+    g.set_custom_trace(&my_trace);
+
+    Image<uint8_t> in(10, 11);
+    for (int y = 0; y < 11; y++) {
+        for (int x = 0; x < 10; x++) {
+            in(x, y) = (uint8_t)(x + y);
+        }
+    }
+    input.set(in);
+
+    Image<int> out = g.realize(10, 10);
+
+    for (int y = 0; y < 10; y++) {
+        for (int x = 0; x < 10; x++) {
+            int correct = (x + y) * 2 + (x + y + 1) * 2;
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    if (other_events) {
+        printf("There were %d events other than summaries\n", other_events);
+        return -1;
+    }
+
+    if (f_summaries != 10 || g_summaries != 1 || bad_box) {
+        printf("Wrong summaries: %d of f, %d of g\n", f_summaries, g_summaries);
+        return -1;
+    }
+
+    // f is stored at 200 points, twice as many as the 110 needed.
+    if (f_stored != 200 || f_box != 200) {
+        printf("f stored %lld points over boxes of %lld instead of 200\n",
+               (long long)f_stored, (long long)f_box);
+        return -1;
+    }
+
+    if (f_input_bytes != 200 || g_f_bytes != 800) {
+        printf("f loaded %lld bytes of input instead of 200, and g loaded %lld of f instead of 800\n",
+               (long long)f_input_bytes, (long long)g_f_bytes);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
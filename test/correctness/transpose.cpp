@@ -0,0 +1,41 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Var x, y, xi, yi;
+
+    // A Func stored transposed. Each tile of its stores should become
+    // dense stores of the transposed rows.
+    Func f("f"), g("g");
+    f(x, y) = x + y * 256;
+    g(x, y) = f(x, y);
+
+    f.compute_root().reorder_storage(y, x)
+        .tile(x, y, xi, yi, 4, 4).vectorize(xi).unroll(yi);
+
+    // A transposed access. Each tile of its strided loads should
+    // become dense loads of the rows of the input and a transpose.
+    Func h("h"), t("t");
+    h(x, y) = x * 3 + y * 512;
+    t(x, y) = h(y, x) + g(x, y);
+
+    h.compute_root();
+    t.tile(x, y, xi, yi, 8, 8).vectorize(xi).unroll(yi);
+
+    Image<int> out = t.realize(64, 64);
+
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            int correct = (y * 3 + x * 512) + (x + y * 256);
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
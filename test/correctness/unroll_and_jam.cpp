@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int N = 37;
+    Image<float> a(N, N), b(N, N);
+    for (int y = 0; y < N; y++) {
+        for (int x = 0; x < N; x++) {
+            a(x, y) = (float)((x * 3 + y) % 7);
+            b(x, y) = (float)((x + y * 5) % 11);
+        }
+    }
+
+    // A matrix multiply with a register-blocked update: each
+    // iteration of r does four rows of the output.
+    Var x, y, xi, yi;
+    RDom r(0, N);
+    Func prod;
+    prod(x, y) = 0.0f;
+    prod(x, y) += a(r, y) * b(x, r);
+    prod.update()
+        .split(x, x, xi, 8, Tail_GuardWithIf)
+        .split(y, y, yi, 4, Tail_GuardWithIf)
+        .reorder(xi, r.x, yi, x, y)
+        .vectorize(xi)
+        .unroll_and_jam(yi);
+
+    Image<float> result = prod.realize(N, N);
+    for (int y = 0; y < N; y++) {
+        for (int x = 0; x < N; x++) {
+            float correct = 0.0f;
+            for (int k = 0; k < N; k++) {
+                correct += a(k, y) * b(x, k);
+            }
+            if (result(x, y) != correct) {
+                printf("prod(%d, %d) = %f instead of %f\n", x, y, result(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -498,6 +498,39 @@ bool test(int vec_width) {
             }
         }
 
+        // Vectorized sin, cos and tan.
+        Func f21, f22, f23;
+        f21(x, y) = sin(a);
+        f22(x, y) = cos(a);
+        f23(x, y) = tan(a);
+        f21.vectorize(x, 8);
+        f22.vectorize(x, 8);
+        f23.vectorize(x, 8);
+        Image<float> im21 = f21.realize(W, H);
+        Image<float> im22 = f22.realize(W, H);
+        Image<float> im23 = f23.realize(W, H);
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                float a = input(x, y) * 0.5f;
+                if (fabs(a) > 8192) continue;
+                float correct_sin = sinf(a), correct_cos = cosf(a), correct_tan = tanf(a);
+                if (fabs(im21(x, y) - correct_sin) > 1e-6f) {
+                    printf("sin(%f) = %1.10f instead of %1.10f\n", a, im21(x, y), correct_sin);
+                    return false;
+                }
+                if (fabs(im22(x, y) - correct_cos) > 1e-6f) {
+                    printf("cos(%f) = %1.10f instead of %1.10f\n", a, im22(x, y), correct_cos);
+                    return false;
+                }
+                // Near the poles of tan, the error of cos is magnified.
+                if (fabs(correct_cos) > 0.1f &&
+                    fabs(im23(x, y) - correct_tan) > 1e-5f * std::max(1.0f, (float)fabs(correct_tan))) {
+                    printf("tan(%f) = %1.10f instead of %1.10f\n", a, im23(x, y), correct_tan);
+                    return false;
+                }
+            }
+        }
+
         /*
         printf("log mantissa error: %d\n", worst_log_mantissa);
         printf("exp mantissa error: %d\n", worst_exp_mantissa);
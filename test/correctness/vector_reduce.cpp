@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    const int W = 32, K = 64;
+    Image<int16_t> a(K, W), b(K);
+    Image<uint8_t> bytes(K, W);
+    Image<float> floats(K, W);
+    for (int x = 0; x < W; x++) {
+        for (int r = 0; r < K; r++) {
+            a(r, x) = (int16_t)((r * 17 + x * 31) % 201 - 100);
+            bytes(r, x) = (uint8_t)((r * 13 + x * 7) % 256);
+            floats(r, x) = (float)((r * 5 + x * 3) % 11) - 5.0f;
+        }
+    }
+    for (int r = 0; r < K; r++) {
+        b(r) = (int16_t)(r % 13 - 6);
+    }
+
+    Var x;
+    RDom r(0, K);
+
+    // A dot product of 16-bit values.
+    Func dot;
+    dot(x) = 0;
+    dot(x) += cast<int>(a(r, x)) * cast<int>(b(r));
+    dot.update().vectorize(r, 8);
+
+    // A box sum of bytes.
+    Func box;
+    box(x) = cast<uint16_t>(0);
+    box(x) += cast<uint16_t>(bytes(r, x));
+    box.update().vectorize(r, 16);
+
+    // A float maximum, over an extent the vector width doesn't divide.
+    RDom s(0, K - 3);
+    Func biggest;
+    biggest(x) = -100.0f;
+    biggest(x) = max(biggest(x), floats(s, x) * (x + 1));
+    biggest.update().vectorize(s, 8);
+
+    // An update that isn't an associative reduction into a single
+    // location must still be done a lane at a time.
+    Func scan;
+    scan(x) = 0;
+    scan(x) = scan(x) * 2 + cast<int>(bytes(r, x)) % 2;
+    scan.update().vectorize(r, 4);
+
+    Image<int> dot_result = dot.realize(W);
+    Image<uint16_t> box_result = box.realize(W);
+    Image<float> biggest_result = biggest.realize(W);
+    Image<int> scan_result = scan.realize(W);
+
+    for (int x = 0; x < W; x++) {
+        int dot_correct = 0, scan_correct = 0;
+        uint16_t box_correct = 0;
+        float biggest_correct = -100.0f;
+        for (int r = 0; r < K; r++) {
+            dot_correct += a(r, x) * b(r);
+            box_correct += bytes(r, x);
+            scan_correct = scan_correct * 2 + bytes(r, x) % 2;
+            if (r < K - 3 && floats(r, x) * (x + 1) > biggest_correct) {
+                biggest_correct = floats(r, x) * (x + 1);
+            }
+        }
+        if (dot_result(x) != dot_correct) {
+            printf("dot(%d) = %d instead of %d\n", x, dot_result(x), dot_correct);
+            return -1;
+        }
+        if (box_result(x) != box_correct) {
+            printf("box(%d) = %d instead of %d\n", x, box_result(x), box_correct);
+            return -1;
+        }
+        if (biggest_result(x) != biggest_correct) {
+            printf("biggest(%d) = %f instead of %f\n", x, biggest_result(x), biggest_correct);
+            return -1;
+        }
+        if (scan_result(x) != scan_correct) {
+            printf("scan(%d) = %d instead of %d\n", x, scan_result(x), scan_correct);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include <Halide.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Var x, xo, xi, xio, xii;
+
+    // The guards of both splits depend on the vectorized variable, so
+    // the vector loop over xii holds one if inside another. Both are
+    // done by predicating the loads and stores.
+    for (int size = 1; size < 40; size += 7) {
+        ImageParam in(Int(32), 1);
+        Image<int> input(size);
+        for (int i = 0; i < size; i++) {
+            input(i) = i * 5 - 3;
+        }
+        in.set(input);
+
+        Func f;
+        f(x) = in(x) * 3 + x;
+        f.split(x, xo, xi, 12, Tail_GuardWithIf)
+            .split(xi, xio, xii, 8, Tail_GuardWithIf)
+            .vectorize(xii);
+
+        Image<int> result = f.realize(size);
+        for (int i = 0; i < size; i++) {
+            int correct = (i * 5 - 3) * 3 + i;
+            if (result(i) != correct) {
+                printf("result(%d) = %d instead of %d\n", i, result(i), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
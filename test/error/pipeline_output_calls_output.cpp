@@ -0,0 +1,20 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Func f("f"), g("g");
+    Var x("x");
+
+    f(x) = x;
+    // g is also an output, so it can't use f directly.
+    g(x) = f(x) + f(x+1);
+
+    Image<int> f_out(10), g_out(10);
+    Pipeline p(f, g);
+    p.realize(Realization(f_out, g_out));
+
+    printf("There should have been an error\n");
+    return 0;
+}
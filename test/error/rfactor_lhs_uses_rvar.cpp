@@ -0,0 +1,23 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Func f("f"), g("g");
+    Var x, y;
+    RDom r(0, 10, 0, 10);
+
+    g(x, y) = x + y;
+    f(x) = 0;
+    f(r.y) += g(r.x, r.y);
+
+    // The update step stores to a different site for each value of
+    // r.y, so it can't be rfactored over r.y.
+    f.rfactor(r.y, y);
+
+    f.realize(10);
+
+    printf("Success!\n");
+    return 0;
+}
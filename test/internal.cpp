@@ -10,6 +10,10 @@
 #include "Deinterleave.h"
 #include "ModulusRemainder.h"
 #include "OneToOne.h"
+#include "IRHash.h"
+#include "CSE.h"
+#include "HoistLoopInvariants.h"
+#include "Interpreter.h"
 
 using namespace Halide;
 using namespace Halide::Internal;
@@ -30,5 +34,9 @@ int main(int argc, const char **argv) {
     deinterleave_vector_test();
     modulus_remainder_test();
     is_one_to_one_test();
+    ir_hash_test();
+    cse_test();
+    hoist_loop_invariants_test();
+    interpreter_test();
     return 0;
 }
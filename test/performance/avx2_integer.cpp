@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <Halide.h>
+#include "benchmark.h"
+
+using namespace Halide;
+
+// Time a pipeline of 8- and 16-bit saturating, averaging, widening and
+// dividing ops compiled for the host with and without AVX2.
+int main(int argc, char **argv) {
+    Target avx2 = get_jit_target_from_environment();
+    if (avx2.arch != Target::X86 || !(avx2.features & Target::AVX2)) {
+        printf("Not running on a machine with AVX2. Skipping test.\n");
+        printf("Success!\n");
+        return 0;
+    }
+    Target sse = avx2;
+    sse.features &= ~(Target::AVX2 | Target::AVX);
+
+    const int W = 1024, H = 1024;
+    Image<uint8_t> a(W, H), b(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            a(x, y) = rand() & 0xff;
+            b(x, y) = rand() & 0xff;
+        }
+    }
+
+    Var x, y;
+    Func f[2];
+    for (int i = 0; i < 2; i++) {
+        Expr av = cast<uint16_t>(a(x, y)), bv = cast<uint16_t>(b(x, y));
+        Expr sum = cast<uint8_t>(min(av + bv, 255));
+        Expr diff = cast<uint8_t>(max(cast<int16_t>(a(x, y)) - cast<int16_t>(b(x, y)), 0));
+        Expr avg = cast<uint8_t>((av + bv + 1) / 2);
+        Expr wide = cast<uint16_t>((cast<uint32_t>(av * 255) * cast<uint32_t>(bv + 7)) / 65536);
+        Expr e = max(sum, avg) - min(diff, avg) + cast<uint8_t>(wide / 7);
+        f[i](x, y) = e;
+    }
+    // Each uses the full width of its vector registers.
+    f[0].vectorize(x, 16);
+    f[1].vectorize(x, 32);
+
+    f[0].compile_jit(sse);
+    f[1].compile_jit(avx2);
+
+    Image<uint8_t> out_sse(W, H), out_avx2(W, H);
+    f[0].realize(out_sse, sse);
+    f[1].realize(out_avx2, avx2);
+
+    Benchmark b_sse("avx2_integer_sse");
+    while (b_sse.running()) {
+        f[0].realize(out_sse, sse);
+    }
+    Benchmark b_avx2("avx2_integer_avx2");
+    while (b_avx2.running()) {
+        f[1].realize(out_avx2, avx2);
+    }
+    double t_sse = b_sse.median(), t_avx2 = b_avx2.median();
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            if (out_sse(x, y) != out_avx2(x, y)) {
+                printf("out_avx2(%d, %d) = %d instead of %d\n",
+                       x, y, out_avx2(x, y), out_sse(x, y));
+                return -1;
+            }
+        }
+    }
+
+    printf("SSE vs AVX2: %1.3gms %1.3gms. Speedup = %1.3f\n",
+           t_sse, t_avx2, t_sse / t_avx2);
+    benchmark_record("avx2_integer_speedup", t_sse / t_avx2);
+
+    if (t_avx2 > t_sse) {
+        printf("AVX2 was slower than SSE\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -1,7 +1,7 @@
 #include <Halide.h>
 #include <stdio.h>
 #include <algorithm>
-#include "clock.h"
+#include "benchmark.h"
 
 using namespace Halide;
 
@@ -11,7 +11,7 @@ Image<uint16_t> output;
 #define MIN 1
 #define MAX 1020
 
-double test(Func f, bool test_correctness = true) {
+double test(Func f, const std::string &name, bool test_correctness = true) {
     f.compile_to_assembly(f.name() + ".s", Internal::vec<Argument>(input), f.name());
     f.compile_jit();
     f.realize(output);
@@ -31,11 +31,11 @@ double test(Func f, bool test_correctness = true) {
         }
     }
 
-    double t1 = currentTime();
-    for (int i = 0; i < 10; i++) {
+    Benchmark b("clamped_vector_load_" + name);
+    while (b.running()) {
         f.realize(output);
     }
-    return currentTime() - t1;
+    return b.median();
 }
 
 int main(int argc, char **argv) {
@@ -63,7 +63,7 @@ int main(int argc, char **argv) {
 
         f.vectorize(x, 8);
 
-        t_ref = test(f, false);
+        t_ref = test(f, "unclamped", false);
     }
 
     {
@@ -76,7 +76,7 @@ int main(int argc, char **argv) {
 
         f.vectorize(x, 8);
 
-        t_clamped = test(f);
+        t_clamped = test(f, "clamped");
     }
 
     {
@@ -90,7 +90,7 @@ int main(int argc, char **argv) {
         f.vectorize(x, 8);
         g.compute_at(f, x);
 
-        t_scalar = test(f);
+        t_scalar = test(f, "scalar");
     }
 
     {
@@ -104,7 +104,7 @@ int main(int argc, char **argv) {
         f.vectorize(x, 8);
         g.compute_at(f, y);
 
-        t_pad = test(f);
+        t_pad = test(f, "pad");
     }
 
     // This constraint is pretty lax, because the op is so trivial
@@ -1,29 +0,0 @@
-// A currentTime function for use in the tests.
-// Returns time in milliseconds.
-
-#ifdef _WIN32
-extern "C" bool QueryPerformanceCounter(uint64_t *);
-extern "C" bool QueryPerformanceFrequency(uint64_t *);
-double currentTime() {
-    uint64_t t, freq;
-    QueryPerformanceCounter(&t);
-    QueryPerformanceFrequency(&freq);
-    return (t * 1000.0) / freq;
-}
-#else
-#include <sys/time.h>
-double currentTime() {
-    static bool first_call = true;
-    static timeval reference_time;
-    if (first_call) {
-        first_call = false;
-        gettimeofday(&reference_time, NULL);
-        return 0.0;
-    } else {
-        timeval t;
-        gettimeofday(&t, NULL);
-        return ((t.tv_sec - reference_time.tv_sec)*1000.0 +
-                (t.tv_usec - reference_time.tv_usec)/1000.0);
-    }
-}
-#endif
@@ -0,0 +1,217 @@
+#include <Halide.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <map>
+#include "benchmark.h"
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// How long lowering and llvm take on large pipelines like the ones
+// our generators make. Each pipeline is timed lowering only, and
+// then jit compiled from scratch, the difference being the time in
+// llvm. The mean time of each lowering pass, the IR nodes made per
+// lowering, and the peak memory of the process are recorded with the
+// timings.
+
+Var x("x"), y("y"), k("k");
+
+// Downsample with a 1 3 3 1 filter
+Func downsample(Func f) {
+    Func downx, downy;
+    downx(x, y, _) = (f(2*x-1, y, _) + 3.0f * (f(2*x, y, _) + f(2*x+1, y, _)) + f(2*x+2, y, _)) / 8.0f;
+    downy(x, y, _) = (downx(x, 2*y-1, _) + 3.0f * (downx(x, 2*y, _) + downx(x, 2*y+1, _)) + downx(x, 2*y+2, _)) / 8.0f;
+    return downy;
+}
+
+// Upsample using bilinear interpolation
+Func upsample(Func f) {
+    Func upx, upy;
+    upx(x, y, _) = 0.25f * f((x/2) - 1 + 2*(x % 2), y, _) + 0.75f * f(x/2, y, _);
+    upy(x, y, _) = 0.25f * upx(x, (y/2) - 1 + 2*(y % 2), _) + 0.75f * upx(x, y/2, _);
+    return upy;
+}
+
+// A grayscale local laplacian filter (as in apps/local_laplacian)
+// with a deep pyramid.
+Func local_laplacian() {
+    const int J = 10, levels = 8;
+    ImageParam input(Float(32), 2);
+
+    Func clamped = BoundaryConditions::repeat_edge(input);
+
+    Func remap;
+    Expr fx = cast<float>(x) / 256.0f;
+    remap(x) = fx * exp(-fx * fx / 2.0f);
+
+    Func gPyramid[J];
+    Expr idx = clamp(cast<int>(clamped(x, y) * (levels - 1) * 256.0f), 0, (levels - 1) * 256);
+    gPyramid[0](x, y, k) = clamped(x, y) + remap(idx - 256 * k);
+    for (int j = 1; j < J; j++) {
+        gPyramid[j](x, y, k) = downsample(gPyramid[j-1])(x, y, k);
+    }
+
+    Func lPyramid[J];
+    lPyramid[J-1](x, y, k) = gPyramid[J-1](x, y, k);
+    for (int j = J-2; j >= 0; j--) {
+        lPyramid[j](x, y, k) = gPyramid[j](x, y, k) - upsample(gPyramid[j+1])(x, y, k);
+    }
+
+    Func inGPyramid[J];
+    inGPyramid[0](x, y) = clamped(x, y);
+    for (int j = 1; j < J; j++) {
+        inGPyramid[j](x, y) = downsample(inGPyramid[j-1])(x, y);
+    }
+
+    Func outLPyramid[J];
+    for (int j = 0; j < J; j++) {
+        Expr level = inGPyramid[j](x, y) * (levels - 1);
+        Expr li = clamp(cast<int>(level), 0, levels - 2);
+        Expr lf = level - cast<float>(li);
+        outLPyramid[j](x, y) = (1.0f - lf) * lPyramid[j](x, y, li) + lf * lPyramid[j](x, y, li + 1);
+    }
+
+    Func outGPyramid[J];
+    outGPyramid[J-1](x, y) = outLPyramid[J-1](x, y);
+    for (int j = J-2; j >= 0; j--) {
+        outGPyramid[j](x, y) = upsample(outGPyramid[j+1])(x, y) + outLPyramid[j](x, y);
+    }
+
+    Func output;
+    output(x, y) = outGPyramid[0](x, y);
+
+    remap.compute_root();
+    output.parallel(y, 4).vectorize(x, 8);
+    for (int j = 0; j < J; j++) {
+        if (j > 0) inGPyramid[j].compute_root().parallel(y, 4).vectorize(x, 8);
+        if (j > 0) gPyramid[j].compute_root().parallel(y, 4).vectorize(x, 8);
+        outGPyramid[j].compute_root().parallel(y, 4).vectorize(x, 8);
+    }
+    return output;
+}
+
+// A bitonic sorting network (as in sort.cpp), one Func per pass.
+Func bitonic_sort() {
+    const int size = 512;
+    ImageParam input(Int(32), 1);
+    Func prev = BoundaryConditions::repeat_edge(input);
+
+    Var xo("xo"), xi("xi");
+    for (int pass_size = 1; pass_size < size; pass_size <<= 1) {
+        for (int chunk_size = pass_size; chunk_size > 0; chunk_size >>= 1) {
+            Func next("bitonic_pass");
+            Expr chunk_start = (x/(2*chunk_size))*(2*chunk_size);
+            Expr chunk_end = (x/(2*chunk_size) + 1)*(2*chunk_size);
+            Expr chunk_middle = chunk_start + chunk_size;
+            Expr chunk_index = x - chunk_start;
+            Expr partner;
+            if (pass_size == chunk_size && pass_size > 1) {
+                partner = clamp(2*chunk_middle - x - 1, chunk_start, chunk_end-1);
+            } else {
+                partner = chunk_start + (chunk_index + chunk_size) % (chunk_size*2);
+            }
+            next(x) = select(x < chunk_middle,
+                             min(prev(x), prev(partner)),
+                             max(prev(x), prev(partner)));
+            if (pass_size > 1) {
+                next.split(x, xo, xi, 2*chunk_size);
+            }
+            next.compute_root().vectorize(xi, 8);
+            prev = next;
+        }
+    }
+    prev.bound(x, 0, size);
+    return prev;
+}
+
+// A few wide stencils, unrolled and vectorized.
+Func unrolled_stencils() {
+    const int radius = 4, stages = 4;
+    ImageParam input(Float(32), 2);
+    Func f = BoundaryConditions::repeat_edge(input);
+
+    Var yi("yi");
+    for (int s = 0; s < stages; s++) {
+        Func g;
+        Expr e = 0.0f;
+        for (int dy = -radius; dy <= radius; dy++) {
+            for (int dx = -radius; dx <= radius; dx++) {
+                e += f(x + dx, y + dy) * (1.0f / (1 + dx*dx + dy*dy));
+            }
+        }
+        g(x, y) = e;
+        g.compute_root().split(y, y, yi, 4).unroll(yi).vectorize(x, 8).parallel(y);
+        f = g;
+    }
+    return f;
+}
+
+// In MB. Linux reports ru_maxrss in KB, and OS X in bytes.
+int peak_memory() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    #ifdef __APPLE__
+    return (int)(usage.ru_maxrss >> 20);
+    #else
+    return (int)(usage.ru_maxrss >> 10);
+    #endif
+}
+
+void time_compilation(const std::string &name, Func (*make)(), const Target &t) {
+    std::map<std::string, double> pass_ms;
+    std::vector<std::string> pass_order;
+    uint64_t nodes = 0;
+    int lowerings = 0;
+
+    Benchmark lowering("compile_time_" + name + "_lower");
+    while (lowering.running()) {
+        Func f = make();
+        uint64_t nodes_before = ir_nodes_allocated();
+        lower(f.function(), t);
+        nodes += ir_nodes_allocated() - nodes_before;
+        lowerings++;
+
+        std::vector<std::pair<std::string, double> > times = last_lowering_pass_times();
+        for (size_t i = 0; i < times.size(); i++) {
+            if (!pass_ms.count(times[i].first)) {
+                pass_order.push_back(times[i].first);
+            }
+            pass_ms[times[i].first] += times[i].second;
+        }
+    }
+
+    Benchmark jit("compile_time_" + name + "_jit");
+    while (jit.running()) {
+        // The jit cache would otherwise find the same module the
+        // second time around.
+        clear_jit_cache();
+        Func f = make();
+        f.compile_jit(t);
+    }
+
+    double llvm_ms = jit.median() - lowering.median();
+    printf("%s: lowering %f ms, llvm %f ms, %d IR nodes per lowering\n",
+           name.c_str(), lowering.median(), llvm_ms, (int)(nodes / lowerings));
+    benchmark_record("compile_time_" + name + "_llvm_ms", llvm_ms);
+    benchmark_record("compile_time_" + name + "_ir_nodes", (double)(nodes / lowerings));
+    for (size_t i = 0; i < pass_order.size(); i++) {
+        double ms = pass_ms[pass_order[i]] / lowerings;
+        printf("  %-28s %10.3f ms\n", pass_order[i].c_str(), ms);
+        benchmark_record("compile_time_" + name + "_pass_" + pass_order[i] + "_ms", ms);
+    }
+}
+
+int main(int argc, char **argv) {
+    Target t = get_jit_target_from_environment();
+
+    time_compilation("local_laplacian", local_laplacian, t);
+    time_compilation("bitonic_sort", bitonic_sort, t);
+    time_compilation("unrolled_stencils", unrolled_stencils, t);
+
+    int peak = peak_memory();
+    printf("Peak memory: %d MB\n", peak);
+    benchmark_record("compile_time_peak_memory_mb", peak);
+
+    printf("Success!\n");
+    return 0;
+}
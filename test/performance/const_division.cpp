@@ -1,7 +1,7 @@
 #include <Halide.h>
 #include <stdio.h>
 #include <stdint.h>
-#include "clock.h"
+#include "benchmark.h"
 #include "time.h"
 
 using namespace Halide;
@@ -58,18 +58,21 @@ bool test(int w) {
     g.compile_jit();
     h.compile_jit();
 
-    double t1 = currentTime();
-    Image<T> correct = g.realize(input.width(), num_vals);
-    for (int i = 0; i < 30; i++) g.realize(correct);
-    double t2 = currentTime();
-    Image<T> fast = f.realize(input.width(), num_vals);
-    for (int i = 0; i < 30; i++) f.realize(fast);
-    double t3 = currentTime();
-    Image<T> fast_dynamic = h.realize(input.width(), num_vals);
-    for (int i = 0; i < 30; i++) h.realize(fast_dynamic);
-    double t4 = currentTime();
-    printf("compile-time-constant divisor path is %1.3f x faster \n", (t2-t1)/(t3-t2));
-    printf("fast_integer_divide path is           %1.3f x faster \n", (t4-t3)/(t3-t2));
+    char name[64];
+    snprintf(name, sizeof(name), "const_division_%sint%d_x%d",
+             is_signed ? "" : "u", (int)bits, w);
+    Image<T> correct(input.width(), num_vals);
+    Image<T> fast(input.width(), num_vals);
+    Image<T> fast_dynamic(input.width(), num_vals);
+
+    Benchmark b_g(std::string(name) + "_reference");
+    while (b_g.running()) g.realize(correct);
+    Benchmark b_f(std::string(name) + "_constant");
+    while (b_f.running()) f.realize(fast);
+    Benchmark b_h(std::string(name) + "_fast_integer_divide");
+    while (b_h.running()) h.realize(fast_dynamic);
+    printf("compile-time-constant divisor path is %1.3f x faster \n", b_g.median() / b_f.median());
+    printf("fast_integer_divide path is           %1.3f x faster \n", b_h.median() / b_f.median());
 
     for (int y = 0; y < num_vals; y++) {
         for (int x = 0; x < input.width(); x++) {
@@ -1,6 +1,6 @@
 #include <Halide.h>
 #include <stdio.h>
-#include "clock.h"
+#include "benchmark.h"
 
 using namespace Halide;
 
@@ -30,19 +30,19 @@ int main(int argc, char **argv) {
 
     const int iterations = 20;
 
-    double t1 = currentTime();
-    for (int i = 0; i < iterations; i++) {
+    Benchmark b_powf("fast_pow_powf");
+    while (b_powf.running()) {
         f.realize(correct_result);
     }
-    double t2 = currentTime();
-    for (int i = 0; i < iterations; i++) {
+    Benchmark b_pow("fast_pow_pow");
+    while (b_pow.running()) {
         g.realize(fast_result);
     }
-    double t3 = currentTime();
-    for (int i = 0; i < iterations; i++) {
+    Benchmark b_fast_pow("fast_pow_fast_pow");
+    while (b_fast_pow.running()) {
         h.realize(faster_result);
     }
-    double t4 = currentTime();
+    double t_powf = b_powf.median(), t_pow = b_pow.median(), t_fast_pow = b_fast_pow.median();
 
     RDom r(correct_result);
     Func fast_error, faster_error;
@@ -58,12 +58,13 @@ int main(int argc, char **argv) {
     fast_err(0) = sqrt(fast_err(0)/N);
     faster_err(0) = sqrt(faster_err(0)/N);
 
+    int pixels = correct_result.width() * correct_result.height();
     printf("powf: %f ns per pixel\n"
            "Halide's pow: %f ns per pixel (rms error = %0.10f)\n"
            "Halide's fast_pow: %f ns per pixel (rms error = %0.10f)\n",
-           1000000*(t2-t1) / N,
-           1000000*(t3-t2) / N, fast_err(0),
-           1000000*(t4-t3) / N, faster_err(0));
+           1000000*t_powf / pixels,
+           1000000*t_pow / pixels, fast_err(0),
+           1000000*t_fast_pow / pixels, faster_err(0));
 
     if (fast_err(0) > 0.000001) {
         printf("Error for pow too large\n");
@@ -75,12 +76,12 @@ int main(int argc, char **argv) {
         return -1;
     }
 
-    if (t2-t1 < t3-t2) {
+    if (t_powf < t_pow) {
         printf("powf is faster than Halide's pow\n");
         return -1;
     }
 
-    if (t3-t2 < t4-t3) {
+    if (t_pow < t_fast_pow) {
         printf("pow is faster than fast_pow\n");
         return -1;
     }
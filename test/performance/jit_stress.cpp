@@ -1,9 +1,21 @@
 #include <stdio.h>
+#include <sys/resource.h>
 #include <Halide.h>
-#include "clock.h"
+#include "benchmark.h"
 
 using namespace Halide;
 
+// In MB. Linux reports ru_maxrss in KB, and OS X in bytes.
+int peak_memory() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    #ifdef __APPLE__
+    return (int)(usage.ru_maxrss >> 20);
+    #else
+    return (int)(usage.ru_maxrss >> 10);
+    #endif
+}
+
 int main(int argc, char **argv) {
     Var x;
 
@@ -14,21 +26,33 @@ int main(int argc, char **argv) {
     a.set(c);
 
 
-    double t1, t2;
-    t1 = currentTime();
-
-    for (int i = 0; i < 100; i++) {
+    Benchmark bench("jit_stress");
+    int i = 0;
+    while (bench.running()) {
         Func f;
         f(x) = a(x) + b(x);
         f.realize(c);
         assert(c(0) == (i+1)*17);
-    }    
+        i++;
+    }
 
-    t2 = currentTime();
-    int elapsed = (int)(10.0 * (t2-t1));
+    int elapsed = (int)(1000 * bench.median());
 
     printf("%d us per jit compilation\n", elapsed);
 
+    // Pipelines that can't share a module, each released after use,
+    // shouldn't make the memory grow.
+    int before = 0;
+    for (int j = 0; j < 200; j++) {
+        if (j == 20) before = peak_memory();
+        Func f;
+        f(x) = a(x) * j;
+        Image<int> out = f.realize(1);
+        assert(out(0) == c(0) * j);
+        f.release_jit();
+    }
+    printf("Peak memory after 20 pipelines: %d MB, after 200: %d MB\n", before, peak_memory());
+
     printf("Success!\n");
     return 0;
 }
@@ -0,0 +1,72 @@
+#include <Halide.h>
+#include <stdio.h>
+#include "benchmark.h"
+
+using namespace Halide;
+
+// Time vectorized lerps of each integer width, and check them against
+// the exactly rounded result computed in C.
+
+template<typename T, typename U>
+bool test_lerp(const char *name, int vector_width) {
+    const int W = 1024, H = 256;
+
+    Image<T> zero(W, H), one(W, H);
+    Image<U> weight(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            zero(x, y) = (T)(rand() * 2654435761u);
+            one(x, y) = (T)(rand() * 2654435761u);
+            weight(x, y) = (U)(rand() * 2654435761u);
+        }
+    }
+
+    Var x, y;
+    Func f;
+    f(x, y) = lerp(zero(x, y), one(x, y), weight(x, y));
+    f.vectorize(x, vector_width).parallel(y);
+    f.compile_jit();
+
+    Image<T> result(W, H);
+    Benchmark b(std::string("lerp_") + name);
+    while (b.running()) {
+        f.realize(result);
+    }
+
+    // Signed values are lerped as if they were biased to be unsigned.
+    const int bits = sizeof(T) * 8;
+    const U bias = (T)(-1) < 0 ? (U)((uint64_t)1 << (bits - 1)) : 0;
+    const uint64_t max_value = (U)(-1);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            uint64_t z = (U)((U)zero(x, y) + bias);
+            uint64_t o = (U)((U)one(x, y) + bias);
+            uint64_t w = weight(x, y);
+            // This can't overflow, even for 32 bits.
+            uint64_t sum = z * (max_value - w) + o * w;
+            T correct = (T)(U)((sum + max_value / 2) / max_value - bias);
+            if (result(x, y) != correct) {
+                printf("lerp_%s(%lld, %lld, %llu) = %lld instead of %lld\n",
+                       name, (long long)zero(x, y), (long long)one(x, y),
+                       (unsigned long long)w, (long long)result(x, y), (long long)correct);
+                return false;
+            }
+        }
+    }
+
+    printf("lerp_%s: %f ns per pixel\n", name, 1000000 * b.median() / (W * H));
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (!test_lerp<uint8_t, uint8_t>("uint8", 16) ||
+        !test_lerp<int8_t, uint8_t>("int8", 16) ||
+        !test_lerp<uint16_t, uint16_t>("uint16", 8) ||
+        !test_lerp<int16_t, uint16_t>("int16", 8) ||
+        !test_lerp<uint32_t, uint32_t>("uint32", 4)) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
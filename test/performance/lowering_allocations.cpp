@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <Halide.h>
+#include "benchmark.h"
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// Build a chain of stencils with a mix of schedules to give each
+// lowering pass something to do.
+Func make_pipeline() {
+    Var x, y, xi, yi;
+    ImageParam input(Float(32), 2);
+    Func f[6];
+    f[0](x, y) = input(clamp(x, 0, input.width()-1), clamp(y, 0, input.height()-1));
+    for (int i = 1; i < 6; i++) {
+        f[i](x, y) = (f[i-1](x-1, y) + f[i-1](x, y) * 2 + f[i-1](x+1, y+1)) / 4;
+    }
+    f[5].tile(x, y, xi, yi, 32, 8).vectorize(xi, 8).parallel(y);
+    f[4].compute_at(f[5], x).vectorize(x, 8);
+    f[3].store_root().compute_at(f[5], y);
+    f[2].compute_root().unroll(x, 2);
+    return f[5];
+}
+
+// Time lowering a fresh pipeline, and count the IR nodes lowering
+// makes. Passes that leave most of the IR alone should make few.
+int main(int argc, char **argv) {
+    Target t = get_jit_target_from_environment();
+
+    uint64_t nodes = 0;
+    Benchmark bench("lowering");
+    while (bench.running()) {
+        Func f = make_pipeline();
+        uint64_t before = ir_nodes_allocated();
+        lower(f.function(), t);
+        nodes = ir_nodes_allocated() - before;
+    }
+
+    printf("Lowering took %f ms and made %llu IR nodes\n",
+           bench.median(), (unsigned long long)nodes);
+    benchmark_record("lowering_ir_nodes", (double)nodes);
+
+    printf("Success!\n");
+    return 0;
+}
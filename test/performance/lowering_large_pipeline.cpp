@@ -0,0 +1,39 @@
+#include <stdio.h>
+#include <Halide.h>
+#include "benchmark.h"
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// A pipeline of many small Funcs, most of them inlined, like the
+// ones that generators make. Computing the realization order and
+// injecting the realizations should take time roughly linear in the
+// number of Funcs.
+Func make_pipeline(int stages) {
+    Var x, y;
+    std::vector<Func> f(stages);
+    f[0](x, y) = x + y;
+    for (int i = 1; i < stages; i++) {
+        Expr e = f[i-1](x, y) + f[i-1](x+1, y);
+        if (i > 2) e += f[i-3](x, y+1);
+        f[i](x, y) = e / 2;
+        // Every tenth Func is computed at the root.
+        if (i % 10 == 0) f[i-1].compute_root();
+    }
+    return f[stages-1];
+}
+
+int main(int argc, char **argv) {
+    Target t = get_jit_target_from_environment();
+
+    Benchmark bench("lowering_300_funcs");
+    while (bench.running()) {
+        Func f = make_pipeline(300);
+        lower(f.function(), t);
+    }
+
+    printf("Lowering 300 Funcs took %f ms\n", bench.median());
+
+    printf("Success!\n");
+    return 0;
+}
@@ -1,6 +1,6 @@
 #include <Halide.h>
 #include <stdio.h>
-#include "clock.h"
+#include "benchmark.h"
 
 using namespace Halide;
 
@@ -20,7 +20,6 @@ int main(int argc, char **argv) {
     dst.compile_jit();
 
     const int32_t buffer_size = 12345678;
-    const int iterations = 50;
 
     Image<uint8_t> input(buffer_size);
     Image<uint8_t> output(buffer_size);
@@ -30,23 +29,18 @@ int main(int argc, char **argv) {
     // Get past one-time set-up issues for the ptx backend.
     dst.realize(output);
 
-    double halide = 0, system = 0;
-    for (int i = 0; i < iterations; i++) {
-        double t1 = currentTime();
+    Benchmark b_halide("memcpy_halide");
+    while (b_halide.running()) {
         dst.realize(output);
-        dst.realize(output);
-        dst.realize(output);
-        double t2 = currentTime();
-        memcpy(output.data(), input.data(), input.width());
-        memcpy(output.data(), input.data(), input.width());
+    }
+    Benchmark b_system("memcpy_system");
+    while (b_system.running()) {
         memcpy(output.data(), input.data(), input.width());
-        double t3 = currentTime();
-        system += t3-t2;
-        halide += t2-t1;
     }
+    double halide = b_halide.median(), system = b_system.median();
 
-    printf("system memcpy: %.3e byte/s\n", (buffer_size / system) * 1000 * iterations);
-    printf("halide memcpy: %.3e byte/s\n", (buffer_size / halide) * 1000 * iterations);
+    printf("system memcpy: %.3e byte/s\n", (buffer_size / system) * 1000);
+    printf("halide memcpy: %.3e byte/s\n", (buffer_size / halide) * 1000);
 
     // memcpy will win by a little bit for large inputs because it uses streaming stores
     if (halide > system * 2) {
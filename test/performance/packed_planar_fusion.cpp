@@ -1,11 +1,11 @@
 #include <Halide.h>
 #include <stdio.h>
-#include "clock.h"
+#include "benchmark.h"
 #include <memory>
 
 using namespace Halide;
 
-double test_copy(Image<uint8_t> src, Image<uint8_t> dst) {
+double test_copy(const char *name, Image<uint8_t> src, Image<uint8_t> dst) {
     Var x, y, c;
     Func f;
     f(x, y, c) = src(x, y, c);
@@ -32,12 +32,11 @@ double test_copy(Image<uint8_t> src, Image<uint8_t> dst) {
 
 
 
-    double t1 = currentTime();
-    for (int i = 0; i < 10; i++) {
+    Benchmark b(std::string("packed_planar_fusion_") + name);
+    while (b.running()) {
         f.realize(dst);
     }
-    double t2 = currentTime();
-    return t2 - t1;
+    return b.median();
 }
 
 Image<uint8_t> make_packed(uint8_t *host, int W, int H) {
@@ -78,13 +77,13 @@ int main(int argc, char **argv) {
     while ((size_t)ptr_1 & 0x1f) ptr_1 ++;
     while ((size_t)ptr_2 & 0x1f) ptr_2 ++;
 
-    double t_packed_packed = test_copy(make_packed(ptr_1, W, H),
+    double t_packed_packed = test_copy("packed_packed", make_packed(ptr_1, W, H),
                                        make_packed(ptr_2, W, H));
-    double t_packed_planar = test_copy(make_packed(ptr_1, W, H),
+    double t_packed_planar = test_copy("packed_planar", make_packed(ptr_1, W, H),
                                        make_planar(ptr_2, W, H));
-    double t_planar_packed = test_copy(make_planar(ptr_1, W, H),
+    double t_planar_packed = test_copy("planar_packed", make_planar(ptr_1, W, H),
                                        make_packed(ptr_2, W, H));
-    double t_planar_planar = test_copy(make_planar(ptr_1, W, H),
+    double t_planar_planar = test_copy("planar_planar", make_planar(ptr_1, W, H),
                                        make_planar(ptr_2, W, H));
 
 
@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <Halide.h>
+#include "benchmark.h"
+
+using namespace Halide;
+
+// Time lots of parallel loops over tiny amounts of work, where the
+// cost of waking the thread pool dominates.
+double time_launches(const char *spin_count) {
+    // Each Func gets a fresh jit module, and hence a fresh thread
+    // pool that reads the environment when it starts.
+    setenv("HL_SPIN_COUNT", spin_count, 1);
+
+    Var x, y;
+    Func f;
+    f(x, y) = x + y;
+    f.parallel(y);
+
+    Image<int> im = f.realize(16, 8);
+
+    Benchmark b(std::string("parallel_launch_spin_") + spin_count);
+    while (b.running()) {
+        f.realize(im);
+    }
+
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 16; x++) {
+            if (im(x, y) != x + y) {
+                printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), x + y);
+                exit(-1);
+            }
+        }
+    }
+
+    return b.median();
+}
+
+int main(int argc, char **argv) {
+    double sleep_time = time_launches("0");
+    double spin_time = time_launches("20000");
+
+    printf("Times: %f %f\n", sleep_time, spin_time);
+
+    if (spin_time > sleep_time) {
+        fprintf(stderr, "WARNING: Spinning before sleeping should make launches cheaper\n");
+        return 0;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -1,6 +1,6 @@
 #include <stdio.h>
 #include <Halide.h>
-#include "clock.h"
+#include "benchmark.h"
 
 using namespace Halide;
 
@@ -20,21 +20,21 @@ int main(int argc, char **argv) {
 
     Image<float> imf = f.realize(W, H);
 
-    double t1, t2;
-
-    t1 = currentTime();
-    f.realize(imf);
-    t2 = currentTime();
-    double parallelTime = t2 - t1;
+    Benchmark b_parallel("parallel_performance_parallel");
+    while (b_parallel.running()) {
+        f.realize(imf);
+    }
+    double parallelTime = b_parallel.median();
 
     printf("Realizing g\n");
     Image<float> img = g.realize(W, H);
     printf("Done realizing g\n");
 
-    t1 = currentTime();
-    g.realize(img);
-    t2 = currentTime();
-    double serialTime = t2 - t1;
+    Benchmark b_serial("parallel_performance_serial");
+    while (b_serial.running()) {
+        g.realize(img);
+    }
+    double serialTime = b_serial.median();
 
     for (int y = 0; y < H; y++) {
         for (int x = 0; x < W; x++) {
@@ -49,6 +49,23 @@ int main(int argc, char **argv) {
     printf("Times: %f %f\n", serialTime, parallelTime);
     double speedup = serialTime / parallelTime;
     printf("Speedup: %f\n", speedup);
+    benchmark_record("parallel_performance_speedup", speedup);
+
+    // Measure the cost of each parallel task by giving it almost
+    // nothing to do.
+    const int tasks = 16384;
+    Func tiny;
+    tiny(x, y) = x + y;
+    tiny.parallel(y);
+    Image<int> imt = tiny.realize(1, tasks);
+
+    Benchmark b_tiny("parallel_performance_per_task");
+    while (b_tiny.running()) {
+        tiny.realize(imt);
+    }
+    double per_task = b_tiny.median() * 1e6 / tasks;
+    printf("Per-task overhead: %f ns\n", per_task);
+    benchmark_record("parallel_performance_per_task_ns", per_task);
 
     if (speedup < 1.5) {
         fprintf(stderr, "WARNING: Parallel should be faster\n");
@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <Halide.h>
+#include "benchmark.h"
+
+using namespace Halide;
+
+// Time a parallel loop over thousands of rows of almost no work each,
+// against the same loop run serially. The thread pool should coalesce
+// the iterations, so that handing them out doesn't cost more than the
+// work saved.
+double time_rows(bool parallel) {
+    Var x, y;
+    Func f;
+    f(x, y) = x * y;
+    if (parallel) f.parallel(y);
+
+    Image<int> im = f.realize(4, 10000);
+
+    Benchmark b(parallel ? "parallel_tiny_tasks" : "serial_tiny_tasks");
+    while (b.running()) {
+        f.realize(im);
+    }
+
+    for (int y = 0; y < 10000; y++) {
+        for (int x = 0; x < 4; x++) {
+            if (im(x, y) != x * y) {
+                printf("im(%d, %d) = %d instead of %d\n", x, y, im(x, y), x * y);
+                exit(-1);
+            }
+        }
+    }
+
+    return b.median();
+}
+
+int main(int argc, char **argv) {
+    double serial_time = time_rows(false);
+    double parallel_time = time_rows(true);
+
+    printf("Times: %f %f\n", serial_time, parallel_time);
+
+    if (parallel_time > serial_time * 4) {
+        fprintf(stderr, "WARNING: A parallel loop over tiny tasks was more "
+                "than 4x slower than the serial loop\n");
+        return 0;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -1,6 +1,6 @@
 #include <Halide.h>
 #include <stdio.h>
-#include "clock.h"
+#include "benchmark.h"
 #include <memory>
 
 using namespace Halide;
@@ -23,8 +23,6 @@ int main(int argc, char **argv) {
     dst.reorder(c, x, y).unroll(c);
     dst.vectorize(x, 16);
 
-    // Run test many times to avoid timing jitter
-    const int iterations = 20;
 
     // Allocate two 16 megapixel, 3 channel, 8-bit images -- input and output
     const int32_t buffer_side_length = (1 << 12);
@@ -77,14 +75,12 @@ int main(int argc, char **argv) {
     // Warm up caches, etc.
     dst.realize(dst_image);
 
-    double t1 = currentTime();
-
-    for (int i = 0; i < iterations; i++)
+    Benchmark b_planar("rgb_interleaved_to_planar");
+    while (b_planar.running()) {
         dst.realize(dst_image);
+    }
 
-    double t2 = currentTime();
-
-    printf("Interleaved to planar bandwidth %.3e byte/s.\n", (buffer_size / (t2 - t1)) * 1000 * iterations);
+    printf("Interleaved to planar bandwidth %.3e byte/s.\n", (buffer_size / b_planar.median()) * 1000);
 
     for (int32_t x = 0; x < buffer_side_length; x++) {
         for (int32_t y = 0; y < buffer_side_length; y++) {
@@ -107,12 +103,10 @@ int main(int argc, char **argv) {
 
     memset(dst_storage, 0, buffer_size);
 
-    double t3 = currentTime();
-
-    for (int i = 0; i < iterations; i++)
+    Benchmark b_semi_planar("rgb_interleaved_to_semi_planar");
+    while (b_semi_planar.running()) {
         dst.realize(dst_image);
-
-    double t4 = currentTime();
+    }
 
     for (int32_t x = 0; x < buffer_side_length; x++) {
         for (int32_t y = 0; y < buffer_side_length; y++) {
@@ -122,7 +116,62 @@ int main(int argc, char **argv) {
         }
     }
 
-    printf("Interleaved to semi-planar bandwidth %.3e byte/s.\n", (buffer_size / (t4 - t3)) * 1000 * iterations);
+    printf("Interleaved to semi-planar bandwidth %.3e byte/s.\n", (buffer_size / b_semi_planar.median()) * 1000);
+
+    // Now go the other way, from planar to interleaved. Each channel
+    // is computed separately, but the stores of the three channels
+    // get combined into one dense interleaved store.
+    ImageParam planar(UInt(8), 3);
+    Func interleaved;
+    interleaved(x, y, c) = planar(x, y, c);
+
+    planar.set_stride(0, 1);
+    interleaved.output_buffer().set_stride(0, 3);
+    interleaved.output_buffer().set_stride(2, 1);
+    interleaved.output_buffer().set_extent(2, 3);
+
+    interleaved.reorder(c, x, y).unroll(c);
+    interleaved.vectorize(x, 16);
+
+    // The planar image from the previous test is the input.
+    memset(&dst_buffer, 0, sizeof(dst_buffer));
+    dst_buffer.host = dst_storage;
+    dst_buffer.extent[0] = buffer_side_length;
+    dst_buffer.stride[0] = 1;
+    dst_buffer.extent[1] = buffer_side_length;
+    dst_buffer.stride[1] = dst_buffer.stride[0] * dst_buffer.extent[0];
+    dst_buffer.extent[2] = 3;
+    dst_buffer.stride[2] = dst_buffer.stride[1] * dst_buffer.extent[1];
+    dst_buffer.elem_size = 1;
+
+    Image<uint8_t> planar_image(&dst_buffer, "planar_image");
+    for (int32_t x = 0; x < buffer_side_length; x++) {
+        for (int32_t y = 0; y < buffer_side_length; y++) {
+            planar_image(x, y, 0) = 0;
+            planar_image(x, y, 1) = 128;
+            planar_image(x, y, 2) = 255;
+        }
+    }
+    planar.set(planar_image);
+
+    memset(src_storage, 0, buffer_size * 3);
+    interleaved.compile_jit();
+    interleaved.realize(src_image);
+
+    Benchmark b_interleaved("rgb_planar_to_interleaved");
+    while (b_interleaved.running()) {
+        interleaved.realize(src_image);
+    }
+
+    for (int32_t x = 0; x < buffer_side_length; x++) {
+        for (int32_t y = 0; y < buffer_side_length; y++) {
+            assert(src_image(x, y, 0) == 0);
+            assert(src_image(x, y, 1) == 128);
+            assert(src_image(x, y, 2) == 255);
+        }
+    }
+
+    printf("Planar to interleaved bandwidth %.3e byte/s.\n", (buffer_size / b_interleaved.median()) * 1000);
 
     delete[] src_storage;
     delete[] dst_storage;
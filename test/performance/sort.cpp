@@ -1,7 +1,7 @@
 #include <Halide.h>
 #include <stdio.h>
 #include <algorithm>
-#include "clock.h"
+#include "benchmark.h"
 
 using namespace Halide;
 
@@ -156,11 +156,10 @@ int main(int argc, char **argv) {
     printf("Running...\n");
     Image<int> bitonic_sorted(N);
     f.realize(bitonic_sorted);
-    double t1 = currentTime();
-    for (int i = 0; i < 10; i++) {
+    Benchmark b_bitonic("sort_bitonic");
+    while (b_bitonic.running()) {
         f.realize(bitonic_sorted);
     }
-    double t2 = currentTime();
 
     printf("Merge sort...\n");
     f = merge_sort(input, N);
@@ -169,26 +168,26 @@ int main(int argc, char **argv) {
     printf("Running...\n");
     Image<int> merge_sorted(N);
     f.realize(merge_sorted);
-    double t3 = currentTime();
-    for (int i = 0; i < 10; i++) {
+    Benchmark b_merge("sort_merge");
+    while (b_merge.running()) {
         f.realize(merge_sorted);
     }
-    double t4 = currentTime();
 
     Image<int> correct(N);
     for (int i = 0; i < N; i++) {
         correct(i) = data(i);
     }
     printf("std::sort...\n");
-    double t5 = currentTime();
+    // This sorts in place, so it can only be timed once.
+    double t1 = benchmark_now_ms();
     std::sort(&correct(0), &correct(N));
-    double t6 = currentTime();
+    double t2 = benchmark_now_ms();
 
     printf("Times:\n"
            "bitonic sort: %f \n"
            "merge sort: %f \n"
            "std::sort %f\n",
-           (t2-t1)/10, (t4-t3)/10, t6-t5);
+           b_bitonic.median(), b_merge.median(), t2-t1);
 
     if (N <= 100) {
         for (int i = 0; i < N; i++) {
@@ -1,6 +1,6 @@
 #include <stdio.h>
 #include <Halide.h>
-#include "clock.h"
+#include "benchmark.h"
 
 using namespace Halide;
 
@@ -52,17 +52,17 @@ bool test(int vec_width) {
     Image<A> outputg = g.realize(W, H);
     Image<A> outputf = f.realize(W, H);
 
-    double t1 = currentTime();
-    for (int i = 0; i < 10; i++) {
+    char name[64];
+    snprintf(name, sizeof(name), "vectorize_%s_x%d", string_of_type<A>(), vec_width);
+    Benchmark b_scalar(std::string(name) + "_scalar");
+    while (b_scalar.running()) {
         g.realize(outputg);
     }
-    double t2 = currentTime();
-    for (int i = 0; i < 10; i++) {
+    Benchmark b_vector(std::string(name) + "_vector");
+    while (b_vector.running()) {
         f.realize(outputf);
     }
-    double t3 = currentTime();
-
-    printf("%g %g %g\n", t1, t2, t3);
+    double t_scalar = b_scalar.median(), t_vector = b_vector.median();
 
     for (int y = 0; y < H; y++) {
         for (int x = 0; x < W; x++) {
@@ -78,9 +78,9 @@ bool test(int vec_width) {
     }
 
     printf("Vectorized vs scalar (%s x %d): %1.3gms %1.3gms. Speedup = %1.3f\n",
-           string_of_type<A>(), vec_width, (t3-t2), (t2-t1), (t2-t1)/(t3-t2));
+           string_of_type<A>(), vec_width, t_vector, t_scalar, t_scalar/t_vector);
 
-    if ((t3 - t2) > (t2 - t1)) {
+    if (t_vector > t_scalar) {
         return false;
     }
 
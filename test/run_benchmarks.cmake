@@ -0,0 +1,19 @@
+# Runs each of the comma-separated BENCHMARKS with HL_BENCH_JSON set
+# to OUTPUT, so that their timings end up in the one file. Invoked by
+# the benchmarks target.
+
+file(REMOVE "${OUTPUT}")
+set(ENV{HL_BENCH_JSON} "${OUTPUT}")
+string(REPLACE "," ";" BENCHMARKS "${BENCHMARKS}")
+set(FAILED "")
+foreach(benchmark ${BENCHMARKS})
+  message(STATUS "Running ${benchmark}")
+  execute_process(COMMAND "${benchmark}" RESULT_VARIABLE result)
+  if (NOT result EQUAL 0)
+    list(APPEND FAILED ${benchmark})
+  endif()
+endforeach()
+if (FAILED)
+  message(FATAL_ERROR "Failed: ${FAILED}")
+endif()
+message(STATUS "Wrote ${OUTPUT}")
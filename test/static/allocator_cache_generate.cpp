@@ -0,0 +1,18 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    // An intermediate allocated afresh for every row of the output.
+    Func g, f;
+    g(x, y) = x + y;
+    f(x, y) = g(x, y) + g(x+1, y);
+    g.compute_at(f, y);
+    f.parallel(y);
+
+    f.compile_to_file("allocator_cache");
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include <allocator_cache.h>
+#include <../../include/HalideRuntime.h>
+#include <static_image.h>
+#include <stdio.h>
+
+bool check(Image<int> &out) {
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            int correct = 2*(x + y) + 1;
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Image<int> out(1000, 256);
+
+    halide_use_allocator_cache(1, 0);
+
+    for (int i = 0; i < 3; i++) {
+        allocator_cache(out);
+        if (!check(out)) return -1;
+    }
+
+    halide_allocator_cache_stats stats;
+    halide_get_allocator_cache_stats(&stats);
+    printf("%llu allocations, %llu from the cache, %llu bytes cached\n",
+           (unsigned long long)stats.allocations,
+           (unsigned long long)stats.hits,
+           (unsigned long long)stats.cached_bytes);
+    if (stats.allocations < 256*3) {
+        printf("Expected at least one allocation per row\n");
+        return -1;
+    }
+    if (stats.hits == 0 || stats.cached_bytes == 0) {
+        printf("Expected freed buffers to be reused\n");
+        return -1;
+    }
+
+    halide_release_allocator_cache();
+    halide_get_allocator_cache_stats(&stats);
+    if (stats.cached_bytes != 0) {
+        printf("Releasing the cache left %llu bytes behind\n",
+               (unsigned long long)stats.cached_bytes);
+        return -1;
+    }
+
+    // Blocks allocated after turning the cache off go straight back
+    // to malloc.
+    halide_use_allocator_cache(0, 0);
+    allocator_cache(out);
+    if (!check(out)) return -1;
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,34 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    ImageParam input(Float(32), 2);
+    Param<float> scale;
+    Var x, y;
+
+    // Several pipelines that share a stage, compiled together.
+    Func clamped;
+    clamped(x, y) = input(clamp(x, 0, input.width()-1), clamp(y, 0, input.height()-1));
+
+    Func blur_x, blur_y, scaled;
+    blur_x(x, y) = (clamped(x-1, y) + clamped(x, y) + clamped(x+1, y)) / 3;
+    blur_y(x, y) = (clamped(x, y-1) + clamped(x, y) + clamped(x, y+1)) / 3;
+    scaled(x, y) = clamped(x, y) * scale;
+    blur_x.vectorize(x, 4).parallel(y);
+    blur_y.vectorize(x, 4).parallel(y);
+
+    std::vector<Argument> args;
+    args.push_back(input);
+    std::vector<Argument> scaled_args = args;
+    scaled_args.push_back(scale);
+
+    std::vector<BatchCompileJob> jobs;
+    jobs.push_back(BatchCompileJob(blur_x, args, "batch_compile"));
+    jobs.push_back(BatchCompileJob(blur_y, args, "batch_compile_blur_y"));
+    jobs.push_back(BatchCompileJob(scaled, scaled_args, "batch_compile_scaled"));
+    compile_batch_to_file(jobs, 3);
+
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include <batch_compile.h>
+#include <batch_compile_blur_y.h>
+#include <batch_compile_scaled.h>
+#include <../../include/HalideRuntime.h>
+#include <static_image.h>
+#include <stdio.h>
+#include <math.h>
+
+float in_val(int x, int y) {
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x > 63) x = 63;
+    if (y > 63) y = 63;
+    return (float)(x * 3 + y * 5);
+}
+
+int main(int argc, char **argv) {
+    Image<float> input(64, 64);
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            input(x, y) = in_val(x, y);
+        }
+    }
+
+    Image<float> bx(64, 64), by(64, 64), sc(64, 64);
+    batch_compile(input, bx);
+    batch_compile_blur_y(input, by);
+    batch_compile_scaled(input, 2.0f, sc);
+
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            float cx = (in_val(x-1, y) + in_val(x, y) + in_val(x+1, y)) / 3;
+            float cy = (in_val(x, y-1) + in_val(x, y) + in_val(x, y+1)) / 3;
+            float cs = in_val(x, y) * 2.0f;
+            if (fabs(bx(x, y) - cx) > 0.001f ||
+                fabs(by(x, y) - cy) > 0.001f ||
+                sc(x, y) != cs) {
+                printf("Mismatch at %d, %d: %f %f %f instead of %f %f %f\n",
+                       x, y, bx(x, y), by(x, y), sc(x, y), cx, cy, cs);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,25 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    ImageParam input(Float(32), 2);
+    Param<float> scale;
+    scale.set_range(0.0f, 10.0f);
+    Var x, y;
+
+    Func f;
+    f(x, y) = input(x + 1, y) * scale;
+    f.vectorize(x, 4);
+
+    std::vector<Argument> args;
+    args.push_back(input);
+    args.push_back(scale);
+    f.compile_to_file_check_once("check_once", args);
+
+    // The usual version on its own, to check the results against.
+    f.compile_to_file("check_once_reference", args);
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <check_once.h>
+#include <check_once_reference.h>
+#include <../../include/HalideRuntime.h>
+#include <static_image.h>
+#include <stdio.h>
+
+static int errors = 0;
+
+extern "C" void halide_error(void *context, const char *msg) {
+    errors++;
+}
+
+bool matches(Image<float> out, Image<float> input, float scale) {
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            if (out(x, y) != input(x + 1, y) * scale) {
+                printf("out(%d, %d) = %f instead of %f\n", x, y, out(x, y), input(x + 1, y) * scale);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Image<float> input(33, 16);
+    for (int y = 0; y < input.height(); y++) {
+        for (int x = 0; x < input.width(); x++) {
+            input(x, y) = (float)(x * 3 + y * 5);
+        }
+    }
+
+    Image<float> out(32, 16), ref(32, 16);
+    check_once_checked handle;
+    if (check_once_check(&handle, input, 2.0f, out) != 0 || !handle.valid) {
+        printf("check_once_check failed\n");
+        return -1;
+    }
+    check_once_reference(input, 2.0f, ref);
+    if (!matches(out, input, 2.0f) || !matches(ref, input, 2.0f)) return -1;
+
+    // The same shapes, so this runs the unchecked version.
+    for (int i = 0; i < 10; i++) {
+        Image<float> again(32, 16);
+        if (check_once_call_checked(&handle, input, 2.0f, again) != 0 || !matches(again, input, 2.0f)) {
+            printf("check_once_call_checked failed\n");
+            return -1;
+        }
+    }
+
+    // A scale out of range and an input that's too small both differ
+    // from the call that was checked, so they get checked, and fail.
+    if (check_once_call_checked(&handle, input, 20.0f, out) == 0 || errors != 1) {
+        printf("An out of range scale wasn't caught\n");
+        return -1;
+    }
+    Image<float> small(32, 16);
+    if (check_once_call_checked(&handle, small, 2.0f, out) == 0 || errors != 2) {
+        printf("A small input wasn't caught\n");
+        return -1;
+    }
+
+    // A batch of frames, run in parallel.
+    const int frames = 8;
+    Image<float> inputs[frames], outputs[frames];
+    buffer_t *input_bufs[frames], *output_bufs[frames];
+    for (int i = 0; i < frames; i++) {
+        inputs[i] = Image<float>(33, 16);
+        outputs[i] = Image<float>(32, 16);
+        for (int y = 0; y < 16; y++) {
+            for (int x = 0; x < 33; x++) {
+                inputs[i](x, y) = (float)(x + y * i);
+            }
+        }
+        input_bufs[i] = inputs[i];
+        output_bufs[i] = outputs[i];
+    }
+    if (check_once_batch(frames, input_bufs, 3.0f, output_bufs) != 0) {
+        printf("check_once_batch failed\n");
+        return -1;
+    }
+    for (int i = 0; i < frames; i++) {
+        if (!matches(outputs[i], inputs[i], 3.0f)) {
+            printf("Frame %d of the batch is wrong\n", i);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    ImageParam input(Float(32), 2);
+    Var x, y;
+
+    Func f;
+    f(x, y) = sqrt(input(x, y) * 2.0f + 1.0f) * input(x, y);
+    f.vectorize(x, 8).parallel(y);
+
+    std::vector<Argument> args;
+    args.push_back(input);
+
+    // Versions from avx2 down to no extensions at all.
+    Target base = get_target_from_environment();
+    base.features &= ~(uint64_t)(Target::SSE41 | Target::AVX | Target::AVX2 |
+                                 Target::FMA | Target::F16C | Target::AVX512);
+    Target sse41 = base, avx = base, avx2 = base;
+    sse41.features |= Target::SSE41;
+    avx.features |= Target::SSE41 | Target::AVX;
+    avx2.features |= Target::SSE41 | Target::AVX | Target::AVX2 | Target::FMA;
+
+    std::vector<Target> targets;
+    targets.push_back(avx2);
+    targets.push_back(avx);
+    targets.push_back(sse41);
+    targets.push_back(base);
+    f.compile_to_file("multi_target", args, targets);
+
+    // The baseline on its own, to check the results against.
+    f.compile_to_file("multi_target_reference", args, base);
+
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include <multi_target.h>
+#include <multi_target_reference.h>
+#include <../../include/HalideRuntime.h>
+#include <static_image.h>
+#include <stdio.h>
+#include <math.h>
+
+int main(int argc, char **argv) {
+    Image<float> input(100, 30);
+    for (int y = 0; y < input.height(); y++) {
+        for (int x = 0; x < input.width(); x++) {
+            input(x, y) = (float)(x * 3 + y * 5);
+        }
+    }
+
+    printf("CPU features: %llx\n", (unsigned long long)halide_get_cpu_features());
+
+    Image<float> out(100, 30), ref(100, 30);
+    // Twice, to use the remembered features.
+    for (int i = 0; i < 2; i++) {
+        if (multi_target(input, out) != 0) {
+            printf("multi_target failed\n");
+            return -1;
+        }
+    }
+    multi_target_reference(input, ref);
+
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            if (fabs(out(x, y) - ref(x, y)) > 0.001f * fabs(ref(x, y))) {
+                printf("out(%d, %d) = %f instead of %f\n", x, y, out(x, y), ref(x, y));
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
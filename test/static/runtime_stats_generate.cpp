@@ -0,0 +1,19 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    Func f("f"), g("telemetry");
+    f(x, y) = x * y;
+    g(x, y) = f(x, y) + f(x + 1, y);
+    f.compute_root().parallel(y);
+    g.parallel(y);
+
+    Target target = get_target_from_environment();
+    target.features |= Target::Telemetry;
+    g.compile_to_file("runtime_stats", target);
+    return 0;
+}
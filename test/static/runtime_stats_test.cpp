@@ -0,0 +1,55 @@
+#include <runtime_stats.h>
+#include <../../include/HalideRuntime.h>
+#include <static_image.h>
+#include <stdio.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+    const int runs = 10;
+    Image<int> out(256, 256);
+
+    halide_reset_runtime_stats();
+    for (int i = 0; i < runs; i++) {
+        runtime_stats(out);
+        for (int y = 0; y < out.height(); y++) {
+            for (int x = 0; x < out.width(); x++) {
+                int correct = x * y + (x + 1) * y;
+                if (out(x, y) != correct) {
+                    printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    static halide_runtime_stats stats;
+    halide_get_runtime_stats(&stats);
+    if (stats.num_pipelines != 1) {
+        printf("%d pipelines recorded instead of 1\n", stats.num_pipelines);
+        return -1;
+    }
+
+    const halide_pipeline_stats &p = stats.pipelines[0];
+    if (p.name == NULL || strcmp(p.name, "telemetry") != 0) {
+        printf("Pipeline recorded as %s instead of telemetry\n", p.name ? p.name : "NULL");
+        return -1;
+    }
+    if (p.latency_ns.count != (uint64_t)runs) {
+        printf("%llu calls recorded instead of %d\n",
+               (unsigned long long)p.latency_ns.count, runs);
+        return -1;
+    }
+
+    uint64_t p50 = halide_histogram_percentile(&p.latency_ns, 50);
+    uint64_t p99 = halide_histogram_percentile(&p.latency_ns, 99);
+    printf("p50 %llu ns, p99 %llu ns, max %llu ns\n",
+           (unsigned long long)p50, (unsigned long long)p99,
+           (unsigned long long)p.latency_ns.max);
+    if (p50 > p99 || p99 > p.latency_ns.max) {
+        printf("Percentiles out of order\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
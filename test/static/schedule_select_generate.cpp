@@ -0,0 +1,33 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    ImageParam input(Float(32), 2, "input");
+    Var x("x"), y("y");
+
+    Func blur_x("blur_x"), blur_y("blur_y");
+    blur_x(x, y) = input(x, y) + input(x + 1, y) + input(x + 2, y);
+    blur_y(x, y) = blur_x(x, y) + blur_x(x, y + 1) + blur_x(x, y + 2);
+
+    std::vector<Argument> args;
+    args.push_back(input);
+
+    // Three schedules that need the same region of the input.
+    std::vector<std::string> schedules;
+    schedules.push_back(schedule_to_string(blur_y));
+    blur_x.compute_root();
+    schedules.push_back(schedule_to_string(blur_y));
+    blur_x.compute_at(blur_y, y);
+    blur_y.parallel(y);
+    schedules.push_back(schedule_to_string(blur_y));
+
+    blur_y.compile_to_file_with_schedules("schedule_select", args, schedules);
+
+    // The first schedule on its own, to check the results against.
+    schedule_from_string(blur_y, schedules[0]);
+    blur_y.compile_to_file("schedule_select_reference", args);
+
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include <schedule_select.h>
+#include <schedule_select_reference.h>
+#include <../../include/HalideRuntime.h>
+#include <static_image.h>
+#include <stdio.h>
+
+bool run(int width, int height) {
+    Image<float> input(width + 2, height + 2);
+    for (int y = 0; y < input.height(); y++) {
+        for (int x = 0; x < input.width(); x++) {
+            input(x, y) = (float)(x * 3 + y * 5);
+        }
+    }
+    Image<float> out(width, height), ref(width, height);
+    if (schedule_select(input, out) != 0) {
+        printf("schedule_select failed\n");
+        return false;
+    }
+    schedule_select_reference(input, ref);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (out(x, y) != ref(x, y)) {
+                printf("out(%d, %d) = %f instead of %f\n", x, y, out(x, y), ref(x, y));
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    // Enough calls to time each schedule at two sizes, and explore.
+    for (int i = 0; i < 40; i++) {
+        if (!run(64, 48) || !run(7, 300)) return -1;
+    }
+
+    // 64x48 is in bucket 6 | 5 << 5.
+    int chosen = halide_schedule_selected(NULL, "schedule_select", 3, 6 | (5 << 5));
+    if (chosen < 0 || chosen > 2) {
+        printf("No schedule was chosen for 64x48 (%d)\n", chosen);
+        return -1;
+    }
+    printf("Chose schedule %d for 64x48\n", chosen);
+
+    printf("Success!\n");
+    return 0;
+}
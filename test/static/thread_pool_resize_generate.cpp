@@ -0,0 +1,15 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Var x, y;
+
+    Func f;
+    f(x, y) = x * y + 3;
+    f.parallel(y);
+
+    f.compile_to_file("thread_pool_resize");
+    return 0;
+}
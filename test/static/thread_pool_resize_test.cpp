@@ -0,0 +1,40 @@
+#include <thread_pool_resize.h>
+#include <../../include/HalideRuntime.h>
+#include <static_image.h>
+#include <stdio.h>
+#include <assert.h>
+
+bool check(Image<int> &out) {
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            if (out(x, y) != x * y + 3) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), x * y + 3);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Image<int> out(64, 512);
+
+    // Grow and shrink the pool between invocations, including past
+    // the old limit of 64 threads.
+    int sizes[] = {3, 200, 1, 8, 0};
+    for (int i = 0; i < 5; i++) {
+        halide_set_num_threads(sizes[i]);
+        thread_pool_resize(out);
+        if (!check(out)) return -1;
+    }
+
+    halide_shutdown_thread_pool();
+
+    // Setting the size before the pool exists should also work.
+    halide_set_num_threads(4);
+    thread_pool_resize(out);
+    if (!check(out)) return -1;
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,28 @@
+#include <Halide.h>
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    ImageParam input(Float(32), 2);
+    ImageParam workspace(UInt(8), 1, "workspace");
+    Var x, y;
+
+    // Two intermediates whose sizes depend on the output, so they'd
+    // go on the heap.
+    Func g, h, f;
+    g(x, y) = input(x, y) * 2.0f;
+    h(x, y) = g(x, y) + g(x + 1, y);
+    f(x, y) = h(x, y) + h(x, y + 1);
+    g.compute_root();
+    h.compute_root();
+
+    f.use_workspace(workspace);
+
+    std::vector<Argument> args;
+    args.push_back(input);
+    args.push_back(workspace);
+    f.compile_to_file("workspace", args);
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <workspace.h>
+#include <../../include/HalideRuntime.h>
+#include <static_image.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int mallocs = 0;
+static int errors = 0;
+
+extern "C" void *halide_malloc(void *context, size_t sz) {
+    mallocs++;
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, 32, sz)) return NULL;
+    return ptr;
+}
+
+extern "C" void halide_free(void *context, void *ptr) {
+    free(ptr);
+}
+
+extern "C" void halide_error(void *context, const char *msg) {
+    errors++;
+}
+
+float expected(Image<float> input, int x, int y) {
+    float h0 = input(x, y) * 2.0f + input(x + 1, y) * 2.0f;
+    float h1 = input(x, y + 1) * 2.0f + input(x + 1, y + 1) * 2.0f;
+    return h0 + h1;
+}
+
+int main(int argc, char **argv) {
+    Image<float> input(65, 33);
+    for (int y = 0; y < input.height(); y++) {
+        for (int x = 0; x < input.width(); x++) {
+            input(x, y) = (float)(x * 3 + y * 5);
+        }
+    }
+
+    Image<float> out(64, 32);
+
+    // Ask how big the workspace has to be.
+    buffer_t ws;
+    memset(&ws, 0, sizeof(ws));
+    ws.elem_size = 1;
+    if (workspace(input, &ws, out) != 0 || ws.extent[0] <= 0) {
+        printf("The workspace size query failed\n");
+        return -1;
+    }
+    // g and h each need at least this much.
+    if (ws.extent[0] < 2 * 64 * 32 * 4) {
+        printf("The workspace is too small: %d bytes\n", ws.extent[0]);
+        return -1;
+    }
+    if (posix_memalign((void **)&ws.host, 32, ws.extent[0])) return -1;
+
+    for (int i = 0; i < 5; i++) {
+        if (workspace(input, &ws, out) != 0) {
+            printf("Running with the workspace failed\n");
+            return -1;
+        }
+        for (int y = 0; y < out.height(); y++) {
+            for (int x = 0; x < out.width(); x++) {
+                if (out(x, y) != expected(input, x, y)) {
+                    printf("out(%d, %d) = %f instead of %f\n", x, y, out(x, y), expected(input, x, y));
+                    return -1;
+                }
+            }
+        }
+    }
+
+    if (mallocs != 0) {
+        printf("The pipeline called halide_malloc %d times\n", mallocs);
+        return -1;
+    }
+
+    // A workspace that's too small is an error.
+    ws.extent[0] /= 2;
+    if (workspace(input, &ws, out) == 0 || errors != 1) {
+        printf("A small workspace wasn't caught\n");
+        return -1;
+    }
+
+    free(ws.host);
+    printf("Success!\n");
+    return 0;
+}
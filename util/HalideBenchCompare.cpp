@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Compares two files of results from apps/support/benchmark.h (one
+// JSON object per line, as written to HL_BENCH_JSON), and fails if
+// any benchmark got slower by more than the threshold.
+
+namespace {
+
+  // Find the value of a field in one of the flat JSON objects that
+  // benchmark.h writes. Strings are returned without their quotes.
+  bool GetField(const std::string& line, const std::string& field, std::string* value) {
+    std::string key = "\"" + field + "\":";
+    size_t pos = line.find(key);
+    if (pos == std::string::npos) {
+      return false;
+    }
+    pos += key.size();
+    value->clear();
+    if (pos < line.size() && line[pos] == '"') {
+      for (pos++; pos < line.size() && line[pos] != '"'; pos++) {
+        if (line[pos] == '\\' && pos + 1 < line.size()) {
+          pos++;
+        }
+        *value += line[pos];
+      }
+    } else {
+      size_t end = line.find_first_of(",}", pos);
+      *value = line.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+    }
+    return true;
+  }
+
+  // Read the given metric for each benchmark, keyed by name and
+  // target. A benchmark that appears more than once gets its best
+  // result.
+  bool Load(const std::string& path, const std::string& metric,
+            std::map<std::string, double>* results) {
+    std::ifstream f(path.c_str());
+    if (!f) {
+      std::cerr << "Could not open " << path << "\n";
+      return false;
+    }
+    std::string line;
+    while (std::getline(f, line)) {
+      std::string name, target, value;
+      if (!GetField(line, "name", &name) || !GetField(line, metric, &value)) {
+        continue;
+      }
+      if (GetField(line, "target", &target)) {
+        name += " [" + target + "]";
+      }
+      double v = atof(value.c_str());
+      std::map<std::string, double>::iterator it = results->find(name);
+      if (it == results->end()) {
+        (*results)[name] = v;
+      } else {
+        it->second = std::min(it->second, v);
+      }
+    }
+    return true;
+  }
+
+  bool HasOpt(char** begin, char** end, const std::string& opt) {
+    return std::find(begin, end, opt) != end;
+  }
+
+  // look for string "opt"; if found, return subsequent string;
+  // if not found, return empty string.
+  std::string GetOpt(char** begin, char** end, const std::string& opt) {
+    char** it = std::find(begin, end, opt);
+    if (it != end && ++it != end) {
+        return std::string(*it);
+    }
+    return std::string();
+  }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+
+  if (HasOpt(argv, argv + argc, "-h")) {
+    printf("HalideBenchCompare [-threshold fraction] [-metric median_ms] baseline.json current.json\n");
+    return 0;
+  }
+
+  double threshold = 0.05;
+  std::string threshold_str = GetOpt(argv, argv + argc, "-threshold");
+  if (!threshold_str.empty()) {
+    std::istringstream(threshold_str) >> threshold;
+  }
+
+  std::string metric = GetOpt(argv, argv + argc, "-metric");
+  if (metric.empty()) {
+    metric = "median_ms";
+  }
+
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-threshold" || arg == "-metric") {
+      i++;
+    } else {
+      files.push_back(arg);
+    }
+  }
+  if (files.size() != 2) {
+    printf("HalideBenchCompare [-threshold fraction] [-metric median_ms] baseline.json current.json\n");
+    return 1;
+  }
+
+  std::map<std::string, double> baseline, current;
+  if (!Load(files[0], metric, &baseline) || !Load(files[1], metric, &current)) {
+    return 1;
+  }
+
+  int slower = 0, faster = 0, missing = 0, added = 0;
+  printf("%-48s %12s %12s %8s\n", "benchmark", "baseline", "current", "change");
+  for (std::map<std::string, double>::iterator it = current.begin(); it != current.end(); ++it) {
+    std::map<std::string, double>::iterator base = baseline.find(it->first);
+    if (base == baseline.end()) {
+      printf("%-48s %12s %12.4g %8s  new\n", it->first.c_str(), "-", it->second, "");
+      added++;
+      continue;
+    }
+    double change = base->second > 0 ? it->second / base->second - 1 : 0;
+    const char *flag = "";
+    if (change > threshold) {
+      flag = "  SLOWER";
+      slower++;
+    } else if (change < -threshold) {
+      flag = "  faster";
+      faster++;
+    }
+    printf("%-48s %12.4g %12.4g %+7.1f%%%s\n", it->first.c_str(),
+           base->second, it->second, change * 100, flag);
+  }
+  for (std::map<std::string, double>::iterator it = baseline.begin(); it != baseline.end(); ++it) {
+    if (current.find(it->first) == current.end()) {
+      printf("%-48s %12.4g %12s %8s  missing\n", it->first.c_str(), it->second, "-", "");
+      missing++;
+    }
+  }
+
+  printf("\n%d slower, %d faster, %d new, %d missing (threshold %.1f%% on %s)\n",
+         slower, faster, added, missing, threshold * 100, metric.c_str());
+  return slower ? 1 : 0;
+}
@@ -33,6 +33,50 @@ namespace {
     int64_t ticks_only;
     double nsec_only;
     double percent_only;
+    // Only reported for gpu kernels and copies: bytes copied, the
+    // launch config of the last launch, and its occupancy (in
+    // percent, or -1 if unknown)
+    int64_t bytes;
+    int64_t blocks;
+    int64_t threads;
+    int64_t shmem;
+    int64_t occupancy;
+    // Only reported for $total$ by the sampling profiler: the number
+    // of samples taken, and the sum over them of the number of busy
+    // threads
+    int64_t samples;
+    int64_t busy_thread_samples;
+    // Only reported by the sampling profiler: the allocations of the
+    // buffers of a Func (or for $total$, the peak of the pipeline)
+    int64_t heap_allocs;
+    int64_t heap_bytes;
+    int64_t heap_peak;
+    int64_t stack_allocs;
+    int64_t stack_peak;
+    // Only reported for the parallel loops on the timeline: the sums
+    // over runs of the time spent in tasks, of the busy time of the
+    // busiest thread, of the mean busy time of the threads, and of the
+    // number of threads that ran tasks
+    int64_t busy;
+    int64_t max_busy;
+    int64_t mean_busy;
+    int64_t loop_threads;
+    // Only reported by the sampling profiler with HL_PROFILE_COUNTERS:
+    // the hardware counts of the threads while computing a Func
+    int64_t cycles;
+    int64_t instructions;
+    int64_t llc_misses;
+    // Only in the static estimate written by compile_to_lowered_stmt:
+    // the points stored, the ops, the bytes loaded and stored, the
+    // vector lanes used and available, and the size of the buffer of
+    // the Func if it is a constant (or -1)
+    int64_t static_points;
+    int64_t static_ops;
+    int64_t static_load_bytes;
+    int64_t static_store_bytes;
+    int64_t static_lanes_used;
+    int64_t static_lanes_available;
+    int64_t static_footprint;
 
     OpInfo()
       : count(0),
@@ -41,7 +85,33 @@ namespace {
         percent(0.0),
         ticks_only(0),
         nsec_only(0.0),
-        percent_only(0.0) {}
+        percent_only(0.0),
+        bytes(0),
+        blocks(0),
+        threads(0),
+        shmem(0),
+        occupancy(-1),
+        samples(0),
+        busy_thread_samples(0),
+        heap_allocs(0),
+        heap_bytes(0),
+        heap_peak(0),
+        stack_allocs(0),
+        stack_peak(0),
+        busy(0),
+        max_busy(0),
+        mean_busy(0),
+        loop_threads(0),
+        cycles(0),
+        instructions(0),
+        llc_misses(0),
+        static_points(0),
+        static_ops(0),
+        static_load_bytes(0),
+        static_store_bytes(0),
+        static_lanes_used(0),
+        static_lanes_available(0),
+        static_footprint(-1) {}
   };
 
   // Outer map is keyed by function name,
@@ -122,6 +192,58 @@ namespace {
       op_info.ticks = value;
     } else if (metric == "nsec") {
       op_info.nsec = value;
+    } else if (metric == "bytes") {
+      op_info.bytes = value;
+    } else if (metric == "blocks") {
+      op_info.blocks = value;
+    } else if (metric == "threads") {
+      op_info.threads = value;
+    } else if (metric == "shmem") {
+      op_info.shmem = value;
+    } else if (metric == "occupancy") {
+      op_info.occupancy = value;
+    } else if (metric == "samples") {
+      op_info.samples = value;
+    } else if (metric == "busy_thread_samples") {
+      op_info.busy_thread_samples = value;
+    } else if (metric == "heap_allocs") {
+      op_info.heap_allocs = value;
+    } else if (metric == "heap_bytes") {
+      op_info.heap_bytes = value;
+    } else if (metric == "heap_peak") {
+      op_info.heap_peak = value;
+    } else if (metric == "stack_allocs") {
+      op_info.stack_allocs = value;
+    } else if (metric == "stack_peak") {
+      op_info.stack_peak = value;
+    } else if (metric == "busy") {
+      op_info.busy = value;
+    } else if (metric == "max_busy") {
+      op_info.max_busy = value;
+    } else if (metric == "mean_busy") {
+      op_info.mean_busy = value;
+    } else if (metric == "loop_threads") {
+      op_info.loop_threads = value;
+    } else if (metric == "cycles") {
+      op_info.cycles = value;
+    } else if (metric == "instructions") {
+      op_info.instructions = value;
+    } else if (metric == "llc_misses") {
+      op_info.llc_misses = value;
+    } else if (metric == "static_points") {
+      op_info.static_points = value;
+    } else if (metric == "static_ops") {
+      op_info.static_ops = value;
+    } else if (metric == "static_load_bytes") {
+      op_info.static_load_bytes = value;
+    } else if (metric == "static_store_bytes") {
+      op_info.static_store_bytes = value;
+    } else if (metric == "static_lanes_used") {
+      op_info.static_lanes_used = value;
+    } else if (metric == "static_lanes_available") {
+      op_info.static_lanes_available = value;
+    } else if (metric == "static_footprint") {
+      op_info.static_footprint = value;
     }
   }
 
@@ -148,7 +270,9 @@ namespace {
     total.count = 1;
     total.percent = 1.0;
 
-    double ticks_per_nsec = (double)total.ticks / (double)total.nsec;
+    // A static cost estimate on its own has no times.
+    double ticks_per_nsec = total.nsec > 0 ? (double)total.ticks / (double)total.nsec : 1.0;
+    double total_ticks = total.ticks > 0 ? (double)total.ticks : 1.0;
 
     // Note that overhead (if present) is measured outside the rest
     // of the "total", so it should not be included (or subtracted from)
@@ -189,8 +313,8 @@ namespace {
       OpInfo& op_info = o->second;
       op_info.nsec = op_info.ticks / ticks_per_nsec;
       op_info.nsec_only = op_info.ticks_only / ticks_per_nsec;
-      op_info.percent = (double)op_info.ticks / (double)total.ticks;
-      op_info.percent_only = (double)op_info.ticks_only / (double)total.ticks;
+      op_info.percent = (double)op_info.ticks / total_ticks;
+      op_info.percent_only = (double)op_info.ticks_only / total_ticks;
     }
   }
 
@@ -208,13 +332,14 @@ namespace {
   bool by_count(const OpInfo& a, const OpInfo& b) { return a.count < b.count; }
   bool by_ticks(const OpInfo& a, const OpInfo& b) { return a.ticks < b.ticks; }
   bool by_ticks_only(const OpInfo& a, const OpInfo& b) { return a.ticks_only < b.ticks_only; }
+  bool by_heap_peak(const OpInfo& a, const OpInfo& b) { return a.heap_peak < b.heap_peak; }
 
 }  // namespace
 
 int main(int argc, char** argv) {
 
   if (HasOpt(argv, argv + argc, "-h")) {
-    printf("HalideProf [-f funcname] [-sort c|t|to] [-top N] [-overhead=0|1] < profiledata\n");
+    printf("HalideProf [-f funcname] [-sort c|t|to] [-top N] [-overhead=0|1] [-balance ops_per_byte] < profiledata\n");
     return 0;
   }
 
@@ -248,6 +373,15 @@ int main(int argc, char** argv) {
     std::istringstream(adjust_for_overhead_str) >> adjust_for_overhead;
   }
 
+  // The ops per byte of memory traffic at which the machine is as
+  // fast at arithmetic as at moving data. Steps that do fewer ops per
+  // byte than this are bandwidth-bound.
+  double balance = 4.0;
+  std::string balance_str = GetOpt(argv, argv + argc, "-balance");
+  if (!balance_str.empty()) {
+    std::istringstream(balance_str) >> balance;
+  }
+
   FuncInfoMap func_info_map;
   std::string line;
   while (std::getline(std::cin, line)) {
@@ -265,6 +399,15 @@ int main(int argc, char** argv) {
     }
     std::cout << "Func: " << func_name << "\n";
     std::cout << "--------------------------\n";
+    const OpInfo& total = f->second[qualified_name(kToplevel, kToplevel)];
+    if (total.samples > 0) {
+      std::cout << "Average busy threads: " << std::setprecision(2) << std::fixed
+                << (double)total.busy_thread_samples / (double)total.samples
+                << " (" << total.samples << " samples)\n";
+    }
+    if (total.heap_peak > 0) {
+      std::cout << "Peak heap memory: " << total.heap_peak << " bytes\n";
+    }
     std::cout
       << std::setw(10) << std::left << "op_type"
       << std::setw(40) << std::left << "op_name"
@@ -277,6 +420,7 @@ int main(int argc, char** argv) {
       << std::setw(8) << std::fixed << "%-only"
       << "\n";
     std::vector<OpInfo> op_info = SortOpInfo(f->second, sort_by_func);
+    int32_t remaining = top_n;
     for (std::vector<OpInfo>::const_iterator o = op_info.begin(); o != op_info.end(); ++o) {
       const OpInfo& op_info = *o;
       std::cout
@@ -290,7 +434,236 @@ int main(int argc, char** argv) {
         << std::setw(12) << std::setprecision(2) << std::fixed << (op_info.nsec_only / 1000000.0)
         << std::setw(8) << std::setprecision(2) << std::fixed << (op_info.percent_only * 100.0)
         << "\n";
-      if (--top_n <= 0) {
+      if (--remaining <= 0) {
+        break;
+      }
+    }
+
+    // The sampling profiler also reports the allocations of each Func.
+    std::vector<OpInfo> by_peak = SortOpInfo(f->second, by_heap_peak);
+    bool has_memory_info = false;
+    for (std::vector<OpInfo>::const_iterator o = by_peak.begin(); o != by_peak.end(); ++o) {
+      has_memory_info = has_memory_info || o->heap_allocs || o->stack_allocs;
+    }
+    if (has_memory_info) {
+      std::cout << "\n"
+        << std::setw(10) << std::left << "op_type"
+        << std::setw(40) << std::left << "op_name"
+        << std::setw(14) << std::right << "heap-allocs"
+        << std::setw(16) << "heap-bytes"
+        << std::setw(16) << "heap-peak"
+        << std::setw(14) << "stack-allocs"
+        << std::setw(12) << "stack-peak"
+        << "\n";
+      remaining = top_n;
+      for (std::vector<OpInfo>::const_iterator o = by_peak.begin(); o != by_peak.end(); ++o) {
+        const OpInfo& op_info = *o;
+        if (op_info.op_type == kToplevel || (!op_info.heap_allocs && !op_info.stack_allocs)) {
+          continue;
+        }
+        std::cout
+          << std::setw(10) << std::left << op_info.op_type
+          << std::setw(40) << std::left << op_info.op_name
+          << std::setw(14) << std::right << op_info.heap_allocs
+          << std::setw(16) << op_info.heap_bytes
+          << std::setw(16) << op_info.heap_peak
+          << std::setw(14) << op_info.stack_allocs
+          << std::setw(12) << op_info.stack_peak
+          << "\n";
+        if (--remaining <= 0) {
+          break;
+        }
+      }
+    }
+
+    // The static estimate from compile_to_lowered_stmt gives the work
+    // done per point by each step, and so its arithmetic intensity.
+    bool has_static_info = false;
+    for (std::vector<OpInfo>::const_iterator o = op_info.begin(); o != op_info.end(); ++o) {
+      has_static_info = has_static_info || o->static_points;
+    }
+    if (has_static_info) {
+      std::cout << "\n"
+        << std::setw(10) << std::left << "op_type"
+        << std::setw(40) << std::left << "op_name"
+        << std::setw(10) << std::right << "ops/pt"
+        << std::setw(12) << "load-B/pt"
+        << std::setw(12) << "store-B/pt"
+        << std::setw(10) << "ops/B"
+        << std::setw(10) << "vector%"
+        << std::setw(14) << "footprint"
+        << std::setw(12) << "msec-only"
+        << std::setw(12) << "bound"
+        << "\n";
+      remaining = top_n;
+      for (std::vector<OpInfo>::const_iterator o = op_info.begin(); o != op_info.end(); ++o) {
+        const OpInfo& op_info = *o;
+        if (!op_info.static_points) {
+          continue;
+        }
+        double points = op_info.static_points;
+        int64_t bytes = op_info.static_load_bytes + op_info.static_store_bytes;
+        double intensity = bytes ? (double)op_info.static_ops / bytes : 0.0;
+        std::cout
+          << std::setw(10) << std::left << op_info.op_type
+          << std::setw(40) << std::left << op_info.op_name
+          << std::setw(10) << std::right << std::setprecision(2) << std::fixed
+          << op_info.static_ops / points
+          << std::setw(12) << op_info.static_load_bytes / points
+          << std::setw(12) << op_info.static_store_bytes / points
+          << std::setw(10) << intensity
+          << std::setw(10)
+          << (op_info.static_lanes_available ?
+              100.0 * op_info.static_lanes_used / op_info.static_lanes_available : 0.0);
+        if (op_info.static_footprint >= 0) {
+          std::cout << std::setw(14) << op_info.static_footprint;
+        } else {
+          std::cout << std::setw(14) << "-";
+        }
+        if (op_info.ticks > 0) {
+          std::cout << std::setw(12) << (op_info.nsec_only / 1000000.0);
+        } else {
+          std::cout << std::setw(12) << "-";
+        }
+        std::cout
+          << std::setw(12) << (bytes && intensity < balance ? "bandwidth" : "compute")
+          << "\n";
+        if (--remaining <= 0) {
+          break;
+        }
+      }
+    }
+
+    // With HL_PROFILE_COUNTERS, the sampling profiler also reports
+    // the hardware counters of each Func. Each last level cache miss
+    // is taken to read one 64 byte line from DRAM.
+    bool has_counter_info = false;
+    for (std::vector<OpInfo>::const_iterator o = op_info.begin(); o != op_info.end(); ++o) {
+      has_counter_info = has_counter_info || o->cycles;
+    }
+    if (has_counter_info) {
+      const double kCacheLineBytes = 64;
+      std::cout << "\n"
+        << std::setw(10) << std::left << "op_type"
+        << std::setw(40) << std::left << "op_name"
+        << std::setw(16) << std::right << "cycles"
+        << std::setw(16) << "instructions"
+        << std::setw(8) << "IPC"
+        << std::setw(14) << "llc-misses"
+        << std::setw(12) << "MPKI"
+        << std::setw(12) << "dram-MB"
+        << std::setw(10) << "GB/s"
+        << "\n";
+      remaining = top_n;
+      for (std::vector<OpInfo>::const_iterator o = op_info.begin(); o != op_info.end(); ++o) {
+        const OpInfo& op_info = *o;
+        if (!op_info.cycles) {
+          continue;
+        }
+        double dram_bytes = op_info.llc_misses * kCacheLineBytes;
+        std::cout
+          << std::setw(10) << std::left << op_info.op_type
+          << std::setw(40) << std::left << op_info.op_name
+          << std::setw(16) << std::right << op_info.cycles
+          << std::setw(16) << op_info.instructions
+          << std::setw(8) << std::setprecision(2) << std::fixed
+          << (double)op_info.instructions / op_info.cycles
+          << std::setw(14) << op_info.llc_misses
+          << std::setw(12)
+          << (op_info.instructions ? 1000.0 * op_info.llc_misses / op_info.instructions : 0.0)
+          << std::setw(12) << dram_bytes / 1000000.0
+          << std::setw(10) << (op_info.nsec > 0 ? dram_bytes / op_info.nsec : 0.0)
+          << "\n";
+        if (--remaining <= 0) {
+          break;
+        }
+      }
+    }
+
+    // The timeline reports how evenly the tasks of each parallel
+    // loop were spread over the threads: the utilization of the
+    // threads that took part while the loop ran, and how much longer
+    // the busiest thread worked than the average one.
+    bool has_loop_info = false;
+    for (std::vector<OpInfo>::const_iterator o = op_info.begin(); o != op_info.end(); ++o) {
+      has_loop_info = has_loop_info || o->busy;
+    }
+    if (has_loop_info) {
+      std::cout << "\n"
+        << std::setw(10) << std::left << "op_type"
+        << std::setw(40) << std::left << "op_name"
+        << std::setw(10) << std::right << "runs"
+        << std::setw(12) << "msec-wall"
+        << std::setw(12) << "msec-busy"
+        << std::setw(10) << "threads"
+        << std::setw(10) << "util%"
+        << std::setw(12) << "imbalance"
+        << "\n";
+      remaining = top_n;
+      for (std::vector<OpInfo>::const_iterator o = op_info.begin(); o != op_info.end(); ++o) {
+        const OpInfo& op_info = *o;
+        if (op_info.op_type == kToplevel || !op_info.busy) {
+          continue;
+        }
+        double threads = op_info.count ? (double)op_info.loop_threads / op_info.count : 0.0;
+        double capacity = op_info.ticks * threads;
+        std::cout
+          << std::setw(10) << std::left << op_info.op_type
+          << std::setw(40) << std::left << op_info.op_name
+          << std::setw(10) << std::right << op_info.count
+          << std::setw(12) << std::setprecision(2) << std::fixed << (op_info.ticks / 1000000.0)
+          << std::setw(12) << (op_info.busy / 1000000.0)
+          << std::setw(10) << threads
+          << std::setw(10) << (capacity > 0 ? 100.0 * op_info.busy / capacity : 0.0)
+          << std::setw(12) << (op_info.mean_busy > 0 ? (double)op_info.max_busy / op_info.mean_busy : 0.0)
+          << "\n";
+        if (--remaining <= 0) {
+          break;
+        }
+      }
+    }
+
+    // The gpu runtimes also report what the kernels and copies moved
+    // and how the kernels were launched.
+    bool has_gpu_info = false;
+    for (std::vector<OpInfo>::const_iterator o = op_info.begin(); o != op_info.end(); ++o) {
+      has_gpu_info = has_gpu_info || o->bytes || o->threads;
+    }
+    if (!has_gpu_info) {
+      continue;
+    }
+    std::cout << "\n"
+      << std::setw(10) << std::left << "op_type"
+      << std::setw(40) << std::left << "op_name"
+      << std::setw(16) << std::right << "bytes"
+      << std::setw(10) << "GB/s"
+      << std::setw(12) << "blocks"
+      << std::setw(10) << "threads"
+      << std::setw(10) << "shmem"
+      << std::setw(12) << "occupancy%"
+      << "\n";
+    remaining = top_n;
+    for (std::vector<OpInfo>::const_iterator o = op_info.begin(); o != op_info.end(); ++o) {
+      const OpInfo& op_info = *o;
+      if (op_info.op_type == kToplevel) {
+        continue;
+      }
+      std::cout
+        << std::setw(10) << std::left << op_info.op_type
+        << std::setw(40) << std::left << op_info.op_name
+        << std::setw(16) << std::right << op_info.bytes
+        << std::setw(10) << std::setprecision(2) << std::fixed
+        << (op_info.nsec > 0 ? op_info.bytes / op_info.nsec : 0.0)
+        << std::setw(12) << op_info.blocks
+        << std::setw(10) << op_info.threads
+        << std::setw(10) << op_info.shmem;
+      if (op_info.occupancy >= 0) {
+        std::cout << std::setw(12) << op_info.occupancy;
+      } else {
+        std::cout << std::setw(12) << "-";
+      }
+      std::cout << "\n";
+      if (--remaining <= 0) {
         break;
       }
     }
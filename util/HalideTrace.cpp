@@ -2,13 +2,17 @@
 #include <stdint.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
 #include <iostream>
 #include <unistd.h>
 
 using std::map;
+using std::set;
 using std::vector;
 
 typedef uint32_t Id;
@@ -33,18 +37,170 @@ struct Packet {
         return value_bytes() + int_args_bytes();
     }
 
-    // Grab a packet from stdin. Returns false when stdin closes.
-    bool read_from_stdin() {
-        if (!read_stdin(this, 32)) {
-            return false;
+    // A name of the full 17 characters isn't terminated, because the
+    // payload writes over the last byte of the header.
+    std::string func() const {
+        return std::string(name, strnlen(name, sizeof(name)));
+    }
+
+    const int *int_args() const {
+        return (const int *)(payload + value_bytes());
+    }
+
+    // The coordinates of one lane of a vector packet. They are stored
+    // one dimension at a time.
+    vector<int> coordinates(int lane) const {
+        vector<int> c;
+        for (int i = lane; i < num_int_args; i += width) {
+            c.push_back(int_args()[i]);
         }
-        assert(read_stdin(payload, payload_bytes()) &&
-               "Unexpected EOF mid-packet");
+        return c;
+    }
+};
+
+// Reads packets from stdin, in either the raw format, or the blocks of
+// delta-encoded packets written with HL_TRACE_COMPRESS=1 (see
+// src/runtime/tracing.cpp). A trace can mix the two. Blocks with none
+// of the wanted Funcs are skipped without being decoded.
+class TraceReader {
+public:
+    TraceReader(const set<std::string> &f) : funcs(f), block_packets(0), pos(0) {}
+
+    // Grab a packet. Returns false when stdin closes.
+    bool next(Packet &p) {
+        while (block_packets == 0) {
+            uint8_t magic[4];
+            if (!read_stdin(magic, 4)) {
+                return false;
+            }
+            if (memcmp(magic, "HLTB", 4)) {
+                // A raw packet.
+                memcpy(&p, magic, 4);
+                read_or_die((uint8_t *)&p + 4, 28);
+                read_or_die(p.payload, p.payload_bytes());
+                return true;
+            }
+            read_block();
+        }
+        decode(p);
+        block_packets--;
         return true;
     }
 
 private:
-    bool read_stdin(void *d, ssize_t size) {
+    const set<std::string> &funcs;
+
+    // The block being decoded, the names of its Funcs, and the last
+    // packet of each of them.
+    vector<uint8_t> block;
+    vector<std::string> names;
+    vector<Packet> last;
+    vector<bool> has_last;
+    uint32_t block_packets;
+    size_t pos;
+
+    void read_block() {
+        uint8_t header[12];
+        read_or_die(header, 12);
+        uint32_t data_bytes = get_uint32(header);
+        uint32_t num_packets = get_uint32(header + 4);
+        uint32_t num_funcs = get_uint32(header + 8);
+
+        bool wanted = funcs.empty();
+        names.resize(num_funcs);
+        for (uint32_t i = 0; i < num_funcs; i++) {
+            uint8_t len;
+            char name[256];
+            uint8_t count[4];
+            read_or_die(&len, 1);
+            read_or_die(name, len);
+            read_or_die(count, 4);
+            names[i] = std::string(name, len);
+            wanted = wanted || funcs.count(names[i]);
+        }
+
+        block.resize(data_bytes);
+        read_or_die(data_bytes ? &block[0] : NULL, data_bytes);
+        if (wanted) {
+            block_packets = num_packets;
+            pos = 0;
+            last.resize(num_funcs);
+            has_last.assign(num_funcs, false);
+        }
+    }
+
+    static uint32_t get_uint32(const uint8_t *p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    uint64_t get_varint() {
+        uint64_t v = 0;
+        for (int shift = 0; ; shift += 7) {
+            assert(pos < block.size() && "Corrupt trace block");
+            uint8_t b = block[pos++];
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+    }
+
+    int64_t get_zigzag() {
+        uint64_t v = get_varint();
+        return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+    }
+
+    // Undo the encoding of halide_trace_encode_packet.
+    void decode(Packet &p) {
+        uint64_t f = get_varint();
+        assert(f < names.size() && "Corrupt trace block");
+        Packet &prev = last[f];
+
+        p.id = (Id)((has_last[f] ? prev.id : 0) + get_zigzag());
+        p.parent = (Id)((has_last[f] ? prev.parent : 0) + get_zigzag());
+        assert(pos + 6 <= block.size() && "Corrupt trace block");
+        p.event = block[pos++];
+        p.type = block[pos++];
+        p.bits = block[pos++];
+        p.width = block[pos++];
+        p.value_idx = block[pos++];
+        p.num_int_args = block[pos++];
+        memset(p.name, 0, sizeof(p.name));
+        strncpy(p.name, names[f].c_str(), sizeof(p.name));
+
+        bool same_shape = has_last[f] && prev.type == p.type && prev.bits == p.bits &&
+            prev.width == p.width && prev.num_int_args == p.num_int_args;
+        size_t bytes = p.value_bytes() / (p.width ? p.width : 1);
+
+        int *coords = (int *)(p.payload + p.value_bytes());
+        const int *prev_coords = prev.int_args();
+        for (int i = 0; i < p.num_int_args; i++) {
+            coords[i] = (int)((same_shape ? prev_coords[i] : 0) + get_zigzag());
+        }
+
+        for (int i = 0; i < p.width; i++) {
+            uint64_t r = 0;
+            if (same_shape) {
+                for (size_t b = 0; b < bytes; b++) {
+                    r |= (uint64_t)prev.payload[i * bytes + b] << (b * 8);
+                }
+            }
+            uint64_t v = p.type == 2 ? (r ^ get_varint()) : (r + (uint64_t)get_zigzag());
+            for (size_t b = 0; b < bytes; b++) {
+                p.payload[i * bytes + b] = (uint8_t)(v >> (b * 8));
+            }
+        }
+
+        memcpy(&prev, &p, offsetof(Packet, payload) + p.payload_bytes());
+        has_last[f] = true;
+    }
+
+    static void read_or_die(void *d, ssize_t size) {
+        if (!read_stdin(d, size)) {
+            fprintf(stderr, "Unexpected EOF mid-packet\n");
+            exit(-1);
+        }
+    }
+
+    static bool read_stdin(void *d, ssize_t size) {
         uint8_t *dst = (uint8_t *)d;
         if (!size) return true;
         while (1) {
@@ -90,6 +246,7 @@ public:
     }
 
     bool operator<(const Point &other) const {
+        if (p.size() != other.p.size()) return p.size() < other.p.size();
         for (size_t i = 0; i < p.size(); i++) {
             if (p[i] < other[i]) return true;
             if (p[i] > other[i]) return false;
@@ -196,6 +353,14 @@ struct Production {
 };
 
 
+// Look up the parent of a packet. The trace may not have it, if the
+// runtime was asked to drop some events (see HL_TRACE_EVENTS).
+template<typename T>
+T *find_parent(const map<Id, T *> &m, const Packet &p) {
+    typename map<Id, T *>::const_iterator iter = m.find(p.parent);
+    return iter == m.end() ? NULL : iter->second;
+}
+
 struct Realization {
     map<Id, Production *> productions;
 
@@ -208,15 +373,13 @@ struct Realization {
     map<Point, PointState> state_map;
 
     void load(Count clock, const Packet &p) {
-        Production *prod = productions[p.parent];
-        assert(prod && "Load without a parent");
-        prod->load(clock, p);
+        Production *prod = find_parent(productions, p);
+        if (prod) prod->load(clock, p);
     }
 
     void store(Count clock, const Packet &p) {
-        Production *prod = productions[p.parent];
-        assert(prod && "Store without a parent");
-        prod->store(clock, p);
+        Production *prod = find_parent(productions, p);
+        if (prod) prod->store(clock, p);
     }
 
     void produce(Count clock, const Packet &p) {
@@ -226,20 +389,17 @@ struct Realization {
     }
 
     void update(Count clock, const Packet &p) {
-        Production *prod = productions[p.parent];
-        assert(prod && "Update without a parent");
-        prod->state = Production::Updating;
+        Production *prod = find_parent(productions, p);
+        if (prod) prod->state = Production::Updating;
     }
 
     void consume(Count clock, const Packet &p) {
-        Production *prod = productions[p.parent];
-        assert(prod && "Consume without a parent");
-        prod->state = Production::Consuming;
+        Production *prod = find_parent(productions, p);
+        if (prod) prod->state = Production::Consuming;
     }
 
     void end_consume(Count clock, const Packet &p) {
-        Production *prod = productions[p.parent];
-        assert(prod && "Consume without a parent");
+        Production *prod = find_parent(productions, p);
         // Retrieve stats
         delete prod;
         productions.erase(p.parent);
@@ -247,51 +407,86 @@ struct Realization {
 
 };
 
+// What to aggregate besides the counts of loads and stores.
+struct Options {
+    set<std::string> funcs;
+    bool histogram;
+    int tile_width, tile_height;
+
+    Options() : histogram(false), tile_width(0), tile_height(0) {}
+
+    bool count_points() const {
+        return histogram || tile_width > 0;
+    }
+};
 
 struct FuncStats {
     map<Id, Realization *> realizations;
 
     Count loads, stores;
 
-    FuncStats() {}
+    // From the summary events of Funcs marked trace_summary: the
+    // number of realizations, the points stored and the points in the
+    // realized boxes, and the bytes loaded from each input.
+    int64_t summaries, summary_stored, summary_box;
+    map<std::string, int64_t> summary_bytes;
 
-    void load(Count clock, const Packet &p) {
-        Realization *r = realizations[p.parent];
-        assert(r && "Load without a parent");
-        r->load(clock, p);
+    // The number of loads and stores of each point, if asked for.
+    map<Point, size_t> point_loads, point_stores;
+
+    FuncStats() : summaries(0), summary_stored(0), summary_box(0) {}
+
+    void summary(const Packet &p) {
+        const int64_t *v = (const int64_t *)p.payload;
+        summaries++;
+        summary_stored += v[0];
+        summary_box += v[1];
+    }
+
+    void summary_load(const std::string &source, const Packet &p) {
+        summary_bytes[source] += ((const int64_t *)p.payload)[0];
+    }
+
+    void count_points(map<Point, size_t> &m, const Packet &p) {
+        for (int i = 0; i < p.width; i++) {
+            m[Point(p.coordinates(i))]++;
+        }
+    }
+
+    void load(Count clock, const Packet &p, const Options &opts) {
+        Realization *r = find_parent(realizations, p);
+        if (r) r->load(clock, p);
         loads++;
+        if (opts.count_points()) count_points(point_loads, p);
     }
 
-    void store(Count clock, const Packet &p) {
-        Realization *r = realizations[p.parent];
-        assert(r && "Store without a parent");
-        r->store(clock, p);
+    void store(Count clock, const Packet &p, const Options &opts) {
+        Realization *r = find_parent(realizations, p);
+        if (r) r->store(clock, p);
         stores++;
+        if (opts.count_points()) count_points(point_stores, p);
     }
 
     void produce(Count clock, const Packet &p) {
-        Realization *r = realizations[p.parent];
-        assert(r && "Produce without a parent");
+        Realization *r = find_parent(realizations, p);
+        if (!r) return;
         realizations[p.id] = r;
         r->produce(clock, p);
     }
 
     void update(Count clock, const Packet &p) {
-        Realization *r = realizations[p.parent];
-        assert(r && "Update without a parent");
-        r->update(clock, p);
+        Realization *r = find_parent(realizations, p);
+        if (r) r->update(clock, p);
     }
 
     void consume(Count clock, const Packet &p) {
-        Realization *r = realizations[p.parent];
-        assert(r && "Consume without a parent");
-        r->consume(clock, p);
+        Realization *r = find_parent(realizations, p);
+        if (r) r->consume(clock, p);
     }
 
     void end_consume(Count clock, const Packet &p) {
-        Realization *r = realizations[p.parent];
-        assert(r && "Update without a parent");
-        r->end_consume(clock, p);
+        Realization *r = find_parent(realizations, p);
+        if (r) r->end_consume(clock, p);
         realizations.erase(p.parent);
     }
 
@@ -301,44 +496,167 @@ struct FuncStats {
     }
 
     void end_realize(Count clock, const Packet &p) {
-        Realization *r = realizations[p.parent];
+        Realization *r = find_parent(realizations, p);
         // Aggregate stats
         delete r;
         realizations.erase(p.parent);
     }
 
-    void report() const {
+    // How many points were accessed once, twice, 3-4 times, 5-8
+    // times, and so on.
+    static void report_histogram(const char *what, const map<Point, size_t> &m) {
+        if (m.empty()) return;
+        vector<size_t> buckets;
+        for (map<Point, size_t>::const_iterator iter = m.begin(); iter != m.end(); ++iter) {
+            size_t b = 0;
+            while (((size_t)1 << b) < iter->second) b++;
+            if (buckets.size() <= b) buckets.resize(b + 1, 0);
+            buckets[b]++;
+        }
+        std::cout << " " << what << " per point (" << m.size() << " points):\n";
+        for (size_t b = 0; b < buckets.size(); b++) {
+            if (!buckets[b]) continue;
+            size_t lo = b == 0 ? 1 : ((size_t)1 << (b - 1)) + 1;
+            size_t hi = (size_t)1 << b;
+            std::cout << "  " << lo;
+            if (hi > lo) std::cout << "-" << hi;
+            std::cout << ": " << buckets[b] << '\n';
+        }
+    }
+
+    static int tile_of(int x, int size) {
+        // Round down, for negative coordinates too.
+        return x >= 0 ? x / size : -((-x + size - 1) / size);
+    }
+
+    // The number of distinct points accessed in each tile of the first
+    // two dimensions, and how many accesses there were.
+    void report_tiles(const Options &opts) const {
+        map<std::pair<int, int>, std::pair<size_t, size_t> > tiles;
+        const map<Point, size_t> *maps[] = {&point_loads, &point_stores};
+        set<Point> seen;
+        for (int i = 0; i < 2; i++) {
+            for (map<Point, size_t>::const_iterator iter = maps[i]->begin();
+                 iter != maps[i]->end(); ++iter) {
+                const Point &pt = iter->first;
+                int tx = pt.dimensions() > 0 ? tile_of(pt[0], opts.tile_width) : 0;
+                int ty = pt.dimensions() > 1 ? tile_of(pt[1], opts.tile_height) : 0;
+                std::pair<size_t, size_t> &t = tiles[std::make_pair(tx, ty)];
+                if (seen.insert(pt).second) t.first++;
+                t.second += iter->second;
+            }
+        }
+        if (tiles.empty()) return;
+        std::cout << " footprint per " << opts.tile_width << "x" << opts.tile_height << " tile:\n";
+        for (map<std::pair<int, int>, std::pair<size_t, size_t> >::const_iterator iter = tiles.begin();
+             iter != tiles.end(); ++iter) {
+            std::cout << "  (" << iter->first.first << ", " << iter->first.second << "): "
+                      << iter->second.first << " points, "
+                      << iter->second.second << " accesses\n";
+        }
+    }
+
+    void report(const Options &opts) const {
         std::cout << " stores:" << stores.value() << '\n';
         std::cout << " loads:" << loads.value() << '\n';
+        if (summaries) {
+            std::cout << " realizations:" << summaries << '\n';
+            std::cout << " points stored:" << summary_stored
+                      << " of " << summary_box << " realized";
+            if (summary_box) {
+                std::cout << " (" << (double)summary_stored / summary_box << "x)";
+            }
+            std::cout << '\n';
+            for (map<std::string, int64_t>::const_iterator iter = summary_bytes.begin();
+                 iter != summary_bytes.end(); ++iter) {
+                std::cout << " bytes loaded from " << iter->first << ":" << iter->second << '\n';
+            }
+        }
+        if (opts.histogram) {
+            report_histogram("loads", point_loads);
+            report_histogram("stores", point_stores);
+        }
+        if (opts.tile_width > 0) {
+            report_tiles(opts);
+        }
     }
 };
 
-
+void usage() {
+    fprintf(stderr,
+            "Usage: HalideTrace [-f func1,func2,...] [-histogram] [-tile WxH] < trace\n"
+            "  -f          only report on these Funcs\n"
+            "  -histogram  how many times each point of a Func is loaded and stored\n"
+            "  -tile WxH   distinct points accessed per tile of each Func\n");
+    exit(-1);
+}
 
 int main(int argc, char **argv) {
     assert(sizeof(Packet) == 4096);
 
+    Options opts;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-f" && i + 1 < argc) {
+            std::string list = argv[++i];
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t end = list.find(',', start);
+                if (end == std::string::npos) end = list.size();
+                if (end > start) opts.funcs.insert(list.substr(start, end - start));
+                start = end + 1;
+            }
+        } else if (arg == "-histogram") {
+            opts.histogram = true;
+        } else if (arg == "-tile" && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &opts.tile_width, &opts.tile_height) != 2 ||
+                opts.tile_width <= 0 || opts.tile_height <= 0) {
+                usage();
+            }
+        } else {
+            usage();
+        }
+    }
+
     map<std::string, FuncStats> funcs;
 
+    // The Func of each summary event, by id, for the summary_load
+    // events that follow it.
+    map<Id, std::string> summary_funcs;
+
     Count clock;
 
-    while (1) {
-        Packet p;
-        if (!p.read_from_stdin()) {
-            break;
-        }
+    TraceReader reader(opts.funcs);
+    Packet p;
+    while (reader.next(p)) {
 
         //printf("Packet header: %u %u %d %d %d %d %d %d %s\n", p.id, p.parent, p.event, p.type, p.bits, p.width, p.value_idx, p.num_int_args, p.name);
 
-        FuncStats &f = funcs[p.name];
+        std::string name = p.func();
+        if (p.event == 9) {
+            // Summary loads are named for the input, and belong to
+            // the Func of their parent.
+            map<Id, std::string>::iterator iter = summary_funcs.find(p.parent);
+            if (iter == summary_funcs.end()) continue;
+            if (!opts.funcs.empty() && !opts.funcs.count(iter->second)) {
+                continue;
+            }
+            funcs[iter->second].summary_load(name, p);
+            continue;
+        }
+        if (!opts.funcs.empty() && !opts.funcs.count(name)) {
+            continue;
+        }
+
+        FuncStats &f = funcs[name];
 
         switch (p.event) {
         case 0:
-            f.load(clock, p);
+            f.load(clock, p, opts);
             clock += p.value_bytes();
             break;
         case 1:
-            f.store(clock, p);
+            f.store(clock, p, opts);
             clock += p.value_bytes();
             break;
         case 2: // begin realization
@@ -359,6 +677,10 @@ int main(int argc, char **argv) {
         case 7: // end consume
             f.end_consume(clock, p);
             break;
+        case 8: // summary
+            f.summary(p);
+            summary_funcs[p.id] = name;
+            break;
         default:
             exit(-1);
         }
@@ -367,7 +689,7 @@ int main(int argc, char **argv) {
     for (map<std::string, FuncStats>::iterator iter = funcs.begin();
          iter != funcs.end(); ++iter) {
         std::cout << "Function " << iter->first << ":\n";
-        iter->second.report();
+        iter->second.report(opts);
     }
 
     return 0;